@@ -0,0 +1,587 @@
+/*
+ * binder_bench: binder IPC microbenchmark
+ *
+ * Talks to /dev/binder directly, without libbinder, so the numbers are
+ * those of the driver and not of the framework above it. One forked
+ * process becomes the context manager and serves handle 0 from a pool
+ * of looper threads, the other process calls it:
+ *
+ *   sync     ping-pong, transaction and reply
+ *   oneway   TF_ONE_WAY transaction, until BR_TRANSACTION_COMPLETE
+ *   size     sync ping-pong with growing parcels, with throughput
+ *   threads  many caller threads against the looper pool
+ *   fd       sync ping-pong carrying one BINDER_TYPE_FD
+ *   object   sync ping-pong carrying one BINDER_TYPE_BINDER
+ *
+ * Each test prints one line of key=value pairs with the p50 and p99
+ * call latency, so before/after runs can be compared with a script.
+ *
+ * Only one context manager can exist, and only the uid which first
+ * registered one may do it again. On a device stop the framework and
+ * servicemanager first and run as the system uid:
+ *
+ *   adb shell stop; adb shell stop servicemanager
+ *   adb shell /data/binder_bench -u 1000
+ *
+ * Build it for the device with something like
+ *
+ *   arm-eabi-gcc -static -O2 -Idrivers/staging/android \
+ *	-o binder_bench Documentation/android/binder_bench.c -lpthread -lrt
+ *
+ * Copyright (C) 2010 HTC Corporation.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "binder.h"
+
+#define BINDER_VM_SIZE		((1 * 1024 * 1024) - (4096 * 2))
+#define BENCH_MAX_THREADS	32
+#define BENCH_MAX_SIZE		(64 * 1024)
+
+enum {
+	BENCH_PING = 1,
+	BENCH_EXIT,
+};
+
+struct bench_out {
+	uint8_t buf[256];
+	size_t len;
+};
+
+/* one per calling thread, all share the process' binder fd */
+struct bench_conn {
+	int fd;
+	struct bench_out out;
+	const void *reply_buf;	/* released along with the next call */
+};
+
+struct bench_args {
+	struct bench_conn conn;
+	uint32_t *lat;
+	int iters;
+	size_t size;
+	int own_thread;
+	int err;
+};
+
+static int iterations = 10000;
+static int max_threads = 8;
+static const char *binder_dev = "/dev/binder";
+static uint8_t payload[BENCH_MAX_SIZE];
+static const int32_t reply_status;
+
+static void usage(void)
+{
+	fprintf(stderr, "binder_bench [-i iterations] [-t max_threads] "
+		"[-u uid] [-d device]\n");
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int binder_open(void)
+{
+	struct binder_version vers;
+	void *map;
+	int fd;
+
+	fd = open(binder_dev, O_RDWR);
+	if (fd < 0) {
+		perror(binder_dev);
+		return -1;
+	}
+	if (ioctl(fd, BINDER_VERSION, &vers) < 0 ||
+	    vers.protocol_version != BINDER_CURRENT_PROTOCOL_VERSION) {
+		fprintf(stderr, "binder_bench: protocol version mismatch\n");
+		close(fd);
+		return -1;
+	}
+	map = mmap(NULL, BINDER_VM_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void out_cmd(struct bench_out *o, uint32_t cmd, const void *arg,
+		    size_t size)
+{
+	if (o->len + sizeof(cmd) + size > sizeof(o->buf)) {
+		fprintf(stderr, "binder_bench: command buffer overflow\n");
+		exit(1);
+	}
+	memcpy(o->buf + o->len, &cmd, sizeof(cmd));
+	memcpy(o->buf + o->len + sizeof(cmd), arg, size);
+	o->len += sizeof(cmd) + size;
+}
+
+/* write what is queued in o, read into in; returns bytes read */
+static int binder_write_read(int fd, struct bench_out *o, uint32_t *in,
+			     size_t in_size)
+{
+	struct binder_write_read bwr;
+	int ret;
+
+	bwr.write_size = o->len;
+	bwr.write_consumed = 0;
+	bwr.write_buffer = (unsigned long)o->buf;
+	bwr.read_size = in_size;
+	bwr.read_consumed = 0;
+	bwr.read_buffer = (unsigned long)in;
+	do {
+		ret = ioctl(fd, BINDER_WRITE_READ, &bwr);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+		return -errno;
+	if (bwr.write_consumed != bwr.write_size)
+		return -EPROTO;
+	o->len = 0;
+	return bwr.read_consumed;
+}
+
+/*
+ * Send one transaction to handle 0 and wait for the reply, or only for
+ * BR_TRANSACTION_COMPLETE if it is oneway. Returns 0, -ENOSPC when the
+ * target ran out of async buffer space, or another negative error.
+ */
+static int bench_transact(struct bench_conn *c, uint32_t code,
+			  const void *data, size_t size,
+			  const size_t *offsets, size_t offsets_size,
+			  unsigned int flags)
+{
+	struct binder_transaction_data txn;
+	struct binder_ptr_cookie pc;
+	uint32_t in[64];
+	uint8_t *p, *end;
+	uint32_t cmd;
+	int done = 0;
+	int ret;
+
+	if (c->reply_buf) {
+		out_cmd(&c->out, BC_FREE_BUFFER, &c->reply_buf, sizeof(void *));
+		c->reply_buf = NULL;
+	}
+
+	memset(&txn, 0, sizeof(txn));
+	txn.target.handle = 0;
+	txn.code = code;
+	txn.flags = flags | TF_ACCEPT_FDS;
+	txn.data_size = size;
+	txn.offsets_size = offsets_size;
+	txn.data.ptr.buffer = data;
+	txn.data.ptr.offsets = offsets;
+	out_cmd(&c->out, BC_TRANSACTION, &txn, sizeof(txn));
+
+	while (!done) {
+		ret = binder_write_read(c->fd, &c->out, in, sizeof(in));
+		if (ret < 0)
+			return ret;
+		p = (uint8_t *)in;
+		end = p + ret;
+		while (p < end) {
+			memcpy(&cmd, p, sizeof(cmd));
+			p += sizeof(cmd);
+			switch (cmd) {
+			case BR_NOOP:
+			case BR_SPAWN_LOOPER:
+			case BR_RELEASE:
+			case BR_DECREFS:
+				break;
+			case BR_TRANSACTION_COMPLETE:
+				if (flags & TF_ONE_WAY)
+					done = 1;
+				break;
+			case BR_REPLY:
+				memcpy(&txn, p, sizeof(txn));
+				c->reply_buf = txn.data.ptr.buffer;
+				done = 1;
+				break;
+			/* first time the object test hands out its node */
+			case BR_INCREFS:
+			case BR_ACQUIRE:
+				memcpy(&pc, p, sizeof(pc));
+				out_cmd(&c->out, cmd == BR_INCREFS ?
+					BC_INCREFS_DONE : BC_ACQUIRE_DONE,
+					&pc, sizeof(pc));
+				break;
+			case BR_FAILED_REPLY:
+				return -ENOSPC;
+			case BR_DEAD_REPLY:
+				return -EPIPE;
+			case BR_ERROR:
+				memcpy(&ret, p, sizeof(ret));
+				return ret < 0 ? ret : -EIO;
+			default:
+				fprintf(stderr, "binder_bench: unexpected "
+					"return %08x\n", cmd);
+				return -EPROTO;
+			}
+			p += _IOC_SIZE(cmd);
+		}
+	}
+	return 0;
+}
+
+static void server_handle(struct bench_out *o,
+			  struct binder_transaction_data *txn)
+{
+	const struct flat_binder_object *obj;
+	const size_t *offsets = txn->data.ptr.offsets;
+	struct binder_transaction_data reply;
+	size_t i;
+
+	/* the driver installed these in our table, it won't close them */
+	for (i = 0; i < txn->offsets_size / sizeof(size_t); i++) {
+		obj = (const void *)((const uint8_t *)txn->data.ptr.buffer +
+				     offsets[i]);
+		if (obj->type == BINDER_TYPE_FD)
+			close(obj->handle);
+	}
+
+	/* freeing the buffer also drops the refs taken for its objects */
+	out_cmd(o, BC_FREE_BUFFER, &txn->data.ptr.buffer, sizeof(void *));
+	if (txn->flags & TF_ONE_WAY)
+		return;
+
+	memset(&reply, 0, sizeof(reply));
+	reply.data_size = sizeof(reply_status);
+	reply.data.ptr.buffer = &reply_status;
+	out_cmd(o, BC_REPLY, &reply, sizeof(reply));
+}
+
+static void *server_loop(void *arg)
+{
+	int fd = (long)arg;
+	struct binder_transaction_data txn;
+	struct bench_out o;
+	uint32_t in[64];
+	uint8_t *p, *end;
+	uint32_t cmd;
+	int quit = 0;
+	int ret;
+
+	o.len = 0;
+	out_cmd(&o, BC_ENTER_LOOPER, NULL, 0);
+	for (;;) {
+		ret = binder_write_read(fd, &o, in, sizeof(in));
+		if (ret < 0) {
+			fprintf(stderr, "binder_bench: server: %s\n",
+				strerror(-ret));
+			_exit(1);
+		}
+		p = (uint8_t *)in;
+		end = p + ret;
+		while (p < end) {
+			memcpy(&cmd, p, sizeof(cmd));
+			p += sizeof(cmd);
+			if (cmd == BR_TRANSACTION) {
+				memcpy(&txn, p, sizeof(txn));
+				if (txn.code == BENCH_EXIT)
+					quit = 1;
+				server_handle(&o, &txn);
+			}
+			p += _IOC_SIZE(cmd);
+		}
+		if (quit) {
+			binder_write_read(fd, &o, in, 0);
+			_exit(0);
+		}
+	}
+	return NULL;
+}
+
+static void server_main(int nthreads, int ready_fd)
+{
+	pthread_t thread;
+	size_t zero = 0;
+	int fd;
+	int i;
+
+	fd = binder_open();
+	if (fd < 0)
+		_exit(1);
+	if (ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0) {
+		perror("binder_bench: BINDER_SET_CONTEXT_MGR");
+		_exit(1);
+	}
+	/* the pool is fixed, don't let the driver ask for more */
+	ioctl(fd, BINDER_SET_MAX_THREADS, &zero);
+
+	for (i = 1; i < nthreads; i++)
+		pthread_create(&thread, NULL, server_loop, (void *)(long)fd);
+	write(ready_fd, "", 1);
+	close(ready_fd);
+	server_loop((void *)(long)fd);
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *test, size_t size, int threads,
+		   uint32_t *lat, int n, uint64_t elapsed)
+{
+	qsort(lat, n, sizeof(*lat), cmp_u32);
+	printf("test=%s size=%zu threads=%d iters=%d "
+	       "p50_us=%.1f p99_us=%.1f max_us=%.1f calls_per_s=%.0f",
+	       test, size, threads, n,
+	       lat[(n - 1) / 2] / 1000.0, lat[(n - 1) * 99 / 100] / 1000.0,
+	       lat[n - 1] / 1000.0, n * 1e9 / elapsed);
+	if (size)
+		printf(" mb_per_s=%.2f", (double)size * n * 1e3 / elapsed);
+	printf("\n");
+	fflush(stdout);
+}
+
+static void *caller_thread(void *arg)
+{
+	struct bench_args *a = arg;
+	uint64_t t;
+	int i;
+
+	for (i = 0; i < a->iters; i++) {
+		t = now_ns();
+		a->err = bench_transact(&a->conn, BENCH_PING, payload,
+					a->size, NULL, 0, 0);
+		if (a->err)
+			break;
+		a->lat[i] = now_ns() - t;
+	}
+
+	if (a->conn.reply_buf) {
+		out_cmd(&a->conn.out, BC_FREE_BUFFER, &a->conn.reply_buf,
+			sizeof(void *));
+		binder_write_read(a->conn.fd, &a->conn.out, NULL, 0);
+	}
+	if (a->own_thread)
+		ioctl(a->conn.fd, BINDER_THREAD_EXIT, 0);
+	return NULL;
+}
+
+static int run_sync(int fd, const char *test, size_t size, int nthreads,
+		    uint32_t *lat)
+{
+	pthread_t threads[BENCH_MAX_THREADS];
+	struct bench_args args[BENCH_MAX_THREADS];
+	int per_thread = iterations / nthreads;
+	uint64_t t;
+	int i, err = 0;
+
+	memset(args, 0, sizeof(args));
+	for (i = 0; i < nthreads; i++) {
+		args[i].conn.fd = fd;
+		args[i].lat = lat + i * per_thread;
+		args[i].iters = per_thread;
+		args[i].size = size;
+		args[i].own_thread = nthreads > 1;
+	}
+
+	t = now_ns();
+	if (nthreads == 1) {
+		caller_thread(&args[0]);
+	} else {
+		for (i = 0; i < nthreads; i++)
+			pthread_create(&threads[i], NULL, caller_thread,
+				       &args[i]);
+		for (i = 0; i < nthreads; i++)
+			pthread_join(threads[i], NULL);
+	}
+	t = now_ns() - t;
+
+	for (i = 0; i < nthreads; i++)
+		if (args[i].err)
+			err = args[i].err;
+	if (err) {
+		fprintf(stderr, "binder_bench: %s: %s\n", test, strerror(-err));
+		return err;
+	}
+	report(test, size, nthreads, lat, per_thread * nthreads, t);
+	return 0;
+}
+
+static int run_oneway(int fd, uint32_t *lat)
+{
+	struct bench_conn conn = { .fd = fd };
+	int i, full = 0, err = 0;
+	uint64_t t, start;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		t = now_ns();
+		/* the server frees behind us, wait for it if we got ahead */
+		while ((err = bench_transact(&conn, BENCH_PING, payload, 32,
+					     NULL, 0, TF_ONE_WAY)) == -ENOSPC) {
+			full++;
+			usleep(100);
+			t = now_ns();
+		}
+		if (err) {
+			fprintf(stderr, "binder_bench: oneway: %s\n",
+				strerror(-err));
+			return err;
+		}
+		lat[i] = now_ns() - t;
+	}
+	report("oneway", 32, 1, lat, iterations, now_ns() - start);
+	if (full)
+		printf("test=oneway async_space_full=%d\n", full);
+	return 0;
+}
+
+/* a parcel holding one object of the given type and nothing else */
+static int run_object(int fd, const char *test, unsigned long type,
+		      uint32_t *lat)
+{
+	struct bench_conn conn = { .fd = fd };
+	static int cookie;
+	struct flat_binder_object obj;
+	size_t offset = 0;
+	uint64_t t, start;
+	int i, err;
+
+	memset(&obj, 0, sizeof(obj));
+	obj.type = type;
+	obj.flags = FLAT_BINDER_FLAG_ACCEPTS_FDS | 0x7f;
+	if (type == BINDER_TYPE_FD) {
+		obj.handle = open("/dev/null", O_RDONLY);
+		if (obj.handle < 0) {
+			perror("/dev/null");
+			return -errno;
+		}
+	} else {
+		obj.binder = &cookie;
+		obj.cookie = &cookie;
+	}
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		t = now_ns();
+		err = bench_transact(&conn, BENCH_PING, &obj, sizeof(obj),
+				     &offset, sizeof(offset), 0);
+		if (err) {
+			fprintf(stderr, "binder_bench: %s: %s\n", test,
+				strerror(-err));
+			return err;
+		}
+		lat[i] = now_ns() - t;
+	}
+	report(test, sizeof(obj), 1, lat, iterations, now_ns() - start);
+
+	out_cmd(&conn.out, BC_FREE_BUFFER, &conn.reply_buf, sizeof(void *));
+	binder_write_read(fd, &conn.out, NULL, 0);
+	if (type == BINDER_TYPE_FD)
+		close(obj.handle);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_conn conn;
+	int ready[2];
+	uint32_t *lat;
+	size_t size;
+	pid_t server;
+	char c;
+	int fd, n, status;
+	int uid = -1;
+
+	while ((n = getopt(argc, argv, "i:t:u:d:")) != -1) {
+		switch (n) {
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'u':
+			uid = atoi(optarg);
+			break;
+		case 'd':
+			binder_dev = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < max_threads || max_threads < 1 ||
+	    max_threads > BENCH_MAX_THREADS)
+		usage();
+	if (uid != -1 && setuid(uid) < 0) {
+		perror("setuid");
+		return 1;
+	}
+
+	lat = malloc(iterations * sizeof(*lat));
+	if (!lat)
+		return 1;
+
+	if (pipe(ready) < 0) {
+		perror("pipe");
+		return 1;
+	}
+	server = fork();
+	if (server == 0) {
+		close(ready[0]);
+		server_main(max_threads, ready[1]);
+	}
+	close(ready[1]);
+	if (server < 0 || read(ready[0], &c, 1) != 1) {
+		fprintf(stderr, "binder_bench: server failed to start\n");
+		return 1;
+	}
+
+	fd = binder_open();
+	if (fd < 0)
+		goto out;
+
+	if (run_sync(fd, "sync", 0, 1, lat) ||
+	    run_oneway(fd, lat))
+		goto out;
+	for (size = 32; size <= BENCH_MAX_SIZE; size *= 4)
+		if (run_sync(fd, "size", size, 1, lat))
+			goto out;
+	for (n = 2; n <= max_threads; n *= 2)
+		if (run_sync(fd, "threads", 32, n, lat))
+			goto out;
+	if (run_object(fd, "fd", BINDER_TYPE_FD, lat) ||
+	    run_object(fd, "object", BINDER_TYPE_BINDER, lat))
+		goto out;
+
+	memset(&conn, 0, sizeof(conn));
+	conn.fd = fd;
+	bench_transact(&conn, BENCH_EXIT, NULL, 0, NULL, 0, 0);
+out:
+	kill(server, SIGTERM);
+	waitpid(server, &status, 0);
+	return 0;
+}
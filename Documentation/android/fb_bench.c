@@ -0,0 +1,245 @@
+/*
+ * fb_bench: msm framebuffer and mdp blit microbenchmark
+ *
+ * Works on the framebuffer device alone, the blits read and write the
+ * framebuffer memory itself so no pmem is needed:
+ *
+ *   blit     MSMFB_BLIT of a half screen rect from buffer 1 into
+ *            buffer 0, once per source format, with pixel throughput
+ *   pan      FBIOPAN_DISPLAY until it returns
+ *   scanout  FBIOPAN_DISPLAY until the frame is on the panel, taken
+ *            from frame_done_ns after MSMFB_WAIT_FRAME
+ *
+ * Each test prints one line of key=value pairs with the p50 and p99
+ * latency, so before/after runs can be compared with a script. Where a
+ * scanout is lost, /sys/kernel/debug/msm_fb_frames says whether it was
+ * queueing, the vsync or the dma.
+ *
+ * Stop the framework first, the blits scribble over the screen and the
+ * panel has to be on:
+ *
+ *   adb shell stop; adb shell /data/fb_bench
+ *
+ * Build it for the device with something like
+ *
+ *   arm-eabi-gcc -static -O2 -idirafter include \
+ *	-o fb_bench Documentation/android/fb_bench.c -lrt
+ *
+ * Copyright (C) 2010 HTC Corporation.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <linux/fb.h>
+
+#include <linux/msm_mdp.h>
+
+struct bench_fb {
+	int fd;
+	struct fb_var_screeninfo var;
+	struct fb_fix_screeninfo fix;
+	int nbuffers;
+	uint32_t format;	/* of the framebuffer, the blit destination */
+};
+
+static const struct {
+	const char *name;
+	uint32_t format;
+} formats[] = {
+	{ "rgb565", MDP_RGB_565 },
+	{ "xrgb8888", MDP_XRGB_8888 },
+	{ "argb8888", MDP_ARGB_8888 },
+	{ "rgba8888", MDP_RGBA_8888 },
+	{ "bgra8888", MDP_BGRA_8888 },
+	{ "rgbx8888", MDP_RGBX_8888 },
+	{ "ycbcr420", MDP_Y_CBCR_H2V2 },
+	{ "ycrcb420", MDP_Y_CRCB_H2V2 },
+};
+
+static int iterations = 500;
+static const char *fb_dev = "/dev/graphics/fb0";
+
+static void usage(void)
+{
+	fprintf(stderr, "fb_bench [-i iterations] [-d device]\n");
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *test, const char *format, uint32_t pixels,
+		   uint32_t *lat, int n, uint64_t elapsed)
+{
+	qsort(lat, n, sizeof(*lat), cmp_u32);
+	printf("test=%s format=%s iters=%d "
+	       "p50_us=%.1f p99_us=%.1f max_us=%.1f calls_per_s=%.1f",
+	       test, format, n,
+	       lat[(n - 1) / 2] / 1000.0, lat[(n - 1) * 99 / 100] / 1000.0,
+	       lat[n - 1] / 1000.0, n * 1e9 / elapsed);
+	if (pixels)
+		printf(" mpix_per_s=%.1f", (double)pixels * n * 1e3 / elapsed);
+	printf("\n");
+	fflush(stdout);
+}
+
+static int fb_open(struct bench_fb *fb)
+{
+	fb->fd = open(fb_dev, O_RDWR);
+	if (fb->fd < 0) {
+		perror(fb_dev);
+		return -1;
+	}
+	if (ioctl(fb->fd, FBIOGET_VSCREENINFO, &fb->var) < 0 ||
+	    ioctl(fb->fd, FBIOGET_FSCREENINFO, &fb->fix) < 0) {
+		perror("FBIOGET_SCREENINFO");
+		return -1;
+	}
+	fb->nbuffers = fb->var.yres_virtual / fb->var.yres;
+	fb->format = fb->var.bits_per_pixel == 16 ? MDP_RGB_565 :
+		MDP_RGBA_8888;
+	return 0;
+}
+
+/* src is the top half of buffer 1, dst the top half of buffer 0; half
+ * a screen of even the widest source format fits in one buffer */
+static int bench_blit(struct bench_fb *fb, const char *name,
+		      uint32_t format, uint32_t *lat)
+{
+	struct {
+		struct mdp_blit_req_list list;
+		struct mdp_blit_req req;
+	} blit;
+	struct mdp_blit_req *req = &blit.req;
+	uint32_t w = fb->var.xres & ~1, h = (fb->var.yres / 2) & ~1;
+	uint64_t start, t;
+	int i;
+
+	memset(&blit, 0, sizeof(blit));
+	blit.list.count = 1;
+	req->src.width = w;
+	req->src.height = h;
+	req->src.format = format;
+	req->src.offset = fb->fix.line_length * fb->var.yres;
+	req->src.memory_id = fb->fd;
+	req->dst.width = fb->var.xres;
+	req->dst.height = fb->var.yres;
+	req->dst.format = fb->format;
+	req->dst.offset = 0;
+	req->dst.memory_id = fb->fd;
+	req->src_rect.w = req->dst_rect.w = w;
+	req->src_rect.h = req->dst_rect.h = h;
+	req->alpha = MDP_ALPHA_NOP;
+	req->transp_mask = MDP_TRANSP_NOP;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		t = now_ns();
+		if (ioctl(fb->fd, MSMFB_BLIT, &blit) < 0) {
+			fprintf(stderr, "fb_bench: MSMFB_BLIT %s: %s\n",
+				name, strerror(errno));
+			return -1;
+		}
+		lat[i] = now_ns() - t;
+	}
+	report("blit", name, w * h, lat, iterations, now_ns() - start);
+	return 0;
+}
+
+static int bench_pan(struct bench_fb *fb, uint32_t *pan, uint32_t *scanout)
+{
+	struct fb_var_screeninfo var = fb->var;
+	struct msmfb_frame_info fi;
+	uint64_t start, t;
+	int i;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		var.yoffset = (i % fb->nbuffers) * fb->var.yres;
+		t = now_ns();
+		if (ioctl(fb->fd, FBIOPAN_DISPLAY, &var) < 0) {
+			perror("FBIOPAN_DISPLAY");
+			return -1;
+		}
+		pan[i] = now_ns() - t;
+		if (ioctl(fb->fd, MSMFB_FRAME_INFO, &fi) < 0 ||
+		    ioctl(fb->fd, MSMFB_WAIT_FRAME, &fi.frame_queued) < 0 ||
+		    ioctl(fb->fd, MSMFB_FRAME_INFO, &fi) < 0) {
+			perror("MSMFB_WAIT_FRAME");
+			return -1;
+		}
+		/* frame_done_ns is ktime, the same clock as now_ns() */
+		scanout[i] = fi.frame_done_ns > t ? fi.frame_done_ns - t : 0;
+	}
+	t = now_ns() - start;
+	report("pan", "fb", 0, pan, iterations, t);
+	report("scanout", "fb", 0, scanout, iterations, t);
+	if (fi.frames_late || fi.frames_dropped)
+		printf("frames_late=%u frames_dropped=%u\n",
+		       fi.frames_late, fi.frames_dropped);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_fb fb;
+	uint32_t *lat, *lat2;
+	int i, n;
+
+	while ((n = getopt(argc, argv, "i:d:")) != -1) {
+		switch (n) {
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'd':
+			fb_dev = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < 1)
+		usage();
+
+	lat = malloc(2 * iterations * sizeof(*lat));
+	if (!lat || fb_open(&fb))
+		return 1;
+	lat2 = lat + iterations;
+
+	if (fb.nbuffers < 2) {
+		fprintf(stderr, "fb_bench: needs two buffers, %s has %d\n",
+			fb_dev, fb.nbuffers);
+		return 1;
+	}
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++)
+		if (bench_blit(&fb, formats[i].name, formats[i].format, lat))
+			return 1;
+	if (bench_pan(&fb, lat, lat2))
+		return 1;
+	return 0;
+}
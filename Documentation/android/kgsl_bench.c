@@ -0,0 +1,259 @@
+/*
+ * kgsl_bench: gpu submission microbenchmark
+ *
+ * Talks to /dev/kgsl directly, without the gl driver, so the numbers are
+ * those of the kernel path alone. The submitted indirect buffer is a
+ * single NOP packet, the gpu itself has next to nothing to do:
+ *
+ *   submit   IOCTL_KGSL_RINGBUFFER_ISSUEIBCMDS until it returns
+ *   poll     submit until READTIMESTAMP shows it retired, spinning
+ *   wait     submit until IOCTL_KGSL_DEVICE_WAITTIMESTAMP returns
+ *   batch    submit -b buffers back to back, then wait for the last
+ *
+ * wait - poll is what the interrupt, the event work and the wakeup of
+ * the sleeping caller add on top of the gpu. Each test prints one line
+ * of key=value pairs with the p50 and p99 latency, so before/after runs
+ * can be compared with a script.
+ *
+ * The kernel side of the same measurement, without the ioctl and the
+ * scheduler in the way, is in /sys/kernel/debug/kgsl/selftest; it only
+ * runs while a client such as this one keeps the device open.
+ *
+ * The indirect buffer comes from IOCTL_KGSL_SHAREDMEM_FROM_VMALLOC, so
+ * the kernel must be built with CONFIG_MSM_KGSL_MMU. Stop the framework
+ * first or the compositor's own frames are timed as well:
+ *
+ *   adb shell stop; adb shell /data/kgsl_bench
+ *
+ * Build it for the device with something like
+ *
+ *   arm-eabi-gcc -static -O2 -idirafter include \
+ *	-o kgsl_bench Documentation/android/kgsl_bench.c -lrt
+ *
+ * Copyright (C) 2010 HTC Corporation.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <linux/msm_kgsl.h>
+
+/* type 3 NOP with one dword of payload, see kgsl_pm4types.h */
+#define PM4_NOP_PACKET		(0xc0000000 | (0x10 << 8))
+#define BENCH_IB_SIZE		4096
+#define BENCH_MAX_BATCH		64
+
+static int iterations = 2000;
+static int batch = 16;
+static const char *kgsl_dev = "/dev/kgsl";
+
+struct bench_gpu {
+	int fd;
+	unsigned int ctxt;
+	unsigned int ibaddr;
+	uint32_t *ib;
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "kgsl_bench [-i iterations] [-b batch] "
+		"[-d device]\n");
+	exit(1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *test, int per_call, uint32_t *lat, int n,
+		   uint64_t elapsed)
+{
+	qsort(lat, n, sizeof(*lat), cmp_u32);
+	printf("test=%s ibs=%d iters=%d "
+	       "p50_us=%.1f p99_us=%.1f max_us=%.1f ibs_per_s=%.0f\n",
+	       test, per_call, n,
+	       lat[(n - 1) / 2] / 1000.0, lat[(n - 1) * 99 / 100] / 1000.0,
+	       lat[n - 1] / 1000.0, (double)n * per_call * 1e9 / elapsed);
+	fflush(stdout);
+}
+
+static int gpu_open(struct bench_gpu *gpu)
+{
+	struct kgsl_drawctxt_create create;
+	struct kgsl_sharedmem_from_vmalloc mem;
+	void *map;
+
+	gpu->fd = open(kgsl_dev, O_RDWR);
+	if (gpu->fd < 0) {
+		perror(kgsl_dev);
+		return -1;
+	}
+
+	memset(&create, 0, sizeof(create));
+	create.flags = KGSL_CONTEXT_NO_GMEM_ALLOC;
+	if (ioctl(gpu->fd, IOCTL_KGSL_DRAWCTXT_CREATE, &create) < 0) {
+		perror("IOCTL_KGSL_DRAWCTXT_CREATE");
+		return -1;
+	}
+	gpu->ctxt = create.drawctxt_id;
+
+	/* an untouched shared mapping at offset 0, the kernel puts its
+	 * own pages in it */
+	map = mmap(NULL, BENCH_IB_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	memset(&mem, 0, sizeof(mem));
+	mem.hostptr = (unsigned int)(uintptr_t)map;
+	if (ioctl(gpu->fd, IOCTL_KGSL_SHAREDMEM_FROM_VMALLOC, &mem) < 0) {
+		perror("IOCTL_KGSL_SHAREDMEM_FROM_VMALLOC");
+		return -1;
+	}
+	gpu->ibaddr = mem.gpuaddr;
+	gpu->ib = map;
+	gpu->ib[0] = PM4_NOP_PACKET;
+	gpu->ib[1] = 0;
+	return 0;
+}
+
+static int submit(struct bench_gpu *gpu, unsigned int *timestamp)
+{
+	struct kgsl_ringbuffer_issueibcmds cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.drawctxt_id = gpu->ctxt;
+	cmd.ibaddr = gpu->ibaddr;
+	cmd.sizedwords = 2;
+	if (ioctl(gpu->fd, IOCTL_KGSL_RINGBUFFER_ISSUEIBCMDS, &cmd) < 0) {
+		perror("IOCTL_KGSL_RINGBUFFER_ISSUEIBCMDS");
+		return -1;
+	}
+	*timestamp = cmd.timestamp;
+	return 0;
+}
+
+static int wait_ts(struct bench_gpu *gpu, unsigned int timestamp)
+{
+	struct kgsl_device_waittimestamp wait;
+
+	memset(&wait, 0, sizeof(wait));
+	wait.timestamp = timestamp;
+	wait.timeout = 1000;
+	if (ioctl(gpu->fd, IOCTL_KGSL_DEVICE_WAITTIMESTAMP, &wait) < 0) {
+		perror("IOCTL_KGSL_DEVICE_WAITTIMESTAMP");
+		return -1;
+	}
+	return 0;
+}
+
+static int poll_ts(struct bench_gpu *gpu, unsigned int timestamp)
+{
+	struct kgsl_cmdstream_readtimestamp rd;
+	uint64_t start = now_ns();
+
+	memset(&rd, 0, sizeof(rd));
+	rd.type = KGSL_TIMESTAMP_RETIRED;
+	do {
+		if (ioctl(gpu->fd, IOCTL_KGSL_CMDSTREAM_READTIMESTAMP,
+			  &rd) < 0) {
+			perror("IOCTL_KGSL_CMDSTREAM_READTIMESTAMP");
+			return -1;
+		}
+		if (now_ns() - start > 1000000000ULL) {
+			fprintf(stderr, "kgsl_bench: timestamp %u stuck at "
+				"%u\n", timestamp, rd.timestamp);
+			return -1;
+		}
+	} while ((int)(rd.timestamp - timestamp) < 0);
+	return 0;
+}
+
+static int bench(struct bench_gpu *gpu, const char *test, uint32_t *lat)
+{
+	unsigned int ts;
+	uint64_t start, t;
+	int i, j, n = !strcmp(test, "batch") ? batch : 1;
+
+	start = now_ns();
+	for (i = 0; i < iterations; i++) {
+		t = now_ns();
+		for (j = 0; j < n; j++)
+			if (submit(gpu, &ts))
+				return -1;
+		if (!strcmp(test, "submit")) {
+			lat[i] = now_ns() - t;
+			/* keep the ring from filling up */
+			if (wait_ts(gpu, ts))
+				return -1;
+			continue;
+		}
+		if (!strcmp(test, "poll") ? poll_ts(gpu, ts) :
+		    wait_ts(gpu, ts))
+			return -1;
+		lat[i] = now_ns() - t;
+	}
+	report(test, n, lat, iterations, now_ns() - start);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const char *tests[] = { "submit", "poll", "wait", "batch" };
+	struct bench_gpu gpu;
+	uint32_t *lat;
+	int i, n;
+
+	while ((n = getopt(argc, argv, "i:b:d:")) != -1) {
+		switch (n) {
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 'd':
+			kgsl_dev = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (iterations < 1 || batch < 1 || batch > BENCH_MAX_BATCH)
+		usage();
+
+	lat = malloc(iterations * sizeof(*lat));
+	if (!lat || gpu_open(&gpu))
+		return 1;
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+		if (bench(&gpu, tests[i], lat))
+			return 1;
+	return 0;
+}
@@ -170,6 +170,45 @@ asmlinkage void __div0(void)
 
 extern void do_decompress(u8 *input, int len, u8 *output, void (*error)(char *x));
 
+#ifdef CONFIG_CPU_V7
+/*
+ * Time the decompressor with the cycle counter so gzip, lzo and lzma
+ * images can be compared on the device. 32 bits of cycles is a few
+ * seconds at full speed, which is well above what any of them take.
+ */
+static inline void decomp_cycles_start(void)
+{
+	unsigned int pmnc;
+
+	asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r" (pmnc));
+	pmnc |= (1 << 0) | (1 << 2);	/* enable, reset the cycle counter */
+	pmnc &= ~(1 << 3);		/* count every cycle */
+	asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r" (pmnc));
+	asm volatile("mcr p15, 0, %0, c9, c12, 1" : : "r" (1U << 31));
+}
+
+static inline unsigned int decomp_cycles(void)
+{
+	unsigned int val;
+
+	asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (val));
+	return val;
+}
+
+static void putdec(unsigned int n)
+{
+	char buf[11];
+	int i = sizeof(buf) - 1;
+
+	buf[i] = '\0';
+	do {
+		buf[--i] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+	putstr(&buf[i]);
+}
+#endif
+
 unsigned long
 decompress_kernel(unsigned long output_start, unsigned long free_mem_ptr_p,
                unsigned long free_mem_ptr_end_p,
@@ -187,8 +226,18 @@ decompress_kernel(unsigned long output_start, unsigned long free_mem_ptr_p,
 	tmp = (unsigned char *) (((unsigned long)input_data_end) - 4);
 	output_ptr = get_unaligned_le32(tmp);
 	putstr("Uncompressing Linux...");
+#ifdef CONFIG_CPU_V7
+	decomp_cycles_start();
+#endif
 	do_decompress(input_data, input_data_end - input_data,
 			output_data, error);
-	putstr(" done, booting the kernel.\n");
+#ifdef CONFIG_CPU_V7
+	putstr(" done in ");
+	putdec(decomp_cycles());
+	putstr(" cycles");
+#else
+	putstr(" done");
+#endif
+	putstr(", booting the kernel.\n");
 	return output_ptr;
 }
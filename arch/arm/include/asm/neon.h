@@ -0,0 +1,31 @@
+/*
+ *  arch/arm/include/asm/neon.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(elf_hwcap & HWCAP_NEON)
+
+/* memcpy() sizes from which the NEON copy is tried */
+#define NEON_COPY_MIN		512
+/* and the same for csum_partial() and csum_partial_copy_from_user() */
+#define NEON_CSUM_MIN		256
+
+#if defined(CONFIG_KERNEL_MODE_NEON) && !defined(__ASSEMBLY__)
+/*
+ * NEON may be used by the kernel between kernel_neon_begin() and
+ * kernel_neon_end(), from process context only. Preemption is disabled
+ * in between, so the section must not sleep; any user VFP state is
+ * saved on entry and lazily reloaded on the owner's next VFP access.
+ */
+extern void kernel_neon_begin(void);
+extern void kernel_neon_end(void);
+#endif
+
+#endif
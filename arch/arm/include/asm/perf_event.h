@@ -0,0 +1,22 @@
+/*
+ *  arch/arm/include/asm/perf_event.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ARM_PERF_EVENT_H__
+#define __ARM_PERF_EVENT_H__
+
+/*
+ * The pmu interrupt is an ordinary irq, so overflows are handled right
+ * away and there is never any pending work to kick.
+ */
+static inline void set_perf_event_pending(void)
+{
+}
+
+/* counter 0 is the cycle counter, the event counters follow it */
+#define PERF_EVENT_INDEX_OFFSET	1
+
+#endif /* __ARM_PERF_EVENT_H__ */
@@ -0,0 +1,30 @@
+/*
+ *  arch/arm/include/asm/pmu.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ARM_PMU_H__
+#define __ARM_PMU_H__
+
+#include <linux/errno.h>
+#include <asm/bitops.h>
+
+/*
+ * The performance monitor is shared by oprofile and perf events, only
+ * one of them may program it at a time.
+ */
+extern unsigned long arm_pmu_owned;
+
+static inline int reserve_pmu(void)
+{
+	return test_and_set_bit(0, &arm_pmu_owned) ? -EBUSY : 0;
+}
+
+static inline void release_pmu(void)
+{
+	clear_bit(0, &arm_pmu_owned);
+}
+
+#endif /* __ARM_PMU_H__ */
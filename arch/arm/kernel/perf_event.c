@@ -0,0 +1,990 @@
+/*
+ *  linux/arch/arm/kernel/perf_event.c
+ *
+ *  perf events backend for the ARMv7 performance monitor: the cycle
+ *  counter and four event counters, with overflow interrupts for
+ *  sampling and frame pointer callchains. On Scorpion the events of the
+ *  local performance monitor (LPM) regions are available as well.
+ *
+ *  Based on the sparc64 and x86 perf event code.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/perf_event.h>
+#include <linux/interrupt.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/uaccess.h>
+
+#include <asm/cputype.h>
+#include <asm/irq.h>
+#include <asm/irq_regs.h>
+#include <asm/pmu.h>
+#include <asm/stacktrace.h>
+#include <asm/system.h>
+
+#if defined(CONFIG_ARCH_QSD8X50)
+#define ARMV7_PMU_IRQ		INT_ARM11_PM
+#elif defined(CONFIG_ARCH_OMAP3)
+#define ARMV7_PMU_IRQ		INT_34XX_BENCH_MPU_EMUL
+#else
+#define ARMV7_PMU_IRQ		-1
+#endif
+
+/*
+ * Counter 0 is the cycle counter, 1-4 are the event counters, which the
+ * hardware numbers from 0.
+ */
+#define ARMV7_CCNT		0
+#define ARMV7_CNT0		1
+#define ARMV7_MAX_COUNTERS	5
+#define ARMV7_MAX_PERIOD	((1ULL << 32) - 1)
+
+#define ARMV7_PMNC_E		(1 << 0)	/* enable all counters */
+#define ARMV7_PMNC_P		(1 << 1)	/* reset the event counters */
+#define ARMV7_PMNC_C		(1 << 2)	/* reset the cycle counter */
+#define ARMV7_FLAG_MASK		0x8000000f
+
+/* architected events, and the pseudo event for the cycle counter */
+#define ARMV7_EVT_ICACHE_REFILL	0x01
+#define ARMV7_EVT_ITLB_REFILL	0x02
+#define ARMV7_EVT_DCACHE_REFILL	0x03
+#define ARMV7_EVT_DCACHE_ACCESS	0x04
+#define ARMV7_EVT_DTLB_REFILL	0x05
+#define ARMV7_EVT_INSTR		0x08
+#define ARMV7_EVT_PC_WRITE	0x0c
+#define ARMV7_EVT_BRANCH_MISS	0x10
+#define ARMV7_EVT_CYCLES	0xff
+
+#define EVT_UNSUPPORTED		0xfffffffe
+#define EVT_NONSENSE		0xffffffff
+
+/*
+ * Scorpion events are 0x1RCCG: region R (0-2 for LPM0-2, 3 for the L2
+ * LPM), event code CC and group G. The code goes in byte G of the region
+ * register and the counter is pointed at event 0x4c + 4 * R + G.
+ */
+#define SCORPION_EVT_PREFIX	0x10000
+#define SCORPION_EVT(r, c, g)	(SCORPION_EVT_PREFIX | ((r) << 12) | \
+				 ((c) << 4) | (g))
+#define SCORPION_EVT_REGION(e)	(((e) >> 12) & 0xf)
+#define SCORPION_EVT_CODE(e)	(((e) >> 4) & 0xff)
+#define SCORPION_EVT_GROUP(e)	((e) & 0xf)
+#define SCORPION_NUM_REGIONS	4
+#define SCORPION_NUM_GROUPS	4
+#define SCORPION_LPM_ENABLE	(1 << 31)
+
+#define SCORPION_ICACHE_MISS	SCORPION_EVT(0, 0x05, 2)
+#define SCORPION_ICACHE_ACCESS	SCORPION_EVT(0, 0x05, 3)
+#define SCORPION_ITLB_MISS	SCORPION_EVT(2, 0x02, 1)
+#define SCORPION_DTLB_MISS	SCORPION_EVT(2, 0x01, 2)
+#define SCORPION_DTLB_ACCESS	SCORPION_EVT(2, 0x01, 3)
+
+struct cpu_hw_events {
+	struct perf_event	*events[ARMV7_MAX_COUNTERS];
+	unsigned long		used_mask[BITS_TO_LONGS(ARMV7_MAX_COUNTERS)];
+	unsigned long		active_mask[BITS_TO_LONGS(ARMV7_MAX_COUNTERS)];
+	/* lpm groups in use, one bit per group for each region */
+	u8			lpm_used[SCORPION_NUM_REGIONS];
+	int			enabled;
+};
+static DEFINE_PER_CPU(struct cpu_hw_events, cpu_hw_events) = { .enabled = 1, };
+
+#define C(x) PERF_COUNT_HW_CACHE_##x
+
+typedef u32 cache_map_t[PERF_COUNT_HW_CACHE_MAX]
+		       [PERF_COUNT_HW_CACHE_OP_MAX]
+		       [PERF_COUNT_HW_CACHE_RESULT_MAX];
+
+struct armv7_pmu {
+	const char		*name;
+	const u32		*event_map;
+	const cache_map_t	*cache_map;
+	int			has_lpm;
+};
+
+static const u32 armv7_event_map[PERF_COUNT_HW_MAX] = {
+	[PERF_COUNT_HW_CPU_CYCLES]		= ARMV7_EVT_CYCLES,
+	[PERF_COUNT_HW_INSTRUCTIONS]		= ARMV7_EVT_INSTR,
+	[PERF_COUNT_HW_CACHE_REFERENCES]	= ARMV7_EVT_DCACHE_ACCESS,
+	[PERF_COUNT_HW_CACHE_MISSES]		= ARMV7_EVT_DCACHE_REFILL,
+	[PERF_COUNT_HW_BRANCH_INSTRUCTIONS]	= ARMV7_EVT_PC_WRITE,
+	[PERF_COUNT_HW_BRANCH_MISSES]		= ARMV7_EVT_BRANCH_MISS,
+	[PERF_COUNT_HW_BUS_CYCLES]		= EVT_UNSUPPORTED,
+};
+
+static const cache_map_t armv7_cache_map = {
+[C(L1D)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= ARMV7_EVT_DCACHE_ACCESS,
+		[C(RESULT_MISS)]	= ARMV7_EVT_DCACHE_REFILL,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= ARMV7_EVT_DCACHE_ACCESS,
+		[C(RESULT_MISS)]	= ARMV7_EVT_DCACHE_REFILL,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+[C(L1I)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= ARMV7_EVT_ICACHE_REFILL,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= EVT_NONSENSE,
+		[C(RESULT_MISS)]	= EVT_NONSENSE,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+[C(LL)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+[C(DTLB)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= ARMV7_EVT_DTLB_REFILL,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= ARMV7_EVT_DTLB_REFILL,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+[C(ITLB)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= ARMV7_EVT_ITLB_REFILL,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= EVT_NONSENSE,
+		[C(RESULT_MISS)]	= EVT_NONSENSE,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+[C(BPU)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= ARMV7_EVT_PC_WRITE,
+		[C(RESULT_MISS)]	= ARMV7_EVT_BRANCH_MISS,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= EVT_NONSENSE,
+		[C(RESULT_MISS)]	= EVT_NONSENSE,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+};
+
+/* the architected set, with the i-side and tlb events the lpm adds */
+static const cache_map_t scorpion_cache_map = {
+[C(L1D)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= ARMV7_EVT_DCACHE_ACCESS,
+		[C(RESULT_MISS)]	= ARMV7_EVT_DCACHE_REFILL,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= ARMV7_EVT_DCACHE_ACCESS,
+		[C(RESULT_MISS)]	= ARMV7_EVT_DCACHE_REFILL,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+[C(L1I)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= SCORPION_ICACHE_ACCESS,
+		[C(RESULT_MISS)]	= SCORPION_ICACHE_MISS,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= EVT_NONSENSE,
+		[C(RESULT_MISS)]	= EVT_NONSENSE,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+[C(LL)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+[C(DTLB)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= SCORPION_DTLB_ACCESS,
+		[C(RESULT_MISS)]	= SCORPION_DTLB_MISS,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= SCORPION_DTLB_ACCESS,
+		[C(RESULT_MISS)]	= SCORPION_DTLB_MISS,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+[C(ITLB)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= SCORPION_ITLB_MISS,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= EVT_NONSENSE,
+		[C(RESULT_MISS)]	= EVT_NONSENSE,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+[C(BPU)] = {
+	[C(OP_READ)] = {
+		[C(RESULT_ACCESS)]	= ARMV7_EVT_PC_WRITE,
+		[C(RESULT_MISS)]	= ARMV7_EVT_BRANCH_MISS,
+	},
+	[C(OP_WRITE)] = {
+		[C(RESULT_ACCESS)]	= EVT_NONSENSE,
+		[C(RESULT_MISS)]	= EVT_NONSENSE,
+	},
+	[C(OP_PREFETCH)] = {
+		[C(RESULT_ACCESS)]	= EVT_UNSUPPORTED,
+		[C(RESULT_MISS)]	= EVT_UNSUPPORTED,
+	},
+},
+};
+
+static const struct armv7_pmu armv7_cortex_pmu = {
+	.name		= "ARMv7",
+	.event_map	= armv7_event_map,
+	.cache_map	= &armv7_cache_map,
+};
+
+static const struct armv7_pmu armv7_scorpion_pmu = {
+	.name		= "Scorpion",
+	.event_map	= armv7_event_map,
+	.cache_map	= &scorpion_cache_map,
+	.has_lpm	= 1,
+};
+
+static const struct armv7_pmu *armv7_pmu __read_mostly;
+
+/*
+ * Register access
+ */
+static inline u32 armv7_pmnc_read(void)
+{
+	u32 val;
+	asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r" (val));
+	return val;
+}
+
+static inline void armv7_pmnc_write(u32 val)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r" (val));
+}
+
+static inline u32 armv7_counter_bit(int idx)
+{
+	return idx == ARMV7_CCNT ? (1 << 31) : (1 << (idx - ARMV7_CNT0));
+}
+
+static inline void armv7_select_counter(int idx)
+{
+	u32 val = idx - ARMV7_CNT0;
+	asm volatile("mcr p15, 0, %0, c9, c12, 5" : : "r" (val));
+	isb();
+}
+
+static u32 armv7_read_counter(int idx)
+{
+	u32 val;
+
+	if (idx == ARMV7_CCNT)
+		asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (val));
+	else {
+		armv7_select_counter(idx);
+		asm volatile("mrc p15, 0, %0, c9, c13, 2" : "=r" (val));
+	}
+	return val;
+}
+
+static void armv7_write_counter(int idx, u32 val)
+{
+	if (idx == ARMV7_CCNT)
+		asm volatile("mcr p15, 0, %0, c9, c13, 0" : : "r" (val));
+	else {
+		armv7_select_counter(idx);
+		asm volatile("mcr p15, 0, %0, c9, c13, 2" : : "r" (val));
+	}
+}
+
+static void armv7_write_evtsel(int idx, u32 val)
+{
+	armv7_select_counter(idx);
+	asm volatile("mcr p15, 0, %0, c9, c13, 1" : : "r" (val & 0xff));
+}
+
+static inline void armv7_enable_counter(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 1" : :
+		     "r" (armv7_counter_bit(idx)));
+}
+
+static inline void armv7_disable_counter(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 2" : :
+		     "r" (armv7_counter_bit(idx)));
+}
+
+static inline void armv7_enable_intens(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c14, 1" : :
+		     "r" (armv7_counter_bit(idx)));
+}
+
+static inline void armv7_disable_intens(int idx)
+{
+	asm volatile("mcr p15, 0, %0, c9, c14, 2" : :
+		     "r" (armv7_counter_bit(idx)));
+}
+
+static inline u32 armv7_getreset_flags(void)
+{
+	u32 val;
+
+	asm volatile("mrc p15, 0, %0, c9, c12, 3" : "=r" (val));
+	val &= ARMV7_FLAG_MASK;
+	/* write to clear */
+	asm volatile("mcr p15, 0, %0, c9, c12, 3" : : "r" (val));
+	return val;
+}
+
+static u32 scorpion_read_lpm(int region)
+{
+	u32 val = 0;
+
+	switch (region) {
+	case 0:
+		asm volatile("mrc p15, 0, %0, c15, c0, 0" : "=r" (val));
+		break;
+	case 1:
+		asm volatile("mrc p15, 1, %0, c15, c0, 0" : "=r" (val));
+		break;
+	case 2:
+		asm volatile("mrc p15, 2, %0, c15, c0, 0" : "=r" (val));
+		break;
+	case 3:
+		asm volatile("mrc p15, 3, %0, c15, c2, 0" : "=r" (val));
+		break;
+	}
+	return val;
+}
+
+static void scorpion_write_lpm(int region, u32 val)
+{
+	switch (region) {
+	case 0:
+		asm volatile("mcr p15, 0, %0, c15, c0, 0" : : "r" (val));
+		break;
+	case 1:
+		asm volatile("mcr p15, 1, %0, c15, c0, 0" : : "r" (val));
+		break;
+	case 2:
+		asm volatile("mcr p15, 2, %0, c15, c0, 0" : : "r" (val));
+		break;
+	case 3:
+		asm volatile("mcr p15, 3, %0, c15, c2, 0" : : "r" (val));
+		break;
+	}
+	isb();
+}
+
+static void scorpion_lpm_set(u32 config, int on)
+{
+	int region = SCORPION_EVT_REGION(config);
+	int shift = SCORPION_EVT_GROUP(config) * 8;
+	u32 val;
+
+	val = scorpion_read_lpm(region) & ~(0xff << shift);
+	if (on)
+		val |= (SCORPION_EVT_CODE(config) << shift) |
+			SCORPION_LPM_ENABLE;
+	scorpion_write_lpm(region, val);
+}
+
+/*
+ * Counter management
+ */
+static void armv7_enable_event(struct hw_perf_event *hwc, int idx)
+{
+	armv7_disable_counter(idx);
+	if (idx != ARMV7_CCNT) {
+		if (hwc->config & SCORPION_EVT_PREFIX)
+			scorpion_lpm_set(hwc->config, 1);
+		armv7_write_evtsel(idx, hwc->config_base);
+	}
+	armv7_enable_intens(idx);
+	armv7_enable_counter(idx);
+}
+
+static void armv7_disable_event(struct hw_perf_event *hwc, int idx)
+{
+	armv7_disable_counter(idx);
+	armv7_disable_intens(idx);
+}
+
+void hw_perf_enable(void)
+{
+	struct cpu_hw_events *cpuc = &__get_cpu_var(cpu_hw_events);
+
+	if (cpuc->enabled)
+		return;
+
+	cpuc->enabled = 1;
+	barrier();
+
+	if (bitmap_weight(cpuc->used_mask, ARMV7_MAX_COUNTERS))
+		armv7_pmnc_write(armv7_pmnc_read() | ARMV7_PMNC_E);
+}
+
+void hw_perf_disable(void)
+{
+	struct cpu_hw_events *cpuc = &__get_cpu_var(cpu_hw_events);
+
+	if (!cpuc->enabled)
+		return;
+
+	cpuc->enabled = 0;
+	barrier();
+
+	if (bitmap_weight(cpuc->used_mask, ARMV7_MAX_COUNTERS))
+		armv7_pmnc_write(armv7_pmnc_read() & ~ARMV7_PMNC_E);
+}
+
+static int armv7_set_period(struct perf_event *event,
+			    struct hw_perf_event *hwc, int idx)
+{
+	s64 left = atomic64_read(&hwc->period_left);
+	s64 period = hwc->sample_period;
+	int ret = 0;
+
+	if (unlikely(left <= -period)) {
+		left = period;
+		atomic64_set(&hwc->period_left, left);
+		hwc->last_period = period;
+		ret = 1;
+	}
+
+	if (unlikely(left <= 0)) {
+		left += period;
+		atomic64_set(&hwc->period_left, left);
+		hwc->last_period = period;
+		ret = 1;
+	}
+
+	if (left > (s64)ARMV7_MAX_PERIOD)
+		left = ARMV7_MAX_PERIOD;
+
+	atomic64_set(&hwc->prev_count, (u64)-left);
+	armv7_write_counter(idx, (u64)(-left) & 0xffffffff);
+
+	perf_event_update_userpage(event);
+
+	return ret;
+}
+
+static u64 armv7_event_update(struct perf_event *event,
+			      struct hw_perf_event *hwc, int idx)
+{
+	u64 prev_raw_count, new_raw_count;
+	s64 delta;
+
+again:
+	prev_raw_count = atomic64_read(&hwc->prev_count);
+	new_raw_count = armv7_read_counter(idx);
+
+	if (atomic64_cmpxchg(&hwc->prev_count, prev_raw_count,
+			     new_raw_count) != prev_raw_count)
+		goto again;
+
+	delta = (new_raw_count - prev_raw_count) & ARMV7_MAX_PERIOD;
+
+	atomic64_add(delta, &event->count);
+	atomic64_sub(delta, &hwc->period_left);
+
+	return new_raw_count;
+}
+
+static int armv7_pmu_enable(struct perf_event *event)
+{
+	struct cpu_hw_events *cpuc = &__get_cpu_var(cpu_hw_events);
+	struct hw_perf_event *hwc = &event->hw;
+	int lpm = hwc->config & SCORPION_EVT_PREFIX;
+	int region = SCORPION_EVT_REGION(hwc->config);
+	u8 group = 1 << SCORPION_EVT_GROUP(hwc->config);
+	int idx;
+
+	/* one event per lpm group */
+	if (lpm && (cpuc->lpm_used[region] & group))
+		return -EAGAIN;
+
+	if (hwc->config_base == ARMV7_EVT_CYCLES) {
+		if (test_and_set_bit(ARMV7_CCNT, cpuc->used_mask))
+			return -EAGAIN;
+		idx = ARMV7_CCNT;
+	} else {
+		for (idx = ARMV7_CNT0; idx < ARMV7_MAX_COUNTERS; idx++)
+			if (!test_and_set_bit(idx, cpuc->used_mask))
+				break;
+		if (idx == ARMV7_MAX_COUNTERS)
+			return -EAGAIN;
+	}
+
+	if (lpm)
+		cpuc->lpm_used[region] |= group;
+	hwc->idx = idx;
+	cpuc->events[idx] = event;
+	set_bit(idx, cpuc->active_mask);
+
+	armv7_set_period(event, hwc, idx);
+	armv7_enable_event(hwc, idx);
+	if (cpuc->enabled)
+		armv7_pmnc_write(armv7_pmnc_read() | ARMV7_PMNC_E);
+
+	perf_event_update_userpage(event);
+	return 0;
+}
+
+static void armv7_pmu_disable(struct perf_event *event)
+{
+	struct cpu_hw_events *cpuc = &__get_cpu_var(cpu_hw_events);
+	struct hw_perf_event *hwc = &event->hw;
+	int idx = hwc->idx;
+
+	clear_bit(idx, cpuc->active_mask);
+	armv7_disable_event(hwc, idx);
+
+	barrier();
+
+	armv7_event_update(event, hwc, idx);
+	if (hwc->config & SCORPION_EVT_PREFIX) {
+		scorpion_lpm_set(hwc->config, 0);
+		cpuc->lpm_used[SCORPION_EVT_REGION(hwc->config)] &=
+			~(1 << SCORPION_EVT_GROUP(hwc->config));
+	}
+	cpuc->events[idx] = NULL;
+	clear_bit(idx, cpuc->used_mask);
+
+	perf_event_update_userpage(event);
+}
+
+static void armv7_pmu_read(struct perf_event *event)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	armv7_event_update(event, hwc, hwc->idx);
+}
+
+static void armv7_pmu_unthrottle(struct perf_event *event)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	armv7_enable_event(hwc, hwc->idx);
+}
+
+static const struct pmu pmu = {
+	.enable		= armv7_pmu_enable,
+	.disable	= armv7_pmu_disable,
+	.read		= armv7_pmu_read,
+	.unthrottle	= armv7_pmu_unthrottle,
+};
+
+static irqreturn_t armv7_pmu_irq(int irq, void *dev)
+{
+	struct cpu_hw_events *cpuc = &__get_cpu_var(cpu_hw_events);
+	struct pt_regs *regs = get_irq_regs();
+	struct perf_sample_data data;
+	u32 flags;
+	int idx;
+
+	flags = armv7_getreset_flags();
+	if (!flags)
+		return IRQ_NONE;
+
+	data.addr = 0;
+	data.raw = NULL;
+
+	for (idx = 0; idx < ARMV7_MAX_COUNTERS; idx++) {
+		struct perf_event *event = cpuc->events[idx];
+		struct hw_perf_event *hwc;
+
+		if (!test_bit(idx, cpuc->active_mask) ||
+		    !(flags & armv7_counter_bit(idx)))
+			continue;
+
+		hwc = &event->hw;
+		armv7_event_update(event, hwc, idx);
+		data.period = hwc->last_period;
+		if (!armv7_set_period(event, hwc, idx))
+			continue;
+
+		if (perf_event_overflow(event, 0, &data, regs))
+			armv7_disable_event(hwc, idx);
+	}
+
+	return IRQ_HANDLED;
+}
+
+/*
+ * The counters are grabbed from oprofile with the first event and handed
+ * back with the last one.
+ */
+static atomic_t active_events = ATOMIC_INIT(0);
+static DEFINE_MUTEX(pmu_reserve_mutex);
+
+static int armv7_pmu_grab(void)
+{
+	int err = 0;
+
+	if (atomic_inc_not_zero(&active_events))
+		return 0;
+
+	mutex_lock(&pmu_reserve_mutex);
+	if (atomic_read(&active_events) == 0) {
+		err = reserve_pmu();
+		if (err)
+			goto out;
+		err = request_irq(ARMV7_PMU_IRQ, armv7_pmu_irq, IRQF_DISABLED,
+				  "armv7_pmu", NULL);
+		if (err) {
+			pr_warning("perf: unable to request pmu irq %d\n",
+				   ARMV7_PMU_IRQ);
+			release_pmu();
+			goto out;
+		}
+		/* all counters stopped and cleared, the global enable on */
+		armv7_disable_counter(ARMV7_CCNT);
+		armv7_disable_intens(ARMV7_CCNT);
+		armv7_pmnc_write(ARMV7_PMNC_P | ARMV7_PMNC_C);
+		asm volatile("mcr p15, 0, %0, c9, c12, 2" : : "r" (0x0f));
+		asm volatile("mcr p15, 0, %0, c9, c14, 2" : : "r" (0x0f));
+		armv7_getreset_flags();
+		armv7_pmnc_write(ARMV7_PMNC_E);
+	}
+	atomic_inc(&active_events);
+out:
+	mutex_unlock(&pmu_reserve_mutex);
+	return err;
+}
+
+static void armv7_pmu_release(struct perf_event *event)
+{
+	if (atomic_dec_and_mutex_lock(&active_events, &pmu_reserve_mutex)) {
+		armv7_pmnc_write(0);
+		free_irq(ARMV7_PMU_IRQ, NULL);
+		release_pmu();
+		mutex_unlock(&pmu_reserve_mutex);
+	}
+}
+
+static u32 armv7_map_cache_event(u64 config)
+{
+	unsigned int cache_type, cache_op, cache_result;
+
+	cache_type = (config >>  0) & 0xff;
+	cache_op = (config >>  8) & 0xff;
+	cache_result = (config >> 16) & 0xff;
+	if (cache_type >= PERF_COUNT_HW_CACHE_MAX ||
+	    cache_op >= PERF_COUNT_HW_CACHE_OP_MAX ||
+	    cache_result >= PERF_COUNT_HW_CACHE_RESULT_MAX)
+		return EVT_NONSENSE;
+
+	return (*armv7_pmu->cache_map)[cache_type][cache_op][cache_result];
+}
+
+static u32 armv7_map_raw_event(u64 config)
+{
+	if (config <= 0xff)
+		return config;
+	if (armv7_pmu->has_lpm && (config >> 16) == 1 &&
+	    SCORPION_EVT_REGION(config) < SCORPION_NUM_REGIONS &&
+	    SCORPION_EVT_GROUP(config) < SCORPION_NUM_GROUPS)
+		return config;
+	return EVT_NONSENSE;
+}
+
+static u32 armv7_evtsel(u32 config)
+{
+	if (config & SCORPION_EVT_PREFIX)
+		return 0x4c + 4 * SCORPION_EVT_REGION(config) +
+			SCORPION_EVT_GROUP(config);
+	return config;
+}
+
+/* make sure the whole group can be on the counters at the same time */
+static int armv7_validate_group(struct perf_event *event, u32 evtsel)
+{
+	struct perf_event *leader = event->group_leader, *sibling;
+	int cycles = 0, others = 0;
+
+	if (evtsel == ARMV7_EVT_CYCLES)
+		cycles++;
+	else
+		others++;
+
+	if (leader != event && !is_software_event(leader)) {
+		if (leader->hw.config_base == ARMV7_EVT_CYCLES)
+			cycles++;
+		else
+			others++;
+	}
+	list_for_each_entry(sibling, &leader->sibling_list, group_entry) {
+		if (is_software_event(sibling) ||
+		    sibling->state == PERF_EVENT_STATE_OFF)
+			continue;
+		if (sibling->hw.config_base == ARMV7_EVT_CYCLES)
+			cycles++;
+		else
+			others++;
+	}
+
+	if (cycles > 1 || others > ARMV7_MAX_COUNTERS - 1)
+		return -EINVAL;
+	return 0;
+}
+
+static int __hw_perf_event_init(struct perf_event *event)
+{
+	struct perf_event_attr *attr = &event->attr;
+	struct hw_perf_event *hwc = &event->hw;
+	u32 config;
+	int err;
+
+	if (!armv7_pmu)
+		return -ENODEV;
+
+	/* the counters can't tell user from kernel mode */
+	if (attr->exclude_user || attr->exclude_kernel ||
+	    attr->exclude_hv || attr->exclude_idle)
+		return -EPERM;
+
+	switch (attr->type) {
+	case PERF_TYPE_HARDWARE:
+		if (attr->config >= PERF_COUNT_HW_MAX)
+			return -EINVAL;
+		config = armv7_pmu->event_map[attr->config];
+		break;
+	case PERF_TYPE_HW_CACHE:
+		config = armv7_map_cache_event(attr->config);
+		break;
+	case PERF_TYPE_RAW:
+		config = armv7_map_raw_event(attr->config);
+		break;
+	default:
+		return -EOPNOTSUPP;
+	}
+	if (config == EVT_UNSUPPORTED)
+		return -ENOENT;
+	if (config == EVT_NONSENSE)
+		return -EINVAL;
+
+	err = armv7_validate_group(event, armv7_evtsel(config));
+	if (err)
+		return err;
+
+	err = armv7_pmu_grab();
+	if (err)
+		return err;
+	event->destroy = armv7_pmu_release;
+
+	hwc->config = config;
+	hwc->config_base = armv7_evtsel(config);
+	hwc->idx = -1;
+
+	if (!hwc->sample_period) {
+		hwc->sample_period = ARMV7_MAX_PERIOD;
+		hwc->last_period = hwc->sample_period;
+		atomic64_set(&hwc->period_left, hwc->sample_period);
+	}
+	return 0;
+}
+
+const struct pmu *hw_perf_event_init(struct perf_event *event)
+{
+	int err = __hw_perf_event_init(event);
+
+	if (err)
+		return ERR_PTR(err);
+	return &pmu;
+}
+
+void perf_event_print_debug(void)
+{
+	unsigned long flags;
+	int idx;
+
+	if (!armv7_pmu)
+		return;
+
+	local_irq_save(flags);
+	pr_info("PMNC %08x\n", armv7_pmnc_read());
+	for (idx = 0; idx < ARMV7_MAX_COUNTERS; idx++)
+		pr_info("counter %d: %08x\n", idx, armv7_read_counter(idx));
+	local_irq_restore(flags);
+}
+
+/*
+ * Callchain support
+ */
+static inline void callchain_store(struct perf_callchain_entry *entry, u64 ip)
+{
+	if (entry->nr < PERF_MAX_STACK_DEPTH)
+		entry->ip[entry->nr++] = ip;
+}
+
+/* the end of an APCS frame, fp points just past the saved pc */
+struct frame_tail {
+	struct frame_tail	*fp;
+	unsigned long		sp;
+	unsigned long		lr;
+} __attribute__((packed));
+
+static struct frame_tail *user_backtrace(struct frame_tail *tail,
+					 struct perf_callchain_entry *entry)
+{
+	struct frame_tail buftail;
+
+	if (!access_ok(VERIFY_READ, tail, sizeof(buftail)))
+		return NULL;
+	if (__copy_from_user_inatomic(&buftail, tail, sizeof(buftail)))
+		return NULL;
+
+	callchain_store(entry, buftail.lr);
+
+	/* frames must move up the stack, or this is garbage */
+	if (tail >= buftail.fp)
+		return NULL;
+
+	return buftail.fp - 1;
+}
+
+static void perf_callchain_user(struct pt_regs *regs,
+				struct perf_callchain_entry *entry)
+{
+	struct frame_tail *tail;
+
+	callchain_store(entry, PERF_CONTEXT_USER);
+	callchain_store(entry, regs->ARM_pc);
+
+	tail = (struct frame_tail *)regs->ARM_fp - 1;
+	while (tail && !((unsigned long)tail & 3) &&
+	       entry->nr < PERF_MAX_STACK_DEPTH)
+		tail = user_backtrace(tail, entry);
+}
+
+static int callchain_trace(struct stackframe *fr, void *data)
+{
+	struct perf_callchain_entry *entry = data;
+
+	callchain_store(entry, fr->pc);
+	return entry->nr >= PERF_MAX_STACK_DEPTH;
+}
+
+static void perf_callchain_kernel(struct pt_regs *regs,
+				  struct perf_callchain_entry *entry)
+{
+	struct stackframe fr;
+
+	callchain_store(entry, PERF_CONTEXT_KERNEL);
+	fr.fp = regs->ARM_fp;
+	fr.sp = regs->ARM_sp;
+	fr.lr = regs->ARM_lr;
+	fr.pc = regs->ARM_pc;
+	walk_stackframe(&fr, callchain_trace, entry);
+}
+
+/* the pmu interrupt doesn't nest, one entry per cpu will do */
+static DEFINE_PER_CPU(struct perf_callchain_entry, callchain);
+
+struct perf_callchain_entry *perf_callchain(struct pt_regs *regs)
+{
+	struct perf_callchain_entry *entry = &__get_cpu_var(callchain);
+
+	entry->nr = 0;
+
+	if (!regs || !current->pid)
+		return entry;
+
+	if (!user_mode(regs)) {
+		perf_callchain_kernel(regs, entry);
+		if (!current->mm)
+			return entry;
+		regs = task_pt_regs(current);
+	}
+	perf_callchain_user(regs, entry);
+
+	return entry;
+}
+
+static int __init init_hw_perf_events(void)
+{
+	unsigned long cpuid = read_cpuid_id();
+
+	if (cpu_architecture() != CPU_ARCH_ARMv7)
+		return 0;
+	if (ARMV7_PMU_IRQ < 0) {
+		pr_info("perf: no interrupt for the ARMv7 pmu\n");
+		return 0;
+	}
+
+	/* implementer Qualcomm, part 0x00f */
+	if ((cpuid & 0xff00fff0) == 0x510000f0)
+		armv7_pmu = &armv7_scorpion_pmu;
+	else
+		armv7_pmu = &armv7_cortex_pmu;
+
+	perf_max_events = ARMV7_MAX_COUNTERS;
+	pr_info("perf: %s pmu, %d counters\n", armv7_pmu->name,
+		ARMV7_MAX_COUNTERS);
+	return 0;
+}
+arch_initcall(init_hw_perf_events);
@@ -0,0 +1,14 @@
+/*
+ *  linux/arch/arm/kernel/pmu.c
+ *
+ *  Ownership of the cpu performance monitor, see asm/pmu.h.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <asm/pmu.h>
+
+unsigned long arm_pmu_owned;
+EXPORT_SYMBOL_GPL(arm_pmu_owned);
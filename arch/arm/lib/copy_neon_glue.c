@@ -0,0 +1,91 @@
+/*
+ *  linux/arch/arm/lib/copy_neon_glue.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *  Large memcpy() and copy_page() calls made from process context go
+ *  through the NEON loop in copy_neon.S; everything else, and every
+ *  call until the VFP code has probed for NEON, uses the LDM/STM copies.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/hardirq.h>
+#include <linux/moduleparam.h>
+
+#include <asm/neon.h>
+#include <asm/page.h>
+
+extern void __memcpy_neon(void *dest, const void *src, size_t n);
+extern void *__memcpy_arm(void *dest, const void *src, size_t n);
+extern void __copy_page_arm(void *to, const void *from);
+
+/* longest stretch copied with preemption disabled */
+#define NEON_COPY_CHUNK		(16 * 1024)
+
+static int neon_copy_ready __read_mostly;
+static int neon_copy = 1;
+core_param(neon_copy, neon_copy, bool, 0644);
+
+static inline int neon_copy_ok(void)
+{
+	return neon_copy_ready && neon_copy && !in_interrupt();
+}
+
+/* reached from memcpy() for n >= NEON_COPY_MIN */
+void *memcpy_neon(void *dest, const void *src, size_t n)
+{
+	size_t head = -(unsigned long)dest & 15;
+	size_t chunk;
+	void *d = dest;
+
+	if (!neon_copy_ok())
+		return __memcpy_arm(dest, src, n);
+
+	/* align the destination; the source follows if it can */
+	if (head) {
+		__memcpy_arm(d, src, head);
+		d += head;
+		src += head;
+		n -= head;
+	}
+
+	while (n >= 64) {
+		chunk = min_t(size_t, n, NEON_COPY_CHUNK) & ~63;
+		kernel_neon_begin();
+		__memcpy_neon(d, src, chunk);
+		kernel_neon_end();
+		d += chunk;
+		src += chunk;
+		n -= chunk;
+	}
+	if (n)
+		__memcpy_arm(d, src, n);
+
+	return dest;
+}
+
+void copy_page(void *to, const void *from)
+{
+	if (!neon_copy_ok()) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	__memcpy_neon(to, from, PAGE_SIZE);
+	kernel_neon_end();
+}
+
+/* after vfp_init(), which sets HWCAP_NEON */
+static int __init neon_copy_init(void)
+{
+	neon_copy_ready = cpu_has_neon() ? 1 : 0;
+	if (neon_copy_ready)
+		printk(KERN_INFO "NEON bulk copies %s\n",
+		       neon_copy ? "enabled" : "disabled");
+	return 0;
+}
+late_initcall_sync(neon_copy_init);
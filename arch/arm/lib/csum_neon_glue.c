@@ -0,0 +1,102 @@
+/*
+ *  linux/arch/arm/lib/csum_neon_glue.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *  csum_partial() and csum_partial_copy_from_user() for large buffers.
+ *  Most received packets are checksummed in softirq context, where NEON
+ *  cannot be used, so this mainly helps the socket send and receive
+ *  copies made by the task itself; everything else stays scalar.
+ */
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/hardirq.h>
+#include <linux/moduleparam.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#include <asm/checksum.h>
+#include <asm/neon.h>
+
+extern u64 __csum_partial_neon(const void *buf, int len);
+extern __wsum __csum_partial_arm(const void *buff, int len, __wsum sum);
+extern __wsum __csum_partial_copy_from_user_arm(const void __user *src,
+		void *dst, int len, __wsum sum, int *err_ptr);
+
+/* per NEON section; also keeps the 32-bit lanes from overflowing */
+#define NEON_CSUM_CHUNK		(16 * 1024)
+
+static int neon_csum_ready __read_mostly;
+static int neon_csum = 1;
+core_param(neon_csum, neon_csum, bool, 0644);
+
+static inline int neon_csum_ok(void)
+{
+	return neon_csum_ready && neon_csum && !in_interrupt();
+}
+
+static inline u32 csum_fold64(u64 sum)
+{
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	sum = (sum & 0xffffffff) + (sum >> 32);
+	return sum;
+}
+
+/* reached from csum_partial() for len >= NEON_CSUM_MIN */
+__wsum csum_partial_neon(const void *buff, int len, __wsum sum)
+{
+	u64 acc = (__force u32)sum;
+	int chunk;
+
+	if (!neon_csum_ok())
+		return __csum_partial_arm(buff, len, sum);
+
+	while (len >= 64) {
+		chunk = min(len, NEON_CSUM_CHUNK) & ~63;
+		kernel_neon_begin();
+		acc += __csum_partial_neon(buff, chunk);
+		kernel_neon_end();
+		buff += chunk;
+		len -= chunk;
+	}
+
+	/* an even offset, so the scalar tail pairs bytes the same way */
+	sum = (__force __wsum)csum_fold64(acc);
+	if (len)
+		sum = __csum_partial_arm(buff, len, sum);
+	return sum;
+}
+
+/*
+ * Reached from csum_partial_copy_from_user() for len >= NEON_CSUM_MIN.
+ * Copy first, then checksum the destination while it is still in the
+ * cache. On a fault the rest of dst is zeroed and *err_ptr set, as the
+ * assembler version does.
+ */
+__wsum csum_partial_copy_from_user_neon(const void __user *src, void *dst,
+					int len, __wsum sum, int *err_ptr)
+{
+	unsigned long missing;
+
+	if (!neon_csum_ok())
+		return __csum_partial_copy_from_user_arm(src, dst, len, sum,
+							 err_ptr);
+
+	missing = __copy_from_user(dst, src, len);
+	if (unlikely(missing)) {
+		memset(dst + len - missing, 0, missing);
+		*err_ptr = -EFAULT;
+	}
+	return csum_partial_neon(dst, len, sum);
+}
+
+/* after vfp_init(), which sets HWCAP_NEON */
+static int __init neon_csum_init(void)
+{
+	neon_csum_ready = cpu_has_neon() ? 1 : 0;
+	return 0;
+}
+late_initcall_sync(neon_csum_init);
@@ -21,9 +21,12 @@
 #include <linux/mutex.h>
 #include <linux/errno.h>
 #include <linux/cpufreq.h>
+#include <linux/hrtimer.h>
+#include <linux/moduleparam.h>
 #include <linux/regulator/consumer.h>
 
 #include <mach/board.h>
+#include <mach/htc_pwrsink.h>
 #include <mach/msm_iomap.h>
 
 #include "acpuclock.h"
@@ -31,6 +34,9 @@
 #include "clock.h"
 #ifdef CONFIG_CPU_FREQ_VDD_LEVELS
 #include "board-bravo.h"
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/acpuclk.h>
 #endif
 
 #if 0
@@ -112,6 +118,50 @@ struct clkctl_acpu_speed *acpu_stby = &acpu_freq_tbl[2];
 
 struct clkctl_acpu_speed *acpu_mpll = &acpu_freq_tbl[2];
 
+/*
+ * Switch plan between any two table entries, built once the table is
+ * final and again whenever the vdd levels change.  Steps sharing a vdd
+ * never touch the regulator; SCPLL to SCPLL moves just hop the L value
+ * while running from the PLL, instead of detouring via the standby clock.
+ */
+#define PLAN_VDD_UP	(1 << 0)
+#define PLAN_VDD_DOWN	(1 << 1)
+#define PLAN_AXI	(1 << 2)	/* axi rate differs */
+#define PLAN_HOP	(1 << 3)	/* SCPLL -> SCPLL, new L value in place */
+#define PLAN_PLL_PREP	(1 << 4)	/* lock the SCPLL before switching to it */
+#define PLAN_PLL_OFF	(1 << 5)	/* SCPLL -> other, via standby, PLL off */
+
+static u8 switch_plan[ARRAY_SIZE(acpu_freq_tbl)][ARRAY_SIZE(acpu_freq_tbl)];
+
+static int scpll_hop = 1;
+module_param(scpll_hop, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(scpll_hop, "hop SCPLL L values in place, not via standby");
+
+static void acpuclk_build_switch_plan(void)
+{
+	struct clkctl_acpu_speed *cur, *next;
+	u8 plan;
+
+	for (cur = acpu_freq_tbl; cur->acpu_khz; cur++) {
+		for (next = acpu_freq_tbl; next->acpu_khz; next++) {
+			plan = 0;
+			if (next->vdd > cur->vdd)
+				plan |= PLAN_VDD_UP;
+			else if (next->vdd < cur->vdd)
+				plan |= PLAN_VDD_DOWN;
+			if (next->axiclk_khz != cur->axiclk_khz)
+				plan |= PLAN_AXI;
+			if (next->clk_sel == SRC_SCPLL)
+				plan |= cur->clk_sel == SRC_SCPLL ?
+					PLAN_HOP : PLAN_PLL_PREP;
+			else if (cur->clk_sel == SRC_SCPLL)
+				plan |= PLAN_PLL_OFF;
+			switch_plan[cur - acpu_freq_tbl][next - acpu_freq_tbl] =
+				plan;
+		}
+	}
+}
+
 #ifdef CONFIG_CPU_FREQ_TABLE
 static struct cpufreq_frequency_table freq_table[ARRAY_SIZE(acpu_freq_tbl)];
 
@@ -160,6 +210,7 @@ struct clock_state {
 	unsigned long			wait_for_irq_khz;
 	struct clk*			clk_ebi1;
 	struct regulator                *regulator;
+	u64				top_power;
 };
 
 static struct clock_state drv_state = { 0 };
@@ -258,6 +309,16 @@ static void scpll_set_freq(uint32_t lval)
 		;
 }
 
+/* is the SCPLL settled in normal mode at this L value? */
+static int scpll_running_at(uint32_t lval)
+{
+	if ((readl(SCPLL_CTL_ADDR) & PLLMODE_MASK) != PLLMODE_NORMAL)
+		return 0;
+	if (readl(SCPLL_STATUS_ADDR) & 0x3)
+		return 0;
+	return ((readl(SCPLL_FSM_CTL_EXT_ADDR) >> 3) & 0x3f) == lval;
+}
+
 /* this is still a bit weird... */
 static void select_clock(unsigned src, unsigned config)
 {
@@ -283,7 +344,7 @@ static void select_clock(unsigned src, unsigned config)
 	writel(val | ((src & 3) << 1), SPSS_CLK_SEL_ADDR);
 }
 
-static int acpuclk_set_vdd_level(int vdd)
+static int __acpuclk_set_vdd_level(int vdd)
 {
 	if (!drv_state.regulator || IS_ERR(drv_state.regulator)) {
 		drv_state.regulator = regulator_get(NULL, "acpu_vcore");
@@ -300,10 +361,33 @@ static int acpuclk_set_vdd_level(int vdd)
 	return regulator_set_voltage(drv_state.regulator, vdd, vdd);
 }
 
+/* single Scorpion core: transitions are accounted to cpu 0 */
+static int acpuclk_set_vdd_level(int vdd)
+{
+	ktime_t start = ktime_get();
+	int ret = __acpuclk_set_vdd_level(vdd);
+
+	cpufreq_stats_update_latency(0, CPUFREQ_STATS_LATENCY_VDD,
+		ktime_to_us(ktime_sub(ktime_get(), start)));
+	return ret;
+}
+
+/* dynamic power goes with f * V^2, as a percentage of the top speed's */
+static unsigned acpuclk_pwrsink_percent(struct clkctl_acpu_speed *s)
+{
+	if (!drv_state.top_power)
+		return 0;
+	return div64_u64((u64)s->acpu_khz * s->vdd * s->vdd * 100,
+			 drv_state.top_power);
+}
+
 int acpuclk_set_rate(unsigned long rate, enum setrate_reason reason)
 {
 	struct clkctl_acpu_speed *cur, *next;
 	unsigned long flags;
+	ktime_t start;
+	s64 switch_us;
+	u8 plan;
 
 	cur = drv_state.current_speed;
 
@@ -324,34 +408,57 @@ int acpuclk_set_rate(unsigned long rate, enum setrate_reason reason)
 		next++;
 	}
 
+	plan = switch_plan[cur - acpu_freq_tbl][next - acpu_freq_tbl];
+
+	/* Coming off TCXO/MPLL/AXI: bring the SCPLL up and locked at the new
+	 * L value now, while still running from the old source.  That keeps
+	 * the calibration out of the irqs-off switch below and lets it
+	 * overlap the wait for a voltage raise.
+	 */
+	if (plan & PLAN_PLL_PREP)
+		scpll_set_freq(next->sc_l_value);
+
 	if (reason == SETRATE_CPUFREQ) {
 		mutex_lock(&drv_state.lock);
 		/* Increase VDD if needed. */
-		if (next->vdd > cur->vdd) {
+		if (plan & PLAN_VDD_UP) {
 			if (acpuclk_set_vdd_level(next->vdd)) {
 				pr_err("acpuclock: Unable to increase ACPU VDD.\n");
+				if (plan & PLAN_PLL_PREP)
+					scpll_power_down();
 				mutex_unlock(&drv_state.lock);
 				return -EINVAL;
 			}
 		}
 	}
 
+	start = ktime_get();
 	spin_lock_irqsave(&acpu_lock, flags);
 
 	DEBUG("sel=%d cfg=%02x lv=%02x -> sel=%d, cfg=%02x lv=%02x\n",
 	      cur->clk_sel, cur->clk_cfg, cur->sc_l_value,
 	      next->clk_sel, next->clk_cfg, next->sc_l_value);
 
-	if (next->clk_sel == SRC_SCPLL) {
-		/* curr -> standby(MPLL speed) -> target */
-		if (!IS_ACPU_STANDBY(cur))
-			select_clock(acpu_stby->clk_sel, acpu_stby->clk_cfg);
+	if ((plan & PLAN_HOP) && scpll_hop) {
+		/* same source, the FSM hops to the new L value */
 		loops_per_jiffy = next->lpj;
 		scpll_set_freq(next->sc_l_value);
+	} else if (next->clk_sel == SRC_SCPLL) {
+		/* curr -> standby(MPLL speed) -> target, unless the PLL was
+		 * already brought up and is still where we left it
+		 */
+		if (!(plan & PLAN_PLL_PREP) ||
+		    !scpll_running_at(next->sc_l_value)) {
+			if (!IS_ACPU_STANDBY(cur))
+				select_clock(acpu_stby->clk_sel,
+					     acpu_stby->clk_cfg);
+			scpll_set_freq(next->sc_l_value);
+		}
+		loops_per_jiffy = next->lpj;
 		select_clock(SRC_SCPLL, 0);
 	} else {
 		loops_per_jiffy = next->lpj;
-		if (cur->clk_sel == SRC_SCPLL) {
+		if (plan & PLAN_PLL_OFF) {
 			select_clock(acpu_stby->clk_sel, acpu_stby->clk_cfg);
 			select_clock(next->clk_sel, next->clk_cfg);
 			scpll_power_down();
@@ -364,9 +471,18 @@ int acpuclk_set_rate(unsigned long rate, enum setrate_reason reason)
 
 	spin_unlock_irqrestore(&acpu_lock, flags);
 
+	htc_pwrsink_set(PWRSINK_CPU, acpuclk_pwrsink_percent(next));
+
+	switch_us = ktime_to_us(ktime_sub(ktime_get(), start));
+	trace_acpuclk_set_rate(cur->acpu_khz, next->acpu_khz, reason,
+			       switch_us);
+	if (reason == SETRATE_CPUFREQ)
+		cpufreq_stats_update_latency(0, CPUFREQ_STATS_LATENCY_CLOCK,
+					     switch_us);
+
 #ifndef CONFIG_AXI_SCREEN_POLICY
 	if (reason == SETRATE_CPUFREQ || reason == SETRATE_PC) {
-		if (cur->axiclk_khz != next->axiclk_khz)
+		if (plan & PLAN_AXI)
 			clk_set_rate(drv_state.clk_ebi1, next->axiclk_khz * 1000);
 		DEBUG("acpuclk_set_rate switch axi to %d\n",
 			clk_get_rate(drv_state.clk_ebi1));
@@ -374,7 +490,7 @@ int acpuclk_set_rate(unsigned long rate, enum setrate_reason reason)
 #endif
 	if (reason == SETRATE_CPUFREQ) {
 		/* Drop VDD level if we can. */
-		if (next->vdd < cur->vdd) {
+		if (plan & PLAN_VDD_DOWN) {
 			if (acpuclk_set_vdd_level(next->vdd))
 				pr_err("acpuclock: Unable to drop ACPU VDD.\n");
 		}
@@ -551,6 +667,8 @@ unsigned long acpuclk_wait_for_irq(void)
 
 void __init msm_acpu_clock_init(struct msm_acpu_clock_platform_data *clkdata)
 {
+	struct clkctl_acpu_speed *speed;
+
 	spin_lock_init(&acpu_lock);
 	mutex_init(&drv_state.lock);
 
@@ -564,7 +682,11 @@ void __init msm_acpu_clock_init(struct msm_acpu_clock_platform_data *clkdata)
 		acpu_mpll->acpu_khz = clkdata->mpll_khz;
 
 	acpu_freq_tbl_fixup();
+	for (speed = acpu_freq_tbl; speed->acpu_khz; speed++)
+		drv_state.top_power = (u64)speed->acpu_khz * speed->vdd *
+				      speed->vdd;
 	acpuclk_init();
+	acpuclk_build_switch_plan();
 	acpuclk_init_cpufreq_table();
 	drv_state.clk_ebi1 = clk_get(NULL,"ebi1_clk");
 #ifndef CONFIG_AXI_SCREEN_POLICY
@@ -605,6 +727,7 @@ void acpuclk_set_vdd(unsigned acpu_khz, int vdd)
 				acpu_freq_tbl[i].vdd = min(max(vdd, BRAVO_TPS65023_MIN_UV_MV), BRAVO_TPS65023_MAX_UV_MV);
 		}
 	}
+	acpuclk_build_switch_plan();
 	mutex_unlock(&drv_state.lock);
 }
 
@@ -33,12 +33,37 @@
 #define I2C_READ_RETRY_TIMES			10
 #define I2C_WRITE_RETRY_TIMES			10
 #define MICROP_I2C_WRITE_BLOCK_SIZE		80
+#define MICROP_I2C_GUARD_US			1000
+#define MICROP_SHADOW_ENTRIES			16
+#define MICROP_SHADOW_SIZE			8
+#define MICROP_READ_MULTI_MAX			4
 
 static struct i2c_client *private_microp_client;
 static struct microp_ops *board_ops;
 
 static int microp_rw_delay;
 
+/* last value written through microp_i2c_write_cached() per command */
+struct microp_shadow {
+	uint8_t addr;
+	uint8_t len;
+	uint8_t data[MICROP_SHADOW_SIZE];
+};
+
+static struct microp_shadow microp_shadow[MICROP_SHADOW_ENTRIES];
+static int microp_shadow_count;
+static DEFINE_MUTEX(microp_shadow_mutex);
+
+/* the microp wants 1ms between transactions, only sleep for what
+ * is left of it.  Called with microp_i2c_rw_mutex held.
+ */
+static void microp_i2c_guard(struct microp_i2c_client_data *cdata)
+{
+	if (ktime_us_delta(ktime_get(), cdata->last_access) <
+	    MICROP_I2C_GUARD_US)
+		hr_msleep(1);
+}
+
 static char *hex2string(uint8_t *data, int len)
 {
 	static char buf[MICROP_I2C_WRITE_BLOCK_SIZE*4];
@@ -76,12 +101,13 @@ static int i2c_read_block(struct i2c_client *client, uint8_t addr,
 
 	cdata = i2c_get_clientdata(client);
 	mutex_lock(&cdata->microp_i2c_rw_mutex);
-	hr_msleep(1);
+	microp_i2c_guard(cdata);
 	for (retry = 0; retry <= I2C_READ_RETRY_TIMES; retry++) {
 		if (i2c_transfer(client->adapter, msgs, 2) == 2)
 			break;
 		msleep(microp_rw_delay);
 	}
+	cdata->last_access = ktime_get();
 	mutex_unlock(&cdata->microp_i2c_rw_mutex);
 	dev_dbg(&client->dev, "R [%02X] = %s\n",
 			addr, hex2string(data, length));
@@ -125,12 +151,13 @@ static int i2c_write_block(struct i2c_client *client, uint8_t addr,
 		buf[i+1] = data[i];
 
 	mutex_lock(&cdata->microp_i2c_rw_mutex);
-	hr_msleep(1);
+	microp_i2c_guard(cdata);
 	for (retry = 0; retry <= I2C_WRITE_RETRY_TIMES; retry++) {
 		if (i2c_transfer(client->adapter, msg, 1) == 1)
 			break;
 		msleep(microp_rw_delay);
 	}
+	cdata->last_access = ktime_get();
 	if (retry > I2C_WRITE_RETRY_TIMES) {
 		dev_err(&client->dev, "i2c_write_block retry over %d\n",
 			I2C_WRITE_RETRY_TIMES);
@@ -180,6 +207,99 @@ int microp_i2c_write(uint8_t addr, uint8_t *data, int length)
 }
 EXPORT_SYMBOL(microp_i2c_write);
 
+/*
+ * Like microp_i2c_write() for commands that only set state (LED pwm,
+ * backlight...): a write repeating the last value sent is dropped.
+ */
+int microp_i2c_write_cached(uint8_t addr, uint8_t *data, int length)
+{
+	struct microp_shadow *s = NULL;
+	int i, ret;
+
+	if (length > MICROP_SHADOW_SIZE)
+		return microp_i2c_write(addr, data, length);
+
+	mutex_lock(&microp_shadow_mutex);
+	for (i = 0; i < microp_shadow_count; i++) {
+		if (microp_shadow[i].addr == addr) {
+			s = &microp_shadow[i];
+			break;
+		}
+	}
+	if (s && s->len == length && !memcmp(s->data, data, length)) {
+		mutex_unlock(&microp_shadow_mutex);
+		return 0;
+	}
+	if (!s && microp_shadow_count < MICROP_SHADOW_ENTRIES)
+		s = &microp_shadow[microp_shadow_count++];
+
+	ret = microp_i2c_write(addr, data, length);
+	if (s) {
+		s->addr = addr;
+		/* a failed write leaves the microp state unknown */
+		s->len = ret < 0 ? 0 : length;
+		memcpy(s->data, data, length);
+	}
+	mutex_unlock(&microp_shadow_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL(microp_i2c_write_cached);
+
+static void microp_shadow_invalidate(void)
+{
+	mutex_lock(&microp_shadow_mutex);
+	microp_shadow_count = 0;
+	mutex_unlock(&microp_shadow_mutex);
+}
+
+/* read several commands in one transaction, repeated starts between */
+int microp_i2c_read_multi(struct microp_i2c_read_req *req, int num)
+{
+	struct i2c_client *client = private_microp_client;
+	struct microp_i2c_client_data *cdata;
+	struct i2c_msg msgs[2 * MICROP_READ_MULTI_MAX];
+	int i, retry;
+
+	if (!client)	{
+		printk(KERN_ERR "%s: dataset: client is empty\n", __func__);
+		return -EIO;
+	}
+	if (num <= 0 || num > MICROP_READ_MULTI_MAX)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		msgs[2 * i].addr = client->addr;
+		msgs[2 * i].flags = 0;
+		msgs[2 * i].len = 1;
+		msgs[2 * i].buf = &req[i].addr;
+		msgs[2 * i + 1].addr = client->addr;
+		msgs[2 * i + 1].flags = I2C_M_RD;
+		msgs[2 * i + 1].len = req[i].length;
+		msgs[2 * i + 1].buf = req[i].data;
+	}
+
+	cdata = i2c_get_clientdata(client);
+	mutex_lock(&cdata->microp_i2c_rw_mutex);
+	microp_i2c_guard(cdata);
+	for (retry = 0; retry <= I2C_READ_RETRY_TIMES; retry++) {
+		if (i2c_transfer(client->adapter, msgs, 2 * num) == 2 * num)
+			break;
+		msleep(microp_rw_delay);
+	}
+	cdata->last_access = ktime_get();
+	mutex_unlock(&cdata->microp_i2c_rw_mutex);
+
+	if (retry > I2C_READ_RETRY_TIMES) {
+		dev_err(&client->dev, "%s: retry over %d\n", __func__,
+			I2C_READ_RETRY_TIMES);
+		return -EIO;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(microp_i2c_read_multi);
+
 void microp_mobeam_enable(int enable)
 {
 	if (enable)
@@ -380,6 +500,7 @@ static void microp_reset_microp(struct i2c_client *client)
 	udelay(120);
 	gpio_set_value(pdata->gpio_reset, 1);
 	mdelay(5);
+	microp_shadow_invalidate();
 }
 
 static ssize_t microp_version_show(struct device *dev,
@@ -65,6 +65,7 @@ static struct gpio_event_matrix_info bravo_keypad_matrix_info = {
 	.poll_time.tv.nsec = 20 * NSEC_PER_MSEC,
 	.debounce_delay.tv.nsec = 5 * NSEC_PER_MSEC,
 	.flags = (GPIOKPF_LEVEL_TRIGGERED_IRQ |
+		  GPIOKPF_IRQ_RELEASE |
 		  GPIOKPF_REMOVE_PHANTOM_KEYS |
 		  GPIOKPF_PRINT_UNMAPPED_KEYS),
 };
@@ -48,6 +48,7 @@
 #include <mach/msm_hsusb.h>
 #include <mach/msm_iomap.h>
 #include <mach/htc_battery.h>
+#include <mach/htc_pwrsink.h>
 #include <mach/perflock.h>
 #include <mach/msm_serial_debugger.h>
 #include <mach/system.h>
@@ -431,6 +432,58 @@ static struct platform_device bravo_rfkill = {
 	.id = -1,
 };
 
+#ifdef CONFIG_HTC_PWRSINK
+/* full-load currents, estimates for attribution rather than measurements */
+static struct pwr_sink bravo_pwrsink_table[] = {
+	{
+		.id	= PWRSINK_AUDIO,
+		.ua_max	= 90000,
+	},
+	{
+		.id	= PWRSINK_BACKLIGHT,
+		.ua_max	= 200000,
+	},
+	{
+		.id	= PWRSINK_BLUETOOTH,
+		.ua_max	= 15000,
+	},
+	{
+		.id	= PWRSINK_WIFI,
+		.ua_max	= 200000,
+	},
+	{
+		.id	= PWRSINK_CPU,
+		.ua_max	= 350000,
+	},
+	{
+		.id	= PWRSINK_GPU,
+		.ua_max	= 120000,
+	},
+	{
+		.id	= PWRSINK_RADIO,
+		.ua_max	= 250000,
+	},
+	{
+		.id	= PWRSINK_SYSTEM_LOAD,
+		.ua_max	= 100000,
+		.percent_util = 38,
+	},
+};
+
+static struct pwr_sink_platform_data bravo_pwrsink_data = {
+	.num_sinks	= ARRAY_SIZE(bravo_pwrsink_table),
+	.sinks		= bravo_pwrsink_table,
+};
+
+static struct platform_device bravo_pwr_sink = {
+	.name = "htc_pwrsink",
+	.id = -1,
+	.dev	= {
+		.platform_data = &bravo_pwrsink_data,
+	},
+};
+#endif
+
 static struct vreg *vreg_lcm_rftx_2v6;
 static struct vreg *vreg_lcm_aux_2v6;
 
@@ -1229,6 +1282,9 @@ static struct platform_device *devices[] __initdata = {
 	&htc_headset_gpio,
 	&ram_console_device,
 	&bravo_rfkill,
+#ifdef CONFIG_HTC_PWRSINK
+	&bravo_pwr_sink,
+#endif
 	&msm_device_smd,
 	&msm_device_nand,
 	&android_pmem_mdp_device,
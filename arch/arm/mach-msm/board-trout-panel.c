@@ -356,19 +356,33 @@ static struct mddi_table mddi_tpo_deinit_table[] = {
 #define GPIOSEL_VWAKEINT (1U << 0)
 #define INTMASK_VWAKEOUT (1U << 0)
 
+/* Runs of register writes between delays go out as one link list. */
 static void trout_process_mddi_table(struct msm_mddi_client_data *client_data,
 				     struct mddi_table *table, size_t count)
 {
-	int i;
+	struct msm_mddi_reg_write batch[16];
+	int i, n = 0;
+
 	for(i = 0; i < count; i++) {
 		uint32_t reg = table[i].reg;
 		uint32_t value = table[i].value;
 
+		if (reg > 1 && client_data->remote_write_batch) {
+			batch[n].reg = reg;
+			batch[n].val = value;
+			if (++n < ARRAY_SIZE(batch) && i < count - 1)
+				continue;
+		}
+		if (n) {
+			client_data->remote_write_batch(client_data, batch, n);
+			n = 0;
+		}
+
 		if (reg == 0)
 			udelay(value);
 		else if (reg == 1)
 			msleep(value);
-		else
+		else if (!client_data->remote_write_batch)
 			client_data->remote_write(client_data, value, reg);
 	}
 }
@@ -45,20 +45,98 @@ struct clk* axi_clk;  /* hack */
 
 static int clk_set_rate_locked(struct clk *clk, unsigned long rate);
 
+/*
+ * What the modem was last told for each clock, so requests that change
+ * nothing don't cost a proc_comm round trip. A failed call forgets the
+ * cached state.
+ */
+enum {
+	PC_CLK_ENABLED,
+	PC_CLK_RATE,
+	PC_CLK_MIN_RATE,
+	PC_CLK_MAX_RATE,
+	PC_CLK_NR_SHADOW
+};
+
+struct pc_clk_shadow {
+	unsigned val[PC_CLK_NR_SHADOW];
+	unsigned valid;		/* bit per val */
+	unsigned calls;		/* proc_comm calls made */
+	unsigned skipped;	/* calls saved by the shadow */
+};
+
+static struct pc_clk_shadow pc_clk_shadow[NR_CLKS];
+static DEFINE_SPINLOCK(pc_clk_shadow_lock);
+
+/* returns 1 if the modem already has val, else records it */
+static int pc_clk_shadow_hit(unsigned id, int what, unsigned val)
+{
+	struct pc_clk_shadow *sh = &pc_clk_shadow[id];
+	unsigned long flags;
+	int hit;
+
+	if (id >= NR_CLKS)
+		return 0;
+
+	spin_lock_irqsave(&pc_clk_shadow_lock, flags);
+	hit = (sh->valid & (1U << what)) && sh->val[what] == val;
+	sh->val[what] = val;
+	sh->valid |= 1U << what;
+	if (hit)
+		sh->skipped++;
+	spin_unlock_irqrestore(&pc_clk_shadow_lock, flags);
+	return hit;
+}
+
+static void pc_clk_shadow_forget(unsigned id)
+{
+	unsigned long flags;
+
+	if (id >= NR_CLKS)
+		return;
+	spin_lock_irqsave(&pc_clk_shadow_lock, flags);
+	pc_clk_shadow[id].valid = 0;
+	spin_unlock_irqrestore(&pc_clk_shadow_lock, flags);
+}
+
+static int pc_clk_call(unsigned cmd, unsigned *id, unsigned *data2)
+{
+	unsigned long flags;
+
+	if (*id < NR_CLKS) {
+		spin_lock_irqsave(&pc_clk_shadow_lock, flags);
+		pc_clk_shadow[*id].calls++;
+		spin_unlock_irqrestore(&pc_clk_shadow_lock, flags);
+	}
+	return msm_proc_comm(cmd, id, data2);
+}
+
 /*
  * glue for the proc_comm interface
  */
 static inline int pc_clk_enable(unsigned id)
 {
+	unsigned clk_id = id;
+	int rc;
+
 	/* gross hack to set axi clk rate when turning on uartdm clock */
 	if (id == UART1DM_CLK && axi_clk)
 		clk_set_rate_locked(axi_clk, 128000000);
-	return msm_proc_comm(PCOM_CLKCTL_RPC_ENABLE, &id, NULL);
+	if (pc_clk_shadow_hit(id, PC_CLK_ENABLED, 1))
+		return 0;
+	rc = pc_clk_call(PCOM_CLKCTL_RPC_ENABLE, &clk_id, NULL);
+	if (rc)
+		pc_clk_shadow_forget(id);
+	return rc;
 }
 
 static inline void pc_clk_disable(unsigned id)
 {
-	msm_proc_comm(PCOM_CLKCTL_RPC_DISABLE, &id, NULL);
+	unsigned clk_id = id;
+
+	if (!pc_clk_shadow_hit(id, PC_CLK_ENABLED, 0) &&
+	    pc_clk_call(PCOM_CLKCTL_RPC_DISABLE, &clk_id, NULL))
+		pc_clk_shadow_forget(id);
 	if (id == UART1DM_CLK && axi_clk)
 		clk_set_rate_locked(axi_clk, 0);
 }
@@ -67,10 +145,12 @@ static int pc_clk_reset(unsigned id, enum clk_reset_action action)
 {
 	int rc;
 
+	/* a reset may put the clock back to its defaults */
+	pc_clk_shadow_forget(id);
 	if (action == CLK_RESET_ASSERT)
-		rc = msm_proc_comm(PCOM_CLKCTL_RPC_RESET_ASSERT, &id, NULL);
+		rc = msm_proc_comm_sleep(PCOM_CLKCTL_RPC_RESET_ASSERT, &id, NULL);
 	else
-		rc = msm_proc_comm(PCOM_CLKCTL_RPC_RESET_DEASSERT, &id, NULL);
+		rc = msm_proc_comm_sleep(PCOM_CLKCTL_RPC_RESET_DEASSERT, &id, NULL);
 
 	if (rc < 0)
 		return rc;
@@ -78,42 +158,46 @@ static int pc_clk_reset(unsigned id, enum clk_reset_action action)
 		return (int)id < 0 ? -EINVAL : 0;
 }
 
+static int pc_clk_set_rate_cmd(unsigned cmd, int what, unsigned id,
+			       unsigned rate)
+{
+	unsigned clk_id = id;
+	int rc;
+
+	if (pc_clk_shadow_hit(id, what, rate))
+		return 0;
+	rc = pc_clk_call(cmd, &clk_id, &rate);
+	if (rc)
+		pc_clk_shadow_forget(id);
+	return rc;
+}
+
 static inline int pc_clk_set_rate(unsigned id, unsigned rate)
 {
-	return msm_proc_comm(PCOM_CLKCTL_RPC_SET_RATE, &id, &rate);
+	return pc_clk_set_rate_cmd(PCOM_CLKCTL_RPC_SET_RATE, PC_CLK_RATE,
+				   id, rate);
 }
 
-static unsigned ebi1_min_rate = 0;	/* Last EBI1 min rate */
-static spinlock_t ebi1_rate_lock;	/* Avoid race conditions */
 static int pc_clk_set_min_rate(unsigned id, unsigned rate)
 {
-	/* Do not set the same EBI1 min rate via proc comm */
-	if (id == EBI1_CLK) {
-		spin_lock(&ebi1_rate_lock);
-		if (rate == ebi1_min_rate) {
-			spin_unlock(&ebi1_rate_lock);
-			return 0;	/* Return success */
-		}
-		else
-			ebi1_min_rate = rate;
-		spin_unlock(&ebi1_rate_lock);
-	}
-	return msm_proc_comm(PCOM_CLKCTL_RPC_MIN_RATE, &id, &rate);
+	return pc_clk_set_rate_cmd(PCOM_CLKCTL_RPC_MIN_RATE, PC_CLK_MIN_RATE,
+				   id, rate);
 }
 
 static inline int pc_clk_set_max_rate(unsigned id, unsigned rate)
 {
-	return msm_proc_comm(PCOM_CLKCTL_RPC_MAX_RATE, &id, &rate);
+	return pc_clk_set_rate_cmd(PCOM_CLKCTL_RPC_MAX_RATE, PC_CLK_MAX_RATE,
+				   id, rate);
 }
 
 static inline int pc_clk_set_flags(unsigned id, unsigned flags)
 {
-	return msm_proc_comm(PCOM_CLKCTL_RPC_SET_FLAGS, &id, &flags);
+	return pc_clk_call(PCOM_CLKCTL_RPC_SET_FLAGS, &id, &flags);
 }
 
 static inline unsigned pc_clk_get_rate(unsigned id)
 {
-	if (msm_proc_comm(PCOM_CLKCTL_RPC_RATE, &id, NULL))
+	if (pc_clk_call(PCOM_CLKCTL_RPC_RATE, &id, NULL))
 		return 0;
 	else
 		return id;
@@ -121,7 +205,7 @@ static inline unsigned pc_clk_get_rate(unsigned id)
 
 static inline unsigned pc_clk_is_enabled(unsigned id)
 {
-	if (msm_proc_comm(PCOM_CLKCTL_RPC_ENABLED, &id, NULL))
+	if (pc_clk_call(PCOM_CLKCTL_RPC_ENABLED, &id, NULL))
 		return 0;
 	else
 		return id;
@@ -130,7 +214,7 @@ static inline unsigned pc_clk_is_enabled(unsigned id)
 static inline int pc_pll_request(unsigned id, unsigned on)
 {
 	on = !!on;
-	return msm_proc_comm(PCOM_CLKCTL_RPC_PLL_REQUEST, &id, &on);
+	return pc_clk_call(PCOM_CLKCTL_RPC_PLL_REQUEST, &id, &on);
 }
 
 static struct clk *clk_allocate_handle(struct clk *sclk)
@@ -233,6 +317,47 @@ void clk_disable(struct clk *clk)
 }
 EXPORT_SYMBOL(clk_disable);
 
+/*
+ * Enable several clocks under one hold of clocks_lock, for drivers that
+ * switch a group of clocks together. Clocks already on in the modem
+ * are skipped by the shadow state.
+ */
+void clk_enable_many(struct clk **clks, int n)
+{
+	unsigned long flags;
+	struct clk *clk;
+	int i;
+
+	spin_lock_irqsave(&clocks_lock, flags);
+	for (i = 0; i < n; i++) {
+		clk = source_clk(clks[i]);
+		clk->count++;
+		if (clk->count == 1)
+			clk->ops->enable(clk->id);
+	}
+	spin_unlock_irqrestore(&clocks_lock, flags);
+}
+EXPORT_SYMBOL(clk_enable_many);
+
+/* disables in the reverse order of clk_enable_many */
+void clk_disable_many(struct clk **clks, int n)
+{
+	unsigned long flags;
+	struct clk *clk;
+	int i;
+
+	spin_lock_irqsave(&clocks_lock, flags);
+	for (i = n - 1; i >= 0; i--) {
+		clk = source_clk(clks[i]);
+		BUG_ON(clk->count == 0);
+		clk->count--;
+		if (clk->count == 0)
+			clk->ops->disable(clk->id);
+	}
+	spin_unlock_irqrestore(&clocks_lock, flags);
+}
+EXPORT_SYMBOL(clk_disable_many);
+
 int clk_reset(struct clk *clk, enum clk_reset_action action)
 {
 	if (!clk->ops->reset)
@@ -457,7 +582,6 @@ void __init msm_clock_init(void)
 	clk_7x30_init();
 #endif
 	spin_lock_init(&clocks_lock);
-	spin_lock_init(&ebi1_rate_lock);
 	mutex_lock(&clocks_mutex);
 	for (clk = msm_clocks; clk && clk->name; clk++) {
 		set_clock_ops(clk);
@@ -595,6 +719,51 @@ static void __init clock_debug_init(void)
 static inline void __init clock_debug_init(void) {}
 #endif
 
+#if defined(CONFIG_DEBUG_FS)
+static int clk_pcom_stats_show(struct seq_file *m, void *unused)
+{
+	struct hlist_node *pos;
+	struct pc_clk_shadow sh;
+	unsigned long flags;
+	struct clk *clk;
+
+	seq_printf(m, "%-16s %8s %8s\n", "clock", "calls", "skipped");
+	mutex_lock(&clocks_mutex);
+	hlist_for_each_entry(clk, pos, &clocks, list) {
+		if (clk->ops != &clk_ops_pcom || clk->id >= NR_CLKS)
+			continue;
+		spin_lock_irqsave(&pc_clk_shadow_lock, flags);
+		sh = pc_clk_shadow[clk->id];
+		spin_unlock_irqrestore(&pc_clk_shadow_lock, flags);
+		if (sh.calls || sh.skipped)
+			seq_printf(m, "%-16s %8u %8u\n", clk->name,
+				   sh.calls, sh.skipped);
+	}
+	mutex_unlock(&clocks_mutex);
+	return 0;
+}
+
+static int clk_pcom_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, clk_pcom_stats_show, NULL);
+}
+
+static const struct file_operations clk_pcom_stats_fops = {
+	.open		= clk_pcom_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void __init clock_pcom_stats_init(void)
+{
+	debugfs_create_file("clk_pcom_stats", 0444, NULL, NULL,
+			    &clk_pcom_stats_fops);
+}
+#else
+static inline void __init clock_pcom_stats_init(void) {}
+#endif
+
 
 /* The bootloader and/or AMSS may have left various clocks enabled.
  * Disable any clocks that belong to us (CLKFLAG_AUTO_OFF) but have
@@ -622,6 +791,7 @@ static int __init clock_late_init(void)
 	pr_info("clock_late_init() disabled %d unused clocks\n", count);
 
 	clock_debug_init();
+	clock_pcom_stats_init();
 
 	axi_clk = clk_get(NULL, "ebi1_clk");
 
@@ -20,6 +20,7 @@
 #include <linux/io.h>
 #include <linux/interrupt.h>
 #include <linux/module.h>
+#include <linux/slab.h>
 #include <mach/dma.h>
 
 #define MSM_DMOV_CHANNEL_COUNT 16
@@ -163,6 +164,144 @@ int msm_dmov_exec_cmd(unsigned id, unsigned int cmdptr)
 	return 0;
 }
 
+/* each command of a pool is its box array followed by the 64 bit aligned
+ * command pointer, all in one coherent allocation */
+static inline size_t msm_dmov_sg_cmd_size(int max_ents)
+{
+	return ALIGN(max_ents * sizeof(dmov_box), 8) + 8;
+}
+
+struct msm_dmov_sg_pool *msm_dmov_sg_pool_create(int nr_cmds, int max_ents)
+{
+	struct msm_dmov_sg_pool *pool;
+	size_t cmd_size = msm_dmov_sg_cmd_size(max_ents);
+	int i;
+
+	if (nr_cmds <= 0 || max_ents <= 0)
+		return ERR_PTR(-EINVAL);
+
+	pool = kzalloc(sizeof(*pool) + nr_cmds * sizeof(pool->cmds[0]),
+		       GFP_KERNEL);
+	if (!pool)
+		return ERR_PTR(-ENOMEM);
+
+	pool->size = nr_cmds * cmd_size;
+	pool->cpu_addr = dma_alloc_coherent(NULL, pool->size, &pool->busaddr,
+					    GFP_KERNEL);
+	if (!pool->cpu_addr) {
+		kfree(pool);
+		return ERR_PTR(-ENOMEM);
+	}
+	memset(pool->cpu_addr, 0, pool->size);
+
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->free);
+	pool->max_ents = max_ents;
+	pool->nr_cmds = nr_cmds;
+	for (i = 0; i < nr_cmds; i++) {
+		struct msm_dmov_sg_cmd *cmd = &pool->cmds[i];
+		size_t off = i * cmd_size;
+		size_t ptr_off = off + cmd_size - 8;
+
+		cmd->pool = pool;
+		cmd->box = pool->cpu_addr + off;
+		cmd->box_busaddr = pool->busaddr + off;
+		cmd->cmdptr = pool->cpu_addr + ptr_off;
+		cmd->cmdptr_busaddr = pool->busaddr + ptr_off;
+		/* location of command block must be 64 bit aligned */
+		BUG_ON(cmd->box_busaddr & 0x07);
+		list_add_tail(&cmd->list, &pool->free);
+	}
+	return pool;
+}
+EXPORT_SYMBOL(msm_dmov_sg_pool_create);
+
+void msm_dmov_sg_pool_destroy(struct msm_dmov_sg_pool *pool)
+{
+	if (!pool)
+		return;
+	dma_free_coherent(NULL, pool->size, pool->cpu_addr, pool->busaddr);
+	kfree(pool);
+}
+EXPORT_SYMBOL(msm_dmov_sg_pool_destroy);
+
+/* may be called from interrupt context, returns NULL if the pool is empty */
+struct msm_dmov_sg_cmd *msm_dmov_sg_get(struct msm_dmov_sg_pool *pool)
+{
+	struct msm_dmov_sg_cmd *cmd = NULL;
+	unsigned long irq_flags;
+
+	spin_lock_irqsave(&pool->lock, irq_flags);
+	if (!list_empty(&pool->free)) {
+		cmd = list_first_entry(&pool->free, struct msm_dmov_sg_cmd,
+				       list);
+		list_del(&cmd->list);
+		cmd->nents = 0;
+	}
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+	return cmd;
+}
+EXPORT_SYMBOL(msm_dmov_sg_get);
+
+void msm_dmov_sg_put(struct msm_dmov_sg_cmd *cmd)
+{
+	struct msm_dmov_sg_pool *pool = cmd->pool;
+	unsigned long irq_flags;
+
+	spin_lock_irqsave(&pool->lock, irq_flags);
+	list_add(&cmd->list, &pool->free);
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+}
+EXPORT_SYMBOL(msm_dmov_sg_put);
+
+/* adds one box per element of an already mapped scatterlist, moving it in
+ * fifo_size bursts paced by crci. only the last box of the whole list
+ * carries CMD_LC so appended transfers run back to back */
+int msm_dmov_sg_append(struct msm_dmov_sg_cmd *cmd, struct scatterlist *sg,
+		       int nents, uint32_t fifo_addr, unsigned fifo_size,
+		       enum dma_data_direction dir, unsigned crci)
+{
+	dmov_box *box = (dmov_box *)cmd->box + cmd->nents;
+	struct scatterlist *s;
+	uint32_t rows;
+	int i;
+
+	if (nents <= 0 || cmd->nents + nents > cmd->pool->max_ents)
+		return -EINVAL;
+
+	if (cmd->nents)
+		box[-1].cmd &= ~CMD_LC;
+	for_each_sg(sg, s, nents, i) {
+		rows = DIV_ROUND_UP(sg_dma_len(s), fifo_size);
+		box->cmd = CMD_MODE_BOX;
+		box->src_dst_len = (fifo_size << 16) | fifo_size;
+		box->num_rows = rows * ((1 << 16) + 1);
+		if (dir == DMA_FROM_DEVICE) {
+			box->src_row_addr = fifo_addr;
+			box->dst_row_addr = sg_dma_address(s);
+			box->row_offset = fifo_size;
+			box->cmd |= CMD_SRC_CRCI(crci);
+		} else {
+			box->src_row_addr = sg_dma_address(s);
+			box->dst_row_addr = fifo_addr;
+			box->row_offset = fifo_size << 16;
+			box->cmd |= CMD_DST_CRCI(crci);
+		}
+		box++;
+	}
+	box[-1].cmd |= CMD_LC;
+	cmd->nents += nents;
+	return 0;
+}
+EXPORT_SYMBOL(msm_dmov_sg_append);
+
+/* value for msm_dmov_cmd.cmdptr once the list is complete */
+unsigned int msm_dmov_sg_cmdptr(struct msm_dmov_sg_cmd *cmd)
+{
+	*cmd->cmdptr = (cmd->box_busaddr >> 3) | CMD_PTR_LP;
+	return DMOV_CMD_PTR_LIST | DMOV_CMD_ADDR(cmd->cmdptr_busaddr);
+}
+EXPORT_SYMBOL(msm_dmov_sg_cmdptr);
 
 static irqreturn_t msm_datamover_irq_handler(int irq, void *dev_id)
 {
@@ -0,0 +1,251 @@
+/* arch/arm/mach-msm/fiq_profiler.c
+ *
+ * PC sampling driven by the cycle counter overflow routed to the FIQ.
+ * Unlike the perf and oprofile interrupt, the FIQ is taken while
+ * interrupts are disabled, so spinlock and irq-off sections show up in
+ * the samples too.
+ *
+ * debugfs fiq_profiler/period: cycles between samples, 0 stops
+ * debugfs fiq_profiler/samples: one line per sample, writing clears
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/sched.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <asm/ptrace.h>
+#include <asm/pmu.h>
+
+#include <mach/irqs.h>
+#include <mach/fiq.h>
+
+#define FIQ_PROF_IRQ		INT_ARM11_PM
+#define FIQ_PROF_SAMPLES	4096
+
+#define PMNC_E			(1 << 0)
+#define PMNC_C			(1 << 2)
+#define CCNT_BIT		(1U << 31)
+
+#define SAMPLE_USER		(1 << 0)
+#define SAMPLE_IRQS_OFF		(1 << 1)
+
+struct fiq_prof_sample {
+	unsigned long pc;
+	pid_t pid;
+	unsigned int flags;
+};
+
+struct fiq_prof_buf {
+	unsigned int head;
+	unsigned int lost;
+	struct fiq_prof_sample samples[FIQ_PROF_SAMPLES];
+};
+
+static DEFINE_PER_CPU(struct fiq_prof_buf, fiq_prof_bufs);
+static DEFINE_MUTEX(fiq_prof_lock);
+static u32 fiq_prof_period;
+
+static inline u32 pmnc_read(void)
+{
+	u32 val;
+	asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r" (val));
+	return val;
+}
+
+static inline void pmnc_write(u32 val)
+{
+	asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r" (val));
+}
+
+static inline void ccnt_write(u32 val)
+{
+	asm volatile("mcr p15, 0, %0, c9, c13, 0" : : "r" (val));
+}
+
+static inline u32 overflow_getreset(void)
+{
+	u32 val;
+	asm volatile("mrc p15, 0, %0, c9, c12, 3" : "=r" (val));
+	asm volatile("mcr p15, 0, %0, c9, c12, 3" : : "r" (val));
+	return val;
+}
+
+/* runs in FIQ mode: no locks, no printk */
+static void fiq_prof_fiq(void *data, void *regs, void *svc_sp)
+{
+	unsigned long *r = regs;
+	struct fiq_prof_buf *buf;
+	struct fiq_prof_sample *s;
+	struct thread_info *ti;
+
+	if (!(overflow_getreset() & CCNT_BIT))
+		return;
+	ccnt_write(-fiq_prof_period);
+
+	buf = &__get_cpu_var(fiq_prof_bufs);
+	if (buf->head >= FIQ_PROF_SAMPLES) {
+		buf->lost++;
+		return;
+	}
+	s = &buf->samples[buf->head];
+
+	/* current is only valid on the svc stack */
+	ti = (struct thread_info *)((unsigned long)svc_sp & ~(THREAD_SIZE - 1));
+	s->pc = r[15];
+	s->pid = ti->task->pid;
+	s->flags = 0;
+	if ((r[16] & MODE_MASK) == USR_MODE)
+		s->flags |= SAMPLE_USER;
+	if (r[16] & PSR_I_BIT)
+		s->flags |= SAMPLE_IRQS_OFF;
+	buf->head++;
+}
+
+static int fiq_prof_start(u32 period)
+{
+	int ret;
+
+	ret = reserve_pmu();
+	if (ret) {
+		pr_err("fiq_profiler: pmu in use\n");
+		return ret;
+	}
+	ret = msm_fiq_set_handler(fiq_prof_fiq, NULL);
+	if (ret) {
+		release_pmu();
+		return ret;
+	}
+	fiq_prof_period = period;
+
+	msm_fiq_select(FIQ_PROF_IRQ);
+	pmnc_write(pmnc_read() | PMNC_C);
+	ccnt_write(-period);
+	overflow_getreset();
+	asm volatile("mcr p15, 0, %0, c9, c14, 1" : : "r" (CCNT_BIT));
+	asm volatile("mcr p15, 0, %0, c9, c12, 1" : : "r" (CCNT_BIT));
+	pmnc_write(pmnc_read() | PMNC_E);
+	msm_fiq_enable(FIQ_PROF_IRQ);
+	return 0;
+}
+
+static void fiq_prof_stop(void)
+{
+	msm_fiq_disable(FIQ_PROF_IRQ);
+	pmnc_write(pmnc_read() & ~PMNC_E);
+	asm volatile("mcr p15, 0, %0, c9, c12, 2" : : "r" (CCNT_BIT));
+	asm volatile("mcr p15, 0, %0, c9, c14, 2" : : "r" (CCNT_BIT));
+	overflow_getreset();
+	msm_fiq_unselect(FIQ_PROF_IRQ);
+	msm_fiq_remove_handler(fiq_prof_fiq);
+	release_pmu();
+	fiq_prof_period = 0;
+}
+
+static int fiq_prof_period_get(void *data, u64 *val)
+{
+	*val = fiq_prof_period;
+	return 0;
+}
+
+static int fiq_prof_period_set(void *data, u64 val)
+{
+	int ret = 0;
+
+	/* below this the profiler would do nothing but take samples */
+	if (val && (val < 10000 || val > 0xffffffff))
+		return -EINVAL;
+
+	mutex_lock(&fiq_prof_lock);
+	if (fiq_prof_period)
+		fiq_prof_stop();
+	if (val)
+		ret = fiq_prof_start(val);
+	mutex_unlock(&fiq_prof_lock);
+	return ret;
+}
+DEFINE_SIMPLE_ATTRIBUTE(fiq_prof_period_fops, fiq_prof_period_get,
+			fiq_prof_period_set, "%llu\n");
+
+static int fiq_prof_samples_show(struct seq_file *m, void *unused)
+{
+	struct fiq_prof_buf *buf;
+	struct fiq_prof_sample *s;
+	unsigned int i, head;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		buf = &per_cpu(fiq_prof_bufs, cpu);
+		head = buf->head;
+		seq_printf(m, "cpu %d: %u samples, %u lost\n",
+			   cpu, head, buf->lost);
+		for (i = 0; i < head; i++) {
+			s = &buf->samples[i];
+			seq_printf(m, "%5d %c%c %08lx", s->pid,
+				   s->flags & SAMPLE_USER ? 'u' : 'k',
+				   s->flags & SAMPLE_IRQS_OFF ? 'D' : '.',
+				   s->pc);
+			if (!(s->flags & SAMPLE_USER))
+				seq_printf(m, " %pS", (void *)s->pc);
+			seq_putc(m, '\n');
+		}
+	}
+	return 0;
+}
+
+static int fiq_prof_samples_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fiq_prof_samples_show, NULL);
+}
+
+static ssize_t fiq_prof_samples_write(struct file *file,
+				      const char __user *ubuf,
+				      size_t count, loff_t *ppos)
+{
+	struct fiq_prof_buf *buf;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		buf = &per_cpu(fiq_prof_bufs, cpu);
+		local_fiq_disable();
+		buf->head = 0;
+		buf->lost = 0;
+		local_fiq_enable();
+	}
+	return count;
+}
+
+static const struct file_operations fiq_prof_samples_fops = {
+	.open		= fiq_prof_samples_open,
+	.read		= seq_read,
+	.write		= fiq_prof_samples_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init fiq_prof_init(void)
+{
+	struct dentry *dent;
+
+	dent = debugfs_create_dir("fiq_profiler", 0);
+	if (IS_ERR(dent))
+		return PTR_ERR(dent);
+
+	debugfs_create_file("period", 0644, dent, NULL, &fiq_prof_period_fops);
+	debugfs_create_file("samples", 0644, dent, NULL,
+			    &fiq_prof_samples_fops);
+	return 0;
+}
+late_initcall(fiq_prof_init);
@@ -17,6 +17,8 @@
 #include <asm/gpio.h>
 #include <linux/irq.h>
 #include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "gpio_chip.h"
 #include "gpio_hw.h"
 
@@ -40,6 +42,10 @@ module_param_named(debug_mask, msm_gpio_debug_mask, int, S_IRUGO | S_IWUSR | S_I
 #define MSM_GPIOF_ENABLE_WAKE           0x40000000
 #define MSM_GPIOF_DISABLE_WAKE          0x80000000
 
+/* interrupts taken per gpio, and how many of them woke us from sleep */
+static unsigned int msm_gpio_irq_count[NR_GPIO_IRQS];
+static unsigned int msm_gpio_wake_count[NR_GPIO_IRQS];
+
 static int msm_gpio_configure(struct gpio_chip *chip, unsigned int gpio, unsigned long flags);
 static int msm_gpio_get_irq_num(struct gpio_chip *chip, unsigned int gpio, unsigned int *irqp, unsigned long *irqnumflagsp);
 static int msm_gpio_read(struct gpio_chip *chip, unsigned n);
@@ -482,19 +488,22 @@ static int msm_gpio_irq_set_type(unsigned int irq, unsigned int flow_type)
 
 static void msm_gpio_irq_handler(unsigned int irq, struct irq_desc *desc)
 {
-	int i, j, m;
-	unsigned v;
+	int i;
+	unsigned v, gpio;
 
 	for (i = 0; i < ARRAY_SIZE(msm_gpio_chips); i++) {
 		struct msm_gpio_chip *msm_chip = &msm_gpio_chips[i];
+
+		/* int_enable[0] mirrors int_en, no need to read idle banks */
+		if (!msm_chip->int_enable[0])
+			continue;
 		v = readl(msm_chip->regs.int_status);
 		v &= msm_chip->int_enable[0];
 		while (v) {
-			m = v & -v;
-			j = fls(m) - 1;
-			/* printk("msm_gpio_irq_handler %08x %08x bit %d gpio %d irq %d\n", v, m, j, msm_chip->chip.start + j, FIRST_GPIO_IRQ + msm_chip->chip.start + j); */
-			v &= ~m;
-			generic_handle_irq(FIRST_GPIO_IRQ + msm_chip->chip.start + j);
+			gpio = msm_chip->chip.start + __ffs(v);
+			v &= v - 1;
+			msm_gpio_irq_count[gpio]++;
+			generic_handle_irq(FIRST_GPIO_IRQ + gpio);
 		}
 	}
 	desc->chip->ack(irq);
@@ -536,8 +545,19 @@ static void msm_gpio_sleep_int(unsigned long arg)
 	for(i = 0; i < GPIO_SMEM_NUM_GROUPS; i++) {
 		int count = smem_gpio->num_fired[i];
 		for(j = 0; j < count; j++) {
-			/* TODO: Check mask */
-			generic_handle_irq(MSM_GPIO_TO_INT(smem_gpio->fired[i][j]));
+			unsigned gpio = smem_gpio->fired[i][j];
+			struct msm_gpio_chip *msm_chip;
+
+			if (gpio >= NR_GPIO_IRQS)
+				continue;
+			/* the modem reports what fired, not what we still want */
+			msm_chip = get_irq_chip_data(MSM_GPIO_TO_INT(gpio));
+			if (!(msm_chip->int_enable[0] &
+			      (1U << (gpio - msm_chip->chip.start))))
+				continue;
+			msm_gpio_irq_count[gpio]++;
+			msm_gpio_wake_count[gpio]++;
+			generic_handle_irq(MSM_GPIO_TO_INT(gpio));
 		}
 	}
 	local_irq_enable();
@@ -681,3 +701,39 @@ int gpio_tlmm_config(unsigned config, unsigned disable)
 EXPORT_SYMBOL(gpio_tlmm_config);
 
 postcore_initcall(msm_init_gpio);
+
+#if defined(CONFIG_DEBUG_FS)
+static int msm_gpio_irq_stats_show(struct seq_file *m, void *unused)
+{
+	int i;
+
+	seq_printf(m, "gpio       irqs     wakeups\n");
+	for (i = 0; i < NR_GPIO_IRQS; i++) {
+		if (!msm_gpio_irq_count[i] && !msm_gpio_wake_count[i])
+			continue;
+		seq_printf(m, "%4d %10u %10u\n", i, msm_gpio_irq_count[i],
+			   msm_gpio_wake_count[i]);
+	}
+	return 0;
+}
+
+static int msm_gpio_irq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, msm_gpio_irq_stats_show, NULL);
+}
+
+static const struct file_operations msm_gpio_irq_stats_fops = {
+	.open		= msm_gpio_irq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init msm_gpio_debug_init(void)
+{
+	debugfs_create_file("gpio_irq_stats", 0444, NULL, NULL,
+			    &msm_gpio_irq_stats_fops);
+	return 0;
+}
+late_initcall(msm_gpio_debug_init);
+#endif
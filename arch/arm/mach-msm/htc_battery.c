@@ -22,6 +22,7 @@
 #include <linux/platform_device.h>
 #include <linux/debugfs.h>
 #include <linux/wakelock.h>
+#include <linux/earlysuspend.h>
 #include <asm/gpio.h>
 #include <mach/msm_rpcrouter.h>
 #include <mach/board.h>
@@ -121,8 +122,52 @@ static struct msm_rpc_endpoint *endpoint;
 
 static struct htc_battery_info htc_batt_info;
 
-/* Remove cache mechanism to prevent cable status not sync. */
-static unsigned int cache_time;
+/*
+ * Userspace rereads every attribute after a battery uevent; answer those
+ * from the refresh done for the uevent itself. The cable status doesn't
+ * come from the refresh, cable events set it directly.
+ */
+static unsigned int cache_time = 1000;
+module_param(cache_time, uint, S_IRUGO | S_IWUSR | S_IWGRP);
+
+/*
+ * Level and temperature changes are only passed on to userspace once they
+ * reach these deltas (temperature in 0.1 C). Cable events, charging state
+ * changes, the last BATT_LEVEL_LOW percent and full always are.
+ */
+#define BATT_LEVEL_LOW		15
+static unsigned int notify_level_delta = 1;
+module_param(notify_level_delta, uint, S_IRUGO | S_IWUSR | S_IWGRP);
+static unsigned int notify_temp_delta = 20;
+module_param(notify_temp_delta, uint, S_IRUGO | S_IWUSR | S_IWGRP);
+
+/*
+ * While the screen is off on battery the gauge reports less often: the
+ * modem every screen_off_delta percent, the ds2784 at its suspended rate.
+ */
+static unsigned int screen_off_delta = 5;
+module_param(screen_off_delta, uint, S_IRUGO | S_IWUSR | S_IWGRP);
+
+/* what userspace was last told about */
+static struct {
+	int valid;
+	u32 level;
+	s32 batt_temp;
+	u32 charging_enabled;
+	u32 over_vchg;
+} batt_notified;
+
+static struct {
+	unsigned long updates;		/* level updates from the gauge */
+	unsigned long updates_screen_off;
+	unsigned long notified;		/* uevents sent for them */
+	unsigned long suppressed;
+	unsigned long backoffs;
+} batt_stats;
+
+static int batt_screen_off;
+static int batt_backoff;	/* protected by rpc_lock */
+static unsigned batt_delta = 1;	/* level delta asked of the modem */
 
 static int htc_battery_initial = 0;
 static int htc_full_level_flag = 0;
@@ -185,6 +230,7 @@ static struct power_supply htc_power_supplies[] = {
 };
 
 static int update_batt_info(void);
+static void htc_battery_update_backoff(void);
 static void usb_status_notifier_func(int online);
 //static int g_usb_online;
 static struct t_usb_status_notifier usb_status_notifier = {
@@ -310,6 +356,29 @@ static int batt_debug_get(void *data, u64 *val)
 }
 
 DEFINE_SIMPLE_ATTRIBUTE(batt_debug_fops, batt_debug_get, batt_debug_set, "%llu\n");
+
+static ssize_t batt_stats_read(struct file *file, char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	char buf[192];
+	int len;
+
+	len = scnprintf(buf, sizeof(buf),
+			"updates: %lu\n"
+			"updates_screen_off: %lu\n"
+			"notified: %lu\n"
+			"suppressed: %lu\n"
+			"backoffs: %lu\n",
+			batt_stats.updates, batt_stats.updates_screen_off,
+			batt_stats.notified, batt_stats.suppressed,
+			batt_stats.backoffs);
+	return simple_read_from_buffer(ubuf, count, ppos, buf, len);
+}
+
+static const struct file_operations batt_stats_fops = {
+	.read = batt_stats_read,
+};
+
 static int __init batt_debug_init(void)
 {
 	struct dentry *dent;
@@ -319,6 +388,7 @@ static int __init batt_debug_init(void)
 		return PTR_ERR(dent);
 
 	debugfs_create_file("charger_state", 0644, dent, NULL, &batt_debug_fops);
+	debugfs_create_file("stats", 0444, dent, NULL, &batt_stats_fops);
 
 	return 0;
 }
@@ -398,28 +468,66 @@ result:
 	return rc;
 }
 
-static int htc_battery_status_update(u32 curr_level)
+static int htc_batt_changed_locked(void)
+{
+	struct battery_info_reply *rep = &htc_batt_info.rep;
+	int level = rep->level, last = batt_notified.level;
+
+	if (!batt_notified.valid)
+		return 1;
+	if (level != last && (abs(level - last) >= notify_level_delta ||
+			      level <= BATT_LEVEL_LOW || level == 100))
+		return 1;
+	if (abs(rep->batt_temp - batt_notified.batt_temp) >= notify_temp_delta)
+		return 1;
+	/* the modem reports charging stopped over temp this way */
+	return rep->charging_enabled != batt_notified.charging_enabled ||
+		rep->over_vchg != batt_notified.over_vchg;
+}
+
+/*
+ * The gauge reported a new level, or force for a fault: refresh the rest
+ * of the info with it and tell userspace if anything moved enough.
+ */
+static int htc_battery_status_update(u32 curr_level, int force)
 {
 	int notify;
+
 	if (!htc_battery_initial)
 		return 0;
 
+	batt_stats.updates++;
+	if (batt_screen_off)
+		batt_stats.updates_screen_off++;
+
+	mutex_lock(&htc_batt_info.rpc_lock);
+	if (update_batt_info())
+		force = 1;
+	else
+		htc_batt_info.update_time = jiffies;
+	mutex_unlock(&htc_batt_info.rpc_lock);
+
 	mutex_lock(&htc_batt_info.lock);
-	notify = (htc_batt_info.rep.level != curr_level);
 	htc_batt_info.rep.level = curr_level;
-	mutex_unlock(&htc_batt_info.lock);
-#if 0
+	notify = force || htc_batt_changed_locked();
 	if (notify) {
-		power_supply_changed(&htc_power_supplies[CHARGER_BATTERY]);
-		if (htc_batt_debug_mask & HTC_BATT_DEBUG_UEVT)
-			BATT_LOG("power_supply_changed: battery");
+		batt_notified.valid = 1;
+		batt_notified.level = curr_level;
+		batt_notified.batt_temp = htc_batt_info.rep.batt_temp;
+		batt_notified.charging_enabled =
+			htc_batt_info.rep.charging_enabled;
+		batt_notified.over_vchg = htc_batt_info.rep.over_vchg;
 	}
-#else
-	/* we don't check level here for charging over temp RPC call */
-		power_supply_changed(&htc_power_supplies[CHARGER_BATTERY]);
+	mutex_unlock(&htc_batt_info.lock);
+
+	if (!notify) {
+		batt_stats.suppressed++;
+		return 0;
+	}
+	batt_stats.notified++;
+	power_supply_changed(&htc_power_supplies[CHARGER_BATTERY]);
 	if (htc_batt_debug_mask & HTC_BATT_DEBUG_UEVT)
 		BATT_LOG("batt:power_supply_changed: battery");
-#endif
 	return 0;
 }
 
@@ -558,6 +666,7 @@ static int htc_cable_status_update(int status)
 #endif
 	mutex_unlock(&htc_batt_info.lock);
 
+	htc_battery_update_backoff();
 	return rc;
 }
 
@@ -615,6 +724,7 @@ static void usb_status_notifier_func(int online)
 	power_supply_changed(&htc_power_supplies[CHARGER_USB]);
 	power_supply_changed(&htc_power_supplies[CHARGER_BATTERY]);
 	update_wake_lock(htc_batt_info.rep.charging_source);
+	htc_battery_update_backoff();
 #else
 	mutex_lock(&htc_batt_info.lock);
 	if (htc_batt_debug_mask & HTC_BATT_DEBUG_USB_NOTIFY)
@@ -1135,7 +1245,9 @@ static ssize_t htc_battery_set_delta(struct device *dev,
 		return -EINVAL;
 
 	mutex_lock(&htc_batt_info.rpc_lock);
-	rc = htc_rpc_set_delta(delta);
+	batt_delta = delta;
+	rc = htc_rpc_set_delta(batt_backoff ? max(batt_delta, screen_off_delta) :
+			       batt_delta);
 	mutex_unlock(&htc_batt_info.rpc_lock);
 	if (rc < 0)
 		return rc;
@@ -1260,6 +1372,61 @@ succeed:
 	return rc;
 }
 
+/*
+ * Slow the gauge down while the screen is off on battery, and back up
+ * when either changes.
+ */
+static void htc_battery_update_backoff(void)
+{
+	int on;
+
+	mutex_lock(&htc_batt_info.rpc_lock);
+	on = batt_screen_off &&
+		htc_batt_info.rep.charging_source == CHARGER_BATTERY;
+	if (on == batt_backoff)
+		goto done;
+	batt_backoff = on;
+	if (on)
+		batt_stats.backoffs++;
+
+	switch (htc_batt_info.guage_driver) {
+	case GUAGE_MODEM:
+		if (htc_rpc_set_delta(on ? max(batt_delta, screen_off_delta) :
+				      batt_delta) < 0)
+			BATT_ERR("%s: set delta failed", __func__);
+		break;
+#ifdef CONFIG_BATTERY_DS2784
+	case GUAGE_DS2784:
+		ds2784_set_poll_backoff(on);
+		break;
+#endif
+	}
+done:
+	mutex_unlock(&htc_batt_info.rpc_lock);
+}
+
+#ifdef CONFIG_HAS_EARLYSUSPEND
+static void htc_battery_early_suspend(struct early_suspend *h)
+{
+	batt_screen_off = 1;
+	htc_battery_update_backoff();
+}
+
+static void htc_battery_late_resume(struct early_suspend *h)
+{
+	batt_screen_off = 0;
+	htc_battery_update_backoff();
+	/* catch up with what the coarser updates left out */
+	htc_battery_status_update(htc_batt_info.rep.level, 0);
+}
+
+static struct early_suspend htc_battery_early_suspend_handler = {
+	.level = EARLY_SUSPEND_LEVEL_DISABLE_FB + 1,
+	.suspend = htc_battery_early_suspend,
+	.resume = htc_battery_late_resume,
+};
+#endif
+
 static int update_batt_info(void)
 {
 	int ret = 0;
@@ -1423,11 +1590,15 @@ static int htc_battery_core_probe(struct platform_device *pdev)
 	if (htc_get_batt_info(&htc_batt_info.rep) < 0)
 		BATT_ERR("%s: get info failed", __func__);
 
-	if (htc_rpc_set_delta(1) < 0)
+	if (htc_rpc_set_delta(batt_delta) < 0)
 		BATT_ERR("%s: set delta failed", __func__);
 	htc_batt_info.update_time = jiffies;
 	mutex_unlock(&htc_batt_info.rpc_lock);
 
+#ifdef CONFIG_HAS_EARLYSUSPEND
+	register_early_suspend(&htc_battery_early_suspend_handler);
+#endif
+
 	return 0;
 }
 
@@ -1503,7 +1674,7 @@ static int handle_battery_call(struct msm_rpc_server *server,
 		args->level = be32_to_cpu(args->level);
 		if (htc_batt_debug_mask & HTC_BATT_DEBUG_M2A_RPC)
 			BATT_LOG("M2A_RPC: level_update: %d", args->level);
-		htc_battery_status_update(args->level);
+		htc_battery_status_update(args->level, 0);
 		return 0;
 	}
 	default:
@@ -1537,11 +1708,11 @@ static int ds2784_notifier_func(struct notifier_block *nfb,
 //			set_charger_ctrl(arg);
 		break;
 	case DS2784_LEVEL_UPDATE:
-		htc_battery_status_update(arg);
+		htc_battery_status_update(arg, 0);
 		break;
 	case DS2784_BATTERY_FAULT:
 	case DS2784_OVER_TEMP:
-		htc_battery_status_update(htc_batt_info.rep.level);
+		htc_battery_status_update(htc_batt_info.rep.level, 1);
 		break;
 	default:
 		return NOTIFY_BAD;
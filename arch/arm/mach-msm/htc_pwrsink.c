@@ -22,6 +22,8 @@
 #include <linux/device.h>
 #include <linux/debugfs.h>
 #include <linux/earlysuspend.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
 #include <mach/msm_smd.h>
 #include <mach/htc_pwrsink.h>
 
@@ -43,13 +45,120 @@ static DEFINE_SPINLOCK(sink_lock);
 static DEFINE_SPINLOCK(audio_sink_lock);
 static unsigned long total_sink;
 static uint32_t *smem_total_sink;
+static unsigned long smem_retry;
+
+/*
+ * Energy attribution. Each sink's current (ua_max * percent_util) is
+ * integrated over time into a charge, in uA*ms, at every change of its
+ * utilization. The charge also goes to the uid that owns the sink at
+ * the time, or to uid 0 when no driver named an owner.
+ */
+#define PWRSINK_UIDS		32
+#define PWRSINK_UA_MS_PER_UAH	(3600 * MSEC_PER_SEC)
+
+struct pwrsink_energy {
+	uid_t owner;
+	ktime_t since;
+	u64 charge;
+};
+
+struct pwrsink_uid_energy {
+	uid_t uid;
+	u64 charge;
+};
+
+static const char *sink_names[PWRSINK_LAST + 1] = {
+	[PWRSINK_SYSTEM_LOAD]	= "system",
+	[PWRSINK_AUDIO]		= "audio",
+	[PWRSINK_BACKLIGHT]	= "backlight",
+	[PWRSINK_LED_BUTTON]	= "led_button",
+	[PWRSINK_LED_KEYBOARD]	= "led_keyboard",
+	[PWRSINK_GP_CLK]	= "gp_clk",
+	[PWRSINK_BLUETOOTH]	= "bluetooth",
+	[PWRSINK_CAMERA]	= "camera",
+	[PWRSINK_SDCARD]	= "sdcard",
+	[PWRSINK_VIDEO]		= "video",
+	[PWRSINK_WIFI]		= "wifi",
+	[PWRSINK_CPU]		= "cpu",
+	[PWRSINK_GPU]		= "gpu",
+	[PWRSINK_RADIO]		= "radio",
+};
+
+static struct pwrsink_energy sink_energy[PWRSINK_LAST + 1];
+static struct pwrsink_uid_energy uid_energy[PWRSINK_UIDS];
+static int uid_energy_count;
+/* uids that did not fit in uid_energy */
+static u64 uid_energy_other;
+
+static void pwrsink_charge_uid_locked(uid_t uid, u64 charge)
+{
+	int i;
+
+	for (i = 0; i < uid_energy_count; i++) {
+		if (uid_energy[i].uid == uid) {
+			uid_energy[i].charge += charge;
+			return;
+		}
+	}
+	if (uid_energy_count == PWRSINK_UIDS) {
+		uid_energy_other += charge;
+		return;
+	}
+	uid_energy[uid_energy_count].uid = uid;
+	uid_energy[uid_energy_count].charge = charge;
+	uid_energy_count++;
+}
+
+/* Caller must hold sink_lock */
+static void pwrsink_integrate_locked(pwrsink_id_type id, ktime_t now)
+{
+	struct pwr_sink *sink = sink_array[id];
+	struct pwrsink_energy *e = &sink_energy[id];
+	u64 ms = div_u64(ktime_to_us(ktime_sub(now, e->since)), USEC_PER_MSEC);
+	u64 charge;
+
+	charge = (u64)(sink->ua_max * sink->percent_util / 100) * ms;
+	e->since = now;
+	if (!charge)
+		return;
+	e->charge += charge;
+	pwrsink_charge_uid_locked(e->owner, charge);
+}
+
+int htc_pwrsink_set_owner(pwrsink_id_type id, uid_t uid)
+{
+	unsigned long flags;
+
+	if (!initialized)
+		return -EAGAIN;
+
+	if (id < 0 || id > PWRSINK_LAST)
+		return -EINVAL;
+
+	spin_lock_irqsave(&sink_lock, flags);
+	if (!sink_array[id]) {
+		spin_unlock_irqrestore(&sink_lock, flags);
+		return -ENOENT;
+	}
+	if (sink_energy[id].owner != uid) {
+		pwrsink_integrate_locked(id, ktime_get());
+		sink_energy[id].owner = uid;
+	}
+	spin_unlock_irqrestore(&sink_lock, flags);
+	return 0;
+}
+EXPORT_SYMBOL(htc_pwrsink_set_owner);
 
 int htc_pwrsink_set(pwrsink_id_type id, unsigned percent_utilized)
 {
 	unsigned long flags;
 
-	if (!smem_total_sink)
+	/* retried at most once a second, this runs on every cpu speed change */
+	if (!smem_total_sink &&
+	    (!smem_retry || time_after_eq(jiffies, smem_retry))) {
 		smem_total_sink = smem_alloc(SMEM_ID_VENDOR0, sizeof(uint32_t));
+		smem_retry = jiffies + HZ;
+	}
 
 	if (!initialized)
 		return -EAGAIN;
@@ -69,6 +178,7 @@ int htc_pwrsink_set(pwrsink_id_type id, unsigned percent_utilized)
 		return 0;
 	}
 
+	pwrsink_integrate_locked(id, ktime_get());
 	total_sink -= (sink_array[id]->ua_max *
 		       sink_array[id]->percent_util / 100);
 	sink_array[id]->percent_util = percent_utilized;
@@ -197,6 +307,70 @@ int htc_pwrsink_audio_path_set(unsigned path)
 }
 EXPORT_SYMBOL(htc_pwrsink_audio_path_set);
 
+static void pwrsink_print_charge(struct seq_file *m, u64 charge)
+{
+	u64 uah = div_u64(charge, PWRSINK_UA_MS_PER_UAH);
+	u32 frac;
+
+	uah = div_u64_rem(uah, 1000, &frac);
+	seq_printf(m, "%llu.%03u mAh\n", uah, frac);
+}
+
+static int pwrsink_energy_show(struct seq_file *m, void *unused)
+{
+	struct pwrsink_energy energy[PWRSINK_LAST + 1];
+	struct pwrsink_uid_energy uids[PWRSINK_UIDS];
+	unsigned percent[PWRSINK_LAST + 1];
+	unsigned long flags;
+	ktime_t now = ktime_get();
+	int i, nuids;
+	u64 other;
+
+	spin_lock_irqsave(&sink_lock, flags);
+	for (i = 0; i <= PWRSINK_LAST; i++) {
+		if (!sink_array[i])
+			continue;
+		pwrsink_integrate_locked(i, now);
+		percent[i] = sink_array[i]->percent_util;
+	}
+	memcpy(energy, sink_energy, sizeof(energy));
+	nuids = uid_energy_count;
+	memcpy(uids, uid_energy, nuids * sizeof(uids[0]));
+	other = uid_energy_other;
+	spin_unlock_irqrestore(&sink_lock, flags);
+
+	seq_printf(m, "total now: %lu uA\n", total_sink);
+	for (i = 0; i <= PWRSINK_LAST; i++) {
+		if (!sink_array[i])
+			continue;
+		seq_printf(m, "%-12s %3u%% of %6u uA, uid %5u: ",
+			   sink_names[i], percent[i], sink_array[i]->ua_max,
+			   energy[i].owner);
+		pwrsink_print_charge(m, energy[i].charge);
+	}
+	for (i = 0; i < nuids; i++) {
+		seq_printf(m, "uid %5u: ", uids[i].uid);
+		pwrsink_print_charge(m, uids[i].charge);
+	}
+	if (other) {
+		seq_printf(m, "uid other: ");
+		pwrsink_print_charge(m, other);
+	}
+	return 0;
+}
+
+static int pwrsink_energy_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pwrsink_energy_show, NULL);
+}
+
+static const struct file_operations pwrsink_energy_fops = {
+	.open		= pwrsink_energy_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void htc_pwrsink_suspend_early(struct early_suspend *h)
 {
 	htc_pwrsink_set(PWRSINK_SYSTEM_LOAD, 7);
@@ -248,6 +422,7 @@ static int __init htc_pwrsink_probe(struct platform_device *pdev)
 	total_sink = 0;
 	for (i = 0; i < pdata->num_sinks; i++) {
 		sink_array[pdata->sinks[i].id] = &pdata->sinks[i];
+		sink_energy[pdata->sinks[i].id].since = ktime_get();
 		total_sink += (pdata->sinks[i].ua_max *
 			       pdata->sinks[i].percent_util / 100);
 	}
@@ -262,6 +437,8 @@ static int __init htc_pwrsink_probe(struct platform_device *pdev)
 #endif
 	register_early_suspend(&htc_pwrsink_early_suspend);
 
+	debugfs_create_file("pwrsink_energy", S_IRUGO, NULL, NULL,
+			    &pwrsink_energy_fops);
 	return 0;
 }
 
@@ -228,6 +228,7 @@ struct microp_i2c_client_data {
 	uint32_t als_func;
 	struct hrtimer gen_irq_timer;
 	uint16_t intr_status;
+	ktime_t last_access;
 };
 
 struct lightsensor_platform_data{
@@ -251,6 +252,15 @@ struct microp_ops {
 
 int microp_i2c_read(uint8_t addr, uint8_t *data, int length);
 int microp_i2c_write(uint8_t addr, uint8_t *data, int length);
+int microp_i2c_write_cached(uint8_t addr, uint8_t *data, int length);
+
+struct microp_i2c_read_req {
+	uint8_t addr;
+	uint8_t *data;
+	int length;
+};
+
+int microp_i2c_read_multi(struct microp_i2c_read_req *req, int num);
 int microp_function_check(struct i2c_client *client, uint8_t category);
 int microp_read_gpio_status(uint8_t *data);
 int microp_write_interrupt(struct i2c_client *client,
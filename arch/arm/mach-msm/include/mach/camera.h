@@ -6,6 +6,7 @@
 #define __ASM__ARCH_CAMERA_H
 
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/poll.h>
 #include <linux/cdev.h>
 #include <linux/platform_device.h>
@@ -126,6 +127,27 @@ struct msm_queue_cmd {
 	enum msm_queue type;
 	void *command;
 	int on_heap;
+	/* the pool the command was taken from, NULL if it was kmalloced */
+	struct msm_qcmd_pool *pool;
+};
+
+#define MSM_QCMD_POOL_SLOTS	64
+#define MSM_QCMD_SLOT_SIZE	256
+
+/* Preallocated commands for the VFE messages, which arrive in interrupt
+ * context.  A message that doesn't fit in a slot, or arrives while every
+ * slot is still queued, is kmalloced instead and counted as an overflow;
+ * one that can't be allocated at all is dropped.
+ */
+struct msm_qcmd_pool {
+	spinlock_t lock;
+	void *slots;
+	/* stack of free slot numbers */
+	uint8_t free[MSM_QCMD_POOL_SLOTS];
+	int nr_free;
+	int min_free;
+	unsigned long overflow;
+	unsigned long dropped;
 };
 
 struct msm_device_queue {
@@ -137,13 +159,38 @@ struct msm_device_queue {
 	const char *name;
 };
 
+struct msm_frame_consumer {
+	/* (1 << OUTPUT_TYPE_*) of the paths shared, 0 if not registered */
+	uint32_t paths;
+	/* regions queued through their consumer_node */
+	struct list_head list;
+	wait_queue_head_t wait;
+};
+
+#define MSM_PMEM_HASH_BITS 4
+
+/* The pmem regions registered for one purpose (frames or stats).  The list
+ * is walked when the VFE is configured; the per-frame lookups go through
+ * the tree, ordered by physical address since regions never overlap, and
+ * two hashes, one keyed by the address the VFE reports and one by the
+ * user address.
+ */
+struct msm_pmem_table {
+	struct hlist_head list;
+	struct rb_root by_paddr;
+	struct hlist_head by_vfe_addr[1 << MSM_PMEM_HASH_BITS];
+	struct hlist_head by_vaddr[1 << MSM_PMEM_HASH_BITS];
+	/* the VFE reports frames by their Y plane address */
+	int vfe_addr_y_off;
+};
+
 struct msm_sync {
 	/* These two queues are accessed from a process context only.  They contain
 	 * pmem descriptors for the preview frames and the stats coming from the
 	 * camera sensor.
 	 */
-	struct hlist_head pmem_frames;
-	struct hlist_head pmem_stats;
+	struct msm_pmem_table pmem_frames;
+	struct msm_pmem_table pmem_stats;
 
 	/* The message queue is used by the control thread to send commands
 	 * to the config thread, and also by the DSP to send messages to the
@@ -164,6 +211,14 @@ struct msm_sync {
 	struct msm_device_queue pict_q;
 	int get_pic_abort;
 
+	/* backs the commands of the three queues above */
+	struct msm_qcmd_pool qcmd_pool;
+
+	/* frames shared with consumers other than the frame thread; the lock
+	 * protects the lists and the frame refs */
+	spinlock_t frame_lock;
+	struct msm_frame_consumer consumers[MSM_FRAME_CONSUMER_MAX];
+
 	struct msm_camera_sensor_info *sdata;
 	struct msm_camvfe_fn vfefn;
 	struct msm_sensor_ctrl sctrl;
@@ -223,6 +278,9 @@ struct register_address_value_pair {
 
 struct msm_pmem_region {
 	struct hlist_node list;
+	struct rb_node pnode;
+	struct hlist_node vfe_node;
+	struct hlist_node vnode;
 	unsigned long paddr;
 //#ifdef CONFIG_MSM_CAMERA_LEGACY
 	unsigned long kvaddr;
@@ -230,6 +288,10 @@ struct msm_pmem_region {
 	unsigned long len;
 	struct file *file;
 	struct msm_pmem_info info;
+	/* consumers holding the frame, see MSM_FRAME_CONSUMER_* */
+	int refs;
+	int path;
+	struct list_head consumer_node[MSM_FRAME_CONSUMER_MAX];
 };
 
 struct axidata {
@@ -51,4 +51,8 @@ int clk_set_max_rate(struct clk *clk, unsigned long rate);
 int clk_reset(struct clk *clk, enum clk_reset_action action);
 
 int clk_set_flags(struct clk *clk, unsigned long flags);
+
+/* Switch a group of clocks together, disable takes them in reverse */
+void clk_enable_many(struct clk **clks, int n);
+void clk_disable_many(struct clk **clks, int n);
 #endif
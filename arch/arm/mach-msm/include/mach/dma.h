@@ -18,6 +18,9 @@
 #ifndef __ASM_ARCH_MSM_DMA_H
 
 #include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/dma-mapping.h>
+#include <linux/scatterlist.h>
 #include <mach/msm_iomap.h>
 
 struct msm_dmov_errdata {
@@ -40,6 +43,47 @@ void msm_dmov_stop_cmd(unsigned id, struct msm_dmov_cmd *cmd, int graceful);
 void msm_dmov_flush(unsigned int id);
 int msm_dmov_exec_cmd(unsigned id, unsigned int cmdptr);
 
+/* box mode command lists moving a mapped scatterlist to or from a device
+ * fifo. a list can be appended to several times so a batch of transfers
+ * completes with a single data mover interrupt */
+struct msm_dmov_sg_pool;
+
+struct msm_dmov_sg_cmd {
+	struct list_head list;
+	struct msm_dmov_sg_pool *pool;
+	void *box;			/* dmov_box[max_ents] */
+	uint32_t *cmdptr;
+	dma_addr_t box_busaddr;
+	dma_addr_t cmdptr_busaddr;
+	int nents;
+};
+
+struct msm_dmov_sg_pool {
+	spinlock_t lock;
+	struct list_head free;
+	int max_ents;
+	int nr_cmds;
+	void *cpu_addr;
+	dma_addr_t busaddr;
+	size_t size;
+	struct msm_dmov_sg_cmd cmds[0];
+};
+
+struct msm_dmov_sg_pool *msm_dmov_sg_pool_create(int nr_cmds, int max_ents);
+void msm_dmov_sg_pool_destroy(struct msm_dmov_sg_pool *pool);
+struct msm_dmov_sg_cmd *msm_dmov_sg_get(struct msm_dmov_sg_pool *pool);
+void msm_dmov_sg_put(struct msm_dmov_sg_cmd *cmd);
+int msm_dmov_sg_append(struct msm_dmov_sg_cmd *cmd, struct scatterlist *sg,
+		       int nents, uint32_t fifo_addr, unsigned fifo_size,
+		       enum dma_data_direction dir, unsigned crci);
+unsigned int msm_dmov_sg_cmdptr(struct msm_dmov_sg_cmd *cmd);
+
+/* empty the list of a command kept across transfers */
+static inline void msm_dmov_sg_reset(struct msm_dmov_sg_cmd *cmd)
+{
+	cmd->nents = 0;
+}
+
 
 
 #define DMOV_SD0(off, ch) (MSM_DMOV_BASE + 0x0000 + (off) + ((ch) << 2))
@@ -24,9 +24,10 @@ void msm_fiq_unselect(int number);
 void msm_fiq_enable(int number);
 void msm_fiq_disable(int number);
 
-/* install an FIQ handler */
+/* install an FIQ handler, called for every FIQ along with the others */
 int msm_fiq_set_handler(void (*func)(void *data, void *regs, void *svc_sp),
 			void *data);
+void msm_fiq_remove_handler(void (*func)(void *data, void *regs, void *svc_sp));
 
 /* cause an edge triggered interrupt to fire (safe from FIQ context */
 void msm_trigger_irq(int number);
@@ -45,8 +45,11 @@ typedef enum {
 	PWRSINK_SDCARD,
 	PWRSINK_VIDEO,
 	PWRSINK_WIFI,
+	PWRSINK_CPU,
+	PWRSINK_GPU,
+	PWRSINK_RADIO,
 
-	PWRSINK_LAST = PWRSINK_WIFI,
+	PWRSINK_LAST = PWRSINK_RADIO,
 	PWRSINK_INVALID
 } pwrsink_id_type;
 
@@ -75,6 +78,10 @@ static inline int htc_pwrsink_audio_set(pwrsink_audio_id_type id,
 static inline int htc_pwrsink_audio_volume_set(
 	pwrsink_audio_id_type id, unsigned volume) { return 0; }
 static inline int htc_pwrsink_audio_path_set(unsigned path) { return 0; }
+static inline int htc_pwrsink_set_owner(pwrsink_id_type id, uid_t uid)
+{
+	return 0;
+}
 #else
 extern int htc_pwrsink_set(pwrsink_id_type id, unsigned percent);
 extern int htc_pwrsink_audio_set(pwrsink_audio_id_type id,
@@ -82,6 +89,8 @@ extern int htc_pwrsink_audio_set(pwrsink_audio_id_type id,
 extern int htc_pwrsink_audio_volume_set(pwrsink_audio_id_type id,
 	unsigned volume);
 extern int htc_pwrsink_audio_path_set(unsigned path);
+/* charge the sink's use from now on to uid, until the next call */
+extern int htc_pwrsink_set_owner(pwrsink_id_type id, uid_t uid);
 #endif
 
 #endif
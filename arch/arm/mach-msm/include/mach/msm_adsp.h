@@ -46,6 +46,19 @@ int msm_adsp_write(struct msm_adsp_module *module,
 		   unsigned queue_id,
 		   void *data, size_t len);
 
+struct msm_adsp_cmd {
+	unsigned queue_id;
+	void *data;
+	size_t len;
+};
+
+/* Write several commands back to back under one hold of the command
+ * lock, for drivers that issue a handful per frame. Also safe to call
+ * from interrupt context.
+ */
+int msm_adsp_write_batch(struct msm_adsp_module *module,
+			 struct msm_adsp_cmd *cmds, int count);
+
 #if CONFIG_MSM_AMSS_VERSION >= 6350
 /* Command Queue Indexes */
 #define QDSP_lpmCommandQueue              0
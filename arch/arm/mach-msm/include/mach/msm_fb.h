@@ -105,6 +105,8 @@ struct msm_panel_data {
 
 	/* capabilities supported by the panel */
 	uint32_t caps;
+	/* frame the bootloader left on the panel, 0 if it was off */
+	uint32_t boot_fb;
 	/*
 	 * For samsung driver IC, we always need to indicate where
 	 * to draw. So we pass update_into to mddi client.
@@ -134,6 +136,11 @@ struct msm_mdp_platform_data {
 	unsigned sync_start_pos;
 };
 
+struct msm_mddi_reg_write {
+	uint32_t reg;
+	uint32_t val;
+};
+
 struct msm_mddi_client_data {
 	void (*suspend)(struct msm_mddi_client_data *);
 	void (*resume)(struct msm_mddi_client_data *);
@@ -142,6 +149,10 @@ struct msm_mddi_client_data {
 			     uint32_t reg);
 	void (*remote_write_vals)(struct msm_mddi_client_data *, uint8_t * val,
 			     uint32_t reg, unsigned int nr_bytes);
+	/* send all the writes as one chained link list and wait once */
+	void (*remote_write_batch)(struct msm_mddi_client_data *,
+				   const struct msm_mddi_reg_write *writes,
+				   unsigned int count);
 	uint32_t (*remote_read)(struct msm_mddi_client_data *, uint32_t reg);
 	void (*auto_hibernate)(struct msm_mddi_client_data *, int);
 	/* custom data that needs to be passed from the board file to a 
@@ -217,9 +228,18 @@ struct mdp_device {
 		    uint32_t stride, uint32_t w, uint32_t h, uint32_t x,
 		    uint32_t y, struct msmfb_callback *callback, int interface);
 	void (*dma_wait)(struct mdp_device *mdp, int interface);
+	/* only from the dma callback, sends another rect to the same
+	 * interface and completes it into callback */
+	void (*dma_chain)(struct mdp_device *mdp, uint32_t addr,
+			  uint32_t stride, uint32_t w, uint32_t h, uint32_t x,
+			  uint32_t y, struct msmfb_callback *callback,
+			  int interface);
 	int (*blit)(struct mdp_device *mdp, struct fb_info *fb,
 		    struct mdp_blit_req *req);
-#ifdef CONFIG_FB_MSM_OVERLAY
+	int (*blit_async)(struct mdp_device *mdp, struct fb_info *fb,
+			  struct mdp_blit_req *req, uint32_t *timestamp);
+	int (*blit_wait)(struct mdp_device *mdp, uint32_t timestamp);
+#if defined(CONFIG_FB_MSM_OVERLAY) || defined(CONFIG_FB_MSM_PPP_OVERLAY)
 	int (*overlay_get)(struct mdp_device *mdp, struct fb_info *fb,
 		    struct mdp_overlay *req);
 	int (*overlay_set)(struct mdp_device *mdp, struct fb_info *fb,
@@ -227,7 +247,7 @@ struct mdp_device {
 	int (*overlay_unset)(struct mdp_device *mdp, struct fb_info *fb,
 		    int ndx);
 	int (*overlay_play)(struct mdp_device *mdp, struct fb_info *fb,
-		    struct msmfb_overlay_data *req, struct file *p_src_file);
+		    struct msmfb_overlay_data *req, struct file **pp_src_file);
 #endif
 	void (*set_grp_disp)(struct mdp_device *mdp, uint32_t disp_id);
 	void (*configure_dma)(struct mdp_device *mdp);
@@ -20,6 +20,9 @@
 #define AUDIO_FLAG_READ		0
 #define AUDIO_FLAG_WRITE	1
 
+/* more, smaller buffers for low latency output */
+#define AUDIO_MAX_BUFFERS	8
+
 struct audio_buffer {
 	dma_addr_t phys;
 	void *data;
@@ -28,7 +31,8 @@ struct audio_buffer {
 };
 
 struct audio_client {
-	struct audio_buffer buf[2];
+	struct audio_buffer buf[AUDIO_MAX_BUFFERS];
+	int buf_count;
 	int cpu_buf;	/* next buffer the CPU will touch */
 	int dsp_buf;	/* next buffer the DSP will touch */
 	int running;
@@ -39,8 +43,21 @@ struct audio_client {
 
 	int cb_status;
 	uint32_t flags;
+
+	/* free buffers needed before a writer is woken, 0 for every one */
+	int wake_free;
 };
 
+static inline int q6audio_bufs_free(struct audio_client *ac)
+{
+	int n, free = 0;
+
+	for (n = 0; n < ac->buf_count; n++)
+		if (!ac->buf[n].used)
+			free++;
+	return free;
+}
+
 #define Q6_HW_HANDSET	0
 #define Q6_HW_HEADSET	1
 #define Q6_HW_SPEAKER	2
@@ -62,10 +79,17 @@ struct audio_client *q6audio_open_pcm(uint32_t bufsz, uint32_t rate,
 				      uint32_t channels, uint32_t flags,
 				      uint32_t acdb_id);
 
+/* As above, with bufcnt (2 to AUDIO_MAX_BUFFERS) buffers of bufsz bytes.
+ */
+struct audio_client *q6audio_open_pcm_bufs(uint32_t bufsz, uint32_t bufcnt,
+					   uint32_t rate, uint32_t channels,
+					   uint32_t flags, uint32_t acdb_id);
+
 struct audio_client *q6voice_open(uint32_t flags, uint32_t acdb_id);
 
-struct audio_client *q6audio_open_mp3(uint32_t bufsz, uint32_t rate,
-				      uint32_t channels, uint32_t acdb_id);
+struct audio_client *q6audio_open_mp3(uint32_t bufsz, uint32_t bufcnt,
+				      uint32_t rate, uint32_t channels,
+				      uint32_t acdb_id);
 
 struct audio_client *q6fm_open(void);
 
@@ -75,12 +99,20 @@ struct audio_client *q6audio_open_aac(uint32_t bufsz, uint32_t rate,
 struct audio_client *q6audio_open_qcelp(uint32_t bufsz, uint32_t rate,
 				      void *data, uint32_t acdb_id);
 
+struct msm_audio_sbc_enc_config;
+
+/* SBC frames for A2DP, encoded by the DSP from the playback mix */
+struct audio_client *q6audio_open_sbc(uint32_t bufsz, uint32_t rate,
+				      uint32_t channels,
+				      struct msm_audio_sbc_enc_config *cfg);
+
 int q6audio_close(struct audio_client *ac);
 int q6voice_close(struct audio_client *ac);
 int q6audio_mp3_close(struct audio_client *ac);
 int q6fm_close(struct audio_client *ac);
 int q6audio_aac_close(struct audio_client *ac);
 int q6audio_qcelp_close(struct audio_client *ac);
+int q6audio_sbc_close(struct audio_client *ac);
 
 int q6audio_read(struct audio_client *ac, struct audio_buffer *ab);
 int q6audio_write(struct audio_client *ac, struct audio_buffer *ab);
@@ -160,6 +160,23 @@ int msm_rpc_call(struct msm_rpc_endpoint *ept, uint32_t proc,
 		 void *request, int request_size,
 		 long timeout);
 
+/* non-blocking rpc call
+ *
+ * Sends the request like msm_rpc_call() and returns once it is written.
+ * The reply is matched by xid, so several calls may be outstanding on
+ * one endpoint.  callback runs in process context (a workqueue) with the
+ * reply, valid only during the callback, and status 0, or NULL and
+ * -ETIMEDOUT, -EPERM, -EINVAL or -ECANCELED (endpoint closed).
+ * A timeout < 0 waits forever.  The callback must not close the endpoint.
+ */
+typedef void (*msm_rpc_async_cb)(void *data, void *reply, int len,
+				 int status);
+
+int msm_rpc_call_async(struct msm_rpc_endpoint *ept, uint32_t proc,
+		       void *request, int request_size,
+		       msm_rpc_async_cb callback, void *data,
+		       long timeout);
+
 struct msm_rpc_xdr {
 	void *in_buf;
 	uint32_t in_size;
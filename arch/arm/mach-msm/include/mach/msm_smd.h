@@ -48,6 +48,36 @@ int smd_read_avail(smd_channel_t *ch);
 */
 int smd_cur_packet_size(smd_channel_t *ch);
 
+/* The kind of a channel is set by the side which allocated it, returns
+** 1 for packet channels and 0 for stream channels.
+*/
+int smd_is_packet_channel(smd_channel_t *ch);
+
+/* Zero-copy access to the fifo, for callers that want to move data
+** straight between it and their own buffers (e.g. skbs).
+**
+** smd_read_peek() returns the number of bytes readable at *ptr, limited
+** to the current packet on packet channels.  The data may wrap around
+** the fifo, so peek again after smd_read_consume() releases what was
+** used.  Returns 0 if nothing is available.
+**
+** smd_write_begin() reserves room for a len byte write (a whole packet
+** on packet channels) or returns an error: -EBUSY if a write is already
+** in progress, -ENOMEM if the fifo lacks room.  smd_write_peek() then
+** returns the contiguous space at *ptr and smd_write_commit() hands the
+** bytes filled in to the other side.
+** Writers must be serialized by the caller, as for smd_write().
+**
+** Neither consume nor commit interrupts the other side, so a batch of
+** packets costs one smd_kick_remote() when the caller is done with it.
+*/
+int smd_read_peek(smd_channel_t *ch, void **ptr);
+int smd_read_consume(smd_channel_t *ch, int len);
+int smd_write_begin(smd_channel_t *ch, int len);
+int smd_write_peek(smd_channel_t *ch, void **ptr);
+int smd_write_commit(smd_channel_t *ch, int len);
+void smd_kick_remote(smd_channel_t *ch);
+
 /* used for tty unthrottling and the like -- causes the notify()
 ** callback to be called from the same lock context as is used
 ** when it is called from channel updates
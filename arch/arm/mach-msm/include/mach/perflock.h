@@ -20,6 +20,7 @@
 #define __ARCH_ARM_MACH_PERF_LOCK_H
 
 #include <linux/list.h>
+#include <linux/notifier.h>
 
 /*
  * Performance level determine differnt EBI1 rate
@@ -32,11 +33,14 @@ enum {
 	PERF_LOCK_INVALID,
 };
 
+struct task_struct;
+
 struct perf_lock {
 	struct list_head link;
 	unsigned int flags;
 	unsigned int level;
 	const char *name;
+	struct task_struct *owner;	/* set by perf_lock_task() */
 };
 
 struct perflock_platform_data {
@@ -50,17 +54,28 @@ static inline void __init perflock_init(
 static inline void perf_lock_init(struct perf_lock *lock,
 	unsigned int level, const char *name) { return; }
 static inline void perf_lock(struct perf_lock *lock) { return; }
+static inline void perf_lock_task(struct perf_lock *lock,
+	struct task_struct *task) { return; }
 static inline void perf_unlock(struct perf_lock *lock) { return; }
 static inline int is_perf_lock_active(struct perf_lock *lock) { return 0; }
 static inline int is_perf_locked(void) { return 0; }
+static inline void perf_boost(unsigned int msecs) { return; }
+static inline int register_perf_boost_notifier(
+	struct notifier_block *nb) { return 0; }
+static inline int unregister_perf_boost_notifier(
+	struct notifier_block *nb) { return 0; }
 #else
 extern void __init perflock_init(struct perflock_platform_data *pdata);
 extern void perf_lock_init(struct perf_lock *lock,
 	unsigned int level, const char *name);
 extern void perf_lock(struct perf_lock *lock);
+extern void perf_lock_task(struct perf_lock *lock, struct task_struct *task);
 extern void perf_unlock(struct perf_lock *lock);
 extern int is_perf_lock_active(struct perf_lock *lock);
 extern int is_perf_locked(void);
+extern void perf_boost(unsigned int msecs);
+extern int register_perf_boost_notifier(struct notifier_block *nb);
+extern int unregister_perf_boost_notifier(struct notifier_block *nb);
 #endif
 
 
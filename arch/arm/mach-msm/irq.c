@@ -21,6 +21,10 @@
 #include <linux/timer.h>
 #include <linux/irq.h>
 #include <linux/io.h>
+#include <linux/math64.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/wakelock.h>
 
 #include <asm/cacheflush.h>
 
@@ -135,6 +139,9 @@ module_param_named(debug_mask, msm_irq_debug_mask, int, S_IRUGO | S_IWUSR | S_IW
 #define VIC_NUM_REGS	    2
 #endif
 
+#define VIC_PRIO_FAST	    0
+#define VIC_PRIO_DEFAULT    7
+
 #if VIC_NUM_REGS == 2
 #define DPRINT_REGS(base_reg, format, ...)	      			\
 	printk(KERN_INFO format " %x %x\n", ##__VA_ARGS__,		\
@@ -232,6 +239,19 @@ static uint8_t msm_irq_to_smsm[NR_MSM_IRQS + NR_SIRC_IRQS] = {
 #endif
 };
 
+/* Display, GPU, storage and modem sources. The VIC hands these out
+ * before anything else that is pending at the same time.
+ */
+static const uint8_t msm_irq_fast[] = {
+	INT_A9_M2A_0,
+	INT_MDP,
+#if defined(INT_GRAPHICS)
+	INT_GRAPHICS,
+#endif
+	INT_SDC1_0,
+	INT_SDC2_0,
+};
+
 static inline void msm_irq_write_all_regs(void __iomem *base, unsigned int val)
 {
 	int i;
@@ -247,6 +267,18 @@ static void msm_irq_ack(unsigned int irq)
 	writel(irq, reg);
 }
 
+/* Called by the level flow before the handler runs. The handler can't
+ * sleep, so the wake and idle bookkeeping in msm_irq_mask would only be
+ * undone again by the unmask that follows; just gate and clear the line.
+ */
+static void msm_irq_mask_ack(unsigned int irq)
+{
+	uint32_t mask = 1UL << (irq & 31);
+
+	writel(mask, VIC_INT_TO_REG_ADDR(VIC_INT_ENCLEAR0, irq));
+	writel(mask, VIC_INT_TO_REG_ADDR(VIC_INT_CLEAR0, irq));
+}
+
 static void msm_irq_mask(unsigned int irq)
 {
 	void __iomem *reg = VIC_INT_TO_REG_ADDR(VIC_INT_ENCLEAR0, irq);
@@ -328,11 +360,11 @@ static int msm_irq_set_type(unsigned int irq, unsigned int flow_type)
 	type = msm_irq_shadow_reg[index].int_type;
 	if (flow_type & (IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING)) {
 		type |= b;
-		irq_desc[irq].handle_irq = handle_edge_irq;
+		msm_irq_set_flow(irq, handle_edge_irq);
 	}
 	if (flow_type & (IRQF_TRIGGER_HIGH | IRQF_TRIGGER_LOW)) {
 		type &= ~b;
-		irq_desc[irq].handle_irq = handle_level_irq;
+		msm_irq_set_flow(irq, handle_level_irq);
 	}
 	writel(type, treg);
 	msm_irq_shadow_reg[index].int_type = type;
@@ -479,6 +511,8 @@ void msm_irq_exit_sleep2(void)
 		if (!(pending & smsm_mask))
 			continue;
 		pending &= ~smsm_mask;
+		/* lowest numbered pending irq stands for the wakeup */
+		suspend_wakeup_irq(i);
 		if (msm_irq_debug_mask & IRQ_DEBUG_SLEEP_INT)
 			printk(KERN_INFO "msm_irq_exit_sleep2: irq %d "
 			       "still pending %x now %x %x\n", i, pending,
@@ -517,6 +551,7 @@ static struct irq_chip msm_irq_chip = {
 	.disable   = msm_irq_mask,
 	.ack       = msm_irq_ack,
 	.mask      = msm_irq_mask,
+	.mask_ack  = msm_irq_mask_ack,
 	.unmask    = msm_irq_unmask,
 	.set_wake  = msm_irq_set_wake,
 	.set_type  = msm_irq_set_type,
@@ -541,12 +576,18 @@ void __init msm_init_irq(void)
 	/* don't use 1136 vic */
 	writel(0, VIC_CONFIG);
 
+	/* latency critical sources win when several are pending */
+	for (n = 0; n < NR_MSM_IRQS; n++)
+		writel(VIC_PRIO_DEFAULT, VIC_VECTPRIORITY(n));
+	for (n = 0; n < ARRAY_SIZE(msm_irq_fast); n++)
+		writel(VIC_PRIO_FAST, VIC_VECTPRIORITY(msm_irq_fast[n]));
+
 	/* enable interrupt controller */
 	writel(3, VIC_INT_MASTEREN);
 
 	for (n = 0; n < NR_MSM_IRQS; n++) {
 		set_irq_chip(n, &msm_irq_chip);
-		set_irq_handler(n, handle_level_irq);
+		msm_irq_set_flow(n, handle_level_irq);
 		set_irq_flags(n, IRQF_VALID);
 	}
 
@@ -562,6 +603,107 @@ static int __init msm_init_irq_late(void)
 }
 late_initcall(msm_init_irq_late);
 
+#if defined(CONFIG_MSM_IRQ_STATS)
+static struct {
+	irq_flow_handler_t flow;
+	unsigned int count;
+	uint32_t max_ns;
+	uint64_t total_ns;
+} msm_irq_stats[NR_MSM_IRQS + NR_SIRC_IRQS];
+
+/* Times the flow handler, so the chip callbacks are included. Cascades
+ * install their own handler and are not counted twice.
+ */
+static void msm_irq_timed_flow(unsigned int irq, struct irq_desc *desc)
+{
+	uint64_t start = sched_clock();
+	uint32_t t;
+
+	msm_irq_stats[irq].flow(irq, desc);
+
+	t = sched_clock() - start;
+	msm_irq_stats[irq].count++;
+	msm_irq_stats[irq].total_ns += t;
+	if (t > msm_irq_stats[irq].max_ns)
+		msm_irq_stats[irq].max_ns = t;
+}
+
+void msm_irq_set_flow(unsigned int irq, irq_flow_handler_t flow)
+{
+	msm_irq_stats[irq].flow = flow;
+	irq_desc[irq].handle_irq = msm_irq_timed_flow;
+}
+
+static int msm_irq_stats_show(struct seq_file *m, void *unused)
+{
+	struct irqaction *action;
+	unsigned long flags;
+	uint64_t avg;
+	int i;
+
+	seq_printf(m, "irq      count   total_us  avg_ns  max_ns  name\n");
+	for (i = 0; i < ARRAY_SIZE(msm_irq_stats); i++) {
+		if (!msm_irq_stats[i].count)
+			continue;
+		local_irq_save(flags);
+		avg = msm_irq_stats[i].total_ns;
+		do_div(avg, msm_irq_stats[i].count);
+		seq_printf(m, "%3d %10u %10llu %7llu %7u ", i,
+			   msm_irq_stats[i].count,
+			   div_u64(msm_irq_stats[i].total_ns, NSEC_PER_USEC),
+			   avg, msm_irq_stats[i].max_ns);
+		local_irq_restore(flags);
+
+		spin_lock_irqsave(&irq_desc[i].lock, flags);
+		for (action = irq_desc[i].action; action;
+		     action = action->next)
+			seq_printf(m, "%s%s", action->name,
+				   action->next ? ", " : "");
+		spin_unlock_irqrestore(&irq_desc[i].lock, flags);
+		seq_putc(m, '\n');
+	}
+	return 0;
+}
+
+static int msm_irq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, msm_irq_stats_show, NULL);
+}
+
+/* any write clears the counters */
+static ssize_t msm_irq_stats_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+	int i;
+
+	local_irq_save(flags);
+	for (i = 0; i < ARRAY_SIZE(msm_irq_stats); i++) {
+		msm_irq_stats[i].count = 0;
+		msm_irq_stats[i].max_ns = 0;
+		msm_irq_stats[i].total_ns = 0;
+	}
+	local_irq_restore(flags);
+	return count;
+}
+
+static const struct file_operations msm_irq_stats_fops = {
+	.open		= msm_irq_stats_open,
+	.read		= seq_read,
+	.write		= msm_irq_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init msm_irq_stats_init(void)
+{
+	proc_create("msm_irq_stats", S_IRUGO | S_IWUSR, NULL,
+		    &msm_irq_stats_fops);
+	return 0;
+}
+late_initcall(msm_irq_stats_init);
+#endif
+
 #if defined(CONFIG_MSM_FIQ_SUPPORT)
 void msm_trigger_irq(int irq)
 {
@@ -607,7 +749,7 @@ static void _msm_fiq_unselect(int irq)
 	unsigned long flags;
 
 	local_irq_save(flags);
-	msm_irq_shadow_reg[index].int_select &= (!mask);
+	msm_irq_shadow_reg[index].int_select &= ~mask;
 	writel(msm_irq_shadow_reg[index].int_select, reg);
 	local_irq_restore(flags);
 }
@@ -643,17 +785,33 @@ static void set_fiq_handler(void *start, unsigned int length)
 
 extern unsigned char fiq_glue, fiq_glue_end;
 
-static void (*fiq_func)(void *data, void *regs, void *svc_sp);
-static void *fiq_data;
+#define MSM_FIQ_MAX_HANDLERS	2
+
+/* The FIQ is shared between the serial debugger and the profiler, each
+ * handler checks its own source.
+ */
+static struct {
+	void (*func)(void *data, void *regs, void *svc_sp);
+	void *data;
+} fiq_handlers[MSM_FIQ_MAX_HANDLERS];
 static void *fiq_stack;
 
 void fiq_glue_setup(void *func, void *data, void *sp);
 
+static void msm_fiq_dispatch(void *data, void *regs, void *svc_sp)
+{
+	int i;
+
+	for (i = 0; i < MSM_FIQ_MAX_HANDLERS; i++)
+		if (fiq_handlers[i].func)
+			fiq_handlers[i].func(fiq_handlers[i].data, regs, svc_sp);
+}
+
 int msm_fiq_set_handler(void (*func)(void *data, void *regs, void *svc_sp),
 			void *data)
 {
 	unsigned long flags;
-	int ret = -ENOMEM;
+	int i, ret = -EBUSY;
 
 	if (!fiq_stack)
 		fiq_stack = kzalloc(THREAD_SIZE, GFP_KERNEL);
@@ -661,20 +819,43 @@ int msm_fiq_set_handler(void (*func)(void *data, void *regs, void *svc_sp),
 		return -ENOMEM;
 
 	local_irq_save(flags);
-	if (fiq_func == 0) {
-		fiq_func = func;
-		fiq_data = data;
-		fiq_glue_setup(func, data, fiq_stack + THREAD_START_SP);
-		set_fiq_handler(&fiq_glue, (&fiq_glue_end - &fiq_glue));
+	local_fiq_disable();
+	for (i = 0; i < MSM_FIQ_MAX_HANDLERS; i++) {
+		if (fiq_handlers[i].func)
+			continue;
+		fiq_handlers[i].data = data;
+		fiq_handlers[i].func = func;
 		ret = 0;
+		break;
+	}
+	if (!ret && i == 0) {
+		fiq_glue_setup(msm_fiq_dispatch, NULL,
+			       fiq_stack + THREAD_START_SP);
+		set_fiq_handler(&fiq_glue, (&fiq_glue_end - &fiq_glue));
 	}
+	local_fiq_enable();
 	local_irq_restore(flags);
 	return ret;
 }
 
+void msm_fiq_remove_handler(void (*func)(void *data, void *regs, void *svc_sp))
+{
+	unsigned long flags;
+	int i;
+
+	local_irq_save(flags);
+	local_fiq_disable();
+	for (i = 0; i < MSM_FIQ_MAX_HANDLERS; i++)
+		if (fiq_handlers[i].func == func)
+			fiq_handlers[i].func = NULL;
+	local_fiq_enable();
+	local_irq_restore(flags);
+}
+
 void msm_fiq_exit_sleep(void)
 {
 	if (fiq_stack)
-		fiq_glue_setup(fiq_func, fiq_data, fiq_stack + THREAD_START_SP);
+		fiq_glue_setup(msm_fiq_dispatch, NULL,
+			       fiq_stack + THREAD_START_SP);
 }
 #endif
@@ -28,6 +28,7 @@
 #include <linux/gpio.h>
 #include <mach/msm_iomap.h>
 #include <mach/msm_panel.h>
+#include <mach/htc_pwrsink.h>
 #include <linux/spi/spi.h>
 
 #include "devices.h"
@@ -461,6 +462,8 @@ static int amoled_panel_unblank(struct msm_lcdc_panel_ops *panel_data)
 
 	LCMDBG("%s: last_val = %d\n", __func__,last_val);
 	led_trigger_event(amoled_lcd_backlight, LED_FULL);
+	htc_pwrsink_set(PWRSINK_BACKLIGHT,
+			last_val * 100 / SAMSUNG_OLED_MAX_VAL);
 	return 0;
 }
 
@@ -493,6 +496,7 @@ static int amoled_panel_blank(struct msm_lcdc_panel_ops *panel_data)
 	mutex_unlock(&panel_lock);
 	amoled_panel_power(0);
 	led_trigger_event(amoled_lcd_backlight, LED_OFF);
+	htc_pwrsink_set(PWRSINK_BACKLIGHT, 0);
 	return 0;
 }
 
@@ -560,6 +564,8 @@ void amoled_brightness_set(struct led_classdev *led_cdev,
 	new_val = val;
 	amoled_set_gamma_val(new_val);
 	mutex_unlock(&panel_lock);
+	htc_pwrsink_set(PWRSINK_BACKLIGHT,
+			last_val * 100 / SAMSUNG_OLED_MAX_VAL);
 }
 
 static int amoled_panel_detect(void)
@@ -31,6 +31,7 @@
 #include <mach/vreg.h>
 #include <linux/spi/spi.h>
 #include <mach/atmega_microp.h>
+#include <mach/htc_pwrsink.h>
 #include "devices.h"
 
 //#define DEBUG_LCM
@@ -350,6 +351,7 @@ static int sonywvga_panel_unblank(struct msm_lcdc_panel_ops *panel_data)
 			ARRAY_SIZE(SONY_TFT_INIT_TABLE));
 
 	sonywvga_set_gamma_val(last_val_pwm);
+	htc_pwrsink_set(PWRSINK_BACKLIGHT, last_val_pwm * 100 / LED_FULL);
 
 	g_unblank_stage = 1;
 
@@ -370,6 +372,7 @@ static int sonywvga_panel_blank(struct msm_lcdc_panel_ops *panel_data)
 	qspi_send_9bit(0x0, 0x10);
 	hr_msleep(40);
 	g_unblank_stage = 0;
+	htc_pwrsink_set(PWRSINK_BACKLIGHT, 0);
 	mutex_unlock(&panel_lock);
 	sonywvga_panel_power(0);
 
@@ -458,9 +461,10 @@ void sonywvga_brightness_set(struct led_classdev *led_cdev,
 	led_cdev->brightness = val;
 
 	mutex_lock(&panel_lock);
-	if(g_unblank_stage)
+	if(g_unblank_stage) {
 		sonywvga_set_gamma_val(val);
-	else
+		htc_pwrsink_set(PWRSINK_BACKLIGHT, val * 100 / LED_FULL);
+	} else
 		last_val_pwm =val;
 	mutex_unlock(&panel_lock);
 }
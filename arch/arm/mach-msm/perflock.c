@@ -22,12 +22,17 @@
 #include <linux/earlysuspend.h>
 #include <linux/cpufreq.h>
 #include <linux/timer.h>
+#include <linux/sched.h>
 #include <mach/perflock.h>
 #include "proc_comm.h"
 #include "acpuclock.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/perflock.h>
+
 #define PERF_LOCK_INITIALIZED	(1U << 0)
 #define PERF_LOCK_ACTIVE	(1U << 1)
+#define PERF_LOCK_BOOST		(1U << 2)
 
 enum {
 	PERF_LOCK_DEBUG = 1U << 0,
@@ -45,6 +50,9 @@ static int initialized;
 static unsigned int *perf_acpu_table;
 static unsigned int table_size;
 static unsigned int curr_lock_speed;
+static unsigned int curr_floor_speed;
+static unsigned int task_locks_active;
+static struct perf_lock boost_perf_lock;
 static struct cpufreq_policy *cpufreq_policy;
 
 #ifdef CONFIG_PERF_LOCK_DEBUG
@@ -57,6 +65,7 @@ module_param_call(debug_mask, param_set_int, param_get_int,
 		&debug_mask, S_IWUSR | S_IRUGO);
 
 static unsigned int get_perflock_speed(void);
+static unsigned int get_floor_perflock_speed(void);
 static void print_active_locks(void);
 
 #ifdef CONFIG_PERFLOCK_SCREEN_POLICY
@@ -200,6 +209,16 @@ static int perflock_notifier_call(struct notifier_block *self,
 					__func__, policy->min, policy->max);
 		}
 		curr_lock_speed = lock_speed;
+
+		/* Task-bound and boost locks only raise the floor,
+		 * never pin max. */
+		curr_floor_speed = get_floor_perflock_speed() / 1000;
+		if (!lock_speed && curr_floor_speed > policy->min) {
+			policy->min = min(curr_floor_speed, policy->max);
+			if (debug_mask & PERF_CPUFREQ_LOCK_DEBUG)
+				pr_info("%s: cpufreq task floor %d\n",
+					__func__, policy->min);
+		}
 	}
 	spin_unlock_irqrestore(&policy_update_lock, irqflags);
 
@@ -215,6 +234,7 @@ static unsigned int get_perflock_speed(void)
 	unsigned long irqflags;
 	struct perf_lock *lock;
 	unsigned int perf_level = 0;
+	int found = 0;
 
 	/* Get the maxmimum perf level. */
 	if (list_empty(&active_perf_locks))
@@ -222,12 +242,69 @@ static unsigned int get_perflock_speed(void)
 
 	spin_lock_irqsave(&list_lock, irqflags);
 	list_for_each_entry(lock, &active_perf_locks, link) {
+		if (lock->owner || (lock->flags & PERF_LOCK_BOOST))
+			continue;
+		found = 1;
 		if (lock->level > perf_level)
 			perf_level = lock->level;
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 
-	return perf_acpu_table[perf_level];
+	return found ? perf_acpu_table[perf_level] : 0;
+}
+
+/*
+ * Floor requested by a running frame boost and by task-bound locks whose
+ * owner is currently runnable. A sleeping owner (e.g. the mass storage
+ * thread waiting for the host) does not hold the cpu up.
+ */
+static unsigned int get_floor_perflock_speed(void)
+{
+	unsigned long irqflags;
+	struct perf_lock *lock;
+	unsigned int perf_level = 0;
+	int found = 0;
+
+	if (!task_locks_active && !(boost_perf_lock.flags & PERF_LOCK_ACTIVE))
+		return 0;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	list_for_each_entry(lock, &active_perf_locks, link) {
+		if (!(lock->flags & PERF_LOCK_BOOST) &&
+		    (!lock->owner || lock->owner->state != TASK_RUNNING))
+			continue;
+		found = 1;
+		if (lock->level > perf_level)
+			perf_level = lock->level;
+	}
+	spin_unlock_irqrestore(&list_lock, irqflags);
+
+	return found ? perf_acpu_table[perf_level] : 0;
+}
+
+static int perflock_speed_changed(void)
+{
+	return (curr_lock_speed != (get_perflock_speed() / 1000)) ||
+		(curr_floor_speed != (get_floor_perflock_speed() / 1000));
+}
+
+/*
+ * The owner's run state changes without telling us, so sample it while
+ * any task-bound lock is held.
+ */
+#define PERF_TASK_POLL_DELAY		(HZ / 20)
+static void do_poll_task_locks(struct work_struct *work);
+static DECLARE_DELAYED_WORK(work_poll_task_locks, do_poll_task_locks);
+
+static void do_poll_task_locks(struct work_struct *work)
+{
+	if (!task_locks_active)
+		return;
+
+	if (cpufreq_policy && perflock_speed_changed())
+		cpufreq_update_policy(cpufreq_policy->cpu);
+
+	schedule_delayed_work(&work_poll_task_locks, PERF_TASK_POLL_DELAY);
 }
 
 static void print_active_locks(void)
@@ -237,7 +314,11 @@ static void print_active_locks(void)
 
 	spin_lock_irqsave(&list_lock, irqflags);
 	list_for_each_entry(lock, &active_perf_locks, link) {
-		pr_info("active perf lock '%s'\n", lock->name);
+		if (lock->owner)
+			pr_info("active perf lock '%s' (task %d)\n",
+				lock->name, task_pid_nr(lock->owner));
+		else
+			pr_info("active perf lock '%s'\n", lock->name);
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
@@ -268,6 +349,7 @@ void perf_lock_init(struct perf_lock *lock,
 	lock->name = name;
 	lock->flags = PERF_LOCK_INITIALIZED;
 	lock->level = level;
+	lock->owner = NULL;
 
 	INIT_LIST_HEAD(&lock->link);
 	spin_lock_irqsave(&list_lock, irqflags);
@@ -276,13 +358,7 @@ void perf_lock_init(struct perf_lock *lock,
 }
 EXPORT_SYMBOL(perf_lock_init);
 
-/**
- * perf_lock - activate a perf lock
- * @lock: perf lock to activate
- *
- * Activate @lock.(Need to init_perf_lock before activate)
- */
-void perf_lock(struct perf_lock *lock)
+static void __perf_lock(struct perf_lock *lock, struct task_struct *task)
 {
 	unsigned long irqflags;
 
@@ -295,35 +371,68 @@ void perf_lock(struct perf_lock *lock)
 		pr_info("%s: '%s', flags %d level %d\n",
 			__func__, lock->name, lock->flags, lock->level);
 	if (lock->flags & PERF_LOCK_ACTIVE) {
+		spin_unlock_irqrestore(&list_lock, irqflags);
 		pr_err("%s: over-locked\n", __func__);
 		return;
 	}
 	lock->flags |= PERF_LOCK_ACTIVE;
+	if (task) {
+		get_task_struct(task);
+		lock->owner = task;
+		if (!task_locks_active++)
+			schedule_delayed_work(&work_poll_task_locks,
+				PERF_TASK_POLL_DELAY);
+	}
 	list_del(&lock->link);
 	list_add(&lock->link, &active_perf_locks);
+	trace_perflock_acquire(lock);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 
 	/* Update cpufreq policy - scaling_min/scaling_max */
-	if (cpufreq_policy &&
-			(curr_lock_speed != (get_perflock_speed() / 1000)))
+	if (cpufreq_policy && perflock_speed_changed())
 		cpufreq_update_policy(cpufreq_policy->cpu);
 }
+
+/**
+ * perf_lock - activate a perf lock
+ * @lock: perf lock to activate
+ *
+ * Activate @lock.(Need to init_perf_lock before activate)
+ */
+void perf_lock(struct perf_lock *lock)
+{
+	__perf_lock(lock, NULL);
+}
 EXPORT_SYMBOL(perf_lock);
 
+/**
+ * perf_lock_task - activate a perf lock on behalf of a task
+ * @lock: perf lock to activate
+ * @task: task the request belongs to
+ *
+ * Like perf_lock(), but @lock only raises the minimum cpu speed while
+ * @task is runnable, and never pins the maximum. perf_unlock() releases it.
+ */
+void perf_lock_task(struct perf_lock *lock, struct task_struct *task)
+{
+	__perf_lock(lock, task);
+}
+EXPORT_SYMBOL(perf_lock_task);
+
 #define PERF_UNLOCK_DELAY		(HZ)
 static void do_expire_perf_locks(struct work_struct *work)
 {
 	if (debug_mask & PERF_EXPIRE_DEBUG)
 		pr_info("%s: timed out to unlock\n", __func__);
 
-	if (cpufreq_policy &&
-			(curr_lock_speed != (get_perflock_speed() / 1000))) {
+	if (cpufreq_policy && perflock_speed_changed()) {
 		if (debug_mask & PERF_EXPIRE_DEBUG)
 			pr_info("%s: update cpufreq policy\n", __func__);
 		cpufreq_update_policy(cpufreq_policy->cpu);
 	}
 }
 static DECLARE_DELAYED_WORK(work_expire_perf_locks, do_expire_perf_locks);
+static DECLARE_WORK(work_update_perf_locks, do_expire_perf_locks);
 
 /**
  * perf_unlock - de-activate a perf lock
@@ -334,6 +443,7 @@ static DECLARE_DELAYED_WORK(work_expire_perf_locks, do_expire_perf_locks);
 void perf_unlock(struct perf_lock *lock)
 {
 	unsigned long irqflags;
+	struct task_struct *owner;
 
 	WARN_ON(!initialized);
 	WARN_ON((lock->flags & PERF_LOCK_ACTIVE) == 0);
@@ -343,22 +453,120 @@ void perf_unlock(struct perf_lock *lock)
 		pr_info("%s: '%s', flags %d level %d\n",
 			__func__, lock->name, lock->flags, lock->level);
 	if (!(lock->flags & PERF_LOCK_ACTIVE)) {
+		spin_unlock_irqrestore(&list_lock, irqflags);
 		pr_err("%s: under-locked\n", __func__);
 		return;
 	}
 	lock->flags &= ~PERF_LOCK_ACTIVE;
+	owner = lock->owner;
+	lock->owner = NULL;
+	if (owner)
+		task_locks_active--;
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_perf_locks);
+	trace_perflock_release(lock);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 
+	if (owner)
+		put_task_struct(owner);
+
 	/* Prevent lock/unlock quickly, add a timeout to release perf_lock */
-	if (cpufreq_policy &&
-			(curr_lock_speed != (get_perflock_speed() / 1000)))
+	if (cpufreq_policy && perflock_speed_changed())
 		schedule_delayed_work(&work_expire_perf_locks,
 			PERF_UNLOCK_DELAY);
 }
 EXPORT_SYMBOL(perf_unlock);
 
+/*
+ * Frame boost: a short floor that display and gpu drivers raise when a
+ * frame missed its deadline, without waiting for the governor to ramp.
+ */
+static unsigned int boost_level = PERF_LOCK_HIGH;
+module_param(boost_level, uint, S_IWUSR | S_IRUGO);
+
+static unsigned long boost_expires;
+static ATOMIC_NOTIFIER_HEAD(perf_boost_notifier_list);
+
+static void perf_boost_timer_fn(unsigned long data)
+{
+	unsigned long irqflags;
+	int expired = 0;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	if ((boost_perf_lock.flags & PERF_LOCK_ACTIVE) &&
+	    time_after_eq(jiffies, boost_expires)) {
+		boost_perf_lock.flags &= ~PERF_LOCK_ACTIVE;
+		list_move(&boost_perf_lock.link, &inactive_perf_locks);
+		expired = 1;
+	}
+	spin_unlock_irqrestore(&list_lock, irqflags);
+
+	if (expired)
+		schedule_work(&work_update_perf_locks);
+}
+static DEFINE_TIMER(perf_boost_timer, perf_boost_timer_fn, 0, 0);
+
+/**
+ * perf_boost - raise the cpu floor for a short time
+ * @msecs: how long the boost lasts
+ *
+ * Raise the minimum cpu speed to the boost_level entry of the perf table
+ * for @msecs, extending a boost that is already running, and tell the
+ * perf_boost notifiers so they can raise their own clocks. The boost
+ * expires by itself. May be called from interrupt context.
+ */
+void perf_boost(unsigned int msecs)
+{
+	unsigned long irqflags;
+	unsigned long expires;
+	int start = 0;
+
+	if (!initialized || !msecs)
+		return;
+
+	expires = jiffies + msecs_to_jiffies(msecs);
+	spin_lock_irqsave(&list_lock, irqflags);
+	if (!(boost_perf_lock.flags & PERF_LOCK_ACTIVE)) {
+		boost_perf_lock.level = min(boost_level,
+					    (unsigned int)PERF_LOCK_HIGHEST);
+		boost_perf_lock.flags |= PERF_LOCK_ACTIVE;
+		list_move(&boost_perf_lock.link, &active_perf_locks);
+		start = 1;
+	}
+	if (start || time_after(expires, boost_expires)) {
+		boost_expires = expires;
+		mod_timer(&perf_boost_timer, expires);
+	}
+	spin_unlock_irqrestore(&list_lock, irqflags);
+
+	if (start) {
+		if (debug_mask & PERF_LOCK_DEBUG)
+			pr_info("%s: %u ms at level %u\n", __func__,
+				msecs, boost_perf_lock.level);
+		schedule_work(&work_update_perf_locks);
+	}
+	atomic_notifier_call_chain(&perf_boost_notifier_list, msecs, NULL);
+}
+EXPORT_SYMBOL(perf_boost);
+
+/**
+ * register_perf_boost_notifier - follow perf_boost() requests
+ * @nb: notifier called with the boost length in ms as the event
+ *
+ * Called in atomic context, possibly from an interrupt handler.
+ */
+int register_perf_boost_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&perf_boost_notifier_list, nb);
+}
+EXPORT_SYMBOL(register_perf_boost_notifier);
+
+int unregister_perf_boost_notifier(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&perf_boost_notifier_list, nb);
+}
+EXPORT_SYMBOL(unregister_perf_boost_notifier);
+
 /**
  * is_perf_lock_active - query if a perf_lock is active or not
  * @lock: target perf lock
@@ -430,6 +638,9 @@ void __init perflock_init(struct perflock_platform_data *pdata)
 	perf_acpu_table_fixup();
 	cpufreq_register_notifier(&perflock_notifier, CPUFREQ_POLICY_NOTIFIER);
 
+	perf_lock_init(&boost_perf_lock, PERF_LOCK_HIGH, "frame-boost");
+	boost_perf_lock.flags |= PERF_LOCK_BOOST;
+
 	initialized = 1;
 
 #ifdef CONFIG_PERFLOCK_BOOT_LOCK
@@ -45,6 +45,7 @@
 #include "spm.h"
 #ifdef CONFIG_HAS_WAKELOCK
 #include <linux/wakelock.h>
+#include <linux/pm_timeline.h>
 #endif
 
 enum {
@@ -76,6 +77,8 @@ static int msm_pm_idle_sleep_min_time = CONFIG_MSM7X00A_IDLE_SLEEP_MIN_TIME;
 module_param_named(idle_sleep_min_time, msm_pm_idle_sleep_min_time, int, S_IRUGO | S_IWUSR | S_IWGRP);
 static int msm_pm_idle_spin_time = CONFIG_MSM7X00A_IDLE_SPIN_TIME;
 module_param_named(idle_spin_time, msm_pm_idle_spin_time, int, S_IRUGO | S_IWUSR | S_IWGRP);
+static int msm_pm_idle_predict = 1;
+module_param_named(idle_predict, msm_pm_idle_predict, int, S_IRUGO | S_IWUSR | S_IWGRP);
 
 #ifdef CONFIG_HTC_OFFMODE_ALARM
 static int offalarm_size = 10;
@@ -207,6 +210,152 @@ static void msm_pm_add_stat(enum msm_pm_time_stats_id id, int64_t t)
 }
 #endif
 
+/*
+ * Idle state prediction. The next timer only bounds an idle period,
+ * interrupts usually end it sooner. Scale the timer estimate by a
+ * correction factor learned per range of timer estimates, and when the
+ * last few idles were all too short to pay for a power collapse, trust
+ * them over the timer. Each state keeps how often it was the right call:
+ * a collapse is a miss when we woke before idle_sleep_min_time, wfi is a
+ * miss when a collapse was allowed and we slept longer than that.
+ */
+#define MSM_PM_IDLE_BUCKETS	6
+#define MSM_PM_IDLE_HISTORY	8
+#define MSM_PM_IDLE_CORR_SHIFT	10	/* correction 1.0 */
+#define MSM_PM_IDLE_CORR_DECAY	8
+
+enum {
+	MSM_PM_IDLE_STATE_WFI,
+	MSM_PM_IDLE_STATE_COLLAPSE,
+	MSM_PM_IDLE_STATE_COUNT
+};
+
+static const int64_t msm_pm_idle_bucket_limit[MSM_PM_IDLE_BUCKETS - 1] = {
+	1 * NSEC_PER_MSEC, 5 * NSEC_PER_MSEC, 20 * NSEC_PER_MSEC,
+	100 * NSEC_PER_MSEC, 500 * NSEC_PER_MSEC,
+};
+
+static struct msm_pm_idle_governor {
+	uint32_t correction[MSM_PM_IDLE_BUCKETS];
+	int64_t history[MSM_PM_IDLE_HISTORY];	/* ns */
+	unsigned int history_head;
+	struct {
+		unsigned int count;
+		unsigned int hits;
+		unsigned int misses;
+		int64_t residency;
+	} state[MSM_PM_IDLE_STATE_COUNT];
+} msm_pm_idle_gov = {
+	.correction = {
+		[0 ... MSM_PM_IDLE_BUCKETS - 1] = 1U << MSM_PM_IDLE_CORR_SHIFT,
+	},
+};
+
+static const char *msm_pm_idle_state_name[MSM_PM_IDLE_STATE_COUNT] = {
+	[MSM_PM_IDLE_STATE_WFI] = "wfi",
+	[MSM_PM_IDLE_STATE_COLLAPSE] = "power-collapse",
+};
+
+static int msm_pm_idle_bucket(int64_t sleep_time)
+{
+	int i;
+
+	for (i = 0; i < MSM_PM_IDLE_BUCKETS - 1; i++)
+		if (sleep_time < msm_pm_idle_bucket_limit[i])
+			break;
+	return i;
+}
+
+static int64_t msm_pm_idle_predict_time(int64_t sleep_time, int bucket)
+{
+	struct msm_pm_idle_governor *gov = &msm_pm_idle_gov;
+	int64_t predicted, longest = 0;
+	int i;
+
+	if (sleep_time <= 0)
+		return sleep_time;
+	predicted = (sleep_time >> MSM_PM_IDLE_CORR_SHIFT) *
+		    gov->correction[bucket];
+
+	for (i = 0; i < MSM_PM_IDLE_HISTORY; i++)
+		if (gov->history[i] > longest)
+			longest = gov->history[i];
+	/* a steady interrupt rate keeps every idle short */
+	if (longest < msm_pm_idle_sleep_min_time && longest < predicted)
+		predicted = longest;
+	return predicted;
+}
+
+static void msm_pm_idle_update(int state, int64_t sleep_time, int bucket,
+			       int64_t actual, int collapse_allowed)
+{
+	struct msm_pm_idle_governor *gov = &msm_pm_idle_gov;
+	uint64_t ratio;
+	uint32_t corr;
+
+	gov->state[state].count++;
+	gov->state[state].residency += actual;
+	if (state == MSM_PM_IDLE_STATE_COLLAPSE) {
+		if (actual >= msm_pm_idle_sleep_min_time)
+			gov->state[state].hits++;
+		else
+			gov->state[state].misses++;
+	} else if (collapse_allowed) {
+		if (actual < msm_pm_idle_sleep_min_time)
+			gov->state[state].hits++;
+		else
+			gov->state[state].misses++;
+	}
+
+	gov->history[gov->history_head] = actual;
+	gov->history_head = (gov->history_head + 1) % MSM_PM_IDLE_HISTORY;
+
+	if (sleep_time <= 0)
+		return;
+	if (actual > sleep_time)
+		actual = sleep_time;
+	ratio = (uint64_t)actual << MSM_PM_IDLE_CORR_SHIFT;
+	do_div(ratio, (uint32_t)min_t(int64_t, sleep_time, UINT_MAX));
+	corr = gov->correction[bucket];
+	corr -= corr / MSM_PM_IDLE_CORR_DECAY;
+	corr += (uint32_t)ratio / MSM_PM_IDLE_CORR_DECAY;
+	gov->correction[bucket] = max(corr, 1U);
+}
+
+static int msm_pm_idle_read_proc(char *page, char **start, off_t off,
+				 int count, int *eof, void *data)
+{
+	struct msm_pm_idle_governor *gov = &msm_pm_idle_gov;
+	char *p = page;
+	int len, i;
+	int64_t s;
+	uint32_t ns;
+
+	for (i = 0; i < MSM_PM_IDLE_STATE_COUNT; i++) {
+		s = gov->state[i].residency;
+		ns = do_div(s, NSEC_PER_SEC);
+		p += sprintf(p, "%s:\n"
+			"  count: %u\n"
+			"  residency: %lld.%09u\n"
+			"  hits: %u\n"
+			"  misses: %u\n",
+			msm_pm_idle_state_name[i], gov->state[i].count,
+			s, ns, gov->state[i].hits, gov->state[i].misses);
+	}
+	p += sprintf(p, "correction:");
+	for (i = 0; i < MSM_PM_IDLE_BUCKETS; i++)
+		p += sprintf(p, " %u", gov->correction[i]);
+	p += sprintf(p, "\n");
+
+	*start = page + off;
+	len = p - page;
+	if (len > off)
+		len -= off;
+	else
+		len = 0;
+	return len < count ? len : count;
+}
+
 static int
 msm_pm_wait_state(uint32_t wait_all_set, uint32_t wait_all_clear,
                   uint32_t wait_any_set, uint32_t wait_any_clear)
@@ -459,6 +608,8 @@ static int msm_sleep(int sleep_mode, uint32_t sleep_delay, int from_idle)
 		msm_arch_idle();
 		rv = 0;
 	}
+	if (!from_idle)
+		pm_timeline_start("msm_pm: apps wakeup");
 #ifdef CONFIG_HTC_POWER_COLLAPSE_MAGIC
 	magic_num = 0xBBBB9999;
 	writel(magic_num, HTC_POWER_COLLAPSE_MAGIC_NUM);
@@ -515,6 +666,8 @@ enter_failed:
 	if (enter_state) {
 		smsm_change_state(PM_SMSM_WRITE_STATE, exit_state, PM_SMSM_WRITE_RUN);
 		msm_pm_wait_state(PM_SMSM_READ_RUN, 0, 0, 0);
+		if (!from_idle)
+			pm_timeline_mark("msm_pm: modem run");
 		if (msm_pm_debug_mask & MSM_PM_DEBUG_STATE)
 			printk(KERN_INFO "msm_sleep(): sleep exit "
 			       "A11S_CLK_SLEEP_EN %x, A11S_PWRDOWN %x, "
@@ -525,6 +678,8 @@ enter_failed:
 	msm_gpio_exit_sleep();
 	smd_sleep_exit();
 	clk_exit_sleep();
+	if (!from_idle)
+		pm_timeline_mark("msm_pm: sleep exit");
 	return rv;
 }
 
@@ -545,6 +700,11 @@ void arch_idle(void)
 {
 	int ret;
 	int64_t sleep_time;
+	int64_t predicted;
+	int64_t idle_start;
+	int bucket;
+	int idle_state = MSM_PM_IDLE_STATE_WFI;
+	int64_t sleep_delay;
 	int low_power = 0;
 #ifdef CONFIG_MSM_IDLE_STATS
 	int64_t t1;
@@ -561,15 +721,19 @@ void arch_idle(void)
 		return;
 
 	sleep_time = msm_timer_enter_idle();
+	bucket = msm_pm_idle_bucket(sleep_time);
+	predicted = msm_pm_idle_predict ?
+		msm_pm_idle_predict_time(sleep_time, bucket) : sleep_time;
+	idle_start = ktime_to_ns(ktime_get());
 #ifdef CONFIG_MSM_IDLE_STATS
-	t1 = ktime_to_ns(ktime_get());
+	t1 = idle_start;
 	msm_pm_add_stat(MSM_PM_STAT_NOT_IDLE, t1 - t2);
 	msm_pm_add_stat(MSM_PM_STAT_REQUESTED_IDLE, sleep_time);
 #endif
 	if (msm_pm_debug_mask & MSM_PM_DEBUG_IDLE)
-		printk(KERN_INFO "arch_idle: sleep time %llu, allow_sleep %d\n",
-		       sleep_time, allow_sleep);
-	if (sleep_time < msm_pm_idle_sleep_min_time || !allow_sleep) {
+		printk(KERN_INFO "arch_idle: sleep time %llu, predicted %llu, "
+		       "allow_sleep %d\n", sleep_time, predicted, allow_sleep);
+	if (predicted < msm_pm_idle_sleep_min_time || !allow_sleep) {
 		unsigned long saved_rate;
 		/* only spin while trying wfi ramp down */
 		if (acpuclk_get_wfi_rate() && msm_pm_idle_spin() < 0) {
@@ -618,12 +782,14 @@ void arch_idle(void)
 		}
 
 		low_power = 1;
-		do_div(sleep_time, NSEC_PER_SEC / 32768);
-		if (sleep_time > 0x6DDD000) {
-			printk("sleep_time too big %lld\n", sleep_time);
-			sleep_time = 0x6DDD000;
+		idle_state = MSM_PM_IDLE_STATE_COLLAPSE;
+		sleep_delay = sleep_time;
+		do_div(sleep_delay, NSEC_PER_SEC / 32768);
+		if (sleep_delay > 0x6DDD000) {
+			printk("sleep_time too big %lld\n", sleep_delay);
+			sleep_delay = 0x6DDD000;
 		}
-		ret = msm_sleep(msm_pm_idle_sleep_mode, sleep_time, 1);
+		ret = msm_sleep(msm_pm_idle_sleep_mode, sleep_delay, 1);
 #ifdef CONFIG_MSM_IDLE_STATS
 		if (ret)
 			exit_stat = MSM_PM_STAT_IDLE_FAILED_SLEEP;
@@ -631,6 +797,8 @@ void arch_idle(void)
 			exit_stat = MSM_PM_STAT_IDLE_SLEEP;
 #endif
 	}
+	msm_pm_idle_update(idle_state, sleep_time, bucket,
+			   ktime_to_ns(ktime_get()) - idle_start, allow_sleep);
 abort_idle:
 	msm_timer_exit_idle(low_power);
 #ifdef CONFIG_MSM_IDLE_STATS
@@ -930,6 +1098,8 @@ static int __init msm_pm_init(void)
 	create_proc_read_entry("msm_pm_stats", S_IRUGO,
 				NULL, msm_pm_read_proc, NULL);
 #endif
+	create_proc_read_entry("msm_pm_idle", S_IRUGO,
+				NULL, msm_pm_idle_read_proc, NULL);
 
 	if ((board_mfg_mode() == 0) || (board_mfg_mode() == 1)) {
 		disable_hlt();
@@ -18,6 +18,12 @@
 #include <linux/errno.h>
 #include <linux/io.h>
 #include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/hrtimer.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <mach/msm_iomap.h>
 #include <mach/system.h>
 
@@ -49,6 +55,48 @@ static inline void notify_other_proc_comm(void)
 #define MDM_DATA2   0x1C
 
 static DEFINE_SPINLOCK(proc_comm_lock);
+static DEFINE_MUTEX(proc_comm_mutex);
+
+/* A command sent by msm_proc_comm_sleep() that the modem hasn't
+ * answered yet. Whoever sees it done first (the sleeper polling, the
+ * SMSM interrupt or an atomic caller wanting the slot) completes it.
+ */
+struct proc_comm_req {
+	unsigned data1;
+	unsigned data2;
+	int ret;
+	int done;
+	struct task_struct *task;
+};
+static struct proc_comm_req *proc_comm_pending;
+
+/* how often a sleeping caller looks for the answer */
+static unsigned proc_comm_poll_us = 50;
+module_param_named(poll_us, proc_comm_poll_us, uint, S_IWUSR | S_IRUGO);
+
+#define PROC_COMM_HIST_BUCKETS 12
+
+/* log2 histogram of durations in us, the last bucket is open ended */
+struct proc_comm_hist {
+	unsigned count;
+	unsigned max_us;
+	unsigned buckets[PROC_COMM_HIST_BUCKETS];
+};
+static struct proc_comm_hist proc_comm_spin_hist;	/* irqs off */
+static struct proc_comm_hist proc_comm_sleep_hist;	/* whole call */
+
+static void proc_comm_hist_add(struct proc_comm_hist *h, u64 ns)
+{
+	unsigned us = div_u64(ns, NSEC_PER_USEC);
+	int b = us ? fls(us) : 0;
+
+	if (b >= PROC_COMM_HIST_BUCKETS)
+		b = PROC_COMM_HIST_BUCKETS - 1;
+	h->buckets[b]++;
+	h->count++;
+	if (us > h->max_us)
+		h->max_us = us;
+}
 
 /* The higher level SMD support will install this to
  * provide a way to check for and handle modem restart.
@@ -75,44 +123,243 @@ static int proc_comm_wait_for(void __iomem *addr, unsigned value)
 	}
 }
 
+static void proc_comm_send(unsigned cmd, unsigned data1, unsigned data2)
+{
+	void __iomem *base = MSM_SHARED_RAM_BASE;
+
+	writel(cmd, base + APP_COMMAND);
+	writel(data1, base + APP_DATA1);
+	writel(data2, base + APP_DATA2);
+
+	notify_other_proc_comm();
+}
+
+/* collect the answer to a command that reads PCOM_CMD_DONE */
+static int proc_comm_finish(unsigned *data1, unsigned *data2)
+{
+	void __iomem *base = MSM_SHARED_RAM_BASE;
+	int ret;
+
+	if (readl(base + APP_STATUS) != PCOM_CMD_FAIL) {
+		if (data1)
+			*data1 = readl(base + APP_DATA1);
+		if (data2)
+			*data2 = readl(base + APP_DATA2);
+		ret = 0;
+	} else {
+		ret = -EIO;
+	}
+	writel(PCOM_CMD_IDLE, base + APP_COMMAND);
+	return ret;
+}
+
+/* called with proc_comm_lock held, ret -EAGAIN makes the sleeper resend */
+static void proc_comm_complete_pending(int ret)
+{
+	struct proc_comm_req *req = proc_comm_pending;
+
+	if (!ret)
+		ret = proc_comm_finish(&req->data1, &req->data2);
+	else
+		writel(PCOM_CMD_IDLE, MSM_SHARED_RAM_BASE + APP_COMMAND);
+	req->ret = ret;
+	req->done = 1;
+	proc_comm_pending = NULL;
+	wake_up_process(req->task);
+}
+
+static void proc_comm_poll(int check_crash)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&proc_comm_lock, flags);
+	if (proc_comm_pending) {
+		if (readl(MSM_SHARED_RAM_BASE + APP_COMMAND) == PCOM_CMD_DONE)
+			proc_comm_complete_pending(0);
+		else if (check_crash && msm_check_for_modem_crash &&
+			 msm_check_for_modem_crash())
+			proc_comm_complete_pending(-EAGAIN);
+	}
+	spin_unlock_irqrestore(&proc_comm_lock, flags);
+}
+
+/*
+ * Called from the SMSM interrupt, the modem often raises it around the
+ * time it answers, which saves a sleeping caller the rest of its poll
+ * interval.
+ */
+void msm_proc_comm_wakeup(void)
+{
+	proc_comm_poll(0);
+}
+
 int msm_proc_comm(unsigned cmd, unsigned *data1, unsigned *data2)
 {
 	void __iomem *base = MSM_SHARED_RAM_BASE;
 	unsigned long flags;
+	u64 start;
 	int ret;
 
 	spin_lock_irqsave(&proc_comm_lock, flags);
+	start = sched_clock();
+
+	/* a sleeping caller has the slot, wait out its command */
+	if (proc_comm_pending)
+		proc_comm_complete_pending(
+			proc_comm_wait_for(base + APP_COMMAND, PCOM_CMD_DONE));
 
 	for (;;) {
 		if (proc_comm_wait_for(base + MDM_STATUS, PCOM_READY))
 			continue;
 
-		writel(cmd, base + APP_COMMAND);
-		writel(data1 ? *data1 : 0, base + APP_DATA1);
-		writel(data2 ? *data2 : 0, base + APP_DATA2);
-
-		notify_other_proc_comm();
+		proc_comm_send(cmd, data1 ? *data1 : 0, data2 ? *data2 : 0);
 
 		if (proc_comm_wait_for(base + APP_COMMAND, PCOM_CMD_DONE))
 			continue;
 
-		if (readl(base + APP_STATUS) != PCOM_CMD_FAIL) {
-			if (data1)
-				*data1 = readl(base + APP_DATA1);
-			if (data2)
-				*data2 = readl(base + APP_DATA2);
-			ret = 0;
-		} else {
-			ret = -EIO;
-		}
+		ret = proc_comm_finish(data1, data2);
 		break;
 	}
 
-	writel(PCOM_CMD_IDLE, base + APP_COMMAND);
-
+	proc_comm_hist_add(&proc_comm_spin_hist, sched_clock() - start);
 	spin_unlock_irqrestore(&proc_comm_lock, flags);
 
 	return ret;
 }
 
+/*
+ * Same as msm_proc_comm() but sleeps while the modem works on the
+ * command instead of spinning with interrupts off. Falls back to
+ * msm_proc_comm() when called from atomic context.
+ */
+int msm_proc_comm_sleep(unsigned cmd, unsigned *data1, unsigned *data2)
+{
+	void __iomem *base = MSM_SHARED_RAM_BASE;
+	struct proc_comm_req req;
+	unsigned long flags;
+	ktime_t poll;
+	u64 start, spin;
+
+	if (in_atomic() || irqs_disabled())
+		return msm_proc_comm(cmd, data1, data2);
+
+	start = sched_clock();
+	mutex_lock(&proc_comm_mutex);
+	do {
+		spin_lock_irqsave(&proc_comm_lock, flags);
+		spin = sched_clock();
+		if (proc_comm_pending)
+			proc_comm_complete_pending(
+				proc_comm_wait_for(base + APP_COMMAND,
+						   PCOM_CMD_DONE));
+		if (proc_comm_wait_for(base + MDM_STATUS, PCOM_READY)) {
+			spin_unlock_irqrestore(&proc_comm_lock, flags);
+			req.ret = -EAGAIN;
+			continue;
+		}
+		req.data1 = data1 ? *data1 : 0;
+		req.data2 = data2 ? *data2 : 0;
+		req.done = 0;
+		req.task = current;
+		proc_comm_pending = &req;
+		proc_comm_send(cmd, req.data1, req.data2);
+		proc_comm_hist_add(&proc_comm_spin_hist, sched_clock() - spin);
+		spin_unlock_irqrestore(&proc_comm_lock, flags);
+
+		for (;;) {
+			set_current_state(TASK_UNINTERRUPTIBLE);
+			proc_comm_poll(1);
+			if (req.done)
+				break;
+			poll = ktime_set(0, proc_comm_poll_us * NSEC_PER_USEC);
+			schedule_hrtimeout(&poll, HRTIMER_MODE_REL);
+		}
+		__set_current_state(TASK_RUNNING);
+	} while (req.ret == -EAGAIN);
+	proc_comm_hist_add(&proc_comm_sleep_hist, sched_clock() - start);
+	mutex_unlock(&proc_comm_mutex);
+
+	if (!req.ret) {
+		if (data1)
+			*data1 = req.data1;
+		if (data2)
+			*data2 = req.data2;
+	}
+	return req.ret;
+}
+
+#if defined(CONFIG_DEBUG_FS)
+
+static void proc_comm_hist_show(struct seq_file *m, const char *name,
+				struct proc_comm_hist *h)
+{
+	int i;
+
+	seq_printf(m, "%s: %u calls, max %u us\n", name, h->count, h->max_us);
+	for (i = 0; i < PROC_COMM_HIST_BUCKETS; i++) {
+		if (!h->buckets[i])
+			continue;
+		if (i == PROC_COMM_HIST_BUCKETS - 1)
+			seq_printf(m, "  >= %5u us: %u\n",
+				   1U << (i - 1), h->buckets[i]);
+		else
+			seq_printf(m, "  < %6u us: %u\n", 1U << i,
+				   h->buckets[i]);
+	}
+}
+
+static int proc_comm_stats_show(struct seq_file *m, void *unused)
+{
+	unsigned long flags;
+	struct proc_comm_hist spin_hist, sleep_hist;
+
+	spin_lock_irqsave(&proc_comm_lock, flags);
+	spin_hist = proc_comm_spin_hist;
+	spin_unlock_irqrestore(&proc_comm_lock, flags);
+	mutex_lock(&proc_comm_mutex);
+	sleep_hist = proc_comm_sleep_hist;
+	mutex_unlock(&proc_comm_mutex);
+
+	proc_comm_hist_show(m, "spinning (irqs off)", &spin_hist);
+	proc_comm_hist_show(m, "sleeping", &sleep_hist);
+	return 0;
+}
+
+static int proc_comm_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, proc_comm_stats_show, NULL);
+}
+
+/* writing anything clears the histograms */
+static ssize_t proc_comm_stats_write(struct file *file,
+				     const char __user *ubuf,
+				     size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+
+	mutex_lock(&proc_comm_mutex);
+	spin_lock_irqsave(&proc_comm_lock, flags);
+	memset(&proc_comm_spin_hist, 0, sizeof(proc_comm_spin_hist));
+	memset(&proc_comm_sleep_hist, 0, sizeof(proc_comm_sleep_hist));
+	spin_unlock_irqrestore(&proc_comm_lock, flags);
+	mutex_unlock(&proc_comm_mutex);
+	return count;
+}
 
+static const struct file_operations proc_comm_stats_fops = {
+	.open		= proc_comm_stats_open,
+	.read		= seq_read,
+	.write		= proc_comm_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init proc_comm_debugfs_init(void)
+{
+	debugfs_create_file("proc_comm", 0644, NULL, NULL,
+			    &proc_comm_stats_fops);
+	return 0;
+}
+late_initcall(proc_comm_debugfs_init);
+
+#endif
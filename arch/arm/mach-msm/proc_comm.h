@@ -251,5 +251,7 @@ enum {
 		(((drvstr) & 0xF) << 17))
 
 int msm_proc_comm(unsigned cmd, unsigned *data1, unsigned *data2);
+int msm_proc_comm_sleep(unsigned cmd, unsigned *data1, unsigned *data2);
+void msm_proc_comm_wakeup(void);
 
 #endif
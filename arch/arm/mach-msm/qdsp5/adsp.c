@@ -381,32 +381,18 @@ static int rpc_send_accepted_void_reply(struct msm_rpc_endpoint *client,
 	return rc;
 }
 
-int __msm_adsp_write(struct msm_adsp_module *module, unsigned dsp_queue_addr,
-		   void *cmd_buf, size_t cmd_size)
+/* Hand one command to the DSP. Called with adsp_cmd_lock held. */
+static int adsp_write_locked(struct msm_adsp_module *module,
+			     unsigned dsp_queue_addr,
+			     void *cmd_buf, size_t cmd_size)
 {
 	uint32_t ctrl_word;
 	uint32_t dsp_q_addr;
 	uint32_t dsp_addr;
 	uint32_t cmd_id = 0;
 	int cnt = 0;
-	int ret_status = 0;
-	unsigned long flags;
 	struct adsp_info *info = module->info;
 
-	spin_lock_irqsave(&adsp_cmd_lock, flags);
-
-	if (module->state != ADSP_STATE_ENABLED) {
-		spin_unlock_irqrestore(&adsp_cmd_lock, flags);
-		pr_err("adsp: module %s not enabled before write\n",
-		       module->name);
-		return -ENODEV;
-	}
-	if (adsp_validate_module(module->id)) {
-		spin_unlock_irqrestore(&adsp_cmd_lock, flags);
-		pr_info("adsp: module id validation failed %s  %d\n",
-			module->name, module->id);
-		return -ENXIO;
-	}
 	dsp_q_addr = adsp_get_queue_offset(info, dsp_queue_addr);
 	dsp_q_addr &= ADSP_RTOS_WRITE_CTRL_WORD_DSP_ADDR_M;
 
@@ -420,8 +406,7 @@ int __msm_adsp_write(struct msm_adsp_module *module, unsigned dsp_queue_addr,
 		ADSP_RTOS_WRITE_CTRL_WORD_READY_V) {
 		if (cnt > 100) {
 			pr_err("adsp: timeout waiting for DSP write ready\n");
-			ret_status = -EIO;
-			goto fail;
+			return -EIO;
 		}
 		pr_warning("adsp: waiting for DSP write ready\n");
 		udelay(1);
@@ -457,8 +442,7 @@ int __msm_adsp_write(struct msm_adsp_module *module, unsigned dsp_queue_addr,
 		ADSP_RTOS_WRITE_CTRL_WORD_MUTEX_NAVAIL_V) {
 		if (cnt > 5000) {
 			pr_err("adsp: timeout waiting for adsp ack\n");
-			ret_status = -EIO;
-			goto fail;
+			return -EIO;
 		}
 		udelay(1);
 		cnt++;
@@ -469,8 +453,7 @@ int __msm_adsp_write(struct msm_adsp_module *module, unsigned dsp_queue_addr,
 
 	if ((ctrl_word & ADSP_RTOS_WRITE_CTRL_WORD_STATUS_M) !=
 			 ADSP_RTOS_WRITE_CTRL_WORD_NO_ERR_V) {
-		ret_status = -EAGAIN;
-		goto fail;
+		return -EAGAIN;
 	}
 
 	/* Ctrl word status bits were 00, no error in the ctrl word */
@@ -526,8 +509,35 @@ int __msm_adsp_write(struct msm_adsp_module *module, unsigned dsp_queue_addr,
 	writel(1, info->send_irq);
 
 	module->num_commands++;
+	return 0;
+}
+
+static int adsp_write_check(struct msm_adsp_module *module)
+{
+	if (module->state != ADSP_STATE_ENABLED) {
+		pr_err("adsp: module %s not enabled before write\n",
+		       module->name);
+		return -ENODEV;
+	}
+	if (adsp_validate_module(module->id)) {
+		pr_info("adsp: module id validation failed %s  %d\n",
+			module->name, module->id);
+		return -ENXIO;
+	}
+	return 0;
+}
 
-fail:
+int __msm_adsp_write(struct msm_adsp_module *module, unsigned dsp_queue_addr,
+		   void *cmd_buf, size_t cmd_size)
+{
+	unsigned long flags;
+	int ret_status;
+
+	spin_lock_irqsave(&adsp_cmd_lock, flags);
+	ret_status = adsp_write_check(module);
+	if (!ret_status)
+		ret_status = adsp_write_locked(module, dsp_queue_addr,
+					       cmd_buf, cmd_size);
 	spin_unlock_irqrestore(&adsp_cmd_lock, flags);
 	return ret_status;
 }
@@ -548,6 +558,52 @@ int msm_adsp_write(struct msm_adsp_module *module, unsigned dsp_queue_addr,
 	return rc;
 }
 
+/* Write as many of the commands as the DSP takes without a retry, in
+ * one hold of the command lock. Returns how many went out, or an error
+ * if none did.
+ */
+static int __msm_adsp_write_batch(struct msm_adsp_module *module,
+				  struct msm_adsp_cmd *cmds, int count)
+{
+	unsigned long flags;
+	int n, rc;
+
+	spin_lock_irqsave(&adsp_cmd_lock, flags);
+	rc = adsp_write_check(module);
+	for (n = 0; !rc && n < count; n++) {
+		rc = adsp_write_locked(module, cmds[n].queue_id,
+				       cmds[n].data, cmds[n].len);
+		if (rc)
+			break;
+	}
+	if (n)
+		module->num_batches++;
+	spin_unlock_irqrestore(&adsp_cmd_lock, flags);
+	return n ? n : rc;
+}
+
+int msm_adsp_write_batch(struct msm_adsp_module *module,
+			 struct msm_adsp_cmd *cmds, int count)
+{
+	int rc, done = 0, retries = 0;
+
+	while (done < count) {
+		rc = __msm_adsp_write_batch(module, cmds + done, count - done);
+		if (rc > 0) {
+			done += rc;
+			continue;
+		}
+		if (rc != -EAGAIN || retries++ >= 100)
+			return rc;
+		udelay(10);
+	}
+	if (retries > 50)
+		pr_warning("adsp: %s batch of %d took %d retries\n",
+			   module->name, count, retries);
+	return 0;
+}
+EXPORT_SYMBOL(msm_adsp_write_batch);
+
 #ifdef CONFIG_MSM_ADSP_REPORT_EVENTS
 static void *modem_event_addr;
 #if CONFIG_MSM_AMSS_VERSION >= 6350
@@ -1002,6 +1058,10 @@ int msm_adsp_enable(struct msm_adsp_module *module)
 					1 * HZ);
 		mutex_lock(&module->lock);
 		if (module->state == ADSP_STATE_ENABLED) {
+			module->enabled_at = jiffies;
+			module->stats_commands = module->num_commands;
+			module->stats_batches = module->num_batches;
+			module->stats_events = module->num_events;
 			rc = 0;
 		} else {
 			pr_err("adsp: module '%s' enable timed out\n",
@@ -1028,6 +1088,19 @@ int msm_adsp_enable(struct msm_adsp_module *module)
 }
 EXPORT_SYMBOL(msm_adsp_enable);
 
+static void adsp_report_rates(struct msm_adsp_module *module)
+{
+	unsigned secs = (jiffies - module->enabled_at) / HZ;
+
+	if (!secs)
+		return;
+	pr_info("adsp: %s: %u commands/s in %u batches/s, %u events/s\n",
+		module->name,
+		(module->num_commands - module->stats_commands) / secs,
+		(module->num_batches - module->stats_batches) / secs,
+		(module->num_events - module->stats_events) / secs);
+}
+
 static int msm_adsp_disable_locked(struct msm_adsp_module *module)
 {
 	int rc = 0;
@@ -1037,8 +1110,10 @@ static int msm_adsp_disable_locked(struct msm_adsp_module *module)
 		pr_warning("adsp: module '%s' already disabled\n",
 			   module->name);
 		break;
-	case ADSP_STATE_ENABLING:
 	case ADSP_STATE_ENABLED:
+		adsp_report_rates(module);
+		/* fall through */
+	case ADSP_STATE_ENABLING:
 		rc = rpc_adsp_rtos_app_to_modem(RPC_ADSP_RTOS_CMD_DISABLE,
 						module->id, module);
 		module->state = ADSP_STATE_DISABLED;
@@ -277,8 +277,15 @@ struct msm_adsp_module {
 
 	/* statistics */
 	unsigned num_commands;
+	unsigned num_batches;
 	unsigned num_events;
 
+	/* counts at enable time, for the rates reported on disable */
+	unsigned long enabled_at;
+	unsigned stats_commands;
+	unsigned stats_batches;
+	unsigned stats_events;
+
 	wait_queue_head_t state_wait;
 	unsigned state;
 
@@ -35,12 +35,21 @@ struct adsp_pmem_region {
 	struct file *file;
 };
 
+/* Events are copied out of the DSP in interrupt context; keep a ring
+ * of them per open device rather than allocating one at a time.
+ */
+#define ADSP_EVENT_RING 32
+
 struct adsp_device {
 	struct msm_adsp_module *module;
 
 	spinlock_t event_queue_lock;
 	wait_queue_head_t event_wait;
-	struct list_head event_queue;
+	struct adsp_event *event_ring;
+	unsigned event_head;
+	unsigned event_tail;
+	unsigned events_dropped;
+	struct mutex event_read_lock;
 	int abort;
 
 	const char *name;
@@ -284,12 +293,71 @@ end:
 	return rc;
 }
 
+static long adsp_write_cmds(struct adsp_device *adev, void __user *arg)
+{
+	struct adsp_commands_t batch;
+	struct adsp_command_t cmd[ADSP_MAX_BATCH];
+	struct msm_adsp_cmd kcmd[ADSP_MAX_BATCH];
+	unsigned char *cmd_data, *p;
+	size_t total = 0;
+	long rc;
+	int n;
+
+	if (copy_from_user(&batch, arg, sizeof(batch)))
+		return -EFAULT;
+	if (batch.count == 0 || batch.count > ADSP_MAX_BATCH)
+		return -EINVAL;
+	if (copy_from_user(cmd, (void __user *)batch.cmds,
+			   batch.count * sizeof(cmd[0])))
+		return -EFAULT;
+
+	for (n = 0; n < batch.count; n++) {
+		if (cmd[n].len > 4096)
+			return -EINVAL;
+		/* keep every command word aligned in the scratch buffer */
+		total += ALIGN(cmd[n].len, 4);
+	}
+
+	cmd_data = kmalloc(total, GFP_USER);
+	if (!cmd_data)
+		return -ENOMEM;
+
+	for (n = 0, p = cmd_data; n < batch.count; n++) {
+		if (copy_from_user(p, (void __user *)(cmd[n].data),
+				   cmd[n].len)) {
+			rc = -EFAULT;
+			goto free;
+		}
+		kcmd[n].queue_id = cmd[n].queue;
+		kcmd[n].data = p;
+		kcmd[n].len = cmd[n].len;
+		p += ALIGN(cmd[n].len, 4);
+	}
+
+	mutex_lock(&adev->module->pmem_regions_lock);
+	for (n = 0; n < batch.count; n++) {
+		if (adsp_verify_cmd(adev->module, kcmd[n].queue_id,
+				    kcmd[n].data, kcmd[n].len)) {
+			printk(KERN_ERR "module %s: verify failed.\n",
+				adev->module->name);
+			rc = -EINVAL;
+			goto end;
+		}
+	}
+	rc = msm_adsp_write_batch(adev->module, kcmd, batch.count);
+end:
+	mutex_unlock(&adev->module->pmem_regions_lock);
+free:
+	kfree(cmd_data);
+	return rc;
+}
+
 static int adsp_events_pending(struct adsp_device *adev)
 {
 	unsigned long flags;
 	int yes;
 	spin_lock_irqsave(&adev->event_queue_lock, flags);
-	yes = !list_empty(&adev->event_queue);
+	yes = adev->event_head != adev->event_tail;
 	spin_unlock_irqrestore(&adev->event_queue_lock, flags);
 	return yes || adev->abort;
 }
@@ -367,16 +435,17 @@ static long adsp_get_event(struct adsp_device *adev, void __user *arg)
 	if (adev->abort)
 		return -ENODEV;
 
+	/* the slot stays ours until the tail moves past it */
+	mutex_lock(&adev->event_read_lock);
 	spin_lock_irqsave(&adev->event_queue_lock, flags);
-	if (!list_empty(&adev->event_queue)) {
-		data = list_first_entry(&adev->event_queue,
-					struct adsp_event, list);
-		list_del(&data->list);
-	}
+	if (adev->event_head != adev->event_tail)
+		data = adev->event_ring + adev->event_tail;
 	spin_unlock_irqrestore(&adev->event_queue_lock, flags);
 
-	if (!data)
+	if (!data) {
+		mutex_unlock(&adev->event_read_lock);
 		return -EAGAIN;
+	}
 
 	/* DSP messages are type 0; they may contain physical addresses */
 	if (data->type == 0)
@@ -408,7 +477,10 @@ static long adsp_get_event(struct adsp_device *adev, void __user *arg)
 	if (copy_to_user(arg, &evt, sizeof(evt)))
 		rc = -EFAULT;
 end:
-	kfree(data);
+	spin_lock_irqsave(&adev->event_queue_lock, flags);
+	adev->event_tail = (adev->event_tail + 1) % ADSP_EVENT_RING;
+	spin_unlock_irqrestore(&adev->event_queue_lock, flags);
+	mutex_unlock(&adev->event_read_lock);
 	return rc;
 }
 
@@ -433,6 +505,9 @@ static long adsp_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	case ADSP_IOCTL_WRITE_COMMAND:
 		return adsp_write_cmd(adev, (void __user *) arg);
 
+	case ADSP_IOCTL_WRITE_COMMANDS:
+		return adsp_write_cmds(adev, (void __user *) arg);
+
 	case ADSP_IOCTL_GET_EVENT:
 		return adsp_get_event(adev, (void __user *) arg);
 
@@ -486,6 +561,12 @@ static int adsp_release(struct inode *inode, struct file *filp)
 	BUG_ON(!hlist_empty(&module->pmem_regions));
 
 	msm_adsp_put(module);
+
+	if (adev->events_dropped)
+		pr_warning("adsp: %s dropped %u events\n", adev->name,
+			   adev->events_dropped);
+	kfree(adev->event_ring);
+	adev->event_ring = NULL;
 	return 0;
 }
 
@@ -495,17 +576,26 @@ static void adsp_event(void *driver_data, unsigned id, size_t len,
 	struct adsp_device *adev = driver_data;
 	struct adsp_event *event;
 	unsigned long flags;
+	unsigned next;
 
 	if (len > ADSP_EVENT_MAX_SIZE) {
 		pr_err("adsp_event: event too large (%d bytes)\n", len);
 		return;
 	}
 
-	event = kmalloc(sizeof(*event), GFP_ATOMIC);
-	if (!event) {
-		pr_err("adsp_event: cannot allocate buffer\n");
+	/* events come from both the dsp interrupt and the rpc thread, so
+	 * fill the slot under the lock
+	 */
+	spin_lock_irqsave(&adev->event_queue_lock, flags);
+	next = (adev->event_head + 1) % ADSP_EVENT_RING;
+	if (next == adev->event_tail) {
+		adev->events_dropped++;
+		spin_unlock_irqrestore(&adev->event_queue_lock, flags);
+		if (printk_ratelimit())
+			pr_err("adsp_event: %s event ring full\n", adev->name);
 		return;
 	}
+	event = adev->event_ring + adev->event_head;
 
 	if (id != EVENT_MSG_ID) {
 		event->type = 0;
@@ -522,8 +612,7 @@ static void adsp_event(void *driver_data, unsigned id, size_t len,
 		getevent(event->data.msg32, len);
 	}
 
-	spin_lock_irqsave(&adev->event_queue_lock, flags);
-	list_add_tail(&event->list, &adev->event_queue);
+	adev->event_head = next;
 	spin_unlock_irqrestore(&adev->event_queue_lock, flags);
 	wake_up(&adev->event_wait);
 }
@@ -547,9 +636,20 @@ static int adsp_open(struct inode *inode, struct file *filp)
 
 	pr_info("adsp_open() name = '%s'\n", adev->name);
 
+	adev->event_ring = kmalloc(ADSP_EVENT_RING * sizeof(struct adsp_event),
+				   GFP_KERNEL);
+	if (!adev->event_ring)
+		return -ENOMEM;
+	adev->event_head = 0;
+	adev->event_tail = 0;
+	adev->events_dropped = 0;
+
 	rc = msm_adsp_get(adev->name, &adev->module, &adsp_ops, adev);
-	if (rc)
+	if (rc) {
+		kfree(adev->event_ring);
+		adev->event_ring = NULL;
 		return rc;
+	}
 
 	pr_info("adsp_open() module '%s' adev %p\n", adev->name, adev);
 	filp->private_data = adev;
@@ -594,8 +694,8 @@ static void adsp_create(struct adsp_device *adev, const char *name,
 		return;
 
 	init_waitqueue_head(&adev->event_wait);
-	INIT_LIST_HEAD(&adev->event_queue);
 	spin_lock_init(&adev->event_queue_lock);
+	mutex_init(&adev->event_read_lock);
 
 	cdev_init(&adev->cdev, &adsp_fops);
 	adev->cdev.owner = THIS_MODULE;
@@ -21,6 +21,9 @@
 #include <linux/sched.h>
 #include <linux/wait.h>
 #include <linux/errno.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 
 #include <linux/delay.h>
 
@@ -58,6 +61,9 @@ struct dal_trace {
 
 #define DAL_VERSION		0x11
 
+/* calls a client may have outstanding, each with its own message buffer */
+#define DAL_CALL_SLOTS		8
+
 #define DAL_MSGID_DDI		0x00
 #define DAL_MSGID_ATTACH	0x01
 #define DAL_MSGID_DETACH	0x02
@@ -89,27 +95,56 @@ struct dal_channel {
 	struct dal_client *active;
 };
 
+/* One call: its message, ready to go out in a single write, and where
+ * the reply goes. A call with a done function is asynchronous, its reply
+ * is handed to done from the smd notify, at IRQ context.
+ */
+struct dal_call_slot {
+	struct list_head list;
+	dal_reply_func_t done;
+	void *cookie;
+	void *reply;
+	int reply_max;
+	int status;
+	unsigned msgid; /* msgid of expected reply */
+	ktime_t start;
+
+	struct dal_hdr hdr;
+	unsigned char data[DAL_DATA_MAX];
+};
+
 struct dal_client {
 	struct list_head list;
 	struct dal_channel *dch;
 	void *cookie;
 	dal_event_func_t event;
+	uint32_t device_id;
 
 	/* opaque handle for the far side */
 	void *remote;
 
-	/* dal rpc calls are fully synchronous -- only one call may be
-	 * active per client at a time
+	/* synchronous calls still go one at a time per client, but
+	 * asynchronous ones may queue up behind them
 	 */
 	struct mutex write_lock;
 	wait_queue_head_t wait;
 
 	unsigned char data[DAL_DATA_MAX];
 
-	void *reply;
-	int reply_max;
-	int status;
-	unsigned msgid; /* msgid of expected reply */
+	/* calls are answered in order, so replies pop the head of
+	 * pending. Both lists are protected by the channel lock.
+	 */
+	struct list_head pending;
+	struct list_head free_slots;
+	struct dal_call_slot slots[DAL_CALL_SLOTS];
+
+	/* call latency, send to reply */
+	unsigned calls;
+	unsigned async_calls;
+	unsigned outstanding;
+	unsigned max_outstanding;
+	u64 total_us;
+	unsigned max_us;
 
 	spinlock_t tr_lock;
 	unsigned tr_head;
@@ -191,11 +226,26 @@ static void dal_trace_log(struct dal_client *c,
 }
 
 
+static void dal_account_locked(struct dal_client *client,
+			       struct dal_call_slot *slot)
+{
+	unsigned us = ktime_to_us(ktime_sub(ktime_get(), slot->start));
+
+	client->calls++;
+	if (slot->done)
+		client->async_calls++;
+	client->outstanding--;
+	client->total_us += us;
+	if (us > client->max_us)
+		client->max_us = us;
+}
+
 static void dal_channel_notify(void *priv, unsigned event)
 {
 	struct dal_channel *dch = priv;
 	struct dal_hdr *hdr = &dch->hdr;
 	struct dal_client *client;
+	struct dal_call_slot *slot;
 	unsigned long flags;
 	int len;
 	int r;
@@ -267,13 +317,23 @@ check_data:
 			goto again;
 		}
 
-		if (hdr->msgid == client->msgid) {
+		slot = list_empty(&client->pending) ? NULL :
+			list_first_entry(&client->pending,
+					 struct dal_call_slot, list);
+		if (slot && hdr->msgid == slot->msgid) {
 			if (!client->remote)
 				client->remote = hdr->from;
-			if (len > client->reply_max)
-				len = client->reply_max;
-			memcpy(client->reply, client->data, len);
-			client->status = len;
+			if (len > slot->reply_max)
+				len = slot->reply_max;
+			list_del(&slot->list);
+			dal_account_locked(client, slot);
+			if (slot->done) {
+				slot->done(client->data, len, slot->cookie);
+				list_add(&slot->list, &client->free_slots);
+			} else {
+				memcpy(slot->reply, client->data, len);
+				slot->status = len;
+			}
 			wake_up(&client->wait);
 			goto again;
 		}
@@ -331,43 +391,132 @@ fail:
 	return dch;
 }
 
-int dal_call_raw(struct dal_client *client,
-		 struct dal_hdr *hdr,
-		 void *data, int data_len,
-		 void *reply, int reply_max)
+static struct dal_call_slot *dal_try_get_slot(struct dal_client *client)
 {
 	struct dal_channel *dch = client->dch;
+	struct dal_call_slot *slot = NULL;
 	unsigned long flags;
 
-	client->reply = reply;
-	client->reply_max = reply_max;
-	client->msgid = hdr->msgid | DAL_MSGID_REPLY;
-	client->status = -EBUSY;
+	spin_lock_irqsave(&dch->lock, flags);
+	if (!list_empty(&client->free_slots)) {
+		slot = list_first_entry(&client->free_slots,
+					struct dal_call_slot, list);
+		list_del(&slot->list);
+	}
+	spin_unlock_irqrestore(&dch->lock, flags);
+	return slot;
+}
+
+static struct dal_call_slot *dal_get_slot(struct dal_client *client)
+{
+	struct dal_call_slot *slot;
+
+	if (!wait_event_timeout(client->wait,
+				(slot = dal_try_get_slot(client)), 5*HZ)) {
+		dal_trace_dump(client);
+		pr_err("dal: no free call slot. dsp is probably dead.\n");
+		BUG();
+	}
+	return slot;
+}
+
+static void dal_put_slot(struct dal_client *client, struct dal_call_slot *slot)
+{
+	struct dal_channel *dch = client->dch;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dch->lock, flags);
+	list_add(&slot->list, &client->free_slots);
+	spin_unlock_irqrestore(&dch->lock, flags);
+	wake_up(&client->wait);
+}
+
+/* The whole message goes out in one write, and joins pending under the
+ * same lock so that the reply cannot beat it there.
+ */
+static void dal_send_slot(struct dal_client *client,
+			  struct dal_call_slot *slot)
+{
+	struct dal_channel *dch = client->dch;
+	struct dal_hdr *hdr = &slot->hdr;
+	unsigned long flags;
+	int tries = 0;
+
+	slot->msgid = hdr->msgid | DAL_MSGID_REPLY;
+	slot->status = -EBUSY;
 
 #if DAL_TRACE
 	pr_info("dal send %p -> %p %02x:%04x:%02x %d\n",
 		hdr->from, hdr->to, hdr->msgid, hdr->ddi,
 		hdr->prototype, hdr->length - sizeof(*hdr));
-	print_hex_dump_bytes("", DUMP_PREFIX_OFFSET, data, data_len);
+	print_hex_dump_bytes("", DUMP_PREFIX_OFFSET, slot->data,
+			     hdr->length - sizeof(*hdr));
 #endif
 
 	if (client->tr_log)
-		dal_trace_log(client, hdr, data, data_len);
-
-	spin_lock_irqsave(&dch->lock, flags);
-	/* FIXME: ensure entire message is written or none. */
-	smd_write(dch->sch, hdr, sizeof(*hdr));
-	smd_write(dch->sch, data, data_len);
+		dal_trace_log(client, hdr, slot->data,
+			      hdr->length - sizeof(*hdr));
+
+	for (;;) {
+		spin_lock_irqsave(&dch->lock, flags);
+		if (smd_write_avail(dch->sch) >= hdr->length)
+			break;
+		spin_unlock_irqrestore(&dch->lock, flags);
+		if (++tries > 5000) {
+			pr_err("dal: channel %s stuck full\n", dch->name);
+			BUG();
+		}
+		msleep(1);
+	}
+	slot->start = ktime_get();
+	list_add_tail(&slot->list, &client->pending);
+	if (++client->outstanding > client->max_outstanding)
+		client->max_outstanding = client->outstanding;
+	smd_write(dch->sch, hdr, hdr->length);
 	spin_unlock_irqrestore(&dch->lock, flags);
+}
 
-	if (!wait_event_timeout(client->wait, (client->status != -EBUSY), 5*HZ)) {
+int dal_call_raw(struct dal_client *client,
+		 struct dal_hdr *hdr,
+		 void *data, int data_len,
+		 void *reply, int reply_max)
+{
+	struct dal_call_slot *slot;
+	int status;
+
+	slot = dal_get_slot(client);
+	slot->done = NULL;
+	slot->reply = reply;
+	slot->reply_max = reply_max;
+	memcpy(&slot->hdr, hdr, sizeof(*hdr));
+	memcpy(slot->data, data, data_len);
+
+	dal_send_slot(client, slot);
+
+	if (!wait_event_timeout(client->wait, (slot->status != -EBUSY), 5*HZ)) {
 		dal_trace_dump(client);
 		pr_err("dal: call timed out. dsp is probably dead.\n");
 		dal_trace_print(hdr, data, data_len, 0);
 		BUG();
 	}
 
-	return client->status;
+	status = slot->status;
+	dal_put_slot(client, slot);
+	return status;
+}
+
+static void dal_init_hdr(struct dal_client *client, struct dal_hdr *hdr,
+			 unsigned ddi, unsigned prototype, int data_len)
+{
+	memset(hdr, 0, sizeof(*hdr));
+
+	hdr->length = data_len + sizeof(*hdr);
+	hdr->version = DAL_VERSION;
+	hdr->msgid = DAL_MSGID_DDI;
+	hdr->ddi = ddi;
+	hdr->prototype = prototype;
+	hdr->from = client;
+	hdr->to = client->remote;
 }
 
 int dal_call(struct dal_client *client,
@@ -378,19 +527,11 @@ int dal_call(struct dal_client *client,
 	struct dal_hdr hdr;
 	int r;
 
-	memset(&hdr, 0, sizeof(hdr));
-
-	hdr.length = data_len + sizeof(hdr);
-	hdr.version = DAL_VERSION;
-	hdr.msgid = DAL_MSGID_DDI;
-	hdr.ddi = ddi;
-	hdr.prototype = prototype;
-	hdr.from = client;
-	hdr.to = client->remote;
-
-	if (hdr.length > DAL_MSG_MAX)
+	if (data_len > DAL_DATA_MAX)
 		return -EINVAL;
 
+	dal_init_hdr(client, &hdr, ddi, prototype, data_len);
+
 	mutex_lock(&client->write_lock);
 	r = dal_call_raw(client, &hdr, data, data_len, reply, reply_max);
 	mutex_unlock(&client->write_lock);
@@ -404,6 +545,69 @@ int dal_call(struct dal_client *client,
 	return r;
 }
 
+int dal_call_async(struct dal_client *client,
+		   unsigned ddi, unsigned prototype,
+		   void *data, int data_len, int reply_max,
+		   dal_reply_func_t done, void *cookie)
+{
+	struct dal_call_slot *slot;
+
+	if (data_len > DAL_DATA_MAX || !done)
+		return -EINVAL;
+
+	slot = dal_get_slot(client);
+	slot->done = done;
+	slot->cookie = cookie;
+	slot->reply = NULL;
+	slot->reply_max = min(reply_max, DAL_DATA_MAX);
+	dal_init_hdr(client, &slot->hdr, ddi, prototype, data_len);
+	memcpy(slot->data, data, data_len);
+
+	mutex_lock(&client->write_lock);
+	dal_send_slot(client, slot);
+	mutex_unlock(&client->write_lock);
+	return 0;
+}
+
+static int dal_idle(struct dal_client *client)
+{
+	struct dal_channel *dch = client->dch;
+	unsigned long flags;
+	int idle;
+
+	spin_lock_irqsave(&dch->lock, flags);
+	idle = list_empty(&client->pending);
+	spin_unlock_irqrestore(&dch->lock, flags);
+	return idle;
+}
+
+int dal_call_flush(struct dal_client *client)
+{
+	if (!wait_event_timeout(client->wait, dal_idle(client), 5*HZ)) {
+		dal_trace_dump(client);
+		pr_err("dal: flush timed out. dsp is probably dead.\n");
+		return -ETIMEDOUT;
+	}
+	return 0;
+}
+
+/* async reply handler for calls whose only result is a status word */
+void dal_reply_status(void *data, int len, void *cookie)
+{
+	uint32_t status = len >= 4 ? *(uint32_t *)data : -EIO;
+
+	if (status)
+		pr_err("dal: async call %08x failed (%d)\n",
+		       (unsigned) cookie, (int) status);
+}
+
+int dal_call_f0_async(struct dal_client *client, uint32_t ddi, uint32_t arg1)
+{
+	return dal_call_async(client, ddi, 0, &arg1, sizeof(arg1),
+			      sizeof(uint32_t), dal_reply_status,
+			      (void *) ddi);
+}
+
 struct dal_msg_attach {
 	uint32_t device_id;
 	char attach[64];
@@ -437,6 +641,11 @@ struct dal_client *dal_attach(uint32_t device_id, const char *name,
 	client->dch = dch;
 	client->event = func;
 	client->cookie = cookie;
+	client->device_id = device_id;
+	INIT_LIST_HEAD(&client->pending);
+	INIT_LIST_HEAD(&client->free_slots);
+	for (r = 0; r < DAL_CALL_SLOTS; r++)
+		list_add(&client->slots[r].list, &client->free_slots);
 	mutex_init(&client->write_lock);
 	spin_lock_init(&client->tr_lock);
 	init_waitqueue_head(&client->wait);
@@ -475,6 +684,8 @@ int dal_detach(struct dal_client *client)
 	struct dal_channel *dch;
 	unsigned long flags;
 
+	dal_call_flush(client);
+
 	mutex_lock(&client->write_lock);
 	if (client->remote) {
 		struct dal_hdr hdr;
@@ -517,6 +728,49 @@ void *dal_get_remote_handle(struct dal_client *client)
 	return client->remote;
 }
 
+static int dal_stats_show(struct seq_file *m, void *unused)
+{
+	struct dal_channel *dch;
+	struct dal_client *client;
+	unsigned long flags;
+
+	mutex_lock(&dal_channel_list_lock);
+	list_for_each_entry(dch, &dal_channel_list, list) {
+		seq_printf(m, "%s:\n", dch->name);
+		spin_lock_irqsave(&dch->lock, flags);
+		list_for_each_entry(client, &dch->clients, list)
+			seq_printf(m, "  %08x: calls %u async %u "
+				   "outstanding %u/%u avg %llu us max %u us\n",
+				   client->device_id, client->calls,
+				   client->async_calls, client->outstanding,
+				   client->max_outstanding, client->calls ?
+				   div_u64(client->total_us, client->calls) : 0,
+				   client->max_us);
+		spin_unlock_irqrestore(&dch->lock, flags);
+	}
+	mutex_unlock(&dal_channel_list_lock);
+	return 0;
+}
+
+static int dal_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dal_stats_show, NULL);
+}
+
+static const struct file_operations dal_stats_fops = {
+	.open		= dal_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init dal_stats_init(void)
+{
+	debugfs_create_file("dal_stats", S_IRUGO, NULL, NULL, &dal_stats_fops);
+	return 0;
+}
+late_initcall(dal_stats_init);
+
 /* convenience wrappers */
 
 int dal_call_f0(struct dal_client *client, uint32_t ddi, uint32_t arg1)
@@ -563,6 +817,23 @@ int dal_call_f5(struct dal_client *client, uint32_t ddi, void *ibuf, uint32_t il
 	return res;
 }
 
+int dal_call_f5_async(struct dal_client *client, uint32_t ddi, void *ibuf,
+		      uint32_t ilen)
+{
+	uint32_t tmp[128];
+
+	if (ilen + 4 > DAL_DATA_MAX)
+		return -EINVAL;
+
+	tmp[0] = ilen;
+	memcpy(&tmp[1], ibuf, ilen);
+
+	return dal_call_async(client, ddi, 5, tmp,
+			      (1 + DIV_ROUND_UP(ilen, 4)) * 4,
+			      sizeof(uint32_t), dal_reply_status,
+			      (void *) ddi);
+}
+
 int dal_call_f9(struct dal_client *client, uint32_t ddi, void *obuf,
 		uint32_t olen)
 {
@@ -27,6 +27,9 @@ struct dal_info {
 
 typedef void (*dal_event_func_t)(void *data, int len, void *cookie);
 
+/* called from the smd notify, at IRQ context, with the reply to a call */
+typedef void (*dal_reply_func_t)(void *data, int len, void *cookie);
+
 struct dal_client *dal_attach(uint32_t device_id, const char *name,
 			      dal_event_func_t func, void *cookie);
 
@@ -37,6 +40,20 @@ int dal_call(struct dal_client *client,
 	     void *data, int data_len,
 	     void *reply, int reply_max);
 
+/* Queue a call without waiting for its reply. Calls on one client are
+ * answered in the order they were made, sync or async.
+ */
+int dal_call_async(struct dal_client *client,
+		   unsigned ddi, unsigned prototype,
+		   void *data, int data_len, int reply_max,
+		   dal_reply_func_t done, void *cookie);
+
+/* wait until every call on the client has been answered */
+int dal_call_flush(struct dal_client *client);
+
+/* reply handler that logs a non-zero status word */
+void dal_reply_status(void *data, int len, void *cookie);
+
 void dal_trace(struct dal_client *client);
 void dal_trace_dump(struct dal_client *client);
 
@@ -48,8 +65,12 @@ int dal_call_f0(struct dal_client *client, uint32_t ddi,
 		uint32_t arg1);
 int dal_call_f1(struct dal_client *client, uint32_t ddi,
 		uint32_t arg1, uint32_t arg2);
+int dal_call_f0_async(struct dal_client *client, uint32_t ddi,
+		      uint32_t arg1);
 int dal_call_f5(struct dal_client *client, uint32_t ddi,
 		void *ibuf, uint32_t ilen);
+int dal_call_f5_async(struct dal_client *client, uint32_t ddi,
+		      void *ibuf, uint32_t ilen);
 int dal_call_f9(struct dal_client *client, uint32_t ddi,
 		void *obuf, uint32_t olen);
 int dal_call_f13(struct dal_client *client, uint32_t ddi, void *ibuf1,
@@ -29,13 +29,38 @@
 #define BUFSZ (8192)
 #define DMASZ (BUFSZ * 2)
 
+/* Deep buffering: with the screen off, userspace hands over seconds of
+ * compressed data at a time (64k is ~4s of 128kbps mp3) and is only
+ * woken again once half of it has been played.
+ */
+#define DEEP_BUFSZ_MAX (65536)
+
 struct mp3 {
 	struct mutex lock;
 	struct audio_client *ac;
 	uint32_t sample_rate;
 	uint32_t channel_count;
+	uint32_t buffer_size;
+	uint32_t buffer_count;
+
+	/* for AUDIO_GET_STATS */
+	uint32_t byte_count;
+	uint32_t wakeups;
+	unsigned long start;
 };
 
+static uint32_t mp3_wakeups_per_min(struct mp3 *mp3)
+{
+	unsigned long secs;
+
+	if (!mp3->ac)
+		return 0;
+	secs = (jiffies - mp3->start) / HZ;
+	if (!secs)
+		return 0;
+	return mp3->wakeups * 60 / secs;
+}
+
 static long mp3_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct mp3 *mp3 = file->private_data;
@@ -44,6 +69,9 @@ static long mp3_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	if (cmd == AUDIO_GET_STATS) {
 		struct msm_audio_stats stats;
 		memset(&stats, 0, sizeof(stats));
+		stats.byte_count = mp3->byte_count;
+		/* host wakeups per minute of playback */
+		stats.unused[0] = mp3_wakeups_per_min(mp3);
 		if (copy_to_user((void*) arg, &stats, sizeof(stats)))
 			return -EFAULT;
 		return 0;
@@ -72,10 +100,17 @@ static long mp3_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		if (mp3->ac) {
 			rc = -EBUSY;
 		} else {
-			mp3->ac = q6audio_open_mp3(BUFSZ,
-				mp3->sample_rate, mp3->channel_count, acdb_id);
-			if (!mp3->ac)
+			mp3->ac = q6audio_open_mp3(mp3->buffer_size,
+				mp3->buffer_count, mp3->sample_rate,
+				mp3->channel_count, acdb_id);
+			if (!mp3->ac) {
 				rc = -ENOMEM;
+				break;
+			}
+			mp3->ac->wake_free = mp3->buffer_count / 2;
+			mp3->byte_count = 0;
+			mp3->wakeups = 0;
+			mp3->start = jiffies;
 		}
 		break;
 	}
@@ -97,14 +132,28 @@ static long mp3_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			rc = -EINVAL;
 			break;
 		}
+		/* 0 keeps the defaults for callers that never set them */
+		if (config.buffer_size == 0)
+			config.buffer_size = BUFSZ;
+		if (config.buffer_count == 0)
+			config.buffer_count = 2;
+		if (config.buffer_size < BUFSZ ||
+		    config.buffer_size > DEEP_BUFSZ_MAX ||
+		    config.buffer_count < 2 ||
+		    config.buffer_count > AUDIO_MAX_BUFFERS) {
+			rc = -EINVAL;
+			break;
+		}
 		mp3->sample_rate = config.sample_rate;
 		mp3->channel_count = config.channel_count;
+		mp3->buffer_size = config.buffer_size;
+		mp3->buffer_count = config.buffer_count;
 		break;
 	}
 	case AUDIO_GET_CONFIG: {
 		struct msm_audio_config config;
-		config.buffer_size = BUFSZ;
-		config.buffer_count = 2;
+		config.buffer_size = mp3->buffer_size;
+		config.buffer_count = mp3->buffer_count;
 		config.sample_rate = mp3->sample_rate;
 		config.channel_count = mp3->channel_count;
 		config.unused[0] = 0;
@@ -135,6 +184,8 @@ static int mp3_open(struct inode *inode, struct file *file)
 	mutex_init(&mp3->lock);
 	mp3->channel_count = 2;
 	mp3->sample_rate = 44100;
+	mp3->buffer_size = BUFSZ;
+	mp3->buffer_count = 2;
 
 	file->private_data = mp3;
 	return rc;
@@ -159,8 +210,14 @@ static ssize_t mp3_write(struct file *file, const char __user *buf,
 	while (count > 0) {
 		ab = ac->buf + ac->cpu_buf;
 
-		if (ab->used)
-			wait_event(ac->wait, (ab->used == 0));
+		/* sleep until the ring is down to its low water mark, and
+		 * then refill all of it in one go
+		 */
+		if (ab->used) {
+			wait_event(ac->wait, (ab->used == 0 &&
+				   q6audio_bufs_free(ac) >= ac->wake_free));
+			mp3->wakeups++;
+		}
 
 		xfer = count;
 		if (xfer > ab->size)
@@ -174,7 +231,9 @@ static ssize_t mp3_write(struct file *file, const char __user *buf,
 
 		ab->used = xfer;
 		q6audio_write(ac, ab);
-		ac->cpu_buf ^= 1;
+		if (++ac->cpu_buf == ac->buf_count)
+			ac->cpu_buf = 0;
+		mp3->byte_count += xfer;
 	}
 
 	return buf - start;
@@ -191,8 +250,12 @@ static int mp3_fsync(struct file *f, struct dentry *dentry, int datasync)
 static int mp3_release(struct inode *inode, struct file *file)
 {
 	struct mp3 *mp3 = file->private_data;
-	if (mp3->ac)
+	if (mp3->ac) {
+		pr_info("mp3: %u x %u byte buffers, %u wakeups/min\n",
+			mp3->buffer_count, mp3->buffer_size,
+			mp3_wakeups_per_min(mp3));
 		q6audio_mp3_close(mp3->ac);
+	}
 	kfree(mp3);
 	return 0;
 }
@@ -469,8 +469,9 @@ static int vdec_reuse_framebuffer(struct vdec_data *vd, void *argp)
 		return ret;
 	}
 
-	ret = dal_call_f0(vd->vdec_handle, VDEC_DALRPC_REUSEFRAMEBUFFER,
-			  buf_id);
+	/* one per decoded frame, nothing to wait for but the status */
+	ret = dal_call_f0_async(vd->vdec_handle, VDEC_DALRPC_REUSEFRAMEBUFFER,
+				buf_id);
 	if (ret)
 		pr_err("%s: remote function failed (%d)\n", __func__, ret);
 
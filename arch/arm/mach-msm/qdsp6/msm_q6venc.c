@@ -157,6 +157,7 @@ struct venc_buf {
 struct venc_pmem_list {
 	struct list_head list;
 	struct venc_buf buf;
+	int index;
 };
 struct venc_dev {
 	bool is_active;
@@ -167,6 +168,7 @@ struct venc_dev {
 	spinlock_t venc_msg_list_lock;
 	struct list_head venc_pmem_list_head;
 	spinlock_t venc_pmem_list_lock;
+	struct venc_pmem_list *pmem_reg[VENC_MAX_REG_BUFFERS];
 	struct dal_client *q6_handle;
 	wait_queue_head_t venc_msg_evt;
 	struct device *class_devp;
@@ -302,9 +304,21 @@ static struct venc_pmem_list *venc_add_pmem_to_list(struct venc_dev *dvenc,
 	plist->buf.size = mptr->size;
 	plist->buf.btype = btype;
 	plist->buf.offset = mptr->offset;
+	plist->index = -1;
 
 	spin_lock_irqsave(&dvenc->venc_pmem_list_lock, flags);
 	list_add(&plist->list, &dvenc->venc_pmem_list_head);
+	if (btype == VENC_BUFFER_TYPE_INPUT ||
+	    btype == VENC_BUFFER_TYPE_OUTPUT) {
+		int i;
+		for (i = 0; i < VENC_MAX_REG_BUFFERS; i++) {
+			if (!dvenc->pmem_reg[i]) {
+				dvenc->pmem_reg[i] = plist;
+				plist->index = i;
+				break;
+			}
+		}
+	}
 	spin_unlock_irqrestore(&dvenc->venc_pmem_list_lock, flags);
 	return plist;
 
@@ -347,6 +361,54 @@ static struct venc_pmem_list *venc_get_pmem_from_list(
 		return NULL;
 }
 
+/* The registered pmem files stay pinned until release, so the table
+ * entries never go away under a running session.
+ */
+static struct venc_pmem_list *venc_get_pmem_by_index(struct venc_dev *dvenc,
+						     u32 index, u32 btype)
+{
+	struct venc_pmem_list *plist;
+
+	if (index >= VENC_MAX_REG_BUFFERS)
+		return NULL;
+	plist = dvenc->pmem_reg[index];
+	if (plist && plist->buf.btype != btype)
+		return NULL;
+	return plist;
+}
+
+static int venc_register_buffer(struct venc_dev *dvenc, void *argp,
+				u32 btype)
+{
+	struct venc_reg_buffer reg;
+	struct venc_pmem_list *plist;
+
+	if (copy_from_user(&reg, argp, sizeof(reg))) {
+		pr_err("%s: copy_from_user failed\n", __func__);
+		return -EFAULT;
+	}
+	plist = venc_get_pmem_from_list(dvenc, reg.buf.fd, reg.buf.offset,
+			btype);
+	if (plist == NULL) {
+		plist = venc_add_pmem_to_list(dvenc, &reg.buf, btype);
+		if (plist == NULL) {
+			pr_err("%s: buffer add_to_pmem_list failed\n",
+				__func__);
+			return -EPERM;
+		}
+	}
+	if (plist->index < 0) {
+		pr_err("%s: no free buffer index\n", __func__);
+		return -ENOSPC;
+	}
+	reg.index = plist->index;
+	if (copy_to_user(argp, &reg, sizeof(reg))) {
+		pr_err("%s: copy_to_user failed\n", __func__);
+		return -EFAULT;
+	}
+	return 0;
+}
+
 static int venc_set_buffer(struct venc_dev *dvenc, void *argp,
 			     u32 btype)
 {
@@ -478,11 +540,68 @@ static int venc_start(struct venc_dev *dvenc, void *argp)
 	return ret;
 }
 
+static int venc_queue_input(struct venc_dev *dvenc,
+			    struct venc_pmem_list *plist, u32 flags,
+			    long long time_stamp, u32 client_data)
+{
+	int ret;
+	struct venc_input_buf q6_input;
+
+	q6_input.flags = 0;
+	if (flags & VENC_FLAG_EOS)
+		q6_input.flags |= 0x00000001;
+	q6_input.yuv_buf.region = 0;
+	q6_input.yuv_buf.phys = plist->buf.paddr;
+	q6_input.yuv_buf.size = plist->buf.size;
+	q6_input.yuv_buf.offset = 0;
+	q6_input.data_size = plist->buf.size;
+	q6_input.client_data = client_data;
+	q6_input.time_stamp = time_stamp;
+	q6_input.dvs_offsetx = 0;
+	q6_input.dvs_offsety = 0;
+
+
+kpi_start[cnt] = ktime_to_ns(ktime_get());
+TRACE("kpi_start %d, %u \n", cnt, kpi_start[cnt]);
+cnt++;
+
+	TRACE("Pushing down input phys=0x%x fd= %d, client_data: 0x%x,"
+		" time_stamp:%lld \n", q6_input.yuv_buf.phys, plist->buf.fd,
+		client_data, time_stamp);
+	ret = dal_call_f5(dvenc->q6_handle, VENC_DALRPC_QUEUE_INPUT,
+		&q6_input, sizeof(q6_input));
+
+	if (ret != 0)
+		pr_err("%s: Q6 queue_input failed (%d)\n", __func__,
+		(int)ret);
+	return ret;
+}
+
+static int venc_queue_output(struct venc_dev *dvenc,
+			     struct venc_pmem_list *plist, u32 client_data)
+{
+	int ret;
+	struct venc_output_buf q6_output;
+
+	q6_output.bit_stream_buf.region = 0;
+	q6_output.bit_stream_buf.phys = (u32)plist->buf.paddr;
+	q6_output.bit_stream_buf.size = plist->buf.size;
+	q6_output.bit_stream_buf.offset = 0;
+	q6_output.client_data = client_data;
+	/* the buffer comes back with the encoded frame, the status of the
+	 * queue call itself is only worth a log line
+	 */
+	ret = dal_call_f5_async(dvenc->q6_handle, VENC_DALRPC_QUEUE_OUTPUT,
+				&q6_output, sizeof(q6_output));
+	if (ret != 0)
+		pr_err("%s: remote function failed (%d)\n", __func__, ret);
+	return ret;
+}
+
 static int venc_encode_frame(struct venc_dev *dvenc, void *argp)
 {
 	int ret = 0;
 	struct venc_pmem buf;
-	struct venc_input_buf q6_input;
 	struct venc_pmem_list *plist;
 	struct venc_buffer input;
 
@@ -511,41 +630,34 @@ static int venc_encode_frame(struct venc_dev *dvenc, void *argp)
 		}
 	}
 
-	q6_input.flags = 0;
-	if (input.flags & VENC_FLAG_EOS)
-		q6_input.flags |= 0x00000001;
-	q6_input.yuv_buf.region = 0;
-	q6_input.yuv_buf.phys = plist->buf.paddr;
-	q6_input.yuv_buf.size = plist->buf.size;
-	q6_input.yuv_buf.offset = 0;
-	q6_input.data_size = plist->buf.size;
-	q6_input.client_data = (u32)input.client_data;
-	q6_input.time_stamp = input.time_stamp;
-	q6_input.dvs_offsetx = 0;
-	q6_input.dvs_offsety = 0;
-
-
-kpi_start[cnt] = ktime_to_ns(ktime_get());
-TRACE("kpi_start %d, %u \n", cnt, kpi_start[cnt]);
-cnt++;
+	return venc_queue_input(dvenc, plist, input.flags, input.time_stamp,
+				(u32)input.client_data);
+}
 
-	TRACE("Pushing down input phys=0x%x fd= %d, client_data: 0x%x,"
-		" time_stamp:%lld \n", q6_input.yuv_buf.phys, plist->buf.fd,
-		input.client_data, input.time_stamp);
-	ret = dal_call_f5(dvenc->q6_handle, VENC_DALRPC_QUEUE_INPUT,
-		&q6_input, sizeof(q6_input));
+static int venc_encode_frame_index(struct venc_dev *dvenc, void *argp)
+{
+	struct venc_index_buffer input;
+	struct venc_pmem_list *plist;
 
-	if (ret != 0)
-		pr_err("%s: Q6 queue_input failed (%d)\n", __func__,
-		(int)ret);
-	return ret;
+	if (copy_from_user(&input, argp, sizeof(input))) {
+		pr_err("%s: copy_from_user failed\n", __func__);
+		return -EFAULT;
+	}
+	plist = venc_get_pmem_by_index(dvenc, input.index,
+			VENC_BUFFER_TYPE_INPUT);
+	if (plist == NULL) {
+		pr_err("%s: invalid input buffer index %u\n", __func__,
+			input.index);
+		return -EINVAL;
+	}
+	return venc_queue_input(dvenc, plist, input.flags, input.time_stamp,
+				input.client_data);
 }
 
 static int venc_fill_output(struct venc_dev *dvenc, void *argp)
 {
 	int ret = 0;
 	struct venc_pmem buf;
-	struct venc_output_buf q6_output;
 	struct venc_pmem_list *plist;
 	struct venc_buffer output;
 
@@ -572,17 +684,26 @@ static int venc_fill_output(struct venc_dev *dvenc, void *argp)
 			return -EPERM;
 		}
 	}
-	q6_output.bit_stream_buf.region = 0;
-	q6_output.bit_stream_buf.phys = (u32)plist->buf.paddr;
-	q6_output.bit_stream_buf.size = plist->buf.size;
-	q6_output.bit_stream_buf.offset = 0;
-	q6_output.client_data = (u32)output.client_data;
-	ret =
-	    dal_call_f5(dvenc->q6_handle, VENC_DALRPC_QUEUE_OUTPUT, &q6_output,
-			sizeof(q6_output));
-	if (ret != 0)
-		pr_err("%s: remote function failed (%d)\n", __func__, ret);
-	return ret;
+	return venc_queue_output(dvenc, plist, (u32)output.client_data);
+}
+
+static int venc_fill_output_index(struct venc_dev *dvenc, void *argp)
+{
+	struct venc_index_buffer output;
+	struct venc_pmem_list *plist;
+
+	if (copy_from_user(&output, argp, sizeof(output))) {
+		pr_err("%s: copy_from_user failed\n", __func__);
+		return -EFAULT;
+	}
+	plist = venc_get_pmem_by_index(dvenc, output.index,
+			VENC_BUFFER_TYPE_OUTPUT);
+	if (plist == NULL) {
+		pr_err("%s: invalid output buffer index %u\n", __func__,
+			output.index);
+		return -EINVAL;
+	}
+	return venc_queue_output(dvenc, plist, output.client_data);
 }
 
 static int venc_stop(struct venc_dev *dvenc)
@@ -1042,6 +1163,19 @@ static long q6venc_ioctl(struct file *file, u32 cmd,
 	case VENC_IOCTL_CMD_FILL_OUTPUT_BUFFER:
 		ret = venc_fill_output(dvenc, argp);
 		break;
+	case VENC_IOCTL_REGISTER_INPUT_BUFFER:
+		ret = venc_register_buffer(dvenc, argp, VENC_BUFFER_TYPE_INPUT);
+		break;
+	case VENC_IOCTL_REGISTER_OUTPUT_BUFFER:
+		ret = venc_register_buffer(dvenc, argp,
+					   VENC_BUFFER_TYPE_OUTPUT);
+		break;
+	case VENC_IOCTL_CMD_ENCODE_FRAME_INDEX:
+		ret = venc_encode_frame_index(dvenc, argp);
+		break;
+	case VENC_IOCTL_CMD_FILL_OUTPUT_BUFFER_INDEX:
+		ret = venc_fill_output_index(dvenc, argp);
+		break;
 	case VENC_IOCTL_CMD_FLUSH:
 		ret = venc_flush(dvenc, argp);
 		break;
@@ -28,7 +28,11 @@
 
 void audio_client_dump(struct audio_client *ac);
 
+/* large buffers by default, so the DSP wakes the CPU up rarely during
+ * music playback; AUDIO_SET_CONFIG may ask for more, smaller ones.
+ */
 #define BUFSZ (3072)
+#define BUFCNT (2)
 
 struct pcm {
 	struct mutex lock;
@@ -36,8 +40,17 @@ struct pcm {
 	uint32_t sample_rate;
 	uint32_t channel_count;
 	size_t buffer_size;
+	uint32_t buffer_count;
 };
 
+/* time to drain all queued buffers, which is what a new sample waits */
+static unsigned pcm_latency_ms(struct pcm *pcm)
+{
+	unsigned bytes_per_sec = pcm->sample_rate * pcm->channel_count * 2;
+
+	return (pcm->buffer_size * pcm->buffer_count * 1000) / bytes_per_sec;
+}
+
 static long pcm_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct pcm *pcm = file->private_data;
@@ -74,11 +87,17 @@ static long pcm_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		if (pcm->ac) {
 			rc = -EBUSY;
 		} else {
-			pcm->ac = q6audio_open_pcm(pcm->buffer_size, pcm->sample_rate,
-						   pcm->channel_count,
-						   AUDIO_FLAG_WRITE, acdb_id);
+			pcm->ac = q6audio_open_pcm_bufs(pcm->buffer_size,
+							pcm->buffer_count,
+							pcm->sample_rate,
+							pcm->channel_count,
+							AUDIO_FLAG_WRITE, acdb_id);
 			if (!pcm->ac)
 				rc = -ENOMEM;
+			else
+				pr_info("pcm_out: %u x %zu bytes, latency %u ms\n",
+					pcm->buffer_count, pcm->buffer_size,
+					pcm_latency_ms(pcm));
 		}
 		break;
 	}
@@ -108,18 +127,28 @@ static long pcm_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			rc = -EINVAL;
 			break;
 		}
+		/* 0 for callers that never looked at the count */
+		if (config.buffer_count == 0)
+			config.buffer_count = BUFCNT;
+		if (config.buffer_count < 2 ||
+		    config.buffer_count > AUDIO_MAX_BUFFERS) {
+			rc = -EINVAL;
+			break;
+		}
 		pcm->sample_rate = config.sample_rate;
 		pcm->channel_count = config.channel_count;
 		pcm->buffer_size = config.buffer_size;
+		pcm->buffer_count = config.buffer_count;
 		break;
 	}
 	case AUDIO_GET_CONFIG: {
 		struct msm_audio_config config;
 		config.buffer_size = pcm->buffer_size;
-		config.buffer_count = 2;
+		config.buffer_count = pcm->buffer_count;
 		config.sample_rate = pcm->sample_rate;
 		config.channel_count = pcm->channel_count;
-		config.unused[0] = 0;
+		/* output latency of this configuration, in ms */
+		config.unused[0] = pcm_latency_ms(pcm);
 		config.unused[1] = 0;
 		config.unused[2] = 0;
 		if (copy_to_user((void*) arg, &config, sizeof(config))) {
@@ -148,6 +177,7 @@ static int pcm_open(struct inode *inode, struct file *file)
 	pcm->channel_count = 2;
 	pcm->sample_rate = 44100;
 	pcm->buffer_size = BUFSZ;
+	pcm->buffer_count = BUFCNT;
 
 	file->private_data = pcm;
 	return 0;
@@ -191,7 +221,8 @@ static ssize_t pcm_write(struct file *file, const char __user *buf,
 
 		ab->used = xfer;
 		q6audio_write(ac, ab);
-		ac->cpu_buf ^= 1;
+		if (++ac->cpu_buf == ac->buf_count)
+			ac->cpu_buf = 0;
 	}
 
 	return buf - start;
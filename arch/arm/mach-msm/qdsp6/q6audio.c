@@ -275,18 +275,19 @@ static void session_free(int n, struct audio_client *ac)
 
 static void audio_client_free(struct audio_client *ac)
 {
+	int n;
+
 	session_free(ac->session, ac);
 
-	if (ac->buf[0].data)
-		dma_free_coherent(NULL, ac->buf[0].size,
-				  ac->buf[0].data, ac->buf[0].phys);
-	if (ac->buf[1].data)
-		dma_free_coherent(NULL, ac->buf[1].size,
-				  ac->buf[1].data, ac->buf[1].phys);
+	for (n = 0; n < ac->buf_count; n++)
+		if (ac->buf[n].data)
+			dma_free_coherent(NULL, ac->buf[n].size,
+					  ac->buf[n].data, ac->buf[n].phys);
 	kfree(ac);
 }
 
-static struct audio_client *audio_client_alloc(unsigned bufsz)
+static struct audio_client *__audio_client_alloc(unsigned bufsz,
+						 unsigned bufcnt)
 {
 	struct audio_client *ac;
 	int n;
@@ -300,18 +301,15 @@ static struct audio_client *audio_client_alloc(unsigned bufsz)
 		goto fail_session;
 	ac->session = n;
 
+	ac->buf_count = bufcnt;
 	if (bufsz > 0) {
-		ac->buf[0].data = dma_alloc_coherent(NULL, bufsz,
-						&ac->buf[0].phys, GFP_KERNEL);
-		if (!ac->buf[0].data)
-			goto fail;
-		ac->buf[1].data = dma_alloc_coherent(NULL, bufsz,
-						&ac->buf[1].phys, GFP_KERNEL);
-		if (!ac->buf[1].data)
-			goto fail;
-
-		ac->buf[0].size = bufsz;
-		ac->buf[1].size = bufsz;
+		for (n = 0; n < bufcnt; n++) {
+			ac->buf[n].data = dma_alloc_coherent(NULL, bufsz,
+						&ac->buf[n].phys, GFP_KERNEL);
+			if (!ac->buf[n].data)
+				goto fail;
+			ac->buf[n].size = bufsz;
+		}
 	}
 
 	init_waitqueue_head(&ac->wait);
@@ -320,12 +318,17 @@ static struct audio_client *audio_client_alloc(unsigned bufsz)
 	return ac;
 
 fail:
-	session_free(n, ac);
+	session_free(ac->session, ac);
 fail_session:
 	audio_client_free(ac);
 	return 0;
 }
 
+static struct audio_client *audio_client_alloc(unsigned bufsz)
+{
+	return __audio_client_alloc(bufsz, 2);
+}
+
 void audio_client_dump(struct audio_client *ac)
 {
 	dal_trace_dump(ac->client);
@@ -588,6 +591,37 @@ static int audio_qcelp_open(struct audio_client *ac, uint32_t bufsz,
 	return audio_ioctl(ac, &rpc, sizeof(rpc));
 }
 
+/* SBC frames encoded by the DSP from what is mixed for the A2DP device */
+static int audio_sbc_open(struct audio_client *ac, uint32_t bufsz,
+			  uint32_t rate, uint32_t channels,
+			  struct msm_audio_sbc_enc_config *cfg)
+{
+	struct adsp_open_command rpc;
+	struct adsp_audio_standard_format *fmt = &(rpc.format.standard);
+
+	memset(&rpc, 0, sizeof(rpc));
+
+	fmt->format = ADSP_AUDIO_FORMAT_SBC;
+	fmt->sampling_rate = rate;
+	fmt->channels = channels;
+	fmt->bits_per_sample = 16;
+	fmt->is_signed = 1;
+	fmt->is_interleaved = 1;
+
+	rpc.device = ADSP_AUDIO_DEVICE_ID_BT_A2DP_SPKR;
+	rpc.hdr.opcode = ADSP_AUDIO_IOCTL_CMD_OPEN_READ;
+	rpc.stream_context = ADSP_AUDIO_DEVICE_CONTEXT_RECORD;
+	rpc.config.sbc.num_subbands = cfg->subbands;
+	rpc.config.sbc.block_len = cfg->block_len;
+	rpc.config.sbc.channel_mode = cfg->channel_mode;
+	rpc.config.sbc.allocation_method = cfg->allocation;
+	rpc.config.sbc.bit_rate = cfg->bit_rate;
+	rpc.buf_max_size = bufsz;
+
+	TRACE("%p: open sbc\n", ac);
+	return audio_ioctl(ac, &rpc, sizeof(rpc));
+}
+
 static int audio_close(struct audio_client *ac)
 {
 	TRACE("%p: close\n", ac);
@@ -736,9 +770,6 @@ static void callback(void *data, int len, void *cookie)
 	struct audio_client *ac;
 	struct adsp_buffer_event *abe = data;
 
-	TRACE("audio callback: context %d, event 0x%x, status %d\n",
-	      e->context, e->event_id, e->status);
-
 	if (e->context >= SESSION_MAX) {
 		pr_err("audio callback: bogus session %d\n",
 		       e->context);
@@ -751,6 +782,30 @@ static void callback(void *data, int len, void *cookie)
 		return;
 	}
 
+	/* buffer completions are what a writer is blocked on; handle them
+	 * first, and with as little work as possible, so small buffers
+	 * get refilled before the DSP runs dry.
+	 */
+	if (likely(e->event_id == ADSP_AUDIO_EVT_STATUS_BUF_DONE)) {
+		TRACE("%p: CB done (%d)\n", ac, e->status);
+		TRACE("%p: actual_size %d, buffer_size %d\n",
+		      ac, abe->buffer.actual_size, ac->buf[ac->dsp_buf].size);
+
+		if (e->status)
+			pr_err("buffer status %d\n", e->status);
+		ac->buf[ac->dsp_buf].used = 0;
+		if (++ac->dsp_buf == ac->buf_count)
+			ac->dsp_buf = 0;
+		/* deep buffered writers only want to hear when it runs low */
+		if (ac->wake_free <= 1 ||
+		    q6audio_bufs_free(ac) >= ac->wake_free)
+			wake_up(&ac->wait);
+		return;
+	}
+
+	TRACE("audio callback: context %d, event 0x%x, status %d\n",
+	      e->context, e->event_id, e->status);
+
 	if (e->event_id == ADSP_AUDIO_IOCTL_CMD_STREAM_EOS) {
 		TRACE("%p: CB stream eos\n", ac);
 		if (e->status)
@@ -762,19 +817,6 @@ static void callback(void *data, int len, void *cookie)
 		return;
 	}
 
-	if (e->event_id == ADSP_AUDIO_EVT_STATUS_BUF_DONE) {
-		TRACE("%p: CB done (%d)\n", ac, e->status);
-		TRACE("%p: actual_size %d, buffer_size %d\n",
-		      ac, abe->buffer.actual_size, ac->buf[ac->dsp_buf].size);
-
-		if (e->status)
-			pr_err("buffer status %d\n", e->status);
-		ac->buf[ac->dsp_buf].used = 0;
-		ac->dsp_buf ^= 1;
-		wake_up(&ac->wait);
-		return;
-	}
-
 	TRACE("%p: CB %08x status %d\n", ac, e->event_id, e->status);
 	if (e->status)
 		pr_warning("audio_cb: s=%d e=%08x status=%d\n",
@@ -890,6 +932,34 @@ void *acdb_data;
 const struct firmware *acdb_fw;
 extern struct miscdevice q6_control_device;
 
+/* Routing looks the same few (device, rate) pairs up over and over, and
+ * the database has up to 1024 entries. Remember where they were, misses
+ * included, until another database is loaded.
+ */
+#define ACDB_CACHE_SIZE 16
+
+struct acdb_cache_entry {
+	uint32_t device_id;
+	uint32_t sample_rate;
+	int n;		/* database entry, -1 if there is none */
+};
+
+static struct acdb_cache_entry acdb_cache[ACDB_CACHE_SIZE];
+static int acdb_cache_count;
+static int acdb_cache_next;
+
+/* the table last sent to the dsp, and for which device: [0] tx, [1] rx */
+static uint32_t acdb_sent_dev[2];
+static int acdb_sent_entry[2] = { -1, -1 };
+
+static void acdb_cache_flush(void)
+{
+	acdb_cache_count = 0;
+	acdb_cache_next = 0;
+	acdb_sent_entry[0] = -1;
+	acdb_sent_entry[1] = -1;
+}
+
 static int acdb_init(char *filename)
 {
 	const struct audio_config_database *db;
@@ -935,19 +1005,21 @@ static int acdb_init(char *filename)
 		release_firmware(acdb_fw);
 	acdb_data = (void*) fw->data;
 	acdb_fw = fw;
+	acdb_cache_flush();
 	return 0;
 fail:
 	release_firmware(fw);
 	return -ENODEV;
 }
 
-static int acdb_get_config_table(uint32_t device_id, uint32_t sample_rate)
+static int acdb_find_entry(uint32_t device_id, uint32_t sample_rate)
 {
 	struct audio_config_database *db;
+	struct acdb_cache_entry *ce;
 	int n, res;
 
 	if (q6audio_init())
-		return 0;
+		return -ENODEV;
 
 	if (!acdb_data) {
 		res = acdb_init(acdb_file);
@@ -955,6 +1027,13 @@ static int acdb_get_config_table(uint32_t device_id, uint32_t sample_rate)
 			return res;
 	}
 
+	for (n = 0; n < acdb_cache_count; n++) {
+		ce = &acdb_cache[n];
+		if (ce->device_id == device_id &&
+		    ce->sample_rate == sample_rate)
+			return ce->n;
+	}
+
 	db = acdb_data;
 	for (n = 0; n < db->entry_count; n++) {
 		if (db->entry[n].device_id != device_id)
@@ -967,11 +1046,26 @@ static int acdb_get_config_table(uint32_t device_id, uint32_t sample_rate)
 	if (n == db->entry_count) {
 		pr_err("acdb: no entry for device %d, rate %d.\n",
 		       device_id, sample_rate);
-		return 0;
+		n = -1;
 	}
 
+	ce = &acdb_cache[acdb_cache_next];
+	ce->device_id = device_id;
+	ce->sample_rate = sample_rate;
+	ce->n = n;
+	acdb_cache_next = (acdb_cache_next + 1) % ACDB_CACHE_SIZE;
+	if (acdb_cache_count < ACDB_CACHE_SIZE)
+		acdb_cache_count++;
+	return n;
+}
+
+static int acdb_get_config_table(int n)
+{
+	struct audio_config_database *db = acdb_data;
+
 	pr_info("acdb: %d bytes for device %d, rate %d.\n",
-		db->entry[n].length, device_id, sample_rate);
+		db->entry[n].length, db->entry[n].device_id,
+		db->entry[n].sample_rate);
 
 	memcpy(audio_data, acdb_data + db->entry[n].offset, db->entry[n].length);
 	return db->entry[n].length;
@@ -1075,30 +1169,40 @@ static void audio_tx_analog_enable(int en)
 	}
 }
 
-static int audio_update_acdb(uint32_t adev, uint32_t acdb_id)
+static int audio_find_acdb(uint32_t adev, uint32_t acdb_id)
 {
-	uint32_t sample_rate;
-	int sz = -1;
+	uint32_t sample_rate = q6_device_to_rate(adev);
+	int n = -1;
 
-	sample_rate = q6_device_to_rate(adev);
+	if (acdb_id != 0)
+		n = acdb_find_entry(acdb_id, sample_rate);
+	if (n < 0)
+		n = acdb_find_entry(q6_device_to_cad_id(adev), sample_rate);
+	return n;
+}
+
+static int audio_update_acdb(uint32_t adev, uint32_t acdb_id)
+{
+	int rx = (q6_device_to_dir(adev) == Q6_RX);
+	int n, sz;
 
-	if (q6_device_to_dir(adev) == Q6_RX)
+	if (rx)
 		rx_acdb = acdb_id;
 	else
 		tx_acdb = acdb_id;
 
-	if (acdb_id != 0)
-		sz = acdb_get_config_table(acdb_id, sample_rate);
+	n = audio_find_acdb(adev, acdb_id);
+	if (n < 0)
+		return -EINVAL;
 
-	if (sz <= 0) {
-		acdb_id = q6_device_to_cad_id(adev);
-		sz = acdb_get_config_table(acdb_id, sample_rate);
-		if (sz <= 0)
-			return -EINVAL;
-	}
+	/* the dsp still has this table for the device */
+	if (acdb_sent_entry[rx] == n && acdb_sent_dev[rx] == adev)
+		return 0;
 
-	if (sz > 0)
-		audio_set_table(ac_control, adev, sz);
+	sz = acdb_get_config_table(n);
+	audio_set_table(ac_control, adev, sz);
+	acdb_sent_dev[rx] = adev;
+	acdb_sent_entry[rx] = n;
 	return 0;
 }
 
@@ -1480,10 +1584,18 @@ static void do_rx_routing(uint32_t device_id, uint32_t acdb_id)
 	}
 
 	if (audio_rx_path_refcount > 0) {
+		/* look the new table up and hold the adie session open
+		 * across the switch, so only the path change itself is
+		 * left between the old device going quiet and the new
+		 * one starting
+		 */
+		audio_find_acdb(device_id, acdb_id);
+		adie_enable();
 		qdsp6_devchg_notify(ac_control, ADSP_AUDIO_RX_DEVICE, device_id);
 		_audio_rx_path_disable();
 		_audio_rx_clk_reinit(device_id);
 		_audio_rx_path_enable(1, acdb_id);
+		adie_disable();
 	} else {
 		audio_rx_device_id = device_id;
 		audio_rx_path_id = q6_device_to_path(device_id);
@@ -1503,10 +1615,14 @@ static void do_tx_routing(uint32_t device_id, uint32_t acdb_id)
 	}
 
 	if (audio_tx_path_refcount > 0) {
+		/* see do_rx_routing() */
+		audio_find_acdb(device_id, acdb_id);
+		adie_enable();
 		qdsp6_devchg_notify(ac_control, ADSP_AUDIO_TX_DEVICE, device_id);
 		_audio_tx_path_disable();
 		_audio_tx_clk_reinit(device_id);
 		_audio_tx_path_enable(1, acdb_id);
+		adie_disable();
 	} else {
 		audio_tx_device_id = device_id;
 		audio_tx_path_id = q6_device_to_path(device_id);
@@ -1567,14 +1683,24 @@ done:
 
 struct audio_client *q6audio_open_pcm(uint32_t bufsz, uint32_t rate,
 				      uint32_t channels, uint32_t flags, uint32_t acdb_id)
+{
+	return q6audio_open_pcm_bufs(bufsz, 2, rate, channels, flags, acdb_id);
+}
+
+struct audio_client *q6audio_open_pcm_bufs(uint32_t bufsz, uint32_t bufcnt,
+					   uint32_t rate, uint32_t channels,
+					   uint32_t flags, uint32_t acdb_id)
 {
 	int rc, retry = 5;
 	struct audio_client *ac;
 
+	if (bufcnt < 2 || bufcnt > AUDIO_MAX_BUFFERS)
+		return 0;
+
 	if (q6audio_init())
 		return 0;
 
-	ac = audio_client_alloc(bufsz);
+	ac = __audio_client_alloc(bufsz, bufcnt);
 	if (!ac)
 		return 0;
 
@@ -1639,10 +1765,11 @@ struct audio_client *q6audio_open_pcm(uint32_t bufsz, uint32_t rate,
 	}
 
 	if (!(ac->flags & AUDIO_FLAG_WRITE)) {
-		ac->buf[0].used = 1;
-		ac->buf[1].used = 1;
-		q6audio_read(ac, &ac->buf[0]);
-		q6audio_read(ac, &ac->buf[1]);
+		int n;
+		for (n = 0; n < ac->buf_count; n++) {
+			ac->buf[n].used = 1;
+			q6audio_read(ac, &ac->buf[n]);
+		}
 	}
 
 	audio_prevent_sleep();
@@ -1697,17 +1824,21 @@ int q6voice_close(struct audio_client *ac)
 	return 0;
 }
 
-struct audio_client *q6audio_open_mp3(uint32_t bufsz, uint32_t rate,
-				      uint32_t channels, uint32_t acdb_id)
+struct audio_client *q6audio_open_mp3(uint32_t bufsz, uint32_t bufcnt,
+				      uint32_t rate, uint32_t channels,
+				      uint32_t acdb_id)
 {
 	struct audio_client *ac;
 
 	printk("q6audio_open_mp3()\n");
 
+	if (bufcnt < 2 || bufcnt > AUDIO_MAX_BUFFERS)
+		return 0;
+
 	if (q6audio_init())
 		return 0;
 
-	ac = audio_client_alloc(bufsz);
+	ac = __audio_client_alloc(bufsz, bufcnt);
 	if (!ac)
 		return 0;
 
@@ -1786,6 +1917,50 @@ int q6audio_aac_close(struct audio_client *ac)
 	return 0;
 }
 
+/* The PCM side is an ordinary playback stream routed to the A2DP
+ * device, so only the encoded stream is opened here and no tx path
+ * is brought up.
+ */
+struct audio_client *q6audio_open_sbc(uint32_t bufsz, uint32_t rate,
+				      uint32_t channels,
+				      struct msm_audio_sbc_enc_config *cfg)
+{
+	struct audio_client *ac;
+	int rc;
+
+	if (q6audio_init())
+		return 0;
+
+	ac = audio_client_alloc(bufsz);
+	if (!ac)
+		return 0;
+
+	ac->flags = AUDIO_FLAG_READ;
+	rc = audio_sbc_open(ac, bufsz, rate, channels, cfg);
+	if (rc) {
+		pr_err("q6audio: open sbc error %d\n", rc);
+		audio_client_free(ac);
+		return 0;
+	}
+	audio_command(ac, ADSP_AUDIO_IOCTL_CMD_SESSION_START);
+
+	ac->buf[0].used = 1;
+	ac->buf[1].used = 1;
+	q6audio_read(ac, &ac->buf[0]);
+	q6audio_read(ac, &ac->buf[1]);
+
+	audio_prevent_sleep();
+	return ac;
+}
+
+int q6audio_sbc_close(struct audio_client *ac)
+{
+	audio_close(ac);
+	audio_client_free(ac);
+	audio_allow_sleep();
+	return 0;
+}
+
 struct audio_client *q6fm_open(void)
 {
 	struct audio_client *ac;
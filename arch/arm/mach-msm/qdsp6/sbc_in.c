@@ -0,0 +1,238 @@
+/* arch/arm/mach-msm/qdsp6/sbc_in.c
+ *
+ * SBC frames for A2DP, encoded by the DSP. Audio for the headset is
+ * played through msm_pcm_out with the route set to the A2DP device as
+ * usual, and the Bluetooth stack reads the encoded frames from here
+ * instead of running the SBC encoder on the CPU.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/fs.h>
+#include <linux/module.h>
+#include <linux/miscdevice.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/uaccess.h>
+
+#include <linux/msm_audio.h>
+
+#include <mach/msm_qdsp6_audio.h>
+
+#define BUFSZ (2048)
+
+static DEFINE_MUTEX(sbc_in_lock);
+static uint32_t sample_rate = 44100;
+static uint32_t channel_count = 2;
+static uint32_t buffer_size = BUFSZ;
+static struct msm_audio_sbc_enc_config sbc_config = {
+	.subbands = 8,
+	.block_len = 16,
+	.channel_mode = AUDIO_SBC_MODE_JOINT_STEREO,
+	.allocation = AUDIO_SBC_ALLOCATION_LOUDNESS,
+	.bit_rate = 328000,
+};
+static int sbc_in_opened;
+
+void audio_client_dump(struct audio_client *ac);
+
+static int sbc_config_valid(struct msm_audio_sbc_enc_config *cfg)
+{
+	if (cfg->subbands != 4 && cfg->subbands != 8)
+		return 0;
+	if (cfg->block_len < 4 || cfg->block_len > 16 || cfg->block_len % 4)
+		return 0;
+	switch (cfg->channel_mode) {
+	case AUDIO_SBC_MODE_MONO:
+	case AUDIO_SBC_MODE_STEREO:
+	case AUDIO_SBC_MODE_DUAL:
+	case AUDIO_SBC_MODE_JOINT_STEREO:
+		break;
+	default:
+		return 0;
+	}
+	return cfg->allocation == AUDIO_SBC_ALLOCATION_LOUDNESS ||
+		cfg->allocation == AUDIO_SBC_ALLOCATION_SNR;
+}
+
+static long q6_sbc_in_ioctl(struct file *file, unsigned int cmd,
+			    unsigned long arg)
+{
+	int rc = 0;
+
+	switch (cmd) {
+	case AUDIO_START:
+		mutex_lock(&sbc_in_lock);
+		if (file->private_data) {
+			rc = -EBUSY;
+		} else {
+			file->private_data = q6audio_open_sbc(buffer_size,
+					sample_rate, channel_count, &sbc_config);
+			if (!file->private_data)
+				rc = -ENOMEM;
+		}
+		mutex_unlock(&sbc_in_lock);
+		break;
+	case AUDIO_STOP:
+		break;
+	case AUDIO_FLUSH:
+		break;
+	case AUDIO_SET_CONFIG: {
+		struct msm_audio_config config;
+		if (copy_from_user(&config, (void *) arg, sizeof(config))) {
+			rc = -EFAULT;
+			break;
+		}
+		if (!config.channel_count || config.channel_count > 2) {
+			rc = -EINVAL;
+			break;
+		}
+		if (config.sample_rate < 16000 || config.sample_rate > 48000) {
+			rc = -EINVAL;
+			break;
+		}
+		if (config.buffer_size < 512 || config.buffer_size > 8192) {
+			rc = -EINVAL;
+			break;
+		}
+		sample_rate = config.sample_rate;
+		channel_count = config.channel_count;
+		buffer_size = config.buffer_size;
+		break;
+	}
+	case AUDIO_GET_CONFIG: {
+		struct msm_audio_config config;
+		memset(&config, 0, sizeof(config));
+		config.buffer_size = buffer_size;
+		config.buffer_count = 2;
+		config.sample_rate = sample_rate;
+		config.channel_count = channel_count;
+		if (copy_to_user((void *) arg, &config, sizeof(config)))
+			rc = -EFAULT;
+		break;
+	}
+	case AUDIO_SET_SBC_ENC_CONFIG: {
+		struct msm_audio_sbc_enc_config cfg;
+		if (copy_from_user(&cfg, (void *) arg, sizeof(cfg))) {
+			rc = -EFAULT;
+			break;
+		}
+		if (!sbc_config_valid(&cfg)) {
+			rc = -EINVAL;
+			break;
+		}
+		mutex_lock(&sbc_in_lock);
+		sbc_config = cfg;
+		mutex_unlock(&sbc_in_lock);
+		break;
+	}
+	case AUDIO_GET_SBC_ENC_CONFIG:
+		if (copy_to_user((void *) arg, &sbc_config, sizeof(sbc_config)))
+			rc = -EFAULT;
+		break;
+	default:
+		rc = -EINVAL;
+	}
+	return rc;
+}
+
+static int q6_sbc_in_open(struct inode *inode, struct file *file)
+{
+	int rc;
+
+	mutex_lock(&sbc_in_lock);
+	if (sbc_in_opened) {
+		pr_err("sbc_in: busy\n");
+		rc = -EBUSY;
+	} else {
+		sbc_in_opened = 1;
+		rc = 0;
+	}
+	mutex_unlock(&sbc_in_lock);
+	return rc;
+}
+
+/* Each read returns one DSP buffer, count must be large enough for it */
+static ssize_t q6_sbc_in_read(struct file *file, char __user *buf,
+			      size_t count, loff_t *pos)
+{
+	struct audio_client *ac;
+	struct audio_buffer *ab;
+	int xfer;
+	int res;
+
+	mutex_lock(&sbc_in_lock);
+	ac = file->private_data;
+	if (!ac) {
+		res = -ENODEV;
+		goto done;
+	}
+
+	ab = ac->buf + ac->cpu_buf;
+	if (ab->used)
+		if (!wait_event_timeout(ac->wait, (ab->used == 0), 5*HZ)) {
+			audio_client_dump(ac);
+			pr_err("sbc_read: timeout. dsp dead?\n");
+			res = -ETIMEDOUT;
+			goto done;
+		}
+
+	xfer = ab->size;
+	if (xfer > count) {
+		res = -EINVAL;
+		goto done;
+	}
+	if (copy_to_user(buf, ab->data, xfer)) {
+		res = -EFAULT;
+		goto done;
+	}
+	res = xfer;
+
+	ab->used = 1;
+	q6audio_read(ac, ab);
+	ac->cpu_buf ^= 1;
+done:
+	mutex_unlock(&sbc_in_lock);
+	return res;
+}
+
+static int q6_sbc_in_release(struct inode *inode, struct file *file)
+{
+	int rc = 0;
+	mutex_lock(&sbc_in_lock);
+	if (file->private_data)
+		rc = q6audio_sbc_close(file->private_data);
+	sbc_in_opened = 0;
+	mutex_unlock(&sbc_in_lock);
+	return rc;
+}
+
+static struct file_operations q6_sbc_in_fops = {
+	.owner		= THIS_MODULE,
+	.open		= q6_sbc_in_open,
+	.read		= q6_sbc_in_read,
+	.release	= q6_sbc_in_release,
+	.unlocked_ioctl	= q6_sbc_in_ioctl,
+};
+
+struct miscdevice q6_sbc_in_misc = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "msm_sbc_in",
+	.fops	= &q6_sbc_in_fops,
+};
+
+static int __init q6_sbc_in_init(void)
+{
+	return misc_register(&q6_sbc_in_misc);
+}
+
+device_initcall(q6_sbc_in_init);
@@ -148,10 +148,10 @@ static int sirc_irq_set_type(unsigned int irq, unsigned int flow_type)
 	val = readl(sirc_regs.int_type);
 	if (flow_type & (IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING)) {
 		val |= mask;
-		irq_desc[irq].handle_irq = handle_edge_irq;
+		msm_irq_set_flow(irq, handle_edge_irq);
 	} else {
 		val &= ~mask;
-		irq_desc[irq].handle_irq = handle_level_irq;
+		msm_irq_set_flow(irq, handle_level_irq);
 	}
 
 	writel(val, sirc_regs.int_type);
@@ -177,7 +177,7 @@ void sirc_fiq_select(int irq, bool enable)
 }
 #endif
 
-/* Finds the pending interrupt on the passed cascade irq and redrives it */
+/* Redrives every interrupt pending on the passed cascade irq */
 static void sirc_irq_handler(unsigned int irq, struct irq_desc *desc)
 {
 	unsigned int reg = 0;
@@ -193,11 +193,11 @@ static void sirc_irq_handler(unsigned int irq, struct irq_desc *desc)
 	if (status == 0)
 		return;
 
-	for (sirq = 0;
-	     (sirq < NR_SIRC_IRQS) && ((status & (1U << sirq)) == 0);
-	     sirq++)
-		;
-	generic_handle_irq(sirq+FIRST_SIRC_IRQ);
+	while (status) {
+		sirq = __ffs(status);
+		status &= ~(1U << sirq);
+		generic_handle_irq(sirq + FIRST_SIRC_IRQ);
+	}
 
 	desc->chip->ack(irq);
 }
@@ -236,7 +236,7 @@ void __init msm_init_sirc(void)
 
 	for (i = FIRST_SIRC_IRQ; i < FIRST_SIRC_IRQ + NR_SIRC_IRQS; i++) {
 		set_irq_chip(i, &sirc_irq_chip);
-		set_irq_handler(i, handle_edge_irq);
+		msm_irq_set_flow(i, handle_edge_irq);
 		set_irq_flags(i, IRQF_VALID);
 	}
 
@@ -16,6 +16,8 @@
 #ifndef _ARCH_ARM_MACH_MSM_SIRC_H
 #define _ARCH_ARM_MACH_MSM_SIRC_H
 
+#include <linux/irq.h>
+
 #ifdef CONFIG_ARCH_QSD8X50
 void sirc_fiq_select(int irq, bool enable);
 void __init msm_init_sirc(void);
@@ -24,4 +26,16 @@ static inline void sirc_fiq_select(int irq, bool enable) {}
 static inline void __init msm_init_sirc(void) {}
 #endif
 
+/* Installs the flow handler of a VIC or SIRC interrupt. With
+ * CONFIG_MSM_IRQ_STATS it is wrapped to account the time spent in it.
+ */
+#if defined(CONFIG_MSM_IRQ_STATS)
+void msm_irq_set_flow(unsigned int irq, irq_flow_handler_t flow);
+#else
+static inline void msm_irq_set_flow(unsigned int irq, irq_flow_handler_t flow)
+{
+	irq_desc[irq].handle_irq = flow;
+}
+#endif
+
 #endif
@@ -27,6 +27,7 @@
 #include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/io.h>
+#include <linux/hrtimer.h>
 
 #include <mach/msm_smd.h>
 #include <mach/msm_iomap.h>
@@ -35,6 +36,9 @@
 #include "smd_private.h"
 #include "proc_comm.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/smd.h>
+
 #if defined(CONFIG_ARCH_QSD8X50)
 #define CONFIG_QDSP6 1
 #endif
@@ -69,6 +73,16 @@ module_param_named(ciq_info, msm_smd_ciq_info,
 module_param_named(debug_mask, msm_smd_debug_mask,
 		   int, S_IRUGO | S_IWUSR | S_IWGRP);
 
+/* Writes interrupt the other side once coalesce_bytes are pending, or after
+ * coalesce_us, whichever comes first.  0 bytes interrupts on every write.
+ */
+static int msm_smd_coalesce_bytes;
+static int msm_smd_coalesce_us = 200;
+module_param_named(coalesce_bytes, msm_smd_coalesce_bytes,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+module_param_named(coalesce_us, msm_smd_coalesce_us,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+
 void *smem_item(unsigned id, unsigned *size);
 static void smd_diag(void);
 
@@ -163,6 +177,21 @@ static int check_for_modem_crash(void)
 DEFINE_SPINLOCK(smd_lock);
 DEFINE_SPINLOCK(smem_lock);
 
+/* write interrupt coalescing, one per remote processor */
+struct smd_coalesce {
+	struct hrtimer timer;
+	unsigned pending;
+	void (*notify)(void);
+};
+
+static DEFINE_SPINLOCK(smd_coalesce_lock);
+static struct smd_coalesce smd_coalesce_modem = {
+	.notify = notify_modem_smd,
+};
+static struct smd_coalesce smd_coalesce_dsp = {
+	.notify = notify_dsp_smd,
+};
+
 /* the mutex is used during open() and close()
  * operations to avoid races while creating or
  * destroying smd_channel structures
@@ -213,6 +242,7 @@ struct smd_channel {
 	unsigned fifo_mask;
 	unsigned fifo_size;
 	unsigned current_packet;
+	unsigned pending_write;
 	unsigned n;
 
 	struct list_head ch_list;
@@ -230,6 +260,10 @@ struct smd_channel {
 	void (*notify_other_cpu)(void);
 	unsigned type;
 
+	unsigned intr_rx;		/* irqs that flagged this channel */
+	unsigned intr_tx;		/* interrupts sent to the other side */
+	unsigned intr_tx_coalesced;	/* writes that did not interrupt */
+
 	char name[32];
 	struct platform_device pdev;
 };
@@ -516,6 +550,7 @@ static void handle_smd_irq(struct list_head *list, void (*notify)(void))
 		if (tmp != ch->last_state)
 			smd_state_change(ch, ch->last_state, tmp);
 		if (ch_flags) {
+			ch->intr_rx++;
 			ch->update_state(ch);
 			ch->notify(ch->priv, SMD_EVENT_DATA);
 		}
@@ -632,16 +667,16 @@ static int smd_is_packet(int chn, unsigned type)
 		return 0;
 }
 
-static int smd_stream_write(smd_channel_t *ch, const void *_data, int len)
+/* basic write interface to ch_write_{buffer,done} used by
+ * smd_stream_write() and smd_write_begin(), does not notify
+ */
+static int ch_write(struct smd_channel *ch, const void *_data, int len)
 {
 	void *ptr;
 	const unsigned char *buf = _data;
 	unsigned xfer;
 	int orig_len = len;
 
-	if (len < 0)
-		return -EINVAL;
-
 	while ((xfer = ch_write_buffer(ch, &ptr)) != 0) {
 		if (!ch_is_open(ch))
 			break;
@@ -655,11 +690,72 @@ static int smd_stream_write(smd_channel_t *ch, const void *_data, int len)
 			break;
 	}
 
-	ch->notify_other_cpu();
-
 	return orig_len - len;
 }
 
+static enum hrtimer_restart smd_coalesce_timer_func(struct hrtimer *timer)
+{
+	struct smd_coalesce *c = container_of(timer, struct smd_coalesce, timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&smd_coalesce_lock, flags);
+	c->pending = 0;
+	spin_unlock_irqrestore(&smd_coalesce_lock, flags);
+	c->notify();
+
+	return HRTIMER_NORESTART;
+}
+
+/* interrupt the other side about bytes just written, or let the
+ * coalescing timer do it for this and following writes
+ */
+static void smd_notify_write(struct smd_channel *ch, unsigned bytes)
+{
+	struct smd_coalesce *c;
+	unsigned long flags;
+	int now = 1;
+
+	if (msm_smd_coalesce_bytes > 0) {
+		c = (ch->type == SMD_TYPE_APPS_MODEM) ?
+			&smd_coalesce_modem : &smd_coalesce_dsp;
+
+		spin_lock_irqsave(&smd_coalesce_lock, flags);
+		c->pending += bytes;
+		if (c->pending >= msm_smd_coalesce_bytes) {
+			c->pending = 0;
+			hrtimer_try_to_cancel(&c->timer);
+		} else {
+			if (!hrtimer_active(&c->timer))
+				hrtimer_start(&c->timer,
+					ktime_set(0, msm_smd_coalesce_us * 1000),
+					HRTIMER_MODE_REL);
+			now = 0;
+		}
+		spin_unlock_irqrestore(&smd_coalesce_lock, flags);
+	}
+
+	if (now) {
+		ch->intr_tx++;
+		ch->notify_other_cpu();
+	} else {
+		ch->intr_tx_coalesced++;
+	}
+}
+
+static int smd_stream_write(smd_channel_t *ch, const void *_data, int len)
+{
+	int r;
+
+	if (len < 0)
+		return -EINVAL;
+
+	r = ch_write(ch, _data, len);
+
+	smd_notify_write(ch, r);
+
+	return r;
+}
+
 static int smd_packet_write(smd_channel_t *ch, const void *_data, int len)
 {
 	unsigned hdr[5];
@@ -673,8 +769,10 @@ static int smd_packet_write(smd_channel_t *ch, const void *_data, int len)
 	hdr[0] = len;
 	hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
 
-	smd_stream_write(ch, hdr, sizeof(hdr));
-	smd_stream_write(ch, _data, len);
+	/* header and data go out with one interrupt */
+	ch_write(ch, hdr, sizeof(hdr));
+	ch_write(ch, _data, len);
+	smd_notify_write(ch, len + SMD_HEADER_SIZE);
 
 	return len;
 }
@@ -867,6 +965,7 @@ int smd_open(const char *name, smd_channel_t **_ch,
 
 	ch->notify = notify;
 	ch->current_packet = 0;
+	ch->pending_write = 0;
 	ch->last_state = SMD_SS_CLOSED;
 	ch->priv = priv;
 
@@ -913,12 +1012,18 @@ int smd_close(smd_channel_t *ch)
 
 int smd_read(smd_channel_t *ch, void *data, int len)
 {
-	return ch->read(ch, data, len);
+	int res = ch->read(ch, data, len);
+
+	trace_smd_read(ch->name, len, res);
+	return res;
 }
 
 int smd_write(smd_channel_t *ch, const void *data, int len)
 {
-	return ch->write(ch, data, len);
+	int res = ch->write(ch, data, len);
+
+	trace_smd_write(ch->name, len, res);
+	return res;
 }
 
 int smd_write_atomic(smd_channel_t *ch, const void *data, int len)
@@ -928,6 +1033,7 @@ int smd_write_atomic(smd_channel_t *ch, const void *data, int len)
 	spin_lock_irqsave(&smd_lock, flags);
 	res = ch->write(ch, data, len);
 	spin_unlock_irqrestore(&smd_lock, flags);
+	trace_smd_write(ch->name, len, res);
 	return res;
 }
 
@@ -976,6 +1082,89 @@ int smd_cur_packet_size(smd_channel_t *ch)
 	return ch->current_packet;
 }
 
+int smd_is_packet_channel(smd_channel_t *ch)
+{
+	return ch->update_state == update_packet_state;
+}
+
+int smd_read_peek(smd_channel_t *ch, void **ptr)
+{
+	unsigned n = ch_read_buffer(ch, ptr);
+
+	if (ch->update_state == update_packet_state && n > ch->current_packet)
+		n = ch->current_packet;
+	return n;
+}
+
+int smd_read_consume(smd_channel_t *ch, int len)
+{
+	unsigned long flags;
+	void *ptr;
+
+	if (len < 0 || len > smd_read_peek(ch, &ptr))
+		return -EINVAL;
+
+	ch_read_done(ch, len);
+
+	if (ch->update_state == update_packet_state) {
+		spin_lock_irqsave(&smd_lock, flags);
+		ch->current_packet -= len;
+		update_packet_state(ch);
+		spin_unlock_irqrestore(&smd_lock, flags);
+	}
+	return len;
+}
+
+int smd_write_begin(smd_channel_t *ch, int len)
+{
+	unsigned hdr[5];
+
+	if (len <= 0)
+		return -EINVAL;
+	if (ch->pending_write)
+		return -EBUSY;
+	if (!ch_is_open(ch))
+		return -EIO;
+	if (ch->write_avail(ch) < len)
+		return -ENOMEM;
+
+	if (ch->update_state == update_packet_state) {
+		hdr[0] = len;
+		hdr[1] = hdr[2] = hdr[3] = hdr[4] = 0;
+		if (ch_write(ch, hdr, sizeof(hdr)) != sizeof(hdr))
+			return -EIO;
+	}
+	ch->pending_write = len;
+	return 0;
+}
+
+int smd_write_peek(smd_channel_t *ch, void **ptr)
+{
+	unsigned n = ch_write_buffer(ch, ptr);
+
+	if (n > ch->pending_write)
+		n = ch->pending_write;
+	return n;
+}
+
+int smd_write_commit(smd_channel_t *ch, int len)
+{
+	void *ptr;
+
+	if (len < 0 || len > smd_write_peek(ch, &ptr))
+		return -EINVAL;
+
+	ch_write_done(ch, len);
+	ch->pending_write -= len;
+	return len;
+}
+
+void smd_kick_remote(smd_channel_t *ch)
+{
+	ch->intr_tx++;
+	ch->notify_other_cpu();
+}
+
 
 /* ------------------------------------------------------------------------- */
 
@@ -1039,6 +1228,7 @@ static irqreturn_t smsm_irq_handler(int irq, void *data)
 	do_smd_probe();
 
 	spin_unlock_irqrestore(&smem_lock, flags);
+	msm_proc_comm_wakeup();
 	return IRQ_HANDLED;
 }
 
@@ -1160,6 +1350,13 @@ int smd_core_init(void)
 
 	smd_info.ready = 1;
 
+	hrtimer_init(&smd_coalesce_modem.timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	smd_coalesce_modem.timer.function = smd_coalesce_timer_func;
+	hrtimer_init(&smd_coalesce_dsp.timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	smd_coalesce_dsp.timer.function = smd_coalesce_timer_func;
+
 	r = request_irq(INT_A9_M2A_0, smd_modem_irq_handler,
 			IRQF_TRIGGER_RISING, "smd_dev", 0);
 	if (r < 0)
@@ -0,0 +1,314 @@
+/* arch/arm/mach-msm/smd_bench.c
+ *
+ * SMD loopback and RPC router round trip benchmark.
+ *
+ * Reading /sys/kernel/debug/smd_bench/loopback asks the modem to echo
+ * the LOOPBACK channel back to us and times it at several message sizes:
+ * the round trip of one message with the fifo otherwise empty, and the
+ * throughput with up to half the fifo in flight. Reading rpc times null
+ * procedure calls to a modem rpc server through msm_rpc_call(). Neither
+ * does any work on the modem beyond copying the data back, so the numbers
+ * are those of the shared memory transport and of the apps side driver.
+ *
+ * Each read starts one run and may take a few seconds, a second reader
+ * waits for the first.  Stop the radio first, its traffic shares the
+ * interrupts.
+ *
+ * Copyright (C) 2010 HTC Corporation.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/err.h>
+#include <linux/fs.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/wait.h>
+#include <asm/uaccess.h>
+
+#include <mach/msm_smd.h>
+#include <mach/msm_rpcrouter.h>
+#include <mach/msm_rpc_version.h>
+
+#include "smd_private.h"
+
+#define SMD_BENCH_RUNS		64	/* round trips per size */
+#define SMD_BENCH_BYTES		(128 * 1024)	/* streamed per size */
+#define SMD_BENCH_MAX_SIZE	4096
+#define SMD_BENCH_RPC_RUNS	256
+#define SMD_BENCH_BUFMAX	2048
+
+static const int smd_bench_sizes[] = { 16, 64, 256, 1024, 4096 };
+
+/* the channel the modem echoes once SMSM_SMD_LOOPBACK is set */
+static char loopback_channel[20] = "LOOPBACK";
+module_param_string(loopback_channel, loopback_channel,
+		    sizeof(loopback_channel), S_IWUSR | S_IRUGO);
+
+/* any server answers the null procedure, pmic lib is always there */
+static uint rpc_prog = PM_LIBPROG;
+module_param(rpc_prog, uint, S_IWUSR | S_IRUGO);
+static uint rpc_vers = PM_LIBVERS;
+module_param(rpc_vers, uint, S_IWUSR | S_IRUGO);
+
+struct smd_bench {
+	smd_channel_t *ch;
+	wait_queue_head_t wait;
+	int opened;
+	void *tx;
+	void *rx;
+	u32 us[SMD_BENCH_RPC_RUNS];
+};
+
+static struct smd_bench smd_bench;
+static DEFINE_MUTEX(smd_bench_lock);
+static char smd_bench_buffer[SMD_BENCH_BUFMAX];
+
+static void smd_bench_notify(void *priv, unsigned event)
+{
+	struct smd_bench *b = priv;
+
+	if (event == SMD_EVENT_OPEN)
+		b->opened = 1;
+	wake_up(&b->wait);
+}
+
+static int smd_bench_cmp(const void *a, const void *b)
+{
+	const u32 *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+/* sorts us, then the p50, p99 and max of the n samples */
+static int smd_bench_percentiles(char *buf, int max, u32 *us, int n)
+{
+	sort(us, n, sizeof(*us), smd_bench_cmp, NULL);
+	return scnprintf(buf, max, " %8u %8u %8u", us[(n - 1) / 2],
+			 us[(n - 1) * 99 / 100], us[n - 1]);
+}
+
+/* read whatever has come back, returns the bytes read or 0 on timeout */
+static int smd_bench_read(struct smd_bench *b)
+{
+	int n;
+
+	if (!wait_event_timeout(b->wait, smd_read_avail(b->ch) > 0, HZ))
+		return 0;
+	n = smd_read_avail(b->ch);
+	if (n > SMD_BENCH_MAX_SIZE)
+		n = SMD_BENCH_MAX_SIZE;
+	return smd_read(b->ch, b->rx, n);
+}
+
+static int smd_bench_rtt(struct smd_bench *b, int size)
+{
+	ktime_t start;
+	int i, n, got;
+
+	for (i = 0; i < SMD_BENCH_RUNS; i++) {
+		start = ktime_get();
+		if (smd_write(b->ch, b->tx, size) != size)
+			return -EIO;
+		for (got = 0; got < size; got += n) {
+			n = smd_bench_read(b);
+			if (n <= 0)
+				return -ETIMEDOUT;
+		}
+		b->us[i] = ktime_us_delta(ktime_get(), start);
+	}
+	return 0;
+}
+
+/* keeps at most window bytes in flight, so the echo never has to wait
+ * for us to make room, returns the time taken in us */
+static s64 smd_bench_stream(struct smd_bench *b, int size, int window)
+{
+	ktime_t start = ktime_get();
+	int sent = 0, got = 0, n;
+
+	while (got < SMD_BENCH_BYTES) {
+		while (sent < SMD_BENCH_BYTES && sent - got + size <= window &&
+		       smd_write_avail(b->ch) >= size) {
+			n = smd_write(b->ch, b->tx, size);
+			if (n <= 0)
+				break;
+			sent += n;
+		}
+		n = smd_bench_read(b);
+		if (n <= 0)
+			return -ETIMEDOUT;
+		got += n;
+	}
+	return ktime_us_delta(ktime_get(), start);
+}
+
+static int smd_bench_loopback(char *buf, int max)
+{
+	struct smd_bench *b = &smd_bench;
+	int i, size, window, len = 0;
+	s64 us;
+	int ret;
+
+	b->tx = kmalloc(SMD_BENCH_MAX_SIZE, GFP_KERNEL);
+	b->rx = kmalloc(SMD_BENCH_MAX_SIZE, GFP_KERNEL);
+	if (!b->tx || !b->rx) {
+		ret = -ENOMEM;
+		goto done;
+	}
+	memset(b->tx, 0x5a, SMD_BENCH_MAX_SIZE);
+
+	smsm_change_state(SMSM_STATE_APPS, 0, SMSM_SMD_LOOPBACK);
+	b->opened = 0;
+	ret = smd_open(loopback_channel, &b->ch, b, smd_bench_notify);
+	if (ret)
+		goto clear;
+	if (!wait_event_timeout(b->wait, b->opened, 2 * HZ)) {
+		ret = -ETIMEDOUT;
+		goto close;
+	}
+
+	/* the fifo is empty, this is all of it */
+	window = smd_write_avail(b->ch) / 2;
+	len += scnprintf(buf + len, max - len,
+			 "%s: %s channel, window %d bytes\n"
+			 " size  rtt_p50  rtt_p99  rtt_max  kb_per_s\n",
+			 loopback_channel,
+			 smd_is_packet_channel(b->ch) ? "packet" : "stream",
+			 window);
+	for (i = 0; i < ARRAY_SIZE(smd_bench_sizes); i++) {
+		size = smd_bench_sizes[i];
+		if (size > window)
+			break;
+		ret = smd_bench_rtt(b, size);
+		if (ret)
+			goto close;
+		us = smd_bench_stream(b, size, window);
+		if (us < 0) {
+			ret = us;
+			goto close;
+		}
+		len += scnprintf(buf + len, max - len, "%5d", size);
+		len += smd_bench_percentiles(buf + len, max - len, b->us,
+					     SMD_BENCH_RUNS);
+		len += scnprintf(buf + len, max - len, "  %8u\n",
+				 (unsigned)div64_u64(SMD_BENCH_BYTES * 1000ULL,
+						     max_t(s64, us, 1)));
+	}
+	ret = len;
+
+close:
+	smd_close(b->ch);
+clear:
+	smsm_change_state(SMSM_STATE_APPS, SMSM_SMD_LOOPBACK, 0);
+done:
+	kfree(b->tx);
+	kfree(b->rx);
+	if (ret < 0)
+		pr_err("smd_bench: %s failed %d\n", loopback_channel, ret);
+	return ret;
+}
+
+static int smd_bench_rpc(char *buf, int max)
+{
+	struct smd_bench *b = &smd_bench;
+	struct msm_rpc_endpoint *ept;
+	struct rpc_request_hdr req;
+	ktime_t start, t;
+	s64 us;
+	int i, ret = 0, len = 0;
+
+	ept = msm_rpc_connect(rpc_prog, rpc_vers, 0);
+	if (IS_ERR(ept))
+		return PTR_ERR(ept);
+
+	start = ktime_get();
+	for (i = 0; i < SMD_BENCH_RPC_RUNS; i++) {
+		t = ktime_get();
+		/* procedure 0 is the null procedure */
+		ret = msm_rpc_call(ept, 0, &req, sizeof(req), 5 * HZ);
+		if (ret < 0)
+			goto done;
+		b->us[i] = ktime_us_delta(ktime_get(), t);
+	}
+	us = ktime_us_delta(ktime_get(), start);
+
+	len += scnprintf(buf + len, max - len,
+			 "%08x:%08x null calls %d\n"
+			 "   p50_us   p99_us   max_us  calls_per_s\n",
+			 rpc_prog, rpc_vers, SMD_BENCH_RPC_RUNS);
+	len += smd_bench_percentiles(buf + len, max - len, b->us,
+				     SMD_BENCH_RPC_RUNS);
+	len += scnprintf(buf + len, max - len, " %12u\n",
+			 (unsigned)div64_u64(SMD_BENCH_RPC_RUNS * 1000000ULL,
+					     max_t(s64, us, 1)));
+	ret = len;
+done:
+	msm_rpc_close(ept);
+	return ret;
+}
+
+static ssize_t smd_bench_read_file(struct file *file, char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	int (*run)(char *buf, int max) = file->private_data;
+	ssize_t ret;
+	int n;
+
+	mutex_lock(&smd_bench_lock);
+	/* a run per read from the start, the tail comes from the buffer */
+	if (*ppos == 0) {
+		n = run(smd_bench_buffer, SMD_BENCH_BUFMAX);
+		if (n < 0) {
+			smd_bench_buffer[0] = 0;
+			mutex_unlock(&smd_bench_lock);
+			return n;
+		}
+	}
+	ret = simple_read_from_buffer(buf, count, ppos, smd_bench_buffer,
+				      strlen(smd_bench_buffer));
+	mutex_unlock(&smd_bench_lock);
+	return ret;
+}
+
+static int smd_bench_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static const struct file_operations smd_bench_ops = {
+	.read = smd_bench_read_file,
+	.open = smd_bench_open,
+};
+
+static int __init smd_bench_init(void)
+{
+	struct dentry *dent;
+
+	init_waitqueue_head(&smd_bench.wait);
+
+	dent = debugfs_create_dir("smd_bench", 0);
+	if (IS_ERR(dent))
+		return PTR_ERR(dent);
+
+	debugfs_create_file("loopback", 0400, dent, smd_bench_loopback,
+			    &smd_bench_ops);
+	debugfs_create_file("rpc", 0400, dent, smd_bench_rpc,
+			    &smd_bench_ops);
+	return 0;
+}
+
+late_initcall(smd_bench_init);
@@ -265,6 +265,29 @@ static int debug_read_ch(char *buf, int max)
 	return i;
 }
 
+static int dump_ch_intr(char *buf, int max, struct smd_channel *ch)
+{
+	return scnprintf(buf, max, "ch%02d: rx %8u tx %8u coalesced %8u '%s'\n",
+			 ch->n, ch->intr_rx, ch->intr_tx,
+			 ch->intr_tx_coalesced, ch->name);
+}
+
+static int debug_read_intr(char *buf, int max)
+{
+	struct smd_channel *ch;
+	unsigned long flags;
+	int i = 0;
+
+	spin_lock_irqsave(&smd_lock, flags);
+	list_for_each_entry(ch, &smd_ch_list_dsp, ch_list)
+		i += dump_ch_intr(buf + i, max - i, ch);
+	list_for_each_entry(ch, &smd_ch_list_modem, ch_list)
+		i += dump_ch_intr(buf + i, max - i, ch);
+	spin_unlock_irqrestore(&smd_lock, flags);
+
+	return i;
+}
+
 static int debug_read_version(char *buf, int max)
 {
 	struct smem_shared *shared = (void *) MSM_SHARED_RAM_BASE;
@@ -352,6 +375,7 @@ static int __init smd_debugfs_init(void)
 		return -1;
 
 	debug_create("ch", 0444, dent, debug_read_ch);
+	debug_create("intr", 0444, dent, debug_read_intr);
 	debug_create("stat", 0444, dent, debug_read_stat);
 	debug_create("mem", 0444, dent, debug_read_mem);
 	debug_create("version", 0444, dent, debug_read_version);
@@ -60,6 +60,7 @@ struct smd_channel {
 	unsigned fifo_mask;
 	unsigned fifo_size;
 	unsigned current_packet;
+	unsigned pending_write;
 	unsigned n;
 
 	struct list_head ch_list;
@@ -77,6 +78,10 @@ struct smd_channel {
 	void (*notify_other_cpu)(void);
 	unsigned type;
 
+	unsigned intr_rx;		/* irqs that flagged this channel */
+	unsigned intr_tx;		/* interrupts sent to the other side */
+	unsigned intr_tx_coalesced;	/* writes that did not interrupt */
+
 	char name[32];
 	struct platform_device pdev;
 };
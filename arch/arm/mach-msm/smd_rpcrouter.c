@@ -18,7 +18,6 @@
 /* TODO: handle cases where smd_write() will tempfail due to full fifo */
 /* TODO: thread priority? schedule a work to bump it? */
 /* TODO: maybe make server_list_lock a mutex */
-/* TODO: pool fragments to avoid kmalloc/kfree churn */
 
 #include <linux/module.h>
 #include <linux/kernel.h>
@@ -34,6 +33,10 @@
 #include <linux/sched.h>
 #include <linux/poll.h>
 #include <linux/wakelock.h>
+#include <linux/hash.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/pm_timeline.h>
 #include <asm/uaccess.h>
 #include <asm/byteorder.h>
 #include <linux/platform_device.h>
@@ -44,6 +47,9 @@
 #include <mach/msm_smd.h>
 #include "smd_rpcrouter.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/rpcrouter.h>
+
 #define TRACE_R2R_MSG 0
 #define TRACE_R2R_RAW 0
 #define TRACE_RPC_MSG 0
@@ -80,8 +86,21 @@
 #define NTFY(x...) do {} while (0)
 #endif
 
-static LIST_HEAD(local_endpoints);
-static LIST_HEAD(remote_endpoints);
+/* endpoints hashed by cid */
+#define RPCROUTER_EPT_HASH_BITS 5
+#define RPCROUTER_EPT_HASH_SIZE (1 << RPCROUTER_EPT_HASH_BITS)
+
+static struct list_head local_endpoints[RPCROUTER_EPT_HASH_SIZE];
+static struct list_head remote_endpoints[RPCROUTER_EPT_HASH_SIZE];
+
+static inline struct list_head *ept_hash(struct list_head *table, uint32_t cid)
+{
+	return &table[hash_32(cid, RPCROUTER_EPT_HASH_BITS)];
+}
+
+/* read buffers each local endpoint keeps preallocated */
+#define RPCROUTER_POOL_SIZE 2
+#define RPCROUTER_POOL_MAX  8
 
 static LIST_HEAD(server_list);
 
@@ -97,6 +116,7 @@ static DEFINE_SPINLOCK(server_list_lock);
 static DEFINE_SPINLOCK(smd_lock);
 
 static struct workqueue_struct *rpcrouter_workqueue;
+static struct workqueue_struct *rpcrouter_async_workqueue;
 static struct wake_lock rpcrouter_wake_lock;
 static int rpcrouter_need_len;
 
@@ -248,6 +268,413 @@ static struct rr_server *rpcrouter_lookup_server_by_dev(dev_t dev)
 	return NULL;
 }
 
+static void *rr_malloc(unsigned sz)
+{
+	void *ptr = kmalloc(sz, GFP_KERNEL);
+	if (ptr)
+		return ptr;
+
+	printk(KERN_ERR "rpcrouter: kmalloc of %d failed, retrying...\n", sz);
+	do {
+		ptr = kmalloc(sz, GFP_KERNEL);
+	} while (!ptr);
+
+	return ptr;
+}
+
+/* Fragments are always kmalloc'ed at full size, so one handed out by
+ * msm_rpc_read() may simply be kfree'd by its caller instead of coming
+ * back to the pool.
+ */
+static struct rr_fragment *rr_frag_alloc(struct msm_rpc_endpoint *ept)
+{
+	struct rr_fragment *frag;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ept->pool_lock, flags);
+	frag = ept->frag_pool;
+	if (frag) {
+		ept->frag_pool = frag->next;
+		ept->frag_pool_count--;
+	}
+	spin_unlock_irqrestore(&ept->pool_lock, flags);
+
+	if (!frag)
+		frag = rr_malloc(sizeof(struct rr_fragment));
+	return frag;
+}
+
+void msm_rpcrouter_free_frag(struct msm_rpc_endpoint *ept,
+			     struct rr_fragment *frag)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ept->pool_lock, flags);
+	if (ept->frag_pool_count < RPCROUTER_POOL_MAX) {
+		frag->next = ept->frag_pool;
+		ept->frag_pool = frag;
+		ept->frag_pool_count++;
+		frag = NULL;
+	}
+	spin_unlock_irqrestore(&ept->pool_lock, flags);
+
+	kfree(frag);
+}
+
+static struct rr_packet *rr_pkt_alloc(struct msm_rpc_endpoint *ept)
+{
+	struct rr_packet *pkt = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ept->pool_lock, flags);
+	if (!list_empty(&ept->pkt_pool)) {
+		pkt = list_first_entry(&ept->pkt_pool, struct rr_packet, list);
+		list_del(&pkt->list);
+		ept->pkt_pool_count--;
+	}
+	spin_unlock_irqrestore(&ept->pool_lock, flags);
+
+	if (!pkt)
+		pkt = rr_malloc(sizeof(struct rr_packet));
+	return pkt;
+}
+
+static void rr_pkt_free(struct msm_rpc_endpoint *ept, struct rr_packet *pkt)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ept->pool_lock, flags);
+	if (ept->pkt_pool_count < RPCROUTER_POOL_MAX) {
+		list_add(&pkt->list, &ept->pkt_pool);
+		ept->pkt_pool_count++;
+		pkt = NULL;
+	}
+	spin_unlock_irqrestore(&ept->pool_lock, flags);
+
+	kfree(pkt);
+}
+
+static void rr_pool_fill(struct msm_rpc_endpoint *ept)
+{
+	struct rr_fragment *frag;
+	struct rr_packet *pkt;
+	int n;
+
+	for (n = 0; n < RPCROUTER_POOL_SIZE; n++) {
+		frag = kmalloc(sizeof(struct rr_fragment), GFP_KERNEL);
+		if (frag)
+			msm_rpcrouter_free_frag(ept, frag);
+		pkt = kmalloc(sizeof(struct rr_packet), GFP_KERNEL);
+		if (pkt)
+			rr_pkt_free(ept, pkt);
+	}
+}
+
+static void rr_pool_drain(struct msm_rpc_endpoint *ept)
+{
+	struct rr_fragment *frag;
+	struct rr_packet *pkt, *tmp;
+
+	while ((frag = ept->frag_pool) != NULL) {
+		ept->frag_pool = frag->next;
+		kfree(frag);
+	}
+	ept->frag_pool_count = 0;
+	list_for_each_entry_safe(pkt, tmp, &ept->pkt_pool, list)
+		kfree(pkt);
+	INIT_LIST_HEAD(&ept->pkt_pool);
+	ept->pkt_pool_count = 0;
+}
+
+static void rr_async_work(struct work_struct *work);
+
+/* Called with read_q_lock held.  Takes pkt if it answers an outstanding
+ * msm_rpc_call_async() on this endpoint.
+ */
+static int rr_async_dispatch(struct msm_rpc_endpoint *ept,
+			     struct rr_packet *pkt)
+{
+	struct rpc_reply_hdr *reply = (void *) pkt->first->data;
+	struct rr_async_call *call;
+
+	if (list_empty(&ept->async_q))
+		return 0;
+	if (pkt->first->length < (3 * sizeof(uint32_t)) || reply->type != 1)
+		return 0;
+
+	list_for_each_entry(call, &ept->async_q, list) {
+		if (call->xid == reply->xid) {
+			list_del_init(&call->list);
+			call->pkt = pkt;
+			del_timer(&call->timer);
+			queue_work(rpcrouter_async_workqueue, &call->work);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void rr_async_timeout(unsigned long data)
+{
+	struct rr_async_call *call = (struct rr_async_call *) data;
+	struct msm_rpc_endpoint *ept = call->ept;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ept->read_q_lock, flags);
+	if (!list_empty(&call->list)) {
+		list_del_init(&call->list);
+		call->status = -ETIMEDOUT;
+		queue_work(rpcrouter_async_workqueue, &call->work);
+	}
+	spin_unlock_irqrestore(&ept->read_q_lock, flags);
+}
+
+/* complete every outstanding async call of an endpoint being closed */
+static void rr_async_cancel_all(struct msm_rpc_endpoint *ept)
+{
+	struct rr_async_call *call, *tmp;
+	unsigned long flags;
+	LIST_HEAD(cancelled);
+
+	spin_lock_irqsave(&ept->read_q_lock, flags);
+	list_splice_init(&ept->async_q, &cancelled);
+	spin_unlock_irqrestore(&ept->read_q_lock, flags);
+
+	list_for_each_entry_safe(call, tmp, &cancelled, list) {
+		list_del_init(&call->list);
+		call->status = -ECANCELED;
+		queue_work(rpcrouter_async_workqueue, &call->work);
+	}
+
+	/* nothing may still point at ept once it is freed */
+	flush_workqueue(rpcrouter_async_workqueue);
+}
+
+#if defined(CONFIG_DEBUG_FS)
+/*
+ * Per prog/vers/proc call latency, measured from msm_rpc_write() of
+ * the CALL to the arrival of the reply with the same xid.  Calls this
+ * processor serves are timed around the server handler instead.
+ */
+#define RR_STAT_MAX	  64
+#define RR_STAT_PENDING	  32
+#define RR_STAT_BUCKETS	  6	/* <100us <1ms <10ms <100ms <1s >=1s */
+
+struct rr_stat {
+	uint32_t prog;
+	uint32_t vers;
+	uint32_t proc;
+	uint32_t served;	/* timed around a local server handler */
+	uint32_t calls;
+	uint32_t inflight;
+	uint32_t lost;		/* never answered, slot reused */
+	uint32_t max_us;
+	uint32_t hist[RR_STAT_BUCKETS];
+};
+
+struct rr_stat_pending {
+	uint32_t xid;
+	struct rr_stat *stat;
+	ktime_t start;
+};
+
+static struct rr_stat rr_stats[RR_STAT_MAX];
+static int rr_stat_count;
+static struct rr_stat_pending rr_stat_pending[RR_STAT_PENDING];
+static unsigned rr_stat_pending_next;
+static DEFINE_SPINLOCK(rr_stat_lock);
+
+/* called with rr_stat_lock held; values in cpu order */
+static struct rr_stat *rr_stat_lookup(uint32_t prog, uint32_t vers,
+				      uint32_t proc, uint32_t served)
+{
+	struct rr_stat *stat;
+	int n;
+
+	for (n = 0; n < rr_stat_count; n++) {
+		stat = &rr_stats[n];
+		if (stat->prog == prog && stat->vers == vers &&
+		    stat->proc == proc && stat->served == served)
+			return stat;
+	}
+	if (rr_stat_count == RR_STAT_MAX)
+		return NULL;
+
+	stat = &rr_stats[rr_stat_count++];
+	stat->prog = prog;
+	stat->vers = vers;
+	stat->proc = proc;
+	stat->served = served;
+	return stat;
+}
+
+static void rr_stat_account(struct rr_stat *stat, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket = 0;
+	s64 limit = 100;
+
+	while (bucket < RR_STAT_BUCKETS - 1 && us >= limit) {
+		bucket++;
+		limit *= 10;
+	}
+	stat->hist[bucket]++;
+	if (us > stat->max_us)
+		stat->max_us = us;
+}
+
+static void rr_stat_call(struct rpc_request_hdr *rq)
+{
+	struct rr_stat_pending *p;
+	struct rr_stat *stat;
+	unsigned long flags;
+
+	spin_lock_irqsave(&rr_stat_lock, flags);
+	stat = rr_stat_lookup(be32_to_cpu(rq->prog), be32_to_cpu(rq->vers),
+			      be32_to_cpu(rq->procedure), 0);
+	if (stat) {
+		p = &rr_stat_pending[rr_stat_pending_next++ % RR_STAT_PENDING];
+		if (p->stat) {
+			p->stat->inflight--;
+			p->stat->lost++;
+		}
+		p->xid = rq->xid;
+		p->stat = stat;
+		p->start = ktime_get();
+		stat->calls++;
+		stat->inflight++;
+	}
+	spin_unlock_irqrestore(&rr_stat_lock, flags);
+}
+
+static void rr_stat_reply(struct rr_packet *pkt)
+{
+	struct rpc_reply_hdr *reply = (void *) pkt->first->data;
+	struct rr_stat_pending *p;
+	unsigned long flags;
+	int n;
+
+	if (pkt->first->length < (2 * sizeof(uint32_t)) || reply->type != 1)
+		return;
+
+	spin_lock_irqsave(&rr_stat_lock, flags);
+	for (n = 0; n < RR_STAT_PENDING; n++) {
+		p = &rr_stat_pending[n];
+		if (p->stat && p->xid == reply->xid) {
+			rr_stat_account(p->stat, p->start);
+			p->stat->inflight--;
+			p->stat = NULL;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&rr_stat_lock, flags);
+}
+
+void msm_rpcrouter_stat_served(uint32_t prog, uint32_t vers, uint32_t proc,
+			       ktime_t start)
+{
+	struct rr_stat *stat;
+	unsigned long flags;
+
+	spin_lock_irqsave(&rr_stat_lock, flags);
+	stat = rr_stat_lookup(prog, vers, proc, 1);
+	if (stat) {
+		stat->calls++;
+		rr_stat_account(stat, start);
+	}
+	spin_unlock_irqrestore(&rr_stat_lock, flags);
+}
+
+#define RR_DEBUG_BUFMAX 8192
+static char rr_debug_buffer[RR_DEBUG_BUFMAX];
+static DEFINE_MUTEX(rr_debug_lock);
+
+static int rr_debug_fill_stats(char *buf, int max)
+{
+	struct rr_stat *stat;
+	unsigned long flags;
+	int i = 0;
+	int n, b;
+
+	i += scnprintf(buf + i, max - i,
+		       "  prog     vers     proc   calls  infl  lost"
+		       " <100us   <1ms  <10ms <100ms    <1s   >=1s"
+		       "     max_us\n");
+
+	spin_lock_irqsave(&rr_stat_lock, flags);
+	for (n = 0; n < rr_stat_count; n++) {
+		stat = &rr_stats[n];
+		i += scnprintf(buf + i, max - i,
+			       "%c %08x %08x %4d %7u %5u %5u",
+			       stat->served ? 'S' : 'C',
+			       stat->prog, stat->vers, stat->proc,
+			       stat->calls, stat->inflight, stat->lost);
+		for (b = 0; b < RR_STAT_BUCKETS; b++)
+			i += scnprintf(buf + i, max - i, " %6u",
+				       stat->hist[b]);
+		i += scnprintf(buf + i, max - i, " %10u\n", stat->max_us);
+	}
+	spin_unlock_irqrestore(&rr_stat_lock, flags);
+
+	return i;
+}
+
+static ssize_t rr_debug_read(struct file *file, char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	int (*fill)(char *buf, int max) = file->private_data;
+	ssize_t rc;
+
+	mutex_lock(&rr_debug_lock);
+	rc = simple_read_from_buffer(buf, count, ppos, rr_debug_buffer,
+				     fill(rr_debug_buffer, RR_DEBUG_BUFMAX));
+	mutex_unlock(&rr_debug_lock);
+	return rc;
+}
+
+/* any write clears the latency table */
+static ssize_t rr_debug_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&rr_stat_lock, flags);
+	memset(rr_stats, 0, sizeof(rr_stats));
+	memset(rr_stat_pending, 0, sizeof(rr_stat_pending));
+	rr_stat_count = 0;
+	spin_unlock_irqrestore(&rr_stat_lock, flags);
+	return count;
+}
+
+static int rr_debug_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static const struct file_operations rr_debug_ops = {
+	.read = rr_debug_read,
+	.write = rr_debug_write,
+	.open = rr_debug_open,
+};
+
+static void rr_debug_init(void)
+{
+	struct dentry *dent;
+
+	dent = debugfs_create_dir("smd_rpcrouter", 0);
+	if (IS_ERR(dent))
+		return;
+
+	debugfs_create_file("latency", 0644, dent, rr_debug_fill_stats,
+			    &rr_debug_ops);
+}
+#else
+static inline void rr_stat_call(struct rpc_request_hdr *rq) {}
+static inline void rr_stat_reply(struct rr_packet *pkt) {}
+static inline void rr_debug_init(void) {}
+#endif
+
 struct msm_rpc_endpoint *msm_rpcrouter_create_local_endpoint(dev_t dev)
 {
 	struct msm_rpc_endpoint *ept;
@@ -294,9 +721,13 @@ struct msm_rpc_endpoint *msm_rpcrouter_create_local_endpoint(dev_t dev)
 	spin_lock_init(&ept->read_q_lock);
 	wake_lock_init(&ept->read_q_wake_lock, WAKE_LOCK_SUSPEND, "rpc_read");
 	INIT_LIST_HEAD(&ept->incomplete);
+	INIT_LIST_HEAD(&ept->async_q);
+	spin_lock_init(&ept->pool_lock);
+	INIT_LIST_HEAD(&ept->pkt_pool);
+	rr_pool_fill(ept);
 
 	spin_lock_irqsave(&local_endpoints_lock, flags);
-	list_add_tail(&ept->list, &local_endpoints);
+	list_add_tail(&ept->list, ept_hash(local_endpoints, ept->cid));
 	spin_unlock_irqrestore(&local_endpoints_lock, flags);
 	return ept;
 }
@@ -305,6 +736,7 @@ int msm_rpcrouter_destroy_local_endpoint(struct msm_rpc_endpoint *ept)
 {
 	int rc;
 	union rr_control_msg msg;
+	unsigned long flags;
 
 	msg.cmd = RPCROUTER_CTRL_CMD_REMOVE_CLIENT;
 	msg.cli.pid = ept->pid;
@@ -315,8 +747,13 @@ int msm_rpcrouter_destroy_local_endpoint(struct msm_rpc_endpoint *ept)
 	if (rc < 0)
 		return rc;
 
+	rr_async_cancel_all(ept);
+
 	wake_lock_destroy(&ept->read_q_wake_lock);
+	spin_lock_irqsave(&local_endpoints_lock, flags);
 	list_del(&ept->list);
+	spin_unlock_irqrestore(&local_endpoints_lock, flags);
+	rr_pool_drain(ept);
 	kfree(ept);
 	return 0;
 }
@@ -337,7 +774,7 @@ static int rpcrouter_create_remote_endpoint(uint32_t cid)
 	spin_lock_init(&new_c->quota_lock);
 
 	spin_lock_irqsave(&remote_endpoints_lock, flags);
-	list_add_tail(&new_c->list, &remote_endpoints);
+	list_add_tail(&new_c->list, ept_hash(remote_endpoints, cid));
 	spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 	return 0;
 }
@@ -348,7 +785,7 @@ static struct msm_rpc_endpoint *rpcrouter_lookup_local_endpoint(uint32_t cid)
 	unsigned long flags;
 
 	spin_lock_irqsave(&local_endpoints_lock, flags);
-	list_for_each_entry(ept, &local_endpoints, list) {
+	list_for_each_entry(ept, ept_hash(local_endpoints, cid), list) {
 		if (ept->cid == cid) {
 			spin_unlock_irqrestore(&local_endpoints_lock, flags);
 			return ept;
@@ -364,7 +801,7 @@ static struct rr_remote_endpoint *rpcrouter_lookup_remote_endpoint(uint32_t cid)
 	unsigned long flags;
 
 	spin_lock_irqsave(&remote_endpoints_lock, flags);
-	list_for_each_entry(ept, &remote_endpoints, list) {
+	list_for_each_entry(ept, ept_hash(remote_endpoints, cid), list) {
 		if (ept->cid == cid) {
 			spin_unlock_irqrestore(&remote_endpoints_lock, flags);
 			return ept;
@@ -547,19 +984,6 @@ static void rpcrouter_smdnotify(void *_dev, unsigned event)
 	wake_up(&smd_wait);
 }
 
-static void *rr_malloc(unsigned sz)
-{
-	void *ptr = kmalloc(sz, GFP_KERNEL);
-	if (ptr)
-		return ptr;
-
-	printk(KERN_ERR "rpcrouter: kmalloc of %d failed, retrying...\n", sz);
-	do {
-		ptr = kmalloc(sz, GFP_KERNEL);
-	} while (!ptr);
-
-	return ptr;
-}
 
 /* TODO: deal with channel teardown / restore */
 static int rr_read(void *data, int len)
@@ -635,19 +1059,20 @@ static void do_read_data(struct work_struct *work)
 
 	hdr.size -= sizeof(pm);
 
-	frag = rr_malloc(hdr.size + sizeof(*frag));
-	frag->next = NULL;
-	frag->length = hdr.size;
-	if (rr_read(frag->data, hdr.size))
-		goto fail_io;
-
 	ept = rpcrouter_lookup_local_endpoint(hdr.dst_cid);
 	if (!ept) {
 		DIAG("no local ept for cid %08x\n", hdr.dst_cid);
-		kfree(frag);
+		if (rr_read(r2r_buf, hdr.size))
+			goto fail_io;
 		goto done;
 	}
 
+	frag = rr_frag_alloc(ept);
+	frag->next = NULL;
+	frag->length = hdr.size;
+	if (rr_read(frag->data, hdr.size))
+		goto fail_io;
+
 	/* See if there is already a partial packet that matches our mid
 	 * and if so, append this fragment to that packet.
 	 */
@@ -668,7 +1093,7 @@ static void do_read_data(struct work_struct *work)
 	 * the incomplete list if this fragment is not a last fragment,
 	 * otherwise put it on the read queue.
 	 */
-	pkt = rr_malloc(sizeof(struct rr_packet));
+	pkt = rr_pkt_alloc(ept);
 	pkt->first = frag;
 	pkt->last = frag;
 	memcpy(&pkt->hdr, &hdr, sizeof(hdr));
@@ -680,8 +1105,15 @@ static void do_read_data(struct work_struct *work)
 	}
 
 packet_complete:
+	rr_stat_reply(pkt);
+	if (pkt->first->length >= (2 * sizeof(uint32_t)) &&
+	    ((struct rpc_reply_hdr *) pkt->first->data)->type == 1)
+		pm_timeline_first(PM_TIMELINE_FIRST_RPC, "rpc: first reply");
+
 	spin_lock_irqsave(&ept->read_q_lock, flags);
-	if (ept->flags & MSM_RPC_ENABLE_RECEIVE) {
+	if (rr_async_dispatch(ept, pkt)) {
+		/* handed to the caller's callback */
+	} else if (ept->flags & MSM_RPC_ENABLE_RECEIVE) {
 		wake_lock(&ept->read_q_wake_lock);
 		list_add_tail(&pkt->list, &ept->read_q);
 		wake_up(&ept->wait_q);
@@ -839,6 +1271,10 @@ int msm_rpc_write(struct msm_rpc_endpoint *ept, void *buffer, int count)
 	hdr.src_cid = ept->cid;
 	hdr.confirm_rx = 0;
 	hdr.size = count + sizeof(uint32_t);
+	trace_rpc_send(hdr.dst_pid, hdr.dst_cid, be32_to_cpu(rq->xid),
+		       rq->type == 0,
+		       rq->type == 0 ? be32_to_cpu(rq->prog) : 0,
+		       rq->type == 0 ? be32_to_cpu(rq->procedure) : 0, count);
 
 	for (;;) {
 		prepare_to_wait(&r_ept->quota_wait, &__wait,
@@ -879,6 +1315,10 @@ int msm_rpc_write(struct msm_rpc_endpoint *ept, void *buffer, int count)
 		spin_lock_irqsave(&smd_lock, flags);
 	}
 
+	/* start the clock before the reply can possibly arrive */
+	if (rq->type == 0)
+		rr_stat_call(rq);
+
 	/* TODO: deal with full fifo */
 	smd_write(smd_channel, &hdr, sizeof(hdr));
 	smd_write(smd_channel, &pacmark, sizeof(pacmark));
@@ -890,14 +1330,35 @@ int msm_rpc_write(struct msm_rpc_endpoint *ept, void *buffer, int count)
 }
 EXPORT_SYMBOL(msm_rpc_write);
 
+/* copy a multi-fragment message into one buffer, the fragments
+ * go back to the endpoint's pool
+ */
+static void *rr_frags_flatten(struct msm_rpc_endpoint *ept,
+			      struct rr_fragment *frag, int len)
+{
+	struct rr_fragment *next;
+	char *buf, *ptr;
+
+	buf = ptr = rr_malloc(len);
+
+	while (frag != NULL) {
+		memcpy(ptr, frag->data, frag->length);
+		next = frag->next;
+		ptr += frag->length;
+		msm_rpcrouter_free_frag(ept, frag);
+		frag = next;
+	}
+
+	return buf;
+}
+
 /*
  * NOTE: It is the responsibility of the caller to kfree buffer
  */
 int msm_rpc_read(struct msm_rpc_endpoint *ept, void **buffer,
 		 unsigned user_len, long timeout)
 {
-	struct rr_fragment *frag, *next;
-	char *buf;
+	struct rr_fragment *frag;
 	int rc;
 
 	rc = __msm_rpc_read(ept, &frag, user_len, timeout);
@@ -915,20 +1376,20 @@ int msm_rpc_read(struct msm_rpc_endpoint *ept, void **buffer,
 	/* multi-fragment messages, we have to do it the
 	 * hard way, which is rather disgusting right now
 	 */
-	buf = rr_malloc(rc);
-	*buffer = buf;
-
-	while (frag != NULL) {
-		memcpy(buf, frag->data, frag->length);
-		next = frag->next;
-		buf += frag->length;
-		kfree(frag);
-		frag = next;
-	}
+	*buffer = rr_frags_flatten(ept, frag, rc);
 
 	return rc;
 }
 
+static void rr_reply_free(struct msm_rpc_endpoint *ept,
+			  struct rr_fragment *frag, void *reply)
+{
+	if (frag)
+		msm_rpcrouter_free_frag(ept, frag);
+	else
+		kfree(reply);
+}
+
 int msm_rpc_call(struct msm_rpc_endpoint *ept, uint32_t proc,
 		 void *_request, int request_size,
 		 long timeout)
@@ -946,6 +1407,7 @@ int msm_rpc_call_reply(struct msm_rpc_endpoint *ept, uint32_t proc,
 {
 	struct rpc_request_hdr *req = _request;
 	struct rpc_reply_hdr *reply;
+	struct rr_fragment *frag;
 	int rc;
 
 	if (request_size < sizeof(*req))
@@ -972,16 +1434,23 @@ int msm_rpc_call_reply(struct msm_rpc_endpoint *ept, uint32_t proc,
 		goto error;
 
 	for (;;) {
-		rc = msm_rpc_read(ept, (void*) &reply, -1, timeout);
+		/* read the reply in place if it fits one (pooled) fragment */
+		rc = __msm_rpc_read(ept, &frag, -1, timeout);
 		if (rc < 0)
 			goto error;
+		if (frag->next) {
+			reply = rr_frags_flatten(ept, frag, rc);
+			frag = NULL;
+		} else {
+			reply = (void *) frag->data;
+		}
 		if (rc < (3 * sizeof(uint32_t))) {
 			rc = -EIO;
 			break;
 		}
 		/* we should not get CALL packets -- ignore them */
 		if (reply->type == 0) {
-			kfree(reply);
+			rr_reply_free(ept, frag, reply);
 			continue;
 		}
 		/* If an earlier call timed out, we could get the (no
@@ -989,7 +1458,7 @@ int msm_rpc_call_reply(struct msm_rpc_endpoint *ept, uint32_t proc,
 		 * we don't expect.
 		 */
 		if (reply->xid != req->xid) {
-			kfree(reply);
+			rr_reply_free(ept, frag, reply);
 			continue;
 		}
 		if (reply->reply_stat != 0) {
@@ -1011,7 +1480,7 @@ int msm_rpc_call_reply(struct msm_rpc_endpoint *ept, uint32_t proc,
 		}
 		break;
 	}
-	kfree(reply);
+	rr_reply_free(ept, frag, reply);
 error:
 	ept->flags &= ~MSM_RPC_ENABLE_RECEIVE;
 	wake_unlock(&ept->read_q_wake_lock);
@@ -1020,6 +1489,104 @@ error:
 }
 EXPORT_SYMBOL(msm_rpc_call_reply);
 
+static void rr_async_work(struct work_struct *work)
+{
+	struct rr_async_call *call =
+		container_of(work, struct rr_async_call, work);
+	struct msm_rpc_endpoint *ept = call->ept;
+	struct rpc_reply_hdr *reply = NULL;
+	struct rr_fragment *frag = NULL;
+	int len = 0;
+	int status = call->status;
+
+	del_timer_sync(&call->timer);
+
+	if (call->pkt) {
+		len = call->pkt->length;
+		if (call->pkt->first->next) {
+			reply = rr_frags_flatten(ept, call->pkt->first, len);
+		} else {
+			frag = call->pkt->first;
+			reply = (void *) frag->data;
+		}
+		rr_pkt_free(ept, call->pkt);
+
+		if (reply->reply_stat != 0)
+			status = -EPERM;
+		else if (reply->data.acc_hdr.accept_stat != 0)
+			status = -EINVAL;
+	}
+
+	call->callback(call->data, status ? NULL : reply,
+		       status ? 0 : len, status);
+
+	if (reply)
+		rr_reply_free(ept, frag, reply);
+	kfree(call);
+}
+
+int msm_rpc_call_async(struct msm_rpc_endpoint *ept, uint32_t proc,
+		       void *_request, int request_size,
+		       msm_rpc_async_cb callback, void *data,
+		       long timeout)
+{
+	struct rpc_request_hdr *req = _request;
+	struct rr_async_call *call;
+	unsigned long flags;
+	int rc;
+
+	if (request_size < sizeof(*req))
+		return -ETOOSMALL;
+
+	if (ept->dst_pid == 0xffffffff)
+		return -ENOTCONN;
+
+	call = kzalloc(sizeof(*call), GFP_KERNEL);
+	if (!call)
+		return -ENOMEM;
+
+	/* dst_prog and dst_vers are already in BE, as in msm_rpc_call_reply */
+	memset(req, 0, sizeof(*req));
+	req->xid = cpu_to_be32(atomic_add_return(1, &next_xid));
+	req->rpc_vers = cpu_to_be32(2);
+	req->prog = ept->dst_prog;
+	req->vers = ept->dst_vers;
+	req->procedure = cpu_to_be32(proc);
+
+	call->ept = ept;
+	call->xid = req->xid;
+	call->callback = callback;
+	call->data = data;
+	INIT_LIST_HEAD(&call->list);
+	INIT_WORK(&call->work, rr_async_work);
+	setup_timer(&call->timer, rr_async_timeout, (unsigned long) call);
+
+	/* queue before writing, the reply may beat msm_rpc_write() back */
+	spin_lock_irqsave(&ept->read_q_lock, flags);
+	list_add_tail(&call->list, &ept->async_q);
+	if (timeout >= 0)
+		mod_timer(&call->timer, jiffies + timeout);
+	spin_unlock_irqrestore(&ept->read_q_lock, flags);
+
+	rc = msm_rpc_write(ept, req, request_size);
+	if (rc < 0) {
+		spin_lock_irqsave(&ept->read_q_lock, flags);
+		if (list_empty(&call->list)) {
+			/* timed out already, the callback reports it */
+			spin_unlock_irqrestore(&ept->read_q_lock, flags);
+			return 0;
+		}
+		list_del(&call->list);
+		spin_unlock_irqrestore(&ept->read_q_lock, flags);
+		del_timer_sync(&call->timer);
+		kfree(call);
+		return rc;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(msm_rpc_call_async);
+
 
 static inline int ept_packet_available(struct msm_rpc_endpoint *ept)
 {
@@ -1087,6 +1654,13 @@ int __msm_rpc_read(struct msm_rpc_endpoint *ept,
 
 	*frag_ret = pkt->first;
 	rq = (void*) pkt->first->data;
+	if (rc >= (sizeof(uint32_t) * 2))
+		trace_rpc_recv(pkt->hdr.src_pid, pkt->hdr.src_cid,
+			       be32_to_cpu(rq->xid), rq->type == 0,
+			       (rc >= (sizeof(uint32_t) * 6) && rq->type == 0) ?
+			       be32_to_cpu(rq->prog) : 0,
+			       (rc >= (sizeof(uint32_t) * 6) && rq->type == 0) ?
+			       be32_to_cpu(rq->procedure) : 0, rc);
 	if ((rc >= (sizeof(uint32_t) * 3)) && (rq->type == 0)) {
 		IO("READ on ept %p is a CALL on %08x:%08x proc %d xid %d\n",
 			ept, be32_to_cpu(rq->prog), be32_to_cpu(rq->vers),
@@ -1108,7 +1682,7 @@ int __msm_rpc_read(struct msm_rpc_endpoint *ept,
 	else IO("READ on ept %p (%d bytes)\n", ept, rc);
 #endif
 
-	kfree(pkt);
+	rr_pkt_free(ept, pkt);
 	return rc;
 }
 
@@ -1251,17 +1825,26 @@ static int msm_rpcrouter_probe(struct platform_device *pdev)
 	int rc;
 
 	/* Initialize what we need to start processing */
-	INIT_LIST_HEAD(&local_endpoints);
-	INIT_LIST_HEAD(&remote_endpoints);
+	for (rc = 0; rc < RPCROUTER_EPT_HASH_SIZE; rc++) {
+		INIT_LIST_HEAD(&local_endpoints[rc]);
+		INIT_LIST_HEAD(&remote_endpoints[rc]);
+	}
 
 	init_waitqueue_head(&newserver_wait);
 	init_waitqueue_head(&smd_wait);
 	wake_lock_init(&rpcrouter_wake_lock, WAKE_LOCK_SUSPEND, "SMD_RPCCALL");
 
-	rpcrouter_workqueue = create_singlethread_workqueue("rpcrouter");
+	rpcrouter_workqueue = create_hipri_workqueue("rpcrouter");
 	if (!rpcrouter_workqueue)
 		return -ENOMEM;
 
+	rpcrouter_async_workqueue =
+		create_singlethread_workqueue("rpcrouter_async");
+	if (!rpcrouter_async_workqueue) {
+		destroy_workqueue(rpcrouter_workqueue);
+		return -ENOMEM;
+	}
+
 	rc = msm_rpcrouter_init_devices();
 	if (rc < 0)
 		goto fail_destroy_workqueue;
@@ -1273,6 +1856,7 @@ static int msm_rpcrouter_probe(struct platform_device *pdev)
 		goto fail_remove_devices;
 
 	queue_work(rpcrouter_workqueue, &work_read_data);
+	rr_debug_init();
 	return 0;
 
  fail_remove_devices:
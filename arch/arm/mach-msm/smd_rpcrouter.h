@@ -23,6 +23,7 @@
 #include <linux/cdev.h>
 #include <linux/platform_device.h>
 #include <linux/wakelock.h>
+#include <linux/ktime.h>
 
 #include <mach/msm_smd.h>
 #include <mach/msm_rpcrouter.h>
@@ -152,6 +153,19 @@ struct msm_rpc_reply {
 };
 #endif
 
+/* outstanding msm_rpc_call_async() */
+struct rr_async_call {
+	struct list_head list;		/* on ept->async_q until answered */
+	struct msm_rpc_endpoint *ept;
+	uint32_t xid; /* be32 */
+	msm_rpc_async_cb callback;
+	void *data;
+	struct rr_packet *pkt;		/* the reply, or NULL */
+	int status;
+	struct timer_list timer;
+	struct work_struct work;
+};
+
 struct msm_rpc_endpoint {
 	struct list_head list;
 
@@ -161,6 +175,9 @@ struct msm_rpc_endpoint {
 	/* complete packets waiting to be read */
 	struct list_head read_q;
 	spinlock_t read_q_lock;
+
+	/* async calls waiting for their reply, under read_q_lock */
+	struct list_head async_q;
 	struct wake_lock read_q_wake_lock;
 	wait_queue_head_t wait_q;
 	unsigned flags;
@@ -193,6 +210,13 @@ struct msm_rpc_endpoint {
 	uint32_t reply_xid; /* be32 */
 	uint32_t next_pm;   /* Pacmark sequence */
 
+	/* preallocated read buffers, so replies don't kmalloc */
+	spinlock_t pool_lock;
+	struct rr_fragment *frag_pool;
+	int frag_pool_count;
+	struct list_head pkt_pool;
+	int pkt_pool_count;
+
 #if defined(CONFIG_ARCH_MSM7X30)
 	/* reply queue for inbound messages */
 	struct list_head reply_pend_q;
@@ -211,7 +235,18 @@ int __msm_rpc_read(struct msm_rpc_endpoint *ept,
 		   struct rr_fragment **frag,
 		   unsigned len, long timeout);
 
+void msm_rpcrouter_free_frag(struct msm_rpc_endpoint *ept,
+			     struct rr_fragment *frag);
 int msm_rpcrouter_close(void);
+
+#if defined(CONFIG_DEBUG_FS)
+void msm_rpcrouter_stat_served(uint32_t prog, uint32_t vers, uint32_t proc,
+			       ktime_t start);
+#else
+static inline void msm_rpcrouter_stat_served(uint32_t prog, uint32_t vers,
+					     uint32_t proc, ktime_t start) {}
+#endif
+
 struct msm_rpc_endpoint *msm_rpcrouter_create_local_endpoint(dev_t dev);
 int msm_rpcrouter_destroy_local_endpoint(struct msm_rpc_endpoint *ept);
 
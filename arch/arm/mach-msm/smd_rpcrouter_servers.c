@@ -132,6 +132,7 @@ static int rpc_servers_thread(void *data)
 	void *buffer;
 	struct rpc_request_hdr *req;
 	struct msm_rpc_server *server;
+	ktime_t start;
 	int rc;
 
 	for (;;) {
@@ -167,7 +168,10 @@ static int rpc_servers_thread(void *data)
 			continue;
 		}
 
+		start = ktime_get();
 		rc = server->rpc_call(server, req, rc);
+		msm_rpcrouter_stat_served(req->prog, req->vers,
+					  req->procedure, start);
 
 		switch (rc) {
 		case 0:
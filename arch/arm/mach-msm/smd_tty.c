@@ -20,6 +20,9 @@
 #include <linux/device.h>
 #include <linux/wait.h>
 #include <linux/wakelock.h>
+#include <linux/interrupt.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/tty.h>
 #include <linux/tty_driver.h>
@@ -36,68 +39,77 @@ struct smd_tty_info {
 	struct tty_struct *tty;
 	struct wake_lock wake_lock;
 	int open_count;
-	struct work_struct tty_work;
+	struct tasklet_struct rx_tsklt;
+	struct tasklet_struct tx_tsklt;
+
+	unsigned rx_bytes;
+	unsigned rx_wakeups;
+	unsigned tx_bytes;
+	unsigned tx_writes;
+	unsigned tx_kicks;
 };
 
 static struct smd_tty_info smd_tty[MAX_SMD_TTYS];
-static struct workqueue_struct *smd_tty_wq;
 
-static void smd_tty_work_func(struct work_struct *work)
+/* copy what the fifo holds straight into the flip buffer, the
+ * remote side is told about the freed space once per pass
+ */
+static void smd_tty_read(unsigned long param)
 {
+	struct smd_tty_info *info = (struct smd_tty_info *) param;
+	struct tty_struct *tty = info->tty;
 	unsigned char *ptr;
+	void *data;
+	int total = 0;
 	int avail;
 
-	struct smd_tty_info *info = container_of(work,
-						struct smd_tty_info,
-						tty_work);
-	struct tty_struct *tty = info->tty;
-
-	if (!tty)
+	if (!tty || !info->ch)
 		return;
 
-
-	mutex_lock(&smd_tty_lock);
+	info->rx_wakeups++;
 
 	for (;;) {
 		if (test_bit(TTY_THROTTLED, &tty->flags))
 			break;
 
-		if (info->ch == 0) {
-			printk(KERN_ERR "smd_tty_work_func: info->ch null\n");
+		avail = smd_read_peek(info->ch, &data);
+		if (avail <= 0)
 			break;
-		}
 
-		avail = smd_read_avail(info->ch);
-		if (avail == 0) {
-			tty->low_latency = 0;
-			tty_flip_buffer_push(tty);
+		avail = tty_prepare_flip_string(tty, &ptr, avail);
+		if (avail <= 0) {
+			printk(KERN_ERR "smd_tty_read: tty_prepare_flip_string fail\n");
 			break;
 		}
 
-		ptr = NULL;
-		avail = tty_prepare_flip_string(tty, &ptr, avail);
-
-		if (avail && ptr) {
-			if (smd_read(info->ch, ptr, avail) != avail) {
-				/* shouldn't be possible since we're in interrupt
-				 * context here and nobody else could 'steal' our
-				 * characters.
-				 */
-				printk(KERN_ERR "OOPS - smd_tty_buffer mismatch?!");
-			}
-			wake_lock_timeout(&info->wake_lock, HZ / 2);
-			tty->low_latency = 1;
-			tty_flip_buffer_push(tty);
-		} else
-			printk(KERN_ERR "smd_tty_work_func: tty_prepare_flip_string fail\n");
+		memcpy(ptr, data, avail);
+		smd_read_consume(info->ch, avail);
+		total += avail;
 	}
 
-	mutex_unlock(&smd_tty_lock);
+	if (total) {
+		info->rx_bytes += total;
+		wake_lock_timeout(&info->wake_lock, HZ / 2);
+		tty_flip_buffer_push(tty);
+		smd_kick_remote(info->ch);
+	}
 
 	/* XXX only when writable and necessary */
 	tty_wakeup(tty);
 }
 
+/* one interrupt to the remote side for every write queued since */
+static void smd_tty_kick(unsigned long param)
+{
+	struct smd_tty_info *info = (struct smd_tty_info *) param;
+
+	if (!info->ch)
+		return;
+
+	info->tx_kicks++;
+	smd_kick_remote(info->ch);
+}
+
 static void smd_tty_notify(void *priv, unsigned event)
 {
 	struct smd_tty_info *info = priv;
@@ -105,7 +117,7 @@ static void smd_tty_notify(void *priv, unsigned event)
 	if (event != SMD_EVENT_DATA)
 		return;
 
-	queue_work(smd_tty_wq, &info->tty_work);
+	tasklet_schedule(&info->rx_tsklt);
 }
 
 static int smd_tty_open(struct tty_struct *tty, struct file *f)
@@ -173,18 +185,18 @@ static void smd_tty_close(struct tty_struct *tty, struct file *f)
 
 	if (info == 0)
 		return;
-	/* wait for the work in workqueue to complete */
-	flush_work(&info->tty_work);
 
 	mutex_lock(&smd_tty_lock);
 	if (--info->open_count == 0) {
+		if (info->ch)
+			smd_close(info->ch);
+		/* no notification can queue them again now */
+		tasklet_kill(&info->rx_tsklt);
+		tasklet_kill(&info->tx_tsklt);
 		info->tty = 0;
+		info->ch = 0;
 		tty->driver_data = 0;
 		wake_lock_destroy(&info->wake_lock);
-		if (info->ch) {
-			smd_close(info->ch);
-			info->ch = 0;
-		}
 	}
 	mutex_unlock(&smd_tty_lock);
 }
@@ -193,8 +205,10 @@ static int smd_tty_write(struct tty_struct *tty,
 					const unsigned char *buf, int len)
 {
 	struct smd_tty_info *info = tty->driver_data;
+	void *ptr;
 	int avail;
 	int ret;
+	int n;
 
 	/* if we're writing to a packet channel we will
 	** never be able to write more data than there
@@ -204,7 +218,31 @@ static int smd_tty_write(struct tty_struct *tty,
 	avail = smd_write_avail(info->ch);
 	if (len > avail)
 		len = avail;
-	ret = smd_write(info->ch, buf, len);
+	if (len <= 0) {
+		mutex_unlock(&smd_tty_lock);
+		return 0;
+	}
+
+	/* copy into the fifo now, but leave the interrupt to the
+	 * tasklet so back to back writes share one
+	 */
+	ret = smd_write_begin(info->ch, len);
+	if (ret < 0) {
+		mutex_unlock(&smd_tty_lock);
+		return ret == -ENOMEM ? 0 : ret;
+	}
+
+	for (ret = 0; ret < len; ret += n) {
+		n = smd_write_peek(info->ch, &ptr);
+		if (n <= 0)
+			break;
+		memcpy(ptr, buf + ret, n);
+		smd_write_commit(info->ch, n);
+	}
+
+	info->tx_bytes += ret;
+	info->tx_writes++;
+	tasklet_schedule(&info->tx_tsklt);
 	mutex_unlock(&smd_tty_lock);
 
 	return ret;
@@ -225,7 +263,7 @@ static int smd_tty_chars_in_buffer(struct tty_struct *tty)
 static void smd_tty_unthrottle(struct tty_struct *tty)
 {
 	struct smd_tty_info *info = tty->driver_data;
-	queue_work(smd_tty_wq, &info->tty_work);
+	tasklet_schedule(&info->rx_tsklt);
 	return;
 }
 
@@ -240,19 +278,60 @@ static struct tty_operations smd_tty_ops = {
 
 static struct tty_driver *smd_tty_driver;
 
+static void __init smd_tty_register(int n)
+{
+	struct smd_tty_info *info = smd_tty + n;
+
+	tty_register_device(smd_tty_driver, n, 0);
+	tasklet_init(&info->rx_tsklt, smd_tty_read, (unsigned long) info);
+	tasklet_init(&info->tx_tsklt, smd_tty_kick, (unsigned long) info);
+}
+
+#if defined(CONFIG_DEBUG_FS)
+static int smd_tty_stats_show(struct seq_file *s, void *unused)
+{
+	struct smd_tty_info *info;
+	int n;
+
+	for (n = 0; n < MAX_SMD_TTYS; n++) {
+		info = smd_tty + n;
+		if (!info->rx_tsklt.func)
+			continue;
+		seq_printf(s, "smd%d: rx %u bytes %u wakeups, "
+			   "tx %u bytes %u writes %u kicks\n", n,
+			   info->rx_bytes, info->rx_wakeups,
+			   info->tx_bytes, info->tx_writes, info->tx_kicks);
+	}
+	return 0;
+}
+
+static int smd_tty_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, smd_tty_stats_show, NULL);
+}
+
+static const struct file_operations smd_tty_stats_ops = {
+	.open = smd_tty_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void __init smd_tty_debugfs_init(void)
+{
+	debugfs_create_file("smd_tty", 0444, NULL, NULL, &smd_tty_stats_ops);
+}
+#else
+static void smd_tty_debugfs_init(void) {}
+#endif
+
 static int __init smd_tty_init(void)
 {
 	int ret;
 
-	smd_tty_wq = create_singlethread_workqueue("smd_tty");
-	if (smd_tty_wq == 0)
-		return -ENOMEM;
-
 	smd_tty_driver = alloc_tty_driver(MAX_SMD_TTYS);
-	if (smd_tty_driver == 0) {
-		destroy_workqueue(smd_tty_wq);
+	if (smd_tty_driver == 0)
 		return -ENOMEM;
-	}
 
 	smd_tty_driver->owner = THIS_MODULE;
 	smd_tty_driver->driver_name = "smd_tty_driver";
@@ -275,24 +354,20 @@ static int __init smd_tty_init(void)
 		return ret;
 
 	/* this should be dynamic */
-	tty_register_device(smd_tty_driver, 0, 0);
-	INIT_WORK(&smd_tty[0].tty_work, smd_tty_work_func);
-	tty_register_device(smd_tty_driver, 1, 0);
-	INIT_WORK(&smd_tty[1].tty_work, smd_tty_work_func);
-	tty_register_device(smd_tty_driver, 9, 0);
-	INIT_WORK(&smd_tty[9].tty_work, smd_tty_work_func);
-	tty_register_device(smd_tty_driver, 27, 0);
-	INIT_WORK(&smd_tty[27].tty_work, smd_tty_work_func);
+	smd_tty_register(0);
+	smd_tty_register(1);
+	smd_tty_register(9);
+	smd_tty_register(27);
 #ifdef CONFIG_BUILD_OMA_DM
 	/* MASD requested OMA_DM AT-channel */
-	tty_register_device(smd_tty_driver, 19, 0);
-	INIT_WORK(&smd_tty[19].tty_work, smd_tty_work_func);
+	smd_tty_register(19);
 #endif
 #ifdef CONFIG_BUILD_CIQ
-	tty_register_device(smd_tty_driver, 26, 0);
-	INIT_WORK(&smd_tty[26].tty_work, smd_tty_work_func);
+	smd_tty_register(26);
 #endif
 
+	smd_tty_debugfs_init();
+
 	return 0;
 }
 
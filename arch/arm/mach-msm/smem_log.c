@@ -69,6 +69,9 @@
 #include <linux/debugfs.h>
 #include <linux/io.h>
 #include <linux/string.h>
+#include <linux/percpu.h>
+#include <linux/timer.h>
+#include <linux/notifier.h>
 
 #include <mach/msm_iomap.h>
 #include <mach/smem_log.h>
@@ -967,6 +970,8 @@ static void smem_log_event_from_user(struct smem_log_inst *inst,
 	int first = 1;
 	int ret;
 
+	/* keep user events behind the ones already staged */
+	smem_log_flush();
 	remote_spin_lock_irqsave(inst->remote_spinlock, flags);
 
 	while (num--) {
@@ -1088,9 +1093,151 @@ static void _smem_log_event6(
 	remote_spin_unlock_irqrestore(lock, flags);
 }
 
+/*
+ * Events for the general log are staged per cpu and copied to shared
+ * memory in batches, so the remote spinlock is taken once per batch
+ * rather than once per event.  A staged batch is flushed when it is
+ * full, from a timer shortly after the first event was staged, before
+ * anything reads the log, and on panic.  batch=0 writes every event
+ * synchronously; the static log is always written synchronously.
+ */
+#define SMEM_LOG_STAGE_SIZE 32
+#define SMEM_LOG_STAGE_DELAY (HZ / 50 ? HZ / 50 : 1)
+
+struct smem_log_stage {
+	spinlock_t lock;
+	int count;
+	uint32_t pair;	/* bit n: items n, n+1 are one event6 */
+	struct smem_log_item items[SMEM_LOG_STAGE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct smem_log_stage, smem_log_stage);
+
+static int smem_log_batch = SMEM_LOG_STAGE_SIZE;
+module_param_named(batch, smem_log_batch, int, S_IRUGO | S_IWUSR);
+
+static void smem_log_flush_timer(unsigned long data);
+static DEFINE_TIMER(smem_log_timer, smem_log_flush_timer, 0, 0);
+
+/* called with stage->lock held and interrupts disabled */
+static void _smem_log_stage_flush(struct smem_log_stage *stage)
+{
+	struct smem_log_inst *log = &inst[GEN];
+	uint32_t idx;
+	int n;
+
+	if (!stage->count)
+		return;
+
+	remote_spin_lock(log->remote_spinlock);
+
+	idx = *log->idx;
+	for (n = 0; n < stage->count; n++) {
+		if (stage->pair & (1U << n)) {
+			if (idx < (log->num - 1))
+				memcpy(&log->events[idx], &stage->items[n],
+				       2 * sizeof(struct smem_log_item));
+			idx += 2;
+			n++;
+		} else {
+			if (idx < log->num)
+				memcpy(&log->events[idx], &stage->items[n],
+				       sizeof(struct smem_log_item));
+			idx++;
+		}
+		if (idx >= log->num)
+			idx = 0;
+	}
+	*log->idx = idx;
+
+	remote_spin_unlock(log->remote_spinlock);
+
+	stage->count = 0;
+	stage->pair = 0;
+}
+
+void smem_log_flush(void)
+{
+	struct smem_log_stage *stage;
+	unsigned long flags;
+	int cpu;
+
+	if (!inst[GEN].events || !inst[GEN].idx)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		stage = &per_cpu(smem_log_stage, cpu);
+		spin_lock_irqsave(&stage->lock, flags);
+		_smem_log_stage_flush(stage);
+		spin_unlock_irqrestore(&stage->lock, flags);
+	}
+}
+EXPORT_SYMBOL(smem_log_flush);
+
+static void smem_log_flush_timer(unsigned long data)
+{
+	smem_log_flush();
+}
+
+static int smem_log_panic(struct notifier_block *this,
+			  unsigned long event, void *ptr)
+{
+	smem_log_flush();
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block smem_log_panic_notifier = {
+	.notifier_call = smem_log_panic,
+};
+
+/* returns 0 if the caller has to write the event synchronously */
+static int smem_log_stage_event(struct smem_log_item *item, int n)
+{
+	struct smem_log_stage *stage;
+	unsigned long flags;
+	int batch = smem_log_batch;
+
+	if (batch <= 0 || !inst[GEN].events || !inst[GEN].idx)
+		return 0;
+	if (batch > SMEM_LOG_STAGE_SIZE)
+		batch = SMEM_LOG_STAGE_SIZE;
+
+	local_irq_save(flags);
+	stage = &__get_cpu_var(smem_log_stage);
+	spin_lock(&stage->lock);
+
+	if (stage->count + n > SMEM_LOG_STAGE_SIZE)
+		_smem_log_stage_flush(stage);
+
+	memcpy(&stage->items[stage->count], item, n * sizeof(*item));
+	if (n == 2)
+		stage->pair |= 1U << stage->count;
+	stage->count += n;
+
+	if (stage->count >= batch)
+		_smem_log_stage_flush(stage);
+	else if (!timer_pending(&smem_log_timer))
+		mod_timer(&smem_log_timer, jiffies + SMEM_LOG_STAGE_DELAY);
+
+	spin_unlock(&stage->lock);
+	local_irq_restore(flags);
+	return 1;
+}
+
 void smem_log_event(uint32_t id, uint32_t data1, uint32_t data2,
 		    uint32_t data3)
 {
+	struct smem_log_item item;
+
+	item.timetick = read_timestamp();
+	item.identifier = id;
+	item.data1 = data1;
+	item.data2 = data2;
+	item.data3 = data3;
+
+	if (smem_log_stage_event(&item, 1))
+		return;
+
 	_smem_log_event(inst[GEN].events, inst[GEN].idx,
 			inst[GEN].remote_spinlock, SMEM_LOG_NUM_ENTRIES,
 			id, data1, data2, data3);
@@ -1100,6 +1247,22 @@ void smem_log_event6(uint32_t id, uint32_t data1, uint32_t data2,
 		     uint32_t data3, uint32_t data4, uint32_t data5,
 		     uint32_t data6)
 {
+	struct smem_log_item item[2];
+
+	item[0].timetick = read_timestamp();
+	item[0].identifier = id;
+	item[0].data1 = data1;
+	item[0].data2 = data2;
+	item[0].data3 = data3;
+	item[1].identifier = item[0].identifier;
+	item[1].timetick = item[0].timetick;
+	item[1].data1 = data4;
+	item[1].data2 = data5;
+	item[1].data3 = data6;
+
+	if (smem_log_stage_event(item, 2))
+		return;
+
 	_smem_log_event6(inst[GEN].events, inst[GEN].idx,
 			 inst[GEN].remote_spinlock, SMEM_LOG_NUM_ENTRIES,
 			 id, data1, data2, data3, data4, data5, data6);
@@ -1124,6 +1287,8 @@ void smem_log_event6_to_static(uint32_t id, uint32_t data1, uint32_t data2,
 
 static int _smem_log_init(void)
 {
+	int cpu;
+
 	inst[GEN].which_log = GEN;
 	inst[GEN].events =
 		(struct smem_log_item *)smem_alloc(SMEM_SMEM_LOG_EVENTS,
@@ -1176,6 +1341,11 @@ static int _smem_log_init(void)
 	remote_spin_lock_init(&remote_spinlock_static,
 			      SMEM_SPINLOCK_STATIC_LOG);
 
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu(smem_log_stage, cpu).lock);
+	atomic_notifier_chain_register(&panic_notifier_list,
+				       &smem_log_panic_notifier);
+
 	init_syms();
 
 	return 0;
@@ -1193,6 +1363,7 @@ static ssize_t smem_log_read_bin(struct file *fp, char __user *buf,
 
 	inst = fp->private_data;
 
+	smem_log_flush();
 	remote_spin_lock_irqsave(inst->remote_spinlock, flags);
 
 	orig_idx = *inst->idx;
@@ -1243,6 +1414,7 @@ static ssize_t smem_log_read(struct file *fp, char __user *buf,
 
 	inst = fp->private_data;
 
+	smem_log_flush();
 	remote_spin_lock_irqsave(inst->remote_spinlock, flags);
 
 	orig_idx = *inst->idx;
@@ -1467,6 +1639,7 @@ static int _debug_dump(int log, char *buf, int max)
 	if (!inst[log].events)
 		return 0;
 
+	smem_log_flush();
 	remote_spin_lock_irqsave(inst[log].remote_spinlock, flags);
 
 	orig_idx = *inst[log].idx;
@@ -1538,6 +1711,7 @@ static int _debug_dump_sym(int log, char *buf, int max)
 				       voter_d2_syms[k].str);
 	i += scnprintf(buf + i, max - i, "\n");
 
+	smem_log_flush();
 	remote_spin_lock_irqsave(inst[log].remote_spinlock, flags);
 
 	orig_idx = *inst[log].idx;
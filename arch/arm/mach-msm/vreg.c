@@ -18,18 +18,53 @@
 #include <linux/device.h>
 #include <linux/init.h>
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/moduleparam.h>
 #include <mach/vreg.h>
 
 #include "proc_comm.h"
 
+/*
+ * Every vreg_get() caller is a consumer of a rail. Consumers that pass
+ * no device share the rail's anonymous consumer, which behaves like the
+ * old one-handle-per-rail interface. The rail is on while any consumer
+ * has it enabled, at the highest level its enabled consumers asked for,
+ * and only changes in that aggregate are sent to the modem. Lowering
+ * the level of a rail that stays on is not urgent and waits
+ * vreg_coalesce_ms, so a quick lower/raise pair costs nothing.
+ */
+struct vreg_rail;
+
 struct vreg {
+	struct vreg_rail *rail;
+	struct device *dev;
+	struct list_head list;
+	unsigned enabled;
+	unsigned mv;
+	unsigned enables;
+	unsigned disables;
+	unsigned level_sets;
+};
+
+struct vreg_rail {
 	const char *name;
 	unsigned id;
+	struct vreg anon;
+	struct list_head consumers;
+	int modem_on;		/* -1 until first switched */
+	unsigned modem_mv;	/* 0 until first set */
+	struct delayed_work lower_work;
+	unsigned pcom_calls;
+	unsigned pcom_skipped;
+	unsigned deferred;
 };
 
-#define VREG(_name, _id) { .name = _name, .id = _id, }
+#define VREG(_name, _id) { .name = _name, .id = _id, .modem_on = -1, }
 
-static struct vreg vregs[] = {
+static struct vreg_rail vregs[] = {
 	VREG("msma",	0),
 	VREG("msmp",	1),
 	VREG("msme1",	2),
@@ -82,39 +117,163 @@ static struct vreg vregs[] = {
 #endif
 };
 
+static DEFINE_MUTEX(vreg_lock);
+
+static unsigned vreg_coalesce_ms = 20;
+module_param_named(coalesce_ms, vreg_coalesce_ms, uint, S_IWUSR | S_IRUGO);
+
+static int vreg_pcom(struct vreg_rail *rail, unsigned cmd, unsigned arg)
+{
+	unsigned id = rail->id;
+
+	rail->pcom_calls++;
+	return msm_proc_comm_sleep(cmd, &id, &arg);
+}
+
+/* called with vreg_lock held, caller is the consumer that asked */
+static int vreg_apply(struct vreg_rail *rail, struct vreg *caller,
+		      int may_defer)
+{
+	unsigned calls = rail->pcom_calls;
+	struct vreg *c;
+	unsigned mv = 0;
+	int on = 0;
+	int rc = 0;
+
+	list_for_each_entry(c, &rail->consumers, list) {
+		if (!c->enabled)
+			continue;
+		on = 1;
+		if (c->mv > mv)
+			mv = c->mv;
+	}
+	/* a level set while the rail is off goes out as before */
+	if (!on && caller)
+		mv = caller->mv;
+
+	if (mv && mv != rail->modem_mv) {
+		if (may_defer && on && rail->modem_on == 1 &&
+		    mv < rail->modem_mv && vreg_coalesce_ms) {
+			rail->deferred++;
+			schedule_delayed_work(&rail->lower_work,
+				msecs_to_jiffies(vreg_coalesce_ms));
+		} else {
+			rc = vreg_pcom(rail, PCOM_VREG_SET_LEVEL, mv);
+			rail->modem_mv = rc ? 0 : mv;
+		}
+	}
+
+	if (on != rail->modem_on) {
+		rc = vreg_pcom(rail, PCOM_VREG_SWITCH, on);
+		rail->modem_on = rc ? -1 : on;
+	}
+
+	if (caller && rail->pcom_calls == calls)
+		rail->pcom_skipped++;
+	return rc;
+}
+
+static void vreg_lower_work(struct work_struct *work)
+{
+	struct vreg_rail *rail = container_of(work, struct vreg_rail,
+					      lower_work.work);
+
+	mutex_lock(&vreg_lock);
+	vreg_apply(rail, NULL, 0);
+	mutex_unlock(&vreg_lock);
+}
+
 struct vreg *vreg_get(struct device *dev, const char *id)
 {
+	struct vreg_rail *rail = NULL;
+	struct vreg *c;
 	int n;
+
 	for (n = 0; n < ARRAY_SIZE(vregs); n++) {
-		if (!strcmp(vregs[n].name, id))
-			return vregs + n;
+		if (!strcmp(vregs[n].name, id)) {
+			rail = vregs + n;
+			break;
+		}
 	}
-	return 0;
+	if (!rail)
+		return 0;
+	if (!dev)
+		return &rail->anon;
+
+	/* drivers call vreg_get on every power up, hand back the same one */
+	mutex_lock(&vreg_lock);
+	list_for_each_entry(c, &rail->consumers, list) {
+		if (c->dev == dev)
+			goto out;
+	}
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (c) {
+		c->rail = rail;
+		c->dev = dev;
+		list_add_tail(&c->list, &rail->consumers);
+	} else
+		c = &rail->anon;
+out:
+	mutex_unlock(&vreg_lock);
+	return c;
 }
 
+/* consumers stay on the rail for their statistics */
 void vreg_put(struct vreg *vreg)
 {
 }
 
 int vreg_enable(struct vreg *vreg)
 {
-	unsigned id = vreg->id;
-	unsigned enable = 1;
-	return msm_proc_comm(PCOM_VREG_SWITCH, &id, &enable);
+	int rc;
+
+	mutex_lock(&vreg_lock);
+	vreg->enabled = 1;
+	vreg->enables++;
+	rc = vreg_apply(vreg->rail, vreg, 1);
+	mutex_unlock(&vreg_lock);
+	return rc;
 }
 
 int vreg_disable(struct vreg *vreg)
 {
-	unsigned id = vreg->id;
-	unsigned enable = 0;
-	return msm_proc_comm(PCOM_VREG_SWITCH, &id, &enable);
+	int rc;
+
+	mutex_lock(&vreg_lock);
+	vreg->enabled = 0;
+	vreg->disables++;
+	rc = vreg_apply(vreg->rail, vreg, 1);
+	mutex_unlock(&vreg_lock);
+	return rc;
 }
 
 int vreg_set_level(struct vreg *vreg, unsigned mv)
 {
-	unsigned id = vreg->id;
-	return msm_proc_comm(PCOM_VREG_SET_LEVEL, &id, &mv);
+	int rc;
+
+	mutex_lock(&vreg_lock);
+	vreg->mv = mv;
+	vreg->level_sets++;
+	rc = vreg_apply(vreg->rail, vreg, 1);
+	mutex_unlock(&vreg_lock);
+	return rc;
+}
+
+static int __init vreg_init(void)
+{
+	struct vreg_rail *rail;
+	int n;
+
+	for (n = 0; n < ARRAY_SIZE(vregs); n++) {
+		rail = vregs + n;
+		INIT_LIST_HEAD(&rail->consumers);
+		INIT_DELAYED_WORK(&rail->lower_work, vreg_lower_work);
+		rail->anon.rail = rail;
+		list_add(&rail->anon.list, &rail->consumers);
+	}
+	return 0;
 }
+core_initcall(vreg_init);
 
 #if defined(CONFIG_DEBUG_FS)
 
@@ -142,6 +301,48 @@ static int vreg_debug_get(void *data, u64 *val)
 
 DEFINE_SIMPLE_ATTRIBUTE(vreg_fops, vreg_debug_get, vreg_debug_set, "%llu\n");
 
+static int vreg_stats_show(struct seq_file *m, void *unused)
+{
+	struct vreg_rail *rail;
+	struct vreg *c;
+	int n;
+
+	mutex_lock(&vreg_lock);
+	for (n = 0; n < ARRAY_SIZE(vregs); n++) {
+		rail = vregs + n;
+		if (!rail->pcom_calls && !rail->pcom_skipped)
+			continue;
+		seq_printf(m, "%s: %s %u mV, proc_comm %u skipped %u "
+			   "deferred %u\n", rail->name,
+			   rail->modem_on == 1 ? "on" : "off",
+			   rail->modem_mv, rail->pcom_calls,
+			   rail->pcom_skipped, rail->deferred);
+		list_for_each_entry(c, &rail->consumers, list) {
+			if (!c->enables && !c->level_sets)
+				continue;
+			seq_printf(m, "  %-20s %s %4u mV enable %u disable %u "
+				   "level %u\n",
+				   c->dev ? dev_name(c->dev) : "-",
+				   c->enabled ? "on " : "off", c->mv,
+				   c->enables, c->disables, c->level_sets);
+		}
+	}
+	mutex_unlock(&vreg_lock);
+	return 0;
+}
+
+static int vreg_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, vreg_stats_show, NULL);
+}
+
+static const struct file_operations vreg_stats_fops = {
+	.open		= vreg_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int __init vreg_debug_init(void)
 {
 	struct dentry *dent;
@@ -153,7 +354,8 @@ static int __init vreg_debug_init(void)
 
 	for (n = 0; n < ARRAY_SIZE(vregs); n++)
 		(void) debugfs_create_file(vregs[n].name, 0644,
-					   dent, vregs + n, &vreg_fops);
+					   dent, &vregs[n].anon, &vreg_fops);
+	debugfs_create_file("stats", 0444, dent, NULL, &vreg_stats_fops);
 
 	return 0;
 }
@@ -18,6 +18,16 @@
 #include <asm/tlbflush.h>
 #include "mm.h"
 
+#ifndef CONFIG_DEBUG_HIGHMEM
+/*
+ * kunmap_atomic() leaves the fixmap pte in place, so a slot that still
+ * maps the requested page can be handed out again without rewriting
+ * the pte or flushing the TLB.  Indexed like the fixmap slots, which
+ * makes it per cpu and per km_type.
+ */
+static struct page *kmap_atomic_slot[KM_TYPE_NR * NR_CPUS];
+#endif
+
 void *kmap(struct page *page)
 {
 	might_sleep();
@@ -60,7 +70,14 @@ void *kmap_atomic(struct page *page, enum km_type type)
 	 * Make sure it was indeed properly unmapped.
 	 */
 	BUG_ON(!pte_none(*(TOP_PTE(vaddr))));
+#else
+	if (kmap_atomic_slot[idx] == page) {
+		count_vm_event(KMAP_ATOMIC_CACHED);
+		return (void *)vaddr;
+	}
+	kmap_atomic_slot[idx] = page;
 #endif
+	count_vm_event(KMAP_ATOMIC);
 	set_pte_ext(TOP_PTE(vaddr), mk_pte(page, kmap_prot), 0);
 	/*
 	 * When debugging is off, kunmap_atomic leaves the previous mapping
@@ -106,6 +123,8 @@ void *kmap_atomic_pfn(unsigned long pfn, enum km_type type)
 	vaddr = __fix_to_virt(FIX_KMAP_BEGIN + idx);
 #ifdef CONFIG_DEBUG_HIGHMEM
 	BUG_ON(!pte_none(*(TOP_PTE(vaddr))));
+#else
+	kmap_atomic_slot[idx] = NULL;
 #endif
 	set_pte_ext(TOP_PTE(vaddr), pfn_pte(pfn, kmap_prot), 0);
 	local_flush_tlb_kernel_page(vaddr);
@@ -16,6 +16,8 @@
 #include <linux/irq.h>
 #include <linux/smp.h>
 
+#include <asm/pmu.h>
+
 #include "op_counter.h"
 #include "op_arm_model.h"
 #include "op_model_v7.h"
@@ -380,6 +382,7 @@ static void armv7_pmnc_stop(void)
 #endif
 	armv7_stop_pmnc();
 	armv7_release_interrupts(irqs, ARRAY_SIZE(irqs));
+	release_pmu();
 }
 
 static int armv7_pmnc_start(void)
@@ -389,9 +392,16 @@ static int armv7_pmnc_start(void)
 #ifdef DEBUG
 	armv7_pmnc_dump_regs();
 #endif
+	/* perf events may be using the counters */
+	ret = reserve_pmu();
+	if (ret)
+		return ret;
+
 	ret = armv7_request_interrupts(irqs, ARRAY_SIZE(irqs));
 	if (ret >= 0)
 		armv7_start_pmnc();
+	else
+		release_pmu();
 
 	return ret;
 }
@@ -14,6 +14,7 @@
 #include <linux/signal.h>
 #include <linux/sched.h>
 #include <linux/init.h>
+#include <linux/hardirq.h>
 
 #include <asm/thread_notify.h>
 #include <asm/vfp.h>
@@ -478,6 +479,43 @@ out:
 }
 #endif
 
+#ifdef CONFIG_KERNEL_MODE_NEON
+/*
+ * Claim the VFP/NEON registers for the kernel. The state of whichever
+ * thread last used them is written back to its vfpstate, exactly as a
+ * lazy switch would, and last_VFP_context is cleared so that the owner
+ * traps and reloads on its next VFP instruction.
+ */
+void kernel_neon_begin(void)
+{
+	unsigned int cpu;
+	u32 fpexc;
+
+	BUG_ON(in_interrupt());
+	cpu = get_cpu();
+
+	fpexc = fmrx(FPEXC) | FPEXC_EN;
+	fmxr(FPEXC, fpexc & ~FPEXC_EX);
+	isb();
+	if (last_VFP_context[cpu]) {
+		vfp_save_state(last_VFP_context[cpu], fpexc);
+#ifdef CONFIG_SMP
+		last_VFP_context[cpu]->hard.cpu = cpu;
+#endif
+		last_VFP_context[cpu] = NULL;
+	}
+}
+EXPORT_SYMBOL(kernel_neon_begin);
+
+void kernel_neon_end(void)
+{
+	/* disable again so the next user access reloads its own state */
+	fmxr(FPEXC, fmrx(FPEXC) & ~FPEXC_EN);
+	put_cpu();
+}
+EXPORT_SYMBOL(kernel_neon_end);
+#endif
+
 #include <linux/smp.h>
 
 /*
@@ -0,0 +1,205 @@
+/*
+ * Common Block IO controller cgroup interface
+ *
+ * Exposes a weight and an idle flag per cgroup for the io schedulers
+ * that support group scheduling (currently cfq), plus the disk time and
+ * sectors charged to each group.
+ *
+ * blkio.weight   share of disk time relative to sibling groups (100-1000)
+ * blkio.idle     run tasks with no explicit io priority as idle class
+ * blkio.time     disk time used by the group, in milliseconds
+ * blkio.sectors  sectors dispatched on behalf of the group
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/iocontext.h>
+#include <linux/jiffies.h>
+#include "blk-cgroup.h"
+
+struct blkio_cgroup blkio_root_cgroup = {
+	.weight = BLKIO_WEIGHT_DEFAULT,
+	.lock = __SPIN_LOCK_UNLOCKED(blkio_root_cgroup.lock),
+};
+EXPORT_SYMBOL_GPL(blkio_root_cgroup);
+
+static inline struct blkio_cgroup *cgroup_to_blkio_cgroup(struct cgroup *cgroup)
+{
+	return container_of(cgroup_subsys_state(cgroup, blkio_subsys_id),
+			    struct blkio_cgroup, css);
+}
+
+void blkiocg_update_stats(struct blkio_cgroup *blkcg, unsigned long time,
+			  unsigned long sectors)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&blkcg->lock, flags);
+	blkcg->time += time;
+	blkcg->sectors += sectors;
+	spin_unlock_irqrestore(&blkcg->lock, flags);
+}
+EXPORT_SYMBOL_GPL(blkiocg_update_stats);
+
+/*
+ * Make the io scheduler look the task's group up again on its next
+ * request. Pairs with the read in cfq_get_io_context().
+ */
+static void blkiocg_mark_ioc_changed(struct task_struct *tsk)
+{
+	struct io_context *ioc;
+
+	task_lock(tsk);
+	ioc = tsk->io_context;
+	if (ioc)
+		ioc->cgroup_changed = 1;
+	task_unlock(tsk);
+}
+
+static u64 blkiocg_weight_read(struct cgroup *cgroup, struct cftype *cft)
+{
+	return cgroup_to_blkio_cgroup(cgroup)->weight;
+}
+
+static int
+blkiocg_weight_write(struct cgroup *cgroup, struct cftype *cft, u64 val)
+{
+	if (val < BLKIO_WEIGHT_MIN || val > BLKIO_WEIGHT_MAX)
+		return -EINVAL;
+
+	/* picked up by the scheduler the next time the group is charged */
+	cgroup_to_blkio_cgroup(cgroup)->weight = (unsigned int)val;
+	return 0;
+}
+
+static u64 blkiocg_idle_read(struct cgroup *cgroup, struct cftype *cft)
+{
+	return cgroup_to_blkio_cgroup(cgroup)->idle;
+}
+
+static int
+blkiocg_idle_write(struct cgroup *cgroup, struct cftype *cft, u64 val)
+{
+	struct blkio_cgroup *blkcg = cgroup_to_blkio_cgroup(cgroup);
+	struct cgroup_iter it;
+	struct task_struct *tsk;
+
+	if (val > 1)
+		return -EINVAL;
+	if (blkcg->idle == val)
+		return 0;
+
+	blkcg->idle = (unsigned int)val;
+
+	/* existing queues keep their class until they are set up again */
+	cgroup_iter_start(cgroup, &it);
+	while ((tsk = cgroup_iter_next(cgroup, &it)))
+		blkiocg_mark_ioc_changed(tsk);
+	cgroup_iter_end(cgroup, &it);
+
+	return 0;
+}
+
+static u64 blkiocg_stat_read(struct cgroup *cgroup, struct cftype *cft)
+{
+	struct blkio_cgroup *blkcg = cgroup_to_blkio_cgroup(cgroup);
+	u64 val;
+
+	spin_lock_irq(&blkcg->lock);
+	if (cft->private)
+		val = blkcg->sectors;
+	else
+		val = blkcg->time;
+	spin_unlock_irq(&blkcg->lock);
+
+	if (!cft->private)
+		val = jiffies_to_msecs(val);
+	return val;
+}
+
+static struct cftype blkio_files[] = {
+	{
+		.name = "weight",
+		.read_u64 = blkiocg_weight_read,
+		.write_u64 = blkiocg_weight_write,
+	},
+	{
+		.name = "idle",
+		.read_u64 = blkiocg_idle_read,
+		.write_u64 = blkiocg_idle_write,
+	},
+	{
+		.name = "time",
+		.read_u64 = blkiocg_stat_read,
+		.private = 0,
+	},
+	{
+		.name = "sectors",
+		.read_u64 = blkiocg_stat_read,
+		.private = 1,
+	},
+};
+
+static int blkiocg_populate(struct cgroup_subsys *subsys, struct cgroup *cgroup)
+{
+	return cgroup_add_files(cgroup, subsys, blkio_files,
+				ARRAY_SIZE(blkio_files));
+}
+
+static struct cgroup_subsys_state *
+blkiocg_create(struct cgroup_subsys *subsys, struct cgroup *cgroup)
+{
+	struct blkio_cgroup *blkcg;
+
+	if (!cgroup->parent)
+		return &blkio_root_cgroup.css;
+
+	/* groups are flat: the scheduler only knows about leaf weights */
+	if (cgroup->parent->parent)
+		return ERR_PTR(-EINVAL);
+
+	blkcg = kzalloc(sizeof(*blkcg), GFP_KERNEL);
+	if (!blkcg)
+		return ERR_PTR(-ENOMEM);
+
+	blkcg->weight = BLKIO_WEIGHT_DEFAULT;
+	spin_lock_init(&blkcg->lock);
+	return &blkcg->css;
+}
+
+/*
+ * The io schedulers hold a css reference for as long as they keep
+ * per-device state for a group, so by now nobody refers to it.
+ */
+static void blkiocg_destroy(struct cgroup_subsys *subsys, struct cgroup *cgroup)
+{
+	struct blkio_cgroup *blkcg = cgroup_to_blkio_cgroup(cgroup);
+
+	if (blkcg != &blkio_root_cgroup)
+		kfree(blkcg);
+}
+
+static void blkiocg_attach(struct cgroup_subsys *subsys, struct cgroup *cgroup,
+			   struct cgroup *prev, struct task_struct *tsk,
+			   bool threadgroup)
+{
+	blkiocg_mark_ioc_changed(tsk);
+
+	if (threadgroup) {
+		struct task_struct *c;
+
+		rcu_read_lock();
+		list_for_each_entry_rcu(c, &tsk->thread_group, thread_group)
+			blkiocg_mark_ioc_changed(c);
+		rcu_read_unlock();
+	}
+}
+
+struct cgroup_subsys blkio_subsys = {
+	.name = "blkio",
+	.create = blkiocg_create,
+	.destroy = blkiocg_destroy,
+	.attach = blkiocg_attach,
+	.populate = blkiocg_populate,
+	.subsys_id = blkio_subsys_id,
+};
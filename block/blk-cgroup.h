@@ -0,0 +1,49 @@
+#ifndef _BLK_CGROUP_H
+#define _BLK_CGROUP_H
+/*
+ * Common Block IO controller cgroup interface
+ *
+ * A blkio cgroup carries a weight and an idle flag. The io scheduler
+ * looks them up for the submitting task and keeps whatever per-device
+ * state it needs itself; this file only holds the policy and the per
+ * group counters reported back through the cgroup files.
+ */
+
+#include <linux/cgroup.h>
+
+#define BLKIO_WEIGHT_MIN	100
+#define BLKIO_WEIGHT_MAX	1000
+#define BLKIO_WEIGHT_DEFAULT	500
+
+struct blkio_cgroup {
+	struct cgroup_subsys_state css;
+	unsigned int weight;
+	/* tasks without an explicit io priority are run as idle class */
+	unsigned int idle;
+
+	spinlock_t lock;
+	/* disk time charged to the group, in jiffies */
+	u64 time;
+	u64 sectors;
+};
+
+#ifdef CONFIG_BLK_CGROUP
+extern struct blkio_cgroup blkio_root_cgroup;
+
+static inline struct blkio_cgroup *task_blkio_cgroup(struct task_struct *tsk)
+{
+	return container_of(task_subsys_state(tsk, blkio_subsys_id),
+			    struct blkio_cgroup, css);
+}
+
+extern void blkiocg_update_stats(struct blkio_cgroup *blkcg,
+				 unsigned long time, unsigned long sectors);
+#else
+static inline void blkiocg_update_stats(struct blkio_cgroup *blkcg,
+					unsigned long time,
+					unsigned long sectors)
+{
+}
+#endif
+
+#endif /* _BLK_CGROUP_H */
@@ -12,6 +12,7 @@
 #include <linux/rbtree.h>
 #include <linux/ioprio.h>
 #include <linux/blktrace_api.h>
+#include "blk-cgroup.h"
 
 /*
  * tunables
@@ -39,6 +40,8 @@ static int cfq_slice_idle = HZ / 125;
 #define CFQ_MIN_TT		(2)
 
 #define CFQ_SLICE_SCALE		(5)
+/* fixed point shift for the group vdisktime charge */
+#define CFQ_SERVICE_SHIFT	12
 #define CFQ_HW_QUEUE_MIN	(5)
 
 #define RQ_CIC(rq)		\
@@ -70,6 +73,28 @@ struct cfq_rb_root {
 };
 #define CFQ_RB_ROOT	(struct cfq_rb_root) { RB_ROOT, NULL, }
 
+/*
+ * Per blkio cgroup, per device structure. The queues of a group share
+ * one service tree, and groups are served in order of the disk time
+ * they used, scaled by their weight.
+ */
+struct cfq_group {
+	/* group service_tree member */
+	struct rb_node rb_node;
+	/* group service_tree key */
+	u64 vdisktime;
+	/* rr list of this group's queues with requests */
+	struct cfq_rb_root service_tree;
+	unsigned int busy_queues;
+	/* number of cfq_queues linked to the group */
+	int ref;
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+	struct blkio_cgroup *blkcg;
+	/* cfqd->cfqg_list member */
+	struct list_head cfqd_node;
+#endif
+};
+
 /*
  * Per process-grouping structure
  */
@@ -80,6 +105,8 @@ struct cfq_queue {
 	unsigned int flags;
 	/* parent cfq_data */
 	struct cfq_data *cfqd;
+	/* group the queue is served in */
+	struct cfq_group *cfqg;
 	/* service_tree member */
 	struct rb_node rb_node;
 	/* service_tree key */
@@ -99,6 +126,7 @@ struct cfq_queue {
 	/* fifo list of requests in sort_list */
 	struct list_head fifo;
 
+	unsigned long slice_start;
 	unsigned long slice_end;
 	long slice_resid;
 	unsigned int slice_dispatch;
@@ -122,9 +150,16 @@ struct cfq_data {
 	struct request_queue *queue;
 
 	/*
-	 * rr list of queues with requests and the count of them
+	 * rr list of groups with busy queues, ordered by vdisktime
 	 */
-	struct cfq_rb_root service_tree;
+	struct cfq_rb_root grp_service_tree;
+	struct cfq_group root_group;
+	/* vdisktime of the last group selected for service */
+	u64 min_vdisktime;
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+	/* groups other than root_group that have queues on this device */
+	struct list_head cfqg_list;
+#endif
 
 	/*
 	 * Each priority tree is sorted by next_request position.  These
@@ -434,6 +469,17 @@ static struct cfq_queue *cfq_rb_first(struct cfq_rb_root *root)
 	return NULL;
 }
 
+static struct cfq_group *cfq_rb_first_group(struct cfq_rb_root *root)
+{
+	if (!root->left)
+		root->left = rb_first(&root->rb);
+
+	if (root->left)
+		return rb_entry(root->left, struct cfq_group, rb_node);
+
+	return NULL;
+}
+
 static void rb_erase_init(struct rb_node *n, struct rb_root *root)
 {
 	rb_erase(n, root);
@@ -480,18 +526,109 @@ static unsigned long cfq_slice_offset(struct cfq_data *cfqd,
 	/*
 	 * just an approximation, should be ok.
 	 */
-	return (cfqd->busy_queues - 1) * (cfq_prio_slice(cfqd, 1, 0) -
+	return (cfqq->cfqg->busy_queues - 1) * (cfq_prio_slice(cfqd, 1, 0) -
 		       cfq_prio_slice(cfqd, cfq_cfqq_sync(cfqq), cfqq->ioprio));
 }
 
 /*
- * The cfqd->service_tree holds all pending cfq_queue's that have
- * requests waiting to be processed. It is sorted in the order that
+ * The cfqd->grp_service_tree holds the groups that have queues with
+ * requests waiting, sorted by weighted disk time used. A group that
+ * had nothing queued restarts at the current minimum, so it cannot
+ * bank the time it did not use.
+ */
+static void cfq_group_service_tree_add(struct cfq_data *cfqd,
+				       struct cfq_group *cfqg)
+{
+	struct rb_node **p, *parent;
+	struct cfq_group *__cfqg;
+	int left;
+
+	if (cfqg->vdisktime < cfqd->min_vdisktime)
+		cfqg->vdisktime = cfqd->min_vdisktime;
+
+	left = 1;
+	parent = NULL;
+	p = &cfqd->grp_service_tree.rb.rb_node;
+	while (*p) {
+		parent = *p;
+		__cfqg = rb_entry(parent, struct cfq_group, rb_node);
+
+		if (cfqg->vdisktime < __cfqg->vdisktime)
+			p = &parent->rb_left;
+		else {
+			p = &parent->rb_right;
+			left = 0;
+		}
+	}
+
+	if (left)
+		cfqd->grp_service_tree.left = &cfqg->rb_node;
+
+	rb_link_node(&cfqg->rb_node, parent, p);
+	rb_insert_color(&cfqg->rb_node, &cfqd->grp_service_tree.rb);
+}
+
+static inline unsigned int cfq_group_weight(struct cfq_group *cfqg)
+{
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+	return cfqg->blkcg->weight;
+#else
+	return BLKIO_WEIGHT_DEFAULT;
+#endif
+}
+
+/*
+ * Charge the disk time the expiring queue held to its group.
+ */
+static void cfq_group_charge(struct cfq_data *cfqd, struct cfq_queue *cfqq)
+{
+	struct cfq_group *cfqg = cfqq->cfqg;
+	unsigned long used = jiffies - cfqq->slice_start;
+	u64 charge;
+
+	if (!used)
+		used = 1;
+
+	charge = div_u64((u64)used * BLKIO_WEIGHT_DEFAULT << CFQ_SERVICE_SHIFT,
+			 cfq_group_weight(cfqg));
+
+	if (!RB_EMPTY_NODE(&cfqg->rb_node)) {
+		cfq_rb_erase(&cfqg->rb_node, &cfqd->grp_service_tree);
+		cfqg->vdisktime += charge;
+		cfq_group_service_tree_add(cfqd, cfqg);
+	} else
+		cfqg->vdisktime += charge;
+
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+	blkiocg_update_stats(cfqg->blkcg, used, 0);
+#endif
+	cfq_log_cfqq(cfqd, cfqq, "charge=%lu weight=%u", used,
+		     cfq_group_weight(cfqg));
+}
+
+/*
+ * Only let a queue from another group in ahead of the active queue if
+ * its group is owed disk time and is next in line anyway.
+ */
+static bool cfq_group_should_preempt(struct cfq_data *cfqd,
+				     struct cfq_group *new_cfqg,
+				     struct cfq_group *cfqg)
+{
+	if (new_cfqg->vdisktime >= cfqg->vdisktime)
+		return false;
+
+	return cfq_rb_first_group(&cfqd->grp_service_tree) == new_cfqg;
+}
+
+/*
+ * The cfqg->service_tree holds all pending cfq_queue's of a group that
+ * have requests waiting to be processed. It is sorted in the order that
  * we will service the queues.
  */
 static void cfq_service_tree_add(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 				 bool add_front)
 {
+	struct cfq_rb_root *service_tree = &cfqq->cfqg->service_tree;
 	struct rb_node **p, *parent;
 	struct cfq_queue *__cfqq;
 	unsigned long rb_key;
@@ -499,7 +636,7 @@ static void cfq_service_tree_add(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 
 	if (cfq_class_idle(cfqq)) {
 		rb_key = CFQ_IDLE_DELAY;
-		parent = rb_last(&cfqd->service_tree.rb);
+		parent = rb_last(&service_tree->rb);
 		if (parent && parent != &cfqq->rb_node) {
 			__cfqq = rb_entry(parent, struct cfq_queue, rb_node);
 			rb_key += __cfqq->rb_key;
@@ -517,7 +654,7 @@ static void cfq_service_tree_add(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 		cfqq->slice_resid = 0;
 	} else {
 		rb_key = -HZ;
-		__cfqq = cfq_rb_first(&cfqd->service_tree);
+		__cfqq = cfq_rb_first(service_tree);
 		rb_key += __cfqq ? __cfqq->rb_key : jiffies;
 	}
 
@@ -528,12 +665,12 @@ static void cfq_service_tree_add(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 		if (rb_key == cfqq->rb_key)
 			return;
 
-		cfq_rb_erase(&cfqq->rb_node, &cfqd->service_tree);
+		cfq_rb_erase(&cfqq->rb_node, service_tree);
 	}
 
 	left = 1;
 	parent = NULL;
-	p = &cfqd->service_tree.rb.rb_node;
+	p = &service_tree->rb.rb_node;
 	while (*p) {
 		struct rb_node **n;
 
@@ -565,11 +702,11 @@ static void cfq_service_tree_add(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 	}
 
 	if (left)
-		cfqd->service_tree.left = &cfqq->rb_node;
+		service_tree->left = &cfqq->rb_node;
 
 	cfqq->rb_key = rb_key;
 	rb_link_node(&cfqq->rb_node, parent, p);
-	rb_insert_color(&cfqq->rb_node, &cfqd->service_tree.rb);
+	rb_insert_color(&cfqq->rb_node, &service_tree->rb);
 }
 
 static struct cfq_queue *
@@ -657,6 +794,8 @@ static void cfq_add_cfqq_rr(struct cfq_data *cfqd, struct cfq_queue *cfqq)
 	BUG_ON(cfq_cfqq_on_rr(cfqq));
 	cfq_mark_cfqq_on_rr(cfqq);
 	cfqd->busy_queues++;
+	if (!cfqq->cfqg->busy_queues++)
+		cfq_group_service_tree_add(cfqd, cfqq->cfqg);
 
 	cfq_resort_rr_list(cfqd, cfqq);
 }
@@ -672,12 +811,16 @@ static void cfq_del_cfqq_rr(struct cfq_data *cfqd, struct cfq_queue *cfqq)
 	cfq_clear_cfqq_on_rr(cfqq);
 
 	if (!RB_EMPTY_NODE(&cfqq->rb_node))
-		cfq_rb_erase(&cfqq->rb_node, &cfqd->service_tree);
+		cfq_rb_erase(&cfqq->rb_node, &cfqq->cfqg->service_tree);
 	if (cfqq->p_root) {
 		rb_erase(&cfqq->p_node, cfqq->p_root);
 		cfqq->p_root = NULL;
 	}
 
+	BUG_ON(!cfqq->cfqg->busy_queues);
+	if (!--cfqq->cfqg->busy_queues)
+		cfq_rb_erase(&cfqq->cfqg->rb_node, &cfqd->grp_service_tree);
+
 	BUG_ON(!cfqd->busy_queues);
 	cfqd->busy_queues--;
 }
@@ -871,6 +1014,7 @@ static void __cfq_set_active_queue(struct cfq_data *cfqd,
 {
 	if (cfqq) {
 		cfq_log_cfqq(cfqd, cfqq, "set_active");
+		cfqq->slice_start = jiffies;
 		cfqq->slice_end = 0;
 		cfqq->slice_dispatch = 0;
 
@@ -908,6 +1052,9 @@ __cfq_slice_expired(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 		cfq_log_cfqq(cfqd, cfqq, "resid=%ld", cfqq->slice_resid);
 	}
 
+	if (cfqq == cfqd->active_queue)
+		cfq_group_charge(cfqd, cfqq);
+
 	cfq_resort_rr_list(cfqd, cfqq);
 
 	if (cfqq == cfqd->active_queue)
@@ -929,14 +1076,21 @@ static inline void cfq_slice_expired(struct cfq_data *cfqd, bool timed_out)
 
 /*
  * Get next queue for service. Unless we have a queue preemption,
- * we'll simply select the first cfqq in the service tree.
+ * we'll simply select the first cfqq in the service tree of the group
+ * that has used the least weighted disk time.
  */
 static struct cfq_queue *cfq_get_next_queue(struct cfq_data *cfqd)
 {
-	if (RB_EMPTY_ROOT(&cfqd->service_tree.rb))
+	struct cfq_group *cfqg;
+
+	cfqg = cfq_rb_first_group(&cfqd->grp_service_tree);
+	if (!cfqg)
 		return NULL;
 
-	return cfq_rb_first(&cfqd->service_tree);
+	if (cfqg->vdisktime > cfqd->min_vdisktime)
+		cfqd->min_vdisktime = cfqg->vdisktime;
+
+	return cfq_rb_first(&cfqg->service_tree);
 }
 
 /*
@@ -1054,6 +1208,10 @@ static struct cfq_queue *cfq_close_cooperator(struct cfq_data *cfqd,
 	if (!cfqq)
 		return NULL;
 
+	/* don't let a close queue jump the group order */
+	if (cfqq->cfqg != cur_cfqq->cfqg)
+		return NULL;
+
 	if (cfq_cfqq_coop(cfqq))
 		return NULL;
 
@@ -1137,6 +1295,10 @@ static void cfq_dispatch_insert(struct request_queue *q, struct request *rq)
 	cfqq->dispatched++;
 	elv_dispatch_sort(q, rq);
 
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+	blkiocg_update_stats(cfqq->cfqg->blkcg, 0, blk_rq_sectors(rq));
+#endif
+
 	if (cfq_cfqq_sync(cfqq))
 		cfqd->sync_flight++;
 }
@@ -1250,7 +1412,7 @@ static int cfq_forced_dispatch(struct cfq_data *cfqd)
 	struct cfq_queue *cfqq;
 	int dispatched = 0;
 
-	while ((cfqq = cfq_rb_first(&cfqd->service_tree)) != NULL)
+	while ((cfqq = cfq_get_next_queue(cfqd)) != NULL)
 		dispatched += __cfq_forced_dispatch_cfqq(cfqq);
 
 	cfq_slice_expired(cfqd, 0);
@@ -1403,6 +1565,91 @@ static int cfq_dispatch_requests(struct request_queue *q, int force)
 	return 1;
 }
 
+static void cfq_init_cfqg(struct cfq_group *cfqg)
+{
+	RB_CLEAR_NODE(&cfqg->rb_node);
+	cfqg->service_tree = CFQ_RB_ROOT;
+}
+
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+/*
+ * Find or create the group of the current task on this device. Runs
+ * under the queue lock; if the allocation fails the queue is served in
+ * the root group instead.
+ */
+static struct cfq_group *cfq_get_cfqg(struct cfq_data *cfqd)
+{
+	struct blkio_cgroup *blkcg;
+	struct cfq_group *cfqg;
+
+	rcu_read_lock();
+	blkcg = task_blkio_cgroup(current);
+	if (blkcg == &blkio_root_cgroup)
+		goto root;
+
+	list_for_each_entry(cfqg, &cfqd->cfqg_list, cfqd_node)
+		if (cfqg->blkcg == blkcg)
+			goto out;
+
+	cfqg = kmalloc_node(sizeof(*cfqg), GFP_ATOMIC | __GFP_ZERO,
+			    cfqd->queue->node);
+	if (!cfqg)
+		goto root;
+
+	/* the group is being removed, don't pin it */
+	if (!css_tryget(&blkcg->css)) {
+		kfree(cfqg);
+		goto root;
+	}
+
+	cfq_init_cfqg(cfqg);
+	cfqg->blkcg = blkcg;
+	list_add(&cfqg->cfqd_node, &cfqd->cfqg_list);
+	cfq_log(cfqd, "alloc group %p", cfqg);
+	goto out;
+root:
+	cfqg = &cfqd->root_group;
+out:
+	cfqg->ref++;
+	rcu_read_unlock();
+	return cfqg;
+}
+
+static void cfq_put_cfqg(struct cfq_data *cfqd, struct cfq_group *cfqg)
+{
+	BUG_ON(cfqg->ref <= 0);
+
+	if (--cfqg->ref || cfqg == &cfqd->root_group)
+		return;
+
+	BUG_ON(cfqg->busy_queues);
+	list_del(&cfqg->cfqd_node);
+	css_put(&cfqg->blkcg->css);
+	kfree(cfqg);
+}
+
+static inline bool cfq_group_idle(struct cfq_group *cfqg)
+{
+	return cfqg->blkcg->idle;
+}
+#else
+static struct cfq_group *cfq_get_cfqg(struct cfq_data *cfqd)
+{
+	cfqd->root_group.ref++;
+	return &cfqd->root_group;
+}
+
+static void cfq_put_cfqg(struct cfq_data *cfqd, struct cfq_group *cfqg)
+{
+	cfqg->ref--;
+}
+
+static inline bool cfq_group_idle(struct cfq_group *cfqg)
+{
+	return false;
+}
+#endif /* CONFIG_CFQ_GROUP_IOSCHED */
+
 /*
  * task holds one reference to the queue, dropped when task exits. each rq
  * in-flight on this queue also holds a reference, dropped when rq is freed.
@@ -1428,6 +1675,7 @@ static void cfq_put_queue(struct cfq_queue *cfqq)
 		cfq_schedule_dispatch(cfqd);
 	}
 
+	cfq_put_cfqg(cfqd, cfqq->cfqg);
 	kmem_cache_free(cfq_pool, cfqq);
 }
 
@@ -1619,8 +1867,15 @@ static void cfq_init_prio_data(struct cfq_queue *cfqq, struct io_context *ioc)
 		printk(KERN_ERR "cfq: bad prio %x\n", ioprio_class);
 	case IOPRIO_CLASS_NONE:
 		/*
-		 * no prio set, inherit CPU scheduling settings
+		 * no prio set: run as idle class if the group asks for it,
+		 * otherwise inherit CPU scheduling settings
 		 */
+		if (cfq_cfqq_sync(cfqq) && cfq_group_idle(cfqq->cfqg)) {
+			cfqq->ioprio_class = IOPRIO_CLASS_IDLE;
+			cfqq->ioprio = 7;
+			cfq_clear_cfqq_idle_window(cfqq);
+			break;
+		}
 		cfqq->ioprio = task_nice_ioprio(tsk);
 		cfqq->ioprio_class = task_nice_ioclass(tsk);
 		break;
@@ -1683,6 +1938,39 @@ static void cfq_ioc_set_ioprio(struct io_context *ioc)
 	ioc->ioprio_changed = 0;
 }
 
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+/*
+ * The task moved to another blkio cgroup, or its group's settings
+ * changed. Drop the sync queue so the next request sets one up in the
+ * right group; requests already queued finish where they are.
+ */
+static void changed_cgroup(struct io_context *ioc, struct cfq_io_context *cic)
+{
+	struct cfq_data *cfqd = cic->key;
+	struct cfq_queue *sync_cfqq;
+	unsigned long flags;
+
+	if (unlikely(!cfqd))
+		return;
+
+	spin_lock_irqsave(cfqd->queue->queue_lock, flags);
+
+	sync_cfqq = cic_to_cfqq(cic, 1);
+	if (sync_cfqq) {
+		cic_set_cfqq(cic, NULL, 1);
+		cfq_put_queue(sync_cfqq);
+	}
+
+	spin_unlock_irqrestore(cfqd->queue->queue_lock, flags);
+}
+
+static void cfq_ioc_set_cgroup(struct io_context *ioc)
+{
+	call_for_each_cic(ioc, changed_cgroup);
+	ioc->cgroup_changed = 0;
+}
+#endif /* CONFIG_CFQ_GROUP_IOSCHED */
+
 static void cfq_init_cfqq(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 			  pid_t pid, bool is_sync)
 {
@@ -1740,6 +2028,13 @@ retry:
 
 		if (cfqq) {
 			cfq_init_cfqq(cfqd, cfqq, current->pid, is_sync);
+			/* async queues are shared, keep them in the root group */
+			if (is_sync)
+				cfqq->cfqg = cfq_get_cfqg(cfqd);
+			else {
+				cfqd->root_group.ref++;
+				cfqq->cfqg = &cfqd->root_group;
+			}
 			cfq_init_prio_data(cfqq, ioc);
 			cfq_log_cfqq(cfqd, cfqq, "alloced");
 		} else
@@ -1931,6 +2226,10 @@ out:
 	smp_read_barrier_depends();
 	if (unlikely(ioc->ioprio_changed))
 		cfq_ioc_set_ioprio(ioc);
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+	if (unlikely(ioc->cgroup_changed))
+		cfq_ioc_set_cgroup(ioc);
+#endif
 
 	return cic;
 err_free:
@@ -2044,6 +2343,10 @@ cfq_should_preempt(struct cfq_data *cfqd, struct cfq_queue *new_cfqq,
 	if (cfq_class_idle(cfqq))
 		return true;
 
+	if (new_cfqq->cfqg != cfqq->cfqg)
+		return cfq_group_should_preempt(cfqd, new_cfqq->cfqg,
+						cfqq->cfqg);
+
 	/*
 	 * if the new request is sync, but the currently running queue is
 	 * not, let the sync request have priority.
@@ -2506,7 +2809,18 @@ static void *cfq_init_queue(struct request_queue *q)
 	if (!cfqd)
 		return NULL;
 
-	cfqd->service_tree = CFQ_RB_ROOT;
+	cfqd->grp_service_tree = CFQ_RB_ROOT;
+
+	/*
+	 * The root group is embedded and holds a reference of its own,
+	 * so it is never freed through cfq_put_cfqg().
+	 */
+	cfq_init_cfqg(&cfqd->root_group);
+	cfqd->root_group.ref = 1;
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+	cfqd->root_group.blkcg = &blkio_root_cgroup;
+	INIT_LIST_HEAD(&cfqd->cfqg_list);
+#endif
 
 	/*
 	 * Not strictly needed (since RB_ROOT just clears the node and we
@@ -2523,6 +2837,8 @@ static void *cfq_init_queue(struct request_queue *q)
 	 */
 	cfq_init_cfqq(cfqd, &cfqd->oom_cfqq, 1, 0);
 	atomic_inc(&cfqd->oom_cfqq.ref);
+	cfqd->oom_cfqq.cfqg = &cfqd->root_group;
+	cfqd->root_group.ref++;
 
 	INIT_LIST_HEAD(&cfqd->cic_list);
 
@@ -15,6 +15,22 @@
  * Async and synch requests are not treated seperately.  Instead we
  * rely on deadlines to ensure fairness.
  *
+ * Flash mode:
+ *
+ * On eMMC, SD and NAND there is no head, so distance and direction are
+ * ignored.  Sync requests (all reads, and writes someone is waiting for)
+ * are dispatched in FIFO order ahead of async writes.  An async write
+ * only goes first once it has passed async_expire, and then for at most
+ * fifo_batch requests before the next sync one.  Async writes are issued
+ * an erase block (`erase_kb') at a time: starting at the lowest queued
+ * write in the oldest write's erase block and sweeping up through it,
+ * so that back-to-back writes to the block reach the card together and
+ * can be merged.  `flash' is -1 (follow the queue's rotational flag),
+ * 0 or 1.
+ *
+ * read_latency and write_latency report "dispatched avg_us max_us", the
+ * time from queueing to dispatch; writing to either resets both.
+ *
  */
 #include <linux/kernel.h>
 #include <linux/fs.h>
@@ -26,6 +42,8 @@
 #include <linux/init.h>
 #include <linux/compiler.h>
 #include <linux/rbtree.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 
 #include <asm/div64.h>
 
@@ -43,8 +61,16 @@ static const int sync_expire = HZ / 2;  /* max time before a sync is submitted.
 static const int async_expire = 5 * HZ; /* ditto for async, these limits are SOFT! */
 static const int fifo_batch = 16;
 static const int rev_penalty = 10;	/* penalty for reversing head direction */
+static const int erase_kb = 512;	/* flash mode: write grouping unit */
+
+struct vr_lat_stats {
+	unsigned long count;
+	u64 total_us;
+	u32 max_us;
+};
 
 struct vr_data {
+	struct request_queue *q;
 	struct rb_root sort_list;
 	struct list_head fifo_list[2];
 
@@ -54,11 +80,16 @@ struct vr_data {
 	unsigned int nbatched;
 	sector_t last_sector;		/* head position */
 	int head_dir;
+	sector_t write_sector;		/* flash: end of the last async write */
+
+	struct vr_lat_stats lat[2];	/* indexed by rq_data_dir() */
 
 	/* tunables */
 	int fifo_expire[2];
 	int fifo_batch;
 	int rev_penalty;
+	int flash;
+	int erase_kb;
 };
 
 static void vr_move_request(struct vr_data *, struct request *);
@@ -69,6 +100,31 @@ vr_get_data(struct request_queue *q)
 	return q->elevator->elevator_data;
 }
 
+static inline int
+vr_flash(struct vr_data *vd)
+{
+	return vd->flash < 0 ? blk_queue_nonrot(vd->q) : vd->flash;
+}
+
+/* queueing time, kept in the otherwise unused elevator_private */
+static inline u32
+vr_now_us(void)
+{
+	return ktime_to_us(ktime_get());
+}
+
+static inline void
+vr_set_stamp(struct request *rq, u32 us)
+{
+	rq->elevator_private = (void *)(unsigned long)us;
+}
+
+static inline u32
+vr_stamp(struct request *rq)
+{
+	return (unsigned long)rq->elevator_private;
+}
+
 static void
 vr_add_rq_rb(struct vr_data *vd, struct request *rq)
 {
@@ -122,11 +178,14 @@ vr_add_request(struct request_queue *q, struct request *rq)
 	const int dir = rq_is_sync(rq);
 
 	vr_add_rq_rb(vd, rq);
+	vr_set_stamp(rq, vr_now_us());
 
-	if (vd->fifo_expire[dir]) {
-		rq_set_fifo_time(rq, jiffies + vd->fifo_expire[dir]);
-		list_add_tail(&rq->queuelist, &vd->fifo_list[dir]);
-	}
+	/*
+	 * Always queue on the fifo, flash mode dispatches from it; an
+	 * expire time of 0 still means the request never expires.
+	 */
+	rq_set_fifo_time(rq, jiffies + vd->fifo_expire[dir]);
+	list_add_tail(&rq->queuelist, &vd->fifo_list[dir]);
 }
 
 /*
@@ -183,10 +242,24 @@ vr_merged_requests(struct request_queue *q, struct request *rq,
 			rq_set_fifo_time(rq, rq_fifo_time(next));
 		}
 	}
+	if ((s32)(vr_stamp(next) - vr_stamp(rq)) < 0)
+		vr_set_stamp(rq, vr_stamp(next));
 
 	vr_remove_request(q, next);
 }
 
+static void
+vr_account_dispatch(struct vr_data *vd, struct request *rq)
+{
+	struct vr_lat_stats *s = &vd->lat[rq_data_dir(rq)];
+	u32 us = vr_now_us() - vr_stamp(rq);
+
+	s->count++;
+	s->total_us += us;
+	if (us > s->max_us)
+		s->max_us = us;
+}
+
 /*
  * move an entry to dispatch queue
  */
@@ -195,6 +268,8 @@ vr_move_request(struct vr_data *vd, struct request *rq)
 {
 	struct request_queue *q = rq->q;
 
+	vr_account_dispatch(vd, rq);
+
 	if (blk_rq_pos(rq) > vd->last_sector)
 		vd->head_dir = FORWARD;
 	else
@@ -219,7 +294,7 @@ vr_expired_request(struct vr_data *vd, int ddir)
 {
 	struct request *rq;
 
-	if (list_empty(&vd->fifo_list[ddir]))
+	if (!vd->fifo_expire[ddir] || list_empty(&vd->fifo_list[ddir]))
 		return NULL;
 
 	rq = rq_entry_fifo(vd->fifo_list[ddir].next);
@@ -282,12 +357,104 @@ vr_choose_request(struct vr_data *vd)
 	return prev;
 }
 
+/*
+ * Return the queued request with the lowest sector >= sector
+ */
+static struct request *
+vr_rb_ceil(struct vr_data *vd, sector_t sector)
+{
+	struct rb_node *n = vd->sort_list.rb_node;
+	struct request *rq, *ceil = NULL;
+
+	while (n) {
+		rq = rb_entry_rq(n);
+		if (blk_rq_pos(rq) < sector)
+			n = n->rb_right;
+		else {
+			ceil = rq;
+			n = n->rb_left;
+		}
+	}
+	return ceil;
+}
+
+/*
+ * Flash mode: the next async write.  Keep sweeping up the erase block
+ * of the last one unless oldest has expired, otherwise start at the
+ * bottom of oldest's erase block.
+ */
+static struct request *
+vr_flash_next_write(struct vr_data *vd, struct request *oldest, int expired)
+{
+	sector_t mask = ((sector_t)vd->erase_kb << 1) - 1;
+	struct request *rq;
+
+	if (!expired && vd->write_sector) {
+		rq = vr_rb_ceil(vd, vd->write_sector);
+		if (rq && !rq_is_sync(rq) &&
+		    (blk_rq_pos(rq) & ~mask) == ((vd->write_sector - 1) & ~mask))
+			return rq;
+	}
+
+	/* oldest itself ends the walk */
+	rq = vr_rb_ceil(vd, blk_rq_pos(oldest) & ~mask);
+	while (rq_is_sync(rq))
+		rq = elv_rb_latter_request(NULL, rq);
+	return rq;
+}
+
+static struct request *
+vr_flash_choose_request(struct vr_data *vd)
+{
+	struct request *rq;
+
+	if (!list_empty(&vd->fifo_list[SYNC])) {
+		/* an expired write may go first, fifo_batch at a time */
+		rq = vr_expired_request(vd, ASYNC);
+		if (!rq || vd->nbatched >= vd->fifo_batch)
+			return rq_entry_fifo(vd->fifo_list[SYNC].next);
+		return vr_flash_next_write(vd, rq, 1);
+	}
+
+	if (list_empty(&vd->fifo_list[ASYNC]))
+		return NULL;
+
+	rq = vr_expired_request(vd, ASYNC);
+	if (rq)
+		return vr_flash_next_write(vd, rq, 1);
+	return vr_flash_next_write(vd,
+			rq_entry_fifo(vd->fifo_list[ASYNC].next), 0);
+}
+
+static int
+vr_flash_dispatch(struct vr_data *vd)
+{
+	struct request *rq = vr_flash_choose_request(vd);
+	int sync;
+
+	if (!rq)
+		return 0;
+
+	sync = rq_is_sync(rq);
+	if (!sync)
+		vd->write_sector = blk_rq_pos(rq) + blk_rq_sectors(rq);
+	vr_move_request(vd, rq);
+
+	/* nbatched counts the async writes since the last sync request */
+	if (sync)
+		vd->nbatched = 0;
+	return 1;
+}
+
 static int
 vr_dispatch_requests(struct request_queue *q, int force)
 {
 	struct vr_data *vd = vr_get_data(q);
 	struct request *rq = NULL;
 
+	if (vr_flash(vd))
+		return vr_flash_dispatch(vd);
+
 	/* Check for and issue expired requests */
 	if (vd->nbatched > vd->fifo_batch) {
 		vd->nbatched = 0;
@@ -333,11 +500,14 @@ static void *vr_init_queue(struct request_queue *q)
 
 	INIT_LIST_HEAD(&vd->fifo_list[SYNC]);
 	INIT_LIST_HEAD(&vd->fifo_list[ASYNC]);
+	vd->q = q;
 	vd->sort_list = RB_ROOT;
 	vd->fifo_expire[SYNC] = sync_expire;
 	vd->fifo_expire[ASYNC] = async_expire;
 	vd->fifo_batch = fifo_batch;
 	vd->rev_penalty = rev_penalty;
+	vd->flash = -1;
+	vd->erase_kb = erase_kb;
 	return vd;
 }
 
@@ -371,6 +541,8 @@ SHOW_FUNCTION(vr_sync_expire_show, vd->fifo_expire[SYNC], 1);
 SHOW_FUNCTION(vr_async_expire_show, vd->fifo_expire[ASYNC], 1);
 SHOW_FUNCTION(vr_fifo_batch_show, vd->fifo_batch, 0);
 SHOW_FUNCTION(vr_rev_penalty_show, vd->rev_penalty, 0);
+SHOW_FUNCTION(vr_flash_show, vr_flash(vd), 0);
+SHOW_FUNCTION(vr_erase_kb_show, vd->erase_kb, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -393,8 +565,60 @@ STORE_FUNCTION(vr_sync_expire_store, &vd->fifo_expire[SYNC], 0, INT_MAX, 1);
 STORE_FUNCTION(vr_async_expire_store, &vd->fifo_expire[ASYNC], 0, INT_MAX, 1);
 STORE_FUNCTION(vr_fifo_batch_store, &vd->fifo_batch, 0, INT_MAX, 0);
 STORE_FUNCTION(vr_rev_penalty_store, &vd->rev_penalty, 0, INT_MAX, 0);
+STORE_FUNCTION(vr_flash_store, &vd->flash, -1, 1, 0);
 #undef STORE_FUNCTION
 
+static ssize_t
+vr_erase_kb_store(struct elevator_queue *e, const char *page, size_t count)
+{
+	struct vr_data *vd = e->elevator_data;
+	int __data;
+	int ret = vr_var_store(&__data, page, count);
+
+	/* a power of two, so that blocks are found by masking */
+	__data = clamp(__data, 4, 64 * 1024);
+	vd->erase_kb = rounddown_pow_of_two(__data);
+	return ret;
+}
+
+static ssize_t
+vr_lat_show(struct vr_lat_stats *s, char *page)
+{
+	u64 avg = s->total_us;
+
+	if (s->count)
+		do_div(avg, s->count);
+	return sprintf(page, "%lu %llu %u\n", s->count,
+		       (unsigned long long)avg, s->max_us);
+}
+
+static ssize_t
+vr_read_latency_show(struct elevator_queue *e, char *page)
+{
+	struct vr_data *vd = e->elevator_data;
+	return vr_lat_show(&vd->lat[READ], page);
+}
+
+static ssize_t
+vr_write_latency_show(struct elevator_queue *e, char *page)
+{
+	struct vr_data *vd = e->elevator_data;
+	return vr_lat_show(&vd->lat[WRITE], page);
+}
+
+static ssize_t
+vr_lat_reset(struct elevator_queue *e, const char *page, size_t count)
+{
+	struct vr_data *vd = e->elevator_data;
+
+	spin_lock_irq(vd->q->queue_lock);
+	memset(vd->lat, 0, sizeof(vd->lat));
+	spin_unlock_irq(vd->q->queue_lock);
+	return count;
+}
+#define vr_read_latency_store	vr_lat_reset
+#define vr_write_latency_store	vr_lat_reset
+
 #define DD_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, vr_##name##_show, \
 				      vr_##name##_store)
@@ -404,6 +628,10 @@ static struct elv_fs_entry vr_attrs[] = {
 	DD_ATTR(async_expire),
 	DD_ATTR(fifo_batch),
 	DD_ATTR(rev_penalty),
+	DD_ATTR(flash),
+	DD_ATTR(erase_kb),
+	DD_ATTR(read_latency),
+	DD_ATTR(write_latency),
 	__ATTR_NULL
 };
 
@@ -1,3 +1,4 @@
+#include <linux/async.h>
 
 /**
  * struct bus_type_private - structure to hold the private to the driver core portions of the bus_type structure.
@@ -33,6 +34,8 @@ struct driver_private {
 	struct klist_node knode_bus;
 	struct module_kobject *mkobj;
 	struct device_driver *driver;
+	async_cookie_t attach_cookie;
+	bool attach_queued;
 };
 #define to_driver(obj) container_of(obj, struct driver_private, kobj)
 
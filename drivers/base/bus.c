@@ -15,6 +15,8 @@
 #include <linux/errno.h>
 #include <linux/init.h>
 #include <linux/string.h>
+#include <linux/async.h>
+#include <linux/ktime.h>
 #include "base.h"
 #include "power/power.h"
 
@@ -640,6 +642,34 @@ static ssize_t driver_uevent_store(struct device_driver *drv,
 }
 static DRIVER_ATTR(uevent, S_IWUSR, NULL, driver_uevent_store);
 
+static void driver_attach_async(void *data, async_cookie_t cookie)
+{
+	struct device_driver *drv = data;
+	struct device_driver *after;
+	ktime_t start;
+	int error;
+
+	if (drv->probe_after) {
+		after = driver_find(drv->probe_after, drv->bus);
+		if (after) {
+			/* one registered after us can't be waited for */
+			if (after->p->attach_queued &&
+			    after->p->attach_cookie < cookie)
+				async_synchronize_cookie(
+					after->p->attach_cookie + 1);
+			put_driver(after);
+		}
+	}
+
+	start = ktime_get();
+	error = driver_attach(drv);
+	boot_time_record(drv->name, NULL,
+			 ktime_to_us(ktime_sub(ktime_get(), start)));
+	if (error)
+		printk(KERN_ERR "%s: async attach of %s failed %d\n",
+		       __func__, drv->name, error);
+}
+
 /**
  * bus_add_driver - Add a driver to the bus.
  * @drv: driver.
@@ -670,7 +700,8 @@ int bus_add_driver(struct device_driver *drv)
 	if (error)
 		goto out_unregister;
 
-	if (drv->bus->p->drivers_autoprobe) {
+	if (drv->bus->p->drivers_autoprobe &&
+	    !(drv->probe_async && system_state == SYSTEM_BOOTING)) {
 		error = driver_attach(drv);
 		if (error)
 			goto out_unregister;
@@ -700,6 +731,13 @@ int bus_add_driver(struct device_driver *drv)
 	}
 
 	kobject_uevent(&priv->kobj, KOBJ_ADD);
+
+	/* kernel_init waits for these before freeing init memory */
+	if (drv->bus->p->drivers_autoprobe && drv->probe_async &&
+	    system_state == SYSTEM_BOOTING) {
+		priv->attach_cookie = async_schedule(driver_attach_async, drv);
+		priv->attach_queued = true;
+	}
 	return 0;
 
 out_unregister:
@@ -724,6 +762,8 @@ void bus_remove_driver(struct device_driver *drv)
 	if (!drv->bus)
 		return;
 
+	if (drv->p->attach_queued)
+		async_synchronize_cookie(drv->p->attach_cookie + 1);
 	if (!drv->suppress_bind_attrs)
 		remove_bind_files(drv);
 	driver_remove_attrs(drv->bus, drv);
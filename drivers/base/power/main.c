@@ -22,6 +22,7 @@
 #include <linux/mutex.h>
 #include <linux/pm.h>
 #include <linux/pm_runtime.h>
+#include <linux/pm_timeline.h>
 #include <linux/resume-trace.h>
 #include <linux/rwsem.h>
 #include <linux/interrupt.h>
@@ -410,6 +411,7 @@ EXPORT_SYMBOL_GPL(dpm_resume_noirq);
 static int device_resume(struct device *dev, pm_message_t state)
 {
 	int error = 0;
+	u64 start = pm_timeline_clock();
 
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
@@ -452,6 +454,7 @@ static int device_resume(struct device *dev, pm_message_t state)
  End:
 	up(&dev->sem);
 
+	pm_timeline_span(dev_name(dev), start);
 	TRACE_RESUME(error);
 	return error;
 }
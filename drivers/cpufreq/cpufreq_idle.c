@@ -0,0 +1,107 @@
+/*
+ * drivers/cpufreq/cpufreq_idle.c
+ *
+ * Shared pm_idle hook for cpufreq governors that sample around idle.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * Governors used to swap pm_idle themselves and put back whatever they
+ * found on stop, which breaks as soon as two of them are stacked or
+ * switched in a different order.  Here pm_idle is taken over once, while
+ * at least one notifier is registered, and restored on the last
+ * unregister.
+ */
+
+#include <linux/cpufreq.h>
+#include <linux/list.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+
+static void (*pm_idle_old)(void);
+static LIST_HEAD(idle_notifiers);
+static DEFINE_SPINLOCK(idle_notifier_lock);
+
+static void cpufreq_idle(void)
+{
+	struct cpufreq_idle_notifier *n;
+	unsigned int cpu = smp_processor_id();
+	unsigned long flags;
+
+	/* irqs are off here, the old hook turns them back on */
+	spin_lock(&idle_notifier_lock);
+	list_for_each_entry(n, &idle_notifiers, list)
+		if (n->idle_enter && cpumask_test_cpu(cpu, n->cpus))
+			n->idle_enter(n, cpu);
+	spin_unlock(&idle_notifier_lock);
+
+	pm_idle_old();
+
+	spin_lock_irqsave(&idle_notifier_lock, flags);
+	list_for_each_entry(n, &idle_notifiers, list)
+		if (n->idle_exit && cpumask_test_cpu(cpu, n->cpus))
+			n->idle_exit(n, cpu);
+	spin_unlock_irqrestore(&idle_notifier_lock, flags);
+}
+
+/**
+ * cpufreq_register_idle_notifier - hook a governor into the idle loop
+ * @n: notifier, with @cpus and the callbacks filled in
+ * Context: process
+ */
+void cpufreq_register_idle_notifier(struct cpufreq_idle_notifier *n)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&idle_notifier_lock, flags);
+	if (list_empty(&idle_notifiers)) {
+		pm_idle_old = pm_idle;
+		pm_idle = cpufreq_idle;
+	}
+	list_add_tail(&n->list, &idle_notifiers);
+	spin_unlock_irqrestore(&idle_notifier_lock, flags);
+}
+EXPORT_SYMBOL_GPL(cpufreq_register_idle_notifier);
+
+/**
+ * cpufreq_unregister_idle_notifier - undo cpufreq_register_idle_notifier
+ * @n: the notifier
+ * Context: process
+ *
+ * On return no cpu is running @n's callbacks any more; the idle loop
+ * holds the lock across them.
+ */
+void cpufreq_unregister_idle_notifier(struct cpufreq_idle_notifier *n)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&idle_notifier_lock, flags);
+	list_del(&n->list);
+	if (list_empty(&idle_notifiers))
+		pm_idle = pm_idle_old;
+	spin_unlock_irqrestore(&idle_notifier_lock, flags);
+}
+EXPORT_SYMBOL_GPL(cpufreq_unregister_idle_notifier);
+
+/**
+ * cpufreq_idle_skip_sample - may the governor skip arming its timer?
+ * @policy: the policy the idle cpu belongs to
+ * Context: idle_exit callback
+ *
+ * At policy->min there's nothing to ramp down to, and a cpu that only
+ * woke to service an interrupt is about to idle again.  A sample then
+ * is wasted work on every WFI; the next wakeup with something to run
+ * arms the timer soon enough to catch rising load.
+ */
+bool cpufreq_idle_skip_sample(struct cpufreq_policy *policy)
+{
+	return policy->cur == policy->min && !need_resched();
+}
+EXPORT_SYMBOL_GPL(cpufreq_idle_skip_sample);
@@ -19,15 +19,17 @@
 #include <linux/cpu.h>
 #include <linux/cpumask.h>
 #include <linux/cpufreq.h>
+#include <linux/input.h>
 #include <linux/mutex.h>
 #include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/tick.h>
 #include <linux/timer.h>
 #include <linux/workqueue.h>
 
 #include <asm/cputime.h>
 
-static void (*pm_idle_old)(void);
 static atomic_t active_count = ATOMIC_INIT(0);
 
 static DEFINE_PER_CPU(struct timer_list, cpu_timer);
@@ -36,6 +38,7 @@ static DEFINE_PER_CPU(u64, time_in_idle);
 static DEFINE_PER_CPU(u64, idle_exit_time);
 
 static struct cpufreq_policy *policy;
+static struct cpufreq_frequency_table *freq_table;
 static unsigned int target_freq;
 
 /* Workqueues handle frequency scaling */
@@ -44,7 +47,6 @@ static struct workqueue_struct *down_wq;
 static struct work_struct freq_scale_work;
 
 static u64 freq_change_time;
-static u64 freq_change_time_in_idle;
 
 static cpumask_t work_cpumask;
 
@@ -55,6 +57,50 @@ static cpumask_t work_cpumask;
 #define DEFAULT_MIN_SAMPLE_TIME 45000;
 static unsigned long min_sample_time;
 
+/*
+ * Frequency to jump to when load crosses go_hispeed_load or an input
+ * boost is active; 0 means policy->max.
+ */
+static unsigned long hispeed_freq;
+
+#define DEFAULT_GO_HISPEED_LOAD 85
+static unsigned long go_hispeed_load;
+
+/*
+ * Time to stay at or above hispeed_freq before stepping further up, in
+ * usecs.  Keeps short bursts from reaching the top, power hungry steps.
+ */
+#define DEFAULT_ABOVE_HISPEED_DELAY 20000
+static unsigned long above_hispeed_delay;
+static u64 hispeed_validate_time;
+
+/*
+ * Target cpu load per frequency: { load, freq, load, freq, ..., load }.
+ * Each load applies from the frequency before it up to the next one.
+ * The lowest frequency keeping the load under its target is chosen.
+ */
+#define DEFAULT_TARGET_LOAD 90
+static unsigned int default_target_loads[] = {DEFAULT_TARGET_LOAD};
+static unsigned int *target_loads = default_target_loads;
+static int ntarget_loads = ARRAY_SIZE(default_target_loads);
+static DEFINE_SPINLOCK(target_loads_lock);
+
+/* Input boost: hold at least hispeed_freq this long after an event. */
+#define DEFAULT_BOOSTPULSE_DURATION 80000
+static unsigned long boostpulse_duration;
+static u64 boostpulse_endtime;
+static unsigned long input_boost = 1;
+static bool input_registered;
+
+/*
+ * Scheduler load hint: when a second task becomes runnable on a cpu below
+ * hispeed_freq, resample on the next tick instead of waiting for the timer
+ * and treat the window as at least go_hispeed_load.
+ */
+static unsigned long sched_hint = 1;
+static bool sched_hint_registered;
+static DEFINE_PER_CPU(int, sched_kick);
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event);
 
@@ -68,13 +114,90 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+static unsigned int freq_to_targetload(unsigned int freq)
+{
+	unsigned long flags;
+	unsigned int ret;
+	int i;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	for (i = 0; i < ntarget_loads - 1 && freq >= target_loads[i + 1];
+	     i += 2)
+		;
+	ret = target_loads[i];
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return ret;
+}
+
+/*
+ * Choose the cpu frequency based off the load: the lowest table frequency
+ * whose target load the current work would not exceed.  The target load
+ * depends on the frequency picked, so repeat a few times until it settles.
+ */
+static unsigned int cpufreq_interactive_calc_freq(unsigned int cpu_load)
+{
+	unsigned int loadadjfreq = policy->cur * cpu_load;
+	unsigned int freq = policy->cur;
+	unsigned int prevfreq;
+	int index;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		prevfreq = freq;
+		freq = loadadjfreq / freq_to_targetload(freq);
+
+		if (!freq_table ||
+		    cpufreq_frequency_table_target(policy, freq_table, freq,
+				CPUFREQ_RELATION_L, &index)) {
+			freq = clamp(freq, policy->min, policy->max);
+			break;
+		}
+
+		freq = freq_table[index].frequency;
+		if (freq == prevfreq)
+			break;
+	}
+
+	return freq;
+}
+
+static unsigned int cpufreq_interactive_pick_freq(unsigned int cpu_load,
+						  u64 now)
+{
+	unsigned int hispeed = hispeed_freq ? hispeed_freq : policy->max;
+	unsigned int new_freq;
+
+	if (hispeed > policy->max)
+		hispeed = policy->max;
+
+	new_freq = cpufreq_interactive_calc_freq(cpu_load);
+
+	if (cpu_load >= go_hispeed_load || now < boostpulse_endtime) {
+		if (policy->cur < hispeed)
+			return hispeed;
+		if (new_freq < hispeed)
+			new_freq = hispeed;
+	}
+
+	/* stay at hispeed_freq a while before stepping any higher */
+	if (new_freq > policy->cur && policy->cur >= hispeed &&
+	    now - hispeed_validate_time < above_hispeed_delay)
+		return policy->cur;
+
+	return new_freq;
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	u64 delta_idle;
+	u64 delta_time;
 	u64 update_time;
 	u64 *cpu_time_in_idle;
 	u64 *cpu_idle_exit_time;
+	unsigned int cpu_load;
+	unsigned int new_freq;
 	struct timer_list *t;
+	int kicked = per_cpu(sched_kick, data);
 
 	u64 now_idle = get_cpu_idle_time_us(data,
 						&update_time);
@@ -83,24 +206,21 @@ static void cpufreq_interactive_timer(unsigned long data)
 	cpu_time_in_idle = &per_cpu(time_in_idle, data);
 	cpu_idle_exit_time = &per_cpu(idle_exit_time, data);
 
-	if (update_time == *cpu_idle_exit_time)
+	per_cpu(sched_kick, data) = 0;
+	if (update_time == *cpu_idle_exit_time && !kicked)
 		return;
 
 	delta_idle = cputime64_sub(now_idle, *cpu_time_in_idle);
+	delta_time = cputime64_sub(update_time, *cpu_idle_exit_time);
 
-	/* Scale up if there were no idle cycles since coming out of idle */
-	if (delta_idle == 0) {
-		if (policy->cur == policy->max)
-			return;
-
-		if (nr_running() < 1)
-			return;
-
-		target_freq = policy->max;
-		cpumask_set_cpu(data, &work_cpumask);
-		queue_work(up_wq, &freq_scale_work);
-		return;
-	}
+	/* load over the window since this cpu came out of idle */
+	if (delta_idle >= delta_time)
+		cpu_load = 0;
+	else
+		cpu_load = 100 * (unsigned int) (delta_time - delta_idle) /
+			(unsigned int) delta_time;
+	if (kicked && cpu_load < go_hispeed_load)
+		cpu_load = go_hispeed_load;
 
 	/*
 	 * There is a window where if the cpu utlization can go from low to high
@@ -116,95 +236,167 @@ static void cpufreq_interactive_timer(unsigned long data)
 			mod_timer(t, jiffies + 2);
 	}
 
-	if (policy->cur == policy->min)
+	cpufreq_stats_update_load(data, cpu_load);
+	cpufreq_stats_update_request(policy, policy->cur * cpu_load /
+				     freq_to_targetload(policy->cur));
+
+	new_freq = cpufreq_interactive_pick_freq(cpu_load, update_time);
+	if (new_freq == policy->cur)
+		return;
+
+	if (new_freq > policy->cur) {
+		target_freq = new_freq;
+		cpumask_set_cpu(data, &work_cpumask);
+		queue_work(up_wq, &freq_scale_work);
 		return;
+	}
 
 	/*
 	 * Do not scale down unless we have been at this frequency for the
-	 * minimum sample time.
+	 * minimum sample time, nor below hispeed_freq while boosted.
 	 */
 	if (cputime64_sub(update_time, freq_change_time) < min_sample_time)
 		return;
 
-	target_freq = policy->min;
+	target_freq = new_freq;
 	cpumask_set_cpu(data, &work_cpumask);
 	queue_work(down_wq, &freq_scale_work);
 }
 
-static void cpufreq_idle(void)
+static void cpufreq_interactive_idle_exit(struct cpufreq_idle_notifier *n,
+					  unsigned int cpu)
 {
 	struct timer_list *t;
 	u64 *cpu_time_in_idle;
 	u64 *cpu_idle_exit_time;
 
-	pm_idle_old();
-
-	if (!cpumask_test_cpu(smp_processor_id(), policy->cpus))
-			return;
-
 	/* Timer to fire in 1-2 ticks, jiffie aligned. */
-	t = &per_cpu(cpu_timer, smp_processor_id());
-	cpu_idle_exit_time = &per_cpu(idle_exit_time, smp_processor_id());
-	cpu_time_in_idle = &per_cpu(time_in_idle, smp_processor_id());
+	t = &per_cpu(cpu_timer, cpu);
+	cpu_idle_exit_time = &per_cpu(idle_exit_time, cpu);
+	cpu_time_in_idle = &per_cpu(time_in_idle, cpu);
 
-	if (timer_pending(t) == 0) {
+	if (timer_pending(t) == 0 && !cpufreq_idle_skip_sample(policy)) {
 		*cpu_time_in_idle = get_cpu_idle_time_us(
-				smp_processor_id(), cpu_idle_exit_time);
+				cpu, cpu_idle_exit_time);
 		mod_timer(t, jiffies + 2);
 	}
 }
 
+static struct cpufreq_idle_notifier interactive_idle_notifier = {
+	.idle_exit = cpufreq_interactive_idle_exit,
+};
+
+/* We use the same work function to sale up and down */
+static void cpufreq_interactive_freq_change_time_work(struct work_struct *work)
+{
+	unsigned int cpu;
+	unsigned int old_freq;
+	unsigned int hispeed;
+	cpumask_t tmp_mask = work_cpumask;
+	for_each_cpu(cpu, tmp_mask) {
+		old_freq = policy->cur;
+		__cpufreq_driver_target(policy, target_freq,
+						CPUFREQ_RELATION_L);
+		get_cpu_idle_time_us(cpu, &freq_change_time);
+
+		hispeed = hispeed_freq ? hispeed_freq : policy->max;
+		if (policy->cur > old_freq && policy->cur >= hispeed)
+			hispeed_validate_time = freq_change_time;
+
+		cpumask_clear_cpu(cpu, &work_cpumask);
+	}
+
+
+}
+
 /*
- * Choose the cpu frequency based off the load. For now choose the minimum
- * frequency that will satisfy the load, which is not always the lower power.
+ * Raise the floor to hispeed_freq for boostpulse_duration; called for
+ * touch input and from the boostpulse attribute.
  */
-static unsigned int cpufreq_interactive_calc_freq(unsigned int cpu)
+static void cpufreq_interactive_boost(void)
 {
-	unsigned int delta_time;
-	unsigned int idle_time;
-	unsigned int cpu_load;
-	u64 current_wall_time;
-	u64 current_idle_time;;
+	unsigned int hispeed;
 
-	current_idle_time = get_cpu_idle_time_us(cpu, &current_wall_time);
+	if (!policy)
+		return;
 
-	idle_time = (unsigned int) current_idle_time - freq_change_time_in_idle;
-	delta_time = (unsigned int) current_wall_time - freq_change_time;
+	boostpulse_endtime = ktime_to_us(ktime_get()) + boostpulse_duration;
 
-	cpu_load = 100 * (delta_time - idle_time) / delta_time;
+	hispeed = hispeed_freq ? hispeed_freq : policy->max;
+	if (hispeed > policy->max)
+		hispeed = policy->max;
+	if (policy->cur >= hispeed)
+		return;
 
-	return policy->cur * cpu_load / 100;
+	target_freq = hispeed;
+	cpumask_set_cpu(policy->cpu, &work_cpumask);
+	queue_work(up_wq, &freq_scale_work);
 }
 
+static void cpufreq_interactive_input_event(struct input_handle *handle,
+		unsigned int type, unsigned int code, int value)
+{
+	if (input_boost && type == EV_SYN && code == SYN_REPORT)
+		cpufreq_interactive_boost();
+}
 
-/* We use the same work function to sale up and down */
-static void cpufreq_interactive_freq_change_time_work(struct work_struct *work)
+static int cpufreq_interactive_input_connect(struct input_handler *handler,
+		struct input_dev *dev, const struct input_device_id *id)
 {
-	unsigned int cpu;
-	cpumask_t tmp_mask = work_cpumask;
-	for_each_cpu(cpu, tmp_mask) {
-		if (target_freq == policy->max) {
-			if (nr_running() == 1) {
-				cpumask_clear_cpu(cpu, &work_cpumask);
-				return;
-			}
-
-			__cpufreq_driver_target(policy, target_freq,
-					CPUFREQ_RELATION_H);
-		} else {
-			target_freq = cpufreq_interactive_calc_freq(cpu);
-			__cpufreq_driver_target(policy, target_freq,
-							CPUFREQ_RELATION_L);
-		}
-		freq_change_time_in_idle = get_cpu_idle_time_us(cpu,
-							&freq_change_time);
+	struct input_handle *handle;
+	int error;
 
-		cpumask_clear_cpu(cpu, &work_cpumask);
-	}
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
 
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
 
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free_handle;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister_handle;
+
+	return 0;
+
+err_unregister_handle:
+	input_unregister_handle(handle);
+err_free_handle:
+	kfree(handle);
+	return error;
 }
 
+static void cpufreq_interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+/* touchscreens: absolute axes plus BTN_TOUCH */
+static const struct input_device_id cpufreq_interactive_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_KEYBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+	},
+	{ },
+};
+
+static struct input_handler cpufreq_interactive_input_handler = {
+	.event		= cpufreq_interactive_input_event,
+	.connect	= cpufreq_interactive_input_connect,
+	.disconnect	= cpufreq_interactive_input_disconnect,
+	.name		= "cpufreq_interactive",
+	.id_table	= cpufreq_interactive_ids,
+};
+
 static ssize_t show_min_sample_time(struct kobject *kobj,
 				struct attribute *attr, char *buf)
 {
@@ -214,14 +406,130 @@ static ssize_t show_min_sample_time(struct kobject *kobj,
 static ssize_t store_min_sample_time(struct kobject *kobj,
 			struct attribute *attr, const char *buf, size_t count)
 {
-	return strict_strtoul(buf, 0, &min_sample_time);
+	int ret = strict_strtoul(buf, 0, &min_sample_time);
+	return ret ? ret : count;
 }
 
 static struct global_attr min_sample_time_attr = __ATTR(min_sample_time, 0644,
 		show_min_sample_time, store_min_sample_time);
 
+#define interactive_ulong_attr(name)					\
+static ssize_t show_##name(struct kobject *kobj,			\
+				struct attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%lu\n", name);				\
+}									\
+									\
+static ssize_t store_##name(struct kobject *kobj,			\
+			struct attribute *attr, const char *buf, size_t count) \
+{									\
+	unsigned long val;						\
+	int ret = strict_strtoul(buf, 0, &val);				\
+	if (ret)							\
+		return ret;						\
+	name = val;							\
+	return count;							\
+}									\
+									\
+static struct global_attr name##_attr = __ATTR(name, 0644,		\
+		show_##name, store_##name)
+
+interactive_ulong_attr(hispeed_freq);
+interactive_ulong_attr(go_hispeed_load);
+interactive_ulong_attr(above_hispeed_delay);
+interactive_ulong_attr(boostpulse_duration);
+interactive_ulong_attr(input_boost);
+interactive_ulong_attr(sched_hint);
+
+static ssize_t show_target_loads(struct kobject *kobj,
+				struct attribute *attr, char *buf)
+{
+	unsigned long flags;
+	ssize_t ret = 0;
+	int i;
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	for (i = 0; i < ntarget_loads; i++)
+		ret += sprintf(buf + ret, "%u%s", target_loads[i],
+			       i & 1 ? ":" : " ");
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+
+	buf[ret - 1] = '\n';
+	return ret;
+}
+
+/* "load" or "load freq:load freq:load ..." with ascending frequencies */
+static ssize_t store_target_loads(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	const char *cp = buf;
+	unsigned int *new_loads;
+	unsigned long flags;
+	int ntokens = 1;
+	int i;
+
+	while ((cp = strpbrk(cp + 1, " :")))
+		ntokens++;
+
+	if (!(ntokens & 1))
+		return -EINVAL;
+
+	new_loads = kmalloc(ntokens * sizeof(unsigned int), GFP_KERNEL);
+	if (!new_loads)
+		return -ENOMEM;
+
+	cp = buf;
+	for (i = 0; i < ntokens; i++) {
+		if (sscanf(cp, "%u", &new_loads[i]) != 1 ||
+		    (!(i & 1) && (!new_loads[i] || new_loads[i] > 100)) ||
+		    (i > 1 && (i & 1) && new_loads[i] <= new_loads[i - 2])) {
+			kfree(new_loads);
+			return -EINVAL;
+		}
+
+		cp = strpbrk(cp, " :");
+		if (!cp)
+			break;
+		cp++;
+	}
+
+	if (i != ntokens - 1) {
+		kfree(new_loads);
+		return -EINVAL;
+	}
+
+	spin_lock_irqsave(&target_loads_lock, flags);
+	if (target_loads != default_target_loads)
+		kfree(target_loads);
+	target_loads = new_loads;
+	ntarget_loads = ntokens;
+	spin_unlock_irqrestore(&target_loads_lock, flags);
+	return count;
+}
+
+static struct global_attr target_loads_attr = __ATTR(target_loads, 0644,
+		show_target_loads, store_target_loads);
+
+static ssize_t store_boostpulse(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	cpufreq_interactive_boost();
+	return count;
+}
+
+static struct global_attr boostpulse_attr = __ATTR(boostpulse, 0200,
+		NULL, store_boostpulse);
+
 static struct attribute *interactive_attributes[] = {
 	&min_sample_time_attr.attr,
+	&hispeed_freq_attr.attr,
+	&go_hispeed_load_attr.attr,
+	&above_hispeed_delay_attr.attr,
+	&target_loads_attr.attr,
+	&boostpulse_attr.attr,
+	&boostpulse_duration_attr.attr,
+	&input_boost_attr.attr,
+	&sched_hint_attr.attr,
 	NULL,
 };
 
@@ -230,6 +538,30 @@ static struct attribute_group interactive_attr_group = {
 	.name = "interactive",
 };
 
+/*
+ * Called by the scheduler with the runqueue lock held, so the ramp cannot
+ * be queued from here; pull the sample timer in to the next tick instead.
+ */
+static void cpufreq_interactive_sched_load(int cpu, unsigned long nr_running,
+					   unsigned long load_weight)
+{
+	unsigned int hispeed;
+
+	if (!sched_hint || nr_running < 2 || per_cpu(sched_kick, cpu))
+		return;
+
+	/* the timer is per cpu; leave remote wakeups to its own sampling */
+	if (cpu != smp_processor_id())
+		return;
+
+	hispeed = hispeed_freq ? hispeed_freq : policy->max;
+	if (policy->cur >= min(hispeed, policy->max))
+		return;
+
+	per_cpu(sched_kick, cpu) = 1;
+	mod_timer(&per_cpu(cpu_timer, cpu), jiffies);
+}
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		unsigned int event)
 {
@@ -240,7 +572,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 			return -EINVAL;
 
 		/*
-		 * Do not register the idle hook and create sysfs
+		 * Do not register the idle notifier and create sysfs
 		 * entries if we have already done so.
 		 */
 		if (atomic_inc_return(&active_count) > 1)
@@ -251,9 +583,18 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		if (rc)
 			return rc;
 
-		pm_idle_old = pm_idle;
-		pm_idle = cpufreq_idle;
+		freq_table = cpufreq_frequency_get_table(new_policy->cpu);
 		policy = new_policy;
+		interactive_idle_notifier.cpus = new_policy->cpus;
+		cpufreq_register_idle_notifier(&interactive_idle_notifier);
+
+		input_registered = !input_register_handler(
+				&cpufreq_interactive_input_handler);
+		if (!input_registered)
+			pr_warning("interactive: no input boost\n");
+
+		sched_hint_registered = !sched_register_load_hook(
+				cpufreq_interactive_sched_load);
 		break;
 
 	case CPUFREQ_GOV_STOP:
@@ -263,7 +604,15 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *new_policy,
 		sysfs_remove_group(cpufreq_global_kobject,
 				&interactive_attr_group);
 
-		pm_idle = pm_idle_old;
+		if (input_registered)
+			input_unregister_handler(
+				&cpufreq_interactive_input_handler);
+		input_registered = false;
+		if (sched_hint_registered)
+			sched_unregister_load_hook(
+				cpufreq_interactive_sched_load);
+		sched_hint_registered = false;
+		cpufreq_unregister_idle_notifier(&interactive_idle_notifier);
 		del_timer(&per_cpu(cpu_timer, new_policy->cpu));
 			break;
 
@@ -284,6 +633,9 @@ static int __init cpufreq_interactive_init(void)
 	unsigned int i;
 	struct timer_list *t;
 	min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
+	go_hispeed_load = DEFAULT_GO_HISPEED_LOAD;
+	above_hispeed_delay = DEFAULT_ABOVE_HISPEED_DELAY;
+	boostpulse_duration = DEFAULT_BOOSTPULSE_DURATION;
 
 	/* Initalize per-cpu timers */
 	for_each_possible_cpu(i) {
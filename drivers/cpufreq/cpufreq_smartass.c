@@ -34,12 +34,12 @@
 #include <asm/cputime.h>
 #include <linux/earlysuspend.h>
 
-static void (*pm_idle_old)(void);
 static atomic_t active_count = ATOMIC_INIT(0);
 
 struct smartass_info_s {
         struct cpufreq_policy *cur_policy;
         struct timer_list timer;
+        struct cpufreq_idle_notifier idle_notifier;
         u64 time_in_idle;
         u64 idle_exit_time;
         u64 freq_change_time;
@@ -219,6 +219,7 @@ static void cpufreq_smartass_timer(unsigned long data)
                 printk(KERN_INFO "smartassT @ %d: load %d (delta_time %llu)\n",policy->cur,cpu_load,delta_time);
 
         this_smartass->cur_cpu_load = cpu_load;
+        cpufreq_stats_update_load(data, cpu_load);
 
         // Scale up if load is above max or if there where no idle cycles since coming out of idle.
         if (cpu_load > max_cpu_load || delta_idle == 0) {
@@ -262,23 +263,28 @@ static void cpufreq_smartass_timer(unsigned long data)
         queue_work(down_wq, &freq_scale_work);
 }
 
-static void cpufreq_idle(void)
+static void cpufreq_smartass_idle_enter(struct cpufreq_idle_notifier *n, unsigned int cpu)
 {
-        struct smartass_info_s *this_smartass = &per_cpu(smartass_info, smp_processor_id());
+        struct smartass_info_s *this_smartass = container_of(n, struct smartass_info_s, idle_notifier);
         struct cpufreq_policy *policy = this_smartass->cur_policy;
 
-        if (!this_smartass->enable) {
-                pm_idle_old();
+        if (!this_smartass->enable)
                 return;
-        }
 
         if (policy->cur == this_smartass->min_speed && timer_pending(&this_smartass->timer))
                 del_timer(&this_smartass->timer);
+}
 
-        pm_idle_old();
+static void cpufreq_smartass_idle_exit(struct cpufreq_idle_notifier *n, unsigned int cpu)
+{
+        struct smartass_info_s *this_smartass = container_of(n, struct smartass_info_s, idle_notifier);
 
-        if (!timer_pending(&this_smartass->timer))
-                reset_timer(smp_processor_id(), this_smartass);
+        if (!this_smartass->enable)
+                return;
+
+        if (!timer_pending(&this_smartass->timer) &&
+            !cpufreq_idle_skip_sample(this_smartass->cur_policy))
+                reset_timer(cpu, this_smartass);
 }
 
 /* We use the same work function to sale up and down */
@@ -322,6 +328,7 @@ static void cpufreq_smartass_freq_change_time_work(struct work_struct *work)
                 }
                 else new_freq = policy->cur;
 
+                cpufreq_stats_update_request(policy, new_freq);
                 new_freq = validate_freq(this_smartass,new_freq);
 
                 if (new_freq != policy->cur) {
@@ -588,19 +595,19 @@ static int cpufreq_governor_smartass(struct cpufreq_policy *new_policy,
                         return -EINVAL;
 
                 /*
-                 * Do not register the idle hook and create sysfs
-                 * entries if we have already done so.
+                 * Do not create sysfs entries if we have already
+                 * done so.
                  */
                 if (atomic_inc_return(&active_count) <= 1) {
                         rc = sysfs_create_group(&new_policy->kobj, &smartass_attr_group);
                         if (rc)
                                 return rc;
-                        pm_idle_old = pm_idle;
-                        pm_idle = cpufreq_idle;
                 }
 
                 this_smartass->cur_policy = new_policy;
                 this_smartass->enable = 1;
+                this_smartass->idle_notifier.cpus = new_policy->cpus;
+                cpufreq_register_idle_notifier(&this_smartass->idle_notifier);
 
                 // notice no break here!
 
@@ -614,6 +621,7 @@ static int cpufreq_governor_smartass(struct cpufreq_policy *new_policy,
                 break;
 
         case CPUFREQ_GOV_STOP:
+                cpufreq_unregister_idle_notifier(&this_smartass->idle_notifier);
                 del_timer(&this_smartass->timer);
                 this_smartass->enable = 0;
 
@@ -621,8 +629,6 @@ static int cpufreq_governor_smartass(struct cpufreq_policy *new_policy,
                         return 0;
                 sysfs_remove_group(&new_policy->kobj,
                                 &smartass_attr_group);
-
-                pm_idle = pm_idle_old;
                 break;
         }
 
@@ -712,6 +718,8 @@ static int __init cpufreq_smartass_init(void)
                 this_smartass->freq_change_time_in_idle = 0;
                 this_smartass->cur_cpu_load = 0;
                 // intialize timer:
+                this_smartass->idle_notifier.idle_enter = cpufreq_smartass_idle_enter;
+                this_smartass->idle_notifier.idle_exit = cpufreq_smartass_idle_exit;
                 init_timer_deferrable(&this_smartass->timer);
                 this_smartass->timer.function = cpufreq_smartass_timer;
                 this_smartass->timer.data = i;
@@ -23,6 +23,26 @@
 
 static spinlock_t cpufreq_stats_lock;
 
+/*
+ * Governor and driver side counters (load at each decision, transition
+ * latency, limit overrides) are fed from timers and the clock driver, so
+ * they get their own irq-safe lock rather than cpufreq_stats_lock.
+ */
+static DEFINE_SPINLOCK(cpufreq_stats_gov_lock);
+
+#define LOAD_BUCKETS		10	/* 0-9%, ..., 90-100% */
+
+/* transition latency buckets, upper bounds in usecs */
+static const unsigned int latency_bounds[] = {
+	25, 50, 100, 200, 500, 1000, 2000, 5000, UINT_MAX,
+};
+#define LATENCY_BUCKETS		ARRAY_SIZE(latency_bounds)
+
+static const char * const latency_names[CPUFREQ_STATS_LATENCY_NR] = {
+	[CPUFREQ_STATS_LATENCY_CLOCK]	= "clock",
+	[CPUFREQ_STATS_LATENCY_VDD]	= "vdd",
+};
+
 #define CPUFREQ_STATDEVICE_ATTR(_name, _mode, _show) \
 static struct freq_attr _attr_##_name = {\
 	.attr = {.name = __stringify(_name), .mode = _mode, }, \
@@ -41,6 +61,13 @@ struct cpufreq_stats {
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	unsigned int *trans_table;
 #endif
+	unsigned int *load_table;
+	unsigned int latency[CPUFREQ_STATS_LATENCY_NR][LATENCY_BUCKETS];
+	unsigned int latency_max[CPUFREQ_STATS_LATENCY_NR];
+	unsigned long long latency_total[CPUFREQ_STATS_LATENCY_NR];
+	unsigned int requests;
+	unsigned int floor_overrides;
+	unsigned int ceiling_overrides;
 };
 
 static DEFINE_PER_CPU(struct cpufreq_stats *, cpufreq_stats_table);
@@ -139,8 +166,82 @@ static ssize_t show_trans_table(struct cpufreq_policy *policy, char *buf)
 CPUFREQ_STATDEVICE_ATTR(trans_table, 0444, show_trans_table);
 #endif
 
+static ssize_t show_load_table(struct cpufreq_policy *policy, char *buf)
+{
+	ssize_t len = 0;
+	int i, j;
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat)
+		return 0;
+
+	len += snprintf(buf + len, PAGE_SIZE - len, "%9s:", "load %");
+	for (j = 0; j < LOAD_BUCKETS; j++)
+		len += snprintf(buf + len, PAGE_SIZE - len, " %7d", j * 10);
+	len += snprintf(buf + len, PAGE_SIZE - len, "\n");
+
+	for (i = 0; i < stat->state_num; i++) {
+		if (len >= PAGE_SIZE)
+			break;
+		len += snprintf(buf + len, PAGE_SIZE - len, "%9u:",
+				stat->freq_table[i]);
+		for (j = 0; j < LOAD_BUCKETS; j++)
+			len += snprintf(buf + len, PAGE_SIZE - len, " %7u",
+				stat->load_table[i * LOAD_BUCKETS + j]);
+		len += snprintf(buf + len, PAGE_SIZE - len, "\n");
+	}
+	if (len >= PAGE_SIZE)
+		return PAGE_SIZE;
+	return len;
+}
+
+static ssize_t show_transition_latency(struct cpufreq_policy *policy,
+		char *buf)
+{
+	ssize_t len = 0;
+	int i, j;
+	unsigned int count;
+	unsigned long long avg;
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat)
+		return 0;
+
+	len += sprintf(buf + len, "%6s:", "usecs");
+	for (j = 0; j < LATENCY_BUCKETS - 1; j++)
+		len += sprintf(buf + len, " <%-6u", latency_bounds[j]);
+	len += sprintf(buf + len, " >=%-5u    max    avg\n",
+			latency_bounds[LATENCY_BUCKETS - 2]);
+
+	for (i = 0; i < CPUFREQ_STATS_LATENCY_NR; i++) {
+		count = 0;
+		len += sprintf(buf + len, "%6s:", latency_names[i]);
+		for (j = 0; j < LATENCY_BUCKETS; j++) {
+			len += sprintf(buf + len, " %7u", stat->latency[i][j]);
+			count += stat->latency[i][j];
+		}
+		avg = stat->latency_total[i];
+		if (count)
+			do_div(avg, count);
+		len += sprintf(buf + len, " %6u %6llu\n", stat->latency_max[i],
+				avg);
+	}
+	return len;
+}
+
+static ssize_t show_limit_overrides(struct cpufreq_policy *policy, char *buf)
+{
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	if (!stat)
+		return 0;
+	return sprintf(buf, "requests %u\nfloor %u\nceiling %u\n",
+			stat->requests, stat->floor_overrides,
+			stat->ceiling_overrides);
+}
+
 CPUFREQ_STATDEVICE_ATTR(total_trans, 0444, show_total_trans);
 CPUFREQ_STATDEVICE_ATTR(time_in_state, 0444, show_time_in_state);
+CPUFREQ_STATDEVICE_ATTR(load_table, 0444, show_load_table);
+CPUFREQ_STATDEVICE_ATTR(transition_latency, 0444, show_transition_latency);
+CPUFREQ_STATDEVICE_ATTR(limit_overrides, 0444, show_limit_overrides);
 
 static struct attribute *default_attrs[] = {
 	&_attr_total_trans.attr,
@@ -148,6 +249,9 @@ static struct attribute *default_attrs[] = {
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	&_attr_trans_table.attr,
 #endif
+	&_attr_load_table.attr,
+	&_attr_transition_latency.attr,
+	&_attr_limit_overrides.attr,
 	NULL
 };
 static struct attribute_group stats_attr_group = {
@@ -214,6 +318,7 @@ static int cpufreq_stats_create_table(struct cpufreq_policy *policy,
 	}
 
 	alloc_size = count * sizeof(int) + count * sizeof(cputime64_t);
+	alloc_size += count * LOAD_BUCKETS * sizeof(int);
 
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	alloc_size += count * count * sizeof(int);
@@ -226,8 +331,9 @@ static int cpufreq_stats_create_table(struct cpufreq_policy *policy,
 	}
 	stat->freq_table = (unsigned int *)(stat->time_in_state + count);
 
+	stat->load_table = stat->freq_table + count;
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
-	stat->trans_table = stat->freq_table + count;
+	stat->trans_table = stat->load_table + count * LOAD_BUCKETS;
 #endif
 	j = 0;
 	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
@@ -304,6 +410,84 @@ static int cpufreq_stat_notifier_trans(struct notifier_block *nb,
 	return 0;
 }
 
+/**
+ * cpufreq_stats_update_load - note the load a governor decided on
+ * @cpu: the cpu sampled
+ * @load: its load in percent over the governor's sample window
+ *
+ * Binned by the frequency the cpu was running at, which gives
+ * time-in-state by load for tuning governor thresholds and rates.
+ */
+void cpufreq_stats_update_load(unsigned int cpu, unsigned int load)
+{
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, cpu);
+	unsigned long flags;
+	unsigned int bucket = min_t(unsigned int, load / 10, LOAD_BUCKETS - 1);
+
+	if (!stat || stat->last_index >= stat->state_num)
+		return;
+
+	spin_lock_irqsave(&cpufreq_stats_gov_lock, flags);
+	stat->load_table[stat->last_index * LOAD_BUCKETS + bucket]++;
+	spin_unlock_irqrestore(&cpufreq_stats_gov_lock, flags);
+}
+EXPORT_SYMBOL_GPL(cpufreq_stats_update_load);
+
+/**
+ * cpufreq_stats_update_request - note the frequency a governor wanted
+ * @policy: the governed policy
+ * @freq: the governor's choice before policy limits are applied
+ *
+ * Counts the times a raised policy->min (perflock, userspace floors)
+ * or a lowered policy->max overrode what the governor asked for.
+ */
+void cpufreq_stats_update_request(struct cpufreq_policy *policy,
+		unsigned int freq)
+{
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, policy->cpu);
+	unsigned long flags;
+
+	if (!stat)
+		return;
+
+	spin_lock_irqsave(&cpufreq_stats_gov_lock, flags);
+	stat->requests++;
+	if (freq < policy->min && policy->min > policy->cpuinfo.min_freq)
+		stat->floor_overrides++;
+	else if (freq > policy->max && policy->max < policy->cpuinfo.max_freq)
+		stat->ceiling_overrides++;
+	spin_unlock_irqrestore(&cpufreq_stats_gov_lock, flags);
+}
+EXPORT_SYMBOL_GPL(cpufreq_stats_update_request);
+
+/**
+ * cpufreq_stats_update_latency - note how long part of a transition took
+ * @cpu: the cpu whose clock changed
+ * @phase: CPUFREQ_STATS_LATENCY_CLOCK or CPUFREQ_STATS_LATENCY_VDD
+ * @usecs: time spent
+ */
+void cpufreq_stats_update_latency(unsigned int cpu, unsigned int phase,
+		unsigned int usecs)
+{
+	struct cpufreq_stats *stat = per_cpu(cpufreq_stats_table, cpu);
+	unsigned long flags;
+	int i;
+
+	if (!stat || phase >= CPUFREQ_STATS_LATENCY_NR)
+		return;
+
+	for (i = 0; usecs >= latency_bounds[i]; i++)
+		;
+
+	spin_lock_irqsave(&cpufreq_stats_gov_lock, flags);
+	stat->latency[phase][i]++;
+	stat->latency_total[phase] += usecs;
+	if (usecs > stat->latency_max[phase])
+		stat->latency_max[phase] = usecs;
+	spin_unlock_irqrestore(&cpufreq_stats_gov_lock, flags);
+}
+EXPORT_SYMBOL_GPL(cpufreq_stats_update_latency);
+
 static int __cpuinit cpufreq_stat_cpu_callback(struct notifier_block *nfb,
 					       unsigned long action,
 					       void *hcpu)
@@ -24,10 +24,15 @@
 #include <linux/delay.h>
 #include <linux/io.h>
 #include <linux/wakelock.h>
+#include <linux/ktime.h>
 #include <mach/system.h>
 
 #define DEBUG 0
 
+/* controller events serviced per interrupt before giving up the cpu */
+#define MSM_I2C_BURST 4
+#define MSM_I2C_HIST_BUCKETS 8
+
 enum {
 	I2C_WRITE_DATA          = 0x00,
 	I2C_CLK_CTL             = 0x04,
@@ -80,6 +85,19 @@ struct msm_i2c_dev {
 	int                 clk_drv_str;
 	int                 dat_drv_str;
 	int                 skip_recover;
+
+	/* transfer statistics, see xfer_stats */
+	unsigned            xfers;
+	unsigned            errors;
+	unsigned            bytes;
+	unsigned            irqs;
+	unsigned            passes;
+	unsigned            hist[MSM_I2C_HIST_BUCKETS];
+};
+
+/* upper bounds in us of the xfer_stats buckets, the last is open */
+static const unsigned msm_i2c_hist_us[MSM_I2C_HIST_BUCKETS - 1] = {
+	100, 250, 500, 1000, 2000, 5000, 10000,
 };
 
 #if DEBUG
@@ -191,7 +209,8 @@ static void msm_i2c_read_buffer(struct msm_i2c_dev *dev)
 	}
 }
 
-static void msm_i2c_interrupt_locked(struct msm_i2c_dev *dev)
+/* returns true once the transfer finished or there is nothing to run */
+static bool msm_i2c_interrupt_locked(struct msm_i2c_dev *dev)
 {
 	uint32_t status	= readl(dev->base + I2C_STATUS);
 	bool not_done = true;
@@ -202,7 +221,7 @@ static void msm_i2c_interrupt_locked(struct msm_i2c_dev *dev)
 	if (!dev->msg) {
 		dev_err(dev->dev,
 			"IRQ but nothing to do!, status %x\n", status);
-		return;
+		return true;
 	}
 	if (status & I2C_STATUS_ERROR_MASK)
 		goto out_err;
@@ -221,22 +240,44 @@ static void msm_i2c_interrupt_locked(struct msm_i2c_dev *dev)
 		} else if (!not_done && !dev->need_flush)
 			goto out_complete;
 	}
-	return;
+	return false;
 
 out_err:
 	dev_err(dev->dev, "error, status %x (%02X)\n", status, dev->msg->addr);
 	dev->ret = -EIO;
 out_complete:
 	complete(dev->complete);
+	return true;
+}
+
+/* can the controller take or give another byte right now */
+static bool msm_i2c_more_work(struct msm_i2c_dev *dev)
+{
+	uint32_t status = readl(dev->base + I2C_STATUS);
+
+	if (status & (I2C_STATUS_ERROR_MASK | I2C_STATUS_RD_BUFFER_FULL))
+		return true;
+	if (status & I2C_STATUS_WR_BUFFER_FULL)
+		return false;
+	return dev->pos < 0 || (!(dev->msg->flags & I2C_M_RD) && dev->cnt);
 }
 
 static irqreturn_t
 msm_i2c_interrupt(int irq, void *devid)
 {
 	struct msm_i2c_dev *dev = devid;
+	int n;
 
 	spin_lock(&dev->lock);
-	msm_i2c_interrupt_locked(dev);
+	dev->irqs++;
+	/* a byte that became ready while we were here is handled in
+	 * the same interrupt rather than costing another one
+	 */
+	for (n = 0; n < MSM_I2C_BURST; n++) {
+		dev->passes++;
+		if (msm_i2c_interrupt_locked(dev) || !msm_i2c_more_work(dev))
+			break;
+	}
 	spin_unlock(&dev->lock);
 
 	return IRQ_HANDLED;
@@ -328,6 +369,67 @@ msm_i2c_recover_bus_busy(struct msm_i2c_dev *dev)
 }
 
 
+static void msm_i2c_account(struct msm_i2c_dev *dev, struct i2c_msg msgs[],
+			    int num, int ret, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	unsigned long flags;
+	int b;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->xfers++;
+	if (ret < 0)
+		dev->errors++;
+	while (num--)
+		dev->bytes += msgs[num].len;
+	for (b = 0; b < MSM_I2C_HIST_BUCKETS - 1; b++)
+		if (us < msm_i2c_hist_us[b])
+			break;
+	dev->hist[b]++;
+	spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+static ssize_t msm_i2c_xfer_stats_show(struct device *device,
+				       struct device_attribute *attr, char *buf)
+{
+	struct msm_i2c_dev *dev = dev_get_drvdata(device);
+	unsigned long flags;
+	int b, n = 0;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	n += sprintf(buf + n, "xfers %u errors %u bytes %u irqs %u passes %u\n",
+		     dev->xfers, dev->errors, dev->bytes, dev->irqs,
+		     dev->passes);
+	for (b = 0; b < MSM_I2C_HIST_BUCKETS - 1; b++)
+		n += sprintf(buf + n, "<%uus: %u\n", msm_i2c_hist_us[b],
+			     dev->hist[b]);
+	n += sprintf(buf + n, ">=%uus: %u\n", msm_i2c_hist_us[b - 1],
+		     dev->hist[b]);
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return n;
+}
+
+/* any write clears the statistics */
+static ssize_t msm_i2c_xfer_stats_store(struct device *device,
+					struct device_attribute *attr,
+					const char *buf, size_t count)
+{
+	struct msm_i2c_dev *dev = dev_get_drvdata(device);
+	unsigned long flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	dev->xfers = dev->errors = dev->bytes = 0;
+	dev->irqs = dev->passes = 0;
+	memset(dev->hist, 0, sizeof(dev->hist));
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	return count;
+}
+
+static DEVICE_ATTR(xfer_stats, 0644, msm_i2c_xfer_stats_show,
+		   msm_i2c_xfer_stats_store);
+
 static int
 msm_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 {
@@ -336,6 +438,7 @@ msm_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 	int ret;
 	long timeout;
 	unsigned long flags;
+	ktime_t start;
 
 	/*
 	 * If there is an i2c_xfer after driver has been suspended,
@@ -345,6 +448,7 @@ msm_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 		wake_lock(&dev->wakelock);
 	clk_enable(dev->clk);
 	enable_irq(dev->irq);
+	start = ktime_get();
 
 	ret = msm_i2c_poll_notbusy(dev, 1);
 	if (ret) {
@@ -410,6 +514,7 @@ msm_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msgs[], int num)
 			msm_i2c_recover_bus_busy(dev);
 	}
 err:
+	msm_i2c_account(dev, msgs, num, ret, start);
 	disable_irq(dev->irq);
 	clk_disable(dev->clk);
 	if (dev->is_suspended)
@@ -541,6 +646,9 @@ msm_i2c_probe(struct platform_device *pdev)
 		goto err_request_irq_failed;
 	}
 	disable_irq(dev->irq);
+
+	if (device_create_file(&pdev->dev, &dev_attr_xfer_stats))
+		dev_warn(&pdev->dev, "can't create xfer_stats\n");
 	return 0;
 
 /*	free_irq(dev->irq, dev); */
@@ -563,6 +671,7 @@ msm_i2c_remove(struct platform_device *pdev)
 	struct msm_i2c_dev	*dev = platform_get_drvdata(pdev);
 	struct resource		*mem;
 
+	device_remove_file(&pdev->dev, &dev_attr_xfer_stats);
 	platform_set_drvdata(pdev, NULL);
 	enable_irq(dev->irq);
 	free_irq(dev->irq, dev);
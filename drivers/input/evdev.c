@@ -10,7 +10,7 @@
 
 #define EVDEV_MINOR_BASE	64
 #define EVDEV_MINORS		32
-#define EVDEV_BUFFER_SIZE	64
+#define EVDEV_BUFFER_SIZE	256
 
 #include <linux/poll.h>
 #include <linux/sched.h>
@@ -77,7 +77,7 @@ static void evdev_event(struct input_handle *handle,
 	struct input_event event;
 	struct timespec ts;
 
-	ktime_get_ts(&ts);
+	ts = ktime_to_timespec(input_get_timestamp(handle->dev));
 	event.time.tv_sec = ts.tv_sec;
 	event.time.tv_usec = ts.tv_nsec / NSEC_PER_USEC;
 	event.type = type;
@@ -352,6 +352,28 @@ static int evdev_fetch_next_event(struct evdev_client *client,
 	return have_event;
 }
 
+/*
+ * Copy out as many queued events as fit without blocking, returns the
+ * number of events.
+ */
+static int evdev_read_batch(struct evdev_client *client,
+			    void __user *p, size_t size)
+{
+	struct input_event event;
+	int n = 0;
+
+	while ((n + 1) * input_event_size() <= size &&
+	       evdev_fetch_next_event(client, &event)) {
+
+		if (input_event_to_user(p + n * input_event_size(), &event))
+			return -EFAULT;
+
+		n++;
+	}
+
+	return n;
+}
+
 static ssize_t evdev_read(struct file *file, char __user *buffer,
 			  size_t count, loff_t *ppos)
 {
@@ -630,6 +652,10 @@ static long evdev_do_ioctl(struct file *file, unsigned int cmd,
 			if (_IOC_NR(cmd) == _IOC_NR(EVIOCGUNIQ(0)))
 				return str_to_user(dev->uniq, _IOC_SIZE(cmd), p);
 
+			if (_IOC_NR(cmd) == _IOC_NR(EVIOCGEVENTS(0)))
+				return evdev_read_batch(client, p,
+							_IOC_SIZE(cmd));
+
 			if ((_IOC_NR(cmd) & ~ABS_MAX) == _IOC_NR(EVIOCGABS(0))) {
 
 				t = _IOC_NR(cmd) & ABS_MAX;
@@ -289,6 +289,9 @@ static void input_handle_event(struct input_dev *dev,
 
 	if (disposition & INPUT_PASS_TO_HANDLERS)
 		input_pass_event(dev, type, code, value);
+
+	if (type == EV_SYN && code == SYN_REPORT)
+		dev->timestamp.tv64 = 0;
 }
 
 /**
@@ -18,6 +18,8 @@
 #include <linux/gpio_event.h>
 #include <linux/hrtimer.h>
 #include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/module.h>
 #include <linux/wakelock.h>
 
 #ifdef CONFIG_OPTICALJOYSTICK_CRUCIAL
@@ -35,9 +37,19 @@ struct gpio_kp {
 	unsigned int key_state_changed:1;
 	unsigned int last_key_state_changed:1;
 	unsigned int some_keys_pressed:2;
+	unsigned int irq_release:1;
+	unsigned int irq_press_type;
+	unsigned int irq_release_type;
+	ktime_t irq_time;
 	unsigned long keys_pressed[0];
 };
 
+/* how often the keypad got the cpu going, by irq and by scan timer */
+static unsigned int irq_wakeups;
+module_param(irq_wakeups, uint, S_IRUGO);
+static unsigned int scan_wakeups;
+module_param(scan_wakeups, uint, S_IRUGO);
+
 static void clear_phantom_key(struct gpio_kp *kp, int out, int in)
 {
 	struct gpio_event_matrix_info *mi = kp->keypad_info;
@@ -162,6 +174,7 @@ static enum hrtimer_restart gpio_keypad_timer_func(struct hrtimer *timer)
 	unsigned gpio_keypad_flags = mi->flags;
 	unsigned polarity = !!(gpio_keypad_flags & GPIOKPF_ACTIVE_HIGH);
 
+	scan_wakeups++;
 	out = kp->current_output;
 	if (out == mi->noutputs) {
 		out = 0;
@@ -209,25 +222,45 @@ static enum hrtimer_restart gpio_keypad_timer_func(struct hrtimer *timer)
 	if (kp->key_state_changed) {
 		if (gpio_keypad_flags & GPIOKPF_REMOVE_SOME_PHANTOM_KEYS)
 			remove_phantom_keys(kp);
+		/* changes are stamped with the irq that started the scan,
+		 * nothing syncs here so clear the stamp again afterwards
+		 */
+		for (in = 0; in < kp->input_devs->count; in++)
+			input_set_timestamp(kp->input_devs->dev[in],
+					    kp->irq_time);
 		key_index = 0;
 		for (out = 0; out < mi->noutputs; out++)
 			for (in = 0; in < mi->ninputs; in++, key_index++)
 				report_key(kp, key_index, out, in);
+		for (in = 0; in < kp->input_devs->count; in++)
+			input_set_timestamp(kp->input_devs->dev[in],
+					    ktime_set(0, 0));
 	}
-	if (!kp->use_irq || kp->some_keys_pressed) {
+	kp->irq_time = ktime_set(0, 0);
+	if (!kp->use_irq || (kp->some_keys_pressed && !kp->irq_release)) {
 		hrtimer_start(timer, mi->poll_time, HRTIMER_MODE_REL);
 		return HRTIMER_NORESTART;
 	}
 
-	/* No keys are pressed, reenable interrupt */
+	/* No keys are pressed (or releases come by irq), reenable interrupt */
 	for (out = 0; out < mi->noutputs; out++) {
 		if (gpio_keypad_flags & GPIOKPF_DRIVE_INACTIVE)
 			gpio_set_value(mi->output_gpios[out], polarity);
 		else
 			gpio_direction_output(mi->output_gpios[out], polarity);
 	}
-	for (in = 0; in < mi->ninputs; in++)
-		enable_irq(gpio_to_irq(mi->input_gpios[in]));
+	for (in = 0; in < mi->ninputs; in++) {
+		gpio = mi->input_gpios[in];
+		/* a level irq armed for the wrong state fires right away
+		 * and rescans, so an unsettled read here is harmless
+		 */
+		if (kp->irq_release)
+			set_irq_type(gpio_to_irq(gpio),
+				     (gpio_get_value(gpio) ^ !polarity) ?
+				     kp->irq_release_type :
+				     kp->irq_press_type);
+		enable_irq(gpio_to_irq(gpio));
+	}
 	wake_unlock(&kp->wake_lock);
 	return HRTIMER_NORESTART;
 }
@@ -242,6 +275,8 @@ static irqreturn_t gpio_keypad_irq_handler(int irq_in, void *dev_id)
 	if (!kp->use_irq) /* ignore interrupt while registering the handler */
 		return IRQ_HANDLED;
 
+	irq_wakeups++;
+	kp->irq_time = ktime_get();
 	for (i = 0; i < mi->ninputs; i++)
 		disable_irq_nosync(gpio_to_irq(mi->input_gpios[i]));
 	for (i = 0; i < mi->noutputs; i++) {
@@ -278,6 +313,9 @@ static int gpio_keypad_request_irqs(struct gpio_kp *kp)
 		request_flags = IRQF_TRIGGER_HIGH;
 		break;
 	}
+	kp->irq_press_type = request_flags;
+	kp->irq_release_type = request_flags == IRQF_TRIGGER_LOW ?
+		IRQF_TRIGGER_HIGH : IRQF_TRIGGER_LOW;
 
 	for (i = 0; i < mi->ninputs; i++) {
 		err = irq = gpio_to_irq(mi->input_gpios[i]);
@@ -404,10 +442,18 @@ int gpio_event_matrix_func(struct gpio_event_input_devs *input_devs,
 		wake_lock_init(&kp->wake_lock, WAKE_LOCK_SUSPEND, "gpio_kp");
 		err = gpio_keypad_request_irqs(kp);
 		kp->use_irq = err == 0;
+		if (mi->flags & GPIOKPF_IRQ_RELEASE) {
+			if (mi->flags & GPIOKPF_LEVEL_TRIGGERED_IRQ)
+				kp->irq_release = kp->use_irq;
+			else
+				pr_err("gpiomatrix: release irqs need level "
+					"triggered irqs, polling instead\n");
+		}
 
 		pr_info("GPIO Matrix Keypad Driver: Start keypad matrix for "
 			"%s%s in %s mode\n", input_devs->dev[0]->name,
 			(input_devs->count > 1) ? "..." : "",
+			kp->irq_release ? "interrupt only" :
 			kp->use_irq ? "interrupt" : "polling");
 
 		if (kp->use_irq)
@@ -69,8 +69,16 @@ struct synaptics_ts_data {
 	uint8_t key_pressed[2];
 	uint8_t debug_log_level;
 	uint8_t grip_suppression[2];
+	uint16_t report_rate;	/* reports per second, 0 = every frame */
+	ktime_t last_report;
+	ktime_t irq_time;
+	uint8_t last_finger;
+	uint8_t suspended;
 };
 
+#define SYNAPTICS_POLL_ACTIVE_NS	12500000	/* finger down */
+#define SYNAPTICS_POLL_IDLE_NS		50000000
+
 #ifdef CONFIG_HAS_EARLYSUSPEND
 static void synaptics_ts_early_suspend(struct early_suspend *h);
 static void synaptics_ts_late_resume(struct early_suspend *h);
@@ -116,6 +124,43 @@ static ssize_t debug_level_store(struct device *dev,
 
 static DEVICE_ATTR(debug_level, 0644, debug_level_show, debug_level_store);
 
+/* 0xf0 value for normal operation at the configured rate */
+static uint8_t synaptics_report_mode(struct synaptics_ts_data *ts)
+{
+	if (ts->report_rate && ts->report_rate <= 40)
+		return 0x80; /* 40 reports per second */
+	return 0x81; /* 80 reports per second */
+}
+
+static ssize_t report_rate_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct synaptics_ts_data *ts = gl_ts;
+
+	return sprintf(buf, "%d\n", ts->report_rate);
+}
+
+static ssize_t report_rate_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct synaptics_ts_data *ts = gl_ts;
+	unsigned long rate;
+
+	if (strict_strtoul(buf, 10, &rate) || rate > 1000)
+		return -EINVAL;
+
+	ts->report_rate = rate;
+	if (!ts->suspended &&
+	    i2c_smbus_write_byte_data(ts->client, 0xf0,
+				      synaptics_report_mode(ts)) < 0)
+		printk(KERN_ERR "%s: i2c_smbus_write_byte_data failed\n",
+		       __func__);
+
+	return count;
+}
+
+static DEVICE_ATTR(report_rate, 0644, report_rate_show, report_rate_store);
+
 #ifdef ENABLE_IME_IMPROVEMENT
 static ssize_t ime_threshold_show(struct device *dev,
 				   struct device_attribute *attr, char *buf)
@@ -424,11 +469,17 @@ static int synaptics_touch_sysfs_init(void)
 		printk(KERN_ERR "%s: sysfs_create_file failed\n", __func__);
 		return ret;
 	}
+	ret = sysfs_create_file(android_touch_kobj, &dev_attr_report_rate.attr);
+	if (ret) {
+		printk(KERN_ERR "%s: sysfs_create_file failed\n", __func__);
+		return ret;
+	}
 	return 0;
 }
 
 static void synaptics_touch_sysfs_remove(void)
 {
+	sysfs_remove_file(android_touch_kobj, &dev_attr_report_rate.attr);
 	sysfs_remove_file(android_touch_kobj, &dev_attr_debug_level.attr);
 	kobject_del(android_touch_kobj);
 }
@@ -455,7 +506,8 @@ err_page_select_failed:
 	ret = i2c_smbus_write_byte_data(ts->client, 0xff, 0x04); /* page select = 0x04 */
 	if (ret < 0)
 		printk(KERN_ERR "i2c_smbus_write_byte_data failed for page select\n");
-	ret = i2c_smbus_write_byte_data(ts->client, 0xf0, 0x81); /* normal operation, 80 reports per second */
+	ret = i2c_smbus_write_byte_data(ts->client, 0xf0,
+					synaptics_report_mode(ts)); /* normal operation */
 	if (ret < 0)
 		printk(KERN_ERR "synaptics_ts_resume: i2c_smbus_write_byte_data failed\n");
 	return ret;
@@ -472,6 +524,8 @@ static void synaptics_ts_work_func(struct work_struct *work)
 	struct synaptics_ts_data *ts = container_of(work, struct synaptics_ts_data, work);
 	int buf_len = ts->has_relative_report ? 15 : 13;
 
+	input_set_timestamp(ts->input_dev, ts->irq_time);
+
 	msg[0].addr = ts->client->addr;
 	msg[0].flags = 0;
 	msg[0].len = 1;
@@ -511,6 +565,7 @@ static void synaptics_ts_work_func(struct work_struct *work)
 			bad_data = 0;
 			if ((buf[buf_len - 1] & 1) == 0) {
 				/* printk("read %d coordinates\n", i); */
+				ts->last_finger = 0;
 				break;
 			} else {
 				int pos[2][2];
@@ -629,6 +684,20 @@ static void synaptics_ts_work_func(struct work_struct *work)
 					break;
 				}
 #endif
+				/**
+				 * Report rate cap: while the same fingers stay
+				 * down, drop frames that come in faster than
+				 * report_rate; the next one carries the newer
+				 * position anyway.
+				 */
+				if (ts->report_rate && finger &&
+				    finger == ts->last_finger &&
+				    ktime_us_delta(ktime_get(), ts->last_report) <
+				    USEC_PER_SEC / ts->report_rate)
+					break;
+				ts->last_finger = finger;
+				ts->last_report = ktime_get();
+
 #ifdef CONFIG_TOUCHSCREEN_CONCATENATE_REPORT
 				/**
 				 * We concatenate z, w, x, y info to reduce the number of reports in event hub
@@ -698,9 +767,13 @@ static enum hrtimer_restart synaptics_ts_timer_func(struct hrtimer *timer)
 	struct synaptics_ts_data *ts = container_of(timer, struct synaptics_ts_data, timer);
 	/* printk("synaptics_ts_timer_func\n"); */
 
+	ts->irq_time = ktime_get();
 	queue_work(synaptics_wq, &ts->work);
 
-	hrtimer_start(&ts->timer, ktime_set(0, 12500000), HRTIMER_MODE_REL);
+	/* poll slowly until a finger shows up */
+	hrtimer_start(&ts->timer, ktime_set(0, ts->last_finger ?
+				SYNAPTICS_POLL_ACTIVE_NS : SYNAPTICS_POLL_IDLE_NS),
+		      HRTIMER_MODE_REL);
 	return HRTIMER_NORESTART;
 }
 
@@ -709,6 +782,7 @@ static irqreturn_t synaptics_ts_irq_handler(int irq, void *dev_id)
 	struct synaptics_ts_data *ts = dev_id;
 
 	/* printk("synaptics_ts_irq_handler\n"); */
+	ts->irq_time = ktime_get();
 	disable_irq_nosync(ts->client->irq);
 	queue_work(synaptics_wq, &ts->work);
 	return IRQ_HANDLED;
@@ -925,7 +999,7 @@ static int synaptics_ts_probe(
 		goto err_detect_failed;
 	}
 
-	synaptics_wq = create_singlethread_workqueue("synaptics_wq");
+	synaptics_wq = create_hipri_workqueue("synaptics_wq");
 	if (!synaptics_wq)
 		goto err_create_wq_failed;
 	INIT_WORK(&ts->work, synaptics_ts_work_func);
@@ -1122,6 +1196,7 @@ static int synaptics_ts_suspend(struct i2c_client *client, pm_message_t mesg)
 	int ret;
 	struct synaptics_ts_data *ts = i2c_get_clientdata(client);
 
+	ts->suspended = 1;
 	if (ts->use_irq)
 		disable_irq(client->irq);
 	else
@@ -1158,6 +1233,7 @@ static int synaptics_ts_resume(struct i2c_client *client)
 	}
 
 	synaptics_init_panel(ts);
+	ts->suspended = 0;
 
 	if (ts->use_irq)
 		enable_irq(client->irq);
@@ -1201,6 +1277,9 @@ static struct i2c_driver synaptics_ts_driver = {
 	.id_table	= synaptics_ts_id,
 	.driver = {
 		.name	= SYNAPTICS_I2C_RMI_NAME,
+		.probe_async = true,
+		/* the panel and its power come up through the microp */
+		.probe_after = "atmega-microp",
 	},
 };
 
@@ -235,7 +235,7 @@ static void microp_led_pwm_brightness_set(struct led_classdev *led_cdev,
 	data[2] = ldata->led_config->led_pin >> 8;
 	data[3] = ldata->led_config->led_pin;
 
-	ret = microp_i2c_write(MICROP_I2C_WCMD_LED_PWM, data, 4);
+	ret = microp_i2c_write_cached(MICROP_I2C_WCMD_LED_PWM, data, 4);
 	if (ret < 0)
 		pr_err("%s failed on set pwm led mode:0x%2.2X\n", __func__, data[1]);
 }
@@ -416,7 +416,7 @@ static ssize_t microp_jogball_color_store(struct device *dev,
 	data[2] = bpwm;
 	data[3] = 0x00;
 
-	ret = microp_i2c_write(MICROP_I2C_WCMD_JOGBALL_LED_PWM_SET, data, 4);
+	ret = microp_i2c_write_cached(MICROP_I2C_WCMD_JOGBALL_LED_PWM_SET, data, 4);
 	if (ret) {
 		dev_err(&client->dev, "%s set color R=%d G=%d B=%d failed\n",
 				led_cdev->name, rpwm, gpwm, bpwm);
@@ -25,6 +25,7 @@
 
 #include <linux/fs.h>
 #include <linux/list.h>
+#include <linux/hash.h>
 #include <linux/uaccess.h>
 #include <linux/android_pmem.h>
 #include <linux/poll.h>
@@ -45,37 +46,79 @@ static struct class *msm_class;
 static dev_t msm_devno;
 static LIST_HEAD(msm_sensors);
 
-#define __CONTAINS(r, v, l, field) ({				\
-	typeof(r) __r = r;					\
-	typeof(v) __v = v;					\
-	typeof(v) __e = __v + l;				\
-	int res = __v >= __r->field &&				\
-		__e <= __r->field + __r->len;			\
-	res;							\
-})
+#define MSM_QCMD_STRIDE (sizeof(struct msm_queue_cmd) + MSM_QCMD_SLOT_SIZE)
 
-#define CONTAINS(r1, r2, field) ({				\
-	typeof(r2) __r2 = r2;					\
-	__CONTAINS(r1, __r2->field, __r2->len, field);		\
-})
+static int msm_qcmd_pool_init(struct msm_qcmd_pool *pool)
+{
+	int i;
 
-#define IN_RANGE(r, v, field) ({				\
-	typeof(r) __r = r;					\
-	typeof(v) __vv = v;					\
-	int res = ((__vv >= __r->field) &&			\
-		(__vv < (__r->field + __r->len)));		\
-	res;							\
-})
+	spin_lock_init(&pool->lock);
+	pool->slots = kzalloc(MSM_QCMD_POOL_SLOTS * MSM_QCMD_STRIDE,
+			GFP_KERNEL);
+	if (!pool->slots)
+		return -ENOMEM;
+	for (i = 0; i < MSM_QCMD_POOL_SLOTS; i++)
+		pool->free[i] = i;
+	pool->nr_free = MSM_QCMD_POOL_SLOTS;
+	pool->min_free = MSM_QCMD_POOL_SLOTS;
+	pool->overflow = 0;
+	pool->dropped = 0;
+	return 0;
+}
 
-#define OVERLAPS(r1, r2, field) ({				\
-	typeof(r1) __r1 = r1;					\
-	typeof(r2) __r2 = r2;					\
-	typeof(__r2->field) __v = __r2->field;			\
-	typeof(__v) __e = __v + __r2->len - 1;			\
-	int res = (IN_RANGE(__r1, __v, field) ||		\
-		   IN_RANGE(__r1, __e, field));                 \
-	res;							\
-})
+static void msm_qcmd_pool_destroy(struct msm_qcmd_pool *pool)
+{
+	kfree(pool->slots);
+	pool->slots = NULL;
+}
+
+/* may be called from interrupt context */
+static struct msm_queue_cmd *msm_qcmd_alloc(struct msm_qcmd_pool *pool,
+		int size, gfp_t gfp)
+{
+	struct msm_queue_cmd *qcmd = NULL;
+	unsigned long flags;
+	int slot = -1;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	if (size <= MSM_QCMD_SLOT_SIZE && pool->nr_free) {
+		slot = pool->free[--pool->nr_free];
+		if (pool->nr_free < pool->min_free)
+			pool->min_free = pool->nr_free;
+	} else
+		pool->overflow++;
+	spin_unlock_irqrestore(&pool->lock, flags);
+
+	if (slot >= 0) {
+		qcmd = pool->slots + slot * MSM_QCMD_STRIDE;
+		memset(qcmd, 0, sizeof(struct msm_queue_cmd) + size);
+		qcmd->pool = pool;
+		return qcmd;
+	}
+
+	qcmd = kzalloc(sizeof(struct msm_queue_cmd) + size, gfp);
+	if (!qcmd) {
+		spin_lock_irqsave(&pool->lock, flags);
+		pool->dropped++;
+		spin_unlock_irqrestore(&pool->lock, flags);
+	}
+	return qcmd;
+}
+
+static void msm_qcmd_release(struct msm_queue_cmd *qcmd)
+{
+	struct msm_qcmd_pool *pool = qcmd->pool;
+	unsigned long flags;
+
+	if (!pool) {
+		kfree(qcmd);
+		return;
+	}
+	spin_lock_irqsave(&pool->lock, flags);
+	pool->free[pool->nr_free++] =
+		((void *)qcmd - pool->slots) / MSM_QCMD_STRIDE;
+	spin_unlock_irqrestore(&pool->lock, flags);
+}
 
 static inline void free_qcmd(struct msm_queue_cmd *qcmd)
 {
@@ -83,7 +126,7 @@ static inline void free_qcmd(struct msm_queue_cmd *qcmd)
 		return;
 	CDBG("%s qcmd->on_heap:%d\n",__func__,qcmd->on_heap);
 	if (!--qcmd->on_heap)
-		kfree(qcmd);
+		msm_qcmd_release(qcmd);
 }
 
 static void msm_queue_init(struct msm_device_queue *queue, const char *name)
@@ -96,11 +139,16 @@ static void msm_queue_init(struct msm_device_queue *queue, const char *name)
 	init_waitqueue_head(&queue->wait);
 }
 
+/* Every reader waits for the queue to become non-empty and drains it one
+ * command at a time, so only the first command queued needs a wakeup.
+ */
 static void msm_enqueue(struct msm_device_queue *queue,
 		struct list_head *entry)
 {
 	unsigned long flags;
+	int was_empty;
 	spin_lock_irqsave(&queue->lock, flags);
+	was_empty = list_empty(&queue->list);
 	queue->len++;
 
 	if (queue->len > queue->max) {
@@ -115,8 +163,10 @@ static void msm_enqueue(struct msm_device_queue *queue,
 #endif
 	}
 	list_add_tail(entry, &queue->list);
-	wake_up(&queue->wait);
-	CDBG("%s: woke up %s\n", __func__, queue->name);
+	if (was_empty) {
+		wake_up(&queue->wait);
+		CDBG("%s: woke up %s\n", __func__, queue->name);
+	}
 	spin_unlock_irqrestore(&queue->lock, flags);
 }
 
@@ -154,31 +204,92 @@ static void msm_enqueue(struct msm_device_queue *queue,
 	spin_unlock_irqrestore(&__q->lock, flags);		\
 } while(0)
 
-static int check_overlap(struct hlist_head *ptype,
-			unsigned long paddr,
-			unsigned long len)
+static void msm_pmem_table_init(struct msm_pmem_table *ptable,
+			int vfe_addr_y_off)
+{
+	int i;
+
+	INIT_HLIST_HEAD(&ptable->list);
+	ptable->by_paddr = RB_ROOT;
+	for (i = 0; i < (1 << MSM_PMEM_HASH_BITS); i++) {
+		INIT_HLIST_HEAD(&ptable->by_vfe_addr[i]);
+		INIT_HLIST_HEAD(&ptable->by_vaddr[i]);
+	}
+	ptable->vfe_addr_y_off = vfe_addr_y_off;
+}
+
+static inline struct hlist_head *msm_pmem_hash(struct hlist_head *hash,
+			unsigned long addr)
+{
+	return &hash[hash_long(addr, MSM_PMEM_HASH_BITS)];
+}
+
+static inline unsigned long msm_pmem_vfe_addr(struct msm_pmem_table *ptable,
+			struct msm_pmem_region *region)
+{
+	if (ptable->vfe_addr_y_off)
+		return region->paddr + region->info.y_off;
+	return region->paddr;
+}
+
+/* Regions in a table never overlap, so a region that clashes with the new
+ * one lies on the path down to where the new one goes.
+ */
+static int msm_pmem_table_insert(struct msm_pmem_table *ptable,
+			struct msm_pmem_region *t)
 {
+	struct rb_node **p = &ptable->by_paddr.rb_node;
+	struct rb_node *parent = NULL;
 	struct msm_pmem_region *region;
-	struct msm_pmem_region t = { .paddr = paddr, .len = len };
-	struct hlist_node *node;
 
-	hlist_for_each_entry(region, node, ptype, list) {
-		if (CONTAINS(region, &t, paddr) ||
-				CONTAINS(&t, region, paddr) ||
-				OVERLAPS(region, &t, paddr)) {
+	while (*p) {
+		parent = *p;
+		region = rb_entry(parent, struct msm_pmem_region, pnode);
+		if (t->paddr + t->len <= region->paddr)
+			p = &parent->rb_left;
+		else if (t->paddr >= region->paddr + region->len)
+			p = &parent->rb_right;
+		else {
 			printk(KERN_ERR
 				" region (PHYS %p len %ld)"
 				" clashes with registered region"
 				" (paddr %p len %ld)\n",
-				(void *)t.paddr, t.len,
+				(void *)t->paddr, t->len,
 				(void *)region->paddr, region->len);
 			return -1;
 		}
 	}
+	rb_link_node(&t->pnode, parent, p);
+	rb_insert_color(&t->pnode, &ptable->by_paddr);
 
+	hlist_add_head(&t->list, &ptable->list);
+	hlist_add_head(&t->vfe_node, msm_pmem_hash(ptable->by_vfe_addr,
+				msm_pmem_vfe_addr(ptable, t)));
+	hlist_add_head(&t->vnode, msm_pmem_hash(ptable->by_vaddr,
+				(unsigned long)t->info.vaddr));
 	return 0;
 }
 
+static void msm_pmem_table_remove(struct msm_sync *sync,
+			struct msm_pmem_table *ptable,
+			struct msm_pmem_region *region)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&sync->frame_lock, flags);
+	for (i = 0; i < MSM_FRAME_CONSUMER_MAX; i++)
+		list_del_init(&region->consumer_node[i]);
+	spin_unlock_irqrestore(&sync->frame_lock, flags);
+
+	rb_erase(&region->pnode, &ptable->by_paddr);
+	hlist_del(&region->list);
+	hlist_del(&region->vfe_node);
+	hlist_del(&region->vnode);
+	put_pmem_file(region->file);
+	kfree(region);
+}
+
 static int check_pmem_info(struct msm_pmem_info *info, int len)
 {
 	if (info->offset & (PAGE_SIZE - 1)) {
@@ -203,14 +314,14 @@ error:
 	return -EINVAL;
 }
 
-static int msm_pmem_table_add(struct hlist_head *ptype,
+static int msm_pmem_table_add(struct msm_pmem_table *ptable,
 	struct msm_pmem_info *info)
 {
 	struct file *file;
 	unsigned long paddr;
 	unsigned long kvstart;
 	unsigned long len;
-	int rc;
+	int rc, i;
 	struct msm_pmem_region *region;
 
 	rc = get_pmem_file(info->fd, &paddr, &kvstart, &len, &file);
@@ -232,9 +343,6 @@ static int msm_pmem_table_add(struct hlist_head *ptype,
 	kvstart += info->offset;
 	len = info->len;
 
-	if (check_overlap(ptype, paddr, len) < 0)
-		return -EINVAL;
-
 	CDBG("%s: type %d, paddr 0x%lx, vaddr 0x%lx\n",
 		__func__,
 		info->type, paddr, (unsigned long)info->vaddr);
@@ -243,21 +351,24 @@ static int msm_pmem_table_add(struct hlist_head *ptype,
 	if (!region)
 		return -ENOMEM;
 
-	INIT_HLIST_NODE(&region->list);
-
 	region->paddr = paddr;
 	region->kvaddr = kvstart;
 	region->len = len;
 	region->file = file;
 	memcpy(&region->info, info, sizeof(region->info));
+	for (i = 0; i < MSM_FRAME_CONSUMER_MAX; i++)
+		INIT_LIST_HEAD(&region->consumer_node[i]);
 
-	hlist_add_head(&(region->list), ptype);
+	if (msm_pmem_table_insert(ptable, region) < 0) {
+		kfree(region);
+		return -EINVAL;
+	}
 
 	return 0;
 }
 
 /* return of 0 means failure */
-static uint8_t msm_pmem_region_lookup(struct hlist_head *ptype,
+static uint8_t msm_pmem_region_lookup(struct msm_pmem_table *ptable,
 	int pmem_type, struct msm_pmem_region *reg, uint8_t maxcount)
 {
 	struct msm_pmem_region *region;
@@ -268,7 +379,7 @@ static uint8_t msm_pmem_region_lookup(struct hlist_head *ptype,
 
 	regptr = reg;
 	mutex_lock(&hlist_mut);
-	hlist_for_each_entry_safe(region, node, n, ptype, list) {
+	hlist_for_each_entry_safe(region, node, n, &ptable->list, list) {
 		if (region->info.type == pmem_type &&
 			region->info.vfe_can_write) {
 				*regptr = *region;
@@ -287,10 +398,12 @@ static int msm_pmem_frame_ptov_lookup(struct msm_sync *sync,
 		struct msm_pmem_region **pmem_region,
 		int take_from_vfe)
 {
-	struct hlist_node *node, *n;
+	struct hlist_node *node;
 	struct msm_pmem_region *region;
 
-	hlist_for_each_entry_safe(region, node, n, &sync->pmem_frames, list) {
+	hlist_for_each_entry(region, node,
+			msm_pmem_hash(sync->pmem_frames.by_vfe_addr, pyaddr),
+			vfe_node) {
 		if (pyaddr == (region->paddr + region->info.y_off) &&
 #ifndef CONFIG_ARCH_MSM7225
 				pcbcraddr == (region->paddr +
@@ -316,9 +429,11 @@ static unsigned long msm_pmem_stats_ptov_lookup(struct msm_sync *sync,
 		unsigned long addr, int *fd)
 {
 	struct msm_pmem_region *region;
-	struct hlist_node *node, *n;
+	struct hlist_node *node;
 
-	hlist_for_each_entry_safe(region, node, n, &sync->pmem_stats, list) {
+	hlist_for_each_entry(region, node,
+			msm_pmem_hash(sync->pmem_stats.by_vfe_addr, addr),
+			vfe_node) {
 		if (addr == region->paddr && region->info.vfe_can_write) {
 			/* offset since we could pass vaddr inside a
 			 * registered pmem buffer */
@@ -329,7 +444,8 @@ static unsigned long msm_pmem_stats_ptov_lookup(struct msm_sync *sync,
 	}
 #if 1
 	printk("msm_pmem_stats_ptov_lookup: lookup vaddr..\n");
-	hlist_for_each_entry_safe(region, node, n, &sync->pmem_stats, list) {
+	hlist_for_each_entry(region, node,
+			msm_pmem_hash(sync->pmem_stats.by_vaddr, addr), vnode) {
 		if (addr == (unsigned long)(region->info.vaddr)) {
 			/* offset since we could pass vaddr inside a
 			 * registered pmem buffer */
@@ -342,21 +458,33 @@ static unsigned long msm_pmem_stats_ptov_lookup(struct msm_sync *sync,
 	return 0;
 }
 
+/* Drops one consumer's hold on a frame.  *held is set if other consumers
+ * still have it, in which case it must not go back to the VFE yet.
+ */
 static unsigned long msm_pmem_frame_vtop_lookup(struct msm_sync *sync,
 		unsigned long buffer,
-		uint32_t yoff, uint32_t cbcroff, int fd)
+		uint32_t yoff, uint32_t cbcroff, int fd, int *held)
 {
 	struct msm_pmem_region *region;
-	struct hlist_node *node, *n;
+	struct hlist_node *node;
+	unsigned long flags;
 
-	hlist_for_each_entry_safe(region,
-		node, n, &sync->pmem_frames, list) {
+	hlist_for_each_entry(region, node,
+			msm_pmem_hash(sync->pmem_frames.by_vaddr, buffer), vnode) {
 		if (((unsigned long)(region->info.vaddr) == buffer) &&
 				(region->info.y_off == yoff) &&
 				(region->info.cbcr_off == cbcroff) &&
 				(region->info.fd == fd) &&
 				(region->info.vfe_can_write == 0)) {
-			region->info.vfe_can_write = 1;
+			spin_lock_irqsave(&sync->frame_lock, flags);
+			*held = region->refs > 1;
+			if (*held)
+				region->refs--;
+			else {
+				region->refs = 0;
+				region->info.vfe_can_write = 1;
+			}
+			spin_unlock_irqrestore(&sync->frame_lock, flags);
 			return region->paddr;
 		}
 	}
@@ -370,9 +498,10 @@ static unsigned long msm_pmem_stats_vtop_lookup(
 		int fd)
 {
 	struct msm_pmem_region *region;
-	struct hlist_node *node, *n;
+	struct hlist_node *node;
 
-	hlist_for_each_entry_safe(region, node, n, &sync->pmem_stats, list) {
+	hlist_for_each_entry(region, node,
+			msm_pmem_hash(sync->pmem_stats.by_vaddr, buffer), vnode) {
 		if (((unsigned long)(region->info.vaddr) == buffer) &&
 				(region->info.fd == fd) &&
 				region->info.vfe_can_write == 0) {
@@ -403,30 +532,26 @@ static int __msm_pmem_table_del(struct msm_sync *sync,
 	case MSM_PMEM_MAINIMG:
 	case MSM_PMEM_RAW_MAINIMG:
 		hlist_for_each_entry_safe(region, node, n,
-			&sync->pmem_frames, list) {
+			&sync->pmem_frames.list, list) {
 
 			if (pinfo->type == region->info.type &&
 					pinfo->vaddr == region->info.vaddr &&
-					pinfo->fd == region->info.fd) {
-				hlist_del(node);
-				put_pmem_file(region->file);
-				kfree(region);
-			}
+					pinfo->fd == region->info.fd)
+				msm_pmem_table_remove(sync,
+						&sync->pmem_frames, region);
 		}
 		break;
 
 	case MSM_PMEM_AEC_AWB:
 	case MSM_PMEM_AF:
 		hlist_for_each_entry_safe(region, node, n,
-			&sync->pmem_stats, list) {
+			&sync->pmem_stats.list, list) {
 
 			if (pinfo->type == region->info.type &&
 					pinfo->vaddr == region->info.vaddr &&
-					pinfo->fd == region->info.fd) {
-				hlist_del(node);
-				put_pmem_file(region->file);
-				kfree(region);
-			}
+					pinfo->fd == region->info.fd)
+				msm_pmem_table_remove(sync,
+						&sync->pmem_stats, region);
 		}
 		break;
 
@@ -450,6 +575,156 @@ static int msm_pmem_table_del(struct msm_sync *sync, void __user *arg)
 	return __msm_pmem_table_del(sync, &info);
 }
 
+/* The frame thread holds the first reference to a frame it takes from
+ * the VFE; every other consumer registered for the frame's path gets one
+ * more and finds the frame on its own list.
+ */
+static void msm_frame_share(struct msm_sync *sync,
+		struct msm_pmem_region *region, int path)
+{
+	struct msm_frame_consumer *c;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&sync->frame_lock, flags);
+	region->refs = 1;
+	region->path = path;
+	for (i = MSM_FRAME_CONSUMER_PREVIEW + 1;
+			i < MSM_FRAME_CONSUMER_MAX; i++) {
+		c = &sync->consumers[i];
+		if (!(c->paths & (1 << path)))
+			continue;
+		region->refs++;
+		list_add_tail(&region->consumer_node[i], &c->list);
+		wake_up(&c->wait);
+	}
+	spin_unlock_irqrestore(&sync->frame_lock, flags);
+}
+
+static inline struct msm_pmem_region *msm_consumer_to_region(
+		struct list_head *node, int consumer)
+{
+	return container_of(node - consumer, struct msm_pmem_region,
+			consumer_node[0]);
+}
+
+static void msm_frame_fill(struct msm_pmem_region *region,
+		struct msm_frame *frame)
+{
+	frame->buffer = (unsigned long)region->info.vaddr;
+	frame->y_off = region->info.y_off;
+	frame->cbcr_off = region->info.cbcr_off;
+	frame->fd = region->info.fd;
+	frame->path = region->path;
+}
+
+static int msm_frame_give_back(struct msm_sync *sync,
+		struct msm_frame *frame, unsigned long pphy)
+{
+	struct msm_vfe_cfg_cmd cfgcmd;
+
+	cfgcmd.cmd_type = CMD_FRAME_BUF_RELEASE;
+	cfgcmd.value    = (void *)frame;
+	if (sync->vfefn.vfe_config)
+		return sync->vfefn.vfe_config(&cfgcmd, &pphy);
+	return -EIO;
+}
+
+/* Releases the frames a consumer still had queued when it went away. */
+static void msm_frame_consumer_drop(struct msm_sync *sync,
+		struct list_head *frames, int consumer)
+{
+	struct msm_pmem_region *region;
+	struct msm_frame frame;
+	unsigned long flags;
+	int last;
+
+	while (!list_empty(frames)) {
+		spin_lock_irqsave(&sync->frame_lock, flags);
+		region = msm_consumer_to_region(frames->next, consumer);
+		list_del_init(&region->consumer_node[consumer]);
+		last = --region->refs <= 0;
+		if (last) {
+			region->refs = 0;
+			region->info.vfe_can_write = 1;
+		}
+		spin_unlock_irqrestore(&sync->frame_lock, flags);
+
+		if (last) {
+			msm_frame_fill(region, &frame);
+			msm_frame_give_back(sync, &frame, region->paddr);
+		}
+	}
+}
+
+static int msm_frame_consumer_cfg(struct msm_sync *sync, void __user *arg)
+{
+	struct msm_frame_consumer_cfg cfg;
+	struct msm_frame_consumer *c;
+	unsigned long flags;
+	LIST_HEAD(frames);
+
+	if (copy_from_user(&cfg, arg, sizeof(cfg))) {
+		ERR_COPY_FROM_USER();
+		return -EFAULT;
+	}
+	if (cfg.consumer <= MSM_FRAME_CONSUMER_PREVIEW ||
+			cfg.consumer >= MSM_FRAME_CONSUMER_MAX)
+		return -EINVAL;
+
+	c = &sync->consumers[cfg.consumer];
+	spin_lock_irqsave(&sync->frame_lock, flags);
+	c->paths = cfg.paths;
+	if (!cfg.paths)
+		list_splice_init(&c->list, &frames);
+	spin_unlock_irqrestore(&sync->frame_lock, flags);
+	/* a consumer waiting for frames returns once it is unregistered */
+	wake_up(&c->wait);
+
+	msm_frame_consumer_drop(sync, &frames, cfg.consumer);
+	return 0;
+}
+
+static int msm_get_consumer_frame(struct msm_sync *sync, void __user *arg)
+{
+	struct msm_consumer_frame cf;
+	struct msm_frame_consumer *c;
+	struct msm_pmem_region *region = NULL;
+	unsigned long flags;
+	int rc;
+
+	if (copy_from_user(&cf, arg, sizeof(cf))) {
+		ERR_COPY_FROM_USER();
+		return -EFAULT;
+	}
+	if (cf.consumer <= MSM_FRAME_CONSUMER_PREVIEW ||
+			cf.consumer >= MSM_FRAME_CONSUMER_MAX)
+		return -EINVAL;
+
+	c = &sync->consumers[cf.consumer];
+	rc = wait_event_interruptible(c->wait,
+			!list_empty_careful(&c->list) || !c->paths);
+	if (rc < 0)
+		return rc;
+
+	spin_lock_irqsave(&sync->frame_lock, flags);
+	if (!list_empty(&c->list)) {
+		region = msm_consumer_to_region(c->list.next, cf.consumer);
+		list_del_init(&region->consumer_node[cf.consumer]);
+		msm_frame_fill(region, &cf.frame);
+	}
+	spin_unlock_irqrestore(&sync->frame_lock, flags);
+
+	if (!region)
+		return -EAGAIN;
+
+	if (copy_to_user(arg, &cf, sizeof(cf))) {
+		ERR_COPY_TO_USER();
+		return -EFAULT;
+	}
+	return 0;
+}
+
 static int __msm_get_frame(struct msm_sync *sync,
 		struct msm_frame *frame)
 {
@@ -492,6 +767,7 @@ static int __msm_get_frame(struct msm_sync *sync,
 	frame->cbcr_off = region->info.cbcr_off;
 	frame->fd = region->info.fd;
 	frame->path = vdata->phy.output_id;
+	msm_frame_share(sync, region, vdata->phy.output_id);
 	CDBG("%s: y %x, cbcr %x, qcmd %x, virt_addr %x\n",
 		__func__,
 		pphy->y_phy, pphy->cbcr_phy, (int) qcmd, (int) frame->buffer);
@@ -651,6 +927,7 @@ static struct msm_queue_cmd *__msm_control_nb(struct msm_sync *sync,
 	memcpy(udata->value, udata_to_copy->value, udata_to_copy->length);
 
 	qcmd->on_heap = 1;
+	qcmd->pool = NULL;
 
 	/* qcmd_resp will be set to NULL */
 	return __msm_control(sync, NULL, qcmd, 0);
@@ -679,6 +956,7 @@ static int msm_control(struct msm_control_device *ctrl_pmsm,
 	udata.value = data;
 
 	qcmd.on_heap = 0;
+	qcmd.pool = NULL;
 	qcmd.type = MSM_CAM_Q_CTRL;
 	qcmd.command = &udata;
 
@@ -1193,7 +1471,7 @@ static int msm_frame_axi_cfg(struct msm_sync *sync,
 		if (!axi_data.bufnum2) {
 			pr_err("%s %d: pmem region lookup error (empty %d)\n",
 				__func__, __LINE__,
-				hlist_empty(&sync->pmem_frames));
+				hlist_empty(&sync->pmem_frames.list));
 			return -EINVAL;
 		}
 		break;
@@ -1231,7 +1509,7 @@ static int msm_frame_axi_cfg(struct msm_sync *sync,
 		if (!axi_data.bufnum2) {
 			pr_err("%s %d: pmem region lookup error (empty %d)\n",
 				__func__, __LINE__,
-				hlist_empty(&sync->pmem_frames));
+				hlist_empty(&sync->pmem_frames.list));
 			return -EINVAL;
 		}
 		break;
@@ -1351,23 +1629,22 @@ static int __msm_put_frame_buf(struct msm_sync *sync,
 		struct msm_frame *pb)
 {
 	unsigned long pphy;
-	struct msm_vfe_cfg_cmd cfgcmd;
+	int held = 0;
 
 	int rc = -EIO;
 
 	pphy = msm_pmem_frame_vtop_lookup(sync,
 		pb->buffer,
-		pb->y_off, pb->cbcr_off, pb->fd);
+		pb->y_off, pb->cbcr_off, pb->fd, &held);
 
-	if (pphy != 0) {
+	if (pphy != 0 && held) {
+		CDBG("%s: rel: vaddr %lx still held\n", __func__, pb->buffer);
+		rc = 0;
+	} else if (pphy != 0) {
 		CDBG("%s: rel: vaddr %lx, paddr %lx\n",
 			__func__,
 			pb->buffer, pphy);
-		cfgcmd.cmd_type = CMD_FRAME_BUF_RELEASE;
-		cfgcmd.value    = (void *)pb;
-		if (sync->vfefn.vfe_config) {
-			rc = sync->vfefn.vfe_config(&cfgcmd, &pphy);
-    }
+		rc = msm_frame_give_back(sync, pb, pphy);
 	} else {
 		pr_err("%s: msm_pmem_frame_vtop_lookup failed\n",
 			__func__);
@@ -1969,6 +2246,13 @@ static long msm_ioctl_frame(struct file *filep, unsigned int cmd,
 	case MSM_CAM_IOCTL_UNBLOCK_POLL_FRAME:
 		rc = msm_unblock_poll_frame(pmsm->sync);
 		break;
+	case MSM_CAM_IOCTL_FRAME_CONSUMER:
+		rc = msm_frame_consumer_cfg(pmsm->sync, argp);
+		break;
+	case MSM_CAM_IOCTL_GETFRAME_CONSUMER:
+		/* blocks until a frame is shared with the consumer */
+		rc = msm_get_consumer_frame(pmsm->sync, argp);
+		break;
 	default:
 		break;
 	}
@@ -2033,6 +2317,7 @@ static int __msm_release(struct msm_sync *sync)
 	struct msm_pmem_region *region;
 	struct hlist_node *hnode;
 	struct hlist_node *n;
+	int i;
        pr_info("%s:sync->opencnt:%d \n", __func__, sync->opencnt);
 	mutex_lock(&sync->lock);
 	if (sync->opencnt)
@@ -2052,24 +2337,41 @@ static int __msm_release(struct msm_sync *sync)
 
 		/*sensor release moved to vfe_release*/
 
-		hlist_for_each_entry_safe(region, hnode, n,
-				&sync->pmem_frames, list) {
-			hlist_del(hnode);
-			put_pmem_file(region->file);
-			kfree(region);
+		/* the VFE is gone, so frames still held by other consumers
+		 * are simply forgotten */
+		for (i = MSM_FRAME_CONSUMER_PREVIEW + 1;
+				i < MSM_FRAME_CONSUMER_MAX; i++) {
+			struct msm_frame_consumer *c = &sync->consumers[i];
+			unsigned long flags;
+
+			spin_lock_irqsave(&sync->frame_lock, flags);
+			c->paths = 0;
+			while (!list_empty(&c->list))
+				list_del_init(c->list.next);
+			spin_unlock_irqrestore(&sync->frame_lock, flags);
+			wake_up(&c->wait);
 		}
 
 		hlist_for_each_entry_safe(region, hnode, n,
-				&sync->pmem_stats, list) {
-			hlist_del(hnode);
-			put_pmem_file(region->file);
-			kfree(region);
-		}
+				&sync->pmem_frames.list, list)
+			msm_pmem_table_remove(sync, &sync->pmem_frames,
+					region);
+
+		hlist_for_each_entry_safe(region, hnode, n,
+				&sync->pmem_stats.list, list)
+			msm_pmem_table_remove(sync, &sync->pmem_stats,
+					region);
 
 		msm_queue_drain(&sync->event_q, list_config);
 		msm_queue_drain(&sync->frame_q, list_frame);
 		msm_queue_drain(&sync->pict_q, list_pict);
 
+		pr_info("%s: event pool: peak %d of %d slots, %lu overflowed, "
+			"%lu dropped\n", __func__,
+			MSM_QCMD_POOL_SLOTS - sync->qcmd_pool.min_free,
+			MSM_QCMD_POOL_SLOTS, sync->qcmd_pool.overflow,
+			sync->qcmd_pool.dropped);
+
 		wake_unlock(&sync->wake_suspend_lock);
 		wake_unlock(&sync->wake_lock);
 
@@ -2167,15 +2469,17 @@ static unsigned int msm_poll_frame(struct file *filep,
  */
 
 static void *msm_vfe_sync_alloc(int size,
-			void *syncdata __attribute__((unused)),
+			void *syncdata,
 			gfp_t gfp)
 {
-	struct msm_queue_cmd *qcmd =
-		kzalloc(sizeof(struct msm_queue_cmd) + size, gfp);
-	if (qcmd) {
-		/* Becker and kant */
-		memset(qcmd, 0x0, sizeof(struct msm_queue_cmd) + size);
+	struct msm_sync *sync = (struct msm_sync *)syncdata;
+	struct msm_queue_cmd *qcmd;
 
+	if (sync && sync->qcmd_pool.slots)
+		qcmd = msm_qcmd_alloc(&sync->qcmd_pool, size, gfp);
+	else
+		qcmd = kzalloc(sizeof(struct msm_queue_cmd) + size, gfp);
+	if (qcmd) {
 		qcmd->on_heap = 1;
 		return qcmd + 1;
 	}
@@ -2189,7 +2493,7 @@ static void msm_vfe_sync_free(void *ptr)
 			(struct msm_queue_cmd *)ptr;
 		qcmd--;
 		if (qcmd->on_heap)
-			kfree(qcmd);
+			msm_qcmd_release(qcmd);
 	}
 }
 
@@ -2358,8 +2662,8 @@ static int __msm_open(struct msm_sync *sync, const char *const apps_id)
 		}
 
 		if (rc >= 0) {
-			INIT_HLIST_HEAD(&sync->pmem_frames);
-			INIT_HLIST_HEAD(&sync->pmem_stats);
+			msm_pmem_table_init(&sync->pmem_frames, 1);
+			msm_pmem_table_init(&sync->pmem_stats, 0);
 			sync->unblock_poll_frame = 0;
 		}
 	}
@@ -2727,7 +3031,7 @@ static int msm_sync_init(struct msm_sync *sync,
 		int (*sensor_probe)(struct msm_camera_sensor_info *,
 				struct msm_sensor_ctrl *), int camera_node)
 {
-	int rc = 0;
+	int rc = 0, i;
 	struct msm_sensor_ctrl sctrl;
 	sync->sdata = pdev->dev.platform_data;
 
@@ -2735,12 +3039,27 @@ static int msm_sync_init(struct msm_sync *sync,
 	msm_queue_init(&sync->frame_q, "frame");
 	msm_queue_init(&sync->pict_q, "pict");
 
+	rc = msm_qcmd_pool_init(&sync->qcmd_pool);
+	if (rc < 0)
+		return rc;
+
+	spin_lock_init(&sync->frame_lock);
+	for (i = 0; i < MSM_FRAME_CONSUMER_MAX; i++) {
+		sync->consumers[i].paths = 0;
+		INIT_LIST_HEAD(&sync->consumers[i].list);
+		init_waitqueue_head(&sync->consumers[i].wait);
+	}
+
 	wake_lock_init(&sync->wake_suspend_lock, WAKE_LOCK_SUSPEND, "msm_camera_wake");
 	wake_lock_init(&sync->wake_lock, WAKE_LOCK_IDLE, "msm_camera");
 
 	rc = msm_camio_probe_on(pdev);
-	if (rc < 0)
+	if (rc < 0) {
+		wake_lock_destroy(&sync->wake_suspend_lock);
+		wake_lock_destroy(&sync->wake_lock);
+		msm_qcmd_pool_destroy(&sync->qcmd_pool);
 		return rc;
+	}
 	sctrl.node = camera_node;
 	pr_info("sctrl.node %d\n", sctrl.node);
 	rc = sensor_probe(sync->sdata, &sctrl);
@@ -2755,6 +3074,7 @@ static int msm_sync_init(struct msm_sync *sync,
 			sync->sdata->sensor_name);
 		wake_lock_destroy(&sync->wake_suspend_lock);
 		wake_lock_destroy(&sync->wake_lock);
+		msm_qcmd_pool_destroy(&sync->qcmd_pool);
 		return rc;
 	}
 
@@ -2768,6 +3088,7 @@ static int msm_sync_destroy(struct msm_sync *sync)
 {
 	wake_lock_destroy(&sync->wake_suspend_lock);
 	wake_lock_destroy(&sync->wake_lock);
+	msm_qcmd_pool_destroy(&sync->qcmd_pool);
 	return 0;
 }
 
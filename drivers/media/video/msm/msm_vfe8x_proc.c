@@ -23,6 +23,7 @@
 #include <linux/list.h>
 #include <linux/delay.h>
 #include <linux/platform_device.h>
+#include <linux/bitmap.h>
 #include "msm_vfe8x_proc.h"
 #include <media/msm_camera.h>
 #include <mach/board.h>
@@ -36,6 +37,13 @@ struct isr_queue_cmd {
 	struct vfe_bus_performance_monitor vfePmData;
 };
 
+/* Image quality and stats blocks are rewritten on every 3A update, mostly
+ * with the values they already hold. Keep what was last written to them
+ * and to the gamma and luma adaptation RAMs so only changes go out.
+ */
+#define VFE_SHADOW_WORDS	(0x400 >> 2)
+#define VFE_DMI_SHADOW_TABLES	8
+
 struct msm_vfe8x_ctrl {
 	/* bit 1:0 ENC_IRQ_MASK = 0x11:
 	 * generate IRQ when both y and cbcr frame is ready. */
@@ -98,6 +106,11 @@ struct msm_vfe8x_ctrl {
 	int vfeirq;
 	void __iomem *vfebase;
 
+	uint32_t regShadow[VFE_SHADOW_WORDS];
+	DECLARE_BITMAP(regShadowValid, VFE_SHADOW_WORDS);
+	int16_t dmiShadow[VFE_DMI_SHADOW_TABLES][VFE_GAMMA_TABLE_LENGTH];
+	uint32_t dmiShadowValid;
+
 	void *syncdata;
 	struct msm_camera_sensor_info *s_info;
 };
@@ -116,6 +129,33 @@ static void vfe_prog_hw(uint8_t *hwreg, uint32_t *inptr, uint32_t regcnt)
 	/* *p++ = *inptr++; */
 }
 
+/* Only for blocks that are never written with a plain writel(), or the
+ * shadow would go stale.
+ */
+static void vfe_prog_hw_shadow(uint8_t *hwreg, uint32_t *inptr,
+			       uint32_t regcnt)
+{
+	uint32_t i;
+	uint32_t w = (hwreg - (uint8_t *)ctrl->vfebase) >> 2;
+
+	for (i = 0; i < (regcnt >> 2); i++, w++, inptr++) {
+		if (w < VFE_SHADOW_WORDS) {
+			if (test_bit(w, ctrl->regShadowValid) &&
+			    ctrl->regShadow[w] == *inptr)
+				continue;
+			ctrl->regShadow[w] = *inptr;
+			set_bit(w, ctrl->regShadowValid);
+		}
+		writel(*inptr, ctrl->vfebase + (w << 2));
+	}
+}
+
+static void vfe_shadow_invalidate(void)
+{
+	bitmap_zero(ctrl->regShadowValid, VFE_SHADOW_WORDS);
+	ctrl->dmiShadowValid = 0;
+}
+
 static void
 vfe_set_bus_pipo_addr(struct vfe_output_path_combo *vpath,
 		      struct vfe_output_path_combo *epath)
@@ -339,6 +379,43 @@ static void vfe_program_dmi_cfg(enum VFE_DMI_RAM_SEL bankSel)
 	writel(0, ctrl->vfebase + VFE_DMI_ADDR);
 }
 
+static int vfe_dmi_shadow_index(enum VFE_DMI_RAM_SEL bankSel)
+{
+	if (bankSel >= RGBLUT_RAM_CH0_BANK0 && bankSel <= RGBLUT_RAM_CH2_BANK1)
+		return bankSel - RGBLUT_RAM_CH0_BANK0;
+	if (bankSel == LUMA_ADAPT_LUT_RAM_BANK0 ||
+	    bankSel == LUMA_ADAPT_LUT_RAM_BANK1)
+		return 6 + bankSel - LUMA_ADAPT_LUT_RAM_BANK0;
+	return -1;
+}
+
+/* gamma and luma adaptation tables are both 256 entries */
+static void vfe_write_dmi_table(enum VFE_DMI_RAM_SEL bankSel, int16_t *pTable)
+{
+	int idx = vfe_dmi_shadow_index(bankSel);
+	int i;
+
+	if (idx >= 0 && (ctrl->dmiShadowValid & (1 << idx)) &&
+	    !memcmp(ctrl->dmiShadow[idx], pTable,
+		    sizeof(ctrl->dmiShadow[idx])))
+		return;
+
+	vfe_program_dmi_cfg(bankSel);
+
+	for (i = 0; i < VFE_GAMMA_TABLE_LENGTH; i++)
+		writel((uint32_t) pTable[i], ctrl->vfebase + VFE_DMI_DATA_LO);
+
+	/* After DMI transfer, need to set the DMI_CFG to unselect any SRAM
+	   unselect the SRAM Bank. */
+	writel(VFE_DMI_CFG_DEFAULT, ctrl->vfebase + VFE_DMI_CFG);
+
+	if (idx >= 0) {
+		memcpy(ctrl->dmiShadow[idx], pTable,
+		       sizeof(ctrl->dmiShadow[idx]));
+		ctrl->dmiShadowValid |= 1 << idx;
+	}
+}
+
 static void vfe_write_lens_roll_off_table(struct vfe_cmd_roll_off_config *in)
 {
 	uint16_t i;
@@ -401,6 +478,7 @@ static void vfe_write_lens_roll_off_table(struct vfe_cmd_roll_off_config *in)
 
 static void vfe_set_default_reg_values(void)
 {
+	vfe_shadow_invalidate();
 	writel(0x800080, ctrl->vfebase + VFE_DEMUX_GAIN_0);
 	writel(0x800080, ctrl->vfebase + VFE_DEMUX_GAIN_1);
 	writel(0xFFFFF, ctrl->vfebase + VFE_CGC_OVERRIDE);
@@ -443,6 +521,7 @@ static void vfe_program_reg_update_cmd(uint32_t value)
 
 static void vfe_program_global_reset_cmd(uint32_t value)
 {
+	vfe_shadow_invalidate();
 	writel(value, ctrl->vfebase + VFE_GLOBAL_RESET_CMD);
 }
 
@@ -1092,8 +1171,6 @@ static void vfe_process_stats_awb_irq(void)
 static void vfe_write_gamma_table(uint8_t channel,
 				  boolean bank, int16_t *pTable)
 {
-	uint16_t i;
-
 	enum VFE_DMI_RAM_SEL dmiRamSel = NO_MEM_SELECTED;
 
 	switch (channel) {
@@ -1122,16 +1199,7 @@ static void vfe_write_gamma_table(uint8_t channel,
 		break;
 	}
 
-	vfe_program_dmi_cfg(dmiRamSel);
-
-	for (i = 0; i < VFE_GAMMA_TABLE_LENGTH; i++) {
-		writel((uint32_t) (*pTable), ctrl->vfebase + VFE_DMI_DATA_LO);
-		pTable++;
-	}
-
-	/* After DMI transfer, need to set the DMI_CFG to unselect any SRAM
-	   unselect the SRAM Bank. */
-	writel(VFE_DMI_CFG_DEFAULT, ctrl->vfebase + VFE_DMI_CFG);
+	vfe_write_dmi_table(dmiRamSel, pTable);
 }
 
 static void vfe_prog_hw_testgen_cmd(uint32_t value)
@@ -2595,7 +2663,6 @@ void vfe_la_update(struct vfe_cmd_la_config *in)
 {
 	int16_t *pTable;
 	enum VFE_DMI_RAM_SEL dmiRamSel;
-	int i;
 
 	pTable = in->table;
 	ctrl->vfeModuleEnableLocal.lumaAdaptationEnable = in->enable;
@@ -2608,23 +2675,12 @@ void vfe_la_update(struct vfe_cmd_la_config *in)
 	else
 		dmiRamSel = LUMA_ADAPT_LUT_RAM_BANK1;
 
-	/* configure the DMI_CFG to select right sram */
-	vfe_program_dmi_cfg(dmiRamSel);
-
-	for (i = 0; i < VFE_LA_TABLE_LENGTH; i++) {
-		writel((uint32_t) (*pTable), ctrl->vfebase + VFE_DMI_DATA_LO);
-		pTable++;
-	}
-
-	/* After DMI transfer, to make it safe, need to set
-	 * the DMI_CFG to unselect any SRAM */
-	writel(VFE_DMI_CFG_DEFAULT, ctrl->vfebase + VFE_DMI_CFG);
+	vfe_write_dmi_table(dmiRamSel, pTable);
 	writel(ctrl->vfeLaBankSel, ctrl->vfebase + VFE_LA_CFG);
 }
 
 void vfe_la_config(struct vfe_cmd_la_config *in)
 {
-	uint16_t i;
 	int16_t *pTable;
 	enum VFE_DMI_RAM_SEL dmiRamSel;
 
@@ -2636,17 +2692,7 @@ void vfe_la_config(struct vfe_cmd_la_config *in)
 	else
 		dmiRamSel = LUMA_ADAPT_LUT_RAM_BANK1;
 
-	/* configure the DMI_CFG to select right sram */
-	vfe_program_dmi_cfg(dmiRamSel);
-
-	for (i = 0; i < VFE_LA_TABLE_LENGTH; i++) {
-		writel((uint32_t) (*pTable), ctrl->vfebase + VFE_DMI_DATA_LO);
-		pTable++;
-	}
-
-	/* After DMI transfer, to make it safe, need to set the
-	 * DMI_CFG to unselect any SRAM */
-	writel(VFE_DMI_CFG_DEFAULT, ctrl->vfebase + VFE_DMI_CFG);
+	vfe_write_dmi_table(dmiRamSel, pTable);
 
 	/* can only be bank 0 or bank 1 for now. */
 	writel(ctrl->vfeLaBankSel, ctrl->vfebase + VFE_LA_CFG);
@@ -2776,8 +2822,8 @@ void vfe_color_correction_config(struct vfe_cmd_color_correction_config *in)
 
 	cmd.coefQFactor = in->coefQFactor;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_COLOR_CORRECT_COEFF_0,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_COLOR_CORRECT_COEFF_0,
+			   (uint32_t *)&cmd, sizeof(cmd));
 }
 
 void vfe_demosaic_abf_update(struct vfe_cmd_demosaic_abf_update *in)
@@ -2793,15 +2839,15 @@ void vfe_demosaic_abf_update(struct vfe_cmd_demosaic_abf_update *in)
 	cmd.abfEnable = in->abfUpdate.enable;
 	cmd.forceAbfOn = in->abfUpdate.forceOn;
 	cmd.abfShift = in->abfUpdate.shift;
-	vfe_prog_hw(ctrl->vfebase + VFE_DEMOSAIC_CFG,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_DEMOSAIC_CFG,
+			   (uint32_t *)&cmd, sizeof(cmd));
 
 	cmdabf.lpThreshold = in->abfUpdate.lpThreshold;
 	cmdabf.ratio = in->abfUpdate.ratio;
 	cmdabf.minValue = in->abfUpdate.min;
 	cmdabf.maxValue = in->abfUpdate.max;
-	vfe_prog_hw(ctrl->vfebase + VFE_DEMOSAIC_ABF_CFG_0,
-		    (uint32_t *)&cmdabf, sizeof(cmdabf));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_DEMOSAIC_ABF_CFG_0,
+			   (uint32_t *)&cmdabf, sizeof(cmdabf));
 }
 
 void vfe_demosaic_bpc_update(struct vfe_cmd_demosaic_bpc_update *in)
@@ -2819,15 +2865,15 @@ void vfe_demosaic_bpc_update(struct vfe_cmd_demosaic_bpc_update *in)
 	cmd.fminThreshold = in->bpcUpdate.fminThreshold;
 	cmd.fmaxThreshold = in->bpcUpdate.fmaxThreshold;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_DEMOSAIC_CFG,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_DEMOSAIC_CFG,
+			   (uint32_t *)&cmd, sizeof(cmd));
 
 	cmdbpc.blueDiffThreshold = in->bpcUpdate.blueDiffThreshold;
 	cmdbpc.redDiffThreshold = in->bpcUpdate.redDiffThreshold;
 	cmdbpc.greenDiffThreshold = in->bpcUpdate.greenDiffThreshold;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_DEMOSAIC_BPC_CFG_0,
-		    (uint32_t *)&cmdbpc, sizeof(cmdbpc));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_DEMOSAIC_BPC_CFG_0,
+			   (uint32_t *)&cmdbpc, sizeof(cmdbpc));
 }
 
 void vfe_demosaic_config(struct vfe_cmd_demosaic_config *in)
@@ -2850,23 +2896,23 @@ void vfe_demosaic_config(struct vfe_cmd_demosaic_config *in)
 	cmd.fmaxThreshold = in->bpcConfig.fmaxThreshold;
 	cmd.slopeShift = in->slopeShift;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_DEMOSAIC_CFG,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_DEMOSAIC_CFG,
+			   (uint32_t *)&cmd, sizeof(cmd));
 
 	cmd_abf.lpThreshold = in->abfConfig.lpThreshold;
 	cmd_abf.ratio = in->abfConfig.ratio;
 	cmd_abf.minValue = in->abfConfig.min;
 	cmd_abf.maxValue = in->abfConfig.max;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_DEMOSAIC_ABF_CFG_0,
-		    (uint32_t *)&cmd_abf, sizeof(cmd_abf));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_DEMOSAIC_ABF_CFG_0,
+			   (uint32_t *)&cmd_abf, sizeof(cmd_abf));
 
 	cmd_bpc.blueDiffThreshold = in->bpcConfig.blueDiffThreshold;
 	cmd_bpc.redDiffThreshold = in->bpcConfig.redDiffThreshold;
 	cmd_bpc.greenDiffThreshold = in->bpcConfig.greenDiffThreshold;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_DEMOSAIC_BPC_CFG_0,
-		    (uint32_t *)&cmd_bpc, sizeof(cmd_bpc));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_DEMOSAIC_BPC_CFG_0,
+			   (uint32_t *)&cmd_bpc, sizeof(cmd_bpc));
 }
 
 void vfe_demux_channel_gain_update(struct vfe_cmd_demux_channel_gain_config *in)
@@ -2880,8 +2926,8 @@ void vfe_demux_channel_gain_update(struct vfe_cmd_demux_channel_gain_config *in)
 	cmd.ch1Gain = in->ch1Gain;
 	cmd.ch2Gain = in->ch2Gain;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_DEMUX_GAIN_0,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_DEMUX_GAIN_0,
+			   (uint32_t *)&cmd, sizeof(cmd));
 }
 
 void vfe_demux_channel_gain_config(struct vfe_cmd_demux_channel_gain_config *in)
@@ -2895,8 +2941,8 @@ void vfe_demux_channel_gain_config(struct vfe_cmd_demux_channel_gain_config *in)
 	cmd.ch1Gain = in->ch1Gain;
 	cmd.ch2Gain = in->ch2Gain;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_DEMUX_GAIN_0,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_DEMUX_GAIN_0,
+			   (uint32_t *)&cmd, sizeof(cmd));
 }
 
 void vfe_black_level_update(struct vfe_cmd_black_level_config *in)
@@ -2911,8 +2957,8 @@ void vfe_black_level_update(struct vfe_cmd_black_level_config *in)
 	cmd.oddEvenAdjustment = in->oddEvenAdjustment;
 	cmd.oddOddAdjustment = in->oddOddAdjustment;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_BLACK_EVEN_EVEN_VALUE,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_BLACK_EVEN_EVEN_VALUE,
+			   (uint32_t *)&cmd, sizeof(cmd));
 }
 
 void vfe_black_level_config(struct vfe_cmd_black_level_config *in)
@@ -2927,8 +2973,8 @@ void vfe_black_level_config(struct vfe_cmd_black_level_config *in)
 	cmd.oddEvenAdjustment = in->oddEvenAdjustment;
 	cmd.oddOddAdjustment = in->oddOddAdjustment;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_BLACK_EVEN_EVEN_VALUE,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_BLACK_EVEN_EVEN_VALUE,
+			   (uint32_t *)&cmd, sizeof(cmd));
 }
 
 void vfe_asf_update(struct vfe_cmd_asf_update *in)
@@ -2970,8 +3016,8 @@ void vfe_asf_update(struct vfe_cmd_asf_update *in)
 	cmd.F2Coeff7 = in->filter2Coefficients[7];
 	cmd.F2Coeff8 = in->filter2Coefficients[8];
 
-	vfe_prog_hw(ctrl->vfebase + VFE_ASF_CFG,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_ASF_CFG,
+			   (uint32_t *)&cmd, sizeof(cmd));
 }
 
 void vfe_asf_config(struct vfe_cmd_asf_config *in)
@@ -3016,16 +3062,16 @@ void vfe_asf_config(struct vfe_cmd_asf_config *in)
 	cmd.F2Coeff7 = in->filter2Coefficients[7];
 	cmd.F2Coeff8 = in->filter2Coefficients[8];
 
-	vfe_prog_hw(ctrl->vfebase + VFE_ASF_CFG,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_ASF_CFG,
+			   (uint32_t *)&cmd, sizeof(cmd));
 
 	cmd2.firstLine = in->cropFirstLine;
 	cmd2.lastLine = in->cropLastLine;
 	cmd2.firstPixel = in->cropFirstPixel;
 	cmd2.lastPixel = in->cropLastPixel;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_ASF_CROP_WIDTH_CFG,
-		    (uint32_t *)&cmd2, sizeof(cmd2));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_ASF_CROP_WIDTH_CFG,
+			   (uint32_t *)&cmd2, sizeof(cmd2));
 }
 
 void vfe_white_balance_config(struct vfe_cmd_white_balance_config *in)
@@ -3039,8 +3085,8 @@ void vfe_white_balance_config(struct vfe_cmd_white_balance_config *in)
 	cmd.ch1Gain = in->ch1Gain;
 	cmd.ch2Gain = in->ch2Gain;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_WB_CFG,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_WB_CFG,
+			   (uint32_t *)&cmd, sizeof(cmd));
 }
 
 void vfe_chroma_sup_config(struct vfe_cmd_chroma_suppression_config *in)
@@ -3057,8 +3103,8 @@ void vfe_chroma_sup_config(struct vfe_cmd_chroma_suppression_config *in)
 	cmd.mm1 = in->mm1;
 	cmd.nn1 = in->nn1;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_CHROMA_SUPPRESS_CFG_0,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_CHROMA_SUPPRESS_CFG_0,
+			   (uint32_t *)&cmd, sizeof(cmd));
 }
 
 void vfe_roll_off_config(struct vfe_cmd_roll_off_config *in)
@@ -3234,15 +3280,15 @@ void vfe_stats_update_wb_exp(struct vfe_cmd_stats_wb_exp_update *in)
 	cmd.c2 = in->awbCCFG[1];
 	cmd.c3 = in->awbCCFG[2];
 	cmd.c4 = in->awbCCFG[3];
-	vfe_prog_hw(ctrl->vfebase + VFE_STATS_AWB_MCFG,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_STATS_AWB_MCFG,
+			   (uint32_t *)&cmd, sizeof(cmd));
 
 	cmd2.aeRegionCfg = in->wbExpRegions;
 	cmd2.aeSubregionCfg = in->wbExpSubRegion;
 	cmd2.awbYMin = in->awbYMin;
 	cmd2.awbYMax = in->awbYMax;
-	vfe_prog_hw(ctrl->vfebase + VFE_STATS_AWBAE_CFG,
-		    (uint32_t *)&cmd2, sizeof(cmd2));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_STATS_AWBAE_CFG,
+			   (uint32_t *)&cmd2, sizeof(cmd2));
 }
 
 void vfe_stats_update_af(struct vfe_cmd_stats_af_update *in)
@@ -3256,8 +3302,8 @@ void vfe_stats_update_af(struct vfe_cmd_stats_af_update *in)
 	cmd.windowHeight = in->windowHeight;
 	cmd.windowWidth = in->windowWidth;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_STATS_AF_CFG,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_STATS_AF_CFG,
+			   (uint32_t *)&cmd, sizeof(cmd));
 }
 
 void vfe_stats_start_wb_exp(struct vfe_cmd_stats_wb_exp_start *in)
@@ -3281,19 +3327,19 @@ void vfe_stats_start_wb_exp(struct vfe_cmd_stats_wb_exp_start *in)
 	cmd.c2 = in->awbCCFG[1];
 	cmd.c3 = in->awbCCFG[2];
 	cmd.c4 = in->awbCCFG[3];
-	vfe_prog_hw(ctrl->vfebase + VFE_STATS_AWB_MCFG,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_STATS_AWB_MCFG,
+			   (uint32_t *)&cmd, sizeof(cmd));
 
 	cmd2.aeRegionCfg = in->wbExpRegions;
 	cmd2.aeSubregionCfg = in->wbExpSubRegion;
 	cmd2.awbYMin = in->awbYMin;
 	cmd2.awbYMax = in->awbYMax;
-	vfe_prog_hw(ctrl->vfebase + VFE_STATS_AWBAE_CFG,
-		    (uint32_t *)&cmd2, sizeof(cmd2));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_STATS_AWBAE_CFG,
+			   (uint32_t *)&cmd2, sizeof(cmd2));
 
 	cmd3.axwHeader = in->axwHeader;
-	vfe_prog_hw(ctrl->vfebase + VFE_STATS_AXW_HEADER,
-		    (uint32_t *)&cmd3, sizeof(cmd3));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_STATS_AXW_HEADER,
+			   (uint32_t *)&cmd3, sizeof(cmd3));
 }
 
 void vfe_stats_start_af(struct vfe_cmd_stats_af_start *in)
@@ -3313,8 +3359,8 @@ void vfe_stats_start_af(struct vfe_cmd_stats_af_start *in)
 	cmd.windowHeight = in->windowHeight;
 	cmd.windowWidth = in->windowWidth;
 
-	vfe_prog_hw(ctrl->vfebase + VFE_STATS_AF_CFG,
-		    (uint32_t *)&cmd, sizeof(cmd));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_STATS_AF_CFG,
+			   (uint32_t *)&cmd, sizeof(cmd));
 
 	cmd2.a00 = in->highPassCoef[0];
 	cmd2.a04 = in->highPassCoef[1];
@@ -3343,8 +3389,8 @@ void vfe_stats_start_af(struct vfe_cmd_stats_af_start *in)
 	cmd2.entry32 = in->gridForMultiWindows[14];
 	cmd2.entry33 = in->gridForMultiWindows[15];
 
-	vfe_prog_hw(ctrl->vfebase + VFE_STATS_AF_GRID_0,
-		    (uint32_t *)&cmd2, sizeof(cmd2));
+	vfe_prog_hw_shadow(ctrl->vfebase + VFE_STATS_AF_GRID_0,
+			   (uint32_t *)&cmd2, sizeof(cmd2));
 }
 
 void vfe_stats_setting(struct vfe_cmd_stats_setting *in)
@@ -4073,5 +4119,6 @@ void vfe_reset(void)
 	/* enable reset_ack interrupt.  */
 	writel(ctrl->vfeImaskPacked, ctrl->vfebase + VFE_IRQ_MASK);
 
+	vfe_shadow_invalidate();
 	writel(VFE_RESET_UPON_RESET_CMD, ctrl->vfebase + VFE_GLOBAL_RESET_CMD);
 }
@@ -187,6 +187,8 @@ static int mt9p012_i2c_read_w(unsigned short saddr, unsigned short raddr,
 	return rc;
 }
 
+#define MT9P012_BURST_MAX 16
+
 static int mt9p012_i2c_txdata(unsigned short saddr, unsigned char *txdata,
 				  int length)
 {
@@ -249,16 +251,39 @@ static int mt9p012_i2c_write_w(unsigned short saddr, unsigned short waddr,
 static int mt9p012_i2c_write_w_table(struct mt9p012_i2c_reg_conf
 					 *reg_conf_tbl, int num)
 {
+	unsigned char buf[2 + 2 * MT9P012_BURST_MAX];
+	unsigned short waddr = 0;
+	int len = 0;
 	int i;
-	int rc = -EIO;
+	int rc = 0;
 
-	for (i = 0; i < num; i++) {
-		rc = mt9p012_i2c_write_w(mt9p012_client->addr,
-					 reg_conf_tbl->waddr,
-					 reg_conf_tbl->wdata);
-		if (rc < 0)
-			break;
-		reg_conf_tbl++;
+	/* consecutive words go out as one auto-increment write */
+	for (i = 0; i <= num; i++, reg_conf_tbl++) {
+		if (i < num && len && len < MT9P012_BURST_MAX &&
+		    reg_conf_tbl->waddr == waddr + 2 * len) {
+			buf[2 + 2 * len] = (reg_conf_tbl->wdata & 0xFF00) >> 8;
+			buf[3 + 2 * len] = (reg_conf_tbl->wdata & 0x00FF);
+			len++;
+			continue;
+		}
+		if (len) {
+			buf[0] = (waddr & 0xFF00) >> 8;
+			buf[1] = (waddr & 0x00FF);
+			rc = mt9p012_i2c_txdata(mt9p012_client->addr, buf,
+						2 + 2 * len);
+			if (rc < 0) {
+				pr_err("i2c_write_w_table failed, addr = 0x%x, "
+				       "len = %d!\n", waddr, len);
+				break;
+			}
+			len = 0;
+		}
+		if (i < num) {
+			waddr = reg_conf_tbl->waddr;
+			buf[2] = (reg_conf_tbl->wdata & 0xFF00) >> 8;
+			buf[3] = (reg_conf_tbl->wdata & 0x00FF);
+			len = 1;
+		}
 	}
 
 	return rc;
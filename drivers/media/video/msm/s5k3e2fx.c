@@ -14,6 +14,8 @@
 #include <linux/clk.h>
 #include <linux/wakelock.h>
 #include <linux/earlysuspend.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
 
 
 static uint16_t g_usModuleVersion;	/*0: rev.4, 1: rev.5 */
@@ -1729,6 +1731,62 @@ static inline int s5k3e2fx_i2c_txdata(unsigned short saddr,
 	return i2c_transfer_retry(s5k3e2fx_client->adapter, msg, 1);
 }
 
+/* Shadow of what was last written to the sensor, so a mode switch only
+ * sends the registers that differ from the previous mode. The tables
+ * only touch 0x0000-0x03ff and 0x3000-0x33ff, one page each.
+ */
+#define S5K3E2FX_SHADOW_PAGE	0x400
+#define S5K3E2FX_BURST_MAX	32
+
+static int shadow_writes = 1;
+module_param(shadow_writes, int, S_IRUGO | S_IWUSR);
+
+static uint8_t s5k3e2fx_shadow[2][S5K3E2FX_SHADOW_PAGE];
+static DECLARE_BITMAP(s5k3e2fx_shadow_valid, 2 * S5K3E2FX_SHADOW_PAGE);
+static int s5k3e2fx_writes;
+static int s5k3e2fx_skipped;
+
+static int s5k3e2fx_shadow_index(unsigned short waddr)
+{
+	if (waddr < S5K3E2FX_SHADOW_PAGE)
+		return waddr;
+	if (waddr >= 0x3000 && waddr < 0x3000 + S5K3E2FX_SHADOW_PAGE)
+		return S5K3E2FX_SHADOW_PAGE + waddr - 0x3000;
+	return -1;
+}
+
+static void s5k3e2fx_shadow_invalidate(void)
+{
+	bitmap_zero(s5k3e2fx_shadow_valid, 2 * S5K3E2FX_SHADOW_PAGE);
+}
+
+static void s5k3e2fx_shadow_update(unsigned short waddr, unsigned char bdata)
+{
+	int i = s5k3e2fx_shadow_index(waddr);
+
+	if (i < 0)
+		return;
+	s5k3e2fx_shadow[i / S5K3E2FX_SHADOW_PAGE][i % S5K3E2FX_SHADOW_PAGE] =
+		bdata;
+	set_bit(i, s5k3e2fx_shadow_valid);
+}
+
+static int s5k3e2fx_shadow_match(unsigned short waddr, unsigned char bdata)
+{
+	int i;
+
+	/* mode select, reset and group hold act on every write */
+	if (!shadow_writes || waddr == S5K3E2FX_REG_MODE_SELECT ||
+	    waddr == S5K3E2FX_REG_SOFTWARE_RESET ||
+	    waddr == REG_GROUPED_PARAMETER_HOLD)
+		return 0;
+	i = s5k3e2fx_shadow_index(waddr);
+	if (i < 0 || !test_bit(i, s5k3e2fx_shadow_valid))
+		return 0;
+	return s5k3e2fx_shadow[i / S5K3E2FX_SHADOW_PAGE]
+		[i % S5K3E2FX_SHADOW_PAGE] == bdata;
+}
+
 static int s5k3e2fx_i2c_write_b(unsigned short saddr, unsigned short waddr,
 				    unsigned char bdata)
 {
@@ -1742,28 +1800,78 @@ static int s5k3e2fx_i2c_write_b(unsigned short saddr, unsigned short waddr,
 
 	rc = s5k3e2fx_i2c_txdata(saddr, buf, 3);
 
-	if (rc < 0)
+	if (rc < 0) {
 		pr_err("i2c_write_w failed, addr = 0x%x, val = 0x%x!\n",
 		       waddr, bdata);
+		s5k3e2fx_shadow_invalidate();
+	} else if (waddr == S5K3E2FX_REG_SOFTWARE_RESET)
+		s5k3e2fx_shadow_invalidate();
+	else
+		s5k3e2fx_shadow_update(waddr, bdata);
 
 	return rc;
 }
 
+/* Registers that are unchanged since the last write are dropped, and
+ * runs of consecutive addresses go out as one auto-increment write.
+ */
 static int s5k3e2fx_i2c_write_table(struct s5k3e2fx_i2c_reg_conf
 					*reg_cfg_tbl, int num)
 {
-	int i;
-	int rc = -EFAULT;
+	unsigned char buf[2 + S5K3E2FX_BURST_MAX];
+	unsigned short waddr = 0;
+	int len = 0;
+	int i, j;
+	int rc = 0;
+
 	CDBG("s5k3e2fx_i2c_write_table starts\n");
-	for (i = 0; i < num; i++) {
-		CDBG("%d: waddr = 0x%x, bdata = 0x%x\n", i,
-		     (int)reg_cfg_tbl->waddr, (int)reg_cfg_tbl->bdata);
-		rc = s5k3e2fx_i2c_write_b(s5k3e2fx_client->addr,
-					  reg_cfg_tbl->waddr,
-					  reg_cfg_tbl->bdata);
-		if (rc < 0)
-			break;
-		reg_cfg_tbl++;
+	for (i = 0; i <= num; i++, reg_cfg_tbl++) {
+		if (i < num) {
+			CDBG("%d: waddr = 0x%x, bdata = 0x%x\n", i,
+			     (int)reg_cfg_tbl->waddr,
+			     (int)reg_cfg_tbl->bdata);
+			if (s5k3e2fx_shadow_match(reg_cfg_tbl->waddr,
+						  reg_cfg_tbl->bdata)) {
+				s5k3e2fx_skipped++;
+				continue;
+			}
+			if (len && len < S5K3E2FX_BURST_MAX &&
+			    reg_cfg_tbl->waddr == waddr + len &&
+			    reg_cfg_tbl->waddr != S5K3E2FX_REG_SOFTWARE_RESET) {
+				buf[2 + len++] = reg_cfg_tbl->bdata;
+				continue;
+			}
+		}
+		if (len) {
+			buf[0] = (waddr & 0xFF00) >> 8;
+			buf[1] = (waddr & 0x00FF);
+			rc = s5k3e2fx_i2c_txdata(s5k3e2fx_client->addr,
+						 buf, 2 + len);
+			if (rc < 0) {
+				pr_err("i2c_write_table failed, addr = 0x%x, "
+				       "len = %d!\n", waddr, len);
+				s5k3e2fx_shadow_invalidate();
+				break;
+			}
+			for (j = 0; j < len; j++)
+				s5k3e2fx_shadow_update(waddr + j, buf[2 + j]);
+			s5k3e2fx_writes++;
+			len = 0;
+		}
+		if (i < num) {
+			if (reg_cfg_tbl->waddr == S5K3E2FX_REG_SOFTWARE_RESET) {
+				rc = s5k3e2fx_i2c_write_b(s5k3e2fx_client->addr,
+							  reg_cfg_tbl->waddr,
+							  reg_cfg_tbl->bdata);
+				if (rc < 0)
+					break;
+				s5k3e2fx_writes++;
+				continue;
+			}
+			waddr = reg_cfg_tbl->waddr;
+			buf[2] = reg_cfg_tbl->bdata;
+			len = 1;
+		}
 	}
 
 	CDBG("s5k3e2fx_i2c_write_table ends\n");
@@ -1840,6 +1948,7 @@ static int s5k3e2fx_probe_init_sensor(const struct msm_camera_sensor_info *data)
 	CDBG("s5k3e2fx: gpio_free: %d\n", data->sensor_reset);
 
 	gpio_free(data->sensor_reset);
+	s5k3e2fx_shadow_invalidate();
 
 	msleep(20);
 
@@ -2441,8 +2550,12 @@ static int s5k3e2fx_setting(enum msm_s_reg_update rupdate,
 				enum msm_s_setting rt)
 {
 	int rc = 0;
+	ktime_t start = ktime_get();
+
 	pr_info("s5k3e2fx_setting rupdate:%d g_usModuleVersion:%d\n",
 		rupdate, g_usModuleVersion);
+	s5k3e2fx_writes = 0;
+	s5k3e2fx_skipped = 0;
 	switch (rupdate) {
 	case S_UPDATE_PERIODIC:{
 		if (g_usModuleVersion == 1)
@@ -2487,6 +2600,10 @@ static int s5k3e2fx_setting(enum msm_s_reg_update rupdate,
 		break;
 	} /* switch (rupdate) */
 
+	pr_info("s5k3e2fx_setting done in %lld us, %d i2c writes, "
+		"%d registers unchanged\n",
+		ktime_to_us(ktime_sub(ktime_get(), start)),
+		s5k3e2fx_writes, s5k3e2fx_skipped);
 	return rc;
 }
 
@@ -62,6 +62,10 @@ struct apanic_data {
 	struct proc_dir_entry	*apanic_threads;
 };
 
+/* console pages go out this many at a time, one mtd write per chunk */
+#define APANIC_BOUNCE_ORDER	2
+#define APANIC_BOUNCE_SIZE	(PAGE_SIZE << APANIC_BOUNCE_ORDER)
+
 static struct apanic_data drv_ctx;
 static struct work_struct proc_removal_work;
 static DEFINE_MUTEX(drv_mutex);
@@ -402,8 +406,12 @@ static struct mtd_notifier mtd_panic_notifier = {
 
 static int in_panic = 0;
 
-static int apanic_writeflashpage(struct mtd_info *mtd, loff_t to,
-				 const u_char *buf)
+/*
+ * Writes len bytes, a multiple of the page size that stays within one
+ * erase block, in a single mtd call. Returns the number of bytes written.
+ */
+static int apanic_writeflash(struct mtd_info *mtd, loff_t to,
+			     const u_char *buf, size_t len)
 {
 	int rc;
 	size_t wlen;
@@ -424,9 +432,9 @@ static int apanic_writeflashpage(struct mtd_info *mtd, loff_t to,
 	}
 
 	if (panic)
-		rc = mtd->panic_write(mtd, to, mtd->writesize, &wlen, buf);
+		rc = mtd->panic_write(mtd, to, len, &wlen, buf);
 	else
-		rc = mtd->write(mtd, to, mtd->writesize, &wlen, buf);
+		rc = mtd->write(mtd, to, len, &wlen, buf);
 
 	if (rc) {
 		printk(KERN_EMERG
@@ -438,6 +446,12 @@ static int apanic_writeflashpage(struct mtd_info *mtd, loff_t to,
 	return wlen;
 }
 
+static int apanic_writeflashpage(struct mtd_info *mtd, loff_t to,
+				 const u_char *buf)
+{
+	return apanic_writeflash(mtd, to, buf, mtd->writesize);
+}
+
 extern int log_buf_copy(char *dest, int idx, int len);
 extern void log_buf_clear(void);
 
@@ -451,25 +465,32 @@ static int apanic_write_console(struct mtd_info *mtd, unsigned int off)
 	int saved_oip;
 	int idx = 0;
 	int rc, rc2;
+	size_t chunk, len;
 	unsigned int last_chunk = 0;
 
 	while (!last_chunk) {
+		/* as many pages as fit in the bounce buffer and what is left
+		 * of this erase block, bad blocks are remapped per block */
+		chunk = min_t(size_t, APANIC_BOUNCE_SIZE,
+			      mtd->erasesize - (off & (mtd->erasesize - 1)));
+
 		saved_oip = oops_in_progress;
 		oops_in_progress = 1;
-		rc = log_buf_copy(ctx->bounce, idx, mtd->writesize);
+		rc = log_buf_copy(ctx->bounce, idx, chunk);
 		if (rc < 0)
 			break;
 
-		if (rc != mtd->writesize)
+		if (rc != chunk)
 			last_chunk = rc;
 
 		oops_in_progress = saved_oip;
 		if (rc <= 0)
 			break;
-		if (rc != mtd->writesize)
-			memset(ctx->bounce + rc, 0, mtd->writesize - rc);
+		len = ALIGN(rc, mtd->writesize);
+		if (rc != len)
+			memset(ctx->bounce + rc, 0, len - rc);
 
-		rc2 = apanic_writeflashpage(mtd, off, ctx->bounce);
+		rc2 = apanic_writeflash(mtd, off, ctx->bounce, len);
 		if (rc2 <= 0) {
 			printk(KERN_EMERG
 			       "apanic: Flash write failed (%d)\n", rc2);
@@ -596,7 +617,8 @@ int __init apanic_init(void)
 	atomic_notifier_chain_register(&panic_notifier_list, &panic_blk);
 	debugfs_create_file("apanic", 0644, NULL, NULL, &panic_dbg_fops);
 	memset(&drv_ctx, 0, sizeof(drv_ctx));
-	drv_ctx.bounce = (void *) __get_free_page(GFP_KERNEL);
+	drv_ctx.bounce = (void *) __get_free_pages(GFP_KERNEL,
+						   APANIC_BOUNCE_ORDER);
 	INIT_WORK(&proc_removal_work, apanic_remove_proc_work);
 	printk(KERN_INFO "Android kernel panic handler initialized (bind=%s)\n",
 	       CONFIG_APANIC_PLABEL);
@@ -172,38 +172,25 @@ static int spi_bma150_TransRBuff(short *rbuf)
 	} else {
 		/* For Passion with V01 ~ V05 Microp */
 		/*printk(KERN_DEBUG "%s: Old MicroP command\n", __func__);*/
-		ret = microp_i2c_read(MICROP_I2C_RCMD_GSENSOR_X_DATA,
-					buffer, 2);
+		struct microp_i2c_read_req req[3] = {
+			{ MICROP_I2C_RCMD_GSENSOR_X_DATA, buffer, 2 },
+			{ MICROP_I2C_RCMD_GSENSOR_Y_DATA, buffer + 2, 2 },
+			{ MICROP_I2C_RCMD_GSENSOR_Z_DATA, buffer + 4, 2 },
+		};
+		int i;
+
+		/* all three axes in one transaction */
+		ret = microp_i2c_read_multi(req, 3);
 		if (ret < 0) {
 			printk(KERN_ERR "%s: i2c_read_block fail\n", __func__);
 			mutex_unlock(&gsensor_RW_mutex);
 			return ret;
 		}
-		rbuf[0] = buffer[0]<<2|buffer[1]>>6;
-		if (rbuf[0]&0x200)
-			rbuf[0] -= 1<<10;
-
-		ret = microp_i2c_read(MICROP_I2C_RCMD_GSENSOR_Y_DATA,
-					buffer, 2);
-		if (ret < 0) {
-			printk(KERN_ERR "%s: i2c_read_block fail\n", __func__);
-			mutex_unlock(&gsensor_RW_mutex);
-			return ret;
-			}
-		rbuf[1] = buffer[0]<<2|buffer[1]>>6;
-		if (rbuf[1]&0x200)
-			rbuf[1] -= 1<<10;
-
-		ret = microp_i2c_read(MICROP_I2C_RCMD_GSENSOR_Z_DATA,
-					buffer, 2);
-		if (ret < 0) {
-			printk(KERN_ERR "%s: i2c_read_block fail\n", __func__);
-			mutex_unlock(&gsensor_RW_mutex);
-			return ret;
-			}
-		rbuf[2] = buffer[0]<<2|buffer[1]>>6;
-		if (rbuf[2]&0x200)
-			rbuf[2] -= 1<<10;
+		for (i = 0; i < 3; i++) {
+			rbuf[i] = buffer[2 * i]<<2|buffer[2 * i + 1]>>6;
+			if (rbuf[i]&0x200)
+				rbuf[i] -= 1<<10;
+		}
 	}
 /*	printk("X=%d, Y=%d, Z=%d\n",rbuf[0],rbuf[1],rbuf[2]);*/
 
@@ -24,12 +24,15 @@
 #include <linux/android_pmem.h>
 #include <linux/mempolicy.h>
 #include <linux/sched.h>
+#include <linux/rbtree.h>
+#include <linux/workqueue.h>
+#include <linux/moduleparam.h>
+#include <linux/lendable.h>
 #include <asm/io.h>
 #include <asm/uaccess.h>
 #include <asm/cacheflush.h>
 
 #define PMEM_MAX_DEVICES 10
-#define PMEM_MAX_ORDER 128
 #define PMEM_MIN_ALLOC PAGE_SIZE
 
 #define PMEM_DEBUG 0
@@ -50,12 +53,24 @@
  */
 #define PMEM_FLAGS_SUBMAP 0x1 << 3
 #define PMEM_FLAGS_UNSUBMAP 0x1 << 4
+/* the physical address of this allocation has been handed to userspace or
+ * shared with a connected file, so compaction must never move it */
+#define PMEM_FLAGS_PINNED 0x1 << 5
 
 
 struct pmem_data {
-	/* in alloc mode: an index into the bitmap
+	/* in alloc mode: the first PMEM_MIN_ALLOC unit of the allocation
 	 * in no_alloc mode: the size of the allocation */
 	int index;
+	/* size of the allocation in bytes */
+	unsigned long len;
+	/* number of kernel users holding the physical address through
+	 * get_pmem_file, the allocation can't be moved while this is set */
+	atomic_t pins;
+	/* number of vmas mapping this file, forked copies included */
+	int map_count;
+	/* one of PMEM_MAP_MODE_*, applied when the file is mmaped */
+	unsigned int map_mode;
 	/* see flags above for descriptions */
 	unsigned int flags;
 	/* protects this data field, if the mm_mmap sem will be held at the
@@ -81,9 +96,15 @@ struct pmem_data {
 #endif
 };
 
-struct pmem_bits {
-	unsigned allocated:1;		/* 1 if allocated, 0 if free */
-	unsigned order:7;		/* size of the region in pmem space */
+struct pmem_block {
+	/* start and size of the block in PMEM_MIN_ALLOC units */
+	unsigned long start;
+	unsigned long len;
+	unsigned allocated;
+	/* every block, sorted by start, so neighbours can be coalesced */
+	struct rb_node addr_node;
+	/* free blocks only, sorted by len then start, for best fit */
+	struct rb_node free_node;
 };
 
 struct pmem_region_node {
@@ -115,9 +136,14 @@ struct pmem_info {
 	unsigned long garbage_pfn;
 	/* index of the garbage page in the pmem space */
 	int garbage_index;
-	/* the bitmap for the region indicating which entries are allocated
-	 * and which are free */
-	struct pmem_bits *bitmap;
+	/* the blocks the region is split into, free or allocated, and the
+	 * subset of them that are free */
+	struct rb_root blocks;
+	struct rb_root free_blocks;
+	/* number of free entries in the pmem space */
+	unsigned long free_entries;
+	/* moves movable allocations down when fragmentation fails one */
+	struct work_struct compact_work;
 	/* indicates the region should not be managed with an allocator */
 	unsigned no_allocator;
 	/* indicates maps of this region should be cached, if a mix of
@@ -128,24 +154,29 @@ struct pmem_info {
 	/* in no_allocator mode the first mapper gets the whole space and sets
 	 * this flag */
 	unsigned allocated;
+	/* the region is lent to the page allocator while nothing is
+	 * allocated from it, claimed is set while pmem owns the pages */
+	unsigned lendable;
+	unsigned claimed;
 	/* for debugging, creates a list of pmem file structs, the
 	 * data_list_sem should be taken before pmem_data->sem if both are
 	 * needed */
 	struct semaphore data_list_sem;
 	struct list_head data_list;
-	/* pmem_sem protects the bitmap array
-	 * a write lock should be held when modifying entries in bitmap
-	 * a read lock should be held when reading data from bits or
-	 * dereferencing a pointer into bitmap
+	/* alloc_sem protects the block trees
+	 * a write lock should be held when splitting, merging or changing
+	 * the state of blocks
+	 * a read lock should be held when walking the trees or
+	 * dereferencing a pointer to a block
 	 *
 	 * pmem_data->sem protects the pmem data of a particular file
 	 * Many of the function that require the pmem_data->sem have a non-
 	 * locking version for when the caller is already holding that sem.
 	 *
 	 * IF YOU TAKE BOTH LOCKS TAKE THEM IN THIS ORDER:
-	 * down(pmem_data->sem) => down(bitmap_sem)
+	 * down(pmem_data->sem) => down(alloc_sem)
 	 */
-	struct rw_semaphore bitmap_sem;
+	struct rw_semaphore alloc_sem;
 
 	long (*ioctl)(struct file *, unsigned int, unsigned long);
 	int (*release)(struct inode *, struct file *);
@@ -154,18 +185,9 @@ struct pmem_info {
 static struct pmem_info pmem[PMEM_MAX_DEVICES];
 static int id_count;
 
-#define PMEM_IS_FREE(id, index) !(pmem[id].bitmap[index].allocated)
-#define PMEM_ORDER(id, index) pmem[id].bitmap[index].order
-#define PMEM_BUDDY_INDEX(id, index) (index ^ (1 << PMEM_ORDER(id, index)))
-#define PMEM_NEXT_INDEX(id, index) (index + (1 << PMEM_ORDER(id, index)))
 #define PMEM_OFFSET(index) (index * PMEM_MIN_ALLOC)
 #define PMEM_START_ADDR(id, index) (PMEM_OFFSET(index) + pmem[id].base)
-#define PMEM_LEN(id, index) ((1 << PMEM_ORDER(id, index)) * PMEM_MIN_ALLOC)
-#define PMEM_END_ADDR(id, index) (PMEM_START_ADDR(id, index) + \
-	PMEM_LEN(id, index))
-#define PMEM_START_VADDR(id, index) (PMEM_OFFSET(id, index) + pmem[id].vbase)
-#define PMEM_END_VADDR(id, index) (PMEM_START_VADDR(id, index) + \
-	PMEM_LEN(id, index))
+#define PMEM_ENTRIES(len) (((len) + PMEM_MIN_ALLOC - 1) / PMEM_MIN_ALLOC)
 #define PMEM_REVOKED(data) (data->flags & PMEM_FLAGS_REVOKED)
 #define PMEM_IS_PAGE_ALIGNED(addr) (!((addr) & (~PAGE_MASK)))
 #define PMEM_IS_SUBMAP(data) ((data->flags & PMEM_FLAGS_SUBMAP) && \
@@ -234,44 +256,232 @@ static int is_master_owner(struct file *file)
 	return ret;
 }
 
+/* compaction is off by default, when set allocations that are neither
+ * pinned nor shared are moved down the region after a request fails
+ * because the free space is fragmented */
+static int pmem_compact;
+module_param_named(compact, pmem_compact, int, S_IRUGO | S_IWUSR);
+
+#ifdef PMEM_LOG
+static void pmem_dump_blocks(int id, const char *op)
+{
+	struct rb_node *n;
+	struct pmem_block *block;
+
+	for (n = rb_first(&pmem[id].blocks); n; n = rb_next(n)) {
+		block = rb_entry(n, struct pmem_block, addr_node);
+		printk("%s==>index=%lu , len=%lu , allocated=%d\n", op,
+			block->start, block->len, block->allocated);
+	}
+	printk("%s==>free/total = %lu/%lu\n", op, pmem[id].free_entries,
+		pmem[id].num_entries);
+}
+#else
+static inline void pmem_dump_blocks(int id, const char *op) { }
+#endif
+
+static struct pmem_block *pmem_block_new(unsigned long start,
+					 unsigned long len)
+{
+	struct pmem_block *block;
+
+	block = kmalloc(sizeof(struct pmem_block), GFP_KERNEL);
+	if (!block)
+		return NULL;
+	block->start = start;
+	block->len = len;
+	block->allocated = 0;
+	return block;
+}
+
+static void pmem_insert_addr(int id, struct pmem_block *block)
+{
+	struct rb_node **p = &pmem[id].blocks.rb_node;
+	struct rb_node *parent = NULL;
+	struct pmem_block *entry;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct pmem_block, addr_node);
+		if (block->start < entry->start)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&block->addr_node, parent, p);
+	rb_insert_color(&block->addr_node, &pmem[id].blocks);
+}
+
+static void pmem_insert_free(int id, struct pmem_block *block)
+{
+	struct rb_node **p = &pmem[id].free_blocks.rb_node;
+	struct rb_node *parent = NULL;
+	struct pmem_block *entry;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct pmem_block, free_node);
+		if (block->len < entry->len ||
+		    (block->len == entry->len && block->start < entry->start))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&block->free_node, parent, p);
+	rb_insert_color(&block->free_node, &pmem[id].free_blocks);
+	pmem[id].free_entries += block->len;
+}
+
+static void pmem_erase_free(int id, struct pmem_block *block)
+{
+	rb_erase(&block->free_node, &pmem[id].free_blocks);
+	pmem[id].free_entries -= block->len;
+}
+
+static struct pmem_block *pmem_find_block(int id, unsigned long start)
+{
+	struct rb_node *n = pmem[id].blocks.rb_node;
+	struct pmem_block *block;
+
+	while (n) {
+		block = rb_entry(n, struct pmem_block, addr_node);
+		if (start < block->start)
+			n = n->rb_left;
+		else if (start > block->start)
+			n = n->rb_right;
+		else
+			return block;
+	}
+	return NULL;
+}
+
+/* the smallest free block that holds len entries, lowest address first
+ * when several are the same size */
+static struct pmem_block *pmem_best_fit(int id, unsigned long len)
+{
+	struct rb_node *n = pmem[id].free_blocks.rb_node;
+	struct pmem_block *block, *best = NULL;
+
+	while (n) {
+		block = rb_entry(n, struct pmem_block, free_node);
+		if (block->len >= len) {
+			best = block;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
+	return best;
+}
+
+/* mark the first len entries of a free block allocated, whatever is left
+ * over becomes a new free block */
+static int pmem_take_block(int id, struct pmem_block *block,
+			   unsigned long len)
+{
+	struct pmem_block *rest = NULL;
+
+	if (block->len > len) {
+		rest = pmem_block_new(block->start + len, block->len - len);
+		if (!rest)
+			return -ENOMEM;
+	}
+	pmem_erase_free(id, block);
+	if (rest) {
+		block->len = len;
+		pmem_insert_addr(id, rest);
+		pmem_insert_free(id, rest);
+	}
+	block->allocated = 1;
+	return 0;
+}
+
+/* take a lent region back from the page allocator before handing out
+ * memory from it */
+static int pmem_claim(int id)
+{
+	/* caller should hold the write lock on alloc_sem! */
+	int ret;
+
+	if (!pmem[id].lendable || pmem[id].claimed)
+		return 0;
+	ret = lendable_claim(__phys_to_pfn(pmem[id].base),
+			     pmem[id].size >> PAGE_SHIFT);
+	if (ret) {
+		printk(KERN_WARNING "pmem: %s: can't take back lent memory "
+		       "(%d)\n", pmem[id].dev.name, ret);
+		return ret;
+	}
+	/* the pages still hold whatever the last borrower left in them */
+	memset(pmem[id].vbase, 0, pmem[id].size);
+	dmac_flush_range(pmem[id].vbase, pmem[id].vbase + pmem[id].size);
+#ifdef CONFIG_OUTER_CACHE
+	outer_flush_range(pmem[id].base, pmem[id].base + pmem[id].size);
+#endif
+	pmem[id].claimed = 1;
+	return 0;
+}
+
+/* once the last allocation is gone lend the region out again */
+static void pmem_lend(int id)
+{
+	/* caller should hold the write lock on alloc_sem! */
+	if (!pmem[id].claimed)
+		return;
+	if (pmem[id].no_allocator ? pmem[id].allocated :
+	    pmem[id].free_entries != pmem[id].num_entries)
+		return;
+	lendable_release(__phys_to_pfn(pmem[id].base),
+			 pmem[id].size >> PAGE_SHIFT);
+	pmem[id].claimed = 0;
+}
+
 static int pmem_free(int id, int index)
 {
-	/* caller should hold the write lock on pmem_sem! */
-	int buddy, curr = index;
+	/* caller should hold the write lock on alloc_sem! */
+	struct pmem_block *block, *buddy;
+	struct rb_node *n;
 	DLOG("index %d\n", index);
 
 	if (pmem[id].no_allocator) {
 		pmem[id].allocated = 0;
+		pmem_lend(id);
 		return 0;
 	}
-	/* clean up the bitmap, merging any buddies */
-	pmem[id].bitmap[curr].allocated = 0;
-	/* find a slots buddy Buddy# = Slot# ^ (1 << order)
-	 * if the buddy is also free merge them
-	 * repeat until the buddy is not free or end of the bitmap is reached
-	 */
-	do {
-		buddy = PMEM_BUDDY_INDEX(id, curr);
-		if (buddy < pmem[id].num_entries &&
-			PMEM_IS_FREE(id, buddy) &&
-				PMEM_ORDER(id, buddy) == PMEM_ORDER(id, curr)) {
-			PMEM_ORDER(id, buddy)++;
-			PMEM_ORDER(id, curr)++;
-			curr = min(buddy, curr);
-		} else {
-			break;
+	block = pmem_find_block(id, index);
+	if (!block || !block->allocated) {
+		printk(KERN_ERR "pmem: %s: freeing unallocated index %d\n",
+		       pmem[id].dev.name, index);
+		return -EINVAL;
+	}
+	block->allocated = 0;
+	/* the blocks tile the region, so the neighbours in the address tree
+	 * are the ones that touch this block, merge it with any that are
+	 * free */
+	n = rb_prev(&block->addr_node);
+	if (n) {
+		buddy = rb_entry(n, struct pmem_block, addr_node);
+		if (!buddy->allocated) {
+			pmem_erase_free(id, buddy);
+			buddy->len += block->len;
+			rb_erase(&block->addr_node, &pmem[id].blocks);
+			kfree(block);
+			block = buddy;
 		}
-	} while (curr < pmem[id].num_entries);
-
-#ifdef PMEM_LOG
-	int i;
-	for(i=0;i<pmem[id].num_entries;i++)
-	if(pmem[id].bitmap[i].order>0 || i>=pmem[id].num_entries ) {
-		printk("free==>index=%d , order=%d , allocated=%d\n",
-			i,pmem[id].bitmap[i].order,
-			pmem[id].bitmap[i].allocated);
 	}
-#endif
+	n = rb_next(&block->addr_node);
+	if (n) {
+		buddy = rb_entry(n, struct pmem_block, addr_node);
+		if (!buddy->allocated) {
+			pmem_erase_free(id, buddy);
+			block->len += buddy->len;
+			rb_erase(&buddy->addr_node, &pmem[id].blocks);
+			kfree(buddy);
+		}
+	}
+	pmem_insert_free(id, block);
+	pmem_dump_blocks(id, "free");
+	pmem_lend(id);
 	return 0;
 }
 
@@ -309,14 +519,13 @@ static int pmem_release(struct inode *inode, struct file *file)
 
 	/* if its not a conencted file and it has an allocation, free it */
 	if (!(PMEM_FLAGS_CONNECTED & data->flags) && has_allocation(file)) {
-		down_write(&pmem[id].bitmap_sem);
+		down_write(&pmem[id].alloc_sem);
 		ret = pmem_free(id, data->index);
-		up_write(&pmem[id].bitmap_sem);
+		up_write(&pmem[id].alloc_sem);
 	}
 
-	/* if this file is a submap (mapped, connected file), downref the
-	 * task struct */
-	if (PMEM_FLAGS_SUBMAP & data->flags)
+	/* if this file is mapped, downref the task struct */
+	if ((PMEM_FLAGS_SUBMAP | PMEM_FLAGS_MASTERMAP) & data->flags)
 		if (data->task) {
 			put_task_struct(data->task);
 			data->task = NULL;
@@ -357,6 +566,10 @@ static int pmem_open(struct inode *inode, struct file *file)
 	}
 	data->flags = 0;
 	data->index = -1;
+	data->len = 0;
+	atomic_set(&data->pins, 0);
+	data->map_count = 0;
+	data->map_mode = PMEM_MAP_MODE_DEFAULT;
 	data->task = NULL;
 	data->vma = NULL;
 	data->pid = 0;
@@ -376,83 +589,68 @@ static int pmem_open(struct inode *inode, struct file *file)
 	return ret;
 }
 
-static unsigned long pmem_order(unsigned long len)
-{
-	int i;
-
-	len = (len + PMEM_MIN_ALLOC - 1)/PMEM_MIN_ALLOC;
-	len--;
-	for (i = 0; i < sizeof(len)*8; i++)
-		if (len >> i == 0)
-			break;
-	return i;
-}
-
 static int pmem_allocate(int id, unsigned long len)
 {
-	/* caller should hold the write lock on pmem_sem! */
-	/* return the corresponding pdata[] entry */
-	int curr = 0;
-	int end = pmem[id].num_entries;
-	int best_fit = -1;
-	unsigned long order = pmem_order(len);
+	/* caller should hold the write lock on alloc_sem! */
+	/* return the index of the first entry of the allocation */
+	unsigned long entries = PMEM_ENTRIES(len);
+	struct pmem_block *block;
 
 	if (pmem[id].no_allocator) {
 		DLOG("no allocator");
 		if ((len > pmem[id].size) || pmem[id].allocated)
 			return -1;
+		if (pmem_claim(id))
+			return -1;
 		pmem[id].allocated = 1;
 		return len;
 	}
 
-	if (order > PMEM_MAX_ORDER)
+	if (entries == 0 || entries > pmem[id].num_entries)
 		return -1;
-	DLOG("order %lx\n", order);
+	DLOG("entries %lu\n", entries);
 
-	/* look through the bitmap:
-	 * 	if you find a free slot of the correct order use it
-	 * 	otherwise, use the best fit (smallest with size > order) slot
-	 */
-	while (curr < end) {
-		if (PMEM_IS_FREE(id, curr)) {
-			if (PMEM_ORDER(id, curr) == (unsigned char)order) {
-				/* set the not free bit and clear others */
-				best_fit = curr;
-				break;
-			}
-			if (PMEM_ORDER(id, curr) > (unsigned char)order &&
-			    (best_fit < 0 ||
-			     PMEM_ORDER(id, curr) < PMEM_ORDER(id, best_fit)))
-				best_fit = curr;
-		}
-		curr = PMEM_NEXT_INDEX(id, curr);
-	}
+	if (pmem_claim(id))
+		return -1;
 
-	/* if best_fit < 0, there are no suitable slots,
-	 * return an error
-	 */
-	if (best_fit < 0) {
+	block = pmem_best_fit(id, entries);
+	if (!block) {
 		printk("pmem: no space left to allocate! %s, pid=%d\n", pmem[id].dev.name, current->pid);
+		/* there is room, it just isn't in one piece */
+		if (pmem_compact && pmem[id].free_entries >= entries)
+			schedule_work(&pmem[id].compact_work);
 		return -1;
 	}
+	if (pmem_take_block(id, block, entries))
+		return -1;
+	pmem_dump_blocks(id, "alloc");
+	return block->start;
+}
 
-	/* now partition the best fit:
-	 * 	split the slot into 2 buddies of order - 1
-	 * 	repeat until the slot is of the correct order
-	 */
-	while (PMEM_ORDER(id, best_fit) > (unsigned char)order) {
-		int buddy;
-		PMEM_ORDER(id, best_fit) -= 1;
-		buddy = PMEM_BUDDY_INDEX(id, best_fit);
-		PMEM_ORDER(id, buddy) = PMEM_ORDER(id, best_fit);
-	}
-	pmem[id].bitmap[best_fit].allocated = 1;
-	return best_fit;
+static unsigned long pmem_alloc_len(int id, unsigned long len)
+{
+	if (pmem[id].no_allocator)
+		return len;
+	return PMEM_ENTRIES(len) * PMEM_MIN_ALLOC;
 }
 
 static pgprot_t phys_mem_access_prot(struct file *file, pgprot_t vma_prot)
 {
 	int id = get_id(file);
+	struct pmem_data *data = (struct pmem_data *)file->private_data;
+
+	switch (data->map_mode) {
+	case PMEM_MAP_MODE_CACHED:
+		return vma_prot;
+#ifdef pgprot_writecombine
+	case PMEM_MAP_MODE_WRITECOMBINE:
+		return pgprot_writecombine(vma_prot);
+#endif
+#ifdef pgprot_noncached
+	case PMEM_MAP_MODE_UNCACHED:
+		return pgprot_noncached(vma_prot);
+#endif
+	}
 #ifdef pgprot_noncached
 	if (pmem[id].cached == 0 || file->f_flags & O_SYNC)
 		return pgprot_noncached(vma_prot);
@@ -464,6 +662,83 @@ static pgprot_t phys_mem_access_prot(struct file *file, pgprot_t vma_prot)
 	return vma_prot;
 }
 
+/* whether the user mapping of the file goes through the cpu caches */
+static int pmem_map_cached(struct file *file)
+{
+	struct pmem_data *data = (struct pmem_data *)file->private_data;
+	int id = get_id(file);
+
+	switch (data->map_mode) {
+	case PMEM_MAP_MODE_CACHED:
+		return 1;
+	case PMEM_MAP_MODE_WRITECOMBINE:
+	case PMEM_MAP_MODE_UNCACHED:
+		return 0;
+	}
+	return pmem[id].cached && !(file->f_flags & O_SYNC);
+}
+
+static int pmem_set_map_mode(struct file *file, unsigned int mode)
+{
+	struct pmem_data *data = (struct pmem_data *)file->private_data;
+	int id = get_id(file);
+	int ret = 0;
+
+	if (mode > PMEM_MAP_MODE_UNCACHED)
+		return -EINVAL;
+	/* the kernel mapping of an uncached region must not be aliased by a
+	 * cached one */
+	if (mode == PMEM_MAP_MODE_CACHED && !pmem[id].cached)
+		return -EINVAL;
+
+	down_write(&data->sem);
+	if ((data->flags & PMEM_FLAGS_MASTERMAP) ||
+	    (data->flags & PMEM_FLAGS_SUBMAP) ||
+	    (data->flags & PMEM_FLAGS_UNSUBMAP))
+		ret = -EINVAL;
+	else
+		data->map_mode = mode;
+	up_write(&data->sem);
+	return ret;
+}
+
+/* cache maintenance on part of the kernel mapping of the region, the
+ * caches are physically tagged so this covers the user mapping too */
+static void pmem_cache_maint(int id, void *vaddr, unsigned long len,
+			     unsigned int op)
+{
+#ifdef CONFIG_OUTER_CACHE
+	unsigned long phy_start;
+#endif
+
+	if (!pmem[id].cached || !len)
+		return;
+#ifdef CONFIG_OUTER_CACHE
+	phy_start = (unsigned long)vaddr - (unsigned long)pmem[id].vbase +
+		pmem[id].base;
+#endif
+	switch (op) {
+	case PMEM_CACHE_OP_CLEAN:
+		dmac_clean_range(vaddr, vaddr + len);
+#ifdef CONFIG_OUTER_CACHE
+		outer_clean_range(phy_start, phy_start + len);
+#endif
+		break;
+	case PMEM_CACHE_OP_INV:
+		dmac_inv_range(vaddr, vaddr + len);
+#ifdef CONFIG_OUTER_CACHE
+		outer_inv_range(phy_start, phy_start + len);
+#endif
+		break;
+	default:
+		dmac_flush_range(vaddr, vaddr + len);
+#ifdef CONFIG_OUTER_CACHE
+		outer_flush_range(phy_start, phy_start + len);
+#endif
+		break;
+	}
+}
+
 static unsigned long pmem_start_addr(int id, struct pmem_data *data)
 {
 	if (pmem[id].no_allocator)
@@ -480,10 +755,7 @@ static void *pmem_start_vaddr(int id, struct pmem_data *data)
 
 static unsigned long pmem_len(int id, struct pmem_data *data)
 {
-	if (pmem[id].no_allocator)
-		return data->index;
-	else
-		return PMEM_LEN(id, data->index);
+	return data->len;
 }
 
 static int pmem_map_garbage(int id, struct vm_area_struct *vma,
@@ -553,6 +825,7 @@ static void pmem_vma_open(struct vm_area_struct *vma)
 	 * ranges via fork */
 	BUG_ON(!has_allocation(file));
 	down_write(&data->sem);
+	data->map_count++;
 	/* remap the garbage pages, forkers don't get access to the data */
 	pmem_unmap_pfn_range(id, vma, data, 0, vma->vm_start - vma->vm_end);
 	up_write(&data->sem);
@@ -572,6 +845,7 @@ static void pmem_vma_close(struct vm_area_struct *vma)
 		return;
 	}
 	down_write(&data->sem);
+	data->map_count--;
 	if (data->vma == vma) {
 		data->vma = NULL;
 		if ((data->flags & PMEM_FLAGS_CONNECTED) &&
@@ -618,30 +892,13 @@ static int pmem_mmap(struct file *file, struct vm_area_struct *vma)
 	}
 	/* if file->private_data == unalloced, alloc*/
 	if (data && data->index == -1) {
-		down_write(&pmem[id].bitmap_sem);
-		index = pmem_allocate(id, vma->vm_end - vma->vm_start);
-		up_write(&pmem[id].bitmap_sem);
+		down_write(&pmem[id].alloc_sem);
+		index = pmem_allocate(id, vma_size);
+		up_write(&pmem[id].alloc_sem);
 		data->index = index;
+		data->len = pmem_alloc_len(id, vma_size);
 	}
 
-#ifdef PMEM_LOG
-	int i;
-	int allc_cnt = 0;
-	int order_cnt = 0;
-	for(i=0;i<pmem[id].num_entries;i++)
-		if(pmem[id].bitmap[i].order>0 ||  i>=pmem[id].num_entries) {
-			order_cnt++;
-			if (pmem[id].bitmap[i].allocated > 0) {
-			printk("mmap==>index=%d , order=%d,"
-				"allocated=%d, vbase=0x%8X \n",
-				i,pmem[id].bitmap[i].order,
-				pmem[id].bitmap[i].allocated,
-				vma->vm_start);
-		allc_cnt++;
-		}
-	}
-	printk("allocated/total = %d/%d\n", allc_cnt,order_cnt);
-#endif
 	/* either no space was available or an error occured */
 	if (!has_allocation(file)) {
 		ret = -EINVAL;
@@ -700,7 +957,12 @@ static int pmem_mmap(struct file *file, struct vm_area_struct *vma)
 		}
 		data->flags |= PMEM_FLAGS_MASTERMAP;
 		data->pid = current->pid;
+		/* compaction needs the vma to move the mapping with it */
+		get_task_struct(current->group_leader);
+		data->task = current->group_leader;
+		data->vma = vma;
 	}
+	data->map_count = 1;
 	vma->vm_ops = &vm_ops;
 error:
 	up_write(&data->sem);
@@ -754,6 +1016,8 @@ int get_pmem_addr(struct file *file, unsigned long *start,
 	id = get_id(file);
 
 	down_read(&data->sem);
+	/* keep compaction away until put_pmem_file */
+	atomic_inc(&data->pins);
 	*start = pmem_start_addr(id, data);
 	*len = pmem_len(id, data);
 	*vstart = (unsigned long)pmem_start_vaddr(id, data);
@@ -808,6 +1072,7 @@ void put_pmem_file(struct file *file)
 	data->ref--;
 	up_write(&data->sem);
 #endif
+	atomic_dec(&data->pins);
 	fput(file);
 }
 
@@ -818,10 +1083,6 @@ void flush_pmem_file(struct file *file, unsigned long offset, unsigned long len)
 	void *vaddr;
 	struct pmem_region_node *region_node;
 	struct list_head *elt;
-	void *flush_start, *flush_end;
-#ifdef CONFIG_OUTER_CACHE
-	unsigned long phy_start, phy_end;
-#endif
 
 	if (!is_pmem_file(file) || !has_allocation(file)) {
 		return;
@@ -829,42 +1090,29 @@ void flush_pmem_file(struct file *file, unsigned long offset, unsigned long len)
 
 	id = get_id(file);
 	data = (struct pmem_data *)file->private_data;
-	if (!pmem[id].cached || file->f_flags & O_SYNC)
+	if (!pmem_map_cached(file))
 		return;
 
 	down_read(&data->sem);
 	vaddr = pmem_start_vaddr(id, data);
-	/* if this isn't a submmapped file, flush the whole thing */
+	/* if this isn't a submmapped file, flush what was asked for */
 	if (unlikely(!(data->flags & PMEM_FLAGS_CONNECTED))) {
-		dmac_flush_range(vaddr, vaddr + pmem_len(id, data));
-#ifdef CONFIG_OUTER_CACHE
-		phy_start = (unsigned long)vaddr -
-				(unsigned long)pmem[id].vbase + pmem[id].base;
-
-		phy_end  =  phy_start + pmem_len(id, data);
-
-		outer_flush_range(phy_start, phy_end);
-#endif
+		if (offset >= pmem_len(id, data))
+			goto end;
+		len = min(len, pmem_len(id, data) - offset);
+		pmem_cache_maint(id, vaddr + offset, len,
+				 PMEM_CACHE_OP_CLEAN_INV);
 		goto end;
 	}
-	/* otherwise, flush the region of the file we are drawing */
+	/* otherwise, flush it if it lies in a region of the file we are
+	 * drawing */
 	list_for_each(elt, &data->region_list) {
 		region_node = list_entry(elt, struct pmem_region_node, list);
 		if ((offset >= region_node->region.offset) &&
 		    ((offset + len) <= (region_node->region.offset +
 			region_node->region.len))) {
-			flush_start = vaddr + region_node->region.offset;
-			flush_end = flush_start + region_node->region.len;
-			dmac_flush_range(flush_start, flush_end);
-#ifdef CONFIG_OUTER_CACHE
-
-			phy_start = (unsigned long)flush_start -
-				(unsigned long)pmem[id].vbase + pmem[id].base;
-
-			phy_end  =  phy_start + region_node->region.len;
-
-			outer_flush_range(phy_start, phy_end);
-#endif
+			pmem_cache_maint(id, vaddr + offset, len,
+					 PMEM_CACHE_OP_CLEAN_INV);
 			break;
 		}
 	}
@@ -895,14 +1143,24 @@ static int pmem_connect(unsigned long connect, struct file *file)
 		goto err_bad_file;
 	}
 	src_data = (struct pmem_data *)src_file->private_data;
+	if (src_data == data) {
+		ret = -EINVAL;
+		goto err_bad_file;
+	}
 
+	/* once shared the src allocation must stay where it is */
+	down_write(&src_data->sem);
 	if (has_allocation(file) && (data->index != src_data->index)) {
+		up_write(&src_data->sem);
 		printk("pmem: file is already mapped but doesn't match this"
 		       " src_file!\n");
 		ret = -EINVAL;
 		goto err_bad_file;
 	}
+	src_data->flags |= PMEM_FLAGS_PINNED;
 	data->index = src_data->index;
+	data->len = src_data->len;
+	up_write(&src_data->sem);
 	data->flags |= PMEM_FLAGS_CONNECTED;
 	data->master_fd = connect;
 	data->master_file = src_file;
@@ -1103,6 +1361,171 @@ static void pmem_revoke(struct file *file, struct pmem_data *data)
 	pmem_unlock_data_and_mm(data, mm);
 }
 
+static void pmem_pin(struct pmem_data *data)
+{
+	down_write(&data->sem);
+	data->flags |= PMEM_FLAGS_PINNED;
+	up_write(&data->sem);
+}
+
+/* maximum number of passes over the data list a compaction run makes,
+ * every move lowers an allocation so the runs always end anyway */
+#define PMEM_COMPACT_PASSES 4
+
+static int pmem_lock_master_and_mm(struct pmem_data *data,
+				   struct mm_struct **locked_mm)
+{
+	struct mm_struct *mm;
+
+	*locked_mm = NULL;
+lock_mm:
+	mm = NULL;
+	down_read(&data->sem);
+	if (data->vma) {
+		mm = get_task_mm(data->task);
+		if (!mm) {
+			up_read(&data->sem);
+			return -1;
+		}
+	}
+	up_read(&data->sem);
+
+	/* the data list sem is held, which a release from munmap may be
+	 * waiting for under this very mmap_sem, so don't wait for it */
+	if (mm && !down_write_trylock(&mm->mmap_sem)) {
+		mmput(mm);
+		return -1;
+	}
+
+	down_write(&data->sem);
+	/* check that the file didn't get mmaped before we could take the
+	 * data sem */
+	if (data->vma && !mm) {
+		up_write(&data->sem);
+		goto lock_mm;
+	}
+	*locked_mm = mm;
+	return 0;
+}
+
+static int pmem_movable(int id, struct pmem_data *data)
+{
+	if (pmem[id].no_allocator || data->index < 0)
+		return 0;
+	if (data->flags & (PMEM_FLAGS_CONNECTED | PMEM_FLAGS_PINNED))
+		return 0;
+	if (atomic_read(&data->pins))
+		return 0;
+	/* forked or split copies of the mapping would keep the old pages */
+	if (data->map_count != (data->vma ? 1 : 0))
+		return 0;
+	return 1;
+}
+
+/* the lowest free block below index that holds len entries */
+static struct pmem_block *pmem_lowest_fit(int id, unsigned long len,
+					  unsigned long index)
+{
+	struct rb_node *n;
+	struct pmem_block *block;
+
+	for (n = rb_first(&pmem[id].blocks); n; n = rb_next(n)) {
+		block = rb_entry(n, struct pmem_block, addr_node);
+		if (block->start >= index)
+			break;
+		if (!block->allocated && block->len >= len)
+			return block;
+	}
+	return NULL;
+}
+
+static int pmem_move(int id, struct pmem_data *data)
+{
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	struct pmem_block *block;
+	unsigned long entries, old, pgoff;
+	void *src, *dst;
+	int ret = -1;
+
+	if (pmem_lock_master_and_mm(data, &mm))
+		return -1;
+	if (!pmem_movable(id, data))
+		goto out;
+
+	entries = PMEM_ENTRIES(data->len);
+	old = data->index;
+	down_write(&pmem[id].alloc_sem);
+	block = pmem_lowest_fit(id, entries, old);
+	if (!block || pmem_take_block(id, block, entries)) {
+		up_write(&pmem[id].alloc_sem);
+		goto out;
+	}
+	up_write(&pmem[id].alloc_sem);
+
+	/* the mmap_sem is held for writing, so once the old pages are
+	 * unmapped any touch of the vma waits until the new ones are in */
+	vma = data->vma;
+	if (vma)
+		zap_page_range(vma, vma->vm_start, vma->vm_end - vma->vm_start,
+			       NULL);
+
+	src = (void *)pmem[id].vbase + PMEM_OFFSET(old);
+	dst = (void *)pmem[id].vbase + PMEM_OFFSET(block->start);
+	pmem_cache_maint(id, src, data->len, PMEM_CACHE_OP_CLEAN_INV);
+	memcpy(dst, src, data->len);
+	pmem_cache_maint(id, dst, data->len, PMEM_CACHE_OP_CLEAN_INV);
+	data->index = block->start;
+
+	if (vma) {
+		/* vm_pgoff is the pfn the vma starts at */
+		pgoff = vma->vm_pgoff - (PMEM_START_ADDR(id, old) >> PAGE_SHIFT);
+		vma->vm_pgoff = (pmem_start_addr(id, data) >> PAGE_SHIFT) +
+			pgoff;
+		if (io_remap_pfn_range(vma, vma->vm_start, vma->vm_pgoff,
+				       vma->vm_end - vma->vm_start,
+				       vma->vm_page_prot)) {
+			printk(KERN_ERR "pmem: %s: remap after move failed, "
+			       "pid %d loses its mapping\n", pmem[id].dev.name,
+			       data->pid);
+			pmem_map_garbage(id, vma, data, 0,
+					 vma->vm_end - vma->vm_start);
+		}
+	}
+
+	down_write(&pmem[id].alloc_sem);
+	pmem_free(id, old);
+	up_write(&pmem[id].alloc_sem);
+	DLOG("moved index %lu to %lu\n", old, block->start);
+	ret = 0;
+out:
+	pmem_unlock_data_and_mm(data, mm);
+	return ret;
+}
+
+static void pmem_compact_work(struct work_struct *work)
+{
+	struct pmem_info *info = container_of(work, struct pmem_info,
+					      compact_work);
+	int id = info - pmem;
+	struct pmem_data *data;
+	int pass, moved, total = 0;
+
+	down(&pmem[id].data_list_sem);
+	for (pass = 0; pass < PMEM_COMPACT_PASSES; pass++) {
+		moved = 0;
+		list_for_each_entry(data, &pmem[id].data_list, list)
+			if (!pmem_move(id, data))
+				moved++;
+		total += moved;
+		if (!moved)
+			break;
+	}
+	up(&pmem[id].data_list_sem);
+	printk(KERN_INFO "pmem: %s: compaction moved %d allocations\n",
+	       pmem[id].dev.name, total);
+}
+
 static void pmem_get_size(struct pmem_region *region, struct file *file)
 {
 	struct pmem_data *data = (struct pmem_data *)file->private_data;
@@ -1113,6 +1536,7 @@ static void pmem_get_size(struct pmem_region *region, struct file *file)
 		region->len = 0;
 		return;
 	} else {
+		pmem_pin(data);
 		region->offset = pmem_start_addr(id, data);
 		region->len = pmem_len(id, data);
 	}
@@ -1135,6 +1559,7 @@ static long pmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 				region.len = 0;
 			} else {
 				data = (struct pmem_data *)file->private_data;
+				pmem_pin(data);
 				region.offset = pmem_start_addr(id, data);
 				region.len = pmem_len(id, data);
 			}
@@ -1189,10 +1614,17 @@ static long pmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		}
 	case PMEM_ALLOCATE:
 		{
-			if (has_allocation(file))
-				return -EINVAL;
 			data = (struct pmem_data *)file->private_data;
+			down_write(&data->sem);
+			if (has_allocation(file)) {
+				up_write(&data->sem);
+				return -EINVAL;
+			}
+			down_write(&pmem[id].alloc_sem);
 			data->index = pmem_allocate(id, arg);
+			up_write(&pmem[id].alloc_sem);
+			data->len = pmem_alloc_len(id, arg);
+			up_write(&data->sem);
 			break;
 		}
 	case PMEM_CONNECT:
@@ -1211,10 +1643,10 @@ static long pmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			unsigned long offset;
 
 			id = get_id(file);
-			if (!pmem[id].cached)
-				return 0;
 			if (!has_allocation(file))
 				return -EINVAL;
+			if (!pmem_map_cached(file))
+				return 0;
 			if (copy_from_user(&pmem_addr, (void __user *)arg,
 						sizeof(struct pmem_addr)))
 				return -EFAULT;
@@ -1237,6 +1669,32 @@ static long pmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 
 			break;
 		}
+	case PMEM_SET_MAP_MODE:
+		return pmem_set_map_mode(file, arg);
+	case PMEM_CACHE_RANGE:
+		{
+			struct pmem_cache_range range;
+
+			if (!has_allocation(file))
+				return -EINVAL;
+			if (copy_from_user(&range, (void __user *)arg,
+						sizeof(struct pmem_cache_range)))
+				return -EFAULT;
+			if (!pmem_map_cached(file))
+				return 0;
+
+			data = (struct pmem_data *)file->private_data;
+			down_read(&data->sem);
+			if (range.offset > pmem_len(id, data) ||
+			    range.length > pmem_len(id, data) - range.offset) {
+				up_read(&data->sem);
+				return -EINVAL;
+			}
+			pmem_cache_maint(id, pmem_start_vaddr(id, data) +
+					 range.offset, range.length, range.op);
+			up_read(&data->sem);
+			break;
+		}
 
 	default:
 		if (pmem[id].ioctl)
@@ -1310,7 +1768,7 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 	       int (*release)(struct inode *, struct file *))
 {
 	int err = 0;
-	int i, index = 0;
+	struct pmem_block *block = NULL;
 	int id = id_count;
 	id_count++;
 
@@ -1321,7 +1779,8 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 	pmem[id].size = pdata->size;
 	pmem[id].ioctl = ioctl;
 	pmem[id].release = release;
-	init_rwsem(&pmem[id].bitmap_sem);
+	init_rwsem(&pmem[id].alloc_sem);
+	INIT_WORK(&pmem[id].compact_work, pmem_compact_work);
 	init_MUTEX(&pmem[id].data_list_sem);
 	INIT_LIST_HEAD(&pmem[id].data_list);
 	pmem[id].dev.name = pdata->name;
@@ -1336,22 +1795,33 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 	}
 	pmem[id].num_entries = pmem[id].size / PMEM_MIN_ALLOC;
 
-	pmem[id].bitmap = kmalloc(pmem[id].num_entries *
-				  sizeof(struct pmem_bits), GFP_KERNEL);
-	if (!pmem[id].bitmap)
-		goto err_no_mem_for_metadata;
-
-	memset(pmem[id].bitmap, 0, sizeof(struct pmem_bits) *
-					  pmem[id].num_entries);
-
-	for (i = sizeof(pmem[id].num_entries) * 8 - 1; i >= 0; i--) {
-		if ((pmem[id].num_entries) &  1<<i) {
-			PMEM_ORDER(id, index) = i;
-			index = PMEM_NEXT_INDEX(id, index);
-		}
+	pmem[id].blocks = RB_ROOT;
+	pmem[id].free_blocks = RB_ROOT;
+	pmem[id].free_entries = 0;
+	if (!pmem[id].no_allocator) {
+		/* the whole region starts out as one free block */
+		block = pmem_block_new(0, pmem[id].num_entries);
+		if (!block)
+			goto err_no_mem_for_metadata;
+		pmem_insert_addr(id, block);
+		pmem_insert_free(id, block);
 	}
 
-	if (pmem[id].cached)
+	if (pdata->lendable) {
+		/* the region is ordinary lowmem owned by the page allocator,
+		 * use the kernel's own mapping of it */
+		if (!pfn_valid(__phys_to_pfn(pmem[id].base)) ||
+		    PageHighMem(pfn_to_page(__phys_to_pfn(pmem[id].base))) ||
+		    lendable_declare(__phys_to_pfn(pmem[id].base),
+				     pmem[id].size >> PAGE_SHIFT)) {
+			printk(KERN_ERR "pmem: %s: can't lend region\n",
+			       pdata->name);
+			goto error_cant_remap;
+		}
+		pmem[id].lendable = 1;
+		pmem[id].claimed = 0;
+		pmem[id].vbase = __va(pmem[id].base);
+	} else if (pmem[id].cached)
 		pmem[id].vbase = ioremap_cached(pmem[id].base,
 						pmem[id].size);
 #ifdef ioremap_ext_buffered
@@ -1375,7 +1845,7 @@ int pmem_setup(struct android_pmem_platform_data *pdata,
 #endif
 	return 0;
 error_cant_remap:
-	kfree(pmem[id].bitmap);
+	kfree(block);
 err_no_mem_for_metadata:
 	misc_deregister(&pmem[id].dev);
 err_cant_register_device:
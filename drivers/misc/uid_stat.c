@@ -13,131 +13,197 @@
  *
  */
 
-#include <asm/atomic.h>
-
 #include <linux/err.h>
+#include <linux/hash.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/percpu.h>
 #include <linux/proc_fs.h>
+#include <linux/rculist.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/stat.h>
 #include <linux/uid_stat.h>
 
+/*
+ * Entries live in a hash keyed by uid and are never freed, so lookups
+ * only need rcu_read_lock. The counters are per cpu and folded when a
+ * proc file is read; they wrap at 4GB like the old atomic ones did.
+ */
+#define UID_HASH_BITS	6
+
+enum {
+	UID_TCP_SND,
+	UID_TCP_RCV,
+	UID_UDP_SND,
+	UID_UDP_RCV,
+	UID_TCP_SND_PKT,
+	UID_TCP_RCV_PKT,
+	UID_UDP_SND_PKT,
+	UID_UDP_RCV_PKT,
+	UID_NR_COUNTERS,
+};
+
+struct uid_stat_counters {
+	unsigned int c[UID_NR_COUNTERS];
+};
+
 static DEFINE_SPINLOCK(uid_lock);
-static LIST_HEAD(uid_list);
+static struct hlist_head uid_hash[1 << UID_HASH_BITS];
 static struct proc_dir_entry *parent;
 
 struct uid_stat {
-	struct list_head link;
+	struct hlist_node link;
 	uid_t uid;
-	atomic_t tcp_rcv;
-	atomic_t tcp_snd;
+	struct uid_stat_counters *counters;
 };
 
+static struct hlist_head *uid_hash_head(uid_t uid)
+{
+	return &uid_hash[hash_long(uid, UID_HASH_BITS)];
+}
+
 static struct uid_stat *find_uid_stat(uid_t uid) {
-	unsigned long flags;
 	struct uid_stat *entry;
+	struct hlist_node *pos;
 
-	spin_lock_irqsave(&uid_lock, flags);
-	list_for_each_entry(entry, &uid_list, link) {
-		if (entry->uid == uid) {
-			spin_unlock_irqrestore(&uid_lock, flags);
+	hlist_for_each_entry_rcu(entry, pos, uid_hash_head(uid), link) {
+		if (entry->uid == uid)
 			return entry;
-		}
 	}
-	spin_unlock_irqrestore(&uid_lock, flags);
 	return NULL;
 }
 
-static int tcp_snd_read_proc(char *page, char **start, off_t off,
-				int count, int *eof, void *data)
+static unsigned int uid_stat_fold(struct uid_stat *entry, int idx)
 {
-	int len;
-	unsigned int bytes;
-	char *p = page;
-	struct uid_stat *uid_entry = (struct uid_stat *) data;
-	if (!data)
-		return 0;
+	unsigned int sum = 0;
+	int cpu;
 
-	bytes = (unsigned int) (atomic_read(&uid_entry->tcp_snd) + INT_MIN);
-	p += sprintf(p, "%u\n", bytes);
-	len = (p - page) - off;
-	*eof = (len <= count) ? 1 : 0;
-	*start = page + off;
-	return len;
+	for_each_possible_cpu(cpu)
+		sum += per_cpu_ptr(entry->counters, cpu)->c[idx];
+	return sum;
 }
 
-static int tcp_rcv_read_proc(char *page, char **start, off_t off,
-				int count, int *eof, void *data)
+static int uid_stat_read_proc(char *page, char **start, off_t off,
+			      int count, int *eof, void *data, int idx)
 {
 	int len;
-	unsigned int bytes;
 	char *p = page;
 	struct uid_stat *uid_entry = (struct uid_stat *) data;
 	if (!data)
 		return 0;
 
-	bytes = (unsigned int) (atomic_read(&uid_entry->tcp_rcv) + INT_MIN);
-	p += sprintf(p, "%u\n", bytes);
+	p += sprintf(p, "%u\n", uid_stat_fold(uid_entry, idx));
 	len = (p - page) - off;
 	*eof = (len <= count) ? 1 : 0;
 	*start = page + off;
 	return len;
 }
 
+#define UID_STAT_READ_PROC(name, idx)					\
+static int name##_read_proc(char *page, char **start, off_t off,	\
+			    int count, int *eof, void *data)		\
+{									\
+	return uid_stat_read_proc(page, start, off, count, eof, data, idx); \
+}
+
+UID_STAT_READ_PROC(tcp_snd, UID_TCP_SND)
+UID_STAT_READ_PROC(tcp_rcv, UID_TCP_RCV)
+UID_STAT_READ_PROC(udp_snd, UID_UDP_SND)
+UID_STAT_READ_PROC(udp_rcv, UID_UDP_RCV)
+UID_STAT_READ_PROC(tcp_snd_pkt, UID_TCP_SND_PKT)
+UID_STAT_READ_PROC(tcp_rcv_pkt, UID_TCP_RCV_PKT)
+UID_STAT_READ_PROC(udp_snd_pkt, UID_UDP_SND_PKT)
+UID_STAT_READ_PROC(udp_rcv_pkt, UID_UDP_RCV_PKT)
+
+static const struct {
+	const char *name;
+	read_proc_t *read_proc;
+} uid_stat_files[] = {
+	{ "tcp_snd", tcp_snd_read_proc },
+	{ "tcp_rcv", tcp_rcv_read_proc },
+	{ "udp_snd", udp_snd_read_proc },
+	{ "udp_rcv", udp_rcv_read_proc },
+	{ "tcp_snd_pkt", tcp_snd_pkt_read_proc },
+	{ "tcp_rcv_pkt", tcp_rcv_pkt_read_proc },
+	{ "udp_snd_pkt", udp_snd_pkt_read_proc },
+	{ "udp_rcv_pkt", udp_rcv_pkt_read_proc },
+};
+
 /* Create a new entry for tracking the specified uid. */
 static struct uid_stat *create_stat(uid_t uid) {
 	unsigned long flags;
 	char uid_s[32];
-	struct uid_stat *new_uid;
-	struct proc_dir_entry *entry;
+	struct uid_stat *new_uid, *entry;
+	struct proc_dir_entry *dir;
+	int i;
 
-	/* Create the uid stat struct and append it to the list. */
 	if ((new_uid = kmalloc(sizeof(struct uid_stat), GFP_KERNEL)) == NULL)
 		return NULL;
-
+	new_uid->counters = alloc_percpu(struct uid_stat_counters);
+	if (!new_uid->counters) {
+		kfree(new_uid);
+		return NULL;
+	}
 	new_uid->uid = uid;
-	/* Counters start at INT_MIN, so we can track 4GB of network traffic. */
-	atomic_set(&new_uid->tcp_rcv, INT_MIN);
-	atomic_set(&new_uid->tcp_snd, INT_MIN);
 
+	/* Somebody else may have added the uid since we looked. */
 	spin_lock_irqsave(&uid_lock, flags);
-	list_add_tail(&new_uid->link, &uid_list);
+	entry = find_uid_stat(uid);
+	if (!entry)
+		hlist_add_head_rcu(&new_uid->link, uid_hash_head(uid));
 	spin_unlock_irqrestore(&uid_lock, flags);
+	if (entry) {
+		free_percpu(new_uid->counters);
+		kfree(new_uid);
+		return entry;
+	}
 
 	sprintf(uid_s, "%d", uid);
-	entry = proc_mkdir(uid_s, parent);
+	dir = proc_mkdir(uid_s, parent);
 
 	/* Keep reference to uid_stat so we know what uid to read stats from. */
-	create_proc_read_entry("tcp_snd", S_IRUGO, entry , tcp_snd_read_proc,
-		(void *) new_uid);
-
-	create_proc_read_entry("tcp_rcv", S_IRUGO, entry, tcp_rcv_read_proc,
-		(void *) new_uid);
+	for (i = 0; i < ARRAY_SIZE(uid_stat_files); i++)
+		create_proc_read_entry(uid_stat_files[i].name, S_IRUGO, dir,
+				       uid_stat_files[i].read_proc,
+				       (void *) new_uid);
 
 	return new_uid;
 }
 
-int update_tcp_snd(uid_t uid, int size) {
+static int uid_stat_add(uid_t uid, int bytes_idx, int pkt_idx, int size)
+{
+	struct uid_stat_counters *counters;
 	struct uid_stat *entry;
-	if ((entry = find_uid_stat(uid)) == NULL &&
-		((entry = create_stat(uid)) == NULL)) {
-			return -1;
-	}
-	atomic_add(size, &entry->tcp_snd);
+
+	rcu_read_lock();
+	entry = find_uid_stat(uid);
+	rcu_read_unlock();
+	if (entry == NULL && (entry = create_stat(uid)) == NULL)
+		return -1;
+
+	counters = per_cpu_ptr(entry->counters, get_cpu());
+	counters->c[bytes_idx] += size;
+	counters->c[pkt_idx]++;
+	put_cpu();
 	return 0;
 }
 
+int update_tcp_snd(uid_t uid, int size) {
+	return uid_stat_add(uid, UID_TCP_SND, UID_TCP_SND_PKT, size);
+}
+
 int update_tcp_rcv(uid_t uid, int size) {
-	struct uid_stat *entry;
-	if ((entry = find_uid_stat(uid)) == NULL &&
-		((entry = create_stat(uid)) == NULL)) {
-			return -1;
-	}
-	atomic_add(size, &entry->tcp_rcv);
-	return 0;
+	return uid_stat_add(uid, UID_TCP_RCV, UID_TCP_RCV_PKT, size);
+}
+
+int update_udp_snd(uid_t uid, int size) {
+	return uid_stat_add(uid, UID_UDP_SND, UID_UDP_SND_PKT, size);
+}
+
+int update_udp_rcv(uid_t uid, int size) {
+	return uid_stat_add(uid, UID_UDP_RCV, UID_UDP_RCV_PKT, size);
 }
 
 static int __init uid_stat_init(void)
@@ -69,6 +69,7 @@ struct mmc_blk_data {
 
 	unsigned int	usage;
 	unsigned int	read_only;
+	unsigned int	use_cmd23;
 };
 
 static DEFINE_MUTEX(open_lock);
@@ -154,6 +155,7 @@ static const struct block_device_operations mmc_bdops = {
 
 struct mmc_blk_request {
 	struct mmc_request	mrq;
+	struct mmc_command	sbc;
 	struct mmc_command	cmd;
 	struct mmc_command	stop;
 	struct mmc_data		data;
@@ -286,23 +288,168 @@ mmc_blk_set_blksize(struct mmc_blk_data *md, struct mmc_card *card)
 	return 0;
 }
 
+/*
+ * Take requests that carry straight on from @req off the queue so that
+ * they go to the card in the same transfer.  Only whole requests are
+ * packed, and never through the bounce buffer, which maps one request.
+ */
+static void mmc_blk_pack_requests(struct mmc_queue *mq, struct request *req)
+{
+	struct request_queue *q = mq->queue;
+	struct mmc_host *host = mq->card->host;
+	unsigned int max_sectors = min(host->max_blk_count,
+				       host->max_req_size >> 9);
+	unsigned int sectors = blk_rq_sectors(req);
+	unsigned int segs = req->nr_phys_segments;
+	sector_t pos = blk_rq_pos(req) + sectors;
+	struct request *next;
+
+	mq->nr_packed = 0;
+	mq->packed_sectors = 0;
+
+	if (mq->bounce_buf || blk_barrier_rq(req) || sectors >= max_sectors)
+		return;
+
+	spin_lock_irq(q->queue_lock);
+	while (mq->nr_packed < MMC_PACKED_MAX) {
+		next = blk_peek_request(q);
+		if (!next || !blk_fs_request(next) || blk_barrier_rq(next) ||
+		    rq_data_dir(next) != rq_data_dir(req) ||
+		    blk_rq_pos(next) != pos ||
+		    sectors + blk_rq_sectors(next) > max_sectors ||
+		    segs + next->nr_phys_segments > host->max_phys_segs)
+			break;
+
+		blk_start_request(next);
+		mq->packed[mq->nr_packed++] = next;
+		mq->packed_sectors += blk_rq_sectors(next);
+		sectors += blk_rq_sectors(next);
+		segs += next->nr_phys_segments;
+		pos += blk_rq_sectors(next);
+	}
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * Put packed requests back at the head of the queue, in order, so they
+ * get issued on their own.  Called with the queue lock held.
+ */
+static void mmc_blk_unpack_requests(struct mmc_queue *mq)
+{
+	while (mq->nr_packed)
+		blk_requeue_request(mq->queue, mq->packed[--mq->nr_packed]);
+	mq->packed_sectors = 0;
+}
+
+/*
+ * Complete @bytes of a packed transfer across @req and the requests
+ * packed behind it.  Whatever is not complete gets requeued.  Returns
+ * non-zero if @req itself has more to do.  Called with the queue lock
+ * held.
+ */
+static int mmc_blk_end_packed(struct mmc_queue *mq, struct request *req,
+			      unsigned int bytes)
+{
+	unsigned int n = min(bytes, blk_rq_bytes(req));
+	unsigned int i;
+	int ret;
+
+	ret = __blk_end_request(req, 0, n);
+	bytes -= n;
+
+	for (i = 0; i < mq->nr_packed; i++) {
+		struct request *p = mq->packed[i];
+
+		n = min(bytes, blk_rq_bytes(p));
+		bytes -= n;
+		if (n && !__blk_end_request(p, 0, n))
+			continue;
+
+		/* Short transfer, give the rest another go */
+		while (mq->nr_packed > i)
+			blk_requeue_request(mq->queue,
+					    mq->packed[--mq->nr_packed]);
+	}
+
+	mq->nr_packed = 0;
+	mq->packed_sectors = 0;
+
+	return ret;
+}
+
+/*
+ * Start the request after the one on the bus and have the host map it,
+ * so it can go to the card as soon as the current one is done.  Only
+ * requests that fit in one transfer are taken, anything else stays on
+ * the queue for the usual path.
+ */
+static void mmc_blk_prep_next(struct mmc_queue *mq)
+{
+	struct request_queue *q = mq->queue;
+	struct mmc_host *host = mq->card->host;
+	struct mmc_data *data = &mq->prep_data;
+	struct request *next = NULL;
+
+	if (!mq->prep_sg || mq->prep_req || !host->ops->pre_req)
+		return;
+
+	spin_lock_irq(q->queue_lock);
+	if (!blk_queue_plugged(q))
+		next = blk_peek_request(q);
+	if (next && (!blk_fs_request(next) || blk_barrier_rq(next) ||
+		     blk_rq_sectors(next) > host->max_blk_count))
+		next = NULL;
+	if (next)
+		blk_start_request(next);
+	spin_unlock_irq(q->queue_lock);
+
+	if (!next)
+		return;
+
+	memset(data, 0, sizeof(struct mmc_data));
+	data->blksz = 512;
+	data->blocks = blk_rq_sectors(next);
+	data->flags = rq_data_dir(next) == READ ? MMC_DATA_READ :
+						  MMC_DATA_WRITE;
+	data->sg = mq->prep_sg;
+	data->sg_len = blk_rq_map_sg(q, next, mq->prep_sg);
+
+	memset(&mq->prep_mrq, 0, sizeof(struct mmc_request));
+	mq->prep_mrq.data = data;
+	mq->prep_req = next;
+
+	mmc_pre_req(host, &mq->prep_mrq, false);
+}
 
 static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 {
 	struct mmc_blk_data *md = mq->data;
 	struct mmc_card *card = md->queue.card;
 	struct mmc_blk_request brq;
-	int ret = 1, disable_multi = 0;
+	struct completion done;
+	int ret = 1, disable_multi = 0, prepared = 0;
+
+	/* Already mapped into prep_sg, which becomes our list */
+	if (req == mq->prep_req) {
+		swap(mq->sg, mq->prep_sg);
+		mq->prep_req = NULL;
+		prepared = 1;
+	}
 
 #ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
 	if (mmc_bus_needs_resume(card->host)) {
 		mmc_resume_bus(card->host);
-		if (mmc_bus_fails_resume(card->host))
+		if (mmc_bus_fails_resume(card->host)) {
+			if (prepared)
+				mmc_post_req(card->host, &mq->prep_mrq, -EIO);
 			return 0;
+		}
 		mmc_blk_set_blksize(md, card);
 	}
 
 	if (mmc_bus_fails_resume(card->host)) {
+		if (prepared)
+			mmc_post_req(card->host, &mq->prep_mrq, -EIO);
 		spin_lock_irq(&md->lock);
 		__blk_end_request_all(req, -EIO);
 		spin_unlock_irq(&md->lock);
@@ -313,6 +460,8 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 
 	mmc_claim_host(card->host);
 
+	mmc_blk_pack_requests(mq, req);
+
 	do {
 		struct mmc_command cmd;
 		u32 readcmd, writecmd, status = 0;
@@ -329,7 +478,7 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 		brq.stop.opcode = MMC_STOP_TRANSMISSION;
 		brq.stop.arg = 0;
 		brq.stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
-		brq.data.blocks = blk_rq_sectors(req);
+		brq.data.blocks = blk_rq_sectors(req) + mq->packed_sectors;
 
 		/*
 		 * The block layer doesn't support all sector count
@@ -356,6 +505,17 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 				brq.mrq.stop = &brq.stop;
 			readcmd = MMC_READ_MULTIPLE_BLOCK;
 			writecmd = MMC_WRITE_MULTIPLE_BLOCK;
+
+			/*
+			 * Tell the card the length up front, the host then
+			 * only sends a stop if the transfer fails.
+			 */
+			if (md->use_cmd23) {
+				brq.sbc.opcode = MMC_SET_BLOCK_COUNT;
+				brq.sbc.arg = brq.data.blocks;
+				brq.sbc.flags = MMC_RSP_R1 | MMC_CMD_AC;
+				brq.mrq.sbc = &brq.sbc;
+			}
 		} else {
 			brq.mrq.stop = NULL;
 			readcmd = MMC_READ_SINGLE_BLOCK;
@@ -387,13 +547,25 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 		mmc_set_data_timeout(&brq.data, card);
 
 		brq.data.sg = mq->sg;
-		brq.data.sg_len = mmc_queue_map_sg(mq);
+		if (prepared && !mq->nr_packed &&
+		    brq.data.blocks == mq->prep_data.blocks) {
+			/* Mapped while the last request was on the bus */
+			brq.data.sg_len = mq->prep_data.sg_len;
+			brq.data.host_cookie = mq->prep_data.host_cookie;
+		} else {
+			if (prepared)
+				mmc_post_req(card->host, &mq->prep_mrq,
+					     -EINVAL);
+			brq.data.sg_len = mmc_queue_map_sg(mq);
+		}
+		prepared = 0;
 
 		/*
 		 * Adjust the sg list so it is the same size as the
 		 * request.
 		 */
-		if (brq.data.blocks != blk_rq_sectors(req)) {
+		if (brq.data.blocks !=
+		    blk_rq_sectors(req) + mq->packed_sectors) {
 			int i, data_size = brq.data.blocks << 9;
 			struct scatterlist *sg;
 
@@ -410,16 +582,35 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 
 		mmc_queue_bounce_pre(mq);
 
-		mmc_wait_for_req(card->host, &brq.mrq);
+		mmc_start_req(card->host, &brq.mrq, &done);
+		mmc_blk_prep_next(mq);
+		mmc_wait_for_req_done(&brq.mrq);
+		if (brq.data.host_cookie)
+			mmc_post_req(card->host, &brq.mrq, brq.data.error);
 
 		mmc_queue_bounce_post(mq);
 
+		/*
+		 * Don't try to work out how far a packed transfer got,
+		 * just send the packed requests again on their own and
+		 * treat this as a failure of @req alone.
+		 */
+		if ((brq.sbc.error || brq.cmd.error || brq.data.error ||
+		     brq.stop.error) && mq->nr_packed) {
+			spin_lock_irq(&md->lock);
+			mmc_blk_unpack_requests(mq);
+			spin_unlock_irq(&md->lock);
+			if (brq.data.bytes_xfered > blk_rq_bytes(req))
+				brq.data.bytes_xfered = blk_rq_bytes(req);
+		}
+
 		/*
 		 * Check for errors here, but don't jump to cmd_err
 		 * until later as we need to wait for the card to leave
 		 * programming mode even when things go wrong.
 		 */
-		if (brq.cmd.error || brq.data.error || brq.stop.error) {
+		if (brq.sbc.error || brq.cmd.error || brq.data.error ||
+		    brq.stop.error) {
 			if (brq.data.blocks > 1 && rq_data_dir(req) == READ) {
 				/* Redo read one sector at a time */
 				printk(KERN_WARNING "%s: retrying using single "
@@ -432,6 +623,13 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 			disable_multi = 0;
 		}
 
+		if (brq.sbc.error) {
+			printk(KERN_ERR "%s: error %d sending SET_BLOCK_COUNT "
+			       "command, response %#x, card status %#x\n",
+			       req->rq_disk->disk_name, brq.sbc.error,
+			       brq.sbc.resp[0], status);
+		}
+
 		if (brq.cmd.error) {
 			printk(KERN_ERR "%s: error %d sending read/write "
 			       "command, response %#x, card status %#x\n",
@@ -502,7 +700,8 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 #endif
 		}
 
-		if (brq.cmd.error || brq.stop.error || brq.data.error) {
+		if (brq.sbc.error || brq.cmd.error || brq.stop.error ||
+		    brq.data.error) {
 			if (rq_data_dir(req) == READ) {
 				/*
 				 * After an error, we redo I/O one sector at a
@@ -521,7 +720,11 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 		 * A block was successfully transferred.
 		 */
 		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
+		if (mq->nr_packed)
+			ret = mmc_blk_end_packed(mq, req,
+						 brq.data.bytes_xfered);
+		else
+			ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
 		spin_unlock_irq(&md->lock);
 	} while (ret);
 
@@ -538,6 +741,14 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 	 * as reported by the controller (which might be less than
 	 * the real number of written sectors, but never more).
 	 */
+	if (mq->nr_packed) {
+		spin_lock_irq(&md->lock);
+		mmc_blk_unpack_requests(mq);
+		spin_unlock_irq(&md->lock);
+		if (brq.data.bytes_xfered > blk_rq_bytes(req))
+			brq.data.bytes_xfered = blk_rq_bytes(req);
+	}
+
 	if (mmc_card_sd(card)) {
 		u32 blocks;
 
@@ -593,6 +804,18 @@ static struct mmc_blk_data *mmc_blk_alloc(struct mmc_card *card)
 	 */
 	md->read_only = mmc_blk_readonly(card);
 
+	/*
+	 * MMC cards from v3.1 on take SET_BLOCK_COUNT, SD cards say
+	 * so in the SCR.
+	 */
+	if (card->host->caps & MMC_CAP_CMD23) {
+		if (mmc_card_mmc(card))
+			md->use_cmd23 = card->csd.mmca_vsn >= CSD_SPEC_VER_3;
+		else if (mmc_card_sd(card))
+			md->use_cmd23 = !!(card->scr.cmds &
+					   SD_SCR_CMD23_SUPPORT);
+	}
+
 	md->disk = alloc_disk(1 << MMC_SHIFT);
 	if (md->disk == NULL) {
 		ret = -ENOMEM;
@@ -57,7 +57,10 @@ static int mmc_queue_thread(void *d)
 
 		spin_lock_irq(q->queue_lock);
 		set_current_state(TASK_INTERRUPTIBLE);
-		if (!blk_queue_plugged(q))
+		/* Prepared during the last transfer, so it goes first */
+		if (mq->prep_req)
+			req = mq->prep_req;
+		else if (!blk_queue_plugged(q))
 			req = blk_fetch_request(q);
 		mq->req = req;
 		spin_unlock_irq(q->queue_lock);
@@ -160,6 +163,10 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
 
 	mq->queue->queuedata = mq;
 	mq->req = NULL;
+	mq->nr_packed = 0;
+	mq->packed_sectors = 0;
+	mq->prep_req = NULL;
+	mq->prep_sg = NULL;
 
 	blk_queue_prep_rq(mq->queue, mmc_prep_request);
 	blk_queue_ordered(mq->queue, QUEUE_ORDERED_DRAIN, NULL);
@@ -228,6 +235,16 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
 			goto cleanup_queue;
 		}
 		sg_init_table(mq->sg, host->max_phys_segs);
+
+		/*
+		 * Second list for mapping the next request while this
+		 * one is on the bus.  Not having it just means no
+		 * pipelining.
+		 */
+		mq->prep_sg = kmalloc(sizeof(struct scatterlist) *
+			host->max_phys_segs, GFP_KERNEL);
+		if (mq->prep_sg)
+			sg_init_table(mq->prep_sg, host->max_phys_segs);
 	}
 
 	init_MUTEX(&mq->thread_sem);
@@ -247,6 +264,8 @@ int mmc_init_queue(struct mmc_queue *mq, struct mmc_card *card, spinlock_t *lock
  	if (mq->sg)
 		kfree(mq->sg);
 	mq->sg = NULL;
+	kfree(mq->prep_sg);
+	mq->prep_sg = NULL;
 	if (mq->bounce_buf)
 		kfree(mq->bounce_buf);
 	mq->bounce_buf = NULL;
@@ -278,6 +297,9 @@ void mmc_cleanup_queue(struct mmc_queue *mq)
 	kfree(mq->sg);
 	mq->sg = NULL;
 
+	kfree(mq->prep_sg);
+	mq->prep_sg = NULL;
+
 	if (mq->bounce_buf)
 		kfree(mq->bounce_buf);
 	mq->bounce_buf = NULL;
@@ -340,8 +362,18 @@ unsigned int mmc_queue_map_sg(struct mmc_queue *mq)
 	struct scatterlist *sg;
 	int i;
 
-	if (!mq->bounce_buf)
-		return blk_rq_map_sg(mq->queue, mq->req, mq->sg);
+	if (!mq->bounce_buf) {
+		sg_len = blk_rq_map_sg(mq->queue, mq->req, mq->sg);
+
+		/* Packed requests carry on in the same list */
+		for (i = 0; i < mq->nr_packed; i++) {
+			sg_unmark_end(&mq->sg[sg_len - 1]);
+			sg_len += blk_rq_map_sg(mq->queue, mq->packed[i],
+						mq->sg + sg_len);
+		}
+
+		return sg_len;
+	}
 
 	BUG_ON(!mq->bounce_sg);
 
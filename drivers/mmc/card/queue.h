@@ -4,6 +4,12 @@
 struct request;
 struct task_struct;
 
+/*
+ * Requests that follow on from the current one can be sent to the
+ * card in the same transfer.
+ */
+#define MMC_PACKED_MAX		8
+
 struct mmc_queue {
 	struct mmc_card		*card;
 	struct task_struct	*thread;
@@ -17,6 +23,13 @@ struct mmc_queue {
 	char			*bounce_buf;
 	struct scatterlist	*bounce_sg;
 	unsigned int		bounce_sg_len;
+	struct request		*packed[MMC_PACKED_MAX]; /* carried with req */
+	unsigned int		nr_packed;
+	unsigned int		packed_sectors;
+	struct request		*prep_req;	/* started, issue next */
+	struct scatterlist	*prep_sg;	/* prep_req mapped here */
+	struct mmc_data		prep_data;
+	struct mmc_request	prep_mrq;
 #ifdef CONFIG_MMC_BLOCK_PARANOID_RESUME
 	int			check_status;
 #endif
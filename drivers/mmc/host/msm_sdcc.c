@@ -71,6 +71,9 @@ static int msmsdcc_auto_suspend(struct mmc_host *, int);
 
 #define BUSCLK_PWRSAVE 1
 #define BUSCLK_TIMEOUT (HZ)
+/* Lower bounds for the adaptive timeout, SDIO traffic comes in bursts */
+#define BUSCLK_TIMEOUT_MIN_SD	(HZ / 10)
+#define BUSCLK_TIMEOUT_MIN_SDIO	(HZ / 50 ? HZ / 50 : 1)
 static unsigned int msmsdcc_fmin = 144000;
 static unsigned int msmsdcc_fmax = 50000000;
 static unsigned int msmsdcc_4bit = 1;
@@ -85,6 +88,13 @@ static unsigned long msmsdcc_irqtime;
 #define PIO_SPINMAX 30
 #define CMD_SPINMAX 20
 
+/*
+ * Transfers DMA can't do in place (odd lengths, unaligned buffers) go
+ * through a bounce buffer rather than PIO, unless they are tiny.
+ */
+#define DMA_BOUNCE_MIN	MCI_FIFOSIZE
+#define DMA_BOUNCE_SIZE	SZ_4K
+
 #define WRITE_WAIT_DAT0_MAX		10
 
 #define VERBOSE_COMMAND_TIMEOUTS	1
@@ -145,14 +155,23 @@ msmsdcc_disable_clocks(struct msmsdcc_host *host, int deferr)
 	if (is_wimax_platform(host->plat))
 		return;
 
+	/* card interrupts are only seen while the bus clock runs */
+	if (msmsdcc_sdioirq && host->mmc->sdio_irqs)
+		return;
+
 	if (deferr) {
-		mod_timer(&host->busclk_timer, jiffies + BUSCLK_TIMEOUT);
+		host->busclk.idle_since = jiffies;
+		host->busclk.idle = 1;
+		mod_timer(&host->busclk_timer,
+			  jiffies + host->busclk.timeout);
 	} else {
 		del_timer_sync(&host->busclk_timer);
 		if (host->clks_on) {
 			clk_disable(host->clk);
 			clk_disable(host->pclk);
 			host->clks_on = 0;
+			host->busclk.gates++;
+			host->busclk.on_time += jiffies - host->busclk.on_since;
 		}
 	}
 }
@@ -172,14 +191,50 @@ msmsdcc_busclk_expired(unsigned long _data)
 
 #endif
 
+/*
+ * Work out the next idle timeout from the gap that just ended.  Gaps
+ * longer than BUSCLK_TIMEOUT are real idle time and say nothing about
+ * how the traffic is spaced.
+ */
+static void
+msmsdcc_busclk_learn(struct msmsdcc_host *host, int gated)
+{
+	struct msmsdcc_busclk *bc = &host->busclk;
+	unsigned long gap;
+
+	if (!bc->idle)
+		return;
+	bc->idle = 0;
+	gap = jiffies - bc->idle_since;
+
+	if (gated) {
+		if (gap < 2 * bc->timeout) {
+			bc->early_ungates++;
+			bc->timeout = min_t(unsigned long, 2 * bc->timeout,
+					    BUSCLK_TIMEOUT);
+		}
+		return;
+	}
+
+	if (gap >= BUSCLK_TIMEOUT)
+		return;
+	bc->avg_gap += gap - (bc->avg_gap >> 3);
+	bc->timeout = clamp_t(unsigned long, 2 * (bc->avg_gap >> 3) + 1,
+			      bc->min_timeout, BUSCLK_TIMEOUT);
+}
+
 static inline int
 msmsdcc_enable_clocks(struct msmsdcc_host *host)
 {
+	ktime_t start;
+	unsigned int us;
 	int rc;
 
 	del_timer_sync(&host->busclk_timer);
+	msmsdcc_busclk_learn(host, !host->clks_on);
 
 	if (!host->clks_on) {
+		start = ktime_get();
 		rc = clk_enable(host->pclk);
 		if (rc)
 			return rc;
@@ -191,6 +246,13 @@ msmsdcc_enable_clocks(struct msmsdcc_host *host)
 		udelay(1 + ((3 * USEC_PER_SEC) /
 		       (host->clk_rate ? host->clk_rate : msmsdcc_fmin)));
 		host->clks_on = 1;
+
+		us = ktime_us_delta(ktime_get(), start);
+		host->busclk.ungates++;
+		host->busclk.ungate_us += us;
+		if (us > host->busclk.ungate_max_us)
+			host->busclk.ungate_max_us = us;
+		host->busclk.on_since = jiffies;
 	}
 	return 0;
 }
@@ -258,6 +320,16 @@ msmsdcc_stop_data(struct msmsdcc_host *host)
 	host->curr.got_dataend = 0;
 }
 
+/*
+ * A transfer preceded by SET_BLOCK_COUNT ends on its own, it only
+ * needs a STOP_TRANSMISSION to get the card out of a failed one.
+ */
+static inline int
+msmsdcc_data_needs_stop(struct mmc_data *data)
+{
+	return data->stop && (!data->mrq->sbc || data->error);
+}
+
 uint32_t msmsdcc_fifo_addr(struct msmsdcc_host *host)
 {
 	switch (host->pdev_id) {
@@ -339,8 +411,15 @@ msmsdcc_dma_complete_func(struct msm_dmov_cmd *cmd,
 		if (!mrq->data->error)
 			mrq->data->error = -EIO;
 	}
-	dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg, host->dma.num_ents,
-		     host->dma.dir);
+	if (host->dma.bounced) {
+		if (host->dma.dir == DMA_FROM_DEVICE && !mrq->data->error)
+			sg_copy_from_buffer(host->dma.sg, host->dma.num_ents,
+					    host->dma.bounce_buf,
+					    host->curr.xfer_size);
+		host->dma.bounced = 0;
+	} else
+		dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg,
+			     host->dma.num_ents, host->dma.dir);
 
 	if (host->curr.user_pages) {
 		struct scatterlist *sg = host->dma.sg;
@@ -363,7 +442,7 @@ msmsdcc_dma_complete_func(struct msm_dmov_cmd *cmd,
 
 		if (!mrq->data->error)
 			host->curr.data_xfered = host->curr.xfer_size;
-		if (!mrq->data->stop || mrq->cmd->error) {
+		if (!msmsdcc_data_needs_stop(mrq->data) || mrq->cmd->error) {
 			host->curr.mrq = NULL;
 			host->curr.cmd = NULL;
 			mrq->data->bytes_xfered = host->curr.data_xfered;
@@ -385,6 +464,9 @@ out:
 
 static int validate_dma(struct msmsdcc_host *host, struct mmc_data *data)
 {
+	struct scatterlist *sg;
+	int i;
+
 	if (host->dma.channel == -1)
 		return -ENOENT;
 
@@ -392,115 +474,151 @@ static int validate_dma(struct msmsdcc_host *host, struct mmc_data *data)
 		return -EINVAL;
 	if ((data->blksz * data->blocks) % MCI_FIFOSIZE)
 		return -EINVAL;
+
+	/* Each element is moved in whole FIFO bursts, word aligned */
+	for_each_sg(data->sg, sg, data->sg_len, i) {
+		if ((sg->length % MCI_FIFOSIZE) || (sg->offset & 3))
+			return -EINVAL;
+	}
 	return 0;
 }
 
-static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
+static int msmsdcc_dma_crci(struct msmsdcc_host *host, uint32_t *crci)
 {
-	struct msmsdcc_nc_dmadata *nc;
-	dmov_box *box;
-	uint32_t rows;
-	uint32_t crci;
-	unsigned int n;
-	int i, rc;
-	struct scatterlist *sg = data->sg;
-
-	rc = validate_dma(host, data);
-	if (rc)
-		return rc;
-
-	host->dma.sg = data->sg;
-	host->dma.num_ents = data->sg_len;
-
-       BUG_ON(host->dma.num_ents > NR_SG); /* Prevent memory corruption */
-
-	nc = host->dma.nc;
-
 	switch (host->pdev_id) {
 	case 1:
-		crci = MSMSDCC_CRCI_SDC1;
+		*crci = MSMSDCC_CRCI_SDC1;
 		break;
 	case 2:
-		crci = MSMSDCC_CRCI_SDC2;
+		*crci = MSMSDCC_CRCI_SDC2;
 		break;
 	case 3:
-		crci = MSMSDCC_CRCI_SDC3;
+		*crci = MSMSDCC_CRCI_SDC3;
 		break;
 	case 4:
-		crci = MSMSDCC_CRCI_SDC4;
+		*crci = MSMSDCC_CRCI_SDC4;
 		break;
 	default:
-		host->dma.sg = NULL;
-		host->dma.num_ents = 0;
 		return -ENOENT;
 	}
+	return 0;
+}
 
-	if (data->flags & MMC_DATA_READ)
-		host->dma.dir = DMA_FROM_DEVICE;
-	else
-		host->dma.dir = DMA_TO_DEVICE;
+/*
+ * Map @data and build its DataMover command list in @sgcmd.
+ */
+static int msmsdcc_prep_dma(struct msmsdcc_host *host, struct mmc_data *data,
+			    struct msm_dmov_sg_cmd *sgcmd)
+{
+	enum dma_data_direction dir;
+	uint32_t crci;
+	unsigned int n;
+	int rc;
 
-	host->curr.user_pages = 0;
+	rc = validate_dma(host, data);
+	if (rc)
+		return rc;
 
-	box = &nc->cmd[0];
-	for (i = 0; i < host->dma.num_ents; i++) {
-		box->cmd = CMD_MODE_BOX;
+	BUG_ON(data->sg_len > NR_SG); /* Prevent memory corruption */
 
-	/* Initialize sg dma address */
-	sg->dma_address = page_to_dma(mmc_dev(host->mmc), sg_page(sg))
-				+ sg->offset;
+	rc = msmsdcc_dma_crci(host, &crci);
+	if (rc)
+		return rc;
 
-	if (i == (host->dma.num_ents - 1))
-			box->cmd |= CMD_LC;
-		rows = (sg_dma_len(sg) % MCI_FIFOSIZE) ?
-			(sg_dma_len(sg) / MCI_FIFOSIZE) + 1 :
-			(sg_dma_len(sg) / MCI_FIFOSIZE) ;
+	if (data->flags & MMC_DATA_READ)
+		dir = DMA_FROM_DEVICE;
+	else
+		dir = DMA_TO_DEVICE;
 
-		if (data->flags & MMC_DATA_READ) {
-			box->src_row_addr = msmsdcc_fifo_addr(host);
-			box->dst_row_addr = sg_dma_address(sg);
+	n = dma_map_sg(mmc_dev(host->mmc), data->sg, data->sg_len, dir);
+	if (n != data->sg_len) {
+		printk(KERN_ERR "%s: Unable to map in all sg elements\n",
+			mmc_hostname(host->mmc));
+		return -ENOMEM;
+	}
 
-			box->src_dst_len = (MCI_FIFOSIZE << 16) |
-					   (MCI_FIFOSIZE);
-			box->row_offset = MCI_FIFOSIZE;
+	msm_dmov_sg_reset(sgcmd);
+	rc = msm_dmov_sg_append(sgcmd, data->sg, data->sg_len,
+				msmsdcc_fifo_addr(host), MCI_FIFOSIZE, dir,
+				crci);
+	BUG_ON(rc);
 
-			box->num_rows = rows * ((1 << 16) + 1);
-			box->cmd |= CMD_SRC_CRCI(crci);
-		} else {
-			box->src_row_addr = sg_dma_address(sg);
-			box->dst_row_addr = msmsdcc_fifo_addr(host);
+	return 0;
+}
 
-			box->src_dst_len = (MCI_FIFOSIZE << 16) |
-					   (MCI_FIFOSIZE);
-			box->row_offset = (MCI_FIFOSIZE << 16);
+/*
+ * Run @data through the coherent bounce buffer.  The DataMover still
+ * moves whole FIFO bursts, the buffer just has room for the padding,
+ * and the controller stops at the real length.
+ */
+static int msmsdcc_bounce_dma(struct msmsdcc_host *host,
+			      struct mmc_data *data)
+{
+	unsigned int size = data->blksz * data->blocks;
+	enum dma_data_direction dir;
+	uint32_t crci;
+	int rc;
 
-			box->num_rows = rows * ((1 << 16) + 1);
-			box->cmd |= CMD_DST_CRCI(crci);
-		}
-		box++;
-		sg++;
+	if (!host->dma.bounce_buf || host->dma.channel == -1 ||
+	    size < DMA_BOUNCE_MIN || size > DMA_BOUNCE_SIZE)
+		return -EINVAL;
+
+	rc = msmsdcc_dma_crci(host, &crci);
+	if (rc)
+		return rc;
+
+	if (data->flags & MMC_DATA_READ)
+		dir = DMA_FROM_DEVICE;
+	else {
+		dir = DMA_TO_DEVICE;
+		sg_copy_to_buffer(data->sg, data->sg_len,
+				  host->dma.bounce_buf, size);
 	}
 
-	/* location of command block must be 64 bit aligned */
-	BUG_ON(host->dma.cmd_busaddr & 0x07);
+	sg_dma_address(&host->dma.bounce_sg) = host->dma.bounce_busaddr;
+	sg_dma_len(&host->dma.bounce_sg) = ALIGN(size, MCI_FIFOSIZE);
 
-	nc->cmdptr = (host->dma.cmd_busaddr >> 3) | CMD_PTR_LP;
-	host->dma.hdr.cmdptr = DMOV_CMD_PTR_LIST |
-			       DMOV_CMD_ADDR(host->dma.cmdptr_busaddr);
-	host->dma.hdr.complete_func = msmsdcc_dma_complete_func;
+	msm_dmov_sg_reset(host->dma.sgcmd);
+	rc = msm_dmov_sg_append(host->dma.sgcmd, &host->dma.bounce_sg, 1,
+				msmsdcc_fifo_addr(host), MCI_FIFOSIZE, dir,
+				crci);
+	BUG_ON(rc);
+	host->dma.bounced = 1;
 
-	n = dma_map_sg(mmc_dev(host->mmc), host->dma.sg,
-			host->dma.num_ents, host->dma.dir);
-/* dsb inside dma_map_sg will write nc out to mem as well */
+	return 0;
+}
 
-	if (n != host->dma.num_ents) {
-		printk(KERN_ERR "%s: Unable to map in all sg elements\n",
-			mmc_hostname(host->mmc));
-		host->dma.sg = NULL;
-		host->dma.num_ents = 0;
-		return -ENOMEM;
+static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
+{
+	int rc;
+
+	host->dma.bounced = 0;
+	if (data->host_cookie && data->host_cookie == host->dma.next.cookie &&
+	    data->sg == host->dma.next.sg &&
+	    data->sg_len == host->dma.next.num_ents) {
+		/* Already done by msmsdcc_pre_req(), take its list */
+		swap(host->dma.sgcmd, host->dma.next.sgcmd);
+		host->dma.next.cookie = 0;
+	} else {
+		rc = msmsdcc_prep_dma(host, data, host->dma.sgcmd);
+		if (rc == -EINVAL)
+			rc = msmsdcc_bounce_dma(host, data);
+		if (rc)
+			return rc;
 	}
 
+	host->dma.sg = data->sg;
+	host->dma.num_ents = data->sg_len;
+	if (data->flags & MMC_DATA_READ)
+		host->dma.dir = DMA_FROM_DEVICE;
+	else
+		host->dma.dir = DMA_TO_DEVICE;
+
+	host->curr.user_pages = 0;
+
+	host->dma.hdr.cmdptr = msm_dmov_sg_cmdptr(host->dma.sgcmd);
+	host->dma.hdr.complete_func = msmsdcc_dma_complete_func;
+
 	return 0;
 }
 
@@ -649,6 +767,16 @@ msmsdcc_start_command(struct msmsdcc_host *host, struct mmc_command *cmd, u32 c)
 	msmsdcc_start_command_exec(host, cmd->arg, c);
 }
 
+static void
+msmsdcc_start_cmd_data(struct msmsdcc_host *host, struct mmc_request *mrq)
+{
+	if (mrq->data && mrq->data->flags & MMC_DATA_READ)
+		/* Queue/read data, daisy-chain command when data starts */
+		msmsdcc_start_data(host, mrq->data, mrq->cmd, 0);
+	else
+		msmsdcc_start_command(host, mrq->cmd, 0);
+}
+
 static void
 msmsdcc_data_err(struct msmsdcc_host *host, struct mmc_data *data,
 		 unsigned int status)
@@ -891,6 +1019,15 @@ static void msmsdcc_do_cmdirq(struct msmsdcc_host *host, uint32_t status)
 		cmd->error = -EILSEQ;
 	}
 
+	if (cmd == cmd->mrq->sbc) {
+		/* The block count is set, now send the transfer itself */
+		if (!cmd->error)
+			msmsdcc_start_cmd_data(host, cmd->mrq);
+		else
+			msmsdcc_request_end(host, cmd->mrq);
+		return;
+	}
+
 	if (!cmd->data || cmd->error) {
 		if (host->curr.data && host->dma.sg)
 			msm_dmov_stop_cmd(host->dma.channel,
@@ -962,7 +1099,7 @@ msmsdcc_handle_irq_data(struct msmsdcc_host *host, u32 status,
 		if (!data->error)
 			host->curr.data_xfered = host->curr.xfer_size;
 
-		if (!data->stop)
+		if (!msmsdcc_data_needs_stop(data))
 			msmsdcc_request_end(host, data->mrq);
 		else
 			msmsdcc_start_command(host, data->stop, 0);
@@ -1049,11 +1186,10 @@ msmsdcc_request(struct mmc_host *mmc, struct mmc_request *mrq)
 
 	host->curr.mrq = mrq;
 
-	if (mrq->data && mrq->data->flags & MMC_DATA_READ)
-		/* Queue/read data, daisy-chain command when data starts */
-		msmsdcc_start_data(host, mrq->data, mrq->cmd, 0);
+	if (mrq->sbc)
+		msmsdcc_start_command(host, mrq->sbc, 0);
 	else
-		msmsdcc_start_command(host, mrq->cmd, 0);
+		msmsdcc_start_cmd_data(host, mrq);
 
 	if (host->cmdpoll && !msmsdcc_spin_on_status(host,
 				MCI_CMDRESPEND|MCI_CMDCRCFAIL|MCI_CMDTIMEOUT,
@@ -1154,8 +1290,74 @@ static void msmsdcc_enable_sdio_irq(struct mmc_host *mmc, int enable)
 	spin_unlock_irqrestore(&host->lock, flags);
 }
 
+/*
+ * Map the next request and build its command list while the current
+ * one is still on the bus.  There is one spare list, so only one
+ * request can be prepared at a time.
+ */
+static void
+msmsdcc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+		bool is_first_req)
+{
+	struct msmsdcc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+	unsigned long flags;
+
+	if (!data)
+		return;
+	data->host_cookie = 0;
+	if (!host->dma.next.sgcmd || host->dma.next.cookie)
+		return;
+	if (msmsdcc_prep_dma(host, data, host->dma.next.sgcmd))
+		return;
+
+	spin_lock_irqsave(&host->lock, flags);
+	if (++host->dma.cookie <= 0)
+		host->dma.cookie = 1;
+	data->host_cookie = host->dma.cookie;
+	host->dma.next.cookie = data->host_cookie;
+	host->dma.next.sg = data->sg;
+	host->dma.next.num_ents = data->sg_len;
+	if (data->flags & MMC_DATA_READ)
+		host->dma.next.dir = DMA_FROM_DEVICE;
+	else
+		host->dma.next.dir = DMA_TO_DEVICE;
+	spin_unlock_irqrestore(&host->lock, flags);
+}
+
+/*
+ * Once the request has been issued the mapping belongs to the transfer
+ * and is undone on completion, so there is only something to do here
+ * if it never made it to msmsdcc_config_dma().
+ */
+static void
+msmsdcc_post_req(struct mmc_host *mmc, struct mmc_request *mrq, int err)
+{
+	struct msmsdcc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+	unsigned long flags;
+	int unmap = 0;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	spin_lock_irqsave(&host->lock, flags);
+	if (data->host_cookie == host->dma.next.cookie) {
+		host->dma.next.cookie = 0;
+		unmap = 1;
+	}
+	spin_unlock_irqrestore(&host->lock, flags);
+
+	if (unmap)
+		dma_unmap_sg(mmc_dev(mmc), host->dma.next.sg,
+			     host->dma.next.num_ents, host->dma.next.dir);
+	data->host_cookie = 0;
+}
+
 static const struct mmc_host_ops msmsdcc_ops = {
 	.request	= msmsdcc_request,
+	.pre_req	= msmsdcc_pre_req,
+	.post_req	= msmsdcc_post_req,
 	.set_ios	= msmsdcc_set_ios,
 	.enable_sdio_irq = msmsdcc_enable_sdio_irq,
 
@@ -1240,18 +1442,27 @@ msmsdcc_init_dma(struct msmsdcc_host *host)
 	if (!host->dmares)
 		return -ENODEV;
 
-	host->dma.nc = dma_alloc_coherent(NULL,
-					  sizeof(struct msmsdcc_nc_dmadata),
-					  &host->dma.nc_busaddr,
-					  GFP_KERNEL);
-	if (host->dma.nc == NULL) {
+	/*
+	 * One transfer is in flight at a time, plus one being prepared
+	 * behind it.  The two command lists swap roles as requests go.
+	 */
+	host->dma.pool = msm_dmov_sg_pool_create(2, NR_SG);
+	if (IS_ERR(host->dma.pool)) {
 		pr_err("Unable to allocate DMA buffer\n");
+		host->dma.pool = NULL;
 		return -ENOMEM;
 	}
-	memset(host->dma.nc, 0x00, sizeof(struct msmsdcc_nc_dmadata));
-	host->dma.cmd_busaddr = host->dma.nc_busaddr;
-	host->dma.cmdptr_busaddr = host->dma.nc_busaddr +
-				offsetof(struct msmsdcc_nc_dmadata, cmdptr);
+	host->dma.sgcmd = msm_dmov_sg_get(host->dma.pool);
+	host->dma.next.sgcmd = msm_dmov_sg_get(host->dma.pool);
+
+	/* Without it odd sized transfers just stay on PIO */
+	host->dma.bounce_buf = dma_alloc_coherent(NULL, DMA_BOUNCE_SIZE,
+						  &host->dma.bounce_busaddr,
+						  GFP_KERNEL);
+	if (host->dma.bounce_buf)
+		sg_init_one(&host->dma.bounce_sg, host->dma.bounce_buf,
+			    DMA_BOUNCE_SIZE);
+
 	host->dma.channel = host->dmares->start;
 
 	return 0;
@@ -1428,6 +1639,7 @@ msmsdcc_probe(struct platform_device *pdev)
 	if (msmsdcc_sdioirq)
 		mmc->caps |= MMC_CAP_SDIO_IRQ;
 	mmc->caps |= MMC_CAP_MMC_HIGHSPEED | MMC_CAP_SD_HIGHSPEED;
+	mmc->caps |= MMC_CAP_CMD23;
 
 	mmc->max_phys_segs = NR_SG;
 	mmc->max_hw_segs = NR_SG;
@@ -1487,6 +1699,12 @@ msmsdcc_probe(struct platform_device *pdev)
 	host->busclk_timer.data = (unsigned long) host;
 	host->busclk_timer.function = msmsdcc_busclk_expired;
 #endif
+	if (is_sd_platform(plat))
+		host->busclk.min_timeout = BUSCLK_TIMEOUT_MIN_SD;
+	else
+		host->busclk.min_timeout = BUSCLK_TIMEOUT_MIN_SDIO;
+	host->busclk.timeout = BUSCLK_TIMEOUT;
+	host->busclk.stats_since = jiffies;
 
 	ret = request_irq(cmd_irqres->start, msmsdcc_irq, IRQF_SHARED,
 			  DRIVER_NAME " (cmd)", host);
@@ -1524,11 +1742,9 @@ msmsdcc_probe(struct platform_device *pdev)
 		mmc_hostname(mmc), msmsdcc_pwrsave);
 
 	if (host->dma.channel != -1) {
-		pr_info("%s: DM non-cached buffer at %p, dma_addr 0x%.8x\n",
-			mmc_hostname(mmc), host->dma.nc, host->dma.nc_busaddr);
 		pr_info("%s: DM cmd busaddr 0x%.8x, cmdptr busaddr 0x%.8x\n",
-			mmc_hostname(mmc), host->dma.cmd_busaddr,
-			host->dma.cmdptr_busaddr);
+			mmc_hostname(mmc), host->dma.sgcmd->box_busaddr,
+			host->dma.sgcmd->cmdptr_busaddr);
 	} else
 		pr_info("%s: PIO transfer enabled\n", mmc_hostname(mmc));
 	if (host->timer.function)
@@ -1583,7 +1799,9 @@ msmsdcc_suspend(struct platform_device *dev, pm_message_t state)
 			clk_disable(host->clk);
 			clk_disable(host->pclk);
 			host->clks_on = 0;
+			host->busclk.on_time += jiffies - host->busclk.on_since;
 		}
+		host->busclk.idle = 0;
 	}
 	return rc;
 }
@@ -1624,6 +1842,7 @@ static struct platform_driver msmsdcc_driver = {
 	.resume		= msmsdcc_resume,
 	.driver		= {
 		.name	= "msm_sdcc",
+		.probe_async = true,
 	},
 };
 
@@ -1656,6 +1875,17 @@ static int __init msmsdcc_nopwrsave_setup(char *__unused)
 }
 
 
+/*
+ * Have the controller signal SDIO card interrupts instead of the core
+ * polling CCCR_INTx every 10ms. The bus clock then stays on while a
+ * function has its interrupt claimed.
+ */
+static int __init msmsdcc_sdioirq_setup(char *__unused)
+{
+	msmsdcc_sdioirq = 1;
+	return 1;
+}
+
 static int __init msmsdcc_fmin_setup(char *str)
 {
 	unsigned int n;
@@ -1679,6 +1909,7 @@ static int __init msmsdcc_fmax_setup(char *str)
 
 __setup("msmsdcc_pwrsave", msmsdcc_pwrsave_setup);
 __setup("msmsdcc_nopwrsave", msmsdcc_nopwrsave_setup);
+__setup("msmsdcc_sdioirq", msmsdcc_sdioirq_setup);
 __setup("msmsdcc_fmin=", msmsdcc_fmin_setup);
 __setup("msmsdcc_fmax=", msmsdcc_fmax_setup);
 
@@ -1702,6 +1933,8 @@ msmsdcc_dbg_state_read(struct file *file, char __user *ubuf,
 		       size_t count, loff_t *ppos)
 {
 	struct msmsdcc_host *host = (struct msmsdcc_host *) file->private_data;
+	struct msmsdcc_busclk *bc = &host->busclk;
+	unsigned long elapsed, on;
 	char buf[1024];
 	int max, i;
 
@@ -1728,6 +1961,21 @@ msmsdcc_dbg_state_read(struct file *file, char __user *ubuf,
 			      host->curr.data_xfered, host->dma.sg);
 	}
 
+	elapsed = jiffies - bc->stats_since;
+	on = bc->on_time;
+	if (host->clks_on)
+		on += jiffies - bc->on_since;
+	i += scnprintf(buf + i, max - i,
+		       "CLK : timeout %u ms, gates %u (%u/s), early %u\n",
+		       jiffies_to_msecs(bc->timeout), bc->gates,
+		       elapsed >= HZ ? bc->gates / (elapsed / HZ) : bc->gates,
+		       bc->early_ungates);
+	i += scnprintf(buf + i, max - i,
+		       "CLK : on %u of %u ms, ungate avg %u max %u us\n",
+		       jiffies_to_msecs(on), jiffies_to_msecs(elapsed),
+		       bc->ungates ? bc->ungate_us / bc->ungates : 0,
+		       bc->ungate_max_us);
+
 	return simple_read_from_buffer(ubuf, count, ppos, buf, i);
 }
 
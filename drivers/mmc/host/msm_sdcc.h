@@ -168,16 +168,9 @@
 
 struct clk;
 
-struct msmsdcc_nc_dmadata {
-	dmov_box	cmd[NR_SG];
-	uint32_t	cmdptr;
-};
-
 struct msmsdcc_dma_data {
-	struct msmsdcc_nc_dmadata	*nc;
-	dma_addr_t			nc_busaddr;
-	dma_addr_t			cmd_busaddr;
-	dma_addr_t			cmdptr_busaddr;
+	struct msm_dmov_sg_pool		*pool;
+	struct msm_dmov_sg_cmd		*sgcmd;
 
 	struct msm_dmov_cmd		hdr;
 	enum dma_data_direction		dir;
@@ -191,6 +184,20 @@ struct msmsdcc_dma_data {
 	int				active;
 	unsigned int 			result;
 	struct msm_dmov_errdata 	*err;
+
+	struct {
+		struct msm_dmov_sg_cmd	*sgcmd;
+		struct scatterlist	*sg;
+		int			num_ents;
+		enum dma_data_direction	dir;
+		s32			cookie;
+	} next;				/* mapped ahead by pre_req */
+	s32				cookie;
+
+	void				*bounce_buf;
+	dma_addr_t			bounce_busaddr;
+	struct scatterlist		bounce_sg;
+	int				bounced; /* Set if using bounce_buf */
 };
 
 struct msmsdcc_pio_data {
@@ -217,6 +224,29 @@ struct msmsdcc_stats {
 	unsigned int cmdpoll_misses;
 };
 
+/*
+ * The bus clock idle timeout follows the gaps between requests: it
+ * shrinks towards twice the average gap seen while the clocks were
+ * still on, and doubles whenever the clocks were gated just before
+ * the next request turned up.
+ */
+struct msmsdcc_busclk {
+	unsigned long	timeout;	/* idle jiffies before gating */
+	unsigned long	min_timeout;
+	unsigned long	avg_gap;	/* jiffies << 3 */
+	unsigned long	idle_since;	/* when the last request ended */
+	int		idle;		/* idle_since is valid */
+	unsigned long	on_since;	/* when the clocks went on */
+
+	unsigned long	stats_since;
+	unsigned long	on_time;	/* jiffies, up to the last gate */
+	unsigned int	gates;
+	unsigned int	early_ungates;	/* gated too soon */
+	unsigned int	ungates;
+	unsigned int	ungate_us;	/* total re-enable latency */
+	unsigned int	ungate_max_us;
+};
+
 struct msmsdcc_host {
 	struct resource		*irqres;
 	struct resource		*cmd_irqres;
@@ -234,6 +264,7 @@ struct msmsdcc_host {
 	struct clk		*pclk;		/* SDCC peripheral bus clock */
 	unsigned int		clks_on;	/* set if clocks are enabled */
 	struct timer_list	busclk_timer;
+	struct msmsdcc_busclk	busclk;
 
 	unsigned int		eject;		/* eject state */
 
@@ -23,6 +23,9 @@
 #include <linux/io.h>
 #include <linux/moduleparam.h>
 #include <linux/stat.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/slab.h>
 
 #include <asm/dma.h>
 #include <asm/mach/flash.h>
@@ -60,6 +63,37 @@ struct nand_hw_info {
 	uint32_t page_size;
 };
 
+enum {
+	MSM_NAND_STAT_READ,
+	MSM_NAND_STAT_READ_OOB,
+	MSM_NAND_STAT_WRITE,
+	MSM_NAND_STAT_ERASE,
+	MSM_NAND_STAT_NR,
+};
+
+/* latency of one command list, bucket n counts lists that finished in
+ * under 2^(n+1) us, the last one everything slower */
+#define MSM_NAND_LAT_BUCKETS 16
+
+struct msm_nand_op_stats {
+	unsigned long calls;
+	unsigned long units;		/* pages, or blocks for erase */
+	unsigned long errors;
+	uint64_t bytes;
+	uint64_t total_ns;		/* whole call, buffer waits included */
+	uint64_t dm_queue_ns;		/* queued behind other lists */
+	uint64_t dm_active_ns;		/* list running, mostly flash busy */
+	uint32_t max_us;
+	unsigned long lat[MSM_NAND_LAT_BUCKETS];
+};
+
+struct msm_nand_stats {
+	spinlock_t lock;
+	struct msm_nand_op_stats op[MSM_NAND_STAT_NR];
+	unsigned long ecc_corrected;	/* bit flips fixed up */
+	unsigned long ecc_failed;	/* pages beyond repair */
+};
+
 struct msm_nand_chip {
 	struct device *dev;
 	wait_queue_head_t wait_queue;
@@ -73,6 +107,8 @@ struct msm_nand_chip {
 	uint32_t saved_ecc_buf_cfg;
 #endif
 	struct nand_hw_info dev_info;
+	struct msm_nand_stats stats;
+	loff_t subpage_start;	/* 0, or start of the sub-page layout */
 };
 
 #define CFG1_WIDE_FLASH (1U << 1)
@@ -209,6 +245,122 @@ static void msm_nand_release_dma_buffer(struct msm_nand_chip *chip,
 	wake_up(&chip->wait_queue);
 }
 
+/* a command list handed to the data mover, timestamped on its way */
+struct msm_nand_dma_cmd {
+	struct msm_dmov_cmd dmov_cmd;
+	struct completion complete;
+	unsigned int result;
+	ktime_t queued;
+	ktime_t started;
+	ktime_t done;
+};
+
+static void msm_nand_dma_started(struct msm_dmov_cmd *cmd)
+{
+	struct msm_nand_dma_cmd *dcmd =
+		container_of(cmd, struct msm_nand_dma_cmd, dmov_cmd);
+
+	dcmd->started = ktime_get();
+}
+
+static void msm_nand_dma_complete(struct msm_dmov_cmd *cmd,
+				  unsigned int result,
+				  struct msm_dmov_errdata *err)
+{
+	struct msm_nand_dma_cmd *dcmd =
+		container_of(cmd, struct msm_nand_dma_cmd, dmov_cmd);
+
+	dcmd->done = ktime_get();
+	dcmd->result = result;
+	complete(&dcmd->complete);
+}
+
+static void msm_nand_dma_submit(struct msm_nand_chip *chip,
+				struct msm_nand_dma_cmd *dcmd,
+				unsigned *cmdptr)
+{
+	init_completion(&dcmd->complete);
+	dcmd->dmov_cmd.cmdptr = DMOV_CMD_PTR_LIST |
+		DMOV_CMD_ADDR(msm_virt_to_dma(chip, cmdptr));
+	dcmd->dmov_cmd.complete_func = msm_nand_dma_complete;
+	dcmd->dmov_cmd.execute_func = msm_nand_dma_started;
+	dcmd->queued = ktime_get();
+	dcmd->started = dcmd->queued;
+	dsb();
+	msm_dmov_enqueue_cmd_ext(chip->dma_channel, &dcmd->dmov_cmd);
+}
+
+/* wait for a list queued by msm_nand_dma_submit() and charge its time
+ * on the data mover to @op, returns the data mover result word
+ */
+static unsigned int msm_nand_dma_wait(struct msm_nand_chip *chip,
+				      struct msm_nand_dma_cmd *dcmd, int op)
+{
+	struct msm_nand_op_stats *s = &chip->stats.op[op];
+	unsigned long irq_flags;
+	uint32_t us;
+	int bucket;
+
+	wait_for_completion(&dcmd->complete);
+	dsb();
+
+	us = ktime_us_delta(dcmd->done, dcmd->queued);
+	bucket = us ? fls(us) - 1 : 0;
+	if (bucket >= MSM_NAND_LAT_BUCKETS)
+		bucket = MSM_NAND_LAT_BUCKETS - 1;
+
+	spin_lock_irqsave(&chip->stats.lock, irq_flags);
+	s->dm_queue_ns += ktime_to_ns(ktime_sub(dcmd->started, dcmd->queued));
+	s->dm_active_ns += ktime_to_ns(ktime_sub(dcmd->done, dcmd->started));
+	if (us > s->max_us)
+		s->max_us = us;
+	s->lat[bucket]++;
+	spin_unlock_irqrestore(&chip->stats.lock, irq_flags);
+
+	return dcmd->result;
+}
+
+static void msm_nand_dma_exec(struct msm_nand_chip *chip,
+			      unsigned *cmdptr, int op)
+{
+	struct msm_nand_dma_cmd dcmd;
+	unsigned int result;
+
+	msm_nand_dma_submit(chip, &dcmd, cmdptr);
+	result = msm_nand_dma_wait(chip, &dcmd, op);
+	if (result != 0x80000002)
+		pr_err("msm_nand: dma result %x\n", result);
+}
+
+static void msm_nand_stat_op(struct msm_nand_chip *chip, int op,
+			     ktime_t start, unsigned units, size_t bytes,
+			     int err)
+{
+	struct msm_nand_op_stats *s = &chip->stats.op[op];
+	unsigned long irq_flags;
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	spin_lock_irqsave(&chip->stats.lock, irq_flags);
+	s->calls++;
+	s->units += units;
+	s->bytes += bytes;
+	s->total_ns += ns;
+	if (err && err != -EUCLEAN)
+		s->errors++;
+	spin_unlock_irqrestore(&chip->stats.lock, irq_flags);
+}
+
+static void msm_nand_stat_ecc(struct msm_nand_chip *chip,
+			      unsigned corrected, unsigned failed)
+{
+	unsigned long irq_flags;
+
+	spin_lock_irqsave(&chip->stats.lock, irq_flags);
+	chip->stats.ecc_corrected += corrected;
+	chip->stats.ecc_failed += failed;
+	spin_unlock_irqrestore(&chip->stats.lock, irq_flags);
+}
+
 uint32_t flash_read_id(struct msm_nand_chip *chip)
 {
 	struct {
@@ -400,13 +552,44 @@ msm_nand_dma_map(struct device *dev, void *addr, size_t size,
 	return dma_map_page(dev, page, offset, size, dir);
 }
 
-static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
-			     struct mtd_oob_ops *ops)
+/*
+ * Sub-page region.
+ *
+ * A codeword normally carries 516 user bytes, the last one 16 bytes of oob
+ * behind its share of the page data, so a 512 byte sub-page straddles two
+ * codewords and cannot be programmed on its own.  From block
+ * subpage_start_block on, every codeword instead carries exactly 512 bytes
+ * of page data followed by 4 bytes of 0xff padding, all covered by the
+ * codeword's own ecc.  That lets each codeword be programmed separately,
+ * which is what UBI wants for its headers.  The region has no oob; it is
+ * meant for UBI/UBIFS and must not hold yaffs2 partitions.
+ */
+static unsigned subpage_start_block;
+module_param(subpage_start_block, uint, S_IRUGO);
+
+#define MSM_NAND_SUBPAGE_SIZE	512
+#define MSM_NAND_CW_DATA_SIZE	516
+
+static inline int msm_nand_in_subpage_region(struct mtd_info *mtd,
+					     loff_t ofs)
 {
 	struct msm_nand_chip *chip = mtd->priv;
 
+	return chip->subpage_start && ofs >= chip->subpage_start;
+}
+
+/* Read or program codewords first_cw .. first_cw + ncw - 1 of one page in
+ * the sub-page layout, buf holds ncw * 512 bytes of page data.  Returns 0,
+ * -EUCLEAN for a corrected read, -EBADMSG or -EIO.
+ */
+static int msm_nand_subpage_io(struct mtd_info *mtd, unsigned page,
+			       unsigned first_cw, unsigned ncw,
+			       uint8_t *buf, int write,
+			       uint32_t *ecc_corrected)
+{
+	struct msm_nand_chip *chip = mtd->priv;
 	struct {
-		dmov_s cmd[8 * 5 + 3];
+		dmov_s cmd[8 * 6 + 3];
 		unsigned cmdptr;
 		struct {
 			uint32_t cmd;
@@ -420,19 +603,642 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 			uint32_t ecccfg;
 			uint32_t ecccfg_restore;
 #endif
+			uint32_t pad;
+			uint32_t zeroes;
 			struct {
 				uint32_t flash_status;
 				uint32_t buffer_status;
 			} result[8];
 		} data;
 	} *dma_buffer;
+	enum dma_data_direction dir = write ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
 	dmov_s *cmd;
+	dma_addr_t data_dma_addr, data_dma_addr_curr;
+	uint32_t col, ecc_errors;
+	int rawerr = 0, err = 0;
+	unsigned n, i;
+
+	data_dma_addr_curr = data_dma_addr =
+		msm_nand_dma_map(chip->dev, buf, ncw * MSM_NAND_SUBPAGE_SIZE,
+				 dir);
+	if (dma_mapping_error(chip->dev, data_dma_addr)) {
+		pr_err("%s: failed to get dma addr for %p\n", __func__, buf);
+		return -EIO;
+	}
+
+	wait_event(chip->wait_queue, (dma_buffer =
+			msm_nand_get_dma_buffer(chip, sizeof(*dma_buffer))));
+
+	col = first_cw * 528;
+	if (chip->CFG1 & CFG1_WIDE_FLASH)
+		col >>= 1;
+
+	dma_buffer->data.cmd = write ? MSM_NAND_CMD_PRG_PAGE
+				     : MSM_NAND_CMD_PAGE_READ_ECC;
+	dma_buffer->data.addr0 = (page << 16) | col;
+	dma_buffer->data.addr1 = (page >> 16) & 0xff;
+	dma_buffer->data.chipsel = 0 | 4; /* flash0 + undoc bit */
+	dma_buffer->data.cfg0 = (chip->CFG0 & ~(7U << 6)) | ((ncw - 1) << 6);
+	dma_buffer->data.cfg1 = chip->CFG1;
+	dma_buffer->data.exec = 1;
+	dma_buffer->data.pad = 0xffffffff;
+	dma_buffer->data.zeroes = 0;
+
+	BUILD_BUG_ON(8 != ARRAY_SIZE(dma_buffer->data.result));
+
+	cmd = dma_buffer->cmd;
+	for (n = 0; n < ncw; n++) {
+		dma_buffer->data.result[n].flash_status = 0xeeeeeeee;
+		dma_buffer->data.result[n].buffer_status = 0xeeeeeeee;
+
+		/* block on cmd ready, then
+		 * write CMD / ADDR0 / ADDR1 / CHIPSEL regs in a burst
+		 */
+		cmd->cmd = DST_CRCI_NAND_CMD;
+		cmd->src = msm_virt_to_dma(chip, &dma_buffer->data.cmd);
+		cmd->dst = MSM_NAND_FLASH_CMD;
+		cmd->len = n ? 4 : 16;
+		cmd++;
+
+		if (n == 0) {
+			cmd->cmd = 0;
+			cmd->src = msm_virt_to_dma(chip,
+						   &dma_buffer->data.cfg0);
+			cmd->dst = MSM_NAND_DEV0_CFG0;
+			cmd->len = 8;
+			cmd++;
+#if SUPPORT_WRONG_ECC_CONFIG
+			if (chip->saved_ecc_buf_cfg != chip->ecc_buf_cfg) {
+				dma_buffer->data.ecccfg = chip->ecc_buf_cfg;
+				cmd->cmd = 0;
+				cmd->src = msm_virt_to_dma(chip,
+						&dma_buffer->data.ecccfg);
+				cmd->dst = MSM_NAND_EBI2_ECC_BUF_CFG;
+				cmd->len = 4;
+				cmd++;
+			}
+#endif
+		}
+
+		if (write) {
+			/* page data, then the padding behind it */
+			cmd->cmd = 0;
+			cmd->src = data_dma_addr_curr;
+			cmd->dst = MSM_NAND_FLASH_BUFFER;
+			cmd->len = MSM_NAND_SUBPAGE_SIZE;
+			cmd++;
+
+			cmd->cmd = 0;
+			cmd->src = msm_virt_to_dma(chip,
+						   &dma_buffer->data.pad);
+			cmd->dst = MSM_NAND_FLASH_BUFFER +
+				MSM_NAND_SUBPAGE_SIZE;
+			cmd->len = MSM_NAND_CW_DATA_SIZE -
+				MSM_NAND_SUBPAGE_SIZE;
+			cmd++;
+		}
+
+		/* kick the execute register */
+		cmd->cmd = 0;
+		cmd->src = msm_virt_to_dma(chip, &dma_buffer->data.exec);
+		cmd->dst = MSM_NAND_EXEC_CMD;
+		cmd->len = 4;
+		cmd++;
+
+		/* block on data ready, then read the status registers */
+		cmd->cmd = SRC_CRCI_NAND_DATA;
+		cmd->src = MSM_NAND_FLASH_STATUS;
+		cmd->dst = msm_virt_to_dma(chip, &dma_buffer->data.result[n]);
+		/* MSM_NAND_FLASH_STATUS + MSM_NAND_BUFFER_STATUS */
+		cmd->len = 8;
+		cmd++;
+
+		if (write) {
+			/* clear the status register in case the OP_ERR is
+			 * set due to the write, to work around a h/w bug */
+			cmd->cmd = 0;
+			cmd->src = msm_virt_to_dma(chip,
+						   &dma_buffer->data.zeroes);
+			cmd->dst = MSM_NAND_FLASH_STATUS;
+			cmd->len = 4;
+			cmd++;
+		} else {
+			/* read data block, the padding stays behind */
+			cmd->cmd = 0;
+			cmd->src = MSM_NAND_FLASH_BUFFER;
+			cmd->dst = data_dma_addr_curr;
+			cmd->len = MSM_NAND_SUBPAGE_SIZE;
+			cmd++;
+		}
+		data_dma_addr_curr += MSM_NAND_SUBPAGE_SIZE;
+	}
+#if SUPPORT_WRONG_ECC_CONFIG
+	if (chip->saved_ecc_buf_cfg != chip->ecc_buf_cfg) {
+		dma_buffer->data.ecccfg_restore = chip->saved_ecc_buf_cfg;
+		cmd->cmd = 0;
+		cmd->src = msm_virt_to_dma(chip,
+					   &dma_buffer->data.ecccfg_restore);
+		cmd->dst = MSM_NAND_EBI2_ECC_BUF_CFG;
+		cmd->len = 4;
+		cmd++;
+	}
+#endif
+	dma_buffer->cmd[0].cmd |= CMD_OCB;
+	cmd[-1].cmd |= CMD_OCU | CMD_LC;
+	BUILD_BUG_ON(8 * 6 + 3 != ARRAY_SIZE(dma_buffer->cmd));
+	BUG_ON(cmd - dma_buffer->cmd > ARRAY_SIZE(dma_buffer->cmd));
+	dma_buffer->cmdptr =
+		(msm_virt_to_dma(chip, dma_buffer->cmd) >> 3) | CMD_PTR_LP;
+
+	msm_nand_dma_exec(chip, &dma_buffer->cmdptr,
+			  write ? MSM_NAND_STAT_WRITE : MSM_NAND_STAT_READ);
+
+	dma_unmap_page(chip->dev, data_dma_addr, ncw * MSM_NAND_SUBPAGE_SIZE,
+		       dir);
+
+	for (n = 0; n < ncw; n++) {
+		uint32_t flash_status = dma_buffer->data.result[n].flash_status;
+		uint32_t buffer_status =
+			dma_buffer->data.result[n].buffer_status;
+
+		if (write) {
+			/* write failed (0x10), protection violation
+			 * (0x100) or program success bit (0x80) unset
+			 */
+			if ((flash_status & 0x110) || !(flash_status & 0x80)) {
+				if (flash_status & 0x10)
+					pr_err("msm_nand: critical write "
+					       "error, 0x%x(%d)\n",
+					       page, first_cw + n);
+				err = -EIO;
+				break;
+			}
+			continue;
+		}
+
+		if (flash_status & 0x110) {
+			uint8_t *data = buf + n * MSM_NAND_SUBPAGE_SIZE;
+
+			/* an erased codeword is not an error; empty
+			 * blocks read 0x54 at this offset
+			 */
+			if (data[3] == 0x54)
+				data[3] = 0xff;
+			for (i = 0; i < MSM_NAND_SUBPAGE_SIZE; i++)
+				if (data[i] != 0xff)
+					break;
+			if (i == MSM_NAND_SUBPAGE_SIZE)
+				continue;
+			rawerr = 1;
+			if (buffer_status & 0x8) {
+				/* not thread safe */
+				mtd->ecc_stats.failed++;
+				err = -EBADMSG;
+			} else if (!err)
+				err = -EIO;
+			continue;
+		}
+
+		ecc_errors = buffer_status & 0x7;
+		if (ecc_errors) {
+			*ecc_corrected += ecc_errors;
+			/* not thread safe */
+			mtd->ecc_stats.corrected += ecc_errors;
+			if (ecc_errors > 1 && !err)
+				err = -EUCLEAN;
+		}
+	}
+
+	msm_nand_release_dma_buffer(chip, dma_buffer, sizeof(*dma_buffer));
+
+	if (rawerr)
+		pr_err("%s: page %x cw %d+%d read failed %d\n", __func__,
+		       page, first_cw, ncw, err);
+	return err;
+}
+
+/* Any length read from the sub-page region, done by whole codewords
+ * through a bounce buffer.
+ */
+static int msm_nand_subpage_read(struct mtd_info *mtd, loff_t from,
+				 size_t len, size_t *retlen, u_char *buf)
+{
+	struct msm_nand_chip *chip = mtd->priv;
+	unsigned page_shift = ffs(mtd->writesize) - 1;
+	uint32_t corrected = 0;
+	unsigned pages = 0;
+	uint8_t *bounce;
+	ktime_t start;
+	int err = 0, ret;
+
+	*retlen = 0;
+	if (from + len > mtd->size)
+		return -EINVAL;
+
+	bounce = kmalloc(mtd->writesize, GFP_KERNEL);
+	if (!bounce)
+		return -ENOMEM;
+
+	start = ktime_get();
+	while (len) {
+		unsigned page = from >> page_shift;
+		unsigned offs = from & (mtd->writesize - 1);
+		unsigned n = min_t(size_t, len, mtd->writesize - offs);
+		unsigned first_cw = offs / MSM_NAND_SUBPAGE_SIZE;
+		unsigned last_cw = (offs + n - 1) / MSM_NAND_SUBPAGE_SIZE;
+
+		ret = msm_nand_subpage_io(mtd, page, first_cw,
+					  last_cw - first_cw + 1, bounce, 0,
+					  &corrected);
+		if (ret && ret != -EUCLEAN && ret != -EBADMSG) {
+			err = ret;
+			break;
+		}
+		if (ret && (ret != -EUCLEAN || !err))
+			err = ret;
+
+		memcpy(buf, bounce + offs - first_cw * MSM_NAND_SUBPAGE_SIZE,
+		       n);
+		buf += n;
+		from += n;
+		len -= n;
+		*retlen += n;
+		pages++;
+	}
+
+	kfree(bounce);
+	msm_nand_stat_op(chip, MSM_NAND_STAT_READ, start, pages, *retlen, err);
+	msm_nand_stat_ecc(chip, corrected, err == -EBADMSG);
+	return err;
+}
+
+/* Writes to the sub-page region go by 512 byte sub-pages, only the
+ * codewords written to are programmed.
+ */
+static int msm_nand_subpage_write(struct mtd_info *mtd, loff_t to,
+				  size_t len, size_t *retlen,
+				  const u_char *buf)
+{
+	struct msm_nand_chip *chip = mtd->priv;
+	unsigned page_shift = ffs(mtd->writesize) - 1;
+	uint32_t corrected = 0;
+	unsigned pages = 0;
+	uint8_t *bounce;
+	ktime_t start;
+	int err = 0;
+
+	*retlen = 0;
+	if ((to & (MSM_NAND_SUBPAGE_SIZE - 1)) ||
+	    (len & (MSM_NAND_SUBPAGE_SIZE - 1))) {
+		pr_err("%s: unsupported to 0x%llx len %x\n",
+		       __func__, to, len);
+		return -EINVAL;
+	}
+	if (to + len > mtd->size)
+		return -EINVAL;
+
+	bounce = kmalloc(mtd->writesize, GFP_KERNEL);
+	if (!bounce)
+		return -ENOMEM;
+
+	start = ktime_get();
+	while (len) {
+		unsigned page = to >> page_shift;
+		unsigned offs = to & (mtd->writesize - 1);
+		unsigned n = min_t(size_t, len, mtd->writesize - offs);
+
+		memcpy(bounce, buf, n);
+		err = msm_nand_subpage_io(mtd, page,
+					  offs / MSM_NAND_SUBPAGE_SIZE,
+					  n / MSM_NAND_SUBPAGE_SIZE,
+					  bounce, 1, &corrected);
+		if (err)
+			break;
+		buf += n;
+		to += n;
+		len -= n;
+		*retlen += n;
+		pages++;
+	}
+
+	kfree(bounce);
+	msm_nand_stat_op(chip, MSM_NAND_STAT_WRITE, start, pages, *retlen,
+			 err);
+	if (err)
+		pr_err("%s %llx %x failed %d\n", __func__, to, len, err);
+	return err;
+}
+
+/* Number of page reads kept queued on the data mover by a multi-page
+ * read.  While one page's command list runs, the next is already built
+ * and queued behind it, so the controller moves straight on to the next
+ * page instead of waiting for the cpu to take the interrupt, check the
+ * status words and program the next read.
+ */
+#define MSM_NAND_READ_PIPELINE_DEPTH 2
+
+/* one page worth of read command list, lives in the dma buffer */
+struct msm_nand_read_set {
+	dmov_s cmd[8 * 5 + 3];
+	unsigned cmdptr;
+	struct {
+		uint32_t cmd;
+		uint32_t addr0;
+		uint32_t addr1;
+		uint32_t chipsel;
+		uint32_t cfg0;
+		uint32_t cfg1;
+		uint32_t exec;
+#if SUPPORT_WRONG_ECC_CONFIG
+		uint32_t ecccfg;
+		uint32_t ecccfg_restore;
+#endif
+		struct {
+			uint32_t flash_status;
+			uint32_t buffer_status;
+		} result[8];
+	} data;
+};
+
+struct msm_nand_read_job {
+	struct msm_nand_dma_cmd dma;
+	struct msm_nand_read_set *set;
+	unsigned page;
+	dma_addr_t data_addr;	/* start of this page in ops->datbuf */
+	uint32_t oob_offs;	/* start of this page in ops->oobbuf */
+	uint32_t oob_len;	/* ops->ooblen left after this page */
+};
+
+static void msm_nand_read_prep(struct msm_nand_chip *chip,
+			       struct mtd_oob_ops *ops,
+			       struct msm_nand_read_set *set,
+			       unsigned page, unsigned start_sector,
+			       unsigned cwperpage, uint32_t oob_col,
+			       dma_addr_t *data_dma_addr_curr,
+			       dma_addr_t *oob_dma_addr_curr,
+			       uint32_t *oob_len)
+{
+	dmov_s *cmd = set->cmd;
+	uint32_t sectordatasize;
+	uint32_t sectoroobsize;
 	unsigned n;
+
+	/* CMD / ADDR0 / ADDR1 / CHIPSEL program values */
+	set->data.cmd = MSM_NAND_CMD_PAGE_READ_ECC;
+	set->data.addr0 = (page << 16) | oob_col;
+	/* qc example is (page >> 16) && 0xff !? */
+	set->data.addr1 = (page >> 16) & 0xff;
+	/* flash0 + undoc bit */
+	set->data.chipsel = 0 | 4;
+
+	set->data.cfg0 =
+		(chip->CFG0 & ~(7U << 6))
+			| (((cwperpage-1) - start_sector) << 6);
+	set->data.cfg1 = chip->CFG1;
+
+	/* GO bit for the EXEC register */
+	set->data.exec = 1;
+
+	BUILD_BUG_ON(8 != ARRAY_SIZE(set->data.result));
+
+	for (n = start_sector; n < cwperpage; n++) {
+		/* flash + buffer status return words */
+		set->data.result[n].flash_status = 0xeeeeeeee;
+		set->data.result[n].buffer_status = 0xeeeeeeee;
+
+		/* block on cmd ready, then
+		 * write CMD / ADDR0 / ADDR1 / CHIPSEL
+		 * regs in a burst
+		 */
+		cmd->cmd = DST_CRCI_NAND_CMD;
+		cmd->src = msm_virt_to_dma(chip, &set->data.cmd);
+		cmd->dst = MSM_NAND_FLASH_CMD;
+		if (n == start_sector)
+			cmd->len = 16;
+		else
+			cmd->len = 4;
+		cmd++;
+
+		if (n == start_sector) {
+			cmd->cmd = 0;
+			cmd->src = msm_virt_to_dma(chip, &set->data.cfg0);
+			cmd->dst = MSM_NAND_DEV0_CFG0;
+			cmd->len = 8;
+			cmd++;
+#if SUPPORT_WRONG_ECC_CONFIG
+			if (chip->saved_ecc_buf_cfg != chip->ecc_buf_cfg) {
+				set->data.ecccfg = chip->ecc_buf_cfg;
+				cmd->cmd = 0;
+				cmd->src = msm_virt_to_dma(chip,
+							   &set->data.ecccfg);
+				cmd->dst = MSM_NAND_EBI2_ECC_BUF_CFG;
+				cmd->len = 4;
+				cmd++;
+			}
+#endif
+		}
+
+		/* kick the execute register */
+		cmd->cmd = 0;
+		cmd->src = msm_virt_to_dma(chip, &set->data.exec);
+		cmd->dst = MSM_NAND_EXEC_CMD;
+		cmd->len = 4;
+		cmd++;
+
+		/* block on data ready, then
+		 * read the status register
+		 */
+		cmd->cmd = SRC_CRCI_NAND_DATA;
+		cmd->src = MSM_NAND_FLASH_STATUS;
+		cmd->dst = msm_virt_to_dma(chip, &set->data.result[n]);
+		/* MSM_NAND_FLASH_STATUS + MSM_NAND_BUFFER_STATUS */
+		cmd->len = 8;
+		cmd++;
+
+		/* read data block
+		 * (only valid if status says success)
+		 */
+		if (ops->datbuf) {
+			sectordatasize = (n < (cwperpage - 1))
+			? 516 : (512 - ((cwperpage - 1) << 2));
+			cmd->cmd = 0;
+			cmd->src = MSM_NAND_FLASH_BUFFER;
+			cmd->dst = *data_dma_addr_curr;
+			*data_dma_addr_curr += sectordatasize;
+			cmd->len = sectordatasize;
+			cmd++;
+		}
+
+		if (ops->oobbuf && (n == (cwperpage - 1)
+		     || ops->mode != MTD_OOB_AUTO)) {
+			cmd->cmd = 0;
+			if (n == (cwperpage - 1)) {
+				cmd->src = MSM_NAND_FLASH_BUFFER +
+					(512 - ((cwperpage - 1) << 2));
+				sectoroobsize = (cwperpage << 2);
+				if (ops->mode != MTD_OOB_AUTO)
+					sectoroobsize += 10;
+			} else {
+				cmd->src = MSM_NAND_FLASH_BUFFER + 516;
+				sectoroobsize = 10;
+			}
+
+			cmd->dst = *oob_dma_addr_curr;
+			if (sectoroobsize < *oob_len)
+				cmd->len = sectoroobsize;
+			else
+				cmd->len = *oob_len;
+			*oob_dma_addr_curr += cmd->len;
+			*oob_len -= cmd->len;
+			if (cmd->len > 0)
+				cmd++;
+		}
+	}
+#if SUPPORT_WRONG_ECC_CONFIG
+	if (chip->saved_ecc_buf_cfg != chip->ecc_buf_cfg) {
+		set->data.ecccfg_restore = chip->saved_ecc_buf_cfg;
+		cmd->cmd = 0;
+		cmd->src = msm_virt_to_dma(chip, &set->data.ecccfg_restore);
+		cmd->dst = MSM_NAND_EBI2_ECC_BUF_CFG;
+		cmd->len = 4;
+		cmd++;
+	}
+#endif
+
+	BUILD_BUG_ON(8 * 5 + 3 != ARRAY_SIZE(set->cmd));
+	BUG_ON(cmd - set->cmd > ARRAY_SIZE(set->cmd));
+	set->cmd[0].cmd |= CMD_OCB;
+	cmd[-1].cmd |= CMD_OCU | CMD_LC;
+
+	set->cmdptr = (msm_virt_to_dma(chip, set->cmd) >> 3) | CMD_PTR_LP;
+}
+
+static void msm_nand_read_wait(struct msm_nand_chip *chip,
+			       struct msm_nand_read_job *job, int op)
+{
+	unsigned int result = msm_nand_dma_wait(chip, &job->dma, op);
+
+	if (result != 0x80000002)
+		pr_err("msm_nand_read_oob: page %x dma result %x\n",
+		       job->page, result);
+}
+
+/* Turn the status words of one finished page into an error code,
+ * checking for erased pages and accounting ecc corrections.
+ */
+static int msm_nand_read_check(struct msm_nand_chip *chip,
+			       struct mtd_info *mtd, struct mtd_oob_ops *ops,
+			       struct msm_nand_read_job *job,
+			       unsigned pages_read, unsigned start_sector,
+			       uint32_t *total_ecc_errors)
+{
+	struct msm_nand_read_set *set = job->set;
+	unsigned cwperpage = (mtd->writesize >> 9);
+	uint32_t ecc_errors;
+	int pageerr, rawerr;
+	unsigned n;
+
+	/* if any of the writes failed (0x10), or there
+	 * was a protection violation (0x100), we lose
+	 */
+	pageerr = rawerr = 0;
+	for (n = start_sector; n < cwperpage; n++) {
+		if (set->data.result[n].flash_status & 0x110) {
+			rawerr = -EIO;
+			break;
+		}
+	}
+	if (rawerr) {
+		if (ops->datbuf) {
+			uint8_t *datbuf = ops->datbuf +
+				pages_read * mtd->writesize;
+
+			dma_sync_single_for_cpu(chip->dev, job->data_addr,
+				mtd->writesize, DMA_BIDIRECTIONAL);
+
+			for (n = 0; n < mtd->writesize; n++) {
+				/* empty blocks read 0x54 at
+				 * these offsets
+				 */
+				if (n % 516 == 3 && datbuf[n] == 0x54)
+					datbuf[n] = 0xff;
+				if (datbuf[n] != 0xff) {
+					pageerr = rawerr;
+					break;
+				}
+			}
+
+			dma_sync_single_for_device(chip->dev, job->data_addr,
+				mtd->writesize, DMA_BIDIRECTIONAL);
+
+		}
+		if (ops->oobbuf) {
+			/* later pages may still be landing in oobbuf */
+			for (n = job->oob_offs;
+			     n < ops->ooblen - job->oob_len; n++) {
+				if (ops->oobbuf[n] != 0xff) {
+					pageerr = rawerr;
+					break;
+				}
+			}
+		}
+	}
+	if (pageerr) {
+		for (n = start_sector; n < cwperpage; n++) {
+			if (set->data.result[n].buffer_status & 0x8) {
+				/* not thread safe */
+				mtd->ecc_stats.failed++;
+				pageerr = -EBADMSG;
+				break;
+			}
+		}
+	}
+	if (!rawerr) { /* check for corretable errors */
+		for (n = start_sector; n < cwperpage; n++) {
+			ecc_errors = set->data.result[n].buffer_status & 0x7;
+			if (ecc_errors) {
+				*total_ecc_errors += ecc_errors;
+				/* not thread safe */
+				mtd->ecc_stats.corrected += ecc_errors;
+				if (ecc_errors > 1)
+					pageerr = -EUCLEAN;
+			}
+		}
+	}
+
+#if VERBOSE
+	if (rawerr && !pageerr) {
+		pr_err("msm_nand_read_oob %llx %x %x empty page\n",
+		       (loff_t)job->page * mtd->writesize, ops->len,
+		       ops->ooblen);
+	} else {
+		pr_info("status: %x %x %x %x %x %x %x %x\n",
+			set->data.result[0].flash_status,
+			set->data.result[0].buffer_status,
+			set->data.result[1].flash_status,
+			set->data.result[1].buffer_status,
+			set->data.result[2].flash_status,
+			set->data.result[2].buffer_status,
+			set->data.result[3].flash_status,
+			set->data.result[3].buffer_status);
+	}
+#endif
+	return pageerr;
+}
+
+static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
+			     struct mtd_oob_ops *ops)
+{
+	struct msm_nand_chip *chip = mtd->priv;
+
+	struct {
+		struct msm_nand_read_set set[MSM_NAND_READ_PIPELINE_DEPTH];
+	} *dma_buffer;
+	struct msm_nand_read_job jobs[MSM_NAND_READ_PIPELINE_DEPTH];
+	struct msm_nand_read_job *job;
 	unsigned page = 0;
 	uint32_t oob_len;
-	uint32_t sectordatasize;
-	uint32_t sectoroobsize;
-	int err, pageerr, rawerr;
+	int err, pageerr;
 	dma_addr_t data_dma_addr = 0;
 	dma_addr_t oob_dma_addr = 0;
 	dma_addr_t data_dma_addr_curr = 0;
@@ -440,10 +1246,15 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 	uint32_t oob_col = 0;
 	unsigned page_count;
 	unsigned pages_read = 0;
+	unsigned pages_queued = 0;
 	unsigned start_sector = 0;
-	uint32_t ecc_errors;
 	uint32_t total_ecc_errors = 0;
+	uint32_t ecc_failed = 0;
 	unsigned cwperpage;
+	unsigned depth;
+	unsigned n;
+	int op;
+	ktime_t start;
 
 	if (mtd->writesize == 2048)
 		page = from >> 11;
@@ -454,6 +1265,17 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 	oob_len = ops->ooblen;
 	cwperpage = (mtd->writesize >> 9);
 
+	if (msm_nand_in_subpage_region(mtd, from)) {
+		if (!ops->datbuf || (ops->oobbuf && ops->ooblen)) {
+			pr_err("%s: only page data in the sub-page region\n",
+			       __func__);
+			return -EINVAL;
+		}
+		ops->oobretlen = 0;
+		return msm_nand_subpage_read(mtd, from, ops->len,
+					     &ops->retlen, ops->datbuf);
+	}
+
 	if (from & (mtd->writesize - 1)) {
 		pr_err("%s: unsupported from, 0x%llx\n",
 		       __func__, from);
@@ -481,6 +1303,8 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 			page_count = 1;
 	} else
 		page_count = ops->len / mtd->writesize;
+	op = ops->datbuf ? MSM_NAND_STAT_READ : MSM_NAND_STAT_READ_OOB;
+	start = ktime_get();
 
 #if 0 /* yaffs reads more oob data than it needs */
 	if (ops->ooblen >= sectoroobsize * 4) {
@@ -526,256 +1350,50 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 	if (chip->CFG1 & CFG1_WIDE_FLASH)
 		oob_col >>= 1;
 
-	err = 0;
-	while (page_count-- > 0) {
-		cmd = dma_buffer->cmd;
-
-		/* CMD / ADDR0 / ADDR1 / CHIPSEL program values */
-		dma_buffer->data.cmd = MSM_NAND_CMD_PAGE_READ_ECC;
-		dma_buffer->data.addr0 = (page << 16) | oob_col;
-		/* qc example is (page >> 16) && 0xff !? */
-		dma_buffer->data.addr1 = (page >> 16) & 0xff;
-		/* flash0 + undoc bit */
-		dma_buffer->data.chipsel = 0 | 4;
-
-		dma_buffer->data.cfg0 =
-			(chip->CFG0 & ~(7U << 6))
-				| (((cwperpage-1) - start_sector) << 6);
-		dma_buffer->data.cfg1 = chip->CFG1;
-
-		/* GO bit for the EXEC register */
-		dma_buffer->data.exec = 1;
-
-		BUILD_BUG_ON(8 != ARRAY_SIZE(dma_buffer->data.result));
-
-		for (n = start_sector; n < cwperpage; n++) {
-			/* flash + buffer status return words */
-			dma_buffer->data.result[n].flash_status = 0xeeeeeeee;
-			dma_buffer->data.result[n].buffer_status = 0xeeeeeeee;
-
-			/* block on cmd ready, then
-			 * write CMD / ADDR0 / ADDR1 / CHIPSEL
-			 * regs in a burst
-			 */
-			cmd->cmd = DST_CRCI_NAND_CMD;
-			cmd->src = msm_virt_to_dma(chip, &dma_buffer->data.cmd);
-			cmd->dst = MSM_NAND_FLASH_CMD;
-			if (n == start_sector)
-				cmd->len = 16;
-			else
-				cmd->len = 4;
-			cmd++;
+	/* the cmdptr words handed to the data mover must be 64 bit aligned */
+	BUILD_BUG_ON(sizeof(struct msm_nand_read_set) & 7);
+	depth = min_t(unsigned, page_count, MSM_NAND_READ_PIPELINE_DEPTH);
+	for (n = 0; n < depth; n++)
+		jobs[n].set = &dma_buffer->set[n];
 
-			if (n == start_sector) {
-				cmd->cmd = 0;
-				cmd->src = msm_virt_to_dma(chip,
-							&dma_buffer->data.cfg0);
-				cmd->dst = MSM_NAND_DEV0_CFG0;
-				cmd->len = 8;
-				cmd++;
-#if SUPPORT_WRONG_ECC_CONFIG
-				if (chip->saved_ecc_buf_cfg !=
-				    chip->ecc_buf_cfg) {
-					dma_buffer->data.ecccfg =
-						chip->ecc_buf_cfg;
-					cmd->cmd = 0;
-					cmd->src = msm_virt_to_dma(chip,
-						      &dma_buffer->data.ecccfg);
-					cmd->dst = MSM_NAND_EBI2_ECC_BUF_CFG;
-					cmd->len = 4;
-					cmd++;
-				}
-#endif
-			}
-
-			/* kick the execute register */
-			cmd->cmd = 0;
-			cmd->src =
-				msm_virt_to_dma(chip, &dma_buffer->data.exec);
-			cmd->dst = MSM_NAND_EXEC_CMD;
-			cmd->len = 4;
-			cmd++;
-
-			/* block on data ready, then
-			 * read the status register
-			 */
-			cmd->cmd = SRC_CRCI_NAND_DATA;
-			cmd->src = MSM_NAND_FLASH_STATUS;
-			cmd->dst = msm_virt_to_dma(chip,
-						   &dma_buffer->data.result[n]);
-			/* MSM_NAND_FLASH_STATUS + MSM_NAND_BUFFER_STATUS */
-			cmd->len = 8;
-			cmd++;
-
-			/* read data block
-			 * (only valid if status says success)
-			 */
-			if (ops->datbuf) {
-				sectordatasize = (n < (cwperpage - 1))
-				? 516 : (512 - ((cwperpage - 1) << 2));
-				cmd->cmd = 0;
-				cmd->src = MSM_NAND_FLASH_BUFFER;
-				cmd->dst = data_dma_addr_curr;
-				data_dma_addr_curr += sectordatasize;
-				cmd->len = sectordatasize;
-				cmd++;
-			}
-
-			if (ops->oobbuf && (n == (cwperpage - 1)
-			     || ops->mode != MTD_OOB_AUTO)) {
-				cmd->cmd = 0;
-				if (n == (cwperpage - 1)) {
-					cmd->src = MSM_NAND_FLASH_BUFFER +
-						(512 - ((cwperpage - 1) << 2));
-					sectoroobsize = (cwperpage << 2);
-					if (ops->mode != MTD_OOB_AUTO)
-						sectoroobsize += 10;
-				} else {
-					cmd->src = MSM_NAND_FLASH_BUFFER + 516;
-					sectoroobsize = 10;
-				}
-
-				cmd->dst = oob_dma_addr_curr;
-				if (sectoroobsize < oob_len)
-					cmd->len = sectoroobsize;
-				else
-					cmd->len = oob_len;
-				oob_dma_addr_curr += cmd->len;
-				oob_len -= cmd->len;
-				if (cmd->len > 0)
-					cmd++;
-			}
-		}
-#if SUPPORT_WRONG_ECC_CONFIG
-		if (chip->saved_ecc_buf_cfg != chip->ecc_buf_cfg) {
-			dma_buffer->data.ecccfg_restore =
-				chip->saved_ecc_buf_cfg;
-			cmd->cmd = 0;
-			cmd->src = msm_virt_to_dma(chip,
-					      &dma_buffer->data.ecccfg_restore);
-			cmd->dst = MSM_NAND_EBI2_ECC_BUF_CFG;
-			cmd->len = 4;
-			cmd++;
-		}
-#endif
-
-		BUILD_BUG_ON(8 * 5 + 3 != ARRAY_SIZE(dma_buffer->cmd));
-		BUG_ON(cmd - dma_buffer->cmd > ARRAY_SIZE(dma_buffer->cmd));
-		dma_buffer->cmd[0].cmd |= CMD_OCB;
-		cmd[-1].cmd |= CMD_OCU | CMD_LC;
-
-		dma_buffer->cmdptr =
-			(msm_virt_to_dma(chip, dma_buffer->cmd) >> 3)
-			| CMD_PTR_LP;
-
-	dsb();
-		msm_dmov_exec_cmd(
-			chip->dma_channel, DMOV_CMD_PTR_LIST | DMOV_CMD_ADDR(
-				msm_virt_to_dma(chip, &dma_buffer->cmdptr)));
-	dsb();
-
-		/* if any of the writes failed (0x10), or there
-		 * was a protection violation (0x100), we lose
-		 */
-		pageerr = rawerr = 0;
-		for (n = start_sector; n < cwperpage; n++) {
-			if (dma_buffer->data.result[n].flash_status & 0x110) {
-				rawerr = -EIO;
-				break;
-			}
+	err = 0;
+	while (pages_read < page_count) {
+		/* top up the pipeline behind the page being waited on */
+		while (pages_queued < page_count &&
+		       pages_queued - pages_read < depth) {
+			job = &jobs[pages_queued % depth];
+			job->page = page + pages_queued;
+			job->data_addr = data_dma_addr_curr;
+			job->oob_offs = ops->ooblen - oob_len;
+			msm_nand_read_prep(chip, ops, job->set, job->page,
+					   start_sector, cwperpage, oob_col,
+					   &data_dma_addr_curr,
+					   &oob_dma_addr_curr, &oob_len);
+			job->oob_len = oob_len;
+			msm_nand_dma_submit(chip, &job->dma,
+					    &job->set->cmdptr);
+			pages_queued++;
 		}
-		if (rawerr) {
-			if (ops->datbuf) {
-				uint8_t *datbuf = ops->datbuf +
-					pages_read * mtd->writesize;
-
-				dma_sync_single_for_cpu(chip->dev,
-					data_dma_addr_curr-mtd->writesize,
-					mtd->writesize, DMA_BIDIRECTIONAL);
-
-				for (n = 0; n < mtd->writesize; n++) {
-					/* empty blocks read 0x54 at
-					 * these offsets
-					 */
-					if (n % 516 == 3 && datbuf[n] == 0x54)
-						datbuf[n] = 0xff;
-					if (datbuf[n] != 0xff) {
-						pageerr = rawerr;
-						break;
-					}
-				}
 
-				dma_sync_single_for_device(chip->dev,
-					data_dma_addr_curr-mtd->writesize,
-					mtd->writesize, DMA_BIDIRECTIONAL);
-
-			}
-			if (ops->oobbuf) {
-				for (n = 0; n < ops->ooblen; n++) {
-					if (ops->oobbuf[n] != 0xff) {
-						pageerr = rawerr;
-						break;
-					}
-				}
-			}
-		}
-		if (pageerr) {
-			for (n = start_sector; n < cwperpage; n++) {
-				if (dma_buffer->data.result[n].buffer_status &
-								0x8) {
-					/* not thread safe */
-					mtd->ecc_stats.failed++;
-					pageerr = -EBADMSG;
-					break;
-				}
-			}
-		}
-		if (!rawerr) { /* check for corretable errors */
-			for (n = start_sector; n < cwperpage; n++) {
-				ecc_errors = dma_buffer->data.
-					result[n].buffer_status & 0x7;
-				if (ecc_errors) {
-					total_ecc_errors += ecc_errors;
-					/* not thread safe */
-					mtd->ecc_stats.corrected += ecc_errors;
-					if (ecc_errors > 1)
-						pageerr = -EUCLEAN;
-				}
-			}
-		}
+		job = &jobs[pages_read % depth];
+		msm_nand_read_wait(chip, job, op);
+		pageerr = msm_nand_read_check(chip, mtd, ops, job, pages_read,
+					      start_sector, &total_ecc_errors);
+		if (pageerr == -EBADMSG)
+			ecc_failed++;
 		if (pageerr && (pageerr != -EUCLEAN || err == 0))
 			err = pageerr;
 
-#if VERBOSE
-		if (rawerr && !pageerr) {
-			pr_err("msm_nand_read_oob %llx %x %x empty page\n",
-			       (loff_t)page * mtd->writesize, ops->len,
-			       ops->ooblen);
-		} else {
-			pr_info("status: %x %x %x %x %x %x %x %x %x \
-					%x %x %x %x %x %x %x \n",
-				dma_buffer->data.result[0].flash_status,
-				dma_buffer->data.result[0].buffer_status,
-				dma_buffer->data.result[1].flash_status,
-				dma_buffer->data.result[1].buffer_status,
-				dma_buffer->data.result[2].flash_status,
-				dma_buffer->data.result[2].buffer_status,
-				dma_buffer->data.result[3].flash_status,
-				dma_buffer->data.result[3].buffer_status);
-				dma_buffer->data.result[4].buffer_status);
-				dma_buffer->data.result[4].buffer_status);
-				dma_buffer->data.result[5].buffer_status);
-				dma_buffer->data.result[5].buffer_status);
-				dma_buffer->data.result[6].buffer_status);
-				dma_buffer->data.result[6].buffer_status);
-				dma_buffer->data.result[7].buffer_status);
-				dma_buffer->data.result[7].buffer_status);
-		}
-#endif
-		if (err && err != -EUCLEAN && err != -EBADMSG)
+		if (err && err != -EUCLEAN && err != -EBADMSG) {
+			/* pages queued behind the failed one still run to
+			 * completion, but do not count towards the result
+			 */
+			oob_len = job->oob_len;
+			for (n = pages_read + 1; n < pages_queued; n++)
+				msm_nand_read_wait(chip, &jobs[n % depth], op);
 			break;
+		}
 		pages_read++;
-		page++;
 	}
 	msm_nand_release_dma_buffer(chip, dma_buffer, sizeof(*dma_buffer));
 
@@ -791,6 +1409,9 @@ err_dma_map_oobbuf_failed:
 
 	ops->retlen = mtd->writesize * pages_read;
 	ops->oobretlen = ops->ooblen - oob_len;
+	msm_nand_stat_op(chip, op, start, pages_read,
+			 ops->retlen + ops->oobretlen, err);
+	msm_nand_stat_ecc(chip, total_ecc_errors, ecc_failed);
 	if (err)
 		pr_err("msm_nand_read_oob %llx %x %x failed %d, corrected %d\n",
 		       from, ops->datbuf ? ops->len : 0, ops->ooblen, err,
@@ -807,6 +1428,9 @@ msm_nand_read(struct mtd_info *mtd, loff_t from, size_t len,
 
 	/* printk("msm_nand_read %llx %x\n", from, len); */
 
+	if (msm_nand_in_subpage_region(mtd, from))
+		return msm_nand_subpage_read(mtd, from, len, retlen, buf);
+
 	ops.mode = MTD_OOB_PLACE;
 	ops.len = len;
 	ops.retlen = 0;
@@ -854,6 +1478,7 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 	unsigned page_count;
 	unsigned pages_written = 0;
 	unsigned cwperpage;
+	ktime_t start;
 
 	if (mtd->writesize == 2048)
 		page = to >> 11;
@@ -864,6 +1489,17 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 	oob_len = ops->ooblen;
 	cwperpage = (mtd->writesize >> 9);
 
+	if (msm_nand_in_subpage_region(mtd, to)) {
+		if (!ops->datbuf || (ops->oobbuf && ops->ooblen)) {
+			pr_err("%s: only page data in the sub-page region\n",
+			       __func__);
+			return -EINVAL;
+		}
+		ops->oobretlen = 0;
+		return msm_nand_subpage_write(mtd, to, ops->len,
+					      &ops->retlen, ops->datbuf);
+	}
+
 	if (to & (mtd->writesize - 1)) {
 		pr_err("%s: unsupported to, 0x%llx\n", __func__, to);
 		return -EINVAL;
@@ -919,6 +1555,7 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 	}
 
 	page_count = ops->len / mtd->writesize;
+	start = ktime_get();
 
 	wait_event(chip->wait_queue, (dma_buffer =
 			msm_nand_get_dma_buffer(chip, sizeof(*dma_buffer))));
@@ -1063,11 +1700,8 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 			(msm_virt_to_dma(chip, dma_buffer->cmd) >> 3) |
 			CMD_PTR_LP;
 
-		dsb();
-		msm_dmov_exec_cmd(chip->dma_channel,
-			DMOV_CMD_PTR_LIST | DMOV_CMD_ADDR(
-				msm_virt_to_dma(chip, &dma_buffer->cmdptr)));
-		dsb();
+		msm_nand_dma_exec(chip, &dma_buffer->cmdptr,
+				  MSM_NAND_STAT_WRITE);
 
 		/* if any of the writes failed (0x10), or there was a
 		 * protection violation (0x100), or the program success
@@ -1106,6 +1740,8 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 	}
 	ops->retlen = mtd->writesize * pages_written;
 	ops->oobretlen = ops->ooblen - oob_len;
+	msm_nand_stat_op(chip, MSM_NAND_STAT_WRITE, start, pages_written,
+			 ops->retlen + ops->oobretlen, err);
 
 	msm_nand_release_dma_buffer(chip, dma_buffer, sizeof(*dma_buffer));
 
@@ -1128,6 +1764,9 @@ static int msm_nand_write(struct mtd_info *mtd, loff_t to, size_t len,
 	int ret;
 	struct mtd_oob_ops ops;
 
+	if (msm_nand_in_subpage_region(mtd, to))
+		return msm_nand_subpage_write(mtd, to, len, retlen, buf);
+
 	ops.mode = MTD_OOB_PLACE;
 	ops.len = len;
 	ops.retlen = 0;
@@ -1150,6 +1789,7 @@ msm_nand_erase(struct mtd_info *mtd, struct erase_info *instr)
 		unsigned data[9];
 	} *dma_buffer;
 	unsigned page = 0;
+	ktime_t start;
 
 	if (mtd->writesize == 2048)
 		page = instr->addr >> 11;
@@ -1167,6 +1807,7 @@ msm_nand_erase(struct mtd_info *mtd, struct erase_info *instr)
 		       __func__, instr->len);
 		return -EINVAL;
 	}
+	start = ktime_get();
 
 	wait_event(chip->wait_queue,
 		   (dma_buffer = msm_nand_get_dma_buffer(
@@ -1214,11 +1855,7 @@ msm_nand_erase(struct mtd_info *mtd, struct erase_info *instr)
 	dma_buffer->cmdptr =
 		(msm_virt_to_dma(chip, dma_buffer->cmd) >> 3) | CMD_PTR_LP;
 
-	dsb();
-	msm_dmov_exec_cmd(
-		chip->dma_channel, DMOV_CMD_PTR_LIST |
-		DMOV_CMD_ADDR(msm_virt_to_dma(chip, &dma_buffer->cmdptr)));
-	dsb();
+	msm_nand_dma_exec(chip, &dma_buffer->cmdptr, MSM_NAND_STAT_ERASE);
 
 	/* we fail if there was an operation error, a mpu error, or the
 	 * erase success bit was not set.
@@ -1233,6 +1870,8 @@ msm_nand_erase(struct mtd_info *mtd, struct erase_info *instr)
 		err = 0;
 
 	msm_nand_release_dma_buffer(chip, dma_buffer, sizeof(*dma_buffer));
+	msm_nand_stat_op(chip, MSM_NAND_STAT_ERASE, start, 1,
+			 mtd->erasesize, err);
 	if (err) {
 		pr_err("%s: erase failed, 0x%llx\n", __func__, instr->addr);
 		instr->fail_addr = instr->addr;
@@ -1272,6 +1911,7 @@ msm_nand_block_isbad(struct mtd_info *mtd, loff_t ofs)
 	uint8_t *buf;
 	unsigned page = 0;
 	unsigned cwperpage;
+	ktime_t start;
 
 	if (mtd->writesize == 2048)
 		page = ofs >> 11;
@@ -1289,6 +1929,7 @@ msm_nand_block_isbad(struct mtd_info *mtd, loff_t ofs)
 			 __func__, (uint32_t)ofs);
 		return -EINVAL;
 	}
+	start = ktime_get();
 
 	wait_event(chip->wait_queue,
 		(dma_buffer = msm_nand_get_dma_buffer(chip ,
@@ -1358,10 +1999,7 @@ msm_nand_block_isbad(struct mtd_info *mtd, loff_t ofs)
 	dma_buffer->cmdptr = (msm_virt_to_dma(chip,
 				dma_buffer->cmd) >> 3) | CMD_PTR_LP;
 
-	dsb();
-	msm_dmov_exec_cmd(chip->dma_channel, DMOV_CMD_PTR_LIST |
-		DMOV_CMD_ADDR(msm_virt_to_dma(chip, &dma_buffer->cmdptr)));
-	dsb();
+	msm_nand_dma_exec(chip, &dma_buffer->cmdptr, MSM_NAND_STAT_READ_OOB);
 
 	ret = 0;
 	if (dma_buffer->data.result.flash_status & 0x110)
@@ -1379,6 +2017,8 @@ msm_nand_block_isbad(struct mtd_info *mtd, loff_t ofs)
 	}
 
 	msm_nand_release_dma_buffer(chip, dma_buffer, sizeof(*dma_buffer) + 4);
+	msm_nand_stat_op(chip, MSM_NAND_STAT_READ_OOB, start, 1, 4,
+			 ret < 0 ? ret : 0);
 	return ret;
 }
 
@@ -1562,6 +2202,15 @@ int msm_nand_scan(struct mtd_info *mtd, int maxchips)
 		return -ENODEV;
 	}
 
+	if (subpage_start_block) {
+		chip->subpage_start =
+			(loff_t)subpage_start_block * mtd->erasesize;
+		mtd->subpage_sft = ffs(mtd->writesize >> 9) - 1;
+		pr_info("msm_nand: sub-page layout from block %u, "
+			"%d byte sub-pages\n", subpage_start_block,
+			mtd->writesize >> mtd->subpage_sft);
+	}
+
 	/* Fill in remaining MTD driver data */
 	mtd->type = MTD_NANDFLASH;
 	mtd->flags = MTD_CAP_NANDFLASH;
@@ -1636,10 +2285,127 @@ EXPORT_SYMBOL_GPL(msm_nand_release);
 static const char *part_probes[] = { "cmdlinepart", NULL,  };
 #endif
 
+#ifdef CONFIG_DEBUG_FS
+static const char *msm_nand_stat_names[MSM_NAND_STAT_NR] = {
+	[MSM_NAND_STAT_READ]		= "read",
+	[MSM_NAND_STAT_READ_OOB]	= "read_oob",
+	[MSM_NAND_STAT_WRITE]		= "write",
+	[MSM_NAND_STAT_ERASE]		= "erase",
+};
+
+static int msm_nand_debug_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static inline uint64_t msm_nand_ns_to_ms(uint64_t ns)
+{
+	do_div(ns, NSEC_PER_MSEC);
+	return ns;
+}
+
+static ssize_t msm_nand_stats_read(struct file *file, char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	const int bufmax = 4096;
+	struct msm_nand_chip *chip = file->private_data;
+	struct msm_nand_stats *stats;
+	unsigned long irq_flags;
+	char *buffer;
+	ssize_t ret;
+	int i, j, len = 0;
+
+	stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+	buffer = kmalloc(bufmax, GFP_KERNEL);
+	if (!stats || !buffer) {
+		ret = -ENOMEM;
+		goto done;
+	}
+	spin_lock_irqsave(&chip->stats.lock, irq_flags);
+	*stats = chip->stats;
+	spin_unlock_irqrestore(&chip->stats.lock, irq_flags);
+
+	for (i = 0; i < MSM_NAND_STAT_NR; i++) {
+		struct msm_nand_op_stats *s = &stats->op[i];
+		uint64_t other = 0, kbps = 0, total_us;
+
+		/* lists of one call never overlap on the channel, so
+		 * whatever the data mover was not running is cpu time,
+		 * waits for the dma buffer and queueing
+		 */
+		if (s->total_ns > s->dm_active_ns)
+			other = s->total_ns - s->dm_active_ns;
+		total_us = s->total_ns;
+		do_div(total_us, NSEC_PER_USEC);
+		if (total_us) {
+			kbps = s->bytes * USEC_PER_SEC / 1024;
+			do_div(kbps, total_us);
+		}
+		len += scnprintf(buffer + len, bufmax - len,
+				 "%s: calls %lu units %lu errors %lu "
+				 "bytes %llu KB/s %llu\n",
+				 msm_nand_stat_names[i], s->calls, s->units,
+				 s->errors, s->bytes, kbps);
+		len += scnprintf(buffer + len, bufmax - len,
+				 "  ms: total %llu dm queued %llu "
+				 "dm active %llu other %llu\n",
+				 msm_nand_ns_to_ms(s->total_ns),
+				 msm_nand_ns_to_ms(s->dm_queue_ns),
+				 msm_nand_ns_to_ms(s->dm_active_ns),
+				 msm_nand_ns_to_ms(other));
+		len += scnprintf(buffer + len, bufmax - len,
+				 "  list us: max %u", s->max_us);
+		for (j = 0; j < MSM_NAND_LAT_BUCKETS; j++) {
+			if (!s->lat[j])
+				continue;
+			/* labelled with the lower bound of the bucket */
+			len += scnprintf(buffer + len, bufmax - len,
+					 " %u+:%lu", j ? 1U << j : 0,
+					 s->lat[j]);
+		}
+		len += scnprintf(buffer + len, bufmax - len, "\n");
+	}
+	len += scnprintf(buffer + len, bufmax - len,
+			 "ecc corrected %lu failed %lu\n",
+			 stats->ecc_corrected, stats->ecc_failed);
+	ret = simple_read_from_buffer(buf, count, ppos, buffer, len);
+done:
+	kfree(buffer);
+	kfree(stats);
+	return ret;
+}
+
+/* any write clears the counters */
+static ssize_t msm_nand_stats_write(struct file *file,
+				    const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct msm_nand_chip *chip = file->private_data;
+	unsigned long irq_flags;
+
+	spin_lock_irqsave(&chip->stats.lock, irq_flags);
+	memset(chip->stats.op, 0, sizeof(chip->stats.op));
+	chip->stats.ecc_corrected = 0;
+	chip->stats.ecc_failed = 0;
+	spin_unlock_irqrestore(&chip->stats.lock, irq_flags);
+	return count;
+}
+
+static const struct file_operations msm_nand_stats_fops = {
+	.open = msm_nand_debug_open,
+	.read = msm_nand_stats_read,
+	.write = msm_nand_stats_write,
+};
+#endif
+
 struct msm_nand_info {
 	struct mtd_info		mtd;
 	struct mtd_partition	*parts;
 	struct msm_nand_chip	msm_nand;
+#ifdef CONFIG_DEBUG_FS
+	struct dentry		*debugfs;
+#endif
 };
 
 static int __devinit msm_nand_probe(struct platform_device *pdev)
@@ -1664,6 +2430,7 @@ static int __devinit msm_nand_probe(struct platform_device *pdev)
 	info->msm_nand.dev = &pdev->dev;
 
 	init_waitqueue_head(&info->msm_nand.wait_queue);
+	spin_lock_init(&info->msm_nand.stats.lock);
 
 	info->msm_nand.dma_channel = pdev->resource[0].start;
 	/* this currently fails if dev is passed in */
@@ -1707,6 +2474,13 @@ static int __devinit msm_nand_probe(struct platform_device *pdev)
 
 	dev_set_drvdata(&pdev->dev, info);
 
+#ifdef CONFIG_DEBUG_FS
+	info->debugfs = debugfs_create_file("msm_nand_stats",
+					    S_IFREG | S_IRUGO | S_IWUSR, NULL,
+					    &info->msm_nand,
+					    &msm_nand_stats_fops);
+#endif
+
 	return 0;
 
 out_free_dma_buffer:
@@ -1725,6 +2499,9 @@ static int __devexit msm_nand_remove(struct platform_device *pdev)
 	dev_set_drvdata(&pdev->dev, NULL);
 
 	if (info) {
+#ifdef CONFIG_DEBUG_FS
+		debugfs_remove(info->debugfs);
+#endif
 #ifdef CONFIG_MTD_PARTITIONS
 		if (info->parts)
 			del_mtd_partitions(&info->mtd);
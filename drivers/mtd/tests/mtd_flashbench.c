@@ -0,0 +1,531 @@
+/*
+ * Flash path benchmark: raw NAND, the filesystem on top of it, and SD.
+ *
+ * Each part runs only when its parameter is given:
+ *
+ *   dev=N          raw MTD: erase, page write, page read, page+oob read
+ *                  and oob-only read over the first nand_blocks good
+ *                  eraseblocks. DESTROYS the data on them.
+ *   dir=PATH       file I/O in a directory of a mounted filesystem:
+ *                  sequential and random 4KiB writes and reads of a
+ *                  file_mb file, page cache dropped before each read.
+ *   mount_dev=DEV  time to mount an unmounted yaffs2 device (for example
+ *                  /dev/block/mtdblock4) from its checkpoint and with
+ *                  no-checkpoint-read, i.e. with a full scan.
+ *   sd_dev=DEV     sequential 128KiB and random 4KiB reads of a block
+ *                  device, bypassing the page cache. With sd_write=1
+ *                  the same pattern is written too, DESTROYING the data.
+ *
+ * Every result is one line "mtd_flashbench: test=... key=value ..." so
+ * that runs of two builds can be compared by a script. Loading the
+ * module runs the benchmark; it then fails with -EAGAIN so that it does
+ * not stay loaded.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/err.h>
+#include <linux/mtd/mtd.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/random.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mount.h>
+#include <linux/namei.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/completion.h>
+#include <linux/uaccess.h>
+
+#define PRINT_PREF KERN_INFO "mtd_flashbench: "
+
+#define FB_IO_SIZE	4096
+#define FB_SEQ_PAGES	32	/* 128KiB sequential block requests */
+
+static int dev = -1;
+module_param(dev, int, S_IRUGO);
+MODULE_PARM_DESC(dev, "MTD device number for the raw NAND tests");
+
+static int nand_blocks = 16;
+module_param(nand_blocks, int, S_IRUGO);
+MODULE_PARM_DESC(nand_blocks, "Good eraseblocks to use for the NAND tests");
+
+static char *dir;
+module_param(dir, charp, S_IRUGO);
+MODULE_PARM_DESC(dir, "Directory for the file tests");
+
+static int file_mb = 4;
+module_param(file_mb, int, S_IRUGO);
+MODULE_PARM_DESC(file_mb, "Size of the file test file in MiB");
+
+static char *mount_dev;
+module_param(mount_dev, charp, S_IRUGO);
+MODULE_PARM_DESC(mount_dev, "Unmounted yaffs2 block device for the mount test");
+
+static char *sd_dev;
+module_param(sd_dev, charp, S_IRUGO);
+MODULE_PARM_DESC(sd_dev, "Block device for the SD tests");
+
+static int sd_mb = 16;
+module_param(sd_mb, int, S_IRUGO);
+MODULE_PARM_DESC(sd_mb, "MiB transferred by each SD test");
+
+static int sd_write;
+module_param(sd_write, int, S_IRUGO);
+MODULE_PARM_DESC(sd_write, "Also run the (destructive) SD write tests");
+
+static ktime_t fb_start;
+
+static void fb_timer_start(void)
+{
+	fb_start = ktime_get();
+}
+
+static void fb_report(const char *test, const char *target,
+		      unsigned long long bytes, unsigned int ops)
+{
+	s64 us = ktime_us_delta(ktime_get(), fb_start);
+
+	if (us <= 0)
+		us = 1;
+	printk(PRINT_PREF "test=%s target=%s bytes=%llu ops=%u usecs=%lld "
+	       "kib_per_s=%llu ops_per_s=%llu\n", test, target, bytes, ops, us,
+	       div64_u64(bytes * 1000000 / 1024, us),
+	       div64_u64((u64)ops * 1000000, us));
+}
+
+/* raw NAND */
+
+struct fb_nand {
+	struct mtd_info *mtd;
+	char name[16];
+	int *blocks;		/* the good eraseblocks used */
+	int nblocks;
+	int pgcnt;
+	unsigned char *buf;	/* one page */
+	unsigned char *oob;
+};
+
+static int fb_nand_erase(struct fb_nand *n)
+{
+	struct mtd_info *mtd = n->mtd;
+	struct erase_info ei;
+	int i, err;
+
+	for (i = 0; i < n->nblocks; i++) {
+		memset(&ei, 0, sizeof(ei));
+		ei.mtd = mtd;
+		ei.addr = (loff_t)n->blocks[i] * mtd->erasesize;
+		ei.len = mtd->erasesize;
+		err = mtd->erase(mtd, &ei);
+		if (!err && ei.state == MTD_ERASE_FAILED)
+			err = -EIO;
+		if (err) {
+			printk(PRINT_PREF "error %d erasing EB %d\n", err,
+			       n->blocks[i]);
+			return err;
+		}
+		cond_resched();
+	}
+	return 0;
+}
+
+static int fb_nand_pages(struct fb_nand *n, int write, int oob_mode)
+{
+	struct mtd_info *mtd = n->mtd;
+	struct mtd_oob_ops ops;
+	size_t done;
+	loff_t addr;
+	int i, pg, err;
+
+	for (i = 0; i < n->nblocks; i++) {
+		addr = (loff_t)n->blocks[i] * mtd->erasesize;
+		for (pg = 0; pg < n->pgcnt; pg++, addr += mtd->writesize) {
+			if (write) {
+				err = mtd->write(mtd, addr, mtd->writesize,
+						 &done, n->buf);
+			} else if (!oob_mode) {
+				err = mtd->read(mtd, addr, mtd->writesize,
+						&done, n->buf);
+			} else {
+				/* 1: data and oob, 2: oob only, as the scan */
+				memset(&ops, 0, sizeof(ops));
+				ops.mode = MTD_OOB_AUTO;
+				ops.ooblen = mtd->oobavail;
+				ops.oobbuf = n->oob;
+				if (oob_mode == 1) {
+					ops.len = mtd->writesize;
+					ops.datbuf = n->buf;
+				}
+				err = mtd->read_oob(mtd, addr, &ops);
+			}
+			/* corrected bitflips are fine for a benchmark */
+			if (err == -EUCLEAN)
+				err = 0;
+			if (err) {
+				printk(PRINT_PREF "error %d at %#llx\n", err,
+				       addr);
+				return err;
+			}
+		}
+		cond_resched();
+	}
+	return 0;
+}
+
+static int fb_nand_run(void)
+{
+	struct fb_nand n;
+	unsigned long long bytes;
+	int i, err = -ENOMEM;
+
+	memset(&n, 0, sizeof(n));
+	n.mtd = get_mtd_device(NULL, dev);
+	if (IS_ERR(n.mtd)) {
+		printk(PRINT_PREF "cannot get MTD device %d\n", dev);
+		return PTR_ERR(n.mtd);
+	}
+	if (n.mtd->type != MTD_NANDFLASH || !n.mtd->read_oob) {
+		printk(PRINT_PREF "mtd%d is not NAND\n", dev);
+		err = -EINVAL;
+		goto out;
+	}
+	snprintf(n.name, sizeof(n.name), "mtd%d", dev);
+	n.pgcnt = n.mtd->erasesize / n.mtd->writesize;
+
+	n.blocks = kmalloc(nand_blocks * sizeof(int), GFP_KERNEL);
+	n.buf = kmalloc(n.mtd->writesize, GFP_KERNEL);
+	n.oob = kmalloc(n.mtd->oobsize, GFP_KERNEL);
+	if (!n.blocks || !n.buf || !n.oob)
+		goto out;
+	for (i = 0; n.nblocks < nand_blocks &&
+		    (u64)i * n.mtd->erasesize < n.mtd->size; i++) {
+		if (n.mtd->block_isbad &&
+		    n.mtd->block_isbad(n.mtd, (loff_t)i * n.mtd->erasesize))
+			continue;
+		n.blocks[n.nblocks++] = i;
+	}
+	if (!n.nblocks) {
+		err = -ENOSPC;
+		goto out;
+	}
+	get_random_bytes(n.buf, n.mtd->writesize);
+	bytes = (unsigned long long)n.nblocks * n.mtd->erasesize;
+
+	fb_timer_start();
+	err = fb_nand_erase(&n);
+	if (err)
+		goto out;
+	fb_report("nand_erase", n.name, bytes, n.nblocks);
+
+	fb_timer_start();
+	err = fb_nand_pages(&n, 1, 0);
+	if (err)
+		goto out;
+	fb_report("nand_write_page", n.name, bytes, n.nblocks * n.pgcnt);
+
+	fb_timer_start();
+	err = fb_nand_pages(&n, 0, 0);
+	if (err)
+		goto out;
+	fb_report("nand_read_page", n.name, bytes, n.nblocks * n.pgcnt);
+
+	fb_timer_start();
+	err = fb_nand_pages(&n, 0, 1);
+	if (err)
+		goto out;
+	fb_report("nand_read_page_oob", n.name, bytes, n.nblocks * n.pgcnt);
+
+	fb_timer_start();
+	err = fb_nand_pages(&n, 0, 2);
+	if (err)
+		goto out;
+	fb_report("nand_read_oob", n.name,
+		  (unsigned long long)n.nblocks * n.pgcnt * n.mtd->oobavail,
+		  n.nblocks * n.pgcnt);
+
+	err = fb_nand_erase(&n);
+out:
+	kfree(n.oob);
+	kfree(n.buf);
+	kfree(n.blocks);
+	if (!IS_ERR(n.mtd))
+		put_mtd_device(n.mtd);
+	return err;
+}
+
+/* file I/O */
+
+static int fb_file_io(struct file *file, void *buf, int write, int random,
+		      unsigned int nr)
+{
+	unsigned int i;
+	mm_segment_t old_fs;
+	loff_t pos = 0;
+	ssize_t ret = 0;
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	for (i = 0; i < nr; i++) {
+		if (random)
+			pos = (loff_t)(random32() % nr) * FB_IO_SIZE;
+		if (write)
+			ret = vfs_write(file, (char __user *)buf, FB_IO_SIZE,
+					&pos);
+		else
+			ret = vfs_read(file, (char __user *)buf, FB_IO_SIZE,
+				       &pos);
+		if (ret != FB_IO_SIZE)
+			break;
+		if (!(i & 63))
+			cond_resched();
+	}
+	set_fs(old_fs);
+	if (ret != FB_IO_SIZE)
+		return ret < 0 ? ret : -EIO;
+	if (write)
+		return vfs_fsync(file, file->f_path.dentry, 0);
+	return 0;
+}
+
+static int fb_file_run(void)
+{
+	static const struct {
+		const char *test;
+		int write;
+		int random;
+	} fb_file_tests[] = {
+		{ "file_seq_write", 1, 0 },
+		{ "file_seq_read", 0, 0 },
+		{ "file_rand_write", 1, 1 },
+		{ "file_rand_read", 0, 1 },
+	};
+	unsigned int nr = file_mb << (20 - 12);
+	struct dentry *dentry, *parent;
+	struct file *file;
+	char *path;
+	void *buf;
+	int i, err = -ENOMEM;
+
+	path = kasprintf(GFP_KERNEL, "%s/mtd_flashbench.tmp", dir);
+	buf = kmalloc(FB_IO_SIZE, GFP_KERNEL);
+	if (!path || !buf)
+		goto out;
+	get_random_bytes(buf, FB_IO_SIZE);
+
+	file = filp_open(path, O_RDWR | O_CREAT | O_TRUNC | O_LARGEFILE, 0600);
+	if (IS_ERR(file)) {
+		err = PTR_ERR(file);
+		printk(PRINT_PREF "cannot create %s: %d\n", path, err);
+		goto out;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(fb_file_tests); i++) {
+		/* reads must come from flash, not from the page cache */
+		if (!fb_file_tests[i].write)
+			invalidate_mapping_pages(file->f_mapping, 0, -1);
+		fb_timer_start();
+		err = fb_file_io(file, buf, fb_file_tests[i].write,
+				 fb_file_tests[i].random, nr);
+		if (err) {
+			printk(PRINT_PREF "%s failed: %d\n",
+			       fb_file_tests[i].test, err);
+			break;
+		}
+		fb_report(fb_file_tests[i].test, dir,
+			  (unsigned long long)nr * FB_IO_SIZE, nr);
+	}
+
+	dentry = dget(file->f_path.dentry);
+	parent = dget_parent(dentry);
+	filp_close(file, NULL);
+	mutex_lock_nested(&parent->d_inode->i_mutex, I_MUTEX_PARENT);
+	vfs_unlink(parent->d_inode, dentry);
+	mutex_unlock(&parent->d_inode->i_mutex);
+	dput(parent);
+	dput(dentry);
+out:
+	kfree(buf);
+	kfree(path);
+	return err;
+}
+
+/* mount */
+
+static int fb_mount_once(const char *opts, int timed, const char *test)
+{
+	struct vfsmount *mnt;
+	char data[32];
+
+	strlcpy(data, opts, sizeof(data));
+	if (timed)
+		fb_timer_start();
+	mnt = do_kern_mount("yaffs2", 0, mount_dev, data);
+	if (IS_ERR(mnt)) {
+		printk(PRINT_PREF "cannot mount %s: %ld\n", mount_dev,
+		       PTR_ERR(mnt));
+		return PTR_ERR(mnt);
+	}
+	if (timed)
+		fb_report(test, mount_dev, 0, 1);
+	/* the last reference unmounts, writing a fresh checkpoint */
+	mntput(mnt);
+	return 0;
+}
+
+static int fb_mount_run(void)
+{
+	int err;
+
+	err = fb_mount_once("", 0, NULL);
+	if (!err)
+		err = fb_mount_once("", 1, "mount_checkpoint");
+	if (!err)
+		err = fb_mount_once("no-checkpoint-read", 1, "mount_scan");
+	return err;
+}
+
+/* SD, or any block device */
+
+static void fb_bio_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+static int fb_bio_rw(struct block_device *bdev, int rw, sector_t sector,
+		     struct page **pages, int nr_pages)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct bio *bio;
+	int i, err;
+
+	bio = bio_alloc(GFP_KERNEL, nr_pages);
+	if (!bio)
+		return -ENOMEM;
+	bio->bi_bdev = bdev;
+	bio->bi_sector = sector;
+	bio->bi_end_io = fb_bio_end_io;
+	bio->bi_private = &done;
+	for (i = 0; i < nr_pages; i++) {
+		if (!bio_add_page(bio, pages[i], PAGE_SIZE, 0)) {
+			bio_put(bio);
+			return -EIO;
+		}
+	}
+	submit_bio(rw, bio);
+	wait_for_completion(&done);
+	err = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+	return err;
+}
+
+static int fb_sd_pass(struct block_device *bdev, struct page **pages,
+		      int rw, int random, const char *test)
+{
+	sector_t nr_sect = i_size_read(bdev->bd_inode) >> 9;
+	unsigned long long bytes = (unsigned long long)sd_mb << 20;
+	int nr_pages = random ? 1 : FB_SEQ_PAGES;
+	unsigned int len = nr_pages * PAGE_SIZE;
+	unsigned int i, ops = (sd_mb << 20) / len;
+	u32 nr_rand = nr_sect >> (PAGE_SHIFT - 9);
+	sector_t sector = 0;
+	int err;
+
+	if (nr_sect < (bytes >> 9)) {
+		printk(PRINT_PREF "%s is smaller than %d MiB\n", sd_dev, sd_mb);
+		return -ENOSPC;
+	}
+
+	fb_timer_start();
+	for (i = 0; i < ops; i++) {
+		if (random)
+			sector = (sector_t)(random32() % nr_rand) <<
+				 (PAGE_SHIFT - 9);
+		err = fb_bio_rw(bdev, rw, sector, pages, nr_pages);
+		if (err) {
+			printk(PRINT_PREF "%s: error %d at sector %llu\n",
+			       test, err, (unsigned long long)sector);
+			return err;
+		}
+		sector += len >> 9;
+	}
+	fb_report(test, sd_dev, bytes, ops);
+	return 0;
+}
+
+static int fb_sd_run(void)
+{
+	fmode_t mode = FMODE_READ | (sd_write ? FMODE_WRITE : 0);
+	struct page *pages[FB_SEQ_PAGES];
+	struct block_device *bdev;
+	int i, err = -ENOMEM;
+
+	memset(pages, 0, sizeof(pages));
+	for (i = 0; i < FB_SEQ_PAGES; i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i])
+			goto out;
+	}
+
+	bdev = open_bdev_exclusive(sd_dev, mode, pages);
+	if (IS_ERR(bdev)) {
+		err = PTR_ERR(bdev);
+		printk(PRINT_PREF "cannot open %s: %d\n", sd_dev, err);
+		goto out;
+	}
+
+	err = fb_sd_pass(bdev, pages, READ_SYNC, 0, "sd_seq_read");
+	if (!err)
+		err = fb_sd_pass(bdev, pages, READ_SYNC, 1, "sd_rand_read");
+	if (!err && sd_write)
+		err = fb_sd_pass(bdev, pages, WRITE_SYNC, 0, "sd_seq_write");
+	if (!err && sd_write)
+		err = fb_sd_pass(bdev, pages, WRITE_SYNC, 1, "sd_rand_write");
+
+	close_bdev_exclusive(bdev, mode);
+out:
+	for (i = 0; i < FB_SEQ_PAGES; i++)
+		if (pages[i])
+			__free_page(pages[i]);
+	return err;
+}
+
+static int __init mtd_flashbench_init(void)
+{
+	int err = 0;
+
+	if (dev < 0 && !dir && !mount_dev && !sd_dev) {
+		printk(PRINT_PREF "nothing to do, set dev, dir, mount_dev "
+		       "or sd_dev\n");
+		return -EINVAL;
+	}
+
+	if (dev >= 0)
+		err = fb_nand_run();
+	if (!err && dir)
+		err = fb_file_run();
+	if (!err && mount_dev)
+		err = fb_mount_run();
+	if (!err && sd_dev)
+		err = fb_sd_run();
+
+	printk(PRINT_PREF "done, err=%d\n", err);
+	return err ? err : -EAGAIN;
+}
+module_init(mtd_flashbench_init);
+
+static void __exit mtd_flashbench_exit(void)
+{
+}
+module_exit(mtd_flashbench_exit);
+
+MODULE_DESCRIPTION("NAND, filesystem and SD throughput benchmark");
+MODULE_LICENSE("GPL");
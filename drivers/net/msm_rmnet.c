@@ -26,6 +26,11 @@
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/skbuff.h>
+#include <linux/pkt_sched.h>
+#include <linux/timer.h>
+#include <linux/ip.h>
+#include <net/checksum.h>
+#include <net/sock.h>
 #include <linux/wakelock.h>
 
 #ifdef CONFIG_HAS_EARLYSUSPEND
@@ -33,17 +38,38 @@
 #endif
 
 #include <mach/msm_smd.h>
+#include <mach/htc_pwrsink.h>
 
 /* XXX should come from smd headers */
 #define SMD_PORT_ETHER0 11
 #define POLL_DELAY 1000000 /* 1 second delay interval */
 
+#define RMNET_RX_BUDGET		32	/* packets per rx tasklet run */
+#define RMNET_RX_SKB_SIZE	(1514 + NET_IP_ALIGN)
+#define RMNET_POOL_SIZE		16	/* rx skbs kept preallocated */
+#define RMNET_DEFER_MAX		64	/* tx packets held for the radio */
+#define RMNET_RADIO_TAIL_MS	5000	/* radio stays up after traffic */
+
 struct rmnet_private
 {
 	smd_channel_t *ch;
 	struct net_device_stats stats;
 	const char *chname;
 	struct wake_lock wake_lock;
+	struct tasklet_struct rx_tasklet;
+	struct tasklet_struct tx_tasklet;	/* kicks the modem after tx */
+	struct napi_struct napi;	/* GRO list only, never polled */
+	struct sk_buff_head rx_pool;
+
+	/* deferred tx: background packets wait for the radio to come up */
+	struct sk_buff_head defer_q;
+	struct timer_list defer_timer;
+	unsigned int defer_ms;		/* longest hold, 0 disables */
+	u32 defer_mark;			/* skb->mark that may be held */
+	unsigned int radio_tail_ms;
+	unsigned long radio_active_until;
+	unsigned long radio_activations;
+	unsigned long tx_deferred;
 #ifdef CONFIG_MSM_RMNET_DEBUG
 	ktime_t last_packet;
 	short active_countdown; /* Number of times left to check */
@@ -247,13 +273,201 @@ DEVICE_ATTR(awake_time_ms, 0444, awake_time_show, NULL);
 
 #endif
 
-/* Called in soft-irq context */
+/*
+ * The radio is taken to be up for radio_tail_ms after the last packet
+ * in either direction, roughly the time the modem stays in the high
+ * power state. Each idle to active transition counts as an activation.
+ */
+/* the radio sink is shared by all channels, and goes idle with the last */
+static unsigned long rmnet_radio_until;
+static void rmnet_radio_idle(unsigned long data);
+static DEFINE_TIMER(rmnet_radio_timer, rmnet_radio_idle, 0, 0);
+
+static void rmnet_radio_idle(unsigned long data)
+{
+	if (time_before(jiffies, rmnet_radio_until))
+		mod_timer(&rmnet_radio_timer, rmnet_radio_until);
+	else
+		htc_pwrsink_set(PWRSINK_RADIO, 0);
+}
+
+static void rmnet_radio_touch(struct rmnet_private *p)
+{
+	if (time_after_eq(jiffies, p->radio_active_until))
+		p->radio_activations++;
+	p->radio_active_until = jiffies + msecs_to_jiffies(p->radio_tail_ms);
+
+	if (time_after(p->radio_active_until, rmnet_radio_until))
+		rmnet_radio_until = p->radio_active_until;
+	if (!timer_pending(&rmnet_radio_timer)) {
+		htc_pwrsink_set(PWRSINK_RADIO, 100);
+		mod_timer(&rmnet_radio_timer, rmnet_radio_until);
+	}
+}
+
+static int rmnet_radio_active(struct rmnet_private *p)
+{
+	return time_before(jiffies, p->radio_active_until);
+}
+
+/* Background traffic: SO_PRIORITY bulk or filler, or the defer mark */
+static int rmnet_deferrable(struct rmnet_private *p, struct sk_buff *skb)
+{
+	if (skb->priority == TC_PRIO_BULK || skb->priority == TC_PRIO_FILLER)
+		return 1;
+	return p->defer_mark && skb->mark == p->defer_mark;
+}
+
+static ssize_t defer_ms_show(struct device *d, struct device_attribute *attr,
+			     char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%u\n", p->defer_ms);
+}
+
+static ssize_t defer_ms_store(struct device *d, struct device_attribute *attr,
+			      const char *buf, size_t n)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	p->defer_ms = simple_strtoul(buf, NULL, 10);
+	/* anything held goes out now, the next timer uses the new value */
+	mod_timer(&p->defer_timer, jiffies);
+	return n;
+}
+
+DEVICE_ATTR(defer_ms, 0664, defer_ms_show, defer_ms_store);
+
+static ssize_t defer_mark_show(struct device *d, struct device_attribute *attr,
+			       char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "0x%x\n", p->defer_mark);
+}
+
+static ssize_t defer_mark_store(struct device *d,
+				struct device_attribute *attr,
+				const char *buf, size_t n)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	p->defer_mark = simple_strtoul(buf, NULL, 0);
+	return n;
+}
+
+DEVICE_ATTR(defer_mark, 0664, defer_mark_show, defer_mark_store);
+
+static ssize_t radio_tail_ms_show(struct device *d,
+				  struct device_attribute *attr, char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%u\n", p->radio_tail_ms);
+}
+
+static ssize_t radio_tail_ms_store(struct device *d,
+				   struct device_attribute *attr,
+				   const char *buf, size_t n)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	p->radio_tail_ms = simple_strtoul(buf, NULL, 10);
+	return n;
+}
+
+DEVICE_ATTR(radio_tail_ms, 0664, radio_tail_ms_show, radio_tail_ms_store);
+
+static ssize_t radio_activations_show(struct device *d,
+				      struct device_attribute *attr, char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%lu\n", p->radio_activations);
+}
+
+DEVICE_ATTR(radio_activations, 0444, radio_activations_show, NULL);
+
+static ssize_t tx_deferred_show(struct device *d,
+				struct device_attribute *attr, char *buf)
+{
+	struct rmnet_private *p = netdev_priv(to_net_dev(d));
+	return sprintf(buf, "%lu\n", p->tx_deferred);
+}
+
+DEVICE_ATTR(tx_deferred, 0444, tx_deferred_show, NULL);
+
+static struct sk_buff *rmnet_alloc_rx_skb(struct rmnet_private *p)
+{
+	struct sk_buff *skb;
+
+	skb = skb_dequeue(&p->rx_pool);
+	if (!skb)
+		skb = dev_alloc_skb(RMNET_RX_SKB_SIZE);
+	return skb;
+}
+
+static void rmnet_fill_rx_pool(struct rmnet_private *p)
+{
+	struct sk_buff *skb;
+
+	while (skb_queue_len(&p->rx_pool) < RMNET_POOL_SIZE) {
+		skb = dev_alloc_skb(RMNET_RX_SKB_SIZE);
+		if (!skb)
+			break;
+		skb_queue_tail(&p->rx_pool, skb);
+	}
+}
+
+/* Copy the current packet straight out of the smd fifo */
+static int rmnet_smd_read(smd_channel_t *ch, unsigned char *data, int len)
+{
+	void *ptr;
+	int done = 0;
+	int n;
+
+	while (done < len) {
+		n = smd_read_peek(ch, &ptr);
+		if (n <= 0)
+			break;
+		if (n > len - done)
+			n = len - done;
+		memcpy(data + done, ptr, n);
+		smd_read_consume(ch, n);
+		done += n;
+	}
+	return done;
+}
+
+/* GRO only merges TCP segments with a checked checksum and the modem
+ * doesn't give us one, so sum them here; the stack then skips it.
+ */
+static int rmnet_rx_csum(struct sk_buff *skb)
+{
+	struct iphdr *iph = (struct iphdr *) skb->data;
+
+	if (skb->protocol != htons(ETH_P_IP) || skb->len < sizeof(*iph) ||
+	    iph->protocol != IPPROTO_TCP ||
+	    (iph->frag_off & htons(IP_MF | IP_OFFSET)))
+		return 0;
+
+	skb->csum = csum_partial(skb->data, skb->len, 0);
+	skb->ip_summed = CHECKSUM_COMPLETE;
+	return 1;
+}
+
+static int rmnet_napi_poll(struct napi_struct *napi, int budget)
+{
+	return 0;
+}
+
+/* Called in soft-irq context.  Drains up to RMNET_RX_BUDGET packets and
+ * then tells the modem about the freed fifo space once, instead of after
+ * every packet.  TCP segments go through GRO and are flushed up the
+ * stack at the end of the run.
+ */
 static void smd_net_data_handler(unsigned long arg)
 {
 	struct net_device *dev = (struct net_device *) arg;
 	struct rmnet_private *p = netdev_priv(dev);
 	struct sk_buff *skb;
 	void *ptr = 0;
+	int budget = RMNET_RX_BUDGET;
+	int count = 0;
 	int sz;
 
 	for (;;) {
@@ -261,11 +475,16 @@ static void smd_net_data_handler(unsigned long arg)
 		if (sz == 0) break;
 		if (smd_read_avail(p->ch) < sz) break;
 
+		if (budget-- == 0) {
+			tasklet_schedule(&p->rx_tasklet);
+			break;
+		}
+
 		if (sz > 1514) {
 			pr_err("rmnet_recv() discarding %d len\n", sz);
 			ptr = 0;
 		} else {
-			skb = dev_alloc_skb(sz + NET_IP_ALIGN);
+			skb = rmnet_alloc_rx_skb(p);
 			if (skb == NULL) {
 				pr_err("rmnet_recv() cannot allocate skb\n");
 			} else {
@@ -273,13 +492,15 @@ static void smd_net_data_handler(unsigned long arg)
 				skb_reserve(skb, NET_IP_ALIGN);
 				ptr = skb_put(skb, sz);
 				wake_lock_timeout(&p->wake_lock, HZ / 2);
-				if (smd_read(p->ch, ptr, sz) != sz) {
+				count++;
+				if (rmnet_smd_read(p->ch, ptr, sz) != sz) {
 					pr_err("rmnet_recv() smd lied about avail?!");
 					ptr = 0;
 					dev_kfree_skb_irq(skb);
 				} else {
 					skb->protocol = eth_type_trans(skb, dev);
 					if (count_this_packet(ptr, skb->len)) {
+						rmnet_radio_touch(p);
 #ifdef CONFIG_MSM_RMNET_DEBUG
 						p->wakeups_rcv +=
 							rmnet_cause_wakeup(p);
@@ -287,7 +508,11 @@ static void smd_net_data_handler(unsigned long arg)
 						p->stats.rx_packets++;
 						p->stats.rx_bytes += skb->len;
 					}
-					netif_rx(skb);
+					if ((dev->features & NETIF_F_GRO) &&
+					    rmnet_rx_csum(skb))
+						napi_gro_receive(&p->napi, skb);
+					else
+						netif_rx(skb);
 				}
 				continue;
 			}
@@ -295,18 +520,34 @@ static void smd_net_data_handler(unsigned long arg)
 		if (smd_read(p->ch, ptr, sz) != sz)
 			pr_err("rmnet_recv() smd lied about avail?!");
 	}
+
+	if (count) {
+		napi_gro_flush(&p->napi);
+		smd_kick_remote(p->ch);
+	}
+
+	/* the radio is up anyway, let the held packets go */
+	if (count && !skb_queue_empty(&p->defer_q))
+		mod_timer(&p->defer_timer, jiffies);
 }
 
-static DECLARE_TASKLET(smd_net_data_tasklet, smd_net_data_handler, 0);
+/* Runs after the tx softirq has queued what it had */
+static void smd_net_tx_kick(unsigned long arg)
+{
+	struct net_device *dev = (struct net_device *) arg;
+	struct rmnet_private *p = netdev_priv(dev);
+
+	smd_kick_remote(p->ch);
+}
 
 static void smd_net_notify(void *_dev, unsigned event)
 {
+	struct rmnet_private *p = netdev_priv((struct net_device *) _dev);
+
 	if (event != SMD_EVENT_DATA)
 		return;
 
-	smd_net_data_tasklet.data = (unsigned long) _dev;
-
-	tasklet_schedule(&smd_net_data_tasklet);
+	tasklet_schedule(&p->rx_tasklet);
 }
 
 static int rmnet_open(struct net_device *dev)
@@ -315,6 +556,7 @@ static int rmnet_open(struct net_device *dev)
 	struct rmnet_private *p = netdev_priv(dev);
 
 	pr_info("rmnet_open()\n");
+	rmnet_fill_rx_pool(p);
 	if (!p->ch) {
 		r = smd_open(p->chname, &p->ch, dev, smd_net_notify);
 
@@ -328,29 +570,112 @@ static int rmnet_open(struct net_device *dev)
 
 static int rmnet_stop(struct net_device *dev)
 {
+	struct rmnet_private *p = netdev_priv(dev);
+
 	pr_info("rmnet_stop()\n");
 	netif_stop_queue(dev);
+	del_timer_sync(&p->defer_timer);
+	skb_queue_purge(&p->defer_q);
+	tasklet_kill(&p->tx_tasklet);
+	skb_queue_purge(&p->rx_pool);
 	return 0;
 }
 
-static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
+/* Copy the packet straight into the smd fifo.  The netdev tx lock
+ * serializes us, so unlike smd_write_atomic() no irqs-off copy.  The
+ * modem is kicked from tx_tasklet, once for all the packets queued by
+ * this tx softirq run.
+ */
+static int rmnet_smd_write(smd_channel_t *ch, struct sk_buff *skb)
+{
+	void *ptr;
+	int len = 0;
+	int n;
+
+	if (smd_write_begin(ch, skb->len) < 0)
+		return -ENOMEM;
+
+	while (len < skb->len) {
+		n = smd_write_peek(ch, &ptr);
+		if (n <= 0)
+			return -EIO;
+		memcpy(ptr, skb->data + len, n);
+		smd_write_commit(ch, n);
+		len += n;
+	}
+	return len;
+}
+
+/* Called with the netdev tx lock held */
+static void rmnet_send(struct rmnet_private *p, struct sk_buff *skb)
 {
-	struct rmnet_private *p = netdev_priv(dev);
 	smd_channel_t *ch = p->ch;
 
-	if (smd_write_atomic(ch, skb->data, skb->len) != skb->len) {
+	if (rmnet_smd_write(ch, skb) != skb->len) {
 		pr_err("rmnet fifo full, dropping packet\n");
 	} else {
 		if (count_this_packet(skb->data, skb->len)) {
+			if (skb->sk)
+				htc_pwrsink_set_owner(PWRSINK_RADIO,
+						      sock_i_uid(skb->sk));
+			rmnet_radio_touch(p);
 			p->stats.tx_packets++;
 			p->stats.tx_bytes += skb->len;
 #ifdef CONFIG_MSM_RMNET_DEBUG
 			p->wakeups_xmit += rmnet_cause_wakeup(p);
 #endif
 		}
+		tasklet_schedule(&p->tx_tasklet);
 	}
 
-	dev_kfree_skb_irq(skb);
+	/* A sent skb big enough for rx is recycled into the rx pool */
+	if (skb_queue_len(&p->rx_pool) < RMNET_POOL_SIZE &&
+	    skb_recycle_check(skb, RMNET_RX_SKB_SIZE))
+		skb_queue_tail(&p->rx_pool, skb);
+	else
+		dev_kfree_skb_irq(skb);
+}
+
+/* Called with the netdev tx lock held */
+static void rmnet_flush_deferred(struct rmnet_private *p)
+{
+	struct sk_buff *skb;
+
+	while ((skb = skb_dequeue(&p->defer_q)) != NULL)
+		rmnet_send(p, skb);
+}
+
+static void rmnet_defer_timeout(unsigned long arg)
+{
+	struct net_device *dev = (struct net_device *) arg;
+	struct rmnet_private *p = netdev_priv(dev);
+
+	netif_tx_lock(dev);
+	rmnet_flush_deferred(p);
+	netif_tx_unlock(dev);
+}
+
+/* Background packets are held while the radio is idle, for at most
+ * defer_ms, so that they go out together with the next foreground
+ * traffic instead of powering the radio up on their own.
+ */
+static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	struct rmnet_private *p = netdev_priv(dev);
+
+	if (p->defer_ms && !rmnet_radio_active(p) &&
+	    rmnet_deferrable(p, skb) &&
+	    skb_queue_len(&p->defer_q) < RMNET_DEFER_MAX) {
+		if (skb_queue_empty(&p->defer_q))
+			mod_timer(&p->defer_timer,
+				  jiffies + msecs_to_jiffies(p->defer_ms));
+		skb_queue_tail(&p->defer_q, skb);
+		p->tx_deferred++;
+		return 0;
+	}
+
+	rmnet_flush_deferred(p);
+	rmnet_send(p, skb);
 	return 0;
 }
 
@@ -385,6 +710,7 @@ static void __init rmnet_setup(struct net_device *dev)
 	dev->watchdog_timeo = 20; /* ??? */
 
 	ether_setup(dev);
+	dev->features |= NETIF_F_GRO;
 
 	//dev->change_mtu = 0; /* ??? */
 
@@ -428,6 +754,17 @@ static int __init rmnet_init(void)
 		p = netdev_priv(dev);
 		p->chname = ch_name[n];
 		wake_lock_init(&p->wake_lock, WAKE_LOCK_SUSPEND, ch_name[n]);
+		tasklet_init(&p->rx_tasklet, smd_net_data_handler,
+			     (unsigned long) dev);
+		tasklet_init(&p->tx_tasklet, smd_net_tx_kick,
+			     (unsigned long) dev);
+		netif_napi_add(dev, &p->napi, rmnet_napi_poll, RMNET_RX_BUDGET);
+		skb_queue_head_init(&p->rx_pool);
+		skb_queue_head_init(&p->defer_q);
+		setup_timer(&p->defer_timer, rmnet_defer_timeout,
+			    (unsigned long) dev);
+		p->radio_tail_ms = RMNET_RADIO_TAIL_MS;
+		p->radio_active_until = jiffies;
 #ifdef CONFIG_MSM_RMNET_DEBUG
 		p->timeout_us = timeout_us;
 		p->awake_time_ms = p->wakeups_xmit = p->wakeups_rcv = 0;
@@ -441,6 +778,17 @@ static int __init rmnet_init(void)
 			return ret;
 		}
 
+		if (device_create_file(d, &dev_attr_defer_ms))
+			continue;
+		if (device_create_file(d, &dev_attr_defer_mark))
+			continue;
+		if (device_create_file(d, &dev_attr_radio_tail_ms))
+			continue;
+		if (device_create_file(d, &dev_attr_radio_activations))
+			continue;
+		if (device_create_file(d, &dev_attr_tx_deferred))
+			continue;
+
 #ifdef CONFIG_MSM_RMNET_DEBUG
 		if (device_create_file(d, &dev_attr_timeout))
 			continue;
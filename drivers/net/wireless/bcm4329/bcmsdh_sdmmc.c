@@ -34,6 +34,7 @@
 #include <bcmsdbus.h>	/* bcmsdh to/from specific controller APIs */
 #include <sdiovar.h>	/* ioctl/iovars */
 
+#include <linux/mm.h>
 #include <linux/mmc/core.h>
 #include <linux/mmc/sdio_func.h>
 #include <linux/mmc/sdio_ids.h>
@@ -964,6 +965,34 @@ sdioh_request_packet(sdioh_info_t *sd, uint fix_inc, uint write, uint func,
 	return ((err_ret == 0) ? SDIOH_API_RC_SUCCESS : SDIOH_API_RC_FAIL);
 }
 
+/*
+ * Incrementing-address transfer straight from/to a caller's buffer, used for
+ * large backplane reads and writes (dongle image download) so they don't get
+ * copied into a packet first. The mmc core splits the buffer into multi-block
+ * CMD53s as large as the host takes.
+ */
+static SDIOH_API_RC
+sdioh_request_direct(sdioh_info_t *sd, uint write, uint func, uint addr,
+                     uint8 *buffer, uint len)
+{
+	int err_ret;
+
+	sd_data(("%s: Direct %s, len=%d\n", __FUNCTION__, write ? "TX" : "RX", len));
+
+	sdio_claim_host(gInstance->func[func]);
+	if (write)
+		err_ret = sdio_memcpy_toio(gInstance->func[func], addr, buffer, len);
+	else
+		err_ret = sdio_memcpy_fromio(gInstance->func[func], buffer, addr, len);
+	sdio_release_host(gInstance->func[func]);
+
+	if (err_ret) {
+		sd_err(("%s: %s FAILED %p, addr=0x%05x, len=%d, ERR=0x%08x\n",
+			__FUNCTION__, (write) ? "TX" : "RX", buffer, addr, len, err_ret));
+	}
+
+	return ((err_ret == 0) ? SDIOH_API_RC_SUCCESS : SDIOH_API_RC_FAIL);
+}
 
 /*
  * This function takes a buffer or packet, and fixes everything up so that in the
@@ -987,6 +1016,15 @@ sdioh_request_buffer(sdioh_info_t *sd, uint pio_dma, uint fix_inc, uint write, u
 
 	DHD_PM_RESUME_WAIT(sdioh_request_buffer_wait);
 	DHD_PM_RESUME_RETURN_ERROR(SDIOH_API_RC_FAIL);
+	/* Case 0: a buffer made of whole blocks that the host can DMA from as is.
+	 * Reads need cache line alignment so the invalidate can't hit neighbours.
+	 */
+	if (pkt == NULL && fix_inc == SDIOH_DATA_INC && (buflen_u % 64) == 0 &&
+	    virt_addr_valid(buffer) &&
+	    ((uint32)buffer & (write ? DMA_ALIGN_MASK : (L1_CACHE_BYTES - 1))) == 0) {
+		return sdioh_request_direct(sd, write, func, addr, buffer, buflen_u);
+	}
+
 	/* Case 1: we don't have a packet. */
 	if (pkt == NULL) {
 		sd_data(("%s: Creating new %s Packet, len=%d\n",
@@ -138,6 +138,27 @@ typedef struct dhd_pub {
 	ulong tx_realloc;	/* Number of tx packets we had to realloc for headroom */
 	ulong fc_packets;       /* Number of flow control pkts recvd */
 
+	/* Host wakeups from suspend, by class of the frame that caused them */
+	bool in_suspend;	/* Early suspend filters are programmed */
+	ulong wake_ucast;	/* Unicast data frames */
+	ulong wake_mcast;	/* Multicast data frames */
+	ulong wake_bcast;	/* Broadcast data frames */
+	ulong wake_arp;		/* ARP frames */
+	ulong wake_event;	/* Dongle events */
+
+	/* Power save mode, switched on the packet rate by dhd_linux.c */
+	int pm_mode;		/* Mode last programmed into the dongle */
+	bool pm_user_off;	/* PM_OFF asked for through an ioctl (DHCP) */
+	ulong pm_stamp;		/* jiffies when pm_mode was last accounted */
+	ulong pm_off_ms;	/* Time spent in each mode */
+	ulong pm_max_ms;
+	ulong pm_fast_ms;
+	ulong pm_switches;	/* Mode changes made on traffic */
+	ulong pm_max_pkts;	/* Packets moved while in PM_MAX */
+	ulong pm_lat_cnt;	/* PM_MAX to PM_FAST on a traffic burst, */
+	ulong pm_lat_ms;	/* ms from the burst start to PM_FAST, summed */
+	ulong pm_lat_max_ms;	/* and the worst case */
+
 	/* Last error return */
 	int bcmerror;
 	uint tickcnt;
@@ -197,6 +218,10 @@ extern int dhd_os_wake_unlock(dhd_pub_t *pub);
 extern int dhd_os_wake_lock_timeout(dhd_pub_t *pub);
 extern int dhd_os_wake_lock_timeout_enable(dhd_pub_t *pub);
 
+/* Power save mode */
+extern void dhd_pm_note(dhd_pub_t *dhdp, int mode);
+extern int dhd_set_pm(dhd_pub_t *dhd, int mode);
+
 typedef struct dhd_if_event {
 	uint8 ifidx;
 	uint8 action;
@@ -514,29 +514,53 @@ dhd_prot_dstats(dhd_pub_t *dhd)
 	return;
 }
 
+/* Packet filters enabled while in early suspend: 100 passes unicast frames
+ * for our address, 101 passes everything but broadcast, i.e. adds the
+ * multicast groups the host joined.  Broadcast ARP is answered by the
+ * dongle's ARP offload, so no broadcast needs to wake the host.
+ */
+#define DHD_PKT_FILTER_UCAST	100
+#define DHD_PKT_FILTER_MCAST	101
+
+/* Let joined multicast groups wake the host from suspend */
+uint dhd_pkt_filter_mcast = 1;
+
+#define htod32(i) i
+
+static void
+dhd_pktfilter_enable(dhd_pub_t *dhd, int id, int enable)
+{
+	wl_pkt_filter_enable_t	enable_parm;
+	char iovbuf[32];
+
+	enable_parm.id = htod32(id);
+	enable_parm.enable = htod32(enable);
+	bcm_mkiovar("pkt_filter_enable", (char *)&enable_parm,
+		sizeof(wl_pkt_filter_enable_t), iovbuf, sizeof(iovbuf));
+	dhdcdc_set_ioctl(dhd, 0, WLC_SET_VAR, iovbuf, sizeof(iovbuf));
+}
+
 int dhd_set_suspend(int value, dhd_pub_t *dhd)
 {
 	int power_mode = PM_MAX;
-	wl_pkt_filter_enable_t	enable_parm;
 	char iovbuf[32];
 	int bcn_li_dtim = 3;
 #ifdef CUSTOMER_HW2
 	uint roamvar = 1;
 #endif /* CUSTOMER_HW2 */
 
-#define htod32(i) i
-
 	if (dhd && dhd->up) {
 		dhd_os_proto_block(dhd);
 		if (value) {
 			dhdcdc_set_ioctl(dhd, 0, WLC_SET_PM,
 				(char *)&power_mode, sizeof(power_mode));
-			/* Enable packet filter, only allow unicast packet to send up */
-			enable_parm.id = htod32(100);
-			enable_parm.enable = htod32(1);
-			bcm_mkiovar("pkt_filter_enable", (char *)&enable_parm,
-				sizeof(wl_pkt_filter_enable_t), iovbuf, sizeof(iovbuf));
-			dhdcdc_set_ioctl(dhd, 0, WLC_SET_VAR, iovbuf, sizeof(iovbuf));
+			dhd_pm_note(dhd, power_mode);
+			/* Enable packet filters, only allow unicast and joined
+			 * multicast packets to send up
+			 */
+			dhd_pktfilter_enable(dhd, DHD_PKT_FILTER_UCAST, 1);
+			if (dhd_pkt_filter_mcast)
+				dhd_pktfilter_enable(dhd, DHD_PKT_FILTER_MCAST, 1);
 			/* set bcn_li_dtim */
 			bcm_mkiovar("bcn_li_dtim", (char *)&bcn_li_dtim,
 				4, iovbuf, sizeof(iovbuf));
@@ -550,12 +574,10 @@ int dhd_set_suspend(int value, dhd_pub_t *dhd)
 			power_mode = PM_FAST;
 			dhdcdc_set_ioctl(dhd, 0, WLC_SET_PM, (char *)&power_mode,
 				sizeof(power_mode));
-			/* disable pkt filter */
-			enable_parm.id = htod32(100);
-			enable_parm.enable = htod32(0);
-			bcm_mkiovar("pkt_filter_enable", (char *)&enable_parm,
-				sizeof(wl_pkt_filter_enable_t), iovbuf, sizeof(iovbuf));
-			dhdcdc_set_ioctl(dhd, 0, WLC_SET_VAR, iovbuf, sizeof(iovbuf));
+			dhd_pm_note(dhd, power_mode);
+			/* disable pkt filters */
+			dhd_pktfilter_enable(dhd, DHD_PKT_FILTER_UCAST, 0);
+			dhd_pktfilter_enable(dhd, DHD_PKT_FILTER_MCAST, 0);
 			/* set bcn_li_dtim */
 			bcn_li_dtim = 0;
 			bcm_mkiovar("bcn_li_dtim", (char *)&bcn_li_dtim,
@@ -567,12 +589,61 @@ int dhd_set_suspend(int value, dhd_pub_t *dhd)
 			dhdcdc_set_ioctl(dhd, 0, WLC_SET_VAR, iovbuf, sizeof(iovbuf));
 #endif /* CUSTOMER_HW2 */
 		}
+		dhd->in_suspend = value;
 		dhd_os_proto_unblock(dhd);
 	}
 
 	return 0;
 }
 
+/* PM_FAST/PM_MAX switch on traffic, left alone while suspended or when
+ * power save was turned off from above
+ */
+int dhd_set_pm(dhd_pub_t *dhd, int power_mode)
+{
+	int ret = 0;
+
+	dhd_os_proto_block(dhd);
+	if (dhd->up && !dhd->in_suspend && !dhd->pm_user_off &&
+	    dhd->pm_mode != power_mode) {
+		ret = dhdcdc_set_ioctl(dhd, 0, WLC_SET_PM, (char *)&power_mode,
+			sizeof(power_mode));
+		if (ret >= 0) {
+			dhd_pm_note(dhd, power_mode);
+			dhd->pm_switches++;
+			ret = 0;
+		}
+	}
+	dhd_os_proto_unblock(dhd);
+
+	return ret;
+}
+
+void
+dhd_arp_offload_add_ip(dhd_pub_t *dhd, uint32 ipaddr)
+{
+	char iovbuf[32];
+	int ret;
+
+	bcm_mkiovar("arp_hostip", (char *)&ipaddr, 4, iovbuf, sizeof(iovbuf));
+	dhd_os_proto_block(dhd);
+	ret = dhdcdc_set_ioctl(dhd, 0, WLC_SET_VAR, iovbuf, sizeof(iovbuf));
+	dhd_os_proto_unblock(dhd);
+	if (ret < 0)
+		DHD_ERROR(("%s: arp_hostip failed, error=%d\n", __FUNCTION__, ret));
+}
+
+void
+dhd_arp_offload_clear(dhd_pub_t *dhd)
+{
+	char iovbuf[32];
+
+	bcm_mkiovar("arp_hostip_clear", NULL, 0, iovbuf, sizeof(iovbuf));
+	dhd_os_proto_block(dhd);
+	dhdcdc_set_ioctl(dhd, 0, WLC_SET_VAR, iovbuf, sizeof(iovbuf));
+	dhd_os_proto_unblock(dhd);
+}
+
 #define strtoul(nptr, endptr, base) bcm_strtoul((nptr), (endptr), (base))
 
 /* Convert user's input in hex pattern to byte-size mask */
@@ -600,6 +671,68 @@ wl_pattern_atoh(char *src, char *dst)
 	return i;
 }
 
+/* Add a pattern packet filter matching at offset 0, mask and pattern given
+ * in hex.  Called with the proto lock held.
+ */
+static int
+dhd_pktfilter_add(dhd_pub_t *dhd, int id, int negate, char *mask, char *pattern)
+{
+	const char 		*str;
+	wl_pkt_filter_t		pkt_filter;
+	wl_pkt_filter_t		*pkt_filterp;
+	int			buf_len;
+	int			str_len;
+	uint32			mask_size;
+	uint32			pattern_size;
+	char buf[256];
+
+	str = "pkt_filter_add";
+	str_len = strlen(str);
+	strncpy(buf, str, str_len);
+	buf[ str_len ] = '\0';
+	buf_len = str_len + 1;
+
+	pkt_filterp = (wl_pkt_filter_t *) (buf + str_len + 1);
+
+	/* Parse packet filter id. */
+	pkt_filter.id = htod32(id);
+
+	/* Parse filter polarity. */
+	pkt_filter.negate_match = htod32(negate);
+
+	/* Parse filter type. */
+	pkt_filter.type = htod32(0);
+
+	/* Parse pattern filter offset. */
+	pkt_filter.u.pattern.offset = htod32(0);
+
+	/* Parse pattern filter mask. */
+	mask_size =	htod32(wl_pattern_atoh(mask,
+		(char *) pkt_filterp->u.pattern.mask_and_pattern));
+
+	/* Parse pattern filter pattern. */
+	pattern_size = htod32(wl_pattern_atoh(pattern,
+		(char *) &pkt_filterp->u.pattern.mask_and_pattern[mask_size]));
+
+	if (mask_size != pattern_size) {
+		DHD_ERROR(("Mask and pattern not the same size\n"));
+		return -EINVAL;
+	}
+
+	pkt_filter.u.pattern.size_bytes = mask_size;
+	buf_len += WL_PKT_FILTER_FIXED_LEN;
+	buf_len += (WL_PKT_FILTER_PATTERN_FIXED_LEN + 2 * mask_size);
+
+	/* Keep-alive attributes are set in local	variable (keep_alive_pkt), and
+	** then memcpy'ed into buffer (keep_alive_pktp) since there is no
+	** guarantee that the buffer is properly aligned.
+	*/
+	memcpy((char *)pkt_filterp, &pkt_filter,
+		WL_PKT_FILTER_FIXED_LEN + WL_PKT_FILTER_PATTERN_FIXED_LEN);
+
+	return dhdcdc_set_ioctl(dhd, 0, WLC_SET_VAR, buf, buf_len);
+}
+
 int
 dhd_preinit_ioctls(dhd_pub_t *dhd)
 {
@@ -621,17 +754,10 @@ dhd_preinit_ioctls(dhd_pub_t *dhd)
 	int arp_ol = 0xf;
 	int scan_assoc_time = 40;
 	int scan_unassoc_time = 80;
-	const char 				*str;
-	wl_pkt_filter_t		pkt_filter;
-	wl_pkt_filter_t		*pkt_filterp;
-	int						buf_len;
-	int						str_len;
-	uint32					mask_size;
-	uint32					pattern_size;
-	char buf[256];
 	uint filter_mode = 1;
 	char mac_buf[16];
 #ifdef SET_RANDOM_MAC_SOFTAP
+	char buf[256];
 	uint rand_mac;
 #endif
 	dhd_os_proto_block(dhd);
@@ -678,6 +804,8 @@ dhd_preinit_ioctls(dhd_pub_t *dhd)
 
 	/* Set PowerSave mode */
 	dhdcdc_set_ioctl(dhd, 0, WLC_SET_PM, (char *)&power_mode, sizeof(power_mode));
+	dhd->pm_user_off = FALSE;
+	dhd_pm_note(dhd, power_mode);
 
 	/* Match Host and Dongle rx alignment */
 	bcm_mkiovar("bus:txglomalign", (char *)&dongle_align, 4, iovbuf, sizeof(iovbuf));
@@ -737,58 +865,18 @@ dhd_preinit_ioctls(dhd_pub_t *dhd)
 	bcm_mkiovar("arp_ol", (char *)&arp_ol, 4, iovbuf, sizeof(iovbuf));
 	dhdcdc_set_ioctl(dhd, 0, WLC_SET_VAR, iovbuf, sizeof(iovbuf));
 
-	/* add a default packet filter pattern */
-	str = "pkt_filter_add";
-	str_len = strlen(str);
-	strncpy(buf, str, str_len);
-	buf[ str_len ] = '\0';
-	buf_len = str_len + 1;
-
-	pkt_filterp = (wl_pkt_filter_t *) (buf + str_len + 1);
-
-	/* Parse packet filter id. */
-	pkt_filter.id = htod32(100);
-
-	/* Parse filter polarity. */
-	pkt_filter.negate_match = htod32(0);
-
-	/* Parse filter type. */
-	pkt_filter.type = htod32(0);
-
-	/* Parse pattern filter offset. */
-	pkt_filter.u.pattern.offset = htod32(0);
-
-	/* Parse pattern filter mask. */
-	mask_size =	htod32(wl_pattern_atoh("0xffffffffffff",
-		(char *) pkt_filterp->u.pattern.mask_and_pattern));
-
-	/* Parse pattern filter pattern. */
-	sprintf( mac_buf, "0x%02x%02x%02x%02x%02x%02x",
+	/* add the suspend packet filter patterns */
+	sprintf(mac_buf, "0x%02x%02x%02x%02x%02x%02x",
 		dhd->mac.octet[0], dhd->mac.octet[1], dhd->mac.octet[2],
-		dhd->mac.octet[3], dhd->mac.octet[4], dhd->mac.octet[5]
-	);
-
-	pattern_size = htod32(wl_pattern_atoh(mac_buf,
-		(char *) &pkt_filterp->u.pattern.mask_and_pattern[mask_size]));
-
-	if (mask_size != pattern_size) {
-		DHD_ERROR(("Mask and pattern not the same size\n"));
+		dhd->mac.octet[3], dhd->mac.octet[4], dhd->mac.octet[5]);
+	ret = dhd_pktfilter_add(dhd, DHD_PKT_FILTER_UCAST, 0,
+		"0xffffffffffff", mac_buf);
+	if (ret < 0) {
 		dhd_os_proto_unblock(dhd);
-		return -EINVAL;
+		return ret;
 	}
-
-	pkt_filter.u.pattern.size_bytes = mask_size;
-	buf_len += WL_PKT_FILTER_FIXED_LEN;
-	buf_len += (WL_PKT_FILTER_PATTERN_FIXED_LEN + 2 * mask_size);
-
-	/* Keep-alive attributes are set in local	variable (keep_alive_pkt), and
-	** then memcpy'ed into buffer (keep_alive_pktp) since there is no
-	** guarantee that the buffer is properly aligned.
-	*/
-	memcpy((char *)pkt_filterp, &pkt_filter,
-		WL_PKT_FILTER_FIXED_LEN + WL_PKT_FILTER_PATTERN_FIXED_LEN);
-
-	dhdcdc_set_ioctl(dhd, 0, WLC_SET_VAR, buf, buf_len);
+	dhd_pktfilter_add(dhd, DHD_PKT_FILTER_MCAST, 1,
+		"0xffffffffffff", "0xffffffffffff");
 
 	/* set mode to allow pattern */
 	bcm_mkiovar("pkt_filter_mode", (char *)&filter_mode, 4, iovbuf, sizeof(iovbuf));
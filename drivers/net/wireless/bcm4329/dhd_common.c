@@ -154,6 +154,17 @@ dhd_dump(dhd_pub_t *dhdp, char *buf, int buflen)
 	bcm_bprintf(strbuf, "rx_readahead_cnt %ld tx_realloc %ld fc_packets %ld\n",
 	            dhdp->rx_readahead_cnt, dhdp->tx_realloc, dhdp->fc_packets);
 	bcm_bprintf(strbuf, "wd_dpc_sched %ld\n", dhdp->wd_dpc_sched);
+	bcm_bprintf(strbuf, "wake_ucast %ld wake_mcast %ld wake_bcast %ld wake_arp %ld "
+	            "wake_event %ld\n", dhdp->wake_ucast, dhdp->wake_mcast,
+	            dhdp->wake_bcast, dhdp->wake_arp, dhdp->wake_event);
+	dhd_pm_note(dhdp, dhdp->pm_mode);
+	bcm_bprintf(strbuf, "pm_mode %d pm_off_ms %ld pm_max_ms %ld pm_fast_ms %ld "
+	            "pm_switches %ld pm_max_pkts %ld\n", dhdp->pm_mode, dhdp->pm_off_ms,
+	            dhdp->pm_max_ms, dhdp->pm_fast_ms, dhdp->pm_switches, dhdp->pm_max_pkts);
+	bcm_bprintf(strbuf, "pm_lat_cnt %ld pm_lat_ms %ld pm_lat_avg_ms %ld pm_lat_max_ms %ld\n",
+	            dhdp->pm_lat_cnt, dhdp->pm_lat_ms,
+	            dhdp->pm_lat_cnt ? dhdp->pm_lat_ms / dhdp->pm_lat_cnt : 0,
+	            dhdp->pm_lat_max_ms);
 	bcm_bprintf(strbuf, "\n");
 
 	/* Add any prot info */
@@ -233,6 +244,8 @@ dhd_doiovar(dhd_pub_t *dhd_pub, const bcm_iovar_t *vi, uint32 actionid, const ch
 		dhd_pub->rx_readahead_cnt = 0;
 		dhd_pub->tx_realloc = 0;
 		dhd_pub->wd_dpc_sched = 0;
+		dhd_pub->wake_ucast = dhd_pub->wake_mcast = dhd_pub->wake_bcast = 0;
+		dhd_pub->wake_arp = dhd_pub->wake_event = 0;
 		memset(&dhd_pub->dstats, 0, sizeof(dhd_pub->dstats));
 		dhd_bus_clearcounts(dhd_pub);
 		break;
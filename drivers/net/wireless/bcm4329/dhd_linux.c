@@ -41,8 +41,13 @@
 #include <linux/random.h>
 #include <linux/spinlock.h>
 #include <linux/ethtool.h>
+#include <linux/inetdevice.h>
+#include <linux/ip.h>
+#include <net/checksum.h>
 #include <linux/fcntl.h>
 #include <linux/fs.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
 
 #include <asm/uaccess.h>
 #include <asm/unaligned.h>
@@ -62,6 +67,9 @@
 #include <linux/wakelock.h>
 #endif
 #include <linux/freezer.h>
+#ifdef CONFIG_HTC_PWRSINK
+#include <mach/htc_pwrsink.h>
+#endif
 #if defined(CUSTOMER_HW2) && defined(CONFIG_WIFI_CONTROL_FUNC)
 #include <linux/wlan_plat.h>
 
@@ -184,6 +192,8 @@ void wifi_del_dev(void)
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 27)) && defined(CONFIG_PM_SLEEP)
 #include <linux/suspend.h>
 volatile bool dhd_mmc_suspend = FALSE;
+/* Resumed, the next rx frame is counted as the wakeup cause */
+static bool dhd_wake_pending = FALSE;
 DECLARE_WAIT_QUEUE_HEAD(dhd_dpc_wait);
 #endif /* (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 27)) && defined(CONFIG_PM_SLEEP) */
 
@@ -242,6 +252,9 @@ typedef struct dhd_info {
 	struct timer_list timer;
 	bool wd_timer_valid;
 	struct tasklet_struct tasklet;
+#ifdef DHD_GRO
+	struct napi_struct napi;	/* Only carries the GRO list, never polled */
+#endif
 	spinlock_t	sdlock;
 	spinlock_t	txqlock;
 	/* Thread based operation */
@@ -270,6 +283,11 @@ typedef struct dhd_info {
 	bool set_multicast;
 	bool set_macaddress;
 	struct ether_addr macvalue;
+	int pm_request;		/* PM mode for the sysioc thread, 0 for none */
+	ulong pm_sample_time;	/* Traffic monitor, sampled from the watchdog */
+	ulong pm_sample_pkts;
+	ulong pm_busy_time;	/* Last sample at or over dhd_pm_max_pps */
+	ulong pm_burst_time;	/* Traffic started while in PM_MAX */
 	wait_queue_head_t ctrl_wait;
 	atomic_t pend_8021x_cnt;
 
@@ -291,6 +309,11 @@ struct semaphore dhd_registration_sem;
 module_param_string(firmware_path, firmware_path, MOD_PARAM_PATHLEN, 0);
 module_param_string(nvram_path, nvram_path, MOD_PARAM_PATHLEN, 0);
 
+/* Keep firmware and nvram images in memory between downloads */
+uint dhd_image_cache = 1;
+module_param(dhd_image_cache, uint, 0644);
+static void dhd_image_cache_flush(void);
+
 /* Error bits */
 module_param(dhd_msg_level, int, 0);
 
@@ -298,10 +321,32 @@ module_param(dhd_msg_level, int, 0);
 uint dhd_sysioc = TRUE;
 module_param(dhd_sysioc, uint, 0);
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 29))
+#define DHD_GRO
+/* Merge received TCP segments before they go up the stack */
+uint dhd_gro = TRUE;
+module_param(dhd_gro, uint, 0644);
+#endif
+
 /* Watchdog interval */
 uint dhd_watchdog_ms = 10;
 module_param(dhd_watchdog_ms, uint, 0);
 
+/* Switch between PM_MAX and PM_FAST on the packet rate while the screen
+ * is on: PM_FAST once a sample reaches dhd_pm_fast_pps, back to PM_MAX
+ * after dhd_pm_hold_ms below dhd_pm_max_pps
+ */
+uint dhd_pm_adaptive = TRUE;
+module_param(dhd_pm_adaptive, uint, 0644);
+uint dhd_pm_sample_ms = 100;
+module_param(dhd_pm_sample_ms, uint, 0644);
+uint dhd_pm_fast_pps = 20;
+module_param(dhd_pm_fast_pps, uint, 0644);
+uint dhd_pm_max_pps = 5;
+module_param(dhd_pm_max_pps, uint, 0644);
+uint dhd_pm_hold_ms = 2000;
+module_param(dhd_pm_hold_ms, uint, 0644);
+
 
 /* Watchdog thread priority, -1 to use kernel timer */
 int dhd_watchdog_prio = 97;
@@ -365,6 +410,18 @@ extern uint dhd_rxbound;
 module_param(dhd_txbound, uint, 0);
 module_param(dhd_rxbound, uint, 0);
 
+/* Tx superframes */
+extern uint dhd_txglom;
+module_param(dhd_txglom, uint, 0);
+
+/* Multicast allowed through the suspend packet filters */
+extern uint dhd_pkt_filter_mcast;
+module_param(dhd_pkt_filter_mcast, uint, 0);
+
+/* Rx polling threshold */
+extern uint dhd_rxpoll;
+module_param(dhd_rxpoll, uint, 0);
+
 /* Deferred transmits */
 extern uint dhd_deferred_tx;
 module_param(dhd_deferred_tx, uint, 0);
@@ -429,6 +486,7 @@ static int dhd_sleep_pm_callback(struct notifier_block *nfb, unsigned long actio
 		case PM_POST_HIBERNATION:
 		case PM_POST_SUSPEND:
 			dhd_mmc_suspend = FALSE;
+			dhd_wake_pending = TRUE;
 		return NOTIFY_OK;
 	}
 	return 0;
@@ -467,6 +525,42 @@ static void dhd_late_resume(struct early_suspend *h)
 }
 #endif /* defined(CONFIG_HAS_EARLYSUSPEND) */
 
+#if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 31))
+static struct net_device_ops dhd_ops_pri;
+
+/* Keep the dongle's ARP offload host address in sync with the interface */
+static int dhd_inetaddr_notifier_call(struct notifier_block *this,
+                                      unsigned long event, void *ptr)
+{
+	struct in_ifaddr *ifa = (struct in_ifaddr *)ptr;
+	struct net_device *net = ifa->ifa_dev->dev;
+	dhd_info_t *dhd;
+
+	if (net->netdev_ops != &dhd_ops_pri)
+		return NOTIFY_DONE;
+
+	dhd = *(dhd_info_t **)netdev_priv(net);
+	if (!dhd || !dhd->pub.up)
+		return NOTIFY_DONE;
+
+	switch (event) {
+	case NETDEV_UP:
+		DHD_TRACE(("%s: ARP offload host IP %08x\n", __FUNCTION__,
+		           ntoh32(ifa->ifa_address)));
+		dhd_arp_offload_add_ip(&dhd->pub, ifa->ifa_address);
+		break;
+	case NETDEV_DOWN:
+		dhd_arp_offload_clear(&dhd->pub);
+		break;
+	}
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block dhd_inetaddr_notifier = {
+	.notifier_call = dhd_inetaddr_notifier_call
+};
+#endif /* LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 31) */
+
 /*
  * Generalized timeout mechanism.  Uses spin sleep with exponential back-off until
  * the sleep time reaches one jiffy, then switches over to task delay.  Usage:
@@ -854,6 +948,13 @@ _dhd_sysioc_thread(void *data)
 				}
 			}
 		}
+		if (dhd->pm_request) {
+			int mode = dhd->pm_request;
+
+			dhd->pm_request = 0;
+			if (dhd_set_pm(&dhd->pub, mode) < 0)
+				DHD_ERROR(("%s: failed to set PM %d\n", __FUNCTION__, mode));
+		}
 		dhd_os_wake_unlock(&dhd->pub);
 	}
 	complete_and_exit(&dhd->sysioc_exited, 0);
@@ -1015,6 +1116,61 @@ dhd_txflowcontrol(dhd_pub_t *dhdp, int ifidx, bool state)
 		netif_wake_queue(net);
 }
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 27)) && defined(CONFIG_PM_SLEEP)
+static void
+dhd_count_wake(dhd_pub_t *dhdp, struct sk_buff *skb)
+{
+	if (ntoh16(skb->protocol) == ETHER_TYPE_BRCM)
+		dhdp->wake_event++;
+	else if (ntoh16(skb->protocol) == ETHER_TYPE_ARP)
+		dhdp->wake_arp++;
+	else if (skb->pkt_type == PACKET_BROADCAST)
+		dhdp->wake_bcast++;
+	else if (skb->pkt_type == PACKET_MULTICAST)
+		dhdp->wake_mcast++;
+	else
+		dhdp->wake_ucast++;
+}
+#endif
+
+#ifdef DHD_GRO
+/* GRO only merges TCP segments with a checked checksum, and the dongle
+ * doesn't check it for us. Summing here lets the stack skip it later.
+ */
+static bool
+dhd_rx_csum(struct sk_buff *skb)
+{
+	struct iphdr *iph = (struct iphdr *)skb->data;
+
+	if (skb->len < sizeof(struct iphdr) || iph->protocol != IPPROTO_TCP ||
+	    (iph->frag_off & htons(IP_MF | IP_OFFSET)))
+		return FALSE;
+
+	skb->csum = csum_partial(skb->data, skb->len, 0);
+	skb->ip_summed = CHECKSUM_COMPLETE;
+	return TRUE;
+}
+
+static int
+dhd_napi_poll(struct napi_struct *napi, int budget)
+{
+	return 0;
+}
+
+static void
+dhd_gro_flush(dhd_info_t *dhd)
+{
+	if (!dhd->napi.gro_list)
+		return;
+
+	local_bh_disable();
+	napi_gro_flush(&dhd->napi);
+	local_bh_enable();
+}
+#else
+#define dhd_gro_flush(dhd)	do { } while (0)
+#endif /* DHD_GRO */
+
 void
 dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt)
 {
@@ -1063,6 +1219,15 @@ dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt)
 			dhd->pub.rx_multicast++;
 		}
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 27)) && defined(CONFIG_PM_SLEEP)
+		/* First frame after resuming with the screen off woke us up */
+		if (dhd_wake_pending) {
+			dhd_wake_pending = FALSE;
+			if (dhdp->in_suspend)
+				dhd_count_wake(dhdp, skb);
+		}
+#endif
+
 		skb->data = eth;
 		skb->len = len;
 
@@ -1090,6 +1255,20 @@ dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt)
 		dhdp->dstats.rx_bytes += skb->len;
 		dhdp->rx_packets++; /* Local count */
 
+#ifdef DHD_GRO
+		if (dhd_gro && ntoh16(skb->protocol) == ETHER_TYPE_IP && dhd_rx_csum(skb)) {
+			/* Held until dhd_gro_flush() at the end of the dpc pass */
+			if (in_interrupt()) {
+				napi_gro_receive(&dhd->napi, skb);
+			} else {
+				local_bh_disable();
+				napi_gro_receive(&dhd->napi, skb);
+				local_bh_enable();
+			}
+			continue;
+		}
+#endif /* DHD_GRO */
+
 		if (in_interrupt()) {
 			netif_rx(skb);
 		} else {
@@ -1173,6 +1352,93 @@ dhd_get_stats(struct net_device *net)
 	return &ifp->stats;
 }
 
+/* Account the time spent in the current mode and move to the new one */
+void
+dhd_pm_note(dhd_pub_t *dhdp, int mode)
+{
+	dhd_info_t *dhd = dhdp->info;
+	ulong now = jiffies;
+	ulong ms = jiffies_to_msecs(now - dhdp->pm_stamp);
+
+	if (dhdp->pm_stamp) {
+		if (dhdp->pm_mode == PM_FAST)
+			dhdp->pm_fast_ms += ms;
+		else if (dhdp->pm_mode == PM_MAX)
+			dhdp->pm_max_ms += ms;
+		else
+			dhdp->pm_off_ms += ms;
+	}
+	dhdp->pm_stamp = now;
+
+	if (mode == dhdp->pm_mode)
+		return;
+
+	/* Going up on a burst costs the packets that sat in the AP's
+	 * power save queue from the start of the burst until now
+	 */
+	if (mode == PM_FAST && dhd->pm_burst_time) {
+		ms = jiffies_to_msecs(now - dhd->pm_burst_time);
+		dhdp->pm_lat_cnt++;
+		dhdp->pm_lat_ms += ms;
+		if (ms > dhdp->pm_lat_max_ms)
+			dhdp->pm_lat_max_ms = ms;
+	}
+	dhd->pm_burst_time = 0;
+	dhd->pm_busy_time = now;
+	dhdp->pm_mode = mode;
+#ifdef CONFIG_HTC_PWRSINK
+	/* rough share of the awake radio's current in each mode */
+	htc_pwrsink_set(PWRSINK_WIFI,
+		mode == PM_MAX ? 5 : mode == PM_FAST ? 30 : 100);
+#endif
+}
+
+/* Called on every watchdog tick, from the timer or the watchdog thread */
+static void
+dhd_pm_watchdog(dhd_info_t *dhd)
+{
+	dhd_pub_t *dhdp = &dhd->pub;
+	ulong now = jiffies;
+	ulong pkts, ms, pps;
+
+	if (!dhd_pm_adaptive || dhd->sysioc_pid < 0 || !dhdp->up ||
+	    dhdp->busstate != DHD_BUS_DATA || dhdp->in_suspend ||
+	    dhdp->pm_user_off || dhd->pm_request)
+		return;
+
+	ms = jiffies_to_msecs(now - dhd->pm_sample_time);
+	if (!ms || ms < dhd_pm_sample_ms)
+		return;
+	pkts = dhdp->tx_packets + dhdp->rx_packets;
+	if (ms > dhd_pm_sample_ms * 4) {
+		/* First sample, or the monitor was off: start over */
+		dhd->pm_sample_time = now;
+		dhd->pm_sample_pkts = pkts;
+		return;
+	}
+	pps = (pkts - dhd->pm_sample_pkts) * 1000 / ms;
+
+	if (dhdp->pm_mode == PM_MAX) {
+		dhdp->pm_max_pkts += pkts - dhd->pm_sample_pkts;
+		if (pkts == dhd->pm_sample_pkts)
+			dhd->pm_burst_time = 0;
+		else if (!dhd->pm_burst_time)
+			dhd->pm_burst_time = dhd->pm_sample_time;
+		if (pps >= dhd_pm_fast_pps)
+			dhd->pm_request = PM_FAST;
+	} else if (dhdp->pm_mode == PM_FAST) {
+		if (pps >= dhd_pm_max_pps)
+			dhd->pm_busy_time = now;
+		else if (jiffies_to_msecs(now - dhd->pm_busy_time) >= dhd_pm_hold_ms)
+			dhd->pm_request = PM_MAX;
+	}
+	dhd->pm_sample_time = now;
+	dhd->pm_sample_pkts = pkts;
+
+	if (dhd->pm_request)
+		up(&dhd->sysioc_sem);
+}
+
 static int
 dhd_watchdog_thread(void *data)
 {
@@ -1204,6 +1470,8 @@ dhd_watchdog_thread(void *data)
 			/* Count the tick for reference */
 			dhd->pub.tickcnt++;
 
+			dhd_pm_watchdog(dhd);
+
 			/* Reschedule the watchdog */
 			if (dhd->wd_timer_valid) {
 				mod_timer(&dhd->timer, jiffies + dhd_watchdog_ms * HZ / 1000);
@@ -1233,6 +1501,8 @@ dhd_watchdog(ulong data)
 	/* Count the tick for reference */
 	dhd->pub.tickcnt++;
 
+	dhd_pm_watchdog(dhd);
+
 	/* Reschedule the watchdog */
 #if defined(CONTINUOUS_WATCHDOG)
 	mod_timer(&dhd->timer, jiffies + dhd_watchdog_ms * HZ / 1000);
@@ -1268,7 +1538,10 @@ dhd_dpc_thread(void *data)
 		if (down_interruptible(&dhd->dpc_sem) == 0) {
 			/* Call bus dpc unless it indicated down (then clean stop) */
 			if (dhd->pub.busstate != DHD_BUS_DOWN) {
-				if (dhd_bus_dpc(dhd->pub.bus)) {
+				bool resched = dhd_bus_dpc(dhd->pub.bus);
+
+				dhd_gro_flush(dhd);
+				if (resched) {
 					up(&dhd->dpc_sem);
 				}
 				else {
@@ -1295,7 +1568,10 @@ dhd_dpc(ulong data)
 
 	/* Call bus dpc unless it indicated down (then clean stop) */
 	if (dhd->pub.busstate != DHD_BUS_DOWN) {
-		if (dhd_bus_dpc(dhd->pub.bus))
+		bool resched = dhd_bus_dpc(dhd->pub.bus);
+
+		dhd_gro_flush(dhd);
+		if (resched)
 			tasklet_schedule(&dhd->tasklet);
 	} else {
 		dhd_bus_stop(dhd->pub.bus, TRUE);
@@ -1627,6 +1903,14 @@ dhd_ioctl_entry(struct net_device *net, struct ifreq *ifr, int cmd)
 
 	bcmerror = dhd_prot_ioctl(&dhd->pub, ifidx, (wl_ioctl_t *)&ioc, buf, buflen);
 
+	/* A mode set from above (PM_OFF for DHCP) holds off the traffic
+	 * monitor until power save is turned back on
+	 */
+	if (!bcmerror && ioc.cmd == WLC_SET_PM && ioc.set && buf && buflen >= sizeof(int)) {
+		dhd->pub.pm_user_off = (*(int *)buf == PM_OFF);
+		dhd_pm_note(&dhd->pub, *(int *)buf);
+	}
+
 done:
 	if (!bcmerror && buf && ioc.buf) {
 		if (copy_to_user(ioc.buf, buf, buflen))
@@ -1654,6 +1938,9 @@ dhd_stop(struct net_device *net)
 	/* Set state and stop OS transmissions */
 	dhd->pub.up = 0;
 	netif_stop_queue(net);
+#ifdef CONFIG_HTC_PWRSINK
+	htc_pwrsink_set(PWRSINK_WIFI, 0);
+#endif
 #else
 	DHD_ERROR(("BYPASS %s:due to BRCM compilation : under investigation ...\n", __FUNCTION__));
 #endif /* !defined(IGNORE_ETH0_DOWN) */
@@ -1888,6 +2175,10 @@ dhd_attach(osl_t *osh, struct dhd_bus *bus, uint bus_hdrlen)
 		dhd->watchdog_pid = -1;
 	}
 
+#ifdef DHD_GRO
+	netif_napi_add(net, &dhd->napi, dhd_napi_poll, 64);
+#endif
+
 	/* Set up the bottom half handler */
 	if (dhd_dpc_prio >= 0) {
 		/* Initialize DPC thread */
@@ -1925,6 +2216,9 @@ dhd_attach(osl_t *osh, struct dhd_bus *bus, uint bus_hdrlen)
 	dhd->early_suspend.resume = dhd_late_resume;
 	register_early_suspend(&dhd->early_suspend);
 #endif
+#if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 31))
+	register_inetaddr_notifier(&dhd_inetaddr_notifier);
+#endif
 
 	return &dhd->pub;
 
@@ -2086,6 +2380,9 @@ dhd_net_attach(dhd_pub_t *dhdp, int ifidx)
 		temp_addr[0] |= 0x02;  /* set bit 2 , - Locally Administered address  */
 	}
 	net->hard_header_len = ETH_HLEN + dhd->pub.hdrlen;
+#ifdef DHD_GRO
+	net->features |= NETIF_F_GRO;
+#endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 24)
 	net->ethtool_ops = &dhd_ethtool_ops;
 #endif /* LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 24) */
@@ -2175,6 +2472,9 @@ dhd_detach(dhd_pub_t *dhdp)
 #if defined(CONFIG_HAS_EARLYSUSPEND)
 			unregister_early_suspend(&dhd->early_suspend);
 #endif	/* defined(CONFIG_HAS_EARLYSUSPEND) */
+#if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 31))
+			unregister_inetaddr_notifier(&dhd_inetaddr_notifier);
+#endif
 #if defined(CONFIG_WIRELESS_EXT)
 			/* Attach and link in the iw */
 			wl_iw_detach();
@@ -2326,6 +2626,8 @@ dhd_module_cleanup(void)
 #endif
 	/* Call customer gpio to turn off power with WL_REG_ON signal */
 	dhd_customer_gpio_wlan_ctrl(WLAN_POWER_OFF);
+
+	dhd_image_cache_flush();
 }
 
 
@@ -2441,9 +2743,112 @@ dhd_os_wd_timer(void *bus, uint wdtick)
 	}
 }
 
+/*
+ * Firmware and nvram images are read once and kept in memory, keyed by
+ * path, so turning wifi back on or switching to the softap firmware
+ * doesn't go through the filesystem again. An entry is thrown away when
+ * the file's size or mtime no longer match.
+ */
+#define DHD_IMAGE_CACHE_NUM	3		/* sta and ap firmware, nvram */
+#define DHD_IMAGE_CACHE_MAX	(512 * 1024)	/* larger files are not cached */
+
+typedef struct dhd_cached_image {
+	char path[MOD_PARAM_PATHLEN];
+	struct timespec mtime;
+	loff_t size;
+	char *data;
+	unsigned long used;		/* jiffies, for replacement */
+} dhd_cached_image_t;
+
+typedef struct dhd_image {
+	struct file *fp;
+	dhd_cached_image_t *cached;	/* dhd_image_cache_lock held if set */
+	loff_t pos;
+} dhd_image_t;
+
+static dhd_cached_image_t dhd_image_cache_tbl[DHD_IMAGE_CACHE_NUM];
+static DEFINE_MUTEX(dhd_image_cache_lock);
+
+static void
+dhd_image_cache_drop(dhd_cached_image_t *ci)
+{
+	if (ci->data) {
+		vfree(ci->data);
+		ci->data = NULL;
+	}
+}
+
+static void
+dhd_image_cache_flush(void)
+{
+	int i;
+
+	mutex_lock(&dhd_image_cache_lock);
+	for (i = 0; i < DHD_IMAGE_CACHE_NUM; i++)
+		dhd_image_cache_drop(&dhd_image_cache_tbl[i]);
+	mutex_unlock(&dhd_image_cache_lock);
+}
+
+/* Called with dhd_image_cache_lock held */
+static dhd_cached_image_t *
+dhd_image_cache_get(char *filename, struct file *fp)
+{
+	struct inode *inode = fp->f_path.dentry->d_inode;
+	loff_t size = i_size_read(inode);
+	dhd_cached_image_t *ci, *victim = NULL;
+	loff_t pos = 0;
+	char *data;
+	int i, rdlen;
+
+	for (i = 0; i < DHD_IMAGE_CACHE_NUM; i++) {
+		ci = &dhd_image_cache_tbl[i];
+		if (ci->data && !strcmp(ci->path, filename)) {
+			if (ci->size == size &&
+			    timespec_equal(&ci->mtime, &inode->i_mtime)) {
+				ci->used = jiffies;
+				return ci;
+			}
+			/* the file was replaced, read it again */
+			dhd_image_cache_drop(ci);
+			victim = ci;
+			break;
+		}
+		/* prefer a free slot, then the least recently used one */
+		if (!victim || (victim->data &&
+		    (!ci->data || time_before(ci->used, victim->used))))
+			victim = ci;
+	}
+
+	if (size <= 0 || size > DHD_IMAGE_CACHE_MAX)
+		return NULL;
+
+	data = vmalloc(size);
+	if (!data)
+		return NULL;
+	while (pos < size) {
+		rdlen = kernel_read(fp, pos, data + pos, size - pos);
+		if (rdlen <= 0) {
+			vfree(data);
+			return NULL;
+		}
+		pos += rdlen;
+	}
+
+	dhd_image_cache_drop(victim);
+	strncpy(victim->path, filename, MOD_PARAM_PATHLEN - 1);
+	victim->path[MOD_PARAM_PATHLEN - 1] = '\0';
+	victim->mtime = inode->i_mtime;
+	victim->size = size;
+	victim->data = data;
+	victim->used = jiffies;
+	DHD_INFO(("%s: cached %s, %d bytes\n", __FUNCTION__, filename, (int)size));
+	return victim;
+}
+
 void *
 dhd_os_open_image(char *filename)
 {
+	dhd_image_t *image;
 	struct file *fp;
 
 	fp = filp_open(filename, O_RDONLY, 0);
@@ -2453,24 +2858,49 @@ dhd_os_open_image(char *filename)
 	 * fp = open_namei(AT_FDCWD, filename, O_RD, 0);
 	 * ???
 	 */
-	 if (IS_ERR(fp))
-		 fp = NULL;
+	if (IS_ERR(fp))
+		return NULL;
 
-	 return fp;
+	image = kzalloc(sizeof(*image), GFP_KERNEL);
+	if (!image) {
+		filp_close(fp, NULL);
+		return NULL;
+	}
+	image->fp = fp;
+
+	if (!dhd_image_cache) {
+		dhd_image_cache_flush();
+		return image;
+	}
+
+	/* the stat is cheap, the data only comes from the file when it changed */
+	mutex_lock(&dhd_image_cache_lock);
+	image->cached = dhd_image_cache_get(filename, fp);
+	if (!image->cached)
+		mutex_unlock(&dhd_image_cache_lock);
+
+	return image;
 }
 
 int
 dhd_os_get_image_block(char *buf, int len, void *image)
 {
-	struct file *fp = (struct file *)image;
+	dhd_image_t *img = (dhd_image_t *)image;
+	dhd_cached_image_t *ci;
 	int rdlen;
 
 	if (!image)
 		return 0;
 
-	rdlen = kernel_read(fp, fp->f_pos, buf, len);
+	ci = img->cached;
+	if (ci) {
+		rdlen = (int)MIN((loff_t)len, ci->size - img->pos);
+		memcpy(buf, ci->data + img->pos, rdlen);
+	} else {
+		rdlen = kernel_read(img->fp, img->pos, buf, len);
+	}
 	if (rdlen > 0)
-		fp->f_pos += rdlen;
+		img->pos += rdlen;
 
 	return rdlen;
 }
@@ -2478,8 +2908,15 @@ dhd_os_get_image_block(char *buf, int len, void *image)
 void
 dhd_os_close_image(void *image)
 {
-	if (image)
-		filp_close((struct file *)image, NULL);
+	dhd_image_t *img = (dhd_image_t *)image;
+
+	if (!image)
+		return;
+
+	if (img->cached)
+		mutex_unlock(&dhd_image_cache_lock);
+	filp_close(img->fp, NULL);
+	kfree(img);
 }
 
 
@@ -82,6 +82,10 @@ extern int dhd_ioctl(dhd_pub_t * dhd_pub, dhd_ioctl_t *ioc, void * buf, uint buf
 
 extern int dhd_preinit_ioctls(dhd_pub_t *dhd);
 
+/* Set or clear the host IP address the dongle answers ARP for */
+extern void dhd_arp_offload_add_ip(dhd_pub_t *dhd, uint32 ipaddr);
+extern void dhd_arp_offload_clear(dhd_pub_t *dhd);
+
 /********************************
  * For version-string expansion *
  */
@@ -78,9 +78,19 @@
 
 #define DHD_TXMINMAX	1	/* Max tx frames if rx still pending */
 
+#define DHD_RXBUDGET_MIN	8	/* Smallest adaptive rx budget per DPC pass */
+#define DHD_RXPOLL	8	/* Rx frames in one pass that switch to polling */
+#define DHD_POLLIDLE	2	/* Empty polling passes before using interrupts again */
+
 #define MEMBLOCK	2048		/* Block size used for downloading of dongle image */
+#define DLBLOCK		16384		/* Preferred block size for the code image */
+#define DLPAD		64		/* Image writes are padded to whole SDIO blocks */
 #define MAX_DATA_BUF	(32 * 1024)	/* Must be large enough to hold biggest possible glom */
 
+#define DHD_TXGLOM_MAX		16	/* Max frames in a tx superframe */
+#define DHD_TXGLOM_MAXLEN	(8 * 1024)	/* Bounds bus time per superframe */
+#define DHD_TXGLOM_BUFLEN	(DHD_TXGLOM_MAXLEN + 512)	/* Room for block roundup */
+
 /* Packet alignment for most efficient SDIO (can change based on platform) */
 #ifndef DHD_SDALIGN
 #define DHD_SDALIGN	32
@@ -187,6 +197,7 @@ typedef struct dhd_bus {
 
 	void		*glomd;			/* Packet containing glomming descriptor */
 	void		*glom;			/* Packet chain for glommed superframe */
+	bool		glomshared;		/* Chain is clones of one buffer */
 	uint		glomerr;		/* Glom packet read errors */
 
 	uint8		*rxbuf;			/* Buffer for receiving control packets */
@@ -194,6 +205,8 @@ typedef struct dhd_bus {
 	uint8		*rxctl;			/* Aligned pointer into rxbuf */
 	uint8		*databuf;		/* Buffer for receiving big glom packet */
 	uint8		*dataptr;		/* Aligned pointer into databuf */
+	uint8		*txglombuf;		/* Buffer for building tx superframes */
+	uint8		*txglomptr;		/* Aligned pointer into txglombuf */
 	uint		rxlen;			/* Length of valid data in buffer */
 
 	uint8		sdpcm_ver;		/* Bus protocol reported by dongle */
@@ -202,6 +215,9 @@ typedef struct dhd_bus {
 	bool		poll;			/* Use polling */
 	bool		ipend;			/* Device interrupt is pending */
 	bool		intdis;			/* Interrupts disabled by isr */
+	bool		polling;		/* Busy: DPC polls, interrupts stay off */
+	uint		pollidle;		/* Empty passes while polling */
+	uint		rxbudget;		/* Adaptive rx frames per DPC pass */
 	uint 		intrcount;		/* Count of device interrupt callbacks */
 	uint		lastintrs;		/* Count as of last watchdog timer */
 	uint		spurious;		/* Count of spurious interrupts */
@@ -268,10 +284,16 @@ typedef struct dhd_bus {
 	uint		rxglomfail;		/* Failed deglom attempts */
 	uint		rxglomframes;		/* Number of glom frames (superframes) */
 	uint		rxglompkts;		/* Number of packets from glom frames */
+	uint		txglomframes;		/* Number of tx superframes */
+	uint		txglompkts;		/* Number of packets sent in superframes */
 	uint		f2rxhdrs;		/* Number of header reads */
 	uint		f2rxdata;		/* Number of frame data reads */
 	uint		f2txdata;		/* Number of f2 frame writes */
 	uint		f1regdata;		/* Number of f1 register accesses */
+	uint		dpcpasses;		/* Number of DPC passes */
+	uint		pollpasses;		/* DPC passes made while polling */
+	uint		pollenters;		/* Switches from interrupts to polling */
+	uint		rxbudgethits;		/* Passes that used the whole rx budget */
 
 	uint8		*ctrl_frame_buf;
 	uint32		ctrl_frame_len;
@@ -302,6 +324,14 @@ uint dhd_txbound;
 uint dhd_rxbound;
 uint dhd_txminmax;
 
+/* Max frames per tx superframe, 0 or 1 sends them one at a time.  Needs
+ * firmware that takes superframes from the host, so it's off by default.
+ */
+uint dhd_txglom;
+
+/* Rx frames in one DPC pass that switch to polling, 0 never polls */
+uint dhd_rxpoll = DHD_RXPOLL;
+
 /* override the RAM size if possible */
 #define DONGLE_MIN_MEMSIZE (128 *1024)
 int dhd_dongle_memsize;
@@ -860,6 +890,34 @@ dhd_enable_oob_intr(struct dhd_bus *bus, bool enable)
 	} while (0);
 
 
+/* On a failed data write, abort the command and terminate the frame */
+static void
+dhdsdio_txterm(dhd_bus_t *bus, int ret)
+{
+	bcmsdh_info_t *sdh = bus->sdh;
+	int i;
+
+	DHD_INFO(("%s: sdio error %d, abort command and terminate frame.\n",
+	          __FUNCTION__, ret));
+	bus->tx_sderrs++;
+
+	bcmsdh_abort(sdh, SDIO_FUNC_2);
+	bcmsdh_cfg_write(sdh, SDIO_FUNC_1, SBSDIO_FUNC1_FRAMECTRL,
+	                 SFC_WF_TERM, NULL);
+	bus->f1regdata++;
+
+	for (i = 0; i < 3; i++) {
+		uint8 hi, lo;
+		hi = bcmsdh_cfg_read(sdh, SDIO_FUNC_1,
+		                     SBSDIO_FUNC1_WFRAMEBCHI, NULL);
+		lo = bcmsdh_cfg_read(sdh, SDIO_FUNC_1,
+		                     SBSDIO_FUNC1_WFRAMEBCLO, NULL);
+		bus->f1regdata += 2;
+		if ((hi == 0) && (lo == 0))
+			break;
+	}
+}
+
 /* Writes a HW/SW header into the packet and sends it. */
 /* Assumes: (a) header space already there, (b) caller holds lock */
 static int
@@ -873,7 +931,6 @@ dhdsdio_txpkt(dhd_bus_t *bus, void *pkt, uint chan, bool free_pkt)
 	uint retries = 0;
 	bcmsdh_info_t *sdh;
 	void *new;
-	int i;
 
 	DHD_TRACE(("%s: Enter\n", __FUNCTION__));
 
@@ -974,29 +1031,8 @@ dhdsdio_txpkt(dhd_bus_t *bus, void *pkt, uint chan, bool free_pkt)
 		bus->f2txdata++;
 		ASSERT(ret != BCME_PENDING);
 
-		if (ret < 0) {
-			/* On failure, abort the command and terminate the frame */
-			DHD_INFO(("%s: sdio error %d, abort command and terminate frame.\n",
-			          __FUNCTION__, ret));
-			bus->tx_sderrs++;
-
-			bcmsdh_abort(sdh, SDIO_FUNC_2);
-			bcmsdh_cfg_write(sdh, SDIO_FUNC_1, SBSDIO_FUNC1_FRAMECTRL,
-			                 SFC_WF_TERM, NULL);
-			bus->f1regdata++;
-
-			for (i = 0; i < 3; i++) {
-				uint8 hi, lo;
-				hi = bcmsdh_cfg_read(sdh, SDIO_FUNC_1,
-				                     SBSDIO_FUNC1_WFRAMEBCHI, NULL);
-				lo = bcmsdh_cfg_read(sdh, SDIO_FUNC_1,
-				                     SBSDIO_FUNC1_WFRAMEBCLO, NULL);
-				bus->f1regdata += 2;
-				if ((hi == 0) && (lo == 0))
-					break;
-			}
-
-		}
+		if (ret < 0)
+			dhdsdio_txterm(bus, ret);
 	} while ((ret < 0) && retrydata && retries++ < TXRETRIES);
 
 done:
@@ -1110,6 +1146,134 @@ dhd_bus_txdata(struct dhd_bus *bus, void *pkt)
 	return ret;
 }
 
+/* Sends up to maxframes queued data frames in one F2 write.  The
+ * superframe is laid out the way the dongle sends them to us: a glom
+ * channel header, then each frame with its own HW/SW headers, padded
+ * to DHD_SDALIGN.  It's bounded by DHD_TXGLOM_MAXLEN so one write
+ * doesn't hold the bus for long.  Returns the number of frames taken
+ * off the queue.  Assumes caller holds lock.
+ */
+static uint
+dhdsdio_txglom(dhd_bus_t *bus, uint maxframes)
+{
+	osl_t *osh = bus->dhd->osh;
+	void *pkts[DHD_TXGLOM_MAX];
+	void *pkt;
+	uint8 *frame, *sub;
+	uint16 len, sublen, pad;
+	uint16 doff = DHD_SDALIGN;
+	uint32 swheader;
+	uint8 tx_prec_map = ~bus->flowcontrol;
+	uint npkts = 0, retries = 0, i;
+	int ret, prec_out;
+
+	/* Every subframe takes a sequence number */
+	maxframes = MIN(maxframes, MIN(dhd_txglom, DHD_TXGLOM_MAX));
+	maxframes = MIN(maxframes, (uint8)(bus->tx_max - bus->tx_seq));
+
+	len = doff;
+	dhd_os_sdlock_txq(bus->dhd);
+	while (npkts < maxframes) {
+		if ((pkt = pktq_mdeq(&bus->txq, tx_prec_map, &prec_out)) == NULL)
+			break;
+		sublen = ROUNDUP(PKTLEN(osh, pkt), DHD_SDALIGN);
+		if (npkts && (len + sublen > DHD_TXGLOM_MAXLEN)) {
+			pktq_penq_head(&bus->txq, prec_out, pkt);
+			break;
+		}
+		pkts[npkts++] = pkt;
+		len += sublen;
+	}
+	dhd_os_sdunlock_txq(bus->dhd);
+
+	if (npkts == 0)
+		return 0;
+
+	if (npkts == 1) {
+		i = PKTLEN(osh, pkts[0]) - SDPCM_HDRLEN;
+		if (dhdsdio_txpkt(bus, pkts[0], SDPCM_DATA_CHANNEL, TRUE))
+			bus->dhd->tx_errors++;
+		else
+			bus->dhd->dstats.tx_bytes += i;
+		return 1;
+	}
+
+	frame = bus->txglomptr;
+	bzero(frame, doff);
+
+	for (len = doff, i = 0; i < npkts; i++) {
+		sub = frame + len;
+		sublen = (uint16)PKTLEN(osh, pkts[i]);
+		pad = ROUNDUP(sublen, DHD_SDALIGN) - sublen;
+		bcopy(PKTDATA(osh, pkts[i]), sub, sublen);
+		bzero(sub + sublen, pad);
+
+		htol16_ua_store(sublen, sub);
+		htol16_ua_store(~sublen, sub + sizeof(uint16));
+		swheader = ((SDPCM_DATA_CHANNEL << SDPCM_CHANNEL_SHIFT) & SDPCM_CHANNEL_MASK) |
+		        ((bus->tx_seq + i) % SDPCM_SEQUENCE_WRAP) |
+		        ((SDPCM_HDRLEN << SDPCM_DOFFSET_SHIFT) & SDPCM_DOFFSET_MASK);
+		htol32_ua_store(swheader, sub + SDPCM_FRAMETAG_LEN);
+		htol32_ua_store(0, sub + SDPCM_FRAMETAG_LEN + sizeof(swheader));
+
+		len += sublen + pad;
+#ifdef DHD_DEBUG
+		tx_packets[PKTPRIO(pkts[i])]++;
+#endif
+	}
+
+	/* Superframe header carries the first sequence number */
+	*(uint16*)frame = htol16(len);
+	*(((uint16*)frame) + 1) = htol16(~len);
+	swheader = ((SDPCM_GLOM_CHANNEL << SDPCM_CHANNEL_SHIFT) & SDPCM_CHANNEL_MASK) |
+	        bus->tx_seq | ((doff << SDPCM_DOFFSET_SHIFT) & SDPCM_DOFFSET_MASK);
+	htol32_ua_store(swheader, frame + SDPCM_FRAMETAG_LEN);
+	bus->tx_seq = (bus->tx_seq + npkts) % SDPCM_SEQUENCE_WRAP;
+
+#ifdef DHD_DEBUG
+	if (DHD_GLOM_ON())
+		prhex("Tx Superframe", frame, MIN(len, 48));
+#endif
+
+	/* Raise len to next SDIO block to eliminate tail command */
+	if (bus->roundup && bus->blocksize && (len > bus->blocksize)) {
+		pad = bus->blocksize - (len % bus->blocksize);
+		if ((pad <= bus->roundup) && (pad < bus->blocksize) &&
+		    (len + pad <= DHD_TXGLOM_BUFLEN))
+			len += pad;
+	}
+
+	do {
+		ret = dhd_bcmsdh_send_buf(bus, bcmsdh_cur_sbwad(bus->sdh), SDIO_FUNC_2,
+		                          F2SYNC, frame, len, NULL, NULL, NULL);
+		bus->f2txdata++;
+		ASSERT(ret != BCME_PENDING);
+
+		if (ret < 0)
+			dhdsdio_txterm(bus, ret);
+	} while ((ret < 0) && retrydata && retries++ < TXRETRIES);
+
+	bus->txglomframes++;
+	bus->txglompkts += npkts;
+
+	dhd_os_sdunlock(bus->dhd);
+	for (i = 0; i < npkts; i++) {
+		PKTPULL(osh, pkts[i], SDPCM_HDRLEN);
+		dhd_txcomplete(bus->dhd, pkts[i], ret != 0);
+	}
+	dhd_os_sdlock(bus->dhd);
+
+	for (i = 0; i < npkts; i++) {
+		if (ret)
+			bus->dhd->tx_errors++;
+		else
+			bus->dhd->dstats.tx_bytes += PKTLEN(osh, pkts[i]);
+		PKTFREE(osh, pkts[i], TRUE);
+	}
+
+	return npkts;
+}
+
 static uint
 dhdsdio_sendfromq(dhd_bus_t *bus, uint maxframes)
 {
@@ -1130,6 +1294,18 @@ dhdsdio_sendfromq(dhd_bus_t *bus, uint maxframes)
 
 	/* Send frames until the limit or some other event */
 	for (cnt = 0; (cnt < maxframes) && DATAOK(bus); cnt++) {
+#ifdef SDTEST
+		if ((dhd_txglom > 1) && bus->txglomptr && !bus->ext_loop) {
+#else
+		if ((dhd_txglom > 1) && bus->txglomptr) {
+#endif
+			uint n = dhdsdio_txglom(bus, maxframes - cnt);
+			if (!n)
+				break;
+			cnt += n - 1;
+			goto sent;
+		}
+
 		dhd_os_sdlock_txq(bus->dhd);
 		if ((pkt = pktq_mdeq(&bus->txq, tx_prec_map, &prec_out)) == NULL) {
 			dhd_os_sdunlock_txq(bus->dhd);
@@ -1149,6 +1325,7 @@ dhdsdio_sendfromq(dhd_bus_t *bus, uint maxframes)
 		else
 			bus->dhd->dstats.tx_bytes += datalen;
 
+sent:
 		/* In poll mode, need to check for other events */
 		if (!bus->intr && cnt)
 		{
@@ -1383,6 +1560,8 @@ enum {
 	IOV_TXBOUND,
 	IOV_RXBOUND,
 	IOV_TXMINMAX,
+	IOV_TXGLOM,
+	IOV_RXPOLL,
 	IOV_IDLETIME,
 	IOV_IDLECLOCK,
 	IOV_SD1IDLE,
@@ -1404,6 +1583,8 @@ const bcm_iovar_t dhdsdio_iovars[] = {
 	{"sdiod_drive",	IOV_SDIOD_DRIVE, 0,	IOVT_UINT32,	0 },
 	{"readahead",	IOV_READAHEAD,	0,	IOVT_BOOL,	0 },
 	{"sdrxchain",	IOV_SDRXCHAIN,	0,	IOVT_BOOL,	0 },
+	{"txglom",	IOV_TXGLOM,	0,	IOVT_UINT32,	0 },
+	{"rxpoll",	IOV_RXPOLL,	0,	IOVT_UINT32,	0 },
 	{"alignctl",	IOV_ALIGNCTL,	0,	IOVT_BOOL,	0 },
 	{"sdalign",	IOV_SDALIGN,	0,	IOVT_BOOL,	0 },
 	{"devreset",	IOV_DEVRESET,	0,	IOVT_BOOL,	0 },
@@ -1466,6 +1647,12 @@ dhd_bus_dump(dhd_pub_t *dhdp, struct bcmstrbuf *strbuf)
 	            bus->fc_rcvd, bus->fc_xoff, bus->fc_xon);
 	bcm_bprintf(strbuf, "rxglomfail %d, rxglomframes %d, rxglompkts %d\n",
 	            bus->rxglomfail, bus->rxglomframes, bus->rxglompkts);
+	bcm_bprintf(strbuf, "txglom %d, txglomframes %d, txglompkts %d\n",
+	            dhd_txglom, bus->txglomframes, bus->txglompkts);
+	bcm_bprintf(strbuf, "dpcpasses %d, rxbudget %d, rxbudgethits %d\n",
+	            bus->dpcpasses, bus->rxbudget, bus->rxbudgethits);
+	bcm_bprintf(strbuf, "rxpoll %d, polling %d, pollenters %d, pollpasses %d\n",
+	            dhd_rxpoll, bus->polling, bus->pollenters, bus->pollpasses);
 	bcm_bprintf(strbuf, "f2rx (hdrs/data) %d (%d/%d), f2tx %d f1regs %d\n",
 	            (bus->f2rxhdrs + bus->f2rxdata), bus->f2rxhdrs, bus->f2rxdata,
 	            bus->f2txdata, bus->f1regdata);
@@ -1532,6 +1719,8 @@ dhd_bus_clearcounts(dhd_pub_t *dhdp)
 	bus->rx_hdrfail = bus->rx_badhdr = bus->rx_badseq = 0;
 	bus->tx_sderrs = bus->fc_rcvd = bus->fc_xoff = bus->fc_xon = 0;
 	bus->rxglomfail = bus->rxglomframes = bus->rxglompkts = 0;
+	bus->txglomframes = bus->txglompkts = 0;
+	bus->dpcpasses = bus->pollpasses = bus->pollenters = bus->rxbudgethits = 0;
 	bus->f2rxhdrs = bus->f2rxdata = bus->f2txdata = bus->f1regdata = 0;
 }
 
@@ -2176,6 +2365,24 @@ dhdsdio_doiovar(dhd_bus_t *bus, const bcm_iovar_t *vi, uint32 actionid, const ch
 		dhd_txminmax = (uint)int_val;
 		break;
 
+	case IOV_GVAL(IOV_TXGLOM):
+		int_val = (int32)dhd_txglom;
+		bcopy(&int_val, arg, val_size);
+		break;
+
+	case IOV_SVAL(IOV_TXGLOM):
+		dhd_txglom = MIN((uint)int_val, DHD_TXGLOM_MAX);
+		break;
+
+	case IOV_GVAL(IOV_RXPOLL):
+		int_val = (int32)dhd_rxpoll;
+		bcopy(&int_val, arg, val_size);
+		break;
+
+	case IOV_SVAL(IOV_RXPOLL):
+		dhd_rxpoll = (uint)int_val;
+		break;
+
 
 
 #endif /* DHD_DEBUG */
@@ -2867,11 +3074,11 @@ done:
 static uint8
 dhdsdio_rxglom(dhd_bus_t *bus, uint8 rxseq)
 {
-	uint16 dlen, totlen;
+	uint16 dlen, totlen, suplen;
 	uint8 *dptr, num = 0;
 
 	uint16 sublen, check;
-	void *pfirst, *plast, *pnext, *save_pfirst;
+	void *pfirst, *plast, *pnext, *save_pfirst, *psuper;
 	osl_t *osh = bus->dhd->osh;
 
 	int errcode;
@@ -2899,6 +3106,20 @@ dhdsdio_rxglom(dhd_bus_t *bus, uint8 rxseq)
 			dlen = 0;
 		}
 
+		/* Unless reading straight into a chain, read the superframe
+		 * into one packet and hand out clones of it for the subframes
+		 * rather than copying them out of databuf.
+		 */
+		psuper = NULL;
+		if (!usechain && dlen) {
+			for (suplen = 0, num = 0; num < dlen; num += sizeof(uint16))
+				suplen += ltoh16_ua(dptr + num);
+			suplen = ROUNDUP(suplen, bus->blocksize);
+			if ((suplen <= MAX_DATA_BUF) &&
+			    (psuper = PKTGET(osh, suplen + DHD_SDALIGN, FALSE)))
+				PKTALIGN(osh, psuper, suplen, DHD_SDALIGN);
+		}
+
 		for (totlen = num = 0; dlen; num++) {
 			/* Get (and move past) next length */
 			sublen = ltoh16_ua(dptr);
@@ -2925,7 +3146,17 @@ dhdsdio_rxglom(dhd_bus_t *bus, uint8 rxseq)
 			}
 
 			/* Allocate/chain packet for next subframe */
-			if ((pnext = PKTGET(osh, sublen + DHD_SDALIGN, FALSE)) == NULL) {
+			if (psuper) {
+				if ((totlen > PKTLEN(osh, psuper)) ||
+				    (pnext = PKTDUP(osh, psuper)) == NULL) {
+					DHD_ERROR(("%s: PKTDUP failed, num %d len %d\n",
+					           __FUNCTION__, num, sublen));
+					pnext = NULL;
+					break;
+				}
+				PKTPULL(osh, pnext, totlen - sublen);
+				PKTSETLEN(osh, pnext, sublen);
+			} else if ((pnext = PKTGET(osh, sublen + DHD_SDALIGN, FALSE)) == NULL) {
 				DHD_ERROR(("%s: PKTGET failed, num %d len %d\n",
 				           __FUNCTION__, num, sublen));
 				break;
@@ -2941,9 +3172,14 @@ dhdsdio_rxglom(dhd_bus_t *bus, uint8 rxseq)
 			}
 
 			/* Adhere to start alignment requirements */
-			PKTALIGN(osh, pnext, sublen, DHD_SDALIGN);
+			if (!psuper)
+				PKTALIGN(osh, pnext, sublen, DHD_SDALIGN);
 		}
 
+		/* The clones hold on to the buffer */
+		if (psuper)
+			PKTFREE(osh, psuper, FALSE);
+
 		/* If all allocations succeeded, save packet chain in bus structure */
 		if (pnext) {
 			DHD_GLOM(("%s: allocated %d-byte packet chain for %d subframes\n",
@@ -2956,6 +3192,7 @@ dhdsdio_rxglom(dhd_bus_t *bus, uint8 rxseq)
 				}
 			}
 			bus->glom = pfirst;
+			bus->glomshared = (psuper != NULL);
 			pfirst = pnext = NULL;
 		} else {
 			if (pfirst)
@@ -2995,6 +3232,12 @@ dhdsdio_rxglom(dhd_bus_t *bus, uint8 rxseq)
 			                              bcmsdh_cur_sbwad(bus->sdh), SDIO_FUNC_2,
 			                              F2SYNC, (uint8*)PKTDATA(osh, pfirst),
 			                              dlen, pfirst, NULL, NULL);
+		} else if (bus->glomshared) {
+			/* Subframes are back to back in the shared buffer */
+			errcode = dhd_bcmsdh_recv_buf(bus,
+			                              bcmsdh_cur_sbwad(bus->sdh), SDIO_FUNC_2,
+			                              F2SYNC, (uint8*)PKTDATA(osh, pfirst),
+			                              dlen, NULL, NULL, NULL);
 		} else if (bus->dataptr) {
 			errcode = dhd_bcmsdh_recv_buf(bus,
 			                              bcmsdh_cur_sbwad(bus->sdh), SDIO_FUNC_2,
@@ -3895,6 +4138,59 @@ dhdsdio_hostmail(dhd_bus_t *bus)
 	return intstatus;
 }
 
+/* Called at the end of a DPC pass with the frames it moved.  Sizes the
+ * next rx budget: it's halved while tx frames wait behind rx, so a rx
+ * burst doesn't hold them up for long, and grows back towards
+ * dhd_rxbound while passes use all of it.  Also switches between
+ * interrupts and polling: once a pass reads dhd_rxpoll frames the DPC
+ * keeps interrupts off and polls the device, and goes back to
+ * interrupts after DHD_POLLIDLE passes that found nothing to do.
+ * Returns TRUE if the DPC should run again to poll.
+ */
+static bool
+dhdsdio_dpc_adapt(dhd_bus_t *bus, uint rxframes, uint txframes, bool rxfull)
+{
+	bool txwait = pktq_mlen(&bus->txq, ~bus->flowcontrol) && !bus->fcstate;
+
+	bus->dpcpasses++;
+
+	if (rxfull) {
+		bus->rxbudgethits++;
+		if (txwait)
+			bus->rxbudget = MAX(bus->rxbudget / 2, DHD_RXBUDGET_MIN);
+		else
+			bus->rxbudget = MIN(bus->rxbudget * 2, dhd_rxbound);
+	} else if (!txwait && (bus->rxbudget < dhd_rxbound)) {
+		bus->rxbudget = MIN(bus->rxbudget * 2, dhd_rxbound);
+	}
+
+	if (!bus->intr || !dhd_rxpoll)
+		bus->polling = FALSE;
+	else if (bus->polling) {
+		bus->pollpasses++;
+		if (rxframes || txframes)
+			bus->pollidle = 0;
+		else if (++bus->pollidle >= DHD_POLLIDLE)
+			bus->polling = FALSE;
+	} else if (rxframes >= dhd_rxpoll) {
+		bus->polling = TRUE;
+		bus->pollidle = 0;
+		bus->pollenters++;
+	}
+
+	if (!bus->polling) {
+		if (bus->intr && bus->intdis) {
+			bus->intdis = FALSE;
+			bcmsdh_intr_enable(bus->sdh);
+		}
+		return FALSE;
+	}
+
+	/* Read intstatus next pass, as the interrupt would have */
+	bus->ipend = TRUE;
+	return TRUE;
+}
+
 bool
 dhdsdio_dpc(dhd_bus_t *bus)
 {
@@ -3902,9 +4198,10 @@ dhdsdio_dpc(dhd_bus_t *bus)
 	sdpcmd_regs_t *regs = bus->regs;
 	uint32 intstatus, newstatus = 0;
 	uint retries = 0;
-	uint rxlimit = dhd_rxbound; /* Rx frames to read before resched */
+	uint rxlimit;			  /* Rx frames to read before resched */
 	uint txlimit = dhd_txbound; /* Tx frames to send before resched */
 	uint framecnt = 0;		  /* Temporary counter of tx/rx frames */
+	uint rxframes = 0, txframes = 0;  /* Frames moved in this pass */
 	bool rxdone = TRUE;		  /* Flag for no more read data */
 	bool resched = FALSE;	  /* Flag indicating resched wanted */
 
@@ -3915,6 +4212,10 @@ dhdsdio_dpc(dhd_bus_t *bus)
 
 	dhd_os_sdlock(bus->dhd);
 
+	if (!bus->rxbudget || (bus->rxbudget > dhd_rxbound))
+		bus->rxbudget = dhd_rxbound;
+	rxlimit = bus->rxbudget;
+
 	/* If waiting for HTAVAIL, check status */
 	if (bus->clkstate == CLK_PENDING) {
 		int err;
@@ -4037,6 +4338,7 @@ dhdsdio_dpc(dhd_bus_t *bus)
 		if (rxdone || bus->rxskip)
 			intstatus &= ~I_HMB_FRAME_IND;
 		rxlimit -= MIN(framecnt, rxlimit);
+		rxframes = framecnt;
 	}
 
 	/* Keep still-pending events for next scheduling */
@@ -4046,8 +4348,10 @@ clkwait:
 	/* Re-enable interrupts to detect new device events (mailbox, rx frame)
 	 * or clock availability.  (Allows tx loop to check ipend if desired.)
 	 * (Unless register access seems hosed, as we may not be able to ACK...)
+	 * While polling they stay off, unless we're waiting on the clock.
 	 */
-	if (bus->intr && bus->intdis && !bcmsdh_regfail(sdh)) {
+	if (bus->intr && bus->intdis && !bcmsdh_regfail(sdh) &&
+	    (!bus->polling || (bus->clkstate == CLK_PENDING))) {
 		DHD_INTR(("%s: enable SDIO interrupts, rxdone %d framecnt %d\n",
 		          __FUNCTION__, rxdone, framecnt));
 		bus->intdis = FALSE;
@@ -4097,6 +4401,7 @@ clkwait:
 		framecnt = rxdone ? txlimit : MIN(txlimit, dhd_txminmax);
 		framecnt = dhdsdio_sendfromq(bus, framecnt);
 		txlimit -= framecnt;
+		txframes = framecnt;
 	}
 
 	/* Resched if events or tx frames are pending, else await next interrupt */
@@ -4114,6 +4419,14 @@ clkwait:
 		resched = TRUE;
 	}
 
+	/* Adapt budget and interrupt mode, unless things went wrong above */
+	if ((bus->dhd->busstate != DHD_BUS_DOWN) && !bcmsdh_regfail(sdh) &&
+	    (bus->clkstate != CLK_PENDING)) {
+		if (dhdsdio_dpc_adapt(bus, rxframes, txframes, !rxdone && !rxlimit))
+			resched = TRUE;
+	} else {
+		bus->polling = FALSE;
+	}
 
 	bus->dpc_sched = resched;
 
@@ -4922,6 +5235,18 @@ dhdsdio_probe_malloc(dhd_bus_t *bus, osl_t *osh, void *sdh)
 	else
 		bus->dataptr = bus->databuf;
 
+	/* Buffer for tx superframes, without it frames just go one by one */
+	if ((bus->txglombuf = MALLOC(osh, DHD_TXGLOM_BUFLEN + DHD_SDALIGN))) {
+		if ((uintptr)bus->txglombuf % DHD_SDALIGN)
+			bus->txglomptr = bus->txglombuf +
+			        (DHD_SDALIGN - ((uintptr)bus->txglombuf % DHD_SDALIGN));
+		else
+			bus->txglomptr = bus->txglombuf;
+	} else {
+		DHD_ERROR(("%s: MALLOC of %d-byte txglombuf failed\n",
+		           __FUNCTION__, DHD_TXGLOM_BUFLEN + DHD_SDALIGN));
+	}
+
 	return TRUE;
 
 fail:
@@ -5087,6 +5412,11 @@ dhdsdio_release_malloc(dhd_bus_t *bus, osl_t *osh)
 #endif
 		bus->databuf = NULL;
 	}
+
+	if (bus->txglombuf) {
+		MFREE(osh, bus->txglombuf, DHD_TXGLOM_BUFLEN + DHD_SDALIGN);
+		bus->txglombuf = bus->txglomptr = NULL;
+	}
 }
 
 
@@ -5237,7 +5567,7 @@ dhdsdio_download_code_file(struct dhd_bus *bus, char *fw_path)
 {
 	int bcmerror = -1;
 	int offset = 0;
-	uint len;
+	uint len, blksize = DLBLOCK;
 	void *image = NULL;
 	uint8 *memblock = NULL, *memptr;
 
@@ -5247,29 +5577,39 @@ dhdsdio_download_code_file(struct dhd_bus *bus, char *fw_path)
 	if (image == NULL)
 		goto err;
 
-	memptr = memblock = MALLOC(bus->dhd->osh, MEMBLOCK + DHD_SDALIGN);
+	/* Large blocks go down as multi-block CMD53s without an extra copy */
+	memptr = memblock = MALLOC(bus->dhd->osh, blksize + DHD_SDALIGN);
 	if (memblock == NULL) {
-		DHD_ERROR(("%s: Failed to allocate memory %d bytes\n", __FUNCTION__, MEMBLOCK));
+		blksize = MEMBLOCK;
+		memptr = memblock = MALLOC(bus->dhd->osh, blksize + DHD_SDALIGN);
+	}
+	if (memblock == NULL) {
+		DHD_ERROR(("%s: Failed to allocate memory %d bytes\n", __FUNCTION__, blksize));
 		goto err;
 	}
 	if ((uint32)(uintptr)memblock % DHD_SDALIGN)
 		memptr += (DHD_SDALIGN - ((uint32)(uintptr)memblock % DHD_SDALIGN));
 
 	/* Download image */
-	while ((len = dhd_os_get_image_block((char*)memptr, MEMBLOCK, image))) {
+	while ((len = dhd_os_get_image_block((char*)memptr, blksize, image))) {
+		/* Pad the tail so it takes the same path as the full blocks */
+		if (len % DLPAD) {
+			bzero(memptr + len, DLPAD - (len % DLPAD));
+			len = ROUNDUP(len, DLPAD);
+		}
 		bcmerror = dhdsdio_membytes(bus, TRUE, offset, memptr, len);
 		if (bcmerror) {
 			DHD_ERROR(("%s: error %d on writing %d membytes at 0x%08x\n",
-			        __FUNCTION__, bcmerror, MEMBLOCK, offset));
+			        __FUNCTION__, bcmerror, len, offset));
 			goto err;
 		}
 
-		offset += MEMBLOCK;
+		offset += len;
 	}
 
 err:
 	if (memblock)
-		MFREE(bus->dhd->osh, memblock, MEMBLOCK + DHD_SDALIGN);
+		MFREE(bus->dhd->osh, memblock, blksize + DHD_SDALIGN);
 
 	if (image)
 		dhd_os_close_image(image);
@@ -133,6 +133,7 @@ static wlc_ssid_t g_specific_ssid;
 static wlc_ssid_t g_ssid;
 
 static wl_iw_ss_cache_ctrl_t g_ss_cache_ctrl;	
+static wl_iw_bss_cache_ctrl_t g_bss_cache_ctrl;
 static volatile uint g_first_broadcast_scan;	
 
 
@@ -152,12 +153,14 @@ static volatile uint g_first_broadcast_scan;
 #if defined(WL_IW_USE_ISCAN)
 static void wl_iw_free_ss_cache(void);
 static int   wl_iw_run_ss_cache_timer(int kick_off);
+static void wl_iw_bss_cache_flush(void);
 int  wl_iw_iscan_set_scan_broadcast_prep(struct net_device *dev, uint flag);
 static int dev_wlc_bufvar_set(struct net_device *dev, char *name, char *buf, int len);
 #define ISCAN_STATE_IDLE   0
 #define ISCAN_STATE_SCANING 1
 
 #define WLC_IW_ISCAN_MAXLEN   2048
+#define WL_IW_ROAM_CHANNELS   16
 typedef struct iscan_buf {
 	struct iscan_buf * next;
 	char   iscan_buf[WLC_IW_ISCAN_MAXLEN];
@@ -179,6 +182,10 @@ typedef struct iscan_info {
 
 	uint32 scan_flag;	
 
+	/* Channels for the next WL_SCAN_ACTION_START, all when nchan is 0 */
+	uint16 channel_list[WL_IW_ROAM_CHANNELS];
+	int nchan;
+
 	char ioctlbuf[WLC_IOCTL_SMLEN];
 } iscan_info_t;
 #define COEX_DHCP 1 
@@ -977,6 +984,7 @@ wl_iw_control_wl_off(
 #if defined(WL_IW_USE_ISCAN)
 		wl_iw_free_ss_cache();
 		wl_iw_run_ss_cache_timer(0);
+		wl_iw_bss_cache_flush();
 		memset(g_scan, 0, G_SCAN_RESULTS);
 
 		g_ss_cache_ctrl.m_link_down = 1;
@@ -2086,8 +2094,11 @@ wl_iw_iscan(iscan_info_t *iscan, wlc_ssid_t *ssid, uint16 action)
 	if (ssid && ssid->SSID_len) {
 		params_size += sizeof(wlc_ssid_t);
 	}
+	if (action == WL_SCAN_ACTION_START)
+		params_size += iscan->nchan * sizeof(uint16);
 	params = (wl_iscan_params_t*)kmalloc(params_size, GFP_KERNEL);
 	if (params == NULL) {
+		iscan->nchan = 0;
 		return -ENOMEM;
 	}
 	memset(params, 0, params_size);
@@ -2095,6 +2106,17 @@ wl_iw_iscan(iscan_info_t *iscan, wlc_ssid_t *ssid, uint16 action)
 
 	err = wl_iw_iscan_prep(&params->params, ssid);
 
+	if (!err && action == WL_SCAN_ACTION_START && iscan->nchan) {
+		int i;
+
+		for (i = 0; i < iscan->nchan; i++)
+			params->params.channel_list[i] = htodchanspec(iscan->channel_list[i]);
+		params->params.channel_num = htod32(iscan->nchan & WL_SCAN_PARAMS_COUNT_MASK);
+		WL_TRACE(("%s: %d channels\n", __func__, iscan->nchan));
+	}
+	if (action == WL_SCAN_ACTION_START)
+		iscan->nchan = 0;
+
 	if (!err) {
 		params->version = htod32(ISCAN_REQ_VERSION);
 		params->action = htod16(action);
@@ -2133,6 +2155,115 @@ static void wl_iw_set_event_mask(struct net_device *dev)
 		iovbuf, sizeof(iovbuf));
 }
 
+/*
+ * Broadcast scan results are kept per BSSID and SIOCGIWSCAN is answered
+ * from here. A scan of a few channels then only refreshes those channels,
+ * results show up as each iscan chunk comes in, and reading the results
+ * twice doesn't rebuild the event stream. An entry goes away
+ * WL_IW_BSS_CACHE_AGE_MS after the last scan that saw it.
+ */
+#define WL_IW_BSS_CACHE_AGE_MS	30000
+
+/* Called with wl_cache_lock held */
+static void
+wl_iw_bss_cache_add(wl_scan_results_t *list)
+{
+	wl_iw_bss_cache_t *node, *leaf, **pnode;
+	wl_bss_info_t *bi = NULL;
+	uint32 len;
+	int i;
+
+	for (i = 0; i < list->count; i++) {
+		bi = bi ? (wl_bss_info_t *)((uintptr)bi + dtoh32(bi->length)) : list->bss_info;
+		len = dtoh32(bi->length);
+		if ((uintptr)bi + len > (uintptr)list + WLC_IW_ISCAN_MAXLEN)
+			break;
+
+		for (pnode = &g_bss_cache_ctrl.m_cache_head; (node = *pnode); pnode = &node->next)
+			if (!memcmp(&node->bss_info->BSSID, &bi->BSSID, ETHER_ADDR_LEN))
+				break;
+
+		if (node && dtoh32(node->bss_info->length) == len) {
+			memcpy(node->bss_info, bi, len);
+		} else {
+			leaf = kmalloc(OFFSETOF(wl_iw_bss_cache_t, bss_info) + len, GFP_KERNEL);
+			if (!leaf)
+				break;
+			memcpy(leaf->bss_info, bi, len);
+			leaf->next = node ? node->next : NULL;
+			if (node)
+				kfree(node);
+			*pnode = node = leaf;
+		}
+		node->seen = jiffies;
+		g_bss_cache_ctrl.m_gen++;
+	}
+}
+
+/* Called with wl_cache_lock held */
+static void
+wl_iw_bss_cache_age(void)
+{
+	wl_iw_bss_cache_t *node, **pnode;
+	ulong age = msecs_to_jiffies(WL_IW_BSS_CACHE_AGE_MS);
+
+	for (pnode = &g_bss_cache_ctrl.m_cache_head; (node = *pnode);) {
+		if (time_after(jiffies, node->seen + age)) {
+			WL_TRACE(("%s : aged out %s\n", __FUNCTION__, node->bss_info->SSID));
+			*pnode = node->next;
+			kfree(node);
+			g_bss_cache_ctrl.m_gen++;
+		} else {
+			pnode = &node->next;
+		}
+	}
+}
+
+static void
+wl_iw_bss_cache_flush(void)
+{
+	wl_iw_bss_cache_t *node;
+
+	mutex_lock(&wl_cache_lock);
+	while ((node = g_bss_cache_ctrl.m_cache_head)) {
+		g_bss_cache_ctrl.m_cache_head = node->next;
+		kfree(node);
+	}
+	if (g_bss_cache_ctrl.m_events)
+		kfree(g_bss_cache_ctrl.m_events);
+	g_bss_cache_ctrl.m_events = NULL;
+	g_bss_cache_ctrl.m_events_len = 0;
+	g_bss_cache_ctrl.m_gen++;
+	mutex_unlock(&wl_cache_lock);
+}
+
+/* Home channel plus the channels of the APs seen lately, for roaming scans */
+static int
+wl_iw_roam_channels(struct net_device *dev, uint16 *chans)
+{
+	wl_iw_bss_cache_t *node;
+	channel_info_t ci;
+	uint16 ch;
+	int i, n = 0;
+
+	if (!dev_wlc_ioctl(dev, WLC_GET_CHANNEL, &ci, sizeof(ci)) && dtoh32(ci.target_channel))
+		chans[n++] = (uint16)dtoh32(ci.target_channel);
+
+	mutex_lock(&wl_cache_lock);
+	wl_iw_bss_cache_age();
+	for (node = g_bss_cache_ctrl.m_cache_head; node && n < WL_IW_ROAM_CHANNELS;
+		node = node->next) {
+		ch = CHSPEC_CHANNEL(dtohchanspec(node->bss_info->chanspec));
+		for (i = 0; i < n && chans[i] != ch; i++)
+			;
+		if (i == n)
+			chans[n++] = ch;
+	}
+	mutex_unlock(&wl_cache_lock);
+
+	return n;
+}
+
 static uint32
 wl_iw_iscan_get(iscan_info_t *iscan)
 {
@@ -2190,6 +2321,9 @@ wl_iw_iscan_get(iscan_info_t *iscan)
 
 	WL_TRACE(("results->buflen = %d\n", results->buflen));
 	status = dtoh32(list_buf->status);
+	if ((status == WL_SCAN_RESULTS_PARTIAL || status == WL_SCAN_RESULTS_SUCCESS) &&
+		results->version == WL_BSS_INFO_VERSION)
+		wl_iw_bss_cache_add(results);
 	mutex_unlock(&wl_cache_lock);
 	return status;
 }
@@ -2683,6 +2817,48 @@ wl_iw_iscan_set_scan_broadcast_prep(struct net_device *dev, uint flag)
 
 	return 0;
 }
+
+/* Broadcast iscan limited to the given channels, results for the others
+ * stay in the BSS cache until they age out
+ */
+static int
+wl_iw_iscan_set_scan_channels(struct net_device *dev, uint16 *chans, int nchan)
+{
+	iscan_info_t *iscan = g_iscan;
+
+	if (!iscan || iscan->sysioc_pid < 0)
+		return -EBUSY;
+	if (g_first_broadcast_scan < BROADCAST_SCAN_FIRST_RESULT_CONSUMED)
+		nchan = 0;
+	if (iscan->iscan_state == ISCAN_STATE_SCANING) {
+		WL_TRACE(("%s ISCAN already in progress \n", __FUNCTION__));
+		return 0;
+	}
+
+	iscan->nchan = MIN(nchan, WL_IW_ROAM_CHANNELS);
+	memcpy(iscan->channel_list, chans, iscan->nchan * sizeof(uint16));
+
+	return wl_iw_iscan_set_scan_broadcast_prep(dev, 0);
+}
+
+#if WIRELESS_EXT > 17
+static uint16
+wl_iw_freq_to_chan(struct iw_freq *fwrq)
+{
+	int m = fwrq->m, e = fwrq->e;
+
+	if (e == 0 && m < MAXCHANNEL)
+		return m;
+
+	for (; e > 6; e--)
+		m *= 10;
+	for (; e < 6; e++)
+		m /= 10;
+
+	return wf_mhz2channel(m, (m > 4000 && m < 5000) ? WF_CHAN_FACTOR_4_G : 0);
+}
+#endif
+
 static int
 wl_iw_iscan_set_scan(
 	struct net_device *dev,
@@ -2747,6 +2923,16 @@ wl_iw_iscan_set_scan(
 				WL_TRACE(("%s ISCAN already in progress \n", __FUNCTION__));
 				return 0;
 			}
+
+			if (wrqu->data.flags & IW_SCAN_THIS_FREQ) {
+				struct iw_scan_req *req = (struct iw_scan_req *)extra;
+				uint16 chans[WL_IW_ROAM_CHANNELS];
+				int i, n = MIN(req->num_channels, WL_IW_ROAM_CHANNELS);
+
+				for (i = 0; i < n; i++)
+					chans[i] = wl_iw_freq_to_chan(&req->channel_list[i]);
+				return wl_iw_iscan_set_scan_channels(dev, chans, n);
+			}
 		}
 	}
 #endif 
@@ -2848,6 +3034,80 @@ wl_iw_handle_scanresults_ies(char **event_p, char *end,
 	return 0;
 }
 
+/* Append the events for one BSS to the SIOCGIWSCAN stream */
+static char *
+wl_iw_add_bss_event(struct iw_request_info *info, char *event, char *end, wl_bss_info_t *bi)
+{
+	struct iw_event  iwe;
+	char *value;
+	int j;
+
+	WL_TRACE(("%s : %s\n", __FUNCTION__, bi->SSID));
+
+	iwe.cmd = SIOCGIWAP;
+	iwe.u.ap_addr.sa_family = ARPHRD_ETHER;
+	memcpy(iwe.u.ap_addr.sa_data, &bi->BSSID, ETHER_ADDR_LEN);
+	event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_ADDR_LEN);
+	
+	iwe.u.data.length = dtoh32(bi->SSID_len);
+	iwe.cmd = SIOCGIWESSID;
+	iwe.u.data.flags = 1;
+	event = IWE_STREAM_ADD_POINT(info, event, end, &iwe, bi->SSID);
+
+	
+	if (dtoh16(bi->capability) & (DOT11_CAP_ESS | DOT11_CAP_IBSS)) {
+		iwe.cmd = SIOCGIWMODE;
+		if (dtoh16(bi->capability) & DOT11_CAP_ESS)
+			iwe.u.mode = IW_MODE_INFRA;
+		else
+			iwe.u.mode = IW_MODE_ADHOC;
+		event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_UINT_LEN);
+	}
+
+	
+	iwe.cmd = SIOCGIWFREQ;
+	iwe.u.freq.m = wf_channel2mhz(CHSPEC_CHANNEL(bi->chanspec),
+		CHSPEC_CHANNEL(bi->chanspec) <= CH_MAX_2G_CHANNEL ?
+		WF_CHAN_FACTOR_2_4_G : WF_CHAN_FACTOR_5_G);
+	iwe.u.freq.e = 6;
+	event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_FREQ_LEN);
+
+	
+	iwe.cmd = IWEVQUAL;
+	iwe.u.qual.qual = rssi_to_qual(dtoh16(bi->RSSI));
+	iwe.u.qual.level = 0x100 + dtoh16(bi->RSSI);
+	iwe.u.qual.noise = 0x100 + bi->phy_noise;
+	event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_QUAL_LEN);
+
+	wl_iw_handle_scanresults_ies(&event, end, info, bi);
+
+	iwe.cmd = SIOCGIWENCODE;
+	if (dtoh16(bi->capability) & DOT11_CAP_PRIVACY)
+		iwe.u.data.flags = IW_ENCODE_ENABLED | IW_ENCODE_NOKEY;
+	else
+		iwe.u.data.flags = IW_ENCODE_DISABLED;
+	iwe.u.data.length = 0;
+	event = IWE_STREAM_ADD_POINT(info, event, end, &iwe, (char *)event);
+
+	
+	if (bi->rateset.count) {
+		if ((event + IW_EV_LCP_LEN) <= end) {
+			value = event + IW_EV_LCP_LEN;
+			iwe.cmd = SIOCGIWRATE;
+
+			iwe.u.bitrate.fixed = iwe.u.bitrate.disabled = 0;
+			for (j = 0; j < bi->rateset.count && j < IW_MAX_BITRATES; j++) {
+				iwe.u.bitrate.value = (bi->rateset.rates[j] & 0x7f) * 500000;
+				value = IWE_STREAM_ADD_VALUE(info, event, value, end, &iwe,
+					IW_EV_PARAM_LEN);
+			}
+			event = value;
+		}
+	}
+
+	return event;
+}
+
 static uint
 wl_iw_get_scan_prep(
 	wl_scan_results_t *list,
@@ -2855,10 +3115,9 @@ wl_iw_get_scan_prep(
 	char *extra,
 	short max_size)
 {
-	int  i, j;
-	struct iw_event  iwe;
+	int  i;
 	wl_bss_info_t *bi = NULL;
-	char *event = extra, *end = extra + max_size - WE_ADD_EVENT_FIX, *value;
+	char *event = extra, *end = extra + max_size - WE_ADD_EVENT_FIX;
 	int	ret = 0;
 
 	ASSERT(list);
@@ -2873,68 +3132,7 @@ wl_iw_get_scan_prep(
 
 		bi = bi ? (wl_bss_info_t *)((uintptr)bi + dtoh32(bi->length)) : list->bss_info;
 
-		WL_TRACE(("%s : %s\n", __FUNCTION__, bi->SSID));
-
-		iwe.cmd = SIOCGIWAP;
-		iwe.u.ap_addr.sa_family = ARPHRD_ETHER;
-		memcpy(iwe.u.ap_addr.sa_data, &bi->BSSID, ETHER_ADDR_LEN);
-		event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_ADDR_LEN);
-		
-		iwe.u.data.length = dtoh32(bi->SSID_len);
-		iwe.cmd = SIOCGIWESSID;
-		iwe.u.data.flags = 1;
-		event = IWE_STREAM_ADD_POINT(info, event, end, &iwe, bi->SSID);
-
-		
-		if (dtoh16(bi->capability) & (DOT11_CAP_ESS | DOT11_CAP_IBSS)) {
-			iwe.cmd = SIOCGIWMODE;
-			if (dtoh16(bi->capability) & DOT11_CAP_ESS)
-				iwe.u.mode = IW_MODE_INFRA;
-			else
-				iwe.u.mode = IW_MODE_ADHOC;
-			event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_UINT_LEN);
-		}
-
-		
-		iwe.cmd = SIOCGIWFREQ;
-		iwe.u.freq.m = wf_channel2mhz(CHSPEC_CHANNEL(bi->chanspec),
-			CHSPEC_CHANNEL(bi->chanspec) <= CH_MAX_2G_CHANNEL ?
-			WF_CHAN_FACTOR_2_4_G : WF_CHAN_FACTOR_5_G);
-		iwe.u.freq.e = 6;
-		event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_FREQ_LEN);
-
-		
-		iwe.cmd = IWEVQUAL;
-		iwe.u.qual.qual = rssi_to_qual(dtoh16(bi->RSSI));
-		iwe.u.qual.level = 0x100 + dtoh16(bi->RSSI);
-		iwe.u.qual.noise = 0x100 + bi->phy_noise;
-		event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_QUAL_LEN);
-
-		wl_iw_handle_scanresults_ies(&event, end, info, bi);
-
-		iwe.cmd = SIOCGIWENCODE;
-		if (dtoh16(bi->capability) & DOT11_CAP_PRIVACY)
-			iwe.u.data.flags = IW_ENCODE_ENABLED | IW_ENCODE_NOKEY;
-		else
-			iwe.u.data.flags = IW_ENCODE_DISABLED;
-		iwe.u.data.length = 0;
-		event = IWE_STREAM_ADD_POINT(info, event, end, &iwe, (char *)event);
-
-		
-		if (bi->rateset.count) {
-			if (((event -extra) + IW_EV_LCP_LEN) <= (uintptr)end) {
-				value = event + IW_EV_LCP_LEN;
-				iwe.cmd = SIOCGIWRATE;
-
-				iwe.u.bitrate.fixed = iwe.u.bitrate.disabled = 0;
-				for (j = 0; j < bi->rateset.count && j < IW_MAX_BITRATES; j++) {
-					iwe.u.bitrate.value = (bi->rateset.rates[j] & 0x7f) * 500000;
-					value = IWE_STREAM_ADD_VALUE(info, event, value, end, &iwe,
-						IW_EV_PARAM_LEN);
-				}
-				event = value;
-			}
-		}
+		event = wl_iw_add_bss_event(info, event, end, bi);
 	} 
 
 	if ((ret = (event - extra)) < 0) {
@@ -3092,15 +3290,12 @@ wl_iw_iscan_get_scan(
 	char *extra
 )
 {
-	wl_scan_results_t *list;
-	struct iw_event	iwe;
-	wl_bss_info_t *bi = NULL;
-	int ii, j;
-	int apcnt;
-	char *event = extra, *end = extra + dwrq->length, *value;
+	wl_iw_bss_cache_ctrl_t *ctrl;
+	wl_iw_bss_cache_t *node;
+	wl_bss_info_t *bi;
+	int apcnt = 0;
+	char *event = extra, *end = extra + dwrq->length;
 	iscan_info_t *iscan = g_iscan;
-	iscan_buf_t * p_buf;
-	uint32  counter = 0;
 	__u16 merged_len = 0;
 	uint buflen_from_user = dwrq->length;
 
@@ -3150,98 +3345,39 @@ wl_iw_iscan_get_scan(
 	}
 
 	WL_TRACE(("%s: SIOCGIWSCAN GET broadcast results\n", dev->name));
-	apcnt = 0;
-	p_buf = iscan->list_hdr;
-	
-	while (p_buf != iscan->list_cur) {
-	    list = &((wl_iscan_results_t*)p_buf->iscan_buf)->results;
-
-	    counter += list->count;
-
-	    if (list->version != WL_BSS_INFO_VERSION) {
-		WL_ERROR(("%s : list->version %d != WL_BSS_INFO_VERSION\n",
-			 __FUNCTION__, list->version));
-		return -EINVAL;
-	    }
-
-	    bi = NULL;
-	    for (ii = 0; ii < list->count && apcnt < IW_MAX_AP; apcnt++, ii++) {
-		bi = bi ? (wl_bss_info_t *)((uintptr)bi + dtoh32(bi->length)) : list->bss_info;
-		ASSERT(((uintptr)bi + dtoh32(bi->length)) <= ((uintptr)list +
-			WLC_IW_ISCAN_MAXLEN));
-
-		
-		if (event + ETHER_ADDR_LEN + bi->SSID_len + IW_EV_UINT_LEN + IW_EV_FREQ_LEN +
-			IW_EV_QUAL_LEN >= end)
-			return -E2BIG;
-		
-		iwe.cmd = SIOCGIWAP;
-		iwe.u.ap_addr.sa_family = ARPHRD_ETHER;
-		memcpy(iwe.u.ap_addr.sa_data, &bi->BSSID, ETHER_ADDR_LEN);
-		event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_ADDR_LEN);
-
-		
-		iwe.u.data.length = dtoh32(bi->SSID_len);
-		iwe.cmd = SIOCGIWESSID;
-		iwe.u.data.flags = 1;
-		event = IWE_STREAM_ADD_POINT(info, event, end, &iwe, bi->SSID);
-
-		
-		if (dtoh16(bi->capability) & (DOT11_CAP_ESS | DOT11_CAP_IBSS)) {
-			iwe.cmd = SIOCGIWMODE;
-			if (dtoh16(bi->capability) & DOT11_CAP_ESS)
-				iwe.u.mode = IW_MODE_INFRA;
-			else
-				iwe.u.mode = IW_MODE_ADHOC;
-			event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_UINT_LEN);
-		}
-
-		
-		iwe.cmd = SIOCGIWFREQ;
-		iwe.u.freq.m = wf_channel2mhz(CHSPEC_CHANNEL(bi->chanspec),
-			CHSPEC_CHANNEL(bi->chanspec) <= CH_MAX_2G_CHANNEL ?
-			WF_CHAN_FACTOR_2_4_G : WF_CHAN_FACTOR_5_G);
-		iwe.u.freq.e = 6;
-		event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_FREQ_LEN);
-
-		
-		iwe.cmd = IWEVQUAL;
-		iwe.u.qual.qual = rssi_to_qual(dtoh16(bi->RSSI));
-		iwe.u.qual.level = 0x100 + dtoh16(bi->RSSI);
-		iwe.u.qual.noise = 0x100 + bi->phy_noise;
-		event = IWE_STREAM_ADD_EVENT(info, event, end, &iwe, IW_EV_QUAL_LEN);
-
-		
-		wl_iw_handle_scanresults_ies(&event, end, info, bi);
-
-		
-		iwe.cmd = SIOCGIWENCODE;
-		if (dtoh16(bi->capability) & DOT11_CAP_PRIVACY)
-			iwe.u.data.flags = IW_ENCODE_ENABLED | IW_ENCODE_NOKEY;
-		else
-			iwe.u.data.flags = IW_ENCODE_DISABLED;
-		iwe.u.data.length = 0;
-		event = IWE_STREAM_ADD_POINT(info, event, end, &iwe, (char *)event);
-
-		
-		if (bi->rateset.count) {
-			if (event + IW_MAX_BITRATES*IW_EV_PARAM_LEN >= end)
+	mutex_lock(&wl_cache_lock);
+	wl_iw_bss_cache_age();
+	ctrl = &g_bss_cache_ctrl;
+	if (ctrl->m_events && ctrl->m_events_gen == ctrl->m_gen &&
+		ctrl->m_events_len <= buflen_from_user) {
+		/* Nothing new since the last SIOCGIWSCAN */
+		memcpy(extra, ctrl->m_events, ctrl->m_events_len);
+		event = extra + ctrl->m_events_len;
+	} else {
+		apcnt = 0;
+		for (node = ctrl->m_cache_head; node && apcnt < IW_MAX_AP; node = node->next) {
+			bi = node->bss_info;
+
+			if (event + ETHER_ADDR_LEN + bi->SSID_len + IW_EV_UINT_LEN +
+				IW_EV_FREQ_LEN + IW_EV_QUAL_LEN >= end ||
+				(bi->rateset.count &&
+				event + IW_MAX_BITRATES*IW_EV_PARAM_LEN >= end)) {
+				mutex_unlock(&wl_cache_lock);
 				return -E2BIG;
-
-			value = event + IW_EV_LCP_LEN;
-			iwe.cmd = SIOCGIWRATE;
-			
-			iwe.u.bitrate.fixed = iwe.u.bitrate.disabled = 0;
-			for (j = 0; j < bi->rateset.count && j < IW_MAX_BITRATES; j++) {
-				iwe.u.bitrate.value = (bi->rateset.rates[j] & 0x7f) * 500000;
-				value = IWE_STREAM_ADD_VALUE(info, event, value, end, &iwe,
-					IW_EV_PARAM_LEN);
 			}
-			event = value;
+			event = wl_iw_add_bss_event(info, event, end, bi);
+			apcnt++;
 		}
-	    }
-	    p_buf = p_buf->next;
-	} 
+		if (ctrl->m_events)
+			kfree(ctrl->m_events);
+		ctrl->m_events_len = event - extra;
+		ctrl->m_events = kmalloc(ctrl->m_events_len + 1, GFP_KERNEL);
+		if (ctrl->m_events) {
+			memcpy(ctrl->m_events, extra, ctrl->m_events_len);
+			ctrl->m_events_gen = ctrl->m_gen;
+		}
+	}
+	mutex_unlock(&wl_cache_lock);
 
 	dwrq->length = event - extra;
 	dwrq->flags = 0;	
@@ -3253,7 +3389,7 @@ wl_iw_iscan_get_scan(
 	
 	g_first_broadcast_scan = BROADCAST_SCAN_FIRST_RESULT_CONSUMED;
 
-	WL_TRACE(("%s return to WE %d bytes APs=%d\n", __FUNCTION__, dwrq->length, counter));
+	WL_TRACE(("%s return to WE %d bytes APs=%d\n", __FUNCTION__, dwrq->length, apcnt));
 
 	if (!dwrq->length)
 		return -EAGAIN;
@@ -5491,6 +5627,30 @@ int wl_iw_process_private_ascii_cmd(
 }
 #endif
 
+#if defined(WL_IW_USE_ISCAN)
+/* Background roaming scan of the home channel and the channels of the
+ * APs seen lately, instead of a full pass over the band
+ */
+static int
+wl_iw_set_roam_scan(
+	struct net_device *dev,
+	struct iw_request_info *info,
+	union iwreq_data *wrqu,
+	char *extra
+)
+{
+	uint16 chans[WL_IW_ROAM_CHANNELS];
+	int nchan, error;
+
+	nchan = wl_iw_roam_channels(dev, chans);
+	WL_TRACE(("%s: %d channels\n", __FUNCTION__, nchan));
+	error = wl_iw_iscan_set_scan_channels(dev, chans, nchan);
+
+	wrqu->data.length = snprintf(extra, MAX_WX_STRING, error ? "FAIL" : "OK") + 1;
+	return error;
+}
+#endif
+
 static int wl_iw_set_priv(
 	struct net_device *dev,
 	struct iw_request_info *info,
@@ -5538,6 +5698,10 @@ static int wl_iw_set_priv(
 			WL_TRACE(("%s: passive scan setting suppressed\n", dev->name));
 #else
 			ret = wl_iw_set_passive_scan(dev, info, (union iwreq_data *)dwrq, extra);
+#endif
+#if defined(WL_IW_USE_ISCAN)
+		else if (strnicmp(extra, "SCAN-ROAM", strlen("SCAN-ROAM")) == 0)
+			ret = wl_iw_set_roam_scan(dev, info, (union iwreq_data *)dwrq, extra);
 #endif
 		else if (strnicmp(extra, "RSSI", strlen("RSSI")) == 0)
 			ret = wl_iw_get_rssi(dev, info, (union iwreq_data *)dwrq, extra);
@@ -6590,6 +6754,7 @@ void wl_iw_detach(void)
 	kfree(iscan);
 	g_iscan = NULL;
 	mutex_unlock(&wl_cache_lock);
+	wl_iw_bss_cache_flush();
 #endif
 
 	if (g_scan)
@@ -114,6 +114,20 @@ typedef struct wl_iw_ss_cache_ctrl {
 	uint m_cons_br_scan_cnt;	
 	struct timer_list *m_timer;	
 } wl_iw_ss_cache_ctrl_t;
+
+typedef struct wl_iw_bss_cache {
+	struct wl_iw_bss_cache *next;
+	ulong seen;			/* jiffies of the last scan that saw it */
+	wl_bss_info_t bss_info[1];	/* bss_info->length bytes */
+} wl_iw_bss_cache_t;
+
+typedef struct wl_iw_bss_cache_ctrl {
+	wl_iw_bss_cache_t *m_cache_head;
+	uint m_gen;			/* bumped on every change to the list */
+	char *m_events;			/* SIOCGIWSCAN stream built for m_events_gen */
+	uint m_events_len;
+	uint m_events_gen;
+} wl_iw_bss_cache_ctrl_t;
 typedef enum broadcast_first_scan {
 	BROADCAST_SCAN_FIRST_IDLE = 0,
 	BROADCAST_SCAN_FIRST_STARTED,
@@ -182,6 +182,10 @@ static int Full_0;
 #define FAST_POLL	(1 * 60)
 #define SLOW_POLL	(10 * 60)
 
+/* sample at SLOW_POLL even while awake, see ds2784_set_poll_backoff() */
+static int poll_backoff;
+static struct ds2784_device_info *ds2784_di;
+
 static BLOCKING_NOTIFIER_HEAD(ds2784_notifier_list);
 int ds2784_register_notifier(struct notifier_block *nb)
 {
@@ -1203,9 +1207,30 @@ static void ds2784_battery_work(struct work_struct *work)
 	local_irq_save(flags);
 
 	wake_unlock(&di->work_wake_lock);
-	ds2784_program_alarm(di, FAST_POLL);
+	ds2784_program_alarm(di, poll_backoff ? SLOW_POLL : FAST_POLL);
+	local_irq_restore(flags);
+}
+
+/*
+ * htc_battery backs the sampling off while the screen is off on battery,
+ * whether or not something keeps us out of suspend. Turning it back on
+ * resamples right away if the last sample is older than FAST_POLL.
+ */
+void ds2784_set_poll_backoff(int on)
+{
+	struct ds2784_device_info *di = ds2784_di;
+	unsigned long flags;
+
+	if (!di || poll_backoff == on)
+		return;
+
+	local_irq_save(flags);
+	poll_backoff = on;
+	if (!on)
+		ds2784_program_alarm(di, FAST_POLL);
 	local_irq_restore(flags);
 }
+EXPORT_SYMBOL(ds2784_set_poll_backoff);
 static void ds2784_battery_alarm(struct alarm *alarm)
 {
 	struct ds2784_device_info *di =
@@ -1250,6 +1275,7 @@ static int ds2784_battery_probe(struct platform_device *pdev)
 			ds2784_battery_alarm);
 	wake_lock(&di->work_wake_lock);
 	queue_work(di->monitor_wqueue, &di->monitor_work);
+	ds2784_di = di;
 	return 0;
 
 fail_workqueue:
@@ -1262,6 +1288,7 @@ static int ds2784_battery_remove(struct platform_device *pdev)
 {
 	struct ds2784_device_info *di = platform_get_drvdata(pdev);
 
+	ds2784_di = NULL;
 	cancel_rearming_delayed_workqueue(di->monitor_wqueue,
 					  &di->monitor_work);
 	destroy_workqueue(di->monitor_wqueue);
@@ -1301,7 +1328,7 @@ static int ds2784_resume(struct platform_device *pdev)
 	gpio_direction_output(87, 1);
 	ndelay(100 * 1000);
 
-	if (di->slow_poll) {
+	if (di->slow_poll && !poll_backoff) {
 		local_irq_save(flags);
 		ds2784_program_alarm(di, FAST_POLL);
 		di->slow_poll = 0;
@@ -62,6 +62,7 @@ static long alarm_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	int rv = 0;
 	unsigned long flags;
 	struct timespec new_alarm_time;
+	struct android_alarm_window new_window;
 	struct timespec new_rtc_time;
 	struct timespec tmp_time;
 	enum android_alarm_type alarm_type = ANDROID_ALARM_IOCTL_TO_TYPE(cmd);
@@ -146,6 +147,26 @@ from_old_alarm_set:
 		alarm_pending = 0;
 		spin_unlock_irqrestore(&alarm_slock, flags);
 		break;
+	case ANDROID_ALARM_SET_WINDOW(0):
+		if (copy_from_user(&new_window, (void __user *)arg,
+		    sizeof(new_window))) {
+			rv = -EFAULT;
+			goto err1;
+		}
+		if (timespec_compare(&new_window.end, &new_window.start) < 0) {
+			rv = -EINVAL;
+			goto err1;
+		}
+		spin_lock_irqsave(&alarm_slock, flags);
+		pr_alarm(IO, "alarm %d set %ld.%09ld - %ld.%09ld\n", alarm_type,
+			new_window.start.tv_sec, new_window.start.tv_nsec,
+			new_window.end.tv_sec, new_window.end.tv_nsec);
+		alarm_enabled |= alarm_type_mask;
+		alarm_start_range(&alarms[alarm_type],
+			timespec_to_ktime(new_window.start),
+			timespec_to_ktime(new_window.end));
+		spin_unlock_irqrestore(&alarm_slock, flags);
+		break;
 	case ANDROID_ALARM_SET_RTC:
 		if (copy_from_user(&new_rtc_time, (void __user *)arg,
 		    sizeof(new_rtc_time))) {
@@ -15,11 +15,13 @@
 
 #include <asm/mach/time.h>
 #include <linux/android_alarm.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
 #include <linux/platform_device.h>
 #include <linux/rtc.h>
 #include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/spinlock.h>
 #include <linux/sysdev.h>
 #include <linux/wakelock.h>
@@ -68,6 +70,15 @@ static struct platform_device *alarm_platform_dev;
 struct alarm_queue alarms[ANDROID_ALARM_TYPE_COUNT];
 static bool suspended;
 
+/*
+ * Wakeup alarms delivered, and how many times a wakeup queue fired to
+ * deliver them. Each alarm beyond the first in one firing rode along on
+ * a wakeup it would otherwise have needed for itself.
+ */
+static unsigned long alarm_wakeup_fires;
+static unsigned long alarm_wakeup_alarms;
+static unsigned long alarm_wakeup_early;
+
 static void update_timer_locked(struct alarm_queue *base, bool head_removed)
 {
 	struct alarm *alarm;
@@ -314,43 +325,88 @@ ktime_t alarm_get_elapsed_realtime(void)
 	return now;
 }
 
-static enum hrtimer_restart alarm_timer_triggered(struct hrtimer *timer)
+/*
+ * Call every alarm in base whose window has opened by now. The queue is
+ * sorted on the end of the window, so an alarm further down can still
+ * be due; rescan from the head since the lock is dropped for each call.
+ */
+static int alarm_run_queue_locked(struct alarm_queue *base, ktime_t now,
+				  unsigned long *flags)
 {
-	struct alarm_queue *base;
+	struct rb_node *node;
 	struct alarm *alarm;
-	unsigned long flags;
-	ktime_t now;
+	int count = 0;
 
-	spin_lock_irqsave(&alarm_slock, flags);
-
-	base = container_of(timer, struct alarm_queue, timer);
-	now = base->stopped ? base->stopped_time : hrtimer_cb_get_time(timer);
-	now = ktime_sub(now, base->delta);
-
-	pr_alarm(INT, "alarm_timer_triggered type %d at %lld\n",
-		base - alarms, ktime_to_ns(now));
-
-	while (base->first) {
-		alarm = container_of(base->first, struct alarm, node);
-		if (alarm->softexpires.tv64 > now.tv64) {
+	for (;;) {
+		for (node = base->first; node; node = rb_next(node)) {
+			alarm = rb_entry(node, struct alarm, node);
+			if (alarm->softexpires.tv64 <= now.tv64)
+				break;
 			pr_alarm(FLOW, "don't call alarm, %pF, %lld (s %lld)\n",
 				alarm->function, ktime_to_ns(alarm->expires),
 				ktime_to_ns(alarm->softexpires));
-			break;
 		}
-		base->first = rb_next(&alarm->node);
-		rb_erase(&alarm->node, &base->alarms);
-		RB_CLEAR_NODE(&alarm->node);
+		if (!node)
+			break;
+		if (base->first == node)
+			base->first = rb_next(node);
+		rb_erase(node, &base->alarms);
+		RB_CLEAR_NODE(node);
+		if (alarm->expires.tv64 > now.tv64 &&
+		    (ANDROID_ALARM_WAKEUP_MASK & (1U << alarm->type)))
+			alarm_wakeup_early++;
+		count++;
 		pr_alarm(CALL, "call alarm, type %d, func %pF, %lld (s %lld)\n",
 			alarm->type, alarm->function,
 			ktime_to_ns(alarm->expires),
 			ktime_to_ns(alarm->softexpires));
-		spin_unlock_irqrestore(&alarm_slock, flags);
+		spin_unlock_irqrestore(&alarm_slock, *flags);
 		alarm->function(alarm);
-		spin_lock_irqsave(&alarm_slock, flags);
+		spin_lock_irqsave(&alarm_slock, *flags);
 	}
 	if (!base->first)
 		pr_alarm(FLOW, "no more alarms of type %d\n", base - alarms);
+	return count;
+}
+
+static enum hrtimer_restart alarm_timer_triggered(struct hrtimer *timer)
+{
+	struct alarm_queue *base;
+	struct alarm_queue *other = NULL;
+	unsigned long flags;
+	ktime_t now;
+	int count;
+	int other_count = 0;
+
+	spin_lock_irqsave(&alarm_slock, flags);
+
+	base = container_of(timer, struct alarm_queue, timer);
+	now = base->stopped ? base->stopped_time : hrtimer_cb_get_time(timer);
+
+	pr_alarm(INT, "alarm_timer_triggered type %d at %lld\n",
+		base - alarms, ktime_to_ns(ktime_sub(now, base->delta)));
+
+	if (base == &alarms[ANDROID_ALARM_RTC_WAKEUP])
+		other = &alarms[ANDROID_ALARM_ELAPSED_REALTIME_WAKEUP];
+	else if (base == &alarms[ANDROID_ALARM_ELAPSED_REALTIME_WAKEUP])
+		other = &alarms[ANDROID_ALARM_RTC_WAKEUP];
+
+	count = alarm_run_queue_locked(base, ktime_sub(now, base->delta),
+				       &flags);
+	/*
+	 * Both wakeup queues run on CLOCK_REALTIME, so now is valid for the
+	 * other one as well. Anything there whose window is already open
+	 * goes off on this wakeup instead of taking one of its own.
+	 */
+	if (other && !other->stopped)
+		other_count = alarm_run_queue_locked(other,
+				ktime_sub(now, other->delta), &flags);
+	if (other && count + other_count) {
+		alarm_wakeup_fires++;
+		alarm_wakeup_alarms += count + other_count;
+	}
+	if (other_count)
+		update_timer_locked(other, true);
 	update_timer_locked(base, true);
 	spin_unlock_irqrestore(&alarm_slock, flags);
 	return HRTIMER_NORESTART;
@@ -457,6 +513,43 @@ static int alarm_resume(struct platform_device *pdev)
 	return 0;
 }
 
+static int alarm_stats_show(struct seq_file *m, void *unused)
+{
+	unsigned long flags;
+	unsigned long fires, delivered, early;
+	unsigned long hours_x100;
+	s64 secs;
+
+	spin_lock_irqsave(&alarm_slock, flags);
+	fires = alarm_wakeup_fires;
+	delivered = alarm_wakeup_alarms;
+	early = alarm_wakeup_early;
+	spin_unlock_irqrestore(&alarm_slock, flags);
+
+	secs = ktime_to_timespec(alarm_get_elapsed_realtime()).tv_sec;
+	hours_x100 = max_t(unsigned long, div_s64(secs, 36), 1);
+
+	seq_printf(m, "wakeups: %lu\n", fires);
+	seq_printf(m, "alarms: %lu\n", delivered);
+	seq_printf(m, "early: %lu\n", early);
+	seq_printf(m, "saved: %lu\n", delivered - fires);
+	seq_printf(m, "saved/hour: %lu\n",
+		   (delivered - fires) * 100 / hours_x100);
+	return 0;
+}
+
+static int alarm_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, alarm_stats_show, NULL);
+}
+
+static const struct file_operations alarm_stats_fops = {
+	.open		= alarm_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static struct rtc_task alarm_rtc_task = {
 	.func = alarm_triggered_func
 };
@@ -539,6 +632,9 @@ static int __init alarm_late_init(void)
 			timespec_to_ktime(timespec_sub(tmp_time, system_time));
 
 	spin_unlock_irqrestore(&alarm_slock, flags);
+
+	debugfs_create_file("alarm_stats", S_IRUGO, NULL, NULL,
+			    &alarm_stats_fops);
 	return 0;
 }
 
@@ -673,7 +673,7 @@ static int msm_serial_debug_remove(const char *val, struct kernel_param *kp)
 #endif
 	free_irq(init_data.wakeup_irq, 0);
 	free_irq(init_data.signal_irq, 0);
-	msm_fiq_set_handler(NULL, 0);
+	msm_fiq_remove_handler(debug_fiq);
 	msm_fiq_disable(init_data.irq);
 	msm_fiq_unselect(init_data.irq);
 	if (debug_clk_enabled)
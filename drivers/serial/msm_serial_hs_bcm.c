@@ -133,11 +133,18 @@ struct msm_hs_rx {
 	u32 *command_ptr_ptr;
 	dma_addr_t mapped_cmd_ptr;
 	wait_queue_head_t wait;
-	dma_addr_t rbuffer;
-	unsigned char *buffer;
+	/* two buffers: the next transfer is armed before the last is copied */
+	dma_addr_t rbuffer[2];
+	unsigned char *buffer[2];
+	unsigned int cur;
 	struct dma_pool *pool;
 	struct wake_lock wake_lock;
 	struct work_struct tty_work;
+	/* statistics */
+	unsigned long bytes;
+	unsigned long xfers;
+	unsigned long full;
+	unsigned long pushes;
 	struct wake_lock brcm_rx_wake_lock;
 	unsigned int is_brcm_rx_wake_locked;
 };
@@ -175,6 +182,9 @@ struct msm_hs_port {
 
 	struct wake_lock dma_wake_lock;  /* held while any DMA active */
 
+	unsigned int rx_stale;		/* char times, 0 for the bps default */
+	unsigned int rx_stale_default;
+
 	#ifdef SERIAL_CPU_LOCK_SUPPORTED
 	unsigned char cpu_lock_supported;
 	unsigned char is_cpu_lock;
@@ -196,7 +206,7 @@ struct msm_hs_port {
 
 #define MSM_UARTDM_BURST_SIZE 16   /* DM burst size (in bytes) */
 #define UARTDM_TX_BUF_SIZE UART_XMIT_SIZE
-#define UARTDM_RX_BUF_SIZE 512
+#define UARTDM_RX_BUF_SIZE 2048
 
 #define UARTDM_NR 2
 
@@ -370,8 +380,10 @@ static int __devexit msm_hs_remove(struct platform_device *pdev)
 
 	dma_unmap_single(dev, msm_uport->rx.mapped_cmd_ptr, sizeof(dmov_box),
 			 DMA_TO_DEVICE);
-	dma_pool_free(msm_uport->rx.pool, msm_uport->rx.buffer,
-		      msm_uport->rx.rbuffer);
+	dma_pool_free(msm_uport->rx.pool, msm_uport->rx.buffer[0],
+		      msm_uport->rx.rbuffer[0]);
+	dma_pool_free(msm_uport->rx.pool, msm_uport->rx.buffer[1],
+		      msm_uport->rx.rbuffer[1]);
 	dma_pool_destroy(msm_uport->rx.pool);
 
 	dma_unmap_single(dev, msm_uport->rx.cmdptr_dmaaddr, sizeof(u32 *),
@@ -449,6 +461,17 @@ static void msm_hs_pm(struct uart_port *uport, unsigned int state,
 	}
 }
 
+static void msm_hs_write_stale_locked(struct uart_port *uport,
+				      unsigned int rxstale)
+{
+	unsigned long data;
+
+	data = rxstale & UARTDM_IPR_STALE_LSB_BMSK;
+	data |= UARTDM_IPR_STALE_TIMEOUT_MSB_BMSK & (rxstale << 2);
+
+	msm_hs_write(uport, UARTDM_IPR_ADDR, data);
+}
+
 /*
  * programs the UARTDM_CSR register with correct bit rates
  *
@@ -556,10 +579,10 @@ static void msm_hs_set_bps_locked(struct uart_port *uport,
 		return;
 	}
 
-	data = rxstale & UARTDM_IPR_STALE_LSB_BMSK;
-	data |= UARTDM_IPR_STALE_TIMEOUT_MSB_BMSK & (rxstale << 2);
-
-	msm_hs_write(uport, UARTDM_IPR_ADDR, data);
+	msm_uport->rx_stale_default = rxstale;
+	if (msm_uport->rx_stale)
+		rxstale = msm_uport->rx_stale;
+	msm_hs_write_stale_locked(uport, rxstale);
 }
 
 /*
@@ -787,6 +810,11 @@ static void msm_hs_submit_tx_locked(struct uart_port *uport)
 static void msm_hs_start_rx_locked(struct uart_port *uport)
 {
 	struct msm_hs_port *msm_uport = UARTDM_TO_MSM(uport);
+	struct msm_hs_rx *rx = &msm_uport->rx;
+
+	rx->command_ptr->dst_row_addr = rx->rbuffer[rx->cur];
+	dma_sync_single_for_device(uport->dev, rx->mapped_cmd_ptr,
+				   sizeof(dmov_box), DMA_TO_DEVICE);
 
 	msm_hs_write(uport, UARTDM_CR_ADDR, RESET_STALE_INT);
 	msm_hs_write(uport, UARTDM_DMRX_ADDR, UARTDM_RX_BUF_SIZE);
@@ -864,6 +892,7 @@ static void msm_hs_dmov_rx_callback(struct msm_dmov_cmd *cmd_ptr,
 	unsigned int error_f = 0;
 	unsigned long flags;
 	unsigned int flush;
+	unsigned char *buffer;
 	struct tty_struct *tty;
 	struct uart_port *uport;
 	struct msm_hs_port *msm_uport;
@@ -915,14 +944,21 @@ static void msm_hs_dmov_rx_callback(struct msm_dmov_cmd *cmd_ptr,
 
 	rx_count = msm_hs_read(uport, UARTDM_RX_TOTAL_SNAP_ADDR);
 
+	/* rearm on the other buffer first, the fifo keeps filling meanwhile */
+	buffer = msm_uport->rx.buffer[msm_uport->rx.cur];
+	msm_uport->rx.cur ^= 1;
+	msm_hs_start_rx_locked(uport);
+
+	msm_uport->rx.xfers++;
+	msm_uport->rx.bytes += rx_count;
+	if (rx_count == UARTDM_RX_BUF_SIZE)
+		msm_uport->rx.full++;
+
 	if (0 != (uport->read_status_mask & CREAD)) {
-		retval = tty_insert_flip_string(tty, msm_uport->rx.buffer,
-						rx_count);
+		retval = tty_insert_flip_string(tty, buffer, rx_count);
 		BUG_ON(retval != rx_count);
 	}
 
-	msm_hs_start_rx_locked(uport);
-
 out:
 	clk_disable(msm_uport->clk);
 	/* release wakelock in 500ms, not immediately, because higher layers
@@ -930,8 +966,10 @@ out:
 	wake_lock_timeout(&msm_uport->rx.wake_lock, HZ / 2);
 	spin_unlock_irqrestore(&uport->lock, flags);
 
-	if (flush < FLUSH_DATA_INVALID)
-		queue_work(msm_hs_workqueue, &msm_uport->rx.tty_work);
+	/* a push already queued picks up what was just inserted */
+	if (flush < FLUSH_DATA_INVALID &&
+	    queue_work(msm_hs_workqueue, &msm_uport->rx.tty_work))
+		msm_uport->rx.pushes++;
 }
 
 static void msm_hs_tty_flip_buffer_work(struct work_struct *work)
@@ -943,6 +981,49 @@ static void msm_hs_tty_flip_buffer_work(struct work_struct *work)
 	tty_flip_buffer_push(tty);
 }
 
+static ssize_t msm_hs_rx_stale_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct msm_hs_port *msm_uport = &q_uart_port[to_platform_device(dev)->id];
+
+	return sprintf(buf, "%u\n", msm_uport->rx_stale);
+}
+
+static ssize_t msm_hs_rx_stale_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct msm_hs_port *msm_uport = &q_uart_port[to_platform_device(dev)->id];
+	struct uart_port *uport = &msm_uport->uport;
+	unsigned long flags;
+
+	spin_lock_irqsave(&uport->lock, flags);
+	msm_uport->rx_stale = simple_strtoul(buf, NULL, 10);
+	if (msm_uport->clk_state != MSM_HS_CLK_PORT_OFF) {
+		clk_enable(msm_uport->clk);
+		msm_hs_write_stale_locked(uport, msm_uport->rx_stale ?:
+					  msm_uport->rx_stale_default);
+		clk_disable(msm_uport->clk);
+	}
+	spin_unlock_irqrestore(&uport->lock, flags);
+	return count;
+}
+
+static DEVICE_ATTR(rx_stale, 0644, msm_hs_rx_stale_show,
+		   msm_hs_rx_stale_store);
+
+static ssize_t msm_hs_rx_stats_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct msm_hs_rx *rx = &q_uart_port[to_platform_device(dev)->id].rx;
+
+	return sprintf(buf, "bytes %lu\nxfers %lu\nfull %lu\npushes %lu\n"
+		       "bytes/xfer %lu\n", rx->bytes, rx->xfers, rx->full,
+		       rx->pushes, rx->xfers ? rx->bytes / rx->xfers : 0);
+}
+
+static DEVICE_ATTR(rx_stats, 0444, msm_hs_rx_stats_show, NULL);
+
 /*
  *  Standard API, Current states of modem control inputs
  *
@@ -1772,7 +1853,9 @@ static int uartdm_init_port(struct uart_port *uport)
 	rx->pool = dma_pool_create("rx_buffer_pool", uport->dev,
 				   UARTDM_RX_BUF_SIZE, 16, 0);
 
-	rx->buffer = dma_pool_alloc(rx->pool, GFP_KERNEL, &rx->rbuffer);
+	rx->buffer[0] = dma_pool_alloc(rx->pool, GFP_KERNEL, &rx->rbuffer[0]);
+	rx->buffer[1] = dma_pool_alloc(rx->pool, GFP_KERNEL, &rx->rbuffer[1]);
+	rx->cur = 0;
 
 	/* Allocate the command pointer. Needs to be 64 bit aligned */
 	rx->command_ptr = kmalloc(sizeof(dmov_box), GFP_KERNEL | __GFP_DMA);
@@ -1780,13 +1863,13 @@ static int uartdm_init_port(struct uart_port *uport)
 	rx->command_ptr_ptr = kmalloc(sizeof(u32 *), GFP_KERNEL | __GFP_DMA);
 
 	if (!rx->command_ptr || !rx->command_ptr_ptr || !rx->pool ||
-	    !rx->buffer)
+	    !rx->buffer[0] || !rx->buffer[1])
 		return -ENOMEM;
 
 	rx->command_ptr->num_rows = ((UARTDM_RX_BUF_SIZE >> 4) << 16) |
 					 (UARTDM_RX_BUF_SIZE >> 4);
 
-	rx->command_ptr->dst_row_addr = rx->rbuffer;
+	rx->command_ptr->dst_row_addr = rx->rbuffer[0];
 
 	rx->mapped_cmd_ptr = dma_map_single(uport->dev, rx->command_ptr,
 					    sizeof(dmov_box), DMA_TO_DEVICE);
@@ -1945,6 +2028,10 @@ static int __init msm_hs_probe(struct platform_device *pdev)
 
 	uport->line = pdev->id;
 
+	if (device_create_file(&pdev->dev, &dev_attr_rx_stale) ||
+	    device_create_file(&pdev->dev, &dev_attr_rx_stats))
+		printk(KERN_WARNING "msm_serial_hs: no rx sysfs entries\n");
+
 	#ifdef BT_SERIAL_OPEN_ONCE
 	/* set initial state */
 	if (pdev->id == 0)
@@ -28,13 +28,32 @@
 #include <linux/poll.h>
 #include <linux/proc_fs.h>
 #include <linux/rbtree.h>
+#include <linux/slab.h>
 #include <linux/sched.h>
 #include <linux/uaccess.h>
 #include <linux/vmalloc.h>
 
 #include "binder.h"
 
-static DEFINE_MUTEX(binder_lock);
+#define CREATE_TRACE_POINTS
+#include <trace/events/binder.h>
+
+/*
+ * Locking:
+ *
+ * binder_main_lock protects the node/ref graph, all threads, todo lists and
+ * transaction stacks, and the global lists below.
+ *
+ * binder_proc->alloc_lock protects the buffer allocator of a single proc
+ * (buffers, free_buffers, allocated_buffers, pages, free_async_space). It
+ * nests inside binder_main_lock, and is also taken on its own while a
+ * transaction payload is copied into the target buffer, so that copies for
+ * unrelated process pairs do not serialise on binder_main_lock.
+ *
+ * Lock order: binder_main_lock -> proc->alloc_lock -> mm->mmap_sem.
+ * binder_mmap() is called with mmap_sem held and must not take alloc_lock.
+ */
+static DEFINE_MUTEX(binder_main_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
 
 static HLIST_HEAD(binder_procs);
@@ -48,6 +67,13 @@ static uid_t binder_context_mgr_uid = -1;
 static int binder_last_id;
 static struct workqueue_struct *binder_deferred_workqueue;
 
+/* the objects every transaction allocates get caches of their own */
+static struct kmem_cache *binder_node_cachep __read_mostly;
+static struct kmem_cache *binder_ref_cachep __read_mostly;
+static struct kmem_cache *binder_ref_death_cachep __read_mostly;
+static struct kmem_cache *binder_transaction_cachep __read_mostly;
+static struct kmem_cache *binder_work_cachep __read_mostly;
+
 static int binder_read_proc_proc(char *page, char **start, off_t off,
 				 int count, int *eof, void *data);
 
@@ -64,6 +90,17 @@ static int binder_read_proc_proc(char *page, char **start, off_t off,
 
 #define BINDER_SMALL_BUF_SIZE (PAGE_SIZE * 64)
 
+/*
+ * Small buffers are allocated in fixed size classes and, when freed, are
+ * parked on a per-proc free list with their pages still mapped instead of
+ * going back to the free_buffers tree.
+ */
+#define BINDER_POOL_CLASSES                 4
+#define BINDER_POOL_MIN_SIZE                32
+#define BINDER_POOL_MAX_SIZE                (BINDER_POOL_MIN_SIZE << \
+					     (BINDER_POOL_CLASSES - 1))
+#define BINDER_POOL_MAX_PER_CLASS           16
+
 enum {
 	BINDER_DEBUG_USER_ERROR             = 1U << 0,
 	BINDER_DEBUG_FAILED_TRANSACTION     = 1U << 1,
@@ -90,6 +127,20 @@ module_param_named(debug_mask, binder_debug_mask, uint, S_IWUSR | S_IRUGO);
 static int binder_debug_no_lock;
 module_param_named(proc_no_lock, binder_debug_no_lock, bool, S_IWUSR | S_IRUGO);
 
+/* free pages stay mapped until a proc has more than this many mapped */
+static int binder_lazy_reclaim_pages = 16;
+module_param_named(lazy_reclaim_pages, binder_lazy_reclaim_pages, int,
+		   S_IWUSR | S_IRUGO);
+
+/* percentage of a target's async space one sending process may hold */
+static int binder_async_sender_share = 25;
+module_param_named(async_sender_share, binder_async_sender_share, int,
+		   S_IWUSR | S_IRUGO);
+
+/* oneway transactions to one node handed to a thread in a single read */
+static int binder_async_batch = 4;
+module_param_named(async_batch, binder_async_batch, int, S_IWUSR | S_IRUGO);
+
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -132,13 +183,70 @@ enum binder_stat_types {
 
 struct binder_stats {
 	int br[_IOC_NR(BR_FAILED_REPLY) + 1];
-	int bc[_IOC_NR(BC_DEAD_BINDER_DONE) + 1];
+	int bc[_IOC_NR(BC_REPLY_SG) + 1];
 	int obj_created[BINDER_STAT_COUNT];
 	int obj_deleted[BINDER_STAT_COUNT];
 };
 
 static struct binder_stats binder_stats;
 
+struct binder_lock_stats {
+	unsigned long acquired;
+	unsigned long contended;
+	u64 wait_ns;
+	u64 hold_ns;
+	u64 max_hold_ns;
+	u64 locked_at;
+};
+
+static struct binder_lock_stats binder_main_lock_stats;
+
+/* returns the time spent waiting for the lock */
+static u64 binder_mutex_lock(struct mutex *lock,
+			     struct binder_lock_stats *stats)
+{
+	u64 now = sched_clock();
+	u64 wait = 0;
+
+	if (!mutex_trylock(lock)) {
+		u64 start = now;
+
+		mutex_lock(lock);
+		now = sched_clock();
+		wait = now - start;
+		stats->contended++;
+		stats->wait_ns += wait;
+	}
+	stats->acquired++;
+	stats->locked_at = now;
+	return wait;
+}
+
+/* returns the time the lock was held */
+static u64 binder_mutex_unlock(struct mutex *lock,
+			       struct binder_lock_stats *stats)
+{
+	u64 held = sched_clock() - stats->locked_at;
+
+	stats->hold_ns += held;
+	if (held > stats->max_hold_ns)
+		stats->max_hold_ns = held;
+	mutex_unlock(lock);
+	return held;
+}
+
+static inline void binder_lock(void)
+{
+	trace_binder_locked(binder_mutex_lock(&binder_main_lock,
+					      &binder_main_lock_stats));
+}
+
+static inline void binder_unlock(void)
+{
+	trace_binder_unlock(binder_mutex_unlock(&binder_main_lock,
+						&binder_main_lock_stats));
+}
+
 static inline void binder_stats_deleted(enum binder_stat_types type)
 {
 	binder_stats.obj_deleted[type]++;
@@ -149,6 +257,36 @@ static inline void binder_stats_created(enum binder_stat_types type)
 	binder_stats.obj_created[type]++;
 }
 
+/*
+ * Bucket 0 counts latencies below 1 us, bucket i latencies of
+ * [2^(i-1), 2^i) us; the last bucket also takes everything above.
+ */
+#define BINDER_LATENCY_BUCKETS 20
+
+struct binder_latency_hist {
+	unsigned int count;
+	u64 total_ns;
+	u64 max_ns;
+	unsigned int bucket[BINDER_LATENCY_BUCKETS];
+};
+
+static void binder_latency_add(struct binder_latency_hist *hist, u64 delta)
+{
+	u64 us = delta;
+	int i;
+
+	do_div(us, NSEC_PER_USEC);
+	if (us >= 1U << (BINDER_LATENCY_BUCKETS - 2))
+		i = BINDER_LATENCY_BUCKETS - 1;
+	else
+		i = fls((u32)us);
+	hist->bucket[i]++;
+	hist->count++;
+	hist->total_ns += delta;
+	if (delta > hist->max_ns)
+		hist->max_ns = delta;
+}
+
 struct binder_transaction_log_entry {
 	int debug_id;
 	int call_type;
@@ -217,6 +355,11 @@ struct binder_node {
 	unsigned accept_fds:1;
 	unsigned min_priority:8;
 	struct list_head async_todo;
+	int async_depth;	/* entries on async_todo */
+	int async_max_depth;
+	int async_batched;	/* delivered with a batch, not yet freed */
+	unsigned int async_batched_total;
+	struct binder_latency_hist latency; /* enqueue to reply/delivery */
 };
 
 struct binder_ref_death {
@@ -243,18 +386,24 @@ struct binder_ref {
 
 struct binder_buffer {
 	struct list_head entry; /* free and allocated entries by addesss */
-	struct rb_node rb_node; /* free entry by size or allocated entry */
-				/* by address */
+	union {
+		struct rb_node rb_node; /* free entry by size or allocated */
+					/* entry by address */
+		struct list_head pool_entry; /* pooled small buffer */
+	};
 	unsigned free:1;
 	unsigned allow_user_free:1;
 	unsigned async_transaction:1;
-	unsigned debug_id:29;
+	unsigned pooled:1;
+	unsigned debug_id:28;
+	int async_from;	/* sender charged for an async buffer, or 0 */
 
 	struct binder_transaction *transaction;
 
 	struct binder_node *target_node;
 	size_t data_size;
 	size_t offsets_size;
+	size_t extra_buffers_size;	/* BINDER_TYPE_PTR copies */
 	uint8_t data[0];
 };
 
@@ -264,12 +413,34 @@ enum binder_deferred_state {
 	BINDER_DEFERRED_RELEASE      = 0x04,
 };
 
+/* async buffer space held in a target by one sending process */
+struct binder_async_sender {
+	int pid;
+	size_t size;
+};
+
+#define BINDER_ASYNC_SENDERS 8
+
+/*
+ * Descriptors are handed out lowest free first, so most of a process's
+ * refs have small ones. Those are found through ref_by_desc[] instead of
+ * the refs_by_desc tree, which then only has to be searched above it.
+ */
+#define BINDER_REF_DIRECT 64
+
+/* scheduling class a thread runs at while serving a transaction */
+struct binder_priority {
+	unsigned int sched_policy;
+	int prio;	/* rt_priority for SCHED_FIFO/RR, nice otherwise */
+};
+
 struct binder_proc {
 	struct hlist_node proc_node;
 	struct rb_root threads;
 	struct rb_root nodes;
 	struct rb_root refs_by_desc;
 	struct rb_root refs_by_node;
+	struct binder_ref *ref_by_desc[BINDER_REF_DIRECT];
 	int pid;
 	struct vm_area_struct *vma;
 	struct task_struct *tsk;
@@ -279,23 +450,43 @@ struct binder_proc {
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
+	struct mutex alloc_lock;
+	struct binder_lock_stats alloc_lock_stats;
+	atomic_t tmp_ref;
+	int is_dead;
+
 	struct list_head buffers;
 	struct rb_root free_buffers;
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
+	struct binder_async_sender async_senders[BINDER_ASYNC_SENDERS];
+	int async_quota_denied;
+
+	struct list_head buffer_pool[BINDER_POOL_CLASSES];
+	int buffer_pool_count[BINDER_POOL_CLASSES];
+	int buffer_pool_hits;
+	int buffer_pool_misses;
+	int pages_mapped;
+	int pages_reused;
 
 	struct page **pages;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	struct list_head todo;
 	wait_queue_head_t wait;
+	struct list_head waiting_threads; /* most recently idle first */
+	int wakeups;
+	int spurious_wakeups;
 	struct binder_stats stats;
+	struct binder_latency_hist wakeup_latency;
+	struct binder_latency_hist reply_latency;
 	struct list_head delivered_death;
+	struct list_head death_batch_entry; /* on a dying proc's recipients */
 	int max_threads;
 	int requested_threads;
 	int requested_threads_started;
 	int ready_threads;
-	long default_priority;
+	struct binder_priority default_priority;
 };
 
 enum {
@@ -310,6 +501,7 @@ enum {
 struct binder_thread {
 	struct binder_proc *proc;
 	struct rb_node rb_node;
+	struct list_head waiting_thread_node;
 	int pid;
 	int looper;
 	struct binder_transaction *transaction_stack;
@@ -336,14 +528,62 @@ struct binder_transaction {
 	struct binder_buffer *buffer;
 	unsigned int	code;
 	unsigned int	flags;
-	long	priority;
-	long	saved_priority;
+	struct binder_priority	priority;
+	struct binder_priority	saved_priority;
+	/* caller's group, then the server's own while it serves the call */
+	struct task_group	*sched_group;
+	struct task_group	*saved_group;
 	uid_t	sender_euid;
+	u64	enqueue_time;
 };
 
 static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
 
+/*
+ * Wake one thread for proc-level work. Threads waiting for proc work sleep
+ * on their own wait queue and are kept in proc->waiting_threads with the
+ * most recently idle thread first, since it is the most likely to still be
+ * cache hot. The chosen thread is taken off the list, so back-to-back work
+ * items wake distinct threads. Only if no looper is waiting are pollers on
+ * proc->wait woken.
+ */
+static void binder_wakeup_proc(struct binder_proc *proc)
+{
+	struct binder_thread *thread;
+
+	if (!list_empty(&proc->waiting_threads)) {
+		thread = list_first_entry(&proc->waiting_threads,
+					  struct binder_thread,
+					  waiting_thread_node);
+		list_del_init(&thread->waiting_thread_node);
+		wake_up_interruptible(&thread->wait);
+		return;
+	}
+	wake_up_interruptible(&proc->wait);
+}
+
+static inline void binder_alloc_lock(struct binder_proc *proc)
+{
+	binder_mutex_lock(&proc->alloc_lock, &proc->alloc_lock_stats);
+}
+
+static inline void binder_alloc_unlock(struct binder_proc *proc)
+{
+	binder_mutex_unlock(&proc->alloc_lock, &proc->alloc_lock_stats);
+}
+
+/*
+ * A binder_proc is freed when its last reference is dropped. The file owns
+ * one reference; binder_transaction() holds another on the target while it
+ * copies the payload without binder_main_lock.
+ */
+static void binder_proc_dec_tmpref(struct binder_proc *proc)
+{
+	if (atomic_dec_and_test(&proc->tmp_ref))
+		kfree(proc);
+}
+
 /*
  * copied from get_unused_fd_flags
  */
@@ -499,6 +739,87 @@ static void binder_set_nice(long nice)
 	binder_user_error("binder: %d RLIMIT_NICE not set\n", current->pid);
 }
 
+static inline int binder_rt_policy(unsigned int policy)
+{
+	return policy == SCHED_FIFO || policy == SCHED_RR;
+}
+
+static void binder_get_priority(struct task_struct *task,
+				struct binder_priority *p)
+{
+	p->sched_policy = task->policy;
+	if (binder_rt_policy(p->sched_policy))
+		p->prio = task->rt_priority;
+	else
+		p->prio = task_nice(task);
+}
+
+/*
+ * Switch current to @desired. A realtime policy needs CAP_SYS_NICE or a
+ * large enough RLIMIT_RTPRIO, else the strongest nice value the thread may
+ * take is used instead. Restoring a thread's own earlier priority,
+ * @verify == 0, is never refused.
+ */
+static void binder_do_set_priority(struct binder_priority *desired,
+				   int verify)
+{
+	struct sched_param param = { .sched_priority = 0 };
+	unsigned int policy = desired->sched_policy;
+	int prio = desired->prio;
+
+	if (verify && binder_rt_policy(policy) && !capable(CAP_SYS_NICE) &&
+	    prio > current->signal->rlim[RLIMIT_RTPRIO].rlim_cur) {
+		binder_debug(BINDER_DEBUG_PRIORITY_CAP,
+			     "binder: %d: rt priority %d not allowed, "
+			     "using nice instead\n", current->pid, prio);
+		policy = SCHED_NORMAL;
+		prio = -20;
+	}
+
+	if (binder_rt_policy(policy))
+		param.sched_priority = prio;
+	if (policy != current->policy ||
+	    (binder_rt_policy(policy) && prio != current->rt_priority))
+		sched_setscheduler_nocheck(current, policy, &param);
+
+	if (binder_rt_policy(policy))
+		return;
+	if (verify)
+		binder_set_nice(prio);
+	else
+		set_user_nice(current, prio);
+}
+
+static void binder_set_priority(struct binder_priority *desired)
+{
+	binder_do_set_priority(desired, 1);
+}
+
+static void binder_restore_priority(struct binder_priority *saved)
+{
+	binder_do_set_priority(saved, 0);
+}
+
+/*
+ * Serve synchronous transaction @t at its caller's policy, priority and
+ * cpu group, no weaker than @node's floor for normal callers, saving ours
+ * in @t until the reply.
+ */
+static void binder_transaction_priority(struct binder_transaction *t,
+					struct binder_node *node)
+{
+	struct binder_priority desired = t->priority;
+
+	binder_get_priority(current, &t->saved_priority);
+	if (!binder_rt_policy(desired.sched_policy) &&
+	    desired.prio > node->min_priority)
+		desired.prio = node->min_priority;
+	binder_set_priority(&desired);
+
+	t->saved_group = sched_set_task_group(current, t->sched_group);
+	t->sched_group = NULL;
+}
+
 static size_t binder_buffer_size(struct binder_proc *proc,
 				 struct binder_buffer *buffer)
 {
@@ -608,6 +929,9 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 	if (end <= start)
 		return 0;
 
+	if (allocate == 0 && proc->pages_mapped <= binder_lazy_reclaim_pages)
+		return 0;
+
 	if (vma)
 		mm = NULL;
 	else
@@ -632,13 +956,18 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		struct page **page_array_ptr;
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
 
-		BUG_ON(*page);
+		if (*page) {
+			/* left mapped by a lazy free */
+			proc->pages_reused++;
+			continue;
+		}
 		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
 		if (*page == NULL) {
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
 			       "for page at %p\n", proc->pid, page_addr);
 			goto err_alloc_page_failed;
 		}
+		proc->pages_mapped++;
 		tmp_area.addr = page_addr;
 		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
 		page_array_ptr = page;
@@ -670,6 +999,8 @@ free_range:
 	for (page_addr = end - PAGE_SIZE; page_addr >= start;
 	     page_addr -= PAGE_SIZE) {
 		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+		if (*page == NULL)
+			continue;
 		if (vma)
 			zap_page_range(vma, (uintptr_t)page_addr +
 				proc->user_buffer_offset, PAGE_SIZE, NULL);
@@ -678,6 +1009,7 @@ err_vm_insert_page_failed:
 err_map_kernel_failed:
 		__free_page(*page);
 		*page = NULL;
+		proc->pages_mapped--;
 err_alloc_page_failed:
 		;
 	}
@@ -689,17 +1021,55 @@ err_no_vma:
 	return -ENOMEM;
 }
 
+static int binder_drain_buffer_pool(struct binder_proc *proc);
+
+static int binder_pool_class(size_t size)
+{
+	int class = 0;
+
+	while (size > (BINDER_POOL_MIN_SIZE << class))
+		class++;
+	return class;
+}
+
+/*
+ * Find the slot charging async space in proc to the sender pid, or a
+ * free one for it. With every slot in use the sender goes unaccounted,
+ * which only happens when many processes each hold a little.
+ */
+static struct binder_async_sender *
+binder_async_sender(struct binder_proc *proc, int pid)
+{
+	struct binder_async_sender *s, *unused = NULL;
+	int i;
+
+	for (i = 0; i < BINDER_ASYNC_SENDERS; i++) {
+		s = &proc->async_senders[i];
+		if (s->size && s->pid == pid)
+			return s;
+		if (!s->size && !unused)
+			unused = s;
+	}
+	if (unused)
+		unused->pid = pid;
+	return unused;
+}
+
 static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 					      size_t data_size,
-					      size_t offsets_size, int is_async)
+					      size_t offsets_size,
+					      size_t extra_buffers_size,
+					      int is_async, int async_from)
 {
-	struct rb_node *n = proc->free_buffers.rb_node;
+	struct binder_async_sender *sender = NULL;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	size_t buffer_size;
-	struct rb_node *best_fit = NULL;
+	struct rb_node *best_fit;
 	void *has_page_addr;
 	void *end_page_addr;
-	size_t size;
+	size_t size, alloc_size;
+	int pooled = 0;
 
 	if (proc->vma == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf, no vma\n",
@@ -715,6 +1085,13 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 			"size %zd-%zd\n", proc->pid, data_size, offsets_size);
 		return NULL;
 	}
+	size += ALIGN(extra_buffers_size, sizeof(void *));
+	if (size < extra_buffers_size) {
+		binder_user_error("binder: %d: got transaction with invalid "
+			"extra buffers size %zd\n", proc->pid,
+			extra_buffers_size);
+		return NULL;
+	}
 
 	if (is_async &&
 	    proc->free_async_space < size + sizeof(struct binder_buffer)) {
@@ -724,15 +1101,53 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		return NULL;
 	}
 
+	/* keep one flooding sender from starving the others */
+	if (is_async)
+		sender = binder_async_sender(proc, async_from);
+	if (sender && sender->size + size + sizeof(struct binder_buffer) >
+	    proc->buffer_size / 2 * binder_async_sender_share / 100) {
+		proc->async_quota_denied++;
+		binder_debug(BINDER_DEBUG_BUFFER_ALLOC_ASYNC,
+			     "binder: %d: binder_alloc_buf size %zd "
+			     "failed, sender %d over async quota\n",
+			     proc->pid, size, async_from);
+		return NULL;
+	}
+
+	alloc_size = size;
+	if (size <= BINDER_POOL_MAX_SIZE) {
+		int class = binder_pool_class(size);
+
+		if (!list_empty(&proc->buffer_pool[class])) {
+			buffer = list_first_entry(&proc->buffer_pool[class],
+						  struct binder_buffer,
+						  pool_entry);
+			list_del(&buffer->pool_entry);
+			proc->buffer_pool_count[class]--;
+			proc->buffer_pool_hits++;
+			binder_insert_allocated_buffer(proc, buffer);
+			binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+				     "binder: %d: binder_alloc_buf size %zd "
+				     "got pooled %p\n", proc->pid, size, buffer);
+			goto got_buffer;
+		}
+		proc->buffer_pool_misses++;
+		alloc_size = BINDER_POOL_MIN_SIZE << class;
+		pooled = 1;
+	}
+
+retry:
+	n = proc->free_buffers.rb_node;
+	best_fit = NULL;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(!buffer->free);
 		buffer_size = binder_buffer_size(proc, buffer);
 
-		if (size < buffer_size) {
+		if (alloc_size < buffer_size) {
 			best_fit = n;
 			n = n->rb_left;
-		} else if (size > buffer_size)
+		} else if (alloc_size > buffer_size)
 			n = n->rb_right;
 		else {
 			best_fit = n;
@@ -740,6 +1155,8 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		}
 	}
 	if (best_fit == NULL) {
+		if (binder_drain_buffer_pool(proc))
+			goto retry;
 		printk(KERN_ERR "binder: %d: binder_alloc_buf size %zd failed, "
 		       "no address space\n", proc->pid, size);
 		return NULL;
@@ -756,10 +1173,10 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	has_page_addr =
 		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK);
 	if (n == NULL) {
-		if (size + sizeof(struct binder_buffer) + 4 >= buffer_size)
-			buffer_size = size; /* no room for other buffers */
+		if (alloc_size + sizeof(struct binder_buffer) + 4 >= buffer_size)
+			buffer_size = alloc_size; /* no room for other buffers */
 		else
-			buffer_size = size + sizeof(struct binder_buffer);
+			buffer_size = alloc_size + sizeof(struct binder_buffer);
 	}
 	end_page_addr =
 		(void *)PAGE_ALIGN((uintptr_t)buffer->data + buffer_size);
@@ -771,19 +1188,27 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 
 	rb_erase(best_fit, &proc->free_buffers);
 	buffer->free = 0;
+	buffer->pooled = pooled;
 	binder_insert_allocated_buffer(proc, buffer);
-	if (buffer_size != size) {
-		struct binder_buffer *new_buffer = (void *)buffer->data + size;
+	if (buffer_size != alloc_size) {
+		struct binder_buffer *new_buffer = (void *)buffer->data +
+						   alloc_size;
 		list_add(&new_buffer->entry, &buffer->entry);
 		new_buffer->free = 1;
+		new_buffer->pooled = 0;
 		binder_insert_free_buffer(proc, new_buffer);
 	}
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_alloc_buf size %zd got "
 		     "%p\n", proc->pid, size, buffer);
+got_buffer:
 	buffer->data_size = data_size;
 	buffer->offsets_size = offsets_size;
+	buffer->extra_buffers_size = extra_buffers_size;
 	buffer->async_transaction = is_async;
+	buffer->async_from = sender ? async_from : 0;
+	if (sender)
+		sender->size += size + sizeof(struct binder_buffer);
 	if (is_async) {
 		proc->free_async_space -= size + sizeof(struct binder_buffer);
 		binder_debug(BINDER_DEBUG_BUFFER_ALLOC_ASYNC,
@@ -852,6 +1277,68 @@ static void binder_delete_free_buffer(struct binder_proc *proc,
 	}
 }
 
+/*
+ * Return an allocated buffer, already removed from allocated_buffers, to
+ * the free_buffers tree, merging it with free neighbours.
+ */
+static void binder_merge_free_buf(struct binder_proc *proc,
+				  struct binder_buffer *buffer)
+{
+	size_t buffer_size = binder_buffer_size(proc, buffer);
+
+	binder_update_page_range(proc, 0,
+		(void *)PAGE_ALIGN((uintptr_t)buffer->data),
+		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK),
+		NULL);
+	buffer->free = 1;
+	buffer->pooled = 0;
+	if (!list_is_last(&buffer->entry, &proc->buffers)) {
+		struct binder_buffer *next = list_entry(buffer->entry.next,
+						struct binder_buffer, entry);
+		if (next->free) {
+			rb_erase(&next->rb_node, &proc->free_buffers);
+			binder_delete_free_buffer(proc, next);
+		}
+	}
+	if (proc->buffers.next != &buffer->entry) {
+		struct binder_buffer *prev = list_entry(buffer->entry.prev,
+						struct binder_buffer, entry);
+		if (prev->free) {
+			binder_delete_free_buffer(proc, buffer);
+			rb_erase(&prev->rb_node, &proc->free_buffers);
+			buffer = prev;
+		}
+	}
+	binder_insert_free_buffer(proc, buffer);
+}
+
+/*
+ * Give all pooled small buffers back to the free_buffers tree. Called when
+ * an allocation does not fit; returns the number of buffers released.
+ */
+static int binder_drain_buffer_pool(struct binder_proc *proc)
+{
+	struct binder_buffer *buffer;
+	int class;
+	int count = 0;
+
+	for (class = 0; class < BINDER_POOL_CLASSES; class++) {
+		while (!list_empty(&proc->buffer_pool[class])) {
+			buffer = list_first_entry(&proc->buffer_pool[class],
+						  struct binder_buffer,
+						  pool_entry);
+			list_del(&buffer->pool_entry);
+			binder_merge_free_buf(proc, buffer);
+			count++;
+		}
+		proc->buffer_pool_count[class] = 0;
+	}
+	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "binder: %d: drained %d pooled buffers\n",
+		     proc->pid, count);
+	return count;
+}
+
 static void binder_free_buf(struct binder_proc *proc,
 			    struct binder_buffer *buffer)
 {
@@ -860,7 +1347,8 @@ static void binder_free_buf(struct binder_proc *proc,
 	buffer_size = binder_buffer_size(proc, buffer);
 
 	size = ALIGN(buffer->data_size, sizeof(void *)) +
-		ALIGN(buffer->offsets_size, sizeof(void *));
+		ALIGN(buffer->offsets_size, sizeof(void *)) +
+		ALIGN(buffer->extra_buffers_size, sizeof(void *));
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_free_buf %p size %zd buffer"
@@ -874,6 +1362,9 @@ static void binder_free_buf(struct binder_proc *proc,
 
 	if (buffer->async_transaction) {
 		proc->free_async_space += size + sizeof(struct binder_buffer);
+		if (buffer->async_from)
+			binder_async_sender(proc, buffer->async_from)->size -=
+				size + sizeof(struct binder_buffer);
 
 		binder_debug(BINDER_DEBUG_BUFFER_ALLOC_ASYNC,
 			     "binder: %d: binder_free_buf size %zd "
@@ -881,30 +1372,21 @@ static void binder_free_buf(struct binder_proc *proc,
 			     proc->free_async_space);
 	}
 
-	binder_update_page_range(proc, 0,
-		(void *)PAGE_ALIGN((uintptr_t)buffer->data),
-		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK),
-		NULL);
 	rb_erase(&buffer->rb_node, &proc->allocated_buffers);
-	buffer->free = 1;
-	if (!list_is_last(&buffer->entry, &proc->buffers)) {
-		struct binder_buffer *next = list_entry(buffer->entry.next,
-						struct binder_buffer, entry);
-		if (next->free) {
-			rb_erase(&next->rb_node, &proc->free_buffers);
-			binder_delete_free_buffer(proc, next);
-		}
-	}
-	if (proc->buffers.next != &buffer->entry) {
-		struct binder_buffer *prev = list_entry(buffer->entry.prev,
-						struct binder_buffer, entry);
-		if (prev->free) {
-			binder_delete_free_buffer(proc, buffer);
-			rb_erase(&prev->rb_node, &proc->free_buffers);
-			buffer = prev;
+	if (buffer->pooled && !proc->is_dead) {
+		int class = BINDER_POOL_CLASSES - 1;
+
+		while (class > 0 &&
+		       (BINDER_POOL_MIN_SIZE << class) > buffer_size)
+			class--;
+		if (proc->buffer_pool_count[class] < BINDER_POOL_MAX_PER_CLASS) {
+			list_add(&buffer->pool_entry,
+				 &proc->buffer_pool[class]);
+			proc->buffer_pool_count[class]++;
+			return;
 		}
 	}
-	binder_insert_free_buffer(proc, buffer);
+	binder_merge_free_buf(proc, buffer);
 }
 
 static struct binder_node *binder_get_node(struct binder_proc *proc,
@@ -946,7 +1428,7 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 			return NULL;
 	}
 
-	node = kzalloc(sizeof(*node), GFP_KERNEL);
+	node = kmem_cache_zalloc(binder_node_cachep, GFP_KERNEL);
 	if (node == NULL)
 		return NULL;
 	binder_stats_created(BINDER_STAT_NODE);
@@ -1019,7 +1501,7 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 	if (node->proc && (node->has_strong_ref || node->has_weak_ref)) {
 		if (list_empty(&node->work.entry)) {
 			list_add_tail(&node->work.entry, &node->proc->todo);
-			wake_up_interruptible(&node->proc->wait);
+			binder_wakeup_proc(node->proc);
 		}
 	} else {
 		if (hlist_empty(&node->refs) && !node->local_strong_refs &&
@@ -1036,7 +1518,7 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 					     "binder: dead node %d deleted\n",
 					     node->debug_id);
 			}
-			kfree(node);
+			kmem_cache_free(binder_node_cachep, node);
 			binder_stats_deleted(BINDER_STAT_NODE);
 		}
 	}
@@ -1051,6 +1533,9 @@ static struct binder_ref *binder_get_ref(struct binder_proc *proc,
 	struct rb_node *n = proc->refs_by_desc.rb_node;
 	struct binder_ref *ref;
 
+	if (desc < BINDER_REF_DIRECT)
+		return proc->ref_by_desc[desc];
+
 	while (n) {
 		ref = rb_entry(n, struct binder_ref, rb_node_desc);
 
@@ -1083,7 +1568,7 @@ static struct binder_ref *binder_get_ref_for_node(struct binder_proc *proc,
 		else
 			return ref;
 	}
-	new_ref = kzalloc(sizeof(*ref), GFP_KERNEL);
+	new_ref = kmem_cache_zalloc(binder_ref_cachep, GFP_KERNEL);
 	if (new_ref == NULL)
 		return NULL;
 	binder_stats_created(BINDER_STAT_REF);
@@ -1094,11 +1579,18 @@ static struct binder_ref *binder_get_ref_for_node(struct binder_proc *proc,
 	rb_insert_color(&new_ref->rb_node_node, &proc->refs_by_node);
 
 	new_ref->desc = (node == binder_context_mgr_node) ? 0 : 1;
-	for (n = rb_first(&proc->refs_by_desc); n != NULL; n = rb_next(n)) {
-		ref = rb_entry(n, struct binder_ref, rb_node_desc);
-		if (ref->desc > new_ref->desc)
-			break;
-		new_ref->desc = ref->desc + 1;
+	while (new_ref->desc < BINDER_REF_DIRECT &&
+	       proc->ref_by_desc[new_ref->desc])
+		new_ref->desc++;
+	if (new_ref->desc == BINDER_REF_DIRECT) {
+		for (n = rb_first(&proc->refs_by_desc); n != NULL;
+		     n = rb_next(n)) {
+			ref = rb_entry(n, struct binder_ref, rb_node_desc);
+			if (ref->desc > new_ref->desc)
+				break;
+			if (ref->desc >= new_ref->desc)
+				new_ref->desc = ref->desc + 1;
+		}
 	}
 
 	p = &proc->refs_by_desc.rb_node;
@@ -1115,6 +1607,8 @@ static struct binder_ref *binder_get_ref_for_node(struct binder_proc *proc,
 	}
 	rb_link_node(&new_ref->rb_node_desc, parent, p);
 	rb_insert_color(&new_ref->rb_node_desc, &proc->refs_by_desc);
+	if (new_ref->desc < BINDER_REF_DIRECT)
+		proc->ref_by_desc[new_ref->desc] = new_ref;
 	if (node) {
 		hlist_add_head(&new_ref->node_entry, &node->refs);
 
@@ -1139,6 +1633,8 @@ static void binder_delete_ref(struct binder_ref *ref)
 		     ref->desc, ref->node->debug_id);
 
 	rb_erase(&ref->rb_node_desc, &ref->proc->refs_by_desc);
+	if (ref->desc < BINDER_REF_DIRECT)
+		ref->proc->ref_by_desc[ref->desc] = NULL;
 	rb_erase(&ref->rb_node_node, &ref->proc->refs_by_node);
 	if (ref->strong)
 		binder_dec_node(ref->node, 1, 1);
@@ -1150,10 +1646,10 @@ static void binder_delete_ref(struct binder_ref *ref)
 			     "has death notification\n", ref->proc->pid,
 			     ref->debug_id, ref->desc);
 		list_del(&ref->death->work.entry);
-		kfree(ref->death);
+		kmem_cache_free(binder_ref_death_cachep, ref->death);
 		binder_stats_deleted(BINDER_STAT_DEATH);
 	}
-	kfree(ref);
+	kmem_cache_free(binder_ref_cachep, ref);
 	binder_stats_deleted(BINDER_STAT_REF);
 }
 
@@ -1225,7 +1721,9 @@ static void binder_pop_transaction(struct binder_thread *target_thread,
 	t->need_reply = 0;
 	if (t->buffer)
 		t->buffer->transaction = NULL;
-	kfree(t);
+	sched_put_task_group(t->sched_group);
+	sched_put_task_group(t->saved_group);
+	kmem_cache_free(binder_transaction_cachep, t);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION);
 }
 
@@ -1351,6 +1849,10 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 				task_close_fd(proc, fp->handle);
 			break;
 
+		case BINDER_TYPE_PTR:
+			/* the copy lives in this buffer and goes with it */
+			break;
+
 		default:
 			printk(KERN_ERR "binder: transaction release %d bad "
 			       "object type %lx\n", debug_id, fp->type);
@@ -1359,9 +1861,49 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 	}
 }
 
+/*
+ * Copy the blocks referenced by BINDER_TYPE_PTR objects into the space
+ * behind the offsets and point the objects at the copies as the target
+ * sees them. Called with the target's alloc_lock held, before the
+ * offsets are validated, so bad offsets are skipped here and rejected
+ * by binder_transaction.
+ */
+static const char *binder_copy_buffer_objects(struct binder_proc *target_proc,
+					      struct binder_buffer *buffer,
+					      size_t *offp)
+{
+	size_t *off_end = (void *)offp + buffer->offsets_size;
+	struct binder_buffer_object *bp;
+	uint8_t *sg, *sg_end;
+	size_t length;
+
+	BUILD_BUG_ON(sizeof(*bp) != sizeof(struct flat_binder_object));
+
+	sg = (uint8_t *)offp + ALIGN(buffer->offsets_size, sizeof(void *));
+	sg_end = sg + ALIGN(buffer->extra_buffers_size, sizeof(void *));
+	for (; offp < off_end; offp++) {
+		if (buffer->data_size < sizeof(*bp) ||
+		    *offp > buffer->data_size - sizeof(*bp) ||
+		    !IS_ALIGNED(*offp, sizeof(void *)))
+			continue;
+		bp = (struct binder_buffer_object *)(buffer->data + *offp);
+		if (bp->type != BINDER_TYPE_PTR)
+			continue;
+		length = ALIGN(bp->length, sizeof(void *));
+		if (bp->flags || length < bp->length || length > sg_end - sg)
+			return "buffer object size";
+		if (copy_from_user(sg, bp->buffer, bp->length))
+			return "buffer object";
+		bp->buffer = sg + target_proc->user_buffer_offset;
+		sg += length;
+	}
+	return NULL;
+}
+
 static void binder_transaction(struct binder_proc *proc,
 			       struct binder_thread *thread,
-			       struct binder_transaction_data *tr, int reply)
+			       struct binder_transaction_data *tr, int reply,
+			       size_t extra_buffers_size)
 {
 	struct binder_transaction *t;
 	struct binder_work *tcomplete;
@@ -1373,6 +1915,7 @@ static void binder_transaction(struct binder_proc *proc,
 	wait_queue_head_t *target_wait;
 	struct binder_transaction *in_reply_to = NULL;
 	struct binder_transaction_log_entry *e;
+	const char *copy_error;
 	uint32_t return_error;
 
 	e = binder_transaction_log_add(&binder_transaction_log);
@@ -1392,7 +1935,6 @@ static void binder_transaction(struct binder_proc *proc,
 			return_error = BR_FAILED_REPLY;
 			goto err_empty_call_stack;
 		}
-		binder_set_nice(in_reply_to->saved_priority);
 		if (in_reply_to->to_thread != thread) {
 			binder_user_error("binder: %d:%d got reply transaction "
 				"with bad transaction stack,"
@@ -1407,6 +1949,10 @@ static void binder_transaction(struct binder_proc *proc,
 			goto err_bad_call_stack;
 		}
 		thread->transaction_stack = in_reply_to->to_parent;
+		binder_restore_priority(&in_reply_to->saved_priority);
+		sched_put_task_group(sched_set_task_group(current,
+						in_reply_to->saved_group));
+		in_reply_to->saved_group = NULL;
 		target_thread = in_reply_to->from;
 		if (target_thread == NULL) {
 			return_error = BR_DEAD_REPLY;
@@ -1465,32 +2011,19 @@ static void binder_transaction(struct binder_proc *proc,
 				return_error = BR_FAILED_REPLY;
 				goto err_bad_call_stack;
 			}
-			while (tmp) {
-				if (tmp->from && tmp->from->proc == target_proc)
-					target_thread = tmp->from;
-				tmp = tmp->from_parent;
-			}
 		}
 	}
-	if (target_thread) {
-		e->to_thread = target_thread->pid;
-		target_list = &target_thread->todo;
-		target_wait = &target_thread->wait;
-	} else {
-		target_list = &target_proc->todo;
-		target_wait = &target_proc->wait;
-	}
 	e->to_proc = target_proc->pid;
 
 	/* TODO: reuse incoming transaction for reply */
-	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	t = kmem_cache_zalloc(binder_transaction_cachep, GFP_KERNEL);
 	if (t == NULL) {
 		return_error = BR_FAILED_REPLY;
 		goto err_alloc_t_failed;
 	}
 	binder_stats_created(BINDER_STAT_TRANSACTION);
 
-	tcomplete = kzalloc(sizeof(*tcomplete), GFP_KERNEL);
+	tcomplete = kmem_cache_zalloc(binder_work_cachep, GFP_KERNEL);
 	if (tcomplete == NULL) {
 		return_error = BR_FAILED_REPLY;
 		goto err_alloc_tcomplete_failed;
@@ -1499,6 +2032,10 @@ static void binder_transaction(struct binder_proc *proc,
 
 	t->debug_id = ++binder_last_id;
 	e->debug_id = t->debug_id;
+	trace_binder_transaction(reply, t->debug_id, target_proc->pid,
+				 target_thread ? target_thread->pid : 0,
+				 target_node ? target_node->debug_id : 0,
+				 tr->code, tr->flags);
 
 	if (reply)
 		binder_debug(BINDER_DEBUG_TRANSACTION,
@@ -1525,37 +2062,91 @@ static void binder_transaction(struct binder_proc *proc,
 		t->from = NULL;
 	t->sender_euid = proc->tsk->cred->euid;
 	t->to_proc = target_proc;
-	t->to_thread = target_thread;
 	t->code = tr->code;
 	t->flags = tr->flags;
-	t->priority = task_nice(current);
-	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
-		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
-	if (t->buffer == NULL) {
-		return_error = BR_FAILED_REPLY;
-		goto err_binder_alloc_buf_failed;
-	}
-	t->buffer->allow_user_free = 0;
-	t->buffer->debug_id = t->debug_id;
-	t->buffer->transaction = t;
-	t->buffer->target_node = target_node;
+	binder_get_priority(current, &t->priority);
+	if (!reply && !(tr->flags & TF_ONE_WAY))
+		t->sched_group = sched_get_task_group(current);
+
+	/*
+	 * Allocate the target buffer and copy the payload with only the
+	 * target's alloc_lock held. The target node is pinned by a local
+	 * strong ref and the target proc by a tmp ref; everything else is
+	 * revalidated once binder_main_lock is retaken.
+	 */
 	if (target_node)
 		binder_inc_node(target_node, 1, 0, NULL);
+	atomic_inc(&target_proc->tmp_ref);
+	binder_unlock();
 
-	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
+	copy_error = NULL;
+	binder_alloc_lock(target_proc);
+	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
+		tr->offsets_size, extra_buffers_size,
+		!reply && (t->flags & TF_ONE_WAY), proc->pid);
+	if (t->buffer) {
+		t->buffer->allow_user_free = 0;
+		t->buffer->debug_id = t->debug_id;
+		t->buffer->transaction = t;
+		t->buffer->target_node = target_node;
+
+		offp = (size_t *)(t->buffer->data +
+				  ALIGN(tr->data_size, sizeof(void *)));
+
+		if (copy_from_user(t->buffer->data, tr->data.ptr.buffer,
+				   tr->data_size))
+			copy_error = "data";
+		else if (copy_from_user(offp, tr->data.ptr.offsets,
+					tr->offsets_size))
+			copy_error = "offsets";
+		else if (extra_buffers_size)
+			copy_error = binder_copy_buffer_objects(target_proc,
+							t->buffer, offp);
+	}
+	binder_alloc_unlock(target_proc);
 
-	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"data ptr\n", proc->pid, thread->pid);
+	binder_lock();
+	if (target_proc->is_dead) {
+		/* binder_deferred_release freed the buffer and the node */
+		return_error = BR_DEAD_REPLY;
+		goto err_target_died;
+	}
+	if (t->buffer == NULL) {
+		if (target_node)
+			binder_dec_node(target_node, 1, 0);
 		return_error = BR_FAILED_REPLY;
-		goto err_copy_data_failed;
+		goto err_binder_alloc_buf_failed;
 	}
-	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
+	if (copy_error) {
 		binder_user_error("binder: %d:%d got transaction with invalid "
-			"offsets ptr\n", proc->pid, thread->pid);
+			"%s ptr\n", proc->pid, thread->pid, copy_error);
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
+	if (reply) {
+		if (in_reply_to->from != target_thread ||
+		    target_thread->transaction_stack != in_reply_to) {
+			return_error = BR_DEAD_REPLY;
+			goto err_copy_data_failed;
+		}
+	} else if (!(tr->flags & TF_ONE_WAY) && thread->transaction_stack) {
+		struct binder_transaction *tmp;
+		tmp = thread->transaction_stack;
+		while (tmp) {
+			if (tmp->from && tmp->from->proc == target_proc)
+				target_thread = tmp->from;
+			tmp = tmp->from_parent;
+		}
+	}
+	if (target_thread) {
+		e->to_thread = target_thread->pid;
+		target_list = &target_thread->todo;
+		target_wait = &target_thread->wait;
+	} else {
+		target_list = &target_proc->todo;
+		target_wait = &target_proc->wait;
+	}
+	t->to_thread = target_thread;
 	if (!IS_ALIGNED(tr->offsets_size, sizeof(size_t))) {
 		binder_user_error("binder: %d:%d got transaction with "
 			"invalid offsets size, %zd\n",
@@ -1693,6 +2284,11 @@ static void binder_transaction(struct binder_proc *proc,
 			fp->handle = target_fd;
 		} break;
 
+		case BINDER_TYPE_PTR:
+			/* copied by binder_copy_buffer_objects */
+			if (t->buffer->extra_buffers_size)
+				break;
+			/* fall through, only valid in the _SG commands */
 		default:
 			binder_user_error("binder: %d:%d got transactio"
 				"n with invalid object type, %lx\n",
@@ -1701,7 +2297,15 @@ static void binder_transaction(struct binder_proc *proc,
 			goto err_bad_object_type;
 		}
 	}
+	t->enqueue_time = sched_clock();
 	if (reply) {
+		u64 delta = t->enqueue_time - in_reply_to->enqueue_time;
+
+		binder_latency_add(&proc->reply_latency, delta);
+		if (in_reply_to->buffer && in_reply_to->buffer->target_node)
+			binder_latency_add(
+				&in_reply_to->buffer->target_node->latency,
+				delta);
 		BUG_ON(t->buffer->async_transaction != 0);
 		binder_pop_transaction(target_thread, in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
@@ -1715,6 +2319,10 @@ static void binder_transaction(struct binder_proc *proc,
 		if (target_node->has_async_transaction) {
 			target_list = &target_node->async_todo;
 			target_wait = NULL;
+			if (++target_node->async_depth >
+			    target_node->async_max_depth)
+				target_node->async_max_depth =
+					target_node->async_depth;
 		} else
 			target_node->has_async_transaction = 1;
 	}
@@ -1722,8 +2330,13 @@ static void binder_transaction(struct binder_proc *proc,
 	list_add_tail(&t->work.entry, target_list);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
 	list_add_tail(&tcomplete->entry, &thread->todo);
-	if (target_wait)
-		wake_up_interruptible(target_wait);
+	if (target_wait) {
+		if (target_thread)
+			wake_up_interruptible(target_wait);
+		else
+			binder_wakeup_proc(target_proc);
+	}
+	binder_proc_dec_tmpref(target_proc);
 	return;
 
 err_get_unused_fd_failed:
@@ -1737,12 +2350,17 @@ err_bad_offset:
 err_copy_data_failed:
 	binder_transaction_buffer_release(target_proc, t->buffer, offp);
 	t->buffer->transaction = NULL;
+	binder_alloc_lock(target_proc);
 	binder_free_buf(target_proc, t->buffer);
+	binder_alloc_unlock(target_proc);
 err_binder_alloc_buf_failed:
-	kfree(tcomplete);
+err_target_died:
+	binder_proc_dec_tmpref(target_proc);
+	kmem_cache_free(binder_work_cachep, tcomplete);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 err_alloc_tcomplete_failed:
-	kfree(t);
+	sched_put_task_group(t->sched_group);
+	kmem_cache_free(binder_transaction_cachep, t);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION);
 err_alloc_t_failed:
 err_bad_call_stack:
@@ -1919,7 +2537,9 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				return -EFAULT;
 			ptr += sizeof(void *);
 
+			binder_alloc_lock(proc);
 			buffer = binder_buffer_lookup(proc, data_ptr);
+			binder_alloc_unlock(proc);
 			if (buffer == NULL) {
 				binder_user_error("binder: %d:%d "
 					"BC_FREE_BUFFER u%p no match\n",
@@ -1943,14 +2563,24 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				buffer->transaction = NULL;
 			}
 			if (buffer->async_transaction && buffer->target_node) {
-				BUG_ON(!buffer->target_node->has_async_transaction);
-				if (list_empty(&buffer->target_node->async_todo))
-					buffer->target_node->has_async_transaction = 0;
-				else
-					list_move_tail(buffer->target_node->async_todo.next, &thread->todo);
+				struct binder_node *node = buffer->target_node;
+
+				BUG_ON(!node->has_async_transaction);
+				/* the rest of a batch is still being served */
+				if (node->async_batched)
+					node->async_batched--;
+				else if (list_empty(&node->async_todo))
+					node->has_async_transaction = 0;
+				else {
+					list_move_tail(node->async_todo.next,
+						       &thread->todo);
+					node->async_depth--;
+				}
 			}
 			binder_transaction_buffer_release(proc, buffer, NULL);
+			binder_alloc_lock(proc);
 			binder_free_buf(proc, buffer);
+			binder_alloc_unlock(proc);
 			break;
 		}
 
@@ -1961,7 +2591,19 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 			if (copy_from_user(&tr, ptr, sizeof(tr)))
 				return -EFAULT;
 			ptr += sizeof(tr);
-			binder_transaction(proc, thread, &tr, cmd == BC_REPLY);
+			binder_transaction(proc, thread, &tr, cmd == BC_REPLY, 0);
+			break;
+		}
+
+		case BC_TRANSACTION_SG:
+		case BC_REPLY_SG: {
+			struct binder_transaction_data_sg tr;
+
+			if (copy_from_user(&tr, ptr, sizeof(tr)))
+				return -EFAULT;
+			ptr += sizeof(tr);
+			binder_transaction(proc, thread, &tr.transaction_data,
+					   cmd == BC_REPLY_SG, tr.buffers_size);
 			break;
 		}
 
@@ -2050,7 +2692,8 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 						proc->pid, thread->pid);
 					break;
 				}
-				death = kzalloc(sizeof(*death), GFP_KERNEL);
+				death = kmem_cache_zalloc(binder_ref_death_cachep,
+							  GFP_KERNEL);
 				if (death == NULL) {
 					thread->return_error = BR_ERROR;
 					binder_debug(BINDER_DEBUG_FAILED_TRANSACTION,
@@ -2069,7 +2712,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 						list_add_tail(&ref->death->work.entry, &thread->todo);
 					} else {
 						list_add_tail(&ref->death->work.entry, &proc->todo);
-						wake_up_interruptible(&proc->wait);
+						binder_wakeup_proc(proc);
 					}
 				}
 			} else {
@@ -2099,7 +2742,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 						list_add_tail(&death->work.entry, &thread->todo);
 					} else {
 						list_add_tail(&death->work.entry, &proc->todo);
-						wake_up_interruptible(&proc->wait);
+						binder_wakeup_proc(proc);
 					}
 				} else {
 					BUG_ON(death->work.type != BINDER_WORK_DEAD_BINDER);
@@ -2139,7 +2782,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					list_add_tail(&death->work.entry, &thread->todo);
 				} else {
 					list_add_tail(&death->work.entry, &proc->todo);
-					wake_up_interruptible(&proc->wait);
+					binder_wakeup_proc(proc);
 				}
 			}
 		} break;
@@ -2216,9 +2859,11 @@ retry:
 
 
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
-	if (wait_for_proc_work)
+	if (wait_for_proc_work) {
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+		list_add(&thread->waiting_thread_node, &proc->waiting_threads);
+	}
+	binder_unlock();
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2229,12 +2874,14 @@ retry:
 			wait_event_interruptible(binder_user_error_wait,
 						 binder_stop_on_user_error < 2);
 		}
-		binder_set_nice(proc->default_priority);
+		/* nothing on our stack: drop whatever a caller lent us */
+		binder_restore_priority(&proc->default_priority);
+		sched_put_task_group(sched_set_task_group(current, NULL));
 		if (non_block) {
 			if (!binder_has_proc_work(proc, thread))
 				ret = -EAGAIN;
 		} else
-			ret = wait_event_interruptible_exclusive(proc->wait, binder_has_proc_work(proc, thread));
+			ret = wait_event_interruptible(thread->wait, binder_has_proc_work(proc, thread));
 	} else {
 		if (non_block) {
 			if (!binder_has_thread_work(thread))
@@ -2242,10 +2889,14 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
-	if (wait_for_proc_work)
+	binder_lock();
+	if (wait_for_proc_work) {
 		proc->ready_threads--;
+		list_del_init(&thread->waiting_thread_node);
+	}
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
+	if (!non_block && !ret)
+		proc->wakeups++;
 
 	if (ret)
 		return ret;
@@ -2261,8 +2912,10 @@ retry:
 		else if (!list_empty(&proc->todo) && wait_for_proc_work)
 			w = list_first_entry(&proc->todo, struct binder_work, entry);
 		else {
-			if (ptr - buffer == 4 && !(thread->looper & BINDER_LOOPER_STATE_NEED_RETURN)) /* no data added */
+			if (ptr - buffer == 4 && !(thread->looper & BINDER_LOOPER_STATE_NEED_RETURN)) { /* no data added */
+				proc->spurious_wakeups++;
 				goto retry;
+			}
 			break;
 		}
 
@@ -2285,7 +2938,7 @@ retry:
 				     proc->pid, thread->pid);
 
 			list_del(&w->entry);
-			kfree(w);
+			kmem_cache_free(binder_work_cachep, w);
 			binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 		} break;
 		case BINDER_WORK_NODE: {
@@ -2338,7 +2991,7 @@ retry:
 						     proc->pid, thread->pid, node->debug_id,
 						     node->ptr, node->cookie);
 					rb_erase(&node->rb_node, &proc->nodes);
-					kfree(node);
+					kmem_cache_free(binder_node_cachep, node);
 					binder_stats_deleted(BINDER_STAT_NODE);
 				} else {
 					binder_debug(BINDER_DEBUG_INTERNAL_REFS,
@@ -2375,7 +3028,7 @@ retry:
 
 			if (w->type == BINDER_WORK_CLEAR_DEATH_NOTIFICATION) {
 				list_del(&w->entry);
-				kfree(death);
+				kmem_cache_free(binder_ref_death_cachep, death);
 				binder_stats_deleted(BINDER_STAT_DEATH);
 			} else
 				list_move(&w->entry, &proc->delivered_death);
@@ -2392,12 +3045,9 @@ retry:
 			struct binder_node *target_node = t->buffer->target_node;
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
-			t->saved_priority = task_nice(current);
-			if (t->priority < target_node->min_priority &&
-			    !(t->flags & TF_ONE_WAY))
-				binder_set_nice(t->priority);
-			else if (!(t->flags & TF_ONE_WAY) ||
-				 t->saved_priority > target_node->min_priority)
+			if ((t->flags & TF_ONE_WAY) &&
+			    !binder_rt_policy(current->policy) &&
+			    task_nice(current) > target_node->min_priority)
 				binder_set_nice(target_node->min_priority);
 			cmd = BR_TRANSACTION;
 		} else {
@@ -2445,15 +3095,44 @@ retry:
 			     tr.data.ptr.buffer, tr.data.ptr.offsets);
 
 		list_del(&t->work.entry);
+		{
+			u64 delta = sched_clock() - t->enqueue_time;
+
+			trace_binder_transaction_received(t->debug_id,
+					cmd == BR_REPLY, delta);
+			binder_latency_add(&proc->wakeup_latency, delta);
+			if (cmd == BR_TRANSACTION && (t->flags & TF_ONE_WAY))
+				binder_latency_add(
+					&t->buffer->target_node->latency,
+					delta);
+		}
 		t->buffer->allow_user_free = 1;
 		if (cmd == BR_TRANSACTION && !(t->flags & TF_ONE_WAY)) {
+			binder_transaction_priority(t,
+						    t->buffer->target_node);
 			t->to_parent = thread->transaction_stack;
 			t->to_thread = thread;
 			thread->transaction_stack = t;
 		} else {
+			struct binder_node *node = t->buffer->target_node;
+
 			t->buffer->transaction = NULL;
-			kfree(t);
+			kmem_cache_free(binder_transaction_cachep, t);
 			binder_stats_deleted(BINDER_STAT_TRANSACTION);
+			/*
+			 * Queued oneway work for the same node goes to this
+			 * thread right behind the one just read, so it is
+			 * still served in order and one at a time.
+			 */
+			if (cmd == BR_TRANSACTION && node &&
+			    node->async_batched + 1 < binder_async_batch &&
+			    !list_empty(&node->async_todo)) {
+				list_move(node->async_todo.next, &thread->todo);
+				node->async_depth--;
+				node->async_batched++;
+				node->async_batched_total++;
+				continue;
+			}
 		}
 		break;
 	}
@@ -2491,7 +3170,7 @@ static void binder_release_work(struct list_head *list)
 				binder_send_failed_reply(t, BR_DEAD_REPLY);
 		} break;
 		case BINDER_WORK_TRANSACTION_COMPLETE: {
-			kfree(w);
+			kmem_cache_free(binder_work_cachep, w);
 			binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 		} break;
 		default:
@@ -2527,6 +3206,7 @@ static struct binder_thread *binder_get_thread(struct binder_proc *proc)
 		thread->pid = current->pid;
 		init_waitqueue_head(&thread->wait);
 		INIT_LIST_HEAD(&thread->todo);
+		INIT_LIST_HEAD(&thread->waiting_thread_node);
 		rb_link_node(&thread->rb_node, parent, p);
 		rb_insert_color(&thread->rb_node, &proc->threads);
 		thread->looper |= BINDER_LOOPER_STATE_NEED_RETURN;
@@ -2544,6 +3224,7 @@ static int binder_free_thread(struct binder_proc *proc,
 	int active_transactions = 0;
 
 	rb_erase(&thread->rb_node, &proc->threads);
+	list_del_init(&thread->waiting_thread_node);
 	t = thread->transaction_stack;
 	if (t && t->to_thread == thread)
 		send_reply = t;
@@ -2584,12 +3265,12 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	binder_lock();
 	thread = binder_get_thread(proc);
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2623,7 +3304,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	binder_lock();
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2658,7 +3339,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		if (bwr.read_size > 0) {
 			ret = binder_thread_read(proc, thread, (void __user *)bwr.read_buffer, bwr.read_size, &bwr.read_consumed, filp->f_flags & O_NONBLOCK);
 			if (!list_empty(&proc->todo))
-				wake_up_interruptible(&proc->wait);
+				binder_wakeup_proc(proc);
 			if (ret < 0) {
 				if (copy_to_user(ubuf, &bwr, sizeof(bwr)))
 					ret = -EFAULT;
@@ -2732,7 +3413,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		printk(KERN_INFO "binder: %d:%d ioctl %x %lx returned %d\n", proc->pid, current->pid, cmd, arg, ret);
@@ -2864,6 +3545,7 @@ err_bad_arg:
 static int binder_open(struct inode *nodp, struct file *filp)
 {
 	struct binder_proc *proc;
+	int i;
 
 	binder_debug(BINDER_DEBUG_OPEN_CLOSE, "binder_open: %d:%d\n",
 		     current->group_leader->pid, current->pid);
@@ -2875,14 +3557,20 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc->tsk = current;
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
-	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
+	INIT_LIST_HEAD(&proc->waiting_threads);
+	INIT_LIST_HEAD(&proc->death_batch_entry);
+	mutex_init(&proc->alloc_lock);
+	atomic_set(&proc->tmp_ref, 1);
+	for (i = 0; i < BINDER_POOL_CLASSES; i++)
+		INIT_LIST_HEAD(&proc->buffer_pool[i]);
+	binder_get_priority(current, &proc->default_priority);
+	binder_lock();
 	binder_stats_created(BINDER_STAT_PROC);
 	hlist_add_head(&proc->proc_node, &binder_procs);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (binder_proc_dir_entry_proc) {
 		char strbuf[11];
@@ -2943,12 +3631,15 @@ static void binder_deferred_release(struct binder_proc *proc)
 	struct hlist_node *pos;
 	struct binder_transaction *t;
 	struct rb_node *n;
+	struct binder_proc *recipient, *next;
+	LIST_HEAD(recipients);
 	int threads, nodes, incoming_refs, outgoing_refs, buffers, active_transactions, page_count;
 
 	BUG_ON(proc->vma);
 	BUG_ON(proc->files);
 
 	hlist_del(&proc->proc_node);
+	proc->is_dead = 1;
 	if (binder_context_mgr_node && binder_context_mgr_node->proc == proc) {
 		binder_debug(BINDER_DEBUG_DEAD_BINDER,
 			     "binder_release: %d context_mgr_node gone\n",
@@ -2972,7 +3663,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 		rb_erase(&node->rb_node, &proc->nodes);
 		list_del_init(&node->work.entry);
 		if (hlist_empty(&node->refs)) {
-			kfree(node);
+			kmem_cache_free(binder_node_cachep, node);
 			binder_stats_deleted(BINDER_STAT_NODE);
 		} else {
 			struct binder_ref *ref;
@@ -2990,7 +3681,9 @@ static void binder_deferred_release(struct binder_proc *proc)
 					if (list_empty(&ref->death->work.entry)) {
 						ref->death->work.type = BINDER_WORK_DEAD_BINDER;
 						list_add_tail(&ref->death->work.entry, &ref->proc->todo);
-						wake_up_interruptible(&ref->proc->wait);
+						if (list_empty(&ref->proc->death_batch_entry))
+							list_add_tail(&ref->proc->death_batch_entry,
+								      &recipients);
 					} else
 						BUG();
 				}
@@ -3001,6 +3694,16 @@ static void binder_deferred_release(struct binder_proc *proc)
 				     incoming_refs, death);
 		}
 	}
+	/*
+	 * One wakeup per process that had death notifications queued, not
+	 * one per notification: the thread that is woken reads them back to
+	 * back instead of every idle looper being pulled in for one each.
+	 */
+	list_for_each_entry_safe(recipient, next, &recipients,
+				 death_batch_entry) {
+		list_del_init(&recipient->death_batch_entry);
+		binder_wakeup_proc(recipient);
+	}
 	outgoing_refs = 0;
 	while ((n = rb_first(&proc->refs_by_desc))) {
 		struct binder_ref *ref = rb_entry(n, struct binder_ref,
@@ -3011,6 +3714,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 	binder_release_work(&proc->todo);
 	buffers = 0;
 
+	binder_alloc_lock(proc);
 	while ((n = rb_first(&proc->allocated_buffers))) {
 		struct binder_buffer *buffer = rb_entry(n, struct binder_buffer,
 							rb_node);
@@ -3047,8 +3751,10 @@ static void binder_deferred_release(struct binder_proc *proc)
 			}
 		}
 		kfree(proc->pages);
+		proc->pages = NULL;
 		vfree(proc->buffer);
 	}
+	binder_alloc_unlock(proc);
 
 	put_task_struct(proc->tsk);
 
@@ -3059,7 +3765,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 		     proc->pid, threads, nodes, incoming_refs, outgoing_refs,
 		     active_transactions, buffers, page_count);
 
-	kfree(proc);
+	binder_proc_dec_tmpref(proc);
 }
 
 static void binder_deferred_func(struct work_struct *work)
@@ -3069,7 +3775,7 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
+		binder_lock();
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3096,7 +3802,7 @@ static void binder_deferred_func(struct work_struct *work)
 		if (defer & BINDER_DEFERRED_RELEASE)
 			binder_deferred_release(proc); /* frees proc */
 
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3121,13 +3827,14 @@ static char *print_binder_transaction(char *buf, char *end, const char *prefix,
 {
 	buf += snprintf(buf, end - buf,
 			"%s %d: %p from %d:%d to %d:%d code %x "
-			"flags %x pri %ld r%d",
+			"flags %x pri %d:%d r%d",
 			prefix, t->debug_id, t,
 			t->from ? t->from->proc->pid : 0,
 			t->from ? t->from->pid : 0,
 			t->to_proc ? t->to_proc->pid : 0,
 			t->to_thread ? t->to_thread->pid : 0,
-			t->code, t->flags, t->priority, t->need_reply);
+			t->code, t->flags, t->priority.sched_policy,
+			t->priority.prio, t->need_reply);
 	if (buf >= end)
 		return buf;
 	if (t->buffer == NULL) {
@@ -3268,6 +3975,13 @@ static char *print_binder_node(char *buf, char *end, struct binder_node *node)
 				return buf;
 		}
 	}
+	if (node->async_max_depth) {
+		buf += snprintf(buf, end - buf, " async %d/%d batched %u",
+				node->async_depth, node->async_max_depth,
+				node->async_batched_total);
+		if (buf >= end)
+			return buf;
+	}
 	buf += snprintf(buf, end - buf, "\n");
 	list_for_each_entry(w, &node->async_todo, entry) {
 		if (buf >= end)
@@ -3321,12 +4035,16 @@ static char *print_binder_proc(char *buf, char *end,
 					       rb_entry(n, struct binder_ref,
 							rb_node_desc));
 	}
+	if (!binder_debug_no_lock)
+		binder_alloc_lock(proc);
 	for (n = rb_first(&proc->allocated_buffers);
 	     n != NULL && buf < end;
 	     n = rb_next(n))
 		buf = print_binder_buffer(buf, end, "  buffer",
 					  rb_entry(n, struct binder_buffer,
 						   rb_node));
+	if (!binder_debug_no_lock)
+		binder_alloc_unlock(proc);
 	list_for_each_entry(w, &proc->todo, entry) {
 		if (buf >= end)
 			break;
@@ -3383,7 +4101,9 @@ static const char *binder_command_strings[] = {
 	"BC_EXIT_LOOPER",
 	"BC_REQUEST_DEATH_NOTIFICATION",
 	"BC_CLEAR_DEATH_NOTIFICATION",
-	"BC_DEAD_BINDER_DONE"
+	"BC_DEAD_BINDER_DONE",
+	"BC_TRANSACTION_SG",
+	"BC_REPLY_SG"
 };
 
 static const char *binder_objstat_strings[] = {
@@ -3440,6 +4160,20 @@ static char *print_binder_stats(char *buf, char *end, const char *prefix,
 	return buf;
 }
 
+static char *print_binder_lock_stats(char *buf, char *end, const char *prefix,
+				     const char *name,
+				     struct binder_lock_stats *stats)
+{
+	buf += snprintf(buf, end - buf,
+			"%slock %s: acquired %lu contended %lu wait %llu ns "
+			"hold %llu ns max hold %llu ns\n", prefix, name,
+			stats->acquired, stats->contended,
+			(unsigned long long)stats->wait_ns,
+			(unsigned long long)stats->hold_ns,
+			(unsigned long long)stats->max_hold_ns);
+	return buf;
+}
+
 static char *print_binder_proc_stats(char *buf, char *end,
 				     struct binder_proc *proc)
 {
@@ -3458,9 +4192,23 @@ static char *print_binder_proc_stats(char *buf, char *end,
 		return buf;
 	buf += snprintf(buf, end - buf, "  requested threads: %d+%d/%d\n"
 			"  ready threads %d\n"
-			"  free async space %zd\n", proc->requested_threads,
+			"  wakeups %d spurious %d\n"
+			"  free async space %zd quota denied %d\n",
+			proc->requested_threads,
 			proc->requested_threads_started, proc->max_threads,
-			proc->ready_threads, proc->free_async_space);
+			proc->ready_threads, proc->wakeups,
+			proc->spurious_wakeups, proc->free_async_space,
+			proc->async_quota_denied);
+	if (buf >= end)
+		return buf;
+	BUILD_BUG_ON(BINDER_POOL_CLASSES != 4);
+	buf += snprintf(buf, end - buf, "  buffer pool: hits %d misses %d "
+			"pooled %d %d %d %d\n"
+			"  pages mapped %d reused %d\n",
+			proc->buffer_pool_hits, proc->buffer_pool_misses,
+			proc->buffer_pool_count[0], proc->buffer_pool_count[1],
+			proc->buffer_pool_count[2], proc->buffer_pool_count[3],
+			proc->pages_mapped, proc->pages_reused);
 	if (buf >= end)
 		return buf;
 	count = 0;
@@ -3485,8 +4233,12 @@ static char *print_binder_proc_stats(char *buf, char *end,
 		return buf;
 
 	count = 0;
+	if (!binder_debug_no_lock)
+		binder_alloc_lock(proc);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
+	if (!binder_debug_no_lock)
+		binder_alloc_unlock(proc);
 	buf += snprintf(buf, end - buf, "  buffers: %d\n", count);
 	if (buf >= end)
 		return buf;
@@ -3506,6 +4258,11 @@ static char *print_binder_proc_stats(char *buf, char *end,
 		return buf;
 
 	buf = print_binder_stats(buf, end, "  ", &proc->stats);
+	if (buf >= end)
+		return buf;
+
+	buf = print_binder_lock_stats(buf, end, "  ", "alloc",
+				      &proc->alloc_lock_stats);
 
 	return buf;
 }
@@ -3526,7 +4283,7 @@ static int binder_read_proc_state(char *page, char **start, off_t off,
 		return 0;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	buf += snprintf(buf, end - buf, "binder state:\n");
 
@@ -3544,7 +4301,7 @@ static int binder_read_proc_state(char *page, char **start, off_t off,
 		buf = print_binder_proc(buf, end, proc, 1);
 	}
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	if (buf > page + PAGE_SIZE)
 		buf = page + PAGE_SIZE;
 
@@ -3572,11 +4329,14 @@ static int binder_read_proc_stats(char *page, char **start, off_t off,
 		return 0;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	p += snprintf(p, PAGE_SIZE, "binder stats:\n");
 
 	p = print_binder_stats(p, page + PAGE_SIZE, "", &binder_stats);
+	if (p < page + PAGE_SIZE)
+		p = print_binder_lock_stats(p, page + PAGE_SIZE, "", "main",
+					    &binder_main_lock_stats);
 
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
 		if (p >= page + PAGE_SIZE)
@@ -3584,7 +4344,7 @@ static int binder_read_proc_stats(char *page, char **start, off_t off,
 		p = print_binder_proc_stats(p, page + PAGE_SIZE, proc);
 	}
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	if (p > page + PAGE_SIZE)
 		p = page + PAGE_SIZE;
 
@@ -3613,7 +4373,7 @@ static int binder_read_proc_transactions(char *page, char **start, off_t off,
 		return 0;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	buf += snprintf(buf, end - buf, "binder transactions:\n");
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
@@ -3622,7 +4382,7 @@ static int binder_read_proc_transactions(char *page, char **start, off_t off,
 		buf = print_binder_proc(buf, end, proc, 0);
 	}
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	if (buf > page + PAGE_SIZE)
 		buf = page + PAGE_SIZE;
 
@@ -3649,11 +4409,11 @@ static int binder_read_proc_proc(char *page, char **start, off_t off,
 		return 0;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 	p += snprintf(p, PAGE_SIZE, "binder proc state:\n");
 	p = print_binder_proc(p, page + PAGE_SIZE, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 
 	if (p > page + PAGE_SIZE)
 		p = page + PAGE_SIZE;
@@ -3719,6 +4479,166 @@ static int binder_read_proc_transaction_log(
 	return len < count ? len  : count;
 }
 
+static char *print_binder_latency_hist(char *buf, char *end,
+				       const char *prefix, const char *name,
+				       struct binder_latency_hist *hist)
+{
+	u64 avg, max;
+	int i;
+
+	if (!hist->count)
+		return buf;
+	avg = hist->total_ns;
+	do_div(avg, hist->count);
+	do_div(avg, NSEC_PER_USEC);
+	max = hist->max_ns;
+	do_div(max, NSEC_PER_USEC);
+	buf += snprintf(buf, end - buf, "%s%s: count %u avg %llu us "
+			"max %llu us\n", prefix, name, hist->count,
+			(unsigned long long)avg, (unsigned long long)max);
+	for (i = 0; i < BINDER_LATENCY_BUCKETS; i++) {
+		if (buf >= end)
+			break;
+		if (!hist->bucket[i])
+			continue;
+		if (i == 0)
+			buf += snprintf(buf, end - buf, "%s  <1 us: %u\n",
+					prefix, hist->bucket[i]);
+		else if (i == BINDER_LATENCY_BUCKETS - 1)
+			buf += snprintf(buf, end - buf, "%s  >=%u us: %u\n",
+					prefix, 1U << (i - 1), hist->bucket[i]);
+		else
+			buf += snprintf(buf, end - buf, "%s  %u-%u us: %u\n",
+					prefix, 1U << (i - 1), 1U << i,
+					hist->bucket[i]);
+	}
+	return buf;
+}
+
+static int binder_read_proc_latency(char *page, char **start, off_t off,
+				    int count, int *eof, void *data)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	int len = 0;
+	char *buf = page;
+	char *end = page + PAGE_SIZE;
+	int do_lock = !binder_debug_no_lock;
+
+	if (off)
+		return 0;
+
+	if (do_lock)
+		binder_lock();
+
+	buf += snprintf(buf, end - buf, "binder latency:\n");
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (buf >= end)
+			break;
+		if (!proc->wakeup_latency.count && !proc->reply_latency.count)
+			continue;
+		buf += snprintf(buf, end - buf, "proc %d\n", proc->pid);
+		if (buf >= end)
+			break;
+		buf = print_binder_latency_hist(buf, end, "  ", "wakeup",
+						&proc->wakeup_latency);
+		if (buf >= end)
+			break;
+		buf = print_binder_latency_hist(buf, end, "  ", "reply",
+						&proc->reply_latency);
+	}
+	if (do_lock)
+		binder_unlock();
+	if (buf > page + PAGE_SIZE)
+		buf = page + PAGE_SIZE;
+
+	*start = page + off;
+
+	len = buf - page;
+	if (len > off)
+		len -= off;
+	else
+		len = 0;
+
+	return len < count ? len  : count;
+}
+
+#define BINDER_HOT_NODES 16
+
+static int binder_read_proc_hot_nodes(char *page, char **start, off_t off,
+				      int count, int *eof, void *data)
+{
+	struct binder_node *hot[BINDER_HOT_NODES];
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	struct rb_node *n;
+	int nr_hot = 0;
+	int len = 0;
+	int i;
+	char *buf = page;
+	char *end = page + PAGE_SIZE;
+	int do_lock = !binder_debug_no_lock;
+
+	if (off)
+		return 0;
+
+	if (do_lock)
+		binder_lock();
+
+	/* keep the busiest nodes sorted by transaction count */
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n)) {
+			struct binder_node *node = rb_entry(n,
+						struct binder_node, rb_node);
+
+			if (!node->latency.count)
+				continue;
+			if (nr_hot == BINDER_HOT_NODES &&
+			    node->latency.count <=
+			    hot[nr_hot - 1]->latency.count)
+				continue;
+			if (nr_hot < BINDER_HOT_NODES)
+				nr_hot++;
+			for (i = nr_hot - 1; i > 0 &&
+			     hot[i - 1]->latency.count < node->latency.count;
+			     i--)
+				hot[i] = hot[i - 1];
+			hot[i] = node;
+		}
+	}
+
+	buf += snprintf(buf, end - buf, "binder hot nodes:\n");
+	for (i = 0; i < nr_hot && buf < end; i++) {
+		buf += snprintf(buf, end - buf, "node %d: proc %d u%p c%p\n",
+				hot[i]->debug_id, hot[i]->proc->pid,
+				hot[i]->ptr, hot[i]->cookie);
+		if (buf >= end)
+			break;
+		buf = print_binder_latency_hist(buf, end, "  ", "latency",
+						&hot[i]->latency);
+		if (buf >= end || !hot[i]->async_max_depth)
+			continue;
+		buf += snprintf(buf, end - buf,
+				"  async depth %d max %d batched %u\n",
+				hot[i]->async_depth, hot[i]->async_max_depth,
+				hot[i]->async_batched_total);
+	}
+	if (do_lock)
+		binder_unlock();
+	if (buf > page + PAGE_SIZE)
+		buf = page + PAGE_SIZE;
+
+	*start = page + off;
+
+	len = buf - page;
+	if (len > off)
+		len -= off;
+	else
+		len = 0;
+
+	return len < count ? len  : count;
+}
+
 static const struct file_operations binder_fops = {
 	.owner = THIS_MODULE,
 	.poll = binder_poll,
@@ -3739,7 +4659,13 @@ static int __init binder_init(void)
 {
 	int ret;
 
-	binder_deferred_workqueue = create_singlethread_workqueue("binder");
+	binder_node_cachep = KMEM_CACHE(binder_node, SLAB_PANIC);
+	binder_ref_cachep = KMEM_CACHE(binder_ref, SLAB_PANIC);
+	binder_ref_death_cachep = KMEM_CACHE(binder_ref_death, SLAB_PANIC);
+	binder_transaction_cachep = KMEM_CACHE(binder_transaction, SLAB_PANIC);
+	binder_work_cachep = KMEM_CACHE(binder_work, SLAB_PANIC);
+
+	binder_deferred_workqueue = create_hipri_workqueue("binder");
 	if (!binder_deferred_workqueue)
 		return -ENOMEM;
 
@@ -3774,6 +4700,16 @@ static int __init binder_init(void)
 				       binder_proc_dir_entry_root,
 				       binder_read_proc_transaction_log,
 				       &binder_transaction_log_failed);
+		create_proc_read_entry("latency",
+				       S_IRUGO,
+				       binder_proc_dir_entry_root,
+				       binder_read_proc_latency,
+				       NULL);
+		create_proc_read_entry("hot_nodes",
+				       S_IRUGO,
+				       binder_proc_dir_entry_root,
+				       binder_read_proc_hot_nodes,
+				       NULL);
 	}
 	return ret;
 }
@@ -24,6 +24,17 @@
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/time.h>
+#include <linux/pagemap.h>
+#include <linux/vmalloc.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/ctype.h>
+#include <linux/jhash.h>
+#include <linux/hash.h>
+#include <linux/cred.h>
+#include <linux/log2.h>
+#include <linux/lzo.h>
+#include <linux/mm.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
@@ -32,20 +43,127 @@
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.
+ *
+ * Writers never take a lock. All offsets below except 'size' are positions in
+ * an unbounded byte stream; logger_offset() maps them into the ring. A writer
+ * reserves its entry by advancing 'w_off' with cmpxchg, pulls 'head' past the
+ * entries it is about to overwrite, copies its entry in, and finally commits
+ * it by advancing 'c_off'. Head fix-ups and commits both happen in
+ * reservation order, so 'c_off' only ever moves over complete entries.
+ * Readers only read below 'c_off', and detect that they were lapped by
+ * comparing against 'head'. The mutex serializes readers and ioctls.
+ *
+ * Resizing swaps the buffer under the mutex while 'resizing' holds off new
+ * writers and 'writers' drains the ones in flight. It is refused while the
+ * ring is mapped into a reader; 'ctl' is the page mapped along with it,
+ * where writers publish 'head' and 'c_off'.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
-	size_t			head;	/* new readers start here */
+	struct mutex		mutex;	/* mutex protecting readers */
+	size_t			w_off;	/* reserved write head */
+	size_t			fixup_off; /* head fixed up for writes below */
+	size_t			c_off;	/* committed write head */
+	size_t			head;	/* oldest entry still in the log */
+	size_t			flush_off; /* new readers start at or after */
 	size_t			size;	/* size of the log */
+	atomic_t		writers; /* writers in flight */
+	int			resizing; /* buffer is being swapped */
+	int			compact; /* encode new entries */
+	struct logger_tags	*tags;	/* tag table for compact entries */
+	unsigned char		*rbuf;	/* encoded entry, under mutex */
+	unsigned char		*dbuf;	/* decoded entry, under mutex */
+	struct logger_budget	*budget; /* per-uid write budget, or NULL */
+	struct logger_mmap_ctl	*ctl;	/* control page of mmap readers */
+	atomic_t		mapped;	/* mappings of the ring */
+};
+
+#define LOGGER_TAGS		256	/* tag ids fit in one byte */
+#define LOGGER_TAG_PROBES	8	/* slots tried before giving up */
+#define LOGGER_LZO_MIN		64	/* don't compress shorter payloads */
+#define LOGGER_MAX_SIZE		(2*1024*1024)
+
+/* worst case encoding: priority, tag id, decoded length and LZO output */
+#define LOGGER_COMPACT_MAX	\
+	(4 + lzo1x_worst_compress(LOGGER_ENTRY_MAX_PAYLOAD))
+
+/*
+ * struct logger_tags - deduplicated tag strings of a compact log
+ *
+ * Slots are claimed under 'lock' and never change afterwards, so entries
+ * can refer to them by index for as long as the log exists. A slot is in
+ * use once 'len' is set.
+ */
+struct logger_tags {
+	spinlock_t		lock;
+	struct {
+		unsigned char	len;
+		char		name[LOGGER_TAG_MAX];
+	} slot[LOGGER_TAGS];
+};
+
+/*
+ * struct logger_scratch - per-cpu buffers for encoding an entry
+ *
+ * Writers encode with preemption disabled, so one set per cpu is enough.
+ */
+struct logger_scratch {
+	unsigned char		raw[LOGGER_ENTRY_MAX_PAYLOAD];
+	unsigned char		out[LOGGER_COMPACT_MAX];
+	unsigned char		wrkmem[LZO1X_1_MEM_COMPRESS];
+};
+
+static DEFINE_PER_CPU(struct logger_scratch *, logger_scratch);
+static DEFINE_MUTEX(logger_compact_lock);
+
+#define LOGGER_BUDGET_BITS	6	/* uids tracked per log, as a power of 2 */
+
+/*
+ * struct logger_budget - per-uid token buckets of a shared log
+ *
+ * Each uid gets a budget of lines and of bytes per second and may save up
+ * 'burst' seconds worth. Tokens are kept multiplied by HZ so that slow
+ * rates still refill a little every jiffy. Uids map to one of two slots;
+ * a uid finding neither takes over the one idle the longest.
+ */
+struct logger_budget {
+	spinlock_t		lock;
+	struct logger_budget_slot {
+		uid_t		uid;
+		unsigned long	stamp;	/* jiffies of the last refill */
+		unsigned long	lines;	/* line tokens, times HZ */
+		unsigned long	bytes;	/* byte tokens, times HZ */
+		unsigned int	dropped_lines; /* since the last summary */
+		unsigned int	dropped_bytes;
+	} slot[1 << LOGGER_BUDGET_BITS];
 };
 
+/* per uid and second, 0 turns the budget off */
+static unsigned int logger_budget_lines = 100;
+module_param_named(budget_lines, logger_budget_lines, uint,
+		   S_IWUSR | S_IRUGO);
+static unsigned int logger_budget_bytes = 8192;
+module_param_named(budget_bytes, logger_budget_bytes, uint,
+		   S_IWUSR | S_IRUGO);
+
+/* seconds worth of budget a quiet uid may save up */
+static unsigned int logger_budget_burst = 4;
+module_param_named(budget_burst, logger_budget_burst, uint,
+		   S_IWUSR | S_IRUGO);
+
+/* uids below this, the system's own, are never budgeted */
+static unsigned int logger_budget_min_uid = 10000;
+module_param_named(budget_min_uid, logger_budget_min_uid, uint,
+		   S_IWUSR | S_IRUGO);
+
+/* lines dropped over budget, all logs */
+static unsigned long logger_budget_dropped;
+module_param_named(budget_dropped, logger_budget_dropped, ulong, S_IRUGO);
+
 /*
  * struct logger_reader - a logging device open for reading
  *
@@ -56,11 +174,15 @@ struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
 	size_t			r_off;	/* current read head offset */
+	int			raw;	/* wants entries undecoded */
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
+/* logger_before - does stream position 'a' come before 'b'? */
+#define logger_before(a, b)	((long)((a) - (b)) < 0)
+
 /*
  * file_get_log - Given a file structure, return the associated log
  *
@@ -86,9 +208,10 @@ static inline struct logger_log *file_get_log(struct file *file)
 
 /*
  * get_entry_len - Grabs the length of the payload of the next entry starting
- * from 'off'.
+ * from 'off', an index into the ring.
  *
- * Caller needs to hold log->mutex.
+ * The result is only meaningful if the entry was not overwritten meanwhile;
+ * readers check that with entry_still_valid().
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
@@ -106,9 +229,120 @@ static __u32 get_entry_len(struct logger_log *log, size_t off)
 	return sizeof(struct logger_entry) + val;
 }
 
+/*
+ * do_read_log - copies 'count' bytes at stream position 'pos' out of the
+ * ring into the kernel buffer 'buf'
+ */
+static void do_read_log(struct logger_log *log, size_t pos,
+			void *buf, size_t count)
+{
+	size_t off = logger_offset(pos);
+	size_t len;
+
+	len = min(count, log->size - off);
+	memcpy(buf, log->buffer + off, len);
+
+	if (count != len)
+		memcpy(buf + len, log->buffer, count - len);
+}
+
+/*
+ * get_entry_flags - Grabs the LOGGER_ENTRY_* flags of the entry starting at
+ * stream position 'pos'. Same caveat as get_entry_len().
+ */
+static __u16 get_entry_flags(struct logger_log *log, size_t pos)
+{
+	struct logger_entry entry;
+
+	do_read_log(log, pos, &entry, offsetof(struct logger_entry, pid));
+
+	return entry.__pad;
+}
+
+/*
+ * logger_decode - expands the compact entry in 'src' into a plain entry in
+ * 'dst', which has room for LOGGER_ENTRY_MAX_LEN bytes. Returns the length
+ * of the decoded entry or a negative error code.
+ */
+static ssize_t logger_decode(struct logger_log *log, const unsigned char *src,
+			     unsigned char *dst)
+{
+	const struct logger_entry *in = (const struct logger_entry *) src;
+	struct logger_entry *out = (struct logger_entry *) dst;
+	const unsigned char *p = (const unsigned char *) in->msg;
+	unsigned char *q = (unsigned char *) out->msg;
+	unsigned char *end = q + LOGGER_ENTRY_MAX_PAYLOAD;
+	size_t n = in->len;
+
+	*out = *in;
+
+	if (in->__pad & LOGGER_ENTRY_TAGGED) {
+		unsigned int len;
+
+		if (n < 2)
+			return -EIO;
+		len = log->tags->slot[p[1]].len;
+		smp_rmb();
+		*q++ = p[0];
+		memcpy(q, log->tags->slot[p[1]].name, len);
+		q += len;
+		*q++ = '\0';
+		p += 2;
+		n -= 2;
+	}
+
+	if (in->__pad & LOGGER_ENTRY_LZO) {
+		size_t len, room = end - q;
+
+		if (n < 2)
+			return -EIO;
+		len = p[0] | (p[1] << 8);
+		if (len > room || lzo1x_decompress_safe(p + 2, n - 2, q,
+							&room) != LZO_E_OK ||
+		    room != len)
+			return -EIO;
+		q += len;
+	} else {
+		if (n > end - q)
+			return -EIO;
+		memcpy(q, p, n);
+		q += n;
+	}
+
+	out->len = q - (unsigned char *) out->msg;
+	out->__pad = 0;
+
+	return q - dst;
+}
+
+/*
+ * fix_up_reader - pull a reader that was lapped by the writers forward to
+ * the oldest entry still in the log.
+ *
+ * Caller must hold log->mutex.
+ */
+static void fix_up_reader(struct logger_log *log, struct logger_reader *reader)
+{
+	size_t head = ACCESS_ONCE(log->head);
+
+	if (logger_before(reader->r_off, head))
+		reader->r_off = head;
+}
+
+/*
+ * entry_still_valid - has the entry at stream position 'off' not yet been
+ * claimed by a writer? Call after reading from the entry.
+ */
+static inline int entry_still_valid(struct logger_log *log, size_t off)
+{
+	smp_rmb();
+	return !logger_before(off, ACCESS_ONCE(log->head));
+}
+
 /*
  * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * user-space buffer 'buf', starting at the reader's offset. Returns 'count'
+ * on success. The reader's offset is left for the caller to advance.
  *
  * Caller must hold log->mutex.
  */
@@ -117,6 +351,7 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 				   char __user *buf,
 				   size_t count)
 {
+	size_t off = logger_offset(reader->r_off);
 	size_t len;
 
 	/*
@@ -124,8 +359,8 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	 * the current read head offset up to 'count' bytes or to the end of
 	 * the log, whichever comes first.
 	 */
-	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
+	len = min(count, log->size - off);
+	if (copy_to_user(buf, log->buffer + off, len))
 		return -EFAULT;
 
 	/*
@@ -136,11 +371,26 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 		if (copy_to_user(buf + len, log->buffer, count - len))
 			return -EFAULT;
 
-	reader->r_off = logger_offset(reader->r_off + count);
-
 	return count;
 }
 
+/*
+ * do_read_log_decoded - decodes the compact entry of 'len' bytes at the
+ * reader's offset into log->dbuf. Returns the decoded length, zero if the
+ * entry was overwritten meanwhile, or a negative error code.
+ *
+ * Caller must hold log->mutex.
+ */
+static ssize_t do_read_log_decoded(struct logger_log *log,
+				   struct logger_reader *reader, size_t len)
+{
+	do_read_log(log, reader->r_off, log->rbuf, len);
+	if (!entry_still_valid(log, reader->r_off))
+		return 0;
+
+	return logger_decode(log, log->rbuf, log->dbuf);
+}
+
 /*
  * logger_read - our log's read() method
  *
@@ -158,6 +408,8 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t len;
+	__u16 flags;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
@@ -166,7 +418,8 @@ start:
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
 		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
+		fix_up_reader(log, reader);
+		ret = (ACCESS_ONCE(log->c_off) == reader->r_off);
 		mutex_unlock(&log->mutex);
 		if (!ret)
 			break;
@@ -190,21 +443,49 @@ start:
 
 	mutex_lock(&log->mutex);
 
+retry:
+	fix_up_reader(log, reader);
+
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
+	if (unlikely(ACCESS_ONCE(log->c_off) == reader->r_off)) {
 		mutex_unlock(&log->mutex);
 		goto start;
 	}
+	smp_rmb();
 
 	/* get the size of the next entry */
-	ret = get_entry_len(log, reader->r_off);
-	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
-	}
+	len = get_entry_len(log, logger_offset(reader->r_off));
+	flags = get_entry_flags(log, reader->r_off);
+	if (!entry_still_valid(log, reader->r_off))
+		goto retry;
+
+	if (flags && !reader->raw) {
+		/* decode a compact entry in the kernel first */
+		ret = do_read_log_decoded(log, reader, len);
+		if (!ret)
+			goto retry;
+		if (ret > 0 && count < ret)
+			ret = -EINVAL;
+		else if (ret > 0 && copy_to_user(buf, log->dbuf, ret))
+			ret = -EFAULT;
+		if (ret < 0)
+			goto out;
+	} else {
+		if (count < len) {
+			ret = -EINVAL;
+			goto out;
+		}
 
-	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+		/* get exactly one entry from the log */
+		ret = do_read_log_to_user(log, reader, buf, len);
+		if (ret < 0)
+			goto out;
+
+		/* a writer lapped us while we were copying: start over */
+		if (!entry_still_valid(log, reader->r_off))
+			goto retry;
+	}
+	reader->r_off += len;
 
 out:
 	mutex_unlock(&log->mutex);
@@ -213,120 +494,382 @@ out:
 }
 
 /*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
+ * logger_reserve - reserve 'len' bytes at the write head and move the log
+ * head past every entry that the reservation will overwrite. Returns the
+ * stream position of the reservation.
  *
- * Caller must hold log->mutex.
+ * Must be called with preemption disabled: later writers spin until this
+ * one has made its head fix-up and its commit.
  */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
+static size_t logger_reserve(struct logger_log *log, size_t len)
 {
-	size_t count = 0;
+	size_t start, head;
 
 	do {
-		size_t nr = get_entry_len(log, off);
-		off = logger_offset(off + nr);
-		count += nr;
-	} while (count < len);
+		start = ACCESS_ONCE(log->w_off);
+	} while (cmpxchg(&log->w_off, start, start + len) != start);
+
+	/* earlier writers fix up the head for their own entries first */
+	while (ACCESS_ONCE(log->fixup_off) != start)
+		cpu_relax();
+
+	/* the entries we overwrite must be complete before we walk them */
+	while (logger_before(ACCESS_ONCE(log->c_off), start + len - log->size))
+		cpu_relax();
+	smp_rmb();
 
-	return off;
+	head = log->head;
+	while (logger_before(head, start + len - log->size))
+		head += get_entry_len(log, logger_offset(head));
+	log->head = head;
+	log->ctl->head = head;
+
+	/* readers must see the new head before we clobber their entries */
+	smp_wmb();
+	log->fixup_off = start + len;
+
+	return start;
 }
 
 /*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
+ * logger_commit - publish the entry reserved at 'start' to readers once all
+ * earlier entries have been committed.
  */
-static inline int clock_interval(size_t a, size_t b, size_t c)
+static void logger_commit(struct logger_log *log, size_t start, size_t len)
 {
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
-	}
+	while (ACCESS_ONCE(log->c_off) != start)
+		cpu_relax();
 
-	return 0;
+	smp_wmb();
+	log->c_off = start + len;
+	log->ctl->tail = start + len;
 }
 
 /*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
+ * do_write_log - writes 'count' bytes from 'buf' to 'log' at stream
+ * position 'pos'
  *
- * The caller needs to hold log->mutex.
+ * The caller must have reserved the range.
  */
-static void fix_up_readers(struct logger_log *log, size_t len)
+static void do_write_log(struct logger_log *log, size_t pos,
+			 const void *buf, size_t count)
 {
-	size_t old = log->w_off;
-	size_t new = logger_offset(old + len);
-	struct logger_reader *reader;
+	size_t off = logger_offset(pos);
+	size_t len;
 
-	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
-	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+	if (count != len)
+		memcpy(log->buffer, buf + len, count - len);
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * do_write_log_user - writes 'count' bytes from the user-space buffer 'buf'
+ * to the log 'log' at stream position 'pos'
+ *
+ * The caller must have reserved the range and disabled page faults. Bytes
+ * that cannot be copied are zeroed so the entry stays well formed.
  *
- * The caller needs to hold log->mutex.
+ * Returns 'count' on success, negative error code on failure.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static ssize_t do_write_log_from_user(struct logger_log *log, size_t pos,
+				      const void __user *buf, size_t count)
 {
-	size_t len;
+	size_t off = logger_offset(pos);
+	size_t len, left;
+	ssize_t ret = count;
+
+	len = min(count, log->size - off);
+	left = __copy_from_user_inatomic(log->buffer + off, buf, len);
+	if (unlikely(left)) {
+		memset(log->buffer + off + len - left, 0, left);
+		ret = -EFAULT;
+	}
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	if (count != len) {
+		left = __copy_from_user_inatomic(log->buffer, buf + len,
+						 count - len);
+		if (unlikely(left)) {
+			memset(log->buffer + count - len - left, 0, left);
+			ret = -EFAULT;
+		}
+	}
 
-	if (count != len)
-		memcpy(log->buffer, buf + len, count - len);
+	return ret;
+}
 
-	log->w_off = logger_offset(log->w_off + count);
+/*
+ * logger_write_begin - enter the write path, waiting out a resize. Must be
+ * called with preemption disabled.
+ */
+static inline void logger_write_begin(struct logger_log *log)
+{
+	for (;;) {
+		atomic_inc(&log->writers);
+		smp_mb__after_atomic_inc();
+		if (likely(!ACCESS_ONCE(log->resizing)))
+			return;
+
+		atomic_dec(&log->writers);
+		while (ACCESS_ONCE(log->resizing))
+			cpu_relax();
+	}
+}
 
+static inline void logger_write_end(struct logger_log *log)
+{
+	smp_mb__before_atomic_dec();
+	atomic_dec(&log->writers);
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
- *
- * Returns 'count' on success, negative error code on failure.
+ * logger_tag_id - looks up or adds the tag of the text entry 'p' of 'len'
+ * bytes. Returns the tag id, or -1 if the entry does not start with a
+ * printable tag or the table has no room for it.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static int logger_tag_id(struct logger_log *log, const unsigned char *p,
+			 size_t len)
 {
-	size_t len;
+	struct logger_tags *tags = log->tags;
+	const unsigned char *tag = p + 1;
+	unsigned int taglen, hash, i;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
+	for (taglen = 0; taglen < LOGGER_TAG_MAX; taglen++) {
+		if (taglen + 1 == len || !tag[taglen])
+			break;
+		if (!isprint(tag[taglen]))
+			return -1;
+	}
+	if (!taglen || 1 + taglen == len || tag[taglen])
+		return -1;
+
+	hash = jhash(tag, taglen, 0);
+	for (i = 0; i < LOGGER_TAG_PROBES; i++) {
+		unsigned int id = (hash + i) & (LOGGER_TAGS - 1);
+		unsigned int slot_len = ACCESS_ONCE(tags->slot[id].len);
+
+		if (!slot_len) {
+			spin_lock(&tags->lock);
+			if (!tags->slot[id].len) {
+				memcpy(tags->slot[id].name, tag, taglen);
+				smp_wmb();
+				tags->slot[id].len = taglen;
+				spin_unlock(&tags->lock);
+				return id;
+			}
+			spin_unlock(&tags->lock);
+			slot_len = tags->slot[id].len;
+		}
 
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
+		smp_rmb();
+		if (slot_len == taglen &&
+		    !memcmp(tags->slot[id].name, tag, taglen))
+			return id;
+	}
+
+	return -1;
+}
+
+/*
+ * logger_encode - encodes the 'len' byte payload in sc->raw into sc->out.
+ * Returns the encoded length and sets the LOGGER_ENTRY_* flags, which are
+ * zero when encoding would not save anything.
+ */
+static size_t logger_encode(struct logger_log *log, struct logger_scratch *sc,
+			    size_t len, __u16 *flags)
+{
+	const unsigned char *src = sc->raw;
+	unsigned char *dst = sc->out;
+	size_t clen;
+	int id;
+
+	*flags = 0;
+
+	id = logger_tag_id(log, src, len);
+	if (id >= 0) {
+		*dst++ = src[0];
+		*dst++ = id;
+		/* skip the priority, the tag and its NUL */
+		clen = 2 + log->tags->slot[id].len;
+		src += clen;
+		len -= clen;
+		*flags |= LOGGER_ENTRY_TAGGED;
+	}
+
+	if (len >= LOGGER_LZO_MIN &&
+	    lzo1x_1_compress(src, len, dst + 2, &clen,
+			     sc->wrkmem) == LZO_E_OK && clen + 2 < len) {
+		dst[0] = len & 0xff;
+		dst[1] = len >> 8;
+		dst += 2 + clen;
+		*flags |= LOGGER_ENTRY_LZO;
+	} else {
+		memcpy(dst, src, len);
+		dst += len;
+	}
+
+	return dst - sc->out;
+}
+
+/*
+ * logger_budget_charge - charge a 'len' byte line to the calling uid.
+ * Returns 0 if the line is over budget and must be dropped. When a uid
+ * comes back within budget after dropping lines, the count is handed back
+ * through 'lines' and 'bytes' so the caller can log a summary.
+ */
+static int logger_budget_charge(struct logger_budget *budget, uid_t uid,
+				size_t len, unsigned int *lines,
+				unsigned int *bytes)
+{
+	unsigned long rate_lines = ACCESS_ONCE(logger_budget_lines);
+	unsigned long rate_bytes = ACCESS_ONCE(logger_budget_bytes);
+	unsigned long burst = max(ACCESS_ONCE(logger_budget_burst), 1U);
+	unsigned long now = jiffies, elapsed;
+	struct logger_budget_slot *slot, *alt;
+	unsigned int i;
+	int ok;
+
+	*lines = *bytes = 0;
+	if (!rate_lines || !rate_bytes || uid < logger_budget_min_uid)
+		return 1;
+
+	i = hash_32(uid, LOGGER_BUDGET_BITS);
+	spin_lock(&budget->lock);
+
+	slot = &budget->slot[i];
+	alt = &budget->slot[(i + 1) & ((1 << LOGGER_BUDGET_BITS) - 1)];
+	if (slot->uid != uid) {
+		if (alt->uid == uid || time_before(alt->stamp, slot->stamp))
+			slot = alt;
+		if (slot->uid != uid) {
+			slot->uid = uid;
+			slot->stamp = now - burst * HZ;
+			slot->lines = 0;
+			slot->bytes = 0;
+			slot->dropped_lines = 0;
+			slot->dropped_bytes = 0;
+		}
+	}
+
+	elapsed = min(now - slot->stamp, burst * HZ);
+	slot->stamp = now;
+	slot->lines = min(slot->lines + elapsed * rate_lines,
+			  burst * rate_lines * HZ);
+	slot->bytes = min(slot->bytes + elapsed * rate_bytes,
+			  burst * rate_bytes * HZ);
+
+	ok = slot->lines >= HZ && slot->bytes >= len * HZ;
+	if (ok) {
+		slot->lines -= HZ;
+		slot->bytes -= len * HZ;
+		*lines = slot->dropped_lines;
+		*bytes = slot->dropped_bytes;
+		slot->dropped_lines = 0;
+		slot->dropped_bytes = 0;
+	} else {
+		slot->dropped_lines++;
+		slot->dropped_bytes += len;
+		logger_budget_dropped++;
+	}
+
+	spin_unlock(&budget->lock);
+	return ok;
+}
+
+/*
+ * logger_write_budget_summary - note in the log how many lines 'uid' lost
+ * to its budget, as a warning from tag "logger". The entry is written
+ * plain, which compact logs accept too. Called in the write path with
+ * preemption disabled.
+ */
+static void logger_write_budget_summary(struct logger_log *log,
+					struct logger_entry *app,
+					uid_t uid, unsigned int lines,
+					unsigned int bytes)
+{
+	static const char tag[] = "logger";
+	struct logger_entry header = *app;
+	char msg[1 + sizeof(tag) + 64];
+	size_t start;
+	int len;
+
+	msg[0] = 5;	/* ANDROID_LOG_WARN */
+	memcpy(msg + 1, tag, sizeof(tag));
+	len = 1 + sizeof(tag);
+	len += scnprintf(msg + len, sizeof(msg) - len,
+			 "uid %u over budget, %u lines (%u bytes) dropped",
+			 uid, lines, bytes) + 1;
+
+	header.len = len;
+	header.__pad = 0;
+	start = logger_reserve(log, sizeof(struct logger_entry) + len);
+	do_write_log(log, start, &header, sizeof(struct logger_entry));
+	do_write_log(log, start + sizeof(struct logger_entry), msg, len);
+	logger_commit(log, start, sizeof(struct logger_entry) + len);
+}
+
+/*
+ * logger_write_compact - the write path of a compact log
+ *
+ * The payload is copied into this cpu's scratch area and encoded there
+ * before anything is reserved in the ring, so a fault simply fails the
+ * write. Called with preemption and page faults disabled.
+ */
+static ssize_t logger_write_compact(struct logger_log *log,
+				    struct logger_entry *header,
+				    const struct iovec *iov,
+				    unsigned long nr_segs)
+{
+	struct logger_scratch *sc = __get_cpu_var(logger_scratch);
+	const unsigned char *payload = sc->raw;
+	size_t start, len, pos = 0;
+
+	while (nr_segs-- > 0 && pos < header->len) {
+		len = min_t(size_t, iov->iov_len, header->len - pos);
+		if (__copy_from_user_inatomic(sc->raw + pos, iov->iov_base,
+					      len))
 			return -EFAULT;
+		pos += len;
+		iov++;
+	}
 
-	log->w_off = logger_offset(log->w_off + count);
+	len = logger_encode(log, sc, header->len, &header->__pad);
+	if (header->__pad)
+		payload = sc->out;
+	else
+		len = header->len;
 
-	return count;
+	start = logger_reserve(log, sizeof(struct logger_entry) + len);
+	pos = header->len;
+	header->len = len;
+	do_write_log(log, start, header, sizeof(struct logger_entry));
+	do_write_log(log, start + sizeof(struct logger_entry), payload, len);
+	logger_commit(log, start, sizeof(struct logger_entry) + len);
+
+	return pos;
 }
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * Writers do not take any lock and never sleep once they have reserved their
+ * entry: the payload is faulted in up front and copied with page faults
+ * disabled. On a log with a budget, lines over the writer's uid budget are
+ * dropped before they get near the ring, yet reported as written.
  */
 ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
+	size_t start, pos, left;
+	unsigned long seg;
+	unsigned int dropped_lines = 0, dropped_bytes = 0;
+	uid_t uid = 0;
 	ssize_t ret = 0;
 
 	now = current_kernel_time();
@@ -336,43 +879,72 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	header.sec = now.tv_sec;
 	header.nsec = now.tv_nsec;
 	header.len = min_t(size_t, iocb->ki_left, LOGGER_ENTRY_MAX_PAYLOAD);
+	header.__pad = 0;
 
 	/* null writes succeed, return zero */
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
+	if (log->budget) {
+		uid = current_uid();
+		if (!logger_budget_charge(log->budget, uid, header.len,
+					  &dropped_lines, &dropped_bytes))
+			return header.len;
+	}
 
 	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * Fault in the payload now; each segment we keep is shorter than a
+	 * page. Once the entry is reserved, later writers wait for us.
 	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	for (seg = 0, left = header.len; seg < nr_segs && left; seg++) {
+		size_t len = min_t(size_t, iov[seg].iov_len, left);
+
+		if (fault_in_pages_readable(iov[seg].iov_base, len))
+			return -EFAULT;
+		left -= len;
+	}
+
+	preempt_disable();
+	pagefault_disable();
+	logger_write_begin(log);
+
+	if (unlikely(dropped_lines))
+		logger_write_budget_summary(log, &header, uid, dropped_lines,
+					    dropped_bytes);
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	if (ACCESS_ONCE(log->compact)) {
+		ret = logger_write_compact(log, &header, iov, nr_segs);
+		goto out;
+	}
 
-	while (nr_segs-- > 0) {
+	start = logger_reserve(log, sizeof(struct logger_entry) + header.len);
+
+	do_write_log(log, start, &header, sizeof(struct logger_entry));
+	pos = start + sizeof(struct logger_entry);
+
+	for (left = header.len; nr_segs-- > 0 && left; iov++) {
 		size_t len;
-		ssize_t nr;
 
 		/* figure out how much of this vector we can keep */
-		len = min_t(size_t, iov->iov_len, header.len - ret);
+		len = min_t(size_t, iov->iov_len, left);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
-		}
+		if (unlikely(do_write_log_from_user(log, pos, iov->iov_base,
+						    len) < 0))
+			ret = -EFAULT;
 
-		iov++;
-		ret += nr;
+		pos += len;
+		left -= len;
 	}
+	if (!ret)
+		ret = header.len;
 
-	mutex_unlock(&log->mutex);
+	logger_commit(log, start, sizeof(struct logger_entry) + header.len);
+
+out:
+	logger_write_end(log);
+	pagefault_enable();
+	preempt_enable();
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
@@ -411,7 +983,8 @@ static int logger_open(struct inode *inode, struct file *file)
 		INIT_LIST_HEAD(&reader->list);
 
 		mutex_lock(&log->mutex);
-		reader->r_off = log->head;
+		reader->r_off = log->flush_off;
+		fix_up_reader(log, reader);
 		list_add_tail(&reader->list, &log->readers);
 		mutex_unlock(&log->mutex);
 
@@ -462,17 +1035,137 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 	poll_wait(file, &log->wq, wait);
 
 	mutex_lock(&log->mutex);
-	if (log->w_off != reader->r_off)
+	fix_up_reader(log, reader);
+	if (ACCESS_ONCE(log->c_off) != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
 	mutex_unlock(&log->mutex);
 
 	return ret;
 }
 
+/*
+ * logger_set_size - replaces the ring of 'log' with one of 'size' bytes,
+ * keeping the newest entries that fit.
+ *
+ * Caller must hold log->mutex, which keeps readers out.
+ */
+static int logger_set_size(struct logger_log *log, unsigned long size)
+{
+	struct logger_reader *reader;
+	unsigned char *buffer, *old;
+	size_t start, end;
+
+	if (!is_power_of_2(size) || size <= LOGGER_ENTRY_MAX_LEN ||
+	    size > LOGGER_MAX_SIZE)
+		return -EINVAL;
+
+	buffer = vmalloc_user(size);
+	if (!buffer)
+		return -ENOMEM;
+
+	/* hold off new writers and drain the ones in flight */
+	preempt_disable();
+	log->resizing = 1;
+	smp_mb();
+	if (atomic_read(&log->mapped)) {
+		log->resizing = 0;
+		preempt_enable();
+		vfree(buffer);
+		return -EBUSY;
+	}
+	while (atomic_read(&log->writers))
+		cpu_relax();
+	smp_rmb();
+
+	start = log->head;
+	end = log->c_off;
+	while (end - start > size)
+		start += get_entry_len(log, logger_offset(start));
+	do_read_log(log, start, buffer, end - start);
+
+	list_for_each_entry(reader, &log->readers, list)
+		reader->r_off = logger_before(reader->r_off, start) ?
+				0 : reader->r_off - start;
+	log->flush_off = logger_before(log->flush_off, start) ?
+			 0 : log->flush_off - start;
+
+	old = log->buffer;
+	log->buffer = buffer;
+	log->size = size;
+	log->head = 0;
+	log->w_off = log->fixup_off = log->c_off = end - start;
+	log->ctl->size = size;
+	log->ctl->head = 0;
+	log->ctl->tail = log->c_off;
+	log->ctl->flush = log->flush_off;
+
+	smp_wmb();
+	log->resizing = 0;
+	preempt_enable();
+
+	vfree(old);
+
+	return 0;
+}
+
+/*
+ * logger_set_compact - turns compact encoding of new entries on or off.
+ * Entries already in the log stay as they are; the tag table and decode
+ * buffers therefore live as long as the log once allocated.
+ *
+ * Caller must hold log->mutex.
+ */
+static int logger_set_compact(struct logger_log *log, int enable)
+{
+	int cpu, ret = 0;
+
+	if (!enable) {
+		log->compact = 0;
+		return 0;
+	}
+
+	mutex_lock(&logger_compact_lock);
+	for_each_possible_cpu(cpu) {
+		if (per_cpu(logger_scratch, cpu))
+			continue;
+		per_cpu(logger_scratch, cpu) =
+			vmalloc(sizeof(struct logger_scratch));
+		if (!per_cpu(logger_scratch, cpu)) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	if (!log->tags) {
+		log->tags = vmalloc(sizeof(struct logger_tags));
+		if (!log->tags) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		memset(log->tags, 0, sizeof(struct logger_tags));
+		spin_lock_init(&log->tags->lock);
+	}
+	if (!log->rbuf)
+		log->rbuf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+	if (!log->dbuf)
+		log->dbuf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+	if (!log->rbuf || !log->dbuf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	smp_wmb();
+	log->compact = 1;
+out:
+	mutex_unlock(&logger_compact_lock);
+	return ret;
+}
+
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
 	struct logger_reader *reader;
+	struct logger_tag tag;
 	long ret = -ENOTTY;
 
 	mutex_lock(&log->mutex);
@@ -487,10 +1180,8 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
-		else
-			ret = (log->size - reader->r_off) + log->w_off;
+		fix_up_reader(log, reader);
+		ret = ACCESS_ONCE(log->c_off) - reader->r_off;
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -498,19 +1189,93 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off != reader->r_off)
-			ret = get_entry_len(log, reader->r_off);
-		else
-			ret = 0;
+		do {
+			__u16 flags;
+
+			fix_up_reader(log, reader);
+			if (ACCESS_ONCE(log->c_off) == reader->r_off) {
+				ret = 0;
+				break;
+			}
+			smp_rmb();
+			ret = get_entry_len(log, logger_offset(reader->r_off));
+			flags = get_entry_flags(log, reader->r_off);
+			if (!entry_still_valid(log, reader->r_off)) {
+				ret = 0;
+				continue;
+			}
+			if (flags && !reader->raw)
+				ret = do_read_log_decoded(log, reader, ret);
+		} while (!ret);
 		break;
 	case LOGGER_FLUSH_LOG:
 		if (!(file->f_mode & FMODE_WRITE)) {
 			ret = -EBADF;
 			break;
 		}
+		log->flush_off = ACCESS_ONCE(log->c_off);
+		log->ctl->flush = log->flush_off;
 		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+			reader->r_off = log->flush_off;
+		ret = 0;
+		break;
+	case LOGGER_SET_LOG_BUF_SIZE:
+		if (!(file->f_mode & FMODE_WRITE)) {
+			ret = -EBADF;
+			break;
+		}
+		if (!capable(CAP_SYS_ADMIN)) {
+			ret = -EPERM;
+			break;
+		}
+		ret = logger_set_size(log, arg);
+		break;
+	case LOGGER_SET_COMPACT:
+		if (!(file->f_mode & FMODE_WRITE)) {
+			ret = -EBADF;
+			break;
+		}
+		if (!capable(CAP_SYS_ADMIN)) {
+			ret = -EPERM;
+			break;
+		}
+		ret = logger_set_compact(log, !!arg);
+		break;
+	case LOGGER_SET_RAW:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		reader->raw = !!arg;
+		ret = 0;
+		break;
+	case LOGGER_GET_TAG:
+		if (copy_from_user(&tag, (void __user *) arg, sizeof(tag))) {
+			ret = -EFAULT;
+			break;
+		}
+		if (!log->tags || !log->tags->slot[tag.id].len) {
+			ret = -ENOENT;
+			break;
+		}
+		tag.len = log->tags->slot[tag.id].len;
+		memcpy(tag.name, log->tags->slot[tag.id].name, tag.len);
+		ret = copy_to_user((void __user *) arg, &tag, sizeof(tag)) ?
+		      -EFAULT : 0;
+		break;
+	case LOGGER_SET_READ_POS:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		if (logger_before(ACCESS_ONCE(log->c_off), arg)) {
+			ret = -EINVAL;
+			break;
+		}
+		reader->r_off = arg;
+		fix_up_reader(log, reader);
 		ret = 0;
 		break;
 	}
@@ -520,9 +1285,76 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	return ret;
 }
 
+static void logger_vm_open(struct vm_area_struct *vma)
+{
+	struct logger_log *log = file_get_log(vma->vm_file);
+
+	atomic_inc(&log->mapped);
+}
+
+static void logger_vm_close(struct vm_area_struct *vma)
+{
+	struct logger_log *log = file_get_log(vma->vm_file);
+
+	atomic_dec(&log->mapped);
+}
+
+static const struct vm_operations_struct logger_vm_ops = {
+	.open = logger_vm_open,
+	.close = logger_vm_close,
+};
+
+/*
+ * logger_mmap - the log's mmap file operation
+ *
+ * Maps the control page and, right after it, the whole ring, read-only.
+ * Does not take log->mutex, which readers hold while they fault on their
+ * buffers; a resize is kept out through 'mapped' and 'resizing' instead.
+ */
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_log *log = file_get_log(file);
+	unsigned long off;
+	int ret;
+
+	if (!(file->f_mode & FMODE_READ) || (vma->vm_flags & VM_WRITE))
+		return -EACCES;
+	if (vma->vm_pgoff)
+		return -EINVAL;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	atomic_inc(&log->mapped);
+	smp_mb__after_atomic_inc();
+	if (ACCESS_ONCE(log->resizing)) {
+		ret = -EBUSY;
+		goto err;
+	}
+	smp_rmb();
+
+	if (vma->vm_end - vma->vm_start != PAGE_SIZE + log->size) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	ret = vm_insert_page(vma, vma->vm_start, virt_to_page(log->ctl));
+	for (off = 0; !ret && off < log->size; off += PAGE_SIZE)
+		ret = vm_insert_page(vma, vma->vm_start + PAGE_SIZE + off,
+				     vmalloc_to_page(log->buffer + off));
+	if (ret)
+		goto err;
+
+	vma->vm_ops = &logger_vm_ops;
+	return 0;
+
+err:
+	atomic_dec(&log->mapped);
+	return ret;
+}
+
 static const struct file_operations logger_fops = {
 	.owner = THIS_MODULE,
 	.read = logger_read,
+	.mmap = logger_mmap,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
 	.unlocked_ioctl = logger_ioctl,
@@ -532,14 +1364,12 @@ static const struct file_operations logger_fops = {
 };
 
 /*
- * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, greater than LOGGER_ENTRY_MAX_LEN, and less than
- * LONG_MAX minus LOGGER_ENTRY_MAX_LEN.
+ * Defines a log structure with name 'NAME' and an initial size of 'SIZE'
+ * bytes, which must be a power of two, greater than LOGGER_ENTRY_MAX_LEN, and
+ * at most LOGGER_MAX_SIZE. The buffer is allocated by init_log().
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
 static struct logger_log VAR = { \
-	.buffer = _buf_ ## VAR, \
 	.misc = { \
 		.minor = MISC_DYNAMIC_MINOR, \
 		.name = NAME, \
@@ -550,8 +1380,13 @@ static struct logger_log VAR = { \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
 	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
 	.w_off = 0, \
+	.fixup_off = 0, \
+	.c_off = 0, \
 	.head = 0, \
+	.flush_off = 0, \
 	.size = SIZE, \
+	.writers = ATOMIC_INIT(0), \
+	.mapped = ATOMIC_INIT(0), \
 };
 
 DEFINE_LOGGER_DEVICE(log_main, LOGGER_LOG_MAIN, 64*1024)
@@ -559,6 +1394,11 @@ DEFINE_LOGGER_DEVICE(log_events, LOGGER_LOG_EVENTS, 256*1024)
 DEFINE_LOGGER_DEVICE(log_radio, LOGGER_LOG_RADIO, 64*1024)
 DEFINE_LOGGER_DEVICE(log_system, LOGGER_LOG_SYSTEM, 64*1024)
 
+/* only the shared main log is budgeted */
+static struct logger_budget log_main_budget = {
+	.lock = __SPIN_LOCK_UNLOCKED(log_main_budget.lock),
+};
+
 static struct logger_log *get_log_from_minor(int minor)
 {
 	if (log_main.misc.minor == minor)
@@ -576,10 +1416,24 @@ static int __init init_log(struct logger_log *log)
 {
 	int ret;
 
+	/* zeroed, the ring can be mapped into readers */
+	log->buffer = vmalloc_user(log->size);
+	log->ctl = (struct logger_mmap_ctl *) get_zeroed_page(GFP_KERNEL);
+	if (unlikely(!log->buffer || !log->ctl)) {
+		printk(KERN_ERR "logger: failed to allocate buffer "
+		       "for log '%s'!\n", log->misc.name);
+		vfree(log->buffer);
+		free_page((unsigned long) log->ctl);
+		return -ENOMEM;
+	}
+	log->ctl->size = log->size;
+
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
 		printk(KERN_ERR "logger: failed to register misc "
 		       "device for log '%s'!\n", log->misc.name);
+		vfree(log->buffer);
+		free_page((unsigned long) log->ctl);
 		return ret;
 	}
 
@@ -593,6 +1447,7 @@ static int __init logger_init(void)
 {
 	int ret;
 
+	log_main.budget = &log_main_budget;
 	ret = init_log(&log_main);
 	if (unlikely(ret))
 		goto out;
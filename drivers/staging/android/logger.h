@@ -30,6 +30,43 @@ struct logger_entry {
 	char		msg[0];	/* the entry's payload */
 };
 
+/*
+ * Flags in logger_entry.__pad, only ever seen by readers that asked for raw
+ * entries with LOGGER_SET_RAW. A tagged entry starts with the priority byte
+ * and a one byte tag id instead of the NUL-terminated tag string. The rest
+ * of a compressed entry is its decoded length as a little-endian __u16
+ * followed by the LZO1X data.
+ */
+#define LOGGER_ENTRY_TAGGED	0x0001	/* tag replaced by a tag id */
+#define LOGGER_ENTRY_LZO	0x0002	/* rest of the payload is LZO1X */
+
+#define LOGGER_TAG_MAX		32	/* longest tag that is deduplicated */
+
+struct logger_tag {
+	__u8		id;	/* tag id, from a tagged entry */
+	__u8		len;	/* length of the name, no NUL */
+	char		name[LOGGER_TAG_MAX];
+};
+
+/*
+ * The first page of a log mapped with mmap(), followed by the ring itself.
+ * Positions are offsets into an unbounded byte stream; position 'pos' is at
+ * byte (pos & (size - 1)) of the ring. The writers keep 'head' and 'tail'
+ * up to date, a reader keeps its own position and reads the entries from it
+ * up to 'tail' without any system call. Entries are as LOGGER_SET_RAW
+ * readers get them. An entry may be overwritten while it is being copied,
+ * so after copying one a reader issues a read barrier and checks that
+ * 'head' has not moved past it; if it has, it starts over from 'head'.
+ * Before it sleeps in poll(), a reader hands its position to the kernel
+ * with LOGGER_SET_READ_POS.
+ */
+struct logger_mmap_ctl {
+	__u32		size;	/* size of the ring, a power of two */
+	__u32		head;	/* oldest entry still in the ring */
+	__u32		tail;	/* end of the newest complete entry */
+	__u32		flush;	/* where a new reader starts */
+};
+
 #define LOGGER_LOG_RADIO	"log_radio"	/* radio-related messages */
 #define LOGGER_LOG_EVENTS	"log_events"	/* system/hardware events */
 #define LOGGER_LOG_SYSTEM	"log_system"	/* system/framework messages */
@@ -45,5 +82,10 @@ struct logger_entry {
 #define LOGGER_GET_LOG_LEN		_IO(__LOGGERIO, 2) /* used log len */
 #define LOGGER_GET_NEXT_ENTRY_LEN	_IO(__LOGGERIO, 3) /* next entry len */
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
+#define LOGGER_SET_LOG_BUF_SIZE		_IO(__LOGGERIO, 5) /* resize log */
+#define LOGGER_SET_COMPACT		_IO(__LOGGERIO, 6) /* compact encoding */
+#define LOGGER_SET_RAW			_IO(__LOGGERIO, 7) /* read undecoded */
+#define LOGGER_GET_TAG			_IOWR(__LOGGERIO, 8, struct logger_tag)
+#define LOGGER_SET_READ_POS		_IO(__LOGGERIO, 9) /* mmap reader pos */
 
 #endif /* _LINUX_LOGGER_H */
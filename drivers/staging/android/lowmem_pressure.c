@@ -0,0 +1,646 @@
+/* drivers/staging/android/lowmem_pressure.c
+ *
+ * Memory pressure harness for tuning the lowmemorykiller and ashmem
+ * shrinker. A thread grows four kinds of memory toward the targets set in
+ * debugfs lowmem_pressure/, step_kb every step_ms, and releases down to
+ * them at once when they are lowered:
+ *
+ *   anon_kb    pages held by the harness. With no swap, anonymous memory
+ *              is just as unreclaimable.
+ *   file_kb    page cache of file_path, read in and left on the LRU.
+ *   ashmem_kb  ashmem areas of step_kb, filled and then unpinned whole.
+ *   pmem_kb    PMEM_ALLOCATE on pmem_dev, step_kb per file. Only puts
+ *              pressure on the system if the region is lendable.
+ *
+ * For each kind, 'stats' has a histogram of the time to allocate a page
+ * (a step for ashmem and pmem), split by whether the allocation went
+ * through direct reclaim, and the lowmemorykiller kills seen while
+ * enabled with the time since the harness started. Writing to 'stats'
+ * clears it; writing 0 to 'enable' stops the thread and frees everything.
+ *
+ * Copyright (C) 2010 HTC Corporation.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/vmstat.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/smp_lock.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/ashmem.h>
+#include <linux/android_pmem.h>
+#include <trace/events/lowmemorykiller.h>
+
+#define LP_HIST_BUCKETS		16
+#define LP_KILL_RECORDS		16
+#define LP_PATH_LEN		128
+
+enum {
+	LP_ANON,
+	LP_FILE,
+	LP_ASHMEM,
+	LP_PMEM,
+	LP_KINDS,
+};
+
+static const char *lp_kind_name[LP_KINDS] = {
+	"anon", "file", "ashmem", "pmem",
+};
+
+/* bucket i counts samples below 2^i us, the last takes the rest */
+struct lp_hist {
+	uint32_t		count;
+	uint64_t		total;
+	uint32_t		max;
+	uint32_t		bucket[LP_HIST_BUCKETS];
+};
+
+struct lp_kind_stats {
+	struct lp_hist		fast;
+	struct lp_hist		reclaim;
+	uint32_t		failed;
+};
+
+struct lp_kill_record {
+	pid_t			pid;
+	char			comm[TASK_COMM_LEN];
+	int			adj;
+	int			rss;
+	int			free;
+	int			file;
+	uint32_t		ms;	/* since the harness was enabled */
+	uint32_t		held_kb[LP_KINDS];
+};
+
+struct lp_stats {
+	struct lp_kind_stats	kind[LP_KINDS];
+	struct lp_kill_record	kill[LP_KILL_RECORDS];
+	unsigned int		kills;
+};
+
+/* one step_kb allocation of ashmem or pmem */
+struct lp_chunk {
+	struct list_head	list;
+	struct file		*file;
+	struct file		*backing;	/* ashmem only */
+	uint32_t		kb;
+};
+
+struct lp_state {
+	struct list_head	anon;		/* pages, linked by lru */
+	struct list_head	chunks[LP_KINDS];
+	struct file		*file;
+	pgoff_t			file_pages;
+	uint32_t		held_kb[LP_KINDS];
+};
+
+static uint32_t lp_target_kb[LP_KINDS];
+static uint32_t lp_step_kb = 1024;
+static uint32_t lp_step_ms = 100;
+static char lp_file_path[LP_PATH_LEN];
+static char lp_pmem_dev[LP_PATH_LEN] = "/dev/pmem";
+static char lp_ashmem_name[ASHMEM_NAME_LEN] = "lowmem_pressure";
+
+static struct lp_state lp_state;
+static struct lp_stats lp_stats;
+static DEFINE_SPINLOCK(lp_stats_lock);
+static DEFINE_MUTEX(lp_lock);
+static struct task_struct *lp_task;
+static uint64_t lp_start;
+
+static unsigned long lp_allocstalls(void)
+{
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu)
+		sum += per_cpu(vm_event_states, cpu).event[ALLOCSTALL];
+	return sum;
+}
+
+static void lp_hist_add(struct lp_hist *hist, uint32_t val)
+{
+	int bucket = fls(val);
+
+	if (bucket >= LP_HIST_BUCKETS)
+		bucket = LP_HIST_BUCKETS - 1;
+	hist->bucket[bucket]++;
+	hist->count++;
+	hist->total += val;
+	if (val > hist->max)
+		hist->max = val;
+}
+
+static void lp_account(int kind, uint64_t start, unsigned long stalls, int ok)
+{
+	struct lp_kind_stats *ks = &lp_stats.kind[kind];
+	uint64_t us = sched_clock() - start;
+	unsigned long flags;
+
+	do_div(us, NSEC_PER_USEC);
+	spin_lock_irqsave(&lp_stats_lock, flags);
+	if (!ok)
+		ks->failed++;
+	else if (lp_allocstalls() != stalls)
+		lp_hist_add(&ks->reclaim, min_t(uint64_t, us, UINT_MAX));
+	else
+		lp_hist_add(&ks->fast, min_t(uint64_t, us, UINT_MAX));
+	spin_unlock_irqrestore(&lp_stats_lock, flags);
+}
+
+static void lp_kill_probe(struct task_struct *task, int adj, int tasksize,
+			  int min_adj)
+{
+	struct lp_kill_record *rec;
+	unsigned long flags;
+	uint64_t ms = sched_clock() - lp_start;
+
+	do_div(ms, NSEC_PER_MSEC);
+	spin_lock_irqsave(&lp_stats_lock, flags);
+	rec = &lp_stats.kill[lp_stats.kills++ % LP_KILL_RECORDS];
+	rec->pid = task->pid;
+	memcpy(rec->comm, task->comm, sizeof(rec->comm));
+	rec->adj = adj;
+	rec->rss = tasksize;
+	rec->free = global_page_state(NR_FREE_PAGES);
+	rec->file = global_page_state(NR_FILE_PAGES);
+	rec->ms = ms;
+	memcpy(rec->held_kb, lp_state.held_kb, sizeof(rec->held_kb));
+	spin_unlock_irqrestore(&lp_stats_lock, flags);
+}
+
+static long lp_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	mm_segment_t old_fs = get_fs();
+	long ret = -ENOTTY;
+
+	set_fs(KERNEL_DS);
+	if (file->f_op->unlocked_ioctl) {
+		ret = file->f_op->unlocked_ioctl(file, cmd, arg);
+	} else if (file->f_op->ioctl) {
+		lock_kernel();
+		ret = file->f_op->ioctl(file->f_path.dentry->d_inode, file,
+					cmd, arg);
+		unlock_kernel();
+	}
+	set_fs(old_fs);
+	return ret;
+}
+
+/* anon */
+
+static int lp_anon_grow(struct lp_state *s, unsigned int pages)
+{
+	struct page *page;
+	unsigned long stalls;
+	uint64_t start;
+
+	while (pages--) {
+		stalls = lp_allocstalls();
+		start = sched_clock();
+		page = alloc_page(GFP_HIGHUSER | __GFP_NOWARN);
+		lp_account(LP_ANON, start, stalls, page != NULL);
+		if (!page)
+			return -ENOMEM;
+		list_add(&page->lru, &s->anon);
+		s->held_kb[LP_ANON] += PAGE_SIZE / 1024;
+	}
+	return 0;
+}
+
+static void lp_anon_shrink(struct lp_state *s, uint32_t target_kb)
+{
+	struct page *page;
+
+	while (s->held_kb[LP_ANON] > target_kb) {
+		page = list_first_entry(&s->anon, struct page, lru);
+		list_del(&page->lru);
+		__free_page(page);
+		s->held_kb[LP_ANON] -= PAGE_SIZE / 1024;
+	}
+}
+
+/* file */
+
+static int lp_file_grow(struct lp_state *s, unsigned int pages)
+{
+	struct page *page;
+	unsigned long stalls;
+	uint64_t start;
+
+	if (!s->file) {
+		if (!lp_file_path[0])
+			return -EINVAL;
+		s->file = filp_open(lp_file_path, O_RDONLY | O_LARGEFILE, 0);
+		if (IS_ERR(s->file)) {
+			int ret = PTR_ERR(s->file);
+
+			s->file = NULL;
+			return ret;
+		}
+	}
+
+	while (pages--) {
+		if ((loff_t)(s->file_pages + 1) << PAGE_SHIFT >
+		    i_size_read(s->file->f_mapping->host))
+			return -ENOSPC;
+		stalls = lp_allocstalls();
+		start = sched_clock();
+		page = read_mapping_page(s->file->f_mapping, s->file_pages,
+					 s->file);
+		lp_account(LP_FILE, start, stalls, !IS_ERR(page));
+		if (IS_ERR(page))
+			return PTR_ERR(page);
+		/* reclaim may take it back, that is the point */
+		page_cache_release(page);
+		s->file_pages++;
+		s->held_kb[LP_FILE] += PAGE_SIZE / 1024;
+	}
+	return 0;
+}
+
+static void lp_file_shrink(struct lp_state *s, uint32_t target_kb)
+{
+	pgoff_t keep = target_kb / (PAGE_SIZE / 1024);
+
+	if (!s->file || s->file_pages <= keep)
+		return;
+	invalidate_mapping_pages(s->file->f_mapping, keep, s->file_pages - 1);
+	s->file_pages = keep;
+	s->held_kb[LP_FILE] = target_kb;
+	if (!keep) {
+		filp_close(s->file, NULL);
+		s->file = NULL;
+	}
+}
+
+/* ashmem and pmem */
+
+static int lp_ashmem_fill(struct lp_chunk *c)
+{
+	struct ashmem_pin pin = { 0, 0 };	/* the whole area */
+	mm_segment_t old_fs;
+	char *buf;
+	loff_t pos = 0;
+	uint32_t done;
+	int ret;
+
+	c->file = filp_open("/dev/ashmem", O_RDWR, 0);
+	if (IS_ERR(c->file))
+		return PTR_ERR(c->file);
+	lp_ioctl(c->file, ASHMEM_SET_NAME, (unsigned long)lp_ashmem_name);
+	ret = lp_ioctl(c->file, ASHMEM_SET_SIZE, c->kb * 1024);
+	if (ret)
+		return ret;
+	c->backing = ashmem_kernel_file(c->file);
+	if (IS_ERR(c->backing)) {
+		ret = PTR_ERR(c->backing);
+		c->backing = NULL;
+		return ret;
+	}
+
+	buf = (char *)get_zeroed_page(GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	memset(buf, 0x5a, PAGE_SIZE);
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	for (done = 0; done < c->kb; done += PAGE_SIZE / 1024) {
+		ret = vfs_write(c->backing, (char __user *)buf, PAGE_SIZE,
+				&pos);
+		if (ret != PAGE_SIZE)
+			break;
+	}
+	set_fs(old_fs);
+	free_page((unsigned long)buf);
+	if (ret != PAGE_SIZE)
+		return ret < 0 ? ret : -ENOSPC;
+
+	ret = lp_ioctl(c->file, ASHMEM_UNPIN, (unsigned long)&pin);
+	return ret < 0 ? ret : 0;
+}
+
+static int lp_pmem_fill(struct lp_chunk *c)
+{
+	c->file = filp_open(lp_pmem_dev, O_RDWR, 0);
+	if (IS_ERR(c->file))
+		return PTR_ERR(c->file);
+	return lp_ioctl(c->file, PMEM_ALLOCATE, c->kb * 1024);
+}
+
+static void lp_chunk_free(struct lp_chunk *c)
+{
+	if (c->backing)
+		fput(c->backing);
+	if (c->file && !IS_ERR(c->file))
+		filp_close(c->file, NULL);
+	kfree(c);
+}
+
+static int lp_chunk_grow(struct lp_state *s, int kind, uint32_t kb)
+{
+	struct lp_chunk *c;
+	unsigned long stalls;
+	uint64_t start;
+	int ret;
+
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
+		return -ENOMEM;
+	c->kb = kb;
+
+	stalls = lp_allocstalls();
+	start = sched_clock();
+	ret = kind == LP_ASHMEM ? lp_ashmem_fill(c) : lp_pmem_fill(c);
+	lp_account(kind, start, stalls, !ret);
+	if (ret) {
+		lp_chunk_free(c);
+		return ret;
+	}
+	list_add_tail(&c->list, &s->chunks[kind]);
+	s->held_kb[kind] += kb;
+	return 0;
+}
+
+static void lp_chunk_shrink(struct lp_state *s, int kind, uint32_t target_kb)
+{
+	struct lp_chunk *c;
+
+	while (s->held_kb[kind] > target_kb) {
+		c = list_first_entry(&s->chunks[kind], struct lp_chunk, list);
+		list_del(&c->list);
+		s->held_kb[kind] -= c->kb;
+		lp_chunk_free(c);
+	}
+}
+
+static void lp_shrink(struct lp_state *s, int kind, uint32_t target_kb)
+{
+	if (kind == LP_ANON)
+		lp_anon_shrink(s, target_kb);
+	else if (kind == LP_FILE)
+		lp_file_shrink(s, target_kb);
+	else
+		lp_chunk_shrink(s, kind, target_kb);
+}
+
+/* one step toward the targets; a failing kind stops growing until reset */
+static void lp_step(struct lp_state *s, unsigned int *stuck)
+{
+	uint32_t target, kb;
+	int kind, ret;
+
+	for (kind = 0; kind < LP_KINDS; kind++) {
+		target = lp_target_kb[kind];
+		if (s->held_kb[kind] > target) {
+			lp_shrink(s, kind, target);
+			*stuck &= ~(1U << kind);
+		}
+		if (s->held_kb[kind] >= target || (*stuck & (1U << kind)))
+			continue;
+
+		kb = min(target - s->held_kb[kind], lp_step_kb);
+		kb = ALIGN(kb, PAGE_SIZE / 1024);
+		if (kind == LP_ANON)
+			ret = lp_anon_grow(s, kb / (PAGE_SIZE / 1024));
+		else if (kind == LP_FILE)
+			ret = lp_file_grow(s, kb / (PAGE_SIZE / 1024));
+		else
+			ret = lp_chunk_grow(s, kind, kb);
+		if (ret) {
+			printk(KERN_INFO "lowmem_pressure: %s stuck at %ukB: "
+			       "%d\n", lp_kind_name[kind], s->held_kb[kind],
+			       ret);
+			*stuck |= 1U << kind;
+		}
+	}
+}
+
+static int lp_thread(void *unused)
+{
+	struct lp_state *s = &lp_state;
+	unsigned int stuck = 0;
+	int kind;
+
+	while (!kthread_should_stop()) {
+		lp_step(s, &stuck);
+		schedule_timeout_interruptible(msecs_to_jiffies(lp_step_ms));
+	}
+
+	for (kind = 0; kind < LP_KINDS; kind++)
+		lp_shrink(s, kind, 0);
+	return 0;
+}
+
+static int lp_enable_get(void *data, u64 *val)
+{
+	*val = lp_task != NULL;
+	return 0;
+}
+
+static int lp_enable_set(void *data, u64 val)
+{
+	int ret = 0;
+
+	mutex_lock(&lp_lock);
+	if (val && !lp_task) {
+		lp_start = sched_clock();
+		ret = register_trace_lowmemory_kill(lp_kill_probe);
+		if (ret)
+			goto out;
+		lp_task = kthread_run(lp_thread, NULL, "lowmem_pressure");
+		if (IS_ERR(lp_task)) {
+			ret = PTR_ERR(lp_task);
+			lp_task = NULL;
+			unregister_trace_lowmemory_kill(lp_kill_probe);
+		}
+	} else if (!val && lp_task) {
+		kthread_stop(lp_task);
+		lp_task = NULL;
+		unregister_trace_lowmemory_kill(lp_kill_probe);
+	}
+out:
+	mutex_unlock(&lp_lock);
+	return ret;
+}
+DEFINE_SIMPLE_ATTRIBUTE(lp_enable_fops, lp_enable_get, lp_enable_set,
+			"%llu\n");
+
+static void lp_hist_show(struct seq_file *m, const char *kind,
+			 const char *name, struct lp_hist *hist)
+{
+	uint64_t avg = hist->total;
+	int i;
+
+	if (!hist->count)
+		return;
+	do_div(avg, hist->count);
+	seq_printf(m, "%s %s: count %u avg %lluus max %uus\n", kind, name,
+		   hist->count, avg, hist->max);
+	for (i = 0; i < LP_HIST_BUCKETS; i++) {
+		if (!hist->bucket[i])
+			continue;
+		if (i == LP_HIST_BUCKETS - 1)
+			seq_printf(m, "  >=%uus: %u\n", 1U << (i - 1),
+				   hist->bucket[i]);
+		else
+			seq_printf(m, "  <%uus: %u\n", 1U << i,
+				   hist->bucket[i]);
+	}
+}
+
+static int lp_stats_show(struct seq_file *m, void *unused)
+{
+	struct lp_stats *st;
+	struct lp_kill_record *rec;
+	unsigned int i, n;
+	int kind;
+
+	/* copied out, the kill probe takes the lock from any context */
+	st = kmalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return -ENOMEM;
+	spin_lock_irq(&lp_stats_lock);
+	*st = lp_stats;
+	spin_unlock_irq(&lp_stats_lock);
+
+	for (kind = 0; kind < LP_KINDS; kind++) {
+		seq_printf(m, "%s: held %ukB target %ukB failed %u\n",
+			   lp_kind_name[kind], lp_state.held_kb[kind],
+			   lp_target_kb[kind], st->kind[kind].failed);
+		lp_hist_show(m, lp_kind_name[kind], "alloc",
+			     &st->kind[kind].fast);
+		lp_hist_show(m, lp_kind_name[kind], "alloc with reclaim",
+			     &st->kind[kind].reclaim);
+	}
+
+	n = min_t(unsigned int, st->kills, LP_KILL_RECORDS);
+	seq_printf(m, "kills %u, last %u:\n", st->kills, n);
+	for (i = 0; i < n; i++) {
+		rec = &st->kill[(st->kills - n + i) % LP_KILL_RECORDS];
+		seq_printf(m, "  %ums %d (%s) adj %d rss %d free %d file %d "
+			   "held %u/%u/%u/%ukB\n", rec->ms, rec->pid,
+			   rec->comm, rec->adj, rec->rss, rec->free, rec->file,
+			   rec->held_kb[LP_ANON], rec->held_kb[LP_FILE],
+			   rec->held_kb[LP_ASHMEM], rec->held_kb[LP_PMEM]);
+	}
+	kfree(st);
+	return 0;
+}
+
+static int lp_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lp_stats_show, NULL);
+}
+
+static ssize_t lp_stats_write(struct file *file, const char __user *ubuf,
+			      size_t count, loff_t *ppos)
+{
+	spin_lock_irq(&lp_stats_lock);
+	memset(&lp_stats, 0, sizeof(lp_stats));
+	spin_unlock_irq(&lp_stats_lock);
+	return count;
+}
+
+static const struct file_operations lp_stats_fops = {
+	.open		= lp_stats_open,
+	.read		= seq_read,
+	.write		= lp_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t lp_path_read(struct file *file, char __user *ubuf,
+			    size_t count, loff_t *ppos)
+{
+	char *path = file->private_data;
+	char buf[LP_PATH_LEN + 1];
+	int len;
+
+	len = scnprintf(buf, sizeof(buf), "%s\n", path);
+	return simple_read_from_buffer(ubuf, count, ppos, buf, len);
+}
+
+static ssize_t lp_path_write(struct file *file, const char __user *ubuf,
+			     size_t count, loff_t *ppos)
+{
+	char *path = file->private_data;
+	char buf[LP_PATH_LEN];
+
+	if (count >= LP_PATH_LEN)
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	/* the thread holds the open file and chunks, don't swap under it */
+	mutex_lock(&lp_lock);
+	if (lp_task) {
+		mutex_unlock(&lp_lock);
+		return -EBUSY;
+	}
+	strlcpy(path, strstrip(buf), LP_PATH_LEN);
+	mutex_unlock(&lp_lock);
+	return count;
+}
+
+static int lp_path_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+static const struct file_operations lp_path_fops = {
+	.open		= lp_path_open,
+	.read		= lp_path_read,
+	.write		= lp_path_write,
+};
+
+static int __init lowmem_pressure_init(void)
+{
+	struct dentry *dent;
+	char name[16];
+	int kind;
+
+	INIT_LIST_HEAD(&lp_state.anon);
+	for (kind = 0; kind < LP_KINDS; kind++)
+		INIT_LIST_HEAD(&lp_state.chunks[kind]);
+
+	dent = debugfs_create_dir("lowmem_pressure", 0);
+	if (IS_ERR(dent))
+		return PTR_ERR(dent);
+
+	for (kind = 0; kind < LP_KINDS; kind++) {
+		snprintf(name, sizeof(name), "%s_kb", lp_kind_name[kind]);
+		debugfs_create_u32(name, 0644, dent, &lp_target_kb[kind]);
+	}
+	debugfs_create_u32("step_kb", 0644, dent, &lp_step_kb);
+	debugfs_create_u32("step_ms", 0644, dent, &lp_step_ms);
+	debugfs_create_file("file_path", 0644, dent, lp_file_path,
+			    &lp_path_fops);
+	debugfs_create_file("pmem_dev", 0644, dent, lp_pmem_dev,
+			    &lp_path_fops);
+	debugfs_create_file("enable", 0644, dent, NULL, &lp_enable_fops);
+	debugfs_create_file("stats", 0644, dent, NULL, &lp_stats_fops);
+	return 0;
+}
+late_initcall(lowmem_pressure_init);
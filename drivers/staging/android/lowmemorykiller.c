@@ -35,6 +35,19 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/spinlock.h>
+#include <linux/jiffies.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/proc_fs.h>
+#include <linux/swap.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/lowmemorykiller.h>
 
 #define DEBUG_LEVEL_DEATHPENDING 6
 
@@ -69,9 +82,129 @@ static struct task_struct *lowmem_deathpending;
 
 static uint32_t lowmem_check_filepages = 0;
 
-static uint32_t lowmem_deathpending_retries = 0;
+static unsigned long lowmem_deathpending_timeout;
+static int lowmem_deathpending_expired;
 
-static uint32_t lowmem_max_deathpending_retries = 1000;
+static uint32_t lowmem_deathpending_timeout_ms = 1000;
+
+/*
+ * In async mode a kernel thread polls the free and file page counts against
+ * the minfree table every async_poll_ms and kills before the shrinker gets
+ * called from direct reclaim. Once a level has triggered, killing continues
+ * until free memory is async_hysteresis pages above it. The shrinker stays
+ * registered as a backstop; lowmem_kill_lock keeps the two from killing at
+ * the same time.
+ */
+static int lowmem_async;
+static uint32_t lowmem_async_poll_ms = 100;
+static uint32_t lowmem_async_hysteresis = 256;
+static int lowmem_async_active;
+static struct task_struct *lowmem_async_task;
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_async_wait);
+static DEFINE_MUTEX(lowmem_kill_lock);
+
+static uint32_t lowmem_rss_cache_ms = 100;
+
+/*
+ * With swap to compressed RAM, anonymous pages can still be pushed out
+ * before anyone has to die. swap_credit percent of the anon pages that
+ * fit in the remaining swap space is counted as free.
+ */
+static uint32_t lowmem_swap_credit = 50;
+
+/*
+ * Candidate tasks are indexed by oom_adj, so a shrink only has to look at
+ * the highest populated bucket at or above min_adj instead of walking every
+ * process. The index holds thread group leaders that had an oom_adj other
+ * than OOM_DISABLE at init or had theirs written since, and is kept current
+ * by the oom_adj and task free notifiers. Tasks free from softirq context,
+ * so lowmem_index_lock must never be held while taking task_lock(); RSS is
+ * cached per entry and refreshed outside the lock.
+ */
+#define LOWMEM_BUCKETS		(OOM_ADJUST_MAX - OOM_ADJUST_MIN + 1)
+#define LOWMEM_HASH_BITS	6
+#define LOWMEM_REFRESH_BATCH	16
+
+struct lowmem_task {
+	struct hlist_node	hash;	/* in lowmem_task_hash */
+	struct list_head	bucket;	/* in lowmem_bucket[] */
+	struct task_struct	*task;
+	int			oom_adj;
+	int			rss;	/* cached get_mm_rss(), -1 if unknown */
+	unsigned long		rss_time; /* jiffies when rss was read */
+};
+
+static DEFINE_SPINLOCK(lowmem_index_lock);
+static struct list_head lowmem_bucket[LOWMEM_BUCKETS];
+static struct hlist_head lowmem_task_hash[1 << LOWMEM_HASH_BITS];
+
+/*
+ * Statistics exported through /proc/lowmemorykiller, for tuning minfree and
+ * adj. Histogram bucket i counts samples below 2^i units; the last bucket
+ * takes everything larger. The last LOWMEM_KILL_RECORDS kills are kept with
+ * the memory freed while waiting for the victim to go away, filled in when
+ * its task_struct is freed. Kill records and histograms are updated under
+ * lowmem_stats_lock; the plain counters are only bumped, without it.
+ */
+#define LOWMEM_HIST_BUCKETS	16
+#define LOWMEM_KILL_RECORDS	8
+
+struct lowmem_hist {
+	uint32_t		count;
+	uint64_t		total;
+	uint32_t		max;
+	uint32_t		bucket[LOWMEM_HIST_BUCKETS];
+};
+
+struct lowmem_kill_record {
+	pid_t			pid;
+	char			comm[TASK_COMM_LEN];
+	int			oom_adj;
+	int			rss;	/* victim size at kill, in pages */
+	int			free_at_kill;
+	int			freed;	/* NR_FREE_PAGES delta at exit */
+	uint64_t		kill_time;
+	int			exit_ms; /* -1 while pending */
+};
+
+struct lowmem_stats {
+	uint32_t		shrink_calls;
+	uint32_t		skipped_deathpending;
+	uint32_t		skipped_busy;
+	uint32_t		kills;
+	uint32_t		timeouts;
+	uint64_t		victim_rss;
+	uint64_t		freed;
+	struct lowmem_hist	scan_us;
+	struct lowmem_hist	exit_ms;
+	struct lowmem_kill_record kill[LOWMEM_KILL_RECORDS];
+	unsigned int		next_kill;
+	struct lowmem_kill_record *pending; /* record of lowmem_deathpending */
+};
+
+static struct lowmem_stats lowmem_stats;
+static DEFINE_SPINLOCK(lowmem_stats_lock);
+
+static void lowmem_hist_add(struct lowmem_hist *hist, uint32_t val)
+{
+	int bucket = fls(val);
+
+	if (bucket >= LOWMEM_HIST_BUCKETS)
+		bucket = LOWMEM_HIST_BUCKETS - 1;
+	hist->bucket[bucket]++;
+	hist->count++;
+	hist->total += val;
+	if (val > hist->max)
+		hist->max = val;
+}
+
+static uint32_t lowmem_elapsed(uint64_t start, uint32_t unit_ns)
+{
+	uint64_t delta = sched_clock() - start;
+
+	do_div(delta, unit_ns);
+	return delta > UINT_MAX ? UINT_MAX : delta;
+}
 
 #define lowmem_print(level, x...)			\
 	do {						\
@@ -91,6 +224,24 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 {
 	struct task_struct *task = data;
 	if (task == lowmem_deathpending) {
+		struct lowmem_kill_record *rec;
+		unsigned long flags;
+
+		spin_lock_irqsave(&lowmem_stats_lock, flags);
+		rec = lowmem_stats.pending;
+		if (rec && rec->pid == task->pid) {
+			rec->exit_ms = lowmem_elapsed(rec->kill_time,
+						      NSEC_PER_MSEC);
+			rec->freed = global_page_state(NR_FREE_PAGES) -
+				     rec->free_at_kill;
+			if (rec->freed < 0)
+				rec->freed = 0;
+			lowmem_stats.freed += rec->freed;
+			lowmem_hist_add(&lowmem_stats.exit_ms, rec->exit_ms);
+			lowmem_stats.pending = NULL;
+		}
+		spin_unlock_irqrestore(&lowmem_stats_lock, flags);
+
 		lowmem_deathpending = NULL;
 		task_free_unregister(&task_nb);
 		lowmem_print(2, "deathpending end %d (%s)\n",
@@ -99,6 +250,197 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 	return NOTIFY_OK;
 }
 
+static struct lowmem_task *lowmem_index_find(struct task_struct *task)
+{
+	struct lowmem_task *lt;
+	struct hlist_node *n;
+
+	hlist_for_each_entry(lt, n, &lowmem_task_hash[hash_ptr(task,
+			     LOWMEM_HASH_BITS)], hash)
+		if (lt->task == task)
+			return lt;
+	return NULL;
+}
+
+/*
+ * lowmem_index_set - files 'task' under 'oom_adj', or drops it from the
+ * index for OOM_DISABLE. '*new' is used if an entry has to be added and is
+ * cleared if so; the caller frees whatever is left in it.
+ */
+static void lowmem_index_set(struct task_struct *task, int oom_adj,
+			     struct lowmem_task **new)
+{
+	struct lowmem_task *lt;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	lt = lowmem_index_find(task);
+	if (oom_adj < OOM_ADJUST_MIN || oom_adj > OOM_ADJUST_MAX) {
+		if (lt) {
+			hlist_del(&lt->hash);
+			list_del(&lt->bucket);
+		}
+		spin_unlock_irqrestore(&lowmem_index_lock, flags);
+		kfree(lt);
+		return;
+	}
+
+	if (!lt) {
+		lt = *new;
+		if (!lt)
+			goto out;
+		*new = NULL;
+		lt->task = task;
+		lt->rss = -1;
+		hlist_add_head(&lt->hash, &lowmem_task_hash[hash_ptr(task,
+			       LOWMEM_HASH_BITS)]);
+	} else
+		list_del(&lt->bucket);
+
+	lt->oom_adj = oom_adj;
+	list_add(&lt->bucket, &lowmem_bucket[oom_adj - OOM_ADJUST_MIN]);
+out:
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+}
+
+static int task_oom_adj(struct task_struct *task)
+{
+	int oom_adj = OOM_DISABLE;
+
+	task_lock(task);
+	if (task->mm && task->signal)
+		oom_adj = task->signal->oom_adj;
+	task_unlock(task);
+
+	return oom_adj;
+}
+
+static int
+oom_adj_notify_func(struct notifier_block *self, unsigned long val, void *data)
+{
+	struct task_struct *task = data;
+	struct lowmem_task *new;
+
+	new = kmalloc(sizeof(*new), GFP_KERNEL);
+	lowmem_index_set(task, task_oom_adj(task), &new);
+	kfree(new);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block oom_adj_nb = {
+	.notifier_call	= oom_adj_notify_func,
+};
+
+static int
+task_free_index_func(struct notifier_block *self, unsigned long val, void *data)
+{
+	lowmem_index_set(data, OOM_DISABLE, NULL);
+	return NOTIFY_OK;
+}
+
+static struct notifier_block task_free_index_nb = {
+	.notifier_call	= task_free_index_func,
+};
+
+static inline int lowmem_rss_stale(struct lowmem_task *lt, unsigned long ttl)
+{
+	return lt->rss < 0 || time_after_eq(jiffies, lt->rss_time + ttl);
+}
+
+static int lowmem_task_rss(struct task_struct *task)
+{
+	int rss = 0;
+
+	task_lock(task);
+	if (task->mm)
+		rss = get_mm_rss(task->mm);
+	task_unlock(task);
+
+	return rss;
+}
+
+/*
+ * lowmem_select - picks the largest task in the highest populated bucket at
+ * or above 'min_adj' and returns it with a reference held.
+ *
+ * Stale cached RSS values of that bucket are refreshed without the index lock
+ * and the bucket is scanned once more.
+ */
+static struct task_struct *lowmem_select(int min_adj, int *selected_tasksize,
+					 int *selected_oom_adj)
+{
+	struct task_struct *stale[LOWMEM_REFRESH_BATCH];
+	struct task_struct *selected;
+	struct list_head *bucket;
+	struct lowmem_task *lt;
+	unsigned long flags, ttl = msecs_to_jiffies(lowmem_rss_cache_ms);
+	int nr_stale, pass, adj, i;
+
+	if (min_adj < OOM_ADJUST_MIN)
+		min_adj = OOM_ADJUST_MIN;
+
+	for (pass = 0; ; pass++) {
+		selected = NULL;
+		nr_stale = 0;
+
+		spin_lock_irqsave(&lowmem_index_lock, flags);
+		for (adj = OOM_ADJUST_MAX; adj >= min_adj; adj--) {
+			bucket = &lowmem_bucket[adj - OOM_ADJUST_MIN];
+			list_for_each_entry(lt, bucket, bucket) {
+				struct task_struct *p = lt->task;
+
+				if (p == lowmem_deathpending) {
+					lowmem_print(2, "skip death pending "
+						     "task %d (%s)\n",
+						     p->pid, p->comm);
+					continue;
+				}
+				if (!pass && nr_stale < LOWMEM_REFRESH_BATCH &&
+				    lowmem_rss_stale(lt, ttl)) {
+					get_task_struct(p);
+					stale[nr_stale++] = p;
+					continue;
+				}
+				if (lt->rss <= 0)
+					continue;
+				if (selected && lt->rss <= *selected_tasksize)
+					continue;
+				selected = p;
+				*selected_tasksize = lt->rss;
+				*selected_oom_adj = adj;
+			}
+			if (selected || nr_stale)
+				break;
+		}
+		if (selected && !nr_stale)
+			get_task_struct(selected);
+		spin_unlock_irqrestore(&lowmem_index_lock, flags);
+
+		if (!nr_stale)
+			break;
+
+		for (i = 0; i < nr_stale; i++) {
+			int rss = lowmem_task_rss(stale[i]);
+
+			spin_lock_irqsave(&lowmem_index_lock, flags);
+			lt = lowmem_index_find(stale[i]);
+			if (lt) {
+				lt->rss = rss;
+				lt->rss_time = jiffies;
+			}
+			spin_unlock_irqrestore(&lowmem_index_lock, flags);
+			put_task_struct(stale[i]);
+		}
+	}
+
+	if (selected)
+		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+			     selected->pid, selected->comm,
+			     *selected_oom_adj, *selected_tasksize);
+	return selected;
+}
+
 static void dump_deathpending(struct task_struct *t_deathpending)
 {
 	struct task_struct *p;
@@ -135,22 +477,153 @@ static void dump_deathpending(struct task_struct *t_deathpending)
 	read_unlock(&tasklist_lock);
 }
 
-static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
+static int lowmem_other_free(void)
 {
-	struct task_struct *p;
-	struct task_struct *selected = NULL;
-	int rem = 0;
-	int tasksize;
+	long other_free = global_page_state(NR_FREE_PAGES);
+	long anon;
+
+	if (!total_swap_pages || !lowmem_swap_credit)
+		return other_free;
+
+	anon = global_page_state(NR_ACTIVE_ANON) +
+		global_page_state(NR_INACTIVE_ANON);
+	anon = min(anon, nr_swap_pages);
+	return other_free + anon * (long)min(lowmem_swap_credit, 100U) / 100;
+}
+
+/*
+ * lowmem_min_adj - returns the minimum oom_adj to kill for the given memory
+ * state, or OOM_ADJUST_MAX + 1 when no level has been crossed. Every minfree
+ * threshold is raised by 'margin' pages.
+ */
+static int lowmem_min_adj(int other_free, int other_file, int lru_file,
+			  int margin)
+{
+	int array_size = ARRAY_SIZE(lowmem_adj);
 	int i;
-	int min_adj = OOM_ADJUST_MAX + 1;
+
+	if (lowmem_adj_size < array_size)
+		array_size = lowmem_adj_size;
+	if (lowmem_minfree_size < array_size)
+		array_size = lowmem_minfree_size;
+	for (i = 0; i < array_size; i++) {
+		if (other_free < lowmem_minfree[i] + margin) {
+			if (other_file < lowmem_minfree[i] + margin ||
+				(lowmem_check_filepages &&
+				(lru_file < lowmem_minfile[i] + margin)))
+				return lowmem_adj[i];
+		}
+	}
+	return OOM_ADJUST_MAX + 1;
+}
+
+/*
+ * lowmem_deathpending_busy - is the last victim still expected to exit?
+ * A victim that has not gone away within deathpending_timeout_ms is given
+ * up on, but is still skipped when selecting the next one.
+ */
+static int lowmem_deathpending_busy(void)
+{
+	if (!lowmem_deathpending)
+		return 0;
+
+	dump_deathpending(lowmem_deathpending);
+	if (time_before(jiffies, lowmem_deathpending_timeout))
+		return 1;
+
+	if (!lowmem_deathpending_expired) {
+		lowmem_stats.timeouts++;
+		lowmem_print(2, "deathpending %d (%s) timed out\n",
+			     lowmem_deathpending->pid,
+			     lowmem_deathpending->comm);
+		task_free_unregister(&task_nb);
+		lowmem_deathpending_expired = 1;
+	}
+	return 0;
+}
+
+static void lowmem_record_kill(struct task_struct *task, int oom_adj,
+			       int tasksize)
+{
+	struct lowmem_kill_record *rec;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_stats_lock, flags);
+	rec = &lowmem_stats.kill[lowmem_stats.next_kill++ %
+				 LOWMEM_KILL_RECORDS];
+	rec->pid = task->pid;
+	memcpy(rec->comm, task->comm, sizeof(rec->comm));
+	rec->oom_adj = oom_adj;
+	rec->rss = tasksize;
+	rec->free_at_kill = global_page_state(NR_FREE_PAGES);
+	rec->freed = 0;
+	rec->kill_time = sched_clock();
+	rec->exit_ms = -1;
+	lowmem_stats.pending = ignore_lowmem_deathpending ? NULL : rec;
+	lowmem_stats.kills++;
+	lowmem_stats.victim_rss += tasksize;
+	spin_unlock_irqrestore(&lowmem_stats_lock, flags);
+}
+
+/*
+ * lowmem_kill - kills the best task at or above 'min_adj'. Returns the size
+ * of the victim in pages, or zero if there was nothing to kill.
+ *
+ * Caller must hold lowmem_kill_lock.
+ */
+static int lowmem_kill(int min_adj)
+{
+	struct task_struct *selected;
 	int selected_tasksize = 0;
-	int selected_oom_adj;
-	int array_size = ARRAY_SIZE(lowmem_adj);
-	int other_free = global_page_state(NR_FREE_PAGES);
+	int selected_oom_adj = min_adj;
+
+	selected = lowmem_select(min_adj, &selected_tasksize,
+				 &selected_oom_adj);
+	if (!selected) {
+		lowmem_deathpending = NULL;
+		return 0;
+	}
+
+	lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
+		     selected->pid, selected->comm,
+		     selected_oom_adj, selected_tasksize);
+	lowmem_record_kill(selected, selected_oom_adj, selected_tasksize);
+	trace_lowmemory_kill(selected, selected_oom_adj, selected_tasksize,
+			     min_adj);
+	if (!ignore_lowmem_deathpending) {
+		if (lowmem_deathpending && !lowmem_deathpending_expired)
+			task_free_unregister(&task_nb);
+		lowmem_deathpending = selected;
+		lowmem_deathpending_timeout = jiffies +
+			msecs_to_jiffies(lowmem_deathpending_timeout_ms);
+		lowmem_deathpending_expired = 0;
+		task_free_register(&task_nb);
+	}
+	/* the index may still hold a task that was just released */
+	read_lock(&tasklist_lock);
+	if (pid_alive(selected))
+		force_sig(SIGKILL, selected);
+	read_unlock(&tasklist_lock);
+	put_task_struct(selected);
+
+	return selected_tasksize;
+}
+
+static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	uint64_t start = sched_clock();
+	int rem = 0;
+	int min_adj;
+	int other_free = lowmem_other_free();
 	int other_file = global_page_state(NR_FILE_PAGES);
 	int lru_file = global_page_state(NR_ACTIVE_FILE) +
 			global_page_state(NR_INACTIVE_FILE);
 
+	if (nr_to_scan > 0)
+		lowmem_stats.shrink_calls++;
+	if (lowmem_async && nr_to_scan > 0)
+		wake_up(&lowmem_async_wait);
+
 	/*
 	 * If we already have a death outstanding, then
 	 * bail out right away; indicating to vmscan
@@ -158,29 +631,13 @@ static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 	 * this pass.
 	 *
 	 */
-	if (lowmem_deathpending) {
-		dump_deathpending(lowmem_deathpending);
-		if (lowmem_deathpending_retries++ < lowmem_max_deathpending_retries)
-			return 0;
-		else
-			task_free_unregister(&task_nb);
+	if (lowmem_deathpending_busy()) {
+		if (nr_to_scan > 0)
+			lowmem_stats.skipped_deathpending++;
+		return 0;
 	}
 
-	if (lowmem_adj_size < array_size)
-		array_size = lowmem_adj_size;
-	if (lowmem_minfree_size < array_size)
-		array_size = lowmem_minfree_size;
-	for (i = 0; i < array_size; i++) {
-		if (other_free < lowmem_minfree[i]) {
-			if(other_file < lowmem_minfree[i] ||
-				(lowmem_check_filepages &&
-				(lru_file < lowmem_minfile[i]))) {
-
-				min_adj = lowmem_adj[i];
-				break;
-			}
-		}
-	}
+	min_adj = lowmem_min_adj(other_free, other_file, lru_file, 0);
 	if (nr_to_scan > 0)
 		lowmem_print(3, "lowmem_shrink %d, %x, ofree %d %d, ma %d\n",
 			     nr_to_scan, gfp_mask, other_free, other_file,
@@ -194,69 +651,142 @@ static int lowmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 			     nr_to_scan, gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_adj = min_adj;
 
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
+	/* the async thread is killing right now, or just did */
+	if (!mutex_trylock(&lowmem_kill_lock)) {
+		lowmem_stats.skipped_busy++;
+		return 0;
+	}
+	if (!lowmem_deathpending_busy())
+		rem -= lowmem_kill(min_adj);
+	lowmem_hist_add(&lowmem_stats.scan_us,
+			lowmem_elapsed(start, NSEC_PER_USEC));
+	mutex_unlock(&lowmem_kill_lock);
 
-		if (p == lowmem_deathpending) {
-			lowmem_print(2, "skip death pending task %d (%s)\n",
-							p->pid, p->comm);
-			continue;
-		}
+	lowmem_print(4, "lowmem_shrink %d, %x, return %d\n",
+		     nr_to_scan, gfp_mask, rem);
+	return rem;
+}
 
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
+static void lowmem_async_check(void)
+{
+	int other_free = lowmem_other_free();
+	int other_file = global_page_state(NR_FILE_PAGES);
+	int lru_file = global_page_state(NR_ACTIVE_FILE) +
+			global_page_state(NR_INACTIVE_FILE);
+	int min_adj;
+
+	min_adj = lowmem_min_adj(other_free, other_file, lru_file,
+				 lowmem_async_active ?
+				 lowmem_async_hysteresis : 0);
+	if (min_adj == OOM_ADJUST_MAX + 1) {
+		if (lowmem_async_active)
+			lowmem_print(3, "lowmem_async clear, ofree %d %d\n",
+				     other_free, other_file);
+		lowmem_async_active = 0;
+		return;
 	}
-	if (selected) {
-		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
-			     selected->pid, selected->comm,
-			     selected_oom_adj, selected_tasksize);
-		if (!ignore_lowmem_deathpending) {
-			lowmem_deathpending = selected;
-			lowmem_deathpending_retries = 0;
-			task_free_register(&task_nb);
-		}
-		force_sig(SIGKILL, selected);
-		rem -= selected_tasksize;
+
+	if (!lowmem_async_active)
+		lowmem_print(3, "lowmem_async trigger, ofree %d %d, ma %d\n",
+			     other_free, other_file, min_adj);
+	lowmem_async_active = 1;
+
+	mutex_lock(&lowmem_kill_lock);
+	if (!lowmem_deathpending_busy())
+		lowmem_kill(min_adj);
+	mutex_unlock(&lowmem_kill_lock);
+}
+
+static int lowmem_async_thread(void *unused)
+{
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable_timeout(lowmem_async_wait,
+				kthread_should_stop(),
+				msecs_to_jiffies(lowmem_async_poll_ms));
+		if (lowmem_async && !kthread_should_stop())
+			lowmem_async_check();
 	}
-	else {
-		lowmem_deathpending = NULL;
+
+	return 0;
+}
+
+static char *print_lowmem_hist(char *buf, char *end, const char *name,
+			       const char *unit, struct lowmem_hist *hist)
+{
+	uint64_t avg = hist->total;
+	int i;
+
+	if (hist->count)
+		do_div(avg, hist->count);
+	buf += snprintf(buf, end - buf, "%s: count %u avg %llu%s max %u%s\n",
+			name, hist->count, avg, unit, hist->max, unit);
+	for (i = 0; i < LOWMEM_HIST_BUCKETS && buf < end; i++) {
+		if (!hist->bucket[i])
+			continue;
+		if (i == LOWMEM_HIST_BUCKETS - 1)
+			buf += snprintf(buf, end - buf, "  >=%u%s: %u\n",
+					1U << (i - 1), unit, hist->bucket[i]);
+		else
+			buf += snprintf(buf, end - buf, "  <%u%s: %u\n",
+					1U << i, unit, hist->bucket[i]);
+	}
+	return buf;
+}
+
+static int lowmem_read_proc(char *page, char **start, off_t off,
+			    int count, int *eof, void *data)
+{
+	struct lowmem_stats *st = &lowmem_stats;
+	int len = 0;
+	char *buf = page;
+	char *end = page + PAGE_SIZE;
+	unsigned long flags;
+	unsigned int i;
+
+	if (off)
+		return 0;
+
+	spin_lock_irqsave(&lowmem_stats_lock, flags);
+	buf += snprintf(buf, end - buf,
+			"shrink calls %u skipped deathpending %u busy %u\n"
+			"kills %u deathpending timeouts %u\n"
+			"victim rss %llu pages freed at exit %llu pages\n",
+			st->shrink_calls, st->skipped_deathpending,
+			st->skipped_busy, st->kills, st->timeouts,
+			st->victim_rss, st->freed);
+	buf = print_lowmem_hist(buf, end, "scan time", "us", &st->scan_us);
+	if (buf < end)
+		buf = print_lowmem_hist(buf, end, "time to exit", "ms",
+					&st->exit_ms);
+	if (buf < end)
+		buf += snprintf(buf, end - buf, "recent kills:\n");
+	for (i = 0; i < LOWMEM_KILL_RECORDS && buf < end; i++) {
+		struct lowmem_kill_record *rec;
+
+		rec = &st->kill[(st->next_kill - 1 - i) % LOWMEM_KILL_RECORDS];
+		if (!rec->pid)
+			continue;
+		buf += snprintf(buf, end - buf,
+				"  %d (%s) adj %d rss %d freed %d exit %dms\n",
+				rec->pid, rec->comm, rec->oom_adj, rec->rss,
+				rec->freed, rec->exit_ms);
 	}
+	spin_unlock_irqrestore(&lowmem_stats_lock, flags);
+	if (buf > page + PAGE_SIZE)
+		buf = page + PAGE_SIZE;
 
-	lowmem_print(4, "lowmem_shrink %d, %x, return %d\n",
-		     nr_to_scan, gfp_mask, rem);
-	read_unlock(&tasklist_lock);
-	return rem;
+	*start = page + off;
+
+	len = buf - page;
+	if (len > off)
+		len -= off;
+	else
+		len = 0;
+
+	return len < count ? len  : count;
 }
 
 static struct shrinker lowmem_shrinker = {
@@ -266,13 +796,57 @@ static struct shrinker lowmem_shrinker = {
 
 static int __init lowmem_init(void)
 {
+	struct task_struct *p;
+	struct lowmem_task *new = NULL;
+	int i;
+
+	for (i = 0; i < LOWMEM_BUCKETS; i++)
+		INIT_LIST_HEAD(&lowmem_bucket[i]);
+	for (i = 0; i < ARRAY_SIZE(lowmem_task_hash); i++)
+		INIT_HLIST_HEAD(&lowmem_task_hash[i]);
+
+	task_free_register(&task_free_index_nb);
+	register_oom_adj_notifier(&oom_adj_nb);
+
+	read_lock(&tasklist_lock);
+	for_each_process(p) {
+		if (!new)
+			new = kmalloc(sizeof(*new), GFP_ATOMIC);
+		lowmem_index_set(p, task_oom_adj(p), &new);
+	}
+	read_unlock(&tasklist_lock);
+	kfree(new);
+
+	lowmem_async_task = kthread_run(lowmem_async_thread, NULL,
+					"lowmemorykiller");
+	if (IS_ERR(lowmem_async_task)) {
+		printk(KERN_ERR "lowmemorykiller: failed to start async "
+		       "thread\n");
+		lowmem_async_task = NULL;
+	}
+
+	create_proc_read_entry("lowmemorykiller", S_IRUGO, NULL,
+			       lowmem_read_proc, NULL);
+
 	register_shrinker(&lowmem_shrinker);
 	return 0;
 }
 
 static void __exit lowmem_exit(void)
 {
+	struct lowmem_task *lt, *tmp;
+	int i;
+
 	unregister_shrinker(&lowmem_shrinker);
+	remove_proc_entry("lowmemorykiller", NULL);
+	if (lowmem_async_task)
+		kthread_stop(lowmem_async_task);
+	unregister_oom_adj_notifier(&oom_adj_nb);
+	task_free_unregister(&task_free_index_nb);
+
+	for (i = 0; i < LOWMEM_BUCKETS; i++)
+		list_for_each_entry_safe(lt, tmp, &lowmem_bucket[i], bucket)
+			kfree(lt);
 }
 
 module_param_named(cost, lowmem_shrinker.seeks, int, S_IRUGO | S_IWUSR);
@@ -289,8 +863,16 @@ module_param_array_named(minfile, lowmem_minfile, uint, &lowmem_minfile_size,
 module_param_named(ignore_deathpending, ignore_lowmem_deathpending, int,
 			 S_IRUGO | S_IWUSR);
 
-module_param_named(max_deathpending_retries, lowmem_max_deathpending_retries, int,
-			 S_IRUGO | S_IWUSR);
+module_param_named(deathpending_timeout_ms, lowmem_deathpending_timeout_ms,
+		   uint, S_IRUGO | S_IWUSR);
+module_param_named(async, lowmem_async, int, S_IRUGO | S_IWUSR);
+module_param_named(async_poll_ms, lowmem_async_poll_ms, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(async_hysteresis, lowmem_async_hysteresis, uint,
+		   S_IRUGO | S_IWUSR);
+
+module_param_named(rss_cache_ms, lowmem_rss_cache_ms, uint, S_IRUGO | S_IWUSR);
+module_param_named(swap_credit, lowmem_swap_credit, uint, S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
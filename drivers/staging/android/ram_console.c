@@ -25,6 +25,10 @@
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
 #include <linux/rslib.h>
 #endif
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_COMPRESS
+#include <linux/lzo.h>
+#include <linux/vmalloc.h>
+#endif
 
 struct ram_console_buffer {
 	uint32_t    sig;
@@ -34,6 +38,7 @@ struct ram_console_buffer {
 };
 
 #define RAM_CONSOLE_SIG (0x43474244) /* DBGC */
+#define RAM_CONSOLE_ZSIG (0x5a474244) /* DBGZ */
 
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_EARLY_INIT
 static char __initdata
@@ -55,6 +60,204 @@ static int ram_console_bad_blocks;
 #define ECC_POLY CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION_POLYNOMIAL
 #endif
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_COMPRESS
+/*
+ * A compressed buffer holds an index, the chunk being filled as plain text
+ * and a ring of LZO compressed chunks behind it. buffer->start is how much
+ * of the open chunk is used. Chunks never wrap around the end of the ring,
+ * so each one can be decoded on its own.
+ */
+#define RAM_CONSOLE_CHUNK	4096
+#define RAM_CONSOLE_ZENTRIES	256
+
+struct ram_console_zentry {
+	uint32_t offset;	/* in the ring */
+	uint16_t len;		/* stored as plain text if equal to raw_len */
+	uint16_t raw_len;
+};
+
+struct ram_console_zindex {
+	uint32_t first;		/* oldest chunk still in the ring */
+	uint32_t next;		/* sequence number of the next chunk */
+	uint32_t head;		/* where the next chunk goes in the ring */
+	struct ram_console_zentry ent[RAM_CONSOLE_ZENTRIES];
+};
+
+static struct ram_console_zindex *ram_console_zindex;
+static uint8_t *ram_console_open;
+static uint8_t *ram_console_ring;
+static size_t ram_console_ring_size;
+static void *ram_console_wrkmem;
+static uint8_t *ram_console_zbuf;
+
+static inline struct ram_console_zentry *ram_console_zentry(uint32_t seq)
+{
+	return &ram_console_zindex->ent[seq % RAM_CONSOLE_ZENTRIES];
+}
+
+/* compress the open chunk into the ring, called with the console locked */
+static void ram_console_zflush(void)
+{
+	struct ram_console_zindex *zi = ram_console_zindex;
+	struct ram_console_zentry *e;
+	size_t raw_len = ram_console_buffer->start;
+	const uint8_t *src = ram_console_zbuf;
+	size_t len;
+	uint32_t off;
+	int wrapped = 0;
+
+	if (lzo1x_1_compress(ram_console_open, raw_len, ram_console_zbuf,
+			     &len, ram_console_wrkmem) != LZO_E_OK ||
+	    len >= raw_len) {
+		src = ram_console_open;
+		len = raw_len;
+	}
+
+	off = zi->head;
+	if (off + len > ram_console_ring_size) {
+		off = 0;
+		wrapped = 1;
+	}
+
+	/* the oldest chunk is always the next one in the way */
+	while (zi->first != zi->next) {
+		e = ram_console_zentry(zi->first);
+		if (zi->next - zi->first < RAM_CONSOLE_ZENTRIES &&
+		    !(wrapped && e->offset >= zi->head) &&
+		    (e->offset >= off + len || e->offset + e->len <= off))
+			break;
+		zi->first++;
+	}
+
+	memcpy(ram_console_ring + off, src, len);
+	e = ram_console_zentry(zi->next);
+	e->offset = off;
+	e->len = len;
+	e->raw_len = raw_len;
+	zi->head = off + len;
+	/* only now is the chunk part of the log */
+	zi->next++;
+	ram_console_buffer->start = 0;
+}
+
+static void ram_console_zwrite(const char *s, unsigned int count)
+{
+	struct ram_console_buffer *buffer = ram_console_buffer;
+	unsigned int n;
+
+	while (count) {
+		n = min_t(unsigned int, count,
+			  RAM_CONSOLE_CHUNK - buffer->start);
+		memcpy(ram_console_open + buffer->start, s, n);
+		buffer->start += n;
+		s += n;
+		count -= n;
+		if (buffer->start == RAM_CONSOLE_CHUNK)
+			ram_console_zflush();
+	}
+}
+
+static int __init ram_console_zsetup(struct ram_console_buffer *buffer)
+{
+	size_t need = sizeof(struct ram_console_zindex) + 3 * RAM_CONSOLE_CHUNK;
+
+	if (ram_console_buffer_size < need) {
+		printk(KERN_INFO "ram_console: buffer too small to compress, "
+		       "%zu < %zu\n", ram_console_buffer_size, need);
+		return -EINVAL;
+	}
+	ram_console_zindex = (struct ram_console_zindex *)buffer->data;
+	ram_console_open = buffer->data + sizeof(struct ram_console_zindex);
+	ram_console_ring = ram_console_open + RAM_CONSOLE_CHUNK;
+	ram_console_ring_size = ram_console_buffer_size -
+		sizeof(struct ram_console_zindex) - RAM_CONSOLE_CHUNK;
+
+	ram_console_zbuf = kmalloc(lzo1x_worst_compress(RAM_CONSOLE_CHUNK),
+				   GFP_KERNEL);
+	ram_console_wrkmem = vmalloc(LZO1X_1_MEM_COMPRESS);
+	if (!ram_console_zbuf || !ram_console_wrkmem) {
+		printk(KERN_ERR "ram_console: no memory to compress\n");
+		kfree(ram_console_zbuf);
+		vfree(ram_console_wrkmem);
+		ram_console_wrkmem = NULL;
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static int __init ram_console_zcheck(struct ram_console_buffer *buffer)
+{
+	struct ram_console_zindex *zi = ram_console_zindex;
+	struct ram_console_zentry *e;
+	uint32_t seq;
+
+	if (!zi || zi->next - zi->first > RAM_CONSOLE_ZENTRIES ||
+	    zi->head > ram_console_ring_size ||
+	    buffer->start > RAM_CONSOLE_CHUNK)
+		return -EINVAL;
+	for (seq = zi->first; seq != zi->next; seq++) {
+		e = ram_console_zentry(seq);
+		if (e->offset + e->len > ram_console_ring_size ||
+		    e->raw_len > RAM_CONSOLE_CHUNK || e->len > e->raw_len)
+			return -EINVAL;
+	}
+	return 0;
+}
+
+static void __init
+ram_console_zsave_old(struct ram_console_buffer *buffer, char *dest)
+{
+	struct ram_console_zindex *zi = ram_console_zindex;
+	struct ram_console_zentry *e;
+	size_t old_log_size = buffer->start;
+	size_t pos = 0, out;
+	uint32_t seq;
+	int bad = 0;
+
+	if (ram_console_zcheck(buffer)) {
+		printk(KERN_INFO "ram_console: found invalid compressed "
+		       "buffer\n");
+		return;
+	}
+	for (seq = zi->first; seq != zi->next; seq++)
+		old_log_size += ram_console_zentry(seq)->raw_len;
+
+	printk(KERN_INFO "ram_console: found compressed buffer, %u chunks, "
+	       "%zu bytes\n", zi->next - zi->first, old_log_size);
+
+	if (dest == NULL) {
+		dest = kmalloc(old_log_size, GFP_KERNEL);
+		if (dest == NULL) {
+			printk(KERN_ERR
+			       "ram_console: failed to allocate buffer\n");
+			return;
+		}
+	}
+
+	for (seq = zi->first; seq != zi->next; seq++) {
+		e = ram_console_zentry(seq);
+		out = e->raw_len;
+		if (e->len == e->raw_len)
+			memcpy(dest + pos, ram_console_ring + e->offset, out);
+		else if (lzo1x_decompress_safe(ram_console_ring + e->offset,
+					       e->len, dest + pos, &out) !=
+			 LZO_E_OK) {
+			bad++;
+			continue;
+		}
+		pos += out;
+	}
+	memcpy(dest + pos, ram_console_open, buffer->start);
+	pos += buffer->start;
+
+	if (bad)
+		printk(KERN_INFO "ram_console: %d chunks could not be "
+		       "decoded\n", bad);
+	ram_console_old_log = dest;
+	ram_console_old_log_size = pos;
+}
+#endif
+
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ERROR_CORRECTION
 static void ram_console_encode_rs8(uint8_t *data, size_t len, uint8_t *ecc)
 {
@@ -119,6 +322,12 @@ ram_console_write(struct console *console, const char *s, unsigned int count)
 	int rem;
 	struct ram_console_buffer *buffer = ram_console_buffer;
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_COMPRESS
+	if (ram_console_wrkmem) {
+		ram_console_zwrite(s, count);
+		return;
+	}
+#endif
 	if (count > ram_console_buffer_size) {
 		s += count - ram_console_buffer_size;
 		count = ram_console_buffer_size;
@@ -142,7 +351,7 @@ ram_console_write(struct console *console, const char *s, unsigned int count)
 static struct console ram_console = {
 	.name	= "ram",
 	.write	= ram_console_write,
-	.flags	= CON_PRINTBUFFER | CON_ENABLED,
+	.flags	= CON_PRINTBUFFER | CON_ENABLED | CON_IMMEDIATE,
 	.index	= -1,
 };
 
@@ -279,6 +488,10 @@ static int __init ram_console_init(struct ram_console_buffer *buffer,
 	}
 #endif
 
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_COMPRESS
+	ram_console_zsetup(buffer);
+#endif
+
 	if (buffer->sig == RAM_CONSOLE_SIG) {
 		if (buffer->size > ram_console_buffer_size
 		    || buffer->start > buffer->size)
@@ -291,6 +504,10 @@ static int __init ram_console_init(struct ram_console_buffer *buffer,
 			       buffer->size, buffer->start);
 			ram_console_save_old(buffer, old_buf);
 		}
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_COMPRESS
+	} else if (buffer->sig == RAM_CONSOLE_ZSIG) {
+		ram_console_zsave_old(buffer, old_buf);
+#endif
 	} else {
 		printk(KERN_INFO "ram_console: no valid data in buffer "
 		       "(sig = 0x%08x)\n", buffer->sig);
@@ -299,6 +516,12 @@ static int __init ram_console_init(struct ram_console_buffer *buffer,
 	buffer->sig = RAM_CONSOLE_SIG;
 	buffer->start = 0;
 	buffer->size = 0;
+#ifdef CONFIG_ANDROID_RAM_CONSOLE_COMPRESS
+	if (ram_console_wrkmem) {
+		memset(ram_console_zindex, 0, sizeof(*ram_console_zindex));
+		buffer->sig = RAM_CONSOLE_ZSIG;
+	}
+#endif
 
 	register_console(&ram_console);
 #ifdef CONFIG_ANDROID_RAM_CONSOLE_ENABLE_VERBOSE
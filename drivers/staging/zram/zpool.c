@@ -0,0 +1,262 @@
+/* drivers/staging/zram/zpool.c
+ *
+ * Allocator packing compressed pages into shared pages.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Objects are grouped into size classes ZPOOL_ALIGN bytes apart.  Each
+ * class carves objects out of zspages: runs of up to ZSPAGE_MAX_PAGES
+ * order-0 pages, sized per class so that the tail left over is as small
+ * as possible.  The pages are never mapped into the kernel permanently,
+ * so they may come from highmem; objects are free to straddle a page
+ * boundary and are copied in and out with kmap_atomic().
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/bitops.h>
+#include <linux/spinlock.h>
+#include <linux/list.h>
+
+#include "zpool.h"
+
+#define ZPOOL_ALIGN		32
+#define ZPOOL_NR_CLASSES	(ZPOOL_MAX_SIZE / ZPOOL_ALIGN)
+#define ZSPAGE_MAX_PAGES	4
+#define ZSPAGE_MAX_OBJS		(ZSPAGE_MAX_PAGES * PAGE_SIZE / ZPOOL_ALIGN)
+
+struct zpool_class {
+	unsigned int size;
+	unsigned int nr_pages;
+	unsigned int nr_objs;
+	struct list_head partial;
+};
+
+struct zspage {
+	struct list_head list;
+	struct zpool_class *class;
+	unsigned int inuse;
+	struct page *page[ZSPAGE_MAX_PAGES];
+	unsigned long used[BITS_TO_LONGS(ZSPAGE_MAX_OBJS)];
+};
+
+struct zpool {
+	spinlock_t lock;
+	u64 pages;
+	struct zpool_class class[ZPOOL_NR_CLASSES];
+};
+
+static unsigned int zpool_class_pages(unsigned int size)
+{
+	unsigned int n, best = 1, waste, best_waste = UINT_MAX;
+
+	for (n = 1; n <= ZSPAGE_MAX_PAGES; n++) {
+		/* waste per page, scaled to avoid rounding */
+		waste = ((n * PAGE_SIZE) % size) * ZSPAGE_MAX_PAGES / n;
+		if (waste < best_waste) {
+			best_waste = waste;
+			best = n;
+		}
+	}
+	return best;
+}
+
+static struct zpool_class *zpool_get_class(struct zpool *pool, size_t size)
+{
+	unsigned int i = DIV_ROUND_UP(size, ZPOOL_ALIGN);
+
+	return &pool->class[(i ? i : 1) - 1];
+}
+
+struct zpool *zpool_create(void)
+{
+	struct zpool *pool;
+	int i;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	spin_lock_init(&pool->lock);
+	for (i = 0; i < ZPOOL_NR_CLASSES; i++) {
+		struct zpool_class *class = &pool->class[i];
+
+		class->size = (i + 1) * ZPOOL_ALIGN;
+		class->nr_pages = zpool_class_pages(class->size);
+		class->nr_objs = class->nr_pages * PAGE_SIZE / class->size;
+		INIT_LIST_HEAD(&class->partial);
+	}
+	return pool;
+}
+
+static void zspage_release(struct zspage *zspage)
+{
+	int i;
+
+	for (i = 0; i < zspage->class->nr_pages; i++)
+		__free_page(zspage->page[i]);
+	kfree(zspage);
+}
+
+/* Full zspages are not tracked; the caller must free every object first. */
+void zpool_destroy(struct zpool *pool)
+{
+	struct zspage *zspage, *n;
+	int i;
+
+	for (i = 0; i < ZPOOL_NR_CLASSES; i++) {
+		list_for_each_entry_safe(zspage, n, &pool->class[i].partial,
+					 list) {
+			list_del(&zspage->list);
+			zspage_release(zspage);
+		}
+	}
+	kfree(pool);
+}
+
+static struct zspage *zspage_create(struct zpool_class *class, gfp_t flags)
+{
+	struct zspage *zspage;
+	int i;
+
+	zspage = kzalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	zspage->class = class;
+	INIT_LIST_HEAD(&zspage->list);
+	for (i = 0; i < class->nr_pages; i++) {
+		zspage->page[i] = alloc_page(flags);
+		if (!zspage->page[i])
+			goto err;
+	}
+	return zspage;
+
+err:
+	while (--i >= 0)
+		__free_page(zspage->page[i]);
+	kfree(zspage);
+	return NULL;
+}
+
+/*
+ * Allocate an object of @size bytes.  Full zspages are kept off the
+ * partial list, so the head of that list always has a free slot.  A
+ * zspage goes back to the page allocator as soon as its last object is
+ * freed.
+ */
+int zpool_alloc(struct zpool *pool, size_t size, gfp_t flags,
+		struct zspage **zspagep, u16 *idx)
+{
+	struct zpool_class *class;
+	struct zspage *zspage;
+	unsigned int obj;
+
+	if (!size || size > ZPOOL_MAX_SIZE)
+		return -EINVAL;
+
+	class = zpool_get_class(pool, size);
+
+	spin_lock(&pool->lock);
+	if (list_empty(&class->partial)) {
+		spin_unlock(&pool->lock);
+		zspage = zspage_create(class, flags);
+		if (!zspage)
+			return -ENOMEM;
+		spin_lock(&pool->lock);
+		pool->pages += class->nr_pages;
+		list_add(&zspage->list, &class->partial);
+	}
+
+	zspage = list_first_entry(&class->partial, struct zspage, list);
+	obj = find_first_zero_bit(zspage->used, class->nr_objs);
+	BUG_ON(obj >= class->nr_objs);
+	__set_bit(obj, zspage->used);
+	if (++zspage->inuse == class->nr_objs)
+		list_del_init(&zspage->list);
+	spin_unlock(&pool->lock);
+
+	*zspagep = zspage;
+	*idx = obj;
+	return 0;
+}
+
+void zpool_free(struct zpool *pool, struct zspage *zspage, u16 idx)
+{
+	struct zpool_class *class = zspage->class;
+
+	spin_lock(&pool->lock);
+	BUG_ON(!test_bit(idx, zspage->used));
+	__clear_bit(idx, zspage->used);
+	if (zspage->inuse-- == class->nr_objs)
+		list_add(&zspage->list, &class->partial);
+	if (zspage->inuse) {
+		spin_unlock(&pool->lock);
+		return;
+	}
+	list_del(&zspage->list);
+	pool->pages -= class->nr_pages;
+	spin_unlock(&pool->lock);
+
+	zspage_release(zspage);
+}
+
+/*
+ * The caller owns the object, so the copy helpers need no pool lock: the
+ * pages of a zspage are fixed for its lifetime.
+ */
+static void zpool_copy(struct zspage *zspage, u16 idx, void *buf,
+		       size_t len, int to_obj)
+{
+	unsigned long off = (unsigned long)idx * zspage->class->size;
+	size_t chunk;
+	void *p;
+
+	while (len) {
+		struct page *page = zspage->page[off >> PAGE_SHIFT];
+		unsigned long poff = off & ~PAGE_MASK;
+
+		chunk = min_t(size_t, len, PAGE_SIZE - poff);
+		p = kmap_atomic(page, KM_USER1);
+		if (to_obj)
+			memcpy(p + poff, buf, chunk);
+		else
+			memcpy(buf, p + poff, chunk);
+		kunmap_atomic(p, KM_USER1);
+
+		buf += chunk;
+		off += chunk;
+		len -= chunk;
+	}
+}
+
+void zpool_write(struct zpool *pool, struct zspage *zspage, u16 idx,
+		 const void *src, size_t len)
+{
+	BUG_ON(len > zspage->class->size);
+	zpool_copy(zspage, idx, (void *)src, len, 1);
+}
+
+void zpool_read(struct zpool *pool, struct zspage *zspage, u16 idx,
+		void *dst, size_t len)
+{
+	BUG_ON(len > zspage->class->size);
+	zpool_copy(zspage, idx, dst, len, 0);
+}
+
+u64 zpool_pages(struct zpool *pool)
+{
+	return pool->pages;
+}
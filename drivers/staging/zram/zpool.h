@@ -0,0 +1,41 @@
+/* drivers/staging/zram/zpool.h
+ *
+ * Allocator packing compressed pages into shared pages.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _ZPOOL_H
+#define _ZPOOL_H
+
+#include <linux/types.h>
+
+/* objects larger than this are not worth packing; store them whole */
+#define ZPOOL_MAX_SIZE		(PAGE_SIZE / 4 * 3)
+
+struct zpool;
+struct zspage;
+
+struct zpool *zpool_create(void);
+void zpool_destroy(struct zpool *pool);
+
+int zpool_alloc(struct zpool *pool, size_t size, gfp_t flags,
+		struct zspage **zspage, u16 *idx);
+void zpool_free(struct zpool *pool, struct zspage *zspage, u16 idx);
+
+void zpool_write(struct zpool *pool, struct zspage *zspage, u16 idx,
+		 const void *src, size_t len);
+void zpool_read(struct zpool *pool, struct zspage *zspage, u16 idx,
+		void *dst, size_t len);
+
+u64 zpool_pages(struct zpool *pool);
+
+#endif
@@ -0,0 +1,614 @@
+/* drivers/staging/zram/zram_drv.c
+ *
+ * Compressed RAM block device.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * Every page-sized block of the disk has a table entry. A zero entry has
+ * never been written (or was freed) and reads back as zeroes. Pages made
+ * of a single repeated word only record that word; everything else is
+ * compressed with LZO into the zpool, or kept whole if it does not shrink
+ * enough. The device only accepts page-aligned, page-sized segments, which
+ * is all swap ever issues.
+ *
+ * The disk is set up on first I/O, using the size last written to the
+ * disksize attribute. Writing 1 to reset releases all memory held and
+ * allows the size to be changed again.
+ */
+
+#define pr_fmt(fmt) "zram: " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/genhd.h>
+#include <linux/highmem.h>
+#include <linux/lzo.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+static int zram_major;
+static struct zram *zram_devices;
+
+static unsigned int num_devices = 1;
+module_param(num_devices, uint, 0);
+MODULE_PARM_DESC(num_devices, "Number of zram devices");
+
+static int page_same_filled(void *ptr, unsigned long *element)
+{
+	unsigned long *page = ptr;
+	unsigned long val = page[0];
+	unsigned int pos;
+
+	for (pos = 1; pos < PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != val)
+			return 0;
+	}
+	*element = val;
+	return 1;
+}
+
+static void fill_page(void *ptr, unsigned long value)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	if (!value) {
+		memset(ptr, 0, PAGE_SIZE);
+		return;
+	}
+	for (pos = 0; pos < PAGE_SIZE / sizeof(*page); pos++)
+		page[pos] = value;
+}
+
+/* called with zram->lock held */
+static void zram_free_entry(struct zram *zram, struct zram_entry *entry)
+{
+	if (entry->flags & (1 << ZRAM_SAME)) {
+		zram->stats.pages_same--;
+		goto out;
+	}
+	if (entry->flags & (1 << ZRAM_RAW)) {
+		__free_page(entry->page);
+		zram->stats.pages_raw--;
+		zram->stats.compr_data_size -= PAGE_SIZE;
+		goto out_stored;
+	}
+	if (!entry->zspage)
+		return;
+
+	zpool_free(zram->pool, entry->zspage, entry->idx);
+	zram->stats.compr_data_size -= entry->size;
+out_stored:
+	zram->stats.pages_stored--;
+out:
+	zram->stats.orig_data_size -= PAGE_SIZE;
+	memset(entry, 0, sizeof(*entry));
+}
+
+static int zram_read(struct zram *zram, struct page *page, u32 index)
+{
+	struct zram_entry *entry = &zram->table[index];
+	size_t clen = PAGE_SIZE;
+	void *dst;
+	int ret = 0;
+
+	spin_lock(&zram->lock);
+	zram->stats.num_reads++;
+
+	if (entry->flags & (1 << ZRAM_RAW)) {
+		copy_highpage(page, entry->page);
+		goto out;
+	}
+
+	dst = kmap_atomic(page, KM_USER0);
+	if (entry->flags & (1 << ZRAM_SAME))
+		fill_page(dst, entry->element);
+	else if (!entry->zspage)
+		memset(dst, 0, PAGE_SIZE);
+	else {
+		zpool_read(zram->pool, entry->zspage, entry->idx,
+			   zram->decompress_buf, entry->size);
+		ret = lzo1x_decompress_safe(zram->decompress_buf, entry->size,
+					    dst, &clen);
+	}
+	kunmap_atomic(dst, KM_USER0);
+
+	if (unlikely(ret != LZO_E_OK || clen != PAGE_SIZE)) {
+		zram->stats.failed_reads++;
+		pr_err("decompression failed for page %u: %d\n", index, ret);
+		ret = -EIO;
+	}
+out:
+	spin_unlock(&zram->lock);
+	flush_dcache_page(page);
+	return ret;
+}
+
+static int zram_write(struct zram *zram, struct page *page, u32 index)
+{
+	struct zram_entry new = { };
+	unsigned long element;
+	size_t clen;
+	void *src;
+	int ret;
+
+	src = kmap_atomic(page, KM_USER0);
+	if (page_same_filled(src, &element)) {
+		kunmap_atomic(src, KM_USER0);
+		new.element = element;
+		new.flags = 1 << ZRAM_SAME;
+		goto store;
+	}
+
+	mutex_lock(&zram->write_lock);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, zram->compress_buf, &clen,
+			       zram->compress_workmem);
+	kunmap_atomic(src, KM_USER0);
+	if (unlikely(ret != LZO_E_OK)) {
+		mutex_unlock(&zram->write_lock);
+		pr_err("compression failed for page %u: %d\n", index, ret);
+		goto fail;
+	}
+
+	if (unlikely(clen > ZRAM_MAX_ZPAGE_SIZE)) {
+		mutex_unlock(&zram->write_lock);
+		new.page = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+		if (!new.page)
+			goto fail;
+		copy_highpage(new.page, page);
+		new.flags = 1 << ZRAM_RAW;
+		goto store;
+	}
+
+	if (zpool_alloc(zram->pool, clen, GFP_NOIO | __GFP_HIGHMEM,
+			&new.zspage, &new.idx)) {
+		mutex_unlock(&zram->write_lock);
+		goto fail;
+	}
+	zpool_write(zram->pool, new.zspage, new.idx, zram->compress_buf, clen);
+	mutex_unlock(&zram->write_lock);
+	new.size = clen;
+
+store:
+	spin_lock(&zram->lock);
+	zram_free_entry(zram, &zram->table[index]);
+	zram->table[index] = new;
+	zram->stats.num_writes++;
+	zram->stats.orig_data_size += PAGE_SIZE;
+	if (new.flags & (1 << ZRAM_SAME)) {
+		zram->stats.pages_same++;
+	} else {
+		zram->stats.pages_stored++;
+		if (new.flags & (1 << ZRAM_RAW)) {
+			zram->stats.pages_raw++;
+			zram->stats.compr_data_size += PAGE_SIZE;
+		} else
+			zram->stats.compr_data_size += new.size;
+	}
+	spin_unlock(&zram->lock);
+	return 0;
+
+fail:
+	spin_lock(&zram->lock);
+	zram->stats.num_writes++;
+	zram->stats.failed_writes++;
+	spin_unlock(&zram->lock);
+	return -ENOMEM;
+}
+
+static void zram_reset_device(struct zram *zram)
+{
+	size_t index, nr_pages = zram->disksize >> PAGE_SHIFT;
+
+	if (!zram->init_done)
+		return;
+
+	for (index = 0; index < nr_pages; index++) {
+		spin_lock(&zram->lock);
+		zram_free_entry(zram, &zram->table[index]);
+		spin_unlock(&zram->lock);
+		cond_resched();
+	}
+
+	zpool_destroy(zram->pool);
+	vfree(zram->table);
+	kfree(zram->compress_workmem);
+	free_pages((unsigned long)zram->compress_buf, 1);
+	free_page((unsigned long)zram->decompress_buf);
+
+	zram->pool = NULL;
+	zram->table = NULL;
+	zram->compress_workmem = NULL;
+	zram->compress_buf = NULL;
+	zram->decompress_buf = NULL;
+	memset(&zram->stats, 0, sizeof(zram->stats));
+	zram->init_done = 0;
+}
+
+static int zram_init_device(struct zram *zram)
+{
+	size_t nr_pages;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		return 0;
+	}
+
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	zram->table = vmalloc(nr_pages * sizeof(*zram->table));
+	zram->compress_workmem = kmalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+	/* lzo can expand incompressible data a little past PAGE_SIZE */
+	zram->compress_buf = (void *)__get_free_pages(GFP_KERNEL, 1);
+	zram->decompress_buf = (void *)__get_free_page(GFP_KERNEL);
+	zram->pool = zpool_create();
+	if (!zram->table || !zram->compress_workmem || !zram->compress_buf ||
+	    !zram->decompress_buf || !zram->pool) {
+		pr_err("failed to allocate %zu page table\n", nr_pages);
+		goto fail;
+	}
+	memset(zram->table, 0, nr_pages * sizeof(*zram->table));
+
+	zram->init_done = 1;
+	mutex_unlock(&zram->init_lock);
+	pr_info("%s: %llu KB\n", zram->disk->disk_name, zram->disksize >> 10);
+	return 0;
+
+fail:
+	if (zram->pool)
+		zpool_destroy(zram->pool);
+	vfree(zram->table);
+	kfree(zram->compress_workmem);
+	if (zram->compress_buf)
+		free_pages((unsigned long)zram->compress_buf, 1);
+	if (zram->decompress_buf)
+		free_page((unsigned long)zram->decompress_buf);
+	zram->pool = NULL;
+	zram->table = NULL;
+	zram->compress_workmem = NULL;
+	zram->compress_buf = NULL;
+	zram->decompress_buf = NULL;
+	mutex_unlock(&zram->init_lock);
+	return -ENOMEM;
+}
+
+static int zram_valid_bio(struct zram *zram, struct bio *bio)
+{
+	sector_t end = bio->bi_sector + (bio->bi_size >> SECTOR_SHIFT);
+
+	if (unlikely(bio->bi_sector & (SECTORS_PER_PAGE - 1)))
+		return 0;
+	if (unlikely(bio->bi_size & (PAGE_SIZE - 1)))
+		return 0;
+	if (unlikely(end > (zram->disksize >> SECTOR_SHIFT)))
+		return 0;
+	return 1;
+}
+
+static int zram_make_request(struct request_queue *queue, struct bio *bio)
+{
+	struct zram *zram = queue->queuedata;
+	struct bio_vec *bvec;
+	u32 index;
+	int i, err = 0;
+
+	if (unlikely(!zram->init_done) && zram_init_device(zram))
+		goto out_error;
+
+	if (!zram_valid_bio(zram, bio))
+		goto out_error;
+
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	bio_for_each_segment(bvec, bio, i) {
+		if (unlikely(bvec->bv_len != PAGE_SIZE || bvec->bv_offset))
+			goto out_error;
+
+		if (bio_data_dir(bio) == READ)
+			err = zram_read(zram, bvec->bv_page, index);
+		else
+			err = zram_write(zram, bvec->bv_page, index);
+		if (err)
+			goto out_error;
+		index++;
+	}
+
+	set_bit(BIO_UPTODATE, &bio->bi_flags);
+	bio_endio(bio, 0);
+	return 0;
+
+out_error:
+	bio_io_error(bio);
+	return 0;
+}
+
+/* called with swap_lock held; must not sleep */
+static void zram_slot_free_notify(struct block_device *bdev,
+				  unsigned long index)
+{
+	struct zram *zram = bdev->bd_disk->private_data;
+
+	if (!zram->init_done || index >= (zram->disksize >> PAGE_SHIFT))
+		return;
+
+	spin_lock(&zram->lock);
+	zram_free_entry(zram, &zram->table[index]);
+	zram->stats.notify_free++;
+	spin_unlock(&zram->lock);
+}
+
+static const struct block_device_operations zram_devops = {
+	.swap_slot_free_notify	= zram_slot_free_notify,
+	.owner			= THIS_MODULE,
+};
+
+static inline struct zram *dev_to_zram(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+static ssize_t disksize_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n", dev_to_zram(dev)->disksize);
+}
+
+static ssize_t disksize_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned long long disksize;
+	int ret;
+
+	ret = strict_strtoull(buf, 10, &disksize);
+	if (ret)
+		return ret;
+	disksize = PAGE_ALIGN(disksize);
+	if (!disksize)
+		return -EINVAL;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		mutex_unlock(&zram->init_lock);
+		return -EBUSY;
+	}
+	zram->disksize = disksize;
+	set_capacity(zram->disk, disksize >> SECTOR_SHIFT);
+	mutex_unlock(&zram->init_lock);
+
+	return len;
+}
+
+static ssize_t reset_store(struct device *dev,
+			   struct device_attribute *attr,
+			   const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct block_device *bdev;
+	unsigned long do_reset;
+	int ret;
+
+	ret = strict_strtoul(buf, 10, &do_reset);
+	if (ret)
+		return ret;
+	if (!do_reset)
+		return -EINVAL;
+
+	bdev = bdget_disk(zram->disk, 0);
+	if (!bdev)
+		return -ENOMEM;
+
+	/* the table must not go away under swap or a mounted fs */
+	mutex_lock(&bdev->bd_mutex);
+	if (bdev->bd_openers) {
+		mutex_unlock(&bdev->bd_mutex);
+		bdput(bdev);
+		return -EBUSY;
+	}
+	mutex_lock(&zram->init_lock);
+	zram_reset_device(zram);
+	mutex_unlock(&zram->init_lock);
+	mutex_unlock(&bdev->bd_mutex);
+	bdput(bdev);
+
+	return len;
+}
+
+#define ZRAM_STAT_ATTR(name, expr)					\
+static ssize_t name##_show(struct device *dev,				\
+			   struct device_attribute *attr, char *buf)	\
+{									\
+	struct zram *zram = dev_to_zram(dev);				\
+	u64 val;							\
+									\
+	spin_lock(&zram->lock);						\
+	val = (expr);							\
+	spin_unlock(&zram->lock);					\
+	return sprintf(buf, "%llu\n", (unsigned long long)val);		\
+}									\
+static DEVICE_ATTR(name, S_IRUGO, name##_show, NULL)
+
+ZRAM_STAT_ATTR(orig_data_size, zram->stats.orig_data_size);
+ZRAM_STAT_ATTR(compr_data_size, zram->stats.compr_data_size);
+ZRAM_STAT_ATTR(mem_used_total, zram->pool ?
+	       (zpool_pages(zram->pool) + zram->stats.pages_raw) << PAGE_SHIFT
+	       : 0);
+ZRAM_STAT_ATTR(pages_stored, zram->stats.pages_stored);
+ZRAM_STAT_ATTR(pages_same, zram->stats.pages_same);
+ZRAM_STAT_ATTR(num_reads, zram->stats.num_reads);
+ZRAM_STAT_ATTR(num_writes, zram->stats.num_writes);
+ZRAM_STAT_ATTR(failed_reads, zram->stats.failed_reads);
+ZRAM_STAT_ATTR(failed_writes, zram->stats.failed_writes);
+ZRAM_STAT_ATTR(notify_free, zram->stats.notify_free);
+
+static DEVICE_ATTR(disksize, S_IRUGO | S_IWUSR, disksize_show,
+		   disksize_store);
+static DEVICE_ATTR(reset, S_IWUSR, NULL, reset_store);
+
+static struct attribute *zram_disk_attrs[] = {
+	&dev_attr_disksize.attr,
+	&dev_attr_reset.attr,
+	&dev_attr_orig_data_size.attr,
+	&dev_attr_compr_data_size.attr,
+	&dev_attr_mem_used_total.attr,
+	&dev_attr_pages_stored.attr,
+	&dev_attr_pages_same.attr,
+	&dev_attr_num_reads.attr,
+	&dev_attr_num_writes.attr,
+	&dev_attr_failed_reads.attr,
+	&dev_attr_failed_writes.attr,
+	&dev_attr_notify_free.attr,
+	NULL,
+};
+
+static struct attribute_group zram_disk_attr_group = {
+	.attrs = zram_disk_attrs,
+};
+
+static int __init create_device(struct zram *zram, int device_id)
+{
+	int ret;
+
+	spin_lock_init(&zram->lock);
+	mutex_init(&zram->write_lock);
+	mutex_init(&zram->init_lock);
+
+	zram->queue = blk_alloc_queue(GFP_KERNEL);
+	if (!zram->queue) {
+		pr_err("error allocating disk queue for device %d\n",
+		       device_id);
+		return -ENOMEM;
+	}
+	blk_queue_make_request(zram->queue, zram_make_request);
+	zram->queue->queuedata = zram;
+
+	zram->disk = alloc_disk(1);
+	if (!zram->disk) {
+		pr_err("error allocating disk structure for device %d\n",
+		       device_id);
+		ret = -ENOMEM;
+		goto out_free_queue;
+	}
+
+	zram->disk->major = zram_major;
+	zram->disk->first_minor = device_id;
+	zram->disk->fops = &zram_devops;
+	zram->disk->queue = zram->queue;
+	zram->disk->private_data = zram;
+	snprintf(zram->disk->disk_name, 16, "zram%d", device_id);
+
+	zram->disksize = PAGE_ALIGN(((u64)totalram_pages << PAGE_SHIFT) *
+				    ZRAM_DEFAULT_DISKSIZE_PERC / 100);
+	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
+
+	/* all I/O is done a page at a time */
+	blk_queue_logical_block_size(zram->queue, PAGE_SIZE);
+	blk_queue_physical_block_size(zram->queue, PAGE_SIZE);
+	blk_queue_io_min(zram->queue, PAGE_SIZE);
+	blk_queue_bounce_limit(zram->queue, BLK_BOUNCE_ANY);
+	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->queue);
+
+	add_disk(zram->disk);
+
+	ret = sysfs_create_group(&disk_to_dev(zram->disk)->kobj,
+				 &zram_disk_attr_group);
+	if (ret < 0) {
+		pr_err("error creating sysfs group for device %d\n",
+		       device_id);
+		goto out_del_disk;
+	}
+	return 0;
+
+out_del_disk:
+	del_gendisk(zram->disk);
+	put_disk(zram->disk);
+	zram->disk = NULL;
+out_free_queue:
+	blk_cleanup_queue(zram->queue);
+	zram->queue = NULL;
+	return ret;
+}
+
+static void destroy_device(struct zram *zram)
+{
+	if (zram->disk) {
+		sysfs_remove_group(&disk_to_dev(zram->disk)->kobj,
+				   &zram_disk_attr_group);
+		del_gendisk(zram->disk);
+		put_disk(zram->disk);
+	}
+	if (zram->queue)
+		blk_cleanup_queue(zram->queue);
+	zram_reset_device(zram);
+}
+
+static int __init zram_init(void)
+{
+	int ret, dev_id;
+
+	if (!num_devices || num_devices > 256) {
+		pr_err("invalid num_devices: %u\n", num_devices);
+		return -EINVAL;
+	}
+
+	zram_major = register_blkdev(0, "zram");
+	if (zram_major <= 0) {
+		pr_err("unable to get major number\n");
+		return -EBUSY;
+	}
+
+	zram_devices = kzalloc(num_devices * sizeof(*zram_devices),
+			       GFP_KERNEL);
+	if (!zram_devices) {
+		ret = -ENOMEM;
+		goto out_unregister;
+	}
+
+	for (dev_id = 0; dev_id < num_devices; dev_id++) {
+		ret = create_device(&zram_devices[dev_id], dev_id);
+		if (ret)
+			goto out_destroy;
+	}
+	return 0;
+
+out_destroy:
+	while (--dev_id >= 0)
+		destroy_device(&zram_devices[dev_id]);
+	kfree(zram_devices);
+out_unregister:
+	unregister_blkdev(zram_major, "zram");
+	return ret;
+}
+
+static void __exit zram_exit(void)
+{
+	int i;
+
+	for (i = 0; i < num_devices; i++)
+		destroy_device(&zram_devices[i]);
+	kfree(zram_devices);
+	unregister_blkdev(zram_major, "zram");
+}
+
+module_init(zram_init);
+module_exit(zram_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Compressed RAM block device");
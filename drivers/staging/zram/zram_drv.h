@@ -0,0 +1,87 @@
+/* drivers/staging/zram/zram_drv.h
+ *
+ * Compressed RAM block device.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _ZRAM_DRV_H
+#define _ZRAM_DRV_H
+
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/genhd.h>
+#include <linux/blkdev.h>
+
+#include "zpool.h"
+
+#ifndef SECTOR_SHIFT
+#define SECTOR_SHIFT		9
+#endif
+#define SECTORS_PER_PAGE_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
+#define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
+
+/* default disk size, as a percentage of RAM */
+#define ZRAM_DEFAULT_DISKSIZE_PERC	25
+
+/*
+ * Pages that compress to more than this are stored as-is: the compressed
+ * copy would save too little to be worth the decompression on every read.
+ */
+#define ZRAM_MAX_ZPAGE_SIZE	(PAGE_SIZE / 4 * 3)
+
+enum zram_pageflags {
+	ZRAM_SAME,	/* every word of the page holds 'element' */
+	ZRAM_RAW,	/* stored uncompressed in 'page' */
+	__NR_ZRAM_PAGEFLAGS,
+};
+
+struct zram_entry {
+	union {
+		struct zspage *zspage;	/* compressed object */
+		struct page *page;	/* ZRAM_RAW */
+		unsigned long element;	/* ZRAM_SAME */
+	};
+	u16 idx;	/* object index within zspage */
+	u16 size;	/* compressed length */
+	u8 flags;
+};
+
+struct zram_stats {
+	u64 orig_data_size;	/* uncompressed size of stored pages */
+	u64 compr_data_size;	/* compressed size of stored pages */
+	u64 num_reads;
+	u64 num_writes;
+	u64 failed_reads;
+	u64 failed_writes;
+	u64 notify_free;	/* slots freed by swap */
+	u32 pages_stored;
+	u32 pages_same;
+	u32 pages_raw;
+};
+
+struct zram {
+	struct zpool *pool;
+	struct zram_entry *table;
+	spinlock_t lock;	/* protects table, stats and decompress_buf */
+	struct mutex write_lock; /* serialises compression */
+	void *compress_workmem;
+	void *compress_buf;
+	void *decompress_buf;
+	struct request_queue *queue;
+	struct gendisk *disk;
+	struct mutex init_lock;	/* protects init, reset and disksize */
+	int init_done;
+	u64 disksize;		/* bytes */
+	struct zram_stats stats;
+};
+
+#endif
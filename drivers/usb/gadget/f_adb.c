@@ -25,6 +25,8 @@
 #include <linux/wait.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 
 #include <linux/types.h>
 #include <linux/device.h>
@@ -33,12 +35,24 @@
 #include <linux/usb/android_composite.h>
 #include <mach/board.h>
 
-#define BULK_BUFFER_SIZE           4096
+#define BULK_BUFFER_SIZE           16384
+#define BULK_BUFFER_SIZE_MIN       4096
+#define BULK_BUFFER_SIZE_MAX       65536
 
 /* number of tx requests to allocate */
-#define TX_REQ_MAX 4
+#define TX_REQ_MAX 8
+#define TX_REQ_LIMIT 32
 #define RX_REQ_MAX 32
 
+/* size and number of the tx requests, used when the function binds */
+static unsigned int bulk_size = BULK_BUFFER_SIZE;
+module_param(bulk_size, uint, S_IRUGO);
+MODULE_PARM_DESC(bulk_size, "adb tx request size, 4096-65536 bytes");
+
+static unsigned int tx_reqs = TX_REQ_MAX;
+module_param(tx_reqs, uint, S_IRUGO);
+MODULE_PARM_DESC(tx_reqs, "number of adb tx requests in flight");
+
 static const char shortname[] = "android_adb";
 
 struct adb_dev {
@@ -69,6 +83,11 @@ struct adb_dev {
 	unsigned read_count;
 
 	int maxsize;
+	/* bytes per tx request */
+	unsigned bulk_size;
+
+	/* tx request being filled by adb_splice_write */
+	struct usb_request *splice_req;
 };
 
 static struct usb_interface_descriptor adb_interface_desc = {
@@ -283,8 +302,15 @@ static int __init create_bulk_endpoints(struct adb_dev *dev,
 		req_put(dev, &dev->rx_idle, req);
 	}
 
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = adb_request_new(dev->ep_in, BULK_BUFFER_SIZE);
+	dev->bulk_size = clamp_t(unsigned, bulk_size,
+				 BULK_BUFFER_SIZE_MIN, BULK_BUFFER_SIZE_MAX);
+	for (i = 0; i < clamp_t(unsigned, tx_reqs, 1, TX_REQ_LIMIT); i++) {
+		req = adb_request_new(dev->ep_in, dev->bulk_size);
+		if (!req && i == 0 && dev->bulk_size > BULK_BUFFER_SIZE_MIN) {
+			/* memory too fragmented, settle for small requests */
+			dev->bulk_size = BULK_BUFFER_SIZE_MIN;
+			req = adb_request_new(dev->ep_in, dev->bulk_size);
+		}
 		if (!req)
 			goto fail;
 		req->complete = adb_complete_in;
@@ -309,7 +335,7 @@ static ssize_t adb_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "adb_read(%d)\n", count);
 
-	if (count > BULK_BUFFER_SIZE)
+	if (count > dev->bulk_size)
 		return -EINVAL;
 
 	if (_lock(&dev->read_excl))
@@ -432,8 +458,8 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 		}
 
 		if (req != 0) {
-			if (count > BULK_BUFFER_SIZE)
-				xfer = BULK_BUFFER_SIZE;
+			if (count > dev->bulk_size)
+				xfer = dev->bulk_size;
 			else
 				xfer = count;
 			if (copy_from_user(req->buf, buf, xfer)) {
@@ -466,6 +492,105 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+static int adb_splice_queue(struct adb_dev *dev)
+{
+	struct usb_request *req = dev->splice_req;
+	int ret;
+
+	dev->splice_req = 0;
+	ret = usb_ep_queue(dev->ep_in, req, GFP_ATOMIC);
+	if (ret < 0) {
+		DBG(dev->cdev, "adb_splice: xfer error %d\n", ret);
+		dev->error = 1;
+		req_put(dev, &dev->tx_idle, req);
+		return -EIO;
+	}
+	return 0;
+}
+
+/* copy straight from the pipe pages into the tx requests */
+static int adb_splice_actor(struct pipe_inode_info *pipe,
+			    struct pipe_buffer *buf, struct splice_desc *sd)
+{
+	struct adb_dev *dev = sd->u.file->private_data;
+	struct usb_request *req;
+	size_t len;
+	void *src;
+	int ret;
+
+	ret = buf->ops->confirm(pipe, buf);
+	if (ret)
+		return ret;
+
+	if (!dev->splice_req) {
+		req = 0;
+		ret = wait_event_interruptible(dev->write_wq,
+			((req = req_get(dev, &dev->tx_idle)) || dev->error));
+		if (ret < 0)
+			return ret;
+		if (!req)
+			return -EIO;
+		req->length = 0;
+		dev->splice_req = req;
+	}
+	req = dev->splice_req;
+
+	len = min_t(size_t, sd->len, dev->bulk_size - req->length);
+	src = buf->ops->map(pipe, buf, 0);
+	memcpy(req->buf + req->length, src + buf->offset, len);
+	buf->ops->unmap(pipe, buf, src);
+	req->length += len;
+
+	if (req->length == dev->bulk_size) {
+		ret = adb_splice_queue(dev);
+		if (ret)
+			return ret;
+	}
+	return len;
+}
+
+/*
+ * splice(2) from a file to the adb endpoint: the page cache pages are
+ * copied once into the usb requests, instead of through a userspace
+ * buffer with read and write.
+ */
+static ssize_t adb_splice_write(struct pipe_inode_info *pipe,
+				struct file *fp, loff_t *ppos,
+				size_t len, unsigned int flags)
+{
+	struct adb_dev *dev = fp->private_data;
+	ssize_t r;
+	int ret;
+
+	DBG(dev->cdev, "adb_splice_write(%d)\n", len);
+
+	if (_lock(&dev->write_excl))
+		return -EBUSY;
+
+	if (dev->error) {
+		r = -EIO;
+		goto out;
+	}
+
+	r = splice_from_pipe(pipe, fp, ppos, len, flags, adb_splice_actor);
+
+	/* send the tail, nothing is kept back between calls */
+	if (dev->splice_req) {
+		if (dev->splice_req->length && !dev->error) {
+			ret = adb_splice_queue(dev);
+			if (ret && r >= 0)
+				r = ret;
+		} else {
+			req_put(dev, &dev->tx_idle, dev->splice_req);
+			dev->splice_req = 0;
+		}
+	}
+out:
+	_unlock(&dev->write_excl);
+	DBG(dev->cdev, "adb_splice_write returning %d\n", r);
+	return r;
+}
+
 static int adb_open(struct inode *ip, struct file *fp)
 {
 	printk(KERN_INFO "adb_open\n");
@@ -492,6 +617,7 @@ static struct file_operations adb_fops = {
 	.owner = THIS_MODULE,
 	.read = adb_read,
 	.write = adb_write,
+	.splice_write = adb_splice_write,
 	.open = adb_open,
 	.release = adb_release,
 };
@@ -79,6 +79,23 @@
 
 
 #define BULK_BUFFER_SIZE           16384
+#define BULK_BUFFER_SIZE_MAX       65536
+
+/* Buffer size, read-ahead for sequential READs and the amount of
+ * data WRITE may leave dirty in the page cache before it starts
+ * writeback and waits for the previous batch (0 = no bound).
+ */
+static unsigned int buf_kb = BULK_BUFFER_SIZE / 1024;
+module_param(buf_kb, uint, S_IRUGO);
+MODULE_PARM_DESC(buf_kb, "size of each of the transfer buffers in KB");
+
+static unsigned int readahead_kb = 512;
+module_param(readahead_kb, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(readahead_kb, "read-ahead for sequential reads in KB");
+
+static unsigned int dirty_kb = 4096;
+module_param(dirty_kb, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(dirty_kb, "write-behind dirty window in KB, 0 = unbounded");
 
 /*-------------------------------------------------------------------------*/
 
@@ -240,6 +257,9 @@ struct lun {
 	u32		sense_data_info;
 	u32		unit_attention_data;
 
+	loff_t		next_read;	/* where a sequential READ starts */
+	u32		dirty;		/* bytes written since last flush */
+
 	struct device	dev;
 };
 
@@ -829,6 +849,15 @@ static int do_read(struct fsg_dev *fsg)
 	if (unlikely(amount_left == 0))
 		return -EIO;		/* No default reply */
 
+	/* The host streams sequential READs one at a time, so start
+	 * reading what follows this one while it goes out over USB. */
+	if (file_offset == curlun->next_read && readahead_kb)
+		page_cache_sync_readahead(curlun->filp->f_mapping,
+				&curlun->filp->f_ra, curlun->filp,
+				(file_offset + amount_left) >> PAGE_CACHE_SHIFT,
+				readahead_kb >> (PAGE_CACHE_SHIFT - 10));
+	curlun->next_read = file_offset + amount_left;
+
 	for (;;) {
 
 		/* Figure out how much we need to read:
@@ -917,6 +946,8 @@ static int do_read(struct fsg_dev *fsg)
 
 /*-------------------------------------------------------------------------*/
 
+static void write_behind(struct lun *curlun, u32 amount);
+
 static int do_write(struct fsg_dev *fsg)
 {
 	struct lun		*curlun = fsg->curlun;
@@ -1071,6 +1102,7 @@ static int do_write(struct fsg_dev *fsg)
 			file_offset += nwritten;
 			amount_left_to_write -= nwritten;
 			fsg->residue -= nwritten;
+			write_behind(curlun, nwritten);
 
 			/* If an error occurred, report it and its position */
 			if (nwritten < amount) {
@@ -1124,10 +1156,27 @@ static int fsync_sub(struct lun *curlun)
 	if (!rc)
 		rc = err;
 	mutex_unlock(&inode->i_mutex);
+	curlun->dirty = 0;
 	VLDBG(curlun, "fdatasync -> %d\n", rc);
 	return rc;
 }
 
+/* Keep at most two dirty windows outstanding: once a window fills,
+ * wait for the writeback started at the previous one and start
+ * writing back this one. */
+static void write_behind(struct lun *curlun, u32 amount)
+{
+	struct address_space *mapping = curlun->filp->f_mapping;
+
+	curlun->dirty += amount;
+	if (!dirty_kb || curlun->dirty < dirty_kb * 1024)
+		return;
+
+	curlun->dirty = 0;
+	filemap_fdatawait(mapping);
+	filemap_flush(mapping);
+}
+
 static void fsync_all(struct fsg_dev *fsg)
 {
 	int	i;
@@ -2700,6 +2749,8 @@ static int open_backing_file(struct fsg_dev *fsg, struct lun *curlun,
 	curlun->filp = filp;
 	curlun->file_length = size;
 	curlun->num_sectors = num_sectors;
+	curlun->next_read = 0;
+	curlun->dirty = 0;
 	LDBG(curlun, "open backing file: %s size: %lld num_sectors: %lld\n",
 			filename, size, num_sectors);
 	rc = 0;
@@ -3117,7 +3168,8 @@ int mass_storage_bind_config(struct usb_configuration *c)
 	kref_init(&fsg->ref);
 	init_completion(&fsg->thread_notifier);
 
-	the_fsg->buf_size = BULK_BUFFER_SIZE;
+	the_fsg->buf_size = clamp_t(u32, buf_kb * 1024, PAGE_CACHE_SIZE,
+				    BULK_BUFFER_SIZE_MAX);
 
 	the_fsg->sdev.name = DRIVER_NAME;
 	the_fsg->sdev.print_name = print_switch_name;
@@ -96,6 +96,17 @@ struct f_rndis {
 };
 
 static char		manufacturer [10] = "HTC";
+
+/* Multi-packet transfers.  IN packing is bounded by the host's own
+ * MaxTransferSize, so hosts that can't take it never see it.
+ */
+static unsigned dl_max_pkts = 8;
+module_param(dl_max_pkts, uint, S_IRUGO);
+MODULE_PARM_DESC(dl_max_pkts, "max frames packed into one IN transfer");
+
+static unsigned ul_max_pkts = 3;
+module_param(ul_max_pkts, uint, S_IRUGO);
+MODULE_PARM_DESC(ul_max_pkts, "max frames the host may pack per OUT transfer");
 static inline struct f_rndis *func_to_rndis(struct usb_function *f)
 {
 	return container_of(f, struct f_rndis, port.func);
@@ -378,6 +389,10 @@ static void rndis_command_complete(struct usb_ep *ep, struct usb_request *req)
 	if (status < 0)
 		ERROR(cdev, "RNDIS command error %d, %d/%d\n",
 			status, req->actual, req->length);
+
+	/* REMOTE_NDIS_INITIALIZE_MSG tells us how much IN data fits */
+	gether_update_dl_max_xfer_size(&rndis->port,
+			rndis_get_dl_max_xfer_size(rndis->config));
 //	spin_unlock(&dev->lock);
 }
 
@@ -516,6 +531,8 @@ static int rndis_set_alt(struct usb_function *f, unsigned intf, unsigned alt)
 
 		rndis_set_param_dev(rndis->config, net,
 				&rndis->port.cdc_filter);
+		gether_update_dl_max_xfer_size(&rndis->port,
+				rndis_get_dl_max_xfer_size(rndis->config));
 	} else
 		goto fail;
 
@@ -685,6 +702,7 @@ rndis_bind(struct usb_configuration *c, struct usb_function *f)
 	if (status < 0)
 		goto fail;
 	rndis->config = status;
+	rndis_set_max_pkt_xfer(rndis->config, rndis->port.ul_max_pkts_per_xfer);
 
 	rndis_set_param_medium(rndis->config, NDIS_MEDIUM_802_3, 0);
 	rndis_set_host_mac(rndis->config, rndis->ethaddr);
@@ -815,6 +833,10 @@ int __init rndis_bind_config(struct usb_configuration *c, u8 ethaddr[ETH_ALEN])
 	rndis->port.header_len = sizeof(struct rndis_packet_msg_type);
 	rndis->port.wrap = rndis_add_header;
 	rndis->port.unwrap = rndis_rm_hdr;
+	rndis->port.dl_max_pkts_per_xfer = clamp(dl_max_pkts, 1U, 16U);
+	rndis->port.dl_max_xfer_size = rndis->port.dl_max_pkts_per_xfer
+		* (sizeof(struct rndis_packet_msg_type) + ETH_FRAME_LEN);
+	rndis->port.ul_max_pkts_per_xfer = clamp(ul_max_pkts, 1U, 8U);
 
 	rndis->port.func.name = "ether";
 	rndis->port.func.strings = rndis_strings;
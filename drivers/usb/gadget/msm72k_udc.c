@@ -57,6 +57,12 @@ static struct perf_lock usb_perf_lock;
 
 static const char driver_name[] = "msm72k_udc";
 
+/* link requests queued on a running bulk/int endpoint straight into
+ * the live dTD list instead of re-priming from the completion irq
+ */
+static int chain_live = 1;
+module_param(chain_live, int, S_IRUGO | S_IWUSR);
+
 /* #define DEBUG */
 /* #define VERBOSE */
 
@@ -536,6 +542,37 @@ static void usb_ept_start(struct msm_endpoint *ept)
 	}
 }
 
+/* Append req behind the live tail of ept's dTD list, using the add
+ * dTD tripwire to find out whether the controller already ran off
+ * the end of the list and has to be primed again.
+ */
+static void usb_ept_chain_live(struct msm_endpoint *ept,
+			       struct msm_request *last,
+			       struct msm_request *req)
+{
+	struct usb_info *ui = ept->ui;
+	unsigned bit = 1 << ept->bit;
+	unsigned stat;
+
+	last->item->next = req->item_dma;
+	wmb();
+
+	if (!(readl(USB_ENDPTPRIME) & bit)) {
+		do {
+			writel(readl(USB_USBCMD) | USBCMD_ATDTW, USB_USBCMD);
+			stat = readl(USB_ENDPTSTAT) & bit;
+		} while (!(readl(USB_USBCMD) & USBCMD_ATDTW));
+		writel(readl(USB_USBCMD) & ~USBCMD_ATDTW, USB_USBCMD);
+
+		if (!stat) {
+			ept->head->next = req->item_dma;
+			ept->head->info = 0;
+			writel(bit, USB_ENDPTPRIME);
+		}
+	}
+	req->live = 1;
+}
+
 int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 {
 	unsigned long flags;
@@ -585,16 +622,23 @@ int usb_ept_queue_xfer(struct msm_endpoint *ept, struct usb_request *_req)
 	last = ept->last;
 	if (last) {
 		/* Already requests in the queue. add us to the
-		 * end, but let the completion interrupt actually
-		 * start things going, to avoid hw issues
+		 * end; unless chain_live is set, let the completion
+		 * interrupt actually start things going, to avoid
+		 * hw issues
 		 */
 		last->next = req;
 
 		/* only modify the hw transaction next pointer if
-		 * that request is not live
+		 * that request is not live.  A chain the hardware has
+		 * not seen yet needs an interrupt on its tail only.
 		 */
-		if (!last->live)
+		if (!last->live) {
 			last->item->next = req->item_dma;
+			if (ept->num)
+				last->item->info &= ~INFO_IOC;
+		} else if (chain_live && ept->num) {
+			usb_ept_chain_live(ept, last, req);
+		}
 	} else {
 		/* queue was empty -- kick the hardware */
 		ept->req = req;
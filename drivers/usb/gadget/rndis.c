@@ -584,13 +584,29 @@ static int rndis_init_response (int configNr, rndis_init_msg_type *buf)
 	resp->MinorVersion = cpu_to_le32 (RNDIS_MINOR_VERSION);
 	resp->DeviceFlags = cpu_to_le32 (RNDIS_DF_CONNECTIONLESS);
 	resp->Medium = cpu_to_le32 (RNDIS_MEDIUM_802_3);
-	resp->MaxPacketsPerTransfer = cpu_to_le32 (1);
-	resp->MaxTransferSize = cpu_to_le32 (
-		  params->dev->mtu
-		+ sizeof (struct ethhdr)
-		+ sizeof (struct rndis_packet_msg_type)
-		+ 22);
-	resp->PacketAlignmentFactor = cpu_to_le32 (0);
+	if (params->max_pkt_per_xfer > 1) {
+		/* several PACKET_MSGs per OUT transfer; ask for them to
+		 * start on 4-byte boundaries (2^2) so every IP header we
+		 * hand up stays aligned.  The rx buffers have RX_EXTRA
+		 * slack per frame on top of this.
+		 */
+		resp->MaxPacketsPerTransfer = cpu_to_le32 (
+				params->max_pkt_per_xfer);
+		resp->MaxTransferSize = cpu_to_le32 (
+			params->max_pkt_per_xfer
+			* (params->dev->mtu
+			+ sizeof (struct ethhdr)
+			+ sizeof (struct rndis_packet_msg_type)));
+		resp->PacketAlignmentFactor = cpu_to_le32 (2);
+	} else {
+		resp->MaxPacketsPerTransfer = cpu_to_le32 (1);
+		resp->MaxTransferSize = cpu_to_le32 (
+			  params->dev->mtu
+			+ sizeof (struct ethhdr)
+			+ sizeof (struct rndis_packet_msg_type)
+			+ 22);
+		resp->PacketAlignmentFactor = cpu_to_le32 (0);
+	}
 	resp->AFListOffset = cpu_to_le32 (0);
 	resp->AFListSize = cpu_to_le32 (0);
 
@@ -822,6 +838,9 @@ int rndis_msg_parser (u8 configNr, u8 *buf)
 		pr_debug("%s: REMOTE_NDIS_INITIALIZE_MSG\n",
 			__func__ );
 		params->state = RNDIS_INITIALIZED;
+		/* largest IN transfer the host is prepared to take */
+		params->dl_max_xfer_size = get_unaligned_le32(
+				&((rndis_init_msg_type *) buf)->MaxTransferSize);
 		return  rndis_init_response (configNr,
 					(rndis_init_msg_type *) buf);
 
@@ -903,6 +922,8 @@ int rndis_register(void (*resp_avail)(void *v), void *v)
 			rndis_per_dev_params [i].used = 1;
 			rndis_per_dev_params [i].resp_avail = resp_avail;
 			rndis_per_dev_params [i].v = v;
+			rndis_per_dev_params [i].max_pkt_per_xfer = 1;
+			rndis_per_dev_params [i].dl_max_xfer_size = 0;
 			pr_debug("%s: configNr = %d\n", __func__, i);
 			return i;
 		}
@@ -958,6 +979,20 @@ int rndis_set_param_medium (u8 configNr, u32 medium, u32 speed)
 	return 0;
 }
 
+void rndis_set_max_pkt_xfer (u8 configNr, u32 max_pkt_per_xfer)
+{
+	pr_debug("%s: %u\n", __func__, max_pkt_per_xfer);
+
+	rndis_per_dev_params [configNr].max_pkt_per_xfer =
+			max_pkt_per_xfer ? : 1;
+}
+
+/* zero until the host has sent REMOTE_NDIS_INITIALIZE_MSG */
+u32 rndis_get_dl_max_xfer_size (u8 configNr)
+{
+	return rndis_per_dev_params [configNr].dl_max_xfer_size;
+}
+
 void rndis_add_hdr (struct sk_buff *skb)
 {
 	struct rndis_packet_msg_type	*header;
@@ -1026,30 +1061,68 @@ static rndis_resp_t *rndis_add_response (int configNr, u32 length)
 	return r;
 }
 
+/*
+ * One OUT transfer may carry several REMOTE_NDIS_PACKET_MSGs back to back
+ * when the host honours MaxPacketsPerTransfer; each MessageLength covers
+ * its own header, data and alignment padding.  All but the last frame
+ * are clones sharing the transfer's buffer, so nothing gets copied.
+ * Anything after the last well-formed message is padding.
+ */
 int rndis_rm_hdr(struct gether *port,
 			struct sk_buff *skb,
 			struct sk_buff_head *list)
 {
-	/* tmp points to a struct rndis_packet_msg_type */
-	__le32		*tmp = (void *) skb->data;
+	int		count = 0;
+	int		status;
 
-	/* MessageType, MessageLength */
-	if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
-			!= get_unaligned(tmp++)) {
-		dev_kfree_skb_any(skb);
-		return -EINVAL;
-	}
-	tmp++;
+	for (;;) {
+		/* tmp points to a struct rndis_packet_msg_type */
+		__le32		*tmp = (void *) skb->data;
+		struct sk_buff	*skb2;
+		u32		msg_len, data_offset, data_len;
 
-	/* DataOffset, DataLength */
-	if (!skb_pull(skb, get_unaligned_le32(tmp++) + 8)) {
-		dev_kfree_skb_any(skb);
-		return -EOVERFLOW;
+		status = -EINVAL;
+		if (skb->len < sizeof(struct rndis_packet_msg_type))
+			break;
+
+		/* MessageType, MessageLength */
+		if (cpu_to_le32(REMOTE_NDIS_PACKET_MSG)
+				!= get_unaligned(tmp++))
+			break;
+		msg_len = get_unaligned_le32(tmp++);
+
+		/* DataOffset, DataLength */
+		data_offset = get_unaligned_le32(tmp++) + 8;
+		data_len = get_unaligned_le32(tmp++);
+
+		status = -EOVERFLOW;
+		if (msg_len > skb->len || msg_len < data_offset
+				|| data_len > msg_len - data_offset)
+			break;
+
+		if (skb->len - msg_len
+				>= sizeof(struct rndis_packet_msg_type)) {
+			status = -ENOMEM;
+			skb2 = skb_clone(skb, GFP_ATOMIC);
+			if (!skb2)
+				break;
+			skb_pull(skb, msg_len);
+		} else {
+			skb2 = skb;
+			skb = NULL;
+		}
+
+		skb_pull(skb2, data_offset);
+		skb_trim(skb2, data_len);
+		skb_queue_tail(list, skb2);
+		count++;
+
+		if (!skb)
+			return 0;
 	}
-	skb_trim(skb, get_unaligned_le32(tmp++));
 
-	skb_queue_tail(list, skb);
-	return 0;
+	dev_kfree_skb_any(skb);
+	return count ? 0 : status;
 }
 
 #ifdef	CONFIG_USB_GADGET_DEBUG_FILES
@@ -70,6 +70,22 @@ struct eth_dev {
 
 	struct sk_buff_head	rx_frames;
 
+	/* linear tx skbs already copied out, reused as rx buffers */
+	struct sk_buff_head	rx_recycle;
+	unsigned		rx_skb_size;
+
+	/* multi-packet IN transfers:  tx requests own tx_req_bufsize byte
+	 * buffers and frames are copied in back to back.  tx_hold is the
+	 * one still being filled; it goes out when full, or as soon as the
+	 * request ahead of it completes, so a frame never waits longer
+	 * than one transfer.  Guarded by req_lock.
+	 */
+	struct usb_request	*tx_hold;
+	unsigned		tx_hold_count;
+	unsigned		tx_req_bufsize;
+	unsigned		dl_max_pkts;
+	unsigned		dl_max_xfer_size;
+
 	unsigned		header_len;
 	struct sk_buff		*(*wrap)(struct gether *, struct sk_buff *skb);
 	int			(*unwrap)(struct gether *,
@@ -91,6 +107,8 @@ struct eth_dev {
 
 #define DEFAULT_QLEN	2	/* double buffering by default */
 
+#define RX_RECYCLE_MAX	16	/* tx skbs kept around for rx */
+
 
 #ifdef CONFIG_USB_GADGET_DUALSPEED
 
@@ -209,12 +227,16 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	int		retval = -ENOMEM;
 	size_t		size = 0;
 	struct usb_ep	*out;
+	unsigned	header_len = 0, pkts = 1;
 	unsigned long	flags;
 
 	spin_lock_irqsave(&dev->lock, flags);
-	if (dev->port_usb)
+	if (dev->port_usb) {
 		out = dev->port_usb->out_ep;
-	else
+		header_len = dev->port_usb->header_len;
+		if (dev->port_usb->ul_max_pkts_per_xfer > 1)
+			pkts = dev->port_usb->ul_max_pkts_per_xfer;
+	} else
 		out = NULL;
 	spin_unlock_irqrestore(&dev->lock, flags);
 
@@ -232,14 +254,24 @@ rx_submit(struct eth_dev *dev, struct usb_request *req, gfp_t gfp_flags)
 	 * RNDIS uses internal framing, and explicitly allows senders to
 	 * pad to end-of-packet.  That's potentially nice for speed, but
 	 * means receivers can't recover lost synch on their own (because
-	 * new packets don't only start after a short RX).
+	 * new packets don't only start after a short RX).  It may also
+	 * pack several packets into one transfer, if we said we'd take it.
 	 */
 	size += sizeof(struct ethhdr) + dev->net->mtu + RX_EXTRA;
-	size += dev->port_usb->header_len;
+	size += header_len;
+	size *= pkts;
 	size += out->maxpacket - 1;
 	size -= size % out->maxpacket;
 
-	skb = alloc_skb(size + NET_IP_ALIGN, gfp_flags);
+	dev->rx_skb_size = size + NET_IP_ALIGN;
+	skb = skb_dequeue(&dev->rx_recycle);
+	if (skb && skb_tailroom(skb) < size + NET_IP_ALIGN) {
+		/* recycled before an MTU change */
+		dev_kfree_skb_any(skb);
+		skb = NULL;
+	}
+	if (skb == NULL)
+		skb = alloc_skb(size + NET_IP_ALIGN, gfp_flags);
 	if (skb == NULL) {
 		DBG(dev, "no rx skb\n");
 		goto enomem;
@@ -421,6 +453,49 @@ done:
 	return status;
 }
 
+static void free_tx_bufs(struct eth_dev *dev)
+{
+	struct usb_request	*req;
+
+	list_for_each_entry(req, &dev->tx_reqs, list) {
+		kfree(req->buf);
+		req->buf = NULL;
+	}
+	dev->tx_req_bufsize = 0;
+}
+
+/* give each tx request its own buffer for multi-packet transfers;
+ * without them we quietly fall back to one frame per request
+ */
+static void alloc_tx_bufs(struct eth_dev *dev, struct gether *link)
+{
+	struct usb_request	*req;
+	unsigned		size = link->dl_max_xfer_size;
+
+	spin_lock(&dev->req_lock);
+	dev->tx_hold = NULL;
+	dev->tx_req_bufsize = 0;
+	if (link->dl_max_pkts_per_xfer > 1
+			&& size >= link->header_len + ETH_FRAME_LEN) {
+		list_for_each_entry(req, &dev->tx_reqs, list) {
+			/* one spare byte for the zlp-avoidance pad */
+			req->buf = kmalloc(size + 1, GFP_ATOMIC);
+			if (!req->buf) {
+				free_tx_bufs(dev);
+				DBG(dev, "no multi-packet tx bufs\n");
+				goto done;
+			}
+		}
+		dev->tx_req_bufsize = size;
+		dev->dl_max_pkts = link->dl_max_pkts_per_xfer;
+
+		/* one frame per transfer until the host says otherwise */
+		dev->dl_max_xfer_size = link->header_len + ETH_FRAME_LEN;
+	}
+done:
+	spin_unlock(&dev->req_lock);
+}
+
 static void rx_fill(struct eth_dev *dev, gfp_t gfp_flags)
 {
 	struct usb_request	*req;
@@ -457,11 +532,19 @@ static void eth_work(struct work_struct *work)
 		DBG(dev, "work done, flags = 0x%lx\n", dev->todo);
 }
 
+static int tx_queue(struct eth_dev *dev, struct usb_ep *in,
+		struct usb_request *req, unsigned count);
+
 static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 {
-	struct sk_buff	*skb = req->context;
-	struct eth_dev	*dev = ep->driver_data;
+	struct sk_buff		*skb = req->context;
+	struct eth_dev		*dev = ep->driver_data;
+	struct usb_request	*held = NULL;
+	unsigned		count = 0;
 
+	/* multi-packet requests carry no skb; their frames were
+	 * counted when they were copied in
+	 */
 	switch (req->status) {
 	default:
 		dev->net->stats.tx_errors++;
@@ -471,16 +554,27 @@ static void tx_complete(struct usb_ep *ep, struct usb_request *req)
 	case -ESHUTDOWN:		/* disconnect etc */
 		break;
 	case 0:
-		dev->net->stats.tx_bytes += skb->len;
+		if (skb)
+			dev->net->stats.tx_bytes += skb->len;
 	}
-	dev->net->stats.tx_packets++;
+	if (skb)
+		dev->net->stats.tx_packets++;
 
 	spin_lock(&dev->req_lock);
 	list_add(&req->list, &dev->tx_reqs);
+	atomic_dec(&dev->tx_qlen);
+	if (dev->tx_hold && req->status == 0) {
+		held = dev->tx_hold;
+		count = dev->tx_hold_count;
+		dev->tx_hold = NULL;
+	}
 	spin_unlock(&dev->req_lock);
-	dev_kfree_skb_any(skb);
+	if (skb)
+		dev_kfree_skb_any(skb);
+
+	if (held)
+		tx_queue(dev, ep, held, count);
 
-	atomic_dec(&dev->tx_qlen);
 	if (netif_carrier_ok(dev->net))
 		netif_wake_queue(dev->net);
 }
@@ -490,6 +584,142 @@ static inline int is_promisc(u16 cdc_filter)
 	return cdc_filter & USB_CDC_PACKET_TYPE_PROMISCUOUS;
 }
 
+/* queue a packed multi-packet request holding count frames */
+static int tx_queue(struct eth_dev *dev, struct usb_ep *in,
+		struct usb_request *req, unsigned count)
+{
+	unsigned long	flags;
+	int		retval;
+
+	req->context = NULL;
+	req->complete = tx_complete;
+	req->zero = 1;
+	if (!dev->zlp && (req->length % in->maxpacket) == 0)
+		req->length++;
+
+	/* no IRQ throttling; a held request is waiting on this
+	 * completion, and packing already cut the IRQ rate
+	 */
+	req->no_interrupt = 0;
+
+	atomic_inc(&dev->tx_qlen);
+	retval = usb_ep_queue(in, req, GFP_ATOMIC);
+	if (retval) {
+		DBG(dev, "tx queue err %d\n", retval);
+		dev->net->stats.tx_dropped += count;
+		spin_lock_irqsave(&dev->req_lock, flags);
+		atomic_dec(&dev->tx_qlen);
+		if (list_empty(&dev->tx_reqs))
+			netif_start_queue(dev->net);
+		list_add(&req->list, &dev->tx_reqs);
+		spin_unlock_irqrestore(&dev->req_lock, flags);
+	} else
+		dev->net->trans_start = jiffies;
+	return retval;
+}
+
+/* return a tx skb's buffer to the rx side if it's big enough */
+static void eth_recycle(struct eth_dev *dev, struct sk_buff *skb)
+{
+	if (skb_queue_len(&dev->rx_recycle) < RX_RECYCLE_MAX
+			&& skb_recycle_check(skb, dev->rx_skb_size)) {
+		skb_queue_head(&dev->rx_recycle, skb);
+		return;
+	}
+	dev_kfree_skb_any(skb);
+}
+
+static netdev_tx_t eth_start_xmit_multi(struct eth_dev *dev,
+		struct usb_ep *in, struct sk_buff *skb)
+{
+	struct net_device	*net = dev->net;
+	struct usb_request	*req, *full = NULL;
+	unsigned		full_count = 0;
+	unsigned		length = skb->len + dev->header_len;
+	unsigned		max_size;
+	bool			send;
+	unsigned long		flags;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	max_size = dev->dl_max_xfer_size;
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	if (length > max_size) {
+		dev_kfree_skb_any(skb);
+		dev->net->stats.tx_dropped++;
+		return NETDEV_TX_OK;
+	}
+
+	/* claim the request being filled, or a fresh one if this frame
+	 * won't fit; the frame isn't wrapped yet so it can still be
+	 * handed back to the stack
+	 */
+	spin_lock_irqsave(&dev->req_lock, flags);
+	req = dev->tx_hold;
+	if (req && req->length + length > max_size) {
+		full = req;
+		full_count = dev->tx_hold_count;
+		req = NULL;
+	}
+	if (!req) {
+		if (list_empty(&dev->tx_reqs)) {
+			/* full stays held until a completion frees it */
+			netif_stop_queue(net);
+			spin_unlock_irqrestore(&dev->req_lock, flags);
+			return NETDEV_TX_BUSY;
+		}
+		req = container_of(dev->tx_reqs.next,
+				struct usb_request, list);
+		list_del(&req->list);
+		req->length = 0;
+		dev->tx_hold_count = 0;
+	}
+	dev->tx_hold = NULL;
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	if (full)
+		tx_queue(dev, in, full, full_count);
+
+	spin_lock_irqsave(&dev->lock, flags);
+	if (dev->port_usb && dev->wrap)
+		skb = dev->wrap(dev->port_usb, skb);
+	spin_unlock_irqrestore(&dev->lock, flags);
+
+	if (skb && req->length + skb->len <= max_size) {
+		memcpy(req->buf + req->length, skb->data, skb->len);
+		req->length += skb->len;
+		dev->tx_hold_count++;
+		dev->net->stats.tx_packets++;
+		dev->net->stats.tx_bytes += skb->len;
+		eth_recycle(dev, skb);
+	} else {
+		if (skb)
+			dev_kfree_skb_any(skb);
+		dev->net->stats.tx_dropped++;
+	}
+
+	/* ship it now if it's full, or if nothing is in flight to
+	 * complete and flush it later
+	 */
+	spin_lock_irqsave(&dev->req_lock, flags);
+	send = dev->tx_hold_count >= dev->dl_max_pkts
+		|| req->length + dev->header_len + ETH_FRAME_LEN > max_size
+		|| atomic_read(&dev->tx_qlen) == 0;
+	if (!req->length) {
+		list_add(&req->list, &dev->tx_reqs);
+		req = NULL;
+	} else if (!send) {
+		dev->tx_hold = req;
+		req = NULL;
+	}
+	full_count = dev->tx_hold_count;
+	spin_unlock_irqrestore(&dev->req_lock, flags);
+
+	if (req)
+		tx_queue(dev, in, req, full_count);
+	return NETDEV_TX_OK;
+}
+
 static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 					struct net_device *net)
 {
@@ -538,6 +768,9 @@ static netdev_tx_t eth_start_xmit(struct sk_buff *skb,
 		/* ignores USB_CDC_PACKET_TYPE_DIRECTED */
 	}
 
+	if (dev->tx_req_bufsize)
+		return eth_start_xmit_multi(dev, in, skb);
+
 	spin_lock_irqsave(&dev->req_lock, flags);
 	/*
 	 * this freelist can be empty if an interrupt triggered disconnect()
@@ -780,6 +1013,7 @@ int __init gether_setup(struct usb_gadget *g, u8 ethaddr[ETH_ALEN])
 	INIT_LIST_HEAD(&dev->rx_reqs);
 
 	skb_queue_head_init(&dev->rx_frames);
+	skb_queue_head_init(&dev->rx_recycle);
 
 	/* network device setup */
 	dev->net = net;
@@ -888,6 +1122,7 @@ struct net_device *gether_connect(struct gether *link)
 		result = alloc_requests(dev, link, qlen(dev->gadget));
 
 	if (result == 0) {
+		alloc_tx_bufs(dev, link);
 		dev->zlp = link->is_zlp_ok;
 		DBG(dev, "qlen %d\n", qlen(dev->gadget));
 
@@ -956,6 +1191,12 @@ void gether_disconnect(struct gether *link)
 	 */
 	usb_ep_disable(link->in_ep);
 	spin_lock(&dev->req_lock);
+	if (dev->tx_hold) {
+		list_add(&dev->tx_hold->list, &dev->tx_reqs);
+		dev->tx_hold = NULL;
+	}
+	if (dev->tx_req_bufsize)
+		free_tx_bufs(dev);
 	while (!list_empty(&dev->tx_reqs)) {
 		req = container_of(dev->tx_reqs.next,
 					struct usb_request, list);
@@ -983,6 +1224,7 @@ void gether_disconnect(struct gether *link)
 	spin_unlock(&dev->req_lock);
 	link->out_ep->driver_data = NULL;
 	link->out = NULL;
+	skb_queue_purge(&dev->rx_recycle);
 
 	/* finish forgetting about this USB link episode */
 	dev->header_len = 0;
@@ -994,3 +1236,32 @@ void gether_disconnect(struct gether *link)
 	link->ioport = NULL;
 	spin_unlock(&dev->lock);
 }
+
+/**
+ * gether_update_dl_max_xfer_size - apply the host's IN transfer limit
+ * @link: the USB link, on which gether_connect() was called
+ * @max_size: largest IN transfer the host accepts, in bytes
+ * Context: any
+ *
+ * Framings like RNDIS learn this from the host after the link is up.
+ * It only matters for multi-packet transfers, and never grows beyond
+ * the buffers set up at gether_connect() time.
+ */
+void gether_update_dl_max_xfer_size(struct gether *link, u32 max_size)
+{
+	struct eth_dev		*dev = link->ioport;
+	unsigned long		flags;
+
+	if (!dev || !max_size)
+		return;
+
+	spin_lock_irqsave(&dev->lock, flags);
+	if (dev->tx_req_bufsize) {
+		max_size = min_t(u32, max_size, dev->tx_req_bufsize);
+		dev->dl_max_xfer_size = max_t(u32, max_size,
+				link->header_len + ETH_FRAME_LEN);
+		DBG(dev, "IN transfers up to %u bytes\n",
+				dev->dl_max_xfer_size);
+	}
+	spin_unlock_irqrestore(&dev->lock, flags);
+}
@@ -68,6 +68,15 @@ struct gether {
 						struct sk_buff *skb,
 						struct sk_buff_head *list);
 
+	/* multi-packet transfers, as RNDIS allows:  IN frames are packed
+	 * into one request of up to dl_max_xfer_size bytes, and OUT
+	 * requests are sized for ul_max_pkts_per_xfer frames.  Zero or one
+	 * means classic one-frame-per-request framing.
+	 */
+	u32				dl_max_pkts_per_xfer;
+	u32				dl_max_xfer_size;
+	u32				ul_max_pkts_per_xfer;
+
 	/* called on network open/close */
 	void				(*open)(struct gether *);
 	void				(*close)(struct gether *);
@@ -86,6 +95,7 @@ void gether_cleanup(void);
 /* connect/disconnect is handled by individual functions */
 struct net_device *gether_connect(struct gether *);
 void gether_disconnect(struct gether *);
+void gether_update_dl_max_xfer_size(struct gether *, u32 max_size);
 
 /* Some controllers can't support CDC Ethernet (ECM) ... */
 static inline bool can_support_ecm(struct usb_gadget *gadget)
@@ -29,8 +29,14 @@
 #include <linux/mm.h>
 #include <linux/android_pmem.h>
 #include <linux/highmem.h>
+#include <linux/input.h>
 #include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
 #include <asm/cacheflush.h>
+#include <mach/perflock.h>
+#include <mach/clk.h>
+#include <mach/htc_pwrsink.h>
 
 #include <asm/atomic.h>
 
@@ -39,6 +45,14 @@
 #include "kgsl_ringbuffer.h"
 #include "kgsl_cmdstream.h"
 #include "kgsl_log.h"
+#include "kgsl_pm4types.h"
+
+/* an ib checked once at registration and submitted by handle after that */
+struct kgsl_ib_reg {
+	struct kgsl_mem_entry	*entry;
+	unsigned int		gpuaddr;
+	unsigned int		sizedwords;
+};
 
 struct kgsl_file_private {
 	struct list_head	list;
@@ -46,9 +60,17 @@ struct kgsl_file_private {
 	uint32_t		ctxt_id_mask;
 	struct kgsl_pagetable	*pagetable;
 	unsigned long		vmalloc_size;
+	/* freed vmalloc allocations, still gpu mapped, by size class */
+	struct list_head	pool[KGSL_POOL_CLASSES];
+	unsigned long		pool_size;
+	/* registered ibs, the handle is the index plus one */
+	struct kgsl_ib_reg	ibs[KGSL_IB_REGISTER_MAX];
 };
 
+static struct kmem_cache *kgsl_mem_entry_cachep __read_mostly;
+
 static void kgsl_put_phys_file(struct file *file);
+static void kgsl_pool_drain(struct kgsl_file_private *private);
 
 #ifdef CONFIG_MSM_KGSL_MMU
 static long flush_l1_cache_range(unsigned long addr, int size)
@@ -111,33 +133,164 @@ struct device *kgsl_driver_getdevnode(void)
 	return &kgsl_driver.pdev->dev;
 }
 
+/* grp_clk as a fraction (in quarters) of its rate at probe, and ebi1_clk */
+static const struct {
+	unsigned int grp_quarters;
+	unsigned long ebi1_rate;
+} kgsl_pwrlevels[KGSL_PWRLEVELS] = {
+	{ 4, 128000000 },
+	{ 3, 96000000 },
+	{ 2, 64000000 },
+};
+
+/* call with pwrscale.lock held or the timer stopped */
+static void kgsl_pwrscale_set_level(unsigned int level)
+{
+	struct kgsl_pwrscale *pwr = &kgsl_driver.pwrscale;
+
+	if (!pwr->grp_fixed && pwr->grp_base &&
+	    clk_set_rate(kgsl_driver.grp_clk, pwr->grp_base / 4 *
+			 kgsl_pwrlevels[level].grp_quarters)) {
+		KGSL_DRV_INFO("grp_clk rate is fixed, scaling ebi1 only\n");
+		pwr->grp_fixed = true;
+	}
+	clk_set_rate(kgsl_driver.ebi1_clk, kgsl_pwrlevels[level].ebi1_rate);
+	pwr->level = level;
+}
+
+/* sample gpu busy time once per window, which is meant to be about a
+ * frame, and pick the clock level for the next one */
+static void kgsl_pwrscale_timer(unsigned long data)
+{
+	struct kgsl_pwrscale *pwr = &kgsl_driver.pwrscale;
+	ktime_t now = ktime_get();
+	unsigned int elapsed, busy, pct = 0;
+
+	spin_lock(&pwr->lock);
+	elapsed = (unsigned int)ktime_us_delta(now, pwr->window_start);
+	busy = (unsigned int)pwr->busy_us;
+	if (pwr->busy) {
+		busy += (unsigned int)ktime_us_delta(now, pwr->busy_start);
+		pwr->busy_start = now;
+	}
+	pwr->busy_us = 0;
+	pwr->window_start = now;
+
+	if (elapsed)
+		pct = min(100U, busy * 100 / elapsed);
+
+	pwr->trace_busy[pwr->trace_head] = pct;
+	pwr->trace_level[pwr->trace_head] = pwr->level;
+	pwr->trace_head = (pwr->trace_head + 1) % KGSL_PWR_TRACE_LEN;
+
+	if (!pwr->enable) {
+		if (pwr->level != 0)
+			kgsl_pwrscale_set_level(0);
+	} else if (time_before(jiffies, pwr->boost_until)) {
+		/* a frame was late, hold full speed until the boost ends */
+		if (pwr->level != 0)
+			kgsl_pwrscale_set_level(0);
+	} else if (pct >= pwr->up_threshold) {
+		/* a dropped frame costs more than a window at full speed */
+		if (pwr->level != 0)
+			kgsl_pwrscale_set_level(0);
+	} else if (pct < pwr->down_threshold) {
+		if (pwr->level < KGSL_PWRLEVELS - 1)
+			kgsl_pwrscale_set_level(pwr->level + 1);
+	}
+	htc_pwrsink_set(PWRSINK_GPU,
+			pct * kgsl_pwrlevels[pwr->level].grp_quarters / 4);
+	spin_unlock(&pwr->lock);
+
+	mod_timer(&pwr->timer,
+		  jiffies + msecs_to_jiffies(max(pwr->window_ms, 1U)));
+}
+
+/* perf_boost() notifier, may run in interrupt context so only record the
+ * deadline and let the next window apply it */
+static int kgsl_pwrscale_boost(struct notifier_block *nb,
+			       unsigned long msecs, void *data)
+{
+	struct kgsl_pwrscale *pwr = &kgsl_driver.pwrscale;
+
+	pwr->boost_until = jiffies + msecs_to_jiffies(msecs);
+	return NOTIFY_OK;
+}
+
+static void kgsl_pwrscale_idle(struct kgsl_device *device, void *priv,
+			       uint32_t timestamp)
+{
+	struct kgsl_pwrscale *pwr = &kgsl_driver.pwrscale;
+
+	spin_lock_bh(&pwr->lock);
+	if (pwr->busy) {
+		pwr->busy_us += ktime_us_delta(ktime_get(), pwr->busy_start);
+		pwr->busy = false;
+	}
+	spin_unlock_bh(&pwr->lock);
+}
+
+/*call with driver locked, after issuing timestamp */
+static void kgsl_pwrscale_submit(uint32_t timestamp)
+{
+	struct kgsl_pwrscale *pwr = &kgsl_driver.pwrscale;
+
+	kgsl_cmdstream_cancel_event(&pwr->idle_event);
+	kgsl_cmdstream_add_event(&kgsl_driver.yamato_device, &pwr->idle_event,
+				 timestamp, kgsl_pwrscale_idle, NULL);
+
+	spin_lock_bh(&pwr->lock);
+	if (!pwr->busy) {
+		pwr->busy = true;
+		pwr->busy_start = ktime_get();
+	}
+	spin_unlock_bh(&pwr->lock);
+}
+
 /* the hw and clk enable/disable funcs must be either called from softirq or
  * with mutex held */
-static void kgsl_clk_enable(void)
+#ifdef CONFIG_ARCH_MSM7227
+#define KGSL_NR_CLKS 3
+#else
+#define KGSL_NR_CLKS 2
+#endif
+
+/* the core clocks, switched as one group */
+static void kgsl_clk_group(struct clk **clks)
 {
-	clk_set_rate(kgsl_driver.ebi1_clk, 128000000);
-	clk_enable(kgsl_driver.imem_clk);
-	clk_enable(kgsl_driver.grp_clk);
+	clks[0] = kgsl_driver.imem_clk;
+	clks[1] = kgsl_driver.grp_clk;
 #ifdef CONFIG_ARCH_MSM7227
-	clk_enable(kgsl_driver.grp_pclk);
+	clks[2] = kgsl_driver.grp_pclk;
 #endif
 }
 
+static void kgsl_clk_enable(void)
+{
+	struct clk *clks[KGSL_NR_CLKS];
+
+	clk_set_rate(kgsl_driver.ebi1_clk,
+		     kgsl_pwrlevels[kgsl_driver.pwrscale.level].ebi1_rate);
+	kgsl_clk_group(clks);
+	clk_enable_many(clks, KGSL_NR_CLKS);
+}
+
 static void kgsl_clk_disable(void)
 {
-#ifdef CONFIG_ARCH_MSM7227
-	clk_disable(kgsl_driver.grp_pclk);
-#endif
-	clk_disable(kgsl_driver.grp_clk);
-	clk_disable(kgsl_driver.imem_clk);
+	struct clk *clks[KGSL_NR_CLKS];
+
+	kgsl_clk_group(clks);
+	clk_disable_many(clks, KGSL_NR_CLKS);
 	clk_set_rate(kgsl_driver.ebi1_clk, 0);
 }
 
 static void kgsl_hw_disable(void)
 {
 	kgsl_driver.active = false;
+	del_timer(&kgsl_driver.pwrscale.timer);
 	disable_irq(kgsl_driver.interrupt_num);
 	kgsl_clk_disable();
+	htc_pwrsink_set(PWRSINK_GPU, 0);
 	pr_debug("kgsl: hw disabled\n");
 	wake_unlock(&kgsl_driver.wake_lock);
 }
@@ -147,6 +300,12 @@ static void kgsl_hw_enable(void)
 	wake_lock(&kgsl_driver.wake_lock);
 	kgsl_clk_enable();
 	enable_irq(kgsl_driver.interrupt_num);
+	/* the governor only runs while the core is on */
+	kgsl_driver.pwrscale.window_start = ktime_get();
+	kgsl_driver.pwrscale.busy_start = kgsl_driver.pwrscale.window_start;
+	kgsl_driver.pwrscale.busy_us = 0;
+	mod_timer(&kgsl_driver.pwrscale.timer, jiffies +
+		  msecs_to_jiffies(max(kgsl_driver.pwrscale.window_ms, 1U)));
 	kgsl_driver.active = true;
 	pr_debug("kgsl: hw enabled\n");
 }
@@ -166,21 +325,127 @@ static void kgsl_hw_get_locked(void)
 
 static void kgsl_hw_put_locked(bool start_timer)
 {
+	unsigned int timeout = kgsl_driver.pwrscale.idle_timeout_ms;
+
 	if ((--kgsl_driver.active_cnt == 0) && start_timer) {
 		mod_timer(&kgsl_driver.standby_timer,
-			  jiffies + msecs_to_jiffies(512));
+			  jiffies + msecs_to_jiffies(timeout));
 	}
 }
 
 static void kgsl_do_standby_timer(unsigned long data)
 {
-	if (kgsl_yamato_is_idle(&kgsl_driver.yamato_device))
+	if (kgsl_yamato_is_idle(&kgsl_driver.yamato_device)) {
+		/* reap events whose interrupt was missed */
+		if (!list_empty(&kgsl_driver.yamato_device.events))
+			schedule_work(&kgsl_driver.event_work);
 		kgsl_hw_disable();
+	}
 	else
 		mod_timer(&kgsl_driver.standby_timer,
 			  jiffies + msecs_to_jiffies(10));
 }
 
+static void kgsl_event_work(struct work_struct *work)
+{
+	struct kgsl_device *device = &kgsl_driver.yamato_device;
+
+	mutex_lock(&kgsl_driver.mutex);
+	if ((device->flags & KGSL_FLAGS_INITIALIZED) &&
+	    !list_empty(&device->events)) {
+		/* freeing memory may flush the gpu tlb */
+		kgsl_hw_get_locked();
+		kgsl_cmdstream_process_events(device);
+		kgsl_hw_put_locked(true);
+	}
+	mutex_unlock(&kgsl_driver.mutex);
+}
+
+/* a touch down is usually followed by a frame, turn the core on while
+ * userspace is still handling the event so the first submission doesn't
+ * wait for the clocks.  If nothing is drawn the standby timer turns it
+ * off again after touch_wake_ms. */
+static void kgsl_touch_work(struct work_struct *work)
+{
+	unsigned int timeout = kgsl_driver.pwrscale.touch_wake_ms;
+
+	mutex_lock(&kgsl_driver.mutex);
+	if (atomic_read(&kgsl_driver.open_count) > 0 && !kgsl_driver.active) {
+		kgsl_hw_get_locked();
+		kgsl_hw_put_locked(false);
+		mod_timer(&kgsl_driver.standby_timer,
+			  jiffies + msecs_to_jiffies(timeout));
+	}
+	mutex_unlock(&kgsl_driver.mutex);
+}
+
+static void kgsl_touch_event(struct input_handle *handle,
+			     unsigned int type, unsigned int code, int value)
+{
+	/* key events only get here when the state changes */
+	if (type == EV_KEY && code == BTN_TOUCH && value &&
+	    kgsl_driver.pwrscale.touch_wake_ms && !kgsl_driver.active)
+		schedule_work(&kgsl_driver.touch_work);
+}
+
+static int kgsl_touch_connect(struct input_handler *handler,
+			      struct input_dev *dev,
+			      const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = DRIVER_NAME;
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free_handle;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister_handle;
+
+	return 0;
+
+err_unregister_handle:
+	input_unregister_handle(handle);
+err_free_handle:
+	kfree(handle);
+	return error;
+}
+
+static void kgsl_touch_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+/* touchscreens: absolute axes plus BTN_TOUCH */
+static const struct input_device_id kgsl_touch_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_KEYBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+	},
+	{ },
+};
+
+static struct input_handler kgsl_touch_handler = {
+	.event		= kgsl_touch_event,
+	.connect	= kgsl_touch_connect,
+	.disconnect	= kgsl_touch_disconnect,
+	.name		= DRIVER_NAME,
+	.id_table	= kgsl_touch_ids,
+};
+
 /* file operations */
 static int kgsl_first_open_locked(void)
 {
@@ -216,6 +481,9 @@ static int kgsl_last_release_locked(void)
 	BUG_ON(kgsl_driver.active_cnt);
 
 	disable_irq(kgsl_driver.interrupt_num);
+	del_timer_sync(&kgsl_driver.pwrscale.timer);
+	kgsl_cmdstream_cancel_event(&kgsl_driver.pwrscale.idle_event);
+	kgsl_driver.pwrscale.busy = false;
 
 	kgsl_yamato_stop(&kgsl_driver.yamato_device);
 
@@ -254,6 +522,7 @@ static int kgsl_release(struct inode *inodep, struct file *filep)
 
 	list_for_each_entry_safe(entry, entry_tmp, &private->mem_list, list)
 		kgsl_remove_mem_entry(entry);
+	kgsl_pool_drain(private);
 
 	if (private->pagetable != NULL) {
 		kgsl_yamato_cleanup_pt(&kgsl_driver.yamato_device,
@@ -278,7 +547,7 @@ static int kgsl_release(struct inode *inodep, struct file *filep)
 
 static int kgsl_open(struct inode *inodep, struct file *filep)
 {
-	int result = 0;
+	int result = 0, i;
 	struct kgsl_file_private *private = NULL;
 
 	KGSL_DRV_DBG("file %p pid %d\n", filep, task_pid_nr(current));
@@ -299,6 +568,8 @@ static int kgsl_open(struct inode *inodep, struct file *filep)
 
 	private->ctxt_id_mask = 0;
 	INIT_LIST_HEAD(&private->mem_list);
+	for (i = 0; i < KGSL_POOL_CLASSES; i++)
+		INIT_LIST_HEAD(&private->pool[i]);
 
 	filep->private_data = private;
 
@@ -479,6 +750,135 @@ static long kgsl_ioctl_rb_issueibcmds(struct kgsl_file_private *private,
 	if (result != 0)
 		goto done;
 
+	kgsl_pwrscale_submit(param.timestamp);
+
+	if (copy_to_user(arg, &param, sizeof(param))) {
+		result = -EFAULT;
+		goto done;
+	}
+done:
+	return result;
+}
+
+static long kgsl_ioctl_ib_register(struct kgsl_file_private *private,
+				   void __user *arg)
+{
+	int result = 0, i;
+	struct kgsl_ib_register param;
+	struct kgsl_mem_entry *entry;
+
+	if (copy_from_user(&param, arg, sizeof(param))) {
+		result = -EFAULT;
+		goto done;
+	}
+
+	entry = kgsl_sharedmem_find_region(private, param.gpuaddr,
+				param.sizedwords*sizeof(uint32_t));
+	if (param.gpuaddr == 0 || param.sizedwords == 0 || entry == NULL) {
+		KGSL_DRV_ERR("invalid cmd buffer ibaddr %08x sizedwords %d\n",
+			      param.gpuaddr, param.sizedwords);
+		result = -EINVAL;
+		goto done;
+	}
+
+	for (i = 0; i < KGSL_IB_REGISTER_MAX; i++)
+		if (private->ibs[i].entry == NULL)
+			break;
+	if (i == KGSL_IB_REGISTER_MAX) {
+		result = -ENOSPC;
+		goto done;
+	}
+
+	private->ibs[i].entry = entry;
+	private->ibs[i].gpuaddr = param.gpuaddr;
+	private->ibs[i].sizedwords = param.sizedwords;
+	param.ibhandle = i + 1;
+
+	if (copy_to_user(arg, &param, sizeof(param))) {
+		private->ibs[i].entry = NULL;
+		result = -EFAULT;
+		goto done;
+	}
+done:
+	return result;
+}
+
+static long kgsl_ioctl_ib_unregister(struct kgsl_file_private *private,
+				     void __user *arg)
+{
+	struct kgsl_ib_unregister param;
+
+	if (copy_from_user(&param, arg, sizeof(param)))
+		return -EFAULT;
+
+	if (param.ibhandle == 0 || param.ibhandle > KGSL_IB_REGISTER_MAX ||
+	    private->ibs[param.ibhandle - 1].entry == NULL)
+		return -EINVAL;
+
+	private->ibs[param.ibhandle - 1].entry = NULL;
+	return 0;
+}
+
+static long kgsl_ioctl_rb_issueibhandles(struct kgsl_file_private *private,
+					 void __user *arg)
+{
+	int result = 0, i;
+	struct kgsl_ringbuffer_issueibhandles param;
+	unsigned int handles[KGSL_IB_SUBMIT_MAX];
+	uint32_t ibaddr[KGSL_IB_SUBMIT_MAX];
+	unsigned int sizedwords[KGSL_IB_SUBMIT_MAX];
+	struct kgsl_ib_reg *ib;
+
+	if (copy_from_user(&param, arg, sizeof(param))) {
+		result = -EFAULT;
+		goto done;
+	}
+
+	if (param.drawctxt_id >= KGSL_CONTEXT_MAX
+		|| (private->ctxt_id_mask & 1 << param.drawctxt_id) == 0) {
+		KGSL_DRV_ERR("invalid drawctxt drawctxt_id %d\n",
+			      param.drawctxt_id);
+		result = -EINVAL;
+		goto done;
+	}
+
+	if (param.numhandles == 0 || param.numhandles > KGSL_IB_SUBMIT_MAX) {
+		result = -EINVAL;
+		goto done;
+	}
+
+	if (copy_from_user(handles, (void __user *)param.ibhandles,
+			   param.numhandles * sizeof(handles[0]))) {
+		result = -EFAULT;
+		goto done;
+	}
+
+	for (i = 0; i < param.numhandles; i++) {
+		if (handles[i] == 0 || handles[i] > KGSL_IB_REGISTER_MAX) {
+			result = -EINVAL;
+			goto done;
+		}
+		ib = &private->ibs[handles[i] - 1];
+		if (ib->entry == NULL) {
+			KGSL_DRV_ERR("stale ib handle %d\n", handles[i]);
+			result = -EINVAL;
+			goto done;
+		}
+		ibaddr[i] = ib->gpuaddr;
+		sizedwords[i] = ib->sizedwords;
+	}
+
+	result = kgsl_ringbuffer_issueiblist(&kgsl_driver.yamato_device,
+					     param.drawctxt_id,
+					     ibaddr, sizedwords,
+					     param.numhandles,
+					     &param.timestamp,
+					     param.flags);
+	if (result != 0)
+		goto done;
+
+	kgsl_pwrscale_submit(param.timestamp);
+
 	if (copy_to_user(arg, &param, sizeof(param))) {
 		result = -EFAULT;
 		goto done;
@@ -600,22 +1000,148 @@ done:
 	return result;
 }
 
-void kgsl_remove_mem_entry(struct kgsl_mem_entry *entry)
+/* Freed vmalloc allocations stay mapped in the process's gpu pagetable and
+ * are kept in per-process lists of power-of-two sizes, so reallocating a
+ * size that was just freed skips vmalloc, the gpu mapping and the cache
+ * flush.  The contents are not cleared, they only ever go back to the
+ * process that wrote them.  A shrinker trims the lists under pressure. */
+static unsigned long kgsl_pool_pages;
+
+static int kgsl_pool_class(unsigned int size)
+{
+	int class = get_order(size);
+
+	if (class >= KGSL_POOL_CLASSES || (PAGE_SIZE << class) != size)
+		return -1;
+	return class;
+}
+
+static void kgsl_vmalloc_entry_free(struct kgsl_mem_entry *entry)
 {
 	kgsl_mmu_unmap(entry->memdesc.pagetable,
-		       entry->memdesc.gpuaddr & KGSL_PAGEMASK,
-		       entry->memdesc.size);
-	if (KGSL_MEMFLAGS_VMALLOC_MEM & entry->memdesc.priv) {
-		vfree((void *)entry->memdesc.physaddr);
-		entry->priv->vmalloc_size -= entry->memdesc.size;
-	} else
-		kgsl_put_phys_file(entry->pmem_file);
+		       entry->memdesc.gpuaddr & KGSL_PAGEMASK, entry->mapsize);
+	vfree((void *)entry->memdesc.physaddr);
+	kmem_cache_free(kgsl_mem_entry_cachep, entry);
+}
+
+/*call with driver locked */
+static int kgsl_pool_put(struct kgsl_file_private *private,
+			 struct kgsl_mem_entry *entry)
+{
+	int class = kgsl_pool_class(entry->mapsize);
+
+	if (class < 0 || private->pool_size + entry->mapsize > KGSL_POOL_SIZE)
+		return 0;
+
+	list_add(&entry->list, &private->pool[class]);
+	private->pool_size += entry->mapsize;
+	kgsl_pool_pages += entry->mapsize >> PAGE_SHIFT;
+	return 1;
+}
+
+/*call with driver locked */
+static struct kgsl_mem_entry *kgsl_pool_get(struct kgsl_file_private *private,
+					    int class)
+{
+	struct kgsl_mem_entry *entry;
+	unsigned int uncached = kgsl_cache_enable ? 0 : KGSL_MEMFLAGS_UNCACHED;
+
+	if (class < 0)
+		return NULL;
+
+	/* the cpu side of an allocation is mapped with the caching that
+	 * was in effect when it was flushed, don't hand it out as the
+	 * other kind */
+	list_for_each_entry(entry, &private->pool[class], list) {
+		if ((entry->memdesc.priv & KGSL_MEMFLAGS_UNCACHED) != uncached)
+			continue;
+		list_del(&entry->list);
+		private->pool_size -= entry->mapsize;
+		kgsl_pool_pages -= entry->mapsize >> PAGE_SHIFT;
+		return entry;
+	}
+	return NULL;
+}
+
+/*call with driver locked, frees the oldest entries of the largest classes
+ * first and returns the number of pages freed */
+static int kgsl_pool_trim(struct kgsl_file_private *private, int nr_pages)
+{
+	struct kgsl_mem_entry *entry;
+	int class, freed = 0;
+
+	for (class = KGSL_POOL_CLASSES - 1; class >= 0; class--) {
+		while (freed < nr_pages && !list_empty(&private->pool[class])) {
+			entry = list_entry(private->pool[class].prev,
+					   struct kgsl_mem_entry, list);
+			list_del(&entry->list);
+			private->pool_size -= entry->mapsize;
+			kgsl_pool_pages -= entry->mapsize >> PAGE_SHIFT;
+			freed += entry->mapsize >> PAGE_SHIFT;
+			kgsl_vmalloc_entry_free(entry);
+		}
+	}
+	return freed;
+}
+
+static void kgsl_pool_drain(struct kgsl_file_private *private)
+{
+	kgsl_pool_trim(private, INT_MAX);
+}
+
+static int kgsl_pool_shrink(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct kgsl_file_private *private;
+
+	if (nr_to_scan && kgsl_pool_pages) {
+		if (!(gfp_mask & __GFP_WAIT))
+			return -1;
+		/* allocations under the driver lock may end up in here */
+		if (!mutex_trylock(&kgsl_driver.mutex))
+			return -1;
+		/* unmapping may flush the gpu tlb */
+		kgsl_hw_get_locked();
+		list_for_each_entry(private, &kgsl_driver.client_list, list) {
+			nr_to_scan -= kgsl_pool_trim(private, nr_to_scan);
+			if (nr_to_scan <= 0)
+				break;
+		}
+		kgsl_hw_put_locked(true);
+		mutex_unlock(&kgsl_driver.mutex);
+	}
+	return kgsl_pool_pages;
+}
+
+static struct shrinker kgsl_pool_shrinker = {
+	.shrink = kgsl_pool_shrink,
+	.seeks = DEFAULT_SEEKS
+};
+
+void kgsl_remove_mem_entry(struct kgsl_mem_entry *entry)
+{
+	int i;
+
+	/* ibs registered in this memory can't be submitted any more */
+	for (i = 0; i < KGSL_IB_REGISTER_MAX; i++)
+		if (entry->priv->ibs[i].entry == entry)
+			entry->priv->ibs[i].entry = NULL;
+
 	list_del(&entry->list);
 
-	if (entry->free_list.prev)
-		list_del(&entry->free_list);
+	kgsl_cmdstream_cancel_event(&entry->free_event);
 
-	kfree(entry);
+	if (KGSL_MEMFLAGS_VMALLOC_MEM & entry->memdesc.priv) {
+		entry->priv->vmalloc_size -= entry->memdesc.size;
+		if (!kgsl_pool_put(entry->priv, entry))
+			kgsl_vmalloc_entry_free(entry);
+		return;
+	}
+
+	kgsl_mmu_unmap(entry->memdesc.pagetable,
+		       entry->memdesc.gpuaddr & KGSL_PAGEMASK,
+		       entry->memdesc.size);
+	kgsl_put_phys_file(entry->pmem_file);
+	kmem_cache_free(kgsl_mem_entry_cachep, entry);
 
 }
 
@@ -647,7 +1173,8 @@ done:
 static int kgsl_ioctl_sharedmem_from_vmalloc(struct kgsl_file_private *private,
 					     void __user *arg)
 {
-	int result = 0, len;
+	int result = 0, len, class;
+	unsigned int mapsize;
 	struct kgsl_sharedmem_from_vmalloc param;
 	struct kgsl_mem_entry *entry = NULL;
 	void *vmalloc_area;
@@ -694,14 +1221,28 @@ static int kgsl_ioctl_sharedmem_from_vmalloc(struct kgsl_file_private *private,
 		goto error;
 	}
 
-	entry = kzalloc(sizeof(struct kgsl_mem_entry), GFP_KERNEL);
+	class = kgsl_pool_class(PAGE_SIZE << get_order(len));
+	mapsize = class < 0 ? len : PAGE_SIZE << class;
+	entry = kgsl_pool_get(private, class);
+	if (entry) {
+		vmalloc_area = (void *)entry->memdesc.physaddr;
+		goto map_user;
+	}
+
+	/* what is pooled counts against the watermark too */
+	if (private->vmalloc_size + private->pool_size + mapsize >
+	    KGSL_GRAPHICS_MEMORY_LOW_WATERMARK)
+		kgsl_pool_drain(private);
+
+	entry = kmem_cache_zalloc(kgsl_mem_entry_cachep, GFP_KERNEL);
 	if (entry == NULL) {
 		result = -ENOMEM;
 		goto error;
 	}
+	INIT_LIST_HEAD(&entry->free_event.list);
 
-	/* allocate memory and map it to user space */
-	vmalloc_area = vmalloc_user(len);
+	/* allocate memory and map it to the gpu */
+	vmalloc_area = vmalloc_user(mapsize);
 	if (!vmalloc_area) {
 		KGSL_MEM_ERR("vmalloc failed\n");
 		result = -ENOMEM;
@@ -711,55 +1252,64 @@ static int kgsl_ioctl_sharedmem_from_vmalloc(struct kgsl_file_private *private,
 		/* If we are going to map non-cached, make sure to flush the
 		 * cache to ensure that previously cached data does not
 		 * overwrite this memory */
-		dmac_flush_range(vmalloc_area, vmalloc_area + len);
-		KGSL_MEM_INFO("Caching for memory allocation turned off\n");
-		vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
-	} else {
-		KGSL_MEM_INFO("Caching for memory allocation turned on\n");
-	}
-
-	result = remap_vmalloc_range(vma, vmalloc_area, 0);
-	if (result) {
-		KGSL_MEM_ERR("remap_vmalloc_range returned %d\n", result);
-		goto error_free_vmalloc;
+		dmac_flush_range(vmalloc_area, vmalloc_area + mapsize);
+		entry->memdesc.priv = KGSL_MEMFLAGS_UNCACHED;
 	}
 
 	result =
-	    kgsl_mmu_map(private->pagetable, (unsigned long)vmalloc_area, len,
-			 GSL_PT_PAGE_RV | GSL_PT_PAGE_WV,
+	    kgsl_mmu_map(private->pagetable, (unsigned long)vmalloc_area,
+			 mapsize, GSL_PT_PAGE_RV | GSL_PT_PAGE_WV,
 			 &entry->memdesc.gpuaddr, KGSL_MEMFLAGS_ALIGN4K);
 
 	if (result != 0)
 		goto error_free_vmalloc;
 
 	entry->memdesc.pagetable = private->pagetable;
+	entry->memdesc.physaddr = (unsigned long)vmalloc_area;
+	entry->mapsize = mapsize;
+	entry->priv = private;
+
+map_user:
+	if (!kgsl_cache_enable) {
+		KGSL_MEM_INFO("Caching for memory allocation turned off\n");
+		vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+	} else {
+		KGSL_MEM_INFO("Caching for memory allocation turned on\n");
+	}
+
 	entry->memdesc.size = len;
 	entry->memdesc.hostptr = (void *)param.hostptr;
 	entry->memdesc.priv = KGSL_MEMFLAGS_VMALLOC_MEM |
-	    KGSL_MEMFLAGS_MEM_REQUIRES_FLUSH;
-	entry->memdesc.physaddr = (unsigned long)vmalloc_area;
-	entry->priv = private;
+	    KGSL_MEMFLAGS_MEM_REQUIRES_FLUSH |
+	    (entry->memdesc.priv & KGSL_MEMFLAGS_UNCACHED);
+
+	result = remap_vmalloc_range(vma, vmalloc_area, 0);
+	if (result) {
+		KGSL_MEM_ERR("remap_vmalloc_range returned %d\n", result);
+		goto error_free_mapped;
+	}
 
 	param.gpuaddr = entry->memdesc.gpuaddr;
 
 	if (copy_to_user(arg, &param, sizeof(param))) {
 		result = -EFAULT;
-		goto error_unmap_entry;
+		goto error_free_mapped;
 	}
 	private->vmalloc_size += len;
 	list_add(&entry->list, &private->mem_list);
 
 	return 0;
 
-error_unmap_entry:
-	kgsl_mmu_unmap(private->pagetable, entry->memdesc.gpuaddr,
-		       entry->memdesc.size);
+error_free_mapped:
+	if (!kgsl_pool_put(private, entry))
+		kgsl_vmalloc_entry_free(entry);
+	return result;
 
 error_free_vmalloc:
 	vfree(vmalloc_area);
 
 error_free_entry:
-	kfree(entry);
+	kmem_cache_free(kgsl_mem_entry_cachep, entry);
 
 error:
 	return result;
@@ -838,13 +1388,15 @@ static int kgsl_ioctl_sharedmem_from_pmem(struct kgsl_file_private *private,
 		      pmem_file, start, len);
 	KGSL_DRV_DBG("locked phys file %p\n", pmem_file);
 
-	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	entry = kmem_cache_zalloc(kgsl_mem_entry_cachep, GFP_KERNEL);
 	if (entry == NULL) {
 		result = -ENOMEM;
 		goto error_put_pmem;
 	}
+	INIT_LIST_HEAD(&entry->free_event.list);
 
 	entry->pmem_file = pmem_file;
+	entry->priv = private;
 
 	entry->memdesc.pagetable = private->pagetable;
 
@@ -880,7 +1432,7 @@ error_unmap_entry:
 		       entry->memdesc.gpuaddr & KGSL_PAGEMASK,
 		       entry->memdesc.size);
 error_free_entry:
-	kfree(entry);
+	kmem_cache_free(kgsl_mem_entry_cachep, entry);
 
 error_put_pmem:
 	kgsl_put_phys_file(pmem_file);
@@ -959,9 +1511,26 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 	case IOCTL_KGSL_RINGBUFFER_ISSUEIBCMDS:
 		if (kgsl_cache_enable)
 			flush_l1_cache_all(private);
+		htc_pwrsink_set_owner(PWRSINK_GPU, current_uid());
 		result = kgsl_ioctl_rb_issueibcmds(private, (void __user *)arg);
 		break;
 
+	case IOCTL_KGSL_RINGBUFFER_ISSUEIBHANDLES:
+		if (kgsl_cache_enable)
+			flush_l1_cache_all(private);
+		htc_pwrsink_set_owner(PWRSINK_GPU, current_uid());
+		result = kgsl_ioctl_rb_issueibhandles(private,
+						      (void __user *)arg);
+		break;
+
+	case IOCTL_KGSL_IB_REGISTER:
+		result = kgsl_ioctl_ib_register(private, (void __user *)arg);
+		break;
+
+	case IOCTL_KGSL_IB_UNREGISTER:
+		result = kgsl_ioctl_ib_unregister(private, (void __user *)arg);
+		break;
+
 	case IOCTL_KGSL_CMDSTREAM_READTIMESTAMP:
 		result =
 		    kgsl_ioctl_cmdstream_readtimestamp(private,
@@ -1036,6 +1605,105 @@ static long kgsl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 	return result;
 }
 
+/* submissions timed by kgsl_selftest(), NOP packets through the ring */
+#define KGSL_SELFTEST_RUNS	64
+
+static int kgsl_selftest_cmp(const void *a, const void *b)
+{
+	const u32 *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+static int kgsl_selftest_report(char *buf, int len, const char *name,
+				u32 *us, int n)
+{
+	sort(us, n, sizeof(*us), kgsl_selftest_cmp, NULL);
+	return scnprintf(buf, len, "%s_us p50 %u p99 %u max %u\n", name,
+			 us[n / 2], us[(n * 99) / 100], us[n - 1]);
+}
+
+/* submit latency: kgsl_ringbuffer_issuecmds() until the wptr is written.
+ * poll: submit until the retired timestamp is seen by spinning on the
+ * memstore, which is what the gpu alone costs.  wait: the same through
+ * kgsl_yamato_waittimestamp(), so wait - poll is the interrupt and
+ * wakeup path a client blocked in IOCTL_KGSL_DEVICE_WAITTIMESTAMP pays.
+ * Only runs while a client holds the device open, the ring is not set
+ * up otherwise. */
+int kgsl_selftest(char *buf, int len)
+{
+	struct kgsl_device *device = &kgsl_driver.yamato_device;
+	unsigned int cmds[2];
+	u32 *submit_us, *poll_us, *wait_us;
+	ktime_t start, issued, end;
+	uint32_t timestamp;
+	int i, n = 0, result = 0;
+
+	submit_us = kmalloc(3 * KGSL_SELFTEST_RUNS * sizeof(u32), GFP_KERNEL);
+	if (!submit_us)
+		return -ENOMEM;
+	poll_us = submit_us + KGSL_SELFTEST_RUNS;
+	wait_us = poll_us + KGSL_SELFTEST_RUNS;
+
+	cmds[0] = pm4_nop_packet(1);
+	cmds[1] = 0;
+
+	mutex_lock(&kgsl_driver.mutex);
+	if (atomic_read(&kgsl_driver.open_count) == 0 ||
+	    !(device->ringbuffer.flags & KGSL_FLAGS_STARTED)) {
+		mutex_unlock(&kgsl_driver.mutex);
+		kfree(submit_us);
+		return -ENODEV;
+	}
+	kgsl_hw_get_locked();
+
+	for (i = 0; i < KGSL_SELFTEST_RUNS; i++) {
+		start = ktime_get();
+		timestamp = kgsl_ringbuffer_issuecmds(device, 0, cmds, 2);
+		issued = ktime_get();
+		while (!kgsl_cmdstream_check_timestamp(device, timestamp)) {
+			if (ktime_us_delta(ktime_get(), issued) > USEC_PER_SEC) {
+				result = -ETIMEDOUT;
+				goto done;
+			}
+			cpu_relax();
+		}
+		end = ktime_get();
+		submit_us[i] = ktime_us_delta(issued, start);
+		poll_us[i] = ktime_us_delta(end, start);
+	}
+
+	for (i = 0; i < KGSL_SELFTEST_RUNS; i++) {
+		start = ktime_get();
+		timestamp = kgsl_ringbuffer_issuecmds(device, 0, cmds, 2);
+		result = kgsl_yamato_waittimestamp(device, timestamp,
+						   MSEC_PER_SEC);
+		end = ktime_get();
+		if (result)
+			goto done;
+		wait_us[i] = ktime_us_delta(end, start);
+	}
+	kgsl_yamato_runpending(device);
+
+done:
+	kgsl_hw_put_locked(true);
+	mutex_unlock(&kgsl_driver.mutex);
+
+	if (!result) {
+		n += kgsl_selftest_report(buf + n, len - n, "submit",
+					  submit_us, KGSL_SELFTEST_RUNS);
+		n += kgsl_selftest_report(buf + n, len - n, "retire_poll",
+					  poll_us, KGSL_SELFTEST_RUNS);
+		n += kgsl_selftest_report(buf + n, len - n, "retire_wait",
+					  wait_us, KGSL_SELFTEST_RUNS);
+		n += scnprintf(buf + n, len - n, "wakeup_us p50 %d\\n",
+			       (int)(wait_us[KGSL_SELFTEST_RUNS / 2] -
+				     poll_us[KGSL_SELFTEST_RUNS / 2]));
+	}
+	kfree(submit_us);
+	return result ? result : n;
+}
+
 static int kgsl_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	int result;
@@ -1100,6 +1768,12 @@ static void kgsl_driver_cleanup(void)
 {
 
 	wake_lock_destroy(&kgsl_driver.wake_lock);
+	unregister_perf_boost_notifier(&kgsl_driver.pwrscale.boost_nb);
+	if (kgsl_driver.have_touch_handler) {
+		input_unregister_handler(&kgsl_touch_handler);
+		kgsl_driver.have_touch_handler = false;
+	}
+	cancel_work_sync(&kgsl_driver.touch_work);
 
 	if (kgsl_driver.interrupt_num > 0) {
 		if (kgsl_driver.have_irq) {
@@ -1150,6 +1824,19 @@ static int __devinit kgsl_platform_probe(struct platform_device *pdev)
 	kgsl_driver.pdev = pdev;
 
 	setup_timer(&kgsl_driver.standby_timer, kgsl_do_standby_timer, 0);
+	spin_lock_init(&kgsl_driver.pwrscale.lock);
+	setup_timer(&kgsl_driver.pwrscale.timer, kgsl_pwrscale_timer, 0);
+	INIT_LIST_HEAD(&kgsl_driver.pwrscale.idle_event.list);
+	kgsl_driver.pwrscale.enable = 1;
+	kgsl_driver.pwrscale.window_ms = 16;
+	kgsl_driver.pwrscale.up_threshold = 90;
+	kgsl_driver.pwrscale.down_threshold = 50;
+	kgsl_driver.pwrscale.idle_timeout_ms = 512;
+	kgsl_driver.pwrscale.touch_wake_ms = 100;
+	kgsl_driver.pwrscale.boost_until = jiffies;
+	kgsl_driver.pwrscale.boost_nb.notifier_call = kgsl_pwrscale_boost;
+	INIT_WORK(&kgsl_driver.event_work, kgsl_event_work);
+	INIT_WORK(&kgsl_driver.touch_work, kgsl_touch_work);
 	wake_lock_init(&kgsl_driver.wake_lock, WAKE_LOCK_SUSPEND, "kgsl");
 
 	clk = clk_get(&pdev->dev, "grp_clk");
@@ -1159,6 +1846,7 @@ static int __devinit kgsl_platform_probe(struct platform_device *pdev)
 		goto done;
 	}
 	kgsl_driver.grp_clk = clk;
+	kgsl_driver.pwrscale.grp_base = clk_get_rate(clk);
 
 	clk = clk_get(&pdev->dev, "imem_clk");
 	if (IS_ERR(clk)) {
@@ -1218,6 +1906,13 @@ static int __devinit kgsl_platform_probe(struct platform_device *pdev)
 	kgsl_driver.shmem.physbase = res->start;
 	kgsl_driver.shmem.size = resource_size(res);
 
+	register_perf_boost_notifier(&kgsl_driver.pwrscale.boost_nb);
+
+	kgsl_driver.have_touch_handler =
+		!input_register_handler(&kgsl_touch_handler);
+	if (!kgsl_driver.have_touch_handler)
+		KGSL_DRV_ERR("no touch wake\n");
+
 done:
 	if (result)
 		kgsl_driver_cleanup();
@@ -1254,18 +1949,25 @@ static struct platform_driver kgsl_platform_driver = {
 	.suspend = kgsl_platform_suspend,
 	.driver = {
 		.owner = THIS_MODULE,
-		.name = DRIVER_NAME
+		.name = DRIVER_NAME,
+		.probe_async = true,
 	}
 };
 
 static int __init kgsl_mod_init(void)
 {
+	kgsl_mem_entry_cachep = KMEM_CACHE(kgsl_mem_entry, 0);
+	if (!kgsl_mem_entry_cachep)
+		return -ENOMEM;
+	register_shrinker(&kgsl_pool_shrinker);
 	return platform_driver_register(&kgsl_platform_driver);
 }
 
 static void __exit kgsl_mod_exit(void)
 {
 	platform_driver_unregister(&kgsl_platform_driver);
+	unregister_shrinker(&kgsl_pool_shrinker);
+	kmem_cache_destroy(kgsl_mem_entry_cachep);
 }
 
 module_init(kgsl_mod_init);
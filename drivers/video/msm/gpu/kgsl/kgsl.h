@@ -24,9 +24,12 @@
 #include <linux/platform_device.h>
 #include <linux/clk.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
 #include <linux/wait.h>
 #include <linux/timer.h>
 #include <linux/wakelock.h>
+#include <linux/workqueue.h>
 
 #include <asm/atomic.h>
 
@@ -35,6 +38,41 @@
 
 #define DRIVER_NAME "kgsl"
 
+/* clock levels the governor moves between, fastest first, and how many
+ * per-window samples are kept for debugfs */
+#define KGSL_PWRLEVELS		3
+#define KGSL_PWR_TRACE_LEN	64
+
+struct kgsl_pwrscale {
+	spinlock_t lock;
+	struct timer_list timer;
+	/* fires when the last issued timestamp retires */
+	struct kgsl_event idle_event;
+	unsigned int level;
+	unsigned long grp_base;	/* grp_clk rate at probe, level 0 */
+	bool grp_fixed;		/* grp_clk refused a rate change */
+	bool busy;
+	ktime_t busy_start;
+	ktime_t window_start;
+	s64 busy_us;
+
+	/* tunables, exported in debugfs */
+	u32 enable;
+	u32 window_ms;
+	u32 up_threshold;	/* busy percent that jumps to level 0 */
+	u32 down_threshold;	/* busy percent that steps one level down */
+	u32 idle_timeout_ms;	/* idle time before the core is turned off */
+	u32 touch_wake_ms;	/* on time after a touch down, 0 disables */
+
+	/* perf_boost() keeps level 0 until then, set from atomic context */
+	unsigned long boost_until;
+	struct notifier_block boost_nb;
+
+	u8 trace_busy[KGSL_PWR_TRACE_LEN];
+	u8 trace_level[KGSL_PWR_TRACE_LEN];
+	unsigned int trace_head;
+};
+
 struct kgsl_driver {
 	struct miscdevice misc;
 	struct platform_device *pdev;
@@ -52,6 +90,12 @@ struct kgsl_driver {
 #endif
 	struct kgsl_devconfig yamato_config;
 
+	/* runs retired kgsl_events, scheduled from the cp interrupt */
+	struct work_struct event_work;
+	/* turns the core on ahead of the frame that follows a touch */
+	struct work_struct touch_work;
+	bool have_touch_handler;
+
 	uint32_t flags_debug;
 
 	struct kgsl_sharedmem shmem;
@@ -63,17 +107,26 @@ struct kgsl_driver {
 	int active_cnt;
 	struct timer_list standby_timer;
 
+	struct kgsl_pwrscale pwrscale;
+
 	struct wake_lock wake_lock;
 };
 
 extern struct kgsl_driver kgsl_driver;
 
+/* number of power-of-two size classes of freed vmalloc allocations kept
+ * per process, and the most a process may keep */
+#define KGSL_POOL_CLASSES	8
+#define KGSL_POOL_SIZE		0x200000
+
 struct kgsl_mem_entry {
 	struct kgsl_memdesc memdesc;
+	/* size of the vmalloc area and of its gpu mapping, memdesc.size is
+	 * what the user asked for */
+	unsigned int mapsize;
 	struct file *pmem_file;
 	struct list_head list;
-	struct list_head free_list;
-	uint32_t free_timestamp;
+	struct kgsl_event free_event;
 
 	/* back pointer to private structure under whose context this
 	 * allocation is made */
@@ -82,4 +135,7 @@ struct kgsl_mem_entry {
 
 void kgsl_remove_mem_entry(struct kgsl_mem_entry *entry);
 
+/* fills buf with submit and retire latencies, returns its length */
+int kgsl_selftest(char *buf, int len);
+
 #endif /* _GSL_DRIVER_H */
@@ -61,43 +61,102 @@ int kgsl_cmdstream_check_timestamp(struct kgsl_device *device,
 	return timestamp_cmp(ts_processed, timestamp);
 }
 
-void kgsl_cmdstream_memqueue_drain(struct kgsl_device *device)
+/* have the COND_EXEC at the end of the first submission with a timestamp
+ * at or past this one raise an RB interrupt */
+void kgsl_cmdstream_arm_irq(struct kgsl_device *device, uint32_t timestamp)
 {
-	struct kgsl_mem_entry *entry, *entry_tmp;
+	uint32_t ref_ts;
+	int enableflag = 1;
+
+	kgsl_sharedmem_read(&device->memstore, &ref_ts,
+		KGSL_DEVICE_MEMSTORE_OFFSET(ref_wait_ts), 4);
+	if (timestamp_cmp(ref_ts, timestamp))
+		kgsl_sharedmem_write(&device->memstore,
+			KGSL_DEVICE_MEMSTORE_OFFSET(ref_wait_ts),
+			&timestamp, 4);
+	kgsl_sharedmem_write(&device->memstore,
+		KGSL_DEVICE_MEMSTORE_OFFSET(ts_cmp_enable),
+		&enableflag, 4);
+}
+
+/* call with driver locked */
+void kgsl_cmdstream_add_event(struct kgsl_device *device,
+			      struct kgsl_event *event, uint32_t timestamp,
+			      void (*func)(struct kgsl_device *, void *,
+					   uint32_t),
+			      void *priv)
+{
+	struct kgsl_event *pos;
+
+	event->timestamp = timestamp;
+	event->func = func;
+	event->priv = priv;
+
+	/* keep the list sorted so processing can stop at the first
+	 * unretired event */
+	list_for_each_entry_reverse(pos, &device->events, list) {
+		if (timestamp_cmp(timestamp, pos->timestamp))
+			break;
+	}
+	list_add(&event->list, &pos->list);
+
+	if (device->events.next == &event->list)
+		kgsl_cmdstream_arm_irq(device, timestamp);
+}
+
+/* call with driver locked */
+void kgsl_cmdstream_cancel_event(struct kgsl_event *event)
+{
+	list_del_init(&event->list);
+}
+
+/* call with driver locked */
+void kgsl_cmdstream_process_events(struct kgsl_device *device)
+{
+	struct kgsl_event *event;
 	uint32_t ts_processed;
-	struct kgsl_ringbuffer *rb = &device->ringbuffer;
 
 	/* get current EOP timestamp */
 	ts_processed =
 	    kgsl_cmdstream_readtimestamp(device, KGSL_TIMESTAMP_RETIRED);
 
-	list_for_each_entry_safe(entry, entry_tmp, &rb->memqueue, free_list) {
-		/*NOTE: this assumes that the free list is sorted by
-		 * timestamp, but I'm not yet sure that it is a valid
-		 * assumption
-		 */
-		if (!timestamp_cmp(ts_processed, entry->free_timestamp))
+	/* a callback may cancel other events, so restart from the head
+	 * each time */
+	while (!list_empty(&device->events)) {
+		event = list_first_entry(&device->events, struct kgsl_event,
+					 list);
+		if (!timestamp_cmp(ts_processed, event->timestamp)) {
+			kgsl_cmdstream_arm_irq(device, event->timestamp);
 			break;
-		KGSL_MEM_DBG("ts_processed %d ts_free %d gpuaddr %x)\n",
-			     ts_processed, entry->free_timestamp,
-			     entry->memdesc.gpuaddr);
-		kgsl_remove_mem_entry(entry);
+		}
+		list_del_init(&event->list);
+		event->func(device, event->priv, event->timestamp);
 	}
 }
 
+static void kgsl_cmdstream_free_entry(struct kgsl_device *device, void *priv,
+				      uint32_t timestamp)
+{
+	struct kgsl_mem_entry *entry = priv;
+
+	KGSL_MEM_DBG("ts_free %d gpuaddr %x)\n",
+		     timestamp, entry->memdesc.gpuaddr);
+	kgsl_remove_mem_entry(entry);
+}
+
 int
 kgsl_cmdstream_freememontimestamp(struct kgsl_device *device,
 				  struct kgsl_mem_entry *entry,
 				  uint32_t timestamp,
 				  enum kgsl_timestamp_type type)
 {
-	struct kgsl_ringbuffer *rb = &device->ringbuffer;
 	KGSL_MEM_DBG("enter (dev %p gpuaddr %x ts %d)\n",
 		     device, entry->memdesc.gpuaddr, timestamp);
 	(void)type;		/* unref. For now just use EOP timestamp */
 
-	list_add_tail(&entry->free_list, &rb->memqueue);
-	entry->free_timestamp = timestamp;
+	kgsl_cmdstream_cancel_event(&entry->free_event);
+	kgsl_cmdstream_add_event(device, &entry->free_event, timestamp,
+				 kgsl_cmdstream_free_entry, entry);
 
 	return 0;
 }
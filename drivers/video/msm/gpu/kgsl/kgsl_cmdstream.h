@@ -30,7 +30,17 @@ int kgsl_cmdstream_init(struct kgsl_device *device);
 
 int kgsl_cmdstream_close(struct kgsl_device *device);
 
-void kgsl_cmdstream_memqueue_drain(struct kgsl_device *device);
+void kgsl_cmdstream_arm_irq(struct kgsl_device *device, uint32_t timestamp);
+
+void kgsl_cmdstream_add_event(struct kgsl_device *device,
+			      struct kgsl_event *event, uint32_t timestamp,
+			      void (*func)(struct kgsl_device *, void *,
+					   uint32_t),
+			      void *priv);
+
+void kgsl_cmdstream_cancel_event(struct kgsl_event *event);
+
+void kgsl_cmdstream_process_events(struct kgsl_device *device);
 
 uint32_t
 kgsl_cmdstream_readtimestamp(struct kgsl_device *device,
@@ -46,6 +46,7 @@
 /* Private memory flags for use with memdesc->priv feild */
 #define KGSL_MEMFLAGS_MEM_REQUIRES_FLUSH    0x00000001
 #define KGSL_MEMFLAGS_VMALLOC_MEM           0x00000002
+#define KGSL_MEMFLAGS_UNCACHED              0x00000004
 
 #define KGSL_GRAPHICS_MEMORY_LOW_WATERMARK  0x1000000
 #define KGSL_IS_PAGE_ALIGNED(addr) (!((addr) & (~PAGE_MASK)))
@@ -61,6 +62,24 @@ struct kgsl_memregion {
 	unsigned int   sizebytes;
 };
 
+/* callback run once, in process context with kgsl_driver.mutex held,
+ * after the retired timestamp reaches timestamp */
+struct kgsl_event {
+	uint32_t timestamp;
+	void (*func)(struct kgsl_device *device, void *priv,
+		     uint32_t timestamp);
+	void *priv;
+	struct list_head list;
+};
+
+/* context switches that did (full) or did not (light) copy gmem */
+struct kgsl_ctxtstats {
+	unsigned int full;
+	unsigned int light;
+	unsigned int gmem_saves;
+	unsigned int gmem_restores;
+};
+
 struct kgsl_device {
 
 	unsigned int	  refcnt;
@@ -76,8 +95,14 @@ struct kgsl_device {
 	unsigned int      drawctxt_count;
 	struct kgsl_drawctxt *drawctxt_active;
 	struct kgsl_drawctxt drawctxt[KGSL_CONTEXT_MAX];
+	/* context whose gmem was left in place instead of saved */
+	struct kgsl_drawctxt *gmem_owner;
+	struct kgsl_ctxtstats ctxt_stats;
 
 	wait_queue_head_t ib1_wq;
+
+	/* pending kgsl_events, sorted by timestamp */
+	struct list_head events;
 };
 
 struct kgsl_devconfig {
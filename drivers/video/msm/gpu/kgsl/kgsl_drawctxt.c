@@ -1477,6 +1477,9 @@ kgsl_drawctxt_create(struct kgsl_device *device,
 	/* Save the shader instruction memory on context switching */
 	drawctxt->flags |= CTXT_FLAGS_SHADER_SAVE;
 
+	if (flags & KGSL_CONTEXT_NO_GMEM_WRITE)
+		drawctxt->flags |= CTXT_FLAGS_NO_GMEM_WRITE;
+
 	if (!(flags & KGSL_CONTEXT_NO_GMEM_ALLOC)) {
 		/* create gmem shadow */
 		memset(drawctxt->user_gmem_shadow, 0,
@@ -1521,6 +1524,10 @@ int kgsl_drawctxt_destroy(struct kgsl_device *device, unsigned int drawctxt_id)
 			kgsl_drawctxt_switch(device, NULL, 0);
 		}
 
+		/* its parked gmem is of no use to anyone now */
+		if (device->gmem_owner == drawctxt)
+			device->gmem_owner = NULL;
+
 		kgsl_yamato_idle(device, KGSL_TIMEOUT_DEFAULT);
 
 		/* destroy state shadow, if allocated */
@@ -1677,12 +1684,88 @@ int kgsl_drawctxt_set_bin_base_offset(struct kgsl_device *device,
 	return 0;
 }
 
-/* switch drawing contexts */
+/* copy gmem out to the context's shadow.
+ * (note: changes shader. shader must already be saved.)
+ */
+static void drawctxt_save_gmem(struct kgsl_device *device,
+			       struct kgsl_drawctxt *drawctxt)
+{
+	unsigned int i, numbuffers = 0;
+
+	KGSL_CTXT_DBG("save gmem");
+	for (i = 0; i < KGSL_MAX_GMEM_SHADOW_BUFFERS; i++) {
+		if (drawctxt->user_gmem_shadow[i].gmemshadow.size > 0) {
+			kgsl_ringbuffer_issuecmds(device, KGSL_CMD_FLAGS_PMODE,
+				drawctxt->user_gmem_shadow[i].gmem_save, 3);
+
+			/* Restore TP0_CHICKEN */
+			kgsl_ringbuffer_issuecmds(device, 0,
+				drawctxt->chicken_restore, 3);
+
+			numbuffers++;
+		}
+	}
+	if (numbuffers == 0) {
+		kgsl_ringbuffer_issuecmds(device, KGSL_CMD_FLAGS_PMODE,
+			drawctxt->context_gmem_shadow.gmem_save, 3);
+
+		/* Restore TP0_CHICKEN */
+		kgsl_ringbuffer_issuecmds(device, 0,
+			drawctxt->chicken_restore, 3);
+	}
+
+	drawctxt->flags |= CTXT_FLAGS_GMEM_RESTORE;
+	device->ctxt_stats.gmem_saves++;
+}
+
+/* copy the context's shadow back into gmem.
+ * (note: changes shader. shader must not already be restored.)
+ */
+static void drawctxt_restore_gmem(struct kgsl_device *device,
+				  struct kgsl_drawctxt *drawctxt)
+{
+	unsigned int i, numbuffers = 0;
+
+	KGSL_CTXT_DBG("restore gmem");
+	for (i = 0; i < KGSL_MAX_GMEM_SHADOW_BUFFERS; i++) {
+		if (drawctxt->user_gmem_shadow[i].gmemshadow.size > 0) {
+			kgsl_ringbuffer_issuecmds(device, KGSL_CMD_FLAGS_PMODE,
+				drawctxt->user_gmem_shadow[i].gmem_restore, 3);
+
+			/* Restore TP0_CHICKEN */
+			kgsl_ringbuffer_issuecmds(device, 0,
+				drawctxt->chicken_restore, 3);
+			numbuffers++;
+		}
+	}
+	if (numbuffers == 0) {
+		kgsl_ringbuffer_issuecmds(device, KGSL_CMD_FLAGS_PMODE,
+			drawctxt->context_gmem_shadow.gmem_restore, 3);
+
+		/* Restore TP0_CHICKEN */
+		kgsl_ringbuffer_issuecmds(device, 0,
+			drawctxt->chicken_restore, 3);
+	}
+
+	drawctxt->flags &= ~CTXT_FLAGS_GMEM_RESTORE;
+	device->ctxt_stats.gmem_restores++;
+}
+
+/* switch drawing contexts
+ *
+ * A context created with KGSL_CONTEXT_NO_GMEM_WRITE only does 2D and
+ * resolves, it never renders into gmem. Switching to such a context
+ * leaves the outgoing context's gmem where it is (device->gmem_owner)
+ * instead of copying it to the shadow; if the owner comes back before
+ * any gmem writer runs, neither the save nor the restore is needed.
+ */
 void
 kgsl_drawctxt_switch(struct kgsl_device *device, struct kgsl_drawctxt *drawctxt,
 			unsigned int flags)
 {
 	struct kgsl_drawctxt *active_ctxt = device->drawctxt_active;
+	struct kgsl_drawctxt *owner;
+	unsigned int gmem_copies;
 	unsigned int cmds[2];
 
 	if (drawctxt) {
@@ -1699,6 +1782,9 @@ kgsl_drawctxt_switch(struct kgsl_device *device, struct kgsl_drawctxt *drawctxt,
 
 	KGSL_CTXT_INFO("from %p to %p flags %d\n",
 			device->drawctxt_active, drawctxt, flags);
+	gmem_copies = device->ctxt_stats.gmem_saves +
+		      device->ctxt_stats.gmem_restores;
+
 	/* save old context*/
 	if (active_ctxt != NULL) {
 		KGSL_CTXT_INFO("active_ctxt flags %08x\n", active_ctxt->flags);
@@ -1723,39 +1809,13 @@ kgsl_drawctxt_switch(struct kgsl_device *device, struct kgsl_drawctxt *drawctxt,
 		}
 
 		if (active_ctxt->flags & CTXT_FLAGS_GMEM_SAVE
-			&& active_ctxt->flags & CTXT_FLAGS_GMEM_SHADOW) {
-			/* save gmem.
-			 * (note: changes shader. shader must already be saved.)
-			 */
-			unsigned int i, numbuffers = 0;
-			KGSL_CTXT_DBG("save gmem");
-			for (i = 0; i < KGSL_MAX_GMEM_SHADOW_BUFFERS; i++) {
-				if (active_ctxt->user_gmem_shadow[i].gmemshadow.
-				    size > 0) {
-					kgsl_ringbuffer_issuecmds(device,
-						KGSL_CMD_FLAGS_PMODE,
-					  active_ctxt->user_gmem_shadow[i].
-						gmem_save, 3);
-
-					/* Restore TP0_CHICKEN */
-					kgsl_ringbuffer_issuecmds(device, 0,
-					  active_ctxt->chicken_restore, 3);
-
-					numbuffers++;
-				}
-			}
-			if (numbuffers == 0) {
-				kgsl_ringbuffer_issuecmds(device,
-				    KGSL_CMD_FLAGS_PMODE,
-				    active_ctxt->context_gmem_shadow.gmem_save,
-				    3);
-
-				/* Restore TP0_CHICKEN */
-				kgsl_ringbuffer_issuecmds(device, 0,
-					 active_ctxt->chicken_restore, 3);
-			}
-
-			active_ctxt->flags |= CTXT_FLAGS_GMEM_RESTORE;
+			&& active_ctxt->flags & CTXT_FLAGS_GMEM_SHADOW
+			&& !(active_ctxt->flags & CTXT_FLAGS_NO_GMEM_WRITE)) {
+			if (drawctxt && !(drawctxt->flags &
+					  CTXT_FLAGS_NO_GMEM_WRITE))
+				drawctxt_save_gmem(device, active_ctxt);
+			else
+				device->gmem_owner = active_ctxt;
 		}
 	}
 
@@ -1765,42 +1825,28 @@ kgsl_drawctxt_switch(struct kgsl_device *device, struct kgsl_drawctxt *drawctxt,
 	if (drawctxt != NULL) {
 
 		KGSL_CTXT_INFO("drawctxt flags %08x\n", drawctxt->flags);
+
+		owner = device->gmem_owner;
+		if (owner == drawctxt) {
+			/* nothing wrote gmem meanwhile, it is still ours */
+			device->gmem_owner = NULL;
+		} else if (owner &&
+			   !(drawctxt->flags & CTXT_FLAGS_NO_GMEM_WRITE)) {
+			/* the parked gmem goes out before it is overwritten */
+			KGSL_CTXT_DBG("save parked gmem");
+			kgsl_mmu_setstate(device, owner->pagetable);
+			drawctxt_save_gmem(device, owner);
+			device->gmem_owner = NULL;
+		}
+
 		KGSL_CTXT_DBG("restore pagetable");
 		kgsl_mmu_setstate(device, drawctxt->pagetable);
 
 		/* restore gmem.
 		 *  (note: changes shader. shader must not already be restored.)
 		 */
-		if (drawctxt->flags & CTXT_FLAGS_GMEM_RESTORE) {
-			unsigned int i, numbuffers = 0;
-			KGSL_CTXT_DBG("restore gmem");
-
-			for (i = 0; i < KGSL_MAX_GMEM_SHADOW_BUFFERS; i++) {
-				if (drawctxt->user_gmem_shadow[i].gmemshadow.
-				    size > 0) {
-					kgsl_ringbuffer_issuecmds(device,
-						KGSL_CMD_FLAGS_PMODE,
-					  drawctxt->user_gmem_shadow[i].
-						gmem_restore, 3);
-
-					/* Restore TP0_CHICKEN */
-					kgsl_ringbuffer_issuecmds(device, 0,
-					  drawctxt->chicken_restore, 3);
-					numbuffers++;
-				}
-			}
-			if (numbuffers == 0) {
-				kgsl_ringbuffer_issuecmds(device,
-					KGSL_CMD_FLAGS_PMODE,
-				  drawctxt->context_gmem_shadow.gmem_restore,
-					3);
-
-				/* Restore TP0_CHICKEN */
-				kgsl_ringbuffer_issuecmds(device, 0,
-				  drawctxt->chicken_restore, 3);
-			}
-			drawctxt->flags &= ~CTXT_FLAGS_GMEM_RESTORE;
-		}
+		if (drawctxt->flags & CTXT_FLAGS_GMEM_RESTORE)
+			drawctxt_restore_gmem(device, drawctxt);
 
 		/* restore registers and constants. */
 		KGSL_CTXT_DBG("restore regs");
@@ -1819,5 +1865,11 @@ kgsl_drawctxt_switch(struct kgsl_device *device, struct kgsl_drawctxt *drawctxt,
 
 	} else
 		kgsl_mmu_setstate(device, device->mmu.defaultpagetable);
+
+	if (device->ctxt_stats.gmem_saves + device->ctxt_stats.gmem_restores
+	    == gmem_copies)
+		device->ctxt_stats.light++;
+	else
+		device->ctxt_stats.full++;
 	KGSL_CTXT_INFO("return\n");
 }
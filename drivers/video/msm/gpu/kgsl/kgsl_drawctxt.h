@@ -37,6 +37,8 @@
 #define CTXT_FLAGS_SHADER_SAVE		0x00002000
 /* shader can be restored from shadow */
 #define CTXT_FLAGS_SHADER_RESTORE	0x00004000
+/* context never renders into gmem (2D and resolve only) */
+#define CTXT_FLAGS_NO_GMEM_WRITE	0x00010000
 
 #include "kgsl_sharedmem.h"
 #include "yamato_reg.h"
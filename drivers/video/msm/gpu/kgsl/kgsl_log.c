@@ -254,6 +254,83 @@ DEFINE_SIMPLE_ATTRIBUTE(kgsl_cache_enable_fops, kgsl_cache_enable_get,
 			kgsl_cache_enable_set, "%llu\n");
 #endif
 
+static ssize_t scale_trace_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	const int debug_bufmax = 1024;
+	static char buffer[1024];
+	struct kgsl_pwrscale *pwr = &kgsl_driver.pwrscale;
+	unsigned int i, j;
+	int n = 0;
+
+	spin_lock_bh(&pwr->lock);
+	n += scnprintf(buffer + n, debug_bufmax - n,
+			"level %u grp_fixed %d\n", pwr->level, pwr->grp_fixed);
+	/* oldest window first, one "busy% level" pair per window */
+	for (i = 0; i < KGSL_PWR_TRACE_LEN; i++) {
+		j = (pwr->trace_head + i) % KGSL_PWR_TRACE_LEN;
+		n += scnprintf(buffer + n, debug_bufmax - n, "%u %u\n",
+				pwr->trace_busy[j], pwr->trace_level[j]);
+	}
+	spin_unlock_bh(&pwr->lock);
+
+	return simple_read_from_buffer(buf, count, ppos, buffer, n);
+}
+
+static struct file_operations kgsl_scale_trace_fops = {
+	.read = scale_trace_read,
+};
+
+static ssize_t selftest_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	char buffer[256];
+	int n;
+
+	/* one run per open, reading the tail doesn't start another */
+	if (*ppos)
+		return 0;
+	n = kgsl_selftest(buffer, sizeof(buffer));
+	if (n < 0)
+		return n;
+
+	return simple_read_from_buffer(buf, count, ppos, buffer, n);
+}
+
+static struct file_operations kgsl_selftest_fops = {
+	.read = selftest_read,
+};
+
+#ifdef GSL_STATS_RINGBUFFER
+static ssize_t rb_stats_read(struct file *file, char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	char buffer[256];
+	int n;
+	struct kgsl_rbstats stats;
+	unsigned int sizedwords;
+
+	mutex_lock(&kgsl_driver.mutex);
+	stats = kgsl_driver.yamato_device.ringbuffer.stats;
+	sizedwords = kgsl_driver.yamato_device.ringbuffer.sizedwords;
+	mutex_unlock(&kgsl_driver.mutex);
+
+	n = scnprintf(buffer, sizeof(buffer),
+			"issues %lld words %lld wptr_writes %lld\n"
+			"waitspace %lld waitspace_us %lld\n"
+			"max_occupancy %u/%u\n",
+			stats.issues, stats.words_total, stats.wptr_writes,
+			stats.waitspace, stats.waitspace_us,
+			stats.max_occupancy, sizedwords);
+
+	return simple_read_from_buffer(buf, count, ppos, buffer, n);
+}
+
+static struct file_operations kgsl_rb_stats_fops = {
+	.read = rb_stats_read,
+};
+#endif
+
 #endif /* CONFIG_DEBUG_FS */
 
 int kgsl_debug_init(void)
@@ -287,6 +364,36 @@ int kgsl_debug_init(void)
 			    &kgsl_cache_enable_fops);
 #endif
 
+#ifdef GSL_STATS_RINGBUFFER
+	debugfs_create_file("rb_stats", 0444, dent, 0,
+			    &kgsl_rb_stats_fops);
+#endif
+
+	debugfs_create_u32("ctxt_switch_full", 0444, dent,
+			   &kgsl_driver.yamato_device.ctxt_stats.full);
+	debugfs_create_u32("ctxt_switch_light", 0444, dent,
+			   &kgsl_driver.yamato_device.ctxt_stats.light);
+	debugfs_create_u32("ctxt_gmem_saves", 0444, dent,
+			   &kgsl_driver.yamato_device.ctxt_stats.gmem_saves);
+	debugfs_create_u32("ctxt_gmem_restores", 0444, dent,
+			   &kgsl_driver.yamato_device.ctxt_stats.gmem_restores);
+	debugfs_create_u32("scale_enable", 0644, dent,
+			   &kgsl_driver.pwrscale.enable);
+	debugfs_create_u32("scale_window_ms", 0644, dent,
+			   &kgsl_driver.pwrscale.window_ms);
+	debugfs_create_u32("scale_up_threshold", 0644, dent,
+			   &kgsl_driver.pwrscale.up_threshold);
+	debugfs_create_u32("scale_down_threshold", 0644, dent,
+			   &kgsl_driver.pwrscale.down_threshold);
+	debugfs_create_u32("idle_timeout_ms", 0644, dent,
+			   &kgsl_driver.pwrscale.idle_timeout_ms);
+	debugfs_create_u32("touch_wake_ms", 0644, dent,
+			   &kgsl_driver.pwrscale.touch_wake_ms);
+	debugfs_create_file("scale_trace", 0444, dent, 0,
+			    &kgsl_scale_trace_fops);
+	debugfs_create_file("selftest", 0400, dent, 0,
+			    &kgsl_selftest_fops);
+
 #endif /* CONFIG_DEBUG_FS */
 	return 0;
 }
@@ -22,6 +22,7 @@
 
 #include <asm/pgalloc.h>
 #include <asm/pgtable.h>
+#include <asm/cacheflush.h>
 
 #include "kgsl_mmu.h"
 #include "kgsl.h"
@@ -282,6 +283,8 @@ int kgsl_mmu_setstate(struct kgsl_device *device,
 		KGSL_MEM_INFO("from %p to %p\n", mmu->hwpagetable, pagetable);
 		if (mmu->hwpagetable != pagetable) {
 			mmu->hwpagetable = pagetable;
+			/* the switch invalidates the tlb as well */
+			mmu->tlb_dirty = 0;
 
 			/* call device specific set page table */
 			status = kgsl_yamato_setstate(mmu->device,
@@ -295,6 +298,24 @@ int kgsl_mmu_setstate(struct kgsl_device *device,
 	return status;
 }
 
+/* The gpu only walks its pagetable for commands in the ringbuffer, so
+ * map and unmap just mark the tlb dirty and the invalidate is queued
+ * once, ahead of the next commands submitted.  The yamato mmu can only
+ * invalidate its whole tlb, so this batching is the only saving there is.
+ *
+ * call this with the global lock held */
+int kgsl_mmu_flush_pending(struct kgsl_device *device)
+{
+	struct kgsl_mmu *mmu = &device->mmu;
+
+	if (!mmu->tlb_dirty)
+		return 0;
+	mmu->tlb_dirty = 0;
+	if (!(mmu->flags & KGSL_FLAGS_STARTED))
+		return 0;
+	return kgsl_yamato_setstate(device, KGSL_MMUFLAGS_TLBFLUSH);
+}
+
 int kgsl_mmu_init(struct kgsl_device *device)
 {
 	/*
@@ -464,9 +485,6 @@ int kgsl_mmu_map(struct kgsl_pagetable *pagetable,
 	KGSL_MEM_VDBG("enter (pt=%p, physaddr=%08x, range=%08d, gpuaddr=%p)\n",
 		      pagetable, address, range, gpuaddr);
 
-#ifdef CONFIG_CACHE_L2X0
-        l2x0_cache_flush_all();
-#endif
 	mmu = pagetable->mmu;
 
 	BUG_ON(mmu == NULL);
@@ -542,9 +560,12 @@ int kgsl_mmu_map(struct kgsl_pagetable *pagetable,
 			physaddr <<= PAGE_SHIFT;
 		}
 
-		if (physaddr)
+		if (physaddr) {
+			/* only the pages being mapped need to leave the
+			 * outer cache, not all of it */
+			outer_flush_range(physaddr, physaddr + KGSL_PAGESIZE);
 			kgsl_pt_map_set(pagetable, pte, physaddr | protflags);
-		else {
+		} else {
 			KGSL_MEM_ERR
 			("Unable to find physaddr for vmallloc address: %x\n",
 			     address);
@@ -572,9 +593,10 @@ int kgsl_mmu_map(struct kgsl_pagetable *pagetable,
 	dmb();
 
 	/* Invalidate tlb only if current page table used by GPU is the
-	 * pagetable that we used to allocate */
+	 * pagetable that we used to allocate, and only before the next
+	 * submission */
 	if (pagetable == mmu->hwpagetable)
-		kgsl_yamato_setstate(mmu->device, KGSL_MMUFLAGS_TLBFLUSH);
+		mmu->tlb_dirty = 1;
 
 
 	KGSL_MEM_VDBG("return %d\n", 0);
@@ -615,10 +637,10 @@ kgsl_mmu_unmap(struct kgsl_pagetable *pagetable, unsigned int gpuaddr,
 	dmb();
 
 	/* Invalidate tlb only if current page table used by GPU is the
-	 * pagetable that we used to allocate */
+	 * pagetable that we used to allocate, and only before the next
+	 * submission */
 	if (pagetable == pagetable->mmu->hwpagetable)
-		kgsl_yamato_setstate(pagetable->mmu->device,
-					KGSL_MMUFLAGS_TLBFLUSH);
+		pagetable->mmu->tlb_dirty = 1;
 
 	gen_pool_free(pagetable->pool, gpuaddr, range);
 
@@ -81,6 +81,8 @@ struct kgsl_mmu {
 	/* current page table object being used by device mmu */
 	struct kgsl_pagetable  *defaultpagetable;
 	struct kgsl_pagetable  *hwpagetable;
+	/* hwpagetable changed since the gpu tlb was last invalidated */
+	unsigned int     tlb_dirty;
 };
 
 
@@ -102,6 +104,8 @@ int kgsl_mmu_destroypagetableobject(struct kgsl_pagetable *pagetable);
 int kgsl_mmu_setstate(struct kgsl_device *device,
 			struct kgsl_pagetable *pagetable);
 
+int kgsl_mmu_flush_pending(struct kgsl_device *device);
+
 #ifdef CONFIG_MSM_KGSL_MMU
 int kgsl_mmu_map(struct kgsl_pagetable *pagetable,
 		 unsigned int address,
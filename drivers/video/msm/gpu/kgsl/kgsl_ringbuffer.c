@@ -18,6 +18,7 @@
  */
 #include <linux/firmware.h>
 #include <linux/io.h>
+#include <linux/ktime.h>
 #include <linux/sched.h>
 #include <linux/wait.h>
 
@@ -31,6 +32,10 @@
 #include "yamato_reg.h"
 
 #define GSL_RB_NOP_SIZEDWORDS				2
+/* upper bound on a single sleep for ringbuffer space; the COND_EXEC
+*  interrupt normally ends the wait much sooner
+*/
+#define GSL_RB_WAITSPACE_MSECS				10
 /* protected mode error checking below register address 0x800
 *  note: if CP_INTERRUPT packet is used then checking needs
 *  to change to below register address 0x7C8
@@ -89,7 +94,10 @@ void kgsl_cp_intrcallback(struct kgsl_device *device)
 
 	if (status & (CP_INT_CNTL__IB1_INT_MASK | CP_INT_CNTL__RB_INT_MASK)) {
 		KGSL_CMD_WARN("ringbuffer ib1/rb interrupt\n");
-		wake_up_interruptible_all(&device->ib1_wq);
+		/* waitspace sleeps uninterruptibly on the same queue */
+		wake_up_all(&device->ib1_wq);
+		if (!list_empty(&device->events))
+			schedule_work(&kgsl_driver.event_work);
 	}
 	if (status & CP_INT_CNTL__T0_PACKET_IN_IB_MASK) {
 		KGSL_CMD_FATAL("ringbuffer TO packet in IB interrupt\n");
@@ -192,17 +200,75 @@ static void kgsl_ringbuffer_submit(struct kgsl_ringbuffer *rb)
 	mb();
 
 	kgsl_yamato_regwrite(rb->device, REG_CP_RB_WPTR, rb->wptr);
+	rb->submitted_wptr = rb->wptr;
+	GSL_RB_STATS(rb->stats.wptr_writes++);
 
 	rb->flags |= KGSL_FLAGS_ACTIVE;
 }
 
+void kgsl_ringbuffer_batch_begin(struct kgsl_ringbuffer *rb)
+{
+	rb->batch++;
+}
+
+void kgsl_ringbuffer_batch_end(struct kgsl_ringbuffer *rb)
+{
+	BUG_ON(rb->batch == 0);
+
+	if (--rb->batch == 0)
+		kgsl_ringbuffer_flush(rb);
+}
+
+/* hand anything held back by an open batch to the cp */
+void kgsl_ringbuffer_flush(struct kgsl_ringbuffer *rb)
+{
+	if (rb->wptr != rb->submitted_wptr)
+		kgsl_ringbuffer_submit(rb);
+}
+
+static int kgsl_ringbuffer_hasspace(struct kgsl_ringbuffer *rb,
+				    unsigned int numcmds)
+{
+	unsigned int freecmds;
+
+	GSL_RB_GET_READPTR(rb, &rb->rptr);
+
+	freecmds = rb->rptr - rb->wptr;
+
+	return (freecmds == 0) || (freecmds >= numcmds);
+}
+
+/* pick the oldest outstanding submission whose retirement moves rptr
+*  far enough ahead of wptr, falling back to the last one issued
+*/
+static uint32_t kgsl_ringbuffer_waitts(struct kgsl_ringbuffer *rb,
+				       unsigned int numcmds)
+{
+	struct kgsl_rb_tsrecord *rec;
+	unsigned int best = rb->sizedwords;
+	uint32_t timestamp = rb->timestamp;
+	int i;
+
+	for (i = 0; i < GSL_RB_TS_HISTORY; i++) {
+		rec = &rb->tshistory[i];
+		if (rec->wptr < rb->wptr + numcmds || rec->wptr >= best)
+			continue;
+		if (kgsl_cmdstream_check_timestamp(rb->device, rec->timestamp))
+			continue;
+		best = rec->wptr;
+		timestamp = rec->timestamp;
+	}
+
+	return timestamp;
+}
+
 static int
 kgsl_ringbuffer_waitspace(struct kgsl_ringbuffer *rb, unsigned int numcmds,
 			  int wptr_ahead)
 {
 	int nopcount;
-	unsigned int freecmds;
 	unsigned int *cmds;
+	ktime_t start;
 
 	KGSL_CMD_VDBG("enter (rb=%p, numcmds=%d, wptr_ahead=%d)\n",
 		      rb, numcmds, wptr_ahead);
@@ -219,15 +285,29 @@ kgsl_ringbuffer_waitspace(struct kgsl_ringbuffer *rb, unsigned int numcmds,
 		kgsl_ringbuffer_submit(rb);
 
 		rb->wptr = 0;
+		rb->submitted_wptr = 0;
+	} else {
+		/* the gpu can't free space for commands it hasn't seen */
+		kgsl_ringbuffer_flush(rb);
 	}
 
-	/* wait for space in ringbuffer */
-	do {
-		GSL_RB_GET_READPTR(rb, &rb->rptr);
+	if (kgsl_ringbuffer_hasspace(rb, numcmds))
+		goto done;
 
-		freecmds = rb->rptr - rb->wptr;
+	/* sleep until the cp interrupts on a retired timestamp */
+	GSL_RB_STATS(rb->stats.waitspace++);
+	start = ktime_get();
+	do {
+		kgsl_cmdstream_arm_irq(rb->device,
+			kgsl_ringbuffer_waitts(rb, numcmds));
+		wait_event_timeout(rb->device->ib1_wq,
+			kgsl_ringbuffer_hasspace(rb, numcmds),
+			msecs_to_jiffies(GSL_RB_WAITSPACE_MSECS));
+	} while (!kgsl_ringbuffer_hasspace(rb, numcmds));
+	GSL_RB_STATS(rb->stats.waitspace_us +=
+		     ktime_to_us(ktime_sub(ktime_get(), start)));
 
-	} while ((freecmds != 0) && (freecmds < numcmds));
+done:
 
 	KGSL_CMD_VDBG("return %d\n", 0);
 
@@ -243,6 +323,8 @@ static unsigned int *kgsl_ringbuffer_allocspace(struct kgsl_ringbuffer *rb,
 
 	BUG_ON(numcmds >= rb->sizedwords);
 
+	GSL_RB_GET_READPTR(rb, &rb->rptr);
+
 	/* check for available space */
 	if (rb->wptr >= rb->rptr) {
 		/* wptr ahead or equal to rptr */
@@ -266,6 +348,16 @@ static unsigned int *kgsl_ringbuffer_allocspace(struct kgsl_ringbuffer *rb,
 		rb->wptr += numcmds;
 	}
 
+#ifdef GSL_STATS_RINGBUFFER
+	{
+		unsigned int used = rb->wptr >= rb->rptr ?
+			rb->wptr - rb->rptr :
+			rb->sizedwords - rb->rptr + rb->wptr;
+		if (used > rb->stats.max_occupancy)
+			rb->stats.max_occupancy = used;
+	}
+#endif
+
 	return ptr;
 }
 
@@ -418,12 +510,14 @@ static int kgsl_ringbuffer_start(struct kgsl_ringbuffer *rb)
 
 	rb->rptr = 0;
 	rb->wptr = 0;
+	rb->submitted_wptr = 0;
+	rb->batch = 0;
+	memset(rb->tshistory, 0, sizeof(rb->tshistory));
+	rb->tshead = 0;
 
 	rb->timestamp = 0;
 	GSL_RB_INIT_TIMESTAMP(rb);
 
-	INIT_LIST_HEAD(&rb->memqueue);
-
 	/* clear ME_HALT to start micro engine */
 	kgsl_yamato_regwrite(device, REG_CP_ME_CNTL, 0);
 
@@ -572,7 +666,7 @@ int kgsl_ringbuffer_close(struct kgsl_ringbuffer *rb)
 {
 	KGSL_CMD_VDBG("enter (rb=%p)\n", rb);
 
-	kgsl_cmdstream_memqueue_drain(rb->device);
+	kgsl_cmdstream_process_events(rb->device);
 
 	kgsl_ringbuffer_stop(rb);
 
@@ -654,9 +748,14 @@ kgsl_ringbuffer_addcmds(struct kgsl_ringbuffer *rb,
 		*ringcmds++ = 2;
 		*ringcmds++ = pm4_type3_packet(PM4_INTERRUPT, 1);
 		*ringcmds++ = CP_INT_CNTL__RB_INT_MASK;
+
+		rb->tshistory[rb->tshead].wptr = rb->wptr;
+		rb->tshistory[rb->tshead].timestamp = timestamp;
+		rb->tshead = (rb->tshead + 1) % GSL_RB_TS_HISTORY;
 	}
 
-	kgsl_ringbuffer_submit(rb);
+	if (!rb->batch)
+		kgsl_ringbuffer_submit(rb);
 
 	GSL_RB_STATS(rb->stats.words_total += sizedwords);
 	GSL_RB_STATS(rb->stats.issues++);
@@ -679,6 +778,7 @@ kgsl_ringbuffer_issuecmds(struct kgsl_device *device,
 	KGSL_CMD_VDBG("enter (device->id=%d, flags=%d, cmds=%p, "
 		"sizedwords=%d)\n", device->id, flags, cmds, sizedwords);
 
+	kgsl_mmu_flush_pending(device);
 	timestamp = kgsl_ringbuffer_addcmds(rb, flags, cmds, sizedwords);
 
 	KGSL_CMD_VDBG("return %d\n)", timestamp);
@@ -693,33 +793,61 @@ kgsl_ringbuffer_issueibcmds(struct kgsl_device *device,
 				uint32_t *timestamp,
 				unsigned int flags)
 {
-	unsigned int link[3];
+	unsigned int size = sizedwords;
+
+	return kgsl_ringbuffer_issueiblist(device, drawctxt_index, &ibaddr,
+					   &size, 1, timestamp, flags);
+}
+
+/* several ibs chained from one set of ring commands, they share the
+ * context switch and the timestamp */
+int
+kgsl_ringbuffer_issueiblist(struct kgsl_device *device,
+				int drawctxt_index,
+				const uint32_t *ibaddr,
+				const unsigned int *sizedwords,
+				int count,
+				uint32_t *timestamp,
+				unsigned int flags)
+{
+	unsigned int link[3 * KGSL_IB_SUBMIT_MAX];
+	int i;
 
 	KGSL_CMD_VDBG("enter (device_id=%d, drawctxt_index=%d, ibaddr=0x%08x,"
-			" sizedwords=%d, timestamp=%p)\n",
-			device->id, drawctxt_index, ibaddr,
-			sizedwords, timestamp);
+			" count=%d, timestamp=%p)\n",
+			device->id, drawctxt_index, ibaddr[0],
+			count, timestamp);
 
 	if (!(device->ringbuffer.flags & KGSL_FLAGS_STARTED)) {
 		KGSL_CMD_VDBG("return %d\n", -EINVAL);
 		return -EINVAL;
 	}
 
-	BUG_ON(ibaddr == 0);
-	BUG_ON(sizedwords == 0);
+	BUG_ON(count <= 0 || count > KGSL_IB_SUBMIT_MAX);
+
+	for (i = 0; i < count; i++) {
+		BUG_ON(ibaddr[i] == 0);
+		BUG_ON(sizedwords[i] == 0);
+
+		link[3 * i] = PM4_HDR_INDIRECT_BUFFER_PFD;
+		link[3 * i + 1] = ibaddr[i];
+		link[3 * i + 2] = sizedwords[i];
+	}
 
-	link[0] = PM4_HDR_INDIRECT_BUFFER_PFD;
-	link[1] = ibaddr;
-	link[2] = sizedwords;
+	/* context switch, tlb flush and the ibs go out with one wptr write */
+	kgsl_ringbuffer_batch_begin(&device->ringbuffer);
 
+	kgsl_mmu_flush_pending(device);
 	kgsl_drawctxt_switch(device, &device->drawctxt[drawctxt_index], flags);
 
 	*timestamp = kgsl_ringbuffer_addcmds(&device->ringbuffer,
-					0, &link[0], 3);
+					0, &link[0], 3 * count);
 
+	kgsl_ringbuffer_batch_end(&device->ringbuffer);
 
-	KGSL_CMD_INFO("ctxt %d g %08x sd %d ts %d\n",
-			drawctxt_index, ibaddr, sizedwords, *timestamp);
+	KGSL_CMD_INFO("ctxt %d g %08x sd %d n %d ts %d\n",
+			drawctxt_index, ibaddr[0], sizedwords[0], count,
+			*timestamp);
 
 	KGSL_CMD_VDBG("return %d\n", 0);
 
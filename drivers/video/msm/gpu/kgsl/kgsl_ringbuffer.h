@@ -137,6 +137,18 @@ struct kgsl_rbmemptrs {
 struct kgsl_rbstats {
 	int64_t issues;
 	int64_t words_total;
+	int64_t wptr_writes;	/* REG_CP_RB_WPTR updates */
+	int64_t waitspace;	/* allocations that found the ring full */
+	int64_t waitspace_us;	/* time spent waiting for ring space */
+	unsigned int max_occupancy;	/* peak dwords in flight */
+};
+
+/* recent submissions that end in a COND_EXEC interrupt, used to pick
+ * the timestamp to wait on when the ringbuffer is full */
+#define GSL_RB_TS_HISTORY	32
+struct kgsl_rb_tsrecord {
+	unsigned int wptr;	/* end of the submission */
+	uint32_t timestamp;
 };
 
 
@@ -157,8 +169,11 @@ struct kgsl_ringbuffer {
 	unsigned int rptr; /* read pointer offset in dwords from baseaddr */
 	uint32_t timestamp;
 
-	/* queue of memfrees pending timestamp elapse */
-	struct list_head memqueue;
+	/* batch nesting; REG_CP_RB_WPTR is written when it drops to 0 */
+	unsigned int batch;
+	unsigned int submitted_wptr;
+	struct kgsl_rb_tsrecord tshistory[GSL_RB_TS_HISTORY];
+	unsigned int tshead;
 
 	struct kgsl_rbwatchdog watchdog;
 
@@ -234,6 +249,11 @@ int kgsl_ringbuffer_issueibcmds(struct kgsl_device *, int drawctxt_index,
 				uint32_t *timestamp,
 				unsigned int flags);
 
+int kgsl_ringbuffer_issueiblist(struct kgsl_device *, int drawctxt_index,
+				const uint32_t *ibaddr,
+				const unsigned int *sizedwords, int count,
+				uint32_t *timestamp, unsigned int flags);
+
 int kgsl_ringbuffer_init(struct kgsl_device *device);
 
 int kgsl_ringbuffer_close(struct kgsl_ringbuffer *rb);
@@ -249,6 +269,12 @@ int kgsl_ringbuffer_gettimestampshadow(struct kgsl_device *device,
 
 void kgsl_ringbuffer_watchdog(void);
 
+void kgsl_ringbuffer_batch_begin(struct kgsl_ringbuffer *rb);
+
+void kgsl_ringbuffer_batch_end(struct kgsl_ringbuffer *rb);
+
+void kgsl_ringbuffer_flush(struct kgsl_ringbuffer *rb);
+
 void kgsl_cp_intrcallback(struct kgsl_device *device);
 
 #endif  /* __GSL_RINGBUFFER_H */
@@ -17,6 +17,7 @@
  * along with this program; if not, you can find it at http://www.fsf.org
  */
 #include <linux/delay.h>
+#include <linux/completion.h>
 #include <linux/uaccess.h>
 #include <linux/io.h>
 #include <linux/irq.h>
@@ -473,6 +474,7 @@ int kgsl_yamato_init(struct kgsl_device *device, struct kgsl_devconfig *config)
 	memset(device, 0, sizeof(*device));
 
 	init_waitqueue_head(&device->ib1_wq);
+	INIT_LIST_HEAD(&device->events);
 
 	memcpy(regspace, &config->regspace, sizeof(device->regspace));
 	if (regspace->mmio_phys_base == 0 || regspace->sizebytes == 0) {
@@ -812,6 +814,7 @@ int kgsl_yamato_idle(struct kgsl_device *device, unsigned int timeout)
 	 * the ring buffer
 	 */
 	if (rb->flags & KGSL_FLAGS_STARTED) {
+		kgsl_ringbuffer_flush(rb);
 		do {
 			idle_count++;
 			GSL_RB_GET_READPTR(rb, &rb->rptr);
@@ -877,26 +880,10 @@ int kgsl_yamato_regwrite(struct kgsl_device *device, unsigned int offsetwords,
 	return 0;
 }
 
-static inline int _wait_timestamp(struct kgsl_device *device,
-				unsigned int timestamp,
-				unsigned int msecs)
+static void kgsl_yamato_ts_retired(struct kgsl_device *device, void *priv,
+				   uint32_t timestamp)
 {
-	long status;
-
-	status = wait_event_interruptible_timeout(device->ib1_wq,
-			kgsl_cmdstream_check_timestamp(device, timestamp),
-			msecs_to_jiffies(msecs));
-
-	if (status > 0)
-		status = 0;
-	else if (status == 0) {
-		if (!kgsl_cmdstream_check_timestamp(device, timestamp)) {
-			status = -ETIMEDOUT;
-			kgsl_register_dump(device);
-		}
-	}
-
-	return (int)status;
+	complete(priv);
 }
 
 /* MUST be called with the kgsl_driver.mutex held */
@@ -905,33 +892,40 @@ int kgsl_yamato_waittimestamp(struct kgsl_device *device,
 				unsigned int msecs)
 {
 	long status = 0;
-	uint32_t ref_ts;
-	int enableflag = 1;
 	unsigned int cmd[2];
+	struct kgsl_event event;
+	DECLARE_COMPLETION_ONSTACK(retired);
 
 	KGSL_DRV_INFO("enter (device=%p,timestamp=%d,timeout=0x%08x)\n",
 			device, timestamp, msecs);
 
 	if (!kgsl_cmdstream_check_timestamp(device, timestamp)) {
-		kgsl_sharedmem_read(&device->memstore, &ref_ts,
-			KGSL_DEVICE_MEMSTORE_OFFSET(ref_wait_ts), 4);
-		if (timestamp_cmp(ref_ts, timestamp)) {
-			kgsl_sharedmem_write(&device->memstore,
-				KGSL_DEVICE_MEMSTORE_OFFSET(ref_wait_ts),
-				&timestamp, 4);
-		}
+		kgsl_cmdstream_add_event(device, &event, timestamp,
+					 kgsl_yamato_ts_retired, &retired);
 
+		/* the COND_EXEC for timestamp may already be behind the
+		 * cp, make sure at least one more interrupt comes */
 		cmd[0] = pm4_type3_packet(PM4_INTERRUPT, 1);
 		cmd[1] = CP_INT_CNTL__IB1_INT_MASK;
 		kgsl_ringbuffer_issuecmds(device, KGSL_CMD_FLAGS_NO_TS_CMP,
 					  cmd, 2);
-		kgsl_sharedmem_write(&device->memstore,
-			KGSL_DEVICE_MEMSTORE_OFFSET(ts_cmp_enable),
-			&enableflag, 4);
 
 		mutex_unlock(&kgsl_driver.mutex);
-		status = _wait_timestamp(device, timestamp, msecs);
+		status = wait_for_completion_interruptible_timeout(&retired,
+					msecs_to_jiffies(msecs));
 		mutex_lock(&kgsl_driver.mutex);
+
+		kgsl_cmdstream_cancel_event(&event);
+
+		if (status > 0)
+			status = 0;
+		else if (status == 0) {
+			if (!kgsl_cmdstream_check_timestamp(device,
+							    timestamp)) {
+				status = -ETIMEDOUT;
+				kgsl_register_dump(device);
+			}
+		}
 	}
 
 	KGSL_DRV_INFO("return %ld\n", status);
@@ -941,7 +935,7 @@ int kgsl_yamato_waittimestamp(struct kgsl_device *device,
 int kgsl_yamato_runpending(struct kgsl_device *device)
 {
 	if (device->flags & KGSL_FLAGS_INITIALIZED)
-		kgsl_cmdstream_memqueue_drain(device);
+		kgsl_cmdstream_process_events(device);
 	return 0;
 }
 
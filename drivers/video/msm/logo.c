@@ -37,62 +37,75 @@ static void memset16(void *_ptr, unsigned short val, unsigned count)
 }
 
 /* 565RLE image format: [count(2 bytes), rle(2 bytes)] */
-int load_565rle_image(char *filename)
+void draw_565rle(unsigned short *bits, unsigned max,
+		 const unsigned short *ptr, unsigned count)
 {
-	struct fb_info *info;
-	int fd, err = 0;
-	unsigned count, max;
-	unsigned short *data, *bits, *ptr;
-
-	info = registered_fb[0];
-	if (!info) {
-		printk(KERN_WARNING "%s: Can not access framebuffer\n",
-			__func__);
-		return -ENODEV;
+	while (count > 3) {
+		unsigned n = ptr[0];
+		if (n > max)
+			break;
+		memset16(bits, ptr[1], n << 1);
+		bits += n;
+		max -= n;
+		ptr += 2;
+		count -= 4;
 	}
+}
+
+/* Reads a whole 565rle file, the caller kfree()s the data */
+unsigned short *read_565rle_file(char *filename, unsigned *size)
+{
+	int fd;
+	unsigned count;
+	unsigned short *data = NULL;
 
 	fd = sys_open(filename, O_RDONLY, 0);
-	if (fd < 0) {
-		printk(KERN_WARNING "%s: Can not open %s\n",
-			__func__, filename);
-		return -ENOENT;
-	}
+	if (fd < 0)
+		return NULL;
 	count = (unsigned)sys_lseek(fd, (off_t)0, 2);
-	if (count == 0) {
-		sys_close(fd);
-		err = -EIO;
+	if (count == 0)
 		goto err_logo_close_file;
-	}
 	sys_lseek(fd, (off_t)0, 0);
 	data = kmalloc(count, GFP_KERNEL);
 	if (!data) {
 		printk(KERN_WARNING "%s: Can not alloc data\n", __func__);
-		err = -ENOMEM;
 		goto err_logo_close_file;
 	}
 	if ((unsigned)sys_read(fd, (char *)data, count) != count) {
-		err = -EIO;
-		goto err_logo_free_data;
+		kfree(data);
+		data = NULL;
+		goto err_logo_close_file;
 	}
+	*size = count;
 
-	max = fb_width(info) * fb_height(info);
-	ptr = data;
-	bits = (unsigned short *)(info->screen_base);
-	while (count > 3) {
-		unsigned n = ptr[0];
-		if (n > max)
-			break;
-		memset16(bits, ptr[1], n << 1);
-		bits += n;
-		max -= n;
-		ptr += 2;
-		count -= 4;
+err_logo_close_file:
+	sys_close(fd);
+	return data;
+}
+
+int load_565rle_image(char *filename)
+{
+	struct fb_info *info;
+	unsigned count;
+	unsigned short *data;
+
+	info = registered_fb[0];
+	if (!info) {
+		printk(KERN_WARNING "%s: Can not access framebuffer\n",
+			__func__);
+		return -ENODEV;
 	}
 
-err_logo_free_data:
+	data = read_565rle_file(filename, &count);
+	if (!data) {
+		printk(KERN_WARNING "%s: Can not read %s\n",
+			__func__, filename);
+		return -ENOENT;
+	}
+
+	draw_565rle((unsigned short *)(info->screen_base),
+		    fb_width(info) * fb_height(info), data, count);
 	kfree(data);
-err_logo_close_file:
-	sys_close(fd);
-	return err;
+	return 0;
 }
 EXPORT_SYMBOL(load_565rle_image);
@@ -75,6 +75,9 @@ struct mddi_info {
 	dma_addr_t reg_write_addr;
 	struct mddi_llentry *reg_read_data;
 	dma_addr_t reg_read_addr;
+	/* rest of the page, for chained register writes */
+	struct mddi_llentry *reg_batch_data;
+	dma_addr_t reg_batch_addr;
 	size_t rev_data_curr;
 
 	spinlock_t int_lock;
@@ -611,6 +614,64 @@ void mddi_remote_write(struct msm_mddi_client_data *cdata, uint32_t val,
 	mutex_unlock(&mddi->reg_write_lock);
 }
 
+#define MDDI_REG_BATCH_MAX ((0x1000 - MDDI_REV_BUFFER_SIZE) / \
+			    sizeof(struct mddi_llentry) - 2)
+
+/* Chain up to MDDI_REG_BATCH_MAX register access packets into one link
+ * list, so a panel init sequence costs one link list done interrupt per
+ * chunk instead of one per register.
+ */
+void mddi_remote_write_batch(struct msm_mddi_client_data *cdata,
+			     const struct msm_mddi_reg_write *writes,
+			     unsigned int count)
+{
+	struct mddi_info *mddi = container_of(cdata, struct mddi_info,
+					      client_data);
+	struct mddi_llentry *ll;
+	struct mddi_register_access *ra;
+	dma_addr_t addr;
+	unsigned int i, n;
+
+	mutex_lock(&mddi->reg_write_lock);
+	while (count) {
+		n = min_t(unsigned int, count, MDDI_REG_BATCH_MAX);
+		for (i = 0; i < n; i++) {
+			ll = mddi->reg_batch_data + i;
+			addr = mddi->reg_batch_addr + i * sizeof(*ll);
+
+			ra = &(ll->u.r);
+			ra->length = 14 + 4;
+			ra->type = TYPE_REGISTER_ACCESS;
+			ra->client_id = 0;
+			ra->read_write_info = MDDI_WRITE | 1;
+			ra->crc16 = 0;
+
+			ra->register_address = writes[i].reg;
+			ra->register_data_list = writes[i].val;
+
+			ll->flags = 1;
+			ll->header_count = 14;
+			ll->data_count = 4;
+			ll->data = addr + offsetof(struct mddi_llentry,
+						   u.r.register_data_list);
+			/* the hardware follows physical addresses */
+			if (i == n - 1)
+				ll->next = 0;
+			else
+				ll->next = (struct mddi_llentry *)
+					   (addr + sizeof(*ll));
+			ll->reserved = 0;
+		}
+
+		mddi_writel(mddi->reg_batch_addr, PRI_PTR);
+		mddi_wait_interrupt(mddi, MDDI_INT_PRI_LINK_LIST_DONE);
+
+		writes += n;
+		count -= n;
+	}
+	mutex_unlock(&mddi->reg_write_lock);
+}
+
 uint32_t mddi_remote_read(struct msm_mddi_client_data *cdata, uint32_t reg)
 {
 	struct mddi_info *mddi = container_of(cdata, struct mddi_info,
@@ -748,6 +809,9 @@ static int __init mddi_rev_data_setup(struct mddi_info *mddi)
 	mddi->reg_read_data = mddi->reg_write_data + 1;
 	mddi->reg_read_addr = mddi->reg_write_addr +
 			      sizeof(*mddi->reg_write_data);
+	mddi->reg_batch_data = mddi->reg_read_data + 1;
+	mddi->reg_batch_addr = mddi->reg_read_addr +
+			       sizeof(*mddi->reg_read_data);
 	return 0;
 }
 
@@ -865,6 +929,7 @@ static int __init mddi_probe(struct platform_device *pdev)
 	mddi->client_data.resume = mddi_resume;
 	mddi->client_data.activate_link = mddi_activate_link;
 	mddi->client_data.remote_write = mddi_remote_write;
+	mddi->client_data.remote_write_batch = mddi_remote_write_batch;
 	mddi->client_data.remote_read = mddi_remote_read;
 	mddi->client_data.auto_hibernate = mddi_set_auto_hibernate;
 	mddi->client_data.fb_resource = pdata->fb_resource;
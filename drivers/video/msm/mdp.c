@@ -25,6 +25,10 @@
 #include <linux/android_pmem.h>
 #include <linux/major.h>
 #include <linux/msm_hw3d.h>
+#include <linux/slab.h>
+#include <linux/input.h>
+#include <linux/workqueue.h>
+#include <linux/moduleparam.h>
 
 #include <mach/msm_iomap.h>
 #include <mach/msm_fb.h>
@@ -127,6 +131,39 @@ int disable_mdp_irq(struct mdp_info *mdp, uint32_t mask)
 	return ret;
 }
 
+struct mdp_ppp_job {
+	struct list_head list;
+	struct mdp_blit_req req;
+	struct ppp_regs regs;
+	struct file *src_file;
+	struct file *dst_file;
+	uint32_t timestamp;
+};
+
+static inline int blit_timestamp_passed(uint32_t ts, uint32_t ref)
+{
+	return (int)(ts - ref) >= 0;
+}
+
+/* call with mdp->lock held, retires the running blit and starts the next
+ * one, returns 1 if the ppp is busy again */
+static int mdp_ppp_queue_next(struct mdp_info *mdp)
+{
+	struct mdp_ppp_job *job;
+
+	job = list_first_entry(&mdp->ppp_queue, struct mdp_ppp_job, list);
+	list_move_tail(&job->list, &mdp->ppp_done);
+	mdp->blit_retired = job->timestamp;
+	schedule_work(&mdp->ppp_reap_work);
+	wake_up_all(&mdp->ppp_queue_wq);
+
+	if (list_empty(&mdp->ppp_queue))
+		return 0;
+	job = list_first_entry(&mdp->ppp_queue, struct mdp_ppp_job, list);
+	mdp_ppp_blit_start(mdp, &job->req, &job->regs);
+	return 1;
+}
+
 static irqreturn_t mdp_isr(int irq, void *data)
 {
 	uint32_t status;
@@ -151,11 +188,17 @@ static irqreturn_t mdp_isr(int irq, void *data)
 	for (i = 0; i < MSM_MDP_NUM_INTERFACES; ++i) {
 		struct mdp_out_interface *out_if = &mdp->out_if[i];
 		if (status & out_if->dma_mask) {
-			if (out_if->dma_cb) {
-				out_if->dma_cb->func(out_if->dma_cb);
-				out_if->dma_cb = NULL;
-			}
-			wake_up(&out_if->dma_waitqueue);
+			struct msmfb_callback *dma_cb = out_if->dma_cb;
+
+			out_if->dma_cb = NULL;
+			if (dma_cb)
+				dma_cb->func(dma_cb);
+			/* the callback chained another dma, leave the
+			 * interrupt on for it */
+			if (out_if->dma_cb)
+				status &= ~out_if->dma_mask;
+			else
+				wake_up(&out_if->dma_waitqueue);
 		}
 		if (status & out_if->irq_mask) {
 			out_if->irq_cb->func(out_if->irq_cb);
@@ -163,7 +206,11 @@ static irqreturn_t mdp_isr(int irq, void *data)
 		}
 	}
 
-	if (status & DL0_ROI_DONE)
+	if ((status & DL0_ROI_DONE) && !list_empty(&mdp->ppp_queue)) {
+		/* chain the next queued blit while the ppp is still hot */
+		if (mdp_ppp_queue_next(mdp))
+			status &= ~DL0_ROI_DONE;
+	} else if (status & DL0_ROI_DONE)
 		wake_up(&mdp_ppp_waitqueue);
 
 	if (status)
@@ -427,6 +474,20 @@ done:
 	spin_unlock_irqrestore(&mdp->lock, flags);
 }
 
+/* called from the dma callback in mdp_isr, mdp->lock is held and the
+ * interface dma interrupt is still enabled */
+static void mdp_dma_chain(struct mdp_device *mdp_dev, uint32_t addr,
+			  uint32_t stride, uint32_t width, uint32_t height,
+			  uint32_t x, uint32_t y,
+			  struct msmfb_callback *callback, int interface)
+{
+	struct mdp_info *mdp = container_of(mdp_dev, struct mdp_info, mdp_dev);
+	struct mdp_out_interface *out_if = &mdp->out_if[interface];
+
+	out_if->dma_cb = callback;
+	out_if->dma_start(out_if->priv, addr, stride, width, height, x, y);
+}
+
 static int get_img(struct mdp_img *img, struct fb_info *info,
 		   unsigned long *start, unsigned long *len,
 		   struct file** filep)
@@ -587,14 +648,8 @@ int mdp_blit_and_wait(struct mdp_info *mdp, struct mdp_blit_req *req,
 	return 0;
 }
 
-int mdp_blit(struct mdp_device *mdp_dev, struct fb_info *fb,
-	     struct mdp_blit_req *req)
+static int mdp_blit_check(struct mdp_blit_req *req)
 {
-	int ret;
-	unsigned long src_start = 0, src_len = 0, dst_start = 0, dst_len = 0;
-	struct mdp_info *mdp = container_of(mdp_dev, struct mdp_info, mdp_dev);
-	struct file *src_file = 0, *dst_file = 0;
-
 #if defined(CONFIG_MSM_MDP31) || defined(CONFIG_MSM_MDP302)
 	if (req->flags & MDP_ROT_90) {
 		if (unlikely(((req->dst_rect.h == 1) &&
@@ -626,22 +681,38 @@ int mdp_blit(struct mdp_device *mdp_dev, struct fb_info *fb,
 	if (unlikely(req->dst_rect.h == 0 ||
 		     req->dst_rect.w == 0))
 		return -EINVAL;
+	return 0;
+}
 
-	/* do this first so that if this fails, the caller can always
-	 * safely call put_img */
-	if (unlikely(get_img(&req->src, fb, &src_start, &src_len, &src_file))) {
-		printk(KERN_ERR "mdp_ppp: could not retrieve src image from "
-				"memory\n");
-		return -EINVAL;
-	}
+/* true if the blit is cut into several ppp operations to dodge hardware
+ * bugs, these run back to back from mdp_blit_locked */
+static int mdp_blit_needs_split(struct mdp_blit_req *req)
+{
+#if !defined(CONFIG_MSM_MDP31) && !defined(CONFIG_MSM_MDP302)
+	return (req->transp_mask != MDP_TRANSP_NOP ||
+		req->alpha != MDP_ALPHA_NOP ||
+		HAS_ALPHA(req->src.format)) &&
+		(req->flags & MDP_ROT_90 &&
+		 req->dst_rect.w <= 16 && req->dst_rect.h >= 16);
+#else
+	if ((mdp_get_bytes_per_pixel(req->dst.format) == 4) &&
+	    (req->dst_rect.w != 1) &&
+	    (((req->dst_rect.w % 8) == 6) ||
+	     ((req->dst_rect.w % 32) == 3) ||
+	     ((req->dst_rect.w % 32) == 1)))
+		return 1;
+	return (req->dst_rect.w != 1) && (req->dst_rect.h != 1) &&
+		((req->dst_rect.h % 32) == 3 ||
+		 (req->dst_rect.h % 32) == 1);
+#endif
+}
 
-	if (unlikely(get_img(&req->dst, fb, &dst_start, &dst_len, &dst_file))) {
-		printk(KERN_ERR "mdp_ppp: could not retrieve dst image from "
-				"memory\n");
-		put_img(src_file);
-		return -EINVAL;
-	}
-	mutex_lock(&mdp_mutex);
+/* call with mdp_mutex held */
+static int mdp_blit_locked(struct mdp_info *mdp, struct mdp_blit_req *req,
+	struct file *src_file, unsigned long src_start, unsigned long src_len,
+	struct file *dst_file, unsigned long dst_start, unsigned long dst_len)
+{
+	int ret;
 
 	timeout_req = req;
 	/* transp_masking unimplemented */
@@ -696,12 +767,426 @@ int mdp_blit(struct mdp_device *mdp_dev, struct fb_info *fb,
 				src_file, src_start, src_len,
 				dst_file, dst_start, dst_len);
 end:
+	return ret;
+}
+
+static int mdp_ppp_queue_idle(struct mdp_info *mdp)
+{
+	unsigned long irq_flags;
+	int ret;
+
+	spin_lock_irqsave(&mdp->lock, irq_flags);
+	ret = list_empty(&mdp->ppp_queue);
+	spin_unlock_irqrestore(&mdp->lock, irq_flags);
+	return ret;
+}
+
+/* call with mdp_mutex held, waits for the queued blits to finish so the
+ * ppp can be driven synchronously again */
+static void mdp_ppp_drain(struct mdp_info *mdp)
+{
+	unsigned long irq_flags;
+
+	if (wait_event_timeout(mdp->ppp_queue_wq, mdp_ppp_queue_idle(mdp), HZ))
+		return;
+
+	spin_lock_irqsave(&mdp->lock, irq_flags);
+	if (!list_empty(&mdp->ppp_queue)) {
+		pr_warning("%s: timeout waiting for queued blits\n", __func__);
+		locked_disable_mdp_irq(mdp, DL0_ROI_DONE);
+		list_splice_tail_init(&mdp->ppp_queue, &mdp->ppp_done);
+		mdp->blit_retired = mdp->blit_timestamp;
+		schedule_work(&mdp->ppp_reap_work);
+		wake_up_all(&mdp->ppp_queue_wq);
+	}
+	spin_unlock_irqrestore(&mdp->lock, irq_flags);
+}
+
+/* putting the images can sleep so it is done here rather than in the isr */
+static void mdp_ppp_reap(struct work_struct *work)
+{
+	struct mdp_info *mdp = container_of(work, struct mdp_info,
+					    ppp_reap_work);
+	struct mdp_ppp_job *job, *tmp;
+	unsigned long irq_flags;
+	LIST_HEAD(done);
+
+	spin_lock_irqsave(&mdp->lock, irq_flags);
+	list_splice_init(&mdp->ppp_done, &done);
+	spin_unlock_irqrestore(&mdp->lock, irq_flags);
+
+	list_for_each_entry_safe(job, tmp, &done, list) {
+		put_img(job->src_file);
+		put_img(job->dst_file);
+		kfree(job);
+	}
+}
+
+int mdp_blit(struct mdp_device *mdp_dev, struct fb_info *fb,
+	     struct mdp_blit_req *req)
+{
+	int ret;
+	unsigned long src_start = 0, src_len = 0, dst_start = 0, dst_len = 0;
+	struct mdp_info *mdp = container_of(mdp_dev, struct mdp_info, mdp_dev);
+	struct file *src_file = 0, *dst_file = 0;
+
+	ret = mdp_blit_check(req);
+	if (ret)
+		return ret;
+
+	/* do this first so that if this fails, the caller can always
+	 * safely call put_img */
+	if (unlikely(get_img(&req->src, fb, &src_start, &src_len, &src_file))) {
+		printk(KERN_ERR "mdp_ppp: could not retrieve src image from "
+				"memory\n");
+		return -EINVAL;
+	}
+
+	if (unlikely(get_img(&req->dst, fb, &dst_start, &dst_len, &dst_file))) {
+		printk(KERN_ERR "mdp_ppp: could not retrieve dst image from "
+				"memory\n");
+		put_img(src_file);
+		return -EINVAL;
+	}
+	mutex_lock(&mdp_mutex);
+	mdp_ppp_drain(mdp);
+	ret = mdp_blit_locked(mdp, req, src_file, src_start, src_len,
+			      dst_file, dst_start, dst_len);
 	put_img(src_file);
 	put_img(dst_file);
 	mutex_unlock(&mdp_mutex);
 	return ret;
 }
 
+/* large unscaled blits are cut into bands of destination rows so the top
+ * of the destination is finished, and can be sent on, while the ppp works
+ * on the rest */
+#define MDP_PPP_BAND_LINES 64
+
+static int mdp_blit_can_band(const struct mdp_blit_req *req)
+{
+	return req->dst_rect.h >= 2 * MDP_PPP_BAND_LINES &&
+		!(req->flags & MDP_ROT_90) &&
+		!IS_YCRCB(req->src.format) && !IS_YCRCB(req->dst.format);
+}
+
+/* height of the band at off, keeps the last band away from the heights
+ * the mdp 3.1 workarounds would have to split again */
+static int mdp_blit_band_height(const struct mdp_blit_req *req, int off)
+{
+	int left = req->dst_rect.h - off;
+	int h = MDP_PPP_BAND_LINES;
+	int rest = left - h;
+
+	if (left <= MDP_PPP_BAND_LINES)
+		return left;
+	if (rest < 16)
+		h = left - 16;
+	else if (rest <= MDP_PPP_BAND_LINES &&
+		 (rest % 32 == 1 || rest % 32 == 3))
+		h -= 4;
+	return h;
+}
+
+/* prepares job, or the bands it is cut into, on jobs in ppp order. the
+ * last band is job itself and keeps the image files so they are only put
+ * once the whole blit has retired */
+static int mdp_blit_prepare_bands(struct mdp_info *mdp,
+	struct mdp_ppp_job *job, struct list_head *jobs,
+	unsigned long src_start, unsigned long src_len,
+	unsigned long dst_start, unsigned long dst_len)
+{
+	struct mdp_blit_req whole = job->req;
+	struct mdp_ppp_job *band;
+	int off, h, ret;
+
+	if (!mdp_blit_can_band(&whole)) {
+		list_add_tail(&job->list, jobs);
+		return mdp_ppp_blit_prepare(mdp, &job->req, job->src_file,
+					    src_start, src_len, job->dst_file,
+					    dst_start, dst_len, &job->regs);
+	}
+
+	for (off = 0; off < whole.dst_rect.h; off += h) {
+		h = mdp_blit_band_height(&whole, off);
+		if (off + h == whole.dst_rect.h) {
+			band = job;
+		} else {
+			band = kzalloc(sizeof(*band), GFP_KERNEL);
+			if (!band)
+				return -ENOMEM;
+		}
+		band->req = whole;
+		band->req.dst_rect.y = whole.dst_rect.y + off;
+		band->req.dst_rect.h = h;
+		if (whole.flags & MDP_FLIP_UD)
+			band->req.src_rect.y = whole.src_rect.y +
+					       whole.src_rect.h - off - h;
+		else
+			band->req.src_rect.y = whole.src_rect.y + off;
+		band->req.src_rect.h = h;
+		list_add_tail(&band->list, jobs);
+
+		ret = mdp_ppp_blit_prepare(mdp, &band->req, job->src_file,
+					   src_start, src_len, job->dst_file,
+					   dst_start, dst_len, &band->regs);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* queue a blit behind the ones already on the ppp and return its
+ * timestamp without waiting. blits that load scale or blur tables, or that
+ * are split by the hardware workarounds, cannot be chained from the isr and
+ * are run synchronously once the queue has drained */
+int mdp_blit_async(struct mdp_device *mdp_dev, struct fb_info *fb,
+		   struct mdp_blit_req *req, uint32_t *timestamp)
+{
+	int ret, idle;
+	unsigned long src_start = 0, src_len = 0, dst_start = 0, dst_len = 0;
+	struct mdp_info *mdp = container_of(mdp_dev, struct mdp_info, mdp_dev);
+	struct mdp_ppp_job *job, *band, *tmp;
+	unsigned long irq_flags;
+	LIST_HEAD(jobs);
+
+	ret = mdp_blit_check(req);
+	if (ret)
+		return ret;
+
+	job = kzalloc(sizeof(*job), GFP_KERNEL);
+	if (!job)
+		return -ENOMEM;
+	job->req = *req;
+	req = &job->req;
+
+	if (unlikely(get_img(&req->src, fb, &src_start, &src_len,
+			     &job->src_file))) {
+		printk(KERN_ERR "mdp_ppp: could not retrieve src image from "
+				"memory\n");
+		kfree(job);
+		return -EINVAL;
+	}
+
+	if (unlikely(get_img(&req->dst, fb, &dst_start, &dst_len,
+			     &job->dst_file))) {
+		printk(KERN_ERR "mdp_ppp: could not retrieve dst image from "
+				"memory\n");
+		put_img(job->src_file);
+		kfree(job);
+		return -EINVAL;
+	}
+	mutex_lock(&mdp_mutex);
+
+	/* transp_masking unimplemented */
+	req->transp_mask = MDP_TRANSP_NOP;
+	if (mdp_ppp_blit_uses_tables(req) || mdp_blit_needs_split(req)) {
+		mdp_ppp_drain(mdp);
+		ret = mdp_blit_locked(mdp, req, job->src_file, src_start,
+				      src_len, job->dst_file, dst_start,
+				      dst_len);
+		spin_lock_irqsave(&mdp->lock, irq_flags);
+		mdp->blit_retired = ++mdp->blit_timestamp;
+		*timestamp = mdp->blit_retired;
+		spin_unlock_irqrestore(&mdp->lock, irq_flags);
+		wake_up_all(&mdp->ppp_queue_wq);
+		goto err_put_img;
+	}
+
+	ret = mdp_blit_prepare_bands(mdp, job, &jobs, src_start, src_len,
+				     dst_start, dst_len);
+	if (ret) {
+		list_for_each_entry_safe(band, tmp, &jobs, list)
+			if (band != job)
+				kfree(band);
+		goto err_put_img;
+	}
+
+	spin_lock_irqsave(&mdp->lock, irq_flags);
+	list_for_each_entry(band, &jobs, list)
+		band->timestamp = ++mdp->blit_timestamp;
+	*timestamp = mdp->blit_timestamp;
+	idle = list_empty(&mdp->ppp_queue);
+	list_splice_tail(&jobs, &mdp->ppp_queue);
+	if (idle) {
+		band = list_first_entry(&mdp->ppp_queue, struct mdp_ppp_job,
+					list);
+		locked_enable_mdp_irq(mdp, DL0_ROI_DONE);
+		mdp_ppp_blit_start(mdp, &band->req, &band->regs);
+	}
+	spin_unlock_irqrestore(&mdp->lock, irq_flags);
+	mutex_unlock(&mdp_mutex);
+	return 0;
+
+err_put_img:
+	put_img(job->src_file);
+	put_img(job->dst_file);
+	kfree(job);
+	mutex_unlock(&mdp_mutex);
+	return ret;
+}
+
+int mdp_blit_wait(struct mdp_device *mdp_dev, uint32_t timestamp)
+{
+	struct mdp_info *mdp = container_of(mdp_dev, struct mdp_info, mdp_dev);
+	int ret;
+
+	if (!blit_timestamp_passed(mdp->blit_timestamp, timestamp))
+		return -EINVAL;
+
+	ret = wait_event_interruptible_timeout(mdp->ppp_queue_wq,
+		blit_timestamp_passed(mdp->blit_retired, timestamp), HZ);
+	if (ret < 0)
+		return ret;
+	if (!ret) {
+		pr_warning("%s: timeout waiting for blit %u (retired %u)\n",
+			   __func__, timestamp, mdp->blit_retired);
+		return -ETIMEDOUT;
+	}
+	return 0;
+}
+
+#ifdef CONFIG_FB_MSM_PPP_OVERLAY
+/* mdp 3.1 has no overlay pipe, the ppp converts each video frame from the
+ * decoder's pmem buffer straight into the visible part of the fb */
+static int mdp_ppp_overlay_format_ok(uint32_t format)
+{
+	switch (format) {
+	case MDP_Y_CBCR_H2V2:
+	case MDP_Y_CRCB_H2V2:
+	case MDP_Y_CBCR_H2V1:
+	case MDP_Y_CRCB_H2V1:
+	case MDP_YCRYCB_H2V1:
+		return 1;
+	}
+	return 0;
+}
+
+static uint32_t mdp_ppp_overlay_fb_format(struct fb_info *fb)
+{
+	switch (fb->var.bits_per_pixel) {
+	case 32:
+		return MDP_RGBA_8888;
+	case 24:
+		return MDP_RGB_888;
+	}
+	return MDP_RGB_565;
+}
+
+static int mdp_ppp_overlay_get(struct mdp_device *mdp_dev,
+			       struct fb_info *fb, struct mdp_overlay *req)
+{
+	struct mdp_info *mdp = container_of(mdp_dev, struct mdp_info, mdp_dev);
+	int ret = 0;
+
+	mutex_lock(&mdp_mutex);
+	if (mdp->overlay_active && req->id == mdp->overlay.id)
+		*req = mdp->overlay;
+	else
+		ret = -EINVAL;
+	mutex_unlock(&mdp_mutex);
+	return ret;
+}
+
+static int mdp_ppp_overlay_set(struct mdp_device *mdp_dev,
+			       struct fb_info *fb, struct mdp_overlay *req)
+{
+	struct mdp_info *mdp = container_of(mdp_dev, struct mdp_info, mdp_dev);
+	struct mdp_rect *src = &req->src_rect, *dst = &req->dst_rect;
+
+	if (!mdp_ppp_overlay_format_ok(req->src.format)) {
+		printk(KERN_ERR "%s: format %d not supported\n", __func__,
+		       req->src.format);
+		return -EINVAL;
+	}
+	if (!src->w || !src->h || !dst->w || !dst->h ||
+	    src->x + src->w > req->src.width ||
+	    src->y + src->h > req->src.height ||
+	    dst->x + dst->w > fb->var.xres ||
+	    dst->y + dst->h > fb->var.yres)
+		return -EINVAL;
+
+	mutex_lock(&mdp_mutex);
+	if (mdp->overlay_active && req->id != mdp->overlay.id) {
+		mutex_unlock(&mdp_mutex);
+		return -EBUSY;
+	}
+	/* there is only one overlay */
+	req->id = 0;
+	mdp->overlay = *req;
+	mdp->overlay_active = 1;
+	mutex_unlock(&mdp_mutex);
+	return 0;
+}
+
+static int mdp_ppp_overlay_unset(struct mdp_device *mdp_dev,
+				 struct fb_info *fb, int ndx)
+{
+	struct mdp_info *mdp = container_of(mdp_dev, struct mdp_info, mdp_dev);
+	int ret = 0;
+
+	mutex_lock(&mdp_mutex);
+	if (mdp->overlay_active && ndx == mdp->overlay.id)
+		mdp->overlay_active = 0;
+	else
+		ret = -EINVAL;
+	mutex_unlock(&mdp_mutex);
+	return ret;
+}
+
+static int mdp_ppp_overlay_play(struct mdp_device *mdp_dev,
+				struct fb_info *fb,
+				struct msmfb_overlay_data *req,
+				struct file **pp_src_file)
+{
+	struct mdp_info *mdp = container_of(mdp_dev, struct mdp_info, mdp_dev);
+	struct mdp_overlay *ov = &mdp->overlay;
+	struct mdp_blit_req blit;
+	unsigned long src_start, src_len, vstart;
+	int ret;
+
+	if (get_pmem_file(req->data.memory_id, &src_start, &vstart, &src_len,
+			  pp_src_file)) {
+		printk(KERN_ERR "%s: could not retrieve src image\n", __func__);
+		return -EINVAL;
+	}
+
+	mutex_lock(&mdp_mutex);
+	if (!mdp->overlay_active || req->id != ov->id) {
+		ret = -EINVAL;
+		goto end;
+	}
+
+	memset(&blit, 0, sizeof(blit));
+	blit.src.width = ov->src.width;
+	blit.src.height = ov->src.height;
+	blit.src.format = ov->src.format;
+	blit.src.offset = req->data.offset;
+	blit.src.memory_id = req->data.memory_id;
+	blit.dst.width = fb->var.xres;
+	blit.dst.height = fb->var.yres;
+	blit.dst.format = mdp_ppp_overlay_fb_format(fb);
+	/* the buffer being scanned out, not the one being drawn */
+	blit.dst.offset = fb->var.yoffset * fb->fix.line_length;
+	blit.dst.memory_id = -1;
+	blit.src_rect = ov->src_rect;
+	blit.dst_rect = ov->dst_rect;
+	blit.alpha = MDP_ALPHA_NOP;
+	blit.transp_mask = MDP_TRANSP_NOP;
+	blit.flags = ov->flags & (MDP_ROT_MASK | MDP_DITHER);
+	ret = mdp_blit_check(&blit);
+	if (ret)
+		goto end;
+
+	mdp_ppp_drain(mdp);
+	ret = mdp_blit_locked(mdp, &blit, *pp_src_file, src_start, src_len,
+			      NULL, fb->fix.smem_start, fb->fix.smem_len);
+end:
+	mutex_unlock(&mdp_mutex);
+	return ret;
+}
+#endif
+
 int mdp_fb_mirror(struct mdp_device *mdp_dev,
 		struct fb_info *src_fb, struct fb_info *dst_fb,
 		struct mdp_blit_req *req)
@@ -929,6 +1414,10 @@ int mdp_probe(struct platform_device *pdev)
 		return -ENOMEM;
 
 	spin_lock_init(&mdp->lock);
+	INIT_LIST_HEAD(&mdp->ppp_queue);
+	INIT_LIST_HEAD(&mdp->ppp_done);
+	INIT_WORK(&mdp->ppp_reap_work, mdp_ppp_reap);
+	init_waitqueue_head(&mdp->ppp_queue_wq);
 
 	mdp->irq = platform_get_irq(pdev, 0);
 	if (mdp->irq < 0) {
@@ -947,12 +1436,20 @@ int mdp_probe(struct platform_device *pdev)
 
 	mdp->mdp_dev.dma = mdp_dma;
 	mdp->mdp_dev.dma_wait = mdp_dma_wait;
+	mdp->mdp_dev.dma_chain = mdp_dma_chain;
 	mdp->mdp_dev.blit = mdp_blit;
+	mdp->mdp_dev.blit_async = mdp_blit_async;
+	mdp->mdp_dev.blit_wait = mdp_blit_wait;
 #ifdef CONFIG_FB_MSM_OVERLAY
 	mdp->mdp_dev.overlay_get = mdp4_overlay_get;
 	mdp->mdp_dev.overlay_set = mdp4_overlay_set;
 	mdp->mdp_dev.overlay_unset = mdp4_overlay_unset;
 	mdp->mdp_dev.overlay_play = mdp4_overlay_play;
+#elif defined(CONFIG_FB_MSM_PPP_OVERLAY)
+	mdp->mdp_dev.overlay_get = mdp_ppp_overlay_get;
+	mdp->mdp_dev.overlay_set = mdp_ppp_overlay_set;
+	mdp->mdp_dev.overlay_unset = mdp_ppp_overlay_unset;
+	mdp->mdp_dev.overlay_play = mdp_ppp_overlay_play;
 #endif
 	mdp->mdp_dev.set_grp_disp = mdp_set_grp_disp;
 	mdp->mdp_dev.set_output_format = mdp_set_output_format;
@@ -1052,6 +1549,7 @@ extern void mdp4_hw_init(struct mdp_info *mdp);
 		goto error_device_register;
 
 	pr_info("%s: initialized\n", __func__);
+	mdp_touch_info = mdp;
 
 	return 0;
 
@@ -1075,10 +1573,106 @@ static struct platform_driver msm_mdp_driver = {
 	.driver = {.name = "msm_mdp"},
 };
 
+/* a touch down is usually followed by a frame, so the mdp clock is
+ * turned on right away and held for touch_wake_ms instead of waiting for
+ * the first dma or blit to enable it */
+static struct mdp_info *mdp_touch_info;
+static bool mdp_touch_clk_on;
+static unsigned int touch_wake_ms = 100;
+module_param(touch_wake_ms, uint, 0644);
+
+static void mdp_touch_off_work(struct work_struct *work)
+{
+	if (mdp_touch_clk_on) {
+		clk_disable(mdp_touch_info->clk);
+		mdp_touch_clk_on = false;
+	}
+}
+static DECLARE_DELAYED_WORK(mdp_touch_off, mdp_touch_off_work);
+
+static void mdp_touch_on_work(struct work_struct *work)
+{
+	if (!mdp_touch_clk_on) {
+		clk_enable(mdp_touch_info->clk);
+		mdp_touch_clk_on = true;
+	}
+	cancel_delayed_work(&mdp_touch_off);
+	schedule_delayed_work(&mdp_touch_off, msecs_to_jiffies(touch_wake_ms));
+}
+static DECLARE_WORK(mdp_touch_on, mdp_touch_on_work);
+
+static void mdp_touch_event(struct input_handle *handle,
+			    unsigned int type, unsigned int code, int value)
+{
+	/* key events only get here when the state changes */
+	if (type == EV_KEY && code == BTN_TOUCH && value && touch_wake_ms)
+		schedule_work(&mdp_touch_on);
+}
+
+static int mdp_touch_connect(struct input_handler *handler,
+			     struct input_dev *dev,
+			     const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "msm_mdp";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_free_handle;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_unregister_handle;
+
+	return 0;
+
+err_unregister_handle:
+	input_unregister_handle(handle);
+err_free_handle:
+	kfree(handle);
+	return error;
+}
+
+static void mdp_touch_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+/* touchscreens: absolute axes plus BTN_TOUCH */
+static const struct input_device_id mdp_touch_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_KEYBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+	},
+	{ },
+};
+
+static struct input_handler mdp_touch_handler = {
+	.event		= mdp_touch_event,
+	.connect	= mdp_touch_connect,
+	.disconnect	= mdp_touch_disconnect,
+	.name		= "msm_mdp",
+	.id_table	= mdp_touch_ids,
+};
+
 static int __init mdp_lateinit(void)
 {
 	if (mdp_clk_to_disable_later)
 		clk_disable(mdp_clk_to_disable_later);
+	if (mdp_touch_info && input_register_handler(&mdp_touch_handler))
+		pr_err("mdp: no touch wake\n");
 	return 0;
 }
 
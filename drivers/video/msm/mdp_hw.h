@@ -17,6 +17,8 @@
 
 #include <linux/platform_device.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/msm_mdp.h>
 #include <mach/msm_iomap.h>
 #include <mach/msm_fb.h>
 
@@ -53,6 +55,20 @@ struct mdp_info {
 	int pack_pattern;
 	bool dma_config_dirty;
 	struct mdp_blit_req *req;
+
+	/* queued blits, the head one is running on the ppp */
+	struct list_head ppp_queue;
+	/* finished blits waiting for their images to be put */
+	struct list_head ppp_done;
+	struct work_struct ppp_reap_work;
+	wait_queue_head_t ppp_queue_wq;
+	uint32_t blit_timestamp;	/* last queued */
+	uint32_t blit_retired;		/* last finished */
+#ifdef CONFIG_FB_MSM_PPP_OVERLAY
+	/* the one video overlay, converted by the ppp into the fb */
+	struct mdp_overlay overlay;
+	int overlay_active;
+#endif
 };
 
 extern int mdp_out_if_register(struct mdp_device *mdp_dev, int interface,
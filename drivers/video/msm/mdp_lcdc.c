@@ -151,11 +151,39 @@ static int lcdc_resume(struct msm_panel_data *fb_panel)
 	return 0;
 }
 
-static int lcdc_hw_init(struct mdp_lcdc_info *lcdc)
+/* config the dma_p block that drives the lcdc data */
+static void lcdc_dma_init(struct mdp_lcdc_info *lcdc, uint32_t fb_start)
 {
 	struct msm_panel_data *fb_panel = &lcdc->fb_panel_data;
 	uint32_t dma_cfg;
 
+	mdp_writel(lcdc->mdp, fb_start, MDP_DMA_P_IBUF_ADDR);
+	mdp_writel(lcdc->mdp, (((fb_panel->fb_data->yres & 0x7ff) << 16) |
+			       (fb_panel->fb_data->xres & 0x7ff)),
+		   MDP_DMA_P_SIZE);
+
+	mdp_writel(lcdc->mdp, 0, MDP_DMA_P_OUT_XY);
+
+	dma_cfg = mdp_readl(lcdc->mdp, MDP_DMA_P_CONFIG);
+	if (lcdc->pdata->overrides & MSM_MDP_LCDC_DMA_PACK_ALIGN_LSB)
+		dma_cfg &= ~DMA_PACK_ALIGN_MSB;
+	else
+		dma_cfg |= DMA_PACK_ALIGN_MSB;
+
+	dma_cfg |= (DMA_PACK_PATTERN_RGB |
+		   DMA_DITHER_EN);
+	dma_cfg |= DMA_OUT_SEL_LCDC;
+	dma_cfg &= ~DMA_DST_BITS_MASK;
+	if(lcdc->color_format == MSM_MDP_OUT_IF_FMT_RGB565)
+		dma_cfg |= DMA_DSTC0G_6BITS | DMA_DSTC1B_5BITS | DMA_DSTC2R_5BITS;
+	else if (lcdc->color_format == MSM_MDP_OUT_IF_FMT_RGB666)
+		dma_cfg |= DMA_DSTC0G_6BITS | DMA_DSTC1B_6BITS | DMA_DSTC2R_6BITS;
+
+	mdp_writel(lcdc->mdp, dma_cfg, MDP_DMA_P_CONFIG);
+}
+
+static int lcdc_hw_init(struct mdp_lcdc_info *lcdc)
+{
 	clk_enable(lcdc->mdp_clk);
 	clk_enable(lcdc->pclk);
 	clk_enable(lcdc->pad_pclk);
@@ -181,36 +209,69 @@ static int lcdc_hw_init(struct mdp_lcdc_info *lcdc)
 	mdp_writel(lcdc->mdp, 0, MDP_LCDC_ACTIVE_V_END);
 	mdp_writel(lcdc->mdp, lcdc->parms.polarity, MDP_LCDC_CTL_POLARITY);
 
-	/* config the dma_p block that drives the lcdc data */
-	mdp_writel(lcdc->mdp, lcdc->fb_start, MDP_DMA_P_IBUF_ADDR);
-	mdp_writel(lcdc->mdp, (((fb_panel->fb_data->yres & 0x7ff) << 16) |
-			       (fb_panel->fb_data->xres & 0x7ff)),
-		   MDP_DMA_P_SIZE);
+	lcdc_dma_init(lcdc, lcdc->fb_start);
 
-	mdp_writel(lcdc->mdp, 0, MDP_DMA_P_OUT_XY);
+	/* enable the lcdc timing generation */
+	mdp_writel(lcdc->mdp, 1, MDP_LCDC_EN);
 
-	dma_cfg = mdp_readl(lcdc->mdp, MDP_DMA_P_CONFIG);
-	if (lcdc->pdata->overrides & MSM_MDP_LCDC_DMA_PACK_ALIGN_LSB)
-		dma_cfg &= ~DMA_PACK_ALIGN_MSB;
-	else
-		dma_cfg |= DMA_PACK_ALIGN_MSB;
+	return 0;
+}
 
-	dma_cfg |= (DMA_PACK_PATTERN_RGB |
-		   DMA_DITHER_EN);
-	dma_cfg |= DMA_OUT_SEL_LCDC;
-	dma_cfg &= ~DMA_DST_BITS_MASK;
-	if(lcdc->color_format == MSM_MDP_OUT_IF_FMT_RGB565)
-		dma_cfg |= DMA_DSTC0G_6BITS | DMA_DSTC1B_5BITS | DMA_DSTC2R_5BITS;
-	else if (lcdc->color_format == MSM_MDP_OUT_IF_FMT_RGB666)
-		dma_cfg |= DMA_DSTC0G_6BITS | DMA_DSTC1B_6BITS | DMA_DSTC2R_6BITS;
+#ifdef CONFIG_FB_MSM_BOOT_SPLASH
+/* The bootloader left the lcdc running with the timing we would program,
+ * scanning out an rgb565 frame of the panel's size. */
+static int lcdc_running_from_boot(struct mdp_lcdc_info *lcdc)
+{
+	struct msm_fb_data *fb_data = lcdc->pdata->fb_data;
+	struct mdp_info *mdp = lcdc->mdp;
 
-	mdp_writel(lcdc->mdp, dma_cfg, MDP_DMA_P_CONFIG);
+	if (!(mdp_readl(mdp, MDP_LCDC_EN) & 1))
+		return 0;
+	if (mdp_readl(mdp, MDP_LCDC_HSYNC_CTL) != lcdc->parms.hsync_ctl ||
+	    mdp_readl(mdp, MDP_LCDC_VSYNC_PERIOD) != lcdc->parms.vsync_period ||
+	    mdp_readl(mdp, MDP_LCDC_DISPLAY_HCTL) != lcdc->parms.display_hctl ||
+	    mdp_readl(mdp, MDP_LCDC_DISPLAY_V_START) !=
+	    lcdc->parms.display_vstart)
+		return 0;
+	if ((mdp_readl(mdp, MDP_DMA_P_CONFIG) & DMA_IBUF_FORMAT_MASK) !=
+	    DMA_IBUF_FORMAT_RGB565)
+		return 0;
+	return mdp_readl(mdp, MDP_DMA_P_IBUF_Y_STRIDE) == fb_data->xres * 2;
+}
 
-	/* enable the lcdc timing generation */
-	mdp_writel(lcdc->mdp, 1, MDP_LCDC_EN);
+/*
+ * Take the running panel over without touching its timing, so it doesn't
+ * blank between the bootloader splash and the first frame we send. The
+ * dma keeps scanning out the bootloader's frame until msm_fb flips.
+ */
+static int lcdc_hw_handoff(struct mdp_lcdc_info *lcdc)
+{
+	struct mdp_info *mdp = lcdc->mdp;
+	uint32_t boot_fb = mdp_readl(mdp, MDP_DMA_P_IBUF_ADDR);
 
+	clk_enable(lcdc->mdp_clk);
+	clk_enable(lcdc->pclk);
+	clk_enable(lcdc->pad_pclk);
+
+	/* a rate change restarts the pixel clock, only do it if needed */
+	if (clk_get_rate(lcdc->pclk) != lcdc->parms.clk_rate) {
+		clk_set_rate(lcdc->pclk, lcdc->parms.clk_rate);
+		clk_set_rate(lcdc->pad_pclk, lcdc->parms.clk_rate);
+	}
+
+	lcdc_dma_init(lcdc, boot_fb);
+
+	/* already rgb565, don't let the first flip stop the lcdc to set it */
+	mdp->format = DMA_IBUF_FORMAT_RGB565;
+	mdp->pack_pattern = DMA_PACK_PATTERN_RGB;
+	mdp->dma_config_dirty = false;
+
+	lcdc->fb_panel_data.boot_fb = boot_fb;
+	pr_info("%s: panel left on by the bootloader, fb at 0x%08x\n",
+		__func__, boot_fb);
 	return 0;
 }
+#endif
 
 static void lcdc_wait_vsync(struct msm_panel_data *panel)
 {
@@ -455,7 +516,12 @@ static int mdp_lcdc_probe(struct platform_device *pdev)
 	lcdc->fb_panel_data.fb_data = pdata->fb_data;
 	lcdc->fb_panel_data.interface_type = MSM_LCDC_INTERFACE;
 
-	ret = lcdc_hw_init(lcdc);
+#ifdef CONFIG_FB_MSM_BOOT_SPLASH
+	if (lcdc_running_from_boot(lcdc))
+		ret = lcdc_hw_handoff(lcdc);
+	else
+#endif
+		ret = lcdc_hw_init(lcdc);
 	if (ret) {
 		pr_err("%s: Cannot initialize the mdp_lcdc\n", __func__);
 		goto err_hw_init;
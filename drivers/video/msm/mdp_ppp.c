@@ -15,6 +15,8 @@
 #include <linux/fb.h>
 #include <linux/file.h>
 #include <linux/delay.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
 #include <linux/msm_mdp.h>
 #include <linux/android_pmem.h>
 #include <mach/msm_fb.h>
@@ -444,9 +446,8 @@ static uint32_t get_chroma_base(struct mdp_img *img, uint32_t base,
 #endif
 
 
-static int send_blit(const struct mdp_info *mdp, struct mdp_blit_req *req,
-		     struct ppp_regs *regs, struct file *src_file,
-		     struct file *dst_file)
+static void write_blit_regs(const struct mdp_info *mdp,
+			    struct mdp_blit_req *req, struct ppp_regs *regs)
 {
 #if 0
 	mdp_writel_dbg(mdp, 1, MDP_PPP_CMD_MODE);
@@ -498,12 +499,42 @@ static int send_blit(const struct mdp_info *mdp, struct mdp_blit_req *req,
 			       MDP_PPP_BLEND_BG_ALPHA_SEL);
 #endif
 	}
+}
+
+static int send_blit(const struct mdp_info *mdp, struct mdp_blit_req *req,
+		     struct ppp_regs *regs, struct file *src_file,
+		     struct file *dst_file)
+{
+	write_blit_regs(mdp, req, regs);
 	if( src_file != -1 && dst_file != -1 )
 		flush_imgs(req, regs, src_file, dst_file);
 	mdp_writel_dbg(mdp, 0x1000, MDP_DISPLAY0_START);
 	return 0;
 }
 
+/* Start a blit set up by mdp_ppp_blit_prepare, safe from the isr */
+void mdp_ppp_blit_start(const struct mdp_info *mdp, struct mdp_blit_req *req,
+			struct ppp_regs *regs)
+{
+	write_blit_regs(mdp, req, regs);
+	mdp_writel_dbg(mdp, 0x1000, MDP_DISPLAY0_START);
+}
+
+/* A blit that scales or blurs loads coefficient tables into the ppp while
+ * it is being set up, so it can't be prepared while another one runs */
+int mdp_ppp_blit_uses_tables(const struct mdp_blit_req *req)
+{
+	uint32_t dst_w = req->dst_rect.w, dst_h = req->dst_rect.h;
+
+	if (req->flags & MDP_BLUR)
+		return 1;
+	if (req->flags & MDP_ROT_90) {
+		dst_w = req->dst_rect.h;
+		dst_h = req->dst_rect.w;
+	}
+	return req->src_rect.w != dst_w || req->src_rect.h != dst_h;
+}
+
 void mdp_dump_blit(struct mdp_blit_req *req)
 {
 	pr_info("%s: src: w=%d h=%d f=0x%x offs=0x%x mem_id=%d\n", __func__,
@@ -523,12 +554,190 @@ void mdp_dump_blit(struct mdp_blit_req *req)
 	pr_info("%s: flags=%08x\n", __func__, req->flags);
 }
 
-int mdp_ppp_blit(const struct mdp_info *mdp, struct mdp_blit_req *req,
-		 struct file *src_file, unsigned long src_start, unsigned long src_len,
-		 struct file *dst_file, unsigned long dst_start, unsigned long dst_len)
+/* Registers computed for a blit with both images based at address 0, so a
+ * request that only differs in where its images live can reuse them. The
+ * key is the request with offsets and memory ids cleared, out holds the
+ * alpha, transparency and rects as setup left them. A full screen blit cut
+ * into bands takes one entry per band. */
+#define PPP_BLIT_CACHE_SIZE 32
+
+struct ppp_blit_cache_entry {
+	struct mdp_blit_req key;
+	struct mdp_blit_req out;
+	struct ppp_regs regs;
+	int valid;
+};
+
+static struct ppp_blit_cache_entry blit_cache[PPP_BLIT_CACHE_SIZE];
+static int blit_cache_next;
+static DEFINE_SPINLOCK(blit_cache_lock);
+
+static unsigned int blit_cache_hits;
+module_param(blit_cache_hits, uint, 0444);
+static unsigned int blit_cache_misses;
+module_param(blit_cache_misses, uint, 0444);
+
+static void blit_cache_key(const struct mdp_blit_req *req,
+			   struct mdp_blit_req *key)
+{
+	*key = *req;
+	key->src.offset = 0;
+	key->src.memory_id = 0;
+	key->dst.offset = 0;
+	key->dst.memory_id = 0;
+}
+
+static int blit_cache_lookup(const struct mdp_blit_req *key,
+			     struct mdp_blit_req *req, struct ppp_regs *regs)
+{
+	struct ppp_blit_cache_entry *ent;
+	unsigned long flags;
+	int i, found = 0;
+
+	spin_lock_irqsave(&blit_cache_lock, flags);
+	for (i = 0; i < PPP_BLIT_CACHE_SIZE; i++) {
+		ent = &blit_cache[i];
+		if (!ent->valid || memcmp(&ent->key, key, sizeof(*key)))
+			continue;
+		req->alpha = ent->out.alpha;
+		req->transp_mask = ent->out.transp_mask;
+		req->src_rect = ent->out.src_rect;
+		req->dst_rect = ent->out.dst_rect;
+		*regs = ent->regs;
+		found = 1;
+		break;
+	}
+	if (found)
+		blit_cache_hits++;
+	else
+		blit_cache_misses++;
+	spin_unlock_irqrestore(&blit_cache_lock, flags);
+	return found;
+}
+
+static void blit_cache_store(const struct mdp_blit_req *key,
+			     const struct mdp_blit_req *req,
+			     const struct ppp_regs *regs)
+{
+	struct ppp_blit_cache_entry *ent;
+	unsigned long flags;
+
+	spin_lock_irqsave(&blit_cache_lock, flags);
+	ent = &blit_cache[blit_cache_next];
+	blit_cache_next = (blit_cache_next + 1) % PPP_BLIT_CACHE_SIZE;
+	ent->key = *key;
+	ent->out = *req;
+	ent->regs = *regs;
+	ent->valid = 1;
+	spin_unlock_irqrestore(&blit_cache_lock, flags);
+}
+
+/* a cached scaling or blurring blit still needs its coefficient tables in
+ * the ppp, another blit may have loaded different ones since. the table
+ * loaders skip the writes if they are already there */
+static void blit_load_tables(const struct mdp_info *mdp,
+			     struct mdp_blit_req *req)
+{
+	struct ppp_regs scratch = {0};
+
+	if (!mdp_ppp_blit_uses_tables(req))
+		return;
+	blit_scale(mdp, req, &scratch);
+	blit_blur(mdp, req, &scratch);
+}
+
+/* compute the registers of a blit whose src and dst images start at 0 */
+static int compute_blit_regs(const struct mdp_info *mdp,
+			     struct mdp_blit_req *req, struct ppp_regs *regs)
+{
+	/* set the src image configuration */
+	regs->src_cfg = src_img_cfg[req->src.format];
+	regs->src_cfg |= (req->src_rect.x & 0x1) ? PPP_SRC_BPP_ROI_ODD_X : 0;
+	regs->src_cfg |= (req->src_rect.y & 0x1) ? PPP_SRC_BPP_ROI_ODD_Y : 0;
+	regs->src_pack = pack_pattern[req->src.format];
+
+	/* set the dest image configuration */
+	regs->dst_cfg = dst_img_cfg[req->dst.format] | PPP_DST_OUT_SEL_AXI;
+	regs->dst_pack = pack_pattern[req->dst.format];
+
+	/* set src, bpp, start pixel and ystride */
+	regs->src_bpp = mdp_get_bytes_per_pixel(req->src.format);
+	regs->src0 = get_luma_offset(&req->src, &req->src_rect, regs->src_bpp);
+	regs->src1 = get_chroma_base(&req->src, 0, regs->src_bpp);
+	regs->src1 += get_chroma_offset(&req->src, &req->src_rect,
+					regs->src_bpp);
+	regs->src_ystride = req->src.width * regs->src_bpp;
+	set_src_region(&req->src, &req->src_rect, regs);
+
+	/* set dst, bpp, start pixel and ystride */
+	regs->dst_bpp = mdp_get_bytes_per_pixel(req->dst.format);
+	regs->dst0 = get_luma_offset(&req->dst, &req->dst_rect, regs->dst_bpp);
+	regs->dst1 = get_chroma_base(&req->dst, 0, regs->dst_bpp);
+	regs->dst1 += get_chroma_offset(&req->dst, &req->dst_rect,
+					regs->dst_bpp);
+	regs->dst_ystride = req->dst.width * regs->dst_bpp;
+	set_dst_region(&req->dst_rect, regs);
+
+	/* set up operation register */
+	regs->op = 0;
+	blit_rotate(req, regs);
+	blit_convert(req, regs);
+	if (req->flags & MDP_DITHER)
+		regs->op |= PPP_OP_DITHER_EN;
+	blit_blend(req, regs);
+	if (blit_scale(mdp, req, regs)) {
+		printk(KERN_ERR "mdp_ppp: error computing scale for img.\n");
+		return -EINVAL;
+	}
+	blit_blur(mdp, req, regs);
+	regs->op |= dst_op_chroma[req->dst.format] |
+		    src_op_chroma[req->src.format];
+
+	/* if the image is YCRYCB, the x and w must be even */
+	if (unlikely(req->src.format == MDP_YCRYCB_H2V1)) {
+		req->src_rect.x = req->src_rect.x & (~0x1);
+		req->src_rect.w = req->src_rect.w & (~0x1);
+		req->dst_rect.x = req->dst_rect.x & (~0x1);
+		req->dst_rect.w = req->dst_rect.w & (~0x1);
+	}
+
+	if (mdp_ppp_cfg_edge_cond(req, regs))
+		return -EINVAL;
+
+	/* for simplicity, always write the chroma stride */
+	regs->src_ystride &= 0x3fff;
+	regs->src_ystride |= regs->src_ystride << 16;
+	regs->dst_ystride &= 0x3fff;
+	regs->dst_ystride |= regs->dst_ystride << 16;
+	regs->bg_ystride &= 0x3fff;
+	regs->bg_ystride |= regs->bg_ystride << 16;
+	return 0;
+}
+
+/* move the address registers of a blit computed at 0 to its images. the
+ * chroma planes only have an address for pseudo planar formats */
+static void rebase_blit_regs(struct mdp_blit_req *req, struct ppp_regs *regs,
+			     uint32_t src_base, uint32_t dst_base)
+{
+	regs->src0 += src_base;
+	if (IS_PSEUDOPLNR(req->src.format))
+		regs->src1 += src_base;
+	regs->dst0 += dst_base;
+	regs->bg0 += dst_base;
+	if (IS_PSEUDOPLNR(req->dst.format)) {
+		regs->dst1 += dst_base;
+		regs->bg1 += dst_base;
+	}
+}
+
+static int setup_blit(const struct mdp_info *mdp, struct mdp_blit_req *req,
+		      unsigned long src_start, unsigned long src_len,
+		      unsigned long dst_start, unsigned long dst_len,
+		      struct ppp_regs *regs_out)
 {
 	struct ppp_regs regs = {0};
-	uint32_t luma_base;
+	struct mdp_blit_req key;
+	int ret;
 
 #if PPP_DUMP_BLITS
 	mdp_dump_blit(req);
@@ -556,36 +765,18 @@ int mdp_ppp_blit(const struct mdp_info *mdp, struct mdp_blit_req *req,
 		return -EINVAL;
 	}
 
-	/* set the src image configuration */
-	regs.src_cfg = src_img_cfg[req->src.format];
-	regs.src_cfg |= (req->src_rect.x & 0x1) ? PPP_SRC_BPP_ROI_ODD_X : 0;
-	regs.src_cfg |= (req->src_rect.y & 0x1) ? PPP_SRC_BPP_ROI_ODD_Y : 0;
-	regs.src_pack = pack_pattern[req->src.format];
-
-	/* set the dest image configuration */
-	regs.dst_cfg = dst_img_cfg[req->dst.format] | PPP_DST_OUT_SEL_AXI;
-	regs.dst_pack = pack_pattern[req->dst.format];
-
-	/* set src, bpp, start pixel and ystride */
-	regs.src_bpp = mdp_get_bytes_per_pixel(req->src.format);
-	luma_base = src_start + req->src.offset;
-	regs.src0 = luma_base +
-		get_luma_offset(&req->src, &req->src_rect, regs.src_bpp);
-	regs.src1 = get_chroma_base(&req->src, luma_base, regs.src_bpp);
-	regs.src1 += get_chroma_offset(&req->src, &req->src_rect, regs.src_bpp);
-	regs.src_ystride = req->src.width * regs.src_bpp;
-	set_src_region(&req->src, &req->src_rect, &regs);
-
-	/* set dst, bpp, start pixel and ystride */
-	regs.dst_bpp = mdp_get_bytes_per_pixel(req->dst.format);
-	luma_base = dst_start + req->dst.offset;
-	regs.dst0 = luma_base +
-		get_luma_offset(&req->dst, &req->dst_rect, regs.dst_bpp);
-	regs.dst1 = get_chroma_base(&req->dst, luma_base, regs.dst_bpp);
-	regs.dst1 += get_chroma_offset(&req->dst, &req->dst_rect, regs.dst_bpp);
-	regs.dst_ystride = req->dst.width * regs.dst_bpp;
-	set_dst_region(&req->dst_rect, &regs);
+	blit_cache_key(req, &key);
+	if (blit_cache_lookup(&key, req, &regs)) {
+		blit_load_tables(mdp, &key);
+	} else {
+		ret = compute_blit_regs(mdp, req, &regs);
+		if (ret)
+			return ret;
+		blit_cache_store(&key, req, &regs);
+	}
 
+	rebase_blit_regs(req, &regs, src_start + req->src.offset,
+			 dst_start + req->dst.offset);
 	if (!valid_src_dst(src_start, src_len, dst_start, dst_len, req,
 			   &regs)) {
 		printk(KERN_ERR "mdp_ppp: final src or dst location is "
@@ -594,39 +785,21 @@ int mdp_ppp_blit(const struct mdp_info *mdp, struct mdp_blit_req *req,
 		return -EINVAL;
 	}
 
-	/* set up operation register */
-	regs.op = 0;
-	blit_rotate(req, &regs);
-	blit_convert(req, &regs);
-	if (req->flags & MDP_DITHER)
-		regs.op |= PPP_OP_DITHER_EN;
-	blit_blend(req, &regs);
-	if (blit_scale(mdp, req, &regs)) {
-		printk(KERN_ERR "mdp_ppp: error computing scale for img.\n");
-		return -EINVAL;
-	}
-	blit_blur(mdp, req, &regs);
-	regs.op |= dst_op_chroma[req->dst.format] |
-		   src_op_chroma[req->src.format];
-
-	/* if the image is YCRYCB, the x and w must be even */
-	if (unlikely(req->src.format == MDP_YCRYCB_H2V1)) {
-		req->src_rect.x = req->src_rect.x & (~0x1);
-		req->src_rect.w = req->src_rect.w & (~0x1);
-		req->dst_rect.x = req->dst_rect.x & (~0x1);
-		req->dst_rect.w = req->dst_rect.w & (~0x1);
-	}
+	*regs_out = regs;
+	return 0;
+}
 
-	if (mdp_ppp_cfg_edge_cond(req, &regs))
-		return -EINVAL;
+int mdp_ppp_blit(const struct mdp_info *mdp, struct mdp_blit_req *req,
+		 struct file *src_file, unsigned long src_start, unsigned long src_len,
+		 struct file *dst_file, unsigned long dst_start, unsigned long dst_len)
+{
+	struct ppp_regs regs;
+	int ret;
 
-	/* for simplicity, always write the chroma stride */
-	regs.src_ystride &= 0x3fff;
-	regs.src_ystride |= regs.src_ystride << 16;
-	regs.dst_ystride &= 0x3fff;
-	regs.dst_ystride |= regs.dst_ystride << 16;
-	regs.bg_ystride &= 0x3fff;
-	regs.bg_ystride |= regs.bg_ystride << 16;
+	ret = setup_blit(mdp, req, src_start, src_len, dst_start, dst_len,
+			 &regs);
+	if (ret)
+		return ret;
 
 #if PPP_DUMP_BLITS
 	pr_info("%s: sending blit\n", __func__);
@@ -635,6 +808,27 @@ int mdp_ppp_blit(const struct mdp_info *mdp, struct mdp_blit_req *req,
 	return 0;
 }
 
+/* Compute the registers of a blit that doesn't use the scale tables and
+ * flush its images, without touching the ppp */
+int mdp_ppp_blit_prepare(const struct mdp_info *mdp, struct mdp_blit_req *req,
+		 struct file *src_file, unsigned long src_start, unsigned long src_len,
+		 struct file *dst_file, unsigned long dst_start, unsigned long dst_len,
+		 struct ppp_regs *regs)
+{
+	int ret;
+
+	BUG_ON(mdp_ppp_blit_uses_tables(req));
+
+	ret = setup_blit(mdp, req, src_start, src_len, dst_start, dst_len,
+			 regs);
+	if (ret)
+		return ret;
+
+	if (src_file != -1 && dst_file != -1)
+		flush_imgs(req, regs, src_file, dst_file);
+	return 0;
+}
+
 int mdp_get_bytes_per_pixel(int format)
 {
 	if (format < 0 || format >= MDP_IMGTYPE_LIMIT)
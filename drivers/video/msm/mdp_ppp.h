@@ -71,6 +71,14 @@ int mdp_ppp_cfg_scale(const struct mdp_info *mdp, struct ppp_regs *regs,
 int mdp_ppp_load_blur(const struct mdp_info *mdp);
 void mdp_dump_blit(struct mdp_blit_req *req);
 
+int mdp_ppp_blit_uses_tables(const struct mdp_blit_req *req);
+int mdp_ppp_blit_prepare(const struct mdp_info *mdp, struct mdp_blit_req *req,
+	struct file *src_file, unsigned long src_start, unsigned long src_len,
+	struct file *dst_file, unsigned long dst_start, unsigned long dst_len,
+	struct ppp_regs *regs);
+void mdp_ppp_blit_start(const struct mdp_info *mdp, struct mdp_blit_req *req,
+			struct ppp_regs *regs);
+
 
 #if defined(CONFIG_MSM_MDP31) || defined(CONFIG_MSM_MDP302)
 int mdp_ppp_blit_split_width(struct mdp_info *mdp, const struct mdp_blit_req *req,
@@ -28,11 +28,15 @@
 #include <linux/uaccess.h>
 #include <mach/msm_fb.h>
 #include <mach/board.h>
+#include <mach/perflock.h>
 #include <linux/workqueue.h>
 #include <linux/clk.h>
 #include <linux/debugfs.h>
 #include <linux/dma-mapping.h>
 #include <linux/android_pmem.h>
+#include <linux/slab.h>
+#include <linux/pm_timeline.h>
+#include <linux/kthread.h>
 
 extern void start_drawing_late_resume(struct early_suspend *h);
 static void msmfb_resume_handler(struct early_suspend *h);
@@ -44,6 +48,25 @@ static void msmfb_resume(struct work_struct *work);
 extern int load_565rle_image(char *filename);
 #endif
 
+#ifdef CONFIG_FB_MSM_BOOT_SPLASH
+#define SPLASH_ANIM_FILE "/bootanim/%03d.rle"
+#define SPLASH_MAX_FRAMES 64
+extern unsigned short *read_565rle_file(char *filename, unsigned *size);
+extern void draw_565rle(unsigned short *bits, unsigned max,
+			const unsigned short *ptr, unsigned count);
+
+static unsigned splash_frame_ms = 66;
+module_param_named(splash_frame_ms, splash_frame_ms, uint,
+		   S_IRUGO | S_IWUSR | S_IWGRP);
+
+/* 565rle frames of the boot animation, owned by the splash thread */
+struct msmfb_splash {
+	int nframes;
+	unsigned short *data[SPLASH_MAX_FRAMES];
+	unsigned size[SPLASH_MAX_FRAMES];
+};
+#endif
+
 #define PRINT_FPS 0
 #define PRINT_BLIT_TIME 0
 
@@ -73,6 +96,36 @@ module_param_named(msmfb_debug_mask, msmfb_debug_mask, int,
 
 struct mdp_device *mdp;
 
+/* dirty rects kept per frame, each one costs a dma to the panel */
+#define MSMFB_DMA_RECTS 4
+/* rough cost in pixels of starting one more dma, two rects are merged
+ * when the union wastes less than this */
+#define MSMFB_RECT_MERGE_SLACK (64 * 64)
+/* flips queued behind the one going out to the panel */
+#define MSMFB_MAX_FLIPS 2
+#define MSMFB_NUM_BUFFERS (MSMFB_MAX_FLIPS + 1)
+/* per-frame timing records kept for debugfs, a power of two */
+#define MSMFB_FRAME_HISTORY 128
+/* a flip sent more than two refreshes after it was queued is late */
+#define MSMFB_LATE_NSEC (2 * NSEC_PER_SEC / 60)
+/* cpu/gpu floor raised after a late flip, long enough for a few frames */
+#define MSMFB_BOOST_MSEC 100
+
+struct msmfb_rect {
+	int left;
+	int top;
+	int eright; /* exclusive */
+	int ebottom; /* exclusive */
+};
+
+struct msmfb_flip {
+	struct msmfb_rect rects[MSMFB_DMA_RECTS];
+	int nrects;
+	unsigned yoffset;
+	unsigned frame;
+	ktime_t queued;
+};
+
 struct msmfb_info {
 	struct fb_info *fb;
 	struct msm_panel_data *panel;
@@ -84,12 +137,25 @@ struct msmfb_info {
 	unsigned frame_done;
 	int sleeping;
 	unsigned update_frame;
-	struct {
-		int left;
-		int top;
-		int eright; /* exclusive */
-		int ebottom; /* exclusive */
-	} update_info;
+	/* flips waiting for vsync, flip_tail - flip_head of them */
+	struct msmfb_flip flips[MSMFB_MAX_FLIPS];
+	unsigned flip_head;
+	unsigned flip_tail;
+	int num_buffers;
+	unsigned frames_late;
+	unsigned frames_dropped;
+	ktime_t frame_done_time;
+	/* timing of the last frames, record frame_hist_head is the newest */
+	struct msmfb_frame_record frame_hist[MSMFB_FRAME_HISTORY];
+	unsigned frame_hist_head;
+	ktime_t vsync_time;
+	int vsync_fake;
+	/* rects of the frame being sent, chained from the dma interrupt */
+	struct msmfb_rect dma_rects[MSMFB_DMA_RECTS];
+	int dma_nrects;
+	int dma_next;
+	unsigned dma_yoffset;
+	unsigned dma_frame;
 	char *black;
 
 	struct early_suspend earlier_suspend;
@@ -110,6 +176,15 @@ struct msmfb_info {
 	struct hrtimer fake_vsync;
 	ktime_t vsync_request_time;
 	unsigned fb_resumed;
+#ifdef CONFIG_FB_MSM_PPP_OVERLAY
+	/* where the ppp draws the video, sent on after every frame */
+	struct mdp_rect overlay_dst;
+#endif
+#ifdef CONFIG_FB_MSM_BOOT_SPLASH
+	/* animates the boot splash until userspace opens the fb */
+	struct task_struct *splash_task;
+	struct msmfb_splash *splash;
+#endif
 };
 
 #ifdef CONFIG_FB_MSM_OVERLAY
@@ -157,8 +232,17 @@ static void msmfb_set_var(unsigned char *addr, int area)
 }
 #endif
 
+#ifdef CONFIG_FB_MSM_BOOT_SPLASH
+static void msmfb_splash_stop(struct msmfb_info *msmfb);
+#endif
+
 static int msmfb_open(struct fb_info *info, int user)
 {
+#ifdef CONFIG_FB_MSM_BOOT_SPLASH
+	/* the first client to draw takes the screen over */
+	if (user)
+		msmfb_splash_stop(info->par);
+#endif
 	return 0;
 }
 
@@ -167,6 +251,102 @@ static int msmfb_release(struct fb_info *info, int user)
 	return 0;
 }
 
+static inline int msmfb_rect_area(const struct msmfb_rect *r)
+{
+	return (r->eright - r->left) * (r->ebottom - r->top);
+}
+
+static void msmfb_rect_union(struct msmfb_rect *r, const struct msmfb_rect *a)
+{
+	r->left = min(r->left, a->left);
+	r->top = min(r->top, a->top);
+	r->eright = max(r->eright, a->eright);
+	r->ebottom = max(r->ebottom, a->ebottom);
+}
+
+/* pixels sent for nothing if a and b go out as one rect, negative when
+ * they overlap */
+static int msmfb_merge_cost(const struct msmfb_rect *a,
+			    const struct msmfb_rect *b)
+{
+	struct msmfb_rect u = *a;
+
+	msmfb_rect_union(&u, b);
+	return msmfb_rect_area(&u) - msmfb_rect_area(a) - msmfb_rect_area(b);
+}
+
+/* call with update_lock held, adds r to the dirty rects of a flip merging
+ * it with the cheapest neighbour while that saves bandwidth or the set is
+ * full */
+static void msmfb_add_update_rect(struct msmfb_flip *flip,
+				  struct msmfb_rect r)
+{
+	int i, best, cost, best_cost = 0;
+
+restart:
+	best = -1;
+	for (i = 0; i < flip->nrects; i++) {
+		cost = msmfb_merge_cost(&flip->rects[i], &r);
+		if (best < 0 || cost < best_cost) {
+			best = i;
+			best_cost = cost;
+		}
+	}
+	if (best >= 0 && (best_cost <= MSMFB_RECT_MERGE_SLACK ||
+			  flip->nrects == MSMFB_DMA_RECTS)) {
+		msmfb_rect_union(&r, &flip->rects[best]);
+		flip->rects[best] = flip->rects[--flip->nrects];
+		goto restart;
+	}
+	flip->rects[flip->nrects++] = r;
+}
+
+/* flips queued or going out, each holds a buffer userspace can't draw to */
+static inline int msmfb_flips_busy(struct msmfb_info *msmfb)
+{
+	return (msmfb->flip_tail - msmfb->flip_head) + !!msmfb->dma_nrects;
+}
+
+static void msmfb_dma_rect(struct msmfb_info *msmfb,
+			   const struct msmfb_rect *r, int chain)
+{
+	uint32_t x = r->left, y = r->top;
+	uint32_t w = r->eright - x, h = r->ebottom - y;
+	unsigned addr;
+
+	addr = ((msmfb->xres * (msmfb->dma_yoffset + y) + x) *
+		BYTES_PER_PIXEL(msmfb));
+	if (chain)
+		mdp->dma_chain(mdp, addr + msmfb->fb->fix.smem_start,
+			       msmfb->xres * BYTES_PER_PIXEL(msmfb), w, h, x, y,
+			       &msmfb->dma_callback,
+			       msmfb->panel->interface_type);
+	else
+		mdp->dma(mdp, addr + msmfb->fb->fix.smem_start,
+			 msmfb->xres * BYTES_PER_PIXEL(msmfb), w, h, x, y,
+			 &msmfb->dma_callback,
+			 msmfb->panel->interface_type);
+}
+
+/* if the panel is all the way on wait for vsync, otherwise sleep for 16 ms
+ * (long enough for the dma to panel) and then begin dma */
+static void msmfb_request_vsync(struct msmfb_info *msmfb, int sleeping)
+{
+	struct msm_panel_data *panel = msmfb->panel;
+
+	msmfb->vsync_request_time = ktime_get();
+	if (panel->request_vsync && (sleeping == AWAKE)) {
+		wake_lock_timeout(&msmfb->idle_lock, HZ/4);
+		panel->request_vsync(panel, &msmfb->vsync_callback);
+	} else {
+		if (!hrtimer_active(&msmfb->fake_vsync)) {
+			hrtimer_start(&msmfb->fake_vsync,
+				      ktime_set(0, NSEC_PER_SEC/60),
+				      HRTIMER_MODE_REL);
+		}
+	}
+}
+
 /* Called from dma interrupt handler, must not sleep */
 static void msmfb_handle_dma_interrupt(struct msmfb_callback *callback)
 {
@@ -181,7 +361,23 @@ static void msmfb_handle_dma_interrupt(struct msmfb_callback *callback)
 #endif
 
 	spin_lock_irqsave(&msmfb->update_lock, irq_flags);
-	msmfb->frame_done = msmfb->frame_requested;
+	/* send the rest of the frame's rects back to back */
+	if (msmfb->dma_next < msmfb->dma_nrects) {
+		struct msmfb_rect *r = &msmfb->dma_rects[msmfb->dma_next++];
+		spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
+		msmfb_dma_rect(msmfb, r, 1);
+		return;
+	}
+	msmfb->dma_nrects = 0;
+	msmfb->dma_next = 0;
+	msmfb->frame_done = msmfb->dma_frame;
+	msmfb->frame_done_time = ktime_get();
+	msmfb->frame_hist[msmfb->frame_hist_head].dma_done_ns =
+		ktime_to_ns(msmfb->frame_done_time);
+	pm_timeline_first(PM_TIMELINE_FIRST_FRAME, "msmfb: first frame");
+	/* flips queued while this one was going out start on the next vsync */
+	if (msmfb->flip_head != msmfb->flip_tail)
+		msmfb_request_vsync(msmfb, msmfb->sleeping);
 	if (msmfb->sleeping == UPDATING &&
 	    msmfb->frame_done == msmfb->update_frame) {
 		DLOG(SUSPEND_RESUME, "full update completed\n");
@@ -205,11 +401,9 @@ static void msmfb_handle_dma_interrupt(struct msmfb_callback *callback)
 
 static int msmfb_start_dma(struct msmfb_info *msmfb)
 {
-	uint32_t x, y, w, h;
-	unsigned addr;
 	unsigned long irq_flags;
-	uint32_t yoffset;
 	s64 time_since_request;
+	int i;
 	struct msm_panel_data *panel = msmfb->panel;
 
 	spin_lock_irqsave(&msmfb->update_lock, irq_flags);
@@ -230,29 +424,60 @@ static int msmfb_start_dma(struct msmfb_info *msmfb)
 		spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
 		return -1;
 	}
-	x = msmfb->update_info.left;
-	y = msmfb->update_info.top;
-	w = msmfb->update_info.eright - x;
-	h = msmfb->update_info.ebottom - y;
-	yoffset = msmfb->yoffset;
-	msmfb->update_info.left = msmfb->xres + 1;
-	msmfb->update_info.top = msmfb->yres + 1;
-	msmfb->update_info.eright = 0;
-	msmfb->update_info.ebottom = 0;
-	if (unlikely(w > msmfb->xres || h > msmfb->yres ||
-		     w == 0 || h == 0)) {
-		printk(KERN_INFO "invalid update: %d %d %d "
-				"%d\n", x, y, w, h);
+	if (msmfb->dma_nrects) {
+		/* the last frame is still going out, its interrupt will
+		 * request another vsync for this one */
+		spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
+		return -1;
+	}
+	while (!msmfb->dma_nrects && msmfb->flip_head != msmfb->flip_tail) {
+		struct msmfb_flip *flip =
+			&msmfb->flips[msmfb->flip_head++ % MSMFB_MAX_FLIPS];
+
+		struct msmfb_frame_record *rec;
+		ktime_t now = ktime_get();
+
+		msmfb->frame_hist_head = (msmfb->frame_hist_head + 1) %
+					 MSMFB_FRAME_HISTORY;
+		rec = &msmfb->frame_hist[msmfb->frame_hist_head];
+		rec->frame = flip->frame;
+		rec->flags = msmfb->vsync_fake ? MSMFB_FRAME_FAKE_VSYNC : 0;
+		rec->requested_ns = ktime_to_ns(flip->queued);
+		rec->vsync_ns = ktime_to_ns(msmfb->vsync_time);
+		rec->dma_start_ns = ktime_to_ns(now);
+		rec->dma_done_ns = 0;
+		if (ktime_to_ns(ktime_sub(now, flip->queued)) >
+		    MSMFB_LATE_NSEC) {
+			msmfb->frames_late++;
+			rec->flags |= MSMFB_FRAME_SLIPPED;
+			perf_boost(MSMFB_BOOST_MSEC);
+		}
+		for (i = 0; i < flip->nrects; i++) {
+			struct msmfb_rect *r = &flip->rects[i];
+			int w = r->eright - r->left;
+			int h = r->ebottom - r->top;
+
+			if (unlikely(w > msmfb->xres || h > msmfb->yres ||
+				     w <= 0 || h <= 0)) {
+				printk(KERN_INFO "invalid update: %d %d %d "
+						"%d\n", r->left, r->top, w, h);
+				continue;
+			}
+			msmfb->dma_rects[msmfb->dma_nrects++] = *r;
+		}
+		msmfb->dma_yoffset = flip->yoffset;
+		msmfb->dma_frame = flip->frame;
+		if (unlikely(!msmfb->dma_nrects))
+			msmfb->frame_done = flip->frame;
+	}
+	if (unlikely(!msmfb->dma_nrects)) {
 		msmfb->frame_done = msmfb->frame_requested;
 		goto error;
 	}
+	msmfb->dma_next = 1;
 	spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
 
-	addr = ((msmfb->xres * (yoffset + y) + x) * BYTES_PER_PIXEL(msmfb));
-	mdp->dma(mdp, addr + msmfb->fb->fix.smem_start,
-		 msmfb->xres * BYTES_PER_PIXEL(msmfb), w, h, x, y,
-		 &msmfb->dma_callback,
-		 panel->interface_type);
+	msmfb_dma_rect(msmfb, &msmfb->dma_rects[0], 0);
 	return 0;
 error:
 	spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
@@ -269,6 +494,8 @@ static void msmfb_handle_vsync_interrupt(struct msmfb_callback *callback)
 	struct msmfb_info *msmfb = container_of(callback, struct msmfb_info,
 					       vsync_callback);
 	wake_unlock(&msmfb->idle_lock);
+	msmfb->vsync_time = ktime_get();
+	msmfb->vsync_fake = 0;
 	msmfb_start_dma(msmfb);
 }
 
@@ -276,19 +503,23 @@ static enum hrtimer_restart msmfb_fake_vsync(struct hrtimer *timer)
 {
 	struct msmfb_info *msmfb  = container_of(timer, struct msmfb_info,
 					       fake_vsync);
+	msmfb->vsync_time = ktime_get();
+	msmfb->vsync_fake = 1;
 	msmfb_start_dma(msmfb);
 	return HRTIMER_NORESTART;
 }
 
-static void msmfb_pan_update(struct fb_info *info, uint32_t left, uint32_t top,
-			     uint32_t eright, uint32_t ebottom,
-			     uint32_t yoffset, int pan_display)
+static void msmfb_pan_update_rects(struct fb_info *info,
+				   const struct msmfb_rect *rects, int count,
+				   uint32_t yoffset, int pan_display)
 {
 	struct msmfb_info *msmfb = info->par;
 	struct msm_panel_data *panel = msmfb->panel;
+	struct msmfb_flip *flip;
 	unsigned long irq_flags;
 	int sleeping;
 	int retry = 1;
+	int i, pending, kick;
 #if PRINT_FPS
 	ktime_t t1, t2;
 	static uint64_t pans;
@@ -296,8 +527,10 @@ static void msmfb_pan_update(struct fb_info *info, uint32_t left, uint32_t top,
 	t1 = ktime_get();
 #endif
 
-	DLOG(SHOW_UPDATES, "update %d %d %d %d %d %d\n",
-		left, top, eright, ebottom, yoffset, pan_display);
+	for (i = 0; i < count; i++)
+		DLOG(SHOW_UPDATES, "update %d %d %d %d %d %d\n",
+			rects[i].left, rects[i].top, rects[i].eright,
+			rects[i].ebottom, yoffset, pan_display);
 
         if (msmfb->sleeping != AWAKE)
                 DLOG(SUSPEND_RESUME, "pan_update in state(%d)\n", msmfb->sleeping);
@@ -322,16 +555,20 @@ restart:
 	}
 
 	sleeping = msmfb->sleeping;
-	/* on a full update, if the last frame has not completed, wait for it */
-	if (pan_display && (msmfb->frame_requested != msmfb->frame_done ||
-			    sleeping == UPDATING)) {
+	/* on a full update, wait until a buffer other than the one being
+	 * flipped to is free for drawing, with two buffers that is when the
+	 * last frame has completed */
+	if (pan_display &&
+	    (msmfb_flips_busy(msmfb) >= msmfb->num_buffers - 1 ||
+	     sleeping == UPDATING)) {
 		int ret;
 		spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
 		ret = wait_event_interruptible_timeout(msmfb->frame_wq,
-			msmfb->frame_done == msmfb->frame_requested &&
+			msmfb_flips_busy(msmfb) < msmfb->num_buffers - 1 &&
 			msmfb->sleeping != UPDATING, 5 * HZ);
-		if (ret <= 0 && (msmfb->frame_requested != msmfb->frame_done ||
-				 msmfb->sleeping == UPDATING)) {
+		if (ret <= 0 &&
+		    (msmfb_flips_busy(msmfb) >= msmfb->num_buffers - 1 ||
+		     msmfb->sleeping == UPDATING)) {
 			if (retry && panel->request_vsync &&
 			    (sleeping == AWAKE)) {
 				wake_lock_timeout(&msmfb->idle_lock, HZ/4);
@@ -345,6 +582,7 @@ restart:
 					"waiting for frame start, %d %d\n",
 					msmfb->frame_requested,
 					msmfb->frame_done);
+				msmfb->frames_dropped++;
 				return;
 			}
 		}
@@ -372,9 +610,11 @@ restart:
 	 * first full update on resume, set the sleeping state */
 	if (pan_display) {
 		msmfb->yoffset = yoffset;
-		if (left == 0 && top == 0 && eright == info->var.xres &&
-		    ebottom == info->var.yres) {
-			if (sleeping == WAKING) {
+		for (i = 0; i < count; i++) {
+			if (rects[i].left == 0 && rects[i].top == 0 &&
+			    rects[i].eright == info->var.xres &&
+			    rects[i].ebottom == info->var.yres &&
+			    sleeping == WAKING) {
 				msmfb->update_frame = msmfb->frame_requested;
 				DLOG(SUSPEND_RESUME, "full update starting\n");
 				msmfb->sleeping = UPDATING;
@@ -382,34 +622,49 @@ restart:
 		}
 	}
 
+	/* a pan queues a new flip, plain updates go into the newest one */
+	pending = msmfb->flip_tail - msmfb->flip_head;
+	if (pending && (!pan_display || pending == MSMFB_MAX_FLIPS)) {
+		flip = &msmfb->flips[(msmfb->flip_tail - 1) % MSMFB_MAX_FLIPS];
+		/* a pan replacing a flip that never went out drops it */
+		if (pan_display)
+			msmfb->frames_dropped++;
+	} else {
+		flip = &msmfb->flips[msmfb->flip_tail++ % MSMFB_MAX_FLIPS];
+		flip->nrects = 0;
+		flip->queued = ktime_get();
+	}
+	flip->yoffset = msmfb->yoffset;
+	flip->frame = msmfb->frame_requested;
+
 	/* set the update request */
-	if (left < msmfb->update_info.left)
-		msmfb->update_info.left = left;
-	if (top < msmfb->update_info.top)
-		msmfb->update_info.top = top;
-	if (eright > msmfb->update_info.eright)
-		msmfb->update_info.eright = eright;
-	if (ebottom > msmfb->update_info.ebottom)
-		msmfb->update_info.ebottom = ebottom;
-	DLOG(SHOW_UPDATES, "update queued %d %d %d %d %d\n",
-		msmfb->update_info.left, msmfb->update_info.top,
-		msmfb->update_info.eright, msmfb->update_info.ebottom,
-		msmfb->yoffset);
+	for (i = 0; i < count; i++)
+		msmfb_add_update_rect(flip, rects[i]);
+	for (i = 0; i < flip->nrects; i++)
+		DLOG(SHOW_UPDATES, "update queued %d %d %d %d %d\n",
+			flip->rects[i].left, flip->rects[i].top,
+			flip->rects[i].eright, flip->rects[i].ebottom,
+			flip->yoffset);
+	/* while a frame is going out its dma interrupt requests the vsync */
+	kick = !msmfb->dma_nrects;
 	spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
 
-	/* if the panel is all the way on wait for vsync, otherwise sleep
-	 * for 16 ms (long enough for the dma to panel) and then begin dma */
-	msmfb->vsync_request_time = ktime_get();
-	if (panel->request_vsync && (sleeping == AWAKE)) {
-		wake_lock_timeout(&msmfb->idle_lock, HZ/4);
-		panel->request_vsync(panel, &msmfb->vsync_callback);
-	} else {
-		if (!hrtimer_active(&msmfb->fake_vsync)) {
-			hrtimer_start(&msmfb->fake_vsync,
-				      ktime_set(0, NSEC_PER_SEC/60),
-				      HRTIMER_MODE_REL);
-		}
-	}
+	if (kick)
+		msmfb_request_vsync(msmfb, sleeping);
+}
+
+static void msmfb_pan_update(struct fb_info *info, uint32_t left, uint32_t top,
+			     uint32_t eright, uint32_t ebottom,
+			     uint32_t yoffset, int pan_display)
+{
+	struct msmfb_rect r = {
+		.left = left,
+		.top = top,
+		.eright = eright,
+		.ebottom = ebottom,
+	};
+
+	msmfb_pan_update_rects(info, &r, 1, yoffset, pan_display);
 }
 
 static void msmfb_update(struct fb_info *info, uint32_t left, uint32_t top,
@@ -600,6 +855,7 @@ static void msmfb_resume(struct work_struct *work)
 	}
 	spin_lock_irqsave(&msmfb->update_lock, irq_flags);
 	msmfb->frame_requested = msmfb->frame_done = msmfb->update_frame = 0;
+	msmfb->flip_head = msmfb->flip_tail = 0;
 	msmfb->sleeping = WAKING;
 	DLOG(SUSPEND_RESUME, "ready, waiting for full update\n");
 	spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
@@ -723,7 +979,118 @@ static int msmfb_blit(struct fb_info *info,
 	}
 	return 0;
 }
-#ifdef CONFIG_FB_MSM_OVERLAY
+
+static int msmfb_update_rects(struct fb_info *info, void __user *p)
+{
+	struct msmfb_info *msmfb = info->par;
+	struct msmfb_update_rects req;
+	struct msmfb_rect rects[MSMFB_MAX_UPDATE_RECTS];
+	int i;
+
+	if (copy_from_user(&req, p, sizeof(req)))
+		return -EFAULT;
+	if (req.count == 0 || req.count > MSMFB_MAX_UPDATE_RECTS)
+		return -EINVAL;
+	if (req.yoffset + info->var.yres > info->var.yres_virtual)
+		return -EINVAL;
+
+	if (!(msmfb->panel->caps & MSMFB_CAP_PARTIAL_UPDATES)) {
+		msmfb_pan_update(info, 0, 0, info->var.xres, info->var.yres,
+				 req.yoffset, 1);
+		return 0;
+	}
+
+	for (i = 0; i < req.count; i++) {
+		struct mdp_rect *r = &req.rect[i];
+
+		if (r->w == 0 || r->h == 0 ||
+		    r->x >= info->var.xres || r->w > info->var.xres - r->x ||
+		    r->y >= info->var.yres || r->h > info->var.yres - r->y)
+			return -EINVAL;
+		rects[i].left = r->x;
+		rects[i].top = r->y;
+		rects[i].eright = r->x + r->w;
+		rects[i].ebottom = r->y + r->h;
+	}
+	msmfb_pan_update_rects(info, rects, req.count, req.yoffset, 1);
+	return 0;
+}
+
+static int msmfb_frame_info(struct fb_info *info, void __user *p)
+{
+	struct msmfb_info *msmfb = info->par;
+	struct msmfb_frame_info fi;
+	unsigned long irq_flags;
+
+	spin_lock_irqsave(&msmfb->update_lock, irq_flags);
+	fi.frame_queued = msmfb->frame_requested;
+	fi.frame_done = msmfb->frame_done;
+	fi.frame_done_ns = ktime_to_ns(msmfb->frame_done_time);
+	fi.frames_late = msmfb->frames_late;
+	fi.frames_dropped = msmfb->frames_dropped;
+	spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
+
+	if (copy_to_user(p, &fi, sizeof(fi)))
+		return -EFAULT;
+	return 0;
+}
+
+static int msmfb_wait_frame(struct fb_info *info, void __user *p)
+{
+	struct msmfb_info *msmfb = info->par;
+	uint32_t frame;
+	int ret;
+
+	if (copy_from_user(&frame, p, sizeof(frame)))
+		return -EFAULT;
+	ret = wait_event_interruptible_timeout(msmfb->frame_wq,
+		(int)(msmfb->frame_done - frame) >= 0 ||
+		msmfb->sleeping == SLEEPING, HZ);
+	if (ret < 0)
+		return ret;
+	if (!ret)
+		return -ETIMEDOUT;
+	return 0;
+}
+
+static int msmfb_async_blit(struct fb_info *info, void __user *p)
+{
+	struct mdp_blit_req req;
+	struct mdp_blit_async_req_list req_list;
+	struct mdp_blit_async_req_list __user *list = p;
+	uint32_t timestamp = 0;
+	int i;
+	int ret;
+
+	if (!mdp->blit_async)
+		return msmfb_blit(info, &list->count);
+
+	if (copy_from_user(&req_list, p, sizeof(req_list)))
+		return -EFAULT;
+
+	for (i = 0; i < req_list.count; i++) {
+		if (copy_from_user(&req, &list->req[i], sizeof(req)))
+			return -EFAULT;
+		ret = mdp->blit_async(mdp, info, &req, &timestamp);
+		if (ret)
+			return ret;
+	}
+	if (put_user(timestamp, &list->timestamp))
+		return -EFAULT;
+	return 0;
+}
+
+static int msmfb_blit_wait(void __user *p)
+{
+	uint32_t timestamp;
+
+	if (copy_from_user(&timestamp, p, sizeof(timestamp)))
+		return -EFAULT;
+	if (!mdp->blit_wait)
+		return 0;
+	return mdp->blit_wait(mdp, timestamp);
+}
+#if defined(CONFIG_FB_MSM_OVERLAY) || defined(CONFIG_FB_MSM_PPP_OVERLAY)
 static int msmfb_overlay_get(struct fb_info *info, void __user *p)
 {
 	struct mdp_overlay req;
@@ -750,6 +1117,9 @@ static int msmfb_overlay_get(struct fb_info *info, void __user *p)
 
 static int msmfb_overlay_set(struct fb_info *info, void __user *p)
 {
+#ifdef CONFIG_FB_MSM_PPP_OVERLAY
+	struct msmfb_info *msmfb = info->par;
+#endif
 	struct mdp_overlay req;
 	int ret;
 
@@ -762,6 +1132,9 @@ static int msmfb_overlay_set(struct fb_info *info, void __user *p)
 			__func__);
 		return ret;
 	}
+#ifdef CONFIG_FB_MSM_PPP_OVERLAY
+	msmfb->overlay_dst = req.dst_rect;
+#endif
 
 	if (copy_to_user(p, &req, sizeof(req))) {
 		printk(KERN_ERR "%s: copy2user failed \n",
@@ -788,6 +1161,9 @@ static int msmfb_overlay_unset(struct fb_info *info, unsigned long *argp)
 
 static int msmfb_overlay_play(struct fb_info *info, unsigned long *argp)
 {
+#ifdef CONFIG_FB_MSM_PPP_OVERLAY
+	struct msmfb_info *msmfb = info->par;
+#endif
 	int	ret;
 	struct msmfb_overlay_data req;
 	struct file *p_src_file = 0;
@@ -803,6 +1179,13 @@ static int msmfb_overlay_play(struct fb_info *info, unsigned long *argp)
 
 	if (p_src_file)
 		put_pmem_file(p_src_file);
+#ifdef CONFIG_FB_MSM_PPP_OVERLAY
+	/* the frame is already in the fb, just get it out on the next vsync */
+	if (!ret)
+		msmfb_update(info, msmfb->overlay_dst.x, msmfb->overlay_dst.y,
+			     msmfb->overlay_dst.x + msmfb->overlay_dst.w,
+			     msmfb->overlay_dst.y + msmfb->overlay_dst.h);
+#endif
 
 	return ret;
 }
@@ -837,6 +1220,31 @@ static int msmfb_ioctl(struct fb_info *p, unsigned int cmd, unsigned long arg)
 		       ktime_to_ns(t2) - ktime_to_ns(t1));
 #endif
 		break;
+	case MSMFB_ASYNC_BLIT:
+		ret = msmfb_async_blit(p, argp);
+		if (ret)
+			return ret;
+		break;
+	case MSMFB_BLIT_WAIT:
+		ret = msmfb_blit_wait(argp);
+		if (ret)
+			return ret;
+		break;
+	case MSMFB_UPDATE_RECTS:
+		ret = msmfb_update_rects(p, argp);
+		if (ret)
+			return ret;
+		break;
+	case MSMFB_FRAME_INFO:
+		ret = msmfb_frame_info(p, argp);
+		if (ret)
+			return ret;
+		break;
+	case MSMFB_WAIT_FRAME:
+		ret = msmfb_wait_frame(p, argp);
+		if (ret)
+			return ret;
+		break;
 #ifdef CONFIG_FB_MSM_OVERLAY
 	case MSMFB_OVERLAY_GET:
 		printk("CONFIG_FB_MSM_OVERLAY\n");
@@ -868,6 +1276,27 @@ static int msmfb_ioctl(struct fb_info *p, unsigned int cmd, unsigned long arg)
 		ret = msmfb_overlay_play(p, argp);
 		//up(&mdp_ppp_lock);
 		break;
+#elif defined(CONFIG_FB_MSM_PPP_OVERLAY)
+	case MSMFB_OVERLAY_GET:
+		ret = msmfb_overlay_get(p, argp);
+		if (ret)
+			return ret;
+		break;
+	case MSMFB_OVERLAY_SET:
+		ret = msmfb_overlay_set(p, argp);
+		if (ret)
+			return ret;
+		break;
+	case MSMFB_OVERLAY_UNSET:
+		ret = msmfb_overlay_unset(p, argp);
+		if (ret)
+			return ret;
+		break;
+	case MSMFB_OVERLAY_PLAY:
+		ret = msmfb_overlay_play(p, argp);
+		if (ret)
+			return ret;
+		break;
 #endif
 	default:
 			printk(KERN_INFO "msmfb unknown ioctl: %d\n", cmd);
@@ -919,6 +1348,12 @@ static ssize_t debug_read(struct file *file, char __user *buf, size_t count,
 		       msmfb->sleeping);
 	n += scnprintf(buffer + n, debug_bufmax, "update_frame %d\n",
 		       msmfb->update_frame);
+	n += scnprintf(buffer + n, debug_bufmax, "flips_queued %d\n",
+		       msmfb->flip_tail - msmfb->flip_head);
+	n += scnprintf(buffer + n, debug_bufmax, "frames_late %d\n",
+		       msmfb->frames_late);
+	n += scnprintf(buffer + n, debug_bufmax, "frames_dropped %d\n",
+		       msmfb->frames_dropped);
 	spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
 	n++;
 	buffer[n] = 0;
@@ -929,6 +1364,137 @@ static struct file_operations debug_fops = {
 	.read = debug_read,
 	.open = debug_open,
 };
+
+/* copy the used frame records out oldest first, returns how many */
+static int msmfb_frame_snapshot(struct msmfb_info *msmfb,
+				struct msmfb_frame_record *recs)
+{
+	unsigned long irq_flags;
+	int i, n = 0;
+
+	spin_lock_irqsave(&msmfb->update_lock, irq_flags);
+	for (i = 1; i <= MSMFB_FRAME_HISTORY; i++) {
+		struct msmfb_frame_record *rec = &msmfb->frame_hist[
+			(msmfb->frame_hist_head + i) % MSMFB_FRAME_HISTORY];
+		if (!rec->dma_start_ns)
+			continue;
+		recs[n++] = *rec;
+	}
+	spin_unlock_irqrestore(&msmfb->update_lock, irq_flags);
+	return n;
+}
+
+static ssize_t frames_bin_read(struct file *file, char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	struct msmfb_info *msmfb = file->private_data;
+	struct msmfb_frame_record *recs;
+	ssize_t ret;
+	int n;
+
+	recs = kmalloc(sizeof(*recs) * MSMFB_FRAME_HISTORY, GFP_KERNEL);
+	if (!recs)
+		return -ENOMEM;
+	n = msmfb_frame_snapshot(msmfb, recs);
+	ret = simple_read_from_buffer(buf, count, ppos, recs,
+				      n * sizeof(*recs));
+	kfree(recs);
+	return ret;
+}
+
+static struct file_operations frames_bin_fops = {
+	.read = frames_bin_read,
+	.open = debug_open,
+};
+
+static inline uint32_t ns_to_us(uint64_t ns)
+{
+	do_div(ns, NSEC_PER_USEC);
+	return ns;
+}
+
+/* frame to frame time on the panel, upper bounds of the buckets in ms */
+static const unsigned frame_hist_ms[] = { 17, 34, 50, 67, 100, 200 };
+#define FRAME_HIST_BUCKETS (ARRAY_SIZE(frame_hist_ms) + 1)
+
+static ssize_t frames_read(struct file *file, char __user *buf,
+			   size_t count, loff_t *ppos)
+{
+	const int bufmax = 4096;
+	struct msmfb_info *msmfb = file->private_data;
+	struct msmfb_frame_record *recs;
+	unsigned hist[FRAME_HIST_BUCKETS] = { 0 };
+	uint64_t queue_ns = 0, vsync_ns = 0, dma_ns = 0;
+	unsigned slipped = 0, fake = 0, done = 0;
+	char *buffer;
+	ssize_t ret;
+	int i, j, n, len = 0;
+
+	recs = kmalloc(sizeof(*recs) * MSMFB_FRAME_HISTORY, GFP_KERNEL);
+	buffer = kmalloc(bufmax, GFP_KERNEL);
+	if (!recs || !buffer) {
+		ret = -ENOMEM;
+		goto done;
+	}
+	n = msmfb_frame_snapshot(msmfb, recs);
+	for (i = 0; i < n; i++) {
+		struct msmfb_frame_record *rec = &recs[i];
+
+		if (rec->flags & MSMFB_FRAME_SLIPPED)
+			slipped++;
+		if (rec->flags & MSMFB_FRAME_FAKE_VSYNC)
+			fake++;
+		queue_ns += rec->dma_start_ns - rec->requested_ns;
+		if (rec->vsync_ns && rec->vsync_ns <= rec->dma_start_ns)
+			vsync_ns += rec->dma_start_ns - rec->vsync_ns;
+		if (!rec->dma_done_ns)
+			continue;
+		dma_ns += rec->dma_done_ns - rec->dma_start_ns;
+		if (done++ && recs[i - 1].dma_done_ns) {
+			uint32_t ms = ns_to_us(rec->dma_done_ns -
+					       recs[i - 1].dma_done_ns) / 1000;
+			for (j = 0; j < ARRAY_SIZE(frame_hist_ms); j++)
+				if (ms < frame_hist_ms[j])
+					break;
+			hist[j]++;
+		}
+	}
+
+	len += scnprintf(buffer + len, bufmax - len,
+			 "frames %d done %u slipped %u fake_vsync %u\n",
+			 n, done, slipped, fake);
+	if (n) {
+		do_div(queue_ns, n);
+		do_div(vsync_ns, n);
+	}
+	if (done)
+		do_div(dma_ns, done);
+	len += scnprintf(buffer + len, bufmax - len,
+			 "avg us: queued->dma %u vsync->dma %u dma %u\n",
+			 ns_to_us(queue_ns), ns_to_us(vsync_ns),
+			 ns_to_us(dma_ns));
+	len += scnprintf(buffer + len, bufmax - len, "frame time ms:\n");
+	for (j = 0; j < FRAME_HIST_BUCKETS; j++) {
+		if (j < ARRAY_SIZE(frame_hist_ms))
+			len += scnprintf(buffer + len, bufmax - len,
+					 "  <%3u %u\n", frame_hist_ms[j],
+					 hist[j]);
+		else
+			len += scnprintf(buffer + len, bufmax - len,
+					 " >=%3u %u\n", frame_hist_ms[j - 1],
+					 hist[j]);
+	}
+	ret = simple_read_from_buffer(buf, count, ppos, buffer, len);
+done:
+	kfree(buffer);
+	kfree(recs);
+	return ret;
+}
+
+static struct file_operations frames_fops = {
+	.read = frames_read,
+	.open = debug_open,
+};
 #endif
 
 #define BITS_PER_PIXEL 16
@@ -954,7 +1520,7 @@ static void setup_fb_info(struct msmfb_info *msmfb)
 	fb_info->var.width = msmfb->panel->fb_data->width;
 	fb_info->var.height = msmfb->panel->fb_data->height;
 	fb_info->var.xres_virtual = msmfb->xres;
-	fb_info->var.yres_virtual = msmfb->yres * 2;
+	fb_info->var.yres_virtual = msmfb->yres * msmfb->num_buffers;
 	fb_info->var.bits_per_pixel = BITS_PER_PIXEL;
 	fb_info->var.accel_flags = 0;
 
@@ -1010,8 +1576,7 @@ static int setup_fbmem(struct msmfb_info *msmfb, struct platform_device *pdev)
 {
 	struct fb_info *fb = msmfb->fb;
 	struct resource *resource;
-	unsigned long size = msmfb->xres * msmfb->yres *
-		BYTES_PER_PIXEL(msmfb) * 2;
+	unsigned long size = msmfb->xres * msmfb->yres * (BITS_PER_PIXEL >> 3);
 	unsigned long resource_size;
 	unsigned char *fbram;
 
@@ -1021,12 +1586,15 @@ static int setup_fbmem(struct msmfb_info *msmfb, struct platform_device *pdev)
 		return -EINVAL;
 	resource_size = resource->end - resource->start + 1;
 
-	/* check the resource is large enough to fit the fb */
-	if (resource_size < size) {
+	/* check the resource is large enough to fit the fb, triple buffer
+	 * when there is room so a frame can be drawn while two are queued */
+	if (resource_size < size * 2) {
 		printk(KERN_ERR "msmfb: allocated resource is too small for "
 				"fb\n");
 		return -ENOMEM;
 	}
+	msmfb->num_buffers = resource_size < size * MSMFB_NUM_BUFFERS ?
+			     2 : MSMFB_NUM_BUFFERS;
 	fb->fix.smem_start = resource->start;
 	fb->fix.smem_len = resource_size;
 	fbram = ioremap(resource->start, resource_size);
@@ -1039,6 +1607,105 @@ static int setup_fbmem(struct msmfb_info *msmfb, struct platform_device *pdev)
 	return 0;
 }
 
+#ifdef CONFIG_FB_MSM_BOOT_SPLASH
+/*
+ * The panel is still showing the bootloader's frame. Copy it into our
+ * first buffer so the flips that follow don't replace it with garbage.
+ */
+static void msmfb_keep_boot_frame(struct msmfb_info *msmfb)
+{
+	struct fb_info *fb = msmfb->fb;
+	uint32_t boot_fb = msmfb->panel->boot_fb;
+	unsigned long size = msmfb->xres * msmfb->yres * (BITS_PER_PIXEL >> 3);
+	void __iomem *src;
+
+	if (!boot_fb || boot_fb == fb->fix.smem_start)
+		return;
+	if (boot_fb < fb->fix.smem_start + fb->fix.smem_len &&
+	    boot_fb + size > fb->fix.smem_start)
+		return;
+
+	src = ioremap(boot_fb, size);
+	if (!src) {
+		pr_warning("msmfb: can't map the boot frame at 0x%08x\n",
+			   boot_fb);
+		return;
+	}
+	memcpy_fromio(fb->screen_base, src, size);
+	iounmap(src);
+}
+
+static int msmfb_splash_thread(void *data)
+{
+	struct msmfb_info *msmfb = data;
+	struct msmfb_splash *splash = msmfb->splash;
+	struct fb_info *info = msmfb->fb;
+	unsigned pixels = msmfb->xres * msmfb->yres;
+	int frame = 0, buf = 0;
+
+	while (!kthread_should_stop()) {
+		/* draw into the buffer after the one the panel is showing,
+		 * the pan waits until it is free like it does for userspace */
+		buf = (buf + 1) % msmfb->num_buffers;
+		draw_565rle((unsigned short *)info->screen_base + buf * pixels,
+			    pixels, splash->data[frame], splash->size[frame]);
+		msmfb_pan_update(info, 0, 0, msmfb->xres, msmfb->yres,
+				 buf * msmfb->yres, 1);
+		frame = (frame + 1) % splash->nframes;
+		schedule_timeout_interruptible(
+			msecs_to_jiffies(splash_frame_ms));
+	}
+
+	for (frame = 0; frame < splash->nframes; frame++)
+		kfree(splash->data[frame]);
+	kfree(splash);
+	return 0;
+}
+
+static void msmfb_splash_start(struct msmfb_info *msmfb)
+{
+	struct msmfb_splash *splash;
+	struct task_struct *task;
+	char name[32];
+	int n;
+
+	splash = kzalloc(sizeof(*splash), GFP_KERNEL);
+	if (!splash)
+		return;
+	for (n = 0; n < SPLASH_MAX_FRAMES; n++) {
+		snprintf(name, sizeof(name), SPLASH_ANIM_FILE, n);
+		splash->data[n] = read_565rle_file(name, &splash->size[n]);
+		if (!splash->data[n])
+			break;
+	}
+	splash->nframes = n;
+	if (!n) {
+		kfree(splash);
+		return;
+	}
+
+	msmfb->splash = splash;
+	task = kthread_run(msmfb_splash_thread, msmfb, "msmfb_splash");
+	if (IS_ERR(task)) {
+		while (n--)
+			kfree(splash->data[n]);
+		kfree(splash);
+		msmfb->splash = NULL;
+		return;
+	}
+	msmfb->splash_task = task;
+	pr_info("msmfb: boot animation, %d frames\n", splash->nframes);
+}
+
+static void msmfb_splash_stop(struct msmfb_info *msmfb)
+{
+	struct task_struct *task = xchg(&msmfb->splash_task, NULL);
+
+	if (task)
+		kthread_stop(task);
+}
+#endif
+
 static int msmfb_probe(struct platform_device *pdev)
 {
 	struct fb_info *fb;
@@ -1074,6 +1741,9 @@ static int msmfb_probe(struct platform_device *pdev)
 #endif
 
 	setup_fb_info(msmfb);
+#ifdef CONFIG_FB_MSM_BOOT_SPLASH
+	msmfb_keep_boot_frame(msmfb);
+#endif
 
 	spin_lock_init(&msmfb->update_lock);
 	mutex_init(&msmfb->panel_init_lock);
@@ -1115,6 +1785,10 @@ static int msmfb_probe(struct platform_device *pdev)
 #if MSMFB_DEBUG
 	debugfs_create_file("msm_fb", S_IFREG | S_IRUGO, NULL,
 			    (void *)fb->par, &debug_fops);
+	debugfs_create_file("msm_fb_frames", S_IFREG | S_IRUGO, NULL,
+			    (void *)fb->par, &frames_fops);
+	debugfs_create_file("msm_fb_frames.bin", S_IFREG | S_IRUGO, NULL,
+			    (void *)fb->par, &frames_bin_fops);
 #endif
 
 	printk(KERN_INFO "msmfb_probe() installing %d x %d panel\n",
@@ -1143,13 +1817,12 @@ static int msmfb_probe(struct platform_device *pdev)
 #ifdef CONFIG_FB_MSM_LOGO
 	if (!load_565rle_image(INIT_IMAGE_FILE)) {
 		/* Flip buffer */
-		msmfb->update_info.left = 0;
-		msmfb->update_info.top = 0;
-		msmfb->update_info.eright = info->var.xres;
-		msmfb->update_info.ebottom = info->var.yres;
 		msmfb_pan_update(info, 0, 0, fb->var.xres,
 				 fb->var.yres, 0, 1);
 	}
+#endif
+#ifdef CONFIG_FB_MSM_BOOT_SPLASH
+	msmfb_splash_start(msmfb);
 #endif
 	/* Jay, 29/12/08' */
 	display_notifier(display_notifier_callback, NOTIFY_MSM_FB);
@@ -33,6 +33,7 @@
 #include <linux/bitops.h>
 #include <linux/mutex.h>
 #include <linux/anon_inodes.h>
+#include <linux/wakelock.h>
 #include <asm/uaccess.h>
 #include <asm/system.h>
 #include <asm/io.h>
@@ -72,7 +73,7 @@
  */
 
 /* Epoll private bits inside the event mask */
-#define EP_PRIVATE_BITS (EPOLLONESHOT | EPOLLET)
+#define EP_PRIVATE_BITS (EPOLLWAKEUP | EPOLLONESHOT | EPOLLET)
 
 /* Maximum number of nesting allowed inside epoll sets */
 #define EP_MAX_NESTS 4
@@ -86,6 +87,9 @@
 
 #define EP_ITEM_COST (sizeof(struct epitem) + sizeof(struct eppoll_entry))
 
+/* Events gathered on the stack before one copy to userspace */
+#define EP_SEND_BATCH 16
+
 struct epoll_filefd {
 	struct file *file;
 	int fd;
@@ -184,6 +188,9 @@ struct eventpoll {
 
 	/* The user that created the eventpoll descriptor */
 	struct user_struct *user;
+
+	/* Held while EPOLLWAKEUP events are pending or being handled */
+	struct wake_lock wake_lock;
 };
 
 /* Wait structure used by the poll hooks */
@@ -610,6 +617,7 @@ static void ep_free(struct eventpoll *ep)
 
 	mutex_unlock(&epmutex);
 	mutex_destroy(&ep->mtx);
+	wake_lock_destroy(&ep->wake_lock);
 	free_uid(ep->user);
 	kfree(ep);
 }
@@ -742,6 +750,7 @@ static int ep_alloc(struct eventpoll **pep)
 	ep->rbr = RB_ROOT;
 	ep->ovflist = EP_UNACTIVE_PTR;
 	ep->user = user;
+	wake_lock_init(&ep->wake_lock, WAKE_LOCK_SUSPEND, "eventpoll");
 
 	*pep = ep;
 
@@ -824,7 +833,7 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 			epi->next = ep->ovflist;
 			ep->ovflist = epi;
 		}
-		goto out_unlock;
+		goto out_wakeup;
 	}
 
 	/* If this file is already in the ready list we exit soon */
@@ -840,6 +849,15 @@ static int ep_poll_callback(wait_queue_t *wait, unsigned mode, int sync, void *k
 	if (waitqueue_active(&ep->poll_wait))
 		pwake++;
 
+out_wakeup:
+	/*
+	 * Stay awake until the event has been handed out and the caller
+	 * is back in epoll_wait(). Also done for events parked on
+	 * ep->ovflist, they will be delivered soon.
+	 */
+	if (epi->event.events & EPOLLWAKEUP)
+		wake_lock(&ep->wake_lock);
+
 out_unlock:
 	spin_unlock_irqrestore(&ep->lock, flags);
 
@@ -1047,39 +1065,56 @@ static int ep_send_events_proc(struct eventpoll *ep, struct list_head *head,
 			       void *priv)
 {
 	struct ep_send_events_data *esed = priv;
-	int eventcnt;
+	int eventcnt, i, n;
 	unsigned int revents;
 	struct epitem *epi;
-	struct epoll_event __user *uevent;
+	struct epitem *batch[EP_SEND_BATCH];
+	struct epoll_event kevents[EP_SEND_BATCH];
 
 	/*
 	 * We can loop without lock because we are passed a task private list.
 	 * Items cannot vanish during the loop because ep_scan_ready_list() is
 	 * holding "mtx" during this call.
 	 */
-	for (eventcnt = 0, uevent = esed->events;
-	     !list_empty(head) && eventcnt < esed->maxevents;) {
-		epi = list_first_entry(head, struct epitem, rdllink);
+	for (eventcnt = 0; !list_empty(head) && eventcnt < esed->maxevents;) {
+		/*
+		 * Gather a batch of ready events on the stack and copy them
+		 * out in one go, instead of two user accesses per event.
+		 */
+		for (n = 0; !list_empty(head) && n < EP_SEND_BATCH &&
+			     eventcnt + n < esed->maxevents;) {
+			epi = list_first_entry(head, struct epitem, rdllink);
 
-		list_del_init(&epi->rdllink);
+			list_del_init(&epi->rdllink);
 
-		revents = epi->ffd.file->f_op->poll(epi->ffd.file, NULL) &
-			epi->event.events;
+			revents = epi->ffd.file->f_op->poll(epi->ffd.file, NULL) &
+				epi->event.events;
+			if (!revents)
+				continue;
+
+			kevents[n].events = revents;
+			kevents[n].data = epi->event.data;
+			batch[n++] = epi;
+		}
+		if (!n)
+			break;
+
+		if (__copy_to_user(esed->events + eventcnt, kevents,
+				   n * sizeof(struct epoll_event))) {
+			/* put the batch back, in order, for the next caller */
+			while (n--)
+				list_add(&batch[n]->rdllink, head);
+			return eventcnt ? eventcnt : -EFAULT;
+		}
+		eventcnt += n;
 
 		/*
-		 * If the event mask intersect the caller-requested one,
-		 * deliver the event to userspace. Again, ep_scan_ready_list()
-		 * is holding "mtx", so no operations coming from userspace
-		 * can change the item.
+		 * The events have been delivered to userspace. Again,
+		 * ep_scan_ready_list() is holding "mtx", so no operations
+		 * coming from userspace can change the items.
 		 */
-		if (revents) {
-			if (__put_user(revents, &uevent->events) ||
-			    __put_user(epi->event.data, &uevent->data)) {
-				list_add(&epi->rdllink, head);
-				return eventcnt ? eventcnt : -EFAULT;
-			}
-			eventcnt++;
-			uevent++;
+		for (i = 0; i < n; i++) {
+			epi = batch[i];
 			if (epi->event.events & EPOLLONESHOT)
 				epi->event.events &= EP_PRIVATE_BITS;
 			else if (!(epi->event.events & EPOLLET)) {
@@ -1129,6 +1164,15 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 	jtimeout = (timeout < 0 || timeout >= EP_MAX_MSTIMEO) ?
 		MAX_SCHEDULE_TIMEOUT : (timeout * HZ + 999) / 1000;
 
+	/*
+	 * The caller is back for more, so whatever EPOLLWAKEUP events it
+	 * got last time have been dealt with.
+	 */
+	spin_lock_irqsave(&ep->lock, flags);
+	if (list_empty(&ep->rdllist) && ep->ovflist == EP_UNACTIVE_PTR)
+		wake_unlock(&ep->wake_lock);
+	spin_unlock_irqrestore(&ep->lock, flags);
+
 retry:
 	spin_lock_irqsave(&ep->lock, flags);
 
@@ -7,6 +7,7 @@
 #include <linux/fs.h>
 #include <linux/msdos_fs.h>
 #include <linux/blkdev.h>
+#include <linux/vmalloc.h>
 #include "fat.h"
 
 struct fatent_operations {
@@ -478,6 +479,15 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 	while (count < sbi->max_cluster) {
 		if (fatent.entry >= sbi->max_cluster)
 			fatent.entry = FAT_START_ENT;
+		if (sbi->free_map_valid) {
+			/* skip the FAT blocks without a free entry */
+			int next = find_next_bit(sbi->free_map, sbi->max_cluster,
+						 fatent.entry);
+			count += next - fatent.entry;
+			fatent.entry = next;
+			if (next >= sbi->max_cluster)
+				continue;
+		}
 		fatent_set_entry(&fatent, fatent.entry);
 		err = fat_ent_read_block(sb, &fatent);
 		if (err)
@@ -496,6 +506,8 @@ int fat_alloc_clusters(struct inode *inode, int *cluster, int nr_cluster)
 				fat_collect_bhs(bhs, &nr_bhs, &fatent);
 
 				sbi->prev_free = entry;
+				if (sbi->free_map)
+					__clear_bit(entry, sbi->free_map);
 				if (sbi->free_clusters != -1)
 					sbi->free_clusters--;
 				sb->s_dirt = 1;
@@ -579,6 +591,8 @@ int fat_free_clusters(struct inode *inode, int cluster)
 		}
 
 		ops->ent_put(&fatent, FAT_ENT_FREE);
+		if (sbi->free_map)
+			__set_bit(fatent.entry, sbi->free_map);
 		if (sbi->free_clusters != -1) {
 			sbi->free_clusters++;
 			sb->s_dirt = 1;
@@ -677,3 +691,103 @@ out:
 	unlock_fat(sbi);
 	return err;
 }
+
+/*
+ * Free cluster bitmap. It is built in the background after mount, one
+ * FAT block at a time under the fat lock, while allocations and frees
+ * keep the bits of the blocks already scanned up to date. Once complete
+ * the allocator uses it to jump over full FAT blocks.
+ */
+static struct workqueue_struct *fat_free_map_wq;
+
+static void fat_free_map_build(struct work_struct *work)
+{
+	struct msdos_sb_info *sbi =
+		container_of(work, struct msdos_sb_info, free_map_work);
+	struct super_block *sb = sbi->fat_inode->i_sb;
+	struct fatent_operations *ops = sbi->fatent_ops;
+	struct fat_entry fatent;
+	unsigned long reada_blocks, reada_mask, cur_block;
+	int err = 0;
+
+	reada_blocks = FAT_READA_SIZE >> sb->s_blocksize_bits;
+	reada_mask = reada_blocks - 1;
+	cur_block = 0;
+
+	fatent_init(&fatent);
+	fatent_set_entry(&fatent, FAT_START_ENT);
+	while (fatent.entry < sbi->max_cluster) {
+		if (sbi->free_map_stop)
+			goto out;
+		if ((cur_block & reada_mask) == 0) {
+			unsigned long rest = sbi->fat_length - cur_block;
+			fat_ent_reada(sb, &fatent, min(reada_blocks, rest));
+		}
+		cur_block++;
+
+		lock_fat(sbi);
+		err = fat_ent_read_block(sb, &fatent);
+		if (err) {
+			unlock_fat(sbi);
+			goto out;
+		}
+		do {
+			if (ops->ent_get(&fatent) == FAT_ENT_FREE)
+				__set_bit(fatent.entry, sbi->free_map);
+		} while (fat_ent_next(sbi, &fatent));
+		unlock_fat(sbi);
+		cond_resched();
+	}
+
+	lock_fat(sbi);
+	sbi->free_clusters = bitmap_weight(sbi->free_map, sbi->max_cluster);
+	sbi->free_clus_valid = 1;
+	sbi->free_map_valid = 1;
+	sb->s_dirt = 1;
+	unlock_fat(sbi);
+out:
+	fatent_brelse(&fatent);
+	if (err)
+		printk(KERN_WARNING "FAT: free cluster map not built (%d)\n",
+		       err);
+}
+
+void fat_free_map_init(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+	unsigned long size = BITS_TO_LONGS(sbi->max_cluster) * sizeof(long);
+
+	if (!fat_free_map_wq || (sb->s_flags & MS_RDONLY))
+		return;
+
+	sbi->free_map = vmalloc(size);
+	if (!sbi->free_map)
+		return;
+	memset(sbi->free_map, 0, size);
+	INIT_WORK(&sbi->free_map_work, fat_free_map_build);
+	queue_work(fat_free_map_wq, &sbi->free_map_work);
+}
+
+void fat_free_map_release(struct super_block *sb)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(sb);
+
+	if (!sbi->free_map)
+		return;
+	sbi->free_map_stop = 1;
+	cancel_work_sync(&sbi->free_map_work);
+	vfree(sbi->free_map);
+	sbi->free_map = NULL;
+	sbi->free_map_valid = 0;
+}
+
+int __init fat_free_map_workqueue_init(void)
+{
+	fat_free_map_wq = create_singlethread_workqueue("fat_free_map");
+	return fat_free_map_wq ? 0 : -ENOMEM;
+}
+
+void fat_free_map_workqueue_destroy(void)
+{
+	destroy_workqueue(fat_free_map_wq);
+}
@@ -131,6 +131,11 @@ int fat_generic_ioctl(struct inode *inode, struct file *filp,
 
 static int fat_file_release(struct inode *inode, struct file *filp)
 {
+	if (filp->f_mode & FMODE_WRITE) {
+		mutex_lock(&inode->i_mutex);
+		fat_trim_prealloc(inode);
+		mutex_unlock(&inode->i_mutex);
+	}
 	if ((filp->f_mode & FMODE_WRITE) &&
 	     MSDOS_SB(inode->i_sb)->options.flush) {
 		fat_flush_inodes(inode->i_sb, inode, NULL);
@@ -200,8 +205,34 @@ out:
 	return err;
 }
 
+static int __fat_free(struct inode *inode, int skip, int touch);
+
 /* Free all clusters after the skip'th cluster. */
 static int fat_free(struct inode *inode, int skip)
+{
+	return __fat_free(inode, skip, 1);
+}
+
+/*
+ * Give back the clusters fat_add_cluster() chained ahead of the data.
+ * Caller must hold ->i_mutex.
+ */
+void fat_trim_prealloc(struct inode *inode)
+{
+	struct msdos_sb_info *sbi = MSDOS_SB(inode->i_sb);
+	int nr_clusters;
+
+	if (!MSDOS_I(inode)->i_prealloc)
+		return;
+	MSDOS_I(inode)->i_prealloc = 0;
+
+	nr_clusters = (MSDOS_I(inode)->mmu_private + (sbi->cluster_size - 1))
+		>> sbi->cluster_bits;
+	/* nothing of the file changed, leave the times alone */
+	__fat_free(inode, nr_clusters, 0);
+}
+
+static int __fat_free(struct inode *inode, int skip, int touch)
 {
 	struct super_block *sb = inode->i_sb;
 	int err, wait, free_start, i_start, i_logstart;
@@ -220,8 +251,10 @@ static int fat_free(struct inode *inode, int skip)
 		MSDOS_I(inode)->i_start = 0;
 		MSDOS_I(inode)->i_logstart = 0;
 	}
-	MSDOS_I(inode)->i_attrs |= ATTR_ARCH;
-	inode->i_ctime = inode->i_mtime = CURRENT_TIME_SEC;
+	if (touch) {
+		MSDOS_I(inode)->i_attrs |= ATTR_ARCH;
+		inode->i_ctime = inode->i_mtime = CURRENT_TIME_SEC;
+	}
 	if (wait) {
 		err = fat_sync_inode(inode);
 		if (err) {
@@ -282,6 +315,8 @@ void fat_truncate(struct inode *inode)
 	 */
 	if (MSDOS_I(inode)->mmu_private > inode->i_size)
 		MSDOS_I(inode)->mmu_private = inode->i_size;
+	/* everything past i_size goes, preallocated clusters included */
+	MSDOS_I(inode)->i_prealloc = 0;
 
 	nr_clusters = (inode->i_size + (cluster_size - 1)) >> sbi->cluster_bits;
 
@@ -39,19 +39,45 @@ static int fat_default_codepage = CONFIG_FAT_DEFAULT_CODEPAGE;
 static char fat_default_iocharset[] = CONFIG_FAT_DEFAULT_IOCHARSET;
 
 
+/* most fat_alloc_clusters() takes at once */
+#define FAT_PREALLOC_CLUSTERS	(MAX_BUF_PER_PAGE / 2)
+
 static int fat_add_cluster(struct inode *inode)
 {
-	int err, cluster;
+	struct msdos_inode_info *i = MSDOS_I(inode);
+	int err, cluster[FAT_PREALLOC_CLUSTERS], nr = 1;
 
-	err = fat_alloc_clusters(inode, &cluster, 1);
+	/* the next cluster was already chained by an earlier extension */
+	if (i->i_prealloc) {
+		i->i_prealloc--;
+		return 0;
+	}
+
+	/*
+	 * A regular file that already grows past its first cluster is
+	 * likely to keep growing (recording, copying), so chain a few
+	 * clusters in one FAT pass. The unused ones are given back when
+	 * the file is closed or truncated.
+	 */
+	if (S_ISREG(inode->i_mode) && i->i_start)
+		nr = FAT_PREALLOC_CLUSTERS;
+
+	err = fat_alloc_clusters(inode, cluster, nr);
+	if (err == -ENOSPC && nr > 1) {
+		nr = 1;
+		err = fat_alloc_clusters(inode, cluster, nr);
+	}
 	if (err)
 		return err;
 	/* FIXME: this cluster should be added after data of this
 	 * cluster is writed */
-	err = fat_chain_add(inode, cluster, 1);
-	if (err)
-		fat_free_clusters(inode, cluster);
-	return err;
+	err = fat_chain_add(inode, cluster[0], nr);
+	if (err) {
+		fat_free_clusters(inode, cluster[0]);
+		return err;
+	}
+	i->i_prealloc = nr - 1;
+	return 0;
 }
 
 static inline int __fat_get_block(struct inode *inode, sector_t iblock,
@@ -469,6 +495,8 @@ static void fat_put_super(struct super_block *sb)
 
 	lock_kernel();
 
+	fat_free_map_release(sb);
+
 	if (sb->s_dirt)
 		fat_write_super(sb);
 
@@ -494,6 +522,7 @@ static struct inode *fat_alloc_inode(struct super_block *sb)
 	ei = kmem_cache_alloc(fat_inode_cachep, GFP_NOFS);
 	if (!ei)
 		return NULL;
+	ei->i_prealloc = 0;
 	return &ei->vfs_inode;
 }
 
@@ -1482,6 +1511,8 @@ int fat_fill_super(struct super_block *sb, void *data, int silent,
 		goto out_fail;
 	}
 
+	fat_free_map_init(sb);
+
 	return 0;
 
 out_invalid:
@@ -1570,6 +1601,10 @@ static int __init init_fat_fs(void)
 	if (err)
 		goto failed;
 
+	/* without it the allocator just scans the FAT as before */
+	if (fat_free_map_workqueue_init())
+		printk(KERN_WARNING "FAT: no free cluster map workqueue\n");
+
 	return 0;
 
 failed:
@@ -1579,6 +1614,7 @@ failed:
 
 static void __exit exit_fat_fs(void)
 {
+	fat_free_map_workqueue_destroy();
 	fat_cache_destroy();
 	fat_destroy_inodecache();
 }
@@ -310,7 +310,9 @@ void journal_commit_transaction(journal_t *journal)
 	int err;
 	unsigned int blocknr;
 	ktime_t start_time;
-	u64 commit_time;
+	u64 commit_time, batch_time = 0;
+	unsigned int nr_blocks;
+	struct journal_commit_stats *cs;
 	char *tagp = NULL;
 	journal_header_t *header;
 	journal_block_tag_t *tag = NULL;
@@ -432,6 +434,9 @@ void journal_commit_transaction(journal_t *journal)
 	journal->j_committing_transaction = commit_transaction;
 	journal->j_running_transaction = NULL;
 	start_time = ktime_get();
+	if (commit_transaction->t_batch_start.tv64)
+		batch_time = ktime_to_ns(ktime_sub(start_time,
+					commit_transaction->t_batch_start));
 	commit_transaction->t_log_start = journal->j_head;
 	wake_up(&journal->j_wait_transaction_locked);
 	spin_unlock(&journal->j_state_lock);
@@ -527,6 +532,7 @@ void journal_commit_transaction(journal_t *journal)
 
 	J_ASSERT(commit_transaction->t_nr_buffers <=
 		 commit_transaction->t_outstanding_credits);
+	nr_blocks = commit_transaction->t_nr_buffers;
 
 	descriptor = NULL;
 	bufs = 0;
@@ -942,6 +948,20 @@ restart_loop:
 	else
 		journal->j_average_commit_time = commit_time;
 
+	journal->j_commits++;
+	journal->j_commit_blocks += nr_blocks;
+	journal->j_commit_waiters += commit_transaction->t_commit_waiters;
+	if (commit_time > journal->j_max_commit_time)
+		journal->j_max_commit_time = commit_time;
+	cs = &journal->j_history[journal->j_history_cur];
+	cs->cs_tid = commit_transaction->t_tid;
+	cs->cs_blocks = nr_blocks;
+	cs->cs_waiters = commit_transaction->t_commit_waiters;
+	cs->cs_batch_us = div_u64(batch_time, 1000);
+	cs->cs_commit_us = div_u64(commit_time, 1000);
+	journal->j_history_cur = (journal->j_history_cur + 1) %
+				 JBD_COMMIT_HISTORY;
+
 	spin_unlock(&journal->j_state_lock);
 
 	if (commit_transaction->t_checkpoint_list == NULL &&
@@ -35,7 +35,9 @@
 #include <linux/kthread.h>
 #include <linux/poison.h>
 #include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include <linux/debugfs.h>
+#include <linux/hrtimer.h>
 
 #include <asm/uaccess.h>
 #include <asm/page.h>
@@ -68,6 +70,7 @@ EXPORT_SYMBOL(journal_set_features);
 EXPORT_SYMBOL(journal_create);
 EXPORT_SYMBOL(journal_load);
 EXPORT_SYMBOL(journal_destroy);
+EXPORT_SYMBOL(journal_set_batch_window);
 EXPORT_SYMBOL(journal_abort);
 EXPORT_SYMBOL(journal_errno);
 EXPORT_SYMBOL(journal_ack_err);
@@ -96,6 +99,43 @@ static void commit_timeout(unsigned long __data)
 	wake_up_process(p);
 }
 
+/*
+ * Commit batching: a requested commit of the running transaction is held
+ * back until j_batch_window has passed since the first request, so that
+ * the fsyncs arriving meanwhile go out in the same commit instead of one
+ * commit each.  The window bounds the extra latency.  Called with
+ * j_state_lock held, returns 1 if it dropped the lock to sleep.
+ */
+static int journal_batch_wait(journal_t *journal)
+{
+	transaction_t *transaction = journal->j_running_transaction;
+	ktime_t expires;
+	DEFINE_WAIT(wait);
+
+	if (!journal->j_batch_window || !transaction ||
+	    transaction->t_tid != journal->j_commit_request ||
+	    !transaction->t_batch_start.tv64)
+		return 0;
+
+	/* nobody gains from waiting while the log fills up */
+	if (transaction->t_outstanding_credits >
+			journal->j_max_transaction_buffers / 2 ||
+	    (journal->j_flags & JFS_UNMOUNT) || freezing(current))
+		return 0;
+
+	expires = ktime_add_us(transaction->t_batch_start,
+			       journal->j_batch_window);
+	if (ktime_to_ns(ktime_sub(expires, ktime_get())) <= 0)
+		return 0;
+
+	prepare_to_wait(&journal->j_wait_commit, &wait, TASK_INTERRUPTIBLE);
+	spin_unlock(&journal->j_state_lock);
+	schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+	spin_lock(&journal->j_state_lock);
+	finish_wait(&journal->j_wait_commit, &wait);
+	return 1;
+}
+
 /*
  * kjournald: The main thread function used to manage a logging device
  * journal.
@@ -145,6 +185,8 @@ loop:
 
 	if (journal->j_commit_sequence != journal->j_commit_request) {
 		jbd_debug(1, "OK, requests differ\n");
+		if (journal_batch_wait(journal))
+			goto loop;
 		spin_unlock(&journal->j_state_lock);
 		del_timer_sync(&journal->j_commit_timer);
 		journal_commit_transaction(journal);
@@ -443,6 +485,12 @@ int __log_start_commit(journal_t *journal, tid_t target)
 		 * commit thread.  We do _not_ do the commit ourselves.
 		 */
 
+		transaction_t *transaction = journal->j_running_transaction;
+
+		if (transaction && transaction->t_tid == target &&
+		    !transaction->t_batch_start.tv64)
+			transaction->t_batch_start = ktime_get();
+
 		journal->j_commit_request = target;
 		jbd_debug(1, "JBD: requesting commit %d/%d\n",
 			  journal->j_commit_request,
@@ -528,6 +576,34 @@ int journal_start_commit(journal_t *journal, tid_t *ptid)
 	return ret;
 }
 
+/*
+ * Account a process waiting for transaction @tid in the commit stats.
+ */
+static void journal_count_waiter(journal_t *journal, tid_t tid)
+{
+	transaction_t *transaction = journal->j_running_transaction;
+
+	if (!transaction || transaction->t_tid != tid)
+		transaction = journal->j_committing_transaction;
+	if (transaction && transaction->t_tid == tid)
+		transaction->t_commit_waiters++;
+}
+
+/**
+ * void journal_set_batch_window() - set the commit batching window
+ * @journal: journal to set it for
+ * @usecs: how long a requested commit may wait for others, 0 disables
+ *
+ * The window is clamped to JBD_MAX_BATCH_WINDOW.
+ */
+void journal_set_batch_window(journal_t *journal, unsigned int usecs)
+{
+	spin_lock(&journal->j_state_lock);
+	journal->j_batch_window = min_t(unsigned int, usecs,
+					JBD_MAX_BATCH_WINDOW);
+	spin_unlock(&journal->j_state_lock);
+}
+
 /*
  * Wait for a specified commit to complete.
  * The caller may not hold the journal lock.
@@ -546,6 +622,8 @@ int log_wait_commit(journal_t *journal, tid_t tid)
 	spin_unlock(&journal->j_state_lock);
 #endif
 	spin_lock(&journal->j_state_lock);
+	if (tid_gt(tid, journal->j_commit_sequence))
+		journal_count_waiter(journal, tid);
 	while (tid_gt(tid, journal->j_commit_sequence)) {
 		jbd_debug(1, "JBD: want %d, j_commit_sequence=%d\n",
 				  tid, journal->j_commit_sequence);
@@ -650,6 +728,115 @@ struct journal_head *journal_get_descriptor_buffer(journal_t *journal)
 	return journal_add_journal_head(bh);
 }
 
+#ifdef CONFIG_PROC_FS
+
+#define JBD_STATS_PROC_NAME "fs/jbd"
+
+static struct proc_dir_entry *proc_jbd_stats;
+
+static int jbd_seq_info_show(struct seq_file *seq, void *v)
+{
+	journal_t *journal = seq->private;
+	struct journal_commit_stats *hist;
+	unsigned long commits, blocks, waiters;
+	u64 avg, max;
+	unsigned int window;
+	int i, cur;
+
+	hist = kmalloc(sizeof(journal->j_history), GFP_KERNEL);
+	if (!hist)
+		return -ENOMEM;
+
+	spin_lock(&journal->j_state_lock);
+	memcpy(hist, journal->j_history, sizeof(journal->j_history));
+	cur = journal->j_history_cur;
+	commits = journal->j_commits;
+	blocks = journal->j_commit_blocks;
+	waiters = journal->j_commit_waiters;
+	avg = journal->j_average_commit_time;
+	max = journal->j_max_commit_time;
+	window = journal->j_batch_window;
+	spin_unlock(&journal->j_state_lock);
+
+	seq_printf(seq, "%lu transactions, each up to %u blocks\n",
+		   commits, journal->j_max_transaction_buffers);
+	seq_printf(seq, "batch window %uus\n", window);
+	if (commits) {
+		seq_printf(seq, "average:\n  %lu blocks per transaction\n",
+			   blocks / commits);
+		seq_printf(seq, "  %lu waiters per transaction\n",
+			   waiters / commits);
+		seq_printf(seq, "  %lluus transaction commit time\n",
+			   div_u64(avg, 1000));
+		seq_printf(seq, "max:\n  %lluus transaction commit time\n",
+			   div_u64(max, 1000));
+	}
+
+	seq_printf(seq, "history:\n  tid blocks waiters batch_us commit_us\n");
+	for (i = 0; i < JBD_COMMIT_HISTORY; i++) {
+		struct journal_commit_stats *cs;
+
+		cs = &hist[(cur + i) % JBD_COMMIT_HISTORY];
+		if (!cs->cs_tid)
+			continue;
+		seq_printf(seq, "  %u %u %u %u %u\n", cs->cs_tid,
+			   cs->cs_blocks, cs->cs_waiters, cs->cs_batch_us,
+			   cs->cs_commit_us);
+	}
+	kfree(hist);
+	return 0;
+}
+
+static int jbd_seq_info_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jbd_seq_info_show, PDE(inode)->data);
+}
+
+static const struct file_operations jbd_seq_info_fops = {
+	.owner		= THIS_MODULE,
+	.open		= jbd_seq_info_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void jbd_stats_proc_init(journal_t *journal)
+{
+	journal->j_proc_entry = proc_mkdir(journal->j_devname, proc_jbd_stats);
+	if (journal->j_proc_entry) {
+		proc_create_data("info", S_IRUGO, journal->j_proc_entry,
+				 &jbd_seq_info_fops, journal);
+	}
+}
+
+static void jbd_stats_proc_exit(journal_t *journal)
+{
+	if (!journal->j_proc_entry)
+		return;
+	remove_proc_entry("info", journal->j_proc_entry);
+	remove_proc_entry(journal->j_devname, proc_jbd_stats);
+}
+
+static void __init jbd_create_jbd_stats_proc_entry(void)
+{
+	proc_jbd_stats = proc_mkdir(JBD_STATS_PROC_NAME, NULL);
+}
+
+static void __exit jbd_remove_jbd_stats_proc_entry(void)
+{
+	if (proc_jbd_stats)
+		remove_proc_entry(JBD_STATS_PROC_NAME, NULL);
+}
+
+#else
+
+#define jbd_stats_proc_init(journal) do {} while (0)
+#define jbd_stats_proc_exit(journal) do {} while (0)
+#define jbd_create_jbd_stats_proc_entry() do {} while (0)
+#define jbd_remove_jbd_stats_proc_entry() do {} while (0)
+
+#endif
+
 /*
  * Management for journal control blocks: functions to create and
  * destroy journal_t structures, and to initialise and read existing
@@ -725,6 +912,7 @@ journal_t * journal_init_dev(struct block_device *bdev,
 {
 	journal_t *journal = journal_init_common();
 	struct buffer_head *bh;
+	char *p;
 	int n;
 
 	if (!journal)
@@ -744,6 +932,10 @@ journal_t * journal_init_dev(struct block_device *bdev,
 	journal->j_fs_dev = fs_dev;
 	journal->j_blk_offset = start;
 	journal->j_maxlen = len;
+	bdevname(journal->j_dev, journal->j_devname);
+	p = journal->j_devname;
+	while ((p = strchr(p, '/')))
+		*p = '!';
 
 	bh = __getblk(journal->j_dev, start, journal->j_blocksize);
 	if (!bh) {
@@ -754,6 +946,7 @@ journal_t * journal_init_dev(struct block_device *bdev,
 	}
 	journal->j_sb_buffer = bh;
 	journal->j_superblock = (journal_superblock_t *)bh->b_data;
+	jbd_stats_proc_init(journal);
 
 	return journal;
 out_err:
@@ -774,6 +967,7 @@ journal_t * journal_init_inode (struct inode *inode)
 {
 	struct buffer_head *bh;
 	journal_t *journal = journal_init_common();
+	char *p;
 	int err;
 	int n;
 	unsigned int blocknr;
@@ -783,6 +977,12 @@ journal_t * journal_init_inode (struct inode *inode)
 
 	journal->j_dev = journal->j_fs_dev = inode->i_sb->s_bdev;
 	journal->j_inode = inode;
+	bdevname(journal->j_dev, journal->j_devname);
+	p = journal->j_devname;
+	while ((p = strchr(p, '/')))
+		*p = '!';
+	p = journal->j_devname + strlen(journal->j_devname);
+	sprintf(p, "-%lu", journal->j_inode->i_ino);
 	jbd_debug(1,
 		  "journal %p: inode %s/%ld, size %Ld, bits %d, blksize %ld\n",
 		  journal, inode->i_sb->s_id, inode->i_ino,
@@ -819,6 +1019,7 @@ journal_t * journal_init_inode (struct inode *inode)
 	}
 	journal->j_sb_buffer = bh;
 	journal->j_superblock = (journal_superblock_t *)bh->b_data;
+	jbd_stats_proc_init(journal);
 
 	return journal;
 out_err:
@@ -1192,6 +1393,7 @@ int journal_destroy(journal_t *journal)
 		brelse(journal->j_sb_buffer);
 	}
 
+	jbd_stats_proc_exit(journal);
 	if (journal->j_inode)
 		iput(journal->j_inode);
 	if (journal->j_revoke)
@@ -1991,6 +2193,7 @@ static int __init journal_init(void)
 	if (ret != 0)
 		journal_destroy_caches();
 	jbd_create_debugfs_entry();
+	jbd_create_jbd_stats_proc_entry();
 	return ret;
 }
 
@@ -2002,6 +2205,7 @@ static void __exit journal_exit(void)
 		printk(KERN_EMERG "JBD: leaked %d journal_heads!\n", n);
 #endif
 	jbd_remove_debugfs_entry();
+	jbd_remove_jbd_stats_proc_entry();
 	journal_destroy_caches();
 }
 
@@ -51,6 +51,7 @@ extern const char *yaffs_guts_c_version;
 #include <linux/interrupt.h>
 #include <linux/string.h>
 #include <linux/ctype.h>
+#include <linux/kthread.h>
 
 #include "asm/div64.h"
 
@@ -121,16 +122,19 @@ static uint32_t YCALCBLOCKS(uint64_t partition_size, uint32_t block_size)
 unsigned int yaffs_traceMask = YAFFS_TRACE_BAD_BLOCKS;
 unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
+unsigned int yaffs_lowmem_pagecache = 1;
 
 /* Module Parameters */
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
 module_param(yaffs_traceMask, uint, 0644);
 module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
+module_param(yaffs_lowmem_pagecache, uint, 0644);
 #else
 MODULE_PARM(yaffs_traceMask, "i");
 MODULE_PARM(yaffs_wr_attempts, "i");
 MODULE_PARM(yaffs_auto_checkpoint, "i");
+MODULE_PARM(yaffs_lowmem_pagecache, "i");
 #endif
 
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 25))
@@ -375,9 +379,71 @@ static void yaffs_GrossLock(yaffs_Device *dev)
 static void yaffs_GrossUnlock(yaffs_Device *dev)
 {
 	T(YAFFS_TRACE_OS, ("yaffs unlocking %p\n", current));
+	dev->lastActivity = jiffies;
 	up(&dev->grossLock);
 }
 
+/* Background gc looks for work this often, and counts the device as idle
+ * once nothing has taken the gross lock for YAFFS_BG_GC_IDLE.
+ */
+#define YAFFS_BG_GC_PERIOD	(HZ / 2)
+#define YAFFS_BG_GC_IDLE	(2 * HZ)
+
+static int yaffs_bg_gc_thread(void *data)
+{
+	struct super_block *sb = data;
+	yaffs_Device *dev = yaffs_SuperToDevice(sb);
+	int idle;
+	int more;
+
+	while (!kthread_should_stop()) {
+		more = 0;
+		idle = time_after(jiffies, dev->lastActivity + YAFFS_BG_GC_IDLE);
+
+		/* Never queue up behind the lock: if it is taken the
+		 * device is busy and we would only get in the way.
+		 */
+		if (!(sb->s_flags & MS_RDONLY) &&
+		    !down_trylock(&dev->grossLock)) {
+			more = yaffs_BackgroundGarbageCollect(dev, idle);
+			up(&dev->grossLock);
+		}
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop())
+			schedule_timeout(more ? 1 : YAFFS_BG_GC_PERIOD);
+		__set_current_state(TASK_RUNNING);
+	}
+
+	return 0;
+}
+
+static void yaffs_start_bg_gc(struct super_block *sb)
+{
+	yaffs_Device *dev = yaffs_SuperToDevice(sb);
+	struct task_struct *thread;
+
+	dev->lastActivity = jiffies;
+	thread = kthread_run(yaffs_bg_gc_thread, sb, "yaffs-gc-%s", dev->name);
+	if (IS_ERR(thread)) {
+		T(YAFFS_TRACE_ALWAYS,
+		  ("yaffs: no background gc for \"%s\"\n", dev->name));
+		return;
+	}
+	dev->bgGCThread = thread;
+	dev->backgroundGC = 1;
+}
+
+static void yaffs_stop_bg_gc(yaffs_Device *dev)
+{
+	if (!dev->bgGCThread)
+		return;
+
+	dev->backgroundGC = 0;
+	kthread_stop(dev->bgGCThread);
+	dev->bgGCThread = NULL;
+}
+
 
 /*-----------------------------------------------------------------*/
 /* Directory search context allows us to unlock access to yaffs during
@@ -1107,6 +1173,15 @@ static void yaffs_FillInodeFromObject(struct inode *inode, yaffs_Object *obj)
 			inode->i_fop = &yaffs_file_operations;
 			inode->i_mapping->a_ops =
 				&yaffs_file_address_operations;
+			/*
+			 * Every read and write of a yaffs page goes through
+			 * kmap() under the gross lock; keep the pages in
+			 * lowmem so that is free.
+			 */
+			if (yaffs_lowmem_pagecache)
+				mapping_set_gfp_mask(inode->i_mapping,
+					mapping_gfp_mask(inode->i_mapping) &
+					~__GFP_HIGHMEM);
 			break;
 		case S_IFDIR:	/* directory */
 			inode->i_op = &yaffs_dir_inode_operations;
@@ -1897,6 +1972,8 @@ static void yaffs_put_super(struct super_block *sb)
 
 	T(YAFFS_TRACE_OS, ("yaffs_put_super\n"));
 
+	yaffs_stop_bg_gc(dev);
+
 	yaffs_GrossLock(dev);
 
 	yaffs_FlushEntireDeviceCache(dev);
@@ -1947,8 +2024,14 @@ typedef struct {
 	int skip_checkpoint_read;
 	int skip_checkpoint_write;
 	int no_cache;
+	int cache_size;
+	int write_behind_overridden;
+	int write_behind;
 	int empty_lost_and_found_overridden;
 	int empty_lost_and_found;
+	int background_scan_overridden;
+	int background_scan;
+	int no_background_gc;
 } yaffs_options;
 
 #define MAX_OPT_LEN 20
@@ -1979,6 +2062,32 @@ static int yaffs_parse_options(yaffs_options *options, const char *options_str)
 			options->inband_tags = 1;
 		else if (!strcmp(cur_opt, "no-cache"))
 			options->no_cache = 1;
+		else if (!strncmp(cur_opt, "cache-size=", 11)) {
+			char *end;
+
+			options->cache_size =
+				simple_strtoul(cur_opt + 11, &end, 0);
+			if (*end || options->cache_size < 1 ||
+			    options->cache_size > YAFFS_MAX_SHORT_OP_CACHES) {
+				printk(KERN_INFO
+					"yaffs: Bad cache size \"%s\"\n",
+					cur_opt + 11);
+				error = 1;
+			}
+		}
+		else if (!strncmp(cur_opt, "write-behind=", 13)) {
+			char *end;
+
+			options->write_behind =
+				simple_strtoul(cur_opt + 13, &end, 0);
+			options->write_behind_overridden = 1;
+			if (*end) {
+				printk(KERN_INFO
+					"yaffs: Bad write-behind \"%s\"\n",
+					cur_opt + 13);
+				error = 1;
+			}
+		}
 		else if (!strcmp(cur_opt, "no-checkpoint-read"))
 			options->skip_checkpoint_read = 1;
 		else if (!strcmp(cur_opt, "no-checkpoint-write"))
@@ -1992,6 +2101,14 @@ static int yaffs_parse_options(yaffs_options *options, const char *options_str)
 		} else if (!strcmp(cur_opt, "empty-lost-and-found-enable")) {
 			options->empty_lost_and_found = 1;
 			options->empty_lost_and_found_overridden = 1;
+		} else if (!strcmp(cur_opt, "bg-scan")) {
+			options->background_scan = 1;
+			options->background_scan_overridden = 1;
+		} else if (!strcmp(cur_opt, "no-bg-scan")) {
+			options->background_scan = 0;
+			options->background_scan_overridden = 1;
+		} else if (!strcmp(cur_opt, "no-bg-gc")) {
+			options->no_background_gc = 1;
 		} else {
 			printk(KERN_INFO "yaffs: Bad mount option \"%s\"\n",
 					cur_opt);
@@ -2002,6 +2119,43 @@ static int yaffs_parse_options(yaffs_options *options, const char *options_str)
 	return error;
 }
 
+/* Finish a mount that was left with dev->scanPending, under the gross lock */
+static void yaffs_finish_scan(struct super_block *sb)
+{
+	yaffs_Device *dev = yaffs_SuperToDevice(sb);
+
+	if (yaffs_GutsFinishScan(dev) != YAFFS_OK) {
+		/* The tree is incomplete, don't let anything be written
+		 * on the strength of it, least of all a checkpoint.
+		 */
+		T(YAFFS_TRACE_ALWAYS,
+		  ("yaffs: scan of \"%s\" failed, mounted read only\n",
+		   dev->name));
+		dev->skipCheckpointWrite = 1;
+		sb->s_flags |= MS_RDONLY;
+		return;
+	}
+
+	/* Checkpoint straight away so that losing power before the
+	 * first write does not cost another full scan.
+	 */
+	yaffs_CheckpointSave(dev);
+	sb->s_dirt = !dev->isCheckpointed;
+}
+
+static int yaffs_scan_thread(void *data)
+{
+	struct super_block *sb = data;
+	yaffs_Device *dev = yaffs_SuperToDevice(sb);
+
+	/* The mount handed the gross lock over to us, so every operation on
+	 * the new mount waits here until the tree is complete.
+	 */
+	yaffs_finish_scan(sb);
+	yaffs_GrossUnlock(dev);
+	return 0;
+}
+
 static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 						struct super_block *sb,
 						void *data, int silent)
@@ -2203,7 +2357,16 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	dev->nChunksPerBlock = YAFFS_CHUNKS_PER_BLOCK;
 	dev->totalBytesPerChunk = YAFFS_BYTES_PER_CHUNK;
 	dev->nReservedBlocks = 5;
-	dev->nShortOpCaches = (options.no_cache) ? 0 : 10;
+	if (options.no_cache)
+		dev->nShortOpCaches = 0;
+	else if (options.cache_size)
+		dev->nShortOpCaches = options.cache_size;
+	else
+		dev->nShortOpCaches = CONFIG_YAFFS_SHORT_OP_CACHES;
+	if (options.write_behind_overridden)
+		dev->nWriteBehindChunks = options.write_behind;
+	else
+		dev->nWriteBehindChunks = YAFFS_WRITE_BEHIND_CHUNKS;
 	dev->inbandTags = options.inband_tags;
 
 	/* ... and the functions. */
@@ -2263,6 +2426,12 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	dev->skipCheckpointRead = options.skip_checkpoint_read;
 	dev->skipCheckpointWrite = options.skip_checkpoint_write;
 
+#ifdef CONFIG_YAFFS_BACKGROUND_SCAN
+	dev->deferScan = 1;
+#endif
+	if (options.background_scan_overridden)
+		dev->deferScan = options.background_scan;
+
 	/* we assume this is protected by lock_kernel() in mount/umount */
 	ylist_add_tail(&dev->devList, &yaffs_dev_list);
 
@@ -2309,6 +2478,24 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	T(YAFFS_TRACE_ALWAYS,
 	  ("yaffs_read_super: isCheckpointed %d\n", dev->isCheckpointed));
 
+	if (dev->scanPending) {
+		struct task_struct *scanner;
+
+		T(YAFFS_TRACE_ALWAYS,
+		  ("yaffs_read_super: scanning \"%s\" in the background\n",
+		   dev->name));
+		yaffs_GrossLock(dev);
+		scanner = kthread_run(yaffs_scan_thread, sb, "yaffs-scan-%s",
+				      dev->name);
+		if (IS_ERR(scanner)) {
+			yaffs_finish_scan(sb);
+			yaffs_GrossUnlock(dev);
+		}
+	}
+
+	if (!options.no_background_gc && !(sb->s_flags & MS_RDONLY))
+		yaffs_start_bg_gc(sb);
+
 	T(YAFFS_TRACE_OS, ("yaffs_read_super: done\n"));
 	return sb;
 }
@@ -2423,6 +2610,11 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "blocksInCheckpoint. %d\n", dev->blocksInCheckpoint);
 	buf += sprintf(buf, "nTnodesCreated..... %d\n", dev->nTnodesCreated);
 	buf += sprintf(buf, "nFreeTnodes........ %d\n", dev->nFreeTnodes);
+	buf += sprintf(buf, "nEvictedFiles...... %d\n", dev->nEvictedFiles);
+	buf += sprintf(buf, "nTnodeEvictions.... %d\n", dev->nTnodeEvictions);
+	buf += sprintf(buf, "nTnodeRestores..... %d\n", dev->nTnodeRestores);
+	buf += sprintf(buf, "nTnodeBlocksFreed.. %d\n",
+		    dev->nTnodeBlocksReleased);
 	buf += sprintf(buf, "nObjectsCreated.... %d\n", dev->nObjectsCreated);
 	buf += sprintf(buf, "nFreeObjects....... %d\n", dev->nFreeObjects);
 	buf += sprintf(buf, "nFreeChunks........ %d\n", dev->nFreeChunks);
@@ -2433,8 +2625,16 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "garbageCollections. %d\n", dev->garbageCollections);
 	buf += sprintf(buf, "passiveGCs......... %d\n",
 		    dev->passiveGarbageCollections);
+	buf += sprintf(buf, "backgroundGCs...... %d\n",
+		    dev->backgroundGarbageCollections);
 	buf += sprintf(buf, "nRetriedWrites..... %d\n", dev->nRetriedWrites);
 	buf += sprintf(buf, "nShortOpCaches..... %d\n", dev->nShortOpCaches);
+	buf += sprintf(buf, "nWriteBehindChunks. %d\n",
+		    dev->nWriteBehindChunks);
+	buf += sprintf(buf, "writeBehindStaged.. %d\n",
+		    dev->nWriteBehindStaged);
+	buf += sprintf(buf, "writeBehindFlushes. %d\n",
+		    dev->nWriteBehindFlushes);
 	buf += sprintf(buf, "nRetireBlocks...... %d\n", dev->nRetiredBlocks);
 	buf += sprintf(buf, "eccFixed........... %d\n", dev->eccFixed);
 	buf += sprintf(buf, "eccUnfixed......... %d\n", dev->eccUnfixed);
@@ -2448,6 +2648,7 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "useNANDECC......... %d\n", dev->useNANDECC);
 	buf += sprintf(buf, "isYaffs2........... %d\n", dev->isYaffs2);
 	buf += sprintf(buf, "inbandTags......... %d\n", dev->inbandTags);
+	buf += sprintf(buf, "scanPending........ %d\n", dev->scanPending);
 
 	return buf;
 }
@@ -2627,6 +2828,48 @@ static int yaffs_proc_write(struct file *file, const char *buf,
 	return count;
 }
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 23))
+/*
+ * Tnode trees of files that no longer have an inode are rebuilt from flash
+ * when next used, so under memory pressure we give them up. Devices that
+ * are busy are skipped rather than waited for; reclaim may well be running
+ * on behalf of the very task that holds the gross lock.
+ */
+static int yaffs_shrink_tnodes(int nr_to_scan, gfp_t gfp_mask)
+{
+	struct ylist_head *item;
+	yaffs_Device *dev;
+	int nTnodes = 0;
+
+	if (nr_to_scan && !(gfp_mask & __GFP_FS))
+		return -1;
+
+	/* hold lock_kernel while traversing yaffs_dev_list */
+	lock_kernel();
+
+	ylist_for_each(item, &yaffs_dev_list) {
+		dev = ylist_entry(item, yaffs_Device, devList);
+		if (down_trylock(&dev->grossLock))
+			continue;
+		if (dev->isMounted && !dev->scanPending) {
+			if (nr_to_scan)
+				yaffs_EvictTnodes(dev, nr_to_scan);
+			nTnodes += dev->nTnodesCreated - dev->nFreeTnodes;
+		}
+		up(&dev->grossLock);
+	}
+
+	unlock_kernel();
+
+	return nTnodes;
+}
+
+static struct shrinker yaffs_tnode_shrinker = {
+	.shrink = yaffs_shrink_tnodes,
+	.seeks = DEFAULT_SEEKS * 2,
+};
+#endif
+
 /* Stuff to handle installation of file systems */
 struct file_system_to_install {
 	struct file_system_type *fst;
@@ -2683,6 +2926,11 @@ static int __init init_yaffs_fs(void)
 		}
 	}
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 23))
+	if (!error)
+		register_shrinker(&yaffs_tnode_shrinker);
+#endif
+
 	return error;
 }
 
@@ -2694,6 +2942,10 @@ static void __exit exit_yaffs_fs(void)
 	T(YAFFS_TRACE_ALWAYS, ("yaffs " __DATE__ " " __TIME__
 			       " removing. \n"));
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 23))
+	unregister_shrinker(&yaffs_tnode_shrinker);
+#endif
+
 	remove_proc_entry("yaffs", YPROC_ROOT);
 
 	fsinst = fs_to_install;
@@ -35,6 +35,12 @@ const char *yaffs_guts_c_version =
 
 #define YAFFS_PASSIVE_GC_CHUNKS 2
 
+/* Erased blocks background gc keeps in hand on top of the reserve, and
+ * the most chunks in use a block may have to be collected while idle.
+ */
+#define YAFFS_BG_GC_SPARE_BLOCKS 8
+#define YAFFS_BG_GC_CHUNKS(dev) ((dev)->nChunksPerBlock / 4)
+
 #include "yaffs_ecc.h"
 
 
@@ -69,6 +75,7 @@ static void yaffs_AddObjectToDirectory(yaffs_Object *directory,
 static int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name,
 				int force, int isShrink, int shadows);
 static void yaffs_RemoveObjectFromDirectory(yaffs_Object *obj);
+static void yaffs_HashObjectName(yaffs_Object *obj);
 static int yaffs_CheckStructures(void);
 static int yaffs_DeleteWorker(yaffs_Object *in, yaffs_Tnode *tn, __u32 level,
 			int chunkOffset, int *limit);
@@ -112,6 +119,7 @@ static __u32 yaffs_GetChunkGroupBase(yaffs_Device *dev, yaffs_Tnode *tn,
 static yaffs_Tnode *yaffs_FindLevel0Tnode(yaffs_Device *dev,
 					yaffs_FileStructure *fStruct,
 					__u32 chunkId);
+static int yaffs_RestoreFileTnodes(yaffs_Object *obj);
 
 /* Function to calculate chunk and offset */
 
@@ -661,6 +669,10 @@ static void yaffs_VerifyFile(yaffs_Object *obj)
 	if (yaffs_SkipVerification(obj->myDev))
 		return;
 
+	/* Nothing to check while the tnode tree is evicted */
+	if (obj->variant.fileVariant.evictedBlocks)
+		return;
+
 	dev = obj->myDev;
 	objectId = obj->objectId;
 
@@ -841,7 +853,7 @@ static void yaffs_VerifyObjects(yaffs_Device *dev)
 
 	/* Iterate through the objects in each hash entry */
 
-	for (i = 0; i <  YAFFS_NOBJECT_BUCKETS; i++) {
+	for (i = 0; i <  dev->nObjectBuckets; i++) {
 		ylist_for_each(lh, &dev->objectBucket[i].list) {
 			if (lh) {
 				obj = ylist_entry(lh, yaffs_Object, hashLink);
@@ -856,10 +868,10 @@ static void yaffs_VerifyObjects(yaffs_Device *dev)
  *  Simple hash function. Needs to have a reasonable spread
  */
 
-static Y_INLINE int yaffs_HashFunction(int n)
+static Y_INLINE int yaffs_HashFunction(yaffs_Device *dev, int n)
 {
 	n = abs(n);
-	return n % YAFFS_NOBJECT_BUCKETS;
+	return n % dev->nObjectBuckets;
 }
 
 /*
@@ -1202,6 +1214,103 @@ static __u16 yaffs_CalcNameSum(const YCHAR *name)
 	return sum;
 }
 
+/* Directory name index.
+ * Every object with a parent is either in dev->nameHash, keyed on the
+ * parent and its name sum, or counted in the parent's nUnhashed.  An
+ * object goes in the hash once its name can be trusted: it is not lazy
+ * loaded and it has a header (or is lost+found, whose name is fixed).
+ * yaffs_FindObjectByName only has to walk the children while some of
+ * them are unhashed.
+ */
+
+static __u16 yaffs_NameHashSum(const yaffs_Object *obj)
+{
+	if (obj->objectId == YAFFS_OBJECTID_LOSTNFOUND)
+		return yaffs_CalcNameSum(YAFFS_LOSTNFOUND_NAME);
+	return obj->sum;
+}
+
+static Y_INLINE struct ylist_head *yaffs_NameBucket(yaffs_Device *dev,
+					const yaffs_Object *parent, __u16 sum)
+{
+	return &dev->nameHash[(parent->objectId * 31 + sum) &
+			      (dev->nNameBuckets - 1)];
+}
+
+static void yaffs_GrowNameHash(yaffs_Device *dev)
+{
+	int nBuckets = dev->nNameBuckets * 2;
+	struct ylist_head *newHash;
+	struct ylist_head *oldHash = dev->nameHash;
+	int oldBuckets = dev->nNameBuckets;
+	yaffs_Object *obj;
+	int i;
+
+	if (nBuckets > YAFFS_MAX_OBJECT_BUCKETS)
+		return;
+
+	/* If we can't get the memory just carry on with longer chains */
+	newHash = YMALLOC(nBuckets * sizeof(struct ylist_head));
+	if (!newHash)
+		return;
+
+	for (i = 0; i < nBuckets; i++)
+		YINIT_LIST_HEAD(&newHash[i]);
+
+	dev->nameHash = newHash;
+	dev->nNameBuckets = nBuckets;
+
+	for (i = 0; i < oldBuckets; i++) {
+		while (!ylist_empty(&oldHash[i])) {
+			obj = ylist_entry(oldHash[i].next, yaffs_Object,
+					  nameLink);
+			ylist_del(&obj->nameLink);
+			ylist_add(&obj->nameLink,
+				  yaffs_NameBucket(dev, obj->parent,
+						   yaffs_NameHashSum(obj)));
+		}
+	}
+
+	YFREE(oldHash);
+}
+
+static void yaffs_UnhashObjectName(yaffs_Object *obj)
+{
+	if (!ylist_empty(&obj->nameLink)) {
+		ylist_del_init(&obj->nameLink);
+		obj->myDev->nNameHashed--;
+	}
+	if (obj->nameUnhashed) {
+		obj->nameUnhashed = 0;
+		obj->parent->variant.directoryVariant.nUnhashed--;
+	}
+}
+
+/* (Re)index an object under its current parent and name */
+static void yaffs_HashObjectName(yaffs_Object *obj)
+{
+	yaffs_Device *dev = obj->myDev;
+
+	yaffs_UnhashObjectName(obj);
+
+	if (!obj->parent || !dev->nameHash)
+		return;
+
+	if (obj->objectId == YAFFS_OBJECTID_LOSTNFOUND ||
+	    (!obj->lazyLoaded && obj->hdrChunk > 0)) {
+		if (dev->nNameHashed >=
+		    dev->nNameBuckets * YAFFS_OBJECT_BUCKET_LOAD)
+			yaffs_GrowNameHash(dev);
+		ylist_add(&obj->nameLink,
+			  yaffs_NameBucket(dev, obj->parent,
+					   yaffs_NameHashSum(obj)));
+		dev->nNameHashed++;
+	} else {
+		obj->nameUnhashed = 1;
+		obj->parent->variant.directoryVariant.nUnhashed++;
+	}
+}
+
 static void yaffs_SetObjectName(yaffs_Object *obj, const YCHAR *name)
 {
 #ifdef CONFIG_YAFFS_SHORT_NAMES_IN_RAM
@@ -1212,6 +1321,7 @@ static void yaffs_SetObjectName(yaffs_Object *obj, const YCHAR *name)
 		obj->shortName[0] = _Y('\0');
 #endif
 	obj->sum = yaffs_CalcNameSum(name);
+	yaffs_HashObjectName(obj);
 }
 
 /*-------------------- TNODES -------------------
@@ -1302,6 +1412,7 @@ static int yaffs_CreateTnodes(yaffs_Device *dev, int nTnodes)
 		   return YAFFS_FAIL;
 	} else {
 		tnl->tnodes = newTnodes;
+		tnl->nTnodes = nTnodes;
 		tnl->next = dev->allocatedTnodeList;
 		dev->allocatedTnodeList = tnl;
 	}
@@ -1470,10 +1581,17 @@ static yaffs_Tnode *yaffs_FindLevel0Tnode(yaffs_Device *dev,
 					yaffs_FileStructure *fStruct,
 					__u32 chunkId)
 {
-	yaffs_Tnode *tn = fStruct->top;
+	yaffs_Tnode *tn;
 	__u32 i;
 	int requiredTallness;
-	int level = fStruct->topLevel;
+	int level;
+
+	if (fStruct->evictedBlocks)
+		yaffs_RestoreFileTnodes(ylist_entry(fStruct, yaffs_Object,
+					variant.fileVariant));
+
+	tn = fStruct->top;
+	level = fStruct->topLevel;
 
 	/* Check sane level and chunk Id */
 	if (level < 0 || level > YAFFS_TNODES_MAX_LEVEL)
@@ -1530,6 +1648,9 @@ static yaffs_Tnode *yaffs_AddOrFindLevel0Tnode(yaffs_Device *dev,
 
 	__u32 x;
 
+	if (fStruct->evictedBlocks)
+		yaffs_RestoreFileTnodes(ylist_entry(fStruct, yaffs_Object,
+					variant.fileVariant));
 
 	/* Check sane level and page Id */
 	if (fStruct->topLevel < 0 || fStruct->topLevel > YAFFS_TNODES_MAX_LEVEL)
@@ -1811,6 +1932,8 @@ static int yaffs_SoftDeleteWorker(yaffs_Object *in, yaffs_Tnode *tn,
 
 static void yaffs_SoftDeleteFile(yaffs_Object *obj)
 {
+	yaffs_RestoreFileTnodes(obj);
+
 	if (obj->deleted &&
 	    obj->variantType == YAFFS_OBJECT_TYPE_FILE && !obj->softDeleted) {
 		if (obj->nDataChunks <= 0) {
@@ -1920,6 +2043,342 @@ static int yaffs_PruneFileStructure(yaffs_Device *dev,
 
 /*-------------------- End of File Structure functions.-------------------*/
 
+/*------------------------- Tnode tree eviction ---------------------------
+ * Files whose inode has been evicted from the VFS inode cache can give up
+ * their tnode tree. We remember which blocks held their data and rebuild
+ * the tree from the tags of those blocks the next time the file is looked
+ * at. Every path that moves or writes a chunk of the file goes through
+ * yaffs_FindLevel0Tnode or yaffs_AddOrFindLevel0Tnode first, so the block
+ * list stays complete while the tree is away.
+ */
+
+/* Only bother with files that have more than a single level 0 tnode */
+#define YAFFS_EVICT_MIN_LEVEL	1
+
+static int yaffs_MarkTnodeBlocks(yaffs_Device *dev, yaffs_Tnode *tn,
+				__u32 level, __u8 *blockMap)
+{
+	int i, j;
+	int n = 0;
+	__u32 theChunk;
+	int blk;
+
+	if (!tn)
+		return 0;
+
+	if (level > 0) {
+		for (i = 0; i < YAFFS_NTNODES_INTERNAL; i++)
+			n += yaffs_MarkTnodeBlocks(dev, tn->internal[i],
+						level - 1, blockMap);
+		return n;
+	}
+
+	for (i = 0; i < YAFFS_NTNODES_LEVEL0; i++) {
+		theChunk = yaffs_GetChunkGroupBase(dev, tn, i);
+		if (!theChunk)
+			continue;
+		/* A chunk group may straddle a block boundary */
+		for (j = 0; j < dev->chunkGroupSize; j += dev->chunkGroupSize - 1) {
+			blk = (theChunk + j) / dev->nChunksPerBlock -
+				dev->internalStartBlock;
+			if (!(blockMap[blk / 8] & (1 << (blk & 7)))) {
+				blockMap[blk / 8] |= (1 << (blk & 7));
+				n++;
+			}
+			if (dev->chunkGroupSize == 1)
+				break;
+		}
+	}
+	return n;
+}
+
+static int yaffs_FreeTnodeTree(yaffs_Device *dev, yaffs_Tnode *tn,
+				__u32 level)
+{
+	int i;
+	int n = 1;
+
+	if (!tn)
+		return 0;
+
+	if (level > 0)
+		for (i = 0; i < YAFFS_NTNODES_INTERNAL; i++)
+			n += yaffs_FreeTnodeTree(dev, tn->internal[i],
+						level - 1);
+	yaffs_FreeTnode(dev, tn);
+	return n;
+}
+
+/* Returns the number of tnodes given back, 0 if the file was skipped */
+static int yaffs_EvictFileTnodes(yaffs_Object *obj)
+{
+	yaffs_Device *dev = obj->myDev;
+	yaffs_FileStructure *fStruct = &obj->variant.fileVariant;
+	int nBlocks = dev->internalEndBlock - dev->internalStartBlock + 1;
+	__u8 *blockMap;
+	__u32 *blocks;
+	int nUsed;
+	int i, n;
+
+	if (obj->variantType != YAFFS_OBJECT_TYPE_FILE ||
+	    obj->myInode || obj->deleted || obj->softDeleted ||
+	    obj->unlinked || obj->deferedFree || obj->fake || !obj->valid ||
+	    fStruct->evictedBlocks ||
+	    fStruct->topLevel < YAFFS_EVICT_MIN_LEVEL ||
+	    yaffs_ObjectHasCachedWriteData(obj))
+		return 0;
+
+	blockMap = YMALLOC((nBlocks + 7) / 8);
+	if (!blockMap)
+		return 0;
+	memset(blockMap, 0, (nBlocks + 7) / 8);
+
+	nUsed = yaffs_MarkTnodeBlocks(dev, fStruct->top, fStruct->topLevel,
+					blockMap);
+	blocks = nUsed ? YMALLOC(nUsed * sizeof(__u32)) : NULL;
+	if (!blocks) {
+		YFREE(blockMap);
+		return 0;
+	}
+
+	for (i = 0, n = 0; i < nBlocks && n < nUsed; i++)
+		if (blockMap[i / 8] & (1 << (i & 7)))
+			blocks[n++] = i + dev->internalStartBlock;
+	YFREE(blockMap);
+
+	n = yaffs_FreeTnodeTree(dev, fStruct->top, fStruct->topLevel);
+	fStruct->top = NULL;
+	fStruct->topLevel = 0;
+	fStruct->evictedBlocks = blocks;
+	fStruct->nEvictedBlocks = nUsed;
+
+	dev->nEvictedFiles++;
+	dev->nTnodeEvictions++;
+
+	T(YAFFS_TRACE_ALLOCATE,
+	  (TSTR("yaffs: evicted %d tnodes of object %d, %d blocks" TENDSTR),
+	   n, obj->objectId, nUsed));
+
+	return n;
+}
+
+/* Rebuild the tnode tree of an evicted file from the tags of its blocks */
+static int yaffs_RestoreFileTnodes(yaffs_Object *obj)
+{
+	yaffs_Device *dev = obj->myDev;
+	yaffs_FileStructure *fStruct = &obj->variant.fileVariant;
+	__u32 *blocks = fStruct->evictedBlocks;
+	int nBlocks = fStruct->nEvictedBlocks;
+	yaffs_ExtendedTags tags;
+	yaffs_Tnode *tn;
+	int retVal = YAFFS_OK;
+	int i, c, chunk;
+
+	if (obj->variantType != YAFFS_OBJECT_TYPE_FILE || !blocks)
+		return YAFFS_OK;
+
+	fStruct->top = yaffs_GetTnode(dev);
+	if (!fStruct->top) {
+		T(YAFFS_TRACE_ERROR,
+		  (TSTR("yaffs: no tnodes to restore object %d" TENDSTR),
+		   obj->objectId));
+		return YAFFS_FAIL;
+	}
+	fStruct->topLevel = 0;
+	fStruct->evictedBlocks = NULL;
+	fStruct->nEvictedBlocks = 0;
+
+	for (i = 0; i < nBlocks; i++) {
+		for (c = 0; c < dev->nChunksPerBlock; c++) {
+			if (!yaffs_CheckChunkBit(dev, blocks[i], c))
+				continue;
+			chunk = blocks[i] * dev->nChunksPerBlock + c;
+			yaffs_ReadChunkWithTagsFromNAND(dev, chunk, NULL, &tags);
+			if (!tags.chunkUsed || tags.objectId != obj->objectId ||
+			    tags.chunkId == 0)
+				continue;
+			tn = yaffs_AddOrFindLevel0Tnode(dev, fStruct,
+							tags.chunkId, NULL);
+			if (!tn) {
+				retVal = YAFFS_FAIL;
+				continue;
+			}
+			yaffs_PutLevel0Tnode(dev, tn, tags.chunkId, chunk);
+		}
+	}
+
+	if (retVal != YAFFS_OK)
+		T(YAFFS_TRACE_ERROR,
+		  (TSTR("yaffs: incomplete tnode restore of object %d" TENDSTR),
+		   obj->objectId));
+
+	YFREE(blocks);
+	dev->nEvictedFiles--;
+	dev->nTnodeRestores++;
+
+	return retVal;
+}
+
+static void yaffs_RestoreAllTnodes(yaffs_Device *dev)
+{
+	struct ylist_head *lh;
+	yaffs_Object *obj;
+	int i;
+
+	for (i = 0; i < dev->nObjectBuckets && dev->nEvictedFiles; i++) {
+		ylist_for_each(lh, &dev->objectBucket[i].list) {
+			obj = ylist_entry(lh, yaffs_Object, hashLink);
+			yaffs_RestoreFileTnodes(obj);
+		}
+	}
+}
+
+/* The object is going away; its data chunks are no longer ours to find */
+static void yaffs_DropEvictedBlocks(yaffs_Object *obj)
+{
+	yaffs_FileStructure *fStruct = &obj->variant.fileVariant;
+
+	if (obj->variantType != YAFFS_OBJECT_TYPE_FILE ||
+	    !fStruct->evictedBlocks)
+		return;
+
+	YFREE(fStruct->evictedBlocks);
+	fStruct->evictedBlocks = NULL;
+	fStruct->nEvictedBlocks = 0;
+	obj->myDev->nEvictedFiles--;
+}
+
+static int yaffs_TnodeListCompare(const void *a, const void *b)
+{
+	const yaffs_TnodeList *x = *(yaffs_TnodeList * const *)a;
+	const yaffs_TnodeList *y = *(yaffs_TnodeList * const *)b;
+
+	if (x->tnodes < y->tnodes)
+		return -1;
+	return x->tnodes > y->tnodes;
+}
+
+static int yaffs_FindTnodeList(yaffs_TnodeList **lists, int n,
+				int tnodeSize, yaffs_Tnode *tn)
+{
+	int lo = 0, hi = n - 1, mid;
+	__u8 *p = (__u8 *)tn;
+	__u8 *base;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		base = (__u8 *)lists[mid]->tnodes;
+		if (p < base)
+			hi = mid - 1;
+		else if (p >= base + lists[mid]->nTnodes * tnodeSize)
+			lo = mid + 1;
+		else
+			return mid;
+	}
+	return -1;
+}
+
+/* Give tnode allocations that are entirely on the free list back to the
+ * kernel.
+ */
+static void yaffs_ReleaseFreeTnodes(yaffs_Device *dev)
+{
+	int tnodeSize = (dev->tnodeWidth * YAFFS_NTNODES_LEVEL0) / 8;
+	yaffs_TnodeList **lists;
+	yaffs_TnodeList *tnl, **prev;
+	yaffs_Tnode *tn, *next, **tail;
+	int *nFree;
+	int n = 0, i;
+
+	if (tnodeSize < sizeof(yaffs_Tnode))
+		tnodeSize = sizeof(yaffs_Tnode);
+
+	for (tnl = dev->allocatedTnodeList; tnl; tnl = tnl->next)
+		n++;
+	if (!n)
+		return;
+
+	lists = YMALLOC(n * sizeof(yaffs_TnodeList *));
+	nFree = YMALLOC(n * sizeof(int));
+	if (!lists || !nFree)
+		goto out;
+
+	for (i = 0, tnl = dev->allocatedTnodeList; tnl; tnl = tnl->next)
+		lists[i++] = tnl;
+	yaffs_qsort(lists, n, sizeof(yaffs_TnodeList *),
+			yaffs_TnodeListCompare);
+	memset(nFree, 0, n * sizeof(int));
+
+	for (tn = dev->freeTnodes; tn; tn = tn->internal[0]) {
+		i = yaffs_FindTnodeList(lists, n, tnodeSize, tn);
+		if (i >= 0)
+			nFree[i]++;
+	}
+
+	/* Unhook the free tnodes that live in a wholly free allocation */
+	tail = &dev->freeTnodes;
+	for (tn = dev->freeTnodes; tn; tn = next) {
+		next = tn->internal[0];
+		i = yaffs_FindTnodeList(lists, n, tnodeSize, tn);
+		if (i >= 0 && nFree[i] == lists[i]->nTnodes) {
+			dev->nFreeTnodes--;
+			continue;
+		}
+		*tail = tn;
+		tail = &tn->internal[0];
+	}
+	*tail = NULL;
+
+	prev = &dev->allocatedTnodeList;
+	while ((tnl = *prev) != NULL) {
+		i = yaffs_FindTnodeList(lists, n, tnodeSize, tnl->tnodes);
+		if (i >= 0 && nFree[i] == tnl->nTnodes) {
+			*prev = tnl->next;
+			dev->nTnodesCreated -= tnl->nTnodes;
+			dev->nTnodeBlocksReleased++;
+			YFREE(tnl->tnodes);
+			YFREE(tnl);
+		} else {
+			prev = &tnl->next;
+		}
+	}
+	dev->nCheckpointBlocksRequired = 0; /* force recalculation*/
+
+out:
+	if (lists)
+		YFREE(lists);
+	if (nFree)
+		YFREE(nFree);
+}
+
+/* Called by the tnode shrinker with the gross lock held. Evicts files
+ * until about nTnodes tnodes were given back; returns how many were.
+ */
+int yaffs_EvictTnodes(yaffs_Device *dev, int nTnodes)
+{
+	struct ylist_head *lh;
+	yaffs_Object *obj;
+	int freed = 0;
+	int n;
+
+	for (n = 0; n < dev->nObjectBuckets && freed < nTnodes; n++) {
+		int bucket = dev->tnodeEvictBucket;
+
+		dev->tnodeEvictBucket = (bucket + 1) % dev->nObjectBuckets;
+		ylist_for_each(lh, &dev->objectBucket[bucket].list) {
+			obj = ylist_entry(lh, yaffs_Object, hashLink);
+			freed += yaffs_EvictFileTnodes(obj);
+		}
+	}
+
+	if (freed)
+		yaffs_ReleaseFreeTnodes(dev);
+
+	return freed;
+}
+
+/*------------------------- End of tnode tree eviction --------------------*/
+
 /* yaffs_CreateFreeObjects creates a bunch more objects and
  * adds them to the object free list.
  */
@@ -1997,6 +2456,7 @@ static yaffs_Object *yaffs_AllocateEmptyObject(yaffs_Device *dev)
 		tn->variantType = YAFFS_OBJECT_TYPE_UNKNOWN;
 		YINIT_LIST_HEAD(&(tn->hardLinks));
 		YINIT_LIST_HEAD(&(tn->hashLink));
+		YINIT_LIST_HEAD(&tn->nameLink);
 		YINIT_LIST_HEAD(&tn->siblings);
 
 
@@ -2004,6 +2464,7 @@ static yaffs_Object *yaffs_AllocateEmptyObject(yaffs_Device *dev)
 		if (dev->rootDir) {
 			tn->parent = dev->rootDir;
 			ylist_add(&(tn->siblings), &dev->rootDir->variant.directoryVariant.children);
+			yaffs_HashObjectName(tn);
 		}
 
 		/* Add it to the lost and found directory.
@@ -2050,8 +2511,9 @@ static void yaffs_UnhashObject(yaffs_Object *tn)
 	/* If it is still linked into the bucket list, free from the list */
 	if (!ylist_empty(&tn->hashLink)) {
 		ylist_del_init(&tn->hashLink);
-		bucket = yaffs_HashFunction(tn->objectId);
+		bucket = yaffs_HashFunction(dev, tn->objectId);
 		dev->objectBucket[bucket].count--;
+		dev->nHashedObjects--;
 	}
 }
 
@@ -2080,6 +2542,7 @@ static void yaffs_FreeObject(yaffs_Object *tn)
 	}
 #endif
 
+	yaffs_DropEvictedBlocks(tn);
 	yaffs_UnhashObject(tn);
 
 #ifdef VALGRIND_TEST
@@ -2119,9 +2582,14 @@ static void yaffs_DeinitialiseObjects(yaffs_Device *dev)
 
 	dev->freeObjects = NULL;
 	dev->nFreeObjects = 0;
+
+	YFREE(dev->objectBucket);
+	dev->objectBucket = NULL;
+	YFREE(dev->nameHash);
+	dev->nameHash = NULL;
 }
 
-static void yaffs_InitialiseObjects(yaffs_Device *dev)
+static int yaffs_InitialiseObjects(yaffs_Device *dev)
 {
 	int i;
 
@@ -2129,10 +2597,70 @@ static void yaffs_InitialiseObjects(yaffs_Device *dev)
 	dev->freeObjects = NULL;
 	dev->nFreeObjects = 0;
 
-	for (i = 0; i < YAFFS_NOBJECT_BUCKETS; i++) {
+	dev->nObjectBuckets = YAFFS_NOBJECT_BUCKETS;
+	dev->nHashedObjects = 0;
+	dev->objectBucket = YMALLOC(dev->nObjectBuckets *
+				    sizeof(yaffs_ObjectBucket));
+
+	dev->nNameBuckets = YAFFS_NOBJECT_BUCKETS;
+	dev->nNameHashed = 0;
+	dev->nameHash = YMALLOC(dev->nNameBuckets * sizeof(struct ylist_head));
+
+	if (!dev->objectBucket || !dev->nameHash)
+		return YAFFS_FAIL;
+
+	for (i = 0; i < dev->nObjectBuckets; i++) {
 		YINIT_LIST_HEAD(&dev->objectBucket[i].list);
 		dev->objectBucket[i].count = 0;
 	}
+
+	for (i = 0; i < dev->nNameBuckets; i++)
+		YINIT_LIST_HEAD(&dev->nameHash[i]);
+
+	return YAFFS_OK;
+}
+
+/* Double the object id hash.  The bucket of an existing id changes, so
+ * everything gets moved across.
+ */
+static void yaffs_GrowObjectHash(yaffs_Device *dev)
+{
+	int nBuckets = dev->nObjectBuckets * 2;
+	yaffs_ObjectBucket *newBucket;
+	yaffs_ObjectBucket *oldBucket = dev->objectBucket;
+	int oldBuckets = dev->nObjectBuckets;
+	yaffs_Object *obj;
+	int bucket;
+	int i;
+
+	if (nBuckets > YAFFS_MAX_OBJECT_BUCKETS)
+		return;
+
+	/* If we can't get the memory just carry on with longer chains */
+	newBucket = YMALLOC(nBuckets * sizeof(yaffs_ObjectBucket));
+	if (!newBucket)
+		return;
+
+	for (i = 0; i < nBuckets; i++) {
+		YINIT_LIST_HEAD(&newBucket[i].list);
+		newBucket[i].count = 0;
+	}
+
+	dev->objectBucket = newBucket;
+	dev->nObjectBuckets = nBuckets;
+
+	for (i = 0; i < oldBuckets; i++) {
+		while (!ylist_empty(&oldBucket[i].list)) {
+			obj = ylist_entry(oldBucket[i].list.next, yaffs_Object,
+					  hashLink);
+			ylist_del(&obj->hashLink);
+			bucket = yaffs_HashFunction(dev, obj->objectId);
+			ylist_add(&obj->hashLink, &newBucket[bucket].list);
+			newBucket[bucket].count++;
+		}
+	}
+
+	YFREE(oldBucket);
 }
 
 static int yaffs_FindNiceObjectBucket(yaffs_Device *dev)
@@ -2146,7 +2674,7 @@ static int yaffs_FindNiceObjectBucket(yaffs_Device *dev)
 
 	for (i = 0; i < 10 && lowest > 0; i++) {
 		x++;
-		x %= YAFFS_NOBJECT_BUCKETS;
+		x %= dev->nObjectBuckets;
 		if (dev->objectBucket[x].count < lowest) {
 			lowest = dev->objectBucket[x].count;
 			l = x;
@@ -2160,7 +2688,7 @@ static int yaffs_FindNiceObjectBucket(yaffs_Device *dev)
 
 	for (i = 0; i < 10 && lowest > 3; i++) {
 		x++;
-		x %= YAFFS_NOBJECT_BUCKETS;
+		x %= dev->nObjectBuckets;
 		if (dev->objectBucket[x].count < lowest) {
 			lowest = dev->objectBucket[x].count;
 			l = x;
@@ -2188,7 +2716,7 @@ static int yaffs_CreateNewObjectNumber(yaffs_Device *dev)
 
 	while (!found) {
 		found = 1;
-		n += YAFFS_NOBJECT_BUCKETS;
+		n += dev->nObjectBuckets;
 		if (1 || dev->objectBucket[bucket].count > 0) {
 			ylist_for_each(i, &dev->objectBucket[bucket].list) {
 				/* If there is already one in the list */
@@ -2205,16 +2733,21 @@ static int yaffs_CreateNewObjectNumber(yaffs_Device *dev)
 
 static void yaffs_HashObject(yaffs_Object *in)
 {
-	int bucket = yaffs_HashFunction(in->objectId);
 	yaffs_Device *dev = in->myDev;
+	int bucket;
 
+	if (dev->nHashedObjects >= dev->nObjectBuckets * YAFFS_OBJECT_BUCKET_LOAD)
+		yaffs_GrowObjectHash(dev);
+
+	bucket = yaffs_HashFunction(dev, in->objectId);
 	ylist_add(&in->hashLink, &dev->objectBucket[bucket].list);
 	dev->objectBucket[bucket].count++;
+	dev->nHashedObjects++;
 }
 
 yaffs_Object *yaffs_FindObjectByNumber(yaffs_Device *dev, __u32 number)
 {
-	int bucket = yaffs_HashFunction(number);
+	int bucket = yaffs_HashFunction(dev, number);
 	struct ylist_head *i;
 	yaffs_Object *in;
 
@@ -2288,6 +2821,7 @@ yaffs_Object *yaffs_CreateNewObject(yaffs_Device *dev, int number,
 		case YAFFS_OBJECT_TYPE_DIRECTORY:
 			YINIT_LIST_HEAD(&theObject->variant.directoryVariant.
 					children);
+			theObject->variant.directoryVariant.nUnhashed = 0;
 			break;
 		case YAFFS_OBJECT_TYPE_SYMLINK:
 		case YAFFS_OBJECT_TYPE_HARDLINK:
@@ -3309,6 +3843,10 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 			aggressive = 0;
 		}
 
+		/* Leave leisurely collection to the background */
+		if (!aggressive && dev->backgroundGC && dev->gcBlock <= 0)
+			return YAFFS_OK;
+
 		if (dev->gcBlock <= 0) {
 			dev->gcBlock = yaffs_FindBlockForGarbageCollection(dev, aggressive);
 			dev->gcChunk = 0;
@@ -3342,6 +3880,87 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 	return aggressive ? gcOk : YAFFS_OK;
 }
 
+/* Pick the block that costs least to collect, taking none with more than
+ * maxInUse chunks still in use. Blocks due for prioritised gc go first.
+ */
+static int yaffs_FindBlockForBackgroundGC(yaffs_Device *dev, int maxInUse)
+{
+	int i;
+	int inUse;
+	int dirtiest = -1;
+	yaffs_BlockInfo *bi;
+
+	for (i = dev->internalStartBlock; i <= dev->internalEndBlock; i++) {
+		bi = yaffs_GetBlockInfo(dev, i);
+
+		if (bi->blockState != YAFFS_BLOCK_STATE_FULL ||
+		    !yaffs_BlockNotDisqualifiedFromGC(dev, bi))
+			continue;
+
+		if (bi->gcPrioritise)
+			return i;
+
+		inUse = bi->pagesInUse - bi->softDeletions;
+		if (inUse < maxInUse) {
+			dirtiest = i;
+			maxInUse = inUse;
+		}
+	}
+
+	return dirtiest;
+}
+
+/*
+ * Collect one whole block ahead of demand, so that writers seldom have to.
+ * Below the erased block target anything dirty is collected, otherwise only
+ * cheap blocks and only when the device is idle and the checkpoint is
+ * already gone: collecting would invalidate it.
+ * Returns 1 if a block was collected and there may be more to do.
+ */
+int yaffs_BackgroundGarbageCollect(yaffs_Device *dev, int idle)
+{
+	int block;
+	int target;
+	int maxInUse;
+	int checkpointBlockAdjust;
+
+	if (!dev->isMounted || dev->scanPending || dev->isDoingGC)
+		return 0;
+
+	checkpointBlockAdjust = yaffs_CalcCheckpointBlocksRequired(dev) - dev->blocksInCheckpoint;
+	if (checkpointBlockAdjust < 0)
+		checkpointBlockAdjust = 0;
+
+	target = dev->nReservedBlocks + checkpointBlockAdjust +
+		YAFFS_BG_GC_SPARE_BLOCKS;
+
+	if (dev->nErasedBlocks < target)
+		maxInUse = dev->nChunksPerBlock;
+	else if (idle && !dev->isCheckpointed)
+		maxInUse = YAFFS_BG_GC_CHUNKS(dev);
+	else
+		return 0;
+
+	block = dev->gcBlock;
+	if (block <= 0) {
+		block = yaffs_FindBlockForBackgroundGC(dev, maxInUse);
+		if (block <= 0)
+			return 0;
+		dev->gcBlock = block;
+		dev->gcChunk = 0;
+	}
+
+	T(YAFFS_TRACE_GC,
+	  (TSTR("yaffs: background GC block %d erasedBlocks %d target %d"
+		TENDSTR), block, dev->nErasedBlocks, target));
+
+	dev->garbageCollections++;
+	dev->backgroundGarbageCollections++;
+	yaffs_GarbageCollectBlock(dev, block, 1);
+
+	return 1;
+}
+
 /*-------------------------  TAGS --------------------------------*/
 
 static int yaffs_TagsMatch(const yaffs_ExtendedTags *tags, int objectId,
@@ -3875,6 +4494,10 @@ int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name, int force,
 
 			in->hdrChunk = newChunkId;
 
+			/* It has a header now so its name can be indexed */
+			if (in->nameUnhashed)
+				yaffs_HashObjectName(in);
+
 			if (prevChunkId > 0) {
 				yaffs_DeleteChunk(dev, prevChunkId, 1,
 						  __LINE__);
@@ -3911,10 +4534,40 @@ int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name, int force,
  *   In Linux, the page cache provides read buffering aand the short op cache provides write
  *   buffering.
  *
- *   There are a limited number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   The cache can be set to hundreds of chunks at mount time, so entries are
+ *   looked up through a hash on (object, chunkId) and kept on an LRU list.
+ *   Unused entries sit on a free list.
  */
 
+static struct ylist_head *yaffs_ChunkCacheBucket(yaffs_Device *dev,
+						const yaffs_Object *obj,
+						int chunkId)
+{
+	/* Consecutive chunks of a file land in consecutive buckets */
+	return &dev->srCacheHash[(obj->objectId * 7 + chunkId) &
+				 dev->srCacheHashMask];
+}
+
+static void yaffs_MarkChunkCacheClean(yaffs_Device *dev,
+				      yaffs_ChunkCache *cache)
+{
+	if (cache->dirty) {
+		cache->dirty = 0;
+		dev->srCacheDirty--;
+		cache->object->variant.fileVariant.nDirtyChunks--;
+	}
+}
+
+/* Drop an entry's contents and put it back on the free list */
+static void yaffs_FreeChunkCache(yaffs_Device *dev, yaffs_ChunkCache *cache)
+{
+	yaffs_MarkChunkCacheClean(dev, cache);
+	cache->object = NULL;
+	ylist_del_init(&cache->hashLink);
+	ylist_del(&cache->lruLink);
+	ylist_add(&cache->lruLink, &dev->srCacheFree);
+}
+
 static int yaffs_ObjectHasCachedWriteData(yaffs_Object *obj)
 {
 	yaffs_Device *dev = obj->myDev;
@@ -3922,6 +4575,9 @@ static int yaffs_ObjectHasCachedWriteData(yaffs_Object *obj)
 	yaffs_ChunkCache *cache;
 	int nCaches = obj->myDev->nShortOpCaches;
 
+	if (!dev->srCacheDirty)
+		return 0;
+
 	for (i = 0; i < nCaches; i++) {
 		cache = &dev->srCache[i];
 		if (cache->object == obj &&
@@ -3932,56 +4588,54 @@ static int yaffs_ObjectHasCachedWriteData(yaffs_Object *obj)
 	return 0;
 }
 
+static int yaffs_ChunkCacheCompare(const void *a, const void *b)
+{
+	return (*(yaffs_ChunkCache **)a)->chunkId -
+		(*(yaffs_ChunkCache **)b)->chunkId;
+}
 
 static void yaffs_FlushFilesChunkCache(yaffs_Object *obj)
 {
 	yaffs_Device *dev = obj->myDev;
-	int lowest = -99;	/* Stop compiler whining. */
 	int i;
 	yaffs_ChunkCache *cache;
-	int chunkWritten = 0;
+	int chunkWritten = 1;
 	int nCaches = obj->myDev->nShortOpCaches;
+	int nToFlush = 0;
 
-	if (nCaches > 0) {
-		do {
-			cache = NULL;
-
-			/* Find the dirty cache for this object with the lowest chunk id. */
-			for (i = 0; i < nCaches; i++) {
-				if (dev->srCache[i].object == obj &&
-				    dev->srCache[i].dirty) {
-					if (!cache
-					    || dev->srCache[i].chunkId <
-					    lowest) {
-						cache = &dev->srCache[i];
-						lowest = cache->chunkId;
-					}
-				}
-			}
-
-			if (cache && !cache->locked) {
-				/* Write it out and free it up */
-
-				chunkWritten =
-				    yaffs_WriteChunkDataToObject(cache->object,
-								 cache->chunkId,
-								 cache->data,
-								 cache->nBytes,
-								 1);
-				cache->dirty = 0;
-				cache->object = NULL;
-			}
+	if (nCaches < 1 || !dev->srCacheDirty)
+		return;
 
-		} while (cache && chunkWritten > 0);
+	/* Collect the dirty caches for this object in one pass, then write
+	 * them out in chunk order.
+	 */
+	for (i = 0; i < nCaches; i++) {
+		cache = &dev->srCache[i];
+		if (cache->object == obj && cache->dirty && !cache->locked)
+			dev->srCacheFlush[nToFlush++] = cache;
+	}
 
-		if (cache) {
-			/* Hoosterman, disk full while writing cache out. */
-			T(YAFFS_TRACE_ERROR,
-			  (TSTR("yaffs tragedy: no space during cache write" TENDSTR)));
+	if (nToFlush > 1)
+		yaffs_qsort(dev->srCacheFlush, nToFlush,
+			    sizeof(yaffs_ChunkCache *), yaffs_ChunkCacheCompare);
 
-		}
+	for (i = 0; i < nToFlush && chunkWritten > 0; i++) {
+		/* Write it out and free it up */
+		cache = dev->srCacheFlush[i];
+		chunkWritten =
+		    yaffs_WriteChunkDataToObject(cache->object,
+						 cache->chunkId,
+						 cache->data,
+						 cache->nBytes,
+						 1);
+		yaffs_FreeChunkCache(dev, cache);
 	}
 
+	if (chunkWritten <= 0) {
+		/* Hoosterman, disk full while writing cache out. */
+		T(YAFFS_TRACE_ERROR,
+		  (TSTR("yaffs tragedy: no space during cache write" TENDSTR)));
+	}
 }
 
 /*yaffs_FlushEntireDeviceCache(dev)
@@ -3991,97 +4645,80 @@ static void yaffs_FlushFilesChunkCache(yaffs_Object *obj)
 
 void yaffs_FlushEntireDeviceCache(yaffs_Device *dev)
 {
-	yaffs_Object *obj;
+	yaffs_ChunkCache *cache;
 	int nCaches = dev->nShortOpCaches;
 	int i;
 
-	/* Find a dirty object in the cache and flush it...
-	 * until there are no further dirty objects.
+	/* Flush each object that has a dirty cache. Flushing an object
+	 * cleans all of its caches, so one pass will do.
 	 */
-	do {
-		obj = NULL;
-		for (i = 0; i < nCaches && !obj; i++) {
-			if (dev->srCache[i].object &&
-			    dev->srCache[i].dirty)
-				obj = dev->srCache[i].object;
-
-		}
-		if (obj)
-			yaffs_FlushFilesChunkCache(obj);
-
-	} while (obj);
-
+	for (i = 0; i < nCaches && dev->srCacheDirty > 0; i++) {
+		cache = &dev->srCache[i];
+		if (cache->object && cache->dirty)
+			yaffs_FlushFilesChunkCache(cache->object);
+	}
 }
 
 
 /* Grab us a cache chunk for use.
- * First look for an empty one.
- * Then look for the least recently used non-dirty one.
- * Then look for the least recently used dirty one...., flush and look again.
+ * First look for a free one.
+ * Then push out the least recently used one, flushing its object first if
+ * it is dirty.
  */
 static yaffs_ChunkCache *yaffs_GrabChunkCacheWorker(yaffs_Device *dev)
 {
-	int i;
-
-	if (dev->nShortOpCaches > 0) {
-		for (i = 0; i < dev->nShortOpCaches; i++) {
-			if (!dev->srCache[i].object)
-				return &dev->srCache[i];
-		}
-	}
+	if (dev->nShortOpCaches > 0 && !ylist_empty(&dev->srCacheFree))
+		return ylist_entry(dev->srCacheFree.next, yaffs_ChunkCache,
+				   lruLink);
 
 	return NULL;
 }
 
-static yaffs_ChunkCache *yaffs_GrabChunkCache(yaffs_Device *dev)
+static yaffs_ChunkCache *yaffs_GrabChunkCache(yaffs_Object *obj, int chunkId)
 {
+	yaffs_Device *dev = obj->myDev;
 	yaffs_ChunkCache *cache;
-	yaffs_Object *theObj;
-	int usage;
-	int i;
-	int pushout;
-
-	if (dev->nShortOpCaches > 0) {
-		/* Try find a non-dirty one... */
-
-		cache = yaffs_GrabChunkCacheWorker(dev);
+	struct ylist_head *i;
 
-		if (!cache) {
-			/* They were all dirty, find the last recently used object and flush
-			 * its cache, then  find again.
-			 * NB what's here is not very accurate, we actually flush the object
-			 * the last recently used page.
-			 */
+	if (dev->nShortOpCaches < 1)
+		return NULL;
 
-			/* With locking we can't assume we can use entry zero */
+	cache = yaffs_GrabChunkCacheWorker(dev);
 
-			theObj = NULL;
-			usage = -1;
+	if (!cache) {
+		/* With locking we can't assume we can use the tail entry */
+		for (i = dev->srCacheLRU.prev; i != &dev->srCacheLRU; i = i->prev) {
+			cache = ylist_entry(i, yaffs_ChunkCache, lruLink);
+			if (!cache->locked)
+				break;
 			cache = NULL;
-			pushout = -1;
+		}
 
-			for (i = 0; i < dev->nShortOpCaches; i++) {
-				if (dev->srCache[i].object &&
-				    !dev->srCache[i].locked &&
-				    (dev->srCache[i].lastUse < usage || !cache)) {
-					usage = dev->srCache[i].lastUse;
-					theObj = dev->srCache[i].object;
-					cache = &dev->srCache[i];
-					pushout = i;
-				}
-			}
+		if (!cache)
+			return NULL;
 
-			if (!cache || cache->dirty) {
-				/* Flush and try again */
-				yaffs_FlushFilesChunkCache(theObj);
-				cache = yaffs_GrabChunkCacheWorker(dev);
-			}
+		if (cache->dirty) {
+			/* Flush the whole object so its chunks go out in
+			 * sequence, then take whatever that freed.
+			 */
+			yaffs_FlushFilesChunkCache(cache->object);
+			cache = yaffs_GrabChunkCacheWorker(dev);
+			if (!cache)
+				return NULL;
+		} else
+			yaffs_FreeChunkCache(dev, cache);
+	}
 
-		}
-		return cache;
-	} else
-		return NULL;
+	cache->object = obj;
+	cache->chunkId = chunkId;
+	cache->dirty = 0;
+	cache->locked = 0;
+	cache->nBytes = 0;
+	ylist_add(&cache->hashLink, yaffs_ChunkCacheBucket(dev, obj, chunkId));
+	ylist_del(&cache->lruLink);
+	ylist_add(&cache->lruLink, &dev->srCacheLRU);
 
+	return cache;
 }
 
 /* Find a cached chunk */
@@ -4089,14 +4726,17 @@ static yaffs_ChunkCache *yaffs_FindChunkCache(const yaffs_Object *obj,
 					      int chunkId)
 {
 	yaffs_Device *dev = obj->myDev;
-	int i;
+	yaffs_ChunkCache *cache;
+	struct ylist_head *i;
+
 	if (dev->nShortOpCaches > 0) {
-		for (i = 0; i < dev->nShortOpCaches; i++) {
-			if (dev->srCache[i].object == obj &&
-			    dev->srCache[i].chunkId == chunkId) {
+		ylist_for_each(i, yaffs_ChunkCacheBucket(dev, obj, chunkId)) {
+			cache = ylist_entry(i, yaffs_ChunkCache, hashLink);
+			if (cache->object == obj &&
+			    cache->chunkId == chunkId) {
 				dev->cacheHits++;
 
-				return &dev->srCache[i];
+				return cache;
 			}
 		}
 	}
@@ -4109,21 +4749,68 @@ static void yaffs_UseChunkCache(yaffs_Device *dev, yaffs_ChunkCache *cache,
 {
 
 	if (dev->nShortOpCaches > 0) {
-		if (dev->srLastUse < 0 || dev->srLastUse > 100000000) {
-			/* Reset the cache usages */
-			int i;
-			for (i = 1; i < dev->nShortOpCaches; i++)
-				dev->srCache[i].lastUse = 0;
+		ylist_del(&cache->lruLink);
+		ylist_add(&cache->lruLink, &dev->srCacheLRU);
 
-			dev->srLastUse = 0;
+		if (isAWrite && !cache->dirty) {
+			cache->dirty = 1;
+			cache->object->variant.fileVariant.nDirtyChunks++;
+			/* Let sync and the periodic super write find it */
+			if (dev->srCacheDirty++ == 0 && dev->superBlock &&
+			    dev->markSuperBlockDirty)
+				dev->markSuperBlockDirty(dev->superBlock);
 		}
+	}
+}
 
-		dev->srLastUse++;
+/* Write-behind.
+ * Whole chunks written to a file are staged in the short op cache like
+ * partial ones, and a file's staged chunks are written out together once
+ * there are enough of them. Files written side by side then end up in runs
+ * of consecutive chunks rather than interleaved, which keeps blocks from
+ * holding a mix of long- and short-lived data and cuts garbage collection
+ * copies. A batch is cut short when it would exactly fill the rest of the
+ * current allocation block.
+ */
+static int yaffs_WriteBehindThreshold(yaffs_Device *dev)
+{
+	int n = dev->nWriteBehindChunks;
+	int left;
 
-		cache->lastUse = dev->srLastUse;
+	if (dev->allocationBlock >= 0) {
+		left = dev->nChunksPerBlock - dev->allocationPage;
+		if (left > 0 && left < n)
+			n = left;
+	}
+	return n;
+}
 
-		if (isAWrite)
-			cache->dirty = 1;
+static void yaffs_WriteBehind(yaffs_Object *obj)
+{
+	yaffs_Device *dev = obj->myDev;
+	yaffs_ChunkCache *cache;
+	struct ylist_head *i;
+
+	if (dev->nWriteBehindChunks > 0 &&
+	    obj->variant.fileVariant.nDirtyChunks >=
+	    yaffs_WriteBehindThreshold(dev)) {
+		dev->nWriteBehindFlushes++;
+		yaffs_FlushFilesChunkCache(obj);
+	}
+
+	/* Too much dirty data: push out the file with the oldest of it, so
+	 * the cache keeps room for reads and a sync stays short.
+	 */
+	if (dev->srCacheDirty <= dev->srCacheDirtyLimit)
+		return;
+
+	for (i = dev->srCacheLRU.prev; i != &dev->srCacheLRU; i = i->prev) {
+		cache = ylist_entry(i, yaffs_ChunkCache, lruLink);
+		if (cache->dirty && !cache->locked) {
+			dev->nWriteBehindFlushes++;
+			yaffs_FlushFilesChunkCache(cache->object);
+			break;
+		}
 	}
 }
 
@@ -4137,7 +4824,7 @@ static void yaffs_InvalidateChunkCache(yaffs_Object *object, int chunkId)
 		yaffs_ChunkCache *cache = yaffs_FindChunkCache(object, chunkId);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_FreeChunkCache(object->myDev, cache);
 	}
 }
 
@@ -4153,7 +4840,7 @@ static void yaffs_InvalidateWholeChunkCache(yaffs_Object *in)
 		/* Invalidate it. */
 		for (i = 0; i < dev->nShortOpCaches; i++) {
 			if (dev->srCache[i].object == in)
-				dev->srCache[i].object = NULL;
+				yaffs_FreeChunkCache(dev, &dev->srCache[i]);
 		}
 	}
 }
@@ -4354,8 +5041,10 @@ static int yaffs_CheckpointObjectToObject(yaffs_Object *obj, yaffs_CheckpointObj
 	else if (obj->variantType == YAFFS_OBJECT_TYPE_HARDLINK)
 		obj->variant.hardLinkVariant.equivalentObjectId = cp->fileSizeOrEquivalentObjectId;
 
-	if (obj->hdrChunk > 0)
+	if (obj->hdrChunk > 0) {
 		obj->lazyLoaded = 1;
+		yaffs_HashObjectName(obj);
+	}
 	return 1;
 }
 
@@ -4472,7 +5161,7 @@ static int yaffs_WriteCheckpointObjects(yaffs_Device *dev)
 	 * dumping them to the checkpointing stream.
 	 */
 
-	for (i = 0; ok &&  i <  YAFFS_NOBJECT_BUCKETS; i++) {
+	for (i = 0; ok &&  i <  dev->nObjectBuckets; i++) {
 		ylist_for_each(lh, &dev->objectBucket[i].list) {
 			if (lh) {
 				obj = ylist_entry(lh, yaffs_Object, hashLink);
@@ -4694,6 +5383,8 @@ int yaffs_CheckpointSave(yaffs_Device *dev)
 	yaffs_VerifyFreeChunks(dev);
 
 	if (!dev->isCheckpointed) {
+		/* The checkpoint carries the tnode trees */
+		yaffs_RestoreAllTnodes(dev);
 		yaffs_InvalidateCheckpoint(dev);
 		yaffs_WriteCheckpointData(dev);
 	}
@@ -4772,15 +5463,10 @@ int yaffs_ReadDataFromFile(yaffs_Object *in, __u8 *buffer, loff_t offset,
 				/* If we can't find the data in the cache, then load it up. */
 
 				if (!cache) {
-					cache = yaffs_GrabChunkCache(in->myDev);
-					cache->object = in;
-					cache->chunkId = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					cache = yaffs_GrabChunkCache(in, chunk);
 					yaffs_ReadChunkDataFromObject(in, chunk,
 								      cache->
 								      data);
-					cache->nBytes = 0;
 				}
 
 				yaffs_UseChunkCache(dev, cache, 0);
@@ -4902,11 +5588,7 @@ int yaffs_WriteDataToFile(yaffs_Object *in, const __u8 *buffer, loff_t offset,
 				if (!cache
 				    && yaffs_CheckSpaceForAllocation(in->
 								     myDev)) {
-					cache = yaffs_GrabChunkCache(in->myDev);
-					cache->object = in;
-					cache->chunkId = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
+					cache = yaffs_GrabChunkCache(in, chunk);
 					yaffs_ReadChunkDataFromObject(in, chunk,
 								      cache->
 								      data);
@@ -4938,8 +5620,9 @@ int yaffs_WriteDataToFile(yaffs_Object *in, const __u8 *buffer, loff_t offset,
 						     cache->chunkId,
 						     cache->data, cache->nBytes,
 						     1);
-						cache->dirty = 0;
-					}
+						yaffs_MarkChunkCacheClean(dev, cache);
+					} else
+						yaffs_WriteBehind(in);
 
 				} else {
 					chunkWritten = -1;	/* fail the write */
@@ -4971,17 +5654,34 @@ int yaffs_WriteDataToFile(yaffs_Object *in, const __u8 *buffer, loff_t offset,
 			}
 
 		} else {
-			/* A full chunk. Write directly from the supplied buffer. */
-
+			/* A full chunk. Stage it for write-behind if we can,
+			 * else write directly from the supplied buffer.
+			 */
+			yaffs_ChunkCache *cache = NULL;
 
+			if (!writeThrough && dev->nWriteBehindChunks > 0 &&
+			    yaffs_CheckSpaceForAllocation(dev)) {
+				cache = yaffs_FindChunkCache(in, chunk);
+				if (!cache)
+					cache = yaffs_GrabChunkCache(in, chunk);
+			}
 
-			chunkWritten =
-			    yaffs_WriteChunkDataToObject(in, chunk, buffer,
-							 dev->nDataBytesPerChunk,
-							 0);
+			if (cache) {
+				yaffs_UseChunkCache(dev, cache, 1);
+				memcpy(cache->data, buffer,
+				       dev->nDataBytesPerChunk);
+				cache->nBytes = dev->nDataBytesPerChunk;
+				dev->nWriteBehindStaged++;
+				yaffs_WriteBehind(in);
+			} else {
+				chunkWritten =
+				    yaffs_WriteChunkDataToObject(in, chunk, buffer,
+							dev->nDataBytesPerChunk,
+							0);
 
-			/* Since we've overwritten the cached data, we better invalidate it. */
-			yaffs_InvalidateChunkCache(in, chunk);
+				/* Since we've overwritten the cached data, we better invalidate it. */
+				yaffs_InvalidateChunkCache(in, chunk);
+			}
 		}
 
 		if (chunkWritten >= 0) {
@@ -5347,6 +6047,7 @@ static int yaffs_UnlinkWorker(yaffs_Object *obj)
 
 		ylist_del_init(&hl->hardLinks);
 		ylist_del_init(&hl->siblings);
+		yaffs_UnhashObjectName(hl);
 
 		yaffs_GetObjectName(hl, name, YAFFS_MAX_NAME_LENGTH + 1);
 
@@ -5563,7 +6264,7 @@ static void yaffs_FixHangingObjects(yaffs_Device *dev)
 	 * Make sure it is rooted.
 	 */
 
-	for (i = 0; i <  YAFFS_NOBJECT_BUCKETS; i++) {
+	for (i = 0; i <  dev->nObjectBuckets; i++) {
 		ylist_for_each_safe(lh, n, &dev->objectBucket[i].list) {
 			if (lh) {
 				obj = ylist_entry(lh, yaffs_Object, hashLink);
@@ -5949,6 +6650,7 @@ static int yaffs_Scan(yaffs_Device *dev)
 						YINIT_LIST_HEAD(&parent->variant.
 								directoryVariant.
 								children);
+						parent->variant.directoryVariant.nUnhashed = 0;
 					} else if (!parent || parent->variantType !=
 						   YAFFS_OBJECT_TYPE_DIRECTORY) {
 						/* Hoosterman, another problem....
@@ -6603,6 +7305,7 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 					} else {
 						in->variantType = tags.extraObjectType;
 						in->lazyLoaded = 1;
+						yaffs_HashObjectName(in);
 					}
 
 					in->hdrChunk = chunk;
@@ -6660,6 +7363,7 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 						 isShrink = tags.extraIsShrinkHeader;
 						 equivalentObjectId = tags.extraEquivalentObjectId;
 						in->lazyLoaded = 1;
+						yaffs_HashObjectName(in);
 
 					}
 					in->dirty = 0;
@@ -6679,6 +7383,7 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 						YINIT_LIST_HEAD(&parent->variant.
 							directoryVariant.
 							children);
+						parent->variant.directoryVariant.nUnhashed = 0;
 					} else if (!parent || parent->variantType !=
 						   YAFFS_OBJECT_TYPE_DIRECTORY) {
 						/* Hoosterman, another problem....
@@ -6918,6 +7623,7 @@ static void yaffs_RemoveObjectFromDirectory(yaffs_Object *obj)
 		dev->removeObjectCallback(obj);
 
 
+	yaffs_UnhashObjectName(obj);
 	ylist_del_init(&obj->siblings);
 	obj->parent = NULL;
 	
@@ -6957,6 +7663,7 @@ static void yaffs_AddObjectToDirectory(yaffs_Object *directory,
 	/* Now add it */
 	ylist_add(&obj->siblings, &directory->variant.directoryVariant.children);
 	obj->parent = directory;
+	yaffs_HashObjectName(obj);
 
 	if (directory == obj->myDev->unlinkedDir
 			|| directory == obj->myDev->deletedDir) {
@@ -6999,6 +7706,26 @@ yaffs_Object *yaffs_FindObjectByName(yaffs_Object *directory,
 
 	sum = yaffs_CalcNameSum(name);
 
+	if (!directory->variant.directoryVariant.nUnhashed &&
+	    directory->myDev->nameHash) {
+		/* Every child is indexed, so only this bucket can match */
+		ylist_for_each(i, yaffs_NameBucket(directory->myDev,
+						   directory, sum)) {
+			l = ylist_entry(i, yaffs_Object, nameLink);
+
+			if (l->parent != directory ||
+			    !yaffs_SumCompare(yaffs_NameHashSum(l), sum))
+				continue;
+
+			yaffs_GetObjectName(l, buffer,
+					    YAFFS_MAX_NAME_LENGTH + 1);
+			if (yaffs_strncmp(name, buffer, YAFFS_MAX_NAME_LENGTH) == 0)
+				return l;
+		}
+
+		return NULL;
+	}
+
 	ylist_for_each(i, &directory->variant.directoryVariant.children) {
 		if (i) {
 			l = ylist_entry(i, yaffs_Object, siblings);
@@ -7008,6 +7735,10 @@ yaffs_Object *yaffs_FindObjectByName(yaffs_Object *directory,
 
 			yaffs_CheckObjectDetailsLoaded(l);
 
+			/* Pick up anything that has become indexable */
+			if (l->nameUnhashed)
+				yaffs_HashObjectName(l);
+
 			/* Special case for lost-n-found */
 			if (l->objectId == YAFFS_OBJECTID_LOSTNFOUND) {
 				if (yaffs_strcmp(name, YAFFS_LOSTNFOUND_NAME) == 0)
@@ -7341,6 +8072,24 @@ static int yaffs_CreateInitialDirectories(yaffs_Device *dev)
 	return YAFFS_FAIL;
 }
 
+static void yaffs_FixupAfterScan(yaffs_Device *dev)
+{
+	yaffs_StripDeletedObjects(dev);
+	yaffs_FixHangingObjects(dev);
+	if(dev->emptyLostAndFound)
+		yaffs_EmptyLostAndFound(dev);
+}
+
+static void yaffs_VerifyAfterScan(yaffs_Device *dev)
+{
+	yaffs_VerifyFreeChunks(dev);
+	yaffs_VerifyBlocks(dev);
+
+	/* Clean up any aborted checkpoint data */
+	if (!dev->isCheckpointed && dev->blocksInCheckpoint > 0)
+		yaffs_InvalidateCheckpoint(dev);
+}
+
 int yaffs_GutsInitialise(yaffs_Device *dev)
 {
 	int init_failed = 0;
@@ -7493,6 +8242,7 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	/* More device initialisation */
 	dev->garbageCollections = 0;
 	dev->passiveGarbageCollections = 0;
+	dev->backgroundGarbageCollections = 0;
 	dev->currentDirtyChecker = 0;
 	dev->bufferedBlock = -1;
 	dev->doingBufferedBlockRewrite = 0;
@@ -7508,12 +8258,15 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	dev->isDoingGC = 0;
 	dev->hasPendingPrioritisedGCs = 1; /* Assume the worst for now, will get fixed on first GC */
 	dev->oldestDirtySequence = 0;
+	dev->scanPending = 0;
 
 	/* Initialise temporary buffers and caches. */
 	if (!yaffs_InitialiseTempBuffers(dev))
 		init_failed = 1;
 
 	dev->srCache = NULL;
+	dev->srCacheHash = NULL;
+	dev->srCacheFlush = NULL;
 	dev->gcCleanupList = NULL;
 
 
@@ -7521,28 +8274,55 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	    dev->nShortOpCaches > 0) {
 		int i;
 		void *buf;
-		int srCacheBytes = dev->nShortOpCaches * sizeof(yaffs_ChunkCache);
+		int srCacheBytes;
+		int nBuckets = 1;
 
 		if (dev->nShortOpCaches > YAFFS_MAX_SHORT_OP_CACHES)
 			dev->nShortOpCaches = YAFFS_MAX_SHORT_OP_CACHES;
 
+		srCacheBytes = dev->nShortOpCaches * sizeof(yaffs_ChunkCache);
+		while (nBuckets < dev->nShortOpCaches)
+			nBuckets <<= 1;
+
 		dev->srCache =  YMALLOC(srCacheBytes);
+		dev->srCacheHash = YMALLOC(nBuckets * sizeof(struct ylist_head));
+		dev->srCacheFlush = YMALLOC(dev->nShortOpCaches *
+					    sizeof(yaffs_ChunkCache *));
+		dev->srCacheHashMask = nBuckets - 1;
+		dev->srCacheDirty = 0;
+		YINIT_LIST_HEAD(&dev->srCacheLRU);
+		YINIT_LIST_HEAD(&dev->srCacheFree);
 
-		buf = (__u8 *) dev->srCache;
+		buf = NULL;
 
 		if (dev->srCache)
 			memset(dev->srCache, 0, srCacheBytes);
 
+		if (dev->srCache && dev->srCacheHash && dev->srCacheFlush) {
+			buf = (__u8 *) dev->srCache;
+			for (i = 0; i < nBuckets; i++)
+				YINIT_LIST_HEAD(&dev->srCacheHash[i]);
+		}
+
 		for (i = 0; i < dev->nShortOpCaches && buf; i++) {
 			dev->srCache[i].object = NULL;
-			dev->srCache[i].lastUse = 0;
 			dev->srCache[i].dirty = 0;
+			YINIT_LIST_HEAD(&dev->srCache[i].hashLink);
+			ylist_add_tail(&dev->srCache[i].lruLink,
+				       &dev->srCacheFree);
 			dev->srCache[i].data = buf = YMALLOC_DMA(dev->totalBytesPerChunk);
 		}
 		if (!buf)
 			init_failed = 1;
 
-		dev->srLastUse = 0;
+		if (dev->nWriteBehindChunks > dev->nShortOpCaches / 2)
+			dev->nWriteBehindChunks = dev->nShortOpCaches / 2;
+		if (dev->nWriteBehindChunks < 2)
+			dev->nWriteBehindChunks = 0;
+		dev->srCacheDirtyLimit = dev->nShortOpCaches -
+					 dev->nShortOpCaches / 4;
+	} else {
+		dev->nWriteBehindChunks = 0;
 	}
 
 	dev->cacheHits = 0;
@@ -7560,7 +8340,8 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 		init_failed = 1;
 
 	yaffs_InitialiseTnodes(dev);
-	yaffs_InitialiseObjects(dev);
+	if (!yaffs_InitialiseObjects(dev))
+		init_failed = 1;
 
 	if (!init_failed && !yaffs_CreateInitialDirectories(dev))
 		init_failed = 1;
@@ -7595,21 +8376,25 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 					init_failed = 1;
 
 				yaffs_InitialiseTnodes(dev);
-				yaffs_InitialiseObjects(dev);
+				if (!yaffs_InitialiseObjects(dev))
+					init_failed = 1;
 
 				if (!init_failed && !yaffs_CreateInitialDirectories(dev))
 					init_failed = 1;
 
-				if (!init_failed && !yaffs_ScanBackwards(dev))
+				/* The root directory is all there is until
+				 * yaffs_GutsFinishScan() gets to run.
+				 */
+				if (!init_failed && dev->deferScan)
+					dev->scanPending = 1;
+				else if (!init_failed && !yaffs_ScanBackwards(dev))
 					init_failed = 1;
 			}
 		} else if (!yaffs_Scan(dev))
 				init_failed = 1;
 
-		yaffs_StripDeletedObjects(dev);
-		yaffs_FixHangingObjects(dev);
-		if(dev->emptyLostAndFound)
-			yaffs_EmptyLostAndFound(dev);
+		if (!dev->scanPending)
+			yaffs_FixupAfterScan(dev);
 	}
 
 	if (init_failed) {
@@ -7630,12 +8415,8 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 
 	dev->nRetiredBlocks = 0;
 
-	yaffs_VerifyFreeChunks(dev);
-	yaffs_VerifyBlocks(dev);
-
-	/* Clean up any aborted checkpoint data */
-	if (!dev->isCheckpointed && dev->blocksInCheckpoint > 0)
-		yaffs_InvalidateCheckpoint(dev);
+	if (!dev->scanPending)
+		yaffs_VerifyAfterScan(dev);
 
 	T(YAFFS_TRACE_TRACING,
 	  (TSTR("yaffs: yaffs_GutsInitialise() done.\n" TENDSTR)));
@@ -7643,11 +8424,46 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 
 }
 
+/*
+ * Scan the flash for a device that yaffs_GutsInitialise() mounted with
+ * scanPending set. Nothing else may touch the device until this returns,
+ * the caller holds whatever lock serialises access to it.
+ * On failure the in-memory tree is incomplete and must not be written to.
+ */
+int yaffs_GutsFinishScan(yaffs_Device *dev)
+{
+	int ok;
+
+	if (!dev->scanPending)
+		return YAFFS_OK;
+
+	T(YAFFS_TRACE_SCAN,
+	  (TSTR("yaffs: yaffs_GutsFinishScan() starts.\n" TENDSTR)));
+
+	ok = yaffs_ScanBackwards(dev);
+	dev->scanPending = 0;
+	if (!ok)
+		return YAFFS_FAIL;
+
+	yaffs_FixupAfterScan(dev);
+	yaffs_VerifyAfterScan(dev);
+
+	T(YAFFS_TRACE_SCAN,
+	  (TSTR("yaffs: yaffs_GutsFinishScan() done.\n" TENDSTR)));
+	return YAFFS_OK;
+}
+
 void yaffs_Deinitialise(yaffs_Device *dev)
 {
 	if (dev->isMounted) {
+		struct ylist_head *lh;
 		int i;
 
+		for (i = 0; i < dev->nObjectBuckets && dev->nEvictedFiles; i++)
+			ylist_for_each(lh, &dev->objectBucket[i].list)
+				yaffs_DropEvictedBlocks(ylist_entry(lh,
+						yaffs_Object, hashLink));
+
 		yaffs_DeinitialiseBlocks(dev);
 		yaffs_DeinitialiseTnodes(dev);
 		yaffs_DeinitialiseObjects(dev);
@@ -7664,6 +8480,11 @@ void yaffs_Deinitialise(yaffs_Device *dev)
 			dev->srCache = NULL;
 		}
 
+		YFREE(dev->srCacheHash);
+		dev->srCacheHash = NULL;
+		YFREE(dev->srCacheFlush);
+		dev->srCacheFlush = NULL;
+
 		YFREE(dev->gcCleanupList);
 
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
@@ -7723,10 +8544,7 @@ int yaffs_GetNumberOfFreeChunks(yaffs_Device *dev)
 
 	/* Now count the number of dirty chunks in the cache and subtract those */
 
-	for (nDirtyCacheChunks = 0, i = 0; i < dev->nShortOpCaches; i++) {
-		if (dev->srCache[i].dirty)
-			nDirtyCacheChunks++;
-	}
+	nDirtyCacheChunks = (dev->nShortOpCaches > 0) ? dev->srCacheDirty : 0;
 
 	nFree -= nDirtyCacheChunks;
 
@@ -58,7 +58,10 @@
 #define YAFFS_ALLOCATION_NTNODES	100
 #define YAFFS_ALLOCATION_NLINKS		100
 
+/* Both object hashes start at this size and double as they fill up */
 #define YAFFS_NOBJECT_BUCKETS		256
+#define YAFFS_MAX_OBJECT_BUCKETS	8192
+#define YAFFS_OBJECT_BUCKET_LOAD	4
 
 
 #define YAFFS_OBJECT_SPACE		0x40000
@@ -88,7 +91,9 @@
 
 /* */
 
-#define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_MAX_SHORT_OP_CACHES	1024
+
+#define YAFFS_WRITE_BEHIND_CHUNKS	16
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
@@ -113,9 +118,10 @@
 
 /* ChunkCache is used for short read/write operations.*/
 typedef struct {
+	struct ylist_head hashLink;	/* Chain in dev->srCacheHash */
+	struct ylist_head lruLink;	/* In dev->srCacheLRU or dev->srCacheFree */
 	struct yaffs_ObjectStruct *object;
 	int chunkId;
-	int lastUse;
 	int dirty;
 	int nBytes;		/* Only valid if the cache is dirty */
 	int locked;		/* Can't push out or flush while locked. */
@@ -365,6 +371,7 @@ typedef union yaffs_Tnode_union yaffs_Tnode;
 struct yaffs_TnodeList_struct {
 	struct yaffs_TnodeList_struct *next;
 	yaffs_Tnode *tnodes;
+	int nTnodes;
 };
 
 typedef struct yaffs_TnodeList_struct yaffs_TnodeList;
@@ -383,10 +390,15 @@ typedef struct {
 	__u32 shrinkSize;
 	int topLevel;
 	yaffs_Tnode *top;
+	__u32 *evictedBlocks;	/* While the tnode tree is evicted: the blocks
+				 * holding the file's data, sorted. */
+	int nEvictedBlocks;
+	int nDirtyChunks;	/* Dirty short op cache entries */
 } yaffs_FileStructure;
 
 typedef struct {
 	struct ylist_head children;     /* list of child links */
+	int nUnhashed;			/* children not in the name hash */
 } yaffs_DirectoryStructure;
 
 typedef struct {
@@ -425,6 +437,7 @@ struct yaffs_ObjectStruct {
 				 */
 	__u8 beingCreated:1;	/* This object is still being created so skip some checks. */
 	__u8 isShadowed:1;      /* This object is shadowed on the way to being renamed. */
+	__u8 nameUnhashed:1;	/* Counted in parent's nUnhashed rather than in the name hash */
 
 	__u8 serial;		/* serial number of chunk in NAND. Cached here */
 	__u16 sum;		/* sum of the name to speed searching */
@@ -432,6 +445,7 @@ struct yaffs_ObjectStruct {
 	struct yaffs_DeviceStruct *myDev;       /* The device I'm on */
 
 	struct ylist_head hashLink;     /* list of objects in this hash bucket */
+	struct ylist_head nameLink;	/* list of objects in this name hash bucket */
 
 	struct ylist_head hardLinks;    /* all the equivalent hard linked objects */
 
@@ -556,10 +570,17 @@ struct yaffs_DeviceStruct {
 				 * the number of short op caches (don't use too many)
 				 */
 
+	int nWriteBehindChunks;	/* Whole chunks staged per file before they
+				 * are written out together, 0 to disable.
+				 * Clipped to half the short op caches.
+				 */
+
 	int useHeaderFileSize;	/* Flag to determine if we should use file sizes from the header */
 
 	int emptyLostAndFound;  /* Flasg to determine if lst+found should be emptied on init */
 
+	int deferScan;		/* Leave any scan to yaffs_GutsFinishScan() */
+
 	int useNANDECC;		/* Flag to decide whether or not to use NANDECC */
 
 	void *genericDevice;	/* Pointer to device context
@@ -615,6 +636,11 @@ struct yaffs_DeviceStruct {
 	__u8 skipCheckpointRead;
 	__u8 skipCheckpointWrite;
 
+	/* Set while something calls yaffs_BackgroundGarbageCollect(), writers
+	 * then leave leisurely collection to it. Can be changed at any time.
+	 */
+	int backgroundGC;
+
 	/* Runtime parameters. Set up by YAFFS. */
 
 	__u16 chunkGroupBits;	/* 0 for devices <= 32MB. else log2(nchunks) - 16 */
@@ -644,6 +670,8 @@ struct yaffs_DeviceStruct {
 				 */
 	void (*putSuperFunc) (struct super_block *sb);
         struct ylist_head searchContexts;
+	struct task_struct *bgGCThread;
+	unsigned long lastActivity;	/* jiffies at the last file system op */
 
 #endif
 
@@ -651,6 +679,8 @@ struct yaffs_DeviceStruct {
 
 	int isCheckpointed;
 
+	int scanPending;	/* Mounted, flash not scanned yet */
+
 
 	/* Stuff to support block offsetting to support start block zero */
 	int internalStartBlock;
@@ -695,6 +725,11 @@ struct yaffs_DeviceStruct {
 	yaffs_Tnode *freeTnodes;
 	int nFreeTnodes;
 	yaffs_TnodeList *allocatedTnodeList;
+	int tnodeEvictBucket;	/* Where the tnode shrinker resumes */
+	int nEvictedFiles;	/* Files whose tnode tree is evicted */
+	int nTnodeEvictions;
+	int nTnodeRestores;
+	int nTnodeBlocksReleased;
 
 	int isDoingGC;
 	int gcBlock;
@@ -708,7 +743,13 @@ struct yaffs_DeviceStruct {
 
 	yaffs_ObjectList *allocatedObjectList;
 
-	yaffs_ObjectBucket objectBucket[YAFFS_NOBJECT_BUCKETS];
+	yaffs_ObjectBucket *objectBucket;	/* Hashed on objectId */
+	int nObjectBuckets;
+	int nHashedObjects;
+
+	struct ylist_head *nameHash;	/* Hashed on (parent, name sum) */
+	int nNameBuckets;
+	int nNameHashed;
 
 	int nFreeChunks;
 
@@ -725,6 +766,7 @@ struct yaffs_DeviceStruct {
 	int nGCCopies;
 	int garbageCollections;
 	int passiveGarbageCollections;
+	int backgroundGarbageCollections;
 	int nRetriedWrites;
 	int nRetiredBlocks;
 	int eccFixed;
@@ -749,7 +791,15 @@ struct yaffs_DeviceStruct {
 	int doingBufferedBlockRewrite;
 
 	yaffs_ChunkCache *srCache;
-	int srLastUse;
+	struct ylist_head *srCacheHash;	/* Buckets hashed on (object, chunkId) */
+	unsigned srCacheHashMask;
+	struct ylist_head srCacheLRU;	/* Entries in use, most recent first */
+	struct ylist_head srCacheFree;	/* Entries with no object */
+	yaffs_ChunkCache **srCacheFlush; /* Scratch list for flushing an object */
+	int srCacheDirty;		/* Number of dirty entries */
+	int srCacheDirtyLimit;		/* Write back the oldest above this */
+	int nWriteBehindStaged;
+	int nWriteBehindFlushes;
 
 	int cacheHits;
 
@@ -820,6 +870,8 @@ typedef struct {
 /*----------------------- YAFFS Functions -----------------------*/
 
 int yaffs_GutsInitialise(yaffs_Device *dev);
+int yaffs_GutsFinishScan(yaffs_Device *dev);
+int yaffs_BackgroundGarbageCollect(yaffs_Device *dev, int idle);
 void yaffs_Deinitialise(yaffs_Device *dev);
 
 int yaffs_GetNumberOfFreeChunks(yaffs_Device *dev);
@@ -856,6 +908,9 @@ void yaffs_FlushEntireDeviceCache(yaffs_Device *dev);
 int yaffs_CheckpointSave(yaffs_Device *dev);
 int yaffs_CheckpointRestore(yaffs_Device *dev);
 
+/* Tnode reclaim */
+int yaffs_EvictTnodes(yaffs_Device *dev, int nTnodes);
+
 /* Directory operations */
 yaffs_Object *yaffs_MknodDirectory(yaffs_Object *parent, const YCHAR *name,
 				__u32 mode, __u32 uid, __u32 gid);
@@ -39,6 +39,9 @@
 #define MADV_MERGEABLE   12		/* KSM may merge identical pages */
 #define MADV_UNMERGEABLE 13		/* KSM may not merge identical pages */
 
+#define MADV_LAZYFORK	14		/* share page tables with children */
+#define MADV_NOLAZYFORK	15		/* copy page tables on fork again */
+
 /* compatibility flags */
 #define MAP_FILE	0
 
@@ -71,6 +71,25 @@
 #define PMEM_CLEAN_INV_CACHES	_IOW(PMEM_IOCTL_MAGIC, 11, unsigned int)
 #define PMEM_CLEAN_CACHES	_IOW(PMEM_IOCTL_MAGIC, 12, unsigned int)
 #define PMEM_INV_CACHES		_IOW(PMEM_IOCTL_MAGIC, 13, unsigned int)
+/* Selects how the file is mapped by its mmap, pass one of the
+ * PMEM_MAP_MODE_* values as the argument. Fails once the file is mapped.
+ */
+#define PMEM_SET_MAP_MODE	_IOW(PMEM_IOCTL_MAGIC, 14, unsigned int)
+/* Cleans and/or invalidates a byte range of the allocation, pass a
+ * pmem_cache_range struct. Unlike PMEM_CLEAN_CACHES it takes an offset into
+ * the allocation, no user address.
+ */
+#define PMEM_CACHE_RANGE	_IOW(PMEM_IOCTL_MAGIC, 15, unsigned int)
+
+/* the region's own setting, uncached if the file was opened O_SYNC */
+#define PMEM_MAP_MODE_DEFAULT		0
+#define PMEM_MAP_MODE_CACHED		1
+#define PMEM_MAP_MODE_WRITECOMBINE	2
+#define PMEM_MAP_MODE_UNCACHED		3
+
+#define PMEM_CACHE_OP_CLEAN_INV		0
+#define PMEM_CACHE_OP_CLEAN		1
+#define PMEM_CACHE_OP_INV		2
 
 struct pmem_region {
 	unsigned long offset;
@@ -83,6 +102,13 @@ struct pmem_addr {
 	unsigned long length;
 };
 
+struct pmem_cache_range {
+	unsigned long offset;
+	unsigned long length;
+	/* one of PMEM_CACHE_OP_* */
+	unsigned int op;
+};
+
 #ifdef __KERNEL__
 void put_pmem_fd(int fd);
 void flush_pmem_fd(int fd, unsigned long start, unsigned long len);
@@ -142,6 +168,10 @@ struct android_pmem_platform_data
 	unsigned buffered;
 	/* This PMEM is on memory that may be powered off */
 	unsigned unstable;
+	/* The region is part of the kernel's lowmem and is lent to the page
+	 * allocator for movable pages while nothing is allocated from it,
+	 * needs CONFIG_LENDABLE_MEMORY */
+	unsigned lendable;
 };
 
 /* flags in the following function defined as above. */
@@ -27,6 +27,13 @@
 #define ASHMEM_IS_UNPINNED	0
 #define ASHMEM_IS_PINNED	1
 
+/*
+ * Regeneration cost hints for ASHMEM_SET_PURGE_COST. An unpinned range of
+ * cost c is purged as if it had been unpinned 2^c times more recently.
+ */
+#define ASHMEM_PURGE_COST_DEF	0
+#define ASHMEM_PURGE_COST_MAX	7
+
 struct ashmem_pin {
 	__u32 offset;	/* offset into region, in bytes, page-aligned */
 	__u32 len;	/* length forward from offset, in bytes, page-aligned */
@@ -44,5 +51,13 @@ struct ashmem_pin {
 #define ASHMEM_UNPIN		_IOW(__ASHMEMIOC, 8, struct ashmem_pin)
 #define ASHMEM_GET_PIN_STATUS	_IO(__ASHMEMIOC, 9)
 #define ASHMEM_PURGE_ALL_CACHES	_IO(__ASHMEMIOC, 10)
+#define ASHMEM_SET_PURGE_COST	_IOW(__ASHMEMIOC, 11, unsigned long)
+#define ASHMEM_GET_PURGE_COST	_IO(__ASHMEMIOC, 12)
+
+#ifdef __KERNEL__
+struct file;
+
+struct file *ashmem_kernel_file(struct file *file);
+#endif
 
 #endif	/* _LINUX_ASHMEM_H */
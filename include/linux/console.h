@@ -92,6 +92,7 @@ void give_up_console(const struct consw *sw);
 #define CON_BOOT	(8)
 #define CON_ANYTIME	(16) /* Safe to call when cpu is offline */
 #define CON_BRL		(32) /* Used for a braille device */
+#define CON_IMMEDIATE	(64) /* Cheap to write, never deferred */
 
 struct console {
 	char	name[16];
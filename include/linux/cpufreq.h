@@ -196,6 +196,48 @@ extern int __cpufreq_driver_getavg(struct cpufreq_policy *policy,
 int cpufreq_register_governor(struct cpufreq_governor *governor);
 void cpufreq_unregister_governor(struct cpufreq_governor *governor);
 
+/*
+ * Idle hooks for governors that sample load around idle (interactive,
+ * smartass).  One pm_idle wrapper is shared by all of them, so they can
+ * be stacked or switched at runtime.  idle_enter runs with irqs off just
+ * before the cpu idles, idle_exit right after it wakes; both only for the
+ * cpus in @cpus, normally the governed policy's.
+ */
+struct cpufreq_idle_notifier {
+	struct list_head	list;
+	const struct cpumask	*cpus;
+	void			(*idle_enter)(struct cpufreq_idle_notifier *n,
+					      unsigned int cpu);
+	void			(*idle_exit)(struct cpufreq_idle_notifier *n,
+					     unsigned int cpu);
+};
+
+#ifdef CONFIG_CPU_FREQ_IDLE_NOTIFIER
+void cpufreq_register_idle_notifier(struct cpufreq_idle_notifier *n);
+void cpufreq_unregister_idle_notifier(struct cpufreq_idle_notifier *n);
+bool cpufreq_idle_skip_sample(struct cpufreq_policy *policy);
+#endif
+
+/* Governor and driver hooks into cpufreq_stats */
+#define CPUFREQ_STATS_LATENCY_CLOCK	0	/* PLL/clock source switch */
+#define CPUFREQ_STATS_LATENCY_VDD	1	/* core voltage change */
+#define CPUFREQ_STATS_LATENCY_NR	2
+
+#ifdef CONFIG_CPU_FREQ_STAT
+void cpufreq_stats_update_load(unsigned int cpu, unsigned int load);
+void cpufreq_stats_update_request(struct cpufreq_policy *policy,
+				  unsigned int freq);
+void cpufreq_stats_update_latency(unsigned int cpu, unsigned int phase,
+				  unsigned int usecs);
+#else
+static inline void cpufreq_stats_update_load(unsigned int cpu,
+					     unsigned int load) { }
+static inline void cpufreq_stats_update_request(struct cpufreq_policy *policy,
+						unsigned int freq) { }
+static inline void cpufreq_stats_update_latency(unsigned int cpu,
+		unsigned int phase, unsigned int usecs) { }
+#endif
+
 int lock_policy_rwsem_read(int cpu);
 int lock_policy_rwsem_write(int cpu);
 void unlock_policy_rwsem_read(int cpu);
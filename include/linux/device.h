@@ -128,6 +128,15 @@ struct device_driver {
 
 	bool suppress_bind_attrs;	/* disables bind/unbind via sysfs */
 
+	/*
+	 * Probe devices from an async thread when registered during boot,
+	 * after the driver named by probe_after (on the same bus) if that
+	 * one is async too. Not for drivers registered through
+	 * platform_driver_probe(), which checks the binding right away.
+	 */
+	bool probe_async;
+	const char *probe_after;
+
 	int (*probe) (struct device *dev);
 	int (*remove) (struct device *dev);
 	void (*shutdown) (struct device *dev);
@@ -32,7 +32,9 @@ extern int ds2784_unregister_notifier(struct notifier_block *nb);
 extern int ds2784_get_battery_info(struct battery_info_reply *batt_info);
 extern ssize_t htc_battery_show_attr(struct device_attribute *attr,
 			char *buf);
+extern void ds2784_set_poll_backoff(int on);
 #else
+static inline void ds2784_set_poll_backoff(int on) { }
 static int ds2784_register_notifier(struct notifier_block *nb) { return 0; }
 static int ds2784_unregister_notifier(struct notifier_block *nb) { return 0; }
 static int ds2784_get_battery_info(struct battery_info_reply *batt_info)
@@ -64,6 +64,11 @@ enum gpio_event_matrix_flags {
 					   GPIOKPF_DEBOUNCE,
 	GPIOKPF_DRIVE_INACTIVE           = 1U << 3,
 	GPIOKPF_LEVEL_TRIGGERED_IRQ      = 1U << 4,
+	/* With level triggered irqs, arm held inputs for release instead
+	 * of polling while keys are down. A second key on an input that is
+	 * already active is only seen when the first one is released.
+	 */
+	GPIOKPF_IRQ_RELEASE              = 1U << 5,
 	GPIOKPF_PRINT_UNMAPPED_KEYS      = 1U << 16,
 	GPIOKPF_PRINT_MAPPED_KEYS        = 1U << 17,
 	GPIOKPF_PRINT_PHANTOM_KEYS       = 1U << 18,
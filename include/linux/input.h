@@ -66,6 +66,7 @@ struct input_absinfo {
 #define EVIOCGNAME(len)		_IOC(_IOC_READ, 'E', 0x06, len)		/* get device name */
 #define EVIOCGPHYS(len)		_IOC(_IOC_READ, 'E', 0x07, len)		/* get physical location */
 #define EVIOCGUNIQ(len)		_IOC(_IOC_READ, 'E', 0x08, len)		/* get unique identifier */
+#define EVIOCGEVENTS(len)	_IOC(_IOC_READ, 'E', 0x0a, len)		/* drain queued events, never blocks */
 
 #define EVIOCGKEY(len)		_IOC(_IOC_READ, 'E', 0x18, len)		/* get global keystate */
 #define EVIOCGLED(len)		_IOC(_IOC_READ, 'E', 0x19, len)		/* get all LEDs */
@@ -996,6 +997,7 @@ struct ff_effect {
 
 #include <linux/device.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <linux/timer.h>
 #include <linux/mod_devicetable.h>
 
@@ -1100,6 +1102,7 @@ struct input_dev {
 	struct timer_list timer;
 
 	int sync;
+	ktime_t timestamp;
 
 	int abs[ABS_MAX + 1];
 	int rep[REP_MAX + 1];
@@ -1135,6 +1138,28 @@ struct input_dev {
 };
 #define to_input_dev(d) container_of(d, struct input_dev, dev)
 
+/**
+ * input_set_timestamp - set the time the following events happened
+ * @dev: input device
+ * @timestamp: usually taken with ktime_get() in the hard irq handler
+ *
+ * Handlers see @timestamp instead of the time the event reached them,
+ * so work queue latency does not end up in the event time. It is
+ * cleared by the next SYN_REPORT.
+ */
+static inline void input_set_timestamp(struct input_dev *dev,
+				       ktime_t timestamp)
+{
+	dev->timestamp = timestamp;
+}
+
+static inline ktime_t input_get_timestamp(struct input_dev *dev)
+{
+	if (dev->timestamp.tv64)
+		return dev->timestamp;
+	return ktime_get();
+}
+
 /*
  * Verify that we are in sync with input_device_id mod_devicetable.h #defines
  */
@@ -48,6 +48,17 @@
  */
 #define JBD_DEFAULT_MAX_COMMIT_AGE 5
 
+/*
+ * Upper bound of the commit batching window, in microseconds.  A commit
+ * request is never held back longer than this.
+ */
+#define JBD_MAX_BATCH_WINDOW	100000
+
+/*
+ * Number of commits kept in the per-journal commit history.
+ */
+#define JBD_COMMIT_HISTORY	32
+
 #ifdef CONFIG_JBD_DEBUG
 /*
  * Define JBD_EXPENSIVE_CHECKING to enable more expensive internal
@@ -547,11 +558,23 @@ struct transaction_s
 	 */
 	ktime_t			t_start_time;
 
+	/*
+	 * When the first commit of this transaction was requested, zero if
+	 * it hasn't been yet [j_state_lock]
+	 */
+	ktime_t			t_batch_start;
+
 	/*
 	 * How many handles used this transaction? [t_handle_lock]
 	 */
 	int t_handle_count;
 
+	/*
+	 * How many processes are waiting for this transaction to commit?
+	 * [j_state_lock]
+	 */
+	int t_commit_waiters;
+
 	/*
 	 * This transaction is being forced and some process is
 	 * waiting for it to finish.
@@ -559,6 +582,18 @@ struct transaction_s
 	unsigned int t_synchronous_commit:1;
 };
 
+/*
+ * One entry of the commit history: what a commit wrote, how long it was
+ * held back for batching, how long it took and how many were waiting.
+ */
+struct journal_commit_stats {
+	tid_t			cs_tid;
+	unsigned int		cs_blocks;
+	unsigned int		cs_waiters;
+	unsigned int		cs_batch_us;
+	unsigned int		cs_commit_us;
+};
+
 /**
  * struct journal_s - this is the concrete type associated with journal_t.
  * @j_flags:  General journaling state flags
@@ -621,6 +656,16 @@ struct transaction_s
  * @j_last_sync_writer: most recent pid which did a synchronous write
  * @j_average_commit_time: the average amount of time in nanoseconds it
  *	takes to commit a transaction to the disk.
+ * @j_batch_window: how long, in microseconds, a requested commit waits for
+ *	more requests to join it
+ * @j_commits: number of commits done
+ * @j_commit_blocks: metadata blocks written by all commits
+ * @j_commit_waiters: processes woken by all commits
+ * @j_max_commit_time: the longest commit so far, in nanoseconds
+ * @j_history: the last JBD_COMMIT_HISTORY commits
+ * @j_history_cur: next slot of @j_history
+ * @j_devname: name of the journal device, used for procfs
+ * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_private: An opaque pointer to fs-private information.
  */
 
@@ -822,6 +867,25 @@ struct journal_s
 	 */
 	u64			j_average_commit_time;
 
+	/*
+	 * Commit batching window in microseconds, 0 disables batching.
+	 * [j_state_lock]
+	 */
+	unsigned int		j_batch_window;
+
+	/*
+	 * Commit statistics [j_state_lock]
+	 */
+	unsigned long		j_commits;
+	unsigned long		j_commit_blocks;
+	unsigned long		j_commit_waiters;
+	u64			j_max_commit_time;
+	struct journal_commit_stats j_history[JBD_COMMIT_HISTORY];
+	int			j_history_cur;
+
+	char			j_devname[BDEVNAME_SIZE+24];
+	struct proc_dir_entry	*j_proc_entry;
+
 	/*
 	 * An opaque pointer to fs-private information.  ext3 puts its
 	 * superblock pointer here
@@ -1000,6 +1064,7 @@ int __log_start_commit(journal_t *journal, tid_t tid);
 int journal_start_commit(journal_t *journal, tid_t *tid);
 int journal_force_commit_nested(journal_t *journal);
 int log_wait_commit(journal_t *journal, tid_t tid);
+void journal_set_batch_window(journal_t *journal, unsigned int usecs);
 int log_do_checkpoint(journal_t *journal);
 
 void __log_wait_for_space(journal_t *journal);
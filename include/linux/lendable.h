@@ -0,0 +1,39 @@
+#ifndef __LINUX_LENDABLE_H
+#define __LINUX_LENDABLE_H
+
+/*
+ * Lendable memory: a physically contiguous range that a driver owns but
+ * does not always need. While the driver is idle the buddy allocator
+ * lends the pages out to movable allocations (page cache, anonymous
+ * memory); lendable_claim() migrates them away and hands the whole range
+ * to the driver, lendable_release() gives it back to the page allocator.
+ *
+ * Ranges must be aligned to MAX_ORDER_NR_PAGES and lie in a single zone.
+ */
+
+#include <linux/errno.h>
+
+#ifdef CONFIG_LENDABLE_MEMORY
+extern int lendable_declare(unsigned long start_pfn, unsigned long nr_pages);
+extern int lendable_claim(unsigned long start_pfn, unsigned long nr_pages);
+extern void lendable_release(unsigned long start_pfn, unsigned long nr_pages);
+#else
+static inline int lendable_declare(unsigned long start_pfn,
+				   unsigned long nr_pages)
+{
+	return -ENOSYS;
+}
+
+static inline int lendable_claim(unsigned long start_pfn,
+				 unsigned long nr_pages)
+{
+	return -ENOSYS;
+}
+
+static inline void lendable_release(unsigned long start_pfn,
+				    unsigned long nr_pages)
+{
+}
+#endif
+
+#endif /* __LINUX_LENDABLE_H */
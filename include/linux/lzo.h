@@ -27,6 +27,16 @@ int lzo1x_1_compress(const unsigned char *src, size_t src_len,
 int lzo1x_decompress_safe(const unsigned char *src, size_t src_len,
 			unsigned char *dst, size_t *dst_len);
 
+/*
+ * Portable byte-wise versions of the above. The plain entry points use
+ * word-sized unaligned accesses where the CPU allows them; these are kept
+ * for comparison.
+ */
+int lzo1x_1_compress_generic(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *wrkmem);
+int lzo1x_decompress_safe_generic(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len);
+
 /*
  * Return values (< 0 = Error)
  */
@@ -28,6 +28,7 @@ extern unsigned long num_physpages;
 extern unsigned long totalram_pages;
 extern void * high_memory;
 extern int page_cluster;
+extern int sysctl_fault_around_pages;
 
 #ifdef CONFIG_SYSCTL
 extern int sysctl_legacy_va_layout;
@@ -107,6 +108,11 @@ extern unsigned int kobjsize(const void *objp);
 #define VM_CAN_NONLINEAR 0x08000000	/* Has ->fault & does nonlinear pages */
 #define VM_MIXEDMAP	0x10000000	/* Can contain "struct page" and pure PFN pages */
 #define VM_SAO		0x20000000	/* Strong Access Ordering (powerpc) */
+#ifdef CONFIG_LAZY_FORK
+#define VM_LAZYFORK	0x20000000	/* Share page tables with the child on fork */
+#else
+#define VM_LAZYFORK	0x00000000
+#endif
 #define VM_PFN_AT_MMAP	0x40000000	/* PFNMAP vma that is fully mapped at mmap time */
 #define VM_MERGEABLE	0x80000000	/* KSM may merge identical pages */
 
@@ -916,6 +922,33 @@ int __pmd_alloc(struct mm_struct *mm, pud_t *pud, unsigned long address);
 #endif
 
 int __pte_alloc(struct mm_struct *mm, pmd_t *pmd, unsigned long address);
+#ifdef CONFIG_LAZY_FORK
+/*
+ * A page table is shared between a parent and the children it forked
+ * after MADV_LAZYFORK; it is copied on the first fault in either mm.
+ */
+static inline int pte_table_shared(pmd_t *pmd)
+{
+	return page_count(pmd_page(*pmd)) > 1;
+}
+int unshare_pte_range(struct vm_area_struct *vma, unsigned long start,
+		unsigned long end);
+void flush_shared_pte_table(struct mm_struct *mm, unsigned long address);
+#else
+static inline int pte_table_shared(pmd_t *pmd)
+{
+	return 0;
+}
+static inline int unshare_pte_range(struct vm_area_struct *vma,
+		unsigned long start, unsigned long end)
+{
+	return 0;
+}
+static inline void flush_shared_pte_table(struct mm_struct *mm,
+		unsigned long address)
+{
+}
+#endif
 int __pte_alloc_kernel(pmd_t *pmd, unsigned long address);
 
 /*
@@ -81,4 +81,17 @@ struct adsp_pmem_info {
 #define ADSP_IOCTL_LINK_TASK \
 	_IOW(ADSP_IOCTL_MAGIC, 16, unsigned)
 
+/* ADSP_IOCTL_WRITE_COMMANDS: up to ADSP_MAX_BATCH commands, written to
+ * the DSP back to back. Returns 0 once all of them have been queued.
+ */
+#define ADSP_MAX_BATCH 16
+
+struct adsp_commands_t {
+	uint32_t count;
+	struct adsp_command_t *cmds;
+};
+
+#define ADSP_IOCTL_WRITE_COMMANDS \
+	_IOW(ADSP_IOCTL_MAGIC, 17, struct adsp_commands_t *)
+
 #endif
@@ -61,6 +61,8 @@
 #define AUDIO_ENABLE_AUXPGA_LOOPBACK _IOW(AUDIO_IOCTL_MAGIC, 40, unsigned)
 #define AUDIO_SET_AUXPGA_GAIN       _IOW(AUDIO_IOCTL_MAGIC, 41, unsigned)
 #define AUDIO_SET_RX_MUTE           _IOW(AUDIO_IOCTL_MAGIC, 42, unsigned)
+#define AUDIO_GET_SBC_ENC_CONFIG    _IOR(AUDIO_IOCTL_MAGIC, 43, unsigned)
+#define AUDIO_SET_SBC_ENC_CONFIG    _IOW(AUDIO_IOCTL_MAGIC, 44, unsigned)
 
 #define	AUDIO_MAX_COMMON_IOCTL_NUM	100
 
@@ -86,6 +88,22 @@ struct msm_mute_info {
 	uint32_t path;
 };
 
+#define AUDIO_SBC_ALLOCATION_LOUDNESS	0
+#define AUDIO_SBC_ALLOCATION_SNR	1
+
+#define AUDIO_SBC_MODE_MONO		1
+#define AUDIO_SBC_MODE_STEREO		2
+#define AUDIO_SBC_MODE_DUAL		8
+#define AUDIO_SBC_MODE_JOINT_STEREO	9
+
+struct msm_audio_sbc_enc_config {
+	uint32_t subbands;	/* 4 or 8 */
+	uint32_t block_len;	/* 4, 8, 12 or 16 */
+	uint32_t channel_mode;	/* AUDIO_SBC_MODE_* */
+	uint32_t allocation;	/* AUDIO_SBC_ALLOCATION_* */
+	uint32_t bit_rate;	/* bits per second */
+};
+
 #define AUDIO_AAC_FORMAT_ADTS		-1
 #define	AUDIO_AAC_FORMAT_RAW		0x0000
 #define	AUDIO_AAC_FORMAT_PSUEDO_RAW	0x0001
@@ -22,6 +22,8 @@
 /*context flags */
 #define KGSL_CONTEXT_SAVE_GMEM		1
 #define KGSL_CONTEXT_NO_GMEM_ALLOC	2
+/* the context only does 2D and resolves, it never renders into gmem */
+#define KGSL_CONTEXT_NO_GMEM_WRITE	4
 
 /* generic flag values */
 #define KGSL_FLAGS_NORMALMODE  0x00000000
@@ -344,4 +346,46 @@ struct kgsl_cmdwindow_write {
 #define IOCTL_KGSL_CMDWINDOW_WRITE \
 	_IOW(KGSL_IOC_TYPE, 0x2e, struct kgsl_cmdwindow_write)
 
+/* register an indirect buffer that is submitted many times unchanged.
+ * gpuaddr and sizedwords are checked once here, like ibaddr and
+ * sizedwords in IOCTL_KGSL_RINGBUFFER_ISSUEIBCMDS, and ibhandle is
+ * returned for IOCTL_KGSL_RINGBUFFER_ISSUEIBHANDLES.  The registration
+ * goes away with IOCTL_KGSL_IB_UNREGISTER or when the memory holding
+ * the buffer is freed.
+ */
+#define KGSL_IB_REGISTER_MAX	64
+
+struct kgsl_ib_register {
+	unsigned int gpuaddr;
+	unsigned int sizedwords;
+	unsigned int ibhandle; /*output param */
+};
+
+#define IOCTL_KGSL_IB_REGISTER \
+	_IOWR(KGSL_IOC_TYPE, 0x30, struct kgsl_ib_register)
+
+struct kgsl_ib_unregister {
+	unsigned int ibhandle;
+};
+
+#define IOCTL_KGSL_IB_UNREGISTER \
+	_IOW(KGSL_IOC_TYPE, 0x31, struct kgsl_ib_unregister)
+
+/* issue a list of registered indirect buffers, in order, as one
+ * submission with a single timestamp.  ibhandles points to numhandles
+ * handles from IOCTL_KGSL_IB_REGISTER, at most KGSL_IB_SUBMIT_MAX.
+ */
+#define KGSL_IB_SUBMIT_MAX	16
+
+struct kgsl_ringbuffer_issueibhandles {
+	unsigned int drawctxt_id;
+	unsigned int *ibhandles;
+	unsigned int numhandles;
+	unsigned int timestamp; /*output param */
+	unsigned int flags;
+};
+
+#define IOCTL_KGSL_RINGBUFFER_ISSUEIBHANDLES \
+	_IOWR(KGSL_IOC_TYPE, 0x32, struct kgsl_ringbuffer_issueibhandles)
+
 #endif /* _MSM_KGSL_H */
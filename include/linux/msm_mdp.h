@@ -19,7 +19,14 @@
 #define MSMFB_IOCTL_MAGIC 'm'
 #define MSMFB_GRP_DISP          _IOW(MSMFB_IOCTL_MAGIC, 1, unsigned int)
 #define MSMFB_BLIT              _IOW(MSMFB_IOCTL_MAGIC, 2, unsigned int)
-#ifdef CONFIG_MSM_MDP40
+#define MSMFB_ASYNC_BLIT        _IOWR(MSMFB_IOCTL_MAGIC, 3, unsigned int)
+#define MSMFB_BLIT_WAIT         _IOW(MSMFB_IOCTL_MAGIC, 4, unsigned int)
+#define MSMFB_UPDATE_RECTS      _IOW(MSMFB_IOCTL_MAGIC, 5, \
+						struct msmfb_update_rects)
+#define MSMFB_FRAME_INFO        _IOR(MSMFB_IOCTL_MAGIC, 6, \
+						struct msmfb_frame_info)
+#define MSMFB_WAIT_FRAME        _IOW(MSMFB_IOCTL_MAGIC, 7, unsigned int)
+#if defined(CONFIG_MSM_MDP40) || defined(CONFIG_FB_MSM_PPP_OVERLAY)
 #define MSMFB_OVERLAY_SET       _IOWR(MSMFB_IOCTL_MAGIC, 135, \
 						struct mdp_overlay)
 #define MSMFB_OVERLAY_UNSET     _IOW(MSMFB_IOCTL_MAGIC, 136, unsigned int)
@@ -103,7 +110,49 @@ struct mdp_blit_req_list {
 	struct mdp_blit_req req[];
 };
 
-#ifdef CONFIG_MSM_MDP40
+/* MSMFB_ASYNC_BLIT returns in timestamp the value to hand to
+ * MSMFB_BLIT_WAIT to wait for the last blit of the list */
+struct mdp_blit_async_req_list {
+	uint32_t timestamp;
+	uint32_t count;
+	struct mdp_blit_req req[];
+};
+
+#define MSMFB_MAX_UPDATE_RECTS 8
+
+/* MSMFB_UPDATE_RECTS pans to yoffset and sends only the given rects of
+ * the new buffer to the panel, overlapping or nearby rects are merged */
+struct msmfb_update_rects {
+	uint32_t yoffset;
+	uint32_t count;
+	struct mdp_rect rect[MSMFB_MAX_UPDATE_RECTS];
+};
+
+/* frame_queued is the number of the last pan, MSMFB_WAIT_FRAME on it
+ * returns once frame_done has caught up and the buffer is on the panel */
+struct msmfb_frame_info {
+	uint32_t frame_queued;
+	uint32_t frame_done;
+	uint64_t frame_done_ns;		/* ktime of the last frame done */
+	uint32_t frames_late;		/* sent a refresh or more late */
+	uint32_t frames_dropped;	/* replaced or timed out unsent */
+};
+
+/* records read back from debugfs msm_fb_frames.bin, oldest first, all
+ * times are ktime in ns */
+#define MSMFB_FRAME_SLIPPED	0x1	/* missed the vsync after queueing */
+#define MSMFB_FRAME_FAKE_VSYNC	0x2	/* started by the vsync timer */
+
+struct msmfb_frame_record {
+	uint32_t frame;
+	uint32_t flags;
+	uint64_t requested_ns;
+	uint64_t vsync_ns;
+	uint64_t dma_start_ns;
+	uint64_t dma_done_ns;
+};
+
+#if defined(CONFIG_MSM_MDP40) || defined(CONFIG_FB_MSM_PPP_OVERLAY)
 struct msmfb_data {
 	uint32_t offset;
 	int memory_id;
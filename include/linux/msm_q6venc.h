@@ -217,6 +217,23 @@ struct venc_buffer {
 
 };
 
+/* Buffers registered once per session and then queued by index, so the
+ * per-frame ioctl does not have to look the pmem fd up again.
+ */
+#define VENC_MAX_REG_BUFFERS 32
+
+struct venc_reg_buffer {
+	struct venc_pmem buf;
+	unsigned int index;
+};
+
+struct venc_index_buffer {
+	unsigned int index;
+	long long time_stamp;
+	unsigned int flags;
+	unsigned int client_data;
+};
+
 struct venc_buffers {
 	struct venc_pmem recon_buf[VENC_MAX_RECON_BUFFERS];
 	struct venc_pmem wb_buf;
@@ -328,4 +345,16 @@ struct venc_version {
 #define VENC_IOCTL_GET_VERSION \
 	 _IOR(VENC_IOCTL_MAGIC, 19, struct venc_version)
 
+#define VENC_IOCTL_REGISTER_INPUT_BUFFER \
+	_IOWR(VENC_IOCTL_MAGIC, 20, struct venc_reg_buffer)
+
+#define VENC_IOCTL_REGISTER_OUTPUT_BUFFER \
+	_IOWR(VENC_IOCTL_MAGIC, 21, struct venc_reg_buffer)
+
+#define VENC_IOCTL_CMD_ENCODE_FRAME_INDEX \
+	_IOW(VENC_IOCTL_MAGIC, 22, struct venc_index_buffer)
+
+#define VENC_IOCTL_CMD_FILL_OUTPUT_BUFFER_INDEX \
+	_IOW(VENC_IOCTL_MAGIC, 23, struct venc_index_buffer)
+
 #endif
@@ -33,5 +33,15 @@ test_pages_isolated(unsigned long start_pfn, unsigned long end_pfn);
 extern int set_migratetype_isolate(struct page *page);
 extern void unset_migratetype_isolate(struct page *page);
 
+#ifdef CONFIG_LENDABLE_MEMORY
+/*
+ * Internal funcs for mm/lendable.c. Marks a pageblock MIGRATE_LENDABLE, and
+ * pulls the free pages of an isolated range out of the buddy allocator.
+ */
+extern int set_migratetype_lendable(struct page *page);
+extern int take_isolated_page_range(unsigned long start_pfn,
+				    unsigned long end_pfn);
+#endif
+
 
 #endif
@@ -0,0 +1,54 @@
+/* include/linux/pm_timeline.h
+ *
+ * Resume timeline, from platform wakeup to the first frame.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_PM_TIMELINE_H
+#define _LINUX_PM_TIMELINE_H
+
+#include <linux/types.h>
+
+/* The resume timeline records what happens between the platform coming
+ * back out of sleep and the first frame on the panel, in the order it
+ * happens. The last one is read from debugfs as pm_timeline.
+ *
+ * pm_timeline_start() opens a new timeline, marks and spans land in it
+ * until it fills up or a few seconds have passed. Span times come from
+ * pm_timeline_clock(). Names are copied.
+ */
+
+#define PM_TIMELINE_NAME_LEN	32
+
+enum {
+	PM_TIMELINE_FIRST_RPC,
+	PM_TIMELINE_FIRST_FRAME,
+	PM_TIMELINE_FIRST_COUNT
+};
+
+#ifdef CONFIG_PM_TIMELINE
+void pm_timeline_start(const char *what);
+int pm_timeline_active(void);
+u64 pm_timeline_clock(void);
+void pm_timeline_mark(const char *what);
+void pm_timeline_span(const char *what, u64 start);
+void pm_timeline_first(int which, const char *what);
+#else
+static inline void pm_timeline_start(const char *what) {}
+static inline int pm_timeline_active(void) { return 0; }
+static inline u64 pm_timeline_clock(void) { return 0; }
+static inline void pm_timeline_mark(const char *what) {}
+static inline void pm_timeline_span(const char *what, u64 start) {}
+static inline void pm_timeline_first(int which, const char *what) {}
+#endif
+
+#endif
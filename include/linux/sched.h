@@ -143,6 +143,23 @@ extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(void);
 extern unsigned long this_cpu_load(void);
 
+/*
+ * Load hook for cpufreq governors, called on enqueue, dequeue and tick of
+ * fair tasks with the runqueue lock held: it must not sleep or wake tasks.
+ */
+typedef void (*sched_load_hook_t)(int cpu, unsigned long nr_running,
+				  unsigned long load_weight);
+#ifdef CONFIG_CPU_FREQ
+extern int sched_register_load_hook(sched_load_hook_t hook);
+extern void sched_unregister_load_hook(sched_load_hook_t hook);
+#else
+static inline int sched_register_load_hook(sched_load_hook_t hook)
+{
+	return -ENOSYS;
+}
+static inline void sched_unregister_load_hook(sched_load_hook_t hook) { }
+#endif
+
 
 extern void calc_global_load(void);
 
@@ -170,6 +187,16 @@ print_cfs_rq(struct seq_file *m, int cpu, struct cfs_rq *cfs_rq)
 }
 #endif
 
+#ifdef CONFIG_SCHEDSTATS
+extern void proc_sched_latency_show(struct task_struct *p, struct seq_file *m);
+extern int proc_sched_latency_set(struct task_struct *p, int enable);
+extern void sched_latency_free(struct task_struct *p);
+#else
+static inline void sched_latency_free(struct task_struct *p)
+{
+}
+#endif
+
 extern unsigned long long time_sync_thresh;
 
 /*
@@ -745,6 +772,25 @@ struct backing_dev_info;
 struct reclaim_state;
 
 #if defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT)
+#ifdef CONFIG_SCHEDSTATS
+#define SCHED_LATENCY_BUCKETS	20
+
+/*
+ * Opt-in histogram of a task's wakeup to run waits, kept from
+ * /proc/<pid>/sched_latency. Bucket i counts waits shorter than 1024 << i
+ * ns; the last one takes everything longer.
+ */
+struct sched_latency_hist {
+	int enabled;
+	int preempted;		/* the current wait follows a preemption */
+	unsigned long count;
+	unsigned long preempt_count;
+	unsigned long long sum;
+	unsigned long long max;
+	unsigned int buckets[SCHED_LATENCY_BUCKETS];
+};
+#endif
+
 struct sched_info {
 	/* cumulative counters */
 	unsigned long pcount;	      /* # of times run on this cpu */
@@ -756,6 +802,7 @@ struct sched_info {
 #ifdef CONFIG_SCHEDSTATS
 	/* BKL stats */
 	unsigned int bkl_count;
+	struct sched_latency_hist *latency_hist;
 #endif
 };
 #endif /* defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT) */
@@ -1466,6 +1513,10 @@ struct task_struct {
 	u64 acct_vm_mem1;	/* accumulated virtual memory usage */
 	cputime_t acct_timexpd;	/* stime + utime since last update */
 #endif
+#ifdef CONFIG_WAKELOCK_STAT
+	/* se.sum_exec_runtime when the current awake window started */
+	u64 wakeup_exec_base;
+#endif
 #ifdef CONFIG_CPUSETS
 	nodemask_t mems_allowed;	/* Protected by alloc_lock */
 	int cpuset_mem_spread_rotor;
@@ -1476,6 +1527,10 @@ struct task_struct {
 	/* cg_list protected by css_set_lock and tsk->alloc_lock */
 	struct list_head cg_list;
 #endif
+#ifdef CONFIG_CGROUP_SCHED
+	/* group lent by sched_set_task_group(), scheduled in place of ours */
+	struct task_group *sched_group_override;
+#endif
 #ifdef CONFIG_FUTEX
 	struct robust_list_head __user *robust_list;
 #ifdef CONFIG_COMPAT
@@ -2516,6 +2571,10 @@ extern struct task_group init_task_group;
 extern struct task_group *sched_create_group(struct task_group *parent);
 extern void sched_destroy_group(struct task_group *tg);
 extern void sched_move_task(struct task_struct *tsk);
+extern struct task_group *sched_get_task_group(struct task_struct *p);
+extern void sched_put_task_group(struct task_group *tg);
+extern struct task_group *sched_set_task_group(struct task_struct *p,
+					       struct task_group *tg);
 #ifdef CONFIG_FAIR_GROUP_SCHED
 extern int sched_group_set_shares(struct task_group *tg, unsigned long shares);
 extern unsigned long sched_group_shares(struct task_group *tg);
@@ -2529,6 +2588,17 @@ extern int sched_group_set_rt_period(struct task_group *tg,
 extern long sched_group_rt_period(struct task_group *tg);
 extern int sched_rt_can_attach(struct task_group *tg, struct task_struct *tsk);
 #endif
+#else
+static inline struct task_group *sched_get_task_group(struct task_struct *p)
+{
+	return NULL;
+}
+static inline void sched_put_task_group(struct task_group *tg) { }
+static inline struct task_group *
+sched_set_task_group(struct task_struct *p, struct task_group *tg)
+{
+	return NULL;
+}
 #endif
 
 extern int task_can_switch_user(struct user_struct *up,
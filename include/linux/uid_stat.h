@@ -20,5 +20,7 @@
 
 extern int update_tcp_snd(uid_t uid, int size);
 extern int update_tcp_rcv(uid_t uid, int size);
+extern int update_udp_snd(uid_t uid, int size);
+extern int update_udp_rcv(uid_t uid, int size);
 
 #endif /* _LINUX_UID_STAT_H */
@@ -17,6 +17,7 @@
 #define _LINUX_WAKELOCK_H
 
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/ktime.h>
 
 /* A wake_lock prevents the system from entering suspend or other low power
@@ -35,6 +36,7 @@ enum {
 struct wake_lock {
 #ifdef CONFIG_HAS_WAKELOCK
 	struct list_head    link;
+	struct rb_node      timeout_node;
 	int                 flags;
 	const char         *name;
 	unsigned long       expires;
@@ -47,6 +49,7 @@ struct wake_lock {
 		ktime_t         prevent_suspend_time;
 		ktime_t         max_time;
 		ktime_t         last_time;
+		ktime_t         prevent_suspend_start;
 	} stat;
 #endif
 #endif
@@ -74,6 +77,14 @@ int wake_lock_active(struct wake_lock *lock);
 long has_wake_lock(int type);
 void print_active_locks(int type);
 
+#ifdef CONFIG_WAKELOCK_STAT
+/* called by the interrupt controller on resume for an irq that was
+ * pending when the system woke up, the first one is the wakeup irq */
+void suspend_wakeup_irq(int irq);
+#else
+static inline void suspend_wakeup_irq(int irq) {}
+#endif
+
 #else
 
 static inline void wake_lock_init(struct wake_lock *lock, int type,
@@ -86,6 +97,7 @@ static inline void wake_unlock(struct wake_lock *lock) {}
 static inline int wake_lock_active(struct wake_lock *lock) { return 0; }
 static inline long has_wake_lock(int type) { return 0; }
 static void print_active_locks(int type) {}
+static inline void suspend_wakeup_irq(int irq) {}
 
 #endif
 
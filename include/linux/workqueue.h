@@ -32,6 +32,9 @@ struct work_struct {
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
+#ifdef CONFIG_WORKQUEUE_STATS
+	u64 queued_at;
+#endif
 };
 
 #define WORK_DATA_INIT()	ATOMIC_LONG_INIT(0)
@@ -190,8 +193,20 @@ __create_workqueue_key(const char *name, int singlethread,
 			       NULL, NULL)
 #endif
 
+/*
+ * Values of the rt argument of __create_workqueue: the threads of a
+ * WQ_PRIO_RT queue run SCHED_FIFO at the top priority, those of a
+ * WQ_PRIO_HIGH queue stay SCHED_NORMAL at nice -20 so latency sensitive
+ * work is not stuck behind other tasks but cannot starve them.
+ */
+#define WQ_PRIO_NORMAL	0
+#define WQ_PRIO_RT	1
+#define WQ_PRIO_HIGH	2
+
 #define create_workqueue(name) __create_workqueue((name), 0, 0, 0)
-#define create_rt_workqueue(name) __create_workqueue((name), 0, 0, 1)
+#define create_rt_workqueue(name) __create_workqueue((name), 0, 0, WQ_PRIO_RT)
+#define create_hipri_workqueue(name) \
+	__create_workqueue((name), 1, 0, WQ_PRIO_HIGH)
 #define create_freezeable_workqueue(name) __create_workqueue((name), 1, 1, 0)
 #define create_singlethread_workqueue(name) __create_workqueue((name), 1, 0, 0)
 
@@ -91,6 +91,12 @@
 #define MSM_CAM_IOCTL_ENABLE_OUTPUT_IND \
 	_IOW(MSM_CAM_IOCTL_MAGIC, 25, uint32_t *)
 
+#define MSM_CAM_IOCTL_FRAME_CONSUMER \
+	_IOW(MSM_CAM_IOCTL_MAGIC, 26, struct msm_frame_consumer_cfg *)
+
+#define MSM_CAM_IOCTL_GETFRAME_CONSUMER \
+	_IOR(MSM_CAM_IOCTL_MAGIC, 27, struct msm_consumer_frame *)
+
 #define MAX_SENSOR_NUM  3
 #define MAX_SENSOR_NAME 32
 
@@ -352,6 +358,28 @@ struct msm_frame {
 	int croplen;
 };
 
+/* Besides the frame thread (MSM_FRAME_CONSUMER_PREVIEW, which gets frames
+ * with MSM_CAM_IOCTL_GETFRAME), a frame can be handed to the video encoder
+ * and to a frame-processing client without copying.  Each of them gets its
+ * own reference and releases it with MSM_CAM_IOCTL_RELEASE_FRAME_BUFFER;
+ * the buffer goes back to the VFE once all of them have done so.
+ */
+#define MSM_FRAME_CONSUMER_PREVIEW	0
+#define MSM_FRAME_CONSUMER_VIDEO	1
+#define MSM_FRAME_CONSUMER_PP		2
+#define MSM_FRAME_CONSUMER_MAX		3
+
+struct msm_frame_consumer_cfg {
+	int consumer;
+	/* (1 << OUTPUT_TYPE_*) for each path to share, 0 to unregister */
+	uint32_t paths;
+};
+
+struct msm_consumer_frame {
+	int consumer;
+	struct msm_frame frame;
+};
+
 #define STAT_AEAW	0
 #define STAT_AF		1
 #define STAT_MAX	2
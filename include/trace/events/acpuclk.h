@@ -0,0 +1,39 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM acpuclk
+
+#if !defined(_TRACE_ACPUCLK_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_ACPUCLK_H
+
+#include <linux/tracepoint.h>
+
+/* a cpu clock switch, switch_us covers the irqs-off part only */
+TRACE_EVENT(acpuclk_set_rate,
+
+	TP_PROTO(unsigned int old_khz, unsigned int new_khz, int reason,
+		 unsigned int switch_us),
+
+	TP_ARGS(old_khz, new_khz, reason, switch_us),
+
+	TP_STRUCT__entry(
+		__field(	unsigned int,	old_khz		)
+		__field(	unsigned int,	new_khz		)
+		__field(	int,		reason		)
+		__field(	unsigned int,	switch_us	)
+	),
+
+	TP_fast_assign(
+		__entry->old_khz	= old_khz;
+		__entry->new_khz	= new_khz;
+		__entry->reason		= reason;
+		__entry->switch_us	= switch_us;
+	),
+
+	TP_printk("old=%u new=%u reason=%d switch_us=%u",
+		  __entry->old_khz, __entry->new_khz, __entry->reason,
+		  __entry->switch_us)
+);
+
+#endif /* _TRACE_ACPUCLK_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
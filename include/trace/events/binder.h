@@ -0,0 +1,106 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM binder
+
+#if !defined(_TRACE_BINDER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_BINDER_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(binder_transaction,
+
+	TP_PROTO(int reply, int debug_id, int to_proc, int to_thread,
+		 int to_node, unsigned int code, unsigned int flags),
+
+	TP_ARGS(reply, debug_id, to_proc, to_thread, to_node, code, flags),
+
+	TP_STRUCT__entry(
+		__field(	int,		debug_id	)
+		__field(	int,		reply		)
+		__field(	int,		to_proc		)
+		__field(	int,		to_thread	)
+		__field(	int,		to_node		)
+		__field(	unsigned int,	code		)
+		__field(	unsigned int,	flags		)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id	= debug_id;
+		__entry->reply		= reply;
+		__entry->to_proc	= to_proc;
+		__entry->to_thread	= to_thread;
+		__entry->to_node	= to_node;
+		__entry->code		= code;
+		__entry->flags		= flags;
+	),
+
+	TP_printk("transaction=%d dest_node=%d dest_proc=%d dest_thread=%d "
+		  "reply=%d flags=0x%x code=0x%x",
+		  __entry->debug_id, __entry->to_node, __entry->to_proc,
+		  __entry->to_thread, __entry->reply, __entry->flags,
+		  __entry->code)
+);
+
+TRACE_EVENT(binder_transaction_received,
+
+	TP_PROTO(int debug_id, int reply, u64 wait_ns),
+
+	TP_ARGS(debug_id, reply, wait_ns),
+
+	TP_STRUCT__entry(
+		__field(	int,		debug_id	)
+		__field(	int,		reply		)
+		__field(	u64,		wait_ns		)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id	= debug_id;
+		__entry->reply		= reply;
+		__entry->wait_ns	= wait_ns;
+	),
+
+	TP_printk("transaction=%d reply=%d wait_us=%llu",
+		  __entry->debug_id, __entry->reply,
+		  (unsigned long long)__entry->wait_ns / NSEC_PER_USEC)
+);
+
+/* binder_main_lock, taken after waiting wait_ns / dropped after hold_ns */
+TRACE_EVENT(binder_locked,
+
+	TP_PROTO(u64 wait_ns),
+
+	TP_ARGS(wait_ns),
+
+	TP_STRUCT__entry(
+		__field(	u64,		wait_ns		)
+	),
+
+	TP_fast_assign(
+		__entry->wait_ns	= wait_ns;
+	),
+
+	TP_printk("wait_us=%llu",
+		  (unsigned long long)__entry->wait_ns / NSEC_PER_USEC)
+);
+
+TRACE_EVENT(binder_unlock,
+
+	TP_PROTO(u64 hold_ns),
+
+	TP_ARGS(hold_ns),
+
+	TP_STRUCT__entry(
+		__field(	u64,		hold_ns		)
+	),
+
+	TP_fast_assign(
+		__entry->hold_ns	= hold_ns;
+	),
+
+	TP_printk("hold_us=%llu",
+		  (unsigned long long)__entry->hold_ns / NSEC_PER_USEC)
+);
+
+#endif /* _TRACE_BINDER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
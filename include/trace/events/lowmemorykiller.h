@@ -0,0 +1,40 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lowmemorykiller
+
+#if !defined(_TRACE_LOWMEMORYKILLER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOWMEMORYKILLER_H
+
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(lowmemory_kill,
+
+	TP_PROTO(struct task_struct *task, int adj, int tasksize, int min_adj),
+
+	TP_ARGS(task, adj, tasksize, min_adj),
+
+	TP_STRUCT__entry(
+		__array(	char,	comm,	TASK_COMM_LEN	)
+		__field(	pid_t,	pid			)
+		__field(	int,	adj			)
+		__field(	int,	tasksize		)
+		__field(	int,	min_adj			)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, task->comm, TASK_COMM_LEN);
+		__entry->pid		= task->pid;
+		__entry->adj		= adj;
+		__entry->tasksize	= tasksize;
+		__entry->min_adj	= min_adj;
+	),
+
+	TP_printk("comm=%s pid=%d adj=%d size=%d min_adj=%d",
+		  __entry->comm, __entry->pid, __entry->adj,
+		  __entry->tasksize, __entry->min_adj)
+);
+
+#endif /* _TRACE_LOWMEMORYKILLER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
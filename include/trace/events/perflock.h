@@ -0,0 +1,55 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM perflock
+
+#if !defined(_TRACE_PERFLOCK_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_PERFLOCK_H
+
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+#include <mach/perflock.h>
+
+TRACE_EVENT(perflock_acquire,
+
+	TP_PROTO(struct perf_lock *lock),
+
+	TP_ARGS(lock),
+
+	TP_STRUCT__entry(
+		__string(	name,		lock->name	)
+		__field(	unsigned int,	level		)
+		__field(	pid_t,		owner		)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, lock->name);
+		__entry->level	= lock->level;
+		__entry->owner	= lock->owner ? lock->owner->pid : 0;
+	),
+
+	TP_printk("name=%s level=%u owner=%d", __get_str(name),
+		  __entry->level, __entry->owner)
+);
+
+TRACE_EVENT(perflock_release,
+
+	TP_PROTO(struct perf_lock *lock),
+
+	TP_ARGS(lock),
+
+	TP_STRUCT__entry(
+		__string(	name,		lock->name	)
+		__field(	unsigned int,	level		)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, lock->name);
+		__entry->level	= lock->level;
+	),
+
+	TP_printk("name=%s level=%u", __get_str(name), __entry->level)
+);
+
+#endif /* _TRACE_PERFLOCK_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
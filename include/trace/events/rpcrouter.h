@@ -0,0 +1,79 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM rpcrouter
+
+#if !defined(_TRACE_RPCROUTER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_RPCROUTER_H
+
+#include <linux/tracepoint.h>
+
+/* xid, prog and procedure are in host order, prog/proc 0 for replies */
+TRACE_EVENT(rpc_send,
+
+	TP_PROTO(u32 pid, u32 cid, u32 xid, int call, u32 prog, u32 proc,
+		 int size),
+
+	TP_ARGS(pid, cid, xid, call, prog, proc, size),
+
+	TP_STRUCT__entry(
+		__field(	u32,	pid	)
+		__field(	u32,	cid	)
+		__field(	u32,	xid	)
+		__field(	int,	call	)
+		__field(	u32,	prog	)
+		__field(	u32,	proc	)
+		__field(	int,	size	)
+	),
+
+	TP_fast_assign(
+		__entry->pid	= pid;
+		__entry->cid	= cid;
+		__entry->xid	= xid;
+		__entry->call	= call;
+		__entry->prog	= prog;
+		__entry->proc	= proc;
+		__entry->size	= size;
+	),
+
+	TP_printk("%s to %u:%08x xid=%x prog=%08x proc=%u size=%d",
+		  __entry->call ? "call" : "reply", __entry->pid,
+		  __entry->cid, __entry->xid, __entry->prog, __entry->proc,
+		  __entry->size)
+);
+
+TRACE_EVENT(rpc_recv,
+
+	TP_PROTO(u32 pid, u32 cid, u32 xid, int call, u32 prog, u32 proc,
+		 int size),
+
+	TP_ARGS(pid, cid, xid, call, prog, proc, size),
+
+	TP_STRUCT__entry(
+		__field(	u32,	pid	)
+		__field(	u32,	cid	)
+		__field(	u32,	xid	)
+		__field(	int,	call	)
+		__field(	u32,	prog	)
+		__field(	u32,	proc	)
+		__field(	int,	size	)
+	),
+
+	TP_fast_assign(
+		__entry->pid	= pid;
+		__entry->cid	= cid;
+		__entry->xid	= xid;
+		__entry->call	= call;
+		__entry->prog	= prog;
+		__entry->proc	= proc;
+		__entry->size	= size;
+	),
+
+	TP_printk("%s from %u:%08x xid=%x prog=%08x proc=%u size=%d",
+		  __entry->call ? "call" : "reply", __entry->pid,
+		  __entry->cid, __entry->xid, __entry->prog, __entry->proc,
+		  __entry->size)
+);
+
+#endif /* _TRACE_RPCROUTER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
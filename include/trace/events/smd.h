@@ -0,0 +1,56 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM smd
+
+#if !defined(_TRACE_SMD_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_SMD_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(smd_write,
+
+	TP_PROTO(const char *name, int len, int ret),
+
+	TP_ARGS(name, len, ret),
+
+	TP_STRUCT__entry(
+		__string(	name,	name	)
+		__field(	int,	len	)
+		__field(	int,	ret	)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, name);
+		__entry->len	= len;
+		__entry->ret	= ret;
+	),
+
+	TP_printk("ch=%s len=%d ret=%d", __get_str(name),
+		  __entry->len, __entry->ret)
+);
+
+TRACE_EVENT(smd_read,
+
+	TP_PROTO(const char *name, int len, int ret),
+
+	TP_ARGS(name, len, ret),
+
+	TP_STRUCT__entry(
+		__string(	name,	name	)
+		__field(	int,	len	)
+		__field(	int,	ret	)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, name);
+		__entry->len	= len;
+		__entry->ret	= ret;
+	),
+
+	TP_printk("ch=%s len=%d ret=%d", __get_str(name),
+		  __entry->len, __entry->ret)
+);
+
+#endif /* _TRACE_SMD_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
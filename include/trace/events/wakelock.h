@@ -0,0 +1,54 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM wakelock
+
+#if !defined(_TRACE_WAKELOCK_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_WAKELOCK_H
+
+#include <linux/wakelock.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(wake_lock,
+
+	TP_PROTO(struct wake_lock *lock, int type, long timeout),
+
+	TP_ARGS(lock, type, timeout),
+
+	TP_STRUCT__entry(
+		__string(	name,		lock->name	)
+		__field(	int,		type		)
+		__field(	long,		timeout		)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, lock->name);
+		__entry->type		= type;
+		__entry->timeout	= timeout;
+	),
+
+	TP_printk("name=%s type=%d timeout_ms=%u", __get_str(name),
+		  __entry->type, jiffies_to_msecs(__entry->timeout))
+);
+
+TRACE_EVENT(wake_unlock,
+
+	TP_PROTO(struct wake_lock *lock, int type),
+
+	TP_ARGS(lock, type),
+
+	TP_STRUCT__entry(
+		__string(	name,		lock->name	)
+		__field(	int,		type		)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, lock->name);
+		__entry->type		= type;
+	),
+
+	TP_printk("name=%s type=%d", __get_str(name), __entry->type)
+);
+
+#endif /* _TRACE_WAKELOCK_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -62,6 +62,8 @@
 #include <linux/kthread.h>
 #include <linux/sched.h>
 #include <linux/signal.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
 #include <linux/idr.h>
 #include <linux/ftrace.h>
 #include <linux/async.h>
@@ -700,6 +702,86 @@ static char msgbuf[64];
 static struct boot_trace_call call;
 static struct boot_trace_ret ret;
 
+/*
+ * The slowest initcalls and asynchronous driver probes of this boot,
+ * kept whether or not initcall_debug is set and read back from
+ * /proc/boot_times.
+ */
+#define BOOT_TIMES_MAX 64
+
+struct boot_time {
+	const char *name;	/* driver name, or NULL for an initcall */
+	void *fn;
+	unsigned long usecs;
+};
+
+static struct boot_time boot_times[BOOT_TIMES_MAX];
+static int boot_times_nr;
+static unsigned long boot_times_total;	/* usecs in initcalls */
+static DEFINE_SPINLOCK(boot_times_lock);
+
+void boot_time_record(const char *name, void *fn, unsigned long usecs)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&boot_times_lock, flags);
+	if (!name)
+		boot_times_total += usecs;
+	if (boot_times_nr == BOOT_TIMES_MAX &&
+	    usecs <= boot_times[BOOT_TIMES_MAX - 1].usecs)
+		goto out;
+	if (boot_times_nr < BOOT_TIMES_MAX)
+		boot_times_nr++;
+	for (i = boot_times_nr - 1; i > 0 && boot_times[i - 1].usecs < usecs;
+	     i--)
+		boot_times[i] = boot_times[i - 1];
+	boot_times[i].name = name;
+	boot_times[i].fn = fn;
+	boot_times[i].usecs = usecs;
+out:
+	spin_unlock_irqrestore(&boot_times_lock, flags);
+}
+
+#ifdef CONFIG_PROC_FS
+static int boot_times_show(struct seq_file *m, void *v)
+{
+	struct boot_time *bt;
+	int i;
+
+	seq_printf(m, "initcalls: %lu usecs\n", boot_times_total);
+	spin_lock_irq(&boot_times_lock);
+	for (i = 0; i < boot_times_nr; i++) {
+		bt = &boot_times[i];
+		if (bt->name)
+			seq_printf(m, "%8lu probe %s\n", bt->usecs, bt->name);
+		else
+			seq_printf(m, "%8lu %pF\n", bt->usecs, bt->fn);
+	}
+	spin_unlock_irq(&boot_times_lock);
+	return 0;
+}
+
+static int boot_times_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, boot_times_show, NULL);
+}
+
+static const struct file_operations boot_times_fops = {
+	.open		= boot_times_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init boot_times_init(void)
+{
+	proc_create("boot_times", 0444, NULL, &boot_times_fops);
+	return 0;
+}
+fs_initcall(boot_times_init);
+#endif
+
 int do_one_initcall(initcall_t fn)
 {
 	int count = preempt_count();
@@ -708,17 +790,18 @@ int do_one_initcall(initcall_t fn)
 	if (initcall_debug) {
 		call.caller = task_pid_nr(current);
 		printk("calling  %pF @ %i\n", fn, call.caller);
-		calltime = ktime_get();
 		trace_boot_call(&call, fn);
 		enable_boot_trace();
 	}
 
+	calltime = ktime_get();
 	ret.result = fn();
+	rettime = ktime_get();
+	delta = ktime_sub(rettime, calltime);
+	boot_time_record(NULL, fn, ktime_to_us(delta));
 
 	if (initcall_debug) {
 		disable_boot_trace();
-		rettime = ktime_get();
-		delta = ktime_sub(rettime, calltime);
 		ret.duration = (unsigned long long) ktime_to_ns(delta) >> 10;
 		trace_boot_ret(&ret, fn);
 		printk("initcall %pF returned %d after %Ld usecs\n", fn,
@@ -155,6 +155,7 @@ void free_task(struct task_struct *tsk)
 	free_thread_info(tsk->stack);
 	rt_mutex_debug_task_free(tsk);
 	ftrace_graph_exit_task(tsk);
+	sched_latency_free(tsk);
 	free_task_struct(tsk);
 }
 EXPORT_SYMBOL(free_task);
@@ -277,6 +278,9 @@ static struct task_struct *dup_task_struct(struct task_struct *orig)
 	atomic_set(&tsk->fs_excl, 0);
 #ifdef CONFIG_BLK_DEV_IO_TRACE
 	tsk->btrace_seq = 0;
+#endif
+#ifdef CONFIG_SCHEDSTATS
+	tsk->sched_info.latency_hist = NULL;
 #endif
 	tsk->splice_pipe = NULL;
 
@@ -1095,6 +1099,10 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 
 	task_io_accounting_init(&p->ioac);
 	acct_clear_integrals(p);
+#ifdef CONFIG_WAKELOCK_STAT
+	/* all of a new task's runtime is in the window it was born in */
+	p->wakeup_exec_base = 0;
+#endif
 
 	posix_cpu_timers_init(p);
 
@@ -13,9 +13,11 @@
  *
  */
 
+#include <linux/async.h>
 #include <linux/earlysuspend.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/pm_timeline.h>
 #include <linux/rtc.h>
 #include <linux/syscalls.h> /* sys_sync */
 #include <linux/wakelock.h>
@@ -26,10 +28,19 @@
 enum {
 	DEBUG_USER_STATE = 1U << 0,
 	DEBUG_SUSPEND = 1U << 2,
+	DEBUG_TIMING = 1U << 3,
 };
 static int debug_mask = DEBUG_USER_STATE;
 module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 
+/* Handlers of one level run in parallel, levels still run in order.
+ * Handlers slower than slow_handler_us are always logged. */
+static int async_handlers = 1;
+module_param(async_handlers, int, S_IRUGO | S_IWUSR | S_IWGRP);
+static int slow_handler_us = 20000;
+module_param(slow_handler_us, int, S_IRUGO | S_IWUSR | S_IWGRP);
+static LIST_HEAD(early_suspend_domain);
+
 static DEFINE_MUTEX(early_suspend_lock);
 static LIST_HEAD(early_suspend_handlers);
 static void early_suspend(struct work_struct *work);
@@ -81,11 +92,62 @@ void unregister_early_suspend(struct early_suspend *handler)
 }
 EXPORT_SYMBOL(unregister_early_suspend);
 
+static void early_suspend_call(struct early_suspend *handler, int resume)
+{
+	void (*func)(struct early_suspend *h);
+	char name[PM_TIMELINE_NAME_LEN];
+	u64 span_start;
+	ktime_t start;
+	s64 us;
+
+	func = resume ? handler->resume : handler->suspend;
+	span_start = pm_timeline_clock();
+	start = ktime_get();
+	func(handler);
+	us = ktime_us_delta(ktime_get(), start);
+	if (resume && pm_timeline_active()) {
+		snprintf(name, sizeof(name), "%pf", func);
+		pm_timeline_span(name, span_start);
+	}
+	if (us >= slow_handler_us || (debug_mask & DEBUG_TIMING))
+		pr_info("%s: %pf took %lld us, level %d\n",
+			resume ? "late_resume" : "early_suspend",
+			func, us, handler->level);
+}
+
+static void early_suspend_async(void *data, async_cookie_t cookie)
+{
+	early_suspend_call(data, 0);
+}
+
+static void late_resume_async(void *data, async_cookie_t cookie)
+{
+	early_suspend_call(data, 1);
+}
+
+/* Caller must hold early_suspend_lock. Waits for the previous level
+ * before starting a handler of a new one. */
+static void early_suspend_dispatch(struct early_suspend *handler,
+				   int *level, int resume)
+{
+	if (handler->level != *level) {
+		async_synchronize_full_domain(&early_suspend_domain);
+		*level = handler->level;
+	}
+	if (async_handlers)
+		async_schedule_domain(resume ? late_resume_async :
+				      early_suspend_async, handler,
+				      &early_suspend_domain);
+	else
+		early_suspend_call(handler, resume);
+}
+
 static void early_suspend(struct work_struct *work)
 {
 	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
+	int level = INT_MIN;
 
 	pr_info("[R] early_suspend start\n");
 	mutex_lock(&early_suspend_lock);
@@ -111,8 +173,9 @@ static void early_suspend(struct work_struct *work)
 		pr_info("early_suspend: call handlers\n");
 	list_for_each_entry(pos, &early_suspend_handlers, link) {
 		if (pos->suspend != NULL)
-			pos->suspend(pos);
+			early_suspend_dispatch(pos, &level, 0);
 	}
+	async_synchronize_full_domain(&early_suspend_domain);
 	mutex_unlock(&early_suspend_lock);
 
 	if (debug_mask & DEBUG_SUSPEND)
@@ -133,6 +196,7 @@ static void late_resume(struct work_struct *work)
 	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
+	int level = INT_MAX;
 
 	pr_info("[R] late_resume start\n");
 	mutex_lock(&early_suspend_lock);
@@ -152,7 +216,9 @@ static void late_resume(struct work_struct *work)
 		pr_info("late_resume: call handlers\n");
 	list_for_each_entry_reverse(pos, &early_suspend_handlers, link)
 		if (pos->resume != NULL)
-			pos->resume(pos);
+			early_suspend_dispatch(pos, &level, 1);
+	async_synchronize_full_domain(&early_suspend_domain);
+	pm_timeline_mark("late_resume done");
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: done\n");
 abort:
@@ -242,6 +242,9 @@ static inline void suspend_thaw_processes(void)
 extern struct workqueue_struct *suspend_work_queue;
 extern struct wake_lock main_wake_lock;
 extern suspend_state_t requested_suspend_state;
+bool suspend_quick_wake(void);
+#else
+static inline bool suspend_quick_wake(void) { return false; }
 #endif
 
 #ifdef CONFIG_USER_WAKELOCK
@@ -277,7 +277,9 @@ int enter_state(suspend_state_t state)
 		goto Finish;
 
 	pr_debug("PM: Entering %s sleep\n", pm_states[state]);
-	error = suspend_devices_and_enter(state);
+	do {
+		error = suspend_devices_and_enter(state);
+	} while (!error && suspend_quick_wake());
 
  Finish:
 	pr_debug("PM: Finishing wakeup.\n");
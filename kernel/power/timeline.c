@@ -0,0 +1,191 @@
+/* kernel/power/timeline.c
+ *
+ * Resume timeline, from platform wakeup to the first frame.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/pm_timeline.h>
+
+#define PM_TIMELINE_ENTRIES	192
+/* stop recording this long after the wakeup */
+#define PM_TIMELINE_WINDOW_NS	(5ULL * NSEC_PER_SEC)
+
+struct pm_timeline_entry {
+	u64 start;		/* ns since the timeline started */
+	u32 duration_us;	/* 0 for a mark */
+	char name[PM_TIMELINE_NAME_LEN];
+};
+
+static DEFINE_SPINLOCK(timeline_lock);
+static struct pm_timeline_entry timeline[PM_TIMELINE_ENTRIES];
+static unsigned int timeline_count;
+static unsigned int timeline_seq;
+static u64 timeline_base;
+static int timeline_open;
+static unsigned long timeline_firsts;
+
+u64 pm_timeline_clock(void)
+{
+	return sched_clock();
+}
+EXPORT_SYMBOL(pm_timeline_clock);
+
+/* Caller must hold timeline_lock */
+static int pm_timeline_open_locked(u64 now)
+{
+	if (!timeline_open)
+		return 0;
+	if (now - timeline_base > PM_TIMELINE_WINDOW_NS ||
+	    timeline_count == PM_TIMELINE_ENTRIES) {
+		timeline_open = 0;
+		return 0;
+	}
+	return 1;
+}
+
+/* Caller must hold timeline_lock */
+static void pm_timeline_add_locked(const char *what, u64 start, u64 end)
+{
+	struct pm_timeline_entry *e;
+	u64 us = end - start;
+
+	if (start < timeline_base)
+		start = timeline_base;
+	e = &timeline[timeline_count++];
+	e->start = start - timeline_base;
+	do_div(us, NSEC_PER_USEC);
+	e->duration_us = us > UINT_MAX ? UINT_MAX : (u32)us;
+	strlcpy(e->name, what, sizeof(e->name));
+}
+
+void pm_timeline_start(const char *what)
+{
+	unsigned long irqflags;
+	u64 now = sched_clock();
+
+	spin_lock_irqsave(&timeline_lock, irqflags);
+	timeline_base = now;
+	timeline_count = 0;
+	timeline_firsts = 0;
+	timeline_seq++;
+	timeline_open = 1;
+	pm_timeline_add_locked(what, now, now);
+	spin_unlock_irqrestore(&timeline_lock, irqflags);
+}
+EXPORT_SYMBOL(pm_timeline_start);
+
+int pm_timeline_active(void)
+{
+	return timeline_open;
+}
+EXPORT_SYMBOL(pm_timeline_active);
+
+void pm_timeline_span(const char *what, u64 start)
+{
+	unsigned long irqflags;
+	u64 now;
+
+	if (!timeline_open)
+		return;
+	now = sched_clock();
+	spin_lock_irqsave(&timeline_lock, irqflags);
+	if (pm_timeline_open_locked(now))
+		pm_timeline_add_locked(what, start, now);
+	spin_unlock_irqrestore(&timeline_lock, irqflags);
+}
+EXPORT_SYMBOL(pm_timeline_span);
+
+void pm_timeline_mark(const char *what)
+{
+	u64 now;
+
+	if (!timeline_open)
+		return;
+	now = sched_clock();
+	pm_timeline_span(what, now);
+}
+EXPORT_SYMBOL(pm_timeline_mark);
+
+/* mark @what only the first time @which happens in this timeline */
+void pm_timeline_first(int which, const char *what)
+{
+	unsigned long irqflags;
+	u64 now;
+
+	if (!timeline_open || test_bit(which, &timeline_firsts))
+		return;
+	now = sched_clock();
+	spin_lock_irqsave(&timeline_lock, irqflags);
+	if (!__test_and_set_bit(which, &timeline_firsts) &&
+	    pm_timeline_open_locked(now))
+		pm_timeline_add_locked(what, now, now);
+	spin_unlock_irqrestore(&timeline_lock, irqflags);
+}
+EXPORT_SYMBOL(pm_timeline_first);
+
+static int pm_timeline_show(struct seq_file *m, void *unused)
+{
+	static struct pm_timeline_entry copy[PM_TIMELINE_ENTRIES];
+	static DEFINE_MUTEX(copy_lock);
+	unsigned long irqflags;
+	unsigned int i, count, seq;
+	u64 start;
+	unsigned long rem;
+
+	mutex_lock(&copy_lock);
+	spin_lock_irqsave(&timeline_lock, irqflags);
+	count = timeline_count;
+	seq = timeline_seq;
+	memcpy(copy, timeline, count * sizeof(copy[0]));
+	spin_unlock_irqrestore(&timeline_lock, irqflags);
+
+	seq_printf(m, "resume %u, %u entries\n", seq, count);
+	seq_printf(m, "start_ms\tduration_us\tname\n");
+	for (i = 0; i < count; i++) {
+		start = copy[i].start;
+		rem = do_div(start, NSEC_PER_MSEC);
+		seq_printf(m, "%llu.%03lu\t%u\t%s\n", start,
+			   rem / NSEC_PER_USEC, copy[i].duration_us,
+			   copy[i].name);
+	}
+	mutex_unlock(&copy_lock);
+	return 0;
+}
+
+static int pm_timeline_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pm_timeline_show, NULL);
+}
+
+static const struct file_operations pm_timeline_fops = {
+	.owner = THIS_MODULE,
+	.open = pm_timeline_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init pm_timeline_init(void)
+{
+	debugfs_create_file("pm_timeline", S_IRUGO, NULL, NULL,
+			    &pm_timeline_fops);
+	return 0;
+}
+
+late_initcall(pm_timeline_init);
@@ -14,16 +14,25 @@
  */
 
 #include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
 #include <linux/platform_device.h>
 #include <linux/rtc.h>
+#include <linux/seq_file.h>
 #include <linux/suspend.h>
 #include <linux/syscalls.h> /* sys_sync */
 #include <linux/wakelock.h>
 #ifdef CONFIG_WAKELOCK_STAT
 #include <linux/proc_fs.h>
+#include <linux/irq.h>
+#include <linux/interrupt.h>
+#include <linux/sched.h>
 #endif
 #include "power.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/wakelock.h>
+
 enum {
 	DEBUG_EXIT_SUSPEND = 1U << 0,
 	DEBUG_WAKEUP = 1U << 1,
@@ -39,22 +48,167 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 #define WAKE_LOCK_INITIALIZED            (1U << 8)
 #define WAKE_LOCK_ACTIVE                 (1U << 9)
 #define WAKE_LOCK_AUTO_EXPIRE            (1U << 10)
-#define WAKE_LOCK_PREVENTING_SUSPEND     (1U << 11)
 
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+/* active auto-expire locks ordered by expiry, and how many are untimed */
+static struct rb_root timed_wake_locks[WAKE_LOCK_TYPE_COUNT];
+static int untimed_wake_locks[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 struct workqueue_struct *suspend_work_queue;
 struct wake_lock main_wake_lock;
 suspend_state_t requested_suspend_state = PM_SUSPEND_MEM;
 static struct wake_lock unknown_wakeup;
 
+/*
+ * Quick wake: when every lock taken for a wakeup has been dropped again
+ * by the kernel within quick_wake_settle_ms (an alarm serviced by a
+ * driver, a packet the driver filtered), go straight back to sleep with
+ * tasks still frozen. That skips the thaw, sync, refreeze and notifier
+ * round trip of a full cycle. Anything that needs user space keeps a
+ * lock, which forces the full path. quick_wake_max bounds the number of
+ * quick cycles in a row.
+ */
+static int quick_wake = 1;
+module_param(quick_wake, int, S_IRUGO | S_IWUSR | S_IWGRP);
+static int quick_wake_settle_ms = 20;
+module_param(quick_wake_settle_ms, int, S_IRUGO | S_IWUSR | S_IWGRP);
+static int quick_wake_max = 16;
+module_param(quick_wake_max, int, S_IRUGO | S_IWUSR | S_IWGRP);
+
+#define WAKEUP_HIST_BUCKETS	16
+
+/* time awake per wakeup, for quick and full wakeups */
+struct wakeup_awake_stat {
+	unsigned int count;
+	ktime_t total;
+	ktime_t max;
+	unsigned int hist[WAKEUP_HIST_BUCKETS];	/* 2^n ms */
+};
+static struct wakeup_awake_stat wakeup_stats[2];
+static ktime_t wakeup_resume_time;
+static int wakeup_entry_event_num;
+static int quick_wake_run;
+static int wakeup_source_pending;
+static char wakeup_source[32];
+
 #ifdef CONFIG_WAKELOCK_STAT
 static struct wake_lock deleted_wake_locks;
-static ktime_t last_sleep_time_update;
 static int wait_for_wakeup;
 
+#define WAKEUP_LOG_LEN		32
+#define WAKEUP_LOG_TASKS	4	/* processes kept per wakeup */
+#define WAKEUP_SCAN_TASKS	32	/* processes told apart per wakeup */
+
+struct wakeup_task {
+	pid_t tgid;
+	uid_t uid;
+	u64 exec_ns;
+	char comm[TASK_COMM_LEN];
+};
+
+/* one awake window, from a resume to the next suspend */
+struct wakeup_record {
+	ktime_t resume;
+	ktime_t awake;
+	int quick;
+	int irq;		/* -1 when none was reported */
+	int source_timed;	/* the first lock was taken with a timeout */
+	int end_expired;	/* the last lock timed out */
+	char source[32];	/* first suspend lock taken */
+	char end[32];		/* last suspend lock to go */
+	struct wakeup_task tasks[WAKEUP_LOG_TASKS];	/* most cpu first */
+	u64 other_ns;		/* cpu of everyone else */
+};
+
+static struct wakeup_record wakeup_log[WAKEUP_LOG_LEN];
+static unsigned int wakeup_log_head;
+static DEFINE_MUTEX(wakeup_log_lock);
+static struct wakeup_task wakeup_scan[WAKEUP_SCAN_TASKS];
+static int wakeup_irq = -1;
+static int wakeup_irq_pending;
+static int wakeup_source_timed;
+static char wakeup_end[32];
+static int wakeup_end_expired;
+
+/* Caller must acquire the list_lock spinlock */
+static void wakeup_note_end_locked(struct wake_lock *lock, int expired)
+{
+	strlcpy(wakeup_end, lock->name, sizeof(wakeup_end));
+	wakeup_end_expired = expired;
+}
+
+/*
+ * Time spent with the main lock released, which is when a suspend lock is
+ * what keeps us awake. A lock's prevent_suspend_time is how far this clock
+ * moved while the lock was held, so it costs nothing to keep up per lock.
+ */
+static ktime_t sleep_wait_base;
+static ktime_t sleep_wait_start;
+static int sleep_waiting;
+
+static ktime_t sleep_wait_clock(ktime_t now)
+{
+	if (!sleep_waiting || now.tv64 < sleep_wait_start.tv64)
+		return sleep_wait_base;
+	return ktime_add(sleep_wait_base, ktime_sub(now, sleep_wait_start));
+}
+
+/*
+ * Finished lock periods are queued per cpu and folded into lock->stat
+ * when the stats are read, so the lock and unlock paths only take a
+ * timestamp. All updates are commutative, order does not matter.
+ */
+#define WAKE_LOCK_STAT_BATCH	32
+
+struct wake_lock_stat_delta {
+	struct wake_lock *lock;
+	ktime_t duration;
+	ktime_t prevent_suspend;
+	int expired;
+};
+
+struct wake_lock_stat_batch {
+	int count;
+	struct wake_lock_stat_delta delta[WAKE_LOCK_STAT_BATCH];
+};
+static DEFINE_PER_CPU(struct wake_lock_stat_batch, wake_lock_stat_batches);
+
+/* Caller must acquire the list_lock spinlock */
+static void fold_wake_lock_stats_locked(struct wake_lock_stat_batch *batch)
+{
+	struct wake_lock_stat_delta *d;
+	struct wake_lock *lock;
+	int i;
+
+	for (i = 0; i < batch->count; i++) {
+		d = &batch->delta[i];
+		lock = d->lock;
+		lock->stat.count++;
+		if (d->expired)
+			lock->stat.expire_count++;
+		lock->stat.total_time = ktime_add(lock->stat.total_time,
+						  d->duration);
+		if (d->duration.tv64 > lock->stat.max_time.tv64)
+			lock->stat.max_time = d->duration;
+		lock->stat.prevent_suspend_time = ktime_add(
+			lock->stat.prevent_suspend_time, d->prevent_suspend);
+	}
+	batch->count = 0;
+}
+
+/* Caller must acquire the list_lock spinlock, which also keeps every other
+ * cpu out of its batch */
+static void fold_all_wake_lock_stats_locked(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		fold_wake_lock_stats_locked(&per_cpu(wake_lock_stat_batches,
+						     cpu));
+}
+
 int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 {
 	struct timespec ts;
@@ -103,9 +257,10 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 		else
 			expire_count++;
 		total_time = ktime_add(total_time, add_time);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND)
+		if ((lock->flags & WAKE_LOCK_TYPE_MASK) == WAKE_LOCK_SUSPEND)
 			prevent_suspend_time = ktime_add(prevent_suspend_time,
-					ktime_sub(now, last_sleep_time_update));
+					ktime_sub(sleep_wait_clock(now),
+					lock->stat.prevent_suspend_start));
 		if (add_time.tv64 > max_time.tv64)
 			max_time = add_time;
 	}
@@ -127,6 +282,7 @@ static int wakelock_stats_show(struct seq_file *m, void *unused)
 	int type;
 
 	spin_lock_irqsave(&list_lock, irqflags);
+	fold_all_wake_lock_stats_locked();
 
 	ret = seq_puts(m, "name\tcount\texpire_count\twake_count\tactive_since"
 			"\ttotal_time\tsleep_time\tmax_time\tlast_change\n");
@@ -140,65 +296,97 @@ static int wakelock_stats_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static void wake_lock_stat_start_locked(struct wake_lock *lock, ktime_t now)
+{
+	lock->stat.last_time = now;
+	lock->stat.prevent_suspend_start = sleep_wait_clock(now);
+}
+
 static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 {
-	ktime_t duration;
-	ktime_t now;
+	struct wake_lock_stat_batch *batch;
+	struct wake_lock_stat_delta *d;
+	ktime_t now, end;
+
 	if (!(lock->flags & WAKE_LOCK_ACTIVE))
 		return;
-	if (get_expired_time(lock, &now))
+	now = ktime_get();
+	if (get_expired_time(lock, &end))
 		expired = 1;
 	else
-		now = ktime_get();
-	lock->stat.count++;
-	if (expired)
-		lock->stat.expire_count++;
-	duration = ktime_sub(now, lock->stat.last_time);
-	lock->stat.total_time = ktime_add(lock->stat.total_time, duration);
-	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
-		lock->stat.max_time = duration;
-	lock->stat.last_time = ktime_get();
-	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-		duration = ktime_sub(now, last_sleep_time_update);
-		lock->stat.prevent_suspend_time = ktime_add(
-			lock->stat.prevent_suspend_time, duration);
-		lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-	}
+		end = now;
+
+	batch = &__get_cpu_var(wake_lock_stat_batches);
+	if (batch->count == WAKE_LOCK_STAT_BATCH)
+		fold_wake_lock_stats_locked(batch);
+	d = &batch->delta[batch->count++];
+	d->lock = lock;
+	d->expired = expired;
+	d->duration = ktime_sub(end, lock->stat.last_time);
+	if ((lock->flags & WAKE_LOCK_TYPE_MASK) == WAKE_LOCK_SUSPEND)
+		d->prevent_suspend = ktime_sub(sleep_wait_clock(end),
+					       lock->stat.prevent_suspend_start);
+	else
+		d->prevent_suspend = ktime_set(0, 0);
+	lock->stat.last_time = now;
 }
 
+/* Caller must acquire the list_lock spinlock */
 static void update_sleep_wait_stats_locked(int done)
 {
-	struct wake_lock *lock;
-	ktime_t now, etime, elapsed, add;
-	int expired;
+	ktime_t now = ktime_get();
 
-	now = ktime_get();
-	elapsed = ktime_sub(now, last_sleep_time_update);
-	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link) {
-		expired = get_expired_time(lock, &etime);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-			if (expired)
-				add = ktime_sub(etime, last_sleep_time_update);
-			else
-				add = elapsed;
-			lock->stat.prevent_suspend_time = ktime_add(
-				lock->stat.prevent_suspend_time, add);
-		}
-		if (done || expired)
-			lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-		else
-			lock->flags |= WAKE_LOCK_PREVENTING_SUSPEND;
+	if (done && sleep_waiting) {
+		sleep_wait_base = sleep_wait_clock(now);
+		sleep_waiting = 0;
+	} else if (!done && !sleep_waiting) {
+		sleep_wait_start = now;
+		sleep_waiting = 1;
 	}
-	last_sleep_time_update = now;
 }
 #endif
 
+/* Caller must acquire the list_lock spinlock */
+static void insert_timed_wake_lock_locked(struct wake_lock *lock, int type)
+{
+	struct rb_node **p = &timed_wake_locks[type].rb_node;
+	struct rb_node *parent = NULL;
+	struct wake_lock *entry;
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct wake_lock, timeout_node);
+		if (time_before(lock->expires, entry->expires))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&lock->timeout_node, parent, p);
+	rb_insert_color(&lock->timeout_node, &timed_wake_locks[type]);
+}
+
+/* Caller must acquire the list_lock spinlock. Drops an active lock from
+ * the expiry tree or the untimed count before its state changes. */
+static void detach_wake_lock_locked(struct wake_lock *lock)
+{
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
+
+	if (!(lock->flags & WAKE_LOCK_ACTIVE))
+		return;
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		rb_erase(&lock->timeout_node, &timed_wake_locks[type]);
+	else
+		untimed_wake_locks[type]--;
+}
 
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
+	if ((lock->flags & WAKE_LOCK_TYPE_MASK) == WAKE_LOCK_SUSPEND)
+		wakeup_note_end_locked(lock, 1);
 #endif
+	detach_wake_lock_locked(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -236,21 +424,24 @@ void print_active_locks(int type)
 
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct rb_node *node;
+	struct wake_lock *lock;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
+	/* expire from the front of the tree, only locks that are due */
+	while ((node = rb_first(&timed_wake_locks[type]))) {
+		lock = rb_entry(node, struct wake_lock, timeout_node);
+		if ((long)(lock->expires - jiffies) > 0)
+			break;
+		expire_wake_lock(lock);
 	}
-	return max_timeout;
+	if (untimed_wake_locks[type])
+		return -1;
+	node = rb_last(&timed_wake_locks[type]);
+	if (!node)
+		return 0;
+	lock = rb_entry(node, struct wake_lock, timeout_node);
+	return lock->expires - jiffies;
 }
 
 long has_wake_lock(int type)
@@ -263,6 +454,162 @@ long has_wake_lock(int type)
 	return ret;
 }
 
+static s64 wakeup_ms(ktime_t t)
+{
+	return div_s64(ktime_to_ns(t), NSEC_PER_MSEC);
+}
+
+#ifdef CONFIG_WAKELOCK_STAT
+void suspend_wakeup_irq(int irq)
+{
+	if (wakeup_irq_pending) {
+		wakeup_irq = irq;
+		wakeup_irq_pending = 0;
+	}
+}
+EXPORT_SYMBOL(suspend_wakeup_irq);
+
+/*
+ * Per process cpu time of a window is what each thread's runtime moved
+ * since the window started. Threads that exit before the window ends
+ * take their share with them.
+ */
+static void wakeup_window_start(void)
+{
+	struct task_struct *g, *t;
+	unsigned long irqflags;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	wakeup_irq_pending = 0;
+	strlcpy(wakeup_end, "none", sizeof(wakeup_end));
+	wakeup_end_expired = 0;
+	spin_unlock_irqrestore(&list_lock, irqflags);
+
+	read_lock(&tasklist_lock);
+	do_each_thread(g, t) {
+		t->wakeup_exec_base = t->se.sum_exec_runtime;
+	} while_each_thread(g, t);
+	read_unlock(&tasklist_lock);
+}
+
+static void wakeup_window_end(int quick, ktime_t awake)
+{
+	struct wakeup_record *rec;
+	struct task_struct *g, *t;
+	struct wakeup_task *w, tmp;
+	unsigned long irqflags;
+	u64 ns, other = 0;
+	int i, j, n = 0;
+
+	mutex_lock(&wakeup_log_lock);
+	read_lock(&tasklist_lock);
+	do_each_thread(g, t) {
+		ns = t->se.sum_exec_runtime - t->wakeup_exec_base;
+		if (!ns)
+			continue;
+		for (i = 0; i < n; i++)
+			if (wakeup_scan[i].tgid == t->tgid)
+				break;
+		if (i == n) {
+			if (n == WAKEUP_SCAN_TASKS) {
+				other += ns;
+				continue;
+			}
+			w = &wakeup_scan[n++];
+			w->tgid = t->tgid;
+			w->uid = task_uid(t);
+			w->exec_ns = 0;
+			strlcpy(w->comm, t->group_leader->comm, sizeof(w->comm));
+		}
+		wakeup_scan[i].exec_ns += ns;
+	} while_each_thread(g, t);
+	read_unlock(&tasklist_lock);
+
+	/* the biggest few to the front, the rest only as a total */
+	for (i = 0; i < n && i < WAKEUP_LOG_TASKS; i++) {
+		for (j = i + 1; j < n; j++)
+			if (wakeup_scan[j].exec_ns > wakeup_scan[i].exec_ns) {
+				tmp = wakeup_scan[i];
+				wakeup_scan[i] = wakeup_scan[j];
+				wakeup_scan[j] = tmp;
+			}
+	}
+	for (j = i; j < n; j++)
+		other += wakeup_scan[j].exec_ns;
+
+	rec = &wakeup_log[wakeup_log_head++ % WAKEUP_LOG_LEN];
+	memset(rec, 0, sizeof(*rec));
+	rec->resume = wakeup_resume_time;
+	rec->awake = awake;
+	rec->quick = quick;
+	memcpy(rec->tasks, wakeup_scan, i * sizeof(*wakeup_scan));
+	rec->other_ns = other;
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	rec->irq = wakeup_irq;
+	rec->source_timed = wakeup_source_timed;
+	rec->end_expired = wakeup_end_expired;
+	strlcpy(rec->source, wakeup_source, sizeof(rec->source));
+	strlcpy(rec->end, wakeup_end, sizeof(rec->end));
+	spin_unlock_irqrestore(&list_lock, irqflags);
+	mutex_unlock(&wakeup_log_lock);
+}
+#else
+static inline void wakeup_window_start(void) {}
+static inline void wakeup_window_end(int quick, ktime_t awake) {}
+#endif
+
+static void wakeup_awake_account(int quick, ktime_t now)
+{
+	struct wakeup_awake_stat *st = &wakeup_stats[quick];
+	ktime_t awake = ktime_sub(now, wakeup_resume_time);
+	unsigned int ms = wakeup_ms(awake);
+	int bucket = ms ? min(fls(ms), WAKEUP_HIST_BUCKETS - 1) : 0;
+
+	st->count++;
+	st->total = ktime_add(st->total, awake);
+	if (awake.tv64 > st->max.tv64)
+		st->max = awake;
+	st->hist[bucket]++;
+	wakeup_window_end(quick, awake);
+	wakeup_resume_time.tv64 = 0;
+}
+
+/*
+ * Called from enter_state() after each resume, with tasks still frozen.
+ * Returns true to suspend again right away.
+ */
+bool suspend_quick_wake(void)
+{
+	unsigned long irqflags;
+	long has_lock;
+	bool quick;
+
+	wakeup_resume_time = ktime_get();
+	wakeup_window_start();
+	if (!quick_wake || quick_wake_run >= quick_wake_max)
+		return false;
+
+	msleep(quick_wake_settle_ms);
+
+	spin_lock_irqsave(&list_lock, irqflags);
+	has_lock = has_wake_lock_locked(WAKE_LOCK_SUSPEND);
+	/* with no event at all the wakeup is unknown, take the full path */
+	quick = !has_lock && current_event_num != wakeup_entry_event_num;
+	if (quick) {
+		wakeup_entry_event_num = current_event_num;
+		quick_wake_run++;
+	}
+	spin_unlock_irqrestore(&list_lock, irqflags);
+
+	if (quick) {
+		if (debug_mask & DEBUG_SUSPEND)
+			pr_info("suspend: quick wake by %s\n", wakeup_source);
+		wakeup_awake_account(1, ktime_get());
+	}
+	return quick;
+}
+
 static void suspend(struct work_struct *work)
 {
 	int ret;
@@ -279,6 +626,10 @@ static void suspend(struct work_struct *work)
 	}
 
 	entry_event_num = current_event_num;
+	if (wakeup_resume_time.tv64)
+		wakeup_awake_account(0, ktime_get());
+	wakeup_entry_event_num = entry_event_num;
+	quick_wake_run = 0;
 	sys_sync();
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("suspend: enter suspend\n");
@@ -323,8 +674,13 @@ static DEFINE_TIMER(expire_timer, expire_wake_locks, 0, 0);
 static int power_suspend_late(struct device *dev)
 {
 	int ret = has_wake_lock(WAKE_LOCK_SUSPEND) ? -EAGAIN : 0;
+	wakeup_source_pending = 1;
+	strlcpy(wakeup_source, "unknown", sizeof(wakeup_source));
 #ifdef CONFIG_WAKELOCK_STAT
 	wait_for_wakeup = 1;
+	wakeup_source_timed = 0;
+	wakeup_irq = -1;
+	wakeup_irq_pending = 1;
 #endif
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("power_suspend_late return %d\n", ret);
@@ -381,6 +737,8 @@ void wake_lock_destroy(struct wake_lock *lock)
 	spin_lock_irqsave(&list_lock, irqflags);
 	lock->flags &= ~WAKE_LOCK_INITIALIZED;
 #ifdef CONFIG_WAKELOCK_STAT
+	/* the lock may sit in a batch, and its memory is going away */
+	fold_all_wake_lock_stats_locked();
 	if (lock->stat.count) {
 		deleted_wake_locks.stat.count += lock->stat.count;
 		deleted_wake_locks.stat.expire_count += lock->stat.expire_count;
@@ -395,6 +753,7 @@ void wake_lock_destroy(struct wake_lock *lock)
 				  lock->stat.max_time);
 	}
 #endif
+	detach_wake_lock_locked(lock);
 	list_del(&lock->link);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
@@ -411,6 +770,13 @@ static void wake_lock_internal(
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
 	BUG_ON(!(lock->flags & WAKE_LOCK_INITIALIZED));
+	if (type == WAKE_LOCK_SUSPEND && wakeup_source_pending) {
+		strlcpy(wakeup_source, lock->name, sizeof(wakeup_source));
+		wakeup_source_pending = 0;
+#ifdef CONFIG_WAKELOCK_STAT
+		wakeup_source_timed = has_timeout;
+#endif
+	}
 #ifdef CONFIG_WAKELOCK_STAT
 	if (type == WAKE_LOCK_SUSPEND && wait_for_wakeup) {
 		if (debug_mask & DEBUG_WAKEUP)
@@ -421,13 +787,15 @@ static void wake_lock_internal(
 	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
 	    (long)(lock->expires - jiffies) <= 0) {
 		wake_unlock_stat_locked(lock, 0);
-		lock->stat.last_time = ktime_get();
+		wake_lock_stat_start_locked(lock, ktime_get());
 	}
 #endif
+	trace_wake_lock(lock, type, has_timeout ? timeout : 0);
+	detach_wake_lock_locked(lock);
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
-		lock->stat.last_time = ktime_get();
+		wake_lock_stat_start_locked(lock, ktime_get());
 #endif
 	}
 	list_del(&lock->link);
@@ -439,20 +807,20 @@ static void wake_lock_internal(
 		lock->expires = jiffies + timeout;
 		lock->flags |= WAKE_LOCK_AUTO_EXPIRE;
 		list_add_tail(&lock->link, &active_wake_locks[type]);
+		insert_timed_wake_lock_locked(lock, type);
 	} else {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d\n", lock->name, type);
 		lock->expires = LONG_MAX;
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
 		list_add(&lock->link, &active_wake_locks[type]);
+		untimed_wake_locks[type]++;
 	}
 	if (type == WAKE_LOCK_SUSPEND) {
 		current_event_num++;
 #ifdef CONFIG_WAKELOCK_STAT
 		if (lock == &main_wake_lock)
 			update_sleep_wait_stats_locked(1);
-		else if (!wake_lock_active(&main_wake_lock))
-			update_sleep_wait_stats_locked(0);
 #endif
 		if (has_timeout)
 			expire_in = has_wake_lock_locked(type);
@@ -498,6 +866,8 @@ void wake_unlock(struct wake_lock *lock)
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
+	trace_wake_unlock(lock, type);
+	detach_wake_lock_locked(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
 	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
@@ -513,8 +883,12 @@ void wake_unlock(struct wake_lock *lock)
 				if (debug_mask & DEBUG_EXPIRE)
 					pr_info("wake_unlock: %s, stop expire "
 						"timer\n", lock->name);
-			if (has_lock == 0)
+			if (has_lock == 0) {
+#ifdef CONFIG_WAKELOCK_STAT
+				wakeup_note_end_locked(lock, 0);
+#endif
 				queue_work(suspend_work_queue, &suspend_work);
+			}
 		}
 		if (lock == &main_wake_lock) {
 			if (debug_mask & DEBUG_SUSPEND)
@@ -547,13 +921,121 @@ static const struct file_operations wakelock_stats_fops = {
 	.release = single_release,
 };
 
+static int suspend_wakeups_show(struct seq_file *m, void *unused)
+{
+	static const char *names[] = { "full", "quick" };
+	struct wakeup_awake_stat *st;
+	int i, j;
+
+	seq_printf(m, "last wakeup: %s\n", wakeup_source);
+	for (i = 0; i < ARRAY_SIZE(wakeup_stats); i++) {
+		st = &wakeup_stats[i];
+		seq_printf(m, "%s: count %u, awake %lld ms, avg %lld ms, "
+			   "max %lld ms\n", names[i], st->count,
+			   wakeup_ms(st->total), st->count ?
+			   div_s64(wakeup_ms(st->total), st->count) : 0,
+			   wakeup_ms(st->max));
+		for (j = 0; j < WAKEUP_HIST_BUCKETS; j++)
+			if (st->hist[j])
+				seq_printf(m, "  <%6u ms: %u\n", 1U << j,
+					   st->hist[j]);
+	}
+	return 0;
+}
+
+static int suspend_wakeups_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, suspend_wakeups_show, NULL);
+}
+
+static const struct file_operations suspend_wakeups_fops = {
+	.open = suspend_wakeups_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+#ifdef CONFIG_WAKELOCK_STAT
+/* oldest first: when, how, what woke us and what kept us awake, then
+ * the processes that used the cpu meanwhile */
+static int suspend_wakeup_log_show(struct seq_file *m, void *unused)
+{
+	struct wakeup_record *rec;
+	struct wakeup_task *w;
+	struct irq_desc *desc;
+	unsigned long irqflags;
+	unsigned int i, n;
+	int j;
+
+	mutex_lock(&wakeup_log_lock);
+	n = min(wakeup_log_head, (unsigned int)WAKEUP_LOG_LEN);
+	for (i = wakeup_log_head - n; i != wakeup_log_head; i++) {
+		rec = &wakeup_log[i % WAKEUP_LOG_LEN];
+		seq_printf(m, "%lld ms: %s, awake %lld ms, irq ",
+			   wakeup_ms(rec->resume),
+			   rec->quick ? "quick" : "full", wakeup_ms(rec->awake));
+		desc = rec->irq >= 0 ? irq_to_desc(rec->irq) : NULL;
+		if (desc) {
+			spin_lock_irqsave(&desc->lock, irqflags);
+			seq_printf(m, "%d %s", rec->irq, desc->action ?
+				   desc->action->name : "-");
+			spin_unlock_irqrestore(&desc->lock, irqflags);
+		} else
+			seq_printf(m, "-");
+		seq_printf(m, ", lock %s%s, until %s%s\n", rec->source,
+			   rec->source_timed ? " (timeout)" : "", rec->end,
+			   rec->end_expired ? " (expired)" : "");
+		for (j = 0; j < WAKEUP_LOG_TASKS; j++) {
+			w = &rec->tasks[j];
+			if (!w->exec_ns)
+				break;
+			seq_printf(m, "  %5d %-16s uid %5u cpu %llu us\n",
+				   w->tgid, w->comm, w->uid,
+				   div_u64(w->exec_ns, NSEC_PER_USEC));
+		}
+		if (rec->other_ns)
+			seq_printf(m, "  other cpu %llu us\n",
+				   div_u64(rec->other_ns, NSEC_PER_USEC));
+	}
+	mutex_unlock(&wakeup_log_lock);
+	return 0;
+}
+
+static int suspend_wakeup_log_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, suspend_wakeup_log_show, NULL);
+}
+
+static const struct file_operations suspend_wakeup_log_fops = {
+	.open = suspend_wakeup_log_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif
+
+/* debugfs is not up yet at core_initcall time */
+static int __init suspend_wakeups_init(void)
+{
+	debugfs_create_file("suspend_wakeups", S_IRUGO, NULL, NULL,
+			    &suspend_wakeups_fops);
+#ifdef CONFIG_WAKELOCK_STAT
+	debugfs_create_file("suspend_wakeup_log", S_IRUGO, NULL, NULL,
+			    &suspend_wakeup_log_fops);
+#endif
+	return 0;
+}
+late_initcall(suspend_wakeups_init);
+
 static int __init wakelocks_init(void)
 {
 	int ret;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
+	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++) {
 		INIT_LIST_HEAD(&active_wake_locks[i]);
+		timed_wake_locks[i] = RB_ROOT;
+	}
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
@@ -574,7 +1056,7 @@ static int __init wakelocks_init(void)
 		goto err_platform_driver_register;
 	}
 
-	suspend_work_queue = create_singlethread_workqueue("suspend");
+	suspend_work_queue = create_hipri_workqueue("suspend");
 	if (suspend_work_queue == NULL) {
 		ret = -ENOMEM;
 		goto err_suspend_work_queue;
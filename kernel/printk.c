@@ -33,6 +33,7 @@
 #include <linux/bootmem.h>
 #include <linux/syscalls.h>
 #include <linux/kexec.h>
+#include <linux/kthread.h>
 
 #include <asm/uaccess.h>
 
@@ -115,6 +116,7 @@ static DEFINE_SPINLOCK(logbuf_lock);
  */
 static unsigned log_start;	/* Index into log_buf: next char to be read by syslog() */
 static unsigned con_start;	/* Index into log_buf: next char to be sent to consoles */
+static unsigned imm_start;	/* Index into log_buf: next char to be sent to CON_IMMEDIATE consoles */
 static unsigned log_end;	/* Index into log_buf: most-recently-written-char + 1 */
 
 /*
@@ -470,13 +472,17 @@ SYSCALL_DEFINE3(syslog, int, type, char __user *, buf, int, len)
 }
 
 /*
- * Call the console drivers on a range of log_buf
+ * Call the console drivers on a range of log_buf, either only the
+ * CON_IMMEDIATE ones or only the others
  */
-static void __call_console_drivers(unsigned start, unsigned end)
+static void __call_console_drivers(unsigned start, unsigned end,
+				   int immediate)
 {
 	struct console *con;
 
 	for_each_console(con) {
+		if (!(con->flags & CON_IMMEDIATE) != !immediate)
+			continue;
 		if ((con->flags & CON_ENABLED) && con->write &&
 				(cpu_online(smp_processor_id()) ||
 				(con->flags & CON_ANYTIME)))
@@ -500,30 +506,34 @@ early_param("ignore_loglevel", ignore_loglevel_setup);
  * Write out chars from start to end - 1 inclusive
  */
 static void _call_console_drivers(unsigned start,
-				unsigned end, int msg_log_level)
+				unsigned end, int msg_log_level, int immediate)
 {
 	if ((msg_log_level < console_loglevel || ignore_loglevel) &&
 			console_drivers && start != end) {
 		if ((start & LOG_BUF_MASK) > (end & LOG_BUF_MASK)) {
 			/* wrapped write */
 			__call_console_drivers(start & LOG_BUF_MASK,
-						log_buf_len);
-			__call_console_drivers(0, end & LOG_BUF_MASK);
+						log_buf_len, immediate);
+			__call_console_drivers(0, end & LOG_BUF_MASK,
+						immediate);
 		} else {
-			__call_console_drivers(start, end);
+			__call_console_drivers(start, end, immediate);
 		}
 	}
 }
 
 /*
  * Call the console drivers, asking them to write out
- * log_buf[start] to log_buf[end - 1].
+ * log_buf[start] to log_buf[end - 1]. The CON_IMMEDIATE consoles and
+ * the others are fed from their own positions in log_buf, so each keeps
+ * its own partial line state.
  * The console_sem must be held.
  */
-static void call_console_drivers(unsigned start, unsigned end)
+static void call_console_drivers(unsigned start, unsigned end, int immediate)
 {
 	unsigned cur_index, start_print;
-	static int msg_level = -1;
+	static int msg_levels[2] = { -1, -1 };
+	int msg_level = msg_levels[immediate];
 
 	BUG_ON(((int)(start - end)) > 0);
 
@@ -553,14 +563,16 @@ static void call_console_drivers(unsigned start, unsigned end)
 					 */
 					msg_level = default_message_loglevel;
 				}
-				_call_console_drivers(start_print, cur_index, msg_level);
+				_call_console_drivers(start_print, cur_index,
+						      msg_level, immediate);
 				msg_level = -1;
 				start_print = cur_index;
 				break;
 			}
 		}
 	}
-	_call_console_drivers(start_print, end, msg_level);
+	_call_console_drivers(start_print, end, msg_level, immediate);
+	msg_levels[immediate] = msg_level;
 }
 
 static void emit_log_char(char c)
@@ -571,6 +583,8 @@ static void emit_log_char(char c)
 		log_start = log_end - log_buf_len;
 	if (log_end - con_start > log_buf_len)
 		con_start = log_end - log_buf_len;
+	if (log_end - imm_start > log_buf_len)
+		imm_start = log_end - log_buf_len;
 	if (logged_chars < log_buf_len)
 		logged_chars++;
 }
@@ -857,7 +871,7 @@ EXPORT_SYMBOL(vprintk);
 
 #else
 
-static void call_console_drivers(unsigned start, unsigned end)
+static void call_console_drivers(unsigned start, unsigned end, int immediate)
 {
 }
 
@@ -1056,13 +1070,49 @@ int is_console_locked(void)
 	return console_locked;
 }
 
+#define PRINTK_PENDING_WAKEUP	0x01
+#define PRINTK_PENDING_CONSOLE	0x02
+
 static DEFINE_PER_CPU(int, printk_pending);
 
+#ifdef CONFIG_PRINTK_DEFER_CONSOLE
+/*
+ * With defer_console set, printk() only writes to the CON_IMMEDIATE
+ * consoles (ram_console) itself. The other consoles, serial ones in
+ * particular, are fed a line at a time by a low priority thread, so a
+ * burst of printks does not keep interrupts off for the whole time it
+ * takes to push it out of a UART. Oopses and panics still print
+ * synchronously.
+ */
+static int defer_console = 1;
+module_param_named(defer_console, defer_console, bool, S_IRUGO | S_IWUSR);
+
+static struct task_struct *console_task;
+static DECLARE_WAIT_QUEUE_HEAD(console_wait);
+
+static int console_deferred(void)
+{
+	return defer_console && console_task && !oops_in_progress;
+}
+#else
+static inline int console_deferred(void)
+{
+	return 0;
+}
+#endif
+
 void printk_tick(void)
 {
-	if (__get_cpu_var(printk_pending)) {
+	int pending = __get_cpu_var(printk_pending);
+
+	if (pending) {
 		__get_cpu_var(printk_pending) = 0;
-		wake_up_interruptible(&log_wait);
+		if (pending & PRINTK_PENDING_WAKEUP)
+			wake_up_interruptible(&log_wait);
+#ifdef CONFIG_PRINTK_DEFER_CONSOLE
+		if (pending & PRINTK_PENDING_CONSOLE)
+			wake_up_interruptible(&console_wait);
+#endif
 	}
 }
 
@@ -1076,7 +1126,7 @@ int printk_needs_cpu(int cpu)
 void wake_up_klogd(void)
 {
 	if (waitqueue_active(&log_wait))
-		__raw_get_cpu_var(printk_pending) = 1;
+		__raw_get_cpu_var(printk_pending) |= PRINTK_PENDING_WAKEUP;
 }
 
 /**
@@ -1091,6 +1141,9 @@ void wake_up_klogd(void)
  *
  * If there is output waiting for klogd, we wake it up.
  *
+ * When the console output is deferred only the CON_IMMEDIATE consoles
+ * are written here and the console thread is woken for the rest.
+ *
  * release_console_sem() may be called from any context.
  */
 void release_console_sem(void)
@@ -1098,6 +1151,7 @@ void release_console_sem(void)
 	unsigned long flags;
 	unsigned _con_start, _log_end;
 	unsigned wake_klogd = 0;
+	int deferred = 0;
 
 	if (console_suspended) {
 		up(&console_sem);
@@ -1109,25 +1163,121 @@ void release_console_sem(void)
 	for ( ; ; ) {
 		spin_lock_irqsave(&logbuf_lock, flags);
 		wake_klogd |= log_start - log_end;
+		if (imm_start != log_end) {
+			_con_start = imm_start;
+			_log_end = log_end;
+			imm_start = log_end;
+			spin_unlock(&logbuf_lock);
+			call_console_drivers(_con_start, _log_end, 1);
+			local_irq_restore(flags);
+			continue;
+		}
 		if (con_start == log_end)
 			break;			/* Nothing to print */
+		if (console_deferred()) {
+			deferred = 1;
+			break;
+		}
 		_con_start = con_start;
 		_log_end = log_end;
 		con_start = log_end;		/* Flush */
 		spin_unlock(&logbuf_lock);
 		stop_critical_timings();	/* don't trace print latency */
-		call_console_drivers(_con_start, _log_end);
+		call_console_drivers(_con_start, _log_end, 0);
 		start_critical_timings();
 		local_irq_restore(flags);
 	}
 	console_locked = 0;
 	up(&console_sem);
 	spin_unlock_irqrestore(&logbuf_lock, flags);
+	if (deferred)
+		__raw_get_cpu_var(printk_pending) |= PRINTK_PENDING_CONSOLE;
 	if (wake_klogd)
 		wake_up_klogd();
 }
 EXPORT_SYMBOL(release_console_sem);
 
+#ifdef CONFIG_PRINTK_DEFER_CONSOLE
+#define CONSOLE_CHUNK	256
+
+/* the end of the next line to send, or of CONSOLE_CHUNK chars of it */
+static unsigned console_chunk_end(void)
+{
+	unsigned end = con_start;
+
+	while (end != log_end && end - con_start < CONSOLE_CHUNK)
+		if (LOG_BUF(end++) == '\n')
+			break;
+	return end;
+}
+
+static int console_pending(void)
+{
+	return con_start != log_end && !console_suspended;
+}
+
+static int console_thread(void *unused)
+{
+	unsigned long flags;
+	unsigned _con_start, _log_end;
+
+	set_user_nice(current, 19);
+
+	for ( ; ; ) {
+		wait_event_interruptible(console_wait, console_pending());
+
+		acquire_console_sem();
+		if (console_suspended) {
+			up(&console_sem);
+			continue;
+		}
+
+		for ( ; ; ) {
+			spin_lock_irqsave(&logbuf_lock, flags);
+			if (imm_start != log_end) {
+				_con_start = imm_start;
+				_log_end = log_end;
+				imm_start = log_end;
+				spin_unlock(&logbuf_lock);
+				call_console_drivers(_con_start, _log_end, 1);
+				local_irq_restore(flags);
+				continue;
+			}
+			if (con_start == log_end)
+				break;
+			_con_start = con_start;
+			_log_end = console_chunk_end();
+			con_start = _log_end;
+			spin_unlock(&logbuf_lock);
+			stop_critical_timings();
+			call_console_drivers(_con_start, _log_end, 0);
+			start_critical_timings();
+			local_irq_restore(flags);
+			cond_resched();
+		}
+		console_locked = 0;
+		up(&console_sem);
+		spin_unlock_irqrestore(&logbuf_lock, flags);
+	}
+	return 0;
+}
+
+static int __init console_thread_init(void)
+{
+	struct task_struct *p;
+
+	p = kthread_run(console_thread, NULL, "kconsoled");
+	if (IS_ERR(p)) {
+		printk(KERN_ERR "printk: no console thread, printing "
+		       "synchronously\n");
+		return PTR_ERR(p);
+	}
+	console_task = p;
+	return 0;
+}
+core_initcall(console_thread_init);
+#endif
+
 /**
  * console_conditional_schedule - yield the CPU if required
  *
@@ -1341,7 +1491,10 @@ void register_console(struct console *newcon)
 		 * for us.
 		 */
 		spin_lock_irqsave(&logbuf_lock, flags);
-		con_start = log_start;
+		if (newcon->flags & CON_IMMEDIATE)
+			imm_start = log_start;
+		else
+			con_start = log_start;
 		spin_unlock_irqrestore(&logbuf_lock, flags);
 	}
 	release_console_sem();
@@ -227,6 +227,20 @@ static void destroy_rt_bandwidth(struct rt_bandwidth *rt_b)
 }
 #endif
 
+#ifdef CONFIG_CFS_BANDWIDTH
+/*
+ * Per cpu cap on the runtime a group's SCHED_OTHER tasks get each period;
+ * a quota of RUNTIME_INF means no cap.
+ */
+struct cfs_bandwidth {
+	/* nests inside the rq lock: */
+	spinlock_t		lock;
+	ktime_t			period;
+	u64			quota;
+	struct hrtimer		period_timer;
+};
+#endif
+
 /*
  * sched_domains_mutex serializes calls to arch_init_sched_domains,
  * detach_destroy_domains and partition_sched_domains.
@@ -251,6 +265,11 @@ struct task_group {
 	/* runqueue "owned" by this group on each cpu */
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
+	/* bound on the wait of a waking task, 0 for none */
+	u64 wakeup_latency;
+#ifdef CONFIG_CFS_BANDWIDTH
+	struct cfs_bandwidth cfs_bandwidth;
+#endif
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -311,8 +330,10 @@ static inline struct task_group *task_group(struct task_struct *p)
 	struct task_group *tg;
 
 #ifdef CONFIG_CGROUP_SCHED
-	tg = container_of(task_subsys_state(p, cpu_cgroup_subsys_id),
-				struct task_group, css);
+	tg = p->sched_group_override;
+	if (!tg)
+		tg = container_of(task_subsys_state(p, cpu_cgroup_subsys_id),
+				  struct task_group, css);
 #else
 	tg = &init_task_group;
 #endif
@@ -365,6 +386,14 @@ struct cfs_rq {
 
 	unsigned int nr_spread_over;
 
+#ifdef CONFIG_SCHEDSTATS
+	/* runnable to running waits of the tasks queued here */
+	u64 wait_max;
+	u64 wait_sum;
+	unsigned long wait_count;
+	unsigned long nr_latency_preempt;
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	/* cpu runqueue to which this cfs_rq is attached */
 
@@ -403,6 +432,13 @@ struct cfs_rq {
 	 */
 	unsigned long rq_weight;
 #endif
+#ifdef CONFIG_CFS_BANDWIDTH
+	u64 runtime_used;	/* this period, against tg->cfs_bandwidth */
+	int throttled;
+	u64 throttled_timestamp;
+	u64 throttled_time;
+	unsigned long nr_throttled;
+#endif
 #endif
 };
 
@@ -2699,6 +2735,10 @@ void sched_fork(struct task_struct *p, int clone_flags)
 	int cpu = get_cpu();
 
 	__sched_fork(p);
+#ifdef CONFIG_CGROUP_SCHED
+	/* a lent group is the parent's, and holds only the parent's ref */
+	p->sched_group_override = NULL;
+#endif
 	/*
 	 * We mark the process as running here. This guarantees that
 	 * nobody will actually run it, and a signal or other external
@@ -9726,6 +9766,10 @@ void __init sched_init(void)
 			global_rt_period(), global_rt_runtime());
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+#ifdef CONFIG_CFS_BANDWIDTH
+	init_cfs_bandwidth(&init_task_group.cfs_bandwidth);
+#endif
+
 #ifdef CONFIG_CGROUP_SCHED
 	list_add(&init_task_group.list, &task_groups);
 	INIT_LIST_HEAD(&init_task_group.children);
@@ -10019,6 +10063,10 @@ static void free_fair_sched_group(struct task_group *tg)
 {
 	int i;
 
+#ifdef CONFIG_CFS_BANDWIDTH
+	destroy_cfs_bandwidth(&tg->cfs_bandwidth);
+#endif
+
 	for_each_possible_cpu(i) {
 		if (tg->cfs_rq)
 			kfree(tg->cfs_rq[i]);
@@ -10038,6 +10086,10 @@ int alloc_fair_sched_group(struct task_group *tg, struct task_group *parent)
 	struct rq *rq;
 	int i;
 
+#ifdef CONFIG_CFS_BANDWIDTH
+	init_cfs_bandwidth(&tg->cfs_bandwidth);
+#endif
+
 	tg->cfs_rq = kzalloc(sizeof(cfs_rq) * nr_cpu_ids, GFP_KERNEL);
 	if (!tg->cfs_rq)
 		goto err;
@@ -10296,6 +10348,52 @@ void sched_move_task(struct task_struct *tsk)
 
 	task_rq_unlock(rq, &flags);
 }
+
+/*
+ * Pin the group @p is scheduled in, which may itself be lent, so that it
+ * can be handed to another task with sched_set_task_group().
+ */
+struct task_group *sched_get_task_group(struct task_struct *p)
+{
+	struct task_group *tg;
+
+	rcu_read_lock();
+	tg = task_group(p);
+	css_get(&tg->css);
+	rcu_read_unlock();
+
+	return tg;
+}
+
+void sched_put_task_group(struct task_group *tg)
+{
+	if (tg)
+		css_put(&tg->css);
+}
+
+/*
+ * Schedule @p in @tg instead of its own cpu cgroup, or in its own cgroup
+ * again for a NULL @tg, without touching its cgroup membership. The
+ * reference on @tg passes to @p; the group lent before is returned along
+ * with its reference, NULL if there was none.
+ */
+struct task_group *sched_set_task_group(struct task_struct *p,
+					struct task_group *tg)
+{
+	struct task_group *old;
+	unsigned long flags;
+	struct rq *rq;
+
+	rq = task_rq_lock(p, &flags);
+	old = p->sched_group_override;
+	p->sched_group_override = tg;
+	task_rq_unlock(rq, &flags);
+
+	if (old != tg)
+		sched_move_task(p);
+
+	return old;
+}
 #endif /* CONFIG_CGROUP_SCHED */
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -10388,6 +10486,44 @@ unsigned long sched_group_shares(struct task_group *tg)
 {
 	return tg->shares;
 }
+
+#ifdef CONFIG_CFS_BANDWIDTH
+static DEFINE_MUTEX(cfs_constraints_mutex);
+
+static int tg_set_cfs_bandwidth(struct task_group *tg, u64 period, u64 quota)
+{
+	struct cfs_bandwidth *cfs_b = &tg->cfs_bandwidth;
+	int i;
+
+	if (tg == &init_task_group)
+		return -EINVAL;
+
+	/* below a millisecond the period timer costs more than it caps */
+	if (period < NSEC_PER_MSEC || (quota != RUNTIME_INF && !quota))
+		return -EINVAL;
+
+	mutex_lock(&cfs_constraints_mutex);
+	spin_lock_irq(&cfs_b->lock);
+	cfs_b->period = ns_to_ktime(period);
+	cfs_b->quota = quota;
+	spin_unlock_irq(&cfs_b->lock);
+
+	/* start the cap afresh, releasing anything held under the old one */
+	for_each_possible_cpu(i) {
+		struct cfs_rq *cfs_rq = tg->cfs_rq[i];
+		struct rq *rq = rq_of(cfs_rq);
+
+		spin_lock_irq(&rq->lock);
+		cfs_rq->runtime_used = 0;
+		if (cfs_rq_throttled(cfs_rq))
+			unthrottle_cfs_rq(cfs_rq);
+		spin_unlock_irq(&rq->lock);
+	}
+	mutex_unlock(&cfs_constraints_mutex);
+
+	return 0;
+}
+#endif /* CONFIG_CFS_BANDWIDTH */
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -10741,6 +10877,14 @@ cpu_cgroup_can_attach(struct cgroup_subsys *ss, struct cgroup *cgrp,
 	return 0;
 }
 
+static void
+cpu_cgroup_exit(struct cgroup_subsys *ss, struct task_struct *tsk)
+{
+	/* drop a lent group before it can go away under us */
+	if (tsk->sched_group_override)
+		sched_put_task_group(sched_set_task_group(tsk, NULL));
+}
+
 static void
 cpu_cgroup_attach(struct cgroup_subsys *ss, struct cgroup *cgrp,
 		  struct cgroup *old_cont, struct task_struct *tsk,
@@ -10770,6 +10914,69 @@ static u64 cpu_shares_read_u64(struct cgroup *cgrp, struct cftype *cft)
 
 	return (u64) tg->shares;
 }
+
+static int cpu_wakeup_latency_write_u64(struct cgroup *cgrp,
+		struct cftype *cftype, u64 latency_us)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+
+	if (tg == &init_task_group)
+		return -EINVAL;
+
+	tg->wakeup_latency = latency_us * NSEC_PER_USEC;
+	return 0;
+}
+
+static u64 cpu_wakeup_latency_read_u64(struct cgroup *cgrp, struct cftype *cft)
+{
+	u64 latency_us = cgroup_tg(cgrp)->wakeup_latency;
+
+	do_div(latency_us, NSEC_PER_USEC);
+	return latency_us;
+}
+
+#ifdef CONFIG_CFS_BANDWIDTH
+static int cpu_cfs_quota_write(struct cgroup *cgrp, struct cftype *cft,
+			       s64 cfs_quota_us)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+	u64 quota = (u64)cfs_quota_us * NSEC_PER_USEC;
+
+	if (cfs_quota_us < 0)
+		quota = RUNTIME_INF;
+
+	return tg_set_cfs_bandwidth(tg,
+			ktime_to_ns(tg->cfs_bandwidth.period), quota);
+}
+
+static s64 cpu_cfs_quota_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	u64 quota_us = cgroup_tg(cgrp)->cfs_bandwidth.quota;
+
+	if (quota_us == RUNTIME_INF)
+		return -1;
+
+	do_div(quota_us, NSEC_PER_USEC);
+	return quota_us;
+}
+
+static int cpu_cfs_period_write_u64(struct cgroup *cgrp, struct cftype *cftype,
+				    u64 cfs_period_us)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+
+	return tg_set_cfs_bandwidth(tg, cfs_period_us * NSEC_PER_USEC,
+			tg->cfs_bandwidth.quota);
+}
+
+static u64 cpu_cfs_period_read_u64(struct cgroup *cgrp, struct cftype *cft)
+{
+	u64 period_us = ktime_to_ns(cgroup_tg(cgrp)->cfs_bandwidth.period);
+
+	do_div(period_us, NSEC_PER_USEC);
+	return period_us;
+}
+#endif /* CONFIG_CFS_BANDWIDTH */
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -10803,6 +11010,23 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_shares_read_u64,
 		.write_u64 = cpu_shares_write_u64,
 	},
+	{
+		.name = "wakeup_latency_us",
+		.read_u64 = cpu_wakeup_latency_read_u64,
+		.write_u64 = cpu_wakeup_latency_write_u64,
+	},
+#endif
+#ifdef CONFIG_CFS_BANDWIDTH
+	{
+		.name = "cfs_quota_us",
+		.read_s64 = cpu_cfs_quota_read,
+		.write_s64 = cpu_cfs_quota_write,
+	},
+	{
+		.name = "cfs_period_us",
+		.read_u64 = cpu_cfs_period_read_u64,
+		.write_u64 = cpu_cfs_period_write_u64,
+	},
 #endif
 #ifdef CONFIG_RT_GROUP_SCHED
 	{
@@ -10829,6 +11053,7 @@ struct cgroup_subsys cpu_cgroup_subsys = {
 	.destroy	= cpu_cgroup_destroy,
 	.can_attach	= cpu_cgroup_can_attach,
 	.attach		= cpu_cgroup_attach,
+	.exit		= cpu_cgroup_exit,
 	.populate	= cpu_cgroup_populate,
 	.subsys_id	= cpu_cgroup_subsys_id,
 	.early_init	= 1,
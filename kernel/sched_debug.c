@@ -205,9 +205,29 @@ void print_cfs_rq(struct seq_file *m, int cpu, struct cfs_rq *cfs_rq)
 
 	SEQ_printf(m, "  .%-30s: %d\n", "nr_spread_over",
 			cfs_rq->nr_spread_over);
+#ifdef CONFIG_SCHEDSTATS
+	SEQ_printf(m, "  .%-30s: %Ld.%06ld\n", "wait_max",
+			SPLIT_NS(cfs_rq->wait_max));
+	SEQ_printf(m, "  .%-30s: %Ld.%06ld\n", "wait_sum",
+			SPLIT_NS(cfs_rq->wait_sum));
+	SEQ_printf(m, "  .%-30s: %ld\n", "wait_count", cfs_rq->wait_count);
+	SEQ_printf(m, "  .%-30s: %ld\n", "nr_latency_preempt",
+			cfs_rq->nr_latency_preempt);
+#endif
 #ifdef CONFIG_FAIR_GROUP_SCHED
 #ifdef CONFIG_SMP
 	SEQ_printf(m, "  .%-30s: %lu\n", "shares", cfs_rq->shares);
+#endif
+	SEQ_printf(m, "  .%-30s: %Ld.%06ld\n", "wakeup_latency",
+			SPLIT_NS(cfs_rq->tg->wakeup_latency));
+#ifdef CONFIG_CFS_BANDWIDTH
+	SEQ_printf(m, "  .%-30s: %Ld.%06ld\n", "runtime_used",
+			SPLIT_NS(cfs_rq->runtime_used));
+	SEQ_printf(m, "  .%-30s: %d\n", "throttled", cfs_rq->throttled);
+	SEQ_printf(m, "  .%-30s: %ld\n", "nr_throttled",
+			cfs_rq->nr_throttled);
+	SEQ_printf(m, "  .%-30s: %Ld.%06ld\n", "throttled_time",
+			SPLIT_NS(cfs_rq->throttled_time));
 #endif
 	print_cfs_group_stats(m, cpu, cfs_rq->tg);
 #endif
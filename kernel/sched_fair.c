@@ -492,6 +492,70 @@ __update_curr(struct cfs_rq *cfs_rq, struct sched_entity *curr,
 	update_min_vruntime(cfs_rq);
 }
 
+#ifdef CONFIG_CFS_BANDWIDTH
+static inline int cfs_rq_throttled(struct cfs_rq *cfs_rq)
+{
+	return cfs_rq->throttled;
+}
+
+static void start_cfs_bandwidth(struct cfs_bandwidth *cfs_b)
+{
+	ktime_t now;
+
+	if (hrtimer_active(&cfs_b->period_timer))
+		return;
+
+	spin_lock(&cfs_b->lock);
+	for (;;) {
+		unsigned long delta;
+		ktime_t soft, hard;
+
+		if (hrtimer_active(&cfs_b->period_timer))
+			break;
+
+		now = hrtimer_cb_get_time(&cfs_b->period_timer);
+		hrtimer_forward(&cfs_b->period_timer, now, cfs_b->period);
+
+		soft = hrtimer_get_softexpires(&cfs_b->period_timer);
+		hard = hrtimer_get_expires(&cfs_b->period_timer);
+		delta = ktime_to_ns(ktime_sub(hard, soft));
+		__hrtimer_start_range_ns(&cfs_b->period_timer, soft, delta,
+				HRTIMER_MODE_ABS_PINNED, 0);
+	}
+	spin_unlock(&cfs_b->lock);
+}
+
+/*
+ * Charge the runtime of the entity running on cfs_rq against its group's
+ * cap. Going over only asks for a reschedule; the group entity is taken
+ * off the runqueue when the current task is put back, in put_prev_entity.
+ */
+static void
+account_cfs_rq_runtime(struct cfs_rq *cfs_rq, unsigned long delta_exec)
+{
+	struct cfs_bandwidth *cfs_b = &cfs_rq->tg->cfs_bandwidth;
+
+	if (likely(cfs_b->quota == RUNTIME_INF))
+		return;
+
+	cfs_rq->runtime_used += delta_exec;
+	start_cfs_bandwidth(cfs_b);
+
+	if (cfs_rq->runtime_used > cfs_b->quota)
+		resched_task(rq_of(cfs_rq)->curr);
+}
+#else
+static inline int cfs_rq_throttled(struct cfs_rq *cfs_rq)
+{
+	return 0;
+}
+
+static inline void
+account_cfs_rq_runtime(struct cfs_rq *cfs_rq, unsigned long delta_exec)
+{
+}
+#endif
+
 static void update_curr(struct cfs_rq *cfs_rq)
 {
 	struct sched_entity *curr = cfs_rq->curr;
@@ -512,6 +576,7 @@ static void update_curr(struct cfs_rq *cfs_rq)
 
 	__update_curr(cfs_rq, curr, delta_exec);
 	curr->exec_start = now;
+	account_cfs_rq_runtime(cfs_rq, delta_exec);
 
 	if (entity_is_task(curr)) {
 		struct task_struct *curtask = task_of(curr);
@@ -551,8 +616,12 @@ update_stats_wait_end(struct cfs_rq *cfs_rq, struct sched_entity *se)
 			rq_of(cfs_rq)->clock - se->wait_start);
 #ifdef CONFIG_SCHEDSTATS
 	if (entity_is_task(se)) {
-		trace_sched_stat_wait(task_of(se),
-			rq_of(cfs_rq)->clock - se->wait_start);
+		u64 delta = rq_of(cfs_rq)->clock - se->wait_start;
+
+		trace_sched_stat_wait(task_of(se), delta);
+		cfs_rq->wait_max = max(cfs_rq->wait_max, delta);
+		cfs_rq->wait_sum += delta;
+		cfs_rq->wait_count++;
 	}
 #endif
 	schedstat_set(se->wait_start, 0);
@@ -808,6 +877,139 @@ dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int sleep)
 	update_min_vruntime(cfs_rq);
 }
 
+#ifdef CONFIG_CFS_BANDWIDTH
+/*
+ * Take the group entity owning cfs_rq, and any parent it leaves empty, off
+ * the runqueue. The tasks stay queued on cfs_rq until the period timer
+ * puts the group back.
+ */
+static void throttle_cfs_rq(struct cfs_rq *cfs_rq)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	struct sched_entity *se = cfs_rq->tg->se[cpu_of(rq)];
+
+	for_each_sched_entity(se) {
+		struct cfs_rq *qcfs_rq = cfs_rq_of(se);
+
+		if (!se->on_rq)
+			break;
+		dequeue_entity(qcfs_rq, se, 1);
+		if (qcfs_rq->load.weight)
+			break;
+	}
+
+	cfs_rq->throttled = 1;
+	cfs_rq->throttled_timestamp = rq->clock;
+	cfs_rq->nr_throttled++;
+}
+
+static void unthrottle_cfs_rq(struct cfs_rq *cfs_rq)
+{
+	struct rq *rq = rq_of(cfs_rq);
+	struct sched_entity *se = cfs_rq->tg->se[cpu_of(rq)];
+
+	update_rq_clock(rq);
+	cfs_rq->throttled = 0;
+	cfs_rq->throttled_time += rq->clock - cfs_rq->throttled_timestamp;
+
+	if (!cfs_rq->load.weight)
+		return;
+
+	for_each_sched_entity(se) {
+		if (se->on_rq)
+			break;
+		cfs_rq = cfs_rq_of(se);
+		enqueue_entity(cfs_rq, se, 1);
+		if (cfs_rq_throttled(cfs_rq))
+			break;
+	}
+
+	if (rq->curr == rq->idle && rq->cfs.nr_running)
+		resched_task(rq->curr);
+}
+
+static void check_cfs_rq_runtime(struct cfs_rq *cfs_rq)
+{
+	u64 quota = cfs_rq->tg->cfs_bandwidth.quota;
+
+	if (likely(quota == RUNTIME_INF))
+		return;
+
+	if (cfs_rq->runtime_used > quota && !cfs_rq_throttled(cfs_rq))
+		throttle_cfs_rq(cfs_rq);
+}
+
+/*
+ * Refill every cpu's runtime and release what the last period throttled.
+ * Returns 1 once a whole period went by without the group running.
+ */
+static int do_sched_cfs_period_timer(struct task_group *tg)
+{
+	int i, idle = 1;
+
+	for_each_possible_cpu(i) {
+		struct cfs_rq *cfs_rq = tg->cfs_rq[i];
+		struct rq *rq = rq_of(cfs_rq);
+
+		spin_lock(&rq->lock);
+		if (cfs_rq->runtime_used || cfs_rq_throttled(cfs_rq))
+			idle = 0;
+		cfs_rq->runtime_used = 0;
+		if (cfs_rq_throttled(cfs_rq))
+			unthrottle_cfs_rq(cfs_rq);
+		spin_unlock(&rq->lock);
+	}
+
+	return idle;
+}
+
+static enum hrtimer_restart sched_cfs_period_timer(struct hrtimer *timer)
+{
+	struct cfs_bandwidth *cfs_b =
+		container_of(timer, struct cfs_bandwidth, period_timer);
+	struct task_group *tg =
+		container_of(cfs_b, struct task_group, cfs_bandwidth);
+	ktime_t now;
+	int overrun;
+	int idle = 0;
+
+	for (;;) {
+		now = hrtimer_cb_get_time(timer);
+		overrun = hrtimer_forward(timer, now, cfs_b->period);
+
+		if (!overrun)
+			break;
+
+		idle = do_sched_cfs_period_timer(tg);
+	}
+
+	return idle ? HRTIMER_NORESTART : HRTIMER_RESTART;
+}
+
+#define DEFAULT_CFS_PERIOD	(100 * NSEC_PER_MSEC)
+
+static void init_cfs_bandwidth(struct cfs_bandwidth *cfs_b)
+{
+	cfs_b->period = ns_to_ktime(DEFAULT_CFS_PERIOD);
+	cfs_b->quota = RUNTIME_INF;
+
+	spin_lock_init(&cfs_b->lock);
+
+	hrtimer_init(&cfs_b->period_timer,
+			CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	cfs_b->period_timer.function = sched_cfs_period_timer;
+}
+
+static void destroy_cfs_bandwidth(struct cfs_bandwidth *cfs_b)
+{
+	hrtimer_cancel(&cfs_b->period_timer);
+}
+#else
+static inline void check_cfs_rq_runtime(struct cfs_rq *cfs_rq)
+{
+}
+#endif
+
 /*
  * Preempt the current task with a newly woken task if needed:
  */
@@ -909,6 +1111,9 @@ static void put_prev_entity(struct cfs_rq *cfs_rq, struct sched_entity *prev)
 	if (prev->on_rq)
 		update_curr(cfs_rq);
 
+	/* over its cap: leave prev queued on cfs_rq, but cfs_rq unqueued */
+	check_cfs_rq_runtime(cfs_rq);
+
 	check_spread(cfs_rq, prev);
 	if (prev->on_rq) {
 		update_stats_wait_start(cfs_rq, prev);
@@ -1007,6 +1212,43 @@ static inline void hrtick_update(struct rq *rq)
 }
 #endif
 
+#ifdef CONFIG_CPU_FREQ
+static sched_load_hook_t sched_load_hook;
+
+/*
+ * Only one governor drives the hook at a time; a second caller gets
+ * -EBUSY and keeps sampling on its own.
+ */
+int sched_register_load_hook(sched_load_hook_t hook)
+{
+	if (cmpxchg(&sched_load_hook, NULL, hook))
+		return -EBUSY;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sched_register_load_hook);
+
+void sched_unregister_load_hook(sched_load_hook_t hook)
+{
+	if (cmpxchg(&sched_load_hook, hook, NULL) != hook)
+		return;
+	/* callers run under the rq lock, with preemption off */
+	synchronize_sched();
+}
+EXPORT_SYMBOL_GPL(sched_unregister_load_hook);
+
+static inline void cfs_rq_load_changed(struct rq *rq)
+{
+	sched_load_hook_t hook = ACCESS_ONCE(sched_load_hook);
+
+	if (hook)
+		hook(cpu_of(rq), rq->cfs.nr_running, rq->cfs.load.weight);
+}
+#else
+static inline void cfs_rq_load_changed(struct rq *rq)
+{
+}
+#endif
+
 /*
  * The enqueue_task method is called before nr_running is
  * increased. Here we update the fair scheduling stats and
@@ -1023,10 +1265,14 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int wakeup, bool head)
 			break;
 		cfs_rq = cfs_rq_of(se);
 		enqueue_entity(cfs_rq, se, wakeup);
+		/* a throttled group is queued again by its period timer */
+		if (cfs_rq_throttled(cfs_rq))
+			break;
 		wakeup = 1;
 	}
 
 	hrtick_update(rq);
+	cfs_rq_load_changed(rq);
 }
 
 /*
@@ -1045,10 +1291,14 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int sleep)
 		/* Don't dequeue parent if it has other entities besides us */
 		if (cfs_rq->load.weight)
 			break;
+		/* its group entity is already off the runqueue */
+		if (cfs_rq_throttled(cfs_rq))
+			break;
 		sleep = 1;
 	}
 
 	hrtick_update(rq);
+	cfs_rq_load_changed(rq);
 }
 
 /*
@@ -1644,6 +1894,56 @@ wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se)
 	return 0;
 }
 
+/* is se queued below a group that is over its bandwidth cap */
+static inline int throttled_hierarchy(struct sched_entity *se)
+{
+	for_each_sched_entity(se) {
+		if (cfs_rq_throttled(cfs_rq_of(se)))
+			return 1;
+	}
+	return 0;
+}
+
+#ifdef CONFIG_FAIR_GROUP_SCHED
+static inline u64 task_wakeup_latency(struct task_struct *p)
+{
+	return task_group(p)->wakeup_latency;
+}
+#else
+static inline u64 task_wakeup_latency(struct task_struct *p)
+{
+	return 0;
+}
+#endif
+
+/*
+ * A group's wakeup latency bounds how long curr may keep one of the
+ * group's waking tasks off the cpu, when curr's own group has a looser
+ * target or none. Once curr ran that long, preempt whatever the
+ * vruntimes say; before that, arm the hrtick (when in use) to end the
+ * wait on time.
+ */
+static int wakeup_latency_preempt(struct rq *rq, struct task_struct *curr,
+				  struct task_struct *p)
+{
+	u64 target = task_wakeup_latency(p);
+	u64 curr_target = task_wakeup_latency(curr);
+	u64 ran;
+
+	if (!target || (curr_target && curr_target <= target))
+		return 0;
+
+	ran = curr->se.sum_exec_runtime - curr->se.prev_sum_exec_runtime;
+	if (ran >= target)
+		return 1;
+
+#ifdef CONFIG_SCHED_HRTICK
+	if (hrtick_enabled(rq))
+		hrtick_start(rq, target - ran);
+#endif
+	return 0;
+}
+
 static void set_last_buddy(struct sched_entity *se)
 {
 	if (likely(task_of(se)->policy != SCHED_IDLE)) {
@@ -1684,6 +1984,10 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int wake_
 	if (unlikely(se == pse))
 		return;
 
+	/* nothing to preempt for until the period timer requeues it */
+	if (unlikely(throttled_hierarchy(pse)))
+		return;
+
 	if (sched_feat(NEXT_BUDDY) && scale && !(wake_flags & WF_FORK))
 		set_next_buddy(pse);
 
@@ -1723,6 +2027,13 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int wake_
 		}
 	}
 
+	if (wakeup_latency_preempt(rq, curr, p)) {
+		schedstat_inc(cfs_rq_of(pse), nr_latency_preempt);
+		set_next_buddy(pse);
+		resched_task(curr);
+		return;
+	}
+
 	if (!sched_feat(WAKEUP_PREEMPT))
 		return;
 
@@ -1950,6 +2261,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	cfs_rq_load_changed(rq);
 }
 
 /*
@@ -104,6 +104,138 @@ static int __init proc_schedstat_init(void)
 }
 module_init(proc_schedstat_init);
 
+static inline void
+sched_latency_account(struct task_struct *t, unsigned long long delta)
+{
+	struct sched_latency_hist *h = t->sched_info.latency_hist;
+	int i;
+
+	if (likely(!h) || !h->enabled)
+		return;
+
+	if (h->preempted) {
+		h->preempted = 0;
+		h->preempt_count++;
+		return;
+	}
+
+	i = fls64(delta >> 10);
+	if (i >= SCHED_LATENCY_BUCKETS)
+		i = SCHED_LATENCY_BUCKETS - 1;
+	h->buckets[i]++;
+	h->count++;
+	h->sum += delta;
+	if (delta > h->max)
+		h->max = delta;
+}
+
+static inline void sched_latency_preempted(struct task_struct *t)
+{
+	struct sched_latency_hist *h = t->sched_info.latency_hist;
+
+	if (unlikely(h))
+		h->preempted = 1;
+}
+
+static unsigned long long sched_latency_bound_us(int i)
+{
+	unsigned long long ns = 1024ULL << i;
+
+	do_div(ns, NSEC_PER_USEC);
+	return ns;
+}
+
+/* upper bound of the bucket holding the given fraction of waits */
+static unsigned long long
+sched_latency_percentile(struct sched_latency_hist *h, unsigned int pct)
+{
+	unsigned long long want = (unsigned long long)h->count * pct;
+	unsigned long long seen = 0;
+	int i;
+
+	for (i = 0; i < SCHED_LATENCY_BUCKETS - 1; i++) {
+		seen += (unsigned long long)h->buckets[i] * 100;
+		if (seen >= want)
+			break;
+	}
+	return sched_latency_bound_us(i);
+}
+
+void proc_sched_latency_show(struct task_struct *p, struct seq_file *m)
+{
+	struct sched_latency_hist h;
+	unsigned long long avg;
+	unsigned long flags;
+	struct rq *rq;
+	int i;
+
+	rq = task_rq_lock(p, &flags);
+	if (p->sched_info.latency_hist)
+		h = *p->sched_info.latency_hist;
+	else
+		memset(&h, 0, sizeof(h));
+	task_rq_unlock(rq, &flags);
+
+	avg = h.sum;
+	if (h.count)
+		do_div(avg, h.count);
+	do_div(avg, NSEC_PER_USEC);
+	do_div(h.max, NSEC_PER_USEC);
+
+	seq_printf(m, "enabled %d\n", h.enabled);
+	seq_printf(m, "wakeups %lu\n", h.count);
+	seq_printf(m, "preempted %lu\n", h.preempt_count);
+	seq_printf(m, "avg_us %llu\n", avg);
+	seq_printf(m, "max_us %llu\n", h.max);
+	if (h.count) {
+		seq_printf(m, "p50_us <%llu\n",
+			   sched_latency_percentile(&h, 50));
+		seq_printf(m, "p90_us <%llu\n",
+			   sched_latency_percentile(&h, 90));
+		seq_printf(m, "p99_us <%llu\n",
+			   sched_latency_percentile(&h, 99));
+	}
+	for (i = 0; i < SCHED_LATENCY_BUCKETS - 1; i++)
+		seq_printf(m, "<%llu %u\n", sched_latency_bound_us(i),
+			   h.buckets[i]);
+	seq_printf(m, ">=%llu %u\n", sched_latency_bound_us(i - 1),
+		   h.buckets[i]);
+}
+
+/* start (again, from zero) or stop collecting p's histogram */
+int proc_sched_latency_set(struct task_struct *p, int enable)
+{
+	struct sched_latency_hist *new = NULL;
+	unsigned long flags;
+	struct rq *rq;
+
+	if (enable && !p->sched_info.latency_hist) {
+		new = kzalloc(sizeof(*new), GFP_KERNEL);
+		if (!new)
+			return -ENOMEM;
+	}
+
+	rq = task_rq_lock(p, &flags);
+	if (!p->sched_info.latency_hist) {
+		p->sched_info.latency_hist = new;
+		new = NULL;
+	} else if (enable) {
+		memset(p->sched_info.latency_hist, 0,
+		       sizeof(*p->sched_info.latency_hist));
+	}
+	if (p->sched_info.latency_hist)
+		p->sched_info.latency_hist->enabled = !!enable;
+	task_rq_unlock(rq, &flags);
+
+	kfree(new);
+	return 0;
+}
+
+void sched_latency_free(struct task_struct *p)
+{
+	kfree(p->sched_info.latency_hist);
+}
+
 /*
  * Expects runqueue lock to be held for atomicity of update
  */
@@ -148,6 +280,8 @@ rq_sched_info_depart(struct rq *rq, unsigned long long delta)
 # define schedstat_inc(rq, field)	do { } while (0)
 # define schedstat_add(rq, field, amt)	do { } while (0)
 # define schedstat_set(var, val)	do { } while (0)
+# define sched_latency_account(t, delta)	do { } while (0)
+# define sched_latency_preempted(t)		do { } while (0)
 #endif
 
 #if defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT)
@@ -192,8 +326,10 @@ static void sched_info_arrive(struct task_struct *t)
 {
 	unsigned long long now = task_rq(t)->clock, delta = 0;
 
-	if (t->sched_info.last_queued)
+	if (t->sched_info.last_queued) {
 		delta = now - t->sched_info.last_queued;
+		sched_latency_account(t, delta);
+	}
 	sched_info_reset_dequeued(t);
 	t->sched_info.run_delay += delta;
 	t->sched_info.last_arrival = now;
@@ -238,8 +374,10 @@ static inline void sched_info_depart(struct task_struct *t)
 
 	rq_sched_info_depart(task_rq(t), delta);
 
-	if (t->state == TASK_RUNNING)
+	if (t->state == TASK_RUNNING) {
 		sched_info_queued(t);
+		sched_latency_preempted(t);
+	}
 }
 
 /*
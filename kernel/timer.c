@@ -39,6 +39,8 @@
 #include <linux/kallsyms.h>
 #include <linux/perf_event.h>
 #include <linux/sched.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/uaccess.h>
 #include <asm/unistd.h>
@@ -81,6 +83,9 @@ struct tvec_base {
 	struct tvec tv3;
 	struct tvec tv4;
 	struct tvec tv5;
+	/* timers run with slack, and those that shared their jiffy */
+	unsigned long slack_expired;
+	unsigned long slack_coalesced;
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -549,6 +554,7 @@ static void __init_timer(struct timer_list *timer,
 {
 	timer->entry.next = NULL;
 	timer->base = __raw_get_cpu_var(tvec_bases);
+	timer->slack = 0;
 #ifdef CONFIG_TIMER_STATS
 	timer->start_site = NULL;
 	timer->start_pid = -1;
@@ -716,6 +722,52 @@ int mod_timer_pending(struct timer_list *timer, unsigned long expires)
 }
 EXPORT_SYMBOL(mod_timer_pending);
 
+/*
+ * Timer slack lets a timer fire up to slack jiffies late so that it lands
+ * on the same jiffy as its neighbours and the cpu wakes once for all of
+ * them. The expiry is moved to the coarsest power of two boundary inside
+ * the window, which timers with overlapping windows agree on. Deferrable
+ * timers that are far enough out get a slack of 1/16 of their timeout.
+ */
+#define TIMER_AUTO_SLACK_SHIFT	4
+
+static unsigned long apply_slack(struct timer_list *timer,
+				 unsigned long expires)
+{
+	unsigned long expires_limit, mask;
+	long slack = timer->slack;
+	int bit;
+
+	if (!slack && tbase_get_deferrable(timer->base))
+		slack = (long)(expires - jiffies) >> TIMER_AUTO_SLACK_SHIFT;
+	if (slack <= 0)
+		return expires;
+
+	expires_limit = expires + slack;
+	mask = expires ^ expires_limit;
+	if (mask == 0)
+		return expires;
+
+	bit = find_last_bit(&mask, BITS_PER_LONG);
+	mask = (1UL << bit) - 1;
+	return expires_limit & ~mask;
+}
+
+/**
+ * set_timer_slack - set the allowed slack for a timer
+ * @timer: the timer to be modified
+ * @slack_hz: the amount of time (in jiffies) allowed for rounding
+ *
+ * mod_timer() may delay @timer by up to @slack_hz jiffies to batch it
+ * with other timers. 0, the default, leaves ordinary timers exact and
+ * gives deferrable timers an automatic slack.
+ */
+void set_timer_slack(struct timer_list *timer, int slack_hz)
+{
+	timer->slack = slack_hz;
+}
+EXPORT_SYMBOL_GPL(set_timer_slack);
+
 /**
  * mod_timer - modify a timer's timeout
  * @timer: the timer to be modified
@@ -743,6 +795,7 @@ int mod_timer(struct timer_list *timer, unsigned long expires)
 	 * networking code - if the timer is re-modified
 	 * to be the same thing then just return:
 	 */
+	expires = apply_slack(timer, expires);
 	if (timer_pending(timer) && timer->expires == expires)
 		return 1;
 
@@ -973,6 +1026,7 @@ static inline void __run_timers(struct tvec_base *base)
 		struct list_head work_list;
 		struct list_head *head = &work_list;
 		int index = base->timer_jiffies & TVR_MASK;
+		int fired = 0, slacked = 0;
 
 		/*
 		 * Cascade timers:
@@ -991,6 +1045,9 @@ static inline void __run_timers(struct tvec_base *base)
 			timer = list_first_entry(head, struct timer_list,entry);
 			fn = timer->function;
 			data = timer->data;
+			fired++;
+			if (timer->slack || tbase_get_deferrable(timer->base))
+				slacked++;
 
 			timer_stats_account_timer(timer);
 
@@ -1039,6 +1096,9 @@ static inline void __run_timers(struct tvec_base *base)
 			}
 			spin_lock_irq(&base->lock);
 		}
+		base->slack_expired += slacked;
+		if (fired > 1)
+			base->slack_coalesced += min(slacked, fired - 1);
 	}
 	set_running_timer(base, NULL);
 	spin_unlock_irq(&base->lock);
@@ -1650,6 +1710,44 @@ static struct notifier_block __cpuinitdata timers_nb = {
 };
 
 
+#ifdef CONFIG_DEBUG_FS
+/* wakeups saved by slack: slack timers that ran in a jiffy that already
+ * had another timer to run */
+static int timer_slack_show(struct seq_file *m, void *unused)
+{
+	struct tvec_base *base;
+	int cpu;
+
+	seq_printf(m, "cpu\tslack_expired\tcoalesced\n");
+	for_each_online_cpu(cpu) {
+		base = per_cpu(tvec_bases, cpu);
+		seq_printf(m, "%d\t%lu\t%lu\n", cpu, base->slack_expired,
+			   base->slack_coalesced);
+	}
+	return 0;
+}
+
+static int timer_slack_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, timer_slack_show, NULL);
+}
+
+static const struct file_operations timer_slack_fops = {
+	.open = timer_slack_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init timer_slack_debugfs_init(void)
+{
+	debugfs_create_file("timer_slack", S_IRUGO, NULL, NULL,
+			    &timer_slack_fops);
+	return 0;
+}
+late_initcall(timer_slack_debugfs_init);
+#endif
+
 void __init init_timers(void)
 {
 	int err = timer_cpu_notify(&timers_nb, (unsigned long)CPU_UP_PREPARE,
@@ -33,6 +33,9 @@
 #include <linux/kallsyms.h>
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <asm/div64.h>
 #define CREATE_TRACE_POINTS
 #include <trace/events/workqueue.h>
 
@@ -50,6 +53,15 @@ struct cpu_workqueue_struct {
 
 	struct workqueue_struct *wq;
 	struct task_struct *thread;
+
+#ifdef CONFIG_WORKQUEUE_STATS
+	/* under lock, times in ns */
+	unsigned long executed;
+	u64 lat_total;
+	u64 lat_max;
+	u64 exec_total;
+	u64 exec_max;
+#endif
 } ____cacheline_aligned;
 
 /*
@@ -66,12 +78,20 @@ struct workqueue_struct {
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
+#ifdef CONFIG_WORKQUEUE_STATS
+	struct list_head stats_list;
+#endif
 };
 
 /* Serializes the accesses to the list of workqueues. */
 static DEFINE_SPINLOCK(workqueue_lock);
 static LIST_HEAD(workqueues);
 
+#ifdef CONFIG_WORKQUEUE_STATS
+/* every workqueue, singlethreaded ones included, under workqueue_lock */
+static LIST_HEAD(workqueue_stats);
+#endif
+
 static int singlethread_cpu __read_mostly;
 static const struct cpumask *cpu_singlethread_map __read_mostly;
 /*
@@ -131,6 +151,9 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 	trace_workqueue_insertion(cwq->thread, work);
 
 	set_wq_data(work, cwq);
+#ifdef CONFIG_WORKQUEUE_STATS
+	work->queued_at = sched_clock();
+#endif
 	/*
 	 * Ensure that we get the right work->data if we see the
 	 * result of list_add() below, see try_to_grab_pending().
@@ -261,6 +284,23 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 }
 EXPORT_SYMBOL_GPL(queue_delayed_work_on);
 
+#ifdef CONFIG_WORKQUEUE_STATS
+static void account_work(struct cpu_workqueue_struct *cwq, u64 queued_at,
+			 u64 start, u64 end)
+{
+	u64 lat = start - queued_at;
+	u64 exec = end - start;
+
+	cwq->executed++;
+	cwq->lat_total += lat;
+	if (lat > cwq->lat_max)
+		cwq->lat_max = lat;
+	cwq->exec_total += exec;
+	if (exec > cwq->exec_max)
+		cwq->exec_max = exec;
+}
+#endif
+
 static void run_workqueue(struct cpu_workqueue_struct *cwq)
 {
 	spin_lock_irq(&cwq->lock);
@@ -268,6 +308,11 @@ static void run_workqueue(struct cpu_workqueue_struct *cwq)
 		struct work_struct *work = list_entry(cwq->worklist.next,
 						struct work_struct, entry);
 		work_func_t f = work->func;
+#ifdef CONFIG_WORKQUEUE_STATS
+		/* the work may be freed by f, so keep what we need of it */
+		u64 queued_at = work->queued_at;
+		u64 start = sched_clock();
+#endif
 #ifdef CONFIG_LOCKDEP
 		/*
 		 * It is permissible to free the struct work_struct
@@ -304,6 +349,9 @@ static void run_workqueue(struct cpu_workqueue_struct *cwq)
 		}
 
 		spin_lock_irq(&cwq->lock);
+#ifdef CONFIG_WORKQUEUE_STATS
+		account_work(cwq, queued_at, start, sched_clock());
+#endif
 		cwq->current_work = NULL;
 	}
 	spin_unlock_irq(&cwq->lock);
@@ -804,8 +852,10 @@ static int create_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
 	 */
 	if (IS_ERR(p))
 		return PTR_ERR(p);
-	if (cwq->wq->rt)
+	if (cwq->wq->rt == WQ_PRIO_RT)
 		sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
+	else if (cwq->wq->rt == WQ_PRIO_HIGH)
+		set_user_nice(p, -20);
 	cwq->thread = p;
 
 	trace_workqueue_creation(cwq->thread, cpu);
@@ -851,6 +901,11 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 	wq->freezeable = freezeable;
 	wq->rt = rt;
 	INIT_LIST_HEAD(&wq->list);
+#ifdef CONFIG_WORKQUEUE_STATS
+	spin_lock(&workqueue_lock);
+	list_add_tail(&wq->stats_list, &workqueue_stats);
+	spin_unlock(&workqueue_lock);
+#endif
 
 	if (singlethread) {
 		cwq = init_cpu_workqueue(wq, singlethread_cpu);
@@ -933,6 +988,9 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	cpu_maps_update_begin();
 	spin_lock(&workqueue_lock);
 	list_del(&wq->list);
+#ifdef CONFIG_WORKQUEUE_STATS
+	list_del(&wq->stats_list);
+#endif
 	spin_unlock(&workqueue_lock);
 
 	for_each_cpu(cpu, cpu_map)
@@ -1041,6 +1099,78 @@ long work_on_cpu(unsigned int cpu, long (*fn)(void *), void *arg)
 EXPORT_SYMBOL_GPL(work_on_cpu);
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_WORKQUEUE_STATS
+static u64 wq_stat_avg_us(u64 total, unsigned long n)
+{
+	if (!n)
+		return 0;
+	do_div(total, n);
+	do_div(total, NSEC_PER_USEC);
+	return total;
+}
+
+static int workqueue_stats_show(struct seq_file *m, void *unused)
+{
+	struct workqueue_struct *wq;
+	struct cpu_workqueue_struct *cwq;
+	unsigned long executed;
+	u64 lat_total, lat_max, exec_total, exec_max;
+	int cpu;
+
+	seq_printf(m, "%-16s %3s %10s %10s %10s %10s %10s\n", "name", "cpu",
+		   "executed", "lat_avg", "lat_max", "exec_avg", "exec_max");
+
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &workqueue_stats, stats_list) {
+		for_each_cpu(cpu, wq_cpu_map(wq)) {
+			cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+			if (!cwq->thread)
+				continue;
+			spin_lock_irq(&cwq->lock);
+			executed = cwq->executed;
+			lat_total = cwq->lat_total;
+			lat_max = cwq->lat_max;
+			exec_total = cwq->exec_total;
+			exec_max = cwq->exec_max;
+			spin_unlock_irq(&cwq->lock);
+
+			do_div(lat_max, NSEC_PER_USEC);
+			do_div(exec_max, NSEC_PER_USEC);
+			seq_printf(m, "%-16s %3d %10lu %10llu %10llu %10llu "
+				   "%10llu\n", wq->name, cpu, executed,
+				   (unsigned long long)
+				   wq_stat_avg_us(lat_total, executed),
+				   (unsigned long long)lat_max,
+				   (unsigned long long)
+				   wq_stat_avg_us(exec_total, executed),
+				   (unsigned long long)exec_max);
+		}
+	}
+	spin_unlock(&workqueue_lock);
+	return 0;
+}
+
+static int workqueue_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, workqueue_stats_show, NULL);
+}
+
+static const struct file_operations workqueue_stats_fops = {
+	.open		= workqueue_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init workqueue_stats_init(void)
+{
+	debugfs_create_file("workqueue_stats", S_IRUGO, NULL, NULL,
+			    &workqueue_stats_fops);
+	return 0;
+}
+late_initcall(workqueue_stats_init);
+#endif
+
 void __init init_workqueues(void)
 {
 	alloc_cpumask_var(&cpu_populated_map, GFP_KERNEL);
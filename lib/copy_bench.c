@@ -0,0 +1,184 @@
+/*
+ * lib/copy_bench.c
+ *
+ * Memory copy bandwidth benchmark. Loading the module times memcpy() at
+ * a range of sizes and alignments, copy_page(), and copy_to_user() /
+ * copy_from_user() on kernel buffers, prints MB/s for each and then fails
+ * with -EAGAIN so that it does not stay loaded.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+#include <linux/uaccess.h>
+
+/* bytes moved per measurement */
+static unsigned int total_kb = 16384;
+module_param(total_kb, uint, 0);
+MODULE_PARM_DESC(total_kb, "KB copied per measurement");
+
+/* each of the source and destination buffers */
+#define COPY_BENCH_ORDER	8
+#define COPY_BENCH_BUF		(PAGE_SIZE << COPY_BENCH_ORDER)
+#define COPY_BENCH_PAGES	(1 << COPY_BENCH_ORDER)
+
+static const size_t copy_bench_sizes[] = {
+	64, 256, 1024, 4096, 16384, 65536, 1024 * 1024,
+};
+
+static u32 copy_bench_mbps(u64 bytes, s64 ns)
+{
+	if (ns <= 0)
+		return 0;
+	/* bytes per microsecond is MB/s */
+	return div64_u64(bytes * 1000, ns);
+}
+
+enum copy_bench_op {
+	COPY_MEMCPY,
+	COPY_TO_USER,
+	COPY_FROM_USER,
+};
+
+static const char * const copy_bench_names[] = {
+	[COPY_MEMCPY]		= "memcpy",
+	[COPY_TO_USER]		= "copy_to_user",
+	[COPY_FROM_USER]	= "copy_from_user",
+};
+
+static s64 copy_bench_run(enum copy_bench_op op, char *dst, const char *src,
+			  size_t size, u64 *bytes)
+{
+	u64 total = (u64)total_kb * 1024;
+	unsigned long loops, i;
+	mm_segment_t old_fs;
+	ktime_t start;
+
+	loops = max_t(u64, div64_u64(total, size), 1);
+	*bytes = (u64)loops * size;
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		switch (op) {
+		case COPY_MEMCPY:
+			memcpy(dst, src, size);
+			break;
+		case COPY_TO_USER:
+			if (copy_to_user((void __user *)dst, src, size))
+				goto fault;
+			break;
+		case COPY_FROM_USER:
+			if (copy_from_user(dst, (const void __user *)src,
+					   size))
+				goto fault;
+			break;
+		}
+		if (!(i & 255))
+			cond_resched();
+	}
+	set_fs(old_fs);
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+
+fault:
+	set_fs(old_fs);
+	return -EFAULT;
+}
+
+static int __init copy_bench_init(void)
+{
+	char *src, *dst;
+	u64 bytes;
+	s64 ns;
+	unsigned long i, loops;
+	ktime_t start;
+	int op, s, ret = 0;
+
+	if (!total_kb)
+		return -EINVAL;
+
+	src = (char *)__get_free_pages(GFP_KERNEL, COPY_BENCH_ORDER);
+	dst = (char *)__get_free_pages(GFP_KERNEL, COPY_BENCH_ORDER);
+	if (!src || !dst) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	memset(src, 0x5a, COPY_BENCH_BUF);
+	memset(dst, 0, COPY_BENCH_BUF);
+
+	pr_info("copy_bench: %u KB per size, MB/s aligned/unaligned\n",
+		total_kb);
+	for (op = 0; op < ARRAY_SIZE(copy_bench_names); op++) {
+		for (s = 0; s < ARRAY_SIZE(copy_bench_sizes); s++) {
+			size_t size = copy_bench_sizes[s];
+			u32 aligned, unaligned;
+			u64 ub;
+
+			/* leave room for the unaligned run */
+			if (size + 8 > COPY_BENCH_BUF)
+				size = COPY_BENCH_BUF - 8;
+
+			ns = copy_bench_run(op, dst, src, size, &bytes);
+			if (ns < 0) {
+				ret = ns;
+				goto fail;
+			}
+			aligned = copy_bench_mbps(bytes, ns);
+
+			ns = copy_bench_run(op, dst + 1, src + 3, size, &ub);
+			if (ns < 0) {
+				ret = ns;
+				goto fail;
+			}
+			unaligned = copy_bench_mbps(ub, ns);
+
+			pr_info("copy_bench: %-14s %7zu: %5u %5u\n",
+				copy_bench_names[op], size, aligned,
+				unaligned);
+		}
+	}
+
+	loops = div64_u64((u64)total_kb * 1024, PAGE_SIZE) ? : 1;
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		copy_page(dst + (i % COPY_BENCH_PAGES) * PAGE_SIZE,
+			  src + (i % COPY_BENCH_PAGES) * PAGE_SIZE);
+		if (!(i & 255))
+			cond_resched();
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	pr_info("copy_bench: %-14s %7lu: %5u\n", "copy_page", PAGE_SIZE,
+		copy_bench_mbps((u64)loops * PAGE_SIZE, ns));
+
+	if (memcmp(dst, src, COPY_BENCH_BUF)) {
+		pr_err("copy_bench: copied data does not match\n");
+		ret = -EINVAL;
+		goto out;
+	}
+	ret = -EAGAIN;
+	goto out;
+
+fail:
+	pr_err("copy_bench: %s faulted\n", copy_bench_names[op]);
+out:
+	if (src)
+		free_pages((unsigned long)src, COPY_BENCH_ORDER);
+	if (dst)
+		free_pages((unsigned long)dst, COPY_BENCH_ORDER);
+	return ret;
+}
+
+module_init(copy_bench_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Memory copy bandwidth benchmark");
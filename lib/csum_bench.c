@@ -0,0 +1,191 @@
+/*
+ * lib/csum_bench.c
+ *
+ * Checksum test and benchmark. Loading the module checks csum_partial()
+ * and csum_partial_copy_from_user() against a plain C reference over a
+ * range of lengths and alignments, then prints MB/s for both at several
+ * buffer sizes. It fails with -EAGAIN afterwards so that it does not
+ * stay loaded.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+#include <linux/uaccess.h>
+#include <net/checksum.h>
+
+static unsigned int total_kb = 16384;
+module_param(total_kb, uint, 0);
+MODULE_PARM_DESC(total_kb, "KB checksummed per measurement");
+
+#define CSUM_BENCH_ORDER	4
+#define CSUM_BENCH_BUF		(PAGE_SIZE << CSUM_BENCH_ORDER)
+
+static const int csum_bench_sizes[] = {
+	64, 256, 576, 1500, 4096, 16384, 65000 - 8,
+};
+
+static u32 csum_bench_seed = 0x6d2b79f5;
+
+static u32 csum_bench_rand(void)
+{
+	csum_bench_seed = csum_bench_seed * 1103515245 + 12345;
+	return csum_bench_seed >> 8;
+}
+
+/* RFC 1071, byte by byte, independent of the arch code */
+static u16 csum_bench_ref(const u8 *p, int len, u32 sum)
+{
+	u64 acc = sum;
+	int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+#ifdef __BIG_ENDIAN
+		acc += (p[i] << 8) | p[i + 1];
+#else
+		acc += p[i] | (p[i + 1] << 8);
+#endif
+	if (len & 1)
+#ifdef __BIG_ENDIAN
+		acc += p[len - 1] << 8;
+#else
+		acc += p[len - 1];
+#endif
+	while (acc >> 16)
+		acc = (acc & 0xffff) + (acc >> 16);
+	return ~acc & 0xffff;
+}
+
+static int csum_bench_check(u8 *src, u8 *dst)
+{
+	mm_segment_t old_fs;
+	int i, off, len, err;
+	u32 sum;
+	u16 ref;
+
+	for (i = 0; i < 2000; i++) {
+		off = csum_bench_rand() & 7;
+		len = i < 1000 ? i : csum_bench_rand() %
+			(CSUM_BENCH_BUF - 8);
+		sum = csum_bench_rand();
+		ref = csum_bench_ref(src + off, len, sum);
+
+		if ((__force u16)csum_fold(csum_partial(src + off, len,
+				(__force __wsum)sum)) != ref) {
+			pr_err("csum_bench: csum_partial off %d len %d\n",
+			       off, len);
+			return -EINVAL;
+		}
+
+		err = 0;
+		old_fs = get_fs();
+		set_fs(KERNEL_DS);
+		sum = (__force u32)csum_partial_copy_from_user(
+			(const void __user *)(src + off), dst + (i & 3), len,
+			(__force __wsum)sum, &err);
+		set_fs(old_fs);
+		if (err || (__force u16)csum_fold((__force __wsum)sum) != ref ||
+		    memcmp(src + off, dst + (i & 3), len)) {
+			pr_err("csum_bench: csum_partial_copy_from_user "
+			       "off %d len %d\n", off, len);
+			return -EINVAL;
+		}
+		if (!(i & 63))
+			cond_resched();
+	}
+	return 0;
+}
+
+static u32 csum_bench_mbps(u64 bytes, s64 ns)
+{
+	if (ns <= 0)
+		return 0;
+	/* bytes per microsecond is MB/s */
+	return div64_u64(bytes * 1000, ns);
+}
+
+static void csum_bench_time(u8 *src, u8 *dst, int size)
+{
+	u64 bytes = (u64)total_kb * 1024;
+	unsigned long loops, i;
+	mm_segment_t old_fs;
+	__wsum sum = 0;
+	ktime_t start;
+	s64 plain, copy;
+	int err = 0;
+
+	loops = max_t(u64, div64_u64(bytes, size), 1);
+	bytes = (u64)loops * size;
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		sum = csum_partial(src, size, sum);
+		if (!(i & 255))
+			cond_resched();
+	}
+	plain = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		sum = csum_partial_copy_from_user((const void __user *)src,
+						  dst, size, sum, &err);
+		if (!(i & 255))
+			cond_resched();
+	}
+	copy = ktime_to_ns(ktime_sub(ktime_get(), start));
+	set_fs(old_fs);
+
+	pr_info("csum_bench: %6d: csum_partial %5u MB/s, "
+		"copy_from_user %5u MB/s (%04x)\n", size,
+		csum_bench_mbps(bytes, plain), csum_bench_mbps(bytes, copy),
+		(__force u16)csum_fold(sum));
+}
+
+static int __init csum_bench_init(void)
+{
+	u8 *src, *dst;
+	int i, ret;
+
+	if (!total_kb)
+		return -EINVAL;
+
+	src = (u8 *)__get_free_pages(GFP_KERNEL, CSUM_BENCH_ORDER);
+	dst = (u8 *)__get_free_pages(GFP_KERNEL, CSUM_BENCH_ORDER);
+	if (!src || !dst) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < CSUM_BENCH_BUF; i++)
+		src[i] = csum_bench_rand();
+
+	ret = csum_bench_check(src, dst);
+	if (ret)
+		goto out;
+	pr_info("csum_bench: results match the reference\n");
+
+	for (i = 0; i < ARRAY_SIZE(csum_bench_sizes); i++)
+		csum_bench_time(src, dst, csum_bench_sizes[i]);
+	ret = -EAGAIN;
+out:
+	if (src)
+		free_pages((unsigned long)src, CSUM_BENCH_ORDER);
+	if (dst)
+		free_pages((unsigned long)dst, CSUM_BENCH_ORDER);
+	return ret;
+}
+
+module_init(csum_bench_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Checksum test and benchmark");
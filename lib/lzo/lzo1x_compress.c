@@ -17,9 +17,12 @@
 #include <asm/unaligned.h>
 #include "lzodefs.h"
 
-static noinline size_t
-_lzo1x_1_do_compress(const unsigned char *in, size_t in_len,
-		unsigned char *out, size_t *out_len, void *wrkmem)
+static int lzo_fast_copy __read_mostly;
+
+static __always_inline size_t
+__lzo1x_1_do_compress(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len, void *wrkmem,
+		const int fast)
 {
 	const unsigned char * const in_end = in + in_len;
 	const unsigned char * const ip_end = in + in_len - M2_MAX_LEN - 5;
@@ -61,7 +64,10 @@ _lzo1x_1_do_compress(const unsigned char *in, size_t in_len,
 		goto literal;
 
 try_match:
-		if (get_unaligned((const unsigned short *)m_pos)
+		if (fast) {
+			if (((lzo_load32(m_pos) ^ lzo_load32(ip)) & 0xffffff) == 0)
+				goto match;
+		} else if (get_unaligned((const unsigned short *)m_pos)
 				== get_unaligned((const unsigned short *)ip)) {
 			if (likely(m_pos[2] == ip[2]))
 					goto match;
@@ -93,10 +99,21 @@ match:
 				}
 				*op++ = tt;
 			}
+			if (fast) {
+				while (t >= 4) {
+					LZO_COPY4(1, op, ii);
+					op += 4;
+					ii += 4;
+					t -= 4;
+				}
+				if (!t)
+					goto literal_done;
+			}
 			do {
 				*op++ = *ii++;
 			} while (--t > 0);
 		}
+literal_done:
 
 		ip += 3;
 		if (m_pos[3] != *ip++ || m_pos[4] != *ip++
@@ -125,6 +142,13 @@ match:
 			end = in_end;
 			m = m_pos + M2_MAX_LEN + 1;
 
+			if (fast) {
+				while (end - ip >= 4 &&
+				       lzo_load32(m) == lzo_load32(ip)) {
+					m += 4;
+					ip += 4;
+				}
+			}
 			while (ip < end && *m == *ip) {
 				m++;
 				ip++;
@@ -173,8 +197,25 @@ m3_m4_offset:
 	return in_end - ii;
 }
 
-int lzo1x_1_compress(const unsigned char *in, size_t in_len, unsigned char *out,
-			size_t *out_len, void *wrkmem)
+static noinline size_t
+_lzo1x_1_do_compress(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len, void *wrkmem)
+{
+	return __lzo1x_1_do_compress(in, in_len, out, out_len, wrkmem, 0);
+}
+
+#ifdef LZO_HAVE_FAST_UNALIGNED
+static noinline size_t
+_lzo1x_1_do_compress_fast(const unsigned char *in, size_t in_len,
+		unsigned char *out, size_t *out_len, void *wrkmem)
+{
+	return __lzo1x_1_do_compress(in, in_len, out, out_len, wrkmem, 1);
+}
+#endif
+
+static __always_inline int
+__lzo1x_1_compress(const unsigned char *in, size_t in_len, unsigned char *out,
+			size_t *out_len, void *wrkmem, const int fast)
 {
 	const unsigned char *ii;
 	unsigned char *op = out;
@@ -183,7 +224,14 @@ int lzo1x_1_compress(const unsigned char *in, size_t in_len, unsigned char *out,
 	if (unlikely(in_len <= M2_MAX_LEN + 5)) {
 		t = in_len;
 	} else {
-		t = _lzo1x_1_do_compress(in, in_len, op, out_len, wrkmem);
+#ifdef LZO_HAVE_FAST_UNALIGNED
+		if (fast)
+			t = _lzo1x_1_do_compress_fast(in, in_len, op, out_len,
+						      wrkmem);
+		else
+#endif
+			t = _lzo1x_1_do_compress(in, in_len, op, out_len,
+						 wrkmem);
 		op += *out_len;
 	}
 
@@ -219,8 +267,30 @@ int lzo1x_1_compress(const unsigned char *in, size_t in_len, unsigned char *out,
 	*out_len = op - out;
 	return LZO_E_OK;
 }
+
+int lzo1x_1_compress_generic(const unsigned char *in, size_t in_len,
+			unsigned char *out, size_t *out_len, void *wrkmem)
+{
+	return __lzo1x_1_compress(in, in_len, out, out_len, wrkmem, 0);
+}
+EXPORT_SYMBOL_GPL(lzo1x_1_compress_generic);
+
+int lzo1x_1_compress(const unsigned char *in, size_t in_len, unsigned char *out,
+			size_t *out_len, void *wrkmem)
+{
+	return __lzo1x_1_compress(in, in_len, out, out_len, wrkmem,
+				  lzo_fast_copy);
+}
 EXPORT_SYMBOL_GPL(lzo1x_1_compress);
 
+static int __init lzo1x_compress_init(void)
+{
+	lzo_fast_copy = lzo_fast_unaligned_ok();
+	return 0;
+}
+module_init(lzo1x_compress_init);
+module_param_named(fast_copy, lzo_fast_copy, bool, S_IRUGO);
+
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("LZO1X-1 Compressor");
 
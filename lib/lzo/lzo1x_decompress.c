@@ -11,8 +11,10 @@
  *  Richard Purdie <rpurdie@openedhand.com>
  */
 
+#ifndef STATIC
 #include <linux/module.h>
 #include <linux/kernel.h>
+#endif
 #include <linux/lzo.h>
 #include <asm/byteorder.h>
 #include <asm/unaligned.h>
@@ -22,11 +24,15 @@
 #define HAVE_OP(x, op_end, op) ((size_t)(op_end - op) < (x))
 #define HAVE_LB(m_pos, out, op) (m_pos < out || m_pos >= op)
 
-#define COPY4(dst, src)	\
-		put_unaligned(get_unaligned((const u32 *)(src)), (u32 *)(dst))
+#define COPY4(dst, src)	LZO_COPY4(fast, dst, src)
 
-int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
-			unsigned char *out, size_t *out_len)
+#ifndef STATIC
+static int lzo_fast_copy __read_mostly;
+#endif
+
+static __always_inline int
+__lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
+			unsigned char *out, size_t *out_len, const int fast)
 {
 	const unsigned char * const ip_end = in + in_len;
 	unsigned char * const op_end = out + *out_len;
@@ -74,6 +80,17 @@ int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
 		op += 4;
 		ip += 4;
 		if (--t > 0) {
+			if (fast) {
+				while (t >= 8) {
+					COPY4(op, ip);
+					COPY4(op + 4, ip + 4);
+					op += 8;
+					ip += 8;
+					t -= 8;
+				}
+				if (!t)
+					goto first_literal_run;
+			}
 			if (t >= 4) {
 				do {
 					COPY4(op, ip);
@@ -186,12 +203,24 @@ match:
 				op += 4;
 				m_pos += 4;
 				t -= 4 - (3 - 1);
+				if (fast && (op - m_pos) >= 8) {
+					while (t >= 8) {
+						COPY4(op, m_pos);
+						COPY4(op + 4, m_pos + 4);
+						op += 8;
+						m_pos += 8;
+						t -= 8;
+					}
+					if (t < 4)
+						goto copy_tail;
+				}
 				do {
 					COPY4(op, m_pos);
 					op += 4;
 					m_pos += 4;
 					t -= 4;
 				} while (t >= 4);
+copy_tail:
 				if (t > 0)
 					do {
 						*op++ = *m_pos++;
@@ -245,8 +274,36 @@ lookbehind_overrun:
 	return LZO_E_LOOKBEHIND_OVERRUN;
 }
 
+int lzo1x_decompress_safe_generic(const unsigned char *in, size_t in_len,
+			unsigned char *out, size_t *out_len)
+{
+	return __lzo1x_decompress_safe(in, in_len, out, out_len, 0);
+}
+#ifndef STATIC
+EXPORT_SYMBOL_GPL(lzo1x_decompress_safe_generic);
+#endif
+
+int lzo1x_decompress_safe(const unsigned char *in, size_t in_len,
+			unsigned char *out, size_t *out_len)
+{
+#ifdef LZO_HAVE_FAST_UNALIGNED
+	if (lzo_fast_copy)
+		return __lzo1x_decompress_safe(in, in_len, out, out_len, 1);
+#endif
+	return lzo1x_decompress_safe_generic(in, in_len, out, out_len);
+}
+#ifndef STATIC
 EXPORT_SYMBOL_GPL(lzo1x_decompress_safe);
 
+static int __init lzo1x_decompress_init(void)
+{
+	lzo_fast_copy = lzo_fast_unaligned_ok();
+	return 0;
+}
+module_init(lzo1x_decompress_init);
+module_param_named(fast_copy, lzo_fast_copy, bool, S_IRUGO);
+
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("LZO1X Decompressor");
+#endif /* STATIC */
 
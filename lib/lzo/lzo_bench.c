@@ -0,0 +1,268 @@
+/*
+ *  LZO1X throughput benchmark
+ *
+ *  Compresses and decompresses a set of sample pages with the default
+ *  and the generic LZO1X code, verifies that both produce the same
+ *  stream and round-trip the data, and reports MB/s for each. Loading
+ *  the module runs the benchmark; it then fails with -EAGAIN so that it
+ *  does not stay loaded.
+ *
+ *  This software is licensed under the terms of the GNU General Public
+ *  License version 2, as published by the Free Software Foundation, and
+ *  may be copied, distributed, and modified under those terms.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/lzo.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+
+static unsigned int pages = 64;
+module_param(pages, uint, 0);
+MODULE_PARM_DESC(pages, "Number of sample pages");
+
+static unsigned int iterations = 20;
+module_param(iterations, uint, 0);
+MODULE_PARM_DESC(iterations, "Passes over the sample pages per variant");
+
+typedef int (*lzo_compress_t)(const unsigned char *, size_t,
+			      unsigned char *, size_t *, void *);
+typedef int (*lzo_decompress_t)(const unsigned char *, size_t,
+				unsigned char *, size_t *);
+
+struct lzo_bench {
+	unsigned char *src;	/* pages * PAGE_SIZE sample data */
+	unsigned char *dst;	/* compressed pages, worst case each */
+	unsigned char *out;	/* one decompressed page */
+	size_t *len;		/* compressed length of each page */
+	void *wrkmem;
+};
+
+#define LZO_BENCH_SLOT	lzo1x_worst_compress(PAGE_SIZE)
+
+static u32 lzo_bench_seed = 0x2545f491;
+
+static u32 lzo_bench_rand(void)
+{
+	lzo_bench_seed = lzo_bench_seed * 1103515245 + 12345;
+	return lzo_bench_seed >> 8;
+}
+
+/*
+ * A mix of what swap and the logger see: mostly zero pages with a few
+ * pointers, small repeated records, text made of a small vocabulary, and
+ * some incompressible data.
+ */
+static void lzo_bench_fill(unsigned char *p, unsigned int n)
+{
+	static const char * const words[] = {
+		"ActivityManager", "binder", "sched", "wakelock", "the ",
+		" at ", "com.android.", "0x", "(", ")", "\n", ": ", "I/",
+	};
+	unsigned int i, off;
+	u32 *w = (u32 *)p;
+
+	switch (n % 4) {
+	case 0:
+		memset(p, 0, PAGE_SIZE);
+		for (i = 0; i < 16; i++)
+			w[lzo_bench_rand() % (PAGE_SIZE / 4)] =
+				0xc0000000 | (lzo_bench_rand() & 0xfffffc);
+		break;
+	case 1:
+		for (i = 0; i < PAGE_SIZE / 4; i += 8) {
+			w[i] = i;
+			w[i + 1] = 0xc0400000 + i * 4;
+			w[i + 2] = 0;
+			w[i + 3] = lzo_bench_rand() & 0xff;
+			w[i + 4] = 0xffffffff;
+			w[i + 5] = 0;
+			w[i + 6] = 0x10;
+			w[i + 7] = lzo_bench_rand() & 1;
+		}
+		break;
+	case 2:
+		for (off = 0; off < PAGE_SIZE; ) {
+			const char *s = words[lzo_bench_rand() %
+					      ARRAY_SIZE(words)];
+			size_t len = min_t(size_t, strlen(s), PAGE_SIZE - off);
+
+			memcpy(p + off, s, len);
+			off += len;
+		}
+		break;
+	default:
+		for (i = 0; i < PAGE_SIZE / 4; i++)
+			w[i] = lzo_bench_rand() ^ (lzo_bench_rand() << 16);
+		break;
+	}
+}
+
+static u32 lzo_bench_mbps(u64 bytes, s64 ns)
+{
+	if (ns <= 0)
+		return 0;
+	/* bytes per microsecond is MB/s */
+	return div64_u64(bytes * 1000, ns);
+}
+
+static int lzo_bench_compress(struct lzo_bench *b, lzo_compress_t fn,
+			      u32 *mbps)
+{
+	ktime_t start;
+	unsigned int i, j;
+	int ret;
+
+	start = ktime_get();
+	for (j = 0; j < iterations; j++) {
+		for (i = 0; i < pages; i++) {
+			ret = fn(b->src + i * PAGE_SIZE, PAGE_SIZE,
+				 b->dst + i * LZO_BENCH_SLOT, &b->len[i],
+				 b->wrkmem);
+			if (ret != LZO_E_OK)
+				return ret;
+		}
+		cond_resched();
+	}
+	*mbps = lzo_bench_mbps((u64)pages * iterations * PAGE_SIZE,
+			       ktime_to_ns(ktime_sub(ktime_get(), start)));
+	return 0;
+}
+
+static int lzo_bench_decompress(struct lzo_bench *b, lzo_decompress_t fn,
+				u32 *mbps)
+{
+	ktime_t start;
+	unsigned int i, j;
+	size_t len;
+	int ret;
+
+	start = ktime_get();
+	for (j = 0; j < iterations; j++) {
+		for (i = 0; i < pages; i++) {
+			len = PAGE_SIZE;
+			ret = fn(b->dst + i * LZO_BENCH_SLOT, b->len[i],
+				 b->out, &len);
+			if (ret != LZO_E_OK || len != PAGE_SIZE)
+				return ret ? ret : LZO_E_ERROR;
+		}
+		cond_resched();
+	}
+	*mbps = lzo_bench_mbps((u64)pages * iterations * PAGE_SIZE,
+			       ktime_to_ns(ktime_sub(ktime_get(), start)));
+
+	/* the last pass left the final page in out */
+	if (memcmp(b->out, b->src + (pages - 1) * PAGE_SIZE, PAGE_SIZE))
+		return LZO_E_ERROR;
+	return 0;
+}
+
+/* both compressors must emit the same stream; check it round-trips */
+static int lzo_bench_verify(struct lzo_bench *b)
+{
+	unsigned char *ref;
+	size_t ref_len, len;
+	unsigned int i;
+	int ret = 0;
+
+	ref = vmalloc(LZO_BENCH_SLOT);
+	if (!ref)
+		return -ENOMEM;
+
+	for (i = 0; i < pages && !ret; i++) {
+		unsigned char *src = b->src + i * PAGE_SIZE;
+
+		/* stale dictionary entries can change the chosen matches */
+		memset(b->wrkmem, 0, LZO1X_MEM_COMPRESS);
+		lzo1x_1_compress(src, PAGE_SIZE, b->dst, &len, b->wrkmem);
+		memset(b->wrkmem, 0, LZO1X_MEM_COMPRESS);
+		lzo1x_1_compress_generic(src, PAGE_SIZE, ref, &ref_len,
+					 b->wrkmem);
+		if (len != ref_len || memcmp(b->dst, ref, len)) {
+			pr_err("lzo_bench: page %u: streams differ\n", i);
+			ret = -EINVAL;
+			break;
+		}
+
+		len = PAGE_SIZE;
+		if (lzo1x_decompress_safe(ref, ref_len, b->out, &len) !=
+		    LZO_E_OK || len != PAGE_SIZE ||
+		    memcmp(b->out, src, PAGE_SIZE)) {
+			pr_err("lzo_bench: page %u: round trip failed\n", i);
+			ret = -EINVAL;
+		}
+	}
+	vfree(ref);
+	return ret;
+}
+
+static int __init lzo_bench_init(void)
+{
+	struct lzo_bench b;
+	u32 c_fast, c_gen, d_fast, d_gen;
+	u64 total = 0;
+	unsigned int i;
+	int ret = -ENOMEM;
+
+	if (!pages || !iterations)
+		return -EINVAL;
+
+	b.src = vmalloc(pages * PAGE_SIZE);
+	b.dst = vmalloc(pages * LZO_BENCH_SLOT);
+	b.out = vmalloc(PAGE_SIZE);
+	b.len = vmalloc(pages * sizeof(*b.len));
+	b.wrkmem = vmalloc(LZO1X_MEM_COMPRESS);
+	if (!b.src || !b.dst || !b.out || !b.len || !b.wrkmem)
+		goto out;
+
+	for (i = 0; i < pages; i++)
+		lzo_bench_fill(b.src + i * PAGE_SIZE, i);
+
+	ret = lzo_bench_verify(&b);
+	if (ret)
+		goto out;
+
+	ret = lzo_bench_compress(&b, lzo1x_1_compress_generic, &c_gen);
+	if (!ret)
+		ret = lzo_bench_decompress(&b, lzo1x_decompress_safe_generic,
+					   &d_gen);
+	if (!ret)
+		ret = lzo_bench_compress(&b, lzo1x_1_compress, &c_fast);
+	if (!ret)
+		ret = lzo_bench_decompress(&b, lzo1x_decompress_safe,
+					   &d_fast);
+	if (ret) {
+		pr_err("lzo_bench: failed: %d\n", ret);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	for (i = 0; i < pages; i++)
+		total += b.len[i];
+	pr_info("lzo_bench: %u pages x %u, ratio %llu%%\n", pages, iterations,
+		(unsigned long long)div_u64(total * 100,
+					    pages * PAGE_SIZE));
+	pr_info("lzo_bench: compress   default %u MB/s, generic %u MB/s\n",
+		c_fast, c_gen);
+	pr_info("lzo_bench: decompress default %u MB/s, generic %u MB/s\n",
+		d_fast, d_gen);
+	ret = -EAGAIN;
+out:
+	vfree(b.wrkmem);
+	vfree(b.len);
+	vfree(b.out);
+	vfree(b.dst);
+	vfree(b.src);
+	return ret;
+}
+
+module_init(lzo_bench_init);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("LZO1X throughput benchmark");
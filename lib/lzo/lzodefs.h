@@ -41,3 +41,51 @@
 #define DX2(p, s1, s2)	(((((size_t)((p)[2]) << (s2)) ^ (p)[1]) \
 							<< (s1)) ^ (p)[0])
 #define DX3(p, s1, s2, s3)	((DX2((p)+1, s2, s3) << (s1)) ^ (p)[0])
+
+/*
+ * ARMv7 handles unaligned LDR/STR in hardware once alignment faults are
+ * off, which lets the copy and compare loops move a word at a time where
+ * get_unaligned() would go byte by byte. The word paths are only used
+ * when lzo_fast_unaligned_ok() says the control register allows it; the
+ * generic byte-wise versions stay available as *_generic. The boot
+ * wrapper (STATIC) doesn't know the control register state and always
+ * goes byte-wise.
+ */
+#if defined(CONFIG_ARM) && __LINUX_ARM_ARCH__ >= 7 && !defined(__ARMEB__) && \
+	!defined(STATIC)
+#include <asm/system.h>
+
+#define LZO_HAVE_FAST_UNALIGNED
+
+static inline u32 lzo_load32(const void *p)
+{
+	u32 v;
+
+	/* plain ldr; the compiler must not merge these into ldrd/ldm */
+	asm("ldr	%0, [%1]" : "=r" (v) : "r" (p), "m" (*(const u32 *)p));
+	return v;
+}
+
+static inline void lzo_store32(void *p, u32 v)
+{
+	asm("str	%2, [%1]" : "=m" (*(u32 *)p) : "r" (p), "r" (v));
+}
+
+static inline int lzo_fast_unaligned_ok(void)
+{
+	return !(get_cr() & CR_A);
+}
+#else
+#define lzo_load32(p)		get_unaligned((const u32 *)(p))
+#define lzo_store32(p, v)	put_unaligned((v), (u32 *)(p))
+#define lzo_fast_unaligned_ok()	0
+#endif
+
+#define LZO_COPY4(fast, dst, src)					\
+	do {								\
+		if (fast)						\
+			lzo_store32((dst), lzo_load32(src));		\
+		else							\
+			put_unaligned(get_unaligned((const u32 *)(src)),\
+				      (u32 *)(dst));			\
+	} while (0)
@@ -27,6 +27,10 @@
 #include <linux/personality.h>
 #include <linux/bitops.h>
 #include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/rbtree.h>
+#include <linux/jiffies.h>
+#include <linux/proc_fs.h>
 #include <linux/shmem_fs.h>
 #include <linux/ashmem.h>
 
@@ -37,43 +41,83 @@
 /*
  * ashmem_area - anonymous shared memory area
  * Lifecycle: From our parent file's open() until its release()
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its own `mutex'
  * Big Note: Mappings do NOT pin this structure; it dies on close()
  */
 struct ashmem_area {
 	char name[ASHMEM_FULL_NAME_LEN];/* optional name for /proc/pid/maps */
-	struct list_head unpinned_list;	/* list of all ashmem areas */
+	struct rb_root unpinned;	/* unpinned ranges, by pgstart */
+	struct mutex mutex;		/* protects the area and its ranges */
 	struct file *file;		/* the shmem-based backing file */
 	size_t size;			/* size of the mapping, in bytes */
 	unsigned long prot_mask;	/* allowed prot bits, as vm_flags */
+	unsigned int purge_cost;	/* ASHMEM_SET_PURGE_COST hint */
+	struct ashmem_purge_stat *stat;	/* purge statistics for our name */
 };
 
 /*
  * ashmem_range - represents an interval of unpinned (evictable) pages
  * Lifecycle: From unpin to pin
- * Locking: Protected by `ashmem_mutex'
+ * Locking: Protected by its area's `mutex'; `lru' also by ashmem_lru_lock
+ *
+ * The ranges of an area never overlap, so ordering them by pgstart also
+ * orders them by pgend and the tree doubles as an interval index.
  */
 struct ashmem_range {
 	struct list_head lru;		/* entry in LRU list */
-	struct list_head unpinned;	/* entry in its area's unpinned list */
+	struct rb_node node;		/* entry in its area's unpinned tree */
 	struct ashmem_area *asma;	/* associated area */
 	size_t pgstart;			/* starting page, inclusive */
 	size_t pgend;			/* ending page, inclusive */
 	unsigned int purged;		/* ASHMEM_NOT or ASHMEM_WAS_PURGED */
+	unsigned int cost;		/* area's purge cost when unpinned */
+	unsigned long lru_time;		/* jiffies when unpinned */
+};
+
+/*
+ * ashmem_purge_stat - purge counts for all areas of one name
+ * Lifecycle: From the first area with the name until module unload
+ * Locking: Counters protected by ashmem_stat_lock, list by ashmem_stat_mutex
+ */
+struct ashmem_purge_stat {
+	struct list_head list;		/* entry in ashmem_stat_list */
+	unsigned long purges;		/* ranges purged */
+	unsigned long long bytes;	/* bytes purged */
+	char name[0];			/* area name, without the prefix */
 };
 
-/* LRU list of unpinned pages, protected by ashmem_mutex */
-static LIST_HEAD(ashmem_lru_list);
+#define ASHMEM_PURGE_STATS_MAX	64	/* names tracked individually */
+#define ASHMEM_LRU_LEVELS	(ASHMEM_PURGE_COST_MAX + 1)
 
-/* Count of pages on our LRU list, protected by ashmem_mutex */
+/*
+ * LRU lists of unpinned pages, one per purge cost; protected by
+ * ashmem_lru_lock
+ */
+static struct list_head ashmem_lru_list[ASHMEM_LRU_LEVELS];
+
+/* Count of pages on our LRU lists, protected by ashmem_lru_lock */
 static unsigned long lru_count;
 
 /*
- * ashmem_mutex - protects the list of and each individual ashmem_area
+ * ashmem_lru_lock - protects the LRU lists and lru_count
+ *
+ * Lock Ordering: asma->mutex -> ashmem_lru_lock, and
+ *		  asma->mutex -> i_mutex -> i_alloc_sem
  *
- * Lock Ordering: ashmex_mutex -> i_mutex -> i_alloc_sem
+ * The shrinker walks the LRU under ashmem_lru_lock and only trylocks the
+ * areas, skipping any that are busy pinning or unpinning.
  */
-static DEFINE_MUTEX(ashmem_mutex);
+static DEFINE_SPINLOCK(ashmem_lru_lock);
+
+static LIST_HEAD(ashmem_stat_list);
+static unsigned int ashmem_stat_count;
+static DEFINE_MUTEX(ashmem_stat_mutex);
+static DEFINE_SPINLOCK(ashmem_stat_lock);
+
+/* areas without a name, or past ASHMEM_PURGE_STATS_MAX names, count here */
+static struct ashmem_purge_stat ashmem_stat_default = {
+	.list = LIST_HEAD_INIT(ashmem_stat_default.list),
+};
 
 static struct kmem_cache *ashmem_area_cachep __read_mostly;
 static struct kmem_cache *ashmem_range_cachep __read_mostly;
@@ -102,33 +146,71 @@ static struct kmem_cache *ashmem_range_cachep __read_mostly;
 
 #define PROT_MASK		(PROT_EXEC | PROT_READ | PROT_WRITE)
 
+/* Caller must hold ashmem_lru_lock. */
 static inline void lru_add(struct ashmem_range *range)
 {
-	list_add_tail(&range->lru, &ashmem_lru_list);
+	list_add_tail(&range->lru, &ashmem_lru_list[range->cost]);
 	lru_count += range_size(range);
 }
 
+/* Caller must hold ashmem_lru_lock. */
 static inline void lru_del(struct ashmem_range *range)
 {
 	list_del(&range->lru);
 	lru_count -= range_size(range);
 }
 
+static inline struct ashmem_range *range_next(struct ashmem_range *range)
+{
+	struct rb_node *next = rb_next(&range->node);
+
+	return next ? rb_entry(next, struct ashmem_range, node) : NULL;
+}
+
+/*
+ * range_first - returns the first unpinned range of 'asma' that ends at or
+ * after page 'pgstart', or NULL if there is none.
+ *
+ * Caller must hold asma->mutex.
+ */
+static struct ashmem_range *range_first(struct ashmem_area *asma,
+					size_t pgstart)
+{
+	struct rb_node *n = asma->unpinned.rb_node;
+	struct ashmem_range *first = NULL;
+
+	while (n) {
+		struct ashmem_range *range;
+
+		range = rb_entry(n, struct ashmem_range, node);
+		if (range_before_page(range, pgstart)) {
+			n = n->rb_right;
+		} else {
+			first = range;
+			n = n->rb_left;
+		}
+	}
+
+	return first;
+}
+
 /*
  * range_alloc - allocate and initialize a new ashmem_range structure
  *
  * 'asma' - associated ashmem_area
- * 'prev_range' - the previous ashmem_range in the sorted asma->unpinned list
  * 'purged' - initial purge value (ASMEM_NOT_PURGED or ASHMEM_WAS_PURGED)
  * 'start' - starting page, inclusive
  * 'end' - ending page, inclusive
  *
- * Caller must hold ashmem_mutex.
+ * The new range must not overlap any of the area's unpinned ranges.
+ *
+ * Caller must hold asma->mutex.
  */
-static int range_alloc(struct ashmem_area *asma,
-		       struct ashmem_range *prev_range, unsigned int purged,
+static int range_alloc(struct ashmem_area *asma, unsigned int purged,
 		       size_t start, size_t end)
 {
+	struct rb_node **p = &asma->unpinned.rb_node;
+	struct rb_node *parent = NULL;
 	struct ashmem_range *range;
 
 	range = kmem_cache_zalloc(ashmem_range_cachep, GFP_KERNEL);
@@ -139,27 +221,47 @@ static int range_alloc(struct ashmem_area *asma,
 	range->pgstart = start;
 	range->pgend = end;
 	range->purged = purged;
+	range->cost = asma->purge_cost;
+	range->lru_time = jiffies;
+
+	while (*p) {
+		struct ashmem_range *entry;
+
+		parent = *p;
+		entry = rb_entry(parent, struct ashmem_range, node);
+		if (end < entry->pgstart)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&range->node, parent, p);
+	rb_insert_color(&range->node, &asma->unpinned);
 
-	list_add_tail(&range->unpinned, &prev_range->unpinned);
-
-	if (range_on_lru(range))
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
 		lru_add(range);
+		spin_unlock(&ashmem_lru_lock);
+	}
 
 	return 0;
 }
 
+/* Caller must hold asma->mutex. */
 static void range_del(struct ashmem_range *range)
 {
-	list_del(&range->unpinned);
-	if (range_on_lru(range))
+	rb_erase(&range->node, &range->asma->unpinned);
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
 		lru_del(range);
+		spin_unlock(&ashmem_lru_lock);
+	}
 	kmem_cache_free(ashmem_range_cachep, range);
 }
 
 /*
  * range_shrink - shrinks a range
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static inline void range_shrink(struct ashmem_range *range,
 				size_t start, size_t end)
@@ -169,8 +271,11 @@ static inline void range_shrink(struct ashmem_range *range,
 	range->pgstart = start;
 	range->pgend = end;
 
-	if (range_on_lru(range))
+	if (range_on_lru(range)) {
+		spin_lock(&ashmem_lru_lock);
 		lru_count -= pre - range_size(range);
+		spin_unlock(&ashmem_lru_lock);
+	}
 }
 
 static int ashmem_open(struct inode *inode, struct file *file)
@@ -186,9 +291,12 @@ static int ashmem_open(struct inode *inode, struct file *file)
 	if (unlikely(!asma))
 		return -ENOMEM;
 
-	INIT_LIST_HEAD(&asma->unpinned_list);
+	asma->unpinned = RB_ROOT;
+	mutex_init(&asma->mutex);
 	memcpy(asma->name, ASHMEM_NAME_PREFIX, ASHMEM_NAME_PREFIX_LEN);
 	asma->prot_mask = PROT_MASK;
+	asma->purge_cost = ASHMEM_PURGE_COST_DEF;
+	asma->stat = &ashmem_stat_default;
 	file->private_data = asma;
 
 	return 0;
@@ -197,12 +305,12 @@ static int ashmem_open(struct inode *inode, struct file *file)
 static int ashmem_release(struct inode *ignored, struct file *file)
 {
 	struct ashmem_area *asma = file->private_data;
-	struct ashmem_range *range, *next;
+	struct rb_node *n;
 
-	mutex_lock(&ashmem_mutex);
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned)
-		range_del(range);
-	mutex_unlock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
+	while ((n = rb_first(&asma->unpinned)))
+		range_del(rb_entry(n, struct ashmem_range, node));
+	mutex_unlock(&asma->mutex);
 
 	if (asma->file)
 		fput(asma->file);
@@ -219,12 +327,35 @@ calc_vm_may_flags(unsigned long prot)
 	       _calc_vm_trans(prot, PROT_EXEC,  VM_MAYEXEC);
 }
 
+/*
+ * ashmem_backing_setup - allocate the backing shmem file on first use
+ *
+ * Caller must hold asma->mutex.
+ */
+static int ashmem_backing_setup(struct ashmem_area *asma, unsigned long flags)
+{
+	char *name = ASHMEM_NAME_DEF;
+	struct file *vmfile;
+
+	if (asma->file)
+		return 0;
+
+	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0')
+		name = asma->name;
+
+	vmfile = shmem_file_setup(name, asma->size, flags);
+	if (unlikely(IS_ERR(vmfile)))
+		return PTR_ERR(vmfile);
+	asma->file = vmfile;
+	return 0;
+}
+
 static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct ashmem_area *asma = file->private_data;
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* user needs to SET_SIZE before mapping */
 	if (unlikely(!asma->size)) {
@@ -240,21 +371,9 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	}
 	vma->vm_flags &= ~calc_vm_may_flags(~asma->prot_mask);
 
-	if (!asma->file) {
-		char *name = ASHMEM_NAME_DEF;
-		struct file *vmfile;
-
-		if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0')
-			name = asma->name;
-
-		/* ... and allocate the backing shmem file */
-		vmfile = shmem_file_setup(name, asma->size, vma->vm_flags);
-		if (unlikely(IS_ERR(vmfile))) {
-			ret = PTR_ERR(vmfile);
-			goto out;
-		}
-		asma->file = vmfile;
-	}
+	ret = ashmem_backing_setup(asma, vma->vm_flags);
+	if (unlikely(ret))
+		goto out;
 	get_file(asma->file);
 
 	if (vma->vm_flags & VM_SHARED)
@@ -267,10 +386,41 @@ static int ashmem_mmap(struct file *file, struct vm_area_struct *vma)
 	vma->vm_flags |= VM_CAN_NONLINEAR;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
+/*
+ * lru_pick - returns the unpinned range to purge next, or NULL
+ *
+ * Takes the oldest range of each purge cost whose area is not busy and picks
+ * the one that has been unpinned longest, counting a range of cost c as if
+ * it had been unpinned 2^c times more recently.
+ *
+ * Caller must hold ashmem_lru_lock.
+ */
+static struct ashmem_range *lru_pick(void)
+{
+	struct ashmem_range *range, *best = NULL;
+	unsigned long age, best_age = 0;
+	int cost;
+
+	for (cost = 0; cost < ASHMEM_LRU_LEVELS; cost++) {
+		list_for_each_entry(range, &ashmem_lru_list[cost], lru) {
+			if (mutex_is_locked(&range->asma->mutex))
+				continue;
+			age = (jiffies - range->lru_time) >> cost;
+			if (!best || age > best_age) {
+				best = range;
+				best_age = age;
+			}
+			break;
+		}
+	}
+
+	return best;
+}
+
 /*
  * ashmem_shrink - our cache shrinker, called from mm/vmscan.c :: shrink_slab
  *
@@ -283,12 +433,16 @@ out:
  * proceed without risk of deadlock (due to gfp_mask).
  *
  * We approximate LRU via least-recently-unpinned, jettisoning unpinned partial
- * chunks of ashmem regions LRU-wise one-at-a-time until we hit 'nr_to_scan'
- * pages freed.
+ * chunks of ashmem regions one-at-a-time until we hit 'nr_to_scan' pages
+ * freed. Each purge cost has its own LRU list; lru_pick() weighs the oldest
+ * range of each against the others. Areas whose mutex is held, be it by
+ * someone pinning or by an allocation of theirs that recursed into us, are
+ * skipped.
  */
 static int ashmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 {
-	struct ashmem_range *range, *next;
+	struct ashmem_range *range;
+	int misses = 0;
 
 	/* We might recurse into filesystem code, so bail out if necessary */
 	if (nr_to_scan && !(gfp_mask & __GFP_FS))
@@ -296,25 +450,44 @@ static int ashmem_shrink(int nr_to_scan, gfp_t gfp_mask)
 	if (!nr_to_scan)
 		return lru_count;
 
-	/* If our mutex is held, we are recursing into ourselves, so bail out */
-	if (!mutex_trylock(&ashmem_mutex)) {
-		return -1;
-	}
+	while (nr_to_scan > 0) {
+		struct ashmem_area *asma;
+		struct inode *inode;
+		loff_t start, end;
 
-	list_for_each_entry_safe(range, next, &ashmem_lru_list, lru) {
-		struct inode *inode = range->asma->file->f_dentry->d_inode;
-		loff_t start = range->pgstart * PAGE_SIZE;
-		loff_t end = (range->pgend + 1) * PAGE_SIZE - 1;
+		spin_lock(&ashmem_lru_lock);
+		range = lru_pick();
+		if (!range) {
+			spin_unlock(&ashmem_lru_lock);
+			break;
+		}
+
+		/* the range can't go away while it is on the LRU */
+		asma = range->asma;
+		if (!mutex_trylock(&asma->mutex)) {
+			spin_unlock(&ashmem_lru_lock);
+			if (++misses > ASHMEM_LRU_LEVELS)
+				break;
+			continue;
+		}
 
-		vmtruncate_range(inode, start, end);
-		range->purged = ASHMEM_WAS_PURGED;
 		lru_del(range);
+		range->purged = ASHMEM_WAS_PURGED;
+		spin_unlock(&ashmem_lru_lock);
 
+		inode = asma->file->f_dentry->d_inode;
+		start = range->pgstart * PAGE_SIZE;
+		end = (range->pgend + 1) * PAGE_SIZE - 1;
+		vmtruncate_range(inode, start, end);
 		nr_to_scan -= range_size(range);
-		if (nr_to_scan <= 0)
-			break;
+
+		spin_lock(&ashmem_stat_lock);
+		asma->stat->purges++;
+		asma->stat->bytes += range_size(range) * PAGE_SIZE;
+		spin_unlock(&ashmem_stat_lock);
+
+		mutex_unlock(&asma->mutex);
 	}
-	mutex_unlock(&ashmem_mutex);
 
 	return lru_count;
 }
@@ -328,7 +501,7 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* the user can only remove, not add, protection bits */
 	if (unlikely((asma->prot_mask & prot) != prot)) {
@@ -343,15 +516,50 @@ static int set_prot_mask(struct ashmem_area *asma, unsigned long prot)
 	asma->prot_mask = prot;
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 	return ret;
 }
 
+/*
+ * get_purge_stat - returns the purge statistics for areas named 'name',
+ * creating them on first use. Past ASHMEM_PURGE_STATS_MAX names, or if
+ * memory is short, all areas share ashmem_stat_default.
+ */
+static struct ashmem_purge_stat *get_purge_stat(const char *name)
+{
+	struct ashmem_purge_stat *stat;
+	size_t len = strlen(name);
+
+	if (!len)
+		return &ashmem_stat_default;
+
+	mutex_lock(&ashmem_stat_mutex);
+	list_for_each_entry(stat, &ashmem_stat_list, list)
+		if (!strcmp(stat->name, name))
+			goto out;
+
+	stat = &ashmem_stat_default;
+	if (ashmem_stat_count < ASHMEM_PURGE_STATS_MAX) {
+		struct ashmem_purge_stat *new;
+
+		new = kzalloc(sizeof(*new) + len + 1, GFP_KERNEL);
+		if (new) {
+			memcpy(new->name, name, len + 1);
+			list_add_tail(&new->list, &ashmem_stat_list);
+			ashmem_stat_count++;
+			stat = new;
+		}
+	}
+out:
+	mutex_unlock(&ashmem_stat_mutex);
+	return stat;
+}
+
 static int set_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	/* cannot change an existing mapping's name */
 	if (unlikely(asma->file)) {
@@ -363,9 +571,10 @@ static int set_name(struct ashmem_area *asma, void __user *name)
 				    name, ASHMEM_NAME_LEN)))
 		ret = -EFAULT;
 	asma->name[ASHMEM_FULL_NAME_LEN-1] = '\0';
+	asma->stat = get_purge_stat(asma->name + ASHMEM_NAME_PREFIX_LEN);
 
 out:
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -374,7 +583,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 {
 	int ret = 0;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 	if (asma->name[ASHMEM_NAME_PREFIX_LEN] != '\0') {
 		size_t len;
 
@@ -391,7 +600,7 @@ static int get_name(struct ashmem_area *asma, void __user *name)
 					  sizeof(ASHMEM_NAME_DEF))))
 			ret = -EFAULT;
 	}
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -400,16 +609,20 @@ static int get_name(struct ashmem_area *asma, void __user *name)
  * ashmem_pin - pin the given ashmem region, returning whether it was
  * previously purged (ASHMEM_WAS_PURGED) or not (ASHMEM_NOT_PURGED).
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
 	struct ashmem_range *range, *next;
 	int ret = ASHMEM_NOT_PURGED;
+	size_t end;
+
+	/* only ranges ending at or after pgstart can be affected */
+	for (range = range_first(asma, pgstart); range; range = next) {
+		next = range_next(range);
 
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned) {
 		/* moved past last applicable page; we can short circuit */
-		if (range_before_page(range, pgstart))
+		if (range->pgstart > pgend)
 			break;
 
 		/*
@@ -450,12 +663,13 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 
 			/*
 			 * Case #4: We eat a chunk out of the middle. A bit
-			 * more complicated, we allocate a new range for the
-			 * second half and adjust the first chunk's endpoint.
+			 * more complicated, we adjust the first chunk's
+			 * endpoint and allocate a new range for the second
+			 * half.
 			 */
-			range_alloc(asma, range, range->purged,
-				    pgend + 1, range->pgend);
+			end = range->pgend;
 			range_shrink(range, range->pgstart, pgstart - 1);
+			range_alloc(asma, range->purged, pgend + 1, end);
 			break;
 		}
 	}
@@ -466,17 +680,18 @@ static int ashmem_pin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 /*
  * ashmem_unpin - unpin the given range of pages. Returns zero on success.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_unpin(struct ashmem_area *asma, size_t pgstart, size_t pgend)
 {
 	struct ashmem_range *range, *next;
 	unsigned int purged = ASHMEM_NOT_PURGED;
 
-restart:
-	list_for_each_entry_safe(range, next, &asma->unpinned_list, unpinned) {
+	for (range = range_first(asma, pgstart); range; range = next) {
+		next = range_next(range);
+
 		/* short circuit: this is our insertion point */
-		if (range_before_page(range, pgstart))
+		if (range->pgstart > pgend)
 			break;
 
 		/*
@@ -490,35 +705,40 @@ restart:
 			pgend = max_t(size_t, range->pgend, pgend);
 			purged |= range->purged;
 			range_del(range);
-			goto restart;
 		}
 	}
 
-	return range_alloc(asma, range, purged, pgstart, pgend);
+	return range_alloc(asma, purged, pgstart, pgend);
 }
 
 /*
  * ashmem_get_pin_status - Returns ASHMEM_IS_UNPINNED if _any_ pages in the
  * given interval are unpinned and ASHMEM_IS_PINNED otherwise.
  *
- * Caller must hold ashmem_mutex.
+ * Caller must hold asma->mutex.
  */
 static int ashmem_get_pin_status(struct ashmem_area *asma, size_t pgstart,
 				 size_t pgend)
 {
-	struct ashmem_range *range;
-	int ret = ASHMEM_IS_PINNED;
+	struct ashmem_range *range = range_first(asma, pgstart);
 
-	list_for_each_entry(range, &asma->unpinned_list, unpinned) {
-		if (range_before_page(range, pgstart))
-			break;
-		if (page_range_in_range(range, pgstart, pgend)) {
-			ret = ASHMEM_IS_UNPINNED;
-			break;
-		}
-	}
+	if (range && range->pgstart <= pgend)
+		return ASHMEM_IS_UNPINNED;
 
-	return ret;
+	return ASHMEM_IS_PINNED;
+}
+
+static int set_purge_cost(struct ashmem_area *asma, unsigned long cost)
+{
+	if (cost > ASHMEM_PURGE_COST_MAX)
+		return -EINVAL;
+
+	/* ranges that are already unpinned keep the cost they had */
+	mutex_lock(&asma->mutex);
+	asma->purge_cost = cost;
+	mutex_unlock(&asma->mutex);
+
+	return 0;
 }
 
 static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
@@ -550,7 +770,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 	pgstart = pin.offset / PAGE_SIZE;
 	pgend = pgstart + (pin.len / PAGE_SIZE) - 1;
 
-	mutex_lock(&ashmem_mutex);
+	mutex_lock(&asma->mutex);
 
 	switch (cmd) {
 	case ASHMEM_PIN:
@@ -564,7 +784,7 @@ static int ashmem_pin_unpin(struct ashmem_area *asma, unsigned long cmd,
 		break;
 	}
 
-	mutex_unlock(&ashmem_mutex);
+	mutex_unlock(&asma->mutex);
 
 	return ret;
 }
@@ -583,10 +803,12 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		break;
 	case ASHMEM_SET_SIZE:
 		ret = -EINVAL;
+		mutex_lock(&asma->mutex);
 		if (!asma->file) {
 			ret = 0;
 			asma->size = (size_t) arg;
 		}
+		mutex_unlock(&asma->mutex);
 		break;
 	case ASHMEM_GET_SIZE:
 		ret = asma->size;
@@ -602,6 +824,12 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case ASHMEM_GET_PIN_STATUS:
 		ret = ashmem_pin_unpin(asma, cmd, (void __user *) arg);
 		break;
+	case ASHMEM_SET_PURGE_COST:
+		ret = set_purge_cost(asma, arg);
+		break;
+	case ASHMEM_GET_PURGE_COST:
+		ret = asma->purge_cost;
+		break;
 	case ASHMEM_PURGE_ALL_CACHES:
 		ret = -EPERM;
 		if (capable(CAP_SYS_ADMIN)) {
@@ -614,6 +842,47 @@ static long ashmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	return ret;
 }
 
+static int ashmem_read_proc_purges(char *page, char **start, off_t off,
+				   int count, int *eof, void *data)
+{
+	struct ashmem_purge_stat *stat;
+	int len = 0;
+	char *buf = page;
+	char *end = page + PAGE_SIZE;
+
+	if (off)
+		return 0;
+
+	mutex_lock(&ashmem_stat_mutex);
+	spin_lock(&ashmem_stat_lock);
+	buf += snprintf(buf, end - buf, "%-10s %12s  name\n",
+			"purges", "bytes");
+	list_for_each_entry(stat, &ashmem_stat_list, list) {
+		if (buf >= end)
+			break;
+		buf += snprintf(buf, end - buf, "%-10lu %12llu  %s\n",
+				stat->purges, stat->bytes, stat->name);
+	}
+	if (buf < end)
+		buf += snprintf(buf, end - buf, "%-10lu %12llu  %s\n",
+				ashmem_stat_default.purges,
+				ashmem_stat_default.bytes, "<other>");
+	spin_unlock(&ashmem_stat_lock);
+	mutex_unlock(&ashmem_stat_mutex);
+	if (buf > page + PAGE_SIZE)
+		buf = page + PAGE_SIZE;
+
+	*start = page + off;
+
+	len = buf - page;
+	if (len > off)
+		len -= off;
+	else
+		len = 0;
+
+	return len < count ? len  : count;
+}
+
 static struct file_operations ashmem_fops = {
 	.owner = THIS_MODULE,
 	.open = ashmem_open,
@@ -623,6 +892,33 @@ static struct file_operations ashmem_fops = {
 	.compat_ioctl = ashmem_ioctl,
 };
 
+/*
+ * ashmem_kernel_file - the backing file of an ashmem area, for in-kernel
+ * users that fill an area without mapping it. 'file' must be an open
+ * /dev/ashmem whose size is set; the backing file is created as the first
+ * mmap would do it. The caller owns the returned reference.
+ */
+struct file *ashmem_kernel_file(struct file *file)
+{
+	struct ashmem_area *asma = file->private_data;
+	int ret;
+
+	if (file->f_op != &ashmem_fops)
+		return ERR_PTR(-EBADF);
+
+	mutex_lock(&asma->mutex);
+	if (unlikely(!asma->size)) {
+		mutex_unlock(&asma->mutex);
+		return ERR_PTR(-EINVAL);
+	}
+	ret = ashmem_backing_setup(asma, 0);
+	if (!ret)
+		get_file(asma->file);
+	mutex_unlock(&asma->mutex);
+
+	return ret ? ERR_PTR(ret) : asma->file;
+}
+
 static struct miscdevice ashmem_misc = {
 	.minor = MISC_DYNAMIC_MINOR,
 	.name = "ashmem",
@@ -631,7 +927,10 @@ static struct miscdevice ashmem_misc = {
 
 static int __init ashmem_init(void)
 {
-	int ret;
+	int ret, i;
+
+	for (i = 0; i < ASHMEM_LRU_LEVELS; i++)
+		INIT_LIST_HEAD(&ashmem_lru_list[i]);
 
 	ashmem_area_cachep = kmem_cache_create("ashmem_area_cache",
 					  sizeof(struct ashmem_area),
@@ -657,6 +956,9 @@ static int __init ashmem_init(void)
 
 	register_shrinker(&ashmem_shrinker);
 
+	create_proc_read_entry("ashmem_purges", S_IRUGO, NULL,
+			       ashmem_read_proc_purges, NULL);
+
 	printk(KERN_INFO "ashmem: initialized\n");
 
 	return 0;
@@ -664,10 +966,15 @@ static int __init ashmem_init(void)
 
 static void __exit ashmem_exit(void)
 {
+	struct ashmem_purge_stat *stat, *tmp;
 	int ret;
 
+	remove_proc_entry("ashmem_purges", NULL);
 	unregister_shrinker(&ashmem_shrinker);
 
+	list_for_each_entry_safe(stat, tmp, &ashmem_stat_list, list)
+		kfree(stat);
+
 	ret = misc_deregister(&ashmem_misc);
 	if (unlikely(ret))
 		printk(KERN_ERR "ashmem: failed to unregister misc device!\n");
@@ -0,0 +1,457 @@
+/*
+ * mm/boot_readahead.c - record page cache misses at boot and replay them
+ *
+ * For the first boot_readahead= seconds of boot (default 30) every file
+ * range that had to be read from disk is noted. Reading
+ * /proc/boot_readahead returns the ranges as "start pages path" lines,
+ * in order of first use per file, sorted by offset within a file and
+ * with neighbouring ranges merged. Reading the file also ends recording.
+ *
+ * Writing such a profile back early on the next boot reads it in from
+ * a kernel thread as a few large readaheads, ahead of the tasks that
+ * will fault on it. The replay's own reads are recorded like any other
+ * miss, so the profile saved on that boot still covers them.
+ */
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/file.h>
+#include <linux/hash.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/kthread.h>
+#include <linux/jiffies.h>
+#include <linux/uaccess.h>
+#include "internal.h"
+
+#define BRA_MAX_FILES		1024
+#define BRA_MAX_EXTENTS		8192
+#define BRA_HASH_BITS		8
+/* ranges of one file closer than this many pages are read as one */
+#define BRA_MERGE_GAP		8
+
+struct bra_file {
+	struct hlist_node hash;
+	dev_t dev;
+	unsigned long ino;
+	char *path;
+};
+
+struct bra_extent {
+	unsigned int file;
+	pgoff_t start;
+	unsigned long nr;
+};
+
+/* one line of a profile being replayed */
+struct bra_item {
+	struct list_head list;
+	pgoff_t start;
+	unsigned long nr;
+	char path[0];
+};
+
+struct bra_load {
+	struct list_head items;
+	unsigned int len;
+	char buf[PAGE_SIZE];
+};
+
+int boot_readahead_recording;
+static unsigned int bra_secs = 30;
+static unsigned long bra_stop;
+
+static DEFINE_MUTEX(bra_mutex);
+static struct hlist_head bra_hash[1 << BRA_HASH_BITS];
+static struct bra_file *bra_files;
+static unsigned int bra_nr_files;
+static struct bra_extent *bra_extents;
+static unsigned int bra_nr_extents;
+static int bra_sorted;
+static int bra_replaying;
+
+static int __init boot_readahead_setup(char *str)
+{
+	bra_secs = simple_strtoul(str, NULL, 0);
+	return 1;
+}
+__setup("boot_readahead=", boot_readahead_setup);
+
+static int bra_file_index(struct file *filp)
+{
+	struct inode *inode = filp->f_mapping->host;
+	dev_t dev = inode->i_sb->s_dev;
+	struct hlist_head *head;
+	struct hlist_node *node;
+	struct bra_file *bf;
+	char *buf, *path;
+
+	head = &bra_hash[hash_long(inode->i_ino ^ dev, BRA_HASH_BITS)];
+	hlist_for_each_entry(bf, node, head, hash)
+		if (bf->ino == inode->i_ino && bf->dev == dev)
+			return bf - bra_files;
+
+	if (bra_nr_files == BRA_MAX_FILES)
+		return -ENOSPC;
+
+	/* we may be called from inside a filesystem, don't recurse into it */
+	buf = (char *)__get_free_page(GFP_NOFS);
+	if (!buf)
+		return -ENOMEM;
+
+	path = d_path(&filp->f_path, buf, PAGE_SIZE);
+	if (IS_ERR(path) || strchr(path, '\n')) {
+		free_page((unsigned long)buf);
+		return -EINVAL;
+	}
+
+	bf = &bra_files[bra_nr_files];
+	bf->path = kstrdup(path, GFP_NOFS);
+	free_page((unsigned long)buf);
+	if (!bf->path)
+		return -ENOMEM;
+
+	bf->dev = dev;
+	bf->ino = inode->i_ino;
+	hlist_add_head(&bf->hash, head);
+	return bra_nr_files++;
+}
+
+/*
+ * Note that pages [start, start + nr) of filp were read from disk.
+ */
+void __boot_readahead_record(struct file *filp, pgoff_t start,
+			     unsigned long nr)
+{
+	struct bra_extent *ext;
+	int file;
+
+	mutex_lock(&bra_mutex);
+
+	if (!boot_readahead_recording)
+		goto out;
+
+	if (time_after(jiffies, bra_stop)) {
+		boot_readahead_recording = 0;
+		goto out;
+	}
+
+	file = bra_file_index(filp);
+	if (file < 0)
+		goto out;
+
+	/* sequential readers mostly extend the range they read last */
+	if (bra_nr_extents) {
+		ext = &bra_extents[bra_nr_extents - 1];
+		if (ext->file == file && ext->start + ext->nr == start) {
+			ext->nr += nr;
+			goto out;
+		}
+	}
+
+	if (bra_nr_extents == BRA_MAX_EXTENTS) {
+		printk(KERN_INFO "boot_readahead: profile full, "
+		       "recording stopped\n");
+		boot_readahead_recording = 0;
+		goto out;
+	}
+
+	ext = &bra_extents[bra_nr_extents++];
+	ext->file = file;
+	ext->start = start;
+	ext->nr = nr;
+out:
+	mutex_unlock(&bra_mutex);
+}
+
+static int bra_extent_cmp(const void *a, const void *b)
+{
+	const struct bra_extent *l = a, *r = b;
+
+	if (l->file != r->file)
+		return l->file < r->file ? -1 : 1;
+	if (l->start != r->start)
+		return l->start < r->start ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Stop recording and turn the extent log into the profile: file
+ * indices are in order of first use, so sorting on (file, start) keeps
+ * the files in boot order and the reads within a file ascending.
+ */
+static void bra_finish(void)
+{
+	struct bra_extent *cur, *ext;
+	unsigned int i;
+
+	boot_readahead_recording = 0;
+	if (bra_sorted || !bra_nr_extents)
+		return;
+
+	sort(bra_extents, bra_nr_extents, sizeof(*bra_extents),
+	     bra_extent_cmp, NULL);
+
+	cur = bra_extents;
+	for (i = 1; i < bra_nr_extents; i++) {
+		ext = &bra_extents[i];
+		if (ext->file == cur->file &&
+		    ext->start <= cur->start + cur->nr + BRA_MERGE_GAP) {
+			if (ext->start + ext->nr > cur->start + cur->nr)
+				cur->nr = ext->start + ext->nr - cur->start;
+			continue;
+		}
+		*++cur = *ext;
+	}
+	bra_nr_extents = cur - bra_extents + 1;
+	bra_sorted = 1;
+}
+
+static void *bra_seq_start(struct seq_file *m, loff_t *pos)
+{
+	return *pos < bra_nr_extents ? &bra_extents[*pos] : NULL;
+}
+
+static void *bra_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return bra_seq_start(m, pos);
+}
+
+static void bra_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static int bra_seq_show(struct seq_file *m, void *v)
+{
+	struct bra_extent *ext = v;
+
+	seq_printf(m, "%lu %lu %s\n", ext->start, ext->nr,
+		   bra_files[ext->file].path);
+	return 0;
+}
+
+static const struct seq_operations bra_seq_ops = {
+	.start	= bra_seq_start,
+	.next	= bra_seq_next,
+	.stop	= bra_seq_stop,
+	.show	= bra_seq_show,
+};
+
+static int bra_replay(void *data)
+{
+	struct list_head *items = data;
+	struct bra_item *item, *next, *cur = NULL;
+	struct file *filp = NULL;
+	unsigned long start = jiffies;
+	unsigned long pages = 0;
+	unsigned int files = 0;
+
+	list_for_each_entry_safe(item, next, items, list) {
+		if (!cur || strcmp(cur->path, item->path)) {
+			if (filp && !IS_ERR(filp))
+				filp_close(filp, NULL);
+			kfree(cur);
+			cur = NULL;
+
+			filp = filp_open(item->path, O_RDONLY | O_LARGEFILE, 0);
+			if (!IS_ERR(filp))
+				files++;
+		}
+
+		if (!IS_ERR(filp)) {
+			int ret = force_page_cache_readahead(filp->f_mapping,
+						filp, item->start, item->nr);
+			if (ret > 0)
+				pages += ret;
+		}
+
+		list_del(&item->list);
+		if (cur)
+			kfree(item);
+		else
+			cur = item;
+	}
+
+	if (filp && !IS_ERR(filp))
+		filp_close(filp, NULL);
+	kfree(cur);
+	kfree(items);
+
+	printk(KERN_INFO "boot_readahead: read %lu pages of %u files in %u ms\n",
+	       pages, files, jiffies_to_msecs(jiffies - start));
+
+	mutex_lock(&bra_mutex);
+	bra_replaying = 0;
+	mutex_unlock(&bra_mutex);
+	return 0;
+}
+
+static int bra_parse_line(struct bra_load *load, char *line)
+{
+	struct bra_item *item;
+	unsigned long start, nr;
+	int off = 0;
+
+	if (sscanf(line, "%lu %lu %n", &start, &nr, &off) != 2 || !off)
+		return -EINVAL;
+	if (!nr || line[off] != '/')
+		return -EINVAL;
+
+	item = kmalloc(sizeof(*item) + strlen(line + off) + 1, GFP_KERNEL);
+	if (!item)
+		return -ENOMEM;
+
+	item->start = start;
+	item->nr = nr;
+	strcpy(item->path, line + off);
+	list_add_tail(&item->list, &load->items);
+	return 0;
+}
+
+static ssize_t bra_write(struct file *file, const char __user *buf,
+			 size_t count, loff_t *ppos)
+{
+	struct bra_load *load = file->private_data;
+	size_t done = 0;
+	char *nl;
+	int ret;
+
+	while (done < count) {
+		size_t chunk = min(count - done,
+				   (size_t)(sizeof(load->buf) - 1 - load->len));
+
+		if (!chunk)
+			return -EINVAL;	/* line too long */
+		if (copy_from_user(load->buf + load->len, buf + done, chunk))
+			return -EFAULT;
+		load->len += chunk;
+		load->buf[load->len] = '\0';
+		done += chunk;
+
+		while ((nl = strchr(load->buf, '\n'))) {
+			*nl = '\0';
+			ret = bra_parse_line(load, load->buf);
+			if (ret)
+				return ret;
+			load->len -= nl + 1 - load->buf;
+			memmove(load->buf, nl + 1, load->len + 1);
+		}
+	}
+
+	return count;
+}
+
+static int bra_open(struct inode *inode, struct file *file)
+{
+	struct bra_load *load;
+	int ret = 0;
+
+	if ((file->f_mode & FMODE_READ) && (file->f_mode & FMODE_WRITE))
+		return -EINVAL;
+
+	if (file->f_mode & FMODE_READ) {
+		mutex_lock(&bra_mutex);
+		bra_finish();
+		mutex_unlock(&bra_mutex);
+		return seq_open(file, &bra_seq_ops);
+	}
+
+	mutex_lock(&bra_mutex);
+	if (bra_replaying)
+		ret = -EBUSY;
+	else
+		bra_replaying = 1;
+	mutex_unlock(&bra_mutex);
+	if (ret)
+		return ret;
+
+	load = kmalloc(sizeof(*load), GFP_KERNEL);
+	if (!load) {
+		mutex_lock(&bra_mutex);
+		bra_replaying = 0;
+		mutex_unlock(&bra_mutex);
+		return -ENOMEM;
+	}
+	INIT_LIST_HEAD(&load->items);
+	load->len = 0;
+	file->private_data = load;
+	return 0;
+}
+
+/*
+ * The profile is complete once the writer closes the file; hand it to
+ * the replay thread and return straight away.
+ */
+static int bra_release(struct inode *inode, struct file *file)
+{
+	struct bra_load *load = file->private_data;
+	struct list_head *items;
+	struct bra_item *item, *next;
+	struct task_struct *tsk;
+
+	if (file->f_mode & FMODE_READ)
+		return seq_release(inode, file);
+
+	if (load->len)
+		bra_parse_line(load, load->buf);
+
+	items = kmalloc(sizeof(*items), GFP_KERNEL);
+	if (items && !list_empty(&load->items)) {
+		list_replace(&load->items, items);
+		tsk = kthread_run(bra_replay, items, "boot_readahead");
+		if (!IS_ERR(tsk))
+			goto out;
+		list_splice(items, &load->items);
+	}
+
+	list_for_each_entry_safe(item, next, &load->items, list)
+		kfree(item);
+	kfree(items);
+	mutex_lock(&bra_mutex);
+	bra_replaying = 0;
+	mutex_unlock(&bra_mutex);
+out:
+	kfree(load);
+	return 0;
+}
+
+static const struct file_operations bra_fops = {
+	.open		= bra_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.write		= bra_write,
+	.release	= bra_release,
+};
+
+static int __init boot_readahead_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(bra_hash); i++)
+		INIT_HLIST_HEAD(&bra_hash[i]);
+
+	if (bra_secs) {
+		bra_files = vmalloc(BRA_MAX_FILES * sizeof(*bra_files));
+		bra_extents = vmalloc(BRA_MAX_EXTENTS * sizeof(*bra_extents));
+		if (bra_files && bra_extents) {
+			bra_stop = jiffies + bra_secs * HZ;
+			boot_readahead_recording = 1;
+		} else {
+			vfree(bra_files);
+			vfree(bra_extents);
+			bra_files = NULL;
+			bra_extents = NULL;
+		}
+	}
+
+	proc_create("boot_readahead", S_IRUSR | S_IWUSR, NULL, &bra_fops);
+	return 0;
+}
+core_initcall(boot_readahead_init);
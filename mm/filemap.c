@@ -470,10 +470,12 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 
 	ret = add_to_page_cache(page, mapping, offset, gfp_mask);
 	if (ret == 0) {
-		if (page_is_file_cache(page))
-			lru_cache_add_file(page);
-		else
+		if (!page_is_file_cache(page))
 			lru_cache_add_anon(page);
+		else if (workingset_refault(mapping, offset))
+			lru_cache_add_active_file(page);
+		else
+			lru_cache_add_file(page);
 	}
 	return ret;
 }
@@ -1188,6 +1190,7 @@ no_cached_page:
 			desc->error = error;
 			goto out;
 		}
+		boot_readahead_record(filp, index, 1);
 		goto readpage;
 	}
 
@@ -1411,8 +1414,10 @@ static int page_cache_read(struct file *file, pgoff_t offset)
 			return -ENOMEM;
 
 		ret = add_to_page_cache_lru(page, mapping, offset, GFP_KERNEL);
-		if (ret == 0)
+		if (ret == 0) {
+			boot_readahead_record(file, offset, 1);
 			ret = mapping->a_ops->readpage(file, page);
+		}
 		else if (ret == -EEXIST)
 			ret = 0; /* losing race to add is OK */
 
@@ -122,8 +122,10 @@ static void flush_all_zero_pkmaps(void)
 		set_page_address(page, NULL);
 		need_flush = 1;
 	}
-	if (need_flush)
+	if (need_flush) {
 		flush_tlb_kernel_range(PKMAP_ADDR(0), PKMAP_ADDR(LAST_PKMAP));
+		count_vm_event(PKMAP_FLUSH);
+	}
 }
 
 /**
@@ -161,6 +163,7 @@ start:
 		{
 			DECLARE_WAITQUEUE(wait, current);
 
+			count_vm_event(PKMAP_WAIT);
 			__set_current_state(TASK_UNINTERRUPTIBLE);
 			add_wait_queue(&pkmap_map_wait, &wait);
 			unlock_kmap();
@@ -203,9 +206,12 @@ void *kmap_high(struct page *page)
 	 * after we have the lock.
 	 */
 	lock_kmap();
+	count_vm_event(KMAP_HIGH);
 	vaddr = (unsigned long)page_address(page);
-	if (!vaddr)
+	if (!vaddr) {
+		count_vm_event(KMAP_HIGH_NEW);
 		vaddr = map_new_virtual(page);
+	}
 	pkmap_count[PKMAP_NR(vaddr)]++;
 	BUG_ON(pkmap_count[PKMAP_NR(vaddr)] < 2);
 	unlock_kmap();
@@ -256,6 +256,25 @@ int __get_user_pages(struct task_struct *tsk, struct mm_struct *mm,
 		     unsigned long start, int len, unsigned int foll_flags,
 		     struct page **pages, struct vm_area_struct **vmas);
 
+#ifdef CONFIG_BOOT_READAHEAD
+extern int boot_readahead_recording;
+extern void __boot_readahead_record(struct file *filp, pgoff_t start,
+				    unsigned long nr);
+
+/* pages [start, start + nr) of filp are being read in from disk */
+static inline void boot_readahead_record(struct file *filp, pgoff_t start,
+					 unsigned long nr)
+{
+	if (unlikely(boot_readahead_recording) && filp)
+		__boot_readahead_record(filp, start, nr);
+}
+#else
+static inline void boot_readahead_record(struct file *filp, pgoff_t start,
+					 unsigned long nr)
+{
+}
+#endif
+
 #define ZONE_RECLAIM_NOSCAN	-2
 #define ZONE_RECLAIM_FULL	-1
 #define ZONE_RECLAIM_SOME	0
@@ -32,6 +32,9 @@
 #include <linux/mmu_notifier.h>
 #include <linux/swap.h>
 #include <linux/ksm.h>
+#include <linux/oom.h>
+#include <linux/power_supply.h>
+#include <linux/earlysuspend.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -82,12 +85,14 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's list of rmap_items
  * @mm: the mm that this information is valid for
+ * @cputime: cpu time of its process when the last pass looked at it
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct list_head rmap_list;
 	struct mm_struct *mm;
+	cputime_t cputime;
 };
 
 /**
@@ -172,6 +177,30 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/*
+ * Targeted mode: only scan processes in the background (oom_adj at or
+ * above ksm_targeted_oom_adj) or that used no cpu since the last pass,
+ * with a budget that depends on the screen and charger. pages_to_scan
+ * is the budget with the screen off on battery.
+ */
+static unsigned int ksm_targeted;
+static int ksm_targeted_oom_adj = 7;
+static unsigned int ksm_pages_to_scan_screen_on;
+static unsigned int ksm_pages_to_scan_charging = 1000;
+static int ksm_screen_on = 1;
+
+/* Rough cpu power while ksmd runs, to turn its cpu time into energy */
+static unsigned int ksm_cpu_power_mw = 400;
+
+/* Current and last full pass */
+struct ksm_pass_stats {
+	unsigned long scanned;
+	unsigned long merged;
+	u64 start_ns;
+	u64 cpu_ns;
+};
+static struct ksm_pass_stats ksm_pass, ksm_last_pass;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -1106,6 +1135,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			 * add its rmap_item to the stable tree.
 			 */
 			stable_tree_append(rmap_item, tree_rmap_item);
+			ksm_pass.merged++;
 		}
 		return;
 	}
@@ -1153,9 +1183,10 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			 * to a ksm page left outside the stable tree,
 			 * in which case we need to break_cow on both.
 			 */
-			if (stable_tree_insert(page2[0], tree_rmap_item))
+			if (stable_tree_insert(page2[0], tree_rmap_item)) {
 				stable_tree_append(rmap_item, tree_rmap_item);
-			else {
+				ksm_pass.merged++;
+			} else {
 				break_cow(tree_rmap_item->mm,
 						tree_rmap_item->address);
 				break_cow(rmap_item->mm, rmap_item->address);
@@ -1197,6 +1228,69 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+/*
+ * Targeted mode wants an mm if its process is in the background or has
+ * been idle since the last pass. A process that can't be found is left
+ * to the normal path, which notices the mm exiting.
+ */
+static int ksm_mm_wanted(struct mm_slot *slot)
+{
+	struct task_struct *p;
+	struct task_cputime times;
+	cputime_t cputime;
+	int wanted = 1;
+
+	read_lock(&tasklist_lock);
+	for_each_process(p) {
+		if (p->mm != slot->mm)
+			continue;
+		thread_group_cputime(p, &times);
+		cputime = cputime_add(times.utime, times.stime);
+		wanted = p->signal->oom_adj >= ksm_targeted_oom_adj ||
+			 cputime_eq(cputime, slot->cputime);
+		slot->cputime = cputime;
+		break;
+	}
+	read_unlock(&tasklist_lock);
+	return wanted;
+}
+
+/*
+ * The unstable tree is rebuilt every pass, so an mm passed over must not
+ * keep rmap_items claiming to be in it.
+ */
+static void ksm_forget_unstable(struct mm_slot *slot)
+{
+	struct rmap_item *rmap_item;
+
+	list_for_each_entry(rmap_item, &slot->rmap_list, link)
+		if (!in_stable_tree(rmap_item))
+			remove_rmap_item_from_tree(rmap_item);
+}
+
+static unsigned int ksm_scan_budget(void)
+{
+	if (!ksm_targeted)
+		return ksm_thread_pages_to_scan;
+	if (power_supply_is_system_supplied() > 0)
+		return ksm_pages_to_scan_charging;
+	if (ksm_screen_on)
+		return ksm_pages_to_scan_screen_on;
+	return ksm_thread_pages_to_scan;
+}
+
+static void ksm_pass_done(void)
+{
+	ksm_pass.cpu_ns = current->se.sum_exec_runtime - ksm_pass.start_ns;
+	ksm_last_pass = ksm_pass;
+	pr_debug("ksm: pass %lu scanned %lu merged %lu cpu %llu us\n",
+		 ksm_scan.seqnr, ksm_pass.scanned, ksm_pass.merged,
+		 ksm_pass.cpu_ns / NSEC_PER_USEC);
+
+	memset(&ksm_pass, 0, sizeof(ksm_pass));
+	ksm_pass.start_ns = current->se.sum_exec_runtime;
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1219,6 +1313,16 @@ next_mm:
 		ksm_scan.address = 0;
 		ksm_scan.rmap_item = list_entry(&slot->rmap_list,
 						struct rmap_item, link);
+
+		if (ksm_targeted && !ksm_test_exit(slot->mm) &&
+		    !ksm_mm_wanted(slot)) {
+			ksm_forget_unstable(slot);
+			spin_lock(&ksm_mmlist_lock);
+			ksm_scan.mm_slot = list_entry(slot->mm_list.next,
+						struct mm_slot, mm_list);
+			spin_unlock(&ksm_mmlist_lock);
+			goto next_slot;
+		}
 	}
 
 	mm = slot->mm;
@@ -1298,11 +1402,13 @@ next_mm:
 		up_read(&mm->mmap_sem);
 	}
 
+next_slot:
 	/* Repeat until we've completed scanning the whole list */
 	slot = ksm_scan.mm_slot;
 	if (slot != &ksm_mm_head)
 		goto next_mm;
 
+	ksm_pass_done();
 	ksm_scan.seqnr++;
 	return NULL;
 }
@@ -1321,6 +1427,7 @@ static void ksm_do_scan(unsigned int scan_npages)
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
 			return;
+		ksm_pass.scanned++;
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
 		else if (page_mapcount(page) == 1) {
@@ -1342,15 +1449,22 @@ static int ksmd_should_run(void)
 
 static int ksm_scan_thread(void *nothing)
 {
+	unsigned int budget;
+
 	set_user_nice(current, 5);
+	ksm_pass.start_ns = current->se.sum_exec_runtime;
 
 	while (!kthread_should_stop()) {
+		budget = ksm_scan_budget();
 		mutex_lock(&ksm_thread_mutex);
 		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+			ksm_do_scan(budget);
 		mutex_unlock(&ksm_thread_mutex);
 
-		if (ksmd_should_run()) {
+		if (ksmd_should_run() && !budget) {
+			/* nothing to do until the screen or charger changes */
+			schedule_timeout_interruptible(HZ);
+		} else if (ksmd_should_run()) {
 			schedule_timeout_interruptible(
 				msecs_to_jiffies(ksm_thread_sleep_millisecs));
 		} else {
@@ -1645,6 +1759,74 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+#define KSM_UINT_ATTR(_name, _var)					\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%u\n", _var);				\
+}									\
+static ssize_t _name##_store(struct kobject *kobj,			\
+			     struct kobj_attribute *attr,		\
+			     const char *buf, size_t count)		\
+{									\
+	unsigned long val;						\
+									\
+	if (strict_strtoul(buf, 10, &val) || val > UINT_MAX)		\
+		return -EINVAL;						\
+	_var = val;							\
+	return count;							\
+}									\
+KSM_ATTR(_name)
+
+KSM_UINT_ATTR(targeted, ksm_targeted);
+KSM_UINT_ATTR(pages_to_scan_screen_on, ksm_pages_to_scan_screen_on);
+KSM_UINT_ATTR(pages_to_scan_charging, ksm_pages_to_scan_charging);
+KSM_UINT_ATTR(cpu_power_mw, ksm_cpu_power_mw);
+
+static ssize_t targeted_oom_adj_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", ksm_targeted_oom_adj);
+}
+
+static ssize_t targeted_oom_adj_store(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	long adj;
+
+	if (strict_strtol(buf, 10, &adj) || adj < OOM_DISABLE ||
+	    adj > OOM_ADJUST_MAX)
+		return -EINVAL;
+	ksm_targeted_oom_adj = adj;
+	return count;
+}
+KSM_ATTR(targeted_oom_adj);
+
+/*
+ * The energy is ksmd's cpu time at cpu_power_mw, which leaves out the
+ * memory traffic but is good enough to compare settings.
+ */
+static ssize_t last_pass_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	struct ksm_pass_stats pass = ksm_last_pass;
+	u64 uj = div_u64(pass.cpu_ns * ksm_cpu_power_mw, NSEC_PER_USEC *
+			 1000);
+	u64 scanned_per_j = 0, merged_per_j = 0;
+
+	if (uj) {
+		scanned_per_j = div64_u64((u64)pass.scanned * USEC_PER_SEC, uj);
+		merged_per_j = div64_u64((u64)pass.merged * USEC_PER_SEC, uj);
+	}
+	return sprintf(buf, "scanned %lu\nmerged %lu\ncpu_us %llu\n"
+		       "energy_uj %llu\nscanned_per_joule %llu\n"
+		       "merged_per_joule %llu\n", pass.scanned, pass.merged,
+		       div_u64(pass.cpu_ns, NSEC_PER_USEC), uj,
+		       scanned_per_j, merged_per_j);
+}
+KSM_ATTR_RO(last_pass);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1655,6 +1837,12 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&targeted_attr.attr,
+	&targeted_oom_adj_attr.attr,
+	&pages_to_scan_screen_on_attr.attr,
+	&pages_to_scan_charging_attr.attr,
+	&cpu_power_mw_attr.attr,
+	&last_pass_attr.attr,
 	NULL,
 };
 
@@ -1664,6 +1852,23 @@ static struct attribute_group ksm_attr_group = {
 };
 #endif /* CONFIG_SYSFS */
 
+#ifdef CONFIG_HAS_EARLYSUSPEND
+static void ksm_early_suspend(struct early_suspend *h)
+{
+	ksm_screen_on = 0;
+}
+
+static void ksm_late_resume(struct early_suspend *h)
+{
+	ksm_screen_on = 1;
+}
+
+static struct early_suspend ksm_early_suspend_handler = {
+	.suspend = ksm_early_suspend,
+	.resume = ksm_late_resume,
+};
+#endif
+
 static int __init ksm_init(void)
 {
 	struct task_struct *ksm_thread;
@@ -1698,6 +1903,11 @@ static int __init ksm_init(void)
 
 #endif /* CONFIG_SYSFS */
 
+#ifdef CONFIG_HAS_EARLYSUSPEND
+	register_early_suspend(&ksm_early_suspend_handler);
+#else
+	ksm_screen_on = 0;
+#endif
 	return 0;
 
 out_free2:
@@ -0,0 +1,170 @@
+/*
+ * mm/lendable.c - contiguous ranges lent to the page allocator while idle
+ *
+ * A driver that needs a large physically contiguous buffer only some of
+ * the time (a camera or video encoder) declares its range lendable
+ * instead of keeping it out of the kernel's memory. The pageblocks are
+ * marked MIGRATE_LENDABLE, which only movable allocations fall back to,
+ * so everything living there can be migrated away again.
+ *
+ * Claiming isolates the range, migrates the pages in use out of it and
+ * takes the free pages out of the buddy allocator in one go. Anything
+ * that can't be moved (a page pinned by get_user_pages for instance)
+ * fails the claim with -EBUSY and the range is handed back as it was.
+ */
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/swap.h>
+#include <linux/migrate.h>
+#include <linux/mm_inline.h>
+#include <linux/page-isolation.h>
+#include <linux/pageblock-flags.h>
+#include <linux/lendable.h>
+#include <linux/sched.h>
+#include "internal.h"
+
+#define LENDABLE_MIGRATE_BATCH	256
+#define LENDABLE_CLAIM_RETRIES	5
+
+static int lendable_range_ok(unsigned long start_pfn, unsigned long nr_pages)
+{
+	unsigned long end_pfn = start_pfn + nr_pages;
+
+	if (!nr_pages || ((start_pfn | nr_pages) & (MAX_ORDER_NR_PAGES - 1)))
+		return 0;
+	if (!pfn_valid(start_pfn) || !pfn_valid(end_pfn - 1))
+		return 0;
+	return page_zone(pfn_to_page(start_pfn)) ==
+		page_zone(pfn_to_page(end_pfn - 1));
+}
+
+static void lendable_mark(unsigned long start_pfn, unsigned long end_pfn)
+{
+	unsigned long pfn;
+
+	for (pfn = start_pfn; pfn < end_pfn; pfn += pageblock_nr_pages)
+		set_migratetype_lendable(pfn_to_page(pfn));
+}
+
+/*
+ * Let movable allocations borrow the range. Pages of the range that the
+ * caller still owns are given back with lendable_release().
+ */
+int lendable_declare(unsigned long start_pfn, unsigned long nr_pages)
+{
+	unsigned long end_pfn = start_pfn + nr_pages;
+	unsigned long pfn, undo_pfn;
+	struct page *page;
+
+	if (!lendable_range_ok(start_pfn, nr_pages))
+		return -EINVAL;
+
+	for (pfn = start_pfn; pfn < end_pfn; pfn += pageblock_nr_pages) {
+		if (set_migratetype_lendable(pfn_to_page(pfn)))
+			goto undo;
+	}
+	return 0;
+undo:
+	/* back to plain movable blocks */
+	for (undo_pfn = start_pfn; undo_pfn < pfn;
+	     undo_pfn += pageblock_nr_pages) {
+		page = pfn_to_page(undo_pfn);
+		if (!set_migratetype_isolate(page))
+			unset_migratetype_isolate(page);
+	}
+	return -EBUSY;
+}
+
+static struct page *
+lendable_migrate_alloc(struct page *page, unsigned long private, int **x)
+{
+	return alloc_page(GFP_HIGHUSER_MOVABLE);
+}
+
+/*
+ * Move the pages in use out of an isolated range. Returns the number of
+ * pages left behind.
+ */
+static int lendable_migrate_range(unsigned long start_pfn,
+				  unsigned long end_pfn)
+{
+	unsigned long pfn;
+	struct page *page;
+	int batch = 0, busy = 0;
+	LIST_HEAD(source);
+
+	for (pfn = start_pfn; pfn < end_pfn; pfn++) {
+		page = pfn_to_page(pfn);
+		if (!get_page_unless_zero(page))
+			continue;
+		if (!isolate_lru_page(page)) {
+			list_add_tail(&page->lru, &source);
+			inc_zone_page_state(page, NR_ISOLATED_ANON +
+					    page_is_file_cache(page));
+			batch++;
+		} else
+			busy++;
+		put_page(page);
+
+		if (batch == LENDABLE_MIGRATE_BATCH) {
+			/* this function returns # of failed pages */
+			busy += migrate_pages(&source, lendable_migrate_alloc, 0);
+			batch = 0;
+			cond_resched();
+		}
+	}
+	if (batch)
+		busy += migrate_pages(&source, lendable_migrate_alloc, 0);
+	return busy;
+}
+
+/*
+ * Take the whole range for the caller. The pages come back with a zero
+ * count and their old contents, the caller clears them if it needs to.
+ */
+int lendable_claim(unsigned long start_pfn, unsigned long nr_pages)
+{
+	unsigned long end_pfn = start_pfn + nr_pages;
+	int tries = LENDABLE_CLAIM_RETRIES;
+	int busy, ret;
+
+	if (!lendable_range_ok(start_pfn, nr_pages))
+		return -EINVAL;
+
+	ret = start_isolate_page_range(start_pfn, end_pfn);
+	if (ret)
+		return ret;
+
+	do {
+		/* pages sitting in pagevecs aren't on the lru yet */
+		lru_add_drain_all();
+		busy = lendable_migrate_range(start_pfn, end_pfn);
+		drain_all_pages();
+		ret = take_isolated_page_range(start_pfn, end_pfn);
+	} while (ret && --tries);
+
+	if (ret) {
+		printk(KERN_INFO "lendable: range %lx-%lx busy, %d pages "
+		       "could not be moved\n", start_pfn, end_pfn, busy);
+		lendable_mark(start_pfn, end_pfn);
+	}
+	return ret;
+}
+
+/*
+ * Hand a claimed range back to the page allocator.
+ */
+void lendable_release(unsigned long start_pfn, unsigned long nr_pages)
+{
+	unsigned long end_pfn = start_pfn + nr_pages;
+	unsigned long pfn;
+	struct page *page;
+
+	/* retype first so the freed pages land on the lendable lists */
+	lendable_mark(start_pfn, end_pfn);
+	for (pfn = start_pfn; pfn < end_pfn; pfn++) {
+		page = pfn_to_page(pfn);
+		init_page_count(page);
+		__free_page(page);
+	}
+}
@@ -70,6 +70,17 @@ static long madvise_behavior(struct vm_area_struct * vma,
 		if (error)
 			goto out;
 		break;
+	case MADV_LAZYFORK:
+		if (vma->vm_flags & (VM_SHARED | VM_HUGETLB | VM_NONLINEAR |
+				     VM_PFNMAP | VM_MIXEDMAP | VM_IO)) {
+			error = -EINVAL;
+			goto out;
+		}
+		new_flags |= VM_LAZYFORK;
+		break;
+	case MADV_NOLAZYFORK:
+		new_flags &= ~VM_LAZYFORK;
+		break;
 	}
 
 	if (new_flags == vma->vm_flags) {
@@ -275,6 +286,10 @@ madvise_behavior_valid(int behavior)
 #ifdef CONFIG_KSM
 	case MADV_MERGEABLE:
 	case MADV_UNMERGEABLE:
+#endif
+#ifdef CONFIG_LAZY_FORK
+	case MADV_LAZYFORK:
+	case MADV_NOLAZYFORK:
 #endif
 		return 1;
 
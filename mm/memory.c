@@ -566,6 +566,291 @@ out:
 	return pfn_to_page(pfn);
 }
 
+#ifdef CONFIG_LAZY_FORK
+/*
+ * Lazy fork: page tables of MADV_LAZYFORK mappings are not copied on
+ * fork but shared between parent and child, with every pte in them
+ * write protected.  The share count is the page count of the page
+ * table page.  Each side copies a shared table on its first fault
+ * inside it, so a zygote-style fork touches one pmd per 2MB of heap
+ * instead of every pte.
+ *
+ * While shared, a table is accounted once in page_mapcount() and in
+ * the swap counts of its entries, and is covered by exactly one vma
+ * in every mm that maps it: split_vma(), mprotect(), mremap() and
+ * partial zaps unshare first.  Both mms see the same pte lock only
+ * with split ptlocks or on UP, so sharing is limited to those.
+ */
+#define VM_NO_LAZYFORK	(VM_SHARED | VM_MAYSHARE | VM_HUGETLB | VM_NONLINEAR | \
+			 VM_PFNMAP | VM_INSERTPAGE | VM_MIXEDMAP | VM_IO | \
+			 VM_LOCKED | VM_GROWSDOWN | VM_GROWSUP)
+
+#if USE_SPLIT_PTLOCKS
+#define pgtable_lockptr(mm, table)	({(void)(mm); __pte_lockptr(table);})
+#define LAZY_FORK_PTLOCKS_SHARED	1
+#else
+#define pgtable_lockptr(mm, table)	({(void)(table); &(mm)->page_table_lock;})
+#ifdef CONFIG_SMP
+#define LAZY_FORK_PTLOCKS_SHARED	0
+#else
+#define LAZY_FORK_PTLOCKS_SHARED	1
+#endif
+#endif
+
+static inline int vma_lazy_fork(struct vm_area_struct *vma)
+{
+	return LAZY_FORK_PTLOCKS_SHARED &&
+		(vma->vm_flags & (VM_LAZYFORK | VM_NO_LAZYFORK)) == VM_LAZYFORK;
+}
+
+static pmd_t *lazy_fork_pmd(struct mm_struct *mm, unsigned long addr)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, addr);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		return NULL;
+	pud = pud_offset(pgd, addr);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		return NULL;
+	pmd = pmd_offset(pud, addr);
+	if (!pmd_present(*pmd) || unlikely(pmd_bad(*pmd)))
+		return NULL;
+	return pmd;
+}
+
+/*
+ * Hand the child the parent's page table for [addr, addr + PMD_SIZE)
+ * instead of copying it.  The caller guarantees that the whole range
+ * lies inside vma.
+ */
+static void share_pte_table(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+		pmd_t *dst_pmd, pmd_t *src_pmd, struct vm_area_struct *vma,
+		unsigned long addr)
+{
+	struct page *table = pmd_page(*src_pmd);
+	unsigned long end = addr + PMD_SIZE;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+	int rss[2] = { 0, 0 };
+
+	pte = orig_pte = pte_offset_map_lock(src_mm, src_pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	do {
+		pte_t ptent = *pte;
+		struct page *page;
+
+		if (pte_none(ptent))
+			continue;
+		if (!pte_present(ptent)) {
+			swp_entry_t entry;
+
+			if (pte_file(ptent))
+				continue;
+			entry = pte_to_swp_entry(ptent);
+			if (is_write_migration_entry(entry) &&
+			    is_cow_mapping(vma->vm_flags)) {
+				make_migration_entry_read(&entry);
+				set_pte_at(src_mm, addr, pte,
+					   swp_entry_to_pte(entry));
+			}
+			continue;
+		}
+		if (is_cow_mapping(vma->vm_flags) && pte_write(ptent))
+			ptep_set_wrprotect(src_mm, addr, pte);
+		page = vm_normal_page(vma, addr, ptent);
+		if (page)
+			rss[PageAnon(page)]++;
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	arch_leave_lazy_mmu_mode();
+	get_page(table);
+	pte_unmap_unlock(orig_pte, ptl);
+
+	spin_lock(&dst_mm->page_table_lock);
+	pmd_populate(dst_mm, dst_pmd, table);
+	dst_mm->nr_ptes++;
+	spin_unlock(&dst_mm->page_table_lock);
+	add_mm_rss(dst_mm, rss[0], rss[1]);
+
+	/* swap entries in the table must stay reachable by swapoff */
+	if (unlikely(!list_empty(&src_mm->mmlist) &&
+		     list_empty(&dst_mm->mmlist))) {
+		spin_lock(&mmlist_lock);
+		if (list_empty(&dst_mm->mmlist))
+			list_add(&dst_mm->mmlist, &src_mm->mmlist);
+		spin_unlock(&mmlist_lock);
+	}
+	count_vm_event(LAZYFORK_PTE_SHARED);
+}
+
+/*
+ * Give mm a private copy of the shared page table under pmd.  Every
+ * entry gains the page, rmap and swap references a regular fork would
+ * have taken; rss was already accounted when the table was shared.
+ */
+static int unshare_pte_table(struct mm_struct *mm, struct vm_area_struct *vma,
+		pmd_t *pmd, unsigned long addr)
+{
+	unsigned long start = addr & PMD_MASK, end = start + PMD_SIZE;
+	spinlock_t *old_ptl, *new_ptl;
+	pte_t *src_pte, *dst_pte, *orig_src, *orig_dst;
+	struct page *old;
+	pgtable_t new;
+
+	new = pte_alloc_one(mm, start);
+	if (!new)
+		return -ENOMEM;
+	smp_wmb(); /* See comment in __pte_alloc */
+
+	spin_lock(&mm->page_table_lock);
+	if (!pmd_present(*pmd)) {
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, new);
+		return 0;
+	}
+	old = pmd_page(*pmd);
+	old_ptl = pte_lockptr(mm, pmd);
+	if (old_ptl != &mm->page_table_lock)
+		spin_lock_nested(old_ptl, SINGLE_DEPTH_NESTING);
+	if (page_count(old) == 1) {
+		/* the other sharers went away meanwhile */
+		if (old_ptl != &mm->page_table_lock)
+			spin_unlock(old_ptl);
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, new);
+		return 0;
+	}
+	new_ptl = pgtable_lockptr(mm, new);
+	if (new_ptl != &mm->page_table_lock)
+		spin_lock_nested(new_ptl, SINGLE_DEPTH_NESTING + 1);
+
+	src_pte = orig_src = pte_offset_map_nested(pmd, start);
+	pmd_populate(mm, pmd, new);
+	dst_pte = orig_dst = pte_offset_map(pmd, start);
+	arch_enter_lazy_mmu_mode();
+	for (addr = start; addr != end; addr += PAGE_SIZE, src_pte++, dst_pte++) {
+		pte_t pte = *src_pte;
+		struct page *page;
+
+		if (pte_none(pte))
+			continue;
+		if (!pte_present(pte)) {
+			if (!pte_file(pte))
+				swap_duplicate(pte_to_swp_entry(pte));
+		} else {
+			page = vm_normal_page(vma, addr, pte);
+			if (page) {
+				get_page(page);
+				page_dup_rmap(page);
+			}
+		}
+		set_pte_at(mm, addr, dst_pte, pte);
+	}
+	arch_leave_lazy_mmu_mode();
+	pte_unmap(orig_dst);
+	pte_unmap_nested(orig_src);
+	/* other sharers still hold references, this never frees the table */
+	put_page(old);
+
+	if (new_ptl != &mm->page_table_lock)
+		spin_unlock(new_ptl);
+	if (old_ptl != &mm->page_table_lock)
+		spin_unlock(old_ptl);
+	spin_unlock(&mm->page_table_lock);
+
+	flush_tlb_range(vma, start, end);
+	count_vm_event(LAZYFORK_PTE_UNSHARED);
+	return 0;
+}
+
+/*
+ * Copy every shared page table that maps part of [start, end) in vma.
+ * Called before anything modifies ptes in the range from this mm's
+ * side, and on faults.
+ */
+int unshare_pte_range(struct vm_area_struct *vma, unsigned long start,
+		unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long addr = start, next;
+	pmd_t *pmd;
+	int err;
+
+	do {
+		next = pmd_addr_end(addr, end);
+		pmd = lazy_fork_pmd(mm, addr);
+		if (pmd && pte_table_shared(pmd)) {
+			err = unshare_pte_table(mm, vma, pmd, addr);
+			if (err)
+				return err;
+		}
+	} while (addr = next, addr != end);
+	return 0;
+}
+
+/*
+ * A pte in a shared table was cleared through rmap: the TLB of the
+ * other sharers may still hold it, and we do not know which mms they
+ * are.  Called with the pte lock held.
+ */
+void flush_shared_pte_table(struct mm_struct *mm, unsigned long address)
+{
+	pmd_t *pmd = lazy_fork_pmd(mm, address);
+
+	if (pmd && pte_table_shared(pmd))
+		flush_tlb_all();
+}
+
+/*
+ * Unmapping a whole shared table from one mm only drops that mm's
+ * reference to it; the ptes stay for the other sharers.
+ */
+static int zap_shared_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+		unsigned long addr, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *table = pmd_page(*pmd);
+	spinlock_t *ptl = pte_lockptr(mm, pmd);
+	int dropped = 0;
+
+	spin_lock(&mm->page_table_lock);
+	if (ptl != &mm->page_table_lock)
+		spin_lock_nested(ptl, SINGLE_DEPTH_NESTING);
+	if (page_count(table) > 1) {
+		pmd_clear(pmd);
+		put_page(table);
+		mm->nr_ptes--;
+		dropped = 1;
+	}
+	if (ptl != &mm->page_table_lock)
+		spin_unlock(ptl);
+	spin_unlock(&mm->page_table_lock);
+
+	if (dropped)
+		flush_tlb_range(vma, addr, end);
+	return dropped;
+}
+#else
+static inline int vma_lazy_fork(struct vm_area_struct *vma)
+{
+	return 0;
+}
+
+static inline void share_pte_table(struct mm_struct *dst_mm,
+		struct mm_struct *src_mm, pmd_t *dst_pmd, pmd_t *src_pmd,
+		struct vm_area_struct *vma, unsigned long addr)
+{
+}
+
+static inline int zap_shared_pte_table(struct vm_area_struct *vma,
+		pmd_t *pmd, unsigned long addr, unsigned long end)
+{
+	return 0;
+}
+#endif /* CONFIG_LAZY_FORK */
+
 /*
  * copy one vm_area from one task to the other. Assumes the page tables
  * already present in the new task to be cleared in the whole range
@@ -704,6 +989,11 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 		next = pmd_addr_end(addr, end);
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
+		if (vma_lazy_fork(vma) && next - addr == PMD_SIZE) {
+			share_pte_table(dst_mm, src_mm, dst_pmd, src_pmd,
+					vma, addr);
+			continue;
+		}
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
 						vma, addr, next))
 			return -ENOMEM;
@@ -805,8 +1095,10 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 	spinlock_t *ptl;
 	int file_rss = 0;
 	int anon_rss = 0;
+	int shared;
 
 	pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	shared = pte_table_shared(pmd);
 	arch_enter_lazy_mmu_mode();
 	do {
 		pte_t ptent = *pte;
@@ -882,6 +1174,9 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 
 	add_mm_rss(mm, file_rss, anon_rss);
 	arch_leave_lazy_mmu_mode();
+	/* truncation zapped a shared table in place, for all its sharers */
+	if (unlikely(shared))
+		flush_tlb_all();
 	pte_unmap_unlock(pte - 1, ptl);
 
 	return addr;
@@ -902,6 +1197,14 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 			(*zap_work)--;
 			continue;
 		}
+		if (unlikely(pte_table_shared(pmd)) && !details) {
+			/* partial zaps unshare in zap_page_range() */
+			if (WARN_ON_ONCE(next - addr != PMD_SIZE) ||
+			    zap_shared_pte_table(vma, pmd, addr, next)) {
+				(*zap_work)--;
+				continue;
+			}
+		}
 		next = zap_pte_range(tlb, vma, pmd, addr, next,
 						zap_work, details);
 	} while (pmd++, addr = next, (addr != end && *zap_work > 0));
@@ -1092,6 +1395,13 @@ unsigned long zap_page_range(struct vm_area_struct *vma, unsigned long address,
 	unsigned long end = address + size;
 	unsigned long nr_accounted = 0;
 
+	if (!details) {
+		/* a shared table is dropped whole, or copied first */
+		if (address & ~PMD_MASK)
+			unshare_pte_range(vma, address, address + 1);
+		if (end & ~PMD_MASK)
+			unshare_pte_range(vma, end - 1, end);
+	}
 	lru_add_drain();
 	tlb = tlb_gather_mmu(mm, 0);
 	update_hiwater_rss(mm);
@@ -2922,6 +3232,97 @@ unwritable_page:
 	return ret;
 }
 
+/*
+ * Number of pages around a read fault on a page cache mapping that are
+ * mapped in one go when they are already cached and uptodate. The
+ * window is aligned to its own size and never leaves the vma or the
+ * page table of the faulting address. 0 disables fault-around.
+ */
+int sysctl_fault_around_pages __read_mostly = 16;
+
+/*
+ * Map the already cached neighbours of a file page that was just
+ * faulted in, so that sequential touches of text and dex mappings do
+ * not take one minor fault per page. Only pages that are uptodate,
+ * not under readahead and can be locked without sleeping are mapped;
+ * anything else is left to the regular fault path.
+ */
+static void do_fault_around(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pmd_t *pmd)
+{
+	struct address_space *mapping;
+	unsigned long nr = sysctl_fault_around_pages;
+	unsigned long start, end, addr;
+	pgoff_t pgoff, max_pgoff;
+	pte_t *page_table, *pte;
+	spinlock_t *ptl;
+	int mapped = 0, skipped = 0;
+
+	if (nr <= 1 || !vma->vm_file || vma->vm_ops->fault != filemap_fault)
+		return;
+	if (vma->vm_flags & (VM_LOCKED | VM_NONLINEAR))
+		return;
+
+	address &= PAGE_MASK;
+	start = address - ((address >> PAGE_SHIFT) % nr) * PAGE_SIZE;
+	end = start + nr * PAGE_SIZE;
+	if (end < start)	/* window wrapped past the top of memory */
+		end = vma->vm_end;
+	start = max(start, max(vma->vm_start, address & PMD_MASK));
+	end = min(end, min(vma->vm_end, (address & PMD_MASK) + PMD_SIZE));
+
+	mapping = vma->vm_file->f_mapping;
+	max_pgoff = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1) >>
+			PAGE_CACHE_SHIFT;
+	pgoff = ((start - vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+
+	page_table = pte_offset_map_lock(mm, pmd, start, &ptl);
+	for (addr = start, pte = page_table; addr < end;
+			addr += PAGE_SIZE, pte++, pgoff++) {
+		struct page *page;
+		pte_t entry;
+
+		if (addr == address || !pte_none(*pte))
+			continue;
+		if (pgoff >= max_pgoff)
+			break;
+
+		page = find_get_page(mapping, pgoff);
+		if (!page) {
+			skipped++;
+			continue;
+		}
+		if (!PageUptodate(page) || PageReadahead(page) ||
+		    PageHWPoison(page) || !trylock_page(page))
+			goto skip;
+		/* Recheck under the page lock: truncate may have raced */
+		if (page->mapping != mapping || !PageUptodate(page))
+			goto skip_unlock;
+
+		flush_icache_page(vma, page);
+		entry = mk_pte(page, vma->vm_page_prot);
+		inc_mm_counter(mm, file_rss);
+		page_add_file_rmap(page);
+		set_pte_at(mm, addr, pte, entry);
+		update_mmu_cache(vma, addr, entry);
+		unlock_page(page);
+		/* the find_get_page() reference now belongs to the pte */
+		mapped++;
+		continue;
+skip_unlock:
+		unlock_page(page);
+skip:
+		page_cache_release(page);
+		skipped++;
+	}
+	pte_unmap_unlock(page_table, ptl);
+
+	if (mapped)
+		count_vm_events(PGFAULTAROUND, mapped);
+	if (skipped)
+		count_vm_events(PGFAULTAROUND_SKIP, skipped);
+}
+
 static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
 		unsigned int flags, pte_t orig_pte)
@@ -2929,8 +3330,13 @@ static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
 
+	int ret;
+
 	pte_unmap(page_table);
-	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
+	ret = __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
+	if (!(flags & FAULT_FLAG_WRITE) && !(ret & VM_FAULT_ERROR))
+		do_fault_around(mm, vma, address, pmd);
+	return ret;
 }
 
 /*
@@ -3056,6 +3462,10 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
+	if (unlikely(pmd_present(*pmd) && pte_table_shared(pmd)) &&
+	    unshare_pte_range(vma, address & PAGE_MASK,
+			      (address & PAGE_MASK) + PAGE_SIZE))
+		return VM_FAULT_OOM;
 	pte = pte_alloc_map(mm, pmd, address);
 	if (!pte)
 		return VM_FAULT_OOM;
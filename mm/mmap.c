@@ -1841,6 +1841,10 @@ int split_vma(struct mm_struct * mm, struct vm_area_struct * vma,
 	if (mm->map_count >= sysctl_max_map_count)
 		return -ENOMEM;
 
+	/* A page table shared by lazy fork must stay inside one vma */
+	if ((addr & ~PMD_MASK) && unshare_pte_range(vma, addr, addr + 1))
+		return -ENOMEM;
+
 	new = kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 	if (!new)
 		return -ENOMEM;
@@ -747,12 +747,27 @@ struct page *__rmqueue_smallest(struct zone *zone, unsigned int order,
  * This array describes the order lists are fallen back to when
  * the free lists for the desirable migrate type are depleted
  */
+#ifdef CONFIG_LENDABLE_MEMORY
+/*
+ * Only movable allocations may borrow lendable pages, and they do so before
+ * stealing blocks of another type: the pages can be migrated away again
+ * when the owner of the region wants it back.
+ */
+static int fallbacks[MIGRATE_TYPES][MIGRATE_TYPES-1] = {
+	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,     MIGRATE_RESERVE,   MIGRATE_RESERVE, MIGRATE_RESERVE },
+	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,     MIGRATE_RESERVE,   MIGRATE_RESERVE, MIGRATE_RESERVE },
+	[MIGRATE_MOVABLE]     = { MIGRATE_LENDABLE,    MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE, MIGRATE_RESERVE },
+	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE,     MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE, MIGRATE_RESERVE }, /* Never used */
+	[MIGRATE_LENDABLE]    = { MIGRATE_RESERVE,     MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE, MIGRATE_RESERVE }, /* Never used */
+};
+#else
 static int fallbacks[MIGRATE_TYPES][MIGRATE_TYPES-1] = {
 	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,   MIGRATE_RESERVE },
 	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,   MIGRATE_RESERVE },
 	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
 	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE }, /* Never used */
 };
+#endif
 
 /*
  * Move the free pages in a range to the free lists of the requested type.
@@ -866,11 +881,13 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			 * If breaking a large block of pages, move all free
 			 * pages to the preferred allocation list. If falling
 			 * back for a reclaimable kernel allocation, be more
-			 * agressive about taking ownership of free pages
+			 * agressive about taking ownership of free pages.
+			 * Lendable blocks are only borrowed, never taken over.
 			 */
-			if (unlikely(current_order >= (pageblock_order >> 1)) ||
+			if (!is_migrate_lendable(migratetype) &&
+			    (unlikely(current_order >= (pageblock_order >> 1)) ||
 					start_migratetype == MIGRATE_RECLAIMABLE ||
-					page_group_by_mobility_disabled) {
+					page_group_by_mobility_disabled)) {
 				unsigned long pages;
 				pages = move_freepages_block(zone, page,
 								start_migratetype);
@@ -889,7 +906,8 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			rmv_page_order(page);
 
 			/* Take ownership for orders >= pageblock_order */
-			if (current_order >= pageblock_order)
+			if (current_order >= pageblock_order &&
+			    !is_migrate_lendable(migratetype))
 				change_pageblock_range(page, current_order,
 							start_migratetype);
 
@@ -965,7 +983,13 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			list_add(&page->lru, list);
 		else
 			list_add_tail(&page->lru, list);
-		set_page_private(page, migratetype);
+#ifdef CONFIG_LENDABLE_MEMORY
+		/* borrowed pages go back to the lendable lists if drained */
+		if (is_migrate_lendable(get_pageblock_migratetype(page)))
+			set_page_private(page, MIGRATE_LENDABLE);
+		else
+#endif
+			set_page_private(page, migratetype);
 		list = &page->lru;
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
@@ -5042,6 +5066,7 @@ int set_migratetype_isolate(struct page *page)
 	 * In future, more migrate types will be able to be isolation target.
 	 */
 	if (get_pageblock_migratetype(page) != MIGRATE_MOVABLE &&
+	    !is_migrate_lendable(get_pageblock_migratetype(page)) &&
 	    zone_idx != ZONE_MOVABLE)
 		goto out;
 	set_pageblock_migratetype(page, MIGRATE_ISOLATE);
@@ -5068,6 +5093,68 @@ out:
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
 
+#ifdef CONFIG_LENDABLE_MEMORY
+/*
+ * Hand a movable or isolated pageblock to the lendable free lists. Only
+ * movable allocations are served from it afterwards.
+ */
+int set_migratetype_lendable(struct page *page)
+{
+	struct zone *zone;
+	unsigned long flags;
+	int migratetype;
+	int ret = -EBUSY;
+
+	zone = page_zone(page);
+	spin_lock_irqsave(&zone->lock, flags);
+	migratetype = get_pageblock_migratetype(page);
+	if (migratetype != MIGRATE_MOVABLE && migratetype != MIGRATE_ISOLATE &&
+	    migratetype != MIGRATE_LENDABLE)
+		goto out;
+	set_pageblock_migratetype(page, MIGRATE_LENDABLE);
+	move_freepages_block(zone, page, MIGRATE_LENDABLE);
+	ret = 0;
+out:
+	spin_unlock_irqrestore(&zone->lock, flags);
+	return ret;
+}
+
+/*
+ * Take the free pages of an isolated range out of the buddy allocator.
+ * The pages are left with a zero count. Returns -EBUSY without touching
+ * anything if a page in the range is still in use.
+ */
+int take_isolated_page_range(unsigned long start_pfn, unsigned long end_pfn)
+{
+	struct page *page;
+	struct zone *zone;
+	unsigned long pfn;
+	unsigned long flags;
+	int order;
+	int ret = -EBUSY;
+
+	zone = page_zone(pfn_to_page(start_pfn));
+	spin_lock_irqsave(&zone->lock, flags);
+	for (pfn = start_pfn; pfn < end_pfn; pfn += 1 << page_order(page)) {
+		page = pfn_to_page(pfn);
+		if (!PageBuddy(page))
+			goto out;
+	}
+	for (pfn = start_pfn; pfn < end_pfn; pfn += 1 << order) {
+		page = pfn_to_page(pfn);
+		order = page_order(page);
+		list_del(&page->lru);
+		rmv_page_order(page);
+		zone->free_area[order].nr_free--;
+		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+	}
+	ret = 0;
+out:
+	spin_unlock_irqrestore(&zone->lock, flags);
+	return ret;
+}
+#endif
+
 #ifdef CONFIG_MEMORY_HOTREMOVE
 /*
  * All pages in the range must be isolated before calling this.
@@ -398,6 +398,9 @@ static char * const migratetype_names[MIGRATE_TYPES] = {
 	"Reclaimable",
 	"Movable",
 	"Reserve",
+#ifdef CONFIG_LENDABLE_MEMORY
+	"Lendable",
+#endif
 	"Isolate",
 };
 
@@ -683,6 +686,8 @@ static const char * const vmstat_text[] = {
 
 	"pgfault",
 	"pgmajfault",
+	"pgfaultaround",
+	"pgfaultaround_skip",
 
 	TEXTS_FOR_ZONES("pgrefill")
 	TEXTS_FOR_ZONES("pgsteal")
@@ -700,6 +705,8 @@ static const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"workingset_refault",
+	"workingset_activate",
 #ifdef CONFIG_HUGETLB_PAGE
 	"htlb_buddy_alloc_success",
 	"htlb_buddy_alloc_fail",
@@ -712,6 +719,18 @@ static const char * const vmstat_text[] = {
 	"unevictable_pgs_cleared",
 	"unevictable_pgs_stranded",
 	"unevictable_pgs_mlockfreed",
+#ifdef CONFIG_HIGHMEM
+	"kmap_high",
+	"kmap_high_new",
+	"pkmap_flush",
+	"pkmap_wait",
+	"kmap_atomic",
+	"kmap_atomic_cached",
+#endif
+#ifdef CONFIG_LAZY_FORK
+	"lazyfork_pte_shared",
+	"lazyfork_pte_unshared",
+#endif
 #endif
 };
 
@@ -0,0 +1,157 @@
+/*
+ * mm/workingset.c - detect thrashing of the page cache working set
+ *
+ * Every file page evicted by reclaim leaves a note of the zone's
+ * inactive age (evictions plus activations so far) in a table of
+ * non-resident pages. When the page is read back in, the difference
+ * between the age then and now is its refault distance: the number of
+ * inactive list slots it would have needed on top of what it had. If
+ * that fits in the active list the page was only lost because the
+ * inactive list is too short for it, so it goes straight to the active
+ * list instead of competing for another round on the inactive one.
+ *
+ * The table is direct mapped and lockless. A collision drops the older
+ * note and a torn update misjudges one page; either way the page is
+ * only treated as a first-time reference.
+ */
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/swap.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/vmalloc.h>
+#include <linux/vmstat.h>
+#include <linux/log2.h>
+
+#define EVICTION_SHIFT	(NODES_SHIFT + ZONES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+struct nonresident {
+	/* hash of mapping and index, 0 if free */
+	unsigned long key;
+	/* inactive age at eviction, node and zone */
+	unsigned long eviction;
+};
+
+static struct nonresident *nonres_table;
+static unsigned int nonres_bits;
+
+static unsigned long nonres_key(struct address_space *mapping, pgoff_t index)
+{
+	unsigned long key;
+
+	key = hash_long((unsigned long)mapping ^ hash_long(index, BITS_PER_LONG),
+			BITS_PER_LONG);
+	return key | 1;
+}
+
+static inline struct nonresident *nonres_slot(unsigned long key)
+{
+	return &nonres_table[key >> (BITS_PER_LONG - nonres_bits)];
+}
+
+static unsigned long pack_eviction(struct zone *zone)
+{
+	unsigned long eviction = atomic_long_read(&zone->inactive_age);
+
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	return eviction;
+}
+
+static struct zone *unpack_eviction(unsigned long eviction,
+				    unsigned long *age)
+{
+	int zid = eviction & ((1UL << ZONES_SHIFT) - 1);
+	int nid;
+
+	eviction >>= ZONES_SHIFT;
+	nid = eviction & ((1UL << NODES_SHIFT) - 1);
+	*age = eviction >> NODES_SHIFT;
+	return NODE_DATA(nid)->node_zones + zid;
+}
+
+/*
+ * Reclaim is dropping a clean file page from the page cache.
+ */
+void workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	struct nonresident *nr;
+	unsigned long key;
+
+	atomic_long_inc(&zone->inactive_age);
+	if (!nonres_table)
+		return;
+
+	key = nonres_key(mapping, page->index);
+	nr = nonres_slot(key);
+	nr->eviction = pack_eviction(zone);
+	nr->key = key;
+}
+
+/*
+ * A file page is being added to the page cache. Return true if it was
+ * evicted recently enough that it belongs on the active list.
+ */
+bool workingset_refault(struct address_space *mapping, pgoff_t index)
+{
+	struct nonresident *nr;
+	struct zone *zone;
+	unsigned long key, eviction, age, distance;
+
+	if (!nonres_table)
+		return false;
+
+	key = nonres_key(mapping, index);
+	nr = nonres_slot(key);
+	if (nr->key != key)
+		return false;
+
+	eviction = nr->eviction;
+	nr->key = 0;
+
+	zone = unpack_eviction(eviction, &age);
+	distance = (atomic_long_read(&zone->inactive_age) - age) & EVICTION_MASK;
+	count_vm_event(WORKINGSET_REFAULT);
+
+	if (distance > zone_page_state(zone, NR_ACTIVE_FILE))
+		return false;
+
+	count_vm_event(WORKINGSET_ACTIVATE);
+	atomic_long_inc(&zone->inactive_age);
+	return true;
+}
+
+/*
+ * A file page moved from the inactive to the active list.
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/*
+ * One note for every four pages of memory: the active file list rarely
+ * grows past half of memory, and notes older than that are useless.
+ */
+static int __init workingset_init(void)
+{
+	unsigned long entries = rounddown_pow_of_two(max(totalram_pages / 4,
+							  1024UL));
+	struct nonresident *table;
+
+	table = vmalloc(entries * sizeof(*table));
+	if (!table) {
+		printk(KERN_WARNING "workingset: no memory for %lu entries\n",
+		       entries);
+		return -ENOMEM;
+	}
+	memset(table, 0, entries * sizeof(*table));
+	nonres_bits = ilog2(entries);
+	/* publish the size before the table */
+	smp_wmb();
+	nonres_table = table;
+	return 0;
+}
+module_init(workingset_init);
@@ -0,0 +1,432 @@
+/*
+ * Forwarding fast path for established NAT flows.
+ *
+ * Tethering forwards every packet through the whole netfilter stack: the
+ * conntrack lookup, the mangle/nat/filter tables in three hooks and the
+ * NAT rewrite. Once a forwarded TCP or UDP connection is assured and NATed
+ * nothing of that changes the outcome any more, so the first packets of
+ * each direction leave the result in a small flow cache on their way out
+ * (POST_ROUTING, after SNAT) and the following packets of that direction
+ * are rewritten and handed to the output device straight from PRE_ROUTING.
+ *
+ * Anything unusual goes the slow way: fragments, IP options, TCP SYN, FIN
+ * and RST (so conntrack still sees the connection close), flows with a
+ * helper or sequence adjustment, packets larger than the path MTU, and
+ * flows whose route or conntrack entry went away.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/types.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <linux/jhash.h>
+#include <linux/netdevice.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter_ipv4.h>
+#include <linux/module.h>
+#include <linux/skbuff.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <net/ip.h>
+#include <net/dst.h>
+#include <net/neighbour.h>
+#include <net/checksum.h>
+
+#include <net/netfilter/nf_conntrack.h>
+#include <net/netfilter/nf_conntrack_core.h>
+#include <net/netfilter/nf_conntrack_helper.h>
+
+#define FP_HASH_BITS	8
+#define FP_HASH_SIZE	(1 << FP_HASH_BITS)
+
+static int enable = 1;
+module_param(enable, bool, 0644);
+MODULE_PARM_DESC(enable, "forward established NAT flows past the tables");
+
+struct fp_flow {
+	struct rcu_head rcu;
+
+	/* what the packet looks like when it comes in */
+	__be32 saddr, daddr;
+	__be16 sport, dport;
+	u8 protonum;
+	int iif;
+
+	/* and when it goes out */
+	__be32 new_saddr, new_daddr;
+	__be16 new_sport, new_dport;
+
+	struct nf_conn *ct;
+	enum ip_conntrack_info ctinfo;
+	unsigned long timeout;
+	struct dst_entry *dst;
+};
+
+static struct fp_flow *fp_table[FP_HASH_SIZE];
+static DEFINE_SPINLOCK(fp_lock);
+
+static struct {
+	unsigned long hit;
+	unsigned long miss;
+	unsigned long added;
+	unsigned long evicted;
+} fp_stats;
+
+static inline unsigned int fp_hash(__be32 saddr, __be32 daddr,
+				   __be16 sport, __be16 dport, u8 protonum)
+{
+	return jhash_3words((__force u32)saddr,
+			    (__force u32)daddr ^ protonum,
+			    ((__force u32)sport << 16) | (__force u32)dport,
+			    0) & (FP_HASH_SIZE - 1);
+}
+
+static void fp_flow_free_rcu(struct rcu_head *head)
+{
+	struct fp_flow *f = container_of(head, struct fp_flow, rcu);
+
+	nf_ct_put(f->ct);
+	dst_release(f->dst);
+	kfree(f);
+}
+
+/* caller holds fp_lock */
+static void __fp_evict(unsigned int hash)
+{
+	struct fp_flow *f = fp_table[hash];
+
+	if (!f)
+		return;
+	rcu_assign_pointer(fp_table[hash], NULL);
+	call_rcu(&f->rcu, fp_flow_free_rcu);
+	fp_stats.evicted++;
+}
+
+static void fp_evict(struct fp_flow *f)
+{
+	unsigned int hash = fp_hash(f->saddr, f->daddr, f->sport, f->dport,
+				    f->protonum);
+
+	spin_lock_bh(&fp_lock);
+	if (fp_table[hash] == f)
+		__fp_evict(hash);
+	spin_unlock_bh(&fp_lock);
+}
+
+static void fp_flush(void)
+{
+	unsigned int i;
+
+	spin_lock_bh(&fp_lock);
+	for (i = 0; i < FP_HASH_SIZE; i++)
+		__fp_evict(i);
+	spin_unlock_bh(&fp_lock);
+}
+
+static int fp_xmit(struct sk_buff *skb)
+{
+	struct dst_entry *dst = skb_dst(skb);
+
+	if (dst->hh)
+		return neigh_hh_output(dst->hh, skb);
+	else if (dst->neighbour)
+		return dst->neighbour->output(skb);
+
+	kfree_skb(skb);
+	return -EINVAL;
+}
+
+static unsigned int fp_in(unsigned int hooknum,
+			  struct sk_buff *skb,
+			  const struct net_device *in,
+			  const struct net_device *out,
+			  int (*okfn)(struct sk_buff *))
+{
+	struct iphdr *iph = ip_hdr(skb);
+	struct fp_flow *f;
+	struct dst_entry *dst;
+	__be16 *ports;
+	__sum16 *check;
+	unsigned int l4len;
+
+	if (!enable || skb->pkt_type != PACKET_HOST || skb_is_gso(skb))
+		return NF_ACCEPT;
+	if (iph->ihl != 5 || iph->ttl <= 1 ||
+	    (iph->frag_off & htons(IP_MF | IP_OFFSET)))
+		return NF_ACCEPT;
+
+	if (iph->protocol == IPPROTO_TCP)
+		l4len = sizeof(struct tcphdr);
+	else if (iph->protocol == IPPROTO_UDP)
+		l4len = sizeof(struct udphdr);
+	else
+		return NF_ACCEPT;
+	if (!pskb_may_pull(skb, sizeof(*iph) + l4len))
+		return NF_ACCEPT;
+	iph = ip_hdr(skb);
+	ports = (__be16 *)(iph + 1);
+
+	if (iph->protocol == IPPROTO_TCP) {
+		struct tcphdr *th = (struct tcphdr *)ports;
+
+		/* connection state changes are for conntrack to see */
+		if (th->syn || th->fin || th->rst)
+			return NF_ACCEPT;
+	}
+
+	f = rcu_dereference(fp_table[fp_hash(iph->saddr, iph->daddr,
+					     ports[0], ports[1],
+					     iph->protocol)]);
+	if (!f || f->saddr != iph->saddr || f->daddr != iph->daddr ||
+	    f->sport != ports[0] || f->dport != ports[1] ||
+	    f->protonum != iph->protocol || f->iif != in->ifindex) {
+		fp_stats.miss++;
+		return NF_ACCEPT;
+	}
+
+	dst = f->dst;
+	if (nf_ct_is_dying(f->ct) || dst->obsolete ||
+	    !(dst->dev->flags & IFF_UP)) {
+		fp_evict(f);
+		return NF_ACCEPT;
+	}
+	/* let the slow path send the ICMP */
+	if (skb->len > dst_mtu(dst))
+		return NF_ACCEPT;
+
+	if (skb_cow(skb, LL_RESERVED_SPACE(dst->dev)))
+		return NF_ACCEPT;
+	iph = ip_hdr(skb);
+	ports = (__be16 *)(iph + 1);
+	if (iph->protocol == IPPROTO_TCP)
+		check = &((struct tcphdr *)ports)->check;
+	else
+		check = &((struct udphdr *)ports)->check;
+
+	/* a zero udp checksum means there is none */
+	if (iph->protocol == IPPROTO_TCP || *check) {
+		inet_proto_csum_replace4(check, skb, iph->saddr,
+					 f->new_saddr, 1);
+		inet_proto_csum_replace4(check, skb, iph->daddr,
+					 f->new_daddr, 1);
+		inet_proto_csum_replace2(check, skb, ports[0],
+					 f->new_sport, 0);
+		inet_proto_csum_replace2(check, skb, ports[1],
+					 f->new_dport, 0);
+		if (iph->protocol == IPPROTO_UDP && !*check)
+			*check = CSUM_MANGLED_0;
+	}
+	csum_replace4(&iph->check, iph->saddr, f->new_saddr);
+	csum_replace4(&iph->check, iph->daddr, f->new_daddr);
+	iph->saddr = f->new_saddr;
+	iph->daddr = f->new_daddr;
+	ports[0] = f->new_sport;
+	ports[1] = f->new_dport;
+	ip_decrease_ttl(iph);
+
+	nf_ct_refresh_acct(f->ct, f->ctinfo, skb, f->timeout);
+	fp_stats.hit++;
+
+	skb_dst_drop(skb);
+	skb_dst_set(skb, dst_clone(dst));
+	skb->dev = dst->dev;
+	skb->protocol = htons(ETH_P_IP);
+	IP_INC_STATS_BH(dev_net(dst->dev), IPSTATS_MIB_OUTFORWDATAGRAMS);
+	fp_xmit(skb);
+	return NF_STOLEN;
+}
+
+static unsigned int fp_out(unsigned int hooknum,
+			   struct sk_buff *skb,
+			   const struct net_device *in,
+			   const struct net_device *out,
+			   int (*okfn)(struct sk_buff *))
+{
+	const struct nf_conntrack_tuple *t;
+	enum ip_conntrack_info ctinfo;
+	struct nf_conn_help *help;
+	struct fp_flow *f, *old;
+	struct dst_entry *dst;
+	struct nf_conn *ct;
+	struct iphdr *iph;
+	__be16 *ports;
+	unsigned int hash;
+	long timeout;
+
+	/* only forwarded packets, locally generated ones have no iif */
+	if (!enable || !skb->iif)
+		return NF_ACCEPT;
+
+	ct = nf_ct_get(skb, &ctinfo);
+	if (!ct || (ctinfo != IP_CT_ESTABLISHED &&
+		    ctinfo != IP_CT_ESTABLISHED + IP_CT_IS_REPLY))
+		return NF_ACCEPT;
+	if (!test_bit(IPS_ASSURED_BIT, &ct->status) ||
+	    !(ct->status & IPS_NAT_MASK) ||
+	    test_bit(IPS_SEQ_ADJUST_BIT, &ct->status))
+		return NF_ACCEPT;
+	help = nfct_help(ct);
+	if (help && help->helper)
+		return NF_ACCEPT;
+
+	iph = ip_hdr(skb);
+	if (iph->ihl != 5 || (iph->frag_off & htons(IP_MF | IP_OFFSET)))
+		return NF_ACCEPT;
+	if (iph->protocol != IPPROTO_TCP && iph->protocol != IPPROTO_UDP)
+		return NF_ACCEPT;
+
+	dst = skb_dst(skb);
+	if (!dst || dst->obsolete)
+		return NF_ACCEPT;
+#ifdef CONFIG_XFRM
+	if (dst->xfrm)
+		return NF_ACCEPT;
+#endif
+
+	timeout = (long)(ct->timeout.expires - jiffies);
+	if (timeout <= 0)
+		return NF_ACCEPT;
+
+	/* the tuple of this direction is the packet before NAT */
+	t = &ct->tuplehash[CTINFO2DIR(ctinfo)].tuple;
+	hash = fp_hash(t->src.u3.ip, t->dst.u3.ip, t->src.u.all,
+		       t->dst.u.all, t->dst.protonum);
+	old = rcu_dereference(fp_table[hash]);
+	if (old && old->ct == ct && old->dst == dst &&
+	    old->ctinfo == ctinfo && old->iif == skb->iif)
+		return NF_ACCEPT;
+
+	if (skb_headlen(skb) < sizeof(*iph) + 2 * sizeof(__be16))
+		return NF_ACCEPT;
+	ports = (__be16 *)(iph + 1);
+
+	f = kmalloc(sizeof(*f), GFP_ATOMIC);
+	if (!f)
+		return NF_ACCEPT;
+	f->saddr = t->src.u3.ip;
+	f->daddr = t->dst.u3.ip;
+	f->sport = t->src.u.all;
+	f->dport = t->dst.u.all;
+	f->protonum = t->dst.protonum;
+	f->iif = skb->iif;
+	f->new_saddr = iph->saddr;
+	f->new_daddr = iph->daddr;
+	f->new_sport = ports[0];
+	f->new_dport = ports[1];
+	f->ctinfo = ctinfo;
+	f->timeout = timeout;
+	nf_conntrack_get(&ct->ct_general);
+	f->ct = ct;
+	f->dst = dst_clone(dst);
+
+	/* conntrack won't see the window move any more */
+	if (f->protonum == IPPROTO_TCP) {
+		spin_lock_bh(&ct->lock);
+		ct->proto.tcp.seen[0].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+		ct->proto.tcp.seen[1].flags |= IP_CT_TCP_FLAG_BE_LIBERAL;
+		spin_unlock_bh(&ct->lock);
+	}
+
+	spin_lock_bh(&fp_lock);
+	__fp_evict(hash);
+	rcu_assign_pointer(fp_table[hash], f);
+	fp_stats.added++;
+	spin_unlock_bh(&fp_lock);
+
+	return NF_ACCEPT;
+}
+
+static struct nf_hook_ops fp_ops[] __read_mostly = {
+	{
+		.hook		= fp_in,
+		.owner		= THIS_MODULE,
+		.pf		= NFPROTO_IPV4,
+		.hooknum	= NF_INET_PRE_ROUTING,
+		.priority	= NF_IP_PRI_FIRST,
+	},
+	{
+		.hook		= fp_out,
+		.owner		= THIS_MODULE,
+		.pf		= NFPROTO_IPV4,
+		.hooknum	= NF_INET_POST_ROUTING,
+		.priority	= NF_IP_PRI_NAT_SRC + 1,
+	},
+};
+
+/* the cached routes pin their devices */
+static int fp_netdev_event(struct notifier_block *this, unsigned long event,
+			   void *ptr)
+{
+	if (event == NETDEV_DOWN || event == NETDEV_UNREGISTER)
+		fp_flush();
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block fp_netdev_notifier = {
+	.notifier_call = fp_netdev_event,
+};
+
+static int fp_stats_show(struct seq_file *m, void *v)
+{
+	unsigned int i, n = 0;
+
+	rcu_read_lock();
+	for (i = 0; i < FP_HASH_SIZE; i++)
+		if (rcu_dereference(fp_table[i]))
+			n++;
+	rcu_read_unlock();
+
+	seq_printf(m, "flows %u/%u hit %lu miss %lu added %lu evicted %lu\n",
+		   n, FP_HASH_SIZE, fp_stats.hit, fp_stats.miss,
+		   fp_stats.added, fp_stats.evicted);
+	return 0;
+}
+
+static int fp_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fp_stats_show, NULL);
+}
+
+static const struct file_operations fp_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= fp_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init nf_nat_fastpath_init(void)
+{
+	int ret;
+
+	ret = register_netdevice_notifier(&fp_netdev_notifier);
+	if (ret < 0)
+		return ret;
+	ret = nf_register_hooks(fp_ops, ARRAY_SIZE(fp_ops));
+	if (ret < 0) {
+		unregister_netdevice_notifier(&fp_netdev_notifier);
+		return ret;
+	}
+	proc_create("nf_nat_fastpath", S_IRUGO, init_net.proc_net_stat,
+		    &fp_stats_fops);
+	return 0;
+}
+
+static void __exit nf_nat_fastpath_fini(void)
+{
+	remove_proc_entry("nf_nat_fastpath", init_net.proc_net_stat);
+	nf_unregister_hooks(fp_ops, ARRAY_SIZE(fp_ops));
+	unregister_netdevice_notifier(&fp_netdev_notifier);
+	fp_flush();
+	rcu_barrier();
+}
+
+module_init(nf_nat_fastpath_init);
+module_exit(nf_nat_fastpath_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("forwarding fast path for established NAT flows");
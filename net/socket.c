@@ -576,8 +576,12 @@ static inline int __sock_sendmsg(struct kiocb *iocb, struct socket *sock,
 
 	err = sock->ops->sendmsg(iocb, sock, msg, size);
 #ifdef CONFIG_UID_STAT
-	if (err > 0)
-		update_tcp_snd(current_uid(), err);
+	if (err > 0) {
+		if (sock->type == SOCK_DGRAM)
+			update_udp_snd(current_uid(), err);
+		else
+			update_tcp_snd(current_uid(), err);
+	}
 #endif
 	return err;
 }
@@ -695,8 +699,12 @@ static inline int __sock_recvmsg(struct kiocb *iocb, struct socket *sock,
 
 	err = sock->ops->recvmsg(iocb, sock, msg, size, flags);
 #ifdef CONFIG_UID_STAT
-	if (err > 0)
-		update_tcp_rcv(current_uid(), err);
+	if (err > 0) {
+		if (sock->type == SOCK_DGRAM)
+			update_udp_rcv(current_uid(), err);
+		else
+			update_tcp_rcv(current_uid(), err);
+	}
 #endif
 	return err;
 }